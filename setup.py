@@ -106,6 +106,14 @@ fftw3_libraries = ['fftw3']
 if 'libraries' in system_info.get_info('fftw3').keys():
     fftw3_libraries = system_info.get_info('fftw3')['libraries']
 
+# zlib decompresses chunks of hdf5 files in parallel:
+zlib_libraries = ['z']
+
+# shm_open() is in librt on older Linux systems:
+rt_libraries = []
+if 'linux' in sys.platform:
+    rt_libraries = ['rt']
+
 if os.name == "nt":
     win_define_macros = [("_WINDOWS", None),
                          ("__STF__", None),
@@ -132,6 +140,7 @@ if os.name == "nt":
         os.path.join(home_dir, 'fftw'),
     ]
     fftw3_libraries = ['libfftw3-3']
+    zlib_libraries = ['zlib']
     np_libraries = ['BLAS', 'clapack', 'libf2c']
     win_libraries = ['user32']
     win_link_args = ["/SUBSYSTEM:WINDOWS",
@@ -161,8 +170,8 @@ stfio_module = Extension(
     '_stfio',
     swig_opts=['-c++'],
     library_dirs=win_library_dirs,
-    libraries=['hdf5', 'hdf5_hl'] + fftw3_libraries + np_libraries +
-    biosig_libraries + win_libraries,
+    libraries=['hdf5', 'hdf5_hl'] + zlib_libraries + fftw3_libraries + np_libraries +
+    biosig_libraries + rt_libraries + win_libraries,
     define_macros=np_define_macros + biosig_define_macros +
     win_define_macros,
     extra_compile_args=np_extra_compile_args + hdf5_extra_compile_args +
@@ -189,6 +198,7 @@ stfio_module = Extension(
         'src/libstfio/abf/axon2/ProtocolReaderABF2.cpp',
         'src/libstfio/abf/axon2/SimpleStringCache.cpp',
         'src/libstfio/abf/axon2/abf2headr.cpp',
+        'src/libstfio/ascii/asciilib.cpp',
         'src/libstfio/atf/atflib.cpp',
         'src/libstfio/axg/AxoGraph_ReadWrite.cpp',
         'src/libstfio/axg/axglib.cpp',
@@ -200,23 +210,60 @@ stfio_module = Extension(
         'src/libstfio/cfs/cfslib.cpp',
         'src/libstfio/channel.cpp',
         'src/libstfio/hdf5/hdf5lib.cpp',
+        'src/libstfio/hdf5/ephyscodec.cpp',
         'src/libstfio/igor/CrossPlatformFileIO.c',
         'src/libstfio/igor/WriteWave.c',
         'src/libstfio/igor/igorlib.cpp',
 	'src/libstfio/intan/common.cpp',
 	'src/libstfio/intan/intanlib.cpp',
 	'src/libstfio/intan/streams.cpp',
+        'src/libstfio/tdms/tdmslib.cpp',
+        'src/libstfio/nwb/nwblib.cpp',
+        'src/libstfio/zarr/zarrlib.cpp',
+        'src/libstfio/son/sonlib.cpp',
         'src/libstfio/recording.cpp',
+        'src/libstfio/mappedfile.cpp',
+        'src/libstfio/accumulator.cpp',
+        'src/libstfio/fitcache.cpp',
+        'src/libstfio/bytestream.cpp',
+        'src/libstfio/sidecar.cpp',
+        'src/libstfio/sharedrecording.cpp',
+        'src/libstfio/folderwatch.cpp',
+        'src/libstfio/online.cpp',
+        'src/libstfio/memory.cpp',
+        'src/libstfio/parallel.cpp',
+        'src/libstfio/history.cpp',
+        'src/libstfio/snapshot.cpp',
+        'src/libstfio/textwriter.cpp',
+        'src/libstfio/tablestream.cpp',
+        'src/libstfio/parquet.cpp',
+        'src/libstfio/profile.cpp',
+        'src/libstfio/scratch.cpp',
+        'src/libstfio/synth.cpp',
         'src/libstfio/section.cpp',
         'src/libstfio/stfio.cpp',
+        'src/libstfnum/derived.cpp',
+        'src/libstfnum/events.cpp',
+        'src/libstfnum/eventstats.cpp',
         'src/libstfnum/fit.cpp',
         'src/libstfnum/funclib.cpp',
+        'src/libstfnum/gpu.cpp',
         'src/libstfnum/levmar/Axb.c',
         'src/libstfnum/levmar/lm.c',
         'src/libstfnum/levmar/lmbc.c',
         'src/libstfnum/levmar/misc.c',
         'src/libstfnum/measure.cpp',
+        'src/libstfnum/noise.cpp',
+        'src/libstfnum/train.cpp',
+        'src/libstfnum/density.cpp',
+        'src/libstfnum/plugin.cpp',
+        'src/libstfnum/arrowtable.cpp',
+        'src/libstfnum/spectrum.cpp',
+        'src/libstfnum/align.cpp',
+        'src/libstfnum/pipeline.cpp',
+        'src/libstfnum/spikes.cpp',
         'src/libstfnum/stfnum.cpp',
+        'src/libstfnum/tdfilter.cpp',
         'src/pystfio/pystfio.cxx',
         'src/pystfio/pystfio.i',
     ] + biosig_lite_sources)
@@ -12447,6 +12447,13 @@ size_t sread_raw(size_t start, size_t length, HDRTYPE* hdr, char flag, void *buf
 			hdr->AS.first = start;
 			hdr->AS.length= count;
 		}
+		else {
+			// hdr->AS.rawdata holds the blocks that have just been read;
+			// sread() relies on hdr->AS.first to find them
+			hdr->AS.flag_collapsed_rawdata = 0;
+			hdr->AS.first = start;
+			hdr->AS.length= count;
+		}
 
 		if (count < nelem) {
 			fprintf(stderr,"warning: less than the number of requested blocks read (%i/%i) from file %s - something went wrong\n",(int)count,(int)nelem,hdr->FileName);
@@ -18,6 +18,11 @@
 #include <iomanip>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #if !defined(_MSC_VER) || defined(__STF__)
 #include "./axon/Common/axodefn.h"
@@ -27,6 +32,7 @@
 
 #include "./abflib.h"
 #include "../recording.h"
+#include "../parallel.h"
 
 namespace stfio {
 
@@ -43,6 +49,243 @@ std::string stfio::ABF1Error(const std::string& fName, int nError) {
     return std::string( &errorMsg[0] );
 }
 
+namespace {
+
+// Mapped gapfree data are split into sections of at most this many samples
+// per channel, so that reading a whole section never decodes more than a
+// bounded part of the file:
+const std::size_t gapfreeSectionSize = (std::size_t)1 << 22;
+
+// Where and how the multiplexed episodes of an ABF file are stored.
+struct ABFEpisodeLayout {
+    bool intData;
+    // position of each channel in the sampling sequence:
+    std::vector<UINT> chOffset;
+    // conversion of integer samples to user units:
+    std::vector<float> chFactor, chShift;
+    // start of each episode in bytes, and its length in samples per channel:
+    std::vector<std::size_t> epOffset, epSize;
+};
+
+// Scatters the interleaved samples of an episode to all channels at once.
+template <typename T>
+void deinterleave(const T* src, std::size_t n_samples, const std::vector<UINT>& chOffset,
+                  std::vector<std::vector<T> >& samples)
+{
+    std::size_t numberChannels = chOffset.size();
+    samples.resize(numberChannels);
+    for (std::size_t nChannel=0; nChannel < numberChannels; ++nChannel) {
+        samples[nChannel].resize(n_samples);
+    }
+    if (numberChannels == 1) {
+        std::copy(src, src+n_samples, samples[0].begin());
+        return;
+    }
+    for (std::size_t n = 0; n < n_samples; ++n, src += numberChannels) {
+        for (std::size_t nChannel=0; nChannel < numberChannels; ++nChannel) {
+            samples[nChannel][n] = src[chOffset[nChannel]];
+        }
+    }
+}
+
+// Reads all episodes from a memory map, de-interleaving the channels of each
+// episode in a single pass instead of reading every episode once per channel
+// through the Axon library. Returns false without touching ReturnData if the
+// episodes don't fit into the file.
+bool importMappedEpisodes(const std::string& fName, const ABFEpisodeLayout& layout,
+                          Recording& ReturnData, stfio::ProgressInfo& progDlg)
+{
+    std::size_t numberChannels = layout.chOffset.size();
+    std::size_t numberSections = layout.epOffset.size();
+    std::size_t sample_size = layout.intData ? sizeof(short) : sizeof(float);
+#if (__cplusplus < 201103)
+    boost::shared_ptr<stfio::MappedFile> mappedFile;
+#else
+    std::shared_ptr<stfio::MappedFile> mappedFile;
+#endif
+    try {
+        mappedFile.reset(new stfio::MappedFile(fName));
+    }
+    catch (const std::runtime_error&) {
+        return false;
+    }
+    for (std::size_t nEpisode=0; nEpisode < numberSections; ++nEpisode) {
+        if (layout.epOffset[nEpisode] + layout.epSize[nEpisode]*numberChannels*sample_size > mappedFile->GetSize()) {
+            return false;
+        }
+    }
+
+    ReturnData.resize(numberChannels);
+    for (std::size_t nChannel=0; nChannel < numberChannels; ++nChannel) {
+        Channel TempChannel(numberSections);
+        ReturnData.InsertChannel(STFIO_MOVE(TempChannel), nChannel);
+    }
+    // episodes are independent and are decoded in parallel; every episode
+    // is inserted at its own index, so the result doesn't depend on the order:
+    stfio::ParallelProgress progress(progDlg, (int)numberSections, "Reading sections");
+    int n_episodes = (int)numberSections;
+    std::string error;
+#ifdef _OPENMP
+    int n_threads = stfio::threadCount(0, n_episodes);
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+        std::vector<std::vector<short> > intSamples;
+        std::vector<std::vector<float> > floatSamples;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (int nEpisode=0; nEpisode < n_episodes; ++nEpisode) {
+            std::ostringstream label;
+            label
+                << fName
+                << ", Section # " << nEpisode + 1;
+            try {
+                // sample sized alignment is guaranteed by the block structure of the file:
+                const char* episode = mappedFile->GetData() + layout.epOffset[nEpisode];
+                if (layout.intData) {
+                    deinterleave(reinterpret_cast<const short*>(episode), layout.epSize[nEpisode],
+                                 layout.chOffset, intSamples);
+                } else {
+                    deinterleave(reinterpret_cast<const float*>(episode), layout.epSize[nEpisode],
+                                 layout.chOffset, floatSamples);
+                }
+                for (std::size_t nChannel=0; nChannel < numberChannels; ++nChannel) {
+                    // float data are stored in user units:
+                    Section TempSection(layout.intData ?
+                                        stfio::compactSamples(intSamples[nChannel], layout.chFactor[nChannel],
+                                                              layout.chShift[nChannel]) :
+                                        stfio::compactSamples(floatSamples[nChannel]),
+                                        label.str());
+                    ReturnData[nChannel].InsertSection(STFIO_MOVE(TempSection), nEpisode);
+                }
+            }
+            catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_abf_episodes)
+#endif
+                error = e.what();
+            }
+            progress.Step();
+        }
+    }
+    if (!error.empty()) {
+        ReturnData.resize(0);
+        throw std::runtime_error(error);
+    }
+    return true;
+}
+
+// Locates the episodes of an ABF1 file. Returns false if the data can't be
+// read with importMappedEpisodes().
+bool importABF1Mapped(const std::string& fName, int hFile, const ABFFileHeader& FH,
+                      Recording& ReturnData, stfio::ProgressInfo& progDlg)
+{
+    if (FH.nDataFormat != ABF_INTEGERDATA && FH.nDataFormat != ABF_FLOATDATA) {
+        return false;
+    }
+    int numberChannels = FH.nADCNumChannels;
+    ABFLONG numberSections = FH.lActualEpisodes;
+    if (numberChannels <= 0 || numberSections <= 0) {
+        return false;
+    }
+    ABFEpisodeLayout layout;
+    layout.intData = (FH.nDataFormat == ABF_INTEGERDATA);
+    std::size_t sample_size = layout.intData ? sizeof(short) : sizeof(float);
+
+    layout.chOffset.resize(numberChannels);
+    layout.chFactor.resize(numberChannels, 1.0f);
+    layout.chShift.resize(numberChannels, 0.0f);
+    for (int nChannel=0; nChannel < numberChannels; ++nChannel) {
+        if (!ABFH_GetChannelOffset(&FH, FH.nADCSamplingSeq[nChannel], &layout.chOffset[nChannel])) {
+            return false;
+        }
+        if (layout.intData) {
+            ABFH_GetADCtoUUFactors(&FH, FH.nADCSamplingSeq[nChannel],
+                                   &layout.chFactor[nChannel], &layout.chShift[nChannel]);
+        }
+    }
+
+    int nError = 0;
+    std::size_t dataOffset = (std::size_t)FH.lDataSectionPtr*ABF_BLOCKSIZE;
+    if (FH.nOperationMode == ABF_GAPFREEFILE) {
+        // garbage points at the start of old AxoLab files:
+        dataOffset += FH.nNumPointsIgnored*sample_size;
+    }
+    layout.epOffset.resize(numberSections);
+    layout.epSize.resize(numberSections);
+    for (ABFLONG nEpisode=0; nEpisode < numberSections; ++nEpisode) {
+        UINT uNumSamples = 0;
+        DWORD dwOffset = 0;
+        if (!ABF_GetNumSamples(hFile, &FH, nEpisode+1, &uNumSamples, &nError) ||
+            !ABF_GetEpisodeFileOffset(hFile, &FH, nEpisode+1, &dwOffset, &nError))
+        {
+            return false;
+        }
+        layout.epSize[nEpisode] = uNumSamples;
+        layout.epOffset[nEpisode] = dataOffset + (std::size_t)dwOffset*numberChannels*sample_size;
+    }
+    return importMappedEpisodes(fName, layout, ReturnData, progDlg);
+}
+
+// Locates the episodes of an ABF2 file that isn't read as a single gapfree
+// section. Returns false if the data can't be read with importMappedEpisodes().
+bool importABF2Mapped(const std::string& fName, int hFile, const ABF2FileHeader* pFH,
+                      Recording& ReturnData, stfio::ProgressInfo& progDlg)
+{
+    if (pFH->nDataFormat != ABF2_INTEGERDATA && pFH->nDataFormat != ABF2_FLOATDATA) {
+        return false;
+    }
+    int numberChannels = pFH->nADCNumChannels;
+    ABFLONG numberSections = pFH->lActualEpisodes;
+    if (numberChannels <= 0 || numberSections <= 0) {
+        return false;
+    }
+    ABFEpisodeLayout layout;
+    layout.intData = (pFH->nDataFormat == ABF2_INTEGERDATA);
+    std::size_t sample_size = layout.intData ? sizeof(short) : sizeof(float);
+
+    layout.chOffset.resize(numberChannels);
+    layout.chFactor.resize(numberChannels, 1.0f);
+    layout.chShift.resize(numberChannels, 0.0f);
+    for (int nChannel=0; nChannel < numberChannels; ++nChannel) {
+        if (!ABF2H_GetChannelOffset(pFH, pFH->nADCSamplingSeq[nChannel], &layout.chOffset[nChannel])) {
+            return false;
+        }
+        if (layout.intData) {
+            ABF2H_GetADCtoUUFactors(pFH, pFH->nADCSamplingSeq[nChannel],
+                                    &layout.chFactor[nChannel], &layout.chShift[nChannel]);
+        }
+    }
+
+    int nError = 0;
+    std::size_t dataOffset = (std::size_t)pFH->lDataSectionPtr*ABF2_BLOCKSIZE;
+    if (pFH->nOperationMode == ABF2_GAPFREEFILE) {
+        // garbage points at the start of old AxoLab files:
+        dataOffset += pFH->nNumPointsIgnored*sample_size;
+    }
+    layout.epOffset.resize(numberSections);
+    layout.epSize.resize(numberSections);
+    for (ABFLONG nEpisode=0; nEpisode < numberSections; ++nEpisode) {
+        UINT uNumSamples = 0;
+        DWORD dwOffset = 0;
+        if (!ABF2_GetNumSamples(hFile, pFH, nEpisode+1, &uNumSamples, &nError) ||
+            !ABF2_GetEpisodeFileOffset(hFile, pFH, nEpisode+1, &dwOffset, &nError))
+        {
+            return false;
+        }
+        // empty episodes are dropped by the reader below:
+        if (uNumSamples == 0) {
+            return false;
+        }
+        layout.epSize[nEpisode] = uNumSamples;
+        layout.epOffset[nEpisode] = dataOffset + (std::size_t)dwOffset*numberChannels*sample_size;
+    }
+    return importMappedEpisodes(fName, layout, ReturnData, progDlg);
+}
+
+}
+
 void stfio::importABFFile(const std::string &fName, Recording &ReturnData, ProgressInfo& progDlg) {
     ABF2_FileInfo fileInfo;
 
@@ -167,7 +410,34 @@ void stfio::importABF2File(const std::string &fName, Recording &ReturnData, Prog
         }
         finalSections = 1;
     }
-    for (int nChannel=0; nChannel < numberChannels; ++nChannel) {
+    // Gapfree data are left in the file and decoded on demand, so that files
+    // of any length can be opened without reading them:
+#if (__cplusplus < 201103)
+    boost::shared_ptr<MappedFile> mappedFile;
+#else
+    std::shared_ptr<MappedFile> mappedFile;
+#endif
+    if (gapfree && (pFH->nDataFormat == ABF2_INTEGERDATA || pFH->nDataFormat == ABF2_FLOATDATA)) {
+        try {
+            mappedFile.reset(new MappedFile(fName));
+        }
+        catch (const std::runtime_error&) {
+            // fall back to reading the data into memory
+        }
+    }
+    // Episodes are read from a memory map, all channels at once:
+    bool mappedEpisodes = false;
+    if (!gapfree) {
+        try {
+            mappedEpisodes = importABF2Mapped(fName, hFile, pFH, ReturnData, progDlg);
+        }
+        catch (...) {
+            ReturnData.resize(0);
+            ABF_Close(hFile,&nError);
+            throw;
+        }
+    }
+    for (int nChannel=0; !mappedEpisodes && nChannel < numberChannels; ++nChannel) {
         int progbar = (int)(((double)nChannel/(double)numberChannels)*100.0);
         progDlg.Update(progbar, "Memory allocation");
         ABFLONG grandsize = pFH->lNumSamplesPerEpisode / numberChannels;
@@ -186,7 +456,8 @@ void stfio::importABF2File(const std::string &fName, Recording &ReturnData, Prog
                 ;
 #endif
             
-            if (grandsize <= 0 || grandsize >= maxsize) {
+            // mapped sections don't need to fit into a single vector:
+            if (grandsize <= 0 || (!mappedFile && grandsize >= maxsize)) {
                     
                 progDlg.Update(progbar, "Gapfree file is too large for a single section." \
                                "It will be segmented.\nFile opening may be very slow.");
@@ -196,9 +467,45 @@ void stfio::importABF2File(const std::string &fName, Recording &ReturnData, Prog
                 finalSections=numberSections;
             }
         }
-        Channel TempChannel(finalSections, grandsize);
-        Section TempSectionGrand(grandsize, label.str());
-        for (int nEpisode=1; nEpisode<=numberSections;++nEpisode) {
+        bool mapped = (gapfree && mappedFile);
+        std::size_t n_pieces = mapped ? ((std::size_t)grandsize + gapfreeSectionSize - 1) / gapfreeSectionSize : 0;
+        // placeholders; all of them will be replaced below:
+        Channel TempChannel(mapped ? n_pieces : finalSections, 0);
+        Section TempSectionGrand(mapped ? 0 : grandsize, label.str());
+        if (mapped) {
+            // float data are stored in user units:
+            float fADCToUUFactor = 1.0f, fADCToUUShift = 0.0f;
+            SampleType type = sample_float32;
+            if (pFH->nDataFormat == ABF2_INTEGERDATA) {
+                ABF2H_GetADCtoUUFactors(pFH, pFH->nADCSamplingSeq[nChannel], &fADCToUUFactor, &fADCToUUShift);
+                type = sample_int16;
+            }
+            std::size_t sample_size = sampleSize(type);
+            // channels are interleaved in the order of the sampling sequence:
+            std::size_t offset = (std::size_t)pFH->lDataSectionPtr*ABF2_BLOCKSIZE + nChannel*sample_size;
+            std::size_t stride = numberChannels*sample_size;
+            try {
+                for (std::size_t n_p = 0; n_p < n_pieces; ++n_p) {
+                    std::size_t begin = n_p*gapfreeSectionSize;
+                    std::size_t n_samples = std::min((std::size_t)grandsize - begin, gapfreeSectionSize);
+                    std::ostringstream pieceLabel;
+                    pieceLabel << label.str();
+                    if (n_pieces > 1) {
+                        pieceLabel << " # " << n_p+1;
+                    }
+                    TempChannel.InsertSection(Section(MappedSamples(mappedFile, offset + begin*stride,
+                                                                    n_samples, stride, type,
+                                                                    fADCToUUFactor, fADCToUUShift),
+                                                      pieceLabel.str()),
+                                              n_p);
+                }
+            }
+            catch (...) {
+                ABF_Close(hFile,&nError);
+                throw;
+            }
+        }
+        for (int nEpisode=1; !mapped && nEpisode<=numberSections;++nEpisode) {
             int progbar =
                 // Channel contribution:
                 (int)(((double)nChannel/(double)numberChannels)*100.0+
@@ -255,10 +562,10 @@ void stfio::importABF2File(const std::string &fName, Recording &ReturnData, Prog
                     label
                         << fName
                         << ", Section # " << nEpisode;
-                    Section TempSectionT(TempSection.size(),label.str());
-                    std::copy(TempSection.begin(),TempSection.end(),&TempSectionT[0]);
+                    // keep the samples in single precision until they are used:
+                    Section TempSectionT(compactSamples(TempSection),label.str());
                     try {
-                        TempChannel.InsertSection(TempSectionT,nEpisode-1);
+                        TempChannel.InsertSection(STFIO_MOVE(TempSectionT),nEpisode-1);
                     }
                     catch (...) {
                         ABF_Close(hFile,&nError);
@@ -279,9 +586,9 @@ void stfio::importABF2File(const std::string &fName, Recording &ReturnData, Prog
                 TempChannel.resize(TempChannel.size()-1);
             }
         }
-        if (gapfree) {
+        if (gapfree && !mapped) {
             try {
-                TempChannel.InsertSection(TempSectionGrand,0);
+                TempChannel.InsertSection(STFIO_MOVE(TempSectionGrand),0);
             }
             catch (...) {
                 ABF_Close(hFile,&nError);
@@ -292,7 +599,7 @@ void stfio::importABF2File(const std::string &fName, Recording &ReturnData, Prog
             if ((int)ReturnData.size()<numberChannels) {
                 ReturnData.resize(numberChannels);
             }
-            ReturnData.InsertChannel(TempChannel,nChannel);
+            ReturnData.InsertChannel(STFIO_MOVE(TempChannel),nChannel);
         }
         catch (...) {
             ReturnData.resize(0);
@@ -302,7 +609,9 @@ void stfio::importABF2File(const std::string &fName, Recording &ReturnData, Prog
         
         progbar = (int)(((double)(nChannel+1)/(double)numberChannels)*100.0);
         progDlg.Update(progbar, "Completing channel reading\n");
+    }
 
+    for (int nChannel=0; nChannel < numberChannels; ++nChannel) {
         std::string channel_name( pFH->sADCChannelName[pFH->nADCSamplingSeq[nChannel]] );
         if (channel_name.find("  ")<channel_name.size()) {
             channel_name.erase(channel_name.begin()+channel_name.find("  "),channel_name.end());
@@ -387,7 +696,16 @@ void stfio::importABF1File(const std::string &fName, Recording &ReturnData, Prog
         throw std::runtime_error("Error while calling stfio::importABFFile():\n"
             "lActualEpisodes>dwMaxEpi");
     }
-    for (int nChannel=0;nChannel<numberChannels;++nChannel) {
+    bool mapped = false;
+    try {
+        mapped = importABF1Mapped(fName, hFile, FH, ReturnData, progDlg);
+    }
+    catch (...) {
+        ReturnData.resize(0);
+        ABF_Close(hFile,&nError);
+        throw;
+    }
+    for (int nChannel=0;!mapped && nChannel<numberChannels;++nChannel) {
         Channel TempChannel(numberSections);
         for (DWORD dwEpisode=1;dwEpisode<=(DWORD)numberSections;++dwEpisode) {
             int progbar = // Channel contribution:
@@ -429,10 +747,10 @@ void stfio::importABF1File(const std::string &fName, Recording &ReturnData, Prog
             label
                 << fName
                 << ", Section # " << dwEpisode;
-            Section TempSectionT(TempSection.size(),label.str());
-            std::copy(TempSection.begin(),TempSection.end(),&TempSectionT[0]);
+            // keep the samples in single precision until they are used:
+            Section TempSectionT(compactSamples(TempSection),label.str());
             try {
-                TempChannel.InsertSection(TempSectionT,dwEpisode-1);
+                TempChannel.InsertSection(STFIO_MOVE(TempSectionT),dwEpisode-1);
             }
             catch (...) {
                 ABF_Close(hFile,&nError);
@@ -443,14 +761,16 @@ void stfio::importABF1File(const std::string &fName, Recording &ReturnData, Prog
             if ((int)ReturnData.size()<numberChannels) {
                 ReturnData.resize(numberChannels);
             }
-            ReturnData.InsertChannel(TempChannel,nChannel);
+            ReturnData.InsertChannel(STFIO_MOVE(TempChannel),nChannel);
         }
         catch (...) {
             ReturnData.resize(0);
             ABF_Close(hFile,&nError);
             throw;
         }
+    }
 
+    for (int nChannel=0;nChannel<numberChannels;++nChannel) {
         std::string channel_name( FH.sADCChannelName[FH.nADCSamplingSeq[nChannel]] );
         if (channel_name.find("  ")<channel_name.size()) {
             channel_name.erase(channel_name.begin()+channel_name.find("  "),channel_name.end());
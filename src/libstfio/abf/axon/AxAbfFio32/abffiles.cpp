@@ -3210,42 +3210,6 @@ BOOL WINAPI ABF_SynchCountFromEpisode(int nFile, const ABFFileHeader *pFH, DWORD
     return TRUE;
 }
 
-//===============================================================================================
-// FUNCTION: ABF_GetEpisodeFileOffset
-// PURPOSE:  This routine returns the sample point offset in the ABF file for the start of the given
-//           episode number that is passed as an argument.
-// INPUT:
-//   nFile           the file index into the g_FileData structure array
-//   pdwEpisode      the episode number which is being searched for
-// 
-// OUTPUT:
-//   plFileOffset the Sample point number of the first point in the episode (per channel).
-// 
-BOOL WINAPI ABF_GetEpisodeFileOffset(int nFile, const ABFFileHeader *pFH, DWORD dwEpisode, 
-                                     DWORD *pdwFileOffset, int *pnError)
-{
-    ABFH_ASSERT(pFH);
-    CFileDescriptor *pFI = NULL;
-    if (!GetFileDescriptor(&pFI, nFile, pnError))
-        return FALSE;
-
-    if (!pFI->CheckEpisodeNumber(dwEpisode))
-        return ErrorReturn(pnError, ABF_EEPISODERANGE);
-
-    // For data that is continuous in time or is a Waveform data file then just
-    // calculate the sample number by multiplying the episode number by the
-    // episode size in samples.
-
-    if (pFI->GetSynchCount() == 0)          // (ABF_WAVEFORMFILE or ABF_GAPFREEFILE)
-    {
-        UINT uEpiSize = (UINT)(pFH->lNumSamplesPerEpisode / pFH->nADCNumChannels);
-        *pdwFileOffset = uEpiSize * (dwEpisode - 1);
-    }
-    else
-        *pdwFileOffset = pFI->FileOffset(dwEpisode) / pFH->nADCNumChannels / SampleSize(pFH);
-    return TRUE;
-}
-
 
 //===============================================================================================
 // FUNCTION: ABF_GetMissingSynchCount
@@ -3316,6 +3280,64 @@ BOOL WINAPI ABF_HasOverlappedData(int nFile, BOOL *pbHasOverlapped, int *pnError
 }
 #endif
 
+//===============================================================================================
+// FUNCTION: ABF_GetEpisodeFileOffset
+// PURPOSE:  This routine returns the sample point offset in the ABF file for the start of the given
+//           episode number that is passed as an argument.
+// INPUT:
+//   nFile           the file index into the g_FileData structure array
+//   pdwEpisode      the episode number which is being searched for
+// 
+// OUTPUT:
+//   plFileOffset the Sample point number of the first point in the episode (per channel).
+// 
+BOOL WINAPI ABF_GetEpisodeFileOffset(int nFile, const ABFFileHeader *pFH, DWORD dwEpisode, 
+                                     DWORD *pdwFileOffset, int *pnError)
+{
+    //   ABFH_ASSERT(pFH);
+    CFileDescriptor *pFI = NULL;
+    if (!GetFileDescriptor(&pFI, nFile, pnError))
+        return FALSE;
+
+    // For data that is continuous in time or is a Waveform data file, the
+    // synch entry is calculated from the episode number and the episode size.
+    Synch SynchEntry;
+    if (!GetSynchEntry( pFH, pFI, dwEpisode, &SynchEntry ))
+        return ErrorReturn(pnError, ABF_EEPISODERANGE);
+
+    *pdwFileOffset = SynchEntry.dwFileOffset / pFH->nADCNumChannels / SampleSize(pFH);
+    return TRUE;
+}
+
+//===============================================================================================
+// FUNCTION: ABF2_GetEpisodeFileOffset
+// PURPOSE:  This routine returns the sample point offset in the ABF file for the start of the given
+//           episode number that is passed as an argument.
+// INPUT:
+//   nFile           the file index into the g_FileData structure array
+//   pdwEpisode      the episode number which is being searched for
+// 
+// OUTPUT:
+//   plFileOffset the Sample point number of the first point in the episode (per channel).
+// 
+BOOL WINAPI ABF2_GetEpisodeFileOffset(int nFile, const ABF2FileHeader *pFH, DWORD dwEpisode, 
+                                      DWORD *pdwFileOffset, int *pnError)
+{
+    //   ABFH_ASSERT(pFH);
+    CFileDescriptor *pFI = NULL;
+    if (!GetFileDescriptor(&pFI, nFile, pnError))
+        return FALSE;
+
+    // For data that is continuous in time or is a Waveform data file, the
+    // synch entry is calculated from the episode number and the episode size.
+    Synch SynchEntry;
+    if (!ABF2_GetSynchEntry( pFH, pFI, dwEpisode, &SynchEntry ))
+        return ErrorReturn(pnError, ABF_EEPISODERANGE);
+
+    *pdwFileOffset = SynchEntry.dwFileOffset / pFH->nADCNumChannels / ABF2_SampleSize(pFH);
+    return TRUE;
+}
+
 //===============================================================================================
 // FUNCTION: ABF_GetNumSamples
 // PURPOSE:  This routine returns the number of samples per channel in a given episode.
@@ -167,10 +167,12 @@ BOOL WINAPI ABF_EpisodeFromSynchCount(int nFile, const ABFFileHeader *pFH, DWORD
 
 BOOL WINAPI ABF_SynchCountFromEpisode(int nFile, const ABFFileHeader *pFH, DWORD dwEpisode, 
                                       DWORD *pdwSynchCount, int *pnError);
-
+*/
 BOOL WINAPI ABF_GetEpisodeFileOffset(int nFile, const ABFFileHeader *pFH, DWORD dwEpisode, 
                                      DWORD *pdwFileOffset, int *pnError);
-
+BOOL WINAPI ABF2_GetEpisodeFileOffset(int nFile, const ABF2FileHeader *pFH, DWORD dwEpisode, 
+                                      DWORD *pdwFileOffset, int *pnError);
+/*
 BOOL WINAPI ABF_GetMissingSynchCount(int nFile, const ABFFileHeader *pFH, DWORD dwEpisode, 
                                      DWORD *pdwMissingSynchCount, int *pnError);
 
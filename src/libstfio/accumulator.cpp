@@ -0,0 +1,117 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file accumulator.cpp
+ *  \brief Defines a running average of sections.
+ */
+
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include "./stfio.h"
+#include "./section.h"
+#include "./accumulator.h"
+#include "./scratch.h"
+
+namespace {
+    // Number of data points that are decoded at once from mapped sections:
+    const std::size_t accumulatorBlockSize = 4096;
+}
+
+AverageAccumulator::AverageAccumulator() :
+    n(0), mean(0), m2(0)
+{}
+
+void AverageAccumulator::Clear() {
+    n = 0;
+    mean.clear();
+    m2.clear();
+}
+
+void AverageAccumulator::Add(const Section& sec) {
+    if (n == 0) {
+        mean.assign(sec.size(), 0.0);
+        m2.assign(sec.size(), 0.0);
+    } else if (sec.size() < mean.size()) {
+        mean.resize(sec.size());
+        m2.resize(sec.size());
+    }
+    Update(sec, true);
+}
+
+void AverageAccumulator::Remove(const Section& sec) {
+    if (n == 0) {
+        throw std::out_of_range("No sections in AverageAccumulator::Remove");
+    }
+    if (sec.size() < mean.size()) {
+        throw std::out_of_range("Section too short in AverageAccumulator::Remove");
+    }
+    if (n == 1) {
+        Clear();
+        return;
+    }
+    Update(sec, false);
+}
+
+void AverageAccumulator::Update(const Section& sec, bool add) {
+    // Welford's update, and its inverse for removing a section:
+    //   add:    mean_n = mean_{n-1} + (x-mean_{n-1})/n
+    //           m2_n = m2_{n-1} + (x-mean_{n-1})*(x-mean_n)
+    //   remove: mean_{n-1} = mean_n - (x-mean_n)/(n-1)
+    //           m2_{n-1} = m2_n - (x-mean_n)*(x-mean_{n-1})
+    std::size_t n_new = add ? n+1 : n-1;
+    double rn = add ? 1.0/n_new : -1.0/n_new;
+    std::size_t n_points = mean.size();
+    stfio::ScratchScope scratch;
+    double* buffer = NULL;
+    for (std::size_t begin = 0; begin < n_points; begin += accumulatorBlockSize) {
+        std::size_t len = std::min(accumulatorBlockSize, n_points-begin);
+        const double* x = sec.GetSpan();
+        if (x != NULL) {
+            x += begin;
+        } else {
+            if (buffer == NULL) {
+                buffer = scratch.Doubles(accumulatorBlockSize);
+            }
+            sec.CopyRange(begin, begin+len, buffer);
+            x = buffer;
+        }
+        double* bmean = &mean[begin];
+        double* bm2 = &m2[begin];
+        if (add) {
+            for (std::size_t k = 0; k < len; ++k) {
+                double delta = x[k] - bmean[k];
+                bmean[k] += delta * rn;
+                bm2[k] += delta * (x[k] - bmean[k]);
+            }
+        } else {
+            for (std::size_t k = 0; k < len; ++k) {
+                double delta = x[k] - bmean[k];
+                bmean[k] += delta * rn;
+                bm2[k] -= delta * (x[k] - bmean[k]);
+            }
+        }
+    }
+    n = n_new;
+}
+
+Vector_double AverageAccumulator::GetSD() const {
+    Vector_double sd(m2.size());
+    for (std::size_t k = 0; k < m2.size(); ++k) {
+        // rounding errors after removing sections mustn't give negative variances:
+        sd[k] = sqrt(std::max(m2[k], 0.0) / (n - 1.0));
+    }
+    return sd;
+}
@@ -0,0 +1,91 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file accumulator.h
+ *  \brief Declares a running average of sections.
+ */
+
+#ifndef _ACCUMULATOR_H
+#define _ACCUMULATOR_H
+
+#include "./stfio.h"
+
+class Section;
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! A running average and standard deviation of sections.
+/*! Sections can be added and removed one at a time, each in a single pass
+ *  over its data (Welford's algorithm), so that the average of a selection
+ *  doesn't have to be recomputed whenever a section is selected or unselected.
+ *  The average covers the first size() points of the sections, where size()
+ *  is the size of the shortest section that was added since the accumulator
+ *  was last empty.
+ */
+class StfioDll AverageAccumulator {
+public:
+    //! Default constructor. Creates an empty accumulator.
+    AverageAccumulator();
+
+    //! Adds a section to the average.
+    /*! \param sec The section to be added.
+     */
+    void Add(const Section& sec);
+
+    //! Removes a section that was added before.
+    /*! The result is undefined if \e sec wasn't added or has been modified since.
+     *  Throws std::out_of_range if the accumulator is empty or if the section is
+     *  shorter than the average.
+     *  \param sec The section to be removed.
+     */
+    void Remove(const Section& sec);
+
+    //! Removes all sections.
+    void Clear();
+
+    //! Retrieves the number of averaged sections.
+    /*! \return The number of sections that have been added and not removed.
+     */
+    std::size_t GetN() const { return n; }
+
+    //! Retrieves the number of points of the average.
+    /*! \return The number of points.
+     */
+    std::size_t size() const { return mean.size(); }
+
+    //! Retrieves the average.
+    /*! \return The average of all sections.
+     */
+    const Vector_double& GetMean() const { return mean; }
+
+    //! Computes the standard deviation.
+    /*! Uses the same normalisation as Recording::MakeAverage().
+     *  \return The standard deviation of all sections.
+     */
+    Vector_double GetSD() const;
+
+private:
+    void Update(const Section& sec, bool add);
+
+    std::size_t n;
+    Vector_double mean;
+    // sums of squared deviations from the mean:
+    Vector_double m2;
+};
+
+/*@}*/
+
+#endif
@@ -0,0 +1,150 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file aligned.h
+ *  \brief Declares an allocator for buffers that are aligned for SIMD instructions.
+ */
+
+#ifndef _STFIO_ALIGNED_H
+#define _STFIO_ALIGNED_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Alignment in bytes of the buffers returned by stfio::AlignedAllocator.
+/*! Suffices for AVX-512 loads and for FFTW's SIMD code paths; it is also the
+ *  size of a cache line on current processors.
+ */
+const std::size_t simdAlignment = 64;
+
+//! Checks whether a pointer is aligned.
+/*! \param p The pointer.
+ *  \param alignment The alignment in bytes; has to be a power of 2.
+ *  \return true if \e p is a multiple of \e alignment.
+ */
+inline bool isAligned(const void* p, std::size_t alignment = simdAlignment) {
+    return ((std::size_t)p & (alignment-1)) == 0;
+}
+
+//! An allocator that aligns every buffer to stfio::simdAlignment bytes.
+/*! Can be used with standard containers, e.g. stfio::Vector_aligned. Unlike
+ *  fftw_malloc(), the memory is released by the container, also when an
+ *  exception is thrown.
+ */
+template <class T>
+class AlignedAllocator {
+public:
+    typedef T value_type;               /*!< Type of the elements. */
+    typedef T* pointer;                 /*!< Pointer to an element. */
+    typedef const T* const_pointer;     /*!< Pointer to a constant element. */
+    typedef T& reference;               /*!< Reference to an element. */
+    typedef const T& const_reference;   /*!< Reference to a constant element. */
+    typedef std::size_t size_type;      /*!< Type of sizes. */
+    typedef std::ptrdiff_t difference_type; /*!< Type of pointer differences. */
+
+    //! Provides the allocator for another element type.
+    template <class U>
+    struct rebind {
+        typedef AlignedAllocator<U> other; /*!< The allocator for U. */
+    };
+
+    //! Default constructor.
+    AlignedAllocator() {}
+
+    //! Converting constructor; the allocator has no state.
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    //! Retrieves the address of an element.
+    pointer address(reference x) const { return &x; }
+
+    //! Retrieves the address of a constant element.
+    const_pointer address(const_reference x) const { return &x; }
+
+    //! Allocates aligned memory for \e n elements.
+    /*! Throws std::bad_alloc if the memory can't be allocated.
+     *  \param n Number of elements.
+     *  \return Pointer to the first element, aligned to stfio::simdAlignment.
+     */
+    pointer allocate(size_type n, const void* = 0) {
+        if (n == 0) {
+            return NULL;
+        }
+        if (n > max_size()) {
+            throw std::bad_alloc();
+        }
+        void* p = NULL;
+#ifdef _WIN32
+        p = _aligned_malloc(n*sizeof(T), simdAlignment);
+#else
+        if (posix_memalign(&p, simdAlignment, n*sizeof(T)) != 0) {
+            p = NULL;
+        }
+#endif
+        if (p == NULL) {
+            throw std::bad_alloc();
+        }
+        return static_cast<pointer>(p);
+    }
+
+    //! Releases memory returned by allocate().
+    void deallocate(pointer p, size_type) {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+
+    //! Retrieves the maximal number of elements that can be allocated.
+    size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+    //! Constructs an element in allocated memory.
+    void construct(pointer p, const T& value) { new((void*)p) T(value); }
+
+    //! Destroys an element without releasing its memory.
+    void destroy(pointer p) { p->~T(); }
+};
+
+//! All instances are interchangeable.
+template <class T, class U>
+inline bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return true; }
+
+//! All instances are interchangeable.
+template <class T, class U>
+inline bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return false; }
+
+//! A vector of doubles that starts at a multiple of stfio::simdAlignment bytes.
+/*! Meant for scratch buffers of FFTs and vectorised kernels. Vector_double
+ *  itself uses the default allocator, since it is part of the interfaces of
+ *  the Python bindings and of the GUI.
+ */
+typedef std::vector<double, AlignedAllocator<double> > Vector_aligned;
+
+}
+
+/*@}*/
+
+#endif
@@ -12,175 +12,458 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "./asciilib.h"
+#include "../mappedfile.h"
+#include "../textwriter.h"
+#include "../parallel.h"
+
+namespace {
+
+// Powers of ten that are exactly representable as doubles:
+const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-#if 0
-wxString stf::NextWord( wxString& str ) {
-    int next_space = str.Find( wxT(' ') );
-	int next_tab = str.Find( wxT('\t') );
-	int next_nline = str.Find( wxT('\n') );
-	if ( next_space == wxNOT_FOUND && next_tab == wxNOT_FOUND && next_nline == wxNOT_FOUND )
-	    return wxT("\0");
-	wxString retStr = wxT("");
-	// wxNOT_FOUND is -1!
-	if ( next_space != wxNOT_FOUND && ( next_space < next_tab || next_tab == wxNOT_FOUND ) && ( next_space < next_nline || next_nline == wxNOT_FOUND ) ) {
-		retStr = str.BeforeFirst( wxT(' ') );
-		str = str.AfterFirst( wxT(' ') );
-	}
-	if ( next_tab != wxNOT_FOUND && ( next_tab < next_space || next_space == wxNOT_FOUND ) && ( next_tab < next_nline || next_nline == wxNOT_FOUND ) ) {
-		retStr = str.BeforeFirst( wxT('\t') );
-		str = str.AfterFirst( wxT('\t') );
-	}
-	if ( next_nline != wxNOT_FOUND && ( next_nline < next_tab || next_tab == wxNOT_FOUND ) && ( next_nline < next_space || next_space == wxNOT_FOUND ) ) {
-		retStr = str.BeforeFirst( wxT('\n') );
-		str = str.AfterFirst( wxT('\n') );
-	}
-	return retStr;
+inline bool isDelimiter(char c) {
+    return c == '\t' || c == ' ' || c == ',' || c == '\r';
 }
-#endif
 
-void stf::importASCIIFile( const wxString& fName, int hLinesToSkip, int nColumns,
-        bool firstIsTime, bool toSection, Recording& ReturnRec, bool progress )
-{
-    wxProgressDialog progDlg( wxT("Importing text file"), wxT("Starting..."), 100,
-            NULL, wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_APP_MODAL | wxPD_CAN_SKIP );
+inline bool isTokenEnd(const char* p, const char* end) {
+    return p == end || *p == '\n' || isDelimiter(*p);
+}
 
-    //Open ASCII file and copy its contents to ReturnData:
+// Converts a token with strtod(), which requires a null-terminated copy:
+bool parseSlow(const char* begin, const char* end, double& value) {
+    char buf[128];
+    std::size_t len = end-begin;
+    if (len == 0 || len >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, begin, len);
+    buf[len] = '\0';
+    char* stop = NULL;
+    value = strtod(buf, &stop);
+    return stop == buf+len;
+}
 
-    wxFileInputStream fStream( fName );
-    wxTextInputStream tStream( fStream );
+// The boundaries and size of a part of the text:
+struct TextChunk {
+    TextChunk() : begin(NULL), end(NULL), n_rows(0), n_lines(0), error_line(0), error_column(0) {}
+    const char* begin;
+    const char* end;
+    std::size_t n_rows, n_lines;
+    // 1-based line of the first error within the chunk, 0 if there was none:
+    std::size_t error_line;
+    std::size_t error_column;
+};
 
-    // Read header:
-    wxString header;
-    for(int n_h=0; n_h<hLinesToSkip; n_h++) {
-        if ( fStream.Eof() ) {
-            ReturnRec.resize(0);
-            throw std::runtime_error("Unexpected end of file; aborting file import.");
+bool isEmptyLine(const char* p, const char* line_end) {
+    for (; p < line_end; ++p) {
+        if (!isDelimiter(*p)) {
+            return false;
         }
-        header << tStream.ReadLine() << wxT("\n");
     }
+    return true;
+}
 
-    double time[2];
-    // Read data:
-    // use vectors temporarily to push back values:
-    std::vector<Vector_double > tempVec(nColumns-int(firstIsTime));
-    std::vector<Vector_double >::iterator it_vd;
-    // Reserve memory right here to speed up file reading a little:
-    for ( it_vd = tempVec.begin(); it_vd != tempVec.end(); ++it_vd ) {
-        // it_vd->reserve( 32768 );
-    }
-    int n_time=0;
-    int nline = 0;
-    bool skip = false;
+void countRows(TextChunk& chunk) {
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* line_end = (const char*)memchr(p, '\n', chunk.end-p);
+        if (line_end == NULL) {
+            line_end = chunk.end;
+        }
+        ++chunk.n_lines;
+        if (!isEmptyLine(p, line_end)) {
+            ++chunk.n_rows;
+        }
+        p = line_end+1;
+    }
+}
+
+void parseRows(TextChunk& chunk, std::size_t row_offset, std::vector<Vector_double>& columns) {
+    const char* p = chunk.begin;
+    std::size_t row = row_offset, line = 0;
+    while (p < chunk.end) {
+        const char* line_end = (const char*)memchr(p, '\n', chunk.end-p);
+        if (line_end == NULL) {
+            line_end = chunk.end;
+        }
+        ++line;
+        if (!isEmptyLine(p, line_end)) {
+            for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+                while (p < line_end && isDelimiter(*p)) {
+                    ++p;
+                }
+                if (p == line_end || !stfio::parseDouble(p, line_end, columns[n_c][row])) {
+                    chunk.error_line = line;
+                    chunk.error_column = n_c+1;
+                    return;
+                }
+            }
+            ++row;
+        }
+        p = line_end+1;
+    }
+}
+
+// Splits a line into values in the same way as parseRows(). Returns the
+// number of values, or 0 if one of them isn't a number:
+std::size_t countValues(const char* p, const char* line_end, double& first) {
+    std::size_t n_values = 0;
     for (;;) {
-        if (fStream.Eof())
-            break;
-        nline++;
-        if ( std::div(nline, 100).rem == 0 ) {
-            if ( skip ) {
-                ReturnRec.resize(0);
-                throw std::runtime_error("File import aborted by user.");
+        while (p < line_end && isDelimiter(*p)) {
+            ++p;
+        }
+        if (p == line_end) {
+            return n_values;
+        }
+        double value = 0;
+        if (!stfio::parseDouble(p, line_end, value)) {
+            return 0;
+        }
+        if (n_values == 0) {
+            first = value;
+        }
+        ++n_values;
+    }
+}
+
+}
+
+bool stfio::parseDouble(const char*& pos, const char* end, double& value) {
+    const char* p = pos;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    // Up to 19 significant digits fit into the mantissa:
+    unsigned long long mantissa = 0;
+    int n_significant = 0, exponent = 0;
+    bool any_digit = false, truncated = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        any_digit = true;
+        if (n_significant < 19) {
+            mantissa = mantissa*10 + (*p-'0');
+            if (mantissa != 0) {
+                ++n_significant;
             }
-            if (progress) {
-                wxString progMsg( wxT("Reading line #") );
-                progMsg << nline;
-                progDlg.Pulse( progMsg, &skip );
+        } else {
+            truncated = true;
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            any_digit = true;
+            if (n_significant < 19) {
+                mantissa = mantissa*10 + (*p-'0');
+                if (mantissa != 0) {
+                    ++n_significant;
+                }
+                --exponent;
+            } else {
+                truncated = true;
             }
         }
-        // calculate sampling rate from first two time values:
-        if (firstIsTime) {
-            double tempTime = tStream.ReadDouble();
-            if (n_time<2) {
-                time[n_time++]=tempTime;
+    }
+    bool valid = any_digit;
+    if (valid && p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool exp_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = (*p == '-');
+            ++p;
+        }
+        int exp_value = 0;
+        bool exp_digit = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            exp_digit = true;
+            if (exp_value < 100000) {
+                exp_value = exp_value*10 + (*p-'0');
             }
         }
+        valid = exp_digit;
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+    if (valid && isTokenEnd(p, end) && !truncated &&
+        mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+        // Both the mantissa and the power of ten are exact, so that
+        // a single multiplication or division rounds correctly:
+        double result = (double)mantissa;
+        result = exponent < 0 ? result/exact_pow10[-exponent] : result*exact_pow10[exponent];
+        value = negative ? -result : result;
+        pos = p;
+        return true;
+    }
 
-        if (fStream.Eof())
-            break;
-        for (int n_col=0;n_col<nColumns-int(firstIsTime);++n_col) {
-            tempVec[n_col].push_back( tStream.ReadDouble() );
+    // Let strtod() deal with everything else:
+    const char* token_end = pos;
+    while (!isTokenEnd(token_end, end)) {
+        ++token_end;
+    }
+    double result;
+    if (!parseSlow(pos, token_end, result)) {
+        return false;
+    }
+    value = result;
+    pos = token_end;
+    return true;
+}
+
+void stfio::parseTextColumns(const char* begin, const char* end,
+                             std::vector<Vector_double>& columns, int nChunks)
+{
+    if (columns.empty()) {
+        return;
+    }
+    std::size_t text_size = end-begin;
+    if (nChunks <= 0) {
+        // parallelization only pays off for large texts:
+        const std::size_t chunk_size = 4*1024*1024;
+        nChunks = (int)(text_size/chunk_size) + 1;
+        nChunks = stfio::threadCount(0, nChunks);
+    }
+
+    // Split the text at line breaks:
+    std::vector<TextChunk> chunks(nChunks);
+    const char* chunk_begin = begin;
+    for (int n_ch = 0; n_ch < nChunks; ++n_ch) {
+        const char* chunk_end = end;
+        if (n_ch < nChunks-1) {
+            chunk_end = begin + (text_size/nChunks)*(n_ch+1);
+            if (chunk_end < chunk_begin) {
+                chunk_end = chunk_begin;
+            }
+            const char* line_end = (const char*)memchr(chunk_end, '\n', end-chunk_end);
+            chunk_end = (line_end == NULL) ? end : line_end+1;
         }
+        chunks[n_ch].begin = chunk_begin;
+        chunks[n_ch].end = chunk_end;
+        chunk_begin = chunk_end;
     }
-    if ( tempVec.empty() ) {
-        ReturnRec.resize(0);
-        throw std::runtime_error("Empty text file; aborting file import.");
+
+    // Count the rows first so that the values can be written in place:
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(stfio::threadCount(0, nChunks))
+#endif
+    for (int n_ch = 0; n_ch < nChunks; ++n_ch) {
+        countRows(chunks[n_ch]);
     }
-    // insert vectors:
-    int n_sec=0, n_ch=0;
-    if (toSection) {
-        n_sec=nColumns-int(firstIsTime);
-        n_ch=1;
-    } else {
-        n_sec=1;
-        n_ch=nColumns-int(firstIsTime);
+    std::vector<std::size_t> row_offsets(nChunks+1, 0);
+    for (int n_ch = 0; n_ch < nChunks; ++n_ch) {
+        row_offsets[n_ch+1] = row_offsets[n_ch] + chunks[n_ch].n_rows;
     }
-    ReturnRec.resize(n_ch);
-    std::vector<Channel> TempChannel(n_ch,Channel(n_sec));
-    for (int n_insert=0;n_insert<nColumns-int(firstIsTime);++n_insert) {
-        Section TempSection(tempVec[n_insert].size());
-        std::copy(tempVec[n_insert].begin(),tempVec[n_insert].end(),&TempSection[0]);
-        try {
-            if (toSection) {
-                std::ostringstream label;
-                label << stf::noPath(fName) << ", Section # " << n_insert+1;
-                TempSection.SetSectionDescription(label.str());
-                TempChannel[0].InsertSection(TempSection,n_insert);
+    for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+        columns[n_c].resize(row_offsets[nChunks]);
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(stfio::threadCount(0, nChunks))
+#endif
+    for (int n_ch = 0; n_ch < nChunks; ++n_ch) {
+        parseRows(chunks[n_ch], row_offsets[n_ch], columns);
+    }
+
+    // Report the first error:
+    std::size_t line_offset = 0;
+    for (int n_ch = 0; n_ch < nChunks; ++n_ch) {
+        if (chunks[n_ch].error_line != 0) {
+            std::ostringstream errorMsg;
+            errorMsg << "Couldn't read column " << chunks[n_ch].error_column
+                     << " in line " << line_offset + chunks[n_ch].error_line;
+            throw std::runtime_error(errorMsg.str());
+        }
+        line_offset += chunks[n_ch].n_lines;
+    }
+}
+
+stfio::TextPreview stfio::sniffText(const char* begin, const char* end, std::size_t maxLines) {
+    TextPreview preview;
+    Vector_double times;
+    bool has_tab = false, has_comma = false;
+    const char* p = begin;
+    std::size_t n_lines = 0;
+    while (p < end && n_lines < maxLines) {
+        const char* line_end = (const char*)memchr(p, '\n', end-p);
+        if (line_end == NULL) {
+            line_end = end;
+        }
+        ++n_lines;
+        double first = 0;
+        std::size_t n_values = isEmptyLine(p, line_end) ? 0 : countValues(p, line_end, first);
+        // text after the first row of numbers is left to the importer to report:
+        if (n_values > 0) {
+            if (times.empty()) {
+                preview.hLines = (int)n_lines-1;
+                preview.nColumns = (int)n_values;
             } else {
-                std::ostringstream label;
-                label << fName << ", Section # 1";
-                TempSection.SetSectionDescription(label.str());
-                TempChannel[n_insert].InsertSection(TempSection,0);
+                preview.nColumns = std::min(preview.nColumns, (int)n_values);
             }
+            times.push_back(first);
+            has_tab = has_tab || memchr(p, '\t', line_end-p) != NULL;
+            has_comma = has_comma || memchr(p, ',', line_end-p) != NULL;
         }
-        catch (...) {throw;}
+        p = (line_end == end) ? end : line_end+1;
     }
-    for (std::size_t n_ch=0;n_ch<TempChannel.size();++n_ch) {
-        try {
-            ReturnRec.InsertChannel(TempChannel[n_ch],n_ch);
+    preview.text.assign(begin, p);
+    preview.truncated = (p < end);
+    preview.delimiter = has_tab ? '\t' : (has_comma ? ',' : ' ');
+
+    // Time values are usually printed with few digits, so that the steps
+    // are only compared to their mean within 1%:
+    if (preview.nColumns >= 2 && times.size() >= 2) {
+        double dt = (times.back()-times.front()) / (times.size()-1);
+        bool constant = dt > 0;
+        for (std::size_t n = 1; constant && n < times.size(); ++n) {
+            constant = fabs(times[n]-times[n-1]-dt) <= 0.01*dt;
         }
-        catch (...) {throw;}
+        if (constant) {
+            preview.firstIsTime = true;
+            preview.sr = 1.0/dt;
+        }
+    }
+    return preview;
+}
+
+stfio::TextPreview stfio::previewTextFile(const std::string& fName, std::size_t maxLines,
+                                          std::size_t maxBytes)
+{
+    std::ifstream file(fName.c_str(), std::ios::in | std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(std::string("Couldn't open ") + fName);
     }
+    // Only the start of the file is read, however large it is:
+    std::string buffer(maxBytes, '\0');
+    file.read(maxBytes > 0 ? &buffer[0] : NULL, (std::streamsize)maxBytes);
+    buffer.resize((std::size_t)file.gcount());
+    bool more = file.peek() != std::char_traits<char>::eof();
+    if (more) {
+        // drop the line that has been cut off:
+        std::size_t last = buffer.find_last_of('\n');
+        buffer.resize(last == std::string::npos ? 0 : last+1);
+    }
+    TextPreview preview = sniffText(buffer.data(), buffer.data()+buffer.size(), maxLines);
+    preview.truncated = preview.truncated || more;
+    return preview;
+}
 
+void stfio::applyTextPreview(const TextPreview& preview, txtImportSettings& txtImport) {
+    if (preview.nColumns == 0) {
+        return;
+    }
+    txtImport.hLines = preview.hLines;
+    txtImport.ncolumns = preview.nColumns;
+    txtImport.firstIsTime = preview.firstIsTime;
+    if (preview.firstIsTime) {
+        txtImport.sr = preview.sr;
+    }
+}
+
+void stfio::importASCIIFile(const std::string& fName, int hLinesToSkip, int nColumns,
+        bool firstIsTime, bool toSection, Recording& ReturnRec, ProgressInfo& progDlg)
+{
+    if (nColumns <= int(firstIsTime)) {
+        throw std::runtime_error("Too few columns; aborting file import.");
+    }
+    progDlg.Update(0, "Reading file");
+    MappedFile file(fName);
+    const char* pos = file.GetData();
+    const char* end = pos + file.GetSize();
+
+    // Read header:
+    std::string header;
+    for (int n_h=0; n_h<hLinesToSkip; n_h++) {
+        if (pos >= end) {
+            throw std::runtime_error("Unexpected end of file; aborting file import.");
+        }
+        const char* line_end = (const char*)memchr(pos, '\n', end-pos);
+        if (line_end == NULL) {
+            line_end = end;
+        }
+        header.append(pos, line_end);
+        header += "\n";
+        pos = (line_end == end) ? end : line_end+1;
+    }
+
+    // Read data:
+    std::vector<Vector_double> columns(nColumns);
+    parseTextColumns(pos, end, columns);
+    if (columns[0].empty()) {
+        throw std::runtime_error("Empty text file; aborting file import.");
+    }
+    progDlg.Update(50, "Creating sections");
+
+    // calculate sampling rate from first two time values:
     if (firstIsTime) {
-        if (time[1]-time[0] <= 0) {
-            ReturnRec.resize(0);
+        if (columns[0].size() < 2 || columns[0][1]-columns[0][0] <= 0) {
             throw std::runtime_error("Negative sampling interval\n"
                     "Check number of columns");
         }
-        ReturnRec.SetXScale(time[1]-time[0]);
+        ReturnRec.SetXScale(columns[0][1]-columns[0][0]);
     }
-#if (wxCHECK_VERSION(2, 9, 0) || defined(MODULE_ONLY))
-    ReturnRec.SetFileDescription( header.ToStdString() );
-#else
-    ReturnRec.SetFileDescription(std::string(header.mb_str()));
-#endif    
+
+    // insert vectors:
+    int n_data = nColumns-int(firstIsTime);
+    int n_sec=0, n_ch=0;
+    if (toSection) {
+        n_sec=n_data;
+        n_ch=1;
+    } else {
+        n_sec=1;
+        n_ch=n_data;
+    }
+    ReturnRec.resize(n_ch);
+    for (int n_c=0;n_c<n_ch;++n_c) {
+        ReturnRec[n_c].resize(n_sec);
+    }
+    for (int n_insert=0;n_insert<n_data;++n_insert) {
+        std::ostringstream label;
+        Section* sec;
+        if (toSection) {
+            label << fName.substr(fName.find_last_of("/\\")+1) << ", Section # " << n_insert+1;
+            sec = &ReturnRec[0][n_insert];
+        } else {
+            label << fName << ", Section # 1";
+            sec = &ReturnRec[n_insert][0];
+        }
+        sec->SetSectionDescription(label.str());
+        // the parsed values aren't copied:
+        sec->get_w().swap(columns[n_insert+int(firstIsTime)]);
+    }
+    ReturnRec.SetFileDescription(header);
 }
 
-bool stf::exportASCIIFile(const wxString& fName, const Section& Export) {
-    wxString out( stf::sectionToString(Export) );
-    ofstreamMan ASCIIfile( fName );
-    ASCIIfile.myStream.Write( out );
+bool stfio::exportASCIIFile(const std::string& fName, const Section& Export, int n_threads) {
+    std::ostringstream header;
+    header << (int)Export.size() << "\n";
+    std::vector<TextColumn> columns;
+    columns.push_back(TextColumn(Export.size(), Export.GetXScale(), 12));
+    columns.push_back(TextColumn(Export));
+    writeTextTable(fName, header.str(), columns, "\t", "\n", 0.0, n_threads);
     return true;
 }
 
-bool stf::exportASCIIFile(const wxString& fName, const Channel& Export) {
-    wxProgressDialog progDlg( wxT("Exporting channel"), wxT("Starting..."), 100,
-            NULL, wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_APP_MODAL );
-
+bool stfio::exportASCIIFile(const std::string& fName, const Channel& Export, int n_threads) {
     for (std::size_t n_s=0;n_s<Export.size();++n_s) {
         // create new filename:
-        wxString newFName;
-        newFName << fName << wxT("_") << (int)n_s << wxT(".txt");
-        wxString progStr;
-        progStr << wxT("Writing section #") << (int)n_s + 1 << wxT(" of ") << (int)Export.size()
-        << wxT("\nto file: ") << newFName;
-        progDlg.Update(
-                // Section contribution:
-                (int)((double)n_s/(double)Export.size()*100.0),
-                progStr
-        );
-        ofstreamMan ASCIIfile( newFName );
-        ASCIIfile.myStream.Write( stf::sectionToString(Export[n_s]) );
+        std::ostringstream newFName;
+        newFName << fName << "_" << (int)n_s << ".txt";
+        exportASCIIFile(newFName.str(), Export[n_s], n_threads);
     }
     return true;
 }
@@ -26,6 +26,85 @@
 
 namespace stfio {
 
+//! Parses a floating point number from text that needn't be null-terminated.
+/*! Numbers are read in the C locale without copying. The result
+ *  agrees with strtod(), which is only called for numbers that can't be
+ *  converted exactly by the fast path, such as "nan" or numbers with more
+ *  than 19 significant digits.
+ *  \param pos On entry, the start of the number. On exit, the position
+ *         past the number if it could be parsed, unchanged otherwise.
+ *  \param end End of the text.
+ *  \param value On exit, the parsed number.
+ *  \return true if a number that is followed by a delimiter, a line break
+ *          or the end of the text was found, false otherwise.
+ */
+StfioDll bool parseDouble(const char*& pos, const char* end, double& value);
+
+//! Parses columns of numbers from text.
+/*! Values are separated by tabs, commas or spaces, and each non-empty
+ *  line is a row; additional values at the end of a row are ignored.
+ *  Large texts are split into chunks at line breaks that are parsed
+ *  in parallel. Throws std::runtime_error if a row has too few values
+ *  or a value isn't a number.
+ *  \param begin Start of the text.
+ *  \param end End of the text.
+ *  \param columns On entry, one vector per column to be read. On exit, the
+ *         values of each column.
+ *  \param nChunks Number of chunks, or 0 to choose it from the size of the
+ *         text and the number of threads.
+ */
+StfioDll void parseTextColumns(const char* begin, const char* end,
+                               std::vector<Vector_double>& columns, int nChunks = 0);
+
+//! The start of a text file and the layout guessed from it.
+/*! Returned by stfio::sniffText() and stfio::previewTextFile(). */
+struct StfioDll TextPreview {
+    TextPreview() : text(), delimiter('\t'), hLines(0), nColumns(0),
+        firstIsTime(false), sr(0), truncated(false) {}
+
+    std::string text;  /*!< The complete lines that have been read. */
+    char delimiter;    /*!< Tab, comma or space, whichever separates the values of the data rows. */
+    int hLines;        /*!< Number of lines before the first row of numbers. */
+    int nColumns;      /*!< Smallest number of values in a row of numbers; 0 if there was none. */
+    bool firstIsTime;  /*!< true if the first of several columns increases in constant steps. */
+    double sr;         /*!< Sampling rate from the steps of the first column; 0 unless firstIsTime. */
+    bool truncated;    /*!< true if the text continues after the preview. */
+};
+
+//! Guesses the layout of a text from its first lines.
+/*! A line is a row of numbers if all of its values can be read by
+ *  stfio::parseDouble(); rows are split in the same way as by
+ *  stfio::parseTextColumns(). Lines of text after the first row of
+ *  numbers are ignored; the importer reports them.
+ *  \param begin Start of the text.
+ *  \param end End of the text.
+ *  \param maxLines Largest number of lines that are examined.
+ *  eturn The examined lines and their layout.
+ */
+StfioDll TextPreview sniffText(const char* begin, const char* end, std::size_t maxLines = 100);
+
+//! Reads the first lines of a text file and guesses its layout.
+/*! At most \e maxBytes are read from the file, so that previews of large
+ *  files are cheap; a line that has been cut off is dropped. Throws
+ *  std::runtime_error if the file can't be opened.
+ *  \param fName Full path to the file.
+ *  \param maxLines Largest number of lines in the preview.
+ *  \param maxBytes Largest number of bytes that are read.
+ *  eturn The preview and the layout guessed from it.
+ */
+StfioDll TextPreview previewTextFile(const std::string& fName, std::size_t maxLines = 100,
+                                     std::size_t maxBytes = 65536);
+
+//! Copies the layout of a preview into import settings.
+/*! Settings that can't be guessed, such as units and whether columns
+ *  become sections or channels, are left unchanged. The sampling rate is
+ *  only set if the first column holds time values.
+ *  \param preview The preview, e.g. from stfio::previewTextFile().
+ *  \param txtImport On entry, the current settings. On exit, the settings
+ *         with the guessed header lines, columns and sampling rate.
+ */
+StfioDll void applyTextPreview(const TextPreview& preview, txtImportSettings& txtImport);
+
 //! Open an ASCII file and store its contents to a Recording object.
 /*! \param fName Full path to the file to be read.
  *  \param hLinesToSkip Header lines to skip.
@@ -35,7 +114,7 @@ namespace stfio {
  *         false if they should be put into different channels.
  *  \param ReturnRec On entry, an empty Recording object. On exit,
  *         the data stored in \e fName.
- *  \param progress True if the progress dialog should be updated.
+ *  \param progDlg Progress indicator.
  */
 void importASCIIFile(const std::string& fName,
         int hLinesToSkip,
@@ -46,23 +125,26 @@ void importASCIIFile(const std::string& fName,
         ProgressInfo& progDlg);
 
 //! Export a Section to a text file.
-/*! \param fName Full path to the file to be written.
+/*! The first line holds the number of data points, followed by one line
+ *  with the time and the value of each data point. Values are written
+ *  with the shortest text that reads back as the same number.
+ *  \param fName Full path to the file to be written.
  *  \param Export The section to be exported.
+ *  \param n_threads Number of threads that format the text, or 0 to use the configured number of threads.
  *  \return true upon success, false otherwise.
  */
-bool exportASCIIFile(const std::string& fName, const Section& Export);
+StfioDll bool exportASCIIFile(const std::string& fName, const Section& Export, int n_threads=0);
 
 //! Export a Channel to a text file.
-/*! \param fName Full path to the file to be written.
+/*! Every section is written to a file of its own, called
+ *  \e fName_0.txt, \e fName_1.txt and so on.
+ *  \param fName Full path to the file to be written.
  *  \param Export The channel to be exported.
+ *  \param n_threads Number of threads that format the text, or 0 to use the configured number of threads.
  *  \return true upon success, false otherwise.
  */
-bool exportASCIIFile(const std::string& fName, const Channel& Export);
+StfioDll bool exportASCIIFile(const std::string& fName, const Channel& Export, int n_threads=0);
  
-#if 0
-std::string NextWord( std::string& str );
-#endif
-
 }
 
 #endif
@@ -14,12 +14,54 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #include "./atflib.h"
 #include "../recording.h"
+#include "../mappedfile.h"
+#include "../ascii/asciilib.h"
+#include "../textwriter.h"
 
 namespace stfio {
     std::string ATFError(const std::string& fName, int nError);
+    void importATFFileAxon(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg);
+}
+
+namespace {
+
+// Reads a line and moves pos to the start of the next line:
+std::string readLine(const char*& pos, const char* end) {
+    const char* line_end = (const char*)memchr(pos, '\n', end-pos);
+    if (line_end == NULL) {
+        line_end = end;
+    }
+    std::string line(pos, line_end);
+    if (!line.empty() && line[line.size()-1] == '\r') {
+        line.resize(line.size()-1);
+    }
+    pos = (line_end == end) ? end : line_end+1;
+    return line;
+}
+
+// Splits a heading such as "Trace #1 (pA)" into its title and units:
+void splitHeading(std::string heading, std::string& title, std::string& units) {
+    if (heading.size() >= 2 && heading[0] == '"' && heading[heading.size()-1] == '"') {
+        heading = heading.substr(1, heading.size()-2);
+    }
+    std::size_t open = heading.find('(');
+    std::size_t close = heading.find(')', open);
+    if (open != std::string::npos && close != std::string::npos) {
+        units = heading.substr(open+1, close-open-1);
+        heading.resize(open);
+    } else {
+        units.clear();
+    }
+    std::size_t last = heading.find_last_not_of(' ');
+    title = (last == std::string::npos) ? std::string() : heading.substr(0, last+1);
+}
+
 }
 
 std::string stfio::ATFError(const std::string& fName, int nError) {
@@ -29,83 +71,132 @@ std::string stfio::ATFError(const std::string& fName, int nError) {
     return std::string( &errorMsg[0] );
 }
 
-bool stfio::exportATFFile(const std::string& fName, const Recording& WData) {
-    int nColumns=1+(int)WData[0].size() /*time + number of sections*/, nFileNum;
-    int nError;
-
-    if (!ATF_OpenFile(fName.c_str(),ATF_WRITEONLY,&nColumns,&nFileNum,&nError)) {
-        std::string errorMsg("Exception while calling ATF_OpenFile():\n");
-        errorMsg += ATFError(fName,nError);
-        throw std::runtime_error(errorMsg);
-    }
-    // Write sections to columns:
-    // First column is time:
-    for (int n_c=0;n_c<nColumns;++n_c) {
-        std::string columnTitle,columnUnits;
+bool stfio::exportATFFile(const std::string& fName, const RecordingView& WData, int n_threads) {
+    // The header is the one that the Axon library writes; the first
+    // column is time, followed by one column per section:
+    std::size_t nColumns = 1+WData[0].size();
+    std::ostringstream header;
+    header << "ATF\t1.0\r\n" << 0 << "\t" << nColumns << "\r\n";
+    for (std::size_t n_c=0; n_c<nColumns; ++n_c) {
+        std::ostringstream heading;
+        std::string units;
         if (n_c==0) {
-            columnTitle = "Time";
-            columnUnits = WData.GetXUnits();
+            heading << "Time";
+            units = WData.GetXUnits();
         } else {
-            std::ostringstream titleStr;
-            titleStr << "Section[" << n_c-1 << "]";
-            columnTitle = titleStr.str();
-            columnUnits = WData[0].GetYUnits();
-        }
-        if (!ATF_SetColumnTitle(nFileNum, columnTitle.c_str(), &nError)) {
-            std::string errorMsg("Exception while calling ATF_SetColumnTitle():\n");
-            errorMsg+=ATFError(fName,nError);
-            throw std::runtime_error(errorMsg);
+            heading << "Section[" << n_c-1 << "]";
+            units = WData[0].GetYUnits();
         }
-        if (!ATF_SetColumnUnits(nFileNum, columnUnits.c_str(),&nError)) {
-            std::string errorMsg("Exception while calling ATF_SetColumnUnits():\n");
-            errorMsg+=ATFError(fName,nError);
-            throw std::runtime_error(errorMsg);
+        if (!units.empty()) {
+            heading << " (" << units << ")";
         }
+        header << (n_c==0 ? "" : "\t") << "\"" << heading.str() << "\"";
+    }
+    header << "\r\n";
+
+    std::size_t max_size=0;
+    for (std::size_t n_s=0; n_s<WData[0].size(); ++n_s) {
+        max_size = std::max(max_size, WData[0][n_s].size());
+    }
+    // Time keeps the 12 significant digits of the Axon library, and
+    // shorter sections are padded with zeros:
+    std::vector<TextColumn> columns;
+    columns.push_back(TextColumn(max_size, WData.GetXScale(), 12));
+    for (std::size_t n_s=0; n_s<WData[0].size(); ++n_s) {
+        columns.push_back(TextColumn(WData[0][n_s]));
+    }
+    writeTextTable(fName, header.str(), columns, "\t", "\r\n", 0.0, n_threads);
+    return true;
+}
+
+void stfio::importATFFile(const std::string &fName, Recording &ReturnData, ProgressInfo& progDlg) {
+    MappedFile file(fName);
+    const char* pos = file.GetData();
+    const char* end = pos + file.GetSize();
+
+    std::string line = readLine(pos, end);
+    if (line.compare(0, 3, "ATF") != 0) {
+        throw std::runtime_error("Error while opening ATF file:\nNot an ATF file");
     }
-    // Write data line by line:
-    std::size_t max_size=WData[0][0].size();
-    // check for equal section sizes:
-    for (int n_s=1;n_s<(int)WData[0].size();++n_s) {
-        if (WData[0][n_s].size() > max_size) {
-            max_size=WData[0][n_s].size();
+    if (atof(line.c_str()+3) == 0.0) {
+        // Headings of old PAF files are stored differently:
+        importATFFileAxon(fName, ReturnData, progDlg);
+        return;
+    }
+    int nHeaders = 0, nColumns = 0;
+    std::istringstream counts(readLine(pos, end));
+    counts >> nHeaders >> nColumns;
+    if (!counts) {
+        throw std::runtime_error("Error while opening ATF file:\nBad header");
+    }
+    // Assume that the first column is time:
+    if (nColumns<=0) {
+        std::string errorMsg("Error while opening ATF file:\nFile appears to be empty");
+        throw std::runtime_error(errorMsg);
+    }
+    std::string header;
+    for (int n_h=0; n_h<nHeaders; ++n_h) {
+        if (pos >= end) {
+            throw std::runtime_error("Error while opening ATF file:\nUnexpected end of header");
         }
+        header += readLine(pos, end) + "\n";
     }
-    for (int n_l=0;n_l < (int)max_size; ++n_l) {
-        for (int n_c=0;n_c<nColumns;++n_c) {
-            if (n_c==0) {
-                // Write time:
-                double time=n_l*WData.GetXScale();
-                if (!ATF_WriteDataRecord1(nFileNum,time,&nError)) {
-                    std::string errorMsg("Exception while calling ATF_WriteDataRecord1():\n");
-                    errorMsg+=ATFError(fName,nError);
-                    throw std::runtime_error(errorMsg);
-                }
-            } else {
-                double toWrite = (n_l < (int)WData[0][n_c-1].size()) ?
-                        (double)WData[0][n_c-1][n_l] :
-                0.0;
-                        if (!ATF_WriteDataRecord1(nFileNum,toWrite,&nError)) {
-                            std::string errorMsg("Exception while calling ATF_WriteDataRecord1():\n");
-                            errorMsg+=ATFError(fName,nError);
-                            throw std::runtime_error(errorMsg);
-                        }
-            }
+    std::vector<std::string> titles, units;
+    std::string headings = readLine(pos, end);
+    std::size_t start = 0;
+    while (start <= headings.size() && (int)titles.size() < nColumns) {
+        std::size_t stop = headings.find_first_of("\t,", start);
+        if (stop == std::string::npos) {
+            stop = headings.size();
         }
-        if (!ATF_WriteEndOfLine(nFileNum,&nError)) {
-            std::string errorMsg("Exception while calling ATF_WriteEndOfLine():\n");
-            errorMsg+=ATFError(fName,nError);
-            throw std::runtime_error(errorMsg);
+        std::string title, unit;
+        splitHeading(headings.substr(start, stop-start), title, unit);
+        titles.push_back(title);
+        units.push_back(unit);
+        start = stop+1;
+    }
+    titles.resize(nColumns);
+    units.resize(nColumns);
+
+    progDlg.Update(0, "Reading data");
+    std::vector<Vector_double> columns(nColumns);
+    parseTextColumns(pos, end, columns);
+
+    // If first column contains time values, determine sampling interval:
+    int timeInFirstColumn=0;
+    if (titles[0].find("time")!=std::string::npos ||
+            titles[0].find("Time")!=std::string::npos ||
+            titles[0].find("TIME")!=std::string::npos)
+    {
+        if (columns[0].size() < 2) {
+            throw std::runtime_error("Error while opening ATF file:\nToo few samples");
         }
+        ReturnData.SetXScale(columns[0][1]-columns[0][0]);
+        timeInFirstColumn=1;
     }
-    if (!ATF_CloseFile(nFileNum)) {
-        std::string errorMsg("Exception while calling ATF_CloseFile():\n");
-        errorMsg += "Error while closing ATF file";
-        throw std::runtime_error(errorMsg);
+    progDlg.Update(50, "Creating sections");
+    ReturnData.resize(1);
+    ReturnData[0].resize(nColumns-timeInFirstColumn);
+    for (int n_c=timeInFirstColumn;n_c<nColumns;++n_c) {
+        std::ostringstream label;
+        label
+            << fName
+            << ", Section # " << n_c-timeInFirstColumn+1;
+        Section& sec = ReturnData[0][n_c-timeInFirstColumn];
+        sec.SetSectionDescription(label.str());
+        // the parsed values aren't copied:
+        sec.get_w().swap(columns[n_c]);
     }
-    return true;
+    if (timeInFirstColumn) {
+        ReturnData.SetXUnits(units[0]);
+    }
+    if (timeInFirstColumn < nColumns) {
+        ReturnData[0].SetYUnits(units[timeInFirstColumn]);
+    }
+    ReturnData.SetFileDescription(header);
 }
 
-void stfio::importATFFile(const std::string &fName, Recording &ReturnData, ProgressInfo& progDlg) {
+void stfio::importATFFileAxon(const std::string &fName, Recording &ReturnData, ProgressInfo& progDlg) {
     int nColumns, nFileNum;
     int nError;
     const int nMaxText=64;
@@ -190,7 +281,7 @@ void stfio::importATFFile(const std::string &fName, Recording &ReturnData, Progr
             ReturnData[0].SetYUnits(std::string(&unitsVec[0]));
         }
         try {
-            TempChannel.InsertSection(TempSection,n_c-timeInFirstColumn);
+            TempChannel.InsertSection(STFIO_MOVE(TempSection),n_c-timeInFirstColumn);
         }
         catch (...) {
             throw;
@@ -204,7 +295,7 @@ void stfio::importATFFile(const std::string &fName, Recording &ReturnData, Progr
         }
     }
     try {
-        ReturnData.InsertChannel(TempChannel,0);
+        ReturnData.InsertChannel(STFIO_MOVE(TempChannel),0);
     }
     catch (...) {
         ReturnData.resize(0);
@@ -25,6 +25,7 @@
 #include "./../abf/axon/AxAtfFio32/axatffio32.h"
 
 class Recording;
+class RecordingView;
 
 namespace stfio {
 
@@ -37,10 +38,13 @@ namespace stfio {
 void importATFFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg);
 
 //! Export a Recording to an ATF file.
-/*! \param fName Full path to the file to be written.
+/*! The sections of the first channel are written as columns, with
+ *  the shortest text that reads back as the same number.
+ *  \param fName Full path to the file to be written.
  *  \param WData The data to be exported.
+ *  \param n_threads Number of threads that format the text, or 0 to use the configured number of threads.
  */
-StfioDll bool exportATFFile(const std::string& fName, const Recording& WData);
+StfioDll bool exportATFFile(const std::string& fName, const RecordingView& WData, int n_threads=0);
 
 }
 
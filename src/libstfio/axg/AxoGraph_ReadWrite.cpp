@@ -133,7 +133,18 @@ int AG_GetNumberOfColumns( filehandle refNum, const int fileFormat, AXGLONG *num
 }
 
 
-int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumber, ColumnData *columnData )
+// Reads the samples of a column as they are stored in the file.
+static int ReadRawColumnData( filehandle refNum, AXGLONG columnBytes, std::vector<char> *rawData )
+{
+    rawData->resize( columnBytes );
+    if ( rawData->empty() )
+        return kAG_MemoryErr;
+    return ReadFromFile( refNum, &columnBytes, &(*rawData)[0] );
+}
+
+
+int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumber, ColumnData *columnData,
+                   std::vector<char> *rawData )
 {
     // Initialize in case of error during read
     columnData->points = 0;
@@ -161,6 +172,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
              PascalToCString( columnHeader.title );
              columnData->title = std::string( (char*)columnHeader.title );
 
+             if ( rawData )
+                 return ReadRawColumnData( refNum, columnHeader.points * sizeof( float ), rawData );
+
              // create a new pointer to receive the data
              AXGLONG columnBytes = columnHeader.points * sizeof( float );
              columnData->floatArray.resize( columnHeader.points );
@@ -228,6 +242,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
                  columnData->scaledShortArray.scale = columnHeader.scalingFactor;
                  columnData->scaledShortArray.offset = 0;
 
+                 if ( rawData )
+                     return ReadRawColumnData( refNum, columnHeader.points * sizeof( short ), rawData );
+
                  // create a new pointer to receive the data
                  AXGLONG columnBytes = columnHeader.points * sizeof( short );
                  columnData->scaledShortArray.shortArray.resize( columnHeader.points );
@@ -285,6 +302,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
              {
               case ShortArrayType:
                   {
+                      if ( rawData )
+                          return ReadRawColumnData( refNum, columnHeader.points * sizeof( short ), rawData );
+
                       // create a new pointer to receive the data
                       AXGLONG columnBytes = columnHeader.points * sizeof( short );
                       columnData->shortArray.resize( columnHeader.points );
@@ -302,6 +322,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
                   }
               case IntArrayType:
                   {
+                      if ( rawData )
+                          return ReadRawColumnData( refNum, columnHeader.points * sizeof( int ), rawData );
+
                       // create a new pointer to receive the data
                       AXGLONG columnBytes = columnHeader.points * sizeof( int );
                       columnData->intArray.resize( columnHeader.points );
@@ -319,6 +342,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
                   }
               case FloatArrayType:
                   {
+                      if ( rawData )
+                          return ReadRawColumnData( refNum, columnHeader.points * sizeof( float ), rawData );
+
                       // create a new pointer to receive the data
                       AXGLONG columnBytes = columnHeader.points * sizeof( float );
                       columnData->floatArray.resize( columnHeader.points );
@@ -335,6 +361,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
                   }
               case DoubleArrayType:
                   {
+                      if ( rawData )
+                          return ReadRawColumnData( refNum, columnHeader.points * sizeof( double ), rawData );
+
                       // create a new pointer to receive the data
                       AXGLONG columnBytes = columnHeader.points * sizeof( double );
                       columnData->doubleArray.resize( columnHeader.points );
@@ -379,6 +408,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
                       columnData->scaledShortArray.scale = scale;
                       columnData->scaledShortArray.offset = offset;
 
+                      if ( rawData )
+                          return ReadRawColumnData( refNum, columnHeader.points * sizeof( short ), rawData );
+
                       // create a new pointer to receive the data
                       AXGLONG columnBytes = columnHeader.points * sizeof( short );
                       columnData->scaledShortArray.shortArray.resize( columnHeader.points );
@@ -367,7 +367,8 @@ int AG_GetNumberOfColumns( filehandle refNum, const int fileFormat, AXGLONG *num
 //    If an error occurs, returns the result from the file access functions,
 
 
-int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumber, ColumnData *columnData );
+int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumber, ColumnData *columnData,
+                   std::vector<char> *rawData = NULL );
 
 //    Read in a column from any AxoGraph data file.
 //    Called once for each column in the file.
@@ -375,6 +376,9 @@ int AG_ReadColumn( filehandle refNum, const int fileFormat, const int columnNumb
 //    the column title, and the column data.
 //    This function allocates new pointers of the appropriate size, reads the data into
 //    them and returns it in columnData.
+//    If rawData is given, the samples of short, int, float, double and scaled short columns
+//    are returned in rawData as they are stored in the file, i.e. in big-endian byte order,
+//    and the arrays in columnData are left empty. Scaling factors are still returned in columnData.
 
 std::string AG_ReadComment( filehandle refNum );
 
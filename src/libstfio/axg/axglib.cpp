@@ -88,6 +88,13 @@ void stfio::importAXGFile(const std::string &fName, Recording &ReturnData, Progr
     std::vector< std::string > channel_names;
     std::vector< std::string > channel_units;
     double xscale = 1.0;
+    // AxoGraph files are big-endian:
+#ifdef __LITTLE_ENDIAN__
+    const bool swapBytes = true;
+#else
+    const bool swapBytes = false;
+#endif
+    std::vector<char> rawData;
     for ( int columnNumber=0; columnNumber<numberOfColumns; columnNumber++ )
     {
         if (columnNumber != 0) {
@@ -103,7 +110,12 @@ void stfio::importAXGFile(const std::string &fName, Recording &ReturnData, Progr
         }
 
         ColumnData column;
-        result = AG_ReadFloatColumn( dataRefNum, fileFormat, columnNumber, &column );
+        if ( columnNumber == 0 ) {
+            result = AG_ReadFloatColumn( dataRefNum, fileFormat, columnNumber, &column );
+        } else {
+            // samples are decoded straight from the file buffer into the section:
+            result = AG_ReadColumn( dataRefNum, fileFormat, columnNumber, &column, &rawData );
+        }
 
         if ( result )
         {
@@ -115,20 +127,38 @@ void stfio::importAXGFile(const std::string &fName, Recording &ReturnData, Progr
         if ( columnNumber == 0 ) {
             xscale = column.seriesArray.increment * 1.0e3;
         } else {
-            section_list.push_back( Section(column.points, column.title ) );
-            std::size_t last = section_list.size()-1;
-
             if (column.points<1) {
                 throw std::out_of_range("number of points too small");
             }
-            if ((int)column.floatArray.size()<column.points) {
-                throw std::out_of_range("floatArray too small in importAXGFile()");
-            }
-            if (section_list[last].get().size()!=column.floatArray.size()) {
-                throw std::out_of_range("section too small in importAXGFile()");
-            }
+            section_list.push_back( Section(column.points, column.title ) );
+            Vector_double& data = section_list[section_list.size()-1].get_w();
 
-            std::copy(column.floatArray.begin(),column.floatArray.end(),section_list[last].get_w().begin());
+            if (column.type == SeriesArrayType) {
+                for (AXGLONG i = 0; i < column.points; ++i) {
+                    data[i] = column.seriesArray.firstValue + i * column.seriesArray.increment;
+                }
+            } else {
+                stfio::SampleType type = stfio::sample_float32;
+                double scale = 1.0, offset = 0.0;
+                switch (column.type) {
+                 case ShortArrayType: type = stfio::sample_int16; break;
+                 case IntArrayType: type = stfio::sample_int32; break;
+                 case FloatArrayType: type = stfio::sample_float32; break;
+                 case DoubleArrayType: type = stfio::sample_float64; break;
+                 case ScaledShortArrayType:
+                     type = stfio::sample_int16;
+                     scale = column.scaledShortArray.scale;
+                     offset = column.scaledShortArray.offset;
+                     break;
+                 default:
+                     throw std::out_of_range("Unsupported column type in importAXGFile()");
+                }
+                if (rawData.size() < column.points*stfio::sampleSize(type)) {
+                    throw std::out_of_range("column data too small in importAXGFile()");
+                }
+                stfio::decodeSamples(&rawData[0], column.points, stfio::sampleSize(type), type,
+                                     swapBytes, scale, offset, &data[0]);
+            }
             // check whether this is a new channel:
             bool isnew = true;
 
@@ -165,10 +195,10 @@ void stfio::importAXGFile(const std::string &fName, Recording &ReturnData, Progr
         }
         for (std::size_t n_s=n_c; (int)n_s < numberOfColumns-1; n_s += numberOfChannels) {
             if (factor != 1.0) {
-                section_list[n_s].get_w() = stfio::vec_scal_mul(section_list[n_s].get(), factor);
+                stfio::vec_scal_mul(section_list[n_s].get(), factor, section_list[n_s].get_w());
             }
             try {
-                TempChannel.InsertSection( section_list[n_s], (n_s-n_c)/numberOfChannels );
+                TempChannel.InsertSection( STFIO_MOVE(section_list[n_s]), (n_s-n_c)/numberOfChannels );
             }
             catch (...) {
                 ReturnData.resize(0);
@@ -182,7 +212,7 @@ void stfio::importAXGFile(const std::string &fName, Recording &ReturnData, Progr
             if ((int)ReturnData.size()<numberOfChannels) {
                 ReturnData.resize(numberOfChannels);
             }
-            ReturnData.InsertChannel(TempChannel,n_c);
+            ReturnData.InsertChannel(STFIO_MOVE(TempChannel),n_c);
         }
         catch (...) {
             ReturnData.resize(0);
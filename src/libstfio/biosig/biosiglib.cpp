@@ -15,6 +15,12 @@
 // Copyright 2012,2013,2017 Alois Schloegl, IST Austria
 
 #include <sstream>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "../stfio.h"
 
@@ -54,6 +60,66 @@ extern "C" uint32_t lcm(uint32_t A, uint32_t B);
 
 
 #include "./biosiglib.h"
+#include "../parallel.h"
+
+namespace {
+    // Maximal number of samples of all channels that are decoded at once:
+    const size_t biosigBlockSamples = 1 << 20;
+    // Maximal number of bytes of GDF rawdata that are packed at once:
+    const size_t biosigBlockBytes = 1 << 23;
+
+    // The position of the next sample of a channel that is packed into rawdata:
+    struct PackCursor {
+        PackCursor() : m(0), n(0), len(0) {}
+        size_t m;    // section
+        size_t n;    // sample within the section
+        size_t len;  // samples of all previous sections, at the sampling rate of the file
+    };
+
+    // Packs the samples of a channel that fall into records [rec_begin, rec_end)
+    // into block, which holds these records with bpb bytes each; bi is the byte
+    // offset of the channel within a record. Samples are read section by section
+    // with Section::CopyRange(), so that channels can be packed in parallel.
+    void packChannel(const Channel& ch, double xscale, size_t SPR, size_t bpb, size_t bi,
+                     size_t rec_begin, size_t rec_end, uint8_t* block, PackCursor& cursor)
+    {
+        Vector_double buffer;
+        for (; cursor.m < ch.size(); ++cursor.m) {
+            const Section& sec = ch[cursor.m];
+            size_t div = lround(sec.GetXScale()/xscale);
+            size_t div2 = SPR/div;
+            // samples that belong to a record before rec_end:
+            size_t n_end = 0;
+            if (rec_end*SPR > cursor.len) {
+                n_end = (std::min)((rec_end*SPR - cursor.len + div - 1) / div, sec.size());
+            }
+            if (n_end > cursor.n) {
+                buffer.resize(n_end - cursor.n);
+                sec.CopyRange(cursor.n, n_end, &buffer[0]);
+                for (size_t n = cursor.n; n < n_end; ++n) {
+                    uint64_t val;
+                    double d = buffer[n - cursor.n];
+#if !defined(__MINGW32__) && !defined(_MSC_VER) && !defined(__APPLE__)
+                    val = htole64(*(uint64_t*)&d);
+#else
+                    val = *(uint64_t*)&d;
+#endif
+                    size_t spr = (cursor.len + n*div) / SPR - rec_begin;
+                    uint64_t* dest = (uint64_t*)(block + bi + bpb * spr);
+                    for (size_t p=0; p < div2; p++)
+                        dest[p] = val;
+                }
+                cursor.n = n_end;
+            }
+            if (cursor.n < sec.size()) {
+                // continues in the next block
+                return;
+            }
+            cursor.len += div*sec.size();
+            cursor.n = 0;
+        }
+    }
+}
 
 /* Redefine BIOSIG_VERSION for versions < 1 */
 #if (BIOSIG_VERSION_MAJOR < 1)
@@ -217,60 +283,77 @@ stfio::filetype stfio::importBiosigFile(const std::string &fName, Recording &Ret
     /*************************************************************************
         read bulk data
      *************************************************************************/
-    biosig_data_type *data = biosig_get_data(hdr, 0);
-    size_t SPR = biosig_get_number_of_samples(hdr);
-
 #ifdef _STFDEBUG
     std::cout << "Number of events: " << numberOfEvents << std::endl;
     /*int res = */ hdr2ascii(hdr, stdout, 4);
 #endif
 
-    for (int NS=0; NS < numberOfChannels; ) {
+    // The sections are allocated first; records are then read in blocks
+    // of bounded size and scattered into them, so that the whole file
+    // doesn't have to be decoded into a second buffer. (std::min) and
+    // (std::max) aren't expanded by the macros of biosig:
+    for (size_t ns=1; ns<=nsections; ns++) {
+        if (SegIndexList[ns] < SegIndexList[ns-1]) {
+            ReturnData.resize(0);
+            destructHDR(hdr);
+            return type;
+        }
+    }
+    ReturnData.resize(numberOfChannels);
+    for (int NS=0; NS < numberOfChannels; ++NS) {
         CHANNEL_TYPE *hc = biosig_get_channel(hdr, NS);
         Channel TempChannel(nsections);
         TempChannel.SetChannelName(biosig_channel_get_label(hc));
         TempChannel.SetYUnits(biosig_channel_get_physdim(hc));
-
+        ReturnData.InsertChannel(STFIO_MOVE(TempChannel), NS);
+        // allocated in place, so that the data are never copied:
         for (size_t ns=1; ns<=nsections; ns++) {
-            if (SegIndexList[ns]-SegIndexList[ns-1] < 0) {
-                ReturnData.resize(0);
-                destructHDR(hdr);
-                return type;
-            }
-            size_t SPS = SegIndexList[ns]-SegIndexList[ns-1];	// length of segment, samples per segment
-
-            int progbar = int(100.0 * (1.0 * ns / nsections + NS) / numberOfChannels);
-            std::ostringstream progStr;
-            progStr << "Reading channel #" << NS + 1 << " of " << numberOfChannels
-                << ", Section #" << ns << " of " << nsections;
-            progDlg.Update(progbar, progStr.str());
-
-            Section TempSection(SPS, "");
-
-            std::copy(&(data[NS*SPR + SegIndexList[ns-1]]),
-			    &(data[NS*SPR + SegIndexList[ns]]),
-			    TempSection.get_w().begin() );
-
-            try {
-                TempChannel.InsertSection(TempSection, ns-1);
-            }
-            catch (...) {
-                ReturnData.resize(0);
-                destructHDR(hdr);
-                return type;
-            }
-        }   // end for sections
-        try {
-            if ((int)ReturnData.size() < numberOfChannels)
-                ReturnData.resize(numberOfChannels);
-            ReturnData.InsertChannel(TempChannel, NS++);
+            ReturnData[NS][ns-1].resize(SegIndexList[ns]-SegIndexList[ns-1]);
         }
-        catch (...) {
+    }
+
+    size_t NRec = biosig_get_number_of_records(hdr);
+    size_t SPR = NRec > 0 ? biosig_get_number_of_samples(hdr) / NRec : 0;  // samples per record
+    size_t blockRecords = (std::max)(NRec, (size_t)1);
+#if defined(WITH_BIOSIGLITE)
+    // Only the bundled libbiosig is known to find the records of later blocks in sread():
+    if (SPR > 0 && numberOfChannels > 0) {
+        blockRecords = (std::max)(biosigBlockSamples / (SPR*numberOfChannels), (size_t)1);
+    }
+#endif
+    biosig_reset_flag(hdr, BIOSIG_FLAG_ROW_BASED_CHANNELS);
+    size_t ns = 0;
+    for (size_t nr = 0; nr < NRec; ) {
+        size_t count = sread(NULL, nr, (std::min)(blockRecords, NRec-nr), hdr);
+        biosig_data_type *data = NULL;
+        size_t rows = 0, columns = 0;
+        biosig_get_datablock(hdr, &data, &rows, &columns);
+        if (count == 0 || biosig_check_error(hdr) || (int)columns < numberOfChannels) {
             ReturnData.resize(0);
             destructHDR(hdr);
             return type;
         }
-    }   // end for channels
+        // channel NS of the block is stored in data[NS*rows] to data[(NS+1)*rows]:
+        size_t first = nr*SPR, last = first+rows;
+        while (ns < nsections && SegIndexList[ns+1] <= first) {
+            ++ns;
+        }
+        for (size_t n_s = ns; n_s < nsections && SegIndexList[n_s] < last; ++n_s) {
+            size_t begin = (std::max)(SegIndexList[n_s], first);
+            size_t end = (std::min)(SegIndexList[n_s+1], last);
+            for (int NS=0; NS < numberOfChannels; ++NS) {
+                Section& sec = ReturnData[NS][n_s];
+                std::copy(&data[NS*rows + begin-first], &data[NS*rows + end-first],
+                          sec.get_w().begin() + (begin-SegIndexList[n_s]));
+            }
+        }
+        nr += count;
+
+        int progbar = int(100.0 * nr / NRec);
+        std::ostringstream progStr;
+        progStr << "Reading record #" << nr << " of " << NRec;
+        progDlg.Update(progbar, progStr.str());
+    }
 
     ReturnData.SetComment ( biosig_get_recording_id(hdr) );
 
@@ -493,7 +576,7 @@ stfio::filetype stfio::importBiosigFile(const std::string &fName, Recording &Ret
 			  TempSection.get_w().begin() );
 
         try {
-            TempChannel.InsertSection(TempSection, ns-1);
+            TempChannel.InsertSection(STFIO_MOVE(TempSection), ns-1);
         }
         catch (...) {
 			ReturnData.resize(0);
@@ -505,7 +588,7 @@ stfio::filetype stfio::importBiosigFile(const std::string &fName, Recording &Ret
         if ((int)ReturnData.size() < numberOfChannels) {
             ReturnData.resize(numberOfChannels);
         }
-        ReturnData.InsertChannel(TempChannel, NS++);
+        ReturnData.InsertChannel(STFIO_MOVE(TempChannel), NS++);
     }
     catch (...) {
 		ReturnData.resize(0);
@@ -753,39 +836,17 @@ bool stfio::exportBiosigFile(const std::string& fName, const Recording& Data, st
         biosig_set_eventtable_samplerate(hdr, fs);
         sort_eventtable(hdr);
 
-        /* convert data into GDF rawdata from  */
-        uint8_t *rawdata = (uint8_t*)malloc(bpb * NRec);
-
+        /* byte offset of each channel within a record */
+        std::vector<size_t> chanOffset(numberOfChannels);
         size_t bi=0;
 	for (k=0; k < numberOfChannels; ++k) {
-        CHANNEL_TYPE *hc = biosig_get_channel(hdr, k);
 #ifdef DONOTUSE_DYNAMIC_ALLOCATION_FOR_CHANSPR
+        CHANNEL_TYPE *hc = biosig_get_channel(hdr, k);
         size_t chSPR = biosig_channel_get_samples_per_record(hc);
 #else
         size_t chSPR = chanSPR[k];
 #endif
-        size_t m,n,len=0;
-        for (m=0; m < Data[k].size(); ++m) {
-
-            size_t div = lround(Data[k][m].GetXScale()/Data.GetXScale());
-            size_t div2 = SPR/div;		  // TODO: avoid using hdr->SPR
-
-            // fprintf(stdout,"k,m,div,div2: %i,%i,%i,%i\n",(int)k,(int)m,(int)div,(int)div2);  //
-            for (n=0; n < Data[k][m].size(); ++n) {
-                uint64_t val;
-                double d = Data[k][m][n];
-#if !defined(__MINGW32__) && !defined(_MSC_VER) && !defined(__APPLE__)
-                val = htole64(*(uint64_t*)&d);
-#else
-                val = *(uint64_t*)&d;
-#endif
-                size_t p, spr = (len + n*div) / SPR;
-
-                for (p=0; p < div2; p++)
-                   *(uint64_t*)(rawdata + bi + bpb * spr + p*8) = val;
-            }
-            len += div*Data[k][m].size();
-        }
+        chanOffset[k] = bi;
 		bi += chSPR*8;
     }
 
@@ -806,11 +867,35 @@ bool stfio::exportBiosigFile(const std::string& fName, const Recording& Data, st
         return false;
     }
 
-    ifwrite(rawdata, bpb, NRec, hdr);
+    /* convert data into GDF rawdata block by block, and write each block
+       as soon as it has been packed, so that the rawdata of the whole
+       recording never has to be held in memory */
+    size_t blockRecords = (std::max)(biosigBlockBytes / (bpb > 0 ? bpb : 1), (size_t)1);
+    std::vector<uint8_t> rawdata(blockRecords * bpb);
+    std::vector<PackCursor> cursors(numberOfChannels);
+    int n_channels = (int)numberOfChannels;
+    for (size_t rec = 0; rec < NRec; rec += blockRecords) {
+        size_t rec_end = (std::min)(rec + blockRecords, NRec);
+#ifdef _OPENMP
+        int n_threads = stfio::threadCount(0, n_channels);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+        for (int n_c = 0; n_c < n_channels; ++n_c) {
+            packChannel(Data[n_c], Data.GetXScale(), SPR, bpb, chanOffset[n_c], rec, rec_end,
+                        &rawdata[0], cursors[n_c]);
+        }
+        if (ifwrite(&rawdata[0], bpb, rec_end - rec, hdr) != rec_end - rec) {
+            sclose(hdr);
+            destructHDR(hdr);
+            throw std::runtime_error("Couldn't write to file in exportBiosigFile()");
+        }
+        std::ostringstream progStr;
+        progStr << "Writing record #" << rec_end << " of " << NRec;
+        progDlg.Update(int(100.0 * rec_end / NRec), progStr.str());
+    }
 
     sclose(hdr);
     destructHDR(hdr);
-    free(rawdata);
 
 
 #else   // #ifndef __LIBBIOSIG2_H__
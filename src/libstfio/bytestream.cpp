@@ -0,0 +1,57 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file bytestream.cpp
+ *  \brief Defines the compact binary encoding of recording attributes.
+ */
+
+#include "./bytestream.h"
+#include "./recording.h"
+
+void stfio::putAttributes(ByteWriter& writer, const Recording& data) {
+    writer.Put<double>(data.GetXScale());
+    writer.PutString(data.GetXUnits());
+    writer.PutString(data.GetComment());
+    writer.PutString(data.GetFileDescription());
+    writer.PutString(data.GetGlobalSectionDescription());
+    writer.PutString(data.GetScaling());
+    struct tm datetime = data.GetDateTime();
+    writer.Put<int>(datetime.tm_year);
+    writer.Put<int>(datetime.tm_mon);
+    writer.Put<int>(datetime.tm_mday);
+    writer.Put<int>(datetime.tm_hour);
+    writer.Put<int>(datetime.tm_min);
+    writer.Put<int>(datetime.tm_sec);
+}
+
+void stfio::getAttributes(ByteReader& reader, Recording& data) {
+    double dt = reader.Get<double>();
+    std::string xunits = reader.GetString();
+    std::string comment = reader.GetString();
+    std::string fileDescription = reader.GetString();
+    std::string sectionDescription = reader.GetString();
+    std::string scaling = reader.GetString();
+    int datetime[6];
+    for (int n = 0; n < 6; ++n) {
+        datetime[n] = reader.Get<int>();
+    }
+    data.SetXScale(dt);
+    data.SetXUnits(xunits);
+    data.SetComment(comment);
+    data.SetFileDescription(fileDescription);
+    data.SetGlobalSectionDescription(sectionDescription);
+    data.SetScaling(scaling);
+    data.SetDateTime(datetime[0], datetime[1], datetime[2], datetime[3], datetime[4], datetime[5]);
+}
@@ -0,0 +1,130 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file bytestream.h
+ *  \brief Declares the compact binary encoding of sidecar indices and shared recordings.
+ *
+ *  Numbers are stored in host byte order, and strings are preceded by
+ *  their length, so that the encoding is only meant to be read on the
+ *  host that wrote it.
+ */
+
+#ifndef _BYTESTREAM_H
+#define _BYTESTREAM_H
+
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+#include "./stfio.h"
+
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Appends numbers and strings to a buffer.
+class ByteWriter {
+public:
+    //! Constructor. Creates an empty buffer.
+    ByteWriter() : buffer() {}
+
+    //! Appends a number.
+    /*! \param value The number.
+     */
+    template <typename T>
+    void Put(T value) { buffer.append((const char*)&value, sizeof(T)); }
+
+    //! Appends a string, preceded by its length.
+    /*! \param str The string.
+     */
+    void PutString(const std::string& str) {
+        Put<unsigned int>((unsigned int)str.size());
+        buffer += str;
+    }
+
+    //! Retrieves the buffer.
+    /*! \return All bytes that have been appended.
+     */
+    const std::string& Get() const { return buffer; }
+
+private:
+    std::string buffer;
+};
+
+//! Reads numbers and strings that have been written by a ByteWriter.
+class ByteReader {
+public:
+    //! Constructor
+    /*! \param begin Pointer to the first byte.
+     *  \param end_ Pointer past the last byte.
+     */
+    ByteReader(const char* begin, const char* end_) : p(begin), end(end_) {}
+
+    //! Reads a number. Throws std::runtime_error if the data are truncated.
+    /*! \return The number.
+     */
+    template <typename T>
+    T Get() {
+        Require(sizeof(T));
+        T value;
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    //! Reads a string. Throws std::runtime_error if the data are truncated.
+    /*! \return The string.
+     */
+    std::string GetString() {
+        std::size_t length = Get<unsigned int>();
+        Require(length);
+        std::string value(p, length);
+        p += length;
+        return value;
+    }
+
+private:
+    void Require(std::size_t n) const {
+        if ((std::size_t)(end-p) < n) {
+            throw std::runtime_error("Truncated data in stfio::ByteReader");
+        }
+    }
+    const char* p;
+    const char* end;
+};
+
+//! Appends the attributes of a recording, such as the sampling interval, units and date.
+/*! Channels and sections aren't written.
+ *  \param writer The destination.
+ *  \param data The recording.
+ */
+StfioDll void putAttributes(ByteWriter& writer, const Recording& data);
+
+//! Reads attributes that have been written by stfio::putAttributes().
+/*! Throws std::runtime_error if the data are truncated.
+ *  \param reader The source.
+ *  \param data On exit, the attributes are set; channels and sections are unchanged.
+ */
+StfioDll void getAttributes(ByteReader& reader, Recording& data);
+
+}
+
+/*@}*/
+
+#endif
@@ -15,6 +15,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 #include "./cfslib.h"
 #include "./cfs.h"
@@ -25,6 +26,9 @@ namespace stfio {
 
 int CFSError(std::string& errorMsg);
 std::string CFSReadVar(short fHandle,short varNo,short varKind);
+void CFSReadChanData(short fHandle, short n_channel, int n_section, TDataType dataType,
+                     float yScale, float yOffset, Section& TempSection);
+bool CFSSampleType(TDataType dataType, SampleType& type);
 
 // Resource management of CFS files
 // Management of read-only files:
@@ -218,7 +222,85 @@ std::string stfio::CFSReadVar(short fHandle,short varNo,short varKind) {
     return outputstream.str();
 }
 
-bool stfio::exportCFSFile(const std::string& fName, const Recording& WData, stfio::ProgressInfo& progDlg) {
+void stfio::CFSReadChanData(short fHandle, short n_channel, int n_section, TDataType dataType,
+                            float yScale, float yOffset, Section& TempSection) {
+    std::string errorMsg;
+    CFSLONG points = (CFSLONG)TempSection.size();
+    //-----------------------------------------------------
+    //The following part was modified to read data sections
+    //larger than 64 KB as e.g. produced by Igor.
+    //Adopted from FPCfs.ipf by U Froebe
+    //Sections with a size larger than 64 KB have been made
+    //possible by dividing CFS-sections into 'blocks'
+    //-----------------------------------------------------
+    int nBlocks, //number of blocks
+        nBlockBytes; //number of bytes per block
+
+    //Calculation of the number of blocks depending on the data format:
+    //RL4 - 4 byte floating point numbers (2 byte int numbers otherwise)
+    if (dataType == RL4)
+        nBlocks=(int)(((points*4-1)/CFSMAXBYTES) + 1);
+    else
+        nBlocks=(int)(((points*2-1)/CFSMAXBYTES) + 1);
+
+    for (int b=0; b < nBlocks; ++b) {
+        //Begin loop: storage of blocks
+        if (dataType == RL4) {
+            //4 byte data
+            //Read data of the current channel and data section
+            //- see manual of CFS file system
+            //Temporary arrays to store blocks:
+            if (b == nBlocks - 1)
+                nBlockBytes=points*4 - b*CFSMAXBYTES;
+            else
+                nBlockBytes=CFSMAXBYTES;
+            Vector_float fTempSection_small(nBlockBytes);
+            GetChanData(fHandle, n_channel, (WORD)n_section+1,
+                b*CFSMAXBYTES/4, (WORD)nBlockBytes/4, &fTempSection_small[0],
+                4*(points+1));
+            if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
+            for (int n=0; n<nBlockBytes/4; ++n) {
+                TempSection[n + b*CFSMAXBYTES/4]=
+                    fTempSection_small[n]* yScale +
+                    yOffset;
+            }
+        } else {
+            //2 byte data
+            //Read data of the current channel and data section
+            //- see manual of CFS file system
+            if (b == nBlocks - 1)
+                nBlockBytes=points*2 - b*CFSMAXBYTES;
+            else
+                nBlockBytes=CFSMAXBYTES;
+            std::vector<short> TempSection_small(nBlockBytes);
+            GetChanData(fHandle, n_channel, (WORD)n_section+1,
+                b*CFSMAXBYTES/2, (WORD)nBlockBytes/2, &TempSection_small[0],
+                2*(points+1));
+            if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
+            for (int n=0; n<nBlockBytes/2; ++n) {
+                TempSection[n + b*CFSMAXBYTES/2]=
+                    TempSection_small[n]* yScale +
+                    yOffset;
+            }
+        }
+    }	//End loop: storage of blocks
+    //-----------------------------------------------------
+    //End of the modified part to read data sections larger than
+    //64kB (as produced e.g. by Igor)
+    //-----------------------------------------------------
+}
+
+bool stfio::CFSSampleType(TDataType dataType, SampleType& type) {
+    switch (dataType) {
+        case INT2: type = sample_int16; return true;
+        case INT4: type = sample_int32; return true;
+        case RL4: type = sample_float32; return true;
+        case RL8: type = sample_float64; return true;
+        default: return false;
+    }
+}
+
+bool stfio::exportCFSFile(const std::string& fName, const RecordingView& WData, stfio::ProgressInfo& progDlg) {
     std::string errorMsg;
     if (fName.length()>1024) {
         throw std::runtime_error(
@@ -377,28 +459,25 @@ int stfio::importCFSFile(const std::string& fName, Recording& ReturnData, Progre
     //can't be read with GetVarVal() since they might change from section
     //to section
     std::string scaling;
-    std::vector<CFSLONG> points(dataSections);
-    TDataType dataType;
+    std::vector<TDataType> dataType(channelsAvail);
+    std::vector<short> spacing(channelsAvail);
     TCFSKind dataKind;
-    short spacing, other;
+    short other;
     float xScale=1.0;
-    std::size_t empty_channels=0;
     for (short n_channel=0; n_channel < channelsAvail; ++n_channel) {
 
         //Get constant information for a particular data channel -
         //see manual of CFS file system.
         std::vector<char> vchannel_name(22),vyUnits(10),vxUnits(10);
-        CFSLONG startOffset;
+        CFSLONG startOffset, points;
         GetFileChan(CFSFile.myHandle, n_channel, &vchannel_name[0],
-            &vyUnits[0], &vxUnits[0], &dataType, &dataKind,
-            &spacing, &other);
+            &vyUnits[0], &vxUnits[0], &dataType[n_channel], &dataKind,
+            &spacing[n_channel], &other);
         if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
         std::string channel_name(&vchannel_name[0]),
             xUnits(&vxUnits[0]),
             yUnits(&vyUnits[0]);
-        //Memory allocation for the current channel
         float yScale, yOffset, xOffset;
-        //Begin loop: read scaling and offsets
         //Write the formatted string from 'n_channel' and 'channel_name' to 'buffer'
         std::ostringstream outputstream;
         outputstream << "Channel " << n_channel << " (" << channel_name.c_str() << ")\n";
@@ -406,7 +485,7 @@ int stfio::importCFSFile(const std::string& fName, Recording& ReturnData, Progre
         //Get the channel information for a data section or a file
         //- see manual of CFS file system
         GetDSChan(CFSFile.myHandle, n_channel /*first channel*/, 1 /*first section*/, &startOffset,
-            &points[0], &yScale, &yOffset,&xScale,&xOffset);
+            &points, &yScale, &yOffset,&xScale,&xOffset);
         if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
         //Write the formatted string from 'yScale' to 'buffer'
         outputstream.clear();
@@ -425,122 +504,89 @@ int stfio::importCFSFile(const std::string& fName, Recording& ReturnData, Progre
         outputstream << "XOffset=" <<  xOffset << "\n";
         scaling += outputstream.str();
 
-        Channel TempChannel(dataSections);
-        TempChannel.SetChannelName(channel_name);
-        TempChannel.SetYUnits(yUnits);
-        std::size_t empty_sections=0;
-        for (int n_section=0; n_section < dataSections; ++n_section) {
-            int progbar =
-                // Channel contribution:
-                (int)(((double)n_channel/(double)channelsAvail)*100.0+
-                      // Section contribution:
-                      (double)n_section/(double)dataSections*(100.0/channelsAvail));
-            std::ostringstream progStr;
-            progStr << "Reading channel #" << n_channel + 1 << " of " << channelsAvail
-                        << ", Section #" << n_section+1 << " of " << dataSections;
-            progDlg.Update(progbar, progStr.str());
-            
-            //Begin loop: n_sections
-            //Get the channel information for a data section or a file
-            //- see manual of CFS file system
-            CFSLONG startOffset;
-            float yScale, yOffset, xOffset;
-            GetDSChan(CFSFile.myHandle,(short)n_channel,(WORD)n_section+1,&startOffset,
-                &points[n_section],&yScale,&yOffset,&xScale,&xOffset);
+        ReturnData[n_channel].SetChannelName(channel_name);
+        ReturnData[n_channel].SetYUnits(yUnits);
+    }
+
+    //4. Layout of the data sections. Empty sections are dropped, and so are
+    //channels without any data.
+    std::vector<std::vector<CFSLONG> > startOffset(channelsAvail, std::vector<CFSLONG>(dataSections)),
+        points(channelsAvail, std::vector<CFSLONG>(dataSections));
+    std::vector<std::vector<float> > yScale(channelsAvail, std::vector<float>(dataSections)),
+        yOffset(channelsAvail, std::vector<float>(dataSections));
+    std::vector<std::size_t> n_sections(channelsAvail, 0);
+    for (int n_section=0; n_section < dataSections; ++n_section) {
+        for (short n_channel=0; n_channel < channelsAvail; ++n_channel) {
+            float xOffset;
+            GetDSChan(CFSFile.myHandle,(short)n_channel,(WORD)n_section+1,&startOffset[n_channel][n_section],
+                &points[n_channel][n_section],&yScale[n_channel][n_section],&yOffset[n_channel][n_section],
+                &xScale,&xOffset);
             if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
-            std::ostringstream label;
-            label << fName << ", Section # " << n_section+1;
-            Section TempSection(
-                (int)(points[n_section]),
-                label.str()
-            );
-            //-----------------------------------------------------
-            //The following part was modified to read data sections
-            //larger than 64 KB as e.g. produced by Igor.
-            //Adopted from FPCfs.ipf by U Froebe
-            //Sections with a size larger than 64 KB have been made
-            //possible by dividing CFS-sections into 'blocks'
-            //-----------------------------------------------------
-            int nBlocks, //number of blocks
-                nBlockBytes; //number of bytes per block
-
-            //Calculation of the number of blocks depending on the data format:
-            //RL4 - 4 byte floating point numbers (2 byte int numbers otherwise)
-            if (dataType == RL4)
-                nBlocks=(int)(((points[n_section]*4-1)/CFSMAXBYTES) + 1);
-            else
-                nBlocks=(int)(((points[n_section]*2-1)/CFSMAXBYTES) + 1);
-
-            for (int b=0; b < nBlocks; ++b) {
-                //Begin loop: storage of blocks
-                if (dataType == RL4) {
-                    //4 byte data
-                    //Read data of the current channel and data section
-                    //- see manual of CFS file system
-                    //Temporary arrays to store blocks:
-                    if (b == nBlocks - 1)
-                        nBlockBytes=points[n_section]*4 - b*CFSMAXBYTES;
-                    else
-                        nBlockBytes=CFSMAXBYTES;
-                    Vector_float fTempSection_small(nBlockBytes);
-                    GetChanData(CFSFile.myHandle, (short)n_channel, (WORD)n_section+1,
-                        b*CFSMAXBYTES/4, (WORD)nBlockBytes/4, &fTempSection_small[0],
-                        4*(points[n_section]+1));
-                    if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
-                    for (int n=0; n<nBlockBytes/4; ++n) {
-                        TempSection[n + b*CFSMAXBYTES/4]=
-                            fTempSection_small[n]* yScale +
-                            yOffset;
-                    }
-                } else {
-                    //2 byte data
-                    //Read data of the current channel and data section
-                    //- see manual of CFS file system
-                    if (b == nBlocks - 1)
-                        nBlockBytes=points[n_section]*2 - b*CFSMAXBYTES;
-                    else
-                        nBlockBytes=CFSMAXBYTES;
-                    std::vector<short> TempSection_small(nBlockBytes);
-                    GetChanData(CFSFile.myHandle, (short)n_channel, (WORD)n_section+1,
-                        b*CFSMAXBYTES/2, (WORD)nBlockBytes/2, &TempSection_small[0],
-                        2*(points[n_section]+1));
-                    if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
-                    for (int n=0; n<nBlockBytes/2; ++n) {
-                        TempSection[n + b*CFSMAXBYTES/2]=
-                            TempSection_small[n]* yScale +
-                            yOffset;
-                    }
-                }
-            }	//End loop: storage of blocks
-            //-----------------------------------------------------
-            //End of the modified part to read data sections larger than
-            //64kB (as produced e.g. by Igor)
-            //-----------------------------------------------------
-            try {
-                if (TempSection.size()!=0) {
-                    TempChannel.InsertSection(TempSection,n_section-empty_sections);
-                } else {
-                    empty_sections++;
-                    TempChannel.resize(TempChannel.size()-1);
-                }
+            if (points[n_channel][n_section] > 0) {
+                n_sections[n_channel]++;
+            }
+        }
+    }
+    for (short n_channel=0; n_channel < channelsAvail; ++n_channel) {
+        ReturnData[n_channel].resize(n_sections[n_channel]);
+    }
+
+    //5. Each data section is read in a few large blocks, and all channels
+    //are decoded from there in a single pass. Channels in formats that
+    //can't be decoded this way are read with GetChanData().
+    std::vector<char> buffer;
+    std::vector<std::size_t> n_inserted(channelsAvail, 0);
+    for (int n_section=0; n_section < dataSections; ++n_section) {
+        int progbar = (int)((double)n_section/(double)dataSections*100.0);
+        std::ostringstream progStr;
+        progStr << "Reading section #" << n_section+1 << " of " << dataSections;
+        progDlg.Update(progbar, progStr.str());
+
+        bool bulk = false;
+        for (short n_channel=0; n_channel < channelsAvail; ++n_channel) {
+            SampleType type;
+            if (points[n_channel][n_section] > 0 && CFSSampleType(dataType[n_channel], type)) {
+                bulk = true;
             }
-            catch (...) {
-                throw;
+        }
+        CFSLONG dsSize = 0;
+        if (bulk) {
+            dsSize = GetDSSize(CFSFile.myHandle, (WORD)n_section+1);
+            if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
+            buffer.resize(dsSize);
+            for (CFSLONG offset = 0; offset < dsSize; offset += CFSMAXBYTES) {
+                WORD nBytes = (WORD)std::min((CFSLONG)CFSMAXBYTES, dsSize-offset);
+                ReadData(CFSFile.myHandle, (WORD)n_section+1, offset, nBytes, &buffer[offset]);
+                if (CFSError(errorMsg))	throw std::runtime_error(errorMsg);
             }
-        }	//End loop: n_section
-        try {
-            if (TempChannel.size()!=0) {
-                ReturnData.InsertChannel(TempChannel,n_channel-empty_channels);
+        }
+        std::ostringstream label;
+        label << fName << ", Section # " << n_section+1;
+        for (short n_channel=0; n_channel < channelsAvail; ++n_channel) {
+            CFSLONG n_points = points[n_channel][n_section];
+            if (n_points <= 0) {
+                continue;
+            }
+            Section TempSection((int)n_points, label.str());
+            SampleType type;
+            if (bulk && CFSSampleType(dataType[n_channel], type) && startOffset[n_channel][n_section] >= 0 &&
+                startOffset[n_channel][n_section] + (n_points-1)*spacing[n_channel] + (CFSLONG)sampleSize(type) <= dsSize)
+            {
+                decodeSamples(&buffer[startOffset[n_channel][n_section]], n_points, spacing[n_channel], type,
+                              false, yScale[n_channel][n_section], yOffset[n_channel][n_section],
+                              &TempSection.get_w()[0]);
             } else {
-                empty_channels++;
-                ReturnData.resize(ReturnData.size()-1);
+                CFSReadChanData(CFSFile.myHandle, n_channel, n_section, dataType[n_channel],
+                                yScale[n_channel][n_section], yOffset[n_channel][n_section], TempSection);
             }
+            ReturnData[n_channel].InsertSection(STFIO_MOVE(TempSection), n_inserted[n_channel]++);
         }
-        catch (...) {
-            ReturnData.resize(0);
-            throw;
+    }
+    for (short n_channel=channelsAvail-1; n_channel >= 0; --n_channel) {
+        if (ReturnData[n_channel].size() == 0) {
+            ReturnData.get().erase(ReturnData.get().begin()+n_channel);
         }
-    }	//Begin loop: n_channel
+    }
     ReturnData.SetXScale(xScale);
     ReturnData.SetFileDescription(file_description + '\0');
     ReturnData.SetGlobalSectionDescription(section_description + '\0');
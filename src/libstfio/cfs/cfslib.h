@@ -23,6 +23,7 @@
 
 #include "../stfio.h"
 class Recording;
+class RecordingView;
 
 namespace stfio {
 
@@ -40,7 +41,7 @@ int importCFSFile(const std::string& fName, Recording& ReturnData, ProgressInfo&
  *  \param WData The data to be exported.
  *  \return The CFS file handle.
  */
-StfioDll bool exportCFSFile(const std::string& fName, const Recording& WData, ProgressInfo& progDlg);
+StfioDll bool exportCFSFile(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg);
 
 }
 
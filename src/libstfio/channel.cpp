@@ -12,8 +12,20 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
+#include <algorithm>
+#include <stdexcept>
+#if (__cplusplus < 201103)
+    #include <boost/shared_ptr.hpp>
+#else
+    #include <memory>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "./stfio.h"
 #include "./channel.h"
+#include "./parallel.h"
 
 Channel::Channel(void) 
 : name("\0"), yunits( "\0" ),
@@ -35,9 +47,8 @@ Channel::~Channel(void) {}
 
 void Channel::InsertSection(const Section& c_Section, std::size_t pos) {
     try {
-        if (SectionArray.at(pos).size() != c_Section.size()) {
-            SectionArray.at(pos).resize(c_Section.size());
-        }
+        // Assign directly; resizing first would decode
+        // compactly stored sections needlessly:
         SectionArray.at(pos) = c_Section;
     }
     catch (...) {
@@ -45,6 +56,12 @@ void Channel::InsertSection(const Section& c_Section, std::size_t pos) {
     }
 }
 
+#if (__cplusplus >= 201103)
+void Channel::InsertSection(Section&& c_Section, std::size_t pos) {
+    SectionArray.at(pos) = std::move(c_Section);
+}
+#endif
+
 const Section& Channel::at(std::size_t at_) const {
     try {
         return SectionArray.at(at_);
@@ -68,3 +85,78 @@ Section& Channel::at(std::size_t at_) {
 void Channel::resize(std::size_t newSize) { SectionArray.resize(newSize); }
 
 void Channel::reserve(std::size_t resSize) { /* SectionArray.reserve(resSize); */ }
+
+void Channel::CopyRange(const std::vector<std::size_t>& sections, std::size_t begin,
+                        std::size_t end, double* dest, int n_threads) const
+{
+    // check everything first, so that no thread has to throw:
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= SectionArray.size()) {
+            throw std::out_of_range("Section index out of range in Channel::CopyRange()");
+        }
+        if (end > SectionArray[sections[n]].size() || begin > end) {
+            throw std::out_of_range("Range out of range in Channel::CopyRange()");
+        }
+    }
+    std::size_t len = end - begin;
+    int n_sections = (int)sections.size();
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        SectionArray[sections[n_s]].CopyRange(begin, end, dest + n_s*len);
+    }
+}
+
+void Channel::MakeContiguous(int n_threads) {
+    if (SectionArray.empty()) {
+        return;
+    }
+    std::size_t len = SectionArray[0].size();
+    for (std::size_t n = 1; n < SectionArray.size(); ++n) {
+        if (SectionArray[n].size() != len) {
+            throw std::runtime_error("Sections differ in size in Channel::MakeContiguous()");
+        }
+    }
+    if (len == 0 || GetContiguous() != NULL) {
+        return;
+    }
+    // over-allocate so that the first data point can be aligned to 64 bytes:
+    const std::size_t alignment = 64;
+    const std::size_t padding = alignment / sizeof(double);
+    Vector_double* buffer = new Vector_double(SectionArray.size()*len + padding);
+    stfio::DecodedSamples shared(buffer);
+    std::size_t misalignment = (std::size_t)(&(*buffer)[0]) % alignment;
+    std::size_t offset = ((alignment - misalignment) % alignment) / sizeof(double);
+
+    std::vector<std::size_t> sections(SectionArray.size());
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        sections[n] = n;
+    }
+    CopyRange(sections, 0, len, &(*buffer)[offset], n_threads);
+
+    for (std::size_t n = 0; n < SectionArray.size(); ++n) {
+        Section span(stfio::MappedSamples(shared, offset + n*len, len),
+                     SectionArray[n].GetSectionDescription());
+        span.SetXScale(SectionArray[n].GetXScale());
+        SectionArray[n] = span;
+    }
+}
+
+const double* Channel::GetContiguous() const {
+    if (SectionArray.empty()) {
+        return NULL;
+    }
+    const double* first = SectionArray[0].GetSpan();
+    std::size_t len = SectionArray[0].size();
+    if (first == NULL || !SectionArray[0].GetSamples().IsShared()) {
+        return NULL;
+    }
+    for (std::size_t n = 1; n < SectionArray.size(); ++n) {
+        if (SectionArray[n].size() != len || SectionArray[n].GetSpan() != first + n*len) {
+            return NULL;
+        }
+    }
+    return first;
+}
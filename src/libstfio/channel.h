@@ -57,6 +57,20 @@ public:
     //! Destructor
     ~Channel();
 
+#if (__cplusplus >= 201103)
+    //! Copy constructor
+    Channel(const Channel&) = default;
+
+    //! Move constructor; leaves \e c_Channel without sections.
+    Channel(Channel&& c_Channel) = default;
+
+    //! Copy assignment
+    Channel& operator=(const Channel&) = default;
+
+    //! Move assignment; leaves \e c_Channel without sections.
+    Channel& operator=(Channel&& c_Channel) = default;
+#endif
+
     //operators---------------------------------------------------
 
     //! Unchecked access to a section (read and write)
@@ -138,6 +152,48 @@ public:
      */
     void InsertSection(const Section& c_Section, std::size_t pos);
 
+#if (__cplusplus >= 201103)
+    //! Moves a section to the given position without copying its data.
+    /*! See InsertSection() above; \e c_Section is empty on return.
+     */
+    void InsertSection(Section&& c_Section, std::size_t pos);
+#endif
+
+    //! Copies the same range of data points from several sections.
+    /*! Sections are copied in parallel with Section::CopyRange(), so that
+     *  mapped sections needn't be decoded in full.
+     *  Throws std::out_of_range if a section index or the range is out of range.
+     *  \param sections Indices of the sections to be copied.
+     *  \param begin Index of the first data point.
+     *  \param end Index past the last data point.
+     *  \param dest Destination; has to hold at least sections.size()*(end-begin)
+     *         values. Section n is copied to dest + n*(end-begin).
+     *  \param n_threads Number of sections that are copied in parallel;
+     *         0 uses the configured number of threads.
+     */
+    void CopyRange(const std::vector<std::size_t>& sections, std::size_t begin,
+                   std::size_t end, double* dest, int n_threads = 0) const;
+
+    //! Stores the data points of all sections in a single buffer.
+    /*! Section n is then a span that starts n*size() data points after the
+     *  beginning of a 64-byte aligned buffer, so that kernels that work across
+     *  sections read memory linearly (see GetContiguous()). Mapped samples are
+     *  decoded. A section that is written to gets its own copy of its data
+     *  points again. Descriptions and x scales are kept.
+     *  Throws std::runtime_error if the sections differ in size.
+     *  \param n_threads Number of sections that are copied in parallel;
+     *         0 uses the configured number of threads.
+     */
+    void MakeContiguous(int n_threads = 0);
+
+    //! Retrieves the buffer created by MakeContiguous().
+    /*! \return Pointer to the first data point of the first section, or NULL
+     *          if the sections aren't stored contiguously (any more), e.g.
+     *          because one of them has been written to. Section n starts
+     *          n*operator[](0).size() data points after the returned pointer.
+     */
+    const double* GetContiguous() const;
+
     //! Resize the section array.
     /*! \param newSize The new number of sections.
      */
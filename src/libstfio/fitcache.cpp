@@ -0,0 +1,60 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file fitcache.cpp
+ *  \brief Defines a cache of best-fit results.
+ */
+
+#include "./fitcache.h"
+
+unsigned long long stfio::hashBytes(const void* data, std::size_t n, unsigned long long seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    unsigned long long hash = seed;
+    for (std::size_t k = 0; k < n; ++k) {
+        hash ^= bytes[k];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+stfio::FitCacheEntry::FitCacheEntry() :
+    key(0), funcName(), fitBeg(0), fitEnd(0), params(0), chisqr(0), warning(0)
+{}
+
+stfio::FitCache::FitCache(std::size_t maxEntries_) :
+    maxEntries(maxEntries_ > 0 ? maxEntries_ : 1), entries()
+{}
+
+const stfio::FitCacheEntry* stfio::FitCache::Find(unsigned long long key) const {
+    for (std::size_t n = 0; n < entries.size(); ++n) {
+        if (entries[n].key == key) {
+            return &entries[n];
+        }
+    }
+    return NULL;
+}
+
+void stfio::FitCache::Insert(const FitCacheEntry& entry) {
+    for (std::size_t n = 0; n < entries.size(); ++n) {
+        if (entries[n].key == entry.key) {
+            entries.erase(entries.begin()+n);
+            break;
+        }
+    }
+    if (entries.size() >= maxEntries) {
+        entries.erase(entries.begin());
+    }
+    entries.push_back(entry);
+}
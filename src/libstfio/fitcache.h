@@ -0,0 +1,104 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file fitcache.h
+ *  \brief Declares a cache of best-fit results.
+ */
+
+#ifndef _FITCACHE_H
+#define _FITCACHE_H
+
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Initial value of stfio::hashBytes(); the FNV-1a offset basis.
+const unsigned long long hashSeed = 14695981039346656037ULL;
+
+//! Computes a 64-bit FNV-1a hash of a block of memory.
+/*! Hashes can be chained by passing the result of a previous call as \e seed.
+ *  \param data Pointer to the first byte.
+ *  \param n Number of bytes.
+ *  \param seed The hash of the preceding data, or stfio::hashSeed.
+ *  \return The hash of all data.
+ */
+StfioDll unsigned long long hashBytes(const void* data, std::size_t n, unsigned long long seed = hashSeed);
+
+//! A cached best-fit result.
+struct StfioDll FitCacheEntry {
+    //! Default constructor.
+    FitCacheEntry();
+
+    unsigned long long key; /*!< Hash of the fit window, the model and the fit settings. */
+    std::string funcName;   /*!< Name of the fitted function. */
+    std::size_t fitBeg;     /*!< Index of the first sampling point of the fit window. */
+    std::size_t fitEnd;     /*!< Index one past the last sampling point of the fit window. */
+    Vector_double params;   /*!< Best-fit parameters. */
+    double chisqr;          /*!< Sum of squared errors. */
+    int warning;            /*!< Warning code of the fit. */
+};
+
+//! Best-fit results of a section, keyed by a hash of the data and the fit settings.
+/*! A fit whose key is found doesn't have to be repeated. When the cache is
+ *  full, inserting replaces the entry that was inserted first.
+ */
+class StfioDll FitCache {
+public:
+    //! Constructor.
+    /*! \param maxEntries The maximal number of entries.
+     */
+    explicit FitCache(std::size_t maxEntries = 16);
+
+    //! Looks up a fit result.
+    /*! \param key The key of the fit.
+     *  \return The cached result, or NULL if there is none.
+     */
+    const FitCacheEntry* Find(unsigned long long key) const;
+
+    //! Inserts a fit result, replacing a previous result with the same key.
+    /*! \param entry The result to be inserted.
+     */
+    void Insert(const FitCacheEntry& entry);
+
+    //! Removes all entries.
+    void Clear() { entries.clear(); }
+
+    //! Retrieves the number of entries.
+    /*! \return The number of cached results.
+     */
+    std::size_t size() const { return entries.size(); }
+
+    //! Retrieves all entries in the order of their insertion.
+    /*! \return The cached results.
+     */
+    const std::vector<FitCacheEntry>& GetEntries() const { return entries; }
+
+private:
+    std::size_t maxEntries;
+    std::vector<FitCacheEntry> entries;
+};
+
+}
+
+/*@}*/
+
+#endif
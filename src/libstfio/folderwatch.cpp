@@ -0,0 +1,196 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file folderwatch.cpp
+ *  \brief Defines a watcher for new files in acquisition folders.
+ *
+ *  Folders are polled rather than watched with inotify or
+ *  ReadDirectoryChangesW, which also works on network shares that
+ *  acquisition computers often write to.
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "./folderwatch.h"
+
+namespace {
+
+    struct Entry {
+        std::string path;
+        unsigned long long size;
+        long long mtime;
+    };
+
+    bool byTime(const Entry& a, const Entry& b) {
+        return (a.mtime != b.mtime) ? a.mtime < b.mtime : a.path < b.path;
+    }
+
+    std::string lower(std::string str) {
+        for (std::size_t n = 0; n < str.size(); ++n) {
+            str[n] = (char)tolower((unsigned char)str[n]);
+        }
+        return str;
+    }
+
+    // Lists the regular files of a folder; returns false if it can't be read.
+    bool listFolder(const std::string& folder, std::vector<Entry>& entries) {
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE hFind = FindFirstFileA((folder + "\\*").c_str(), &data);
+        if (hFind == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        do {
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                continue;
+            }
+            Entry entry;
+            entry.path = folder + "\\" + data.cFileName;
+            entry.size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+            entry.mtime = ((long long)data.ftLastWriteTime.dwHighDateTime << 32) |
+                data.ftLastWriteTime.dwLowDateTime;
+            entries.push_back(entry);
+        } while (FindNextFileA(hFind, &data));
+        FindClose(hFind);
+#else
+        DIR* dir = opendir(folder.c_str());
+        if (dir == NULL) {
+            return false;
+        }
+        while (struct dirent* d = readdir(dir)) {
+            Entry entry;
+            entry.path = folder + "/" + d->d_name;
+            struct stat st;
+            if (stat(entry.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            entry.size = (unsigned long long)st.st_size;
+            entry.mtime = (long long)st.st_mtime;
+            entries.push_back(entry);
+        }
+        closedir(dir);
+#endif
+        return true;
+    }
+}
+
+unsigned long long stfio::hashFile(const std::string& fName) {
+    FILE* fp = fopen(fName.c_str(), "rb");
+    if (fp == NULL) {
+        throw std::runtime_error("Couldn't open " + fName);
+    }
+    unsigned long long hash = 14695981039346656037ULL;
+    std::vector<unsigned char> buffer(1024*1024);
+    std::size_t n_read = 0;
+    while ((n_read = fread(&buffer[0], 1, buffer.size(), fp)) > 0) {
+        for (std::size_t n = 0; n < n_read; ++n) {
+            hash = (hash ^ buffer[n]) * 1099511628211ULL;
+        }
+    }
+    bool failed = ferror(fp) != 0;
+    fclose(fp);
+    if (failed) {
+        throw std::runtime_error("Couldn't read " + fName);
+    }
+    return hash;
+}
+
+stfio::FolderWatcher::FolderWatcher(const std::vector<std::string>& folders_,
+                                    const std::vector<std::string>& extensions_, int stablePolls_)
+    : folders(folders_), extensions(), stablePolls(std::max(stablePolls_, 1)),
+      candidates(), handled(), hashes(), pending(0), duplicates(0)
+{
+    for (std::size_t n_e = 0; n_e < extensions_.size(); ++n_e) {
+        extensions.push_back("." + lower(extensions_[n_e]));
+    }
+}
+
+bool stfio::FolderWatcher::Matches(const std::string& name) const {
+    if (extensions.empty()) {
+        return true;
+    }
+    std::string lname = lower(name);
+    for (std::size_t n_e = 0; n_e < extensions.size(); ++n_e) {
+        const std::string& ext = extensions[n_e];
+        if (lname.size() > ext.size() && lname.compare(lname.size()-ext.size(), ext.size(), ext) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> stfio::FolderWatcher::Poll(std::size_t maxFiles) {
+    std::vector<Entry> entries;
+    for (std::size_t n_f = 0; n_f < folders.size(); ++n_f) {
+        listFolder(folders[n_f], entries);
+    }
+
+    // files that are still being written start over:
+    std::map<std::string, FileState> current;
+    std::vector<Entry> complete;
+    for (std::size_t n_e = 0; n_e < entries.size(); ++n_e) {
+        const Entry& entry = entries[n_e];
+        if (!Matches(entry.path) || handled.count(entry.path)) {
+            continue;
+        }
+        FileState state;
+        state.size = entry.size;
+        state.mtime = entry.mtime;
+        state.stable = 0;
+        std::map<std::string, FileState>::const_iterator it = candidates.find(entry.path);
+        if (it != candidates.end() && it->second.size == entry.size && it->second.mtime == entry.mtime) {
+            state.stable = it->second.stable + 1;
+        }
+        if (state.stable >= stablePolls && entry.size > 0) {
+            complete.push_back(entry);
+        }
+        current[entry.path] = state;
+    }
+    candidates.swap(current);
+
+    std::sort(complete.begin(), complete.end(), byTime);
+    std::vector<std::string> files;
+    std::size_t n_c = 0;
+    for (; n_c < complete.size() && files.size() < maxFiles; ++n_c) {
+        const std::string& path = complete[n_c].path;
+        unsigned long long hash = 0;
+        try {
+            hash = hashFile(path);
+        }
+        catch (const std::runtime_error&) {
+            // e.g. removed or locked; tried again at the next poll
+            continue;
+        }
+        handled.insert(path);
+        candidates.erase(path);
+        if (!hashes.insert(hash).second) {
+            ++duplicates;
+            continue;
+        }
+        files.push_back(path);
+    }
+    pending = complete.size() - n_c;
+    return files;
+}
@@ -0,0 +1,106 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file folderwatch.h
+ *  \brief Declares a watcher for new files in acquisition folders.
+ */
+
+#ifndef _FOLDERWATCH_H
+#define _FOLDERWATCH_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Computes a hash of the contents of a file.
+/*! Files with the same contents have the same hash, independent of
+ *  their names. Throws std::runtime_error if the file can't be read.
+ *  \param fName Full path to the file.
+ *  \return The 64-bit FNV-1a hash of the file contents.
+ */
+StfioDll unsigned long long hashFile(const std::string& fName);
+
+//! Watches folders for new files that have been closed by the acquisition program.
+/*! The folders are listed whenever Poll() is called. A file is complete
+ *  once its size and modification time haven't changed for a number of
+ *  polls, so that files that are still being written are left alone.
+ *  Every complete file is handed out once; files whose contents have
+ *  already been handed out under another name, e.g. copies of a
+ *  recording, are skipped.
+ */
+class StfioDll FolderWatcher {
+public:
+    //! Constructor.
+    /*! \param folders Full paths to the folders; subfolders aren't watched.
+     *  \param extensions File extensions without the dot, e.g. "abf";
+     *         case is ignored. All files are watched if this is empty.
+     *  \param stablePolls Number of polls for which the size and
+     *         modification time of a file have to stay the same.
+     */
+    FolderWatcher(const std::vector<std::string>& folders,
+                  const std::vector<std::string>& extensions, int stablePolls=1);
+
+    //! Lists the folders and hands out complete files.
+    /*! Complete files beyond \e maxFiles stay pending until the next poll,
+     *  so that a slow consumer limits the number of files that are
+     *  hashed and handed out at a time. Folders that can't be listed are
+     *  skipped.
+     *  \param maxFiles Maximal number of files that are handed out.
+     *  \return Full paths to new complete files, oldest first.
+     */
+    std::vector<std::string> Poll(std::size_t maxFiles);
+
+    //! Retrieves the number of complete files that haven't been handed out.
+    /*! \return The number of complete files that Poll() left pending.
+     */
+    std::size_t GetPending() const { return pending; }
+
+    //! Retrieves the number of files that were skipped as duplicates.
+    /*! \return The number of files with contents that had already been handed out.
+     */
+    std::size_t GetDuplicates() const { return duplicates; }
+
+private:
+    struct FileState {
+        unsigned long long size;
+        long long mtime;
+        int stable;
+    };
+
+    bool Matches(const std::string& name) const;
+
+    std::vector<std::string> folders;
+    std::vector<std::string> extensions;
+    int stablePolls;
+    std::map<std::string, FileState> candidates;
+    std::set<std::string> handled;
+    std::set<unsigned long long> hashes;
+    std::size_t pending, duplicates;
+};
+
+}
+
+/*@}*/
+
+#endif
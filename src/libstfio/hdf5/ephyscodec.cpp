@@ -0,0 +1,383 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include "hdf5.h"
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./ephyscodec.h"
+#include "../channel.h"
+#include "../parallel.h"
+
+namespace {
+
+    // The format of an encoded buffer, with all numbers in little-endian
+    // byte order:
+    //   u8 version, u32 number of samples, u32 number of frames,
+    //   u32 size of each frame in bytes, frames.
+    // A frame holds:
+    //   u8 predictor order (1 or 2), i16 first sample,
+    //   for each block of up to 128 residuals: u8 bit width, packed residuals.
+    const unsigned char VERSION = 1;
+    const std::size_t FRAMESIZE = 8192;
+    const std::size_t BLOCKSIZE = 128;
+    const std::size_t HEADERSIZE = 9;
+
+    void putU32(unsigned char* p, unsigned int value) {
+        p[0] = (unsigned char)(value & 0xff);
+        p[1] = (unsigned char)((value >> 8) & 0xff);
+        p[2] = (unsigned char)((value >> 16) & 0xff);
+        p[3] = (unsigned char)((value >> 24) & 0xff);
+    }
+
+    unsigned int getU32(const unsigned char* p) {
+        return (unsigned int)p[0] | ((unsigned int)p[1] << 8) |
+            ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+
+    // The residual of sample n of a frame:
+    int residual(const short* x, std::size_t n, int order) {
+        if (n == 0) {
+            return 0;
+        }
+        if (n == 1 || order == 1) {
+            return (int)x[n] - (int)x[n-1];
+        }
+        return (int)x[n] - (2*(int)x[n-1] - (int)x[n-2]);
+    }
+
+    unsigned int zigzag(int value) {
+        return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+    }
+
+    int unzigzag(unsigned int value) {
+        return (int)(value >> 1) ^ -(int)(value & 1);
+    }
+
+    int bitWidth(unsigned int value) {
+        int bits = 0;
+        while (value != 0) {
+            ++bits;
+            value >>= 1;
+        }
+        return bits;
+    }
+
+    // The size of the packed residuals of a frame:
+    std::size_t packedSize(const short* x, std::size_t n, int order) {
+        std::size_t size = 0;
+        for (std::size_t begin = 0; begin < n; begin += BLOCKSIZE) {
+            std::size_t end = std::min(begin+BLOCKSIZE, n);
+            unsigned int bits = 0;
+            for (std::size_t k = begin; k < end; ++k) {
+                bits |= zigzag(residual(x, k, order));
+            }
+            size += 1 + ((end-begin)*bitWidth(bits)+7)/8;
+        }
+        return size;
+    }
+
+    void encodeFrame(const short* x, std::size_t n, std::vector<unsigned char>& frame) {
+        int order = packedSize(x, n, 2) < packedSize(x, n, 1) ? 2 : 1;
+        frame.clear();
+        frame.push_back((unsigned char)order);
+        unsigned short first = (unsigned short)x[0];
+        frame.push_back((unsigned char)(first & 0xff));
+        frame.push_back((unsigned char)(first >> 8));
+        unsigned int values[BLOCKSIZE];
+        for (std::size_t begin = 0; begin < n; begin += BLOCKSIZE) {
+            std::size_t count = std::min(BLOCKSIZE, n-begin);
+            unsigned int all = 0;
+            for (std::size_t k = 0; k < count; ++k) {
+                values[k] = zigzag(residual(x, begin+k, order));
+                all |= values[k];
+            }
+            int bits = bitWidth(all);
+            frame.push_back((unsigned char)bits);
+            // least significant bits first:
+            unsigned long long buffer = 0;
+            int n_bits = 0;
+            for (std::size_t k = 0; k < count; ++k) {
+                buffer |= (unsigned long long)values[k] << n_bits;
+                n_bits += bits;
+                while (n_bits >= 8) {
+                    frame.push_back((unsigned char)(buffer & 0xff));
+                    buffer >>= 8;
+                    n_bits -= 8;
+                }
+            }
+            if (n_bits > 0) {
+                frame.push_back((unsigned char)(buffer & 0xff));
+            }
+        }
+    }
+
+    // Returns false if the frame is corrupt:
+    bool decodeFrame(const unsigned char* p, std::size_t size, short* x, std::size_t n) {
+        if (size < 3 || (p[0] != 1 && p[0] != 2)) {
+            return false;
+        }
+        int order = p[0];
+        short first = (short)((unsigned short)p[1] | ((unsigned short)p[2] << 8));
+        const unsigned char* end = p + size;
+        p += 3;
+        for (std::size_t begin = 0; begin < n; begin += BLOCKSIZE) {
+            std::size_t count = std::min(BLOCKSIZE, n-begin);
+            if (p >= end || *p > 32) {
+                return false;
+            }
+            int bits = *p++;
+            if ((std::size_t)(end-p) < (count*bits+7)/8) {
+                return false;
+            }
+            unsigned long long buffer = 0;
+            int n_bits = 0;
+            unsigned long long mask = (1ULL << bits) - 1;
+            for (std::size_t k = begin; k < begin+count; ++k) {
+                while (n_bits < bits) {
+                    buffer |= (unsigned long long)(*p++) << n_bits;
+                    n_bits += 8;
+                }
+                int r = unzigzag((unsigned int)(buffer & mask));
+                buffer >>= bits;
+                n_bits -= bits;
+                int prediction = 0;
+                if (k == 0) {
+                    prediction = first;
+                } else if (k == 1 || order == 1) {
+                    prediction = x[k-1];
+                } else {
+                    prediction = 2*(int)x[k-1] - (int)x[k-2];
+                }
+                x[k] = (short)(prediction + r);
+            }
+        }
+        return true;
+    }
+
+    size_t ephysFilter(unsigned int flags, size_t, const unsigned int*, size_t nbytes,
+                       size_t* buf_size, void** buf)
+    {
+        try {
+            const unsigned char* in = (const unsigned char*)*buf;
+            std::vector<unsigned char> out;
+            if (flags & H5Z_FLAG_REVERSE) {
+                std::vector<short> samples;
+                stfio::decodeEphys(in, nbytes, samples);
+                // chunks are stored as little-endian 16-bit integers:
+                out.resize(2*samples.size());
+                for (std::size_t n = 0; n < samples.size(); ++n) {
+                    out[2*n] = (unsigned char)((unsigned short)samples[n] & 0xff);
+                    out[2*n+1] = (unsigned char)((unsigned short)samples[n] >> 8);
+                }
+            } else {
+                if (nbytes % 2 != 0) {
+                    return 0;
+                }
+                std::vector<short> samples(nbytes/2);
+                for (std::size_t n = 0; n < samples.size(); ++n) {
+                    samples[n] = (short)((unsigned short)in[2*n] | ((unsigned short)in[2*n+1] << 8));
+                }
+                stfio::encodeEphys(samples.empty() ? NULL : &samples[0], samples.size(), out);
+                // the chunk is stored as it is (the filter is optional):
+                if (out.size() >= nbytes) {
+                    return 0;
+                }
+            }
+            if (out.size() > *buf_size) {
+                void* res = H5allocate_memory(out.size(), false);
+                if (res == NULL) {
+                    return 0;
+                }
+                H5free_memory(*buf);
+                *buf = res;
+                *buf_size = out.size();
+            }
+            if (!out.empty()) {
+                memcpy(*buf, &out[0], out.size());
+            }
+            return out.size();
+        }
+        catch (...) {
+            return 0;
+        }
+    }
+}
+
+void stfio::encodeEphys(const short* samples, std::size_t n, std::vector<unsigned char>& encoded,
+                        int n_threads)
+{
+    std::size_t n_frames = (n+FRAMESIZE-1) / FRAMESIZE;
+    std::vector<std::vector<unsigned char> > frames(n_frames);
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, (int)n_frames);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_f = 0; n_f < (int)n_frames; ++n_f) {
+        std::size_t begin = n_f*FRAMESIZE;
+        encodeFrame(samples+begin, std::min(FRAMESIZE, n-begin), frames[n_f]);
+    }
+
+    std::size_t size = HEADERSIZE + 4*n_frames;
+    for (std::size_t n_f = 0; n_f < n_frames; ++n_f) {
+        size += frames[n_f].size();
+    }
+    encoded.resize(size);
+    encoded[0] = VERSION;
+    putU32(&encoded[1], (unsigned int)n);
+    putU32(&encoded[5], (unsigned int)n_frames);
+    std::size_t pos = HEADERSIZE + 4*n_frames;
+    for (std::size_t n_f = 0; n_f < n_frames; ++n_f) {
+        putU32(&encoded[HEADERSIZE + 4*n_f], (unsigned int)frames[n_f].size());
+        std::copy(frames[n_f].begin(), frames[n_f].end(), encoded.begin()+pos);
+        pos += frames[n_f].size();
+    }
+}
+
+void stfio::decodeEphys(const unsigned char* encoded, std::size_t size, std::vector<short>& samples,
+                        int n_threads)
+{
+    if (size < HEADERSIZE || encoded[0] != VERSION) {
+        throw std::runtime_error("Unknown format of encoded samples");
+    }
+    std::size_t n = getU32(&encoded[1]);
+    std::size_t n_frames = getU32(&encoded[5]);
+    if (n_frames != (n+FRAMESIZE-1) / FRAMESIZE || size < HEADERSIZE + 4*n_frames) {
+        throw std::runtime_error("Corrupt encoded samples");
+    }
+    // where each frame starts:
+    std::vector<std::size_t> offsets(n_frames+1, HEADERSIZE + 4*n_frames);
+    for (std::size_t n_f = 0; n_f < n_frames; ++n_f) {
+        offsets[n_f+1] = offsets[n_f] + getU32(&encoded[HEADERSIZE + 4*n_f]);
+    }
+    if (offsets[n_frames] > size) {
+        throw std::runtime_error("Corrupt encoded samples");
+    }
+    samples.resize(n);
+    bool ok = true;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, (int)n_frames);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_f = 0; n_f < (int)n_frames; ++n_f) {
+        std::size_t begin = n_f*FRAMESIZE;
+        if (!decodeFrame(&encoded[offsets[n_f]], offsets[n_f+1]-offsets[n_f],
+                         &samples[begin], std::min(FRAMESIZE, n-begin)))
+        {
+#ifdef _OPENMP
+#pragma omp critical(stfio_ephys_decode)
+#endif
+            ok = false;
+        }
+    }
+    if (!ok) {
+        throw std::runtime_error("Corrupt encoded samples");
+    }
+}
+
+bool stfio::findQuantization(const Channel& channel, double& scale, double& shift) {
+    // the range, and the distinct values among the first samples:
+    const std::size_t n_sample = 65536;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -min;
+    std::vector<double> values;
+    Vector_double block(FRAMESIZE);
+    for (std::size_t n_s = 0; n_s < channel.size(); ++n_s) {
+        const Section& sec = channel[n_s];
+        for (std::size_t begin = 0; begin < sec.size(); begin += block.size()) {
+            std::size_t end = std::min(begin+block.size(), sec.size());
+            sec.CopyRange(begin, end, &block[0]);
+            for (std::size_t k = 0; k < end-begin; ++k) {
+                double v = block[k];
+                if (!(v >= -std::numeric_limits<double>::max() && v <= std::numeric_limits<double>::max())) {
+                    // NaN or infinite:
+                    return false;
+                }
+                min = std::min(min, v);
+                max = std::max(max, v);
+                if (values.size() < n_sample) {
+                    values.push_back(v);
+                }
+            }
+        }
+    }
+    if (values.empty()) {
+        return false;
+    }
+    if (max == min) {
+        scale = 1.0;
+        shift = min;
+        return true;
+    }
+    // the quantization step is the smallest difference between values:
+    std::sort(values.begin(), values.end());
+    double step = max - min;
+    for (std::size_t n = 1; n < values.size(); ++n) {
+        if (values[n] > values[n-1]) {
+            step = std::min(step, values[n]-values[n-1]);
+        }
+    }
+    double steps = std::floor((max-min)/step + 0.5);
+    if (steps > 65535) {
+        return false;
+    }
+    scale = (max-min) / steps;
+    // an offset of 0 if the samples are multiples of the step:
+    double k_min = std::floor(min/scale + 0.5);
+    if (std::fabs(min - k_min*scale) <= 1e-6*scale && k_min >= -32768 &&
+        k_min + steps <= 32767)
+    {
+        shift = 0;
+    } else {
+        shift = min + 32768*scale;
+    }
+
+    for (std::size_t n_s = 0; n_s < channel.size(); ++n_s) {
+        const Section& sec = channel[n_s];
+        for (std::size_t begin = 0; begin < sec.size(); begin += block.size()) {
+            std::size_t end = std::min(begin+block.size(), sec.size());
+            sec.CopyRange(begin, end, &block[0]);
+            for (std::size_t k = 0; k < end-begin; ++k) {
+                double code = std::floor((block[k]-shift)/scale + 0.5);
+                if (code < -32768 || code > 32767 ||
+                    std::fabs(shift + code*scale - block[k]) > 1e-6*scale)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool stfio::registerEphysFilter() {
+    if (H5Zfilter_avail(EPHYS_FILTER_ID) > 0) {
+        return true;
+    }
+    const H5Z_class2_t filter = {
+        H5Z_CLASS_T_VERS,
+        (H5Z_filter_t)EPHYS_FILTER_ID,
+        1, 1,
+        "stfio ephys codec",
+        NULL, NULL,
+        ephysFilter
+    };
+    return H5Zregister(&filter) >= 0;
+}
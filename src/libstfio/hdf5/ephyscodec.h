@@ -0,0 +1,86 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file ephyscodec.h
+ *  \brief A lossless codec for 16-bit ADC samples, and its HDF5 filter.
+ *
+ *  Samples are split into frames that are coded independently, so that
+ *  frames are encoded and decoded in parallel. Each frame is predicted
+ *  either from the previous sample or by linear extrapolation of the two
+ *  previous samples, whichever is cheaper; the residuals are zigzag coded
+ *  and bit-packed in blocks of 128 with the smallest width that holds
+ *  them.
+ */
+
+#ifndef _EPHYSCODEC_H
+#define _EPHYSCODEC_H
+
+#include <vector>
+#include "../stfio.h"
+
+class Channel;
+
+namespace stfio {
+
+//! The identifier of the HDF5 filter.
+/*! A private identifier that isn't registered with The HDF Group: 0-255
+ *  are used by HDF5 itself, 256-511 by filters under test and 512-32767
+ *  by registered filters (305 is LZO, for example). Files that use the
+ *  filter can only be read by programs that register it.
+ */
+const int EPHYS_FILTER_ID = 40001;
+
+//! Encodes 16-bit samples losslessly.
+/*! \param samples The samples.
+ *  \param n The number of samples.
+ *  \param encoded On exit, the encoded samples.
+ *  \param n_threads The number of frames that are encoded in parallel;
+ *         0 uses the configured number of threads.
+ */
+StfioDll void encodeEphys(const short* samples, std::size_t n, std::vector<unsigned char>& encoded,
+                          int n_threads = 0);
+
+//! Decodes samples that have been encoded by encodeEphys().
+/*! Throws std::runtime_error if the data are corrupt.
+ *  \param encoded The encoded samples.
+ *  \param size The size of \e encoded in bytes.
+ *  \param samples On exit, the samples.
+ *  \param n_threads The number of frames that are decoded in parallel;
+ *         0 uses the configured number of threads.
+ */
+StfioDll void decodeEphys(const unsigned char* encoded, std::size_t size, std::vector<short>& samples,
+                          int n_threads = 0);
+
+//! Determines whether the samples of a channel are 16-bit integers that have been scaled.
+/*! This is the case for most data that have been read from acquisition
+ *  files. Every sample has to be reproduced by scale*k+shift, with an
+ *  integer k from -32768 to 32767, to within a millionth of \e scale.
+ *  The offset is 0 whenever the samples allow it, so that 0 stays exact.
+ *  \param channel The channel.
+ *  \param scale On exit, the scaling factor if the samples are integers.
+ *  \param shift On exit, the offset if the samples are integers.
+ *  \return true if the samples are scaled 16-bit integers.
+ */
+StfioDll bool findQuantization(const Channel& channel, double& scale, double& shift);
+
+//! Registers the HDF5 filter of the codec.
+/*! Has to be called before a data set that uses the filter is read or
+ *  written, and again after the HDF5 library has been closed.
+ *  \return true if the filter is available.
+ */
+StfioDll bool registerEphysFilter();
+
+}
+
+#endif
@@ -18,12 +18,21 @@
 #else
   #include "H5TA.h"
 #endif
+#include <zlib.h>
 #include <cmath>
+#include <cstring>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "./hdf5lib.h"
+#include "./ephyscodec.h"
 #include "../recording.h"
+#include "../mappedfile.h"
+#include "../parallel.h"
 
 const static unsigned int DATELEN = 128;
 const static unsigned int TIMELEN = 128;
@@ -45,7 +54,992 @@ typedef struct st {
     char yunits[UNITLEN];
 } st;
 
-bool stfio::exportHDF5File(const std::string& fName, const Recording& WData, ProgressInfo& progDlg) {
+// Layout version of files that store one chunked data set per channel:
+const static int CHUNKED_LAYOUT = 2;
+// Approximate number of samples per chunk:
+const static hsize_t CHUNKSIZE = 65536;
+// Registered identifier of the LZ4 filter plugin:
+const static H5Z_filter_t FILTER_LZ4 = 32004;
+// Number of compressed chunks that are read before they are decompressed in parallel:
+const static std::size_t CHUNKBATCH = 256;
+// Number of chunks that are compressed while the previous ones are written:
+const static std::size_t WRITEBATCH = 64;
+// Compression level of the deflate filter:
+const static int DEFLATE_LEVEL = 4;
+
+namespace {
+
+// A chunk as it is stored in the file, i.e. before its filters are undone.
+struct RawChunk {
+    hsize_t offset[2];
+    uint32_t filter_mask;
+    // empty if the chunk hasn't been written:
+    std::vector<unsigned char> bytes;
+};
+
+// Retrieves the chunk size and the filters of a chunked 2-D data set, in the
+// order they are applied when writing. Returns false unless the chunks
+// can be filtered by filterChunk() and unfilterChunk(), which copy samples
+// as they are stored and therefore require a little-endian machine.
+bool directChunkFilters(hid_t dataset, bool integer, hsize_t chunk[2], std::vector<H5Z_filter_t>& filters) {
+    hid_t dcpl = H5Dget_create_plist(dataset);
+    bool known = H5Pget_layout(dcpl) == H5D_CHUNKED && H5Pget_chunk(dcpl, 2, chunk) == 2;
+    filters.clear();
+    int n_filters = known ? H5Pget_nfilters(dcpl) : 0;
+    for (int n_f = 0; n_f < n_filters && known; ++n_f) {
+        unsigned int flags = 0;
+        size_t n_values = 0;
+        H5Z_filter_t filter = H5Pget_filter2(dcpl, n_f, &flags, &n_values, NULL, 0, NULL, NULL);
+        known = filter == H5Z_FILTER_DEFLATE || filter == H5Z_FILTER_SHUFFLE ||
+                filter == stfio::EPHYS_FILTER_ID;
+        filters.push_back(filter);
+    }
+    H5Pclose(dcpl);
+    hid_t file_type = H5Dget_type(dataset);
+    hid_t stored_type = integer ? H5T_STD_I16LE : H5T_IEEE_F32LE;
+    known = known && chunk[0] > 0 && chunk[1] > 0 &&
+        H5Tequal(file_type, stored_type) > 0 &&
+        H5Tequal(integer ? H5T_NATIVE_SHORT : H5T_NATIVE_FLOAT, stored_type) > 0;
+    H5Tclose(file_type);
+    return known;
+}
+
+// Applies the filters to a chunk as the HDF5 library would while writing.
+// The optional ephys filter is skipped, and flagged in the filter mask, if
+// it doesn't make the chunk smaller.
+bool filterChunk(RawChunk& chunk, const std::vector<H5Z_filter_t>& filters, std::size_t type_size,
+                 std::vector<unsigned char>& buffer)
+{
+    chunk.filter_mask = 0;
+    for (std::size_t n_f = 0; n_f < filters.size(); ++n_f) {
+        std::vector<unsigned char>& src = chunk.bytes;
+        switch (filters[n_f]) {
+         case H5Z_FILTER_DEFLATE: {
+             uLongf size = compressBound((uLong)src.size());
+             buffer.resize(size);
+             if (compress2(&buffer[0], &size, &src[0], (uLong)src.size(), DEFLATE_LEVEL) != Z_OK) {
+                 return false;
+             }
+             buffer.resize(size);
+             break;
+         }
+         case H5Z_FILTER_SHUFFLE: {
+             std::size_t n_elements = src.size() / type_size;
+             buffer.resize(src.size());
+             for (std::size_t k = 0; k < type_size; ++k) {
+                 for (std::size_t n_e = 0; n_e < n_elements; ++n_e) {
+                     buffer[k*n_elements + n_e] = src[n_e*type_size + k];
+                 }
+             }
+             std::copy(src.begin() + n_elements*type_size, src.end(), buffer.begin() + n_elements*type_size);
+             break;
+         }
+         case stfio::EPHYS_FILTER_ID: {
+             // chunks are encoded in parallel already:
+             stfio::encodeEphys((const short*)&src[0], src.size()/sizeof(short), buffer, 1);
+             if (buffer.size() >= src.size()) {
+                 chunk.filter_mask |= (1u << n_f);
+                 continue;
+             }
+             break;
+         }
+         default:
+             return false;
+        }
+        chunk.bytes.swap(buffer);
+    }
+    return true;
+}
+
+// Undoes the filters of a chunk, which have been applied in the order of
+// \e filters. n_bytes is the size of the unfiltered chunk. Filters that
+// were skipped while writing are flagged in the filter mask of the chunk.
+bool unfilterChunk(RawChunk& chunk, const std::vector<H5Z_filter_t>& filters, std::size_t type_size,
+                   std::size_t n_bytes, std::vector<unsigned char>& buffer)
+{
+    std::vector<short> codes;
+    for (int n_f = (int)filters.size()-1; n_f >= 0; --n_f) {
+        if (chunk.filter_mask & (1u << n_f)) {
+            continue;
+        }
+        std::vector<unsigned char>& src = chunk.bytes;
+        if (src.empty()) {
+            return false;
+        }
+        switch (filters[n_f]) {
+         case H5Z_FILTER_DEFLATE: {
+             buffer.resize(n_bytes);
+             uLongf size = (uLongf)n_bytes;
+             if (uncompress(&buffer[0], &size, &src[0], (uLong)src.size()) != Z_OK) {
+                 return false;
+             }
+             buffer.resize(size);
+             break;
+         }
+         case H5Z_FILTER_SHUFFLE: {
+             // byte k of all elements is stored in a block; left-over bytes come last:
+             std::size_t n_elements = src.size() / type_size;
+             buffer.resize(src.size());
+             for (std::size_t k = 0; k < type_size; ++k) {
+                 for (std::size_t n_e = 0; n_e < n_elements; ++n_e) {
+                     buffer[n_e*type_size + k] = src[k*n_elements + n_e];
+                 }
+             }
+             std::copy(src.begin() + n_elements*type_size, src.end(), buffer.begin() + n_elements*type_size);
+             break;
+         }
+         case stfio::EPHYS_FILTER_ID: {
+             // chunks are decoded in parallel already:
+             stfio::decodeEphys(&src[0], src.size(), codes, 1);
+             buffer.resize(codes.size()*sizeof(short));
+             if (!codes.empty()) {
+                 std::memcpy(&buffer[0], &codes[0], buffer.size());
+             }
+             break;
+         }
+         default:
+             return false;
+        }
+        chunk.bytes.swap(buffer);
+    }
+    return chunk.bytes.size() == n_bytes;
+}
+
+// Items of an export that are prepared, i.e. converted and compressed, by
+// worker threads, and written by the calling thread, which is the only one
+// that calls the HDF5 library. While a batch of items is written, the next
+// batch is prepared, so that an export runs at the pace of the slower
+// stage, and at most two batches are held in memory.
+class ExportPipeline {
+public:
+    virtual ~ExportPipeline() {}
+
+    // Prepares and writes items [0, n_items). Returns false as soon as any
+    // item has failed.
+    bool Run(std::size_t n_items, std::size_t batch_size);
+
+protected:
+    // Prepares the parts of item n that mustn't run on a worker thread;
+    // called by the calling thread before the batch is handed to the workers.
+    virtual bool Gather(std::size_t n) { return true; }
+    // Prepares item n; called by worker threads.
+    virtual bool Prepare(std::size_t n) = 0;
+    // Writes item n, which has been prepared; called by the calling thread in order.
+    virtual bool Write(std::size_t n) = 0;
+};
+
+bool ExportPipeline::Run(std::size_t n_items, std::size_t batch_size) {
+    int n_threads = stfio::threadCount(0, (int)std::min(batch_size, n_items));
+    bool ok = true;
+    for (std::size_t n = 0; n < std::min(batch_size, n_items) && ok; ++n) {
+        ok = Gather(n);
+    }
+    // the first batch is prepared before anything can be written:
+    int first_end = (int)std::min(batch_size, n_items);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n = 0; n < first_end; ++n) {
+        if (ok && !Prepare(n)) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_hdf5_export)
+#endif
+            ok = false;
+        }
+    }
+
+    for (std::size_t begin = 0; begin < n_items && ok; begin += batch_size) {
+        std::size_t end = std::min(begin + batch_size, n_items);
+        std::size_t next_end = std::min(end + batch_size, n_items);
+        for (std::size_t n = end; n < next_end && ok; ++n) {
+            ok = Gather(n);
+        }
+        // the writer helps with the next batch once it has written this one:
+        int next = (int)end;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(n_threads+1)
+#endif
+        {
+            int thread = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+#endif
+            if (thread == 0) {
+                for (std::size_t n = begin; n < end && ok; ++n) {
+                    if (!Write(n)) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_hdf5_export)
+#endif
+                        ok = false;
+                    }
+                }
+            }
+            for (;;) {
+                int n = 0;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+                n = next++;
+                if (n >= (int)next_end || !ok) {
+                    break;
+                }
+                if (!Prepare(n)) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_hdf5_export)
+#endif
+                    ok = false;
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+// Compresses the chunks of a channel on worker threads while they are
+// written with H5Dwrite_chunk(). Sections are copied to the chunks by the
+// workers, unless their samples are derived on demand, which may require
+// the HDF5 library; those are copied by the calling thread.
+class ChunkExport : public ExportPipeline {
+public:
+    ChunkExport(hid_t dataset_, const Channel& channel_, const std::vector<hsize_t>& lengths_,
+                const hsize_t chunk_[2], const std::vector<H5Z_filter_t>& filters_,
+                bool integer_, double scale_, double shift_,
+                std::size_t n_c_, std::size_t numberChannels_, stfio::ProgressInfo& progDlg_);
+
+    // The chunks that hold any samples; chunks beyond the end of all
+    // sections aren't written.
+    std::vector<RawChunk> chunks;
+
+protected:
+    bool Gather(std::size_t n) { return !serial || Copy(chunks[n]); }
+    bool Prepare(std::size_t n);
+    bool Write(std::size_t n);
+
+private:
+    // Copies the samples of the sections to a chunk:
+    bool Copy(RawChunk& raw) const;
+
+    hid_t dataset;
+    const Channel& channel;
+    const std::vector<hsize_t>& lengths;
+    hsize_t chunk[2];
+    std::vector<H5Z_filter_t> filters;
+    bool integer, serial;
+    double scale, shift;
+    std::size_t type_size, n_c, numberChannels;
+    stfio::ProgressInfo& progDlg;
+};
+
+ChunkExport::ChunkExport(hid_t dataset_, const Channel& channel_, const std::vector<hsize_t>& lengths_,
+                         const hsize_t chunk_[2], const std::vector<H5Z_filter_t>& filters_,
+                         bool integer_, double scale_, double shift_,
+                         std::size_t n_c_, std::size_t numberChannels_, stfio::ProgressInfo& progDlg_)
+    : dataset(dataset_), channel(channel_), lengths(lengths_), filters(filters_),
+      integer(integer_), serial(false), scale(scale_), shift(shift_),
+      type_size(integer_ ? sizeof(short) : sizeof(float)), n_c(n_c_),
+      numberChannels(numberChannels_), progDlg(progDlg_)
+{
+    chunk[0] = chunk_[0];
+    chunk[1] = chunk_[1];
+    hsize_t n_sections = channel.size();
+    for (std::size_t n_s = 0; n_s < channel.size(); ++n_s) {
+        const Section& sec = channel[n_s];
+        serial = serial || (sec.IsMapped() && (sec.GetSamples().IsDerived() || sec.GetSamples().IsChained()));
+    }
+    for (hsize_t row = 0; row < n_sections; row += chunk[0]) {
+        hsize_t row_length = 0;
+        for (hsize_t n_s = row; n_s < std::min(row + chunk[0], n_sections); ++n_s) {
+            row_length = std::max(row_length, lengths[n_s]);
+        }
+        for (hsize_t col = 0; col < row_length; col += chunk[1]) {
+            RawChunk raw;
+            raw.offset[0] = row;
+            raw.offset[1] = col;
+            raw.filter_mask = 0;
+            chunks.push_back(raw);
+        }
+    }
+}
+
+bool ChunkExport::Copy(RawChunk& raw) const {
+    raw.bytes.assign(chunk[0]*chunk[1]*type_size, 0);
+    Vector_double values;
+    for (hsize_t n_s = raw.offset[0]; n_s < std::min(raw.offset[0] + chunk[0], (hsize_t)channel.size()); ++n_s) {
+        hsize_t col_end = std::min(raw.offset[1] + chunk[1], lengths[n_s]);
+        if (raw.offset[1] >= col_end) {
+            continue;
+        }
+        std::size_t pos = ((n_s - raw.offset[0])*chunk[1])*type_size;
+        if (integer) {
+            values.resize(col_end - raw.offset[1]);
+            channel[n_s].CopyRange(raw.offset[1], col_end, &values[0]);
+            short* dest = (short*)&raw.bytes[pos];
+            for (std::size_t n_p = 0; n_p < values.size(); ++n_p) {
+                dest[n_p] = (short)std::floor((values[n_p]-shift)/scale + 0.5);
+            }
+        } else {
+            channel[n_s].CopyRange(raw.offset[1], col_end, (float*)&raw.bytes[pos]);
+        }
+    }
+    return true;
+}
+
+bool ChunkExport::Prepare(std::size_t n) {
+    RawChunk& raw = chunks[n];
+    try {
+        if (!serial) {
+            Copy(raw);
+        }
+        std::vector<unsigned char> buffer;
+        return filterChunk(raw, filters, type_size, buffer);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+}
+
+bool ChunkExport::Write(std::size_t n) {
+    RawChunk& raw = chunks[n];
+    if (n % WRITEBATCH == 0) {
+        std::ostringstream progStr;
+        progStr << "Writing channel #" << n_c + 1 << " of " << numberChannels;
+        progDlg.Update((int)(((double)n_c + (double)n/(double)chunks.size())/(double)numberChannels*100.0),
+                       progStr.str());
+    }
+    herr_t status = H5Dwrite_chunk(dataset, H5P_DEFAULT, raw.filter_mask, raw.offset,
+                                   raw.bytes.size(), &raw.bytes[0]);
+    // release the memory while the next batch is being prepared:
+    std::vector<unsigned char>().swap(raw.bytes);
+    return status >= 0;
+}
+
+// Writes the sections of a channel to a chunked data set with the chunks
+// compressed in parallel. Returns false without writing anything if the
+// chunks can't be written directly, e.g. because the data set uses a
+// filter plugin.
+bool writeChunksParallel(hid_t dataset, const Channel& channel, const std::vector<hsize_t>& lengths,
+                         bool integer, double scale, double shift, std::size_t n_c,
+                         std::size_t numberChannels, stfio::ProgressInfo& progDlg)
+{
+#if !H5_VERSION_GE(1,10,2)
+    // H5Dwrite_chunk() isn't available:
+    return false;
+#else
+    hsize_t chunk[2] = { 0, 0 };
+    std::vector<H5Z_filter_t> filters;
+    if (!directChunkFilters(dataset, integer, chunk, filters)) {
+        return false;
+    }
+    ChunkExport pipeline(dataset, channel, lengths, chunk, filters, integer, scale, shift,
+                         n_c, numberChannels, progDlg);
+    if (!pipeline.Run(pipeline.chunks.size(), WRITEBATCH)) {
+        throw std::runtime_error("Exception while writing data in stfio::exportHDF5File");
+    }
+    return true;
+#endif
+}
+
+// Writes the sections of a channel into a single chunked 2-D data set
+// (sections x samples). Shorter sections are padded with zeros; the
+// length and the description of each section are stored in separate
+// index data sets.
+// With the ephys codec, samples are stored as 16-bit integers, and the
+// attributes "scale" and "offset" of the data set convert them back.
+void exportChunkedChannel(hid_t channel_group, const RecordingView& WData, std::size_t n_c,
+                          stfio::hdf5_filter filter, stfio::ProgressInfo& progDlg)
+{
+    const Channel& channel = WData[n_c];
+    double scale = 1.0, shift = 0.0;
+    bool integer = filter == stfio::hdf5_ephys && stfio::findQuantization(channel, scale, shift);
+    if (filter == stfio::hdf5_ephys && !integer) {
+        filter = stfio::hdf5_shuffle_deflate;
+    }
+    hsize_t n_sections = channel.size();
+    std::vector<hsize_t> lengths(n_sections+1, 0);
+    hsize_t max_length = 0;
+    for (std::size_t n_s=0; n_s < channel.size(); ++n_s) {
+        lengths[n_s] = channel[n_s].size();
+        max_length = std::max(max_length, lengths[n_s]);
+    }
+    hsize_t dimsl[1] = { n_sections };
+    herr_t status = H5LTmake_dataset(channel_group, "lengths", 1, dimsl, H5T_NATIVE_HSIZE, &lengths[0]);
+    if (status < 0) {
+        throw std::runtime_error("Exception while writing section lengths in stfio::exportHDF5File");
+    }
+    std::vector<const char*> descriptions(n_sections+1, "");
+    for (std::size_t n_s=0; n_s < channel.size(); ++n_s) {
+        descriptions[n_s] = channel[n_s].GetSectionDescription().c_str();
+    }
+    hid_t string_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(string_type, H5T_VARIABLE);
+    hid_t desc_space = H5Screate_simple(1, dimsl, NULL);
+    hid_t desc_set = H5Dcreate2(channel_group, "descriptions", string_type, desc_space,
+                                H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    status = desc_set < 0 ? -1 : 0;
+    if (status >= 0 && n_sections > 0) {
+        status = H5Dwrite(desc_set, string_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &descriptions[0]);
+    }
+    if (desc_set >= 0) H5Dclose(desc_set);
+    H5Sclose(desc_space);
+    H5Tclose(string_type);
+    if (status < 0) {
+        throw std::runtime_error("Exception while writing section descriptions in stfio::exportHDF5File");
+    }
+
+    // Whole sections are stored in a chunk, or several of them if they are short:
+    hsize_t chunk[2];
+    chunk[1] = std::max(std::min(max_length, CHUNKSIZE), (hsize_t)1);
+    chunk[0] = std::max(std::min(CHUNKSIZE / chunk[1], n_sections), (hsize_t)1);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 2, chunk);
+    float fill_value = 0;
+    short fill_code = 0;
+    if (integer) {
+        H5Pset_fill_value(dcpl, H5T_NATIVE_SHORT, &fill_code);
+    } else {
+        H5Pset_fill_value(dcpl, H5T_NATIVE_FLOAT, &fill_value);
+    }
+    switch (filter) {
+     case stfio::hdf5_shuffle_deflate:
+         H5Pset_shuffle(dcpl);
+         // fall through
+     case stfio::hdf5_deflate:
+         H5Pset_deflate(dcpl, DEFLATE_LEVEL);
+         break;
+     case stfio::hdf5_lz4:
+         if (H5Zfilter_avail(FILTER_LZ4) <= 0) {
+             H5Pclose(dcpl);
+             throw std::runtime_error("The LZ4 filter plugin is not available in stfio::exportHDF5File");
+         }
+         H5Pset_filter(dcpl, FILTER_LZ4, H5Z_FLAG_MANDATORY, 0, NULL);
+         break;
+     case stfio::hdf5_ephys:
+         if (!stfio::registerEphysFilter()) {
+             H5Pclose(dcpl);
+             throw std::runtime_error("Couldn't register the ephys codec in stfio::exportHDF5File");
+         }
+         // chunks that don't get smaller are stored as they are:
+         H5Pset_filter(dcpl, stfio::EPHYS_FILTER_ID, H5Z_FLAG_OPTIONAL, 0, NULL);
+         break;
+     default:
+         break;
+    }
+
+    // store as 32 bit (or 16 bit integer) little endian independent of machine:
+    hsize_t dims[2] = { n_sections, max_length };
+    // chunks mustn't be larger than a fixed dimension, so that empty
+    // dimensions are declared extendible:
+    hsize_t maxdims[2] = { n_sections > 0 ? n_sections : H5S_UNLIMITED,
+                           max_length > 0 ? max_length : H5S_UNLIMITED };
+    hid_t file_space = H5Screate_simple(2, dims, maxdims);
+    hid_t dataset = H5Dcreate2(channel_group, "data", integer ? H5T_STD_I16LE : H5T_IEEE_F32LE,
+                               file_space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    if (dataset < 0) {
+        H5Sclose(file_space);
+        throw std::runtime_error("Exception while creating data set in stfio::exportHDF5File");
+    }
+
+    // chunks are compressed in parallel while they're written:
+    bool written = false;
+    try {
+        written = writeChunksParallel(dataset, channel, lengths, integer, scale, shift,
+                                      n_c, WData.size(), progDlg);
+    }
+    catch (...) {
+        H5Sclose(file_space);
+        H5Dclose(dataset);
+        throw;
+    }
+
+    // sections in a single buffer (see Channel::MakeContiguous()) are written
+    // at once; HDF5 converts them to single precision while writing:
+    const double* contiguous = channel.GetContiguous();
+    if (!written && contiguous != NULL && lengths[0] == max_length && !integer) {
+        std::ostringstream progStr;
+        progStr << "Writing channel #" << n_c + 1 << " of " << WData.size();
+        progDlg.Update((int)((double)n_c/(double)WData.size()*100.0), progStr.str());
+        status = H5Dwrite(dataset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, contiguous);
+        written = true;
+    }
+
+    Vector_float data_cp;
+    std::vector<short> codes;
+    for (std::size_t n_s=0; n_s < channel.size() && !written && status >= 0; ++n_s) {
+        int progbar =
+            // Channel contribution:
+            (int)(((double)n_c/(double)WData.size())*100.0+
+                  // Section contribution:
+                  (double)(n_s)/(double)channel.size()*(100.0/WData.size()));
+        std::ostringstream progStr;
+        progStr << "Writing channel #" << n_c + 1 << " of " << WData.size()
+                << ", Section #" << n_s << " of " << channel.size();
+        progDlg.Update(progbar, progStr.str());
+
+        if (lengths[n_s] == 0) {
+            continue;
+        }
+        hsize_t start[2] = { n_s, 0 };
+        hsize_t count[2] = { 1, lengths[n_s] };
+        H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+        hid_t mem_space = H5Screate_simple(1, &count[1], NULL);
+        if (integer) {
+            codes.resize(lengths[n_s]);
+            for (std::size_t n_cp = 0; n_cp < codes.size(); ++n_cp) {
+                codes[n_cp] = (short)std::floor((channel[n_s][n_cp]-shift)/scale + 0.5);
+            }
+            status = H5Dwrite(dataset, H5T_NATIVE_SHORT, mem_space, file_space, H5P_DEFAULT, &codes[0]);
+        } else {
+            data_cp.resize(lengths[n_s]);
+            for (std::size_t n_cp = 0; n_cp < data_cp.size(); ++n_cp) {
+                data_cp[n_cp] = float(channel[n_s][n_cp]);
+            }
+            status = H5Dwrite(dataset, H5T_NATIVE_FLOAT, mem_space, file_space, H5P_DEFAULT, &data_cp[0]);
+        }
+        H5Sclose(mem_space);
+    }
+    H5Sclose(file_space);
+    H5Dclose(dataset);
+    if (status < 0) {
+        throw std::runtime_error("Exception while writing data in stfio::exportHDF5File");
+    }
+
+    double dt = WData.GetXScale();
+    if (H5LTset_attribute_double(channel_group, "data", "dt", &dt, 1) < 0 ||
+        H5LTset_attribute_string(channel_group, "data", "xunits", WData.GetXUnits().c_str()) < 0 ||
+        H5LTset_attribute_string(channel_group, "data", "yunits", channel.GetYUnits().c_str()) < 0)
+    {
+        throw std::runtime_error("Exception while writing data description in stfio::exportHDF5File");
+    }
+    if (integer && (H5LTset_attribute_double(channel_group, "data", "scale", &scale, 1) < 0 ||
+                    H5LTset_attribute_double(channel_group, "data", "offset", &shift, 1) < 0))
+    {
+        throw std::runtime_error("Exception while writing data description in stfio::exportHDF5File");
+    }
+}
+
+// Reads a string attribute of a data set.
+std::string readStringAttribute(hid_t loc_id, const char* obj_name, const char* attr_name) {
+    hsize_t dims = 0;
+    H5T_class_t class_id;
+    size_t type_size = 0;
+    herr_t status = H5LTget_attribute_info(loc_id, obj_name, attr_name, &dims, &class_id, &type_size);
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading data description in stfio::importHDF5File");
+    }
+    std::vector<char> buffer(type_size+1, 0);
+    status = H5LTget_attribute_string(loc_id, obj_name, attr_name, &buffer[0]);
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading data description in stfio::importHDF5File");
+    }
+    return std::string(&buffer[0]);
+}
+
+// Reads samples [begin, end) of a 1-D data set, or of a row of a 2-D data
+// set, into a new section. Only the chunks covered by the window are read.
+Section readWindow(hid_t dataset, hsize_t row, hsize_t begin, hsize_t end, const std::string& name) {
+    Section TempSection(begin < end ? end-begin : 0, name);
+    if (TempSection.size() == 0) {
+        return TempSection;
+    }
+    hid_t file_space = H5Dget_space(dataset);
+    int rank = H5Sget_simple_extent_ndims(file_space);
+    hsize_t start[2] = { row, begin };
+    hsize_t count[2] = { 1, end-begin };
+    // a 1-D data set only has the second dimension:
+    herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, &start[2-rank], NULL, &count[2-rank], NULL);
+    if (status >= 0) {
+        hid_t mem_space = H5Screate_simple(1, &count[1], NULL);
+        status = H5Dread(dataset, H5T_NATIVE_DOUBLE, mem_space, file_space, H5P_DEFAULT, &TempSection.get_w()[0]);
+        H5Sclose(mem_space);
+    }
+    H5Sclose(file_space);
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading data in stfio::importHDF5File");
+    }
+    return TempSection;
+}
+
+// Reads samples [begin, end) of a row of a 2-D data set of 16-bit integers,
+// which are kept compactly in memory and scaled on access.
+Section readCodes(hid_t dataset, hsize_t row, hsize_t begin, hsize_t end, const std::string& name,
+                  double scale, double shift)
+{
+    std::vector<short> codes(begin < end ? end-begin : 0);
+    if (codes.empty()) {
+        return Section((std::size_t)0, name);
+    }
+    hid_t file_space = H5Dget_space(dataset);
+    hsize_t start[2] = { row, begin };
+    hsize_t count[2] = { 1, end-begin };
+    herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+    if (status >= 0) {
+        hid_t mem_space = H5Screate_simple(1, &count[1], NULL);
+        status = H5Dread(dataset, H5T_NATIVE_SHORT, mem_space, file_space, H5P_DEFAULT, &codes[0]);
+        H5Sclose(mem_space);
+    }
+    H5Sclose(file_space);
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading data in stfio::importHDF5File");
+    }
+    return Section(stfio::compactSamples(codes, scale, shift), name);
+}
+
+// The chunks of a compressed data set that hold samples of a window of
+// every section, and where their samples go. Chunks are read from the file
+// by the calling thread, which is the only one that calls the HDF5
+// library, and decompressed and copied to the sections by worker threads.
+class ChunkImport {
+public:
+    ChunkImport(hid_t dataset_, Channel& TempChannel, const std::vector<hsize_t>& lengths,
+                const hsize_t dims[2], const hsize_t chunk_[2], const std::vector<H5Z_filter_t>& filters_,
+                std::size_t sec_begin_, std::size_t sample_begin, std::size_t sample_end, bool integer_);
+
+    // Reads chunks [begin, end) from the file. Returns false if any of them can't be read.
+    bool Read(std::size_t begin, std::size_t end);
+    // Decompresses chunk n and copies its samples to the sections; may be
+    // called from any thread. Sections don't overlap, so chunks can be
+    // decoded in any order.
+    bool Decode(std::size_t n);
+
+    std::vector<RawChunk> chunks;
+    // samples of integer data sets, which become compact sections at the end:
+    std::vector<std::vector<short> > codes;
+
+private:
+    hid_t dataset;
+    hsize_t chunk[2];
+    std::vector<H5Z_filter_t> filters;
+    std::size_t sec_begin, n_sections, type_size, n_bytes;
+    bool integer;
+    // the window of each section:
+    std::vector<hsize_t> begins, ends;
+    std::vector<double*> samples;
+};
+
+ChunkImport::ChunkImport(hid_t dataset_, Channel& TempChannel, const std::vector<hsize_t>& lengths,
+                         const hsize_t dims[2], const hsize_t chunk_[2],
+                         const std::vector<H5Z_filter_t>& filters_, std::size_t sec_begin_,
+                         std::size_t sample_begin, std::size_t sample_end, bool integer_)
+    : codes(integer_ ? TempChannel.size() : 0), dataset(dataset_), filters(filters_),
+      sec_begin(sec_begin_), n_sections(TempChannel.size()),
+      type_size(integer_ ? sizeof(short) : sizeof(float)), n_bytes(0), integer(integer_),
+      begins(n_sections), ends(n_sections), samples(n_sections, (double*)NULL)
+{
+    chunk[0] = chunk_[0];
+    chunk[1] = chunk_[1];
+    n_bytes = chunk[0]*chunk[1]*type_size;
+    for (std::size_t n_t=0; n_t < n_sections; ++n_t) {
+        std::size_t n_s = sec_begin + n_t;
+        hsize_t length = std::min(lengths[n_s], dims[1]);
+        begins[n_t] = std::min((hsize_t)sample_begin, length);
+        ends[n_t] = std::min((hsize_t)sample_end, length);
+        if (integer) {
+            codes[n_t].resize(ends[n_t]-begins[n_t]);
+        } else {
+            std::ostringstream section_name;
+            section_name << "sec" << n_s;
+            TempChannel.InsertSection(Section(ends[n_t]-begins[n_t], section_name.str()), n_t);
+            if (ends[n_t] > begins[n_t]) {
+                samples[n_t] = &TempChannel[n_t].get_w()[0];
+            }
+        }
+    }
+
+    // the chunks that hold samples of any of the windows:
+    for (hsize_t row = sec_begin - sec_begin % chunk[0]; row < sec_begin + n_sections; row += chunk[0]) {
+        for (hsize_t col = 0; col < dims[1]; col += chunk[1]) {
+            bool needed = false;
+            for (hsize_t n_s = std::max(row, (hsize_t)sec_begin);
+                 n_s < std::min(row + chunk[0], (hsize_t)(sec_begin + n_sections)) && !needed; ++n_s)
+            {
+                needed = begins[n_s-sec_begin] < col + chunk[1] && ends[n_s-sec_begin] > col;
+            }
+            if (needed) {
+                RawChunk raw;
+                raw.offset[0] = row;
+                raw.offset[1] = col;
+                raw.filter_mask = 0;
+                chunks.push_back(raw);
+            }
+        }
+    }
+}
+
+bool ChunkImport::Read(std::size_t begin, std::size_t end) {
+#if H5_VERSION_GE(1,10,2)
+    for (std::size_t n_k = begin; n_k < end; ++n_k) {
+        RawChunk& raw = chunks[n_k];
+        hsize_t size = 0;
+        herr_t status = 0;
+        H5E_BEGIN_TRY {
+            status = H5Dget_chunk_storage_size(dataset, raw.offset, &size);
+        } H5E_END_TRY;
+        if (status < 0 || size == 0) {
+            // not written, so all samples are 0:
+            continue;
+        }
+        raw.bytes.resize(size);
+        if (H5Dread_chunk(dataset, H5P_DEFAULT, raw.offset, &raw.filter_mask, &raw.bytes[0]) < 0) {
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ChunkImport::Decode(std::size_t n) {
+    RawChunk& raw = chunks[n];
+    if (!raw.bytes.empty()) {
+        std::vector<unsigned char> buffer;
+        try {
+            if (!unfilterChunk(raw, filters, type_size, n_bytes, buffer)) {
+                return false;
+            }
+        }
+        catch (const std::runtime_error&) {
+            return false;
+        }
+    }
+    // copy the overlap of the chunk with each window:
+    for (hsize_t n_s = std::max(raw.offset[0], (hsize_t)sec_begin);
+         n_s < std::min(raw.offset[0] + chunk[0], (hsize_t)(sec_begin + n_sections)); ++n_s)
+    {
+        std::size_t n_t = n_s - sec_begin;
+        hsize_t col_begin = std::max(raw.offset[1], begins[n_t]);
+        hsize_t col_end = std::min(raw.offset[1] + chunk[1], ends[n_t]);
+        if (raw.bytes.empty() || col_begin >= col_end) {
+            continue;
+        }
+        std::size_t pos = (n_s - raw.offset[0])*chunk[1] + (col_begin - raw.offset[1]);
+        if (integer) {
+            std::memcpy(&codes[n_t][col_begin - begins[n_t]], &raw.bytes[pos*type_size],
+                        (col_end - col_begin)*type_size);
+        } else {
+            const float* src = (const float*)&raw.bytes[pos*type_size];
+            double* dest = samples[n_t] + (col_begin - begins[n_t]);
+            for (hsize_t n_p = 0; n_p < col_end - col_begin; ++n_p) {
+                dest[n_p] = src[n_p];
+            }
+        }
+    }
+    // release the memory while the batch is still being decoded:
+    std::vector<unsigned char>().swap(raw.bytes);
+    return true;
+}
+
+// Reads sections [sec_begin, sec_begin+TempChannel.size()) of a channel from
+// a compressed chunked data set. The HDF5 library decompresses the chunks
+// one after the other within H5Dread(); here, the compressed chunks are
+// read from the file directly, and decompressed and copied to the sections
+// in parallel. While a batch of chunks is decompressed, the next batch is
+// read, so that at most two batches are held in memory. Returns false
+// without reading anything if the data set uses a filter that isn't undone
+// here, or if it isn't compressed at all.
+bool readChunksParallel(hid_t dataset, Channel& TempChannel, const std::vector<hsize_t>& lengths,
+                        const hsize_t dims[2], std::size_t sec_begin, std::size_t sample_begin,
+                        std::size_t sample_end, bool integer, double scale, double shift,
+                        int n_c, int numberChannels, stfio::ProgressInfo& progDlg)
+{
+#if !H5_VERSION_GE(1,10,2)
+    // H5Dread_chunk() isn't available:
+    return false;
+#else
+    hsize_t chunk[2] = { 0, 0 };
+    std::vector<H5Z_filter_t> filters;
+    if (!directChunkFilters(dataset, integer, chunk, filters) || filters.empty()) {
+        return false;
+    }
+    ChunkImport import(dataset, TempChannel, lengths, dims, chunk, filters,
+                       sec_begin, sample_begin, sample_end, integer);
+    std::size_t n_chunks = import.chunks.size();
+
+    std::ostringstream progStr;
+    progStr << "Reading channel #" << n_c + 1 << " of " << numberChannels;
+    stfio::ParallelProgress progress(progDlg, (int)n_chunks, progStr.str(),
+                                     (int)(100.0*n_c/numberChannels), (int)(100.0*(n_c+1)/numberChannels));
+    int n_threads = stfio::threadCount(0, (int)std::min(CHUNKBATCH, n_chunks));
+    bool ok = import.Read(0, std::min(CHUNKBATCH, n_chunks));
+    for (std::size_t batch = 0; batch < n_chunks && ok; batch += CHUNKBATCH) {
+        std::size_t batch_end = std::min(batch + CHUNKBATCH, n_chunks);
+        std::size_t next_end = std::min(batch_end + CHUNKBATCH, n_chunks);
+        // the reader helps with this batch once it has read the next one:
+        int next = (int)batch;
+#ifdef _OPENMP
+        int batch_threads = std::max(std::min(n_threads, (int)(batch_end-batch)), 1);
+#pragma omp parallel num_threads(batch_threads+1)
+#endif
+        {
+            int thread = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+#endif
+            if (thread == 0 && !import.Read(batch_end, next_end)) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_hdf5_chunks)
+#endif
+                ok = false;
+            }
+            for (;;) {
+                int n = 0;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+                n = next++;
+                if (n >= (int)batch_end || !ok) {
+                    break;
+                }
+                if (!import.Decode(n)) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_hdf5_chunks)
+#endif
+                    ok = false;
+                }
+                progress.Step();
+            }
+        }
+    }
+    if (!ok) {
+        throw std::runtime_error("Exception while reading compressed data in stfio::importHDF5File");
+    }
+    for (std::size_t n_t=0; n_t < TempChannel.size() && integer; ++n_t) {
+        std::ostringstream section_name;
+        section_name << "sec" << sec_begin + n_t;
+        TempChannel.InsertSection(Section(stfio::compactSamples(import.codes[n_t], scale, shift),
+                                          section_name.str()), n_t);
+        std::vector<short>().swap(import.codes[n_t]);
+    }
+    return true;
+#endif
+}
+
+// Sets the descriptions of the sections read by importChunkedChannel() from the
+// "descriptions" index data set. Files written before it was added keep the
+// default section names.
+void readSectionDescriptions(hid_t channel_group, Channel& TempChannel, std::size_t sec_begin) {
+    if (TempChannel.size() == 0 || H5LTfind_dataset(channel_group, "descriptions") != 1) {
+        return;
+    }
+    hid_t desc_set = H5Dopen2(channel_group, "descriptions", H5P_DEFAULT);
+    if (desc_set < 0) {
+        throw std::runtime_error("Exception while reading section descriptions in stfio::importHDF5File");
+    }
+    hid_t file_space = H5Dget_space(desc_set);
+    hsize_t start[1] = { sec_begin };
+    hsize_t count[1] = { TempChannel.size() };
+    hid_t mem_space = H5Screate_simple(1, count, NULL);
+    hid_t string_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(string_type, H5T_VARIABLE);
+    std::vector<char*> descriptions(TempChannel.size(), (char*)NULL);
+    herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+    if (status >= 0) {
+        status = H5Dread(desc_set, string_type, mem_space, file_space, H5P_DEFAULT, &descriptions[0]);
+    }
+    if (status >= 0) {
+        for (std::size_t n_t=0; n_t < TempChannel.size(); ++n_t) {
+            if (descriptions[n_t] != NULL) {
+                TempChannel[n_t].SetSectionDescription(descriptions[n_t]);
+            }
+        }
+        H5Dvlen_reclaim(string_type, mem_space, H5P_DEFAULT, &descriptions[0]);
+    }
+    H5Tclose(string_type);
+    H5Sclose(mem_space);
+    H5Sclose(file_space);
+    H5Dclose(desc_set);
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading section descriptions in stfio::importHDF5File");
+    }
+}
+
+// Reads sections [sec_begin, sec_begin+TempChannel.size()) of a channel from
+// a chunked 2-D data set; n_sections is the number of sections in the file.
+void importChunkedChannel(hid_t channel_group, Channel& TempChannel, std::size_t n_sections,
+                          std::size_t sec_begin, std::size_t sample_begin, std::size_t sample_end,
+                          int n_c, int numberChannels, double& dt, std::string& yunits,
+                          stfio::ProgressInfo& progDlg)
+{
+    std::vector<hsize_t> lengths(n_sections+1, 0);
+    herr_t status = H5LTread_dataset(channel_group, "lengths", H5T_NATIVE_HSIZE, &lengths[0]);
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading section lengths in stfio::importHDF5File");
+    }
+    // data sets may have been written with the ephys codec:
+    stfio::registerEphysFilter();
+    hid_t dataset = H5Dopen2(channel_group, "data", H5P_DEFAULT);
+    if (dataset < 0) {
+        throw std::runtime_error("Exception while opening data set in stfio::importHDF5File");
+    }
+    double scale = 1.0, shift = 0.0;
+    bool integer = H5LTfind_attribute(dataset, "scale") == 1 &&
+        H5LTget_attribute_double(channel_group, "data", "scale", &scale) >= 0 &&
+        H5LTget_attribute_double(channel_group, "data", "offset", &shift) >= 0;
+    hid_t file_space = H5Dget_space(dataset);
+    hsize_t dims[2] = { 0, 0 };
+    if (H5Sget_simple_extent_ndims(file_space) != 2 ||
+        H5Sget_simple_extent_dims(file_space, dims, NULL) < 0 ||
+        dims[0] < n_sections)
+    {
+        H5Sclose(file_space);
+        H5Dclose(dataset);
+        throw std::runtime_error("Unexpected size of data set in stfio::importHDF5File");
+    }
+    H5Sclose(file_space);
+
+    // compressed chunks are decompressed in parallel:
+    bool read = false;
+    try {
+        read = readChunksParallel(dataset, TempChannel, lengths, dims, sec_begin, sample_begin, sample_end,
+                                  integer, scale, shift, n_c, numberChannels, progDlg);
+    }
+    catch (...) {
+        H5Dclose(dataset);
+        throw;
+    }
+    for (std::size_t n_t=0; n_t < TempChannel.size() && !read; ++n_t) {
+        std::size_t n_s = sec_begin + n_t;
+        int progbar =
+            // Channel contribution:
+            (int)(((double)n_c/(double)numberChannels)*100.0+
+                  // Section contribution:
+                  (double)(n_t)/(double)TempChannel.size()*(100.0/numberChannels));
+        std::ostringstream progStr;
+        progStr << "Reading channel #" << n_c + 1 << " of " << numberChannels
+                << ", Section #" << n_t+1 << " of " << TempChannel.size();
+        progDlg.Update(progbar, progStr.str());
+
+        std::ostringstream section_name;
+        section_name << "sec" << n_s;
+        hsize_t length = std::min(lengths[n_s], dims[1]);
+        try {
+            hsize_t begin = std::min((hsize_t)sample_begin, length);
+            hsize_t end = std::min((hsize_t)sample_end, length);
+            if (integer) {
+                TempChannel.InsertSection(readCodes(dataset, n_s, begin, end, section_name.str(), scale, shift), n_t);
+            } else {
+                TempChannel.InsertSection(readWindow(dataset, n_s, begin, end, section_name.str()), n_t);
+            }
+        }
+        catch (...) {
+            H5Dclose(dataset);
+            throw;
+        }
+    }
+    H5Dclose(dataset);
+    readSectionDescriptions(channel_group, TempChannel, sec_begin);
+
+    if (H5LTget_attribute_double(channel_group, "data", "dt", &dt) < 0) {
+        throw std::runtime_error("Exception while reading data description in stfio::importHDF5File");
+    }
+    yunits = readStringAttribute(channel_group, "data", "yunits");
+}
+
+}
+
+bool stfio::exportHDF5File(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg,
+                           hdf5_layout layout, hdf5_filter filter) {
     
     hid_t file_id = H5Fcreate(fName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
     
@@ -93,6 +1087,16 @@ bool stfio::exportHDF5File(const std::string& fName, const Recording& WData, Pro
         throw std::runtime_error(errorMsg);
     }
 
+    if (layout == hdf5_chunked) {
+        status = H5LTset_attribute_int(file_id, "/", "layout_version", &CHUNKED_LAYOUT, 1);
+        if (status < 0) {
+            std::string errorMsg("Exception while writing layout version in stfio::exportHDF5File");
+            H5Fclose(file_id);
+            H5close();
+            throw std::runtime_error(errorMsg);
+        }
+    }
+
     hid_t comment_group = H5Gcreate2( file_id,"/comment", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 
     /* File comment. */
@@ -183,6 +1187,21 @@ bool stfio::exportHDF5File(const std::string& fName, const Recording& WData, Pro
             throw std::runtime_error(errorMsg);
         }
 
+        if (layout == hdf5_chunked) {
+            try {
+                exportChunkedChannel(channel_group, WData, n_c, filter, progDlg);
+            }
+            catch (...) {
+                H5Gclose(channel_group);
+                H5Gclose(channels_group);
+                H5Fclose(file_id);
+                H5close();
+                throw;
+            }
+            H5Gclose(channel_group);
+            continue;
+        }
+
         int max_log10 = 0;
         if (WData[n_c].size() > 1) {
             max_log10 = int(log10((double)WData[n_c].size()-1.0));
@@ -302,7 +1321,75 @@ bool stfio::exportHDF5File(const std::string& fName, const Recording& WData, Pro
     return (status >= 0);
 }
 
+std::vector<std::size_t> stfio::getHDF5SectionCounts(const std::string& fName) {
+    hid_t file_id = H5Fopen(fName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+        throw std::runtime_error("Couldn't open " + fName + " in stfio::getHDF5SectionCounts");
+    }
+    std::vector<std::size_t> counts;
+    const int NFIELDS = 3;
+    size_t rt_offset[NFIELDS] = {  HOFFSET( rt, channels ),
+                                   HOFFSET( rt, date ),
+                                   HOFFSET( rt, time )};
+    rt rt_buf[1];
+    size_t rt_sizes[NFIELDS] = { sizeof( rt_buf[0].channels),
+                                 sizeof( rt_buf[0].date),
+                                 sizeof( rt_buf[0].time)};
+    herr_t status = H5TBread_table( file_id, "description", sizeof(rt), rt_offset, rt_sizes, rt_buf );
+    for (int n_c=0; status >= 0 && n_c < rt_buf[0].channels; ++n_c) {
+        std::ostringstream desc_path;
+        desc_path << "/channels/ch" << (n_c);
+        hsize_t cdims;
+        H5T_class_t cclass_id;
+        size_t ctype_size;
+        status = H5LTget_dataset_info( file_id, desc_path.str().c_str(), &cdims, &cclass_id, &ctype_size );
+        if (status < 0) {
+            break;
+        }
+        hid_t string_typec = H5Tcopy( H5T_C_S1 );
+        H5Tset_size( string_typec, ctype_size );
+        std::vector<char> szchannel_name(ctype_size);
+        status = H5LTread_dataset(file_id, desc_path.str().c_str(), string_typec, &szchannel_name[0] );
+        H5Tclose( string_typec );
+        if (status < 0) {
+            break;
+        }
+        std::string channel_path = "/" + std::string(szchannel_name.begin(), szchannel_name.end());
+
+        size_t ct_offset[1] = { HOFFSET( ct, n_sections ) };
+        ct ct_buf[1];
+        size_t ct_sizes[1] = { sizeof( ct_buf[0].n_sections) };
+        hid_t channel_group = H5Gopen2(file_id, channel_path.c_str(), H5P_DEFAULT );
+        if (channel_group < 0) {
+            status = -1;
+            break;
+        }
+        status = H5TBread_table( channel_group, "description", sizeof(ct), ct_offset, ct_sizes, ct_buf );
+        H5Gclose( channel_group );
+        if (status < 0) {
+            break;
+        }
+        counts.push_back(ct_buf[0].n_sections > 0 ? ct_buf[0].n_sections : 0);
+    }
+    H5Fclose(file_id);
+    H5close();
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading descriptions in stfio::getHDF5SectionCounts");
+    }
+    return counts;
+}
+
 void stfio::importHDF5File(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg) {
+    importHDF5Range(fName, ReturnData, progDlg, 0, (std::size_t)-1);
+}
+
+void stfio::importHDF5Range(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg,
+                            std::size_t section_begin, std::size_t section_end,
+                            std::size_t sample_begin, std::size_t sample_end)
+{
+    if (section_begin > section_end || sample_begin > sample_end) {
+        throw std::out_of_range("Invalid range in stfio::importHDF5Range");
+    }
     /* Create a new file using default properties. */
     hid_t file_id = H5Fopen(fName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     
@@ -324,6 +1411,14 @@ void stfio::importHDF5File(const std::string& fName, Recording& ReturnData, Prog
         throw std::runtime_error(errorMsg);
     }
     int numberChannels =rt_buf[0].channels;
+    int layout_version = 1;
+    if (H5LTfind_attribute(file_id, "layout_version") == 1) {
+        status = H5LTget_attribute_int(file_id, "/", "layout_version", &layout_version);
+        if (status < 0 || layout_version > CHUNKED_LAYOUT) {
+            H5Fclose(file_id);
+            throw std::runtime_error("Unsupported layout version in stfio::importHDF5File");
+        }
+    }
     if ( ReturnData.SetDate(rt_buf[0].date)
       || ReturnData.SetTime(rt_buf[0].time) ) {
         std::cout << "Warning HDF5: could not decode date/time " << rt_buf[0].date << " " << rt_buf[0].time << std::endl;
@@ -408,22 +1503,31 @@ void stfio::importHDF5File(const std::string& fName, Recording& ReturnData, Prog
             std::string errorMsg("Exception while reading channel description in stfio::importHDF5File");
             throw std::runtime_error(errorMsg);
         }
-        Channel TempChannel(ct_buf[0].n_sections);
+        // only read the selected sections:
+        std::size_t n_sections = ct_buf[0].n_sections > 0 ? ct_buf[0].n_sections : 0;
+        std::size_t sec_begin = std::min(section_begin, n_sections);
+        std::size_t sec_end = std::min(section_end, n_sections);
+        Channel TempChannel(sec_end-sec_begin);
         TempChannel.SetChannelName( channel_name.str() );
+        if (layout_version == CHUNKED_LAYOUT) {
+            importChunkedChannel(channel_group, TempChannel, n_sections, sec_begin, sample_begin, sample_end,
+                                 n_c, numberChannels, dt, yunits, progDlg);
+        }
         int max_log10 = 0;
         if (ct_buf[0].n_sections > 1) {
             max_log10 = int(log10((double)ct_buf[0].n_sections-1.0));
         }
 
-        for (int n_s=0; n_s < ct_buf[0].n_sections; ++n_s) {
+        // in the original layout, each section has a group of its own:
+        for (int n_s=(int)sec_begin; n_s < (int)sec_end && layout_version != CHUNKED_LAYOUT; ++n_s) {
             int progbar =
                 // Channel contribution:
                 (int)(((double)n_c/(double)numberChannels)*100.0+
                       // Section contribution:
-                      (double)(n_s)/(double)ct_buf[0].n_sections*(100.0/numberChannels));
+                      (double)(n_s-sec_begin)/(double)TempChannel.size()*(100.0/numberChannels));
             std::ostringstream progStr;
             progStr << "Reading channel #" << n_c + 1 << " of " << numberChannels
-                    << ", Section #" << n_s+1 << " of " << ct_buf[0].n_sections;
+                    << ", Section #" << n_s-sec_begin+1 << " of " << TempChannel.size();
             progDlg.Update(progbar, progStr.str());
             
             // construct a number with leading zeros:
@@ -454,24 +1558,21 @@ void stfio::importHDF5File(const std::string& fName, Recording& ReturnData, Prog
                 std::string errorMsg("Exception while reading data information in stfio::importHDF5File");
                 throw std::runtime_error(errorMsg);
             }
-            Vector_float TempSection(sdims);
-            status = H5LTread_dataset(file_id, data_path.str().c_str(), H5T_IEEE_F32LE, &TempSection[0]);
-            if (status < 0) {
+            hid_t dataset = H5Dopen2(file_id, data_path.str().c_str(), H5P_DEFAULT);
+            if (dataset < 0) {
                 std::string errorMsg("Exception while reading data in stfio::importHDF5File");
                 throw std::runtime_error(errorMsg);
             }
-
-            Section TempSectionT(TempSection.size(), section_name.str());
-            for (std::size_t cp = 0; cp < TempSectionT.size(); ++cp) {
-                TempSectionT[cp] = double(TempSection[cp]);
-            }
-            // std::copy(TempSection.begin(),TempSection.end(),&TempSectionT[0]);
             try {
-                TempChannel.InsertSection(TempSectionT,n_s);
+                TempChannel.InsertSection(readWindow(dataset, 0, std::min((hsize_t)sample_begin, sdims),
+                                                     std::min((hsize_t)sample_end, sdims), section_name.str()),
+                                          n_s-sec_begin);
             }
             catch (...) {
+                H5Dclose(dataset);
                 throw;
             }
+            H5Dclose(dataset);
 
 
             /* H5TBread_table
@@ -499,7 +1600,7 @@ void stfio::importHDF5File(const std::string& fName, Recording& ReturnData, Prog
             if ((int)ReturnData.size()<numberChannels) {
                 ReturnData.resize(numberChannels);
             }
-            ReturnData.InsertChannel(TempChannel,n_c);
+            ReturnData.InsertChannel(STFIO_MOVE(TempChannel),n_c);
             ReturnData[n_c].SetYUnits( yunits );
         }
         catch (...) {
@@ -526,3 +1627,291 @@ void stfio::importHDF5File(const std::string& fName, Recording& ReturnData, Prog
 }
 
 
+namespace {
+
+const static unsigned int FUNCLEN = 64;
+
+// A row of the fit cache table:
+typedef struct fct {
+    int channel;
+    int section;
+    unsigned long long key;
+    char func[FUNCLEN];
+    long long fitbeg;
+    long long fitend;
+    double chisqr;
+    int warning;
+    // parameters are stored in a separate data set:
+    long long param_offset;
+    int n_params;
+} fct;
+
+const int FCT_NFIELDS = 10;
+
+const size_t fct_offset[FCT_NFIELDS] = { HOFFSET( fct, channel ),
+                                         HOFFSET( fct, section ),
+                                         HOFFSET( fct, key ),
+                                         HOFFSET( fct, func ),
+                                         HOFFSET( fct, fitbeg ),
+                                         HOFFSET( fct, fitend ),
+                                         HOFFSET( fct, chisqr ),
+                                         HOFFSET( fct, warning ),
+                                         HOFFSET( fct, param_offset ),
+                                         HOFFSET( fct, n_params ) };
+
+const size_t fct_sizes[FCT_NFIELDS] = { sizeof( ((fct*)0)->channel ),
+                                        sizeof( ((fct*)0)->section ),
+                                        sizeof( ((fct*)0)->key ),
+                                        sizeof( ((fct*)0)->func ),
+                                        sizeof( ((fct*)0)->fitbeg ),
+                                        sizeof( ((fct*)0)->fitend ),
+                                        sizeof( ((fct*)0)->chisqr ),
+                                        sizeof( ((fct*)0)->warning ),
+                                        sizeof( ((fct*)0)->param_offset ),
+                                        sizeof( ((fct*)0)->n_params ) };
+
+}
+
+void stfio::exportHDF5FitCaches(const std::string& fName,
+                                const std::vector<std::vector<FitCache> >& caches)
+{
+    std::vector<fct> rows;
+    Vector_double params;
+    for (std::size_t n_c = 0; n_c < caches.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < caches[n_c].size(); ++n_s) {
+            const std::vector<FitCacheEntry>& entries = caches[n_c][n_s].GetEntries();
+            for (std::size_t n_e = 0; n_e < entries.size(); ++n_e) {
+                fct row;
+                memset(&row, 0, sizeof(fct));
+                row.channel = (int)n_c;
+                row.section = (int)n_s;
+                row.key = entries[n_e].key;
+                strncpy(row.func, entries[n_e].funcName.c_str(), FUNCLEN-1);
+                row.fitbeg = (long long)entries[n_e].fitBeg;
+                row.fitend = (long long)entries[n_e].fitEnd;
+                row.chisqr = entries[n_e].chisqr;
+                row.warning = entries[n_e].warning;
+                row.param_offset = (long long)params.size();
+                row.n_params = (int)entries[n_e].params.size();
+                params.insert(params.end(), entries[n_e].params.begin(), entries[n_e].params.end());
+                rows.push_back(row);
+            }
+        }
+    }
+
+    hid_t file_id = H5Fopen(fName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    if (file_id < 0) {
+        throw std::runtime_error("Couldn't open " + fName + " in stfio::exportHDF5FitCaches");
+    }
+    herr_t status = 0;
+    if (H5Lexists(file_id, "/fitcache", H5P_DEFAULT) > 0) {
+        status = H5Ldelete(file_id, "/fitcache", H5P_DEFAULT);
+    }
+    if (status >= 0 && !rows.empty()) {
+        hid_t fitcache_group = H5Gcreate2(file_id, "/fitcache", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if (fitcache_group < 0) {
+            status = -1;
+        } else {
+            const char *field_names[FCT_NFIELDS] = { "channel", "section", "key", "function",
+                                                     "fit_begin", "fit_end", "chisqr", "warning",
+                                                     "param_offset", "n_params" };
+            hid_t string_type = H5Tcopy( H5T_C_S1 );
+            H5Tset_size( string_type, FUNCLEN );
+            hid_t field_type[FCT_NFIELDS] = { H5T_NATIVE_INT, H5T_NATIVE_INT, H5T_NATIVE_ULLONG,
+                                              string_type, H5T_NATIVE_LLONG, H5T_NATIVE_LLONG,
+                                              H5T_NATIVE_DOUBLE, H5T_NATIVE_INT, H5T_NATIVE_LLONG,
+                                              H5T_NATIVE_INT };
+            status = H5TBmake_table( "Cached fit results", fitcache_group, "entries", (hsize_t)FCT_NFIELDS,
+                                     (hsize_t)rows.size(), sizeof(fct), field_names, fct_offset, field_type,
+                                     rows.size() < 1024 ? rows.size() : 1024, NULL, 0, &rows[0] );
+            H5Tclose( string_type );
+            if (status >= 0) {
+                hsize_t dims[1] = { params.size() };
+                status = H5LTmake_dataset_double(fitcache_group, "params", 1, dims,
+                                                 params.empty() ? NULL : &params[0]);
+            }
+            H5Gclose(fitcache_group);
+        }
+    }
+    H5Fclose(file_id);
+    H5close();
+    if (status < 0) {
+        throw std::runtime_error("Exception while writing fit caches in stfio::exportHDF5FitCaches");
+    }
+}
+
+std::vector<std::vector<stfio::FitCache> > stfio::importHDF5FitCaches(const std::string& fName) {
+    std::vector<std::size_t> counts(getHDF5SectionCounts(fName));
+    std::vector<std::vector<FitCache> > caches(counts.size());
+    for (std::size_t n_c = 0; n_c < counts.size(); ++n_c) {
+        caches[n_c].resize(counts[n_c]);
+    }
+
+    hid_t file_id = H5Fopen(fName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+        throw std::runtime_error("Couldn't open " + fName + " in stfio::importHDF5FitCaches");
+    }
+    herr_t status = 0;
+    if (H5Lexists(file_id, "/fitcache", H5P_DEFAULT) > 0) {
+        hsize_t n_fields = 0, n_records = 0;
+        status = H5TBget_table_info(file_id, "/fitcache/entries", &n_fields, &n_records);
+        std::vector<fct> rows(n_records);
+        Vector_double params;
+        if (status >= 0 && n_records > 0) {
+            status = H5TBread_table(file_id, "/fitcache/entries", sizeof(fct), fct_offset, fct_sizes, &rows[0]);
+        }
+        if (status >= 0 && n_records > 0) {
+            hsize_t dims[1] = { 0 };
+            H5T_class_t class_id;
+            size_t type_size;
+            status = H5LTget_dataset_info(file_id, "/fitcache/params", dims, &class_id, &type_size);
+            if (status >= 0) {
+                params.resize(dims[0]);
+                if (!params.empty()) {
+                    status = H5LTread_dataset_double(file_id, "/fitcache/params", &params[0]);
+                }
+            }
+        }
+        for (std::size_t n_r = 0; status >= 0 && n_r < rows.size(); ++n_r) {
+            const fct& row = rows[n_r];
+            // rows that don't fit this file are skipped:
+            if (row.channel < 0 || row.channel >= (int)caches.size() ||
+                row.section < 0 || row.section >= (int)caches[row.channel].size() ||
+                row.n_params < 0 || row.param_offset < 0 ||
+                (std::size_t)(row.param_offset + row.n_params) > params.size())
+            {
+                continue;
+            }
+            FitCacheEntry entry;
+            entry.key = row.key;
+            entry.funcName = std::string(row.func, strnlen(row.func, FUNCLEN));
+            entry.fitBeg = (std::size_t)row.fitbeg;
+            entry.fitEnd = (std::size_t)row.fitend;
+            entry.chisqr = row.chisqr;
+            entry.warning = row.warning;
+            entry.params.assign(params.begin()+row.param_offset,
+                                params.begin()+row.param_offset+row.n_params);
+            caches[row.channel][row.section].Insert(entry);
+        }
+    }
+    H5Fclose(file_id);
+    H5close();
+    if (status < 0) {
+        throw std::runtime_error("Exception while reading fit caches in stfio::importHDF5FitCaches");
+    }
+    return caches;
+}
+
+void stfio::createHDF5Table(const std::string& fName, const std::string& labelTitle,
+                            const std::vector<std::string>& colLabels)
+{
+    if (colLabels.empty()) {
+        throw std::runtime_error("No columns in stfio::createHDF5Table");
+    }
+    std::string columns;
+    for (std::size_t n_c = 0; n_c < colLabels.size(); ++n_c) {
+        columns += (n_c == 0 ? "" : ",") + colLabels[n_c];
+    }
+
+    hid_t file_id = H5Fcreate(fName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file_id < 0) {
+        throw std::runtime_error("Couldn't create " + fName + " in stfio::createHDF5Table");
+    }
+    // both data sets start empty and grow by whole chunks of rows:
+    hsize_t n_cols = colLabels.size();
+    hsize_t dims[2] = { 0, n_cols };
+    hsize_t maxdims[2] = { H5S_UNLIMITED, n_cols };
+    hsize_t chunk[2] = { std::max(CHUNKSIZE / 16 / n_cols, (hsize_t)1), n_cols };
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 2, chunk);
+    hid_t space = H5Screate_simple(2, dims, maxdims);
+    hid_t dataset = H5Dcreate2(file_id, "/results", H5T_IEEE_F64LE, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Sclose(space);
+    H5Pclose(dcpl);
+    herr_t status = (dataset < 0) ? -1 : H5Dclose(dataset);
+
+    if (status >= 0) {
+        hid_t string_type = H5Tcopy(H5T_C_S1);
+        H5Tset_size(string_type, H5T_VARIABLE);
+        dcpl = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(dcpl, 1, chunk);
+        space = H5Screate_simple(1, dims, maxdims);
+        dataset = H5Dcreate2(file_id, "/labels", string_type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+        H5Sclose(space);
+        H5Pclose(dcpl);
+        H5Tclose(string_type);
+        status = (dataset < 0) ? -1 : H5Dclose(dataset);
+    }
+    if (status >= 0) {
+        status = H5LTset_attribute_string(file_id, "/results", "columns", columns.c_str());
+    }
+    if (status >= 0) {
+        status = H5LTset_attribute_string(file_id, "/labels", "title", labelTitle.c_str());
+    }
+    H5Fclose(file_id);
+    H5close();
+    if (status < 0) {
+        throw std::runtime_error("Exception while creating table in stfio::createHDF5Table");
+    }
+}
+
+namespace {
+
+// Extends a chunked data set by n_rows and writes them from memory.
+herr_t appendRows(hid_t file_id, const char* name, hid_t mem_type, int rank,
+                  hsize_t n_rows, const void* buf)
+{
+    hid_t dataset = H5Dopen2(file_id, name, H5P_DEFAULT);
+    if (dataset < 0) {
+        return -1;
+    }
+    hsize_t dims[2] = { 0, 0 };
+    hid_t file_space = H5Dget_space(dataset);
+    H5Sget_simple_extent_dims(file_space, dims, NULL);
+    H5Sclose(file_space);
+    hsize_t start[2] = { dims[0], 0 };
+    hsize_t count[2] = { n_rows, dims[1] };
+    dims[0] += n_rows;
+    herr_t status = H5Dset_extent(dataset, dims);
+    if (status >= 0) {
+        file_space = H5Dget_space(dataset);
+        H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+        hid_t mem_space = H5Screate_simple(rank, count, NULL);
+        status = H5Dwrite(dataset, mem_type, mem_space, file_space, H5P_DEFAULT, buf);
+        H5Sclose(mem_space);
+        H5Sclose(file_space);
+    }
+    H5Dclose(dataset);
+    return status;
+}
+
+}
+
+void stfio::appendHDF5Table(const std::string& fName, const std::vector<std::string>& labels,
+                            const Vector_double& values)
+{
+    if (labels.empty()) {
+        return;
+    }
+    std::vector<const char*> labelPtrs(labels.size());
+    for (std::size_t n_r = 0; n_r < labels.size(); ++n_r) {
+        labelPtrs[n_r] = labels[n_r].c_str();
+    }
+
+    hid_t file_id = H5Fopen(fName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    if (file_id < 0) {
+        throw std::runtime_error("Couldn't open " + fName + " in stfio::appendHDF5Table");
+    }
+    herr_t status = appendRows(file_id, "/results", H5T_NATIVE_DOUBLE, 2, labels.size(), &values[0]);
+    if (status >= 0) {
+        hid_t string_type = H5Tcopy(H5T_C_S1);
+        H5Tset_size(string_type, H5T_VARIABLE);
+        status = appendRows(file_id, "/labels", string_type, 1, labels.size(), &labelPtrs[0]);
+        H5Tclose(string_type);
+    }
+    H5Fclose(file_id);
+    H5close();
+    if (status < 0) {
+        throw std::runtime_error("Exception while writing rows in stfio::appendHDF5Table");
+    }
+}
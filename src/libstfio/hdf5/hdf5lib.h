@@ -22,24 +22,116 @@
 #define _HDF5LIB_H
 
 #include "../stfio.h"
+#include "../fitcache.h"
 class Recording;
+class RecordingView;
 
 namespace stfio {
 
+//! Storage layouts of HDF5 files.
+enum hdf5_layout {
+    hdf5_sections, /*!< One data set and description table per section (layout version 1). */
+    hdf5_chunked   /*!< One chunked 2-D data set (sections x samples) per channel (layout version 2). */
+};
+
+//! Compression filters for chunked HDF5 data sets.
+enum hdf5_filter {
+    hdf5_no_filter,       /*!< Uncompressed. */
+    hdf5_deflate,         /*!< zlib compression. */
+    hdf5_shuffle_deflate, /*!< Byte shuffling followed by zlib compression. */
+    hdf5_lz4,             /*!< LZ4 compression; requires the HDF5 LZ4 filter plugin. */
+    hdf5_ephys            /*!< Lossless coding of scaled 16-bit integers (see ephyscodec.h);
+                           *   channels whose samples aren't scaled 16-bit integers are
+                           *   compressed with hdf5_shuffle_deflate. */
+};
+
 //! Open a HDF5 file and store its contents to a Recording object.
-/*! \param fName Full path to the file to be read.
+/*! Both storage layouts are supported.
+ *  \param fName Full path to the file to be read.
  *  \param ReturnData On entry, an empty Recording object. On exit,
  *         the data stored in \e fName.
  *  \param progress True if the progress dialog should be updated.
  */
 void importHDF5File(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg);
 
+//! Read a range of sections and samples from a HDF5 file.
+/*! Only the selected parts of the file are read, so that this is much faster
+ *  than importHDF5File() if only a few sections or a short time window are needed.
+ *  Ranges that extend beyond the data are truncated. Throws std::out_of_range
+ *  if a range ends before it begins.
+ *  \param fName Full path to the file to be read.
+ *  \param ReturnData On entry, an empty Recording object. On exit,
+ *         the selected sections of each channel of \e fName.
+ *  \param progDlg The progress indicator.
+ *  \param section_begin Index of the first section to be read.
+ *  \param section_end Index past the last section to be read.
+ *  \param sample_begin Index of the first sampling point to be read from each section.
+ *  \param sample_end Index past the last sampling point to be read from each section.
+ */
+StfioDll void importHDF5Range(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg,
+                              std::size_t section_begin, std::size_t section_end,
+                              std::size_t sample_begin = 0, std::size_t sample_end = (std::size_t)-1);
+
+//! Retrieves the number of sections of each channel in a HDF5 file.
+/*! Only the file and channel descriptions are read.
+ *  \param fName Full path to the file to be read.
+ *  \return The number of sections of each channel.
+ */
+StfioDll std::vector<std::size_t> getHDF5SectionCounts(const std::string& fName);
+
 //! Export a Recording to a HDF5 file.
 /*! \param fName Full path to the file to be written.
  *  \param WData The data to be exported.
+ *  \param layout The storage layout. Files with the chunked layout can't be
+ *         read by versions of stimfit that only know layout version 1.
+ *  \param filter The compression filter; only used for the chunked layout.
  *  \return The HDF5 file handle.
  */
-StfioDll  bool exportHDF5File(const std::string& fName, const Recording& WData, ProgressInfo& progDlg);
+StfioDll  bool exportHDF5File(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg,
+                              hdf5_layout layout = hdf5_sections, hdf5_filter filter = hdf5_shuffle_deflate);
+
+//! Stores the fit caches of all sections in an existing HDF5 file.
+/*! The caches are written to the group "/fitcache" of a file that was
+ *  written by exportHDF5File(), replacing previously stored caches.
+ *  Throws std::runtime_error if the file can't be written.
+ *  \param fName Full path to the file.
+ *  \param caches The fit caches of each section of each channel, in the
+ *         order of the channels in the file.
+ */
+StfioDll void exportHDF5FitCaches(const std::string& fName,
+                                  const std::vector<std::vector<FitCache> >& caches);
+
+//! Reads the fit caches that were stored by exportHDF5FitCaches().
+/*! Throws std::runtime_error if the file can't be read.
+ *  \param fName Full path to the file.
+ *  \return The fit caches of each section of each channel; caches are
+ *          empty if the file doesn't contain any cached results.
+ */
+StfioDll std::vector<std::vector<FitCache> > importHDF5FitCaches(const std::string& fName);
+
+//! Creates a HDF5 file for a table of results that grows with appendHDF5Table().
+/*! The numbers are stored in the extendible 2-D data set "/results", whose
+ *  attribute "columns" holds the comma-separated column labels, and the label
+ *  of each row in the 1-D string data set "/labels", whose attribute "title"
+ *  describes the labels. Both data sets are empty at first.
+ *  Throws std::runtime_error if the file can't be written.
+ *  \param fName Full path to the file; an existing file is overwritten.
+ *  \param labelTitle Description of the row labels, e.g. "file".
+ *  \param colLabels The labels of the columns; at least one is needed.
+ */
+StfioDll void createHDF5Table(const std::string& fName, const std::string& labelTitle,
+                              const std::vector<std::string>& colLabels);
+
+//! Appends rows to a table that was created by createHDF5Table().
+/*! The file is closed again before returning, so that all rows that have
+ *  been appended can be read even if the program doesn't finish.
+ *  Throws std::runtime_error if the file can't be written.
+ *  \param fName Full path to the file.
+ *  \param labels The labels of the new rows.
+ *  \param values The numbers of the new rows, one row after the other.
+ */
+StfioDll void appendHDF5Table(const std::string& fName, const std::vector<std::string>& labels,
+                              const Vector_double& values);
 
 }
 
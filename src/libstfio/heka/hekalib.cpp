@@ -37,6 +37,7 @@
 
 #include "./hekalib.h"
 #include "../recording.h"
+#include "../parallel.h"
 
 #define C_ASSERT(e) extern void __C_ASSERT__(int [(e)?1:-1])
 #define ByteSwap16(x) ByteSwap((unsigned char *) &x,sizeof(x))
@@ -430,22 +431,10 @@ void ByteSwap32(void* ptr32) {
 }
 #endif
 
-void ShortByteSwap(short& s) {
-    ByteSwap((unsigned char *) &s,sizeof(s));
-}
-
-void FloatByteSwap(float& s) {
-    ByteSwap((unsigned char *) &s,sizeof(s));
-}
-
 void IntByteSwap(int& s) {
     ByteSwap((unsigned char *) &s,sizeof(s));
 }
 
-void DoubleByteSwap(double& s) {
-    ByteSwap((unsigned char *) &s,sizeof(s));
-}
-
 void SwapItem(BundleItem& item) {
     ByteSwap32(item.oStart);
     ByteSwap32(item.oLength);
@@ -727,6 +716,23 @@ std::string time2date(double t) {
     return datestr;
 }
 
+// Location of a trace in the data file:
+struct TracePos {
+    long offset;
+    std::size_t bytes;
+    int nc, ns;
+    stfio::SampleType type;
+};
+
+bool lessOffset(const TracePos& a, const TracePos& b) {
+    return a.offset < b.offset;
+}
+
+// Traces are read in blocks of up to this size:
+const std::size_t maxBlockSize = 32*1024*1024;
+// Gaps between traces up to this size are read through rather than skipped:
+const std::size_t maxGap = 1024*1024;
+
 void ReadData(FILE* fh, const Tree& tree, Recording& RecordingInOut,
               stfio::ProgressInfo& progDlg)
 {
@@ -736,98 +742,100 @@ void ReadData(FILE* fh, const Tree& tree, Recording& RecordingInOut,
 
     int nchannels = ntraces/nsweeps;
     RecordingInOut.resize(nchannels);
-    int res = 0;
+    std::vector<double> factor(nchannels, 1.0), shift(nchannels, 0.0);
+    std::vector<TracePos> traces;
+    traces.reserve(ntraces);
     for (int nc=0; nc<nchannels; ++nc) {
         RecordingInOut[nc].resize(nsweeps);
+        if (std::string(tree.TraceList[nc].TrYUnit) == "V") {
+            RecordingInOut[nc].SetYUnits("mV");
+            factor[nc] = 1.0e3;
+        } else if (std::string(tree.TraceList[nc].TrYUnit) == "A") {
+            RecordingInOut[nc].SetYUnits("pA");
+            factor[nc] = 1.0e12;
+        } else {
+            RecordingInOut[nc].SetYUnits(tree.TraceList[nc].TrYUnit);
+        }
+        factor[nc] *=  tree.TraceList[nc].TrDataScaler;
+        shift[nc] = tree.TraceList[nc].TrZeroData;
+        RecordingInOut[nc].SetChannelName(tree.TraceList[nc].TrLabel);
+
         for (int ns=0; ns<nsweeps; ++ns) {
-            // nstree=nc; nstree<ntraces; nstree += nchannels) {
-            // int ns = nstree/nchannels;
             int nstree = (ns*nchannels)+nc;
-            int progbar =
-                // Channel contribution:
-                (int)(((double)nc/(double)nchannels)*100.0+
-                      // Section contribution:
-                      (double)ns/(double)nsweeps*(100.0/nchannels));
-            std::ostringstream progStr;
-            progStr << "Reading channel #" << nc + 1 << " of " << nchannels
-                    << ", Section #" << ns + 1 << " of " << nsweeps;
-            bool skip = false;
-            progDlg.Update(progbar, progStr.str(), &skip);
-            if (skip) {
-                RecordingInOut.resize(0);
-                return;
-            }
-
             int npoints = tree.TraceList[nstree].TrDataPoints;
             RecordingInOut[nc][ns].resize(npoints);
-
-            fseek(fh, tree.TraceList[nstree].TrData, SEEK_SET);
+            if (npoints <= 0) {
+                continue;
+            }
+            TracePos trace;
             switch (int(tree.TraceList[nstree].TrDataFormat)) {
-             case 0: {
-                 /*int16*/
-                 std::vector<short> tmpSection(npoints);
-                 res = fread(&tmpSection[0], sizeof(short), npoints, fh);
-                 if (res != npoints)
-                     throw std::runtime_error("getBundleHeader: Error in fread()");
-                 if (tree.needsByteSwap) 
-                     std::for_each(tmpSection.begin(), tmpSection.end(), ShortByteSwap);
-
-                 std::copy(tmpSection.begin(), tmpSection.end(), RecordingInOut[nc][ns].get_w().begin());
-                 break;
-             }
-             case 1: {
-                 /*int32*/
-                 std::vector<int> tmpSection(npoints);
-                 res = fread(&tmpSection[0], sizeof(int), npoints, fh);
-                 if (res != npoints)
-                     throw std::runtime_error("getBundleHeader: Error in fread()");
-                 if (tree.needsByteSwap) 
-                     std::for_each(tmpSection.begin(), tmpSection.end(), IntByteSwap);
-                 std::copy(tmpSection.begin(), tmpSection.end(), RecordingInOut[nc][ns].get_w().begin());
-                 break;
-             }
-             case 2: {
-                 /*double16*/
-                 std::vector<float> tmpSection(npoints);
-                 res = fread(&tmpSection[0], sizeof(float), npoints, fh);
-                 if (res != npoints)
-                     throw std::runtime_error("getBundleHeader: Error in fread()");
-                 if (tree.needsByteSwap) 
-                     std::for_each(tmpSection.begin(), tmpSection.end(), FloatByteSwap);
-                 std::copy(tmpSection.begin(), tmpSection.end(), RecordingInOut[nc][ns].get_w().begin());
-                 break;
-             }
-             case 3: {
-                 /*double32*/
-                 std::vector<double> tmpSection(npoints);
-                 res = fread(&tmpSection[0], sizeof(double), npoints, fh);
-                 if (res != npoints)
-                     throw std::runtime_error("getBundleHeader: Error in fread()");
-                 if (tree.needsByteSwap) 
-                     std::for_each(tmpSection.begin(), tmpSection.end(), DoubleByteSwap);
-                 std::copy(tmpSection.begin(), tmpSection.end(), RecordingInOut[nc][ns].get_w().begin());
-                 break;
-             }
+             case 0: trace.type = stfio::sample_int16; break;
+             case 1: trace.type = stfio::sample_int32; break;
+             case 2: trace.type = stfio::sample_float32; break;
+             case 3: trace.type = stfio::sample_float64; break;
              default:
                  throw std::runtime_error("Unknown data format while reading heka file");
             }
-            double factor = 1.0;
-            if (std::string(tree.TraceList[nc].TrYUnit) == "V") {
-                RecordingInOut[nc].SetYUnits("mV");
-                factor = 1.0e3;
-            } else if (std::string(tree.TraceList[nc].TrYUnit) == "A") {
-                RecordingInOut[nc].SetYUnits("pA");
-                factor = 1.0e12;
-            } else {
-                RecordingInOut[nc].SetYUnits(tree.TraceList[nc].TrYUnit);
+            trace.offset = tree.TraceList[nstree].TrData;
+            trace.bytes = npoints*stfio::sampleSize(trace.type);
+            trace.nc = nc;
+            trace.ns = ns;
+            traces.push_back(trace);
+        }
+    }
+
+    // Read the traces in file order, in as few large sequential blocks as possible:
+    std::sort(traces.begin(), traces.end(), lessOffset);
+    std::vector<char> buffer;
+    int lastprog = -1;
+    std::size_t first = 0;
+    while (first < traces.size()) {
+        long blockBegin = traces[first].offset;
+        long blockEnd = blockBegin + (long)traces[first].bytes;
+        std::size_t last = first+1;
+        while (last < traces.size() &&
+               traces[last].offset >= blockBegin &&
+               traces[last].offset <= blockEnd + (long)maxGap &&
+               std::max(blockEnd, traces[last].offset + (long)traces[last].bytes) - blockBegin
+                   <= (long)maxBlockSize)
+        {
+            blockEnd = std::max(blockEnd, traces[last].offset + (long)traces[last].bytes);
+            ++last;
+        }
+
+        buffer.resize(blockEnd-blockBegin);
+        fseek(fh, blockBegin, SEEK_SET);
+        if (fread(&buffer[0], 1, buffer.size(), fh) != buffer.size())
+            throw std::runtime_error("getBundleHeader: Error in fread()");
+
+        // swap, convert and scale straight into the sections:
+        int nblock = last-first;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) num_threads(stfio::threadCount(0, nblock))
+#endif
+        for (int nt=0; nt<nblock; ++nt) {
+            const TracePos& trace = traces[first+nt];
+            Section& sec = RecordingInOut[trace.nc][trace.ns];
+            stfio::decodeSamples(&buffer[trace.offset-blockBegin], sec.size(),
+                                 stfio::sampleSize(trace.type), trace.type, tree.needsByteSwap,
+                                 factor[trace.nc], shift[trace.nc], &sec.get_w()[0]);
+        }
+        first = last;
+
+        int progbar = (int)(100.0*first/traces.size());
+        if (progbar != lastprog) {
+            lastprog = progbar;
+            std::ostringstream progStr;
+            progStr << "Reading trace " << first << " of " << traces.size();
+            bool skip = false;
+            progDlg.Update(progbar, progStr.str(), &skip);
+            if (skip) {
+                RecordingInOut.resize(0);
+                return;
             }
-            factor *=  tree.TraceList[nc].TrDataScaler;
-            RecordingInOut[nc][ns].get_w() = stfio::vec_scal_mul(RecordingInOut[nc][ns].get(), factor);
-            RecordingInOut[nc][ns].get_w() = stfio::vec_scal_plus(RecordingInOut[nc][ns].get(), tree.TraceList[nc].TrZeroData);
         }
-        RecordingInOut[nc].SetChannelName(tree.TraceList[nc].TrLabel);
-        
     }
+
     double tsc = 1.0;
     std::string xunits(tree.TraceList[0].TrXUnit);
     if (xunits == "s") {
@@ -0,0 +1,106 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file history.cpp
+ *  \brief Defines an undo history for operations that modify recordings in place.
+ */
+
+#include <stdexcept>
+#include <algorithm>
+
+#include "./history.h"
+#include "./recording.h"
+
+stfio::EditHistory::EditHistory(std::size_t maxSteps_)
+    : maxSteps(std::max<std::size_t>(maxSteps_, 1)), undoSteps(), redoSteps()
+{}
+
+void stfio::EditHistory::Record(const Recording& data, std::size_t channel,
+                                const std::vector<std::size_t>& sections, const std::string& label)
+{
+    if (channel >= data.size()) {
+        throw std::out_of_range("Channel index out of range in stfio::EditHistory::Record()");
+    }
+    Step step;
+    step.label = label;
+    step.channel = channel;
+    step.indices = sections;
+    step.saved.resize(sections.size());
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= data[channel].size()) {
+            throw std::out_of_range("Section index out of range in stfio::EditHistory::Record()");
+        }
+        // shares the samples with the recording:
+        step.saved[n] = data[channel][sections[n]];
+    }
+    Push(step);
+}
+
+void stfio::EditHistory::Push(Step& step) {
+    redoSteps.clear();
+    undoSteps.push_back(Step());
+    std::swap(undoSteps.back(), step);
+    while (undoSteps.size() > maxSteps) {
+        undoSteps.pop_front();
+    }
+}
+
+void stfio::EditHistory::Swap(Recording& data, Step& step) {
+    if (step.channel >= data.size()) {
+        throw std::out_of_range("The channel of the step doesn't exist any more");
+    }
+    Channel& ch = data[step.channel];
+    for (std::size_t n = 0; n < step.indices.size(); ++n) {
+        if (step.indices[n] >= ch.size()) {
+            throw std::out_of_range("A section of the step doesn't exist any more");
+        }
+    }
+    for (std::size_t n = 0; n < step.indices.size(); ++n) {
+        std::swap(ch[step.indices[n]], step.saved[n]);
+    }
+}
+
+void stfio::EditHistory::Undo(Recording& data) {
+    if (undoSteps.empty()) {
+        throw std::out_of_range("There is nothing to undo");
+    }
+    Swap(data, undoSteps.back());
+    redoSteps.push_back(Step());
+    std::swap(redoSteps.back(), undoSteps.back());
+    undoSteps.pop_back();
+}
+
+void stfio::EditHistory::Redo(Recording& data) {
+    if (redoSteps.empty()) {
+        throw std::out_of_range("There is nothing to redo");
+    }
+    Swap(data, redoSteps.back());
+    undoSteps.push_back(Step());
+    std::swap(undoSteps.back(), redoSteps.back());
+    redoSteps.pop_back();
+}
+
+void stfio::EditHistory::Clear() {
+    undoSteps.clear();
+    redoSteps.clear();
+}
+
+std::string stfio::EditHistory::GetUndoLabel() const {
+    return undoSteps.empty() ? std::string() : undoSteps.back().label;
+}
+
+std::string stfio::EditHistory::GetRedoLabel() const {
+    return redoSteps.empty() ? std::string() : redoSteps.back().label;
+}
@@ -0,0 +1,120 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file history.h
+ *  \brief Declares an undo history for operations that modify recordings in place.
+ */
+
+#ifndef _STFIO_HISTORY_H
+#define _STFIO_HISTORY_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+#include "./channel.h"
+
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Undo and redo of operations that modify a recording in place.
+/*! Before an operation modifies sections, the sections are saved in a
+ *  step. Saving a section doesn't copy its samples: they are shared with
+ *  the section until either is written to (see Section), so that a step
+ *  only holds memory for the samples that the operation actually replaces.
+ *  Undoing a step swaps the saved sections with the current ones, which
+ *  turns the step into the one that redoes the operation.
+ */
+class StfioDll EditHistory {
+public:
+    //! Constructor
+    /*! \param maxSteps The number of steps that can be undone; older steps are discarded.
+     */
+    explicit EditHistory(std::size_t maxSteps = 16);
+
+    //! Saves sections of a channel before they are modified in place.
+    /*! Discards the steps that could be redone. Throws std::out_of_range
+     *  if the channel or a section doesn't exist.
+     *  \param data The recording before the modification.
+     *  \param channel Index of the channel.
+     *  \param sections Indices of the sections that will be modified.
+     *  \param label A description of the operation, e.g. for an "Undo" menu item.
+     */
+    void Record(const Recording& data, std::size_t channel,
+                const std::vector<std::size_t>& sections, const std::string& label);
+
+    //! Restores the sections that the last step has saved.
+    /*! Throws std::out_of_range if there's nothing to undo or if the
+     *  recording no longer has the saved sections.
+     *  \param data The recording that the step was recorded with.
+     */
+    void Undo(Recording& data);
+
+    //! Applies the last undone step again.
+    /*! Throws std::out_of_range if there's nothing to redo or if the
+     *  recording no longer has the saved sections.
+     *  \param data The recording that the step was recorded with.
+     */
+    void Redo(Recording& data);
+
+    //! Discards all steps, e.g. when the recording has been replaced.
+    void Clear();
+
+    //! Checks whether a step can be undone.
+    /*! \return true if Undo() can be called.
+     */
+    bool CanUndo() const { return !undoSteps.empty(); }
+
+    //! Checks whether a step can be redone.
+    /*! \return true if Redo() can be called.
+     */
+    bool CanRedo() const { return !redoSteps.empty(); }
+
+    //! Retrieves the description of the step that Undo() restores.
+    /*! \return The label of the step; empty if there's nothing to undo.
+     */
+    std::string GetUndoLabel() const;
+
+    //! Retrieves the description of the step that Redo() applies.
+    /*! \return The label of the step; empty if there's nothing to redo.
+     */
+    std::string GetRedoLabel() const;
+
+private:
+    struct Step {
+        std::string label;
+        std::size_t channel;
+        std::vector<std::size_t> indices;
+        Channel saved;
+    };
+    // Exchanges the saved sections of a step with those of the recording:
+    static void Swap(Recording& data, Step& step);
+    void Push(Step& step);
+
+    std::size_t maxSteps;
+    std::deque<Step> undoSteps, redoSteps;
+};
+
+}
+
+/*@}*/
+
+#endif
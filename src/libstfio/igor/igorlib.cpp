@@ -29,6 +29,11 @@
 #include <stdio.h>
 #include <stddef.h>					// For offsetof macro.
 #include <sstream>
+#include <limits>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #if !defined(_WINDOWS) || defined(__MINGW32__) 
   #include "../abf/axon/Common/unix.h"
@@ -36,6 +41,7 @@
 
 #include "./igorlib.h"
 #include "../recording.h"
+#include "../parallel.h"
 
 // Headers taken from Wavemetrics' demo files:
 #ifdef __cplusplus
@@ -57,7 +63,83 @@ namespace stfio {
                           int nError);
     
 // Check compatibility before exporting:
-bool CheckComp(const Recording& ReturnData);
+bool CheckComp(const RecordingView& ReturnData);
+
+}
+
+namespace {
+
+    // Record types of packed experiment files (see PTN#003):
+    const unsigned short kWaveRecord = 3;
+
+    // Precedes every record of a packed experiment file:
+    struct PackedFileRecordHeader {
+        unsigned short recordType;
+        short version;
+        IGORLONG numDataBytes;
+    };
+
+    // Unambiguous wave names for all channels:
+    std::vector<std::string> IGORWaveNames(const RecordingView& Data) {
+        std::vector<std::string> channel_name(Data.size());
+        bool ident=false;
+        for (std::size_t n_c=0;n_c<Data.size()-1 && !ident; ++n_c) {
+            for (std::size_t n_c2=n_c+1;n_c2<Data.size()&& !ident; ++n_c2) {
+                if (Data[n_c].GetChannelName()==Data[n_c2].GetChannelName()) {
+                    ident=true;
+                }
+            }
+            if (!ident) channel_name[n_c]=Data[n_c].GetChannelName();
+        }
+        if (ident) {
+            for (std::size_t n_c=0;n_c<Data.size()-1; ++n_c) {
+                std::stringstream channelS;
+                channelS <<  "Ch" << (int)n_c;
+                channel_name[n_c] = channelS.str();
+            }
+        } else {
+            channel_name[Data.size()-1]=Data[Data.size()-1].GetChannelName();
+        }
+        return channel_name;
+    }
+
+    // A channel as a two-dimensional wave with one column per section.
+    // The sections are copied straight into the wave, in parallel:
+    void PackIGORWave(const RecordingView& Data, std::size_t n_c, const std::string& name,
+                      WaveHeader5& wh, Vector_double& cpData)
+    {
+        const Channel& ch = Data[n_c];
+        std::size_t n_points = ch[0].size();
+        if ((double)n_points*(double)ch.size() > (double)std::numeric_limits<IGORLONG>::max()) {
+            throw std::runtime_error("File can't be exported:\nToo many data points for an Igor wave");
+        }
+
+        memset(&wh, 0, sizeof(wh));
+        wh.type = NT_FP64;							// double precision floating point.
+        // It would be possible to write a Windows equivalent for the Macintosh
+        // GetDateTime function but it is not easy:
+        wh.modDate = 0;
+        if (name.length() < MAX_WAVE_NAME2+2)
+            strcpy(wh.bname, name.c_str());
+        if (ch.GetYUnits().length() < MAX_UNIT_CHARS+1)
+            strcpy(wh.dataUnits, ch.GetYUnits().c_str());
+        if (Data.GetXUnits().length() < MAX_UNIT_CHARS+1)
+            strcpy(wh.dimUnits[0], Data.GetXUnits().c_str());
+        wh.npnts = (IGORLONG)(n_points*ch.size());
+        wh.nDim[0] = (IGORLONG)n_points;
+        wh.nDim[1] = (IGORLONG)ch.size();
+        wh.sfA[0] = Data.GetXScale();
+        wh.sfB[0] = 0.0e0;								// Starting from zero.
+
+        cpData.resize(wh.npnts);
+        int n_sections = (int)ch.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16) num_threads(stfio::threadCount(0, n_sections))
+#endif
+        for (int n_s=0; n_s < n_sections; ++n_s) {
+            ch[n_s].CopyRange(0, n_points, &cpData[n_s*n_points]);
+        }
+    }
 
 }
 
@@ -71,9 +153,9 @@ stfio::IGORError(const std::string& msg, int error)
 }
 
 bool
-stfio::CheckComp(const Recording& Data) {
+stfio::CheckComp(const RecordingView& Data) {
     std::size_t oldSize=0;
-    if (!Data.get().empty() && !Data[0].get().empty()) {
+    if (Data.size() != 0 && !Data[0].get().empty()) {
         oldSize=Data[0][0].size();
     } else {
         return false;
@@ -89,7 +171,7 @@ stfio::CheckComp(const Recording& Data) {
 }
 
 bool
-stfio::exportIGORFile(const std::string& fileBase,const Recording& Data, ProgressInfo& progDlg)
+stfio::exportIGORFile(const std::string& fileBase,const RecordingView& Data, ProgressInfo& progDlg)
 {
     // Check compatibility:
     if (!CheckComp(Data)) {
@@ -100,50 +182,20 @@ stfio::exportIGORFile(const std::string& fileBase,const Recording& Data, Progres
     }
 
     // Get unambiguous channel names:
-    std::vector<std::string> channel_name(Data.size());
-    bool ident=false;
-    for (std::size_t n_c=0;n_c<Data.size()-1 && !ident; ++n_c) {
-        for (std::size_t n_c2=n_c+1;n_c2<Data.size()&& !ident; ++n_c2) {
-            if (Data[n_c].GetChannelName()==Data[n_c2].GetChannelName()) {
-                ident=true;
-            }
-        }
-        if (!ident) channel_name[n_c]=Data[n_c].GetChannelName();
-    }
-    if (ident) {
-        for (std::size_t n_c=0;n_c<Data.size()-1; ++n_c) {
-            std::stringstream channelS;
-            channelS <<  "Ch" << (int)n_c;
-            channel_name[n_c] = channelS.str();
-        }
-    } else {
-        channel_name[Data.size()-1]=Data[Data.size()-1].GetChannelName();
-    }
+    std::vector<std::string> channel_name(IGORWaveNames(Data));
+
+    // Add a wave note:
+    std::string waveNote("Wave exported from Stimfit");
 
     // Export channels individually:
+    WaveHeader5 wh;
+    Vector_double cpData;
     for (std::size_t n_c=0;n_c<Data.size();++n_c) {
-        unsigned IGORLONG now;
-        now = 0;			// It would be possible to write a Windows equivalent for the Macintosh GetDateTime function but it is not easy.
-
-        WaveHeader5 wh;
-        memset(&wh, 0, sizeof(wh));
-        wh.type = NT_FP64;							// double precision floating point.
-
-        if (channel_name[n_c].length() < MAX_WAVE_NAME2+2)
-            strcpy(wh.bname, channel_name[n_c].c_str());
-        if (Data[n_c].GetYUnits().length() < MAX_UNIT_CHARS+1)
-            strcpy(wh.dataUnits, Data[n_c].GetYUnits().c_str());
-        if (Data.GetXUnits().length() < MAX_UNIT_CHARS+1)
-            strcpy(wh.dimUnits[0], Data.GetXUnits().c_str());
-        wh.npnts = (IGORLONG)(Data[n_c][0].size()*Data[n_c].size());
-        wh.nDim[0] = (IGORLONG)Data[n_c][0].size();
-        wh.nDim[1] = (IGORLONG)Data[n_c].size();
-        wh.sfA[0] = Data.GetXScale();
-        wh.sfB[0] = 0.0e0;								// Starting from zero.
-        wh.modDate = now;
+        std::ostringstream progStr;
+        progStr << "Writing channel #" << (int)n_c + 1 << " of " << (int)Data.size();
+        progDlg.Update((int)((double)n_c/(double)Data.size()*100.0), progStr.str());
 
-        // Add a wave note:
-        std::string waveNote("Wave exported from Stimfit");
+        PackIGORWave(Data, n_c, channel_name[n_c], wh, cpData);
 
         // Create a file:
         std::stringstream filePath;
@@ -163,38 +215,74 @@ stfio::exportIGORFile(const std::string& fileBase,const Recording& Data, Progres
         }
 
         // Write the data:
-        Vector_double cpData(wh.npnts);
-
-        // One unnecessary copy operation due to const-correctness (couldn't const_cast<>)
-        Channel TempChannel(Data[n_c]);
-        for (std::size_t n_s=0;n_s<Data[n_c].size();++n_s) {
-            std::ostringstream progStr;
-            progStr << "Writing channel #" << (int)n_c + 1 << " of " << (int)Data.size()
-                    << ", Section #" << (int)n_s+1 << " of " << (int)Data[n_c].size();
-            progDlg.Update(
-                    // Channel contribution:
-                    (int)(((double)n_c/(double)Data.size())*100.0+
-                            // Section contribution:
-                            (double)(n_s)/(double)Data[n_c].size()*(100.0/Data.size())),
-                    progStr.str()
-            );
-
-            // std::copy is faster than explicitly assigning to cpData[c][s][p]
-            if (n_s*wh.nDim[0]+Data[n_c][n_s].size() > cpData.size() ||
-                Data[n_c][n_s].size() > TempChannel[n_s].size()) {
-                    throw std::out_of_range("Out of range exception in WriteVersion5NumericWave");
-            }
-            std::copy( TempChannel[n_s].get_w().begin(), 
-                       TempChannel[n_s].get_w().begin()+Data[n_c][n_s].size(),
-                       &cpData[n_s*wh.nDim[0]] );
-        }
         err=WriteVersion5NumericWave( fr, &wh, &cpData[0], waveNote.c_str(),
                                       (long)waveNote.length() );
+        CPCloseFile(fr);
         if (err)
         {
             throw std::runtime_error( std::string(IGORError("Error in WriteVersion5NumericWave()\n", err).c_str()) );
         }
-        CPCloseFile(fr);
     }
     return true;
 }
+
+bool
+stfio::exportIGORPackedFile(const std::string& fName, const RecordingView& Data, ProgressInfo& progDlg)
+{
+    // Check compatibility:
+    if (!CheckComp(Data)) {
+        throw std::runtime_error(
+                "File can't be exported:\n"
+                "Traces have different sizes"
+        );
+    }
+
+    std::vector<std::string> channel_name(IGORWaveNames(Data));
+    std::string waveNote("Wave exported from Stimfit");
+
+    int err = CPCreateFile(fName.c_str(), 1);
+    if (err) {
+        throw std::runtime_error(IGORError("Error in CPCreateFile()\n", err));
+    }
+    CP_FILE_REF fr;
+    err = CPOpenFile(fName.c_str(), 1, &fr);
+    if (err) {
+        throw std::runtime_error(IGORError("Error in CPOpenFile()\n", err));
+    }
+
+    // One wave record per channel:
+    WaveHeader5 wh;
+    Vector_double cpData;
+    for (std::size_t n_c=0;n_c<Data.size();++n_c) {
+        std::ostringstream progStr;
+        progStr << "Writing channel #" << (int)n_c + 1 << " of " << (int)Data.size();
+        progDlg.Update((int)((double)n_c/(double)Data.size()*100.0), progStr.str());
+
+        try {
+            PackIGORWave(Data, n_c, channel_name[n_c], wh, cpData);
+        }
+        catch (...) {
+            CPCloseFile(fr);
+            throw;
+        }
+
+        PackedFileRecordHeader rh;
+        memset(&rh, 0, sizeof(rh));
+        rh.recordType = kWaveRecord;
+        rh.version = 0;
+        rh.numDataBytes = (IGORLONG)(sizeof(BinHeader5) + offsetof(WaveHeader5, wData) +
+                                     cpData.size()*sizeof(double) + waveNote.length());
+        unsigned long numBytesWritten = 0;
+        err = CPWriteFile(fr, sizeof(rh), &rh, &numBytesWritten);
+        if (!err) {
+            err = WriteVersion5NumericWave( fr, &wh, &cpData[0], waveNote.c_str(),
+                                            (long)waveNote.length() );
+        }
+        if (err) {
+            CPCloseFile(fr);
+            throw std::runtime_error(IGORError("Error while writing a wave record\n", err));
+        }
+    }
+    CPCloseFile(fr);
+    return true;
+}
@@ -25,6 +25,7 @@
 #include "./../stfio.h"
 
 class Recording;
+class RecordingView;
 
 namespace stfio {
 
@@ -34,7 +35,20 @@ namespace stfio {
  *  \return At present, always returns 0.
  */
 StfioDll bool
-    exportIGORFile(const std::string& fName, const Recording& WData, ProgressInfo& progDlg);
+    exportIGORFile(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg);
+
+//! Export a Recording to a single Igor packed experiment file.
+/*! Every channel becomes a two-dimensional wave with one column per
+ *  section, as with exportIGORFile(), but all waves are stored in a
+ *  single file. Throws std::runtime_error if the file can't be written
+ *  or if the sections have different sizes.
+ *  \param fName Full path to the file to be written.
+ *  \param WData The data to be exported.
+ *  \param progDlg Progress indicator.
+ *  \return true if the file has been written.
+ */
+StfioDll bool
+    exportIGORPackedFile(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg);
 
 }
 
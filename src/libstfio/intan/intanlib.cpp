@@ -25,6 +25,8 @@ as of 2016-11-05
 */
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
 
 #include "intanlib.h"
 #include "streams.h"
@@ -185,56 +187,69 @@ IntanHeader read_header(BinaryReader& binreader) {
     return hIntan;
 }
 
-std::vector<std::vector<float> > read_data(BinaryReader& binreader, const IntanHeader& hIntan) {
-    uint64_t bytes_remaining = binreader.bytesRemaining();
-    uint64_t length = bytes_remaining / (4+4+4+4);
-    std::vector<uint32_t> timestamps(length);
-    std::vector<float> applied(length);
-    std::vector<float> totalClamp(length);
-    std::vector<std::vector<float> > channels(2);
-    channels[0].resize(length);
-    channels[1].resize(length);
-    for (unsigned int idata = 0; idata < length; ++idata) {
-        binreader >> timestamps[idata];
-        binreader >> applied[idata]; 
-        binreader >> channels[1][idata];
-        binreader >> channels[0][idata];
-        float vfactor = 1e3; // V -> mV
-        float ifactor = 1e12; // A -> pA
-        if (hIntan.Settings.isVoltageClamp) {
-            channels[0][idata] *= ifactor;
-            channels[1][idata] *= vfactor;
-        } else {
-            channels[1][idata] *= ifactor;
-            channels[0][idata] *= vfactor;
-        }
-    }
+// Number of records that are read from the file at once:
+const uint64_t recordsPerBlock = 65536;
 
-    return channels;
+// Decodes little-endian values from a raw byte buffer:
+uint16_t decode_uint16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
 }
 
-std::vector<std::vector<float> > read_aux_data(BinaryReader& binreader, uint16_t numADCs) {
-    uint64_t bytes_remaining = binreader.bytesRemaining();
-    uint64_t length = bytes_remaining / (4+2+2+2*numADCs);
-    std::vector<uint32_t> timestamps(length);
-    std::vector<uint16_t> digitalIn(length);
-    std::vector<uint16_t> digitalOut(length);
-    std::vector<std::vector<float> > adc(numADCs);
-    for (unsigned int iadc = 0; iadc < numADCs; ++iadc) {
-        adc[iadc].resize(length);
-    }
-    for (unsigned int idata = 0; idata < length; ++idata) {
-        binreader >> timestamps[idata];
-        binreader >> digitalIn[idata]; 
-        binreader >> digitalOut[idata];
-        for (unsigned int iadc = 0; iadc < numADCs; ++iadc) {
-            uint16_t tmpui;
-            binreader >> tmpui;
-            adc[iadc][idata] = tmpui*0.0003125 - (1<<15);
+float decode_float(const unsigned char* p) {
+    uint32_t bits = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void read_data(BinaryReader& binreader, const IntanHeader& hIntan,
+               Section& sec0, Section& sec1, stfio::ProgressInfo& progDlg)
+{
+    // timestamp, applied value, channel 1, channel 0:
+    const uint64_t recordSize = 4+4+4+4;
+    uint64_t length = binreader.bytesRemaining() / recordSize;
+    sec0.resize(length);
+    sec1.resize(length);
+    Vector_double& channel0 = sec0.get_w();
+    Vector_double& channel1 = sec1.get_w();
+    float vfactor = 1e3; // V -> mV
+    float ifactor = 1e12; // A -> pA
+    float factor0 = hIntan.Settings.isVoltageClamp ? ifactor : vfactor;
+    float factor1 = hIntan.Settings.isVoltageClamp ? vfactor : ifactor;
+
+    std::vector<unsigned char> buffer(std::min(length, recordsPerBlock)*recordSize);
+    for (uint64_t first = 0; first < length; first += recordsPerBlock) {
+        progDlg.Update((int)(100.0*first/length), "Reading Intan data");
+        uint64_t n = std::min(recordsPerBlock, length-first);
+        binreader.read(reinterpret_cast<char*>(&buffer[0]), n*recordSize);
+        for (uint64_t idata = 0; idata < n; ++idata) {
+            const unsigned char* record = &buffer[idata*recordSize];
+            channel1[first+idata] = decode_float(record+8) * factor1;
+            channel0[first+idata] = decode_float(record+12) * factor0;
         }
     }
+}
 
-    return adc;
+void read_aux_data(BinaryReader& binreader, uint16_t numADCs, Section& sec,
+                   stfio::ProgressInfo& progDlg)
+{
+    // timestamp, digital in, digital out, ADCs:
+    const uint64_t recordSize = 4+2+2+2*numADCs;
+    uint64_t length = binreader.bytesRemaining() / recordSize;
+    // Only the first ADC is imported:
+    sec.resize(numADCs > 0 ? length : 0);
+    Vector_double& adc = sec.get_w();
+
+    std::vector<unsigned char> buffer(std::min((uint64_t)adc.size(), recordsPerBlock)*recordSize);
+    for (uint64_t first = 0; first < adc.size(); first += recordsPerBlock) {
+        progDlg.Update((int)(100.0*first/length), "Reading Intan data");
+        uint64_t n = std::min(recordsPerBlock, adc.size()-first);
+        binreader.read(reinterpret_cast<char*>(&buffer[0]), n*recordSize);
+        for (uint64_t idata = 0; idata < n; ++idata) {
+            float value = decode_uint16(&buffer[idata*recordSize+8])*0.0003125 - (1<<15);
+            adc[first+idata] = value;
+        }
+    }
 }
 
 void stfio::importIntanFile(const std::string &fName, Recording &ReturnData, ProgressInfo& progDlg) {
@@ -252,15 +267,14 @@ void stfio::importIntanFile(const std::string &fName, Recording &ReturnData, Pro
 
     IntanHeader hIntan = read_header(*binreader);
     if (hIntan.datatype == 0) {
-        std::vector<std::vector<float> > channels = read_data(*binreader, hIntan);
-        ReturnData.resize(channels.size());
+        ReturnData.resize(2);
         ReturnData.SetXScale(1e3/hIntan.Settings.samplingRate);
         ReturnData.SetXUnits("ms");
         int mon = hIntan.date_Month-1;
         int year = hIntan.date_Year - 1900;
         ReturnData.SetDateTime(year, mon, hIntan.date_Day,
                                hIntan.date_Hour, hIntan.date_Minute, hIntan.date_Second);
-        for (unsigned int nchan = 0; nchan < channels.size(); ++nchan) {
+        for (unsigned int nchan = 0; nchan < ReturnData.size(); ++nchan) {
             // ReturnData[nchan].resize(hIntan.Settings.waveform.size());
             ReturnData[nchan].resize(1);
         }
@@ -272,11 +286,8 @@ void stfio::importIntanFile(const std::string &fName, Recording &ReturnData, Pro
             ReturnData[0].SetYUnits("mV");
         }
         unsigned int nsec = 0;
-        for (unsigned int nchan = 0; nchan < channels.size(); ++nchan) {
-            ReturnData[nchan][nsec].resize(channels[nchan].size());
-            std::copy(channels[nchan].begin(), channels[nchan].end(),
-                      ReturnData[nchan][nsec].get_w().begin());
-        }
+        // decode straight into the sections:
+        read_data(*binreader, hIntan, ReturnData[0][nsec], ReturnData[1][nsec], progDlg);
 
         // for (std::vector<Segment>::const_iterator it = hIntan.Settings.waveform.begin();
         //      it != hIntan.Settings.waveform.end();
@@ -291,11 +302,9 @@ void stfio::importIntanFile(const std::string &fName, Recording &ReturnData, Pro
         // }
 
     } else {
-        std::vector<std::vector<float> > aux_data = read_aux_data(*binreader, hIntan.numADCs);
         ReturnData.resize(1);
         ReturnData[0].resize(1);
-        ReturnData[0][0].resize(aux_data[0].size());
-        std::copy(aux_data[0].begin(), aux_data[0].end(), ReturnData[0][0].get_w().begin());
+        read_aux_data(*binreader, hIntan.numADCs, ReturnData[0][0], progDlg);
     }
 
 }
@@ -44,6 +44,9 @@ using std::runtime_error;
 
 #define IS_BIG_ENDIAN (*(uint16_t *)"\0\xff" < 0x100)
 
+// Size of the read-ahead buffer of a BinaryReader:
+static const std::size_t readAheadSize = 64*1024;
+
 //  ------------------------------------------------------------------------
 FileInStream::FileInStream() : filestream(nullptr) {
 
@@ -104,23 +107,55 @@ int FileInStream::read(char* data, int len) {
 #else
     BinaryReader::BinaryReader(BOOST_RV_REF(unique_ptr<FileInStream>) other_) :
 #endif
-    other(move(other_))
+    other(move(other_)), buffer(readAheadSize), bufPos(0), bufEnd(0)
 {
 }
 
 BinaryReader::~BinaryReader() {
 }
 
+void BinaryReader::read(char* data, uint64_t len) {
+    // serve what we can from the buffer:
+    uint64_t n = std::min(len, static_cast<uint64_t>(bufEnd - bufPos));
+    if (n > 0) {
+        memcpy(data, &buffer[bufPos], n);
+        bufPos += n;
+        data += n;
+        len -= n;
+    }
+    if (len == 0) {
+        return;
+    }
+    if (len >= buffer.size()) {
+        // large reads bypass the buffer:
+        while (len > 0) {
+            int chunk = static_cast<int>(std::min(len, static_cast<uint64_t>(1 << 30)));
+            other->read(data, chunk);
+            data += chunk;
+            len -= chunk;
+        }
+        return;
+    }
+    uint64_t remaining = other->bytesRemaining();
+    if (remaining < len) {
+        throw runtime_error("No more data");
+    }
+    bufEnd = static_cast<std::size_t>(std::min(remaining, static_cast<uint64_t>(buffer.size())));
+    other->read(&buffer[0], static_cast<int>(bufEnd));
+    memcpy(data, &buffer[0], len);
+    bufPos = len;
+}
+
 BinaryReader& operator>>(BinaryReader& istream, int32_t& value) {
     unsigned char data[4];
-    istream.other->read(reinterpret_cast<char*>(data), 4);
+    istream.read(reinterpret_cast<char*>(data), 4);
     value = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
     return istream;
 }
 
 BinaryReader& operator>>(BinaryReader& istream, uint32_t& value) {
     unsigned char data[4];
-    istream.other->read(reinterpret_cast<char*>(data), 4);
+    istream.read(reinterpret_cast<char*>(data), 4);
     value = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
     return istream;
 }
@@ -128,7 +163,7 @@ BinaryReader& operator>>(BinaryReader& istream, uint32_t& value) {
 
 BinaryReader& operator>>(BinaryReader& istream, uint16_t& value) {
     unsigned char data[2];
-    istream.other->read(reinterpret_cast<char*>(data), 2);
+    istream.read(reinterpret_cast<char*>(data), 2);
     value = data[0] | (data[1] << 8);
     return istream;
 }
@@ -136,14 +171,14 @@ BinaryReader& operator>>(BinaryReader& istream, uint16_t& value) {
 
 BinaryReader& operator>>(BinaryReader& istream, int16_t& value) {
     unsigned char data[2];
-    istream.other->read(reinterpret_cast<char*>(data), 2);
+    istream.read(reinterpret_cast<char*>(data), 2);
     value = data[0] | (data[1] << 8);
     return istream;
 }
 
 BinaryReader& operator>>(BinaryReader& istream, uint8_t& value) {
     unsigned char data[1];
-    istream.other->read(reinterpret_cast<char*>(data), 1);
+    istream.read(reinterpret_cast<char*>(data), 1);
     value = data[0];
     return istream;
 }
@@ -151,7 +186,7 @@ BinaryReader& operator>>(BinaryReader& istream, uint8_t& value) {
 
 BinaryReader& operator>>(BinaryReader& istream, int8_t& value) {
     unsigned char data[1];
-    istream.other->read(reinterpret_cast<char*>(data), 1);
+    istream.read(reinterpret_cast<char*>(data), 1);
     value = data[0];
     return istream;
 }
@@ -160,13 +195,13 @@ BinaryReader& operator>>(BinaryReader& istream, float& value) {
     char* tmp = reinterpret_cast<char*>(&value);
     if (IS_BIG_ENDIAN) {
         char data[4];
-        istream.other->read(data, sizeof(value));
+        istream.read(data, sizeof(value));
         tmp[0] = data[3];
         tmp[1] = data[2];
         tmp[2] = data[1];
         tmp[3] = data[0];
     } else {
-        istream.other->read(tmp, sizeof(value));
+        istream.read(tmp, sizeof(value));
     }
     return istream;
 }
@@ -185,12 +220,12 @@ BinaryReader& operator>>(BinaryReader& istream, wstring& value) {
     if (size > 0) {
         vector<char> tmp(size + 2);
 #ifndef _WINDOWS
-        istream.other->read(tmp.data(), size);
+        istream.read(tmp.data(), size);
         tmp[size] = 0;
         tmp[size + 1] = 0;
         value = reinterpret_cast<wchar_t*>(tmp.data());
 #else
-        istream.other->read(&tmp[0], size);
+        istream.read(&tmp[0], size);
         tmp[size] = 0;
         tmp[size + 1] = 0;
         value = reinterpret_cast<wchar_t*>(&tmp[0]);
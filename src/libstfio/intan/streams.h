@@ -42,6 +42,8 @@ using boost::move;
 #endif
 #include <iosfwd>
 #include <istream>
+#include <vector>
+#include <algorithm>
 
 #include "./intanlib.h"
 
@@ -89,8 +91,30 @@ public:
 #endif
     virtual ~BinaryReader();
 
-    uint64_t bytesRemaining() { return other->bytesRemaining();  }
-    std::istream::pos_type currentPos() { return other->currentPos(); }
+    uint64_t bytesRemaining() { return other->bytesRemaining() + (bufEnd - bufPos); }
+    std::istream::pos_type currentPos() { return other->currentPos() - std::streamoff(bufEnd - bufPos); }
+
+    //! Reads raw bytes, e.g. a block of samples. Throws std::runtime_error at the end of the file.
+    void read(char* data, uint64_t len);
+
+    //! Reads an array of values, converting them from the file's byte order.
+    /*! Throws std::runtime_error at the end of the file.
+     *  \param dest Destination; has to hold at least n values.
+     *  \param n Number of values.
+     *  \param littleEndian true if the values are stored in little-endian byte order.
+     */
+    template <typename T>
+    void readArray(T* dest, uint64_t n, bool littleEndian = true) {
+        read(reinterpret_cast<char*>(dest), n*sizeof(T));
+        if (sizeof(T) > 1 && littleEndian != hostIsLittleEndian()) {
+            for (uint64_t i = 0; i < n; ++i) {
+                char* p = reinterpret_cast<char*>(dest + i);
+                for (std::size_t k = 0; k < sizeof(T)/2; ++k) {
+                    std::swap(p[k], p[sizeof(T)-1-k]);
+                }
+            }
+        }
+    }
 
 protected:
     friend BinaryReader& operator>>(BinaryReader& istream, int32_t& value);
@@ -104,7 +128,15 @@ protected:
     friend BinaryReader& operator>>(BinaryReader& istream, std::wstring& value);
 
 private:
+    static bool hostIsLittleEndian() {
+        const uint16_t one = 1;
+        return *reinterpret_cast<const unsigned char*>(&one) == 1;
+    }
+
     unique_ptr<FileInStream> other;
+    // read-ahead buffer; bytes [bufPos, bufEnd) haven't been consumed yet:
+    std::vector<char> buffer;
+    std::size_t bufPos, bufEnd;
 };
 
 FILENAME toFileName(const std::string& s);
@@ -0,0 +1,723 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include <list>
+#include <map>
+#include <algorithm>
+#include <functional>
+
+#include "./stfio.h"
+#include "./mappedfile.h"
+
+namespace {
+    // Identifies decoded samples across mappings of the same file,
+    // or derived samples by their derivation:
+    struct CacheKey {
+        const void* derived;
+        std::string name;
+        std::size_t file_size, offset, n_samples, stride;
+        int type;
+        double scale, shift;
+
+        bool operator<(const CacheKey& other) const {
+            if (derived != other.derived) return std::less<const void*>()(derived, other.derived);
+            if (name != other.name) return name < other.name;
+            if (file_size != other.file_size) return file_size < other.file_size;
+            if (offset != other.offset) return offset < other.offset;
+            if (n_samples != other.n_samples) return n_samples < other.n_samples;
+            if (stride != other.stride) return stride < other.stride;
+            if (type != other.type) return type < other.type;
+            if (scale != other.scale) return scale < other.scale;
+            return shift < other.shift;
+        }
+    };
+
+    // Least-recently used cache of decoded samples with a memory budget.
+    // Callers have to serialize access.
+    class SectionCache {
+    public:
+        SectionCache() : entries(), lru(), budget(512*1024*1024), bytes(0) {}
+
+        stfio::DecodedSamples Find(const CacheKey& key) {
+            std::map<CacheKey, Entry>::iterator it = entries.find(key);
+            if (it == entries.end()) {
+                return stfio::DecodedSamples();
+            }
+            // move to the front of the list:
+            lru.splice(lru.begin(), lru, it->second.pos);
+            return it->second.samples;
+        }
+
+        // Returns the cached samples if another thread was quicker.
+        stfio::DecodedSamples Insert(const CacheKey& key, const stfio::DecodedSamples& samples) {
+            stfio::DecodedSamples cached = Find(key);
+            if (cached) {
+                return cached;
+            }
+            std::size_t size = samples->size()*sizeof(double);
+            if (size > budget) {
+                return samples;
+            }
+            lru.push_front(key);
+            Entry entry = { samples, lru.begin(), size };
+            entries[key] = entry;
+            bytes += size;
+            Evict();
+            return samples;
+        }
+
+        void Purge(const std::string& name) {
+            for (std::map<CacheKey, Entry>::iterator it = entries.begin(); it != entries.end();) {
+                if (it->first.name == name) {
+                    bytes -= it->second.size;
+                    lru.erase(it->second.pos);
+                    entries.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        void Purge(const void* derived) {
+            for (std::map<CacheKey, Entry>::iterator it = entries.begin(); it != entries.end();) {
+                if (it->first.derived == derived) {
+                    bytes -= it->second.size;
+                    lru.erase(it->second.pos);
+                    entries.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        void SetBudget(std::size_t value) { budget = value; Evict(); }
+        std::size_t GetBudget() const { return budget; }
+        std::size_t GetSize() const { return bytes; }
+
+    private:
+        void Evict() {
+            while (bytes > budget && !lru.empty()) {
+                std::map<CacheKey, Entry>::iterator it = entries.find(lru.back());
+                bytes -= it->second.size;
+                entries.erase(it);
+                lru.pop_back();
+            }
+        }
+
+        struct Entry {
+            stfio::DecodedSamples samples;
+            std::list<CacheKey>::iterator pos;
+            std::size_t size;
+        };
+        std::map<CacheKey, Entry> entries;
+        // most recently used first:
+        std::list<CacheKey> lru;
+        std::size_t budget, bytes;
+    };
+
+    SectionCache& sectionCache() {
+        // never destroyed, so that mapped files can be released during static destruction:
+        static SectionCache* cache = new SectionCache();
+        return *cache;
+    }
+
+    void purgeSectionCache(const std::string& name) {
+        if (name.empty()) {
+            return;
+        }
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+        sectionCache().Purge(name);
+    }
+
+    void purgeSectionCache(const void* derived) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+        sectionCache().Purge(derived);
+    }
+}
+
+#ifdef _WIN32
+stfio::MappedFile::MappedFile(std::vector<char>& buffer_)
+    : data(NULL), size(buffer_.size()), buffer(), owner(), name(), hFile(INVALID_HANDLE_VALUE), hMapping(NULL)
+{
+    buffer.swap(buffer_);
+    if (size > 0) {
+        data = &buffer[0];
+    }
+}
+
+#if (__cplusplus < 201103)
+stfio::MappedFile::MappedFile(const char* data_, std::size_t size_, const boost::shared_ptr<void>& owner_)
+#else
+stfio::MappedFile::MappedFile(const char* data_, std::size_t size_, const std::shared_ptr<void>& owner_)
+#endif
+    : data(data_), size(size_), buffer(), owner(owner_), name(), hFile(INVALID_HANDLE_VALUE), hMapping(NULL)
+{}
+
+stfio::MappedFile::MappedFile(const std::string& fName)
+    : data(NULL), size(0), buffer(), owner(), name(fName), hFile(INVALID_HANDLE_VALUE), hMapping(NULL)
+{
+    hFile = CreateFileA(fName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Couldn't open " + fName + " in stfio::MappedFile");
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || (unsigned long long)fileSize.QuadPart > (std::size_t)-1) {
+        CloseHandle(hFile);
+        throw std::runtime_error("Couldn't get the size of " + fName + " in stfio::MappedFile");
+    }
+    size = (std::size_t)fileSize.QuadPart;
+    if (size == 0) {
+        return;
+    }
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL) {
+        CloseHandle(hFile);
+        throw std::runtime_error("Couldn't map " + fName + " in stfio::MappedFile");
+    }
+    data = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        CloseHandle(hMapping);
+        CloseHandle(hFile);
+        throw std::runtime_error("Couldn't map " + fName + " in stfio::MappedFile");
+    }
+}
+
+stfio::MappedFile::~MappedFile() {
+    purgeSectionCache(name);
+    if (hMapping != NULL && data != NULL) {
+        UnmapViewOfFile(data);
+    }
+    if (hMapping != NULL) {
+        CloseHandle(hMapping);
+    }
+    if (hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+    }
+}
+#else
+stfio::MappedFile::MappedFile(std::vector<char>& buffer_)
+    : data(NULL), size(buffer_.size()), buffer(), owner(), name()
+{
+    buffer.swap(buffer_);
+    if (size > 0) {
+        data = &buffer[0];
+    }
+}
+
+#if (__cplusplus < 201103)
+stfio::MappedFile::MappedFile(const char* data_, std::size_t size_, const boost::shared_ptr<void>& owner_)
+#else
+stfio::MappedFile::MappedFile(const char* data_, std::size_t size_, const std::shared_ptr<void>& owner_)
+#endif
+    : data(data_), size(size_), buffer(), owner(owner_), name()
+{}
+
+stfio::MappedFile::MappedFile(const std::string& fName)
+    : data(NULL), size(0), buffer(), owner(), name(fName)
+{
+    int fd = open(fName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Couldn't open " + fName + " in stfio::MappedFile");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (unsigned long long)st.st_size > (std::size_t)-1) {
+        close(fd);
+        throw std::runtime_error("Couldn't get the size of " + fName + " in stfio::MappedFile");
+    }
+    size = (std::size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return;
+    }
+    void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after closing the file:
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Couldn't map " + fName + " in stfio::MappedFile");
+    }
+    data = (const char*)map;
+}
+
+stfio::MappedFile::~MappedFile() {
+    purgeSectionCache(name);
+    if (buffer.empty() && !owner && data != NULL) {
+        munmap((void*)data, size);
+    }
+}
+#endif
+
+namespace stfio {
+    struct SampleChain {
+        template <typename D>
+        void Decode(std::size_t begin, std::size_t end, D* dest) const {
+            std::size_t n_p = std::upper_bound(ends.begin(), ends.end(), begin) - ends.begin();
+            for (; begin < end; ++n_p) {
+                std::size_t start = n_p > 0 ? ends[n_p-1] : 0;
+                std::size_t stop = std::min(end, ends[n_p]);
+                pieces[n_p].Decode(begin-start, stop-start, dest);
+                dest += stop-begin;
+                begin = stop;
+            }
+        }
+
+        std::vector<MappedSamples> pieces;
+        // index past the last sample of each piece:
+        std::vector<std::size_t> ends;
+    };
+
+    struct SampleDerivation {
+        SampleDerivation() : source(), operations() {}
+        // the cache key refers to this derivation, so drop its samples:
+        ~SampleDerivation() { purgeSectionCache((const void*)this); }
+        MappedSamples source;
+        std::vector<SampleOperationPtr> operations;
+    private:
+        SampleDerivation(const SampleDerivation&);
+        SampleDerivation& operator=(const SampleDerivation&);
+    };
+}
+
+stfio::MappedSamples::MappedSamples()
+    : file(), chain(), derived(), shared(), base(NULL), n_samples(0), stride(0), type(sample_float64), scale(1.0), shift(0.0)
+{}
+
+stfio::MappedSamples::MappedSamples(
+#if (__cplusplus < 201103)
+        const boost::shared_ptr<MappedFile>& file_,
+#else
+        const std::shared_ptr<MappedFile>& file_,
+#endif
+        std::size_t offset, std::size_t size, std::size_t stride_,
+        SampleType type_, double scale_, double shift_)
+    : file(file_), chain(), derived(), shared(), base(NULL), n_samples(size), stride(stride_), type(type_),
+      scale(scale_), shift(shift_)
+{
+    std::size_t sample_size = sampleSize(type);
+    if (n_samples > 0) {
+        std::size_t file_size = file ? file->GetSize() : 0;
+        if (offset > file_size || file_size - offset < sample_size ||
+            (stride > 0 && (file_size - offset - sample_size) / stride < n_samples - 1))
+        {
+            throw std::out_of_range("Samples exceed the file size in stfio::MappedSamples");
+        }
+        base = file->GetData() + offset;
+    }
+}
+
+stfio::MappedSamples::MappedSamples(const DecodedSamples& decoded)
+    : file(), chain(), derived(), shared(decoded), base(NULL), n_samples(decoded ? decoded->size() : 0),
+      stride(sizeof(double)), type(sample_float64), scale(1.0), shift(0.0)
+{
+    if (n_samples > 0) {
+        base = (const char*)&(*shared)[0];
+    }
+}
+
+stfio::MappedSamples::MappedSamples(const DecodedSamples& decoded, std::size_t offset, std::size_t size)
+    : file(), chain(), derived(), shared(decoded), base(NULL), n_samples(size),
+      stride(sizeof(double)), type(sample_float64), scale(1.0), shift(0.0)
+{
+    std::size_t total = decoded ? decoded->size() : 0;
+    if (offset > total || size > total - offset) {
+        throw std::out_of_range("Range exceeds the samples in stfio::MappedSamples");
+    }
+    if (n_samples > 0) {
+        base = (const char*)&(*shared)[offset];
+    }
+}
+
+void stfio::MappedSamples::Decode(std::size_t begin, std::size_t end, double* dest) const {
+    if (end > n_samples || begin > end) {
+        throw std::out_of_range("subscript out of range in stfio::MappedSamples::Decode");
+    }
+    if (chain) {
+        chain->Decode(begin, end, dest);
+    } else if (derived) {
+        DecodedSamples samples = GetDecoded();
+        std::copy(samples->begin()+begin, samples->begin()+end, dest);
+    } else if (end > begin) {
+        decodeSamples(base + begin*stride, end-begin, stride, type, false, scale, shift, dest);
+    }
+}
+
+bool stfio::MappedSamples::SameAs(const MappedSamples& other) const {
+    return file == other.file && chain == other.chain && derived == other.derived &&
+        shared == other.shared && base == other.base && n_samples == other.n_samples &&
+        stride == other.stride && type == other.type && scale == other.scale && shift == other.shift;
+}
+
+bool stfio::MappedSamples::GetLayout(const std::string& fName, std::vector<SampleLayout>& layout) const {
+    layout.clear();
+    if (chain) {
+        for (std::size_t n_p = 0; n_p < chain->pieces.size(); ++n_p) {
+            std::vector<SampleLayout> piece;
+            if (!chain->pieces[n_p].GetLayout(fName, piece)) {
+                layout.clear();
+                return false;
+            }
+            layout.insert(layout.end(), piece.begin(), piece.end());
+        }
+        return true;
+    }
+    if (derived || !IsFileBacked() || file->GetName() != fName) {
+        return false;
+    }
+    if (n_samples > 0) {
+        SampleLayout piece;
+        piece.offset = (std::size_t)(base - file->GetData());
+        piece.size = n_samples;
+        piece.stride = stride;
+        piece.type = type;
+        piece.scale = scale;
+        piece.shift = shift;
+        layout.push_back(piece);
+    }
+    return true;
+}
+
+double stfio::MappedSamples::ChainAt(std::size_t at) const {
+    std::size_t n_p = std::upper_bound(chain->ends.begin(), chain->ends.end(), at) - chain->ends.begin();
+    return chain->pieces[n_p][n_p > 0 ? at-chain->ends[n_p-1] : at];
+}
+
+double stfio::MappedSamples::DerivedAt(std::size_t at) const {
+    return (*GetDecoded())[at];
+}
+
+const double* stfio::MappedSamples::GetInPlace() const {
+    if (shared) {
+        return (const double*)base;
+    }
+    if (chain || derived || n_samples == 0 || type != sample_float64 ||
+        stride != sizeof(double) || scale != 1.0 || shift != 0.0 ||
+        (std::size_t)base % sizeof(double) != 0)
+    {
+        return NULL;
+    }
+    return (const double*)base;
+}
+
+const void* stfio::MappedSamples::GetNative(SampleType& type_, double& scale_, double& shift_) const {
+    if (shared) {
+        type_ = sample_float64;
+        scale_ = 1.0;
+        shift_ = 0.0;
+        return base;
+    }
+    std::size_t width = sampleSize(type);
+    if (chain || derived || n_samples == 0 || stride != width || (std::size_t)base % width != 0) {
+        return NULL;
+    }
+    type_ = type;
+    scale_ = scale;
+    shift_ = shift;
+    return base;
+}
+
+stfio::DecodedSamples stfio::MappedSamples::GetDecoded() const {
+    if (shared && n_samples == shared->size()) {
+        return shared;
+    }
+    DecodedSamples cached;
+    CacheKey key;
+    key.derived = NULL;
+    if (derived) {
+        key.derived = derived.get();
+        key.file_size = key.offset = key.n_samples = key.stride = 0;
+        key.type = 0;
+        key.scale = key.shift = 0.0;
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+        cached = sectionCache().Find(key);
+        if (cached) {
+            return cached;
+        }
+        // evaluate outside of the lock:
+        std::vector<double>* evaluated = new std::vector<double>(derived->source.size());
+        cached.reset(evaluated);
+        if (!evaluated->empty()) {
+            derived->source.Decode(0, evaluated->size(), &(*evaluated)[0]);
+        }
+        for (std::size_t n_o = 0; n_o < derived->operations.size(); ++n_o) {
+            derived->operations[n_o]->Apply(*evaluated);
+        }
+        if (evaluated->size() != n_samples) {
+            throw std::runtime_error("Unexpected number of derived samples in stfio::MappedSamples::GetDecoded");
+        }
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+        cached = sectionCache().Insert(key, cached);
+        return cached;
+    }
+    if (IsFileBacked()) {
+        key.name = file->GetName();
+        key.file_size = file->GetSize();
+        key.offset = n_samples > 0 ? base - file->GetData() : 0;
+        key.n_samples = n_samples;
+        key.stride = stride;
+        key.type = type;
+        key.scale = scale;
+        key.shift = shift;
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+        cached = sectionCache().Find(key);
+        if (cached) {
+            return cached;
+        }
+    }
+    // decode outside of the lock:
+    std::vector<double>* decoded = new std::vector<double>(n_samples);
+    cached.reset(decoded);
+    if (n_samples > 0) {
+        Decode(0, n_samples, &(*decoded)[0]);
+    }
+    if (IsFileBacked()) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+        cached = sectionCache().Insert(key, cached);
+    }
+    return cached;
+}
+
+void stfio::setSectionCacheBudget(std::size_t bytes) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+    sectionCache().SetBudget(bytes);
+}
+
+std::size_t stfio::getSectionCacheBudget() {
+    std::size_t budget;
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+    budget = sectionCache().GetBudget();
+    return budget;
+}
+
+std::size_t stfio::getSectionCacheSize() {
+    std::size_t size;
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_cache)
+#endif
+    size = sectionCache().GetSize();
+    return size;
+}
+
+namespace {
+    template <typename T, bool swap, typename D>
+    void decode_kernel(const char* src, std::size_t n, std::size_t stride,
+                       double scale, double shift, D* dest)
+    {
+        for (std::size_t i = 0; i < n; ++i, src += stride) {
+            T value;
+            if (swap) {
+                unsigned char bytes[sizeof(T)];
+                for (std::size_t k = 0; k < sizeof(T); ++k) {
+                    bytes[k] = (unsigned char)src[sizeof(T)-1-k];
+                }
+                memcpy(&value, bytes, sizeof(T));
+            } else {
+                memcpy(&value, src, sizeof(T));
+            }
+            dest[i] = (D)(scale*value + shift);
+        }
+    }
+
+    template <typename T, typename D>
+    void decode_typed(const char* src, std::size_t n, std::size_t stride, bool swap,
+                      double scale, double shift, D* dest)
+    {
+        if (swap) {
+            decode_kernel<T, true>(src, n, stride, scale, shift, dest);
+        } else if (stride == sizeof(T)) {
+            // contiguous samples; a constant stride lets the compiler vectorize the loop:
+            decode_kernel<T, false>(src, n, sizeof(T), scale, shift, dest);
+        } else {
+            decode_kernel<T, false>(src, n, stride, scale, shift, dest);
+        }
+    }
+
+    template <typename D>
+    void decode_any(const char* src, std::size_t n, std::size_t stride, stfio::SampleType type,
+                    bool swap, double scale, double shift, D* dest)
+    {
+        switch (type) {
+         case stfio::sample_int16: decode_typed<short>(src, n, stride, swap, scale, shift, dest); break;
+         case stfio::sample_int32: decode_typed<int>(src, n, stride, swap, scale, shift, dest); break;
+         case stfio::sample_float32: decode_typed<float>(src, n, stride, swap, scale, shift, dest); break;
+         default: decode_typed<double>(src, n, stride, swap, scale, shift, dest); break;
+        }
+    }
+}
+
+std::size_t stfio::sampleSize(SampleType type) {
+    switch (type) {
+     case sample_int16: return sizeof(short);
+     case sample_int32: return sizeof(int);
+     case sample_float32: return sizeof(float);
+     default: return sizeof(double);
+    }
+}
+
+void stfio::decodeSamples(const char* src, std::size_t n, std::size_t stride, SampleType type,
+                          bool swap, double scale, double shift, double* dest)
+{
+    decode_any(src, n, stride, type, swap, scale, shift, dest);
+}
+
+void stfio::MappedSamples::Decode(std::size_t begin, std::size_t end, float* dest) const {
+    if (end > n_samples || begin > end) {
+        throw std::out_of_range("subscript out of range in stfio::MappedSamples::Decode");
+    }
+    if (chain) {
+        chain->Decode(begin, end, dest);
+    } else if (derived) {
+        DecodedSamples samples = GetDecoded();
+        std::copy(samples->begin()+begin, samples->begin()+end, dest);
+    } else if (end > begin) {
+        decode_any(base + begin*stride, end-begin, stride, type, false, scale, shift, dest);
+    }
+}
+
+namespace {
+    template <typename T>
+    stfio::MappedSamples compact(const std::vector<T>& samples, stfio::SampleType type,
+                                 double scale, double shift)
+    {
+        std::vector<char> buffer(samples.size()*sizeof(T));
+        if (!samples.empty()) {
+            memcpy(&buffer[0], &samples[0], buffer.size());
+        }
+#if (__cplusplus < 201103)
+        boost::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(buffer));
+#else
+        std::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(buffer));
+#endif
+        return stfio::MappedSamples(file, 0, samples.size(), sizeof(T), type, scale, shift);
+    }
+}
+
+stfio::MappedSamples stfio::compactSamples(const std::vector<short>& samples, double scale, double shift) {
+    return compact(samples, sample_int16, scale, shift);
+}
+
+stfio::MappedSamples stfio::compactSamples(const std::vector<float>& samples, double scale, double shift) {
+    return compact(samples, sample_float32, scale, shift);
+}
+
+stfio::MappedSamples stfio::compactSamples(const std::vector<double>& samples) {
+    return compact(samples, sample_float64, 1.0, 0.0);
+}
+
+stfio::MappedSamples stfio::chainSamples(const std::vector<MappedSamples>& pieces) {
+#if (__cplusplus < 201103)
+    boost::shared_ptr<SampleChain> chain(new SampleChain);
+#else
+    std::shared_ptr<SampleChain> chain(new SampleChain);
+#endif
+    std::size_t n_samples = 0;
+    for (std::size_t n_p = 0; n_p < pieces.size(); ++n_p) {
+        if (pieces[n_p].chain) {
+            const SampleChain& sub = *pieces[n_p].chain;
+            for (std::size_t n_s = 0; n_s < sub.pieces.size(); ++n_s) {
+                n_samples += sub.pieces[n_s].size();
+                chain->pieces.push_back(sub.pieces[n_s]);
+                chain->ends.push_back(n_samples);
+            }
+        } else if (pieces[n_p].size() > 0) {
+            n_samples += pieces[n_p].size();
+            chain->pieces.push_back(pieces[n_p]);
+            chain->ends.push_back(n_samples);
+        }
+    }
+    MappedSamples samples;
+    samples.chain = chain;
+    samples.n_samples = n_samples;
+    return samples;
+}
+
+stfio::MappedSamples stfio::sliceSamples(const MappedSamples& source, std::size_t offset, std::size_t size) {
+    if (offset > source.size() || size > source.size() - offset) {
+        throw std::out_of_range("Range exceeds the samples in stfio::sliceSamples");
+    }
+    if (source.derived) {
+        return MappedSamples(source.GetDecoded(), offset, size);
+    }
+    if (source.chain) {
+        const SampleChain& chain = *source.chain;
+        std::vector<MappedSamples> pieces;
+        std::size_t end = offset+size;
+        std::size_t n_p = std::upper_bound(chain.ends.begin(), chain.ends.end(), offset) - chain.ends.begin();
+        for (; n_p < chain.pieces.size() && offset < end; ++n_p) {
+            std::size_t start = n_p > 0 ? chain.ends[n_p-1] : 0;
+            std::size_t stop = std::min(end, chain.ends[n_p]);
+            pieces.push_back(sliceSamples(chain.pieces[n_p], offset-start, stop-offset));
+            offset = stop;
+        }
+        return pieces.size() == 1 ? pieces[0] : chainSamples(pieces);
+    }
+    MappedSamples slice(source);
+    slice.n_samples = size;
+    if (size > 0) {
+        slice.base += offset*slice.stride;
+    } else {
+        slice.base = NULL;
+    }
+    return slice;
+}
+
+stfio::MappedSamples stfio::deriveSamples(const MappedSamples& source,
+                                          const std::vector<SampleOperationPtr>& operations)
+{
+#if (__cplusplus < 201103)
+    boost::shared_ptr<SampleDerivation> derivation(new SampleDerivation);
+#else
+    std::shared_ptr<SampleDerivation> derivation(new SampleDerivation);
+#endif
+    if (source.derived) {
+        derivation->source = source.derived->source;
+        derivation->operations = source.derived->operations;
+    } else {
+        derivation->source = source;
+    }
+    std::size_t n_samples = source.size();
+    for (std::size_t n_o = 0; n_o < operations.size(); ++n_o) {
+        n_samples = operations[n_o]->Size(n_samples);
+        derivation->operations.push_back(operations[n_o]);
+    }
+    MappedSamples samples;
+    samples.derived = derivation;
+    samples.n_samples = n_samples;
+    return samples;
+}
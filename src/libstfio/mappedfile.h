@@ -0,0 +1,467 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file mappedfile.h
+ *  \brief Declares read-only file mappings and lazily decoded samples.
+ */
+
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#if (__cplusplus < 201103)
+    #include <boost/shared_ptr.hpp>
+#else
+    #include <memory>
+#endif
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+namespace stfio {
+
+//! A read-only memory map of a whole file.
+/*! The operating system pages the file in on demand, so that mapping
+ *  even very large files takes almost no time or resident memory.
+ */
+class StfioDll MappedFile {
+public:
+    //! Constructor. Throws std::runtime_error if the file can't be mapped.
+    /*! \param fName Full path of the file to be mapped.
+     */
+    explicit MappedFile(const std::string& fName);
+
+    //! Constructor for data that are already in memory.
+    /*! \param buffer The data; its contents are taken over, leaving it empty.
+     */
+    explicit MappedFile(std::vector<char>& buffer);
+
+    //! Constructor for memory that belongs to someone else, e.g. a NumPy array.
+    /*! The memory is read in place and has to stay unchanged while samples
+     *  refer to it; \e owner is released when the last of them is gone.
+     *  \param data Pointer to the first byte.
+     *  \param size The size of the memory in bytes.
+     *  \param owner Keeps the memory alive.
+     */
+    MappedFile(const char* data, std::size_t size,
+#if (__cplusplus < 201103)
+               const boost::shared_ptr<void>& owner
+#else
+               const std::shared_ptr<void>& owner
+#endif
+               );
+
+    //! Destructor. Unmaps the file and drops its samples from the section cache.
+    ~MappedFile();
+
+    //! Retrieves the name of the mapped file.
+    /*! \return The full path of the file, or an empty string for data in memory.
+     */
+    const std::string& GetName() const { return name; }
+
+    //! Retrieves the mapped file contents.
+    /*! \return Pointer to the first byte of the file.
+     */
+    const char* GetData() const { return data; }
+
+    //! Retrieves the size of the file.
+    /*! \return The file size in bytes.
+     */
+    std::size_t GetSize() const { return size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* data;
+    std::size_t size;
+    // only used if the data are in memory:
+    std::vector<char> buffer;
+    // only used if the memory belongs to someone else:
+#if (__cplusplus < 201103)
+    boost::shared_ptr<void> owner;
+#else
+    std::shared_ptr<void> owner;
+#endif
+    std::string name;
+#ifdef _WIN32
+    void* hFile;
+    void* hMapping;
+#endif
+};
+
+//! Storage formats of samples in a file.
+enum SampleType {
+    sample_int16,   /*!< signed 16-bit integers in host byte order */
+    sample_int32,   /*!< signed 32-bit integers in host byte order */
+    sample_float32, /*!< IEEE single precision floats in host byte order */
+    sample_float64  /*!< IEEE double precision floats in host byte order */
+};
+
+//! Returns the size of a sample in bytes.
+/*! \param type The storage format of the samples.
+ *  \return The size of a single sample in bytes.
+ */
+StfioDll std::size_t sampleSize(SampleType type);
+
+//! Decodes, byte-swaps and scales raw samples in a single pass.
+/*! This is the common conversion kernel for importers that read raw
+ *  sample buffers: dest[n] = scale*value(n)+shift.
+ *  \param src Pointer to the first raw sample; needn't be aligned.
+ *  \param n Number of samples.
+ *  \param stride Distance between subsequent samples in bytes.
+ *  \param type The storage format of the samples.
+ *  \param swap true if the samples are stored in the opposite byte order.
+ *  \param scale Scaling factor applied to the stored values.
+ *  \param shift Offset added to the scaled values.
+ *  \param dest Destination; has to hold at least n values.
+ */
+StfioDll void decodeSamples(const char* src, std::size_t n, std::size_t stride, SampleType type,
+                            bool swap, double scale, double shift, double* dest);
+
+//! Shared, read-only decoded samples.
+#if (__cplusplus < 201103)
+typedef boost::shared_ptr<const std::vector<double> > DecodedSamples;
+#else
+typedef std::shared_ptr<const std::vector<double> > DecodedSamples;
+#endif
+
+struct SampleChain;
+struct SampleDerivation;
+
+//! The location and scaling of a contiguous piece of samples in a file.
+/*! See MappedSamples::GetLayout().
+ */
+struct StfioDll SampleLayout {
+    std::size_t offset; /*!< Byte offset of the first sample. */
+    std::size_t size;   /*!< Number of samples. */
+    std::size_t stride; /*!< Distance between subsequent samples in bytes. */
+    SampleType type;    /*!< The storage format of the samples. */
+    double scale;       /*!< Scaling factor applied to the stored values. */
+    double shift;       /*!< Offset added to the scaled values. */
+};
+
+//! An operation that derives new samples from the samples of a whole section, e.g. a filter.
+/*! See stfio::deriveSamples().
+ */
+class StfioDll SampleOperation {
+public:
+    //! Destructor
+    virtual ~SampleOperation() {}
+    //! Transforms the samples of a section.
+    /*! \param data The samples; on exit, the transformed samples.
+     */
+    virtual void Apply(std::vector<double>& data) const = 0;
+    //! Retrieves the number of transformed samples.
+    /*! \param n The number of samples that are passed to Apply().
+     *  \return The number of samples that Apply() returns.
+     */
+    virtual std::size_t Size(std::size_t n) const { return n; }
+};
+
+//! Shared pointer to a SampleOperation.
+#if (__cplusplus < 201103)
+typedef boost::shared_ptr<const SampleOperation> SampleOperationPtr;
+#else
+typedef std::shared_ptr<const SampleOperation> SampleOperationPtr;
+#endif
+
+//! A sequence of samples in a mapped file or in memory that are decoded and scaled on demand.
+/*! Sample n is read from byte offset + n*stride of the file and converted
+ *  to scale*value+shift. Copies share the same mapping.
+ *  Alternatively, the sequence may chain other sequences end to end
+ *  (see stfio::chainSamples()) or derive its samples from another
+ *  sequence (see stfio::deriveSamples()).
+ */
+class StfioDll MappedSamples {
+public:
+    //! Default constructor. Creates an empty sequence.
+    MappedSamples();
+
+    //! Constructor. Throws std::out_of_range if the samples exceed the file.
+    /*! \param file The mapped file.
+     *  \param offset Byte offset of the first sample.
+     *  \param size Number of samples.
+     *  \param stride Distance between subsequent samples in bytes, e.g.
+     *         the size of a sample times the number of channels for interleaved data.
+     *  \param type The storage format of the samples.
+     *  \param scale Scaling factor applied to the stored values.
+     *  \param shift Offset added to the scaled values.
+     */
+    MappedSamples(
+#if (__cplusplus < 201103)
+            const boost::shared_ptr<MappedFile>& file,
+#else
+            const std::shared_ptr<MappedFile>& file,
+#endif
+            std::size_t offset, std::size_t size, std::size_t stride,
+            SampleType type, double scale = 1.0, double shift = 0.0);
+
+    //! Constructor for samples that have already been decoded.
+    /*! The samples are shared rather than copied, e.g. with the Section
+     *  they belong to; see Section::GetSamples().
+     *  \param decoded The samples; mustn't be written to while they're shared.
+     */
+    explicit MappedSamples(const DecodedSamples& decoded);
+
+    //! Constructor for a range of samples that have already been decoded.
+    /*! Throws std::out_of_range if the range exceeds the samples.
+     *  \param decoded The samples; mustn't be written to while they're shared.
+     *  \param offset Index of the first sample of the range.
+     *  \param size Number of samples in the range.
+     */
+    MappedSamples(const DecodedSamples& decoded, std::size_t offset, std::size_t size);
+
+    //! Unchecked access. Decodes a single sample.
+    /*! \param at Sample index.
+     *  \return The scaled value of the sample.
+     */
+    double operator[](std::size_t at) const {
+        if (chain) {
+            return ChainAt(at);
+        }
+        if (derived) {
+            return DerivedAt(at);
+        }
+        const char* p = base + at*stride;
+        switch (type) {
+         case sample_int16: return scale*decode<short>(p) + shift;
+         case sample_int32: return scale*decode<int>(p) + shift;
+         case sample_float32: return scale*decode<float>(p) + shift;
+         default: return scale*decode<double>(p) + shift;
+        }
+    }
+
+    //! Decodes a range of samples.
+    /*! \param begin Index of the first sample.
+     *  \param end Index past the last sample.
+     *  \param dest Destination; has to hold at least end-begin values.
+     */
+    void Decode(std::size_t begin, std::size_t end, double* dest) const;
+
+    //! Decodes a range of samples in single precision.
+    /*! Single precision samples that are neither scaled nor shifted are copied exactly.
+     *  See Decode() above for a description of the parameters.
+     */
+    void Decode(std::size_t begin, std::size_t end, float* dest) const;
+
+    //! Decodes all samples through the section cache.
+    /*! Samples of a mapped file and derived samples are looked up in a
+     *  process-wide cache first, so that the same samples are only decoded
+     *  once even if several sections refer to them. Samples in memory and
+     *  chained samples are decoded without caching; samples that have
+     *  already been decoded are shared.
+     *  \return The decoded samples.
+     */
+    DecodedSamples GetDecoded() const;
+
+    //! Checks whether the samples are in a file rather than in memory.
+    /*! \return true if the samples are read from a mapped file.
+     */
+    bool IsFileBacked() const { return file && !file->GetName().empty(); }
+
+    //! Checks whether the samples chain other sequences.
+    /*! \return true if the samples have been created by stfio::chainSamples().
+     */
+    bool IsChained() const { return chain.get() != NULL; }
+    //! Checks whether the samples are derived from other samples.
+    /*! \return true if the samples have been created by stfio::deriveSamples().
+     */
+    bool IsDerived() const { return derived.get() != NULL; }
+
+    //! Checks whether the samples have already been decoded.
+    /*! \return true if the samples have been created from DecodedSamples.
+     */
+    bool IsShared() const { return shared.get() != NULL; }
+
+    //! Checks whether two sequences refer to the same samples.
+    /*! \param other Another sequence.
+     *  \return true if \e other is a copy of this sequence, so that both
+     *          decode to the same values without comparing them.
+     */
+    bool SameAs(const MappedSamples& other) const;
+
+    //! Describes where the samples are stored in a file.
+    /*! \param fName Name of the file, as passed to the MappedFile constructor.
+     *  \param layout On exit, the pieces of the samples in order; a chain
+     *         contributes one entry per piece.
+     *  \return true if all samples are read from \e fName; false if
+     *          any of them are in memory, in another file or derived.
+     */
+    bool GetLayout(const std::string& fName, std::vector<SampleLayout>& layout) const;
+
+    //! Retrieves samples that have already been decoded.
+    /*! \return Pointer to the first sample, or NULL if the samples have to be
+     *          decoded or if there are none.
+     */
+    const double* GetShared() const { return shared ? (const double*)base : NULL; }
+
+    //! Retrieves the samples if they can be read in place as doubles.
+    /*! This is the case for samples that have already been decoded, and
+     *  for aligned, contiguous double precision samples of a mapping that
+     *  are neither scaled nor shifted, e.g. in shared memory
+     *  (see stfio::SharedRecording).
+     *  \return Pointer to the first sample, or NULL if the samples have to be
+     *          decoded or if there are none.
+     */
+    const double* GetInPlace() const;
+
+    //! Retrieves the samples if they can be read in place in their storage format.
+    /*! This is the case for aligned, contiguous samples of a mapping, e.g.
+     *  samples that are stored compactly in memory (see stfio::compactSamples()),
+     *  so that they can be processed without decoding them into doubles.
+     *  Sample n is then scale*raw[n]+shift.
+     *  \param type On exit, the storage format of the samples.
+     *  \param scale On exit, the scaling factor applied to the stored values.
+     *  \param shift On exit, the offset added to the scaled values.
+     *  \return Pointer to the first stored sample, or NULL if the samples have
+     *          to be decoded or if there are none.
+     */
+    const void* GetNative(SampleType& type, double& scale, double& shift) const;
+
+    //! Retrieves the number of samples.
+    /*! \return The number of samples.
+     */
+    std::size_t size() const { return n_samples; }
+
+private:
+    friend StfioDll MappedSamples chainSamples(const std::vector<MappedSamples>& pieces);
+    friend StfioDll MappedSamples sliceSamples(const MappedSamples& source,
+                                               std::size_t offset, std::size_t size);
+    friend StfioDll MappedSamples deriveSamples(const MappedSamples& source,
+                                                const std::vector<SampleOperationPtr>& operations);
+
+    // Finds the piece that holds a sample of a chain:
+    double ChainAt(std::size_t at) const;
+    // Evaluates derived samples to read a single one:
+    double DerivedAt(std::size_t at) const;
+
+    template <typename T>
+    static T decode(const char* p) {
+        // samples needn't be aligned:
+        T value;
+        memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+#if (__cplusplus < 201103)
+    boost::shared_ptr<MappedFile> file;
+#else
+    std::shared_ptr<MappedFile> file;
+#endif
+#if (__cplusplus < 201103)
+    boost::shared_ptr<const SampleChain> chain;
+#else
+    std::shared_ptr<const SampleChain> chain;
+#endif
+#if (__cplusplus < 201103)
+    boost::shared_ptr<const SampleDerivation> derived;
+#else
+    std::shared_ptr<const SampleDerivation> derived;
+#endif
+    // only used for samples that have already been decoded:
+    DecodedSamples shared;
+    const char* base;
+    std::size_t n_samples, stride;
+    SampleType type;
+    double scale, shift;
+};
+
+//! Stores 16-bit integer samples compactly in memory.
+/*! \param samples The raw samples.
+ *  \param scale Scaling factor applied to the raw samples on access.
+ *  \param shift Offset added to the scaled samples on access.
+ *  \return Samples that can be used to construct a Section.
+ */
+StfioDll MappedSamples compactSamples(const std::vector<short>& samples, double scale = 1.0, double shift = 0.0);
+
+//! Stores single precision samples compactly in memory.
+/*! \param samples The raw samples.
+ *  \param scale Scaling factor applied to the raw samples on access.
+ *  \param shift Offset added to the scaled samples on access.
+ *  \return Samples that can be used to construct a Section.
+ */
+StfioDll MappedSamples compactSamples(const std::vector<float>& samples, double scale = 1.0, double shift = 0.0);
+
+//! Stores double precision samples in memory.
+/*! \param samples The samples.
+ *  \return Samples that can be used to construct a Section.
+ */
+StfioDll MappedSamples compactSamples(const std::vector<double>& samples);
+
+//! Chains sequences of samples end to end without copying them.
+/*! The pieces keep their mappings alive. Pieces that are chains
+ *  themselves are flattened, so that chains of chains don't add indirections.
+ *  Access by index takes logarithmic time in the number of pieces;
+ *  MappedSamples::Decode() copies whole ranges piece by piece.
+ *  \param pieces The sequences in order.
+ *  \return Samples that can be used to construct a Section.
+ */
+StfioDll MappedSamples chainSamples(const std::vector<MappedSamples>& pieces);
+
+//! Refers to a range of another sequence of samples without copying them.
+/*! Samples in a mapped file or in memory keep their storage; slices of
+ *  chains only keep the pieces that overlap the range. Derived samples are
+ *  evaluated first (see stfio::deriveSamples()), and the slice shares the
+ *  result. Throws std::out_of_range if the range exceeds \e source.
+ *  \param source The samples.
+ *  \param offset Index of the first sample of the range.
+ *  \param size Number of samples in the range.
+ *  \return Samples that can be used to construct a Section.
+ */
+StfioDll MappedSamples sliceSamples(const MappedSamples& source, std::size_t offset, std::size_t size);
+
+//! Derives samples from another sequence of samples on demand.
+/*! The operations are applied in order to all samples of \e source when
+ *  the derived samples are first needed, e.g. when a Section that
+ *  holds them is drawn or measured. The result is kept in the section
+ *  cache (see stfio::setSectionCacheBudget()), so that it's evaluated again
+ *  only if it has been evicted in the meantime. Derived samples
+ *  should therefore be read as a whole or by range rather than one by one.
+ *  Deriving from derived samples appends the operations to those of the
+ *  original sequence, so that pipelines don't add indirections.
+ *  \param source The samples that the operations are applied to.
+ *  \param operations The operations in order.
+ *  \return Samples that can be used to construct a Section.
+ */
+StfioDll MappedSamples deriveSamples(const MappedSamples& source,
+                                     const std::vector<SampleOperationPtr>& operations);
+
+//! Sets the memory budget of the section cache.
+/*! Decoded samples of mapped files are kept in a least-recently used cache
+ *  until its size exceeds the budget. Samples that are still in use by a
+ *  Section stay in memory regardless; see Section::Release().
+ *  \param bytes The budget in bytes. 0 disables caching.
+ */
+StfioDll void setSectionCacheBudget(std::size_t bytes);
+
+//! Retrieves the memory budget of the section cache.
+/*! \return The budget in bytes.
+ */
+StfioDll std::size_t getSectionCacheBudget();
+
+//! Retrieves the amount of decoded samples held by the section cache.
+/*! \return The size of the cached samples in bytes.
+ */
+StfioDll std::size_t getSectionCacheSize();
+
+}
+
+/*@}*/
+
+#endif
@@ -0,0 +1,167 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file memory.cpp
+ *  \brief Defines a global memory budget that decides how imported samples are stored.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <unistd.h>
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#include "./memory.h"
+#include "./recording.h"
+
+namespace {
+
+    // The budget is read by every import; a plain variable suffices because
+    // it is only set at startup or from the settings dialog.
+    std::size_t memoryBudget = 0;
+
+    // Smallest number of bytes per sample that files of a type use:
+    std::size_t storedSampleSize(stfio::filetype type) {
+        switch (type) {
+         case stfio::atf:
+         case stfio::ascii:
+             // at least a digit and a separator per value:
+             return 2;
+         case stfio::hdf5:
+         case stfio::igor:
+         case stfio::tdms:
+         case stfio::nwb:
+         case stfio::zarr:
+             return 4;
+         default:
+             return 2;
+        }
+    }
+}
+
+void stfio::setMemoryBudget(std::size_t bytes) {
+    memoryBudget = bytes;
+}
+
+std::size_t stfio::getMemoryBudget() {
+    return memoryBudget;
+}
+
+std::size_t stfio::getMemoryUsage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return (std::size_t)counters.WorkingSetSize;
+    }
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS) {
+        return (std::size_t)info.resident_size;
+    }
+    return 0;
+#else
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    unsigned long pages = 0, resident = 0;
+    int n_read = fscanf(fp, "%lu %lu", &pages, &resident);
+    fclose(fp);
+    if (n_read != 2) {
+        return 0;
+    }
+    return (std::size_t)resident * (std::size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+std::size_t stfio::getPhysicalMemory() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status)) {
+        return (std::size_t)status.ullTotalPhys;
+    }
+    return 0;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || pageSize <= 0) {
+        return 0;
+    }
+    return (std::size_t)pages * (std::size_t)pageSize;
+#endif
+}
+
+std::size_t stfio::estimateDecodedSize(const std::string& fName, stfio::filetype type) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(fName.c_str(), &st) != 0) {
+        return 0;
+    }
+#else
+    struct stat st;
+    if (stat(fName.c_str(), &st) != 0) {
+        return 0;
+    }
+#endif
+    return (std::size_t)st.st_size / storedSampleSize(type) * sizeof(double);
+}
+
+stfio::storage_mode stfio::chooseStorage(std::size_t decodedBytes) {
+    if (memoryBudget == 0) {
+        return storage_eager;
+    }
+    std::size_t usage = getMemoryUsage();
+    std::size_t available = (memoryBudget > usage) ? memoryBudget - usage : 0;
+    if (decodedBytes <= available) {
+        return storage_eager;
+    }
+    if (decodedBytes/2 <= available) {
+        return storage_compact;
+    }
+    return storage_mapped;
+}
+
+std::size_t stfio::compactRecording(Recording& data) {
+    std::size_t freed = 0;
+    std::vector<float> buffer;
+    for (std::size_t n_c = 0; n_c < data.size(); ++n_c) {
+        Channel& ch = data[n_c];
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            const Section& sec = ch[n_s];
+            // mapped samples are already stored compactly:
+            if (sec.size() == 0 || sec.IsMapped() || sec.GetDecoded()) {
+                continue;
+            }
+            buffer.resize(sec.size());
+            sec.CopyRange(0, sec.size(), &buffer[0]);
+            Section compact(compactSamples(buffer), sec.GetSectionDescription());
+            compact.SetXScale(sec.GetXScale());
+            freed += sec.size()*(sizeof(double)-sizeof(float));
+            ch[n_s] = compact;
+        }
+    }
+    return freed;
+}
@@ -0,0 +1,99 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file memory.h
+ *  \brief Declares a global memory budget that decides how imported samples are stored.
+ */
+
+#ifndef _STFIO_MEMORY_H
+#define _STFIO_MEMORY_H
+
+#include <string>
+
+#include "./stfio.h"
+
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Ways of storing the samples of an imported file.
+enum storage_mode {
+    storage_eager = 0,   /*!< Samples are decoded into memory in double precision. */
+    storage_compact = 1, /*!< Samples in memory are kept in single precision (see stfio::compactRecording()). */
+    storage_mapped = 2   /*!< Samples are read from a sidecar index on demand (see stfio::exportSidecar()). */
+};
+
+//! Sets the memory budget of stfio::importFile().
+/*! With a budget, stfio::importFile() estimates the size of the decoded
+ *  samples before importing a file and stores them compactly or maps them
+ *  from a sidecar index if they wouldn't fit into the budget next to the
+ *  memory that the process already uses (see stfio::chooseStorage()).
+ *  \param bytes The budget in bytes; 0 disables the budget, which is the default.
+ */
+StfioDll void setMemoryBudget(std::size_t bytes);
+
+//! Retrieves the memory budget.
+/*! \return The budget in bytes; 0 if there is none.
+ */
+StfioDll std::size_t getMemoryBudget();
+
+//! Retrieves the memory that the process uses.
+/*! \return The resident memory of the process in bytes; 0 if it can't be determined.
+ */
+StfioDll std::size_t getMemoryUsage();
+
+//! Retrieves the physical memory of the computer.
+/*! \return The physical memory in bytes; 0 if it can't be determined.
+ */
+StfioDll std::size_t getPhysicalMemory();
+
+//! Estimates the memory that the decoded samples of a file will need.
+/*! The estimate is derived from the file size and the smallest sample
+ *  size that the file type uses, so that it errs on the large side.
+ *  \param fName Full path to the file.
+ *  \param type The file type.
+ *  \return The estimated size of the samples in double precision in
+ *          bytes; 0 if the file can't be read.
+ */
+StfioDll std::size_t estimateDecodedSize(const std::string& fName, stfio::filetype type);
+
+//! Chooses how samples are stored so that they fit into the memory budget.
+/*! \param decodedBytes The size of the samples in double precision, e.g.
+ *         as estimated by stfio::estimateDecodedSize().
+ *  \return stfio::storage_eager if there is no budget or the samples fit into
+ *          what the process leaves of it; stfio::storage_compact if they
+ *          fit in single precision; stfio::storage_mapped otherwise.
+ */
+StfioDll storage_mode chooseStorage(std::size_t decodedBytes);
+
+//! Stores the samples of a recording that are in memory in single precision.
+/*! Samples that are mapped from a file are left alone. Section
+ *  descriptions and x scales are kept; values lose precision beyond
+ *  about 7 significant digits, which doesn't affect samples of 16-bit
+ *  digitizers.
+ *  \param data The recording.
+ *  \return The number of bytes that have been freed.
+ */
+StfioDll std::size_t compactRecording(Recording& data);
+
+}
+
+/*@}*/
+
+#endif
@@ -0,0 +1,764 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file nwblib.cpp
+ *  \brief Import from and export to Neurodata Without Borders (NWB 2.x) files.
+ *
+ *  Follows the NWB core schema at https://nwb-schema.readthedocs.io/
+ */
+
+#include "hdf5.h"
+#include "hdf5_hl.h"
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "./nwblib.h"
+#include "./../recording.h"
+#include "./../mappedfile.h"
+
+namespace {
+
+    // The version of the NWB schema that exported files follow:
+    const char* NWB_VERSION = "2.5.0";
+    // Samples per chunk and per block that is written at once:
+    const hsize_t BLOCKSIZE = 65536;
+    // Registered identifier of the LZ4 filter plugin:
+    const H5Z_filter_t FILTER_LZ4 = 32004;
+
+    // Files that lazily read sections refer to, with the number of sections:
+    std::map<std::string, std::size_t> lazyFiles;
+
+    std::string lower(const std::string& str) {
+        std::string res(str);
+        for (std::size_t n = 0; n < res.size(); ++n) {
+            res[n] = (char)std::tolower((unsigned char)res[n]);
+        }
+        return res;
+    }
+
+    // Reads a string attribute (attr_name != NULL) or string data set of an
+    // object; both fixed and variable length strings are read, and only the
+    // first one of an array.
+    bool readString(hid_t loc, const char* obj_name, const char* attr_name, std::string& value) {
+        hid_t obj = -1, type = -1, space = -1;
+        if (attr_name != NULL) {
+            if (H5Aexists_by_name(loc, obj_name, attr_name, H5P_DEFAULT) <= 0) {
+                return false;
+            }
+            obj = H5Aopen_by_name(loc, obj_name, attr_name, H5P_DEFAULT, H5P_DEFAULT);
+            type = obj < 0 ? -1 : H5Aget_type(obj);
+            space = obj < 0 ? -1 : H5Aget_space(obj);
+        } else {
+            // checks the intermediate groups as well:
+            if (H5LTpath_valid(loc, obj_name, 1) <= 0) {
+                return false;
+            }
+            obj = H5Dopen2(loc, obj_name, H5P_DEFAULT);
+            type = obj < 0 ? -1 : H5Dget_type(obj);
+            space = obj < 0 ? -1 : H5Dget_space(obj);
+        }
+        bool ok = obj >= 0 && type >= 0 && space >= 0 && H5Tget_class(type) == H5T_STRING;
+        hssize_t n_points = ok ? H5Sget_simple_extent_npoints(space) : 0;
+        ok = ok && n_points > 0;
+        if (ok) {
+            hid_t mem_type = H5Tcopy(H5T_C_S1);
+            H5Tset_cset(mem_type, H5Tget_cset(type));
+            if (H5Tis_variable_str(type) > 0) {
+                H5Tset_size(mem_type, H5T_VARIABLE);
+                std::vector<char*> buffer(n_points, (char*)NULL);
+                ok = (attr_name != NULL ? H5Aread(obj, mem_type, &buffer[0])
+                                        : H5Dread(obj, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buffer[0])) >= 0;
+                if (ok && buffer[0] != NULL) {
+                    value = buffer[0];
+                }
+                if (ok) {
+                    H5Dvlen_reclaim(mem_type, space, H5P_DEFAULT, &buffer[0]);
+                }
+            } else {
+                std::size_t size = H5Tget_size(type);
+                H5Tset_size(mem_type, size);
+                std::vector<char> buffer(size*n_points+1, 0);
+                ok = (attr_name != NULL ? H5Aread(obj, mem_type, &buffer[0])
+                                        : H5Dread(obj, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &buffer[0])) >= 0;
+                if (ok) {
+                    value.assign(&buffer[0], std::find(buffer.begin(), buffer.begin()+size, '\0')-buffer.begin());
+                }
+            }
+            H5Tclose(mem_type);
+        }
+        if (space >= 0) H5Sclose(space);
+        if (type >= 0) H5Tclose(type);
+        if (obj >= 0) {
+            if (attr_name != NULL) H5Aclose(obj); else H5Dclose(obj);
+        }
+        return ok;
+    }
+
+    // Reads a numeric attribute, keeping defaultValue if there is none:
+    double readNumber(hid_t loc, const char* obj_name, const char* attr_name, double defaultValue) {
+        double value = defaultValue;
+        if (H5Aexists_by_name(loc, obj_name, attr_name, H5P_DEFAULT) <= 0 ||
+            H5LTget_attribute_double(loc, obj_name, attr_name, &value) < 0)
+        {
+            return defaultValue;
+        }
+        return value;
+    }
+
+    // Writes a variable length UTF-8 string data set (n_dims == 0) or a
+    // 1-D array holding a single string, as required by the schema:
+    void writeString(hid_t loc, const char* name, const std::string& value, int n_dims = 0) {
+        hid_t type = H5Tcopy(H5T_C_S1);
+        H5Tset_size(type, H5T_VARIABLE);
+        H5Tset_cset(type, H5T_CSET_UTF8);
+        hsize_t dims[1] = { 1 };
+        hid_t space = n_dims == 0 ? H5Screate(H5S_SCALAR) : H5Screate_simple(1, dims, NULL);
+        hid_t dataset = H5Dcreate2(loc, name, type, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        const char* str = value.c_str();
+        herr_t status = dataset < 0 ? -1 : H5Dwrite(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &str);
+        if (dataset >= 0) H5Dclose(dataset);
+        H5Sclose(space);
+        H5Tclose(type);
+        if (status < 0) {
+            throw std::runtime_error(std::string("Exception while writing ") + name + " in stfio::exportNWBFile");
+        }
+    }
+
+    void setStringAttribute(hid_t loc, const char* obj_name, const char* attr_name, const std::string& value) {
+        if (H5LTset_attribute_string(loc, obj_name, attr_name, value.c_str()) < 0) {
+            throw std::runtime_error(std::string("Exception while writing attribute ") + attr_name +
+                                     " in stfio::exportNWBFile");
+        }
+    }
+
+    void setNumberAttribute(hid_t loc, const char* obj_name, const char* attr_name, double value) {
+        if (H5LTset_attribute_double(loc, obj_name, attr_name, &value, 1) < 0) {
+            throw std::runtime_error(std::string("Exception while writing attribute ") + attr_name +
+                                     " in stfio::exportNWBFile");
+        }
+    }
+
+    hid_t makeGroup(hid_t loc, const char* name, bool trackOrder = false) {
+        hid_t gcpl = H5Pcreate(H5P_GROUP_CREATE);
+        if (trackOrder) {
+            // keeps the sections in order even if their names don't sort:
+            H5Pset_link_creation_order(gcpl, H5P_CRT_ORDER_TRACKED | H5P_CRT_ORDER_INDEXED);
+        }
+        hid_t group = H5Gcreate2(loc, name, H5P_DEFAULT, gcpl, H5P_DEFAULT);
+        H5Pclose(gcpl);
+        if (group < 0) {
+            throw std::runtime_error(std::string("Exception while creating group ") + name +
+                                     " in stfio::exportNWBFile");
+        }
+        return group;
+    }
+
+    std::string isoTime(const struct tm& t) {
+        // large enough for any values of the fields, so that nothing is truncated:
+        char buffer[80];
+        snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d",
+                 t.tm_year+1900, t.tm_mon+1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        return buffer;
+    }
+
+    // Finds the SI unit of the y units of a channel, and the factor that
+    // converts them to it:
+    std::string siUnit(const std::string& yunits, double& conversion) {
+        conversion = 1.0;
+        if (yunits == "mV") {
+            conversion = 1e-3;
+            return "volts";
+        }
+        if (yunits == "V") {
+            return "volts";
+        }
+        if (yunits == "pA") {
+            conversion = 1e-12;
+            return "amperes";
+        }
+        if (yunits == "nA") {
+            conversion = 1e-9;
+            return "amperes";
+        }
+        if (yunits == "A") {
+            return "amperes";
+        }
+        return yunits;
+    }
+
+    // The reverse of siUnit(): the units that Stimfit shows, and the factor
+    // that converts SI units to them:
+    std::string displayUnit(const std::string& unit, double& factor) {
+        factor = 1.0;
+        std::string l = lower(unit);
+        if (l == "volts" || l == "volt" || l == "v") {
+            factor = 1e3;
+            return "mV";
+        }
+        if (l == "amperes" || l == "ampere" || l == "amps" || l == "a") {
+            factor = 1e12;
+            return "pA";
+        }
+        return unit;
+    }
+
+    // "Vm_00012" and "Vm_3" are sections of the channel "Vm":
+    std::string channelName(const std::string& series) {
+        std::size_t pos = series.find_last_not_of("0123456789");
+        if (pos != std::string::npos && pos > 0 && pos+1 < series.size() && series[pos] == '_') {
+            return series.substr(0, pos);
+        }
+        return series;
+    }
+
+    // Reads a column of a data set when the samples are first needed;
+    // the file is opened for every read, so that no HDF5 state is kept
+    // between reads.
+    class ReadColumn : public stfio::SampleOperation {
+    public:
+        ReadColumn(const std::string& fName_, const std::string& path_, hsize_t n_rows_,
+                   hsize_t n_cols_, hsize_t col_, double scale_, double shift_)
+            : fName(fName_), path(path_), n_rows(n_rows_), n_cols(n_cols_), col(col_),
+              scale(scale_), shift(shift_)
+        {
+#ifdef _OPENMP
+#pragma omp critical(stfio_nwb_files)
+#endif
+            ++lazyFiles[fName];
+        }
+
+        ~ReadColumn() {
+#ifdef _OPENMP
+#pragma omp critical(stfio_nwb_files)
+#endif
+            {
+                std::map<std::string, std::size_t>::iterator it = lazyFiles.find(fName);
+                if (it != lazyFiles.end() && --it->second == 0) {
+                    lazyFiles.erase(it);
+                }
+            }
+        }
+
+        void Apply(std::vector<double>& data) const {
+            data.resize(n_rows);
+            if (n_rows == 0) {
+                return;
+            }
+            herr_t status = -1;
+            {
+                stfio::LibraryLock lock(stfio::nwb);
+                hid_t file_id = H5Fopen(fName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+                hid_t dataset = file_id < 0 ? -1 : H5Dopen2(file_id, path.c_str(), H5P_DEFAULT);
+                if (dataset >= 0) {
+                    hid_t file_space = H5Dget_space(dataset);
+                    int rank = H5Sget_simple_extent_ndims(file_space);
+                    hsize_t start[2] = { 0, col };
+                    hsize_t count[2] = { n_rows, 1 };
+                    status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+                    if (status >= 0 && (rank == 1 || rank == 2)) {
+                        hid_t mem_space = H5Screate_simple(1, count, NULL);
+                        status = H5Dread(dataset, H5T_NATIVE_DOUBLE, mem_space, file_space, H5P_DEFAULT, &data[0]);
+                        H5Sclose(mem_space);
+                    }
+                    H5Sclose(file_space);
+                    H5Dclose(dataset);
+                }
+                if (file_id >= 0) {
+                    H5Fclose(file_id);
+                }
+            }
+            if (status < 0) {
+                throw std::runtime_error("Couldn't read " + path + " from " + fName);
+            }
+            for (std::size_t n = 0; n < data.size(); ++n) {
+                data[n] = scale*data[n] + shift;
+            }
+        }
+
+        std::size_t Size(std::size_t) const { return n_rows; }
+
+    private:
+        ReadColumn(const ReadColumn&);
+        ReadColumn& operator=(const ReadColumn&);
+
+        std::string fName, path;
+        hsize_t n_rows, n_cols, col;
+        double scale, shift;
+    };
+
+    // Determines whether the samples of a data set can be mapped:
+    bool mappable(hid_t dataset, stfio::SampleType& type, haddr_t& offset) {
+        hid_t dcpl = H5Dget_create_plist(dataset);
+        bool ok = H5Pget_layout(dcpl) == H5D_CONTIGUOUS && H5Pget_nfilters(dcpl) == 0 &&
+            H5Pget_external_count(dcpl) == 0;
+        H5Pclose(dcpl);
+        offset = ok ? H5Dget_offset(dataset) : HADDR_UNDEF;
+        if (offset == HADDR_UNDEF) {
+            return false;
+        }
+        hid_t dtype = H5Dget_type(dataset);
+        // samples are decoded in host byte order:
+        ok = H5Tget_order(dtype) == H5Tget_order(H5T_NATIVE_INT);
+        std::size_t size = H5Tget_size(dtype);
+        switch (H5Tget_class(dtype)) {
+         case H5T_FLOAT:
+             ok = ok && (size == 4 || size == 8);
+             type = size == 4 ? stfio::sample_float32 : stfio::sample_float64;
+             break;
+         case H5T_INTEGER:
+             ok = ok && H5Tget_sign(dtype) == H5T_SGN_2 && (size == 2 || size == 4);
+             type = size == 2 ? stfio::sample_int16 : stfio::sample_int32;
+             break;
+         default:
+             ok = false;
+        }
+        H5Tclose(dtype);
+        return ok;
+    }
+
+    // A TimeSeries that has been read, with a section for each column:
+    struct Series {
+        std::string name, unit;
+        double dt;
+        std::vector<Section> sections;
+    };
+
+    Series readSeries(hid_t acquisition, const std::string& name, const std::string& fName,
+#if (__cplusplus < 201103)
+                      boost::shared_ptr<stfio::MappedFile>& file
+#else
+                      std::shared_ptr<stfio::MappedFile>& file
+#endif
+                      )
+    {
+        Series series;
+        series.name = name;
+        series.dt = 0;
+        hid_t ts = H5Gopen2(acquisition, name.c_str(), H5P_DEFAULT);
+        if (ts < 0 || H5Lexists(ts, "data", H5P_DEFAULT) <= 0) {
+            if (ts >= 0) H5Gclose(ts);
+            return series;
+        }
+
+        // the sampling interval in ms, either from the rate or from the first timestamps:
+        if (H5Lexists(ts, "starting_time", H5P_DEFAULT) > 0) {
+            double rate = readNumber(ts, "starting_time", "rate", 0);
+            series.dt = rate > 0 ? 1e3/rate : 0;
+        } else if (H5Lexists(ts, "timestamps", H5P_DEFAULT) > 0) {
+            hid_t timestamps = H5Dopen2(ts, "timestamps", H5P_DEFAULT);
+            hid_t space = H5Dget_space(timestamps);
+            hsize_t dims[1] = { 0 };
+            if (H5Sget_simple_extent_ndims(space) == 1 && H5Sget_simple_extent_dims(space, dims, NULL) >= 0 &&
+                dims[0] > 1)
+            {
+                hsize_t start[1] = { 0 }, count[1] = { 2 };
+                double t[2] = { 0, 0 };
+                H5Sselect_hyperslab(space, H5S_SELECT_SET, start, NULL, count, NULL);
+                hid_t mem_space = H5Screate_simple(1, count, NULL);
+                if (H5Dread(timestamps, H5T_NATIVE_DOUBLE, mem_space, space, H5P_DEFAULT, t) >= 0) {
+                    series.dt = 1e3*(t[1]-t[0]);
+                }
+                H5Sclose(mem_space);
+            }
+            H5Sclose(space);
+            H5Dclose(timestamps);
+        }
+
+        std::string unit;
+        readString(ts, "data", "unit", unit);
+        double factor = 1.0;
+        series.unit = displayUnit(unit, factor);
+        double scale = factor*readNumber(ts, "data", "conversion", 1.0);
+        double shift = factor*readNumber(ts, "data", "offset", 0.0);
+
+        hid_t dataset = H5Dopen2(ts, "data", H5P_DEFAULT);
+        hid_t space = dataset < 0 ? -1 : H5Dget_space(dataset);
+        int rank = space < 0 ? 0 : H5Sget_simple_extent_ndims(space);
+        hsize_t dims[2] = { 0, 1 };
+        if (rank == 1 || rank == 2) {
+            H5Sget_simple_extent_dims(space, dims, NULL);
+            stfio::SampleType type = stfio::sample_float64;
+            haddr_t offset = HADDR_UNDEF;
+            bool mapped = mappable(dataset, type, offset);
+            if (mapped && !file) {
+                file.reset(new stfio::MappedFile(fName));
+            }
+            std::string path = "/acquisition/" + name + "/data";
+            for (hsize_t n_c = 0; n_c < dims[1]; ++n_c) {
+                stfio::MappedSamples samples;
+                if (mapped) {
+                    std::size_t size = stfio::sampleSize(type);
+                    samples = stfio::MappedSamples(file, (std::size_t)offset + n_c*size, dims[0],
+                                                   dims[1]*size, type, scale, shift);
+                } else {
+                    std::vector<stfio::SampleOperationPtr> read(1,
+                        stfio::SampleOperationPtr(new ReadColumn(fName, path, dims[0], dims[1], n_c, scale, shift)));
+                    samples = stfio::deriveSamples(stfio::MappedSamples(), read);
+                }
+                series.sections.push_back(Section(samples, name));
+            }
+        }
+        if (space >= 0) H5Sclose(space);
+        if (dataset >= 0) H5Dclose(dataset);
+        H5Gclose(ts);
+        return series;
+    }
+
+    void readNWB(hid_t file_id, const std::string& fName, Recording& ReturnData, stfio::ProgressInfo& progDlg) {
+        if (H5Lexists(file_id, "acquisition", H5P_DEFAULT) <= 0) {
+            throw std::runtime_error(fName + " is not a NWB file");
+        }
+        hid_t acquisition = H5Gopen2(file_id, "acquisition", H5P_DEFAULT);
+        if (acquisition < 0) {
+            throw std::runtime_error("Couldn't open the acquisition group of " + fName);
+        }
+        // in the order of creation if it has been tracked, or by name:
+        hid_t gcpl = H5Gget_create_plist(acquisition);
+        unsigned crt_order = 0;
+        H5Pget_link_creation_order(gcpl, &crt_order);
+        H5Pclose(gcpl);
+        H5_index_t index = (crt_order & H5P_CRT_ORDER_INDEXED) ? H5_INDEX_CRT_ORDER : H5_INDEX_NAME;
+        H5G_info_t info;
+        if (H5Gget_info(acquisition, &info) < 0) {
+            H5Gclose(acquisition);
+            throw std::runtime_error("Couldn't read the acquisition group of " + fName);
+        }
+
+#if (__cplusplus < 201103)
+        boost::shared_ptr<stfio::MappedFile> file;
+#else
+        std::shared_ptr<stfio::MappedFile> file;
+#endif
+        // channels in the order of their first appearance:
+        std::vector<std::string> names;
+        std::map<std::string, std::size_t> channels;
+        std::vector<std::vector<Section> > sections;
+        std::vector<std::string> units;
+        double dt = 0;
+        try {
+            for (hsize_t n_l = 0; n_l < info.nlinks; ++n_l) {
+                ssize_t length = H5Lget_name_by_idx(acquisition, ".", index, H5_ITER_INC, n_l, NULL, 0, H5P_DEFAULT);
+                if (length <= 0) {
+                    continue;
+                }
+                std::vector<char> buffer(length+1, 0);
+                H5Lget_name_by_idx(acquisition, ".", index, H5_ITER_INC, n_l, &buffer[0], buffer.size(), H5P_DEFAULT);
+                std::string name(&buffer[0]);
+
+                std::ostringstream progStr;
+                progStr << "Reading " << name;
+                progDlg.Update((int)(100.0*n_l/info.nlinks), progStr.str());
+
+                hid_t obj = H5Oopen(acquisition, name.c_str(), H5P_DEFAULT);
+                bool isGroup = obj >= 0 && H5Iget_type(obj) == H5I_GROUP;
+                if (obj >= 0) H5Oclose(obj);
+                if (!isGroup) {
+                    continue;
+                }
+                Series series(readSeries(acquisition, name, fName, file));
+                if (series.sections.empty()) {
+                    continue;
+                }
+                if (dt <= 0) {
+                    dt = series.dt;
+                }
+                for (std::size_t n_c = 0; n_c < series.sections.size(); ++n_c) {
+                    std::string chName = channelName(name);
+                    if (series.sections.size() > 1) {
+                        std::ostringstream col;
+                        col << chName << "_" << n_c;
+                        chName = col.str();
+                    }
+                    std::map<std::string, std::size_t>::const_iterator it = channels.find(chName);
+                    std::size_t n_ch = 0;
+                    if (it == channels.end()) {
+                        n_ch = names.size();
+                        channels[chName] = n_ch;
+                        names.push_back(chName);
+                        sections.push_back(std::vector<Section>());
+                        units.push_back(series.unit);
+                    } else {
+                        n_ch = it->second;
+                    }
+                    sections[n_ch].push_back(STFIO_MOVE(series.sections[n_c]));
+                }
+            }
+        }
+        catch (...) {
+            H5Gclose(acquisition);
+            throw;
+        }
+        H5Gclose(acquisition);
+        if (names.empty()) {
+            throw std::runtime_error("No time series found in " + fName);
+        }
+
+        ReturnData.resize(names.size());
+        for (std::size_t n_c = 0; n_c < names.size(); ++n_c) {
+            Channel ch(sections[n_c].size());
+            for (std::size_t n_s = 0; n_s < sections[n_c].size(); ++n_s) {
+                ch.InsertSection(STFIO_MOVE(sections[n_c][n_s]), n_s);
+            }
+            ch.SetChannelName(names[n_c]);
+            ch.SetYUnits(units[n_c]);
+            ReturnData.InsertChannel(STFIO_MOVE(ch), n_c);
+        }
+        ReturnData.SetXScale(dt > 0 ? dt : 1.0);
+        ReturnData.SetXUnits("ms");
+
+        std::string value;
+        if (readString(file_id, "session_description", NULL, value)) {
+            ReturnData.SetFileDescription(value);
+        }
+        if (readString(file_id, "general/notes", NULL, value)) {
+            ReturnData.SetComment(value);
+        }
+        int year = 0, month = 0, day = 0, hour = 0, minute = 0, sec = 0;
+        if (readString(file_id, "session_start_time", NULL, value) &&
+            sscanf(value.c_str(), "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &sec) >= 3)
+        {
+            ReturnData.SetDateTime(year-1900, month-1, day, hour, minute, sec);
+        }
+    }
+
+    // Writes a section to a TimeSeries in blocks:
+    void writeSeries(hid_t acquisition, const std::string& name, const Section& sec, const Channel& channel,
+                     double rate, double start_time, stfio::hdf5_filter filter)
+    {
+        hid_t ts = makeGroup(acquisition, name.c_str());
+        try {
+            setStringAttribute(ts, ".", "neurodata_type", "TimeSeries");
+            setStringAttribute(ts, ".", "namespace", "core");
+            setStringAttribute(ts, ".", "description",
+                               sec.GetSectionDescription().empty() ? "no description" : sec.GetSectionDescription());
+            setStringAttribute(ts, ".", "comments", "no comments");
+
+            hsize_t n_samples = sec.size();
+            hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+            if (filter != stfio::hdf5_no_filter && n_samples > 0) {
+                hsize_t chunk[1] = { std::min(n_samples, BLOCKSIZE) };
+                H5Pset_chunk(dcpl, 1, chunk);
+                switch (filter) {
+                 case stfio::hdf5_shuffle_deflate:
+                 case stfio::hdf5_ephys:
+                     // other NWB readers don't know the ephys codec:
+                     H5Pset_shuffle(dcpl);
+                     // fall through
+                 case stfio::hdf5_deflate:
+                     H5Pset_deflate(dcpl, 4);
+                     break;
+                 case stfio::hdf5_lz4:
+                     if (H5Zfilter_avail(FILTER_LZ4) <= 0) {
+                         H5Pclose(dcpl);
+                         throw std::runtime_error("The LZ4 filter plugin is not available in stfio::exportNWBFile");
+                     }
+                     H5Pset_filter(dcpl, FILTER_LZ4, H5Z_FLAG_MANDATORY, 0, NULL);
+                     break;
+                 default:
+                     break;
+                }
+            }
+            // store as 32 bit little endian independent of machine:
+            hsize_t dims[1] = { n_samples };
+            hid_t file_space = H5Screate_simple(1, dims, NULL);
+            hid_t dataset = H5Dcreate2(ts, "data", H5T_IEEE_F32LE, file_space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+            H5Pclose(dcpl);
+            if (dataset < 0) {
+                H5Sclose(file_space);
+                throw std::runtime_error("Exception while creating data set in stfio::exportNWBFile");
+            }
+            // mapped or derived sections are decoded a block at a time:
+            herr_t status = 0;
+            Vector_float block;
+            for (hsize_t begin = 0; begin < n_samples && status >= 0; begin += BLOCKSIZE) {
+                hsize_t count[1] = { std::min(BLOCKSIZE, n_samples-begin) };
+                block.resize(count[0]);
+                sec.CopyRange(begin, begin+count[0], &block[0]);
+                hsize_t start[1] = { begin };
+                H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+                hid_t mem_space = H5Screate_simple(1, count, NULL);
+                status = H5Dwrite(dataset, H5T_NATIVE_FLOAT, mem_space, file_space, H5P_DEFAULT, &block[0]);
+                H5Sclose(mem_space);
+            }
+            H5Sclose(file_space);
+            H5Dclose(dataset);
+            if (status < 0) {
+                throw std::runtime_error("Exception while writing data in stfio::exportNWBFile");
+            }
+            double conversion = 1.0;
+            setStringAttribute(ts, "data", "unit", siUnit(channel.GetYUnits(), conversion));
+            setNumberAttribute(ts, "data", "conversion", conversion);
+            setNumberAttribute(ts, "data", "offset", 0.0);
+            setNumberAttribute(ts, "data", "resolution", -1.0);
+
+            if (H5LTmake_dataset_double(ts, "starting_time", 0, NULL, &start_time) < 0) {
+                throw std::runtime_error("Exception while writing starting time in stfio::exportNWBFile");
+            }
+            setNumberAttribute(ts, "starting_time", "rate", rate);
+            setStringAttribute(ts, "starting_time", "unit", "seconds");
+        }
+        catch (...) {
+            H5Gclose(ts);
+            throw;
+        }
+        H5Gclose(ts);
+    }
+
+    void writeNWB(hid_t file_id, const std::string& fName, const RecordingView& WData,
+                  stfio::ProgressInfo& progDlg, stfio::hdf5_filter filter)
+    {
+        setStringAttribute(file_id, "/", "nwb_version", NWB_VERSION);
+        setStringAttribute(file_id, "/", "namespace", "core");
+        setStringAttribute(file_id, "/", "neurodata_type", "NWBFile");
+
+        std::string start(isoTime(WData.GetDateTime()));
+        time_t now = time(NULL);
+        std::string created(isoTime(*localtime(&now)));
+        std::ostringstream identifier;
+        identifier << fName << " " << created;
+        writeString(file_id, "identifier", identifier.str());
+        writeString(file_id, "session_description",
+                    WData.GetFileDescription().empty() ? "no description" : WData.GetFileDescription());
+        writeString(file_id, "session_start_time", start);
+        writeString(file_id, "timestamps_reference_time", start);
+        writeString(file_id, "file_create_date", created, 1);
+
+        H5Gclose(makeGroup(file_id, "analysis"));
+        H5Gclose(makeGroup(file_id, "processing"));
+        hid_t stimulus = makeGroup(file_id, "stimulus");
+        H5Gclose(makeGroup(stimulus, "presentation"));
+        H5Gclose(makeGroup(stimulus, "templates"));
+        H5Gclose(stimulus);
+        hid_t general = makeGroup(file_id, "general");
+        try {
+            if (!WData.GetComment().empty()) {
+                writeString(general, "notes", WData.GetComment());
+            }
+        }
+        catch (...) {
+            H5Gclose(general);
+            throw;
+        }
+        H5Gclose(general);
+
+        // the rate in Hz:
+        double dt = WData.GetXScale();
+        double rate = (WData.GetXUnits() == "s" ? 1.0 : 1e3) / (dt > 0 ? dt : 1.0);
+        hid_t acquisition = makeGroup(file_id, "acquisition", true);
+        try {
+            std::size_t n_total = 0, n_done = 0;
+            for (std::size_t n_c = 0; n_c < WData.size(); ++n_c) {
+                n_total += WData[n_c].size();
+            }
+            for (std::size_t n_c = 0; n_c < WData.size(); ++n_c) {
+                const Channel& channel = WData[n_c];
+                std::string chName = channel.GetChannelName();
+                std::replace(chName.begin(), chName.end(), '/', '_');
+                if (chName.empty()) {
+                    std::ostringstream defName;
+                    defName << "ch" << n_c;
+                    chName = defName.str();
+                }
+                // sections follow each other without gaps:
+                double start_time = 0;
+                for (std::size_t n_s = 0; n_s < channel.size(); ++n_s, ++n_done) {
+                    std::ostringstream progStr;
+                    progStr << "Writing channel #" << n_c + 1 << " of " << WData.size()
+                            << ", Section #" << n_s + 1 << " of " << channel.size();
+                    progDlg.Update((int)(100.0*n_done/n_total), progStr.str());
+
+                    char name[16];
+                    snprintf(name, sizeof(name), "_%05d", (int)n_s);
+                    writeSeries(acquisition, chName + name, channel[n_s], channel, rate, start_time, filter);
+                    start_time += channel[n_s].size()/rate;
+                }
+            }
+        }
+        catch (...) {
+            H5Gclose(acquisition);
+            throw;
+        }
+        H5Gclose(acquisition);
+    }
+}
+
+void stfio::importNWBFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg) {
+    hid_t file_id = H5Fopen(fName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+        throw std::runtime_error("Couldn't open " + fName);
+    }
+    try {
+        readNWB(file_id, fName, ReturnData, progDlg);
+    }
+    catch (...) {
+        H5Fclose(file_id);
+        throw;
+    }
+    H5Fclose(file_id);
+}
+
+bool stfio::exportNWBFile(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg,
+                          hdf5_filter filter)
+{
+    // sections that are still read from the file that is replaced have to
+    // be decoded before:
+    bool lazy = false;
+#ifdef _OPENMP
+#pragma omp critical(stfio_nwb_files)
+#endif
+    lazy = lazyFiles.find(fName) != lazyFiles.end();
+    std::vector<stfio::DecodedSamples> pinned;
+    for (std::size_t n_c = 0; n_c < WData.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < WData[n_c].size(); ++n_s) {
+            const Section& sec = WData[n_c][n_s];
+            std::vector<stfio::SampleLayout> layout;
+            if (sec.IsMapped() && (lazy || sec.GetSamples().GetLayout(fName, layout))) {
+                pinned.push_back(sec.GetDecoded());
+            }
+        }
+    }
+
+    std::string tmpName = fName + ".part";
+    hid_t file_id = H5Fcreate(tmpName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file_id < 0) {
+        throw std::runtime_error("Couldn't create " + fName);
+    }
+    try {
+        writeNWB(file_id, fName, WData, progDlg, filter);
+    }
+    catch (...) {
+        H5Fclose(file_id);
+        std::remove(tmpName.c_str());
+        throw;
+    }
+    if (H5Fclose(file_id) < 0) {
+        std::remove(tmpName.c_str());
+        throw std::runtime_error("Couldn't write " + fName);
+    }
+#ifdef _WIN32
+    // rename() doesn't replace existing files:
+    std::remove(fName.c_str());
+#endif
+    if (std::rename(tmpName.c_str(), fName.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        throw std::runtime_error("Couldn't replace " + fName);
+    }
+    return true;
+}
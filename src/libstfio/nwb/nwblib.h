@@ -0,0 +1,68 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file nwblib.h
+ *  \brief Import from and export to Neurodata Without Borders (NWB 2.x) files.
+ */
+
+#ifndef _NWBLIB_H
+#define _NWBLIB_H
+
+#include "./../stfio.h"
+#include "./../hdf5/hdf5lib.h"
+
+class Recording;
+class RecordingView;
+
+namespace stfio {
+
+//! Open a NWB file and store its contents to a Recording object.
+/*! Every TimeSeries in the group "/acquisition" becomes a section.
+ *  TimeSeries whose names only differ in a trailing "_" followed by a
+ *  number, e.g. "Vm_00000" and "Vm_00001", are sections of the same
+ *  channel; a 2-D TimeSeries contributes a section to a channel for each
+ *  of its columns. Volts are converted to mV and amperes to pA. The
+ *  samples are read lazily: contiguous, uncompressed data stay in the
+ *  file and are decoded on demand (see stfio::MappedSamples), while
+ *  chunked or compressed data are read by hyperslab when a section is
+ *  first needed. Throws std::runtime_error if the file can't be read.
+ *  \param fName Full path to the file to be read.
+ *  \param ReturnData On entry, an empty Recording object. On exit,
+ *         the data stored in \e fName.
+ *  \param progDlg Progress indicator.
+ */
+void importNWBFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg);
+
+//! Export a Recording to a NWB file.
+/*! Each section is written to a TimeSeries "/acquisition/<channel>_<section>"
+ *  in blocks, so that sections that are mapped or derived are never
+ *  decoded as a whole. mV, V, pA and nA are stored with the conversion
+ *  factor to volts or amperes; other units are stored as they are. The
+ *  file is written under a temporary name first, so that a recording can
+ *  be saved to the file that it has been read from. Throws
+ *  std::runtime_error if the file can't be written.
+ *  \param fName Full path to the file to be written.
+ *  \param WData The data to be exported.
+ *  \param progDlg Progress indicator.
+ *  \param filter The compression filter; hdf5_no_filter writes contiguous
+ *         data sets that are mapped when they're imported again, and
+ *         hdf5_ephys is replaced by hdf5_shuffle_deflate.
+ *  \return true if the file has been written.
+ */
+StfioDll bool exportNWBFile(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg,
+                            hdf5_filter filter = hdf5_shuffle_deflate);
+
+}
+
+#endif
@@ -0,0 +1,108 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file online.cpp
+ *  \brief Defines sections and recordings that grow while data are acquired.
+ */
+
+#include <stdexcept>
+#include <algorithm>
+
+#include "./online.h"
+#include "./recording.h"
+
+stfio::OnlineSection::OnlineSection(std::size_t chunkSize_)
+    : chunkSize(0), n_sealed(0), chunks(), tail(), pyramid()
+{
+    // chunks hold whole blocks of the pyramid:
+    std::size_t block = MinMaxPyramid::GetBlockSize(0);
+    chunkSize = std::max<std::size_t>((chunkSize_ + block - 1) / block, 1) * block;
+    tail.reserve(chunkSize);
+}
+
+void stfio::OnlineSection::Append(const double* values, std::size_t n) {
+    pyramid.Extend(values, n);
+    while (n > 0) {
+        std::size_t n_copy = std::min(n, chunkSize - tail.size());
+        tail.insert(tail.end(), values, values+n_copy);
+        values += n_copy;
+        n -= n_copy;
+        if (tail.size() == chunkSize) {
+            // the full chunk is shared with views from now on:
+#if (__cplusplus < 201103)
+            boost::shared_ptr<Vector_double> chunk(new Vector_double);
+#else
+            std::shared_ptr<Vector_double> chunk(new Vector_double);
+#endif
+            chunk->swap(tail);
+            chunks.push_back(chunk);
+            n_sealed += chunkSize;
+            tail.reserve(chunkSize);
+        }
+    }
+}
+
+Section stfio::OnlineSection::View(const std::string& label) const {
+    std::vector<MappedSamples> pieces;
+    pieces.reserve(chunks.size()+1);
+    for (std::size_t n_c = 0; n_c < chunks.size(); ++n_c) {
+        pieces.push_back(MappedSamples(chunks[n_c]));
+    }
+    if (!tail.empty()) {
+        pieces.push_back(compactSamples(tail));
+    }
+    if (pieces.empty()) {
+        return Section(Vector_double(0), label);
+    }
+    return Section(pieces.size() == 1 ? pieces[0] : chainSamples(pieces), label);
+}
+
+stfio::OnlineRecording::OnlineRecording(std::size_t n_channels, double dt_, std::size_t chunkSize)
+    : channels(n_channels, OnlineSection(chunkSize)), names(n_channels), yunits(n_channels),
+      dt(dt_), frame()
+{}
+
+void stfio::OnlineRecording::AppendInterleaved(const double* values, std::size_t n) {
+    std::size_t n_channels = channels.size();
+    if (n_channels == 0 || n % n_channels != 0) {
+        throw std::out_of_range("Incomplete sampling points in stfio::OnlineRecording::AppendInterleaved()");
+    }
+    std::size_t n_points = n / n_channels;
+    frame.resize(n_points);
+    for (std::size_t n_c = 0; n_c < n_channels; ++n_c) {
+        for (std::size_t n_p = 0; n_p < n_points; ++n_p) {
+            frame[n_p] = values[n_p*n_channels + n_c];
+        }
+        channels[n_c].Append(frame);
+    }
+}
+
+void stfio::OnlineRecording::SetChannel(std::size_t n_c, const std::string& name,
+                                        const std::string& units)
+{
+    names.at(n_c) = name;
+    yunits.at(n_c) = units;
+}
+
+Recording stfio::OnlineRecording::View() const {
+    Recording view(channels.size(), 1, 0);
+    for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+        view[n_c].InsertSection(channels[n_c].View(), 0);
+        view[n_c].SetChannelName(names[n_c]);
+        view[n_c].SetYUnits(yunits[n_c]);
+    }
+    view.SetXScale(dt);
+    return view;
+}
@@ -0,0 +1,154 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file online.h
+ *  \brief Declares sections and recordings that grow while data are acquired.
+ */
+
+#ifndef _ONLINE_H
+#define _ONLINE_H
+
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+#include "./section.h"
+
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! A gap-free section that data points are appended to while they're acquired.
+/*! The data points are stored in chunks of fixed size. A chunk is never
+ *  written to or moved once it is full, so that appending takes amortized
+ *  constant time per point and views of the section share the full chunks
+ *  rather than copying them. The min/max pyramid is extended with every
+ *  append, so that long traces can be drawn while they grow.
+ *
+ *  An online section isn't thread-safe; views, however, never change and
+ *  can be analysed by other threads while more data are appended.
+ */
+class StfioDll OnlineSection {
+public:
+    //! Constructor.
+    /*! \param chunkSize Number of data points per chunk; rounded up to a
+     *         multiple of the smallest block of stfio::MinMaxPyramid.
+     */
+    explicit OnlineSection(std::size_t chunkSize = 65536);
+
+    //! Appends data points.
+    /*! \param values The data points.
+     *  \param n Number of data points.
+     */
+    void Append(const double* values, std::size_t n);
+
+    //! Appends data points.
+    /*! \param values The data points.
+     */
+    void Append(const Vector_double& values) { if (!values.empty()) Append(&values[0], values.size()); }
+
+    //! Retrieves the number of data points.
+    /*! \return The number of data points that have been appended.
+     */
+    std::size_t size() const { return n_sealed + tail.size(); }
+
+    //! Creates a view of all data points that have been appended so far.
+    /*! Full chunks are shared; only the points of the last chunk are copied.
+     *  The view doesn't change when more data points are appended.
+     *  \param label The description of the section.
+     *  \return A section with the data points.
+     */
+    Section View(const std::string& label = "") const;
+
+    //! Retrieves the min/max pyramid of all data points.
+    /*! Use it with a view, e.g. pyramid.Extrema(View(), begin, end, min, max).
+     *  \return The pyramid; valid until more data points are appended.
+     */
+    const MinMaxPyramid& GetPyramid() const { return pyramid; }
+
+private:
+    std::size_t chunkSize, n_sealed;
+    std::vector<DecodedSamples> chunks;
+    Vector_double tail;
+    MinMaxPyramid pyramid;
+};
+
+//! A gap-free recording whose channels grow while data are acquired.
+/*! Each channel is an stfio::OnlineSection. Views are ordinary recordings
+ *  with one section per channel, so that they can be measured, scanned
+ *  for events or exported like recordings that were read from a file.
+ */
+class StfioDll OnlineRecording {
+public:
+    //! Constructor.
+    /*! \param n_channels Number of channels.
+     *  \param dt The sampling interval.
+     *  \param chunkSize Number of data points per chunk; see stfio::OnlineSection.
+     */
+    OnlineRecording(std::size_t n_channels, double dt, std::size_t chunkSize = 65536);
+
+    //! Retrieves the number of channels.
+    /*! \return The number of channels.
+     */
+    std::size_t size() const { return channels.size(); }
+
+    //! Access to a channel, e.g. to append data points.
+    /*! \param n_c The channel index.
+     *  \return The channel.
+     */
+    OnlineSection& operator[](std::size_t n_c) { return channels[n_c]; }
+
+    //! Read-only access to a channel.
+    /*! \param n_c The channel index.
+     *  \return The channel.
+     */
+    const OnlineSection& operator[](std::size_t n_c) const { return channels[n_c]; }
+
+    //! Appends data points that are interleaved by channel, as delivered by most digitizers.
+    /*! Throws std::out_of_range if \e n isn't a multiple of the number of channels.
+     *  \param values The data points, channel by channel for each sampling point.
+     *  \param n Total number of data points.
+     */
+    void AppendInterleaved(const double* values, std::size_t n);
+
+    //! Sets the name and the units of a channel.
+    /*! \param n_c The channel index.
+     *  \param name The channel name.
+     *  \param yunits The y units.
+     */
+    void SetChannel(std::size_t n_c, const std::string& name, const std::string& yunits);
+
+    //! Creates a view of all data points that have been appended so far.
+    /*! Channels may differ in length if they're appended to separately.
+     *  \return A recording with a single section per channel; see OnlineSection::View().
+     */
+    Recording View() const;
+
+private:
+    std::vector<OnlineSection> channels;
+    std::vector<std::string> names, yunits;
+    double dt;
+    Vector_double frame;
+};
+
+}
+
+/*@}*/
+
+#endif
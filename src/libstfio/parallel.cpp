@@ -0,0 +1,236 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file parallel.cpp
+ *  \brief Defines the number of threads of all parallel operations and a work-stealing loop.
+ */
+
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "./parallel.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    // Like the memory budget, the count is only set at startup or from
+    // the settings, so that a plain variable suffices; 0 is the default:
+    int threadSetting = 0;
+
+    // Nested regions divide the threads of the enclosing team among
+    // themselves, so that a second level doesn't oversubscribe:
+    void enableNesting() {
+#ifdef _OPENMP
+        if (!omp_in_parallel() && omp_get_max_active_levels() < 2) {
+            omp_set_max_active_levels(2);
+        }
+#endif
+    }
+
+    int defaultThreadCount() {
+        enableNesting();
+        const char* env = std::getenv("STFIO_NUM_THREADS");
+        if (env != NULL) {
+            int n = std::atoi(env);
+            if (n > 0) {
+                return n;
+            }
+        }
+        // without OpenMP, threads of the program such as the background
+        // tasks of the GUI still run in parallel:
+#ifdef _OPENMP
+        return omp_get_num_procs();
+#elif defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return std::max((int)info.dwNumberOfProcessors, 1);
+#else
+        return std::max((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+#endif
+    }
+
+#ifdef _OPENMP
+    // The iterations that a thread hasn't started yet; the owner takes
+    // them from the front, other threads steal them from the back:
+    struct Share {
+        Share() : begin(0), end(0) { omp_init_lock(&lock); }
+        ~Share() { omp_destroy_lock(&lock); }
+        std::size_t begin, end;
+        omp_lock_t lock;
+        // keeps the shares of different threads on different cache lines:
+        char padding[64];
+    };
+
+    // Takes up to grain iterations from the front of a share:
+    bool take(Share& share, std::size_t grain, std::size_t& begin, std::size_t& end) {
+        omp_set_lock(&share.lock);
+        bool found = share.begin < share.end;
+        if (found) {
+            begin = share.begin;
+            end = std::min(share.begin + grain, share.end);
+            share.begin = end;
+        }
+        omp_unset_lock(&share.lock);
+        return found;
+    }
+
+    // Moves the second half of the largest other share to the share of
+    // thread me; returns false if no iterations are left:
+    bool steal(std::vector<Share>& shares, int me, std::size_t grain) {
+        for (;;) {
+            int victim = -1;
+            std::size_t largest = 0;
+            for (int n = 0; n < (int)shares.size(); ++n) {
+                if (n == me) {
+                    continue;
+                }
+                omp_set_lock(&shares[n].lock);
+                std::size_t left = shares[n].end - shares[n].begin;
+                omp_unset_lock(&shares[n].lock);
+                if (left > largest) {
+                    largest = left;
+                    victim = n;
+                }
+            }
+            if (victim < 0) {
+                return false;
+            }
+            std::size_t begin = 0, end = 0;
+            omp_set_lock(&shares[victim].lock);
+            std::size_t left = shares[victim].end - shares[victim].begin;
+            if (left > 0) {
+                std::size_t stolen = (left <= grain) ? left : std::max(left/2, grain);
+                end = shares[victim].end;
+                begin = end - stolen;
+                shares[victim].end = begin;
+            }
+            omp_unset_lock(&shares[victim].lock);
+            if (begin < end) {
+                omp_set_lock(&shares[me].lock);
+                shares[me].begin = begin;
+                shares[me].end = end;
+                omp_unset_lock(&shares[me].lock);
+                return true;
+            }
+            // the victim has finished in the meantime; look again:
+        }
+    }
+#endif
+
+}
+
+void stfio::setThreadCount(int n) {
+    enableNesting();
+    threadSetting = std::max(n, 0);
+}
+
+int stfio::getThreadCount() {
+    if (threadSetting > 0) {
+        return threadSetting;
+    }
+    static const int defaultCount = defaultThreadCount();
+    return defaultCount;
+}
+
+int stfio::threadCount(int n_threads, int n_tasks) {
+#ifdef _OPENMP
+    if (omp_get_active_level() >= omp_get_max_active_levels()) {
+        // a region would only get a single thread:
+        return 1;
+    }
+    if (n_threads <= 0) {
+        n_threads = getThreadCount();
+        // nested regions divide the threads of the enclosing team among themselves:
+        if (omp_in_parallel()) {
+            n_threads = std::max(n_threads / omp_get_num_threads(), 1);
+        }
+    }
+    return std::max(std::min(n_threads, n_tasks), 1);
+#else
+    return 1;
+#endif
+}
+
+void stfio::parallelFor(std::size_t n, RangeTask& task, int n_threads, std::size_t grain) {
+    if (n == 0) {
+        return;
+    }
+    grain = std::max<std::size_t>(grain, 1);
+    std::size_t n_grains = (n + grain - 1) / grain;
+    n_threads = threadCount(n_threads, (int)std::min<std::size_t>(n_grains, 1 << 20));
+    if (n_threads == 1) {
+        try {
+            task.Run(0, n, 0);
+        } catch (const std::exception& e) {
+            throw std::runtime_error(e.what());
+        }
+        return;
+    }
+#ifdef _OPENMP
+    std::vector<Share> shares(n_threads);
+    for (int n_t = 0; n_t < n_threads; ++n_t) {
+        // equal shares of whole grains:
+        shares[n_t].begin = std::min(n, (n_grains * n_t / n_threads) * grain);
+        shares[n_t].end = std::min(n, (n_grains * (n_t+1) / n_threads) * grain);
+    }
+    bool failed = false;
+    std::string error;
+#pragma omp parallel num_threads(n_threads)
+    {
+        // the team may be smaller than requested; the shares of missing
+        // threads are stolen by the others:
+        int me = omp_get_thread_num();
+        for (;;) {
+            std::size_t begin = 0, end = 0;
+            if (!take(shares[me], grain, begin, end)) {
+                if (!steal(shares, me, grain)) {
+                    break;
+                }
+                continue;
+            }
+            bool stop = false;
+#pragma omp critical(stfio_parallel_for)
+            stop = failed;
+            if (stop) {
+                break;
+            }
+            try {
+                task.Run(begin, end, me);
+            } catch (const std::exception& e) {
+#pragma omp critical(stfio_parallel_for)
+                {
+                    if (!failed) {
+                        error = e.what();
+                    }
+                    failed = true;
+                }
+            }
+        }
+    }
+    if (failed) {
+        throw std::runtime_error(error);
+    }
+#endif
+}
@@ -0,0 +1,99 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file parallel.h
+ *  \brief Declares the number of threads of all parallel operations and a work-stealing loop.
+ *
+ *  All parallel operations of libstfio and libstfnum take a number of
+ *  threads, where 0 stands for the configured thread count (see
+ *  stfio::setThreadCount()). The count is resolved by stfio::threadCount(),
+ *  so that a single setting, e.g. a preference of the program, a command
+ *  line option or the environment variable STFIO_NUM_THREADS, applies to
+ *  every operation. Operations that are started from within a parallel
+ *  region share the threads of the enclosing team rather than starting a
+ *  full team of their own.
+ */
+
+#ifndef _STFIO_PARALLEL_H
+#define _STFIO_PARALLEL_H
+
+#include <cstddef>
+
+#include "./stfio.h"
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Sets the number of threads of parallel operations that don't ask for a specific number.
+/*! \param n The number of threads; 0 restores the default, i.e. the value
+ *         of the environment variable STFIO_NUM_THREADS if it is set,
+ *         or the number of processors otherwise.
+ */
+StfioDll void setThreadCount(int n);
+
+//! Retrieves the number of threads of parallel operations.
+/*! \return The number set by stfio::setThreadCount(), or the default.
+ */
+StfioDll int getThreadCount();
+
+//! Resolves the number of threads of a parallel region.
+/*! \param n_threads The number of threads that the caller asked for; 0 or
+ *         less uses stfio::getThreadCount(), divided among the threads of
+ *         the enclosing team if the call is made from within a parallel region.
+ *  \param n_tasks The number of independent tasks; no more threads are used.
+ *  \return The number of threads, at least 1; always 1 without OpenMP.
+ */
+StfioDll int threadCount(int n_threads, int n_tasks);
+
+//! A loop body for stfio::parallelFor().
+class StfioDll RangeTask {
+public:
+    //! Destructor
+    virtual ~RangeTask() {}
+
+    //! Processes a range of iterations.
+    /*! Called by several threads at the same time for disjoint ranges.
+     *  \param begin Index of the first iteration.
+     *  \param end Index past the last iteration.
+     *  \param thread Index of the calling thread within the team, e.g. to
+     *         select a buffer of its own.
+     */
+    virtual void Run(std::size_t begin, std::size_t end, int thread) = 0;
+};
+
+//! Runs the iterations [0, n) of a loop on a team of threads.
+/*! Every thread starts with an equal share of the iterations and takes
+ *  \e grain of them at a time. A thread that has run out of iterations
+ *  steals the second half of the largest share that is left, so that
+ *  iterations of very different costs keep all threads busy without the
+ *  overhead of a shared counter for every iteration. The loop may be
+ *  nested: a call from within a task shares the threads of the team.
+ *  If a task throws, no further ranges are started, and std::runtime_error
+ *  with the message of the first exception is thrown once all threads have
+ *  finished.
+ *  \param n The number of iterations.
+ *  \param task The loop body.
+ *  \param n_threads Number of threads; 0 uses stfio::threadCount().
+ *  \param grain Number of iterations that a thread takes at a time.
+ */
+StfioDll void parallelFor(std::size_t n, RangeTask& task, int n_threads = 0, std::size_t grain = 1);
+
+}
+
+/*@}*/
+
+#endif
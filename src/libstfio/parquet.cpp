@@ -0,0 +1,734 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file parquet.cpp
+ *  \brief Defines tables of results in Apache Parquet files.
+ */
+
+#include <zlib.h>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <algorithm>
+
+#include "./parquet.h"
+
+namespace {
+
+    const char MAGIC[] = "PAR1";
+
+    // Compression level of the gzip pages:
+    const int GZIP_LEVEL = 6;
+
+    // Enumerations of the Parquet format:
+    enum { type_int32 = 1, type_int64 = 2, type_float = 4, type_double = 5, type_byte_array = 6 };
+    enum { repetition_required = 0, repetition_optional = 1 };
+    enum { encoding_plain = 0, encoding_rle = 3 };
+    enum { codec_uncompressed = 0, codec_gzip = 2 };
+    enum { page_data = 0 };
+    enum { converted_utf8 = 0 };
+
+    // Types of the Thrift compact protocol:
+    enum { thrift_stop = 0, thrift_true = 1, thrift_false = 2, thrift_byte = 3, thrift_i16 = 4,
+           thrift_i32 = 5, thrift_i64 = 6, thrift_double = 7, thrift_binary = 8,
+           thrift_list = 9, thrift_set = 10, thrift_map = 11, thrift_struct = 12 };
+
+    void putLE(std::string& out, unsigned long long value, int n_bytes) {
+        for (int n = 0; n < n_bytes; ++n) {
+            out += (char)(value >> (8*n));
+        }
+    }
+
+    unsigned long long getLE(const unsigned char* p, int n_bytes) {
+        unsigned long long value = 0;
+        for (int n = 0; n < n_bytes; ++n) {
+            value |= (unsigned long long)p[n] << (8*n);
+        }
+        return value;
+    }
+
+    void putVarint(std::string& out, unsigned long long value) {
+        while (value >= 0x80) {
+            out += (char)((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out += (char)value;
+    }
+
+    // Writes the Thrift compact protocol, in which the metadata of Parquet
+    // files are encoded. Fields have to be written in ascending order.
+    class ThriftWriter {
+    public:
+        ThriftWriter() : out(), last(1, 0) {}
+
+        void I32(int id, long long value) { Field(id, thrift_i32); Zigzag(value); }
+        void I64(int id, long long value) { Field(id, thrift_i64); Zigzag(value); }
+        void Binary(int id, const std::string& value) { Field(id, thrift_binary); String(value); }
+
+        void BeginStruct(int id) { Field(id, thrift_struct); last.push_back(0); }
+        void EndStruct() { out += (char)thrift_stop; last.pop_back(); }
+
+        void BeginList(int id, int elementType, std::size_t size) {
+            Field(id, thrift_list);
+            if (size < 15) {
+                out += (char)((size << 4) | elementType);
+            } else {
+                out += (char)(0xf0 | elementType);
+                putVarint(out, size);
+            }
+        }
+        // Elements of lists:
+        void BeginElement() { last.push_back(0); }
+        void EndElement() { EndStruct(); }
+        void ElementI32(long long value) { Zigzag(value); }
+        void ElementBinary(const std::string& value) { String(value); }
+
+        // Ends the outermost struct:
+        const std::string& Finish() { out += (char)thrift_stop; return out; }
+
+    private:
+        void Field(int id, int type) {
+            int delta = id - last.back();
+            if (delta > 0 && delta <= 15) {
+                out += (char)((delta << 4) | type);
+            } else {
+                out += (char)type;
+                Zigzag(id);
+            }
+            last.back() = id;
+        }
+        void Zigzag(long long value) {
+            putVarint(out, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+        }
+        void String(const std::string& value) {
+            putVarint(out, value.size());
+            out += value;
+        }
+
+        std::string out;
+        std::vector<int> last;
+    };
+
+    // A value of the Thrift compact protocol:
+    struct Thrift {
+        Thrift() : i(0) {}
+
+        const Thrift& operator[](int id) const {
+            static const Thrift none;
+            std::map<int, Thrift>::const_iterator it = fields.find(id);
+            return it == fields.end() ? none : it->second;
+        }
+        bool Has(int id) const { return fields.find(id) != fields.end(); }
+
+        long long i;
+        std::string bin;
+        std::vector<Thrift> items;
+        std::map<int, Thrift> fields;
+    };
+
+    class ThriftReader {
+    public:
+        ThriftReader(const unsigned char* begin, const unsigned char* end_, const std::string& name_)
+            : p(begin), end(end_), name(name_) {}
+
+        Thrift Struct() { return Value(thrift_struct, 0); }
+
+        const unsigned char* Position() const { return p; }
+
+    private:
+        void Fail() const { throw std::runtime_error("Corrupt metadata in " + name); }
+
+        unsigned char Byte() {
+            if (p == end) {
+                Fail();
+            }
+            return *p++;
+        }
+        unsigned long long Varint() {
+            unsigned long long value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                unsigned char b = Byte();
+                value |= (unsigned long long)(b & 0x7f) << shift;
+                if ((b & 0x80) == 0) {
+                    return value;
+                }
+            }
+            Fail();
+            return 0;
+        }
+        long long Zigzag() {
+            unsigned long long value = Varint();
+            return (long long)(value >> 1) ^ -(long long)(value & 1);
+        }
+
+        Thrift Value(int type, int depth) {
+            if (depth > 64) {
+                Fail();
+            }
+            Thrift value;
+            switch (type) {
+             case thrift_true:
+             case thrift_false:
+             case thrift_byte:
+                 value.i = Byte();
+                 break;
+             case thrift_i16:
+             case thrift_i32:
+             case thrift_i64:
+                 value.i = Zigzag();
+                 break;
+             case thrift_double:
+                 if (end - p < 8) {
+                     Fail();
+                 }
+                 p += 8;
+                 break;
+             case thrift_binary: {
+                 unsigned long long size = Varint();
+                 if ((unsigned long long)(end - p) < size) {
+                     Fail();
+                 }
+                 value.bin.assign((const char*)p, (std::size_t)size);
+                 p += size;
+                 break;
+             }
+             case thrift_list:
+             case thrift_set: {
+                 unsigned char header = Byte();
+                 unsigned long long size = header >> 4;
+                 if (size == 15) {
+                     size = Varint();
+                 }
+                 if (size > (unsigned long long)(end - p)) {
+                     Fail();
+                 }
+                 for (unsigned long long n = 0; n < size; ++n) {
+                     value.items.push_back(Value(header & 0x0f, depth+1));
+                 }
+                 break;
+             }
+             case thrift_map: {
+                 unsigned long long size = Varint();
+                 if (size > (unsigned long long)(end - p)) {
+                     Fail();
+                 }
+                 unsigned char types = size > 0 ? Byte() : 0;
+                 for (unsigned long long n = 0; n < size; ++n) {
+                     Value(types >> 4, depth+1);
+                     Value(types & 0x0f, depth+1);
+                 }
+                 break;
+             }
+             case thrift_struct: {
+                 int id = 0;
+                 for (;;) {
+                     unsigned char header = Byte();
+                     if (header == thrift_stop) {
+                         break;
+                     }
+                     int fieldType = header & 0x0f;
+                     id = (header >> 4) != 0 ? id + (header >> 4) : (int)Zigzag();
+                     if (fieldType == thrift_true || fieldType == thrift_false) {
+                         // booleans are held by the type of the field:
+                         value.fields[id].i = fieldType == thrift_true;
+                     } else {
+                         value.fields[id] = Value(fieldType, depth+1);
+                     }
+                 }
+                 break;
+             }
+             default:
+                 Fail();
+            }
+            return value;
+        }
+
+        const unsigned char* p;
+        const unsigned char* end;
+        std::string name;
+    };
+
+    std::string gzipPage(const std::string& page) {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        // windowBits + 16 writes a gzip header:
+        if (deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Couldn't compress a Parquet page");
+        }
+        std::string compressed(deflateBound(&stream, (uLong)page.size()) + 32, '\0');
+        stream.next_in = (Bytef*)page.data();
+        stream.avail_in = (uInt)page.size();
+        stream.next_out = (Bytef*)&compressed[0];
+        stream.avail_out = (uInt)compressed.size();
+        int status = deflate(&stream, Z_FINISH);
+        deflateEnd(&stream);
+        if (status != Z_STREAM_END) {
+            throw std::runtime_error("Couldn't compress a Parquet page");
+        }
+        compressed.resize(stream.total_out);
+        return compressed;
+    }
+
+    std::string gunzipPage(const unsigned char* src, std::size_t size, std::size_t uncompressed,
+                           const std::string& name)
+    {
+        std::string page(uncompressed, '\0');
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+            throw std::runtime_error("Couldn't decompress " + name);
+        }
+        stream.next_in = (Bytef*)src;
+        stream.avail_in = (uInt)size;
+        stream.next_out = (Bytef*)(page.empty() ? NULL : &page[0]);
+        stream.avail_out = (uInt)page.size();
+        int status = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END || stream.total_out != uncompressed) {
+            throw std::runtime_error("Corrupt page in " + name);
+        }
+        return page;
+    }
+
+    // Encodes definition levels of 0 (null) or 1 with the RLE/bit-packing
+    // hybrid, preceded by their length:
+    void putDefinitionLevels(std::string& out, const std::vector<bool>& defined, std::size_t n_null) {
+        std::string levels;
+        if (n_null == 0) {
+            // a single run of ones:
+            putVarint(levels, (unsigned long long)defined.size() << 1);
+            levels += (char)1;
+        } else {
+            // bit-packed groups of 8:
+            std::size_t n_groups = (defined.size() + 7) / 8;
+            putVarint(levels, ((unsigned long long)n_groups << 1) | 1);
+            std::string bits(n_groups, '\0');
+            for (std::size_t n = 0; n < defined.size(); ++n) {
+                if (defined[n]) {
+                    bits[n/8] |= (char)(1 << (n%8));
+                }
+            }
+            levels += bits;
+        }
+        putLE(out, levels.size(), 4);
+        out += levels;
+    }
+
+    // Decodes n_values definition levels of bit width 1; returns the bytes that have been read.
+    std::size_t getDefinitionLevels(const unsigned char* p, const unsigned char* end, std::size_t n_values,
+                                    std::vector<bool>& defined, const std::string& name)
+    {
+        if (end - p < 4) {
+            throw std::runtime_error("Corrupt page in " + name);
+        }
+        std::size_t size = (std::size_t)getLE(p, 4);
+        if ((std::size_t)(end - p - 4) < size) {
+            throw std::runtime_error("Corrupt page in " + name);
+        }
+        const unsigned char* q = p + 4;
+        const unsigned char* q_end = q + size;
+        defined.clear();
+        while (defined.size() < n_values) {
+            unsigned long long header = 0;
+            int shift = 0;
+            do {
+                if (q == q_end || shift > 63) {
+                    throw std::runtime_error("Corrupt definition levels in " + name);
+                }
+                header |= (unsigned long long)(*q & 0x7f) << shift;
+                shift += 7;
+            } while (*q++ & 0x80);
+            if (header & 1) {
+                unsigned long long n_groups = header >> 1;
+                if ((unsigned long long)(q_end - q) < n_groups) {
+                    throw std::runtime_error("Corrupt definition levels in " + name);
+                }
+                for (unsigned long long n = 0; n < 8*n_groups && defined.size() < n_values; ++n) {
+                    defined.push_back(((q[n/8] >> (n%8)) & 1) != 0);
+                }
+                q += n_groups;
+            } else {
+                if (q == q_end) {
+                    throw std::runtime_error("Corrupt definition levels in " + name);
+                }
+                bool value = *q++ != 0;
+                unsigned long long run = std::min<unsigned long long>(header >> 1, n_values - defined.size());
+                if (run == 0) {
+                    throw std::runtime_error("Corrupt definition levels in " + name);
+                }
+                defined.insert(defined.end(), (std::size_t)run, value);
+            }
+        }
+        return size + 4;
+    }
+
+    // Thrift header of an uncompressed or compressed data page:
+    std::string pageHeader(std::size_t n_values, std::size_t uncompressed, std::size_t compressed) {
+        ThriftWriter header;
+        header.I32(1, page_data);
+        header.I32(2, (long long)uncompressed);
+        header.I32(3, (long long)compressed);
+        header.BeginStruct(5);
+        header.I32(1, (long long)n_values);
+        header.I32(2, encoding_plain);
+        header.I32(3, encoding_rle);
+        header.I32(4, encoding_rle);
+        header.EndStruct();
+        return header.Finish();
+    }
+
+    // The values of a column that is being read:
+    struct ColumnValues {
+        std::string name;
+        int type;
+        bool optional;
+        std::vector<std::string> strings;
+        Vector_double numbers;
+    };
+
+    // Reads the pages of a column chunk:
+    void readColumnChunk(const std::string& file, const Thrift& meta, ColumnValues& column,
+                         const std::string& fName)
+    {
+        if (meta.Has(11) && meta[11].i > 0) {
+            throw std::runtime_error("Dictionary encoding isn't supported in " + fName);
+        }
+        long long codec = meta[4].i;
+        if (codec != codec_uncompressed && codec != codec_gzip) {
+            throw std::runtime_error("Unsupported compression of " + column.name + " in " + fName);
+        }
+        long long n_values = meta[5].i;
+        long long offset = meta[9].i;
+        const unsigned char* begin = (const unsigned char*)file.data();
+        const unsigned char* end = begin + file.size();
+        while (n_values > 0) {
+            if (offset < 4 || offset >= (long long)file.size()) {
+                throw std::runtime_error("Corrupt column chunk in " + fName);
+            }
+            ThriftReader reader(begin + offset, end, fName);
+            Thrift header = reader.Struct();
+            const unsigned char* payload = reader.Position();
+            long long uncompressed = header[2].i, compressed = header[3].i;
+            if (header[1].i != page_data || !header.Has(5)) {
+                throw std::runtime_error("Unsupported page type of " + column.name + " in " + fName);
+            }
+            if (compressed < 0 || uncompressed < 0 || compressed > end - payload) {
+                throw std::runtime_error("Corrupt page in " + fName);
+            }
+            const Thrift& dataHeader = header[5];
+            long long page_values = dataHeader[1].i;
+            if (dataHeader[2].i != encoding_plain || page_values <= 0 || page_values > n_values) {
+                throw std::runtime_error("Unsupported encoding of " + column.name + " in " + fName);
+            }
+            std::string page = codec == codec_gzip ?
+                gunzipPage(payload, (std::size_t)compressed, (std::size_t)uncompressed, fName) :
+                std::string((const char*)payload, (std::size_t)compressed);
+            const unsigned char* p = (const unsigned char*)page.data();
+            const unsigned char* p_end = p + page.size();
+            std::vector<bool> defined((std::size_t)page_values, true);
+            if (column.optional) {
+                p += getDefinitionLevels(p, p_end, (std::size_t)page_values, defined, fName);
+            }
+            for (std::size_t n = 0; n < defined.size(); ++n) {
+                if (column.type == type_byte_array) {
+                    std::string value;
+                    if (defined[n]) {
+                        if (p_end - p < 4 || (unsigned long long)(p_end - p - 4) < getLE(p, 4)) {
+                            throw std::runtime_error("Corrupt page in " + fName);
+                        }
+                        std::size_t length = (std::size_t)getLE(p, 4);
+                        value.assign((const char*)p + 4, length);
+                        p += 4 + length;
+                    }
+                    column.strings.push_back(value);
+                    continue;
+                }
+                int size = (column.type == type_int32 || column.type == type_float) ? 4 : 8;
+                double value = NAN;
+                if (defined[n]) {
+                    if (p_end - p < size) {
+                        throw std::runtime_error("Corrupt page in " + fName);
+                    }
+                    unsigned long long raw = getLE(p, size);
+                    p += size;
+                    switch (column.type) {
+                     case type_int32: value = (double)(int)(unsigned int)raw; break;
+                     case type_int64: value = (double)(long long)raw; break;
+                     case type_float: {
+                         unsigned int bits = (unsigned int)raw;
+                         float f;
+                         std::memcpy(&f, &bits, 4);
+                         value = f;
+                         break;
+                     }
+                     default:
+                         std::memcpy(&value, &raw, 8);
+                    }
+                }
+                column.numbers.push_back(value);
+            }
+            n_values -= page_values;
+            offset = (long long)(payload - begin) + compressed;
+        }
+    }
+}
+
+bool stfio::isParquetName(const std::string& fName) {
+    std::size_t dot = fName.find_last_of('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string ext = fName.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".parquet";
+}
+
+stfio::ParquetWriter::ParquetWriter(const std::string& fName, const std::string& labelTitle,
+                                    const std::vector<std::string>& colLabels)
+    : name(fName), columns(1, labelTitle), rowGroups(), n_rows(0), dataEnd(4), fp(NULL)
+{
+    columns.insert(columns.end(), colLabels.begin(), colLabels.end());
+    fp = fopen(name.c_str(), "w+b");
+    if (fp == NULL) {
+        throw std::runtime_error("Couldn't open " + name + " for writing");
+    }
+    try {
+        if (fwrite(MAGIC, 1, 4, fp) != 4) {
+            throw std::runtime_error("Couldn't write to " + name);
+        }
+        WriteFooter();
+    }
+    catch (...) {
+        fclose(fp);
+        fp = NULL;
+        throw;
+    }
+}
+
+stfio::ParquetWriter::~ParquetWriter() {
+    try {
+        Close();
+    }
+    catch (...) {
+    }
+}
+
+void stfio::ParquetWriter::Append(const std::vector<std::string>& labels, const Vector_double& values) {
+    std::size_t n_cols = columns.size()-1;
+    if (values.size() != labels.size()*n_cols) {
+        throw std::runtime_error("Wrong number of values in stfio::ParquetWriter::Append");
+    }
+    if (fp == NULL) {
+        throw std::runtime_error("Can't append to the closed table " + name);
+    }
+    if (labels.empty()) {
+        return;
+    }
+    RowGroup group;
+    group.n_rows = (long long)labels.size();
+    std::string chunks;
+    for (std::size_t n_c = 0; n_c <= n_cols; ++n_c) {
+        std::string page;
+        if (n_c == 0) {
+            for (std::size_t n_r = 0; n_r < labels.size(); ++n_r) {
+                putLE(page, labels[n_r].size(), 4);
+                page += labels[n_r];
+            }
+        } else {
+            std::vector<bool> defined(labels.size());
+            std::size_t n_null = 0;
+            for (std::size_t n_r = 0; n_r < labels.size(); ++n_r) {
+                defined[n_r] = !std::isnan(values[n_r*n_cols + n_c-1]);
+                n_null += !defined[n_r];
+            }
+            putDefinitionLevels(page, defined, n_null);
+            for (std::size_t n_r = 0; n_r < labels.size(); ++n_r) {
+                if (defined[n_r]) {
+                    unsigned long long raw;
+                    std::memcpy(&raw, &values[n_r*n_cols + n_c-1], 8);
+                    putLE(page, raw, 8);
+                }
+            }
+        }
+        std::string compressed = gzipPage(page);
+        std::string header = pageHeader(labels.size(), page.size(), compressed.size());
+        ColumnChunk chunk;
+        chunk.offset = dataEnd + (long long)chunks.size();
+        chunk.uncompressed = (long long)(header.size() + page.size());
+        chunk.compressed = (long long)(header.size() + compressed.size());
+        chunk.n_values = (long long)labels.size();
+        group.columns.push_back(chunk);
+        chunks += header;
+        chunks += compressed;
+    }
+    // the row group replaces the previous footer:
+    if (fseek(fp, (long)dataEnd, SEEK_SET) != 0 ||
+        fwrite(chunks.data(), 1, chunks.size(), fp) != chunks.size())
+    {
+        throw std::runtime_error("Couldn't write to " + name);
+    }
+    dataEnd += (long long)chunks.size();
+    rowGroups.push_back(group);
+    n_rows += group.n_rows;
+    WriteFooter();
+}
+
+void stfio::ParquetWriter::Close() {
+    if (fp == NULL) {
+        return;
+    }
+    int status = fclose(fp);
+    fp = NULL;
+    if (status != 0) {
+        throw std::runtime_error("Couldn't write to " + name);
+    }
+}
+
+void stfio::ParquetWriter::WriteFooter() {
+    // the footer only grows, so that nothing of a previous one remains after it:
+    ThriftWriter meta;
+    meta.I32(1, 1);
+    meta.BeginList(2, thrift_struct, columns.size()+1);
+    meta.BeginElement();
+    meta.Binary(4, "schema");
+    meta.I32(5, (long long)columns.size());
+    meta.EndElement();
+    for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+        meta.BeginElement();
+        meta.I32(1, n_c == 0 ? type_byte_array : type_double);
+        meta.I32(3, n_c == 0 ? repetition_required : repetition_optional);
+        meta.Binary(4, columns[n_c]);
+        if (n_c == 0) {
+            meta.I32(6, converted_utf8);
+            // the logical type STRING:
+            meta.BeginStruct(10);
+            meta.BeginStruct(1);
+            meta.EndStruct();
+            meta.EndStruct();
+        }
+        meta.EndElement();
+    }
+    meta.I64(3, n_rows);
+    meta.BeginList(4, thrift_struct, rowGroups.size());
+    for (std::size_t n_g = 0; n_g < rowGroups.size(); ++n_g) {
+        const RowGroup& group = rowGroups[n_g];
+        long long total = 0;
+        meta.BeginElement();
+        meta.BeginList(1, thrift_struct, group.columns.size());
+        for (std::size_t n_c = 0; n_c < group.columns.size(); ++n_c) {
+            const ColumnChunk& chunk = group.columns[n_c];
+            total += chunk.uncompressed;
+            meta.BeginElement();
+            meta.I64(2, chunk.offset);
+            meta.BeginStruct(3);
+            meta.I32(1, n_c == 0 ? type_byte_array : type_double);
+            meta.BeginList(2, thrift_i32, n_c == 0 ? 1 : 2);
+            meta.ElementI32(encoding_plain);
+            if (n_c > 0) {
+                meta.ElementI32(encoding_rle);
+            }
+            meta.BeginList(3, thrift_binary, 1);
+            meta.ElementBinary(columns[n_c]);
+            meta.I32(4, codec_gzip);
+            meta.I64(5, chunk.n_values);
+            meta.I64(6, chunk.uncompressed);
+            meta.I64(7, chunk.compressed);
+            meta.I64(9, chunk.offset);
+            meta.EndStruct();
+            meta.EndElement();
+        }
+        meta.I64(2, total);
+        meta.I64(3, group.n_rows);
+        meta.EndElement();
+    }
+    meta.Binary(6, "stimfit");
+    std::string footer(meta.Finish());
+    putLE(footer, footer.size(), 4);
+    footer += MAGIC;
+    if (fseek(fp, (long)dataEnd, SEEK_SET) != 0 ||
+        fwrite(footer.data(), 1, footer.size(), fp) != footer.size() || fflush(fp) != 0)
+    {
+        throw std::runtime_error("Couldn't write to " + name);
+    }
+}
+
+void stfio::readTableParquet(const std::string& fName, std::string& labelTitle,
+                             std::vector<std::string>& colLabels, std::vector<std::string>& labels,
+                             Vector_double& values)
+{
+    std::ifstream in(fName.c_str(), std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Couldn't open " + fName);
+    }
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (file.size() < 12 || file.compare(0, 4, MAGIC) != 0 || file.compare(file.size()-4, 4, MAGIC) != 0) {
+        throw std::runtime_error(fName + " is not a Parquet file");
+    }
+    const unsigned char* begin = (const unsigned char*)file.data();
+    std::size_t footerSize = (std::size_t)getLE(begin + file.size() - 8, 4);
+    if (footerSize > file.size() - 12) {
+        throw std::runtime_error("Corrupt footer in " + fName);
+    }
+    const unsigned char* footer = begin + file.size() - 8 - footerSize;
+    Thrift meta = ThriftReader(footer, footer + footerSize, fName).Struct();
+
+    const std::vector<Thrift>& schema = meta[2].items;
+    if (schema.size() < 2 || schema[0][5].i != (long long)schema.size()-1) {
+        throw std::runtime_error("Unsupported schema in " + fName);
+    }
+    std::vector<ColumnValues> columns(schema.size()-1);
+    for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+        const Thrift& element = schema[n_c+1];
+        columns[n_c].name = element[4].bin;
+        columns[n_c].type = (int)element[1].i;
+        columns[n_c].optional = element[3].i == repetition_optional;
+        bool supported = n_c == 0 ? columns[n_c].type == type_byte_array :
+            (columns[n_c].type == type_int32 || columns[n_c].type == type_int64 ||
+             columns[n_c].type == type_float || columns[n_c].type == type_double);
+        if (!supported || element.Has(5) || element[3].i > repetition_optional) {
+            throw std::runtime_error("Unsupported type of " + columns[n_c].name + " in " + fName);
+        }
+    }
+
+    const std::vector<Thrift>& rowGroups = meta[4].items;
+    for (std::size_t n_g = 0; n_g < rowGroups.size(); ++n_g) {
+        const std::vector<Thrift>& chunks = rowGroups[n_g][1].items;
+        if (chunks.size() != columns.size()) {
+            throw std::runtime_error("Corrupt row group in " + fName);
+        }
+        for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+            readColumnChunk(file, chunks[n_c][3], columns[n_c], fName);
+        }
+    }
+
+    labelTitle = columns[0].name;
+    colLabels.clear();
+    for (std::size_t n_c = 1; n_c < columns.size(); ++n_c) {
+        colLabels.push_back(columns[n_c].name);
+        if (columns[n_c].numbers.size() != columns[0].strings.size()) {
+            throw std::runtime_error("Columns of different lengths in " + fName);
+        }
+    }
+    labels.swap(columns[0].strings);
+    values.resize(labels.size()*colLabels.size());
+    for (std::size_t n_r = 0; n_r < labels.size(); ++n_r) {
+        for (std::size_t n_c = 0; n_c < colLabels.size(); ++n_c) {
+            values[n_r*colLabels.size() + n_c] = columns[n_c+1].numbers[n_r];
+        }
+    }
+}
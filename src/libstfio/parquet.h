@@ -0,0 +1,120 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file parquet.h
+ *  \brief Declares tables of results in Apache Parquet files.
+ *
+ *  Follows the Parquet format specification at
+ *  https://github.com/apache/parquet-format
+ */
+
+#ifndef _PARQUET_H
+#define _PARQUET_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Writes a table of results to a Parquet file, one row group at a time.
+/*! The row labels are a UTF-8 string column, followed by a nullable
+ *  double column per column label; NaN is written as null, like the empty
+ *  cells of stfio::TableStream. Pages are compressed with gzip. The footer
+ *  is written again after every row group, so that the file can be read
+ *  after each call to Append(), even if the program doesn't finish.
+ */
+class StfioDll ParquetWriter {
+public:
+    //! Constructor. Creates the file.
+    /*! Throws std::runtime_error if the file can't be written.
+     *  \param fName Full path to the file.
+     *  \param labelTitle Name of the column of row labels, e.g. "file".
+     *  \param colLabels Names of the value columns.
+     */
+    ParquetWriter(const std::string& fName, const std::string& labelTitle,
+                  const std::vector<std::string>& colLabels);
+
+    //! Destructor. Closes the file; errors are ignored.
+    ~ParquetWriter();
+
+    //! Writes a row group.
+    /*! Throws std::runtime_error if the number of values doesn't match,
+     *  or if the file can't be written.
+     *  \param labels The row labels.
+     *  \param values The values row by row; NaN for empty cells.
+     */
+    void Append(const std::vector<std::string>& labels, const Vector_double& values);
+
+    //! Closes the file.
+    /*! Throws std::runtime_error if the file can't be written.
+     */
+    void Close();
+
+private:
+    ParquetWriter(const ParquetWriter&);
+    ParquetWriter& operator=(const ParquetWriter&);
+
+    // Writes the footer at the end of the row groups.
+    void WriteFooter();
+
+    struct ColumnChunk {
+        long long offset, uncompressed, compressed, n_values;
+    };
+    struct RowGroup {
+        long long n_rows;
+        std::vector<ColumnChunk> columns;
+    };
+
+    std::string name;
+    std::vector<std::string> columns;
+    std::vector<RowGroup> rowGroups;
+    long long n_rows, dataEnd;
+    FILE* fp;
+};
+
+//! Reads a table that stfio::ParquetWriter has written.
+/*! Used to merge the tables of several runs. Besides the files of
+ *  stfio::ParquetWriter, files with a string column followed by double,
+ *  float or integer columns can be read, if their pages are plain-encoded
+ *  and uncompressed or compressed with gzip. Nulls are read as NaN. Throws
+ *  std::runtime_error if the file can't be read.
+ *  \param fName Full path to the file.
+ *  \param labelTitle On exit, the name of the column of row labels.
+ *  \param colLabels On exit, the names of the value columns.
+ *  \param labels On exit, the row labels.
+ *  \param values On exit, the values row by row.
+ */
+StfioDll void readTableParquet(const std::string& fName, std::string& labelTitle,
+                               std::vector<std::string>& colLabels, std::vector<std::string>& labels,
+                               Vector_double& values);
+
+//! Checks whether a file name has the extension ".parquet".
+/*! \param fName The file name.
+ *  \return true for Parquet files.
+ */
+StfioDll bool isParquetName(const std::string& fName);
+
+}
+
+/*@}*/
+
+#endif
@@ -0,0 +1,346 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file profile.cpp
+ *  \brief Defines timers and counters that instrument the hot paths.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#elif defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <sys/time.h>
+#endif
+
+#include "./stfio.h"
+#include "./profile.h"
+
+#ifdef _MSC_VER
+    #define STFIO_THREAD_LOCAL __declspec(thread)
+#else
+    #define STFIO_THREAD_LOCAL __thread
+#endif
+
+namespace {
+
+    struct ProfileEvent {
+        const char* name;
+        double start;
+        double duration;
+    };
+
+    struct TimerStats {
+        TimerStats() : calls(0), total(0), max(0) {}
+        long calls;
+        double total;
+        double max;
+    };
+
+    // Orders names by their contents, since the same literal may have
+    // different addresses in different translation units:
+    struct NameLess {
+        bool operator()(const char* a, const char* b) const { return std::strcmp(a, b) < 0; }
+    };
+
+    // The records of a single thread. The lock is only contended while the
+    // records are read; without OpenMP, reading while other threads record
+    // isn't safe.
+    struct ThreadBuffer {
+        ThreadBuffer(int id_) : id(id_), events(), timers(), counters() {
+#ifdef _OPENMP
+            omp_init_lock(&lock);
+#endif
+        }
+
+        void Lock() {
+#ifdef _OPENMP
+            omp_set_lock(&lock);
+#endif
+        }
+
+        void Unlock() {
+#ifdef _OPENMP
+            omp_unset_lock(&lock);
+#endif
+        }
+
+        int id;
+        std::vector<ProfileEvent> events;
+        std::map<const char*, TimerStats, NameLess> timers;
+        std::map<const char*, long long, NameLess> counters;
+#ifdef _OPENMP
+        omp_lock_t lock;
+#endif
+    };
+
+    // Buffers are never deleted, so that the pointers of threads that are
+    // still running stay valid; there's one per thread that has ever recorded.
+    std::vector<ThreadBuffer*>& allBuffers() {
+        static std::vector<ThreadBuffer*> buffers;
+        return buffers;
+    }
+
+    STFIO_THREAD_LOCAL ThreadBuffer* threadBuffer = NULL;
+
+    ThreadBuffer& currentBuffer() {
+        if (threadBuffer == NULL) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_profile)
+#endif
+            {
+                std::vector<ThreadBuffer*>& buffers = allBuffers();
+                threadBuffer = new ThreadBuffer((int)buffers.size());
+                buffers.push_back(threadBuffer);
+            }
+        }
+        return *threadBuffer;
+    }
+
+    // Copies the buffer list, so that buffers can be read one at a time:
+    std::vector<ThreadBuffer*> copyBuffers() {
+        std::vector<ThreadBuffer*> buffers;
+#ifdef _OPENMP
+#pragma omp critical(stfio_profile)
+#endif
+        buffers = allBuffers();
+        return buffers;
+    }
+
+    std::string jsonString(const char* s) {
+        std::string out("\"");
+        for (; *s != '\0'; ++s) {
+            if (*s == '"' || *s == '\\') {
+                out += '\\';
+                out += *s;
+            } else if ((unsigned char)*s < 0x20) {
+                char buf[8];
+                std::sprintf(buf, "\\u%04x", (unsigned char)*s);
+                out += buf;
+            } else {
+                out += *s;
+            }
+        }
+        out += '"';
+        return out;
+    }
+}
+
+bool stfio::profilingAvailable() {
+#ifdef WITH_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+double stfio::profileClock() {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#elif defined(_WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1.0e-6*tv.tv_usec;
+#endif
+}
+
+void stfio::profileRecord(const char* name, double start, double duration) {
+    ThreadBuffer& buffer = currentBuffer();
+    buffer.Lock();
+    TimerStats& stats = buffer.timers[name];
+    ++stats.calls;
+    stats.total += duration;
+    stats.max = std::max(stats.max, duration);
+    if (buffer.events.size() < profileMaxEvents) {
+        ProfileEvent event = {name, start, duration};
+        buffer.events.push_back(event);
+    }
+    buffer.Unlock();
+}
+
+void stfio::profileCount(const char* name, long long n) {
+    ThreadBuffer& buffer = currentBuffer();
+    buffer.Lock();
+    buffer.counters[name] += n;
+    buffer.Unlock();
+}
+
+std::vector<stfio::ProfileTimer> stfio::profileTimers() {
+    std::map<std::string, ProfileTimer> merged;
+    std::vector<ThreadBuffer*> buffers = copyBuffers();
+    for (std::size_t n_b = 0; n_b < buffers.size(); ++n_b) {
+        buffers[n_b]->Lock();
+        std::map<const char*, TimerStats, NameLess>::const_iterator it;
+        for (it = buffers[n_b]->timers.begin(); it != buffers[n_b]->timers.end(); ++it) {
+            std::map<std::string, ProfileTimer>::iterator m_it = merged.find(it->first);
+            if (m_it == merged.end()) {
+                ProfileTimer timer;
+                timer.name = it->first;
+                timer.calls = 0;
+                timer.total = timer.max = 0;
+                m_it = merged.insert(std::make_pair(timer.name, timer)).first;
+            }
+            m_it->second.calls += it->second.calls;
+            m_it->second.total += it->second.total;
+            m_it->second.max = std::max(m_it->second.max, it->second.max);
+        }
+        buffers[n_b]->Unlock();
+    }
+    std::vector<ProfileTimer> timers;
+    for (std::map<std::string, ProfileTimer>::const_iterator it = merged.begin(); it != merged.end(); ++it) {
+        timers.push_back(it->second);
+    }
+    return timers;
+}
+
+std::vector<stfio::ProfileCounter> stfio::profileCounters() {
+    std::map<std::string, long long> merged;
+    std::vector<ThreadBuffer*> buffers = copyBuffers();
+    for (std::size_t n_b = 0; n_b < buffers.size(); ++n_b) {
+        buffers[n_b]->Lock();
+        std::map<const char*, long long, NameLess>::const_iterator it;
+        for (it = buffers[n_b]->counters.begin(); it != buffers[n_b]->counters.end(); ++it) {
+            merged[it->first] += it->second;
+        }
+        buffers[n_b]->Unlock();
+    }
+    std::vector<ProfileCounter> counters;
+    for (std::map<std::string, long long>::const_iterator it = merged.begin(); it != merged.end(); ++it) {
+        ProfileCounter counter;
+        counter.name = it->first;
+        counter.value = it->second;
+        counters.push_back(counter);
+    }
+    return counters;
+}
+
+std::string stfio::profileReport() {
+    std::vector<ProfileTimer> timers = profileTimers();
+    std::vector<ProfileCounter> counters = profileCounters();
+    std::ostringstream report;
+    if (!profilingAvailable()) {
+        report << "This build doesn't include the instrumentation (configure --enable-profiling).\n";
+    }
+    if (timers.empty() && counters.empty()) {
+        report << "Nothing has been recorded yet.\n";
+        return report.str();
+    }
+    report << std::fixed << std::setprecision(3);
+    if (!timers.empty()) {
+        report << std::left << std::setw(40) << "Region" << std::right
+               << std::setw(10) << "Calls" << std::setw(14) << "Total (ms)"
+               << std::setw(12) << "Mean (ms)" << std::setw(12) << "Max (ms)" << "\n";
+        for (std::size_t n_t = 0; n_t < timers.size(); ++n_t) {
+            const ProfileTimer& timer = timers[n_t];
+            report << std::left << std::setw(40) << timer.name << std::right
+                   << std::setw(10) << timer.calls << std::setw(14) << 1.0e3*timer.total
+                   << std::setw(12) << 1.0e3*timer.total/timer.calls
+                   << std::setw(12) << 1.0e3*timer.max << "\n";
+        }
+    }
+    if (!counters.empty()) {
+        report << "\n" << std::left << std::setw(40) << "Counter" << std::right
+               << std::setw(16) << "Value" << "\n";
+        for (std::size_t n_c = 0; n_c < counters.size(); ++n_c) {
+            report << std::left << std::setw(40) << counters[n_c].name << std::right
+                   << std::setw(16) << counters[n_c].value << "\n";
+        }
+    }
+    return report.str();
+}
+
+void stfio::writeChromeTrace(const std::string& fName) {
+    std::vector<ThreadBuffer*> buffers = copyBuffers();
+    std::vector< std::vector<ProfileEvent> > events(buffers.size());
+    double t0 = 0, t1 = 0;
+    bool first = true;
+    for (std::size_t n_b = 0; n_b < buffers.size(); ++n_b) {
+        buffers[n_b]->Lock();
+        events[n_b] = buffers[n_b]->events;
+        buffers[n_b]->Unlock();
+        for (std::size_t n_e = 0; n_e < events[n_b].size(); ++n_e) {
+            const ProfileEvent& event = events[n_b][n_e];
+            if (first || event.start < t0) {
+                t0 = event.start;
+            }
+            if (first || event.start + event.duration > t1) {
+                t1 = event.start + event.duration;
+            }
+            first = false;
+        }
+    }
+    std::vector<ProfileCounter> counters = profileCounters();
+
+    std::ofstream out(fName.c_str());
+    if (!out) {
+        throw std::runtime_error("Couldn't open " + fName + " in stfio::writeChromeTrace()");
+    }
+    // timestamps and durations are given in microseconds:
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[\n";
+    bool comma = false;
+    for (std::size_t n_b = 0; n_b < buffers.size(); ++n_b) {
+        if (comma) {
+            out << ",\n";
+        }
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffers[n_b]->id
+            << ",\"args\":{\"name\":\"Thread " << buffers[n_b]->id << "\"}}";
+        comma = true;
+        for (std::size_t n_e = 0; n_e < events[n_b].size(); ++n_e) {
+            const ProfileEvent& event = events[n_b][n_e];
+            out << ",\n{\"name\":" << jsonString(event.name) << ",\"cat\":\"stimfit\",\"ph\":\"X\""
+                << ",\"ts\":" << 1.0e6*(event.start-t0) << ",\"dur\":" << 1.0e6*event.duration
+                << ",\"pid\":1,\"tid\":" << buffers[n_b]->id << "}";
+        }
+    }
+    // counters only have a final value:
+    for (std::size_t n_c = 0; n_c < counters.size(); ++n_c) {
+        if (comma) {
+            out << ",\n";
+        }
+        out << "{\"name\":" << jsonString(counters[n_c].name.c_str()) << ",\"ph\":\"C\""
+            << ",\"ts\":" << 1.0e6*(t1-t0) << ",\"pid\":1"
+            << ",\"args\":{\"value\":" << counters[n_c].value << "}}";
+        comma = true;
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    if (!out) {
+        throw std::runtime_error("Couldn't write " + fName + " in stfio::writeChromeTrace()");
+    }
+}
+
+void stfio::profileReset() {
+    std::vector<ThreadBuffer*> buffers = copyBuffers();
+    for (std::size_t n_b = 0; n_b < buffers.size(); ++n_b) {
+        buffers[n_b]->Lock();
+        buffers[n_b]->events.clear();
+        buffers[n_b]->timers.clear();
+        buffers[n_b]->counters.clear();
+        buffers[n_b]->Unlock();
+    }
+}
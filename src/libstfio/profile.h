@@ -0,0 +1,144 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file profile.h
+ *  \brief Declares timers and counters that instrument the hot paths.
+ *
+ *  The instrumentation is compiled in with -DWITH_PROFILING (configure
+ *  --enable-profiling); otherwise STF_PROFILE_SCOPE() and STF_PROFILE_COUNT()
+ *  expand to nothing. Every thread records into its own buffer, so that
+ *  parallel code doesn't contend for a lock while it is timed.
+ */
+
+#ifndef _STFIO_PROFILE_H
+#define _STFIO_PROFILE_H
+
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Accumulated time of a named region.
+struct StfioDll ProfileTimer {
+    std::string name; /*!< Name of the region. */
+    long calls;       /*!< Number of times the region has been run. */
+    double total;     /*!< Total time in s, summed over all threads. */
+    double max;       /*!< Longest single run in s. */
+};
+
+//! Value of a named counter.
+struct StfioDll ProfileCounter {
+    std::string name; /*!< Name of the counter. */
+    long long value;  /*!< Sum of all increments. */
+};
+
+//! Determines whether the instrumentation has been compiled in.
+/*! \return true if the library has been built with WITH_PROFILING.
+ */
+StfioDll bool profilingAvailable();
+
+//! Reads the clock of the profiler.
+/*! \return Wall clock time in s since an arbitrary point in time.
+ */
+StfioDll double profileClock();
+
+//! Records a single run of a region. Usually called by stfio::ProfileScope.
+/*! \param name Name of the region. Has to stay valid until stfio::profileReset()
+ *         is called, e.g. a string literal.
+ *  \param start Start time as returned by stfio::profileClock().
+ *  \param duration Duration in s.
+ */
+StfioDll void profileRecord(const char* name, double start, double duration);
+
+//! Increments a counter. Usually called through STF_PROFILE_COUNT().
+/*! \param name Name of the counter; see stfio::profileRecord().
+ *  \param n The increment.
+ */
+StfioDll void profileCount(const char* name, long long n);
+
+//! Summarises the recorded regions of all threads.
+/*! \return The regions sorted by name.
+ */
+StfioDll std::vector<ProfileTimer> profileTimers();
+
+//! Summarises the counters of all threads.
+/*! \return The counters sorted by name.
+ */
+StfioDll std::vector<ProfileCounter> profileCounters();
+
+//! Describes the recorded regions and counters as a plain-text table.
+/*! \return One line per region and counter.
+ */
+StfioDll std::string profileReport();
+
+//! Writes all recorded regions in the Chrome trace event format.
+/*! The file can be viewed in chrome://tracing or in Perfetto. Only the
+ *  first stfio::profileMaxEvents runs of each thread are kept for the
+ *  trace; the summaries include all runs.
+ *  Throws std::runtime_error if the file can't be written.
+ *  \param fName Path of the JSON file.
+ */
+StfioDll void writeChromeTrace(const std::string& fName);
+
+//! Discards everything that has been recorded.
+/*! Mustn't be called while other threads are inside a timed region.
+ */
+StfioDll void profileReset();
+
+//! Maximal number of runs per thread that are kept for the trace.
+const std::size_t profileMaxEvents = 1000000;
+
+//! Times the enclosing scope. Usually created through STF_PROFILE_SCOPE().
+class StfioDll ProfileScope {
+public:
+    //! Constructor. Starts the timer.
+    /*! \param name_ Name of the region; see stfio::profileRecord().
+     */
+    explicit ProfileScope(const char* name_) : name(name_), start(profileClock()) {}
+
+    //! Destructor. Records the run.
+    ~ProfileScope() { profileRecord(name, start, profileClock()-start); }
+
+private:
+    ProfileScope(const ProfileScope&);
+    ProfileScope& operator=(const ProfileScope&);
+
+    const char* name;
+    double start;
+};
+
+}
+
+#define STF_PROFILE_JOIN2(a, b) a##b
+#define STF_PROFILE_JOIN(a, b) STF_PROFILE_JOIN2(a, b)
+
+#ifdef WITH_PROFILING
+//! Times the rest of the enclosing scope as region \e name.
+#define STF_PROFILE_SCOPE(name) stfio::ProfileScope STF_PROFILE_JOIN(stf_profile_scope_, __LINE__)(name)
+//! Increments counter \e name by \e n.
+#define STF_PROFILE_COUNT(name, n) stfio::profileCount(name, (long long)(n))
+#else
+#define STF_PROFILE_SCOPE(name)
+#define STF_PROFILE_COUNT(name, n)
+#endif
+
+/*@}*/
+
+#endif
@@ -15,10 +15,14 @@
 
 #include "./stfio.h"
 #include "./recording.h"
+#include "./scratch.h"
+#include "./parallel.h"
 
 #include <stdio.h>
 #include <ctime>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 
 Recording::Recording(void)
     : ChannelArray(0)
@@ -32,6 +36,15 @@ Recording::Recording(const Channel& c_Channel)
     init();
 }
 
+#if (__cplusplus >= 201103)
+Recording::Recording(Channel&& c_Channel)
+    : ChannelArray()
+{
+    ChannelArray.push_back(std::move(c_Channel));
+    init();
+}
+#endif
+
 Recording::Recording(const std::deque<Channel>& ChannelList)
     : ChannelArray(ChannelList)
 {
@@ -62,6 +75,10 @@ void Recording::init() {
     cs = 0;
     selectedSections = std::vector<std::size_t>(0);
     selectBase = Vector_double(0);
+    selectPos.clear();
+    selectStale = 0;
+    liveAverage = false;
+    selectAverage.clear();
 	sectionMarker = std::vector<int>(0);
 }
 
@@ -171,23 +188,43 @@ void Recording::SetDateTime(int year, int month, int mday,int hour, int minute,
 }
 
 void Recording::InsertChannel(Channel& c_Channel, std::size_t pos) {
-    try {
-        if ( ChannelArray.at(pos).size() <= c_Channel.size() ) {
-            ChannelArray.at(pos).resize( c_Channel.size() );
-        }
-        // Resize sections if necessary:
-        std::size_t n_sec = 0;
-        for ( sec_it sit = c_Channel.get().begin(); sit != c_Channel.get().end(); ++sit ) {
-            if ( ChannelArray.at(pos).at(n_sec).size() <= sit->size() ) {
-                ChannelArray.at(pos).at(n_sec).get_w().resize( sit->size() );
-            }
-            n_sec++;
+    // Assign directly; resizing the sections first would only
+    // allocate memory that is overwritten right away:
+    ChannelArray.at(pos) = c_Channel;
+}
+
+#if (__cplusplus >= 201103)
+void Recording::InsertChannel(Channel&& c_Channel, std::size_t pos) {
+    ChannelArray.at(pos) = std::move(c_Channel);
+}
+#endif
+
+RecordingView::RecordingView(const Recording& c_Recording)
+    : rec(&c_Recording), channels(c_Recording.size())
+{
+    for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+        channels[n_c] = n_c;
+    }
+}
+
+RecordingView::RecordingView(const Recording& c_Recording, const std::vector<std::size_t>& channels_)
+    : rec(&c_Recording), channels(channels_)
+{
+    for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+        if (channels[n_c] >= rec->size()) {
+            throw std::out_of_range("Channel index out of range in RecordingView::RecordingView()");
         }
     }
-    catch (...) {
-        throw;
+}
+
+Recording RecordingView::Copy() const {
+    Recording copy(size());
+    copy.CopyAttributes(*rec);
+    copy.SetXUnits(rec->GetXUnits());
+    for (std::size_t n_c = 0; n_c < size(); ++n_c) {
+        copy[n_c] = (*this)[n_c];
     }
-    ChannelArray.at(pos) = c_Channel;
+    return copy;
 }
 
 void Recording::CopyAttributes(const Recording& c_Recording) {
@@ -238,65 +275,187 @@ void Recording::SetCurSecIndex( size_t value ) {
     cs=value;
 }
 
-void Recording::SelectTrace(std::size_t sectionToSelect, std::size_t base_start, std::size_t base_end) {
+namespace {
+    // Marks entries of unselected sections and sections that aren't selected:
+    const std::size_t unselected = std::size_t(-1);
+}
+
+double Recording::SelectionBase(std::size_t section, std::size_t base_start, std::size_t base_end) const {
+    // read-only access, so that compactly stored samples aren't decoded:
+    const Section& sec = ChannelArray[cc][section];
+    if (sec.size()==0) {
+        return 0;
+    }
+    int start = base_start;
+    int end = base_end;
+    if (start > (int)sec.size()-1)
+        start = sec.size()-1;
+    if (start < 0) start = 0;
+    if (end > (int)sec.size()-1)
+        end = sec.size()-1;
+    if (end < 0) end = 0;
+    double sumY=0;
+    for (int i=start; i<=end; i++) {
+        sumY += sec[i];
+    }
+    int n=(int)(end-start+1);
+    return sumY/n;
+}
+
+bool Recording::SelectTrace(std::size_t sectionToSelect, std::size_t base_start, std::size_t base_end) {
     // Check range so that sectionToSelect can be used
     // without checking again:
     if (sectionToSelect>=curch().size()) {
         std::out_of_range e("subscript out of range in Recording::SelectTrace\n");
         throw e;
     }
+    if (IsSelected(sectionToSelect)) {
+        return false;
+    }
+    if (selectPos.size() <= sectionToSelect) {
+        selectPos.resize(sectionToSelect+1, unselected);
+    }
+    selectPos[sectionToSelect] = selectedSections.size();
     selectedSections.push_back(sectionToSelect);
-    double sumY=0;
-    if (curch()[sectionToSelect].size()==0) {
-        selectBase.push_back(0);
-    } else {
-        int start = base_start;
-        int end = base_end;
-        if (start > (int)curch()[sectionToSelect].size()-1)
-            start = curch()[sectionToSelect].size()-1;
-        if (start < 0) start = 0;
-        if (end > (int)curch()[sectionToSelect].size()-1)
-            end = curch()[sectionToSelect].size()-1;
-        if (end < 0) end = 0;
+    selectBase.push_back(SelectionBase(sectionToSelect, base_start, base_end));
+    if (liveAverage) {
+        selectAverage.resize(ChannelArray.size());
+        for (std::size_t n_c = 0; n_c < ChannelArray.size(); ++n_c) {
+            if (sectionToSelect < ChannelArray[n_c].size()) {
+                selectAverage[n_c].Add(ChannelArray[n_c][sectionToSelect]);
+            }
+        }
+    }
+    return true;
+}
+
+std::size_t Recording::SelectTraces(const std::vector<std::size_t>& sectionsToSelect,
+                                    std::size_t base_start, std::size_t base_end)
+{
+    for (std::size_t n = 0; n < sectionsToSelect.size(); ++n) {
+        if (sectionsToSelect[n]>=curch().size()) {
+            std::out_of_range e("subscript out of range in Recording::SelectTraces\n");
+            throw e;
+        }
+    }
+    if (selectPos.size() < curch().size()) {
+        selectPos.resize(curch().size(), unselected);
+    }
+    std::size_t first = selectedSections.size();
+    for (std::size_t n = 0; n < sectionsToSelect.size(); ++n) {
+        if (!IsSelected(sectionsToSelect[n])) {
+            selectPos[sectionsToSelect[n]] = selectedSections.size();
+            selectedSections.push_back(sectionsToSelect[n]);
+        }
+    }
+    // the baselines are independent of each other:
+    selectBase.resize(selectedSections.size());
+    int n_new = (int)(selectedSections.size() - first);
 #ifdef _OPENMP
-#pragma omp parallel for reduction(+:sumY)
+#pragma omp parallel for num_threads(stfio::threadCount(0, n_new))
 #endif
-        for (int i=start; i<=end; i++) {
-            sumY += curch()[sectionToSelect][i];
+    for (int n = 0; n < n_new; ++n) {
+        selectBase[first+n] = SelectionBase(selectedSections[first+n], base_start, base_end);
+    }
+    if (liveAverage) {
+        selectAverage.resize(ChannelArray.size());
+        for (std::size_t n_c = 0; n_c < ChannelArray.size(); ++n_c) {
+            for (std::size_t n = first; n < selectedSections.size(); ++n) {
+                if (selectedSections[n] < ChannelArray[n_c].size()) {
+                    selectAverage[n_c].Add(ChannelArray[n_c][selectedSections[n]]);
+                }
+            }
         }
-        int n=(int)(end-start+1);
-        selectBase.push_back(sumY/n);
     }
+    return n_new;
 }
 
 bool Recording::UnselectTrace(std::size_t sectionToUnselect) {
+    if (!IsSelected(sectionToUnselect)) {
+        return false;
+    }
+    // Mark the entry instead of shifting all following ones, so that
+    // unselecting many sections in a row takes linear time:
+    selectedSections[selectPos[sectionToUnselect]] = unselected;
+    selectPos[sectionToUnselect] = unselected;
+    ++selectStale;
+    if (liveAverage) {
+        for (std::size_t n_c = 0; n_c < selectAverage.size() && n_c < ChannelArray.size(); ++n_c) {
+            if (sectionToUnselect < ChannelArray[n_c].size() && selectAverage[n_c].GetN() > 0) {
+                selectAverage[n_c].Remove(ChannelArray[n_c][sectionToUnselect]);
+            }
+        }
+    }
+    return true;
+}
 
-    //verify whether the trace has really been selected and find the 
-    //number of the trace within the selectedTraces array:
-    bool traceSelected=false;
-    std::size_t traceToRemove=0;
-    for (std::size_t n=0; n < selectedSections.size() && !traceSelected; ++n) { 
-        if (selectedSections[n] == sectionToUnselect) traceSelected=true;
-        if (traceSelected) traceToRemove=n;
-    }
-    //Shift the selectedTraces array by one position, beginning
-    //with the trace to remove: 
-    if (traceSelected) {
-        //shift traces by one position:
-        for (std::size_t k=traceToRemove; k < GetSelectedSections().size()-1; ++k) { 
-            selectedSections[k]=selectedSections[k+1];
-            selectBase[k]=selectBase[k+1];
+void Recording::CompactSelection() const {
+    if (selectStale == 0) {
+        return;
+    }
+    std::size_t n_kept = 0;
+    for (std::size_t n = 0; n < selectedSections.size(); ++n) {
+        if (selectedSections[n] != unselected) {
+            selectedSections[n_kept] = selectedSections[n];
+            selectBase[n_kept] = selectBase[n];
+            selectPos[selectedSections[n_kept]] = n_kept;
+            ++n_kept;
+        }
+    }
+    selectedSections.resize(n_kept);
+    selectBase.resize(n_kept);
+    selectStale = 0;
+}
+
+void Recording::ClearSelection() {
+    selectedSections.clear();
+    selectBase.clear();
+    selectPos.clear();
+    selectStale = 0;
+    for (std::size_t n_c = 0; n_c < selectAverage.size(); ++n_c) {
+        selectAverage[n_c].Clear();
+    }
+}
+
+void Recording::InvertSelection(std::size_t base_start, std::size_t base_end) {
+    std::vector<std::size_t> inverted;
+    inverted.reserve(curch().size());
+    for (std::size_t n = 0; n < curch().size(); ++n) {
+        if (!IsSelected(n)) {
+            inverted.push_back(n);
+        }
+    }
+    ClearSelection();
+    SelectTraces(inverted, base_start, base_end);
+}
+
+void Recording::SetLiveAverage(bool enable) {
+    liveAverage = enable;
+    selectAverage.clear();
+    if (!enable) {
+        return;
+    }
+    CompactSelection();
+    selectAverage.resize(ChannelArray.size());
+    for (std::size_t n_c = 0; n_c < ChannelArray.size(); ++n_c) {
+        for (std::size_t n = 0; n < selectedSections.size(); ++n) {
+            if (selectedSections[n] < ChannelArray[n_c].size()) {
+                selectAverage[n_c].Add(ChannelArray[n_c][selectedSections[n]]);
+            }
         }
-        // resize vectors:
-        selectedSections.resize(selectedSections.size()-1);
-        selectBase.resize(selectBase.size()-1);
-        return true;
-    } else {
-        //msgbox
-        return false;
     }
 }
 
+const AverageAccumulator& Recording::GetLiveAverage(std::size_t channel) const {
+    if (!liveAverage) {
+        throw std::out_of_range("Running average is disabled in Recording::GetLiveAverage");
+    }
+    if (channel >= selectAverage.size()) {
+        throw std::out_of_range("Channel number out of range in Recording::GetLiveAverage");
+    }
+    return selectAverage[channel];
+}
+
 void Recording::SetXScale(double value) {
     dt=value;
     for (ch_it it1 = ChannelArray.begin(); it1 != ChannelArray.end(); it1++) {
@@ -306,17 +465,36 @@ void Recording::SetXScale(double value) {
     }
 }
 
+namespace {
+    // Number of data points that are averaged at once:
+    const std::size_t averageBlockSize = 4096;
+}
+
 void Recording::MakeAverage(Section& AverageReturn,
         Section& SigReturn,
         std::size_t channel,
         const std::vector<std::size_t>& section_index,
         bool isSig,
         const std::vector<int>& shift) const
+{
+    MakeAverage(AverageReturn, SigReturn, channel, section_index, isSig,
+                Vector_double(shift.begin(), shift.end()));
+}
+
+void Recording::MakeAverage(Section& AverageReturn,
+        Section& SigReturn,
+        std::size_t channel,
+        const std::vector<std::size_t>& section_index,
+        bool isSig,
+        const Vector_double& shift) const
 {
     if (channel >= ChannelArray.size()) {
         throw std::out_of_range("Channel number out of range in Recording::MakeAverage");
     }
     unsigned int n_sections = section_index.size();
+    if (n_sections == 0) {
+        throw std::out_of_range("No sections in Recording::MakeAverage");
+    }
     if (shift.size() != n_sections) {
         throw std::out_of_range("Shift out of range in Recording::MakeAverage");
     }
@@ -324,46 +502,150 @@ void Recording::MakeAverage(Section& AverageReturn,
         if (section_index[l] >= ChannelArray[channel].size()) {
             throw std::out_of_range("Section number out of range in Recording::MakeAverage");
         }
-        if (AverageReturn.size() + shift[l] > ChannelArray[channel][section_index[l]].size()) {
+        if (!(shift[l] >= 0) ||
+            AverageReturn.size() + shift[l] > ChannelArray[channel][section_index[l]].size()) {
             throw std::out_of_range("Sampling point out of range in Recording::MakeAverage");
         }
     }
 
-    for (unsigned int k=0; k < AverageReturn.size(); ++k) {
-        AverageReturn[k]=0.0;
-        //Calculate average
+    // set sample interval of averaged traces
+    AverageReturn.SetXScale(ChannelArray[channel][section_index[0]].GetXScale());
+
+    // The data points are processed in blocks that are distributed among
+    // threads. Each section is read contiguously while the running means
+    // and variances of the block stay in cache; these are updated in a
+    // single pass using Welford's algorithm.
+    const Channel& ch = ChannelArray[channel];
+    std::size_t n_points = AverageReturn.size();
+    double* mean = n_points ? &AverageReturn.get_w()[0] : NULL;
+    double* m2 = (isSig && n_points) ? &SigReturn.get_w()[0] : NULL;
+    int n_blocks = (int)((n_points + averageBlockSize - 1) / averageBlockSize);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(stfio::threadCount(0, n_blocks))
+#endif
+    for (int b = 0; b < n_blocks; ++b) {
+        std::size_t begin = b*averageBlockSize;
+        std::size_t len = std::min(averageBlockSize, n_points-begin);
+        double* bmean = mean + begin;
+        double* bm2 = m2 ? m2 + begin : NULL;
+        std::fill(bmean, bmean+len, 0.0);
+        if (isSig) {
+            std::fill(bm2, bm2+len, 0.0);
+        }
+        stfio::ScratchScope scratch;
+        double* buffer = NULL;
         for (unsigned int l = 0; l < n_sections; ++l) {
-            AverageReturn[k] += 
-                ChannelArray[channel][section_index[l]][k+shift[l]];
+            const Section& sec = ch[section_index[l]];
+            // read data points in memory in place, decode only this block otherwise;
+            // fractional shifts are interpolated:
+            std::size_t first = (std::size_t)shift[l];
+            const double* x = first == shift[l] ? sec.GetSpan() : NULL;
+            if (x != NULL) {
+                x += begin+first;
+            } else {
+                if (buffer == NULL) {
+                    buffer = scratch.Doubles(len);
+                }
+                if (first == shift[l]) {
+                    sec.CopyRange(begin+first, begin+first+len, buffer);
+                } else {
+                    sec.CopyInterpolated(begin+shift[l], len, buffer);
+                }
+                x = buffer;
+            }
+            if (isSig) {
+                double rn = 1.0 / (l+1);
+                for (std::size_t k = 0; k < len; ++k) {
+                    double delta = x[k] - bmean[k];
+                    bmean[k] += delta * rn;
+                    bm2[k] += delta * (x[k] - bmean[k]);
+                }
+            } else {
+                for (std::size_t k = 0; k < len; ++k) {
+                    bmean[k] += x[k];
+                }
+            }
         }
-        AverageReturn[k] /= n_sections;
-
-        // set sample interval of averaged traces
-        AverageReturn.SetXScale(ChannelArray[channel][section_index[0]].GetXScale());
-
         if (isSig) {
-            SigReturn[k]=0.0;
-            //Calculate variance
-            for (unsigned int l=0; l < n_sections; ++l) {
-                SigReturn[k] += 
-                    pow(ChannelArray[channel][section_index[l]][k+shift[l]] -
-                            AverageReturn[k], 2);
+            for (std::size_t k = 0; k < len; ++k) {
+                bm2[k] = sqrt(bm2[k] / (n_sections - 1));
+            }
+        } else {
+            for (std::size_t k = 0; k < len; ++k) {
+                bmean[k] /= n_sections;
             }
-            SigReturn[k] /= (n_sections - 1);
-            SigReturn[k]=sqrt(SigReturn[k]);
         }
     }
 }
 
-void Recording::AddRec(const Recording &toAdd) {
-    // check number of channels:
-    if (toAdd.size()!=size()) {
-        throw std::runtime_error("Number of channels doesn't match");
+Channel Recording::MakePoverN(std::size_t channel, int n) const {
+    if (channel >= ChannelArray.size()) {
+        throw std::out_of_range("Channel number out of range in Recording::MakePoverN");
     }
-    // check dt:
-    if (toAdd.GetXScale()!=dt) {
-        throw std::runtime_error("Sampling interval doesn't match");
+    const Channel& ch = ChannelArray[channel];
+    int n_leak = n < 0 ? -n : n;
+    double direction = n < 0 ? -1.0 : 1.0;
+    int n_groups = n_leak > 0 ? (int)ch.size()/(n_leak+1) : 0;
+    if (n_groups < 1) {
+        throw std::out_of_range("Not enough traces for P/n correction");
+    }
+    for (int g = 0; g < n_groups; ++g) {
+        for (int l = 1; l <= n_leak; ++l) {
+            if (ch[g*(n_leak+1)+l].size() < ch[g*(n_leak+1)].size()) {
+                throw std::out_of_range("Leak pulse shorter than test pulse in Recording::MakePoverN");
+            }
+        }
+    }
+
+    Channel result(n_groups);
+    // Each group is processed by a single thread, block by block, so that
+    // the leak sum stays in cache while the sections are read contiguously:
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(stfio::threadCount(0, n_groups))
+#endif
+    for (int g = 0; g < n_groups; ++g) {
+        const Section& test = ch[g*(n_leak+1)];
+        std::size_t n_points = test.size();
+        Section& corrected = result[g];
+        corrected.get_w().resize(n_points);
+        corrected.SetXScale(test.GetXScale());
+        double* out = n_points ? &corrected.get_w()[0] : NULL;
+        stfio::ScratchScope scratch;
+        double* buffer = scratch.Doubles(std::min(averageBlockSize, n_points));
+        for (std::size_t begin = 0; begin < n_points; begin += averageBlockSize) {
+            std::size_t len = std::min(averageBlockSize, n_points-begin);
+            double* bout = out + begin;
+            std::fill(bout, bout+len, 0.0);
+            for (int l = 1; l <= n_leak; ++l) {
+                const Section& leak = ch[g*(n_leak+1)+l];
+                const double* x = leak.GetSpan();
+                if (x != NULL) {
+                    x += begin;
+                } else {
+                    leak.CopyRange(begin, begin+len, buffer);
+                    x = buffer;
+                }
+                for (std::size_t k = 0; k < len; ++k) {
+                    bout[k] += x[k];
+                }
+            }
+            const double* p = test.GetSpan();
+            if (p != NULL) {
+                p += begin;
+            } else {
+                test.CopyRange(begin, begin+len, buffer);
+                p = buffer;
+            }
+            for (std::size_t k = 0; k < len; ++k) {
+                bout[k] = p[k] - bout[k]*direction;
+            }
+        }
     }
+    return result;
+}
+
+void Recording::AddRec(const Recording &toAdd) {
+    CheckAddRec(toAdd);
     // add sections:
     std::deque< Channel >::iterator it;
     std::size_t n_c = 0;
@@ -382,6 +664,31 @@ void Recording::AddRec(const Recording &toAdd) {
     }
 }
 
+#if (__cplusplus >= 201103)
+void Recording::AddRec(Recording&& toAdd) {
+    CheckAddRec(toAdd);
+    for (std::size_t n_c = 0; n_c < size(); ++n_c) {
+        std::size_t old_size = ChannelArray[n_c].size();
+        ChannelArray[n_c].resize(toAdd[n_c].size()+old_size);
+        for (std::size_t n_s=0; n_s < toAdd[n_c].size(); ++n_s) {
+            ChannelArray[n_c].InsertSection(std::move(toAdd[n_c][n_s]), old_size+n_s);
+        }
+        toAdd[n_c].resize(0);
+    }
+}
+#endif
+
+void Recording::CheckAddRec(const Recording& toAdd) const {
+    // check number of channels:
+    if (toAdd.size()!=size()) {
+        throw std::runtime_error("Number of channels doesn't match");
+    }
+    // check dt:
+    if (toAdd.GetXScale()!=dt) {
+        throw std::runtime_error("Sampling interval doesn't match");
+    }
+}
+
 
 std::string Recording::GetEventDescription(int type) {
     return listOfMarkers[type];
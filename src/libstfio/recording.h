@@ -28,6 +28,7 @@
 #include <string.h>	// declaration of memcpy
 
 #include "./channel.h"
+#include "./accumulator.h"
 // #include "./section.h"
 // #include "./stfio.h"
 
@@ -50,6 +51,13 @@ class StfioDll Recording {
      */
     explicit Recording(const Channel& c_Channel); 
 
+#if (__cplusplus >= 201103)
+    //! Constructor that takes over the sections of a channel without copying them.
+    /*! \param c_Channel The Channel from which to construct a new Recording; empty on return.
+     */
+    explicit Recording(Channel&& c_Channel);
+#endif
+
     //! Constructor
     /*! \param ChannelList A vector of channels from which to construct a new Recording.
      */
@@ -67,6 +75,20 @@ class StfioDll Recording {
     //! Destructor
     virtual ~Recording();
 
+#if (__cplusplus >= 201103)
+    //! Copy constructor
+    Recording(const Recording&) = default;
+
+    //! Move constructor; leaves \e c_Recording without channels.
+    Recording(Recording&& c_Recording) = default;
+
+    //! Copy assignment
+    Recording& operator=(const Recording&) = default;
+
+    //! Move assignment; leaves \e c_Recording without channels.
+    Recording& operator=(Recording&& c_Recording) = default;
+#endif
+
     //member access functions: read-----------------------------------
     
     //! Retrieves the number of sections in a channel.
@@ -156,24 +178,54 @@ class StfioDll Recording {
     std::size_t GetCurSecIndex() const { return cs; }
     
     //! Retrieves the indices of the selected sections (read-only).
-    /*! \return A vector containing the indices of the selected sections.
-     */
-    const std::vector<std::size_t>& GetSelectedSections() const { return selectedSections; } 
-
-    //! Retrieves the indices of the selected sections (read and write).
-    /*! \return A vector containing the indices of the selected sections.
+    /*! \return A vector containing the indices of the selected sections,
+     *  in the order in which they were selected.
      */
-    std::vector<std::size_t>& GetSelectedSectionsW() { return selectedSections; } 
+    const std::vector<std::size_t>& GetSelectedSections() const { CompactSelection(); return selectedSections; } 
 
     //! Retrieves the stored baseline values of the selected sections (read-only).
     /*! \return A vector containing the stored baseline values of the selected sections.
      */
-    const Vector_double& GetSelectBase() const { return selectBase; } 
+    const Vector_double& GetSelectBase() const { CompactSelection(); return selectBase; } 
 
-    //! Retrieves the stored baseline values of the selected sections (read and write).
-    /*! \return A vector containing the stored baseline values of the selected sections.
+    //! Checks whether a section is selected.
+    /*! \param section The index of the section.
+     *  \return true if the section is selected, false otherwise.
+     */
+    bool IsSelected(std::size_t section) const {
+        return section < selectPos.size() && selectPos[section] != std::size_t(-1);
+    }
+
+    //! Unselects all sections.
+    void ClearSelection();
+
+    //! Selects every section of the active channel that isn't selected yet, and unselects all others.
+    /*! \param base_start Start index for baseline
+     *  \param base_end End index for baseline
+     */
+    void InvertSelection(std::size_t base_start, std::size_t base_end);
+
+    //! Enables or disables a running average of the selected sections.
+    /*! If enabled, SelectTrace() and UnselectTrace() update an average and
+     *  standard deviation of each channel in a single pass over the section.
+     *  Enabling the average computes it from the current selection.
+     *  \param enable true if the average should be kept up to date.
      */
-    Vector_double& GetSelectBaseW() { return selectBase; }
+    void SetLiveAverage(bool enable);
+
+    //! Checks whether a running average of the selected sections is kept.
+    /*! \return true if the average is kept up to date, false otherwise.
+     */
+    bool IsLiveAverage() const { return liveAverage; }
+
+    //! Retrieves the running average of the selected sections.
+    /*! Throws std::out_of_range if the running average is disabled or the
+     *  channel index is out of range. The average reflects the data at the time
+     *  the sections were selected.
+     *  \param channel The index of the channel.
+     *  \return The average of the selected sections of the channel.
+     */
+    const AverageAccumulator& GetLiveAverage(std::size_t channel) const;
 
     //! Retrieves the currently accessed section in the active channel (read-only)
     /*! \return The currently accessed section in the active channel.
@@ -310,6 +362,16 @@ class StfioDll Recording {
      */
     virtual void InsertChannel(Channel& c_Channel, std::size_t pos);
 
+#if (__cplusplus >= 201103)
+    //! Moves a Channel to a given position without copying its sections.
+    /*! Used by the file importers. Will throw std::out_of_range if range check fails.
+     *  Hidden by wxStfDoc, which has to be notified of new channels.
+     *  \param c_Channel The Channel to be inserted; empty on return.
+     *  \param pos The position at which to insert the channel (0-based).
+     */
+    void InsertChannel(Channel&& c_Channel, std::size_t pos);
+#endif
+
     //! Copy descriptive attributes from another Recording to this Recording.
     /*! This will copy the file and global section decription, the scaling, time, date, 
      *  comment and global y units strings and the x-scale.
@@ -335,20 +397,71 @@ class StfioDll Recording {
                       const std::vector<std::size_t>& section_index, bool isSig,
                       const std::vector<int>& shift) const;
 
+    //! Calculates an average of several traces that are shifted by fractions of a sampling interval.
+    /*! Data points between sampling points are interpolated linearly; sections
+     *  that are shifted by whole sampling points are read as by the function above.
+     *  Throws std::out_of_range if a shift is negative or if a shifted section
+     *  is shorter than the average.
+     *  \param shift The number of data points by which each section is shifted,
+     *         e.g. from stfnum::correlationLags(); see above for the other parameters.
+     */
+    void MakeAverage( Section& AverageReturn, Section& SigReturn, std::size_t channel,
+                      const std::vector<std::size_t>& section_index, bool isSig,
+                      const Vector_double& shift) const;
+
+    //! Subtracts leak currents with a P over N protocol.
+    /*! The sections of the channel are taken in groups of one test pulse
+     *  followed by |n| scaled leak pulses; incomplete groups at the end are
+     *  ignored. The sum of the leak pulses is subtracted from the test pulse if
+     *  \e n is positive, or added to it if the leak pulses have the opposite
+     *  polarity and \e n is negative. Groups are processed in parallel, in a
+     *  single pass over the data. Throws std::out_of_range if the channel index
+     *  is out of range, if there isn't a single complete group or if a leak
+     *  pulse is shorter than its test pulse.
+     *  \param channel The index of the channel to be used.
+     *  \param n Number of leak pulses per test pulse; mind the polarity.
+     *  \return A channel with one corrected section per group.
+     */
+    Channel MakePoverN(std::size_t channel, int n) const;
+
     //! Add a Recording at the end of this Recording.
     /*! \param toAdd The Recording to be added.
      */
     void AddRec(const Recording& toAdd);
 
+#if (__cplusplus >= 201103)
+    //! Moves the sections of a Recording to the end of this Recording.
+    /*! See AddRec() above; the channels of \e toAdd are empty on return.
+     */
+    void AddRec(Recording&& toAdd);
+#endif
+
     //! Selects a section
-    /*! \param sectionToSelect The index of the section to be selected.
+    /*! Throws std::out_of_range if the section doesn't exist in the active channel.
+     *  \param sectionToSelect The index of the section to be selected.
+     *  \param base_start Start index for baseline
+     *  \param base_end End index for baseline
+     *  \return true if the section has been selected, false if it was selected before.
+     */
+    bool SelectTrace(std::size_t sectionToSelect, std::size_t base_start, std::size_t base_end);
+
+    //! Selects several sections at once.
+    /*! Sections that are already selected are skipped, and the baselines
+     *  of the others are computed in parallel. Throws std::out_of_range
+     *  without selecting anything if one of the sections doesn't exist in
+     *  the active channel.
+     *  \param sectionsToSelect The indices of the sections to be selected.
      *  \param base_start Start index for baseline
      *  \param base_end End index for baseline
+     *  \return The number of sections that have been selected.
      */
-    void SelectTrace(std::size_t sectionToSelect, std::size_t base_start, std::size_t base_end);
+    std::size_t SelectTraces(const std::vector<std::size_t>& sectionsToSelect,
+                             std::size_t base_start, std::size_t base_end);
 
     //! Unselects a section if it was selected before
-    /*! \param sectionToUnselect The index of the section to be unselected.
+    /*! Takes constant time; the section is removed from the list of
+     *  selected sections the next time that list is read.
+     *  \param sectionToUnselect The index of the section to be unselected.
      *  \return true if the section was previously selected, false otherwise.
      */
     bool UnselectTrace(std::size_t sectionToUnselect);
@@ -406,10 +519,20 @@ class StfioDll Recording {
     // currently accessed section:
     std::size_t cs;
 
-    // Indices of the selected sections
-    std::vector<std::size_t> selectedSections;
+    // Indices of the selected sections, in the order of selection.
+    // UnselectTrace() only overwrites an entry with std::size_t(-1);
+    // CompactSelection() removes these entries before the list is read:
+    mutable std::vector<std::size_t> selectedSections;
     // Base line value for each selected trace
-    Vector_double selectBase;
+    mutable Vector_double selectBase;
+    // Position of each section in selectedSections, or std::size_t(-1)
+    // if the section isn't selected:
+    mutable std::vector<std::size_t> selectPos;
+    // Number of unselected entries that are left in selectedSections:
+    mutable std::size_t selectStale;
+    // Running average of the selected traces for each channel:
+    bool liveAverage;
+    std::vector<AverageAccumulator> selectAverage;
     
     // defined when data is loaded
     const char* listOfMarkers[256];
@@ -421,7 +544,93 @@ class StfioDll Recording {
 	std::vector<int> sectionMarker;
 
     void init();
+    // Removes the entries of unselected sections from selectedSections:
+    void CompactSelection() const;
+    // Average of a section of the active channel between base_start and base_end:
+    double SelectionBase(std::size_t section, std::size_t base_start, std::size_t base_end) const;
+    // Throws std::runtime_error if toAdd can't be added by AddRec():
+    void CheckAddRec(const Recording& toAdd) const;
+
+};
+
+//! A read-only view of selected channels of a Recording.
+/*! Exporters read the data through a view, so that channels can be
+ *  reordered or left out without copying the Recording. The view
+ *  refers to the Recording, which has to outlive it.
+ */
+class StfioDll RecordingView {
+ public:
+    //! Constructor. Shows all channels in their original order.
+    /*! Not explicit so that a Recording can be passed wherever a view is expected.
+     *  \param c_Recording The Recording to be shown.
+     */
+    RecordingView(const Recording& c_Recording);
+
+    //! Constructor. Shows the selected channels in the given order.
+    /*! Throws std::out_of_range if a channel doesn't exist.
+     *  \param c_Recording The Recording to be shown.
+     *  \param channels Indices of the channels in \e c_Recording.
+     */
+    RecordingView(const Recording& c_Recording, const std::vector<std::size_t>& channels);
+
+    //! Retrieves the number of channels in the view.
+    /*! \return The number of channels.
+     */
+    std::size_t size() const { return channels.size(); }
+
+    //! Unchecked channel access.
+    /*! \param at_ Index of the channel in the view.
+     *  \return The channel.
+     */
+    const Channel& operator[](std::size_t at_) const { return (*rec)[channels[at_]]; }
+
+    //! Range-checked channel access. Throws std::out_of_range if out of range.
+    /*! \param at_ Index of the channel in the view.
+     *  \return The channel.
+     */
+    const Channel& at(std::size_t at_) const { return rec->at(channels.at(at_)); }
+
+    //! Retrieves the number of sections in a channel.
+    /*! \param n_channel Index of the channel in the view.
+     *  \return The number of sections.
+     */
+    std::size_t GetChannelSize(std::size_t n_channel) const { return at(n_channel).size(); }
+
+    //! Retrieves the underlying Recording, e.g. for its metadata.
+    /*! \return The Recording.
+     */
+    const Recording& GetRecording() const { return *rec; }
+
+    //! Creates a Recording that contains copies of the channels in the view.
+    /*! Only needed by exporters that can't read a view.
+     *  \return The copy.
+     */
+    Recording Copy() const;
+
+    //! Retrieves the file description.
+    const std::string& GetFileDescription() const { return rec->GetFileDescription(); }
+
+    //! Retrieves the common section description.
+    const std::string& GetGlobalSectionDescription() const { return rec->GetGlobalSectionDescription(); }
+
+    //! Retrieves the scaling as a string.
+    const std::string& GetScaling() const { return rec->GetScaling(); }
+
+    //! Retrieves the date and time of recording.
+    struct tm GetDateTime() const { return rec->GetDateTime(); }
+
+    //! Retrieves the comment.
+    const std::string& GetComment() const { return rec->GetComment(); }
 
+    //! Retrieves the x units.
+    const std::string& GetXUnits() const { return rec->GetXUnits(); }
+
+    //! Retrieves the sampling interval.
+    double GetXScale() const { return rec->GetXScale(); }
+
+ private:
+    const Recording* rec;
+    std::vector<std::size_t> channels;
 };
 
 /*@}*/
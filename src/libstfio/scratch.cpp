@@ -0,0 +1,144 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file scratch.cpp
+ *  \brief Defines a thread-local arena for short-lived buffers of kernels.
+ */
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#include "./stfio.h"
+#include "./aligned.h"
+#include "./scratch.h"
+
+#ifdef _MSC_VER
+    #define STFIO_THREAD_LOCAL __declspec(thread)
+#else
+    #define STFIO_THREAD_LOCAL __thread
+#endif
+
+namespace {
+
+    // Size of the first block; later blocks double in size:
+    const std::size_t scratchMinBlock = 1024*1024;
+
+    struct Block {
+        char* data;
+        std::size_t size;
+    };
+
+    // Buffers are handed out from blocks[block], starting at offset. Blocks
+    // after the current one are empty and are reused before new ones are
+    // allocated.
+    struct Arena {
+        Arena() : blocks(), block(0), offset(0), depth(0) {}
+
+        void Release(std::size_t first) {
+            stfio::AlignedAllocator<char> allocator;
+            for (std::size_t n_b = first; n_b < blocks.size(); ++n_b) {
+                allocator.deallocate(blocks[n_b].data, blocks[n_b].size);
+            }
+            blocks.resize(std::min(first, blocks.size()));
+        }
+
+        std::size_t Capacity() const {
+            std::size_t capacity = 0;
+            for (std::size_t n_b = 0; n_b < blocks.size(); ++n_b) {
+                capacity += blocks[n_b].size;
+            }
+            return capacity;
+        }
+
+        std::vector<Block> blocks;
+        std::size_t block, offset;
+        int depth;
+    };
+
+    // Arenas are never deleted, like the buffers of the profiler; there's
+    // one per thread that has ever used a scope.
+    STFIO_THREAD_LOCAL Arena* threadArena = NULL;
+
+    Arena& currentArena() {
+        if (threadArena == NULL) {
+            threadArena = new Arena();
+        }
+        return *threadArena;
+    }
+}
+
+stfio::ScratchScope::ScratchScope() : block(0), offset(0) {
+    Arena& arena = currentArena();
+    block = arena.block;
+    offset = arena.offset;
+    ++arena.depth;
+}
+
+stfio::ScratchScope::~ScratchScope() {
+    Arena& arena = currentArena();
+    arena.block = block;
+    arena.offset = offset;
+    --arena.depth;
+    if (arena.depth == 0 && arena.Capacity() > scratchMaxRetained) {
+        arena.Release(1);
+    }
+}
+
+void* stfio::ScratchScope::Allocate(std::size_t n_bytes) {
+    if (n_bytes == 0) {
+        return NULL;
+    }
+    // keep every buffer aligned:
+    std::size_t size = (n_bytes + simdAlignment - 1) / simdAlignment * simdAlignment;
+    if (size < n_bytes) {
+        throw std::bad_alloc();
+    }
+    Arena& arena = currentArena();
+    while (arena.block < arena.blocks.size()) {
+        Block& current = arena.blocks[arena.block];
+        if (size <= current.size - arena.offset) {
+            void* p = current.data + arena.offset;
+            arena.offset += size;
+            return p;
+        }
+        if (arena.block + 1 == arena.blocks.size()) {
+            break;
+        }
+        ++arena.block;
+        arena.offset = 0;
+    }
+    // Blocks that follow the current one are empty, but too small; replace
+    // them by a block that is large enough:
+    std::size_t first = arena.blocks.empty() ? 0 : arena.block + (arena.offset > 0 ? 1 : 0);
+    arena.Release(first);
+    std::size_t block_size = arena.blocks.empty() ? scratchMinBlock : 2*arena.blocks.back().size;
+    block_size = std::max(block_size, size);
+    Block next;
+    next.data = stfio::AlignedAllocator<char>().allocate(block_size);
+    next.size = block_size;
+    arena.blocks.push_back(next);
+    arena.block = arena.blocks.size()-1;
+    arena.offset = size;
+    return next.data;
+}
+
+std::size_t stfio::scratchCapacity() {
+    return currentArena().Capacity();
+}
+
+void stfio::scratchTrim() {
+    Arena& arena = currentArena();
+    arena.Release(arena.offset > 0 ? arena.block + 1 : arena.block);
+}
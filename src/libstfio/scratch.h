@@ -0,0 +1,101 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file scratch.h
+ *  \brief Declares a thread-local arena for short-lived buffers of kernels.
+ *
+ *  Every thread owns an arena of large blocks. A stfio::ScratchScope hands
+ *  out buffers from the arena of its thread by advancing a pointer and
+ *  gives all of them back when it is destroyed, so that kernels that run
+ *  in many threads at once don't contend for the heap. Scopes may be
+ *  nested; the memory is kept for later scopes of the same thread.
+ */
+
+#ifndef _STFIO_SCRATCH_H
+#define _STFIO_SCRATCH_H
+
+#include <cstddef>
+
+#include "./stfio.h"
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Memory in bytes that an arena keeps once its outermost scope has ended.
+/*! Blocks beyond this size are released, so that a single large operation
+ *  doesn't hold on to its memory for the lifetime of the thread.
+ */
+const std::size_t scratchMaxRetained = 64*1024*1024;
+
+//! Hands out buffers from the arena of the calling thread.
+/*! Buffers are aligned to stfio::simdAlignment bytes and aren't initialised.
+ *  They stay valid until the scope is destroyed. A scope has to be created
+ *  and destroyed by the same thread, and scopes of a thread have to be
+ *  destroyed in the reverse order of their creation, which is what
+ *  automatic variables do. Only types that don't need a constructor or a
+ *  destructor should be placed in the buffers.
+ */
+class StfioDll ScratchScope {
+public:
+    //! Constructor. Marks the current fill level of the arena.
+    ScratchScope();
+
+    //! Destructor. Gives back all buffers that were handed out by this scope.
+    ~ScratchScope();
+
+    //! Retrieves an uninitialised buffer.
+    /*! Throws std::bad_alloc if the memory can't be allocated.
+     *  \param n_bytes Size of the buffer in bytes.
+     *  \return Pointer to the buffer; NULL if \e n_bytes is 0.
+     */
+    void* Allocate(std::size_t n_bytes);
+
+    //! Retrieves an uninitialised buffer of doubles.
+    /*! \param n Number of doubles.
+     *  \return Pointer to the first double; NULL if \e n is 0.
+     */
+    double* Doubles(std::size_t n) { return static_cast<double*>(Allocate(n*sizeof(double))); }
+
+    //! Retrieves an uninitialised array.
+    /*! \param n Number of elements.
+     *  \return Pointer to the first element; NULL if \e n is 0.
+     */
+    template <class T>
+    T* Array(std::size_t n) { return static_cast<T*>(Allocate(n*sizeof(T))); }
+
+private:
+    ScratchScope(const ScratchScope&);
+    ScratchScope& operator=(const ScratchScope&);
+
+    std::size_t block, offset;
+};
+
+//! Retrieves the memory that the arena of the calling thread holds.
+/*! \return The size of all blocks in bytes.
+ */
+StfioDll std::size_t scratchCapacity();
+
+//! Releases the blocks of the calling thread's arena that aren't in use.
+/*! Blocks that hold buffers of live scopes are kept.
+ */
+StfioDll void scratchTrim();
+
+}
+
+/*@}*/
+
+#endif
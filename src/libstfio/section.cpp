@@ -12,6 +12,8 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
+#include <algorithm>
+
 #include "./stfio.h"
 #include "./section.h"
 
@@ -21,15 +23,26 @@
 // within the constructor, see [1]248 and [2]28
 
 Section::Section(void)
-    : section_description(), x_scale(1.0), data(0)
+    : section_description(), x_scale(1.0), data(new Vector_double), samples(), mapped(false)
 {}
 
 Section::Section( const Vector_double& valA, const std::string& label )
-    : section_description(label), x_scale(1.0), data(valA)
+    : section_description(label), x_scale(1.0), data(new Vector_double(valA)), samples(), mapped(false)
+{}
+
+#if (__cplusplus >= 201103)
+Section::Section( Vector_double&& valA, const std::string& label )
+    : section_description(label), x_scale(1.0), data(new Vector_double(std::move(valA))),
+      samples(), mapped(false)
 {}
+#endif
 
 Section::Section(std::size_t size, const std::string& label)
-    : section_description(label), x_scale(1.0), data(size)
+    : section_description(label), x_scale(1.0), data(new Vector_double(size)), samples(), mapped(false)
+{}
+
+Section::Section(const stfio::MappedSamples& samples_, const std::string& label)
+    : section_description(label), x_scale(1.0), data(), samples(samples_), mapped(true)
 {}
 
 Section::~Section(void) {
@@ -37,19 +50,160 @@ Section::~Section(void) {
 
 
 double Section::at(std::size_t at_) const {
-    if (at_>=data.size()) {
+    if (at_>=size()) {
         std::out_of_range e("subscript out of range in class Section");
         throw (e);
     }
-    return data[at_];
+    return (*this)[at_];
 }
 
-double& Section::at(std::size_t at_) {
-    if (at_>=data.size()) {
+Section::Reference Section::at(std::size_t at_) {
+    if (at_>=size()) {
         std::out_of_range e("subscript out of range in class Section");
         throw (e);
     }
-    return data[at_];
+    return (*this)[at_];
+}
+
+stfio::DecodedSamples Section::Decoded() const {
+    stfio::DecodedSamples shared;
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_load)
+#endif
+    shared = decoded;
+    return shared;
+}
+
+const Vector_double& Section::Load() const {
+    stfio::DecodedSamples loaded = Decoded();
+    if (loaded) {
+        return *loaded;
+    }
+    // Decoded outside of the lock. The section stays mapped; the decoded
+    // samples are shared with other sections or released again when they're
+    // no longer needed:
+    if (samples.IsFileBacked() || samples.IsChained() || samples.IsDerived() || samples.IsShared()) {
+        loaded = samples.GetDecoded();
+    } else {
+        Vector_double* compact = new Vector_double(samples.size());
+        loaded.reset(compact);
+        if (!compact->empty()) {
+            samples.Decode(0, compact->size(), &(*compact)[0]);
+        }
+    }
+    // another thread may have decoded them in the meantime:
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_load)
+#endif
+    {
+        if (decoded) {
+            loaded = decoded;
+        } else {
+            decoded = loaded;
+        }
+    }
+    return *loaded;
+}
+
+stfio::DecodedSamples Section::GetDecoded() const {
+    if (!mapped) {
+        return stfio::DecodedSamples();
+    }
+    Load();
+    return Decoded();
+}
+
+void Section::Own() {
+    if (decoded) {
+        data.reset(new Vector_double(*decoded));
+    } else {
+        data.reset(new Vector_double(samples.size()));
+        if (!data->empty()) {
+            samples.Decode(0, data->size(), &(*data)[0]);
+        }
+    }
+    decoded.reset();
+    samples = stfio::MappedSamples();
+    mapped = false;
+}
+
+void Section::Unshare() {
+    if (mapped) {
+        Own();
+    } else if (!data) {
+        data.reset(new Vector_double);
+    } else {
+        data.reset(new Vector_double(*data));
+    }
+}
+
+const Vector_double& Section::Empty() {
+    static const Vector_double empty;
+    return empty;
+}
+
+stfio::MappedSamples Section::GetSamples() const {
+    if (mapped) {
+        return samples;
+    }
+    return stfio::MappedSamples(stfio::DecodedSamples(data));
+}
+
+void Section::Prepare() const {
+    if (mapped && (samples.IsFileBacked() || samples.IsChained() || samples.IsDerived() || samples.IsShared())) {
+        Load();
+    }
+    GetPyramid();
+}
+
+bool Section::SharesData(const Section& other) const {
+    if (mapped != other.mapped) {
+        return false;
+    }
+    return mapped ? samples.SameAs(other.samples) : data == other.data;
+}
+
+bool Section::AdoptCaches(const Section& prepared) {
+    if (!SharesData(prepared)) {
+        return false;
+    }
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_load)
+#endif
+    {
+        if (mapped && !decoded) {
+            decoded = prepared.decoded;
+        }
+        if (!pyramid) {
+            pyramid = prepared.pyramid;
+        }
+        if (!sums) {
+            sums = prepared.sums;
+        }
+    }
+    return true;
+}
+
+const double* Section::GetSpan() const {
+    if (!mapped) {
+        return (data && !data->empty()) ? &(*data)[0] : NULL;
+    }
+    stfio::DecodedSamples loaded = Decoded();
+    if (loaded && !loaded->empty()) {
+        return &(*loaded)[0];
+    }
+    return samples.GetInPlace();
+}
+
+const void* Section::GetNative(stfio::SampleType& type, double& scale, double& shift) const {
+    const double* span = GetSpan();
+    if (span != NULL) {
+        type = stfio::sample_float64;
+        scale = 1.0;
+        shift = 0.0;
+        return span;
+    }
+    return mapped ? samples.GetNative(type, scale, shift) : NULL;
 }
 
 void Section::SetXScale( double value ) {
@@ -58,3 +212,375 @@ void Section::SetXScale( double value ) {
     else
         throw std::runtime_error( "Attempt to set x-scale <= 0" );
 }
+
+const stfio::MinMaxPyramid& Section::GetPyramid() const {
+#if (__cplusplus < 201103)
+    boost::shared_ptr<const stfio::MinMaxPyramid> built;
+#else
+    std::shared_ptr<const stfio::MinMaxPyramid> built;
+#endif
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_load)
+#endif
+    built = pyramid;
+    if (built) {
+        return *built;
+    }
+    // built outside of the lock, like the decoded samples in Load():
+    if (IsMapped()) {
+        built.reset(new stfio::MinMaxPyramid(*this));
+    } else {
+        built.reset(new stfio::MinMaxPyramid(get()));
+    }
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_load)
+#endif
+    {
+        if (pyramid) {
+            built = pyramid;
+        } else {
+            pyramid = built;
+        }
+    }
+    return *built;
+}
+
+void Section::GetExtrema(std::size_t begin, std::size_t end, double& min, double& max) const {
+    if (begin>=end || end>size()) {
+        throw std::out_of_range("subscript out of range in Section::GetExtrema");
+    }
+    // the extrema of the whole section are kept by the pyramid, e.g. for
+    // scaling traces to the window on every repaint:
+    if (begin == 0 && end == size() && GetPyramid().Total(min, max)) {
+        return;
+    }
+    GetPyramid().Extrema(*this, begin, end, min, max);
+}
+
+void Section::Decimate(std::size_t begin, std::size_t end, std::size_t n_columns,
+                       std::vector<std::size_t>& columns, Vector_double& values) const
+{
+    if (begin>=end || end>size() || n_columns == 0) {
+        throw std::out_of_range("subscript out of range in Section::Decimate");
+    }
+    std::size_t len = end-begin;
+    columns.clear();
+    values.clear();
+    columns.reserve(4*std::min(n_columns, len));
+    values.reserve(4*std::min(n_columns, len));
+    std::size_t n = begin;
+    while (n < end) {
+        std::size_t col = (n-begin)*n_columns/len;
+        // first point of the next column:
+        std::size_t n_next = begin + ((col+1)*len + n_columns-1)/n_columns;
+        if (n_next > end) n_next = end;
+        if (n_next == n+1) {
+            columns.push_back(col);
+            values.push_back((*this)[n]);
+        } else {
+            double y_min, y_max;
+            GetExtrema(n, n_next, y_min, y_max);
+            columns.insert(columns.end(), 4, col);
+            values.push_back((*this)[n]);
+            values.push_back(y_min);
+            values.push_back(y_max);
+            values.push_back((*this)[n_next-1]);
+        }
+        n = n_next;
+    }
+}
+
+double Section::GetMean(std::size_t begin, std::size_t end, double& var) const {
+    if (begin>=end || end>size()) {
+        throw std::out_of_range("subscript out of range in Section::GetMean");
+    }
+#if (__cplusplus < 201103)
+    boost::shared_ptr<const stfio::PrefixSums> built;
+#else
+    std::shared_ptr<const stfio::PrefixSums> built;
+#endif
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_load)
+#endif
+    built = sums;
+    if (!built) {
+        built.reset(new stfio::PrefixSums(get()));
+#ifdef _OPENMP
+#pragma omp critical(stfio_section_load)
+#endif
+        {
+            if (sums) {
+                built = sums;
+            } else {
+                sums = built;
+            }
+        }
+    }
+    return built->Mean(begin, end, var);
+}
+
+void Section::CopyRange(std::size_t begin, std::size_t end, double* dest) const {
+    if (end > size() || begin > end) {
+        throw std::out_of_range("subscript out of range in Section::CopyRange");
+    }
+    stfio::DecodedSamples loaded = mapped ? Decoded() : stfio::DecodedSamples();
+    if (loaded) {
+        std::copy(loaded->begin()+begin, loaded->begin()+end, dest);
+    } else if (mapped) {
+        samples.Decode(begin, end, dest);
+    } else if (end > begin) {
+        std::copy(data->begin()+begin, data->begin()+end, dest);
+    }
+}
+
+void Section::CopyInterpolated(double begin, std::size_t n, double* dest) const {
+    if (!(begin >= 0) || (n > 0 && begin + (n-1) > (double)size()-1)) {
+        throw std::out_of_range("subscript out of range in Section::CopyInterpolated");
+    }
+    std::size_t first = (std::size_t)begin;
+    double frac = begin - first;
+    CopyRange(first, first+n, dest);
+    if (frac == 0 || n == 0) {
+        return;
+    }
+    // the point after the range; rounding may place it at the end:
+    double next = dest[n-1];
+    if (first+n < size()) {
+        CopyRange(first+n, first+n+1, &next);
+    }
+    for (std::size_t k = 0; k+1 < n; ++k) {
+        dest[k] += frac*(dest[k+1]-dest[k]);
+    }
+    dest[n-1] += frac*(next-dest[n-1]);
+}
+
+void Section::CopyRange(std::size_t begin, std::size_t end, float* dest) const {
+    if (end > size() || begin > end) {
+        throw std::out_of_range("subscript out of range in Section::CopyRange");
+    }
+    stfio::DecodedSamples loaded = mapped ? Decoded() : stfio::DecodedSamples();
+    if (loaded) {
+        std::copy(loaded->begin()+begin, loaded->begin()+end, dest);
+    } else if (mapped) {
+        samples.Decode(begin, end, dest);
+    } else if (end > begin) {
+        std::copy(data->begin()+begin, data->begin()+end, dest);
+    }
+}
+
+namespace {
+
+// Combines n minima and n maxima; both are NaN if any of them is NaN:
+void blockExtrema(const double* mins, const double* maxs, std::size_t n, double& min, double& max) {
+    min = mins[0];
+    max = maxs[0];
+    for (std::size_t k=0; k < n; ++k) {
+        if (mins[k] != mins[k] || maxs[k] != maxs[k]) {
+            min = max = mins[k] != mins[k] ? mins[k] : maxs[k];
+            return;
+        }
+        if (mins[k] < min) min = mins[k];
+        if (maxs[k] > max) max = maxs[k];
+    }
+}
+
+}
+
+stfio::MinMaxPyramid::MinMaxPyramid(const Vector_double& data)
+    : mins(0), maxs(0), partial(0), n_points(0), total_min(0), total_max(0)
+{
+    if (!data.empty()) {
+        Accumulate(&data[0], data.size());
+    }
+    // lowest level from the data:
+    std::size_t n_blocks = data.size() / blockSize(0);
+    partial.assign(data.begin() + n_blocks*blockSize(0), data.end());
+    if (n_blocks == 0) {
+        return;
+    }
+    mins.push_back(Vector_double(n_blocks));
+    maxs.push_back(Vector_double(n_blocks));
+    for (std::size_t n_b=0; n_b < n_blocks; ++n_b) {
+        blockExtrema(&data[n_b*blockSize(0)], &data[n_b*blockSize(0)], blockSize(0),
+                     mins[0][n_b], maxs[0][n_b]);
+    }
+    Build();
+}
+
+stfio::MinMaxPyramid::MinMaxPyramid(const Section& section)
+    : mins(0), maxs(0), partial(section.size() % blockSize(0)), n_points(0), total_min(0), total_max(0)
+{
+    std::size_t n_blocks = section.size() / blockSize(0);
+    if (n_blocks == 0) {
+        if (!partial.empty()) {
+            section.CopyRange(0, section.size(), &partial[0]);
+            Accumulate(&partial[0], partial.size());
+        }
+        return;
+    }
+    mins.push_back(Vector_double(n_blocks));
+    maxs.push_back(Vector_double(n_blocks));
+    // decode some thousand blocks at a time:
+    const std::size_t chunkBlocks = 4096;
+    Vector_double buffer(std::min(n_blocks, chunkBlocks)*blockSize(0));
+    for (std::size_t n_c=0; n_c < n_blocks; n_c += chunkBlocks) {
+        std::size_t n_end = std::min(n_blocks, n_c+chunkBlocks);
+        section.CopyRange(n_c*blockSize(0), n_end*blockSize(0), &buffer[0]);
+        for (std::size_t n_b=n_c; n_b < n_end; ++n_b) {
+            const double* first = &buffer[(n_b-n_c)*blockSize(0)];
+            blockExtrema(first, first, blockSize(0), mins[0][n_b], maxs[0][n_b]);
+        }
+        Accumulate(&buffer[0], (n_end-n_c)*blockSize(0));
+    }
+    if (!partial.empty()) {
+        section.CopyRange(n_blocks*blockSize(0), section.size(), &partial[0]);
+        Accumulate(&partial[0], partial.size());
+    }
+    Build();
+}
+
+void stfio::MinMaxPyramid::Build() {
+    // each higher level combines 4 blocks of the one below:
+    while (mins.back().size() >= 8) {
+        const Vector_double& lmin = mins.back();
+        const Vector_double& lmax = maxs.back();
+        std::size_t n_blocks = lmin.size() / 4;
+        Vector_double hmin(n_blocks), hmax(n_blocks);
+        for (std::size_t n_b=0; n_b < n_blocks; ++n_b) {
+            blockExtrema(&lmin[4*n_b], &lmax[4*n_b], 4, hmin[n_b], hmax[n_b]);
+        }
+        mins.push_back(hmin);
+        maxs.push_back(hmax);
+    }
+}
+
+void stfio::MinMaxPyramid::Accumulate(const double* data, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    // comparisons with NaN fail, so that NaN is ignored unless it's the first point:
+    if (n_points == 0) {
+        total_min = total_max = data[0];
+    }
+    for (std::size_t n=0; n < size; ++n) {
+        if (data[n] < total_min) total_min = data[n];
+        if (data[n] > total_max) total_max = data[n];
+    }
+    n_points += size;
+}
+
+void stfio::MinMaxPyramid::Extend(const double* data, std::size_t size) {
+    Accumulate(data, size);
+    // complete blocks of level 0, starting with the pending points:
+    Vector_double lmin, lmax;
+    std::size_t pos = 0;
+    if (!partial.empty()) {
+        pos = std::min(size, blockSize(0) - partial.size());
+        partial.insert(partial.end(), data, data+pos);
+        if (partial.size() < blockSize(0)) {
+            return;
+        }
+        lmin.push_back(0);
+        lmax.push_back(0);
+        blockExtrema(&partial[0], &partial[0], blockSize(0), lmin.back(), lmax.back());
+        partial.clear();
+    }
+    for (; pos + blockSize(0) <= size; pos += blockSize(0)) {
+        lmin.push_back(0);
+        lmax.push_back(0);
+        blockExtrema(data+pos, data+pos, blockSize(0), lmin.back(), lmax.back());
+    }
+    partial.insert(partial.end(), data+pos, data+size);
+    if (lmin.empty()) {
+        return;
+    }
+    if (mins.empty()) {
+        mins.push_back(Vector_double());
+        maxs.push_back(Vector_double());
+    }
+    mins[0].insert(mins[0].end(), lmin.begin(), lmin.end());
+    maxs[0].insert(maxs[0].end(), lmax.begin(), lmax.end());
+    // higher levels as in Build(), from the blocks they don't hold yet:
+    for (std::size_t level = 1; mins[level-1].size() >= 8 || level < mins.size(); ++level) {
+        if (level == mins.size()) {
+            mins.push_back(Vector_double());
+            maxs.push_back(Vector_double());
+        }
+        std::size_t n_blocks = mins[level-1].size() / 4;
+        for (std::size_t n_b = mins[level].size(); n_b < n_blocks; ++n_b) {
+            double min = 0, max = 0;
+            blockExtrema(&mins[level-1][4*n_b], &maxs[level-1][4*n_b], 4, min, max);
+            mins[level].push_back(min);
+            maxs[level].push_back(max);
+        }
+    }
+}
+
+template <class Data>
+void stfio::MinMaxPyramid::FindExtrema(const Data& data, std::size_t begin, std::size_t end,
+                                       double& min, double& max) const
+{
+    min = data[begin];
+    max = data[begin];
+    std::size_t pos = begin;
+    while (pos < end) {
+        // use the largest aligned block that fits into the rest of the range:
+        int level = (int)mins.size()-1;
+        for (; level >= 0; --level) {
+            if (pos % blockSize(level) == 0 && pos + blockSize(level) <= end) {
+                break;
+            }
+        }
+        if (level < 0) {
+            if (data[pos] < min) min = data[pos];
+            if (data[pos] > max) max = data[pos];
+            ++pos;
+        } else {
+            std::size_t n_b = pos / blockSize(level);
+            if (mins[level][n_b] < min) min = mins[level][n_b];
+            if (maxs[level][n_b] > max) max = maxs[level][n_b];
+            pos += blockSize(level);
+        }
+    }
+}
+
+void stfio::MinMaxPyramid::Extrema(const Vector_double& data, std::size_t begin, std::size_t end,
+                                   double& min, double& max) const
+{
+    FindExtrema(data, begin, end, min, max);
+}
+
+void stfio::MinMaxPyramid::Extrema(const Section& section, std::size_t begin, std::size_t end,
+                                   double& min, double& max) const
+{
+    FindExtrema(section, begin, end, min, max);
+}
+
+stfio::PrefixSums::PrefixSums(const Vector_double& data)
+    : offset(0.0), sums(data.size()+1), sqsums(data.size()+1)
+{
+    if (data.empty()) {
+        return;
+    }
+    for (std::size_t n=0; n < data.size(); ++n) {
+        offset += data[n];
+    }
+    offset /= data.size();
+    sums[0] = 0.0;
+    sqsums[0] = 0.0;
+    for (std::size_t n=0; n < data.size(); ++n) {
+        double diff = data[n]-offset;
+        sums[n+1] = sums[n] + diff;
+        sqsums[n+1] = sqsums[n] + diff*diff;
+    }
+}
+
+double stfio::PrefixSums::Mean(std::size_t begin, std::size_t end, double& var) const
+{
+    double n = (double)(end-begin);
+    double sum = sums[end]-sums[begin];
+    double sqsum = sqsums[end]-sqsums[begin];
+    // rounding errors mustn't give negative variances:
+    var = n > 1 ? std::max(sqsum-sum*sum/n, 0.0)/(n-1) : 0.0;
+    return offset + sum/n;
+}
@@ -27,11 +27,164 @@
 #ifndef _SECTION_H
 #define _SECTION_H
 
+#include "./mappedfile.h"
+
+class Section;
+
 /*! \addtogroup stfgen
  *  @{
  */
 
+namespace stfio {
+
+//! Minima and maxima of a data array over aligned blocks of increasing size.
+/*! Used to find the extrema of arbitrary ranges in logarithmic rather
+ *  than linear time, e.g. for drawing long traces, and to skip blocks
+ *  that can't contain a level crossing. Both extrema of a block that
+ *  contains NaN are NaN, so that such blocks are never skipped.
+ */
+class StfioDll MinMaxPyramid {
+public:
+    //! Default constructor. Creates a pyramid of an empty data array.
+    MinMaxPyramid() : mins(0), maxs(0), partial(0), n_points(0), total_min(0), total_max(0) {}
+
+    //! Constructor
+    /*! \param data The data array.
+     */
+    explicit MinMaxPyramid(const Vector_double& data);
+
+    //! Constructor that reads the data range by range.
+    /*! Samples that haven't been decoded yet aren't decoded as a whole.
+     *  \param section The section.
+     */
+    explicit MinMaxPyramid(const Section& section);
+
+    //! Finds the extrema of a range.
+    /*! \param data The data array that was used for construction.
+     *  \param begin Index of the first data point.
+     *  \param end Index past the last data point; has to be > \e begin.
+     *  \param min On exit, the minimum within the range.
+     *  \param max On exit, the maximum within the range.
+     */
+    void Extrema(const Vector_double& data, std::size_t begin, std::size_t end,
+                 double& min, double& max) const;
+
+    //! Finds the extrema of a range of a section.
+    /*! See Extrema() above for a description of the parameters.
+     */
+    void Extrema(const Section& section, std::size_t begin, std::size_t end,
+                 double& min, double& max) const;
+
+    //! Adds data points that have been appended to the data array.
+    /*! Only the blocks that are completed by the new points are computed,
+     *  so that a pyramid of a growing array takes amortized constant time
+     *  per data point; the result is the same as that of a pyramid of the
+     *  whole array.
+     *  \param data The data points that follow the last point passed to
+     *         the constructor or to Extend().
+     *  \param size The number of data points.
+     */
+    void Extend(const double* data, std::size_t size);
+
+    //! Retrieves the number of levels.
+    /*! \return The number of levels; 0 if there are fewer data points than a block of level 0.
+     */
+    std::size_t GetLevels() const { return mins.size(); }
+
+    //! Retrieves the extrema of all data points.
+    /*! They are gathered while the pyramid is built or extended, so that
+     *  retrieving them takes constant time. NaN points are ignored unless
+     *  the first point is NaN, in which case both extrema are NaN.
+     *  \param min On exit, the minimum of all data points.
+     *  \param max On exit, the maximum of all data points.
+     *  \return false if there are no data points.
+     */
+    bool Total(double& min, double& max) const {
+        min = total_min;
+        max = total_max;
+        return n_points > 0;
+    }
+
+    //! Retrieves the number of data points in a block.
+    /*! Blocks of a level start at multiples of their size.
+     *  \param level The level.
+     *  \return The number of data points in a block of \e level.
+     */
+    static std::size_t GetBlockSize(std::size_t level) { return blockSize(level); }
+
+    //! Retrieves the extrema of a block.
+    /*! \param level The level.
+     *  \param n_b The index of the block within its level.
+     *  \param min On exit, the minimum within the block.
+     *  \param max On exit, the maximum within the block.
+     *  \return false if the block doesn't exist, e.g. because it would
+     *          extend past the end of the data.
+     */
+    bool GetBlock(std::size_t level, std::size_t n_b, double& min, double& max) const {
+        if (level >= mins.size() || n_b >= mins[level].size()) {
+            return false;
+        }
+        min = mins[level][n_b];
+        max = maxs[level][n_b];
+        return true;
+    }
+
+private:
+    // Builds the higher levels from the lowest one:
+    void Build();
+    // Adds data points to the extrema of all data points:
+    void Accumulate(const double* data, std::size_t size);
+    template <class Data>
+    void FindExtrema(const Data& data, std::size_t begin, std::size_t end,
+                     double& min, double& max) const;
+
+    // level k holds the extrema of blocks of blockSize(k) points:
+    std::vector<Vector_double> mins, maxs;
+    // points past the last complete block of level 0, for Extend():
+    Vector_double partial;
+    // extrema of all data points, see Total():
+    std::size_t n_points;
+    double total_min, total_max;
+    static std::size_t blockSize(std::size_t level) { return std::size_t(16) << (2*level); }
+};
+
+//! Prefix sums and prefix sums of squares of a data array.
+/*! Used to find the mean and the variance of arbitrary ranges in constant
+ *  time, e.g. for aligning the baselines of two channels on the screen.
+ *  The sums are taken over the deviations from the mean of all data, so that
+ *  large offsets don't cost precision; but unlike stfnum::base() the results
+ *  may differ from an explicit summation by rounding errors.
+ */
+class StfioDll PrefixSums {
+public:
+    //! Constructor
+    /*! \param data The data array.
+     */
+    explicit PrefixSums(const Vector_double& data);
+
+    //! Computes the mean of a range.
+    /*! \param begin Index of the first data point.
+     *  \param end Index past the last data point; has to be > \e begin.
+     *  \param var On exit, the variance within the range, normalised like stfnum::base().
+     *  \return The mean within the range.
+     */
+    double Mean(std::size_t begin, std::size_t end, double& var) const;
+
+private:
+    double offset;
+    // sum and sum of squares of the first k deviations from offset:
+    Vector_double sums, sqsums;
+};
+
+}
+
 //! Represents a continuously sampled sweep of data points
+/*! Copies of a section share its data points until either of them is
+ *  written to (copy-on-write), so that sections can be passed between
+ *  recordings and documents without copying the data. Any non-const
+ *  access to the data points, e.g. get_w() or the non-const operator[],
+ *  makes a private copy first if the data are shared.
+ */
 class StfioDll Section {
 public:
     // Construction/Destruction-----------------------------------------------
@@ -47,6 +200,29 @@ public:
             const std::string& label="\0"
     );
 
+#if (__cplusplus >= 201103)
+    //! Constructor that takes over the data points of a vector without copying them.
+    /*! \param valA A vector of values that will make up the section; empty on return.
+     *  \param label An optional section label string.
+     */
+    explicit Section(
+            Vector_double&& valA,
+            const std::string& label="\0"
+    );
+
+    //! Copy constructor; shares the data points.
+    Section(const Section&) = default;
+
+    //! Move constructor; leaves \e c_Section empty.
+    Section(Section&& c_Section) = default;
+
+    //! Copy assignment; shares the data points.
+    Section& operator=(const Section&) = default;
+
+    //! Move assignment; leaves \e c_Section empty.
+    Section& operator=(Section&& c_Section) = default;
+#endif
+
     //! Yet another constructor
     /*! \param size Number of data points.
      *  \param label An optional section label string.
@@ -56,21 +232,68 @@ public:
             const std::string& label="\0"
     );
 
+    //! Constructor for data that are decoded on demand.
+    /*! The samples may stay in a mapped file or be stored compactly in
+     *  memory (see stfio::compactSamples()).
+     *  Samples are decoded on demand by the const operator[]. Any other
+     *  access to the data, such as get(), decodes all samples into memory
+     *  first. Samples of a mapped file are decoded through the section
+     *  cache (see stfio::setSectionCacheBudget()), so that sections referring
+     *  to the same samples share a single read-only copy until they are
+     *  written to. Decoding happens within const member functions; it is
+     *  guarded, so that several threads may read the same section at once.
+     *  Chained samples (see stfio::chainSamples()) are decoded in the same
+     *  way as samples of a mapped file, so that a section can be a
+     *  concatenation of other sections that is never copied as a whole
+     *  unless get() is called.
+     *  \param samples The encoded samples.
+     *  \param label An optional section label string.
+     */
+    explicit Section(
+            const stfio::MappedSamples& samples,
+            const std::string& label="\0"
+    );
+
     //! Destructor
     ~Section();
 
+    //! Refers to a data point of a section, as returned by the non-const operator[] and at().
+    /*! Reading the data point leaves the data shared and the cached extrema
+     *  and sums intact, so that read loops through a non-const section cost
+     *  no more than through a const one. Assigning to the data point or
+     *  taking its address copies the data first if they are shared and
+     *  discards the caches, like get_w().
+     */
+    class Reference {
+    public:
+        operator double() const { return ((const Section&)*sec)[at]; }
+        Reference& operator=(double value) { sec->Write(at) = value; return *this; }
+        Reference& operator=(const Reference& other) { return *this = (double)other; }
+        Reference& operator+=(double value) { sec->Write(at) += value; return *this; }
+        Reference& operator-=(double value) { sec->Write(at) -= value; return *this; }
+        Reference& operator*=(double value) { sec->Write(at) *= value; return *this; }
+        Reference& operator/=(double value) { sec->Write(at) /= value; return *this; }
+        double* operator&() { return &sec->Write(at); }
+
+    private:
+        friend class Section;
+        Reference(Section* sec_, std::size_t at_) : sec(sec_), at(at_) {}
+        Section* sec;
+        std::size_t at;
+    };
+
     // Operators--------------------------------------------------------------
-    //! Unchecked access. Returns a non-const reference.
+    //! Unchecked access. Returns a reference that writes through when it is assigned to.
     /*! \param at Data point index.
-     *  \return Copy of the data point with index at.
+     *  \return Reference to the data point with index at.
      */
-    double& operator[](std::size_t at) { return data[at]; }
+    Reference operator[](std::size_t at) { return Reference(this, at); }
 
     //! Unchecked access. Returns a copy.
     /*! \param at Data point index.
-     *  \return Reference to the data point with index at.
+     *  \return Copy of the data point with index at.
      */
-    double operator[](std::size_t at) const { return data[at]; }
+    double operator[](std::size_t at) const { return mapped ? samples[at] : (*data)[at]; }
 
     // Public member functions------------------------------------------------
 
@@ -81,38 +304,194 @@ public:
      */
     double at(std::size_t at_) const;
 
-    //! Range-checked access. Returns a non-const reference.
+    //! Range-checked access. Returns a reference that writes through when it is assigned to.
     /*! Throws std::out_of_range if out of range.
      *  \param at_ Data point index.
      *  \return Reference to the data point at index at_
      */
-    double& at(std::size_t at_);
+    Reference at(std::size_t at_);
 
     //! Low-level access to the valarray (read-only).
     /*! An explicit function is used instead of implicit type conversion
      *  to access the valarray.
      *  \return The valarray containing the data points.
      */
-    const Vector_double& get() const { return data; }
+    const Vector_double& get() const {
+        if (mapped) return Load();
+        return data ? *data : Empty();
+    }
 
     //! Low-level access to the valarray (read and write).
     /*! An explicit function is used instead of implicit type conversion
-     *  to access the valarray.
+     *  to access the valarray. Copies the data points first if they're
+     *  shared with another section.
      *  \return The valarray containing the data points.
      */
-    Vector_double& get_w() { return data; }
+    Vector_double& get_w() { Detach(); Modified(); return *data; }
 
     //! Resize the Section to a new number of data points; deletes all previously stored data when gcc is used.
     /*! Note that in the gcc implementation of std::vector, resizing will
      *  delete all the original data. This is different from std::vector::resize().
      *  \param new_size The new number of data points.
      */
-    void resize(std::size_t new_size) { data.resize(new_size); }
+    void resize(std::size_t new_size) { Detach(); Modified(); data->resize(new_size); }
 
     //! Retrieve the number of data points.
     /*! \return The number of data points.
      */
-    size_t size() const { return data.size(); }
+    size_t size() const { return mapped ? samples.size() : (data ? data->size() : 0); }
+
+    //! Checks whether the data are still in a mapped file.
+    /*! \return true if the samples haven't been decoded into memory yet.
+     */
+    bool IsMapped() const { return mapped && !Decoded(); }
+
+    //! Shares the samples that were decoded from a mapped file or from compact samples.
+    /*! Decodes them first if necessary. Unlike the reference returned by get(),
+     *  the returned pointer keeps the samples alive after Release() has been
+     *  called, after the section has been written to or after it has been destroyed.
+     *  \return The decoded samples, or an empty pointer if the data points
+     *          are stored in memory as doubles.
+     */
+    stfio::DecodedSamples GetDecoded() const;
+
+    //! Drops this section's share of samples that were decoded from a mapped file.
+    /*! The section cache may then reclaim the memory; the samples are
+     *  decoded again or fetched from the cache when they are needed next.
+     *  References returned by get() become invalid.
+     */
+    void Release() { decoded.reset(); }
+
+    //! Decodes the samples and builds the min/max pyramid ahead of time.
+    /*! Meant to be called on a copy of a section on a worker thread while
+     *  the section itself is in use, e.g. to prepare the sections next to
+     *  the one that is shown. Samples of a mapped file are decoded through
+     *  the section cache; compactly stored samples stay compact. Hand the
+     *  results back with AdoptCaches().
+     */
+    void Prepare() const;
+
+    //! Takes over what has been prepared for a copy of this section.
+    /*! Shares the decoded samples, the min/max pyramid and the prefix sums
+     *  of \e prepared (see Prepare()), unless this section has already got
+     *  them. Nothing is taken over if either section has been written to
+     *  since the copy was made.
+     *  \param prepared A copy of this section.
+     *  \return true if both sections still hold the same data points.
+     */
+    bool AdoptCaches(const Section& prepared);
+
+    //! Checks whether two sections hold the same data points without comparing them.
+    /*! \param other Another section.
+     *  \return true if \e other is a copy of this section and neither has
+     *          been written to since.
+     */
+    bool SharesData(const Section& other) const;
+
+    //! Retrieves the samples, e.g. to chain them with those of other sections.
+    /*! The samples are shared rather than copied; data points in memory
+     *  are copied when this section is written to next.
+     *  \return The samples of this section.
+     */
+    stfio::MappedSamples GetSamples() const;
+
+    //! Retrieves the data points if they are stored in memory as doubles.
+    /*! Unlike get(), this never decodes or copies mapped samples, so that
+     *  kernels can read sections that share a buffer (see
+     *  Channel::MakeContiguous()) in place. The pointer becomes invalid when
+     *  the section is written to or destroyed.
+     *  \return Pointer to the first data point, or NULL if the samples have
+     *          to be decoded first or if the section is empty.
+     */
+    const double* GetSpan() const;
+
+    //! Retrieves the data points in the format in which they are stored.
+    /*! Like GetSpan(), but compactly stored samples (see stfio::compactSamples())
+     *  are returned as they are, e.g. as 16-bit integers, so that kernels
+     *  such as stfnum::peak() can read them without decoding them first.
+     *  Data point n is scale*raw[n]+shift.
+     *  \param type On exit, the storage format of the data points.
+     *  \param scale On exit, the scaling factor applied to the stored values.
+     *  \param shift On exit, the offset added to the scaled values.
+     *  \return Pointer to the first stored data point, or NULL if the samples
+     *          have to be decoded first or if the section is empty.
+     */
+    const void* GetNative(stfio::SampleType& type, double& scale, double& shift) const;
+
+    //! Finds the extrema of a range of data points.
+    /*! Uses a min/max pyramid that is built on first use and discarded
+     *  whenever the data are accessed for writing. Building the pyramid
+     *  doesn't decode all mapped samples at once. The extrema of the whole
+     *  section are retrieved in constant time once the pyramid exists.
+     *  Throws std::out_of_range if the range is empty or out of range.
+     *  \param begin Index of the first data point.
+     *  \param end Index past the last data point.
+     *  \param min On exit, the minimum within the range.
+     *  \param max On exit, the maximum within the range.
+     */
+    void GetExtrema(std::size_t begin, std::size_t end, double& min, double& max) const;
+
+    //! Retrieves the min/max pyramid of the data points.
+    /*! The pyramid is built on first use and discarded whenever the data
+     *  are accessed for writing, like the one that GetExtrema() uses.
+     *  \return The pyramid; valid until the data are accessed for writing.
+     */
+    const stfio::MinMaxPyramid& GetPyramid() const;
+
+    //! Reduces a range of data points to the extrema of pixel columns, e.g. for drawing.
+    /*! Data point n falls into column (n-begin)*n_columns/(end-begin).
+     *  A polyline enters each column at its first point, covers the range
+     *  between its extrema and leaves it at its last point; a column that
+     *  holds a single point contributes only that point. The extrema are
+     *  taken from GetExtrema(), so that the cost is proportional to
+     *  \e n_columns rather than to the number of points.
+     *  Throws std::out_of_range if the range is empty or out of range.
+     *  \param begin Index of the first data point.
+     *  \param end Index past the last data point.
+     *  \param n_columns The number of columns; has to be > 0.
+     *  \param columns On exit, the column of each point of the polyline.
+     *  \param values On exit, the points of the polyline.
+     */
+    void Decimate(std::size_t begin, std::size_t end, std::size_t n_columns,
+                  std::vector<std::size_t>& columns, Vector_double& values) const;
+
+    //! Computes the mean and variance of a range of data points.
+    /*! Uses prefix sums that are built on first use and discarded whenever
+     *  the data are accessed for writing, so that subsequent calls take
+     *  constant time. The results may differ from stfnum::base() by rounding
+     *  errors; use the latter where measurements must be reproducible.
+     *  Throws std::out_of_range if the range is empty or out of range.
+     *  \param begin Index of the first data point.
+     *  \param end Index past the last data point.
+     *  \param var On exit, the variance within the range.
+     *  \return The mean within the range.
+     */
+    double GetMean(std::size_t begin, std::size_t end, double& var) const;
+
+    //! Copies a range of data points without decoding the whole section.
+    /*! Throws std::out_of_range if the range is out of range. Unlike get(),
+     *  this is safe to call concurrently on a mapped section.
+     *  \param begin Index of the first data point.
+     *  \param end Index past the last data point.
+     *  \param dest Destination; has to hold at least end-begin values.
+     */
+    void CopyRange(std::size_t begin, std::size_t end, double* dest) const;
+
+    //! Copies data points at a fractional offset, interpolating linearly.
+    /*! Used to average sections that have been shifted by fractions of a
+     *  sampling interval. Throws std::out_of_range if \e begin is negative or
+     *  if the last point lies beyond the last data point.
+     *  \param begin Fractional index of the first point.
+     *  \param n Number of points.
+     *  \param dest Destination; has to hold at least \e n values.
+     */
+    void CopyInterpolated(double begin, std::size_t n, double* dest) const;
+
+    //! Copies a range of data points in single precision.
+    /*! Compact single precision samples are copied without a detour through
+     *  double precision. See CopyRange() above for a description of the parameters.
+     */
+    void CopyRange(std::size_t begin, std::size_t end, float* dest) const;
 
     //! Sets the x scaling.
     /*! \param value The x scaling.
@@ -136,6 +515,23 @@ public:
     
  private:
     //Private members-------------------------------------------------------
+    // Decodes all mapped samples for reading; safe to call from several threads:
+    const Vector_double& Load() const;
+    // Shares the decoded samples, or returns an empty pointer if they
+    // haven't been decoded yet:
+    stfio::DecodedSamples Decoded() const;
+    // Decodes all mapped samples into data for writing:
+    void Own();
+    // Makes the data writable; copies them if they're mapped or shared:
+    void Detach() { if (mapped || !data || data.use_count() != 1) Unshare(); }
+    // Write access to a single data point:
+    double& Write(std::size_t at) { Detach(); Modified(); return (*data)[at]; }
+    void Unshare();
+    // The data of sections that have been moved from:
+    static const Vector_double& Empty();
+    // Discards the cached range indices before the data are written to:
+    void Modified() { if (pyramid) pyramid.reset(); if (sums) sums.reset(); }
+
 
     // A description that is specific to this section:
     std::string section_description;
@@ -143,8 +539,28 @@ public:
     // The sampling interval:
     double x_scale;
 
-    // The data:
-    Vector_double data;
+    // The data; shared with copies of this section until either is written to:
+#if (__cplusplus < 201103)
+    boost::shared_ptr<Vector_double> data;
+#else
+    std::shared_ptr<Vector_double> data;
+#endif
+    // The data if they haven't been decoded yet:
+    stfio::MappedSamples samples;
+    bool mapped;
+    // The decoded samples of a mapped file, shared with the section cache,
+    // or of compactly stored samples; these and the caches below are set
+    // within const member functions, so that they are only read and set
+    // within the stfio_section_load critical section:
+    mutable stfio::DecodedSamples decoded;
+    // Cached extrema for drawing:
+#if (__cplusplus < 201103)
+    mutable boost::shared_ptr<const stfio::MinMaxPyramid> pyramid;
+    mutable boost::shared_ptr<const stfio::PrefixSums> sums;
+#else
+    mutable std::shared_ptr<const stfio::MinMaxPyramid> pyramid;
+    mutable std::shared_ptr<const stfio::PrefixSums> sums;
+#endif
 };
 
 /*@}*/
@@ -0,0 +1,291 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file sharedrecording.cpp
+ *  \brief Defines recordings in named shared memory that other processes can attach to.
+ *
+ *  The shared memory consists of a fixed header, an index that is
+ *  encoded like a sidecar index (see sidecar.cpp) and a data area. The
+ *  data points of every section start at a multiple of 64 bytes, so that
+ *  they can be read in place as doubles.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "./sharedrecording.h"
+#include "./bytestream.h"
+#include "./recording.h"
+#include "./mappedfile.h"
+#include "./parallel.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    const char kMagic[8] = {'S', 'T', 'F', 'S', 'H', 'M', '0', '1'};
+    const unsigned int kByteOrder = 0x01020304;
+    // magic, byte order, size of the index, size of the shared memory:
+    const std::size_t kHeaderSize = 8 + 4 + 2*8;
+    const std::size_t kAlignment = 64;
+
+    std::size_t align(std::size_t offset) {
+        return (offset + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+#ifdef _WIN32
+    std::string systemName(const std::string& name) {
+        return name;
+    }
+
+    // Unmaps an attached view when the last section that refers to it is gone:
+    struct Unmapper {
+        explicit Unmapper(HANDLE hMapping_) : hMapping(hMapping_) {}
+        void operator()(void* view) const {
+            UnmapViewOfFile(view);
+            CloseHandle(hMapping);
+        }
+        HANDLE hMapping;
+    };
+#else
+    std::string systemName(const std::string& name) {
+        return (!name.empty() && name[0] == '/') ? name : "/" + name;
+    }
+
+    struct Unmapper {
+        explicit Unmapper(std::size_t size_) : size(size_) {}
+        void operator()(void* view) const {
+            munmap(view, size);
+        }
+        std::size_t size;
+    };
+#endif
+}
+
+stfio::SharedRecording::SharedRecording(const Recording& data, const std::string& name_)
+    : name(name_), size(0)
+#ifdef _WIN32
+    , hMapping(NULL)
+#endif
+{
+    // the index, with the offsets of the sections within the data area:
+    ByteWriter index;
+    putAttributes(index, data);
+    std::vector<const Section*> sections;
+    std::vector<std::size_t> offsets;
+    std::size_t dataSize = 0;
+    index.Put<unsigned long long>(data.size());
+    for (std::size_t n_c = 0; n_c < data.size(); ++n_c) {
+        const Channel& ch = data[n_c];
+        index.PutString(ch.GetChannelName());
+        index.PutString(ch.GetYUnits());
+        index.Put<unsigned long long>(ch.size());
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            const Section& sec = ch[n_s];
+            index.PutString(sec.GetSectionDescription());
+            index.Put<unsigned long long>(dataSize);
+            index.Put<unsigned long long>(sec.size());
+            sections.push_back(&sec);
+            offsets.push_back(dataSize);
+            dataSize = align(dataSize + sec.size()*sizeof(double));
+        }
+    }
+    std::size_t dataBegin = align(kHeaderSize + index.Get().size());
+    size = dataBegin + dataSize;
+
+    ByteWriter header;
+    for (std::size_t n = 0; n < sizeof(kMagic); ++n) {
+        header.Put<char>(kMagic[n]);
+    }
+    header.Put<unsigned int>(kByteOrder);
+    header.Put<unsigned long long>(index.Get().size());
+    header.Put<unsigned long long>(size);
+
+    std::string sysName = systemName(name);
+#ifdef _WIN32
+    hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                  (DWORD)((unsigned long long)size >> 32), (DWORD)(size & 0xFFFFFFFF),
+                                  sysName.c_str());
+    if (hMapping == NULL) {
+        throw std::runtime_error("Couldn't create shared memory " + name);
+    }
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(hMapping);
+        throw std::runtime_error("Shared memory " + name + " exists already");
+    }
+    char* view = (char*)MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, size);
+    if (view == NULL) {
+        CloseHandle(hMapping);
+        throw std::runtime_error("Couldn't map shared memory " + name);
+    }
+#else
+    int fd = shm_open(sysName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Couldn't create shared memory " + name);
+    }
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(sysName.c_str());
+        throw std::runtime_error("Couldn't map shared memory " + name);
+    }
+    char* view = (char*)map;
+#endif
+
+    memcpy(view, header.Get().data(), header.Get().size());
+    memcpy(view + kHeaderSize, index.Get().data(), index.Get().size());
+    // sections are copied in parallel; mapped ones are decoded in place:
+    int n_sections = (int)sections.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(stfio::threadCount(0, n_sections))
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        if (sections[n_s]->size() > 0) {
+            sections[n_s]->CopyRange(0, sections[n_s]->size(),
+                                     (double*)(view + dataBegin + offsets[n_s]));
+        }
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+#else
+    munmap(view, size);
+#endif
+}
+
+stfio::SharedRecording::~SharedRecording() {
+#ifdef _WIN32
+    // the memory is freed when the last process closes its handle:
+    CloseHandle(hMapping);
+#else
+    shm_unlink(systemName(name).c_str());
+#endif
+}
+
+bool stfio::attachRecording(const std::string& name, Recording& ReturnData) {
+    std::string sysName = systemName(name);
+#ifdef _WIN32
+    HANDLE hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, sysName.c_str());
+    if (hMapping == NULL) {
+        return false;
+    }
+    const char* view = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(hMapping);
+        return false;
+    }
+    MEMORY_BASIC_INFORMATION info;
+    std::size_t mapped = VirtualQuery(view, &info, sizeof(info)) ? info.RegionSize : 0;
+#if (__cplusplus < 201103)
+    boost::shared_ptr<void> owner((void*)view, Unmapper(hMapping));
+#else
+    std::shared_ptr<void> owner((void*)view, Unmapper(hMapping));
+#endif
+#else
+    int fd = shm_open(sysName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    std::size_t mapped = (std::size_t)st.st_size;
+    void* map = mmap(NULL, mapped, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const char* view = (const char*)map;
+#if (__cplusplus < 201103)
+    boost::shared_ptr<void> owner(map, Unmapper(mapped));
+#else
+    std::shared_ptr<void> owner(map, Unmapper(mapped));
+#endif
+#endif
+
+    try {
+        ByteReader header(view, view + std::min(mapped, kHeaderSize));
+        for (std::size_t n = 0; n < sizeof(kMagic); ++n) {
+            if (header.Get<char>() != kMagic[n]) {
+                return false;
+            }
+        }
+        if (header.Get<unsigned int>() != kByteOrder) {
+            return false;
+        }
+        unsigned long long indexSize = header.Get<unsigned long long>();
+        unsigned long long size = header.Get<unsigned long long>();
+        if (size > mapped || indexSize > size - kHeaderSize) {
+            return false;
+        }
+        std::size_t dataBegin = align(kHeaderSize + (std::size_t)indexSize);
+#if (__cplusplus < 201103)
+        boost::shared_ptr<MappedFile> file(new MappedFile(view, (std::size_t)size, owner));
+#else
+        std::shared_ptr<MappedFile> file(new MappedFile(view, (std::size_t)size, owner));
+#endif
+
+        ByteReader index(view + kHeaderSize, view + kHeaderSize + indexSize);
+        Recording attributes;
+        getAttributes(index, attributes);
+        std::vector<Channel> channels((std::size_t)index.Get<unsigned long long>());
+        for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+            Channel& ch = channels[n_c];
+            ch.SetChannelName(index.GetString());
+            ch.SetYUnits(index.GetString());
+            ch.resize((std::size_t)index.Get<unsigned long long>());
+            for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+                std::string label = index.GetString();
+                std::size_t offset = (std::size_t)index.Get<unsigned long long>();
+                std::size_t n_samples = (std::size_t)index.Get<unsigned long long>();
+                if (n_samples == 0) {
+                    ch.InsertSection(Section(Vector_double(), label), n_s);
+                } else {
+                    // throws if the section exceeds the shared memory:
+                    ch.InsertSection(Section(MappedSamples(file, dataBegin+offset, n_samples,
+                                                           sizeof(double), sample_float64), label), n_s);
+                }
+            }
+        }
+
+        ReturnData.resize(channels.size());
+        for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+            ReturnData.InsertChannel(STFIO_MOVE(channels[n_c]), n_c);
+        }
+        ReturnData.CopyAttributes(attributes);
+        ReturnData.SetXUnits(attributes.GetXUnits());
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file sharedrecording.h
+ *  \brief Declares recordings in named shared memory that other processes can attach to.
+ */
+
+#ifndef _SHAREDRECORDING_H
+#define _SHAREDRECORDING_H
+
+#include <string>
+
+#include "./stfio.h"
+
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! A copy of a recording in named shared memory.
+/*! The shared memory holds the attributes of the recording, the names
+ *  and units of the channels, the section descriptions and the data
+ *  points of all sections in double precision, so that any number of
+ *  processes can attach to it with stfio::attachRecording() and read
+ *  the data points in place. The memory is created once and never
+ *  written to after construction.
+ */
+class StfioDll SharedRecording {
+public:
+    //! Constructor. Copies a recording into shared memory.
+    /*! Throws std::runtime_error if the memory can't be created, e.g.
+     *  because the name is already in use.
+     *  \param data The recording to be shared.
+     *  \param name Name of the shared memory, e.g. "stfio_cell1"; a leading
+     *         slash is added on POSIX systems if it's missing.
+     */
+    SharedRecording(const Recording& data, const std::string& name);
+
+    //! Destructor. Removes the name, so that no more processes can attach.
+    /*! Processes that have already attached keep their data until they
+     *  release them.
+     */
+    ~SharedRecording();
+
+    //! Retrieves the name that other processes can attach to.
+    /*! \return The name of the shared memory, as passed to the constructor.
+     */
+    const std::string& GetName() const { return name; }
+
+    //! Retrieves the size of the shared memory.
+    /*! \return The size in bytes.
+     */
+    std::size_t GetSize() const { return size; }
+
+private:
+    SharedRecording(const SharedRecording&);
+    SharedRecording& operator=(const SharedRecording&);
+
+    std::string name;
+    std::size_t size;
+#ifdef _WIN32
+    void* hMapping;
+#endif
+};
+
+//! Attaches to a recording in shared memory.
+/*! No data points are copied: the sections read the shared memory in
+ *  place (see Section::GetSpan()), and the memory stays mapped until the
+ *  last section that refers to it is gone. Writing to a section makes a
+ *  private copy of its data points.
+ *  \param name Name of the shared memory, as passed to the constructor of
+ *         stfio::SharedRecording.
+ *  \param ReturnData On entry, an empty Recording object. On exit, the
+ *         shared data; unchanged if false is returned.
+ *  \return true if the shared memory exists and holds a recording.
+ */
+StfioDll bool attachRecording(const std::string& name, Recording& ReturnData);
+
+}
+
+/*@}*/
+
+#endif
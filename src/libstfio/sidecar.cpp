@@ -0,0 +1,255 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file sidecar.cpp
+ *  \brief Defines sidecar indices that let files be reopened without importing them again.
+ *
+ *  An index consists of a fixed header, the index proper and a data
+ *  area that is aligned to 8 bytes. Numbers are stored in host byte
+ *  order; an index that was written on a host with a different byte
+ *  order is ignored.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "./sidecar.h"
+#include "./bytestream.h"
+#include "./recording.h"
+#include "./mappedfile.h"
+#include "./fitcache.h"
+
+namespace {
+
+    const char kMagic[8] = {'S', 'T', 'F', 'I', 'D', 'X', '0', '1'};
+    const unsigned int kByteOrder = 0x01020304;
+    // magic, byte order, size and hash of the data file, size of the index:
+    const std::size_t kHeaderSize = 8 + 4 + 3*8;
+
+    // Where the samples of a section are stored:
+    const unsigned char kInDataFile = 0;
+    const unsigned char kInIndex = 1;
+
+    bool sidecarIndex = false;
+
+    // Hashes the size of a file and evenly spaced samples of its contents,
+    // so that checking an index doesn't read the whole file:
+    unsigned long long hashContents(const stfio::MappedFile& file) {
+        const std::size_t chunk = 4096;
+        const std::size_t n_chunks = 64;
+        unsigned long long size = file.GetSize();
+        unsigned long long hash = stfio::hashBytes(&size, sizeof(size));
+        if (file.GetSize() <= chunk*n_chunks) {
+            return stfio::hashBytes(file.GetData(), file.GetSize(), hash);
+        }
+        // the first chunk starts at the beginning and the last one ends at the end of the file:
+        for (std::size_t n_c = 0; n_c < n_chunks; ++n_c) {
+            std::size_t offset = (file.GetSize()-chunk) / (n_chunks-1) * n_c;
+            hash = stfio::hashBytes(file.GetData()+offset, chunk, hash);
+        }
+        return hash;
+    }
+
+    std::size_t dataOffset(std::size_t indexSize) {
+        return (kHeaderSize + indexSize + 7) / 8 * 8;
+    }
+}
+
+std::string stfio::sidecarName(const std::string& fName) {
+    return fName + ".stfidx";
+}
+
+void stfio::exportSidecar(const std::string& fName, const Recording& data) {
+    MappedFile source(fName);
+
+    ByteWriter index;
+    putAttributes(index, data);
+
+    // sections whose samples are stored in the index:
+    std::vector<const Section*> stored;
+    unsigned long long storedSize = 0;
+    index.Put<unsigned long long>(data.size());
+    for (std::size_t n_c = 0; n_c < data.size(); ++n_c) {
+        const Channel& ch = data[n_c];
+        index.PutString(ch.GetChannelName());
+        index.PutString(ch.GetYUnits());
+        index.Put<unsigned long long>(ch.size());
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            const Section& sec = ch[n_s];
+            index.PutString(sec.GetSectionDescription());
+            std::vector<SampleLayout> layout;
+            if (sec.GetSamples().GetLayout(fName, layout)) {
+                index.Put<unsigned char>(kInDataFile);
+                index.Put<unsigned long long>(layout.size());
+                for (std::size_t n_p = 0; n_p < layout.size(); ++n_p) {
+                    index.Put<unsigned long long>(layout[n_p].offset);
+                    index.Put<unsigned long long>(layout[n_p].size);
+                    index.Put<unsigned long long>(layout[n_p].stride);
+                    index.Put<int>((int)layout[n_p].type);
+                    index.Put<double>(layout[n_p].scale);
+                    index.Put<double>(layout[n_p].shift);
+                }
+            } else {
+                index.Put<unsigned char>(kInIndex);
+                index.Put<unsigned long long>(storedSize);
+                index.Put<unsigned long long>(sec.size());
+                stored.push_back(&sec);
+                storedSize += sec.size()*sizeof(double);
+            }
+        }
+    }
+
+    std::string finalName = sidecarName(fName);
+    std::string tmpName = finalName + ".tmp";
+    std::ofstream out(tmpName.c_str(), std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Couldn't create sidecar index " + tmpName);
+    }
+    ByteWriter header;
+    for (std::size_t n = 0; n < sizeof(kMagic); ++n) {
+        header.Put<char>(kMagic[n]);
+    }
+    header.Put<unsigned int>(kByteOrder);
+    header.Put<unsigned long long>(source.GetSize());
+    header.Put<unsigned long long>(hashContents(source));
+    header.Put<unsigned long long>(index.Get().size());
+    out.write(header.Get().data(), header.Get().size());
+    out.write(index.Get().data(), index.Get().size());
+    std::string padding(dataOffset(index.Get().size()) - kHeaderSize - index.Get().size(), '\0');
+    out.write(padding.data(), padding.size());
+
+    // copy range by range, so that mapped sections aren't decoded as a whole:
+    Vector_double buffer(65536);
+    for (std::size_t n_s = 0; n_s < stored.size() && out; ++n_s) {
+        for (std::size_t begin = 0; begin < stored[n_s]->size(); begin += buffer.size()) {
+            std::size_t end = std::min(stored[n_s]->size(), begin+buffer.size());
+            stored[n_s]->CopyRange(begin, end, &buffer[0]);
+            out.write((const char*)&buffer[0], (end-begin)*sizeof(double));
+        }
+    }
+    out.close();
+    if (!out) {
+        std::remove(tmpName.c_str());
+        throw std::runtime_error("Couldn't write sidecar index " + tmpName);
+    }
+    // readers of an older index keep their mapping of it:
+    std::remove(finalName.c_str());
+    if (std::rename(tmpName.c_str(), finalName.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        throw std::runtime_error("Couldn't rename sidecar index to " + finalName);
+    }
+}
+
+bool stfio::importSidecar(const std::string& fName, Recording& ReturnData) {
+    std::string indexName = sidecarName(fName);
+    if (!std::ifstream(indexName.c_str())) {
+        return false;
+    }
+    try {
+#if (__cplusplus < 201103)
+        boost::shared_ptr<MappedFile> source(new MappedFile(fName));
+        boost::shared_ptr<MappedFile> indexFile(new MappedFile(indexName));
+#else
+        std::shared_ptr<MappedFile> source(new MappedFile(fName));
+        std::shared_ptr<MappedFile> indexFile(new MappedFile(indexName));
+#endif
+        const char* begin = indexFile->GetData();
+        ByteReader header(begin, begin+std::min(indexFile->GetSize(), kHeaderSize));
+        for (std::size_t n = 0; n < sizeof(kMagic); ++n) {
+            if (header.Get<char>() != kMagic[n]) {
+                return false;
+            }
+        }
+        if (header.Get<unsigned int>() != kByteOrder ||
+            header.Get<unsigned long long>() != source->GetSize() ||
+            header.Get<unsigned long long>() != hashContents(*source))
+        {
+            return false;
+        }
+        unsigned long long indexSize = header.Get<unsigned long long>();
+        if (indexSize > indexFile->GetSize() - kHeaderSize) {
+            return false;
+        }
+        std::size_t data_begin = dataOffset((std::size_t)indexSize);
+
+        ByteReader index(begin+kHeaderSize, begin+kHeaderSize+indexSize);
+        Recording attributes;
+        getAttributes(index, attributes);
+
+        std::vector<Channel> channels((std::size_t)index.Get<unsigned long long>());
+        for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+            Channel& ch = channels[n_c];
+            ch.SetChannelName(index.GetString());
+            ch.SetYUnits(index.GetString());
+            ch.resize((std::size_t)index.Get<unsigned long long>());
+            for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+                std::string label = index.GetString();
+                std::vector<MappedSamples> pieces;
+                if (index.Get<unsigned char>() == kInDataFile) {
+                    std::size_t n_pieces = (std::size_t)index.Get<unsigned long long>();
+                    for (std::size_t n_p = 0; n_p < n_pieces; ++n_p) {
+                        std::size_t offset = (std::size_t)index.Get<unsigned long long>();
+                        std::size_t size = (std::size_t)index.Get<unsigned long long>();
+                        std::size_t stride = (std::size_t)index.Get<unsigned long long>();
+                        int type = index.Get<int>();
+                        double scale = index.Get<double>();
+                        double shift = index.Get<double>();
+                        if (type < sample_int16 || type > sample_float64) {
+                            return false;
+                        }
+                        pieces.push_back(MappedSamples(source, offset, size, stride,
+                                                       (SampleType)type, scale, shift));
+                    }
+                } else {
+                    std::size_t offset = (std::size_t)index.Get<unsigned long long>();
+                    std::size_t size = (std::size_t)index.Get<unsigned long long>();
+                    if (offset > indexFile->GetSize()) {
+                        return false;
+                    }
+                    pieces.push_back(MappedSamples(indexFile, data_begin+offset, size,
+                                                   sizeof(double), sample_float64));
+                }
+                if (pieces.empty()) {
+                    ch.InsertSection(Section(Vector_double(), label), n_s);
+                } else {
+                    ch.InsertSection(Section(pieces.size() == 1 ? pieces[0] : chainSamples(pieces), label), n_s);
+                }
+            }
+        }
+
+        ReturnData.resize(channels.size());
+        for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+            ReturnData.InsertChannel(STFIO_MOVE(channels[n_c]), n_c);
+        }
+        ReturnData.CopyAttributes(attributes);
+        ReturnData.SetXUnits(attributes.GetXUnits());
+    }
+    catch (const std::exception&) {
+        // a damaged index is ignored like a missing one:
+        return false;
+    }
+    return true;
+}
+
+void stfio::setSidecarIndex(bool enable) {
+    sidecarIndex = enable;
+}
+
+bool stfio::getSidecarIndex() {
+    return sidecarIndex;
+}
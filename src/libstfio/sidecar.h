@@ -0,0 +1,85 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file sidecar.h
+ *  \brief Declares sidecar indices that let files be reopened without importing them again.
+ */
+
+#ifndef _SIDECAR_H
+#define _SIDECAR_H
+
+#include <string>
+
+#include "./stfio.h"
+
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Retrieves the name of the sidecar index of a file.
+/*! \param fName Full path of the data file.
+ *  \return \e fName with ".stfidx" appended.
+ */
+StfioDll std::string sidecarName(const std::string& fName);
+
+//! Writes a sidecar index for a file that has just been imported.
+/*! The index holds the layout of every section: samples that are still
+ *  read from \e fName (see stfio::MappedSamples) are described by their
+ *  offsets, sizes and scaling, and all other samples are stored in the
+ *  index itself in double precision. The index also holds the names and
+ *  units of the channels, the section descriptions and the metadata of
+ *  the recording, together with the size of \e fName and a hash of
+ *  samples of its contents. The index is written to a temporary file
+ *  first, so that readers never see an incomplete one. Throws
+ *  std::runtime_error if the index can't be written.
+ *  \param fName Full path of the data file.
+ *  \param data The data as imported from \e fName.
+ */
+StfioDll void exportSidecar(const std::string& fName, const Recording& data);
+
+//! Reads the sidecar index of a file instead of importing the file.
+/*! No samples are decoded: sections map the data file or the index
+ *  directly. The index is ignored if it's missing, damaged, or doesn't
+ *  match the current size and contents of \e fName.
+ *  \param fName Full path of the data file.
+ *  \param ReturnData On entry, an empty Recording object. On exit, the
+ *         data described by the index; unchanged if false is returned.
+ *  \return true if a valid index has been read.
+ */
+StfioDll bool importSidecar(const std::string& fName, Recording& ReturnData);
+
+//! Enables or disables sidecar indices in stfio::importFile().
+/*! When enabled, stfio::importFile() reads a valid sidecar index
+ *  instead of the file, and writes one after importing a file that
+ *  doesn't have one. Text files aren't indexed because their import
+ *  depends on the import settings. Disabled by default.
+ *  \param enable true to use sidecar indices.
+ */
+StfioDll void setSidecarIndex(bool enable);
+
+//! Checks whether sidecar indices are used by stfio::importFile().
+/*! \return true if sidecar indices are enabled.
+ */
+StfioDll bool getSidecarIndex();
+
+}
+
+/*@}*/
+
+#endif
@@ -0,0 +1,80 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file snapshot.cpp
+ *  \brief Defines immutable views of recordings for background computations.
+ */
+
+#include <stdexcept>
+
+#include "./snapshot.h"
+#include "./recording.h"
+
+stfio::Snapshot::Snapshot()
+    : epoch(0), dt(1.0), parts()
+{}
+
+stfio::Snapshot::Snapshot(const Recording& data, std::size_t epoch_)
+    : epoch(epoch_), dt(data.GetXScale()), parts(data.size())
+{
+    for (std::size_t n_c = 0; n_c < data.size(); ++n_c) {
+        Part& part = parts[n_c];
+        part.channel = n_c;
+        part.indices.resize(data[n_c].size());
+        for (std::size_t n_s = 0; n_s < part.indices.size(); ++n_s) {
+            part.indices[n_s] = n_s;
+        }
+        // copies the section handles, not the samples:
+        part.sections = data[n_c];
+    }
+}
+
+stfio::Snapshot::Snapshot(const Recording& data, std::size_t epoch_, std::size_t channel,
+                          const std::vector<std::size_t>& sections)
+    : epoch(epoch_), dt(data.GetXScale()), parts(1)
+{
+    if (channel >= data.size()) {
+        throw std::out_of_range("Channel index out of range in stfio::Snapshot::Snapshot()");
+    }
+    const Channel& ch = data[channel];
+    Part& part = parts[0];
+    part.channel = channel;
+    part.indices = sections;
+    part.sections = Channel(sections.size());
+    part.sections.SetChannelName(ch.GetChannelName());
+    part.sections.SetYUnits(ch.GetYUnits());
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfio::Snapshot::Snapshot()");
+        }
+        part.sections.InsertSection(ch[sections[n]], n);
+    }
+}
+
+bool stfio::Snapshot::Unchanged(const Recording& data) const {
+    for (std::size_t n_p = 0; n_p < parts.size(); ++n_p) {
+        const Part& part = parts[n_p];
+        if (part.channel >= data.size()) {
+            return false;
+        }
+        const Channel& ch = data[part.channel];
+        for (std::size_t n = 0; n < part.indices.size(); ++n) {
+            if (part.indices[n] >= ch.size() || !ch[part.indices[n]].SharesData(part.sections[n])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
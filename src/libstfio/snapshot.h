@@ -0,0 +1,126 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file snapshot.h
+ *  \brief Declares immutable views of recordings for background computations.
+ */
+
+#ifndef _STFIO_SNAPSHOT_H
+#define _STFIO_SNAPSHOT_H
+
+#include <vector>
+
+#include "./stfio.h"
+#include "./channel.h"
+
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! The sections of a recording as they were at one point in time.
+/*! A snapshot holds copies of sections, which share their samples with
+ *  the recording until either is written to (see Section), so that taking
+ *  a snapshot is cheap and the recording can be modified while another
+ *  thread reads the snapshot without locking. The samples that a snapshot
+ *  refers to are released when the last copy of the snapshot is destroyed.
+ *
+ *  The epoch is a modification counter of the owner of the recording, e.g.
+ *  of a document; results that have been computed from a snapshot can be
+ *  discarded or reconciled if the recording has been modified since.
+ */
+class StfioDll Snapshot {
+public:
+    //! Constructs an empty snapshot.
+    Snapshot();
+
+    //! Takes a snapshot of all sections of all channels.
+    /*! \param data The recording.
+     *  \param epoch The modification counter of the recording.
+     */
+    Snapshot(const Recording& data, std::size_t epoch);
+
+    //! Takes a snapshot of some sections of a channel.
+    /*! Throws std::out_of_range if the channel or a section doesn't exist.
+     *  \param data The recording.
+     *  \param epoch The modification counter of the recording.
+     *  \param channel Index of the channel.
+     *  \param sections Indices of the sections.
+     */
+    Snapshot(const Recording& data, std::size_t epoch, std::size_t channel,
+             const std::vector<std::size_t>& sections);
+
+    //! Retrieves the modification counter that the snapshot was taken at.
+    /*! \return The epoch that was passed to the constructor.
+     */
+    std::size_t GetEpoch() const { return epoch; }
+
+    //! Retrieves the sampling interval of the recording.
+    /*! \return The sampling interval.
+     */
+    double GetXScale() const { return dt; }
+
+    //! Retrieves the number of channels in the snapshot.
+    /*! \return The number of channels.
+     */
+    std::size_t size() const { return parts.size(); }
+
+    //! Retrieves the sections of a channel in the snapshot.
+    /*! \param n Index of the channel within the snapshot.
+     *  \return The sections in the order of GetSectionIndices().
+     */
+    const Channel& operator[](std::size_t n) const { return parts[n].sections; }
+
+    //! Retrieves the index of a channel in the recording.
+    /*! \param n Index of the channel within the snapshot.
+     *  \return The index of the channel in the recording.
+     */
+    std::size_t GetChannelIndex(std::size_t n) const { return parts[n].channel; }
+
+    //! Retrieves the indices of the sections of a channel in the recording.
+    /*! \param n Index of the channel within the snapshot.
+     *  \return The indices of the sections in the recording.
+     */
+    const std::vector<std::size_t>& GetSectionIndices(std::size_t n) const { return parts[n].indices; }
+
+    //! Checks whether the recording still has the sections of the snapshot.
+    /*! Sections are compared by identity rather than by value, so that the
+     *  check is cheap and detects any write to the recording's sections.
+     *  \param data The recording that the snapshot was taken of.
+     *  \return true if every section of the snapshot still shares its
+     *          samples with the section of the recording at the same index.
+     */
+    bool Unchanged(const Recording& data) const;
+
+private:
+    struct Part {
+        std::size_t channel;
+        std::vector<std::size_t> indices;
+        Channel sections;
+    };
+
+    std::size_t epoch;
+    double dt;
+    std::vector<Part> parts;
+};
+
+}
+
+/*@}*/
+
+#endif
@@ -12,171 +12,241 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
-#include "wx/wxprec.h"
-#include "wx/progdlg.h"
+/*! \file sonlib.cpp
+ *  \brief Import CED Spike2 (SON) files.
+ *
+ *  Reads the file, channel and block headers of 32-bit SON files
+ *  (versions 1 to 8) directly rather than through the CED SON library,
+ *  so that the samples of the data blocks can be mapped instead of
+ *  being copied through intermediate buffers.
+ */
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
 
 #include "./sonlib.h"
+#include "./../recording.h"
+#include "./../mappedfile.h"
+
+namespace {
+
+    const std::size_t kFileHeaderSize = 512;
+    const std::size_t kChannelHeaderSize = 140;
+    const std::size_t kBlockHeaderSize = 20;
+    const std::size_t kFileCommentSize = 80;
+    const int kFileComments = 5;
+
+    // Channel kinds that hold waveforms:
+    const unsigned char kKindAdc = 1;
+    const unsigned char kKindRealWave = 9;
+
+    // Adc values are scaled such that a value of 6553.6 corresponds to the scale factor:
+    const double kAdcScale = 6553.6;
+
+    bool hostIsBigEndian() {
+        const unsigned short one = 1;
+        return *(const unsigned char*)&one == 0;
+    }
+
+    // Reads a little-endian number at a byte offset of the file:
+    template <typename T>
+    T get(const stfio::MappedFile& file, std::size_t offset) {
+        if (offset > file.GetSize() || file.GetSize()-offset < sizeof(T)) {
+            throw std::runtime_error("Truncated SON file");
+        }
+        char bytes[sizeof(T)];
+        memcpy(bytes, file.GetData()+offset, sizeof(T));
+        if (hostIsBigEndian()) {
+            std::reverse(bytes, bytes+sizeof(T));
+        }
+        T value;
+        memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
 
-std::string stimfit::SON::SONError(short errorCode) {
-	std::string errorMsg("");
-	switch (errorCode) {
-		case SON_NO_FILE:
-			errorMsg="The file handle does not refer to an open SON file\n"
-					 "or an attempt to open a file failed.";
-			break;
-		case SON_NO_HANDLES:
-			errorMsg="There are too many files open in the system (a DOS problem).";
-			break;
-		case SON_NO_ACCESS:
-			errorMsg="Access was denied, for example insufficient privilege,\n"
-					 "attempt to search for a block in a FastWrite file,\n"
-					 "attempt to change a file size failed.";
-			break;
-		case SON_BAD_HANDLE:
-			errorMsg="The file you have referenced is not open in the library.";
-			break;
-		case SON_OUT_OF_MEMORY:
-			errorMsg="The system could not allocate enough memory.";
-			break;
-		case SON_NO_CHANNEL:
-			errorMsg="Data channel out of range 0 to SONMaxChans(fh)-1\n"
-					 "or no free channel available.";
-			break;
-		case SON_CHANNEL_USED:
-			errorMsg="The channel number supplied is already in use.";
-			break;
-		case SON_CHANNEL_UNUSED:
-			errorMsg="The channel number supplied is not in use.";
-			break;
-		case SON_WRONG_FILE:
-			errorMsg="File header doesn't match a SON file, unknown version,\n"
-					 "wrong revision, wrong byte order.";
-			break;
-		case SON_NO_EXTRA:
-			errorMsg="Read/write past end of extra data, or no extra data.";
-			break;
-		case SON_OUT_OF_HANDLES:
-			errorMsg="The SON library has run out of file handles, are you\n"
-					 "closing files after using them?";
-			break;
-		case SON_BAD_READ:
-			errorMsg="A read from the disk resulted in an error.";
-			break;
-		case SON_BAD_WRITE:
-			errorMsg="A write to the file resulted in an error.";
-			break;
-		case SON_CORRUPT_FILE:
-			errorMsg="Internal file information is inconsistent, try SonFix.";
-			break;
-		case SON_READ_ONLY:
-			errorMsg="Attempt to write to a file opened in read only mode.";
-			break;
-		case SON_BAD_PARAM:
-			errorMsg="A function parameter value is illegal or inconsistent.";
-			break;
-		default:
-			errorMsg="Unknown error code returned from SON library";
-			break;
-	}
-	return errorMsg;
+    // Reads a string that is preceded by its length in a field of fixed size:
+    std::string getString(const stfio::MappedFile& file, std::size_t offset, std::size_t size) {
+        std::size_t length = std::min((std::size_t)get<unsigned char>(file, offset), size-1);
+        if (file.GetSize()-offset-1 < length) {
+            throw std::runtime_error("Truncated SON file");
+        }
+        std::string value(file.GetData()+offset+1, length);
+        return value.substr(0, value.find('\0'));
+    }
+
+    // The samples of a data block:
+    struct Block {
+        std::size_t offset, size;
+        int start;
+    };
+
+    struct SonChannel {
+        std::string title, units;
+        stfio::SampleType type;
+        double scale, shift;
+        // runs of blocks that follow each other without a gap:
+        std::vector< std::vector<Block> > runs;
+    };
+
+    // Follows the chain of data blocks that starts at first and groups
+    // blocks whose first sample is one sampling interval (divide, in
+    // clock ticks) after the last sample of the preceding block:
+    std::vector< std::vector<Block> > readBlocks(const stfio::MappedFile& file, int first,
+                                                 int divide, std::size_t sampleSize)
+    {
+        std::vector< std::vector<Block> > runs;
+        // a chain can't hold more blocks than fit into the file:
+        std::size_t maxBlocks = file.GetSize() / kBlockHeaderSize;
+        int lastTime = 0;
+        int pos = first;
+        for (std::size_t n_b = 0; pos != -1; ++n_b) {
+            if (pos < (int)kFileHeaderSize || n_b >= maxBlocks) {
+                throw std::runtime_error("Corrupt chain of data blocks in SON file");
+            }
+            Block block;
+            block.offset = (std::size_t)pos + kBlockHeaderSize;
+            block.size = get<unsigned short>(file, pos+18);
+            block.start = get<int>(file, pos+8);
+            if (block.offset > file.GetSize() ||
+                (file.GetSize()-block.offset) / sampleSize < block.size)
+            {
+                throw std::runtime_error("Truncated data block in SON file");
+            }
+            if (block.size > 0) {
+                if (runs.empty() || block.start != lastTime+divide) {
+                    runs.push_back(std::vector<Block>());
+                }
+                runs.back().push_back(block);
+                lastTime = get<int>(file, pos+12);
+            }
+            pos = get<int>(file, pos+4);
+        }
+        return runs;
+    }
+
+    Section readSection(const stfio::MappedFile& file,
+#if (__cplusplus < 201103)
+                        const boost::shared_ptr<stfio::MappedFile>& mapped,
+#else
+                        const std::shared_ptr<stfio::MappedFile>& mapped,
+#endif
+                        const SonChannel& ch, const std::vector<Block>& run, const std::string& label)
+    {
+        std::size_t sampleSize = stfio::sampleSize(ch.type);
+        if (!hostIsBigEndian()) {
+            std::vector<stfio::MappedSamples> pieces;
+            pieces.reserve(run.size());
+            for (std::size_t n_b = 0; n_b < run.size(); ++n_b) {
+                pieces.push_back(stfio::MappedSamples(mapped, run[n_b].offset, run[n_b].size,
+                                                      sampleSize, ch.type, ch.scale, ch.shift));
+            }
+            return Section(pieces.size() == 1 ? pieces[0] : stfio::chainSamples(pieces), label);
+        }
+        std::size_t n_samples = 0;
+        for (std::size_t n_b = 0; n_b < run.size(); ++n_b) {
+            n_samples += run[n_b].size;
+        }
+        Vector_double samples(n_samples);
+        std::size_t n_done = 0;
+        for (std::size_t n_b = 0; n_b < run.size(); ++n_b) {
+            stfio::decodeSamples(file.GetData()+run[n_b].offset, run[n_b].size, sampleSize,
+                                 ch.type, true, ch.scale, ch.shift, &samples[n_done]);
+            n_done += run[n_b].size;
+        }
+        return Section(STFIO_MOVE(samples), label);
+    }
 }
 
-COREDLL_API
-void stimfit::SON::importSONFile(const wxString& fName, Recording& ReturnData) {
-	wxProgressDialog progDlg(
-		wxT("SON file import"),
-		wxT("Starting file import"),
-		100,
-		NULL,
-		wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_APP_MODAL
-	);
-	short sFh = SONOpenOldFile(fName.c_str(),0); // try to open file 
-	if (sFh < 0) {
-		std::string errorMsg(SONError(sFh));
-		throw std::runtime_error(errorMsg);
-	}
-	WORD usPerTime = SONGetusPerTime(sFh); /* Get time information */
-	double dTickLen = SONTimeBase(sFh, 0.0); /* base tick units, seconds */	
-	std::vector<int> channel_indices;
-	for (int i=0;i<SONMaxChans(sFh); ++i) { // for each data channel
-		switch (SONChanKind(sFh, i)) {
-			case Adc: //printf("%2d is Adc data\n",i); break;
-			case RealWave: //printf("%2d RealWave data\n", i); break;
-				channel_indices.push_back(i);
-				break;
-			case AdcMark: //printf("%2d AdcMark data\n",i); break;
-			case ChanOff: break; /* do nothing if channel unused */
-			case EventFall: break;//printf("%2d Event on falling edge\n",i); break;
-			case EventRise: break;//printf("%2d Event on rising edge\n",i); break;
-			case EventBoth: break;//printf("%2d Event on both edges\n",i); break;
-			case Marker: break;//printf("%2d Marker data\n",i); break;
-			case RealMark: break;//printf("%2d RealMark data\n",i); break;
-			case TextMark: break;//printf("%2d TextMark data\n",i); break;
-			default: 
-				throw std::runtime_error("Unknown channel type in SON::importSONFile()");
-		}
-	}
-	if (channel_indices.empty())
-		throw std::runtime_error(
-			"Error in SON::importSONFile():\n"
-			"No Adc or RealWave data found\n"
-		);
-	ReturnData.resize(channel_indices.size());
-	for (std::size_t n_c=0;n_c<channel_indices.size();++n_c) {
-		// shorthand:
-		WORD chan=(WORD)channel_indices[n_c];
-
-		// read channel info:
-		std::vector<char> szvComment(SON_CHANCOMSZ+1); /* SON_CHANCOMSZ is 71 */
-		SONGetChanComment(sFh, chan, &szvComment[0], SON_CHANCOMSZ);
-		std::string szComment(szvComment.begin(),szvComment.end()); /* the channel comment */
-		std::vector<char> szvTitle(SON_TITLESZ+1); /* SON_TITLESZ is 9 */
-		SONGetChanTitle(sFh, chan, &szvTitle[0]);
-		std::string szTitle(szvTitle.begin(),szvTitle.end()); /* the channel title */
-		float scale,offset;
-		std::vector<char> szUnits(SON_UNITSZ+1);
-		WORD points;
-		short preTrig;
-		SONGetADCInfo(sFh,chan,&scale,&offset,&szUnits[0],&points,&preTrig);
-		// if this is AdcMark data, get duration from number of points:
-		long bTime=0,eTime=0;
-		Channel TempChannel;
-		TempChannel.SetChannelName(szTitle);
-		std::size_t n_s=0;
-		while (points) {
-			long actBTime; /* for returned time of first data point */
-			int pow2=1 << 24;
-			std::vector<float> afData(pow2); /* example floating point data */
-			points=SONGetRealData(
-				sFh, 
-				chan, 
-				&afData[0],
-				(long)afData.size(), 
-				bTime, 
-				(long)afData.size()*SONChanDivide(sFh, chan),
-				&actBTime, 
-				NULL
-			);
-			if (points<0) {
-				std::string errorMsg(SONError(points));
-				throw std::runtime_error(errorMsg);
-			}
-			if (points>0) {
-				std::ostringstream label;
-				label << fName << ", Section #" << n_s+1;
-				Section TempSection(points,label.str());
-				std::copy(afData.begin(),afData.begin()+points,&TempSection[0]);
-				TempChannel.resize(n_s+1);
-				TempChannel.insert_section(TempSection,n_s++);
-			}
-			bTime = bTime + (points * SONChanDivide(sFh, chan));
-		}
-		// make a string:
-		std::string units(szUnits.begin(),szUnits.begin()+SON_UNITSZ+1);
-		ReturnData.SetGlobalYUnits(n_c,units);
-		long lDivide = SONChanDivide(sFh, (long)n_c); /* get interval for channel 3 */
-		ReturnData.SetXScale(lDivide*(usPerTime*dTickLen)*1e3); /* frequency in kHz */
-		ReturnData.InsertChannel(TempChannel,n_c);
-	}
-	SONCloseFile(sFh);
+void stfio::importSONFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg) {
+#if (__cplusplus < 201103)
+    boost::shared_ptr<MappedFile> file(new MappedFile(fName));
+#else
+    std::shared_ptr<MappedFile> file(new MappedFile(fName));
+#endif
+    if (file->GetSize() < kFileHeaderSize) {
+        throw std::runtime_error("File is too short to be a SON file");
+    }
+    short version = get<short>(*file, 0);
+    if (version < 1 || version > 8) {
+        throw std::runtime_error("Unsupported SON file version; only 32-bit SON files can be read");
+    }
+    short usPerTime = get<short>(*file, 20);
+    short timePerADC = get<short>(*file, 22);
+    short n_channels = get<short>(*file, 30);
+    // versions before 6 count time in microseconds:
+    double timeBase = version < 6 ? 1e-6 : get<double>(*file, 44);
+    if (n_channels < 0 || (file->GetSize()-kFileHeaderSize) / kChannelHeaderSize < (std::size_t)n_channels) {
+        throw std::runtime_error("Invalid number of channels in SON file");
+    }
+
+    std::vector<SonChannel> imported;
+    int divide = 0;
+    for (short n_c = 0; n_c < n_channels; ++n_c) {
+        std::size_t header = kFileHeaderSize + n_c*kChannelHeaderSize;
+        unsigned char kind = get<unsigned char>(*file, header+122);
+        if (kind != kKindAdc && kind != kKindRealWave) {
+            continue;
+        }
+        // sampling interval in clock ticks:
+        int chDivide = version < 6 ?
+            get<short>(*file, header+138) * timePerADC : get<int>(*file, header+102);
+        if (chDivide <= 0 || (divide != 0 && chDivide != divide)) {
+            continue;
+        }
+        divide = chDivide;
+        SonChannel ch;
+        ch.title = getString(*file, header+108, 10);
+        ch.units = getString(*file, header+132, 6);
+        if (kind == kKindAdc) {
+            ch.type = stfio::sample_int16;
+            ch.scale = get<float>(*file, header+124) / kAdcScale;
+            ch.shift = get<float>(*file, header+128);
+        } else {
+            ch.type = stfio::sample_float32;
+            ch.scale = 1.0;
+            ch.shift = 0.0;
+        }
+        ch.runs = readBlocks(*file, get<int>(*file, header+6), divide, stfio::sampleSize(ch.type));
+        if (!ch.runs.empty()) {
+            imported.push_back(ch);
+        }
+        progDlg.Update((int)(100.0*(n_c+1)/n_channels), "Reading SON channels");
+    }
+
+    double dt = divide*usPerTime*timeBase*1e3;
+    ReturnData.resize(imported.size());
+    for (std::size_t n_c = 0; n_c < imported.size(); ++n_c) {
+        const SonChannel& ch = imported[n_c];
+        Channel TempChannel(ch.runs.size());
+        for (std::size_t n_s = 0; n_s < ch.runs.size(); ++n_s) {
+            std::ostringstream label;
+            label << "Start: " << ch.runs[n_s][0].start*usPerTime*timeBase << " s";
+            TempChannel.InsertSection(readSection(*file, file, ch, ch.runs[n_s], label.str()), n_s);
+        }
+        TempChannel.SetChannelName(ch.title);
+        TempChannel.SetYUnits(ch.units);
+        ReturnData.InsertChannel(STFIO_MOVE(TempChannel), n_c);
+    }
+    if (!imported.empty()) {
+        ReturnData.SetXScale(dt);
+    }
+
+    std::string comment;
+    for (int n_f = 0; n_f < kFileComments; ++n_f) {
+        std::string line = getString(*file, 112 + n_f*kFileCommentSize, kFileCommentSize);
+        if (!line.empty()) {
+            comment += (comment.empty() ? "" : "\n") + line;
+        }
+    }
+    ReturnData.SetComment(comment);
+    if (version >= 6) {
+        unsigned short year = get<unsigned short>(*file, 58);
+        if (year > 0) {
+            ReturnData.SetDateTime(year-1900, get<unsigned char>(*file, 57)-1, get<unsigned char>(*file, 56),
+                                   get<unsigned char>(*file, 55), get<unsigned char>(*file, 54),
+                                   get<unsigned char>(*file, 53));
+        }
+    }
 }
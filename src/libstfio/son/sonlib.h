@@ -12,22 +12,36 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
+/*! \file sonlib.h
+ *  \brief Import CED Spike2 (SON) files.
+ */
+
 #ifndef _SONLIB_H
 #define _SONLIB_H
 
-#include <string>
-#include <vector>
-#include "../../core/stimfit_core.h"
-#include "Son.H"
-#pragma once
-
-namespace stimfit {
-	namespace SON {
-		//Open a CFS file and store its contents to a Recording object:
-		std::string SONError(short errorCode);
-		COREDLL_API
-		void importSONFile(const wxString& fName, Recording& ReturnData);
-	}
+#include "./../stfio.h"
+
+class Recording;
+
+namespace stfio {
+
+//! Open a CED Spike2 (32-bit SON) file and store its contents to a Recording object.
+/*! Every Adc and RealWave channel that is sampled at the same rate as
+ *  the first one becomes a channel; the other channel kinds (events,
+ *  markers) are ignored. The data blocks of a channel are read in place:
+ *  16-bit Adc samples stay in the file and are scaled on demand (see
+ *  stfio::MappedSamples), and blocks that follow each other without a
+ *  gap are chained into a single section rather than copied. A new
+ *  section starts wherever sampling was interrupted, e.g. between the
+ *  sweeps of triggered recordings. Throws std::runtime_error if the file
+ *  can't be read, e.g. because it's a 64-bit (.smrx) file.
+ *  \param fName Full path to the file to be read.
+ *  \param ReturnData On entry, an empty Recording object. On exit,
+ *         the data stored in \e fName.
+ *  \param progDlg Progress indicator.
+ */
+void importSONFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg);
+
 }
 
 #endif
@@ -25,10 +25,19 @@
 
 
 #include <sstream>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "stfio.h"
+#include "./profile.h"
+#include "./parallel.h"
 
-// TODO #include "./ascii/asciilib.h"
+#include "./ascii/asciilib.h"
 #include "./hdf5/hdf5lib.h"
 #include "./abf/abflib.h"
 #include "./atf/atflib.h"
@@ -39,6 +48,12 @@
 #endif
 #include "./cfs/cfslib.h"
 #include "./intan/intanlib.h"
+#include "./tdms/tdmslib.h"
+#include "./nwb/nwblib.h"
+#include "./zarr/zarrlib.h"
+#include "./sidecar.h"
+#include "./memory.h"
+#include "./son/sonlib.h"
 #ifndef TEST_MINIMAL
   #include "./heka/hekalib.h"
 #else
@@ -46,9 +61,6 @@
     #error -DTEST_MINIMAL requires -DWITH_BIOSIG or -DWITH_BIOSIG2
   #endif
 #endif
-#if 0
-#include "./son/sonlib.h"
-#endif
 
 #ifdef _MSC_VER
     StfioDll long int lround(double x) {
@@ -66,21 +78,232 @@ stfio::StdoutProgressInfo::StdoutProgressInfo(const std::string& title, const st
       verbosity(verbose)
 {
     if (verbosity) {
-        std::cout << title << std::endl;
-        std::cout << message << std::endl;
+        std::cout << title + "\n" + message + "\n" << std::flush;
     }
 }
 
 bool stfio::StdoutProgressInfo::Update(int value, const std::string& newmsg, bool* skip) {
     if (verbosity) {
-        std::cout << "\r";
-        std::cout.width(3);
-        std::cout << value << "% " << newmsg
-                  << std::flush;
+        std::ostringstream line;
+        line << "\r";
+        line.width(3);
+        line << value << "% " << newmsg;
+        std::cout << line.str() << std::flush;
     }
     return true;
 }
 
+namespace {
+
+    // Atomic operations on long integers that also work with C++98 compilers.
+    // All of them are full memory barriers.
+    long atomicLoad(volatile long* p) {
+#ifdef _MSC_VER
+        return _InterlockedCompareExchange(p, 0, 0);
+#else
+        return __sync_fetch_and_add(p, 0);
+#endif
+    }
+
+    long atomicAdd(volatile long* p, long n) {
+#ifdef _MSC_VER
+        return _InterlockedExchangeAdd(p, n) + n;
+#else
+        return __sync_add_and_fetch(p, n);
+#endif
+    }
+
+    long atomicExchange(volatile long* p, long n) {
+#ifdef _MSC_VER
+        return _InterlockedExchange(p, n);
+#else
+        return __sync_lock_test_and_set(p, n);
+#endif
+    }
+
+    bool atomicCompareExchange(volatile long* p, long expected, long n) {
+#ifdef _MSC_VER
+        return _InterlockedCompareExchange(p, n, expected) == expected;
+#else
+        return __sync_bool_compare_and_swap(p, expected, n);
+#endif
+    }
+
+}
+
+stfio::AtomicProgressInfo::AtomicProgressInfo(const std::string& title, const std::string& message_,
+                                              int maximum_, bool verbose)
+    : ProgressInfo(title, message_, maximum_, verbose), maximum(maximum_),
+      value(0), cancelled(0), generation(0), polledGeneration(0),
+      msgLock(0), msgChanged(0), message(message_)
+{
+    if (!message.empty()) {
+        msgChanged = 1;
+        generation = 1;
+    }
+}
+
+bool stfio::AtomicProgressInfo::Update(int newValue, const std::string& newmsg, bool* skip) {
+    long oldValue = atomicExchange(&value, newValue);
+    // messages are only copied when the value changes, or if nothing has been reported yet:
+    if (oldValue != newValue || atomicLoad(&generation) == 0) {
+        if (!newmsg.empty() && atomicCompareExchange(&msgLock, 0, 1)) {
+            message = newmsg;
+            atomicExchange(&msgChanged, 1);
+            atomicExchange(&msgLock, 0);
+        }
+        atomicAdd(&generation, 1);
+    }
+    bool isCancelled = IsCancelled();
+    if (skip != NULL) {
+        *skip = isCancelled;
+    }
+    return !isCancelled;
+}
+
+bool stfio::AtomicProgressInfo::Step(int n) {
+    atomicAdd(&value, n);
+    atomicAdd(&generation, 1);
+    return !IsCancelled();
+}
+
+void stfio::AtomicProgressInfo::Cancel() {
+    atomicExchange(&cancelled, 1);
+}
+
+bool stfio::AtomicProgressInfo::IsCancelled() const {
+    return atomicLoad(const_cast<volatile long*>(&cancelled)) != 0;
+}
+
+bool stfio::AtomicProgressInfo::Poll(int& value_, std::string& msg) {
+    long gen = atomicLoad(&generation);
+    value_ = (int)atomicLoad(&value);
+    if (atomicCompareExchange(&msgLock, 0, 1)) {
+        if (msgChanged != 0) {
+            msg = message;
+            msgChanged = 0;
+        }
+        atomicExchange(&msgLock, 0);
+    }
+    bool changed = (gen != polledGeneration);
+    polledGeneration = gen;
+    return changed;
+}
+
+stfio::ParallelProgress::ParallelProgress(ProgressInfo& progDlg_, int total_, const std::string& message_,
+                                          int begin_, int end_)
+    : progDlg(progDlg_), total(total_ > 0 ? total_ : 1), begin(begin_), end(end_), lastValue(begin_),
+      message(message_), done(0), cancelled(0)
+{
+    if (!progDlg.Update(begin, message)) {
+        cancelled = 1;
+    }
+}
+
+bool stfio::ParallelProgress::Step(int n) {
+    long nDone = atomicAdd(&done, n);
+#ifdef _OPENMP
+    if (omp_get_thread_num() != 0) {
+        return !IsCancelled();
+    }
+#endif
+    int value = begin + (int)((double)(end-begin)*std::min(nDone, (long)total)/total);
+    if (value != lastValue) {
+        lastValue = value;
+        if (!progDlg.Update(value, message)) {
+            atomicExchange(&cancelled, 1);
+        }
+    }
+    return !IsCancelled();
+}
+
+bool stfio::ParallelProgress::IsCancelled() const {
+    return atomicLoad(const_cast<volatile long*>(&cancelled)) != 0;
+}
+
+namespace {
+
+    // Libraries that keep global state, such as file tables or the HDF5
+    // library, which is shut down after every file. Each of them may only
+    // be used by one thread at a time. The locks are nested because sections
+    // that are read lazily from NWB files lock the HDF5 library again when
+    // they're exported.
+    enum formatLibrary { lib_hdf5, lib_axon, lib_cfs, lib_biosig, lib_none };
+
+#ifdef _OPENMP
+    class FormatLocks {
+     public:
+        FormatLocks() { for (int n = 0; n < lib_none; ++n) omp_init_nest_lock(&locks[n]); }
+        ~FormatLocks() { for (int n = 0; n < lib_none; ++n) omp_destroy_nest_lock(&locks[n]); }
+        omp_nest_lock_t locks[lib_none];
+    };
+    FormatLocks formatLocks;
+#endif
+
+    formatLibrary findLibrary(stfio::filetype type) {
+        switch (type) {
+         case stfio::hdf5:
+         case stfio::nwb: return lib_hdf5;
+         case stfio::abf:
+         case stfio::atf: return lib_axon;
+         case stfio::cfs: return lib_cfs;
+         case stfio::biosig: return lib_biosig;
+         default: return lib_none;
+        }
+    }
+
+#ifdef WITH_PROFILING
+    // Names of the profiled regions of stfio::importFile():
+    const char* importRegion(stfio::filetype type) {
+        switch (type) {
+         case stfio::atf: return "importFile/atf";
+         case stfio::abf: return "importFile/abf";
+         case stfio::axg: return "importFile/axg";
+         case stfio::ascii: return "importFile/ascii";
+         case stfio::cfs: return "importFile/cfs";
+         case stfio::igor: return "importFile/igor";
+         case stfio::son: return "importFile/son";
+         case stfio::hdf5: return "importFile/hdf5";
+         case stfio::heka: return "importFile/heka";
+         case stfio::biosig: return "importFile/biosig";
+         case stfio::tdms: return "importFile/tdms";
+         case stfio::intan: return "importFile/intan";
+         case stfio::nwb: return "importFile/nwb";
+         case stfio::zarr: return "importFile/zarr";
+         default: return "importFile/none";
+        }
+    }
+#endif
+
+    // Collects the results of importFiles():
+    class CollectRecordings : public stfio::ImportCallback {
+     public:
+        explicit CollectRecordings(std::vector<Recording>& recordings_, const std::vector<std::string>& fNames_)
+            : recordings(recordings_), fNames(fNames_) {}
+        void Imported(std::size_t index, Recording& data) { recordings[index] = data; }
+        void Failed(std::size_t index, const std::string& error) {
+            errors << fNames[index] << ": " << error << "\n";
+        }
+        std::string GetErrors() const { return errors.str(); }
+     private:
+        std::vector<Recording>& recordings;
+        const std::vector<std::string>& fNames;
+        std::ostringstream errors;
+    };
+}
+
+stfio::LibraryLock::LibraryLock(stfio::filetype type) : library(findLibrary(type)) {
+#ifdef _OPENMP
+    if (library != lib_none) omp_set_nest_lock(&formatLocks.locks[library]);
+#endif
+}
+
+stfio::LibraryLock::~LibraryLock() {
+#ifdef _OPENMP
+    if (library != lib_none) omp_unset_nest_lock(&formatLocks.locks[library]);
+#endif
+}
+
 #ifndef TEST_MINIMAL
 stfio::filetype
 stfio::findType(const std::string& ext) {
@@ -97,6 +320,8 @@ stfio::findType(const std::string& ext) {
     else if (ext=="*.smr") return stfio::son;
     else if (ext=="*.tdms") return stfio::tdms;
     else if (ext=="*.clp") return stfio::intan;
+    else if (ext=="*.nwb") return stfio::nwb;
+    else if (ext=="*.zarr" || ext=="*.zgroup") return stfio::zarr;
 #if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
 #  if (BIOSIG_VERSION < 10800)
     else if (ext=="*.dat;*.cfs;*.gdf;*.ibw") return stfio::biosig;
@@ -133,6 +358,10 @@ stfio::findExtension(stfio::filetype ftype) {
          return ".tdms";
      case stfio::intan:
          return ".clp";
+     case stfio::nwb:
+         return ".nwb";
+     case stfio::zarr:
+         return ".zarr";
 #if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
      case stfio::biosig:
          return ".gdf";
@@ -142,12 +371,64 @@ stfio::findExtension(stfio::filetype ftype) {
     }
 }
 
+// Runs the importer of a file type:
+static bool importFormat(
+        const std::string& fName,
+        stfio::filetype type,
+        Recording& ReturnData,
+        const stfio::txtImportSettings& txtImport,
+        stfio::ProgressInfo& progDlg);
+
 bool stfio::importFile(
         const std::string& fName,
         stfio::filetype type,
         Recording& ReturnData,
         const stfio::txtImportSettings& txtImport,
         ProgressInfo& progDlg
+) {
+    // text imports depend on the settings and therefore aren't indexed;
+    // Zarr stores are read lazily and may not be local:
+    bool indexed = getSidecarIndex() && type != stfio::ascii && type != stfio::zarr;
+    if (indexed && importSidecar(fName, ReturnData)) {
+        return true;
+    }
+    // samples that don't fit into the memory budget are stored compactly or mapped:
+    storage_mode storage = chooseStorage(getMemoryBudget() > 0 ? estimateDecodedSize(fName, type) : 0);
+    bool success = importFormat(fName, type, ReturnData, txtImport, progDlg);
+    if (success && storage != storage_eager) {
+        compactRecording(ReturnData);
+    }
+    if (success && storage == storage_mapped && type != stfio::ascii && type != stfio::zarr) {
+        // the sidecar index holds the samples that aren't read from the file anyway:
+        try {
+            exportSidecar(fName, ReturnData);
+            Recording mapped;
+            if (importSidecar(fName, mapped)) {
+                ReturnData = mapped;
+            }
+        }
+        catch (const std::exception&) {
+            // e.g. a read-only directory; the samples stay in memory
+        }
+        return success;
+    }
+    if (indexed && success) {
+        try {
+            exportSidecar(fName, ReturnData);
+        }
+        catch (const std::exception&) {
+            // e.g. a read-only directory; the file is imported again next time
+        }
+    }
+    return success;
+}
+
+static bool importFormat(
+        const std::string& fName,
+        stfio::filetype type,
+        Recording& ReturnData,
+        const stfio::txtImportSettings& txtImport,
+        stfio::ProgressInfo& progDlg
 ) {
     try {
 
@@ -158,6 +439,7 @@ bool stfio::importFile(
         if (!check_biosig_version(1,6,3)) {
             try {
                 // workaround for older versions of libbiosig
+                stfio::LibraryLock lock(stfio::abf);
                 stfio::importABFFile(fName, ReturnData, progDlg);
                 return true;
             }
@@ -171,6 +453,8 @@ bool stfio::importFile(
 
        // if this point is reached, import ABF was not applied or not successful
         try {
+            stfio::LibraryLock lock(stfio::biosig);
+            STF_PROFILE_SCOPE("importFile/biosig");
             stfio::filetype type1 = stfio::importBiosigFile(fName, ReturnData, progDlg);
             switch (type1) {
             case stfio::biosig:
@@ -187,6 +471,8 @@ bool stfio::importFile(
         }
 #endif
 
+        stfio::LibraryLock lock(type);
+        STF_PROFILE_SCOPE(importRegion(type));
         switch (type) {
         case stfio::hdf5: {
             stfio::importHDF5File(fName, ReturnData, progDlg);
@@ -212,6 +498,35 @@ bool stfio::importFile(
             stfio::importIntanFile(fName, ReturnData, progDlg);
             break;
         }
+        case stfio::tdms: {
+            stfio::importTDMSFile(fName, ReturnData, progDlg);
+            break;
+        }
+        case stfio::nwb: {
+            stfio::importNWBFile(fName, ReturnData, progDlg);
+            break;
+        }
+        case stfio::zarr: {
+            stfio::importZarrFile(fName, ReturnData, progDlg);
+            break;
+        }
+        case stfio::son: {
+            stfio::importSONFile(fName, ReturnData, progDlg);
+            break;
+        }
+        case stfio::ascii: {
+            stfio::importASCIIFile( fName, txtImport.hLines, txtImport.ncolumns,
+                    txtImport.firstIsTime, txtImport.toSection, ReturnData, progDlg );
+            if (!txtImport.firstIsTime) {
+                ReturnData.SetXScale(1.0/txtImport.sr);
+            }
+            if (ReturnData.size()>0)
+                ReturnData[0].SetYUnits(txtImport.yUnits);
+            if (ReturnData.size()>1)
+                ReturnData[1].SetYUnits(txtImport.yUnitsCh2);
+            ReturnData.SetXUnits(txtImport.xUnits);
+            break;
+        }
 
 #ifndef TEST_MINIMAL
         case stfio::cfs: {
@@ -244,26 +559,6 @@ bool stfio::importFile(
         default:
             throw std::runtime_error("Unknown or unsupported file type");
 	}
-
-#if 0
-        case stfio::son: {
-            stfio::SON::importSONFile(fName,ReturnData);
-            break;
-        }
-        case stfio::ascii: {
-            stfio::importASCIIFile( fName, txtImport.hLines, txtImport.ncolumns,
-                    txtImport.firstIsTime, txtImport.toSection, ReturnData );
-            if (!txtImport.firstIsTime) {
-                ReturnData.SetXScale(1.0/txtImport.sr);
-            }
-            if (ReturnData.size()>0)
-                ReturnData[0].SetYUnits(txtImport.yUnits);
-            if (ReturnData.size()>1)
-                ReturnData[1].SetYUnits(txtImport.yUnitsCh2);
-            ReturnData.SetXUnits(txtImport.xUnits);
-            break;
-        }
-#endif
     }
     catch (...) {
         throw;
@@ -271,10 +566,34 @@ bool stfio::importFile(
     return true;
 }
 
-bool stfio::exportFile(const std::string& fName, stfio::filetype type, const Recording& Data,
+void stfio::importFileRange(const std::string& fName, stfio::filetype type, Recording& ReturnData,
+                            ProgressInfo& progDlg, std::size_t section_begin, std::size_t section_end)
+{
+    LibraryLock lock(type);
+    switch (type) {
+     case stfio::hdf5:
+        stfio::importHDF5Range(fName, ReturnData, progDlg, section_begin, section_end);
+        break;
+     default:
+        throw std::runtime_error("Reading section ranges is not supported for this file type");
+    }
+}
+
+std::vector<std::size_t> stfio::getSectionCounts(const std::string& fName, stfio::filetype type) {
+    LibraryLock lock(type);
+    switch (type) {
+     case stfio::hdf5:
+        return stfio::getHDF5SectionCounts(fName);
+     default:
+        return std::vector<std::size_t>();
+    }
+}
+
+bool stfio::exportFile(const std::string& fName, stfio::filetype type, const RecordingView& Data,
                        ProgressInfo& progDlg)
 {
     try {
+        LibraryLock lock(type);
         switch (type) {
 #ifndef WITHOUT_ABF
         case stfio::atf: {
@@ -284,7 +603,7 @@ bool stfio::exportFile(const std::string& fName, stfio::filetype type, const Rec
 #endif
 #if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
         case stfio::biosig: {
-            stfio::exportBiosigFile(fName, Data, progDlg);
+            stfio::exportBiosigFile(fName, Data.Copy(), progDlg);
             break;
         }
 #endif
@@ -292,12 +611,41 @@ bool stfio::exportFile(const std::string& fName, stfio::filetype type, const Rec
             stfio::exportCFSFile(fName, Data, progDlg);
             break;
         }
+        case stfio::ascii: {
+            // a series of files, one per section:
+            std::string stem(fName);
+            if (stem.size() > 4 && stem.compare(stem.size()-4, 4, ".txt") == 0) {
+                stem.resize(stem.size()-4);
+            }
+            for (std::size_t n_c = 0; n_c < Data.size(); ++n_c) {
+                std::ostringstream chName;
+                chName << stem;
+                if (Data.size() > 1) {
+                    chName << "_ch" << (int)n_c;
+                }
+                stfio::exportASCIIFile(chName.str(), Data[n_c]);
+            }
+            break;
+        }
         case stfio::hdf5: {
             stfio::exportHDF5File(fName, Data, progDlg);
             break;
         }
+        case stfio::nwb: {
+            stfio::exportNWBFile(fName, Data, progDlg);
+            break;
+        }
+        case stfio::zarr: {
+            stfio::exportZarrFile(fName, Data, progDlg);
+            break;
+        }
         case stfio::igor: {
-            stfio::exportIGORFile(fName, Data, progDlg);
+            // a single packed experiment rather than one file per channel:
+            if (fName.size() > 4 && fName.compare(fName.size()-4, 4, ".pxp") == 0) {
+                stfio::exportIGORPackedFile(fName, Data, progDlg);
+            } else {
+                stfio::exportIGORFile(fName, Data, progDlg);
+            }
             break;
         }
         default:
@@ -310,54 +658,197 @@ bool stfio::exportFile(const std::string& fName, stfio::filetype type, const Rec
     return true;
 }
 
+void stfio::importFiles(const std::vector<std::string>& fNames, const std::vector<stfio::filetype>& types,
+                        ImportCallback& callback, const stfio::txtImportSettings& txtImport, int n_threads)
+{
+    if (types.size() != fNames.size()) {
+        throw std::out_of_range("Number of file types doesn't match number of files in stfio::importFiles");
+    }
+    int n_files = (int)fNames.size();
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_files);
+    // headers take very different times to parse, so files are handed out one by one:
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_f = 0; n_f < n_files; ++n_f) {
+        Recording data;
+        stfio::StdoutProgressInfo progDlg("", "", 100, false);
+        std::string error;
+        try {
+            if (!stfio::importFile(fNames[n_f], types[n_f], data, txtImport, progDlg)) {
+                error = "Error importing file";
+            }
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+        }
+        catch (...) {
+            error = "Unknown error importing file";
+        }
+#ifdef _OPENMP
+#pragma omp critical(stfio_import_callback)
+#endif
+        {
+            if (error.empty()) {
+                callback.Imported(n_f, data);
+            } else {
+                callback.Failed(n_f, error);
+            }
+        }
+    }
+}
+
+std::vector<Recording> stfio::importFiles(const std::vector<std::string>& fNames,
+                                          const std::vector<stfio::filetype>& types,
+                                          const stfio::txtImportSettings& txtImport, int n_threads)
+{
+    std::vector<Recording> recordings(fNames.size());
+    CollectRecordings collect(recordings, fNames);
+    importFiles(fNames, types, collect, txtImport, n_threads);
+    if (!collect.GetErrors().empty()) {
+        throw std::runtime_error("Couldn't import the following files:\n" + collect.GetErrors());
+    }
+    return recordings;
+}
+
 Vector_double stfio::vec_scal_plus(const Vector_double& vec, double scalar) {
-    Vector_double ret_vec(vec.size(), scalar);
-    std::transform(vec.begin(), vec.end(), ret_vec.begin(), ret_vec.begin(), std::plus<double>());
+    Vector_double ret_vec;
+    vec_scal_plus(vec, scalar, ret_vec);
     return ret_vec;
 }
 
 Vector_double stfio::vec_scal_minus(const Vector_double& vec, double scalar) {
-    Vector_double ret_vec(vec.size(), scalar);
-    std::transform(vec.begin(), vec.end(), ret_vec.begin(), ret_vec.begin(), std::minus<double>());
+    Vector_double ret_vec;
+    vec_scal_minus(vec, scalar, ret_vec);
     return ret_vec;
 }
 
 Vector_double stfio::vec_scal_mul(const Vector_double& vec, double scalar) {
-    Vector_double ret_vec(vec.size(), scalar);
-    std::transform(vec.begin(), vec.end(), ret_vec.begin(), ret_vec.begin(), std::multiplies<double>());
+    Vector_double ret_vec;
+    vec_scal_mul(vec, scalar, ret_vec);
     return ret_vec;
 }
 
 Vector_double stfio::vec_scal_div(const Vector_double& vec, double scalar) {
-    Vector_double ret_vec(vec.size(), scalar);
-    std::transform(vec.begin(), vec.end(), ret_vec.begin(), ret_vec.begin(), std::divides<double>());
+    Vector_double ret_vec;
+    vec_scal_div(vec, scalar, ret_vec);
     return ret_vec;
 }
 
 Vector_double stfio::vec_vec_plus(const Vector_double& vec1, const Vector_double& vec2) {
-    Vector_double ret_vec(vec1.size());
-    std::transform(vec1.begin(), vec1.end(), vec2.begin(), ret_vec.begin(), std::plus<double>());
+    Vector_double ret_vec;
+    vec_vec_plus(vec1, vec2, ret_vec);
     return ret_vec;
 }
 
 Vector_double stfio::vec_vec_minus(const Vector_double& vec1, const Vector_double& vec2) {
-    Vector_double ret_vec(vec1.size());
-    std::transform(vec1.begin(), vec1.end(), vec2.begin(), ret_vec.begin(), std::minus<double>());
+    Vector_double ret_vec;
+    vec_vec_minus(vec1, vec2, ret_vec);
     return ret_vec;
 }
 
 Vector_double stfio::vec_vec_mul(const Vector_double& vec1, const Vector_double& vec2) {
-    Vector_double ret_vec(vec1.size());
-    std::transform(vec1.begin(), vec1.end(), vec2.begin(), ret_vec.begin(), std::multiplies<double>());
+    Vector_double ret_vec;
+    vec_vec_mul(vec1, vec2, ret_vec);
     return ret_vec;
 }
 
 Vector_double stfio::vec_vec_div(const Vector_double& vec1, const Vector_double& vec2) {
-    Vector_double ret_vec(vec1.size());
-    std::transform(vec1.begin(), vec1.end(), vec2.begin(), ret_vec.begin(), std::divides<double>());
+    Vector_double ret_vec;
+    vec_vec_div(vec1, vec2, ret_vec);
     return ret_vec;
 }
 
+void stfio::vec_scal_plus(const Vector_double& vec, double scalar, Vector_double& out) {
+    std::size_t size = vec.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec[n] + scalar;
+    }
+}
+
+void stfio::vec_scal_minus(const Vector_double& vec, double scalar, Vector_double& out) {
+    std::size_t size = vec.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec[n] - scalar;
+    }
+}
+
+void stfio::vec_scal_mul(const Vector_double& vec, double scalar, Vector_double& out) {
+    std::size_t size = vec.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec[n] * scalar;
+    }
+}
+
+void stfio::vec_scal_div(const Vector_double& vec, double scalar, Vector_double& out) {
+    std::size_t size = vec.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec[n] / scalar;
+    }
+}
+
+void stfio::vec_vec_plus(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out) {
+    if (vec1.size() != vec2.size()) {
+        throw std::out_of_range("Vector sizes differ in stfio::vec_vec_plus");
+    }
+    std::size_t size = vec1.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec1[n] + vec2[n];
+    }
+}
+
+void stfio::vec_vec_minus(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out) {
+    if (vec1.size() != vec2.size()) {
+        throw std::out_of_range("Vector sizes differ in stfio::vec_vec_minus");
+    }
+    std::size_t size = vec1.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec1[n] - vec2[n];
+    }
+}
+
+void stfio::vec_vec_mul(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out) {
+    if (vec1.size() != vec2.size()) {
+        throw std::out_of_range("Vector sizes differ in stfio::vec_vec_mul");
+    }
+    std::size_t size = vec1.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec1[n] * vec2[n];
+    }
+}
+
+void stfio::vec_vec_div(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out) {
+    if (vec1.size() != vec2.size()) {
+        throw std::out_of_range("Vector sizes differ in stfio::vec_vec_div");
+    }
+    std::size_t size = vec1.size();
+    out.resize(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        out[n] = vec1[n] / vec2[n];
+    }
+}
+
+void stfio::scale_offset_inplace(Vector_double& vec, double scale, double offset) {
+    std::size_t size = vec.size();
+    for (std::size_t n = 0; n < size; ++n) {
+        vec[n] = vec[n]*scale + offset;
+    }
+}
+
+void stfio::offset_scale_inplace(Vector_double& vec, double offset, double scale) {
+    std::size_t size = vec.size();
+    for (std::size_t n = 0; n < size; ++n) {
+        vec[n] = (vec[n]+offset)*scale;
+    }
+}
+
 Recording
 stfio::concatenate(const Recording& src, const std::vector<std::size_t>& sections,
                    ProgressInfo& progDlg)
@@ -366,45 +857,31 @@ stfio::concatenate(const Recording& src, const std::vector<std::size_t>& section
     Recording Concatenated(NC, 1);
 
     for (nc = 0; nc < NC; nc++) {
-        int new_size=0;
-        for (c_st_it cit = sections.begin(); cit != sections.end(); cit++) {
-            new_size += (int)src[nc][*cit].size();
-        }
-        Section TempSection(new_size);
-        std::size_t n_new=0;
-        std::size_t n_s=0;
+        std::ostringstream progStr;
+        progStr << "Concatenating channel #" << (int)nc+1 << " of " << (int)NC;
+        progDlg.Update((int)((double)nc/(double)NC*100.0), progStr.str());
+
+        // the new section refers to the samples of the selected sections
+        // rather than copying them:
+        std::vector<MappedSamples> pieces;
+        pieces.reserve(sections.size());
+        double xscale = 1.0;
         for (c_st_it cit = sections.begin(); cit != sections.end(); cit++) {
-            std::ostringstream progStr;
-            progStr << "Adding section #" << (int)n_s+1 << " of " << (int)sections.size();
-            progDlg.Update(
-                (int)((double)n_s/(double)sections.size()*100.0),
-                progStr.str()
-            );
-
             if (cit == sections.begin()) {
-                TempSection.SetXScale(src[nc][*cit].GetXScale());
+                xscale = src[nc][*cit].GetXScale();
             }
-            else if (TempSection.GetXScale() != src[nc][*cit].GetXScale()) {
-                Concatenated.resize(0);
+            else if (xscale != src[nc][*cit].GetXScale()) {
                 throw std::runtime_error("can not concatanate because sampling frequency differs");
             }
-
-            std::size_t secSize=src[nc][*cit].size();
-            if (n_new+secSize>TempSection.size()) {
-                Concatenated.resize(0);
-                throw std::runtime_error("memory allocation error");
-            }
-            std::copy(src[nc][*cit].get().begin(),
-                      src[nc][*cit].get().end(),
-                      &TempSection[n_new]);
-            n_new += secSize;
-            n_s++;
+            pieces.push_back(src[nc][*cit].GetSamples());
         }
-        TempSection.SetSectionDescription(src[nc][0].GetSectionDescription() + ", concatenated");
+        Section TempSection(chainSamples(pieces),
+                            src[nc][0].GetSectionDescription() + ", concatenated");
+        TempSection.SetXScale(xscale);
         Channel TempChannel(TempSection);
 	TempChannel.SetChannelName(src[nc].GetChannelName());
 	TempChannel.SetYUnits(src[nc].GetYUnits());
-	Concatenated.InsertChannel(TempChannel, nc);
+	Concatenated.InsertChannel(STFIO_MOVE(TempChannel), nc);
     }
 
     // Recording Concatenated(TempChannel);
@@ -413,34 +890,105 @@ stfio::concatenate(const Recording& src, const std::vector<std::size_t>& section
     return Concatenated;
 }
 
+namespace {
+    // A range of a section that is scaled by a single thread:
+    struct ScaleChunk {
+        const Section* src; // NULL if dest is scaled in place
+        double* dest;
+        std::size_t begin, end;
+    };
+
+    // Splits the sections into chunks that fit into the cache, so that
+    // a few long sections are spread across all threads, too:
+    void addScaleChunks(std::vector<ScaleChunk>& chunks, const Section* src, double* dest,
+                        std::size_t size)
+    {
+        const std::size_t chunkSize = 16384;
+        for (std::size_t begin = 0; begin < size; begin += chunkSize) {
+            ScaleChunk chunk = { src, dest, begin, std::min(size, begin+chunkSize) };
+            chunks.push_back(chunk);
+        }
+    }
+
+    void scaleChunks(const std::vector<ScaleChunk>& chunks, double factor, int n_threads) {
+        int n_chunks = (int)chunks.size();
+#ifdef _OPENMP
+        n_threads = stfio::threadCount(n_threads, n_chunks);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+        for (int n_c = 0; n_c < n_chunks; ++n_c) {
+            const ScaleChunk& chunk = chunks[n_c];
+            double* dest = chunk.dest + chunk.begin;
+            std::size_t size = chunk.end - chunk.begin;
+            if (chunk.src != NULL) {
+                // safe to call concurrently, even on mapped sections:
+                chunk.src->CopyRange(chunk.begin, chunk.end, dest);
+            }
+            for (std::size_t n = 0; n < size; ++n) {
+                dest[n] *= factor;
+            }
+        }
+    }
+
+    // Throws std::out_of_range if the channel or one of the sections doesn't exist:
+    void checkSections(const Recording& rec, const std::vector<std::size_t>& sections,
+                       std::size_t channel, const std::string& caller)
+    {
+        if (channel >= rec.size()) {
+            throw std::out_of_range("Channel index out of range in " + caller);
+        }
+        for (c_st_it cit = sections.begin(); cit != sections.end(); cit++) {
+            if (*cit >= rec[channel].size()) {
+                throw std::out_of_range("Section index out of range in " + caller);
+            }
+        }
+    }
+}
+
 Recording
 stfio::multiply(const Recording& src, const std::vector<std::size_t>& sections,
-                std::size_t channel, double factor)
+                std::size_t channel, double factor, int n_threads)
 {
-    Channel TempChannel(sections.size(), src[channel][sections[0]].size());
-    std::size_t n = 0;
-    for (c_st_it cit = sections.begin(); cit != sections.end(); cit++) {
-        // Multiply the valarray in Data:
-        Section TempSection(stfio::vec_scal_mul(src[channel][*cit].get(),factor));
-        TempSection.SetXScale(src[channel][*cit].GetXScale());
-        TempSection.SetSectionDescription(
-                src[channel][*cit].GetSectionDescription()+
-                ", multiplied"
-        );
-        try {
-            TempChannel.InsertSection(TempSection, n);
-        }
-        catch (const std::out_of_range e) {
-            throw e;
+    checkSections(src, sections, channel, "stfio::multiply");
+    if (sections.empty()) {
+        throw std::runtime_error("Channel empty in stfio::multiply");
+    }
+    Channel TempChannel(sections.size());
+    std::vector<ScaleChunk> chunks;
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        const Section& sec = src[channel][sections[n]];
+        Section TempSection(sec.size(), sec.GetSectionDescription() + ", multiplied");
+        TempSection.SetXScale(sec.GetXScale());
+        TempChannel[n] = STFIO_MOVE(TempSection);
+        if (sec.size() > 0) {
+            addScaleChunks(chunks, &sec, &TempChannel[n].get_w()[0], sec.size());
         }
-        n++;
     }
-    if (TempChannel.size()>0) {
-        Recording Multiplied(TempChannel);
-        Multiplied.CopyAttributes(src);
-        Multiplied[0].SetYUnits( src.at( channel ).GetYUnits() );
-        return Multiplied;
-    } else {
-        throw std::runtime_error("Channel empty in stfio::multiply");
+    scaleChunks(chunks, factor, n_threads);
+
+    Recording Multiplied(STFIO_MOVE(TempChannel));
+    Multiplied.CopyAttributes(src);
+    Multiplied[0].SetYUnits( src.at( channel ).GetYUnits() );
+    return Multiplied;
+}
+
+void
+stfio::multiplyInPlace(Recording& rec, const std::vector<std::size_t>& sections,
+                       std::size_t channel, double factor, int n_threads)
+{
+    checkSections(rec, sections, channel, "stfio::multiplyInPlace");
+    std::vector<std::size_t> sorted(sections);
+    std::sort(sorted.begin(), sorted.end());
+    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) {
+        throw std::runtime_error("Sections are selected more than once in stfio::multiplyInPlace");
+    }
+    std::vector<ScaleChunk> chunks;
+    for (c_st_it cit = sorted.begin(); cit != sorted.end(); cit++) {
+        // decodes mapped samples before the threads start:
+        Vector_double& data = rec[channel][*cit].get_w();
+        if (!data.empty()) {
+            addScaleChunks(chunks, NULL, &data[0], data.size());
+        }
     }
+    scaleChunks(chunks, factor, n_threads);
 }
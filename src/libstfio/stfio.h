@@ -63,6 +63,15 @@ typedef std::vector<float > Vector_float;
     #define snprintf _snprintf
 #endif
 
+// Hands over large temporary objects without copying them where the
+// compiler supports move semantics, and copies them otherwise:
+#if (__cplusplus < 201103)
+    #define STFIO_MOVE(x) (x)
+#else
+    #include <utility>
+    #define STFIO_MOVE(x) std::move(x)
+#endif
+
 #include "./recording.h"
 #include "./channel.h"
 #include "./section.h"
@@ -97,6 +106,46 @@ namespace stfio {
 
     StfioDll Vector_double vec_vec_div(const Vector_double& vec1, const Vector_double& vec2);
 
+    //! Output-buffer versions of the element-wise operations.
+    /*! No memory is allocated if \e out already has the right size. \e out may
+     *  be one of the input vectors, so that e.g. vec_scal_mul(v, 2.0, v) doubles
+     *  v in place. The vec_vec_* versions throw std::out_of_range if the input
+     *  sizes differ.
+     *  \param vec The input vector.
+     *  \param scalar The scalar operand.
+     *  \param out On return, the result.
+     */
+    StfioDll void vec_scal_plus(const Vector_double& vec, double scalar, Vector_double& out);
+
+    StfioDll void vec_scal_minus(const Vector_double& vec, double scalar, Vector_double& out);
+
+    StfioDll void vec_scal_mul(const Vector_double& vec, double scalar, Vector_double& out);
+
+    StfioDll void vec_scal_div(const Vector_double& vec, double scalar, Vector_double& out);
+
+    StfioDll void vec_vec_plus(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out);
+
+    StfioDll void vec_vec_minus(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out);
+
+    StfioDll void vec_vec_mul(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out);
+
+    StfioDll void vec_vec_div(const Vector_double& vec1, const Vector_double& vec2, Vector_double& out);
+
+    //! Scales a vector and adds an offset in a single pass, in place.
+    /*! \param vec On entry, the input; on return, scale*vec+offset.
+     *  \param scale The scaling factor.
+     *  \param offset The offset added after scaling.
+     */
+    StfioDll void scale_offset_inplace(Vector_double& vec, double scale, double offset);
+
+    //! Adds an offset to a vector and scales it in a single pass, in place.
+    /*! Useful to normalize data, e.g. offset_scale_inplace(v, -min, 1.0/(max-min)).
+     *  \param vec On entry, the input; on return, (vec+offset)*scale.
+     *  \param offset The offset added before scaling.
+     *  \param scale The scaling factor.
+     */
+    StfioDll void offset_scale_inplace(Vector_double& vec, double offset, double scale);
+
 //! ProgressInfo class
 /*! Abstract class to be used as an interface for the file io read/write functions
  *  Can be a GUI Dialog or stdout messages
@@ -122,7 +171,10 @@ namespace stfio {
 
  
 //! StdoutProgressInfo class
-/*! Example of a ProgressInfo that prints to stdout
+/*! Example of a ProgressInfo that prints to stdout. It only uses the
+ *  C++ standard library and writes each message with a single call, so
+ *  that it can be used from several threads, e.g. from Python threads
+ *  that have released the global interpreter lock.
  */
 class StfioDll StdoutProgressInfo : public stfio::ProgressInfo {
  public:
@@ -132,6 +184,103 @@ class StfioDll StdoutProgressInfo : public stfio::ProgressInfo {
     bool verbosity;
 };
 
+//! A progress sink that can be updated cheaply from any thread.
+/*! Update() and Step() only store the progress with atomic operations and
+ *  never block, so that they can be called from inner loops and from
+ *  parallel workers. Nothing is displayed; instead, the GUI polls the
+ *  progress at its own frame rate with Poll(). Messages are best-effort:
+ *  a message is only stored when the progress value changes, and it's
+ *  dropped if the poller is reading the previous message at that moment.
+ */
+class StfioDll AtomicProgressInfo : public stfio::ProgressInfo {
+ public:
+    //! Constructor
+    /*! See ProgressInfo for a description of the parameters.
+     */
+    AtomicProgressInfo(const std::string& title, const std::string& message, int maximum, bool verbose=false);
+
+    //! Stores the progress.
+    /*! \param value New value of the progress meter
+     *  \param newmsg New message for the info text
+     *  \param skip Is set to true if the operation has been cancelled
+     *  \return True unless the operation was cancelled.
+     */
+    bool Update(int value, const std::string& newmsg="", bool* skip=NULL);
+
+    //! Advances the progress meter.
+    /*! Useful when parallel workers each report a share of the work.
+     *  \param n Number of finished units of work.
+     *  \return True unless the operation was cancelled.
+     */
+    bool Step(int n=1);
+
+    //! Requests the operation to stop. Update() and Step() return false afterwards.
+    void Cancel();
+
+    //! Determines whether Cancel() has been called.
+    bool IsCancelled() const;
+
+    //! Reads the progress.
+    /*! \param value Is set to the current value of the progress meter.
+     *  \param msg Is set to the last message if one has been stored since
+     *         the last call; left unchanged otherwise.
+     *  \return True if the progress has changed since the last call.
+     */
+    bool Poll(int& value, std::string& msg);
+
+    //! Retrieves the maximum of the progress meter.
+    int GetMaximum() const { return maximum; }
+
+ private:
+    int maximum;
+    volatile long value;
+    volatile long cancelled;
+    // incremented whenever the value or the message changes:
+    volatile long generation;
+    long polledGeneration;
+    // guards message; taken with a compare-and-swap and never waited for:
+    volatile long msgLock;
+    volatile long msgChanged;
+    std::string message;
+};
+
+//! Lets parallel workers report their progress to a ProgressInfo that isn't thread-safe.
+/*! Workers count their finished units of work with Step(), which only uses
+ *  atomic operations. The progress meter is only updated by the master
+ *  thread of a parallel region that the creating thread has started, or by
+ *  the creating thread itself, and only when the displayed value changes.
+ *  Once the progress meter has reported that the operation has been
+ *  cancelled, Step() returns false on all threads.
+ */
+class StfioDll ParallelProgress {
+ public:
+    //! Constructor
+    /*! \param progDlg The progress meter; only used by the creating thread.
+     *  \param total Number of units of work.
+     *  \param message Message displayed while the work is done.
+     *  \param begin Value of the progress meter before any work has been done.
+     *  \param end Value of the progress meter when all work has been done.
+     */
+    ParallelProgress(ProgressInfo& progDlg, int total, const std::string& message,
+                     int begin=0, int end=100);
+
+    //! Counts finished units of work; may be called from any thread.
+    /*! \param n Number of finished units of work.
+     *  \return True unless the operation was cancelled.
+     */
+    bool Step(int n=1);
+
+    //! Determines whether the progress meter has reported a cancellation.
+    bool IsCancelled() const;
+
+ private:
+    ProgressInfo& progDlg;
+    int total, begin, end, lastValue;
+    std::string message;
+    volatile long done;
+    volatile long cancelled;
+};
+
 //! Text file import filter settings
 struct txtImportSettings {
   txtImportSettings() : hLines(1),toSection(true),firstIsTime(true),ncolumns(2),
@@ -161,9 +310,34 @@ enum filetype {
     biosig, /*!< biosig files. */
     tdms,   /*!< TDMS files. */
     intan,   /*!< Intan CLAMP files. */
+    nwb,    /*!< Neurodata Without Borders (NWB 2.x) files. */
+    zarr,   /*!< Chunked Zarr (version 2) stores. */
     none    /*!< Undefined file type. */
 };
 
+//! Holds the lock of the library that handles a file type while in scope.
+/*! Some libraries keep global state, such as file tables or the HDF5
+ *  library, which is shut down after every file. Each of them may only be
+ *  used by one thread at a time; file types that are read by stfio itself
+ *  aren't locked. A thread that holds the lock may lock the same library
+ *  again, e.g. to read sections lazily while exporting them.
+ */
+class StfioDll LibraryLock {
+ public:
+    //! Constructor. Waits until no other thread uses the library.
+    /*! \param type The file type whose library is needed.
+     */
+    explicit LibraryLock(stfio::filetype type);
+
+    //! Destructor. Releases the library.
+    ~LibraryLock();
+
+ private:
+    LibraryLock(const LibraryLock&);
+    LibraryLock& operator=(const LibraryLock&);
+    int library;
+};
+
   
 #ifndef TEST_MINIMAL
 //! Attempts to determine the filetype from the filter extension.
@@ -182,7 +356,13 @@ StfioDll std::string
 findExtension(stfio::filetype ftype);
 
 //! Generic file import.
-/*! \param fName The full path name of the file. 
+/*! If sidecar indices are enabled (see stfio::setSidecarIndex()), a valid
+ *  index is read instead of the file, and an index is written after the
+ *  file has been imported. If a memory budget is set (see
+ *  stfio::setMemoryBudget()), samples that wouldn't fit into it are stored
+ *  in single precision or mapped from a sidecar index that is written for
+ *  this purpose (see stfio::chooseStorage()).
+ *  \param fName The full path name of the file. 
  *  \param type The file type. 
  *  \param ReturnData Will contain the file data on return.
  *  \param txtImport The text import filter settings.
@@ -198,19 +378,102 @@ importFile(
         stfio::ProgressInfo& progDlg
 );
 
+//! Reads a range of sections from a file.
+/*! Only the selected sections are read, so that the first sections of a
+ *  large file can be shown before the rest has been read. Currently only
+ *  supported for HDF5 files; throws std::runtime_error for other file types.
+ *  Ranges that extend beyond the data are truncated.
+ *  \param fName The full path name of the file.
+ *  \param type The file type.
+ *  \param ReturnData On entry, an empty Recording. On exit, sections
+ *         [section_begin, section_end) of each channel.
+ *  \param progDlg Progress indicator
+ *  \param section_begin Index of the first section to be read.
+ *  \param section_end Index past the last section to be read.
+ */
+StfioDll void
+importFileRange(const std::string& fName, stfio::filetype type, Recording& ReturnData,
+                stfio::ProgressInfo& progDlg, std::size_t section_begin, std::size_t section_end);
+
+//! Retrieves the number of sections of each channel without reading the data.
+/*! \param fName The full path name of the file.
+ *  \param type The file type.
+ *  \return The number of sections of each channel, or an empty vector if
+ *          importFileRange() doesn't support \e type.
+ */
+StfioDll std::vector<std::size_t>
+getSectionCounts(const std::string& fName, stfio::filetype type);
+
+//! Receives the recordings that are read by importFiles().
+/*! The functions are called by one thread at a time, so that they
+ *  needn't be thread-safe, but they mustn't throw exceptions.
+ */
+class StfioDll ImportCallback {
+ public:
+    //! Destructor
+    virtual ~ImportCallback() {}
+
+    //! Called when a file has been imported.
+    /*! \param index The index of the file in the list of files.
+     *  \param data The file data; may be modified or swapped out.
+     */
+    virtual void Imported(std::size_t index, Recording& data) = 0;
+
+    //! Called when a file couldn't be imported.
+    /*! \param index The index of the file in the list of files.
+     *  \param error Description of the error.
+     */
+    virtual void Failed(std::size_t index, const std::string& error) = 0;
+};
+
+//! Imports several files in parallel.
+/*! The files are distributed among a pool of worker threads. Files whose
+ *  libraries keep global state (HDF5, ABF, ATF, CFS and biosig) are read
+ *  by one thread at a time, while all other formats are read concurrently.
+ *  \param fNames The full path names of the files.
+ *  \param types The file types; has to have the same size as \e fNames.
+ *  \param callback Receives each recording as soon as it has been read,
+ *         in no particular order.
+ *  \param txtImport The text import filter settings.
+ *  \param n_threads Maximal number of files that are read at the same time;
+ *         0 uses one thread per processor.
+ */
+StfioDll void
+importFiles(const std::vector<std::string>& fNames, const std::vector<stfio::filetype>& types,
+            ImportCallback& callback, const stfio::txtImportSettings& txtImport, int n_threads = 0);
+
+//! Imports several files in parallel.
+/*! Throws std::runtime_error listing all files that couldn't be imported.
+ *  \param fNames The full path names of the files.
+ *  \param types The file types; has to have the same size as \e fNames.
+ *  \param txtImport The text import filter settings.
+ *  \param n_threads Maximal number of files that are read at the same time;
+ *         0 uses one thread per processor.
+ *  \return The file data, in the order of \e fNames.
+ */
+StfioDll std::vector<Recording>
+importFiles(const std::vector<std::string>& fNames, const std::vector<stfio::filetype>& types,
+            const stfio::txtImportSettings& txtImport, int n_threads = 0);
+
 //! Generic file export.
-/*! \param fName The full path name of the file. 
+/*! Igor files are written as one binary wave per channel, or as a single
+ *  packed experiment if \e fName ends with ".pxp".
+ *  \param fName The full path name of the file. 
  *  \param type The file type. 
- *  \param Data Data to be written
+ *  \param Data Data to be written; either a Recording or a view of some of its channels.
  *  \param ProgressInfo Progress indicator
  *  \return true if the file has successfully been written, false otherwise.
  */
 StfioDll bool
-exportFile(const std::string& fName, stfio::filetype type, const Recording& Data,
+exportFile(const std::string& fName, stfio::filetype type, const RecordingView& Data,
            ProgressInfo& progDlg);
 
 //! Produce new recording with concatenated sections
-/*! \param src Source recording
+/*! The new sections are chained views of the selected sections (see
+ *  stfio::chainSamples()): samples in mapped files aren't copied, and all
+ *  samples are only decoded as a whole when get() is called, e.g. on export.
+ *  Throws std::runtime_error if the sampling intervals differ.
+ *  \param src Source recording
  *  \param sections Indices of selected sections
  *  \param ProgressInfo Progress indicator
  *  \return New recording with concatenated selected sections
@@ -220,15 +483,34 @@ concatenate(const Recording& src, const std::vector<std::size_t>& sections,
             ProgressInfo& progDlg);
 
 //! Produce new recording with multiplied sections
-/*! \param src Source recording
+/*! Sections are split into chunks that are multiplied in parallel.
+ *  Throws std::out_of_range if the channel or a section doesn't exist and
+ *  std::runtime_error if no section is selected.
+ *  \param src Source recording
  *  \param sections Indices of selected sections
  *  \param channel Channel index
  *  \param factor Multiplication factor
+ *  \param n_threads Maximal number of threads; 0 uses the configured number of threads.
  *  \return New recording with multiplied selected sections
  */
 StfioDll Recording
 multiply(const Recording& src, const std::vector<std::size_t>& sections,
-         std::size_t channel, double factor);
+         std::size_t channel, double factor, int n_threads = 0);
+
+//! Multiply sections in place
+/*! Unlike stfio::multiply(), no copy of the sections is made. Mapped
+ *  samples are decoded into memory first.
+ *  Throws std::out_of_range if the channel or a section doesn't exist and
+ *  std::runtime_error if a section is selected more than once.
+ *  \param rec The recording
+ *  \param sections Indices of selected sections
+ *  \param channel Channel index
+ *  \param factor Multiplication factor
+ *  \param n_threads Maximal number of threads; 0 uses the configured number of threads.
+ */
+StfioDll void
+multiplyInPlace(Recording& rec, const std::vector<std::size_t>& sections,
+                std::size_t channel, double factor, int n_threads = 0);
 /*@}*/
 
 } // end of namespace
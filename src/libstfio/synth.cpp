@@ -0,0 +1,217 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file synth.cpp
+ *  \brief Defines a generator of synthetic recordings for benchmarks and tests.
+ */
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./stfio.h"
+#include "./section.h"
+#include "./channel.h"
+#include "./recording.h"
+#include "./synth.h"
+#include "./parallel.h"
+
+namespace {
+    const double synthPi = 3.14159265358979323846;
+
+    // Events have decayed when they have fallen below this fraction of their peak:
+    const double synthCutoff = 1.0e-3;
+
+    // splitmix64; unlike rand(), it gives the same numbers on every platform.
+    class SynthRandom {
+    public:
+        // Every (seed, stream) pair gives an independent sequence:
+        SynthRandom(unsigned long long seed, unsigned long long stream) :
+            state(seed ^ (stream * 0xD1B54A32D192ED03ULL)), hasGauss(false), gauss(0)
+        {
+            next();
+        }
+
+        unsigned long long next() {
+            state += 0x9E3779B97F4A7C15ULL;
+            unsigned long long z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        // Uniformly distributed in [0, 1):
+        double Uniform() {
+            return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        // Standard normal distribution (Box-Muller):
+        double Gauss() {
+            if (hasGauss) {
+                hasGauss = false;
+                return gauss;
+            }
+            double u1 = 1.0 - Uniform();
+            double u2 = Uniform();
+            double r = sqrt(-2.0 * log(u1));
+            gauss = r * sin(2.0 * synthPi * u2);
+            hasGauss = true;
+            return r * cos(2.0 * synthPi * u2);
+        }
+
+    private:
+        unsigned long long state;
+        bool hasGauss;
+        double gauss;
+    };
+}
+
+stfio::SynthSettings::SynthSettings() :
+    n_channels(1), n_sections(10), n_points(100000), dt(0.05), baseline(0), noise(1.0),
+    event(synth_epsc), amplitude(-20.0), tauRise(0.5), tauDecay(5.0), interval(100.0),
+    minInterval(10.0), seed(0), xunits("ms"), yunits("pA")
+{}
+
+Vector_double stfio::synthEvent(const SynthSettings& settings) {
+    if (settings.event == synth_none) {
+        return Vector_double(0);
+    }
+    if (settings.dt <= 0 || settings.tauRise <= 0 || settings.tauDecay <= 0) {
+        throw std::out_of_range("Sampling interval and time constants have to be positive in stfio::synthEvent()");
+    }
+    Vector_double event;
+    if (settings.event == synth_epsc) {
+        if (settings.tauRise >= settings.tauDecay) {
+            throw std::out_of_range("Rise time constant has to be smaller than the decay time constant in stfio::synthEvent()");
+        }
+        double tr = settings.tauRise, td = settings.tauDecay;
+        double tPeak = tr*td / (td-tr) * log(td/tr);
+        double fPeak = exp(-tPeak/td) - exp(-tPeak/tr);
+        for (std::size_t i = 0; ; ++i) {
+            double t = i * settings.dt;
+            double f = (exp(-t/td) - exp(-t/tr)) / fPeak;
+            if (t > tPeak && f < synthCutoff) {
+                break;
+            }
+            event.push_back(settings.amplitude * f);
+        }
+    } else if (settings.event == synth_ap) {
+        // the rising half-Gaussian starts at 3 standard deviations:
+        double tPeak = 3.0 * settings.tauRise;
+        for (std::size_t i = 0; ; ++i) {
+            double t = i * settings.dt;
+            double x = (t - tPeak) / (t < tPeak ? settings.tauRise : settings.tauDecay);
+            double f = exp(-0.5*x*x);
+            if (t > tPeak && f < synthCutoff) {
+                break;
+            }
+            event.push_back(settings.amplitude * f);
+        }
+    } else {
+        throw std::out_of_range("Unknown event shape in stfio::synthEvent()");
+    }
+    return event;
+}
+
+std::vector<std::size_t> stfio::synthOnsets(const SynthSettings& settings, std::size_t n_section) {
+    if (n_section >= settings.n_sections) {
+        throw std::out_of_range("Section index out of range in stfio::synthOnsets()");
+    }
+    std::vector<std::size_t> onsets;
+    if (settings.event == synth_none || settings.interval <= 0) {
+        return onsets;
+    }
+    std::size_t length = synthEvent(settings).size();
+    double minInterval = std::max(settings.minInterval, settings.dt);
+    double meanExtra = std::max(settings.interval - minInterval, 0.0);
+    // stream 0 of every section; noise uses streams from 1:
+    SynthRandom random(settings.seed, (unsigned long long)n_section * (settings.n_channels+1));
+    double t = 0;
+    for (;;) {
+        t += minInterval - meanExtra * log(1.0 - random.Uniform());
+        std::size_t onset = (std::size_t)(t / settings.dt);
+        if (onset + length > settings.n_points) {
+            break;
+        }
+        onsets.push_back(onset);
+    }
+    return onsets;
+}
+
+Section stfio::synthSection(const SynthSettings& settings, std::size_t n_channel, std::size_t n_section) {
+    if (n_channel >= settings.n_channels) {
+        throw std::out_of_range("Channel index out of range in stfio::synthSection()");
+    }
+    std::vector<std::size_t> onsets = synthOnsets(settings, n_section);
+    Vector_double event = synthEvent(settings);
+
+    Vector_double data(settings.n_points);
+    SynthRandom random(settings.seed, (unsigned long long)n_section * (settings.n_channels+1) + n_channel + 1);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = settings.baseline + settings.noise * random.Gauss();
+    }
+    for (std::size_t n_e = 0; n_e < onsets.size(); ++n_e) {
+        double* dest = &data[onsets[n_e]];
+        for (std::size_t i = 0; i < event.size(); ++i) {
+            dest[i] += event[i];
+        }
+    }
+
+    std::ostringstream label;
+    label << "Synthetic section " << n_section+1;
+    Section sec(STFIO_MOVE(data), label.str());
+    sec.SetXScale(settings.dt);
+    return sec;
+}
+
+Recording stfio::synthRecording(const SynthSettings& settings,
+                                std::vector< std::vector<std::size_t> >* onsets, int n_threads)
+{
+    // check everything first, so that no thread has to throw:
+    synthEvent(settings);
+
+    Recording rec(settings.n_channels, settings.n_sections);
+    int n_sections = (int)settings.n_sections;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        for (std::size_t n_c = 0; n_c < settings.n_channels; ++n_c) {
+            rec[n_c][n_s] = synthSection(settings, n_c, n_s);
+        }
+    }
+
+    for (std::size_t n_c = 0; n_c < settings.n_channels; ++n_c) {
+        std::ostringstream name;
+        name << "Ch" << n_c+1;
+        rec[n_c].SetChannelName(name.str());
+        rec[n_c].SetYUnits(settings.yunits);
+    }
+    rec.SetXScale(settings.dt);
+    rec.SetXUnits(settings.xunits);
+    rec.SetFileDescription("Synthetic recording");
+
+    if (onsets != NULL) {
+        onsets->resize(settings.n_sections);
+        for (std::size_t n_s = 0; n_s < settings.n_sections; ++n_s) {
+            (*onsets)[n_s] = synthOnsets(settings, n_s);
+        }
+    }
+    return rec;
+}
@@ -0,0 +1,113 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file synth.h
+ *  \brief Declares a generator of synthetic recordings for benchmarks and tests.
+ */
+
+#ifndef _SYNTH_H
+#define _SYNTH_H
+
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+
+class Section;
+class Recording;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Shapes of synthetic events.
+enum synth_event {
+    synth_none = 0, /*!< Noise only. */
+    synth_epsc = 1, /*!< Difference of two exponentials with time constants tauRise and tauDecay. */
+    synth_ap = 2    /*!< Spike made of two half-Gaussians with standard deviations tauRise and tauDecay. */
+};
+
+//! Describes a synthetic recording.
+/*! The data is fully determined by the settings: the same settings give the
+ *  same samples, independent of the number of threads.
+ *  All channels share the event times of a section; noise is independent.
+ */
+struct StfioDll SynthSettings {
+    //! Constructor. Sets defaults that describe a voltage-clamp recording with EPSCs.
+    SynthSettings();
+
+    std::size_t n_channels;  /*!< Number of channels. */
+    std::size_t n_sections;  /*!< Number of sections per channel. */
+    std::size_t n_points;    /*!< Number of sampling points per section. */
+    double dt;               /*!< Sampling interval in ms. */
+    double baseline;         /*!< Baseline value in y units. */
+    double noise;            /*!< Standard deviation of the Gaussian noise in y units. */
+    synth_event event;       /*!< Shape of the events. */
+    double amplitude;        /*!< Peak amplitude of the events, measured from the baseline. */
+    double tauRise;          /*!< Rise time constant of the events in ms. */
+    double tauDecay;         /*!< Decay time constant of the events in ms. */
+    double interval;         /*!< Mean interval between event onsets in ms (Poisson process). */
+    double minInterval;      /*!< Minimal interval between event onsets in ms. */
+    unsigned long long seed; /*!< Seed of the random number generator. */
+    std::string xunits;      /*!< x units. */
+    std::string yunits;      /*!< y units of all channels. */
+};
+
+//! Computes the waveform of a single event.
+/*! \param settings Describes the shape and the kinetics of the event.
+ *  \return The event from its onset until it has decayed to less than 0.1% of
+ *          its peak, in sampling points of settings.dt, without baseline.
+ */
+StfioDll Vector_double synthEvent(const SynthSettings& settings);
+
+//! Computes the event onsets of a section.
+/*! \param settings Describes the recording.
+ *  \param n_section The index of the section.
+ *  \return Indices of the event onsets in sampling points, in ascending order.
+ *          Only events that fit into the section completely are included.
+ */
+StfioDll std::vector<std::size_t> synthOnsets(const SynthSettings& settings, std::size_t n_section);
+
+//! Generates a single section of a synthetic recording.
+/*! Sections can be generated independently of each other, so that large data
+ *  sets can be written or analysed without keeping all of them in memory.
+ *  Throws std::out_of_range if a section index is out of range.
+ *  \param settings Describes the recording.
+ *  \param n_channel The index of the channel.
+ *  \param n_section The index of the section.
+ *  \return The section.
+ */
+StfioDll Section synthSection(const SynthSettings& settings, std::size_t n_channel, std::size_t n_section);
+
+//! Generates a synthetic recording.
+/*! Sections are generated in parallel. The result can be written with
+ *  stfio::exportFile() to any format that can be exported.
+ *  \param settings Describes the recording.
+ *  \param onsets If not NULL, receives the event onsets of every section
+ *         (see stfio::synthOnsets()), so that detection results can be validated.
+ *  \param n_threads Number of sections that are generated in parallel;
+ *         0 uses the configured number of threads.
+ *  \return The recording.
+ */
+StfioDll Recording synthRecording(const SynthSettings& settings,
+                                  std::vector< std::vector<std::size_t> >* onsets = NULL,
+                                  int n_threads = 0);
+
+}
+
+/*@}*/
+
+#endif
@@ -0,0 +1,297 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file tablestream.cpp
+ *  \brief Defines a table of results that is written to disk while it grows.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "./tablestream.h"
+#include "./textwriter.h"
+#include "./parquet.h"
+#include "./hdf5/hdf5lib.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    bool isHDF5Name(const std::string& fName) {
+        std::size_t dot = fName.find_last_of('.');
+        if (dot == std::string::npos) {
+            return false;
+        }
+        std::string ext = fName.substr(dot);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext == ".h5";
+    }
+
+    // Quotes a CSV cell; quotes within it are doubled.
+    void appendQuoted(std::string& text, const std::string& cell) {
+        text += '"';
+        for (std::size_t n = 0; n < cell.size(); ++n) {
+            if (cell[n] == '"') {
+                text += '"';
+            }
+            text += cell[n];
+        }
+        text += '"';
+    }
+
+    // Splits a line of a CSV file into cells; quoted cells are unquoted.
+    std::vector<std::string> splitCSV(const std::string& line) {
+        std::vector<std::string> cells(1);
+        bool quoted = false;
+        for (std::size_t n = 0; n < line.size(); ++n) {
+            char c = line[n];
+            if (quoted) {
+                if (c == '"' && n+1 < line.size() && line[n+1] == '"') {
+                    cells.back() += '"';
+                    ++n;
+                } else if (c == '"') {
+                    quoted = false;
+                } else {
+                    cells.back() += c;
+                }
+            } else if (c == '"') {
+                quoted = true;
+            } else if (c == ',') {
+                cells.push_back(std::string());
+            } else if (c != '\r') {
+                cells.back() += c;
+            }
+        }
+        return cells;
+    }
+}
+
+// The queue lock guards the queue; the write lock is taken while the queue
+// lock is still held, so that queues are written in the order they were filled.
+struct stfio::TableStream::Locks {
+#ifdef _OPENMP
+    Locks() { omp_init_lock(&queue); omp_init_lock(&write); }
+    ~Locks() { omp_destroy_lock(&queue); omp_destroy_lock(&write); }
+    void SetQueue() { omp_set_lock(&queue); }
+    void UnsetQueue() { omp_unset_lock(&queue); }
+    void SetWrite() { omp_set_lock(&write); }
+    void UnsetWrite() { omp_unset_lock(&write); }
+    omp_lock_t queue, write;
+#else
+    void SetQueue() {}
+    void UnsetQueue() {}
+    void SetWrite() {}
+    void UnsetWrite() {}
+#endif
+};
+
+stfio::TableStream::TableStream(const std::string& fName, const std::string& labelTitle,
+                                const std::vector<std::string>& colLabels, std::size_t queueRows_)
+    : name(fName), hdf5(isHDF5Name(fName)), parquet(NULL), closed(false), n_cols(colLabels.size()),
+      queueRows(std::max<std::size_t>(queueRows_, 1)), n_rows(0), fp(NULL), locks(NULL)
+{
+    if (n_cols == 0) {
+        throw std::runtime_error("No columns in stfio::TableStream");
+    }
+    if (hdf5) {
+        LibraryLock lock(stfio::hdf5);
+        createHDF5Table(name, labelTitle, colLabels);
+    } else if (isParquetName(name)) {
+        parquet = new ParquetWriter(name, labelTitle, colLabels);
+    } else {
+        fp = (name == "-") ? stdout : fopen(name.c_str(), "wb");
+        if (fp == NULL) {
+            throw std::runtime_error("Couldn't open " + name + " for writing");
+        }
+        std::string header(labelTitle);
+        for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+            header += "," + colLabels[n_c];
+        }
+        header += "\n";
+        if (fwrite(header.data(), 1, header.size(), fp) != header.size() || fflush(fp) != 0) {
+            if (fp != stdout) {
+                fclose(fp);
+            }
+            throw std::runtime_error("Couldn't write to " + name);
+        }
+    }
+    labels.reserve(queueRows);
+    values.reserve(queueRows*n_cols);
+    locks = new Locks;
+}
+
+stfio::TableStream::~TableStream() {
+    try {
+        Close();
+    }
+    catch (...) {
+    }
+    delete parquet;
+    delete locks;
+}
+
+void stfio::TableStream::Append(const std::string& label, const Vector_double& rowValues) {
+    if (rowValues.size() != n_cols) {
+        throw std::runtime_error("Wrong number of values in stfio::TableStream::Append");
+    }
+    locks->SetQueue();
+    if (closed) {
+        locks->UnsetQueue();
+        throw std::runtime_error("Can't append to the closed table " + name);
+    }
+    labels.push_back(label);
+    values.insert(values.end(), rowValues.begin(), rowValues.end());
+    ++n_rows;
+    if (labels.size() < queueRows) {
+        locks->UnsetQueue();
+        return;
+    }
+    // the full queue is written while other threads fill the next one:
+    locks->SetWrite();
+    labels.swap(writeLabels);
+    values.swap(writeValues);
+    locks->UnsetQueue();
+    try {
+        Write();
+    }
+    catch (...) {
+        locks->UnsetWrite();
+        throw;
+    }
+    locks->UnsetWrite();
+}
+
+void stfio::TableStream::Flush() {
+    locks->SetQueue();
+    locks->SetWrite();
+    labels.swap(writeLabels);
+    values.swap(writeValues);
+    locks->UnsetQueue();
+    try {
+        Write();
+    }
+    catch (...) {
+        locks->UnsetWrite();
+        throw;
+    }
+    locks->UnsetWrite();
+}
+
+void stfio::TableStream::Close() {
+    if (closed) {
+        return;
+    }
+    Flush();
+    locks->SetQueue();
+    closed = true;
+    locks->UnsetQueue();
+    if (parquet != NULL) {
+        parquet->Close();
+    }
+    if (fp != NULL && fp != stdout && fclose(fp) != 0) {
+        fp = NULL;
+        throw std::runtime_error("Couldn't write to " + name);
+    }
+    fp = NULL;
+}
+
+void stfio::TableStream::Write() {
+    if (writeLabels.empty()) {
+        return;
+    }
+    bool written = true;
+    if (hdf5) {
+        LibraryLock lock(stfio::hdf5);
+        try {
+            appendHDF5Table(name, writeLabels, writeValues);
+        }
+        catch (const std::runtime_error&) {
+            written = false;
+        }
+    } else if (parquet != NULL) {
+        try {
+            parquet->Append(writeLabels, writeValues);
+        }
+        catch (const std::runtime_error&) {
+            written = false;
+        }
+    } else {
+        text.clear();
+        char number[numberTextSize];
+        for (std::size_t n_r = 0; n_r < writeLabels.size(); ++n_r) {
+            appendQuoted(text, writeLabels[n_r]);
+            for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+                text += ',';
+                double value = writeValues[n_r*n_cols + n_c];
+                if (!std::isnan(value)) {
+                    text.append(number, formatNumber(value, 0, number));
+                }
+            }
+            text += '\n';
+        }
+        written = (fwrite(text.data(), 1, text.size(), fp) == text.size() && fflush(fp) == 0);
+    }
+    // the buffers are kept for the next queue; rows that couldn't be written are dropped:
+    writeLabels.clear();
+    writeValues.clear();
+    if (!written) {
+        throw std::runtime_error("Couldn't write to " + name);
+    }
+}
+
+void stfio::readTableCSV(const std::string& fName, std::string& labelTitle,
+                         std::vector<std::string>& colLabels, std::vector<std::string>& labels,
+                         Vector_double& values)
+{
+    std::ifstream file(fName.c_str(), std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Couldn't open " + fName);
+    }
+    std::string line;
+    if (!std::getline(file, line)) {
+        throw std::runtime_error("No header in " + fName);
+    }
+    std::vector<std::string> header = splitCSV(line);
+    labelTitle = header[0];
+    colLabels.assign(header.begin()+1, header.end());
+    labels.clear();
+    values.clear();
+    while (std::getline(file, line)) {
+        if (line.empty() || line == "\r") {
+            continue;
+        }
+        std::vector<std::string> cells = splitCSV(line);
+        if (cells.size() != header.size()) {
+            throw std::runtime_error("Wrong number of cells in " + fName + ": " + line);
+        }
+        labels.push_back(cells[0]);
+        for (std::size_t n_c = 1; n_c < cells.size(); ++n_c) {
+            if (cells[n_c].empty()) {
+                values.push_back(NAN);
+                continue;
+            }
+            char* end = NULL;
+            values.push_back(strtod(cells[n_c].c_str(), &end));
+            if (*end != '\0') {
+                throw std::runtime_error("Invalid number in " + fName + ": " + cells[n_c]);
+            }
+        }
+    }
+}
@@ -0,0 +1,134 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file tablestream.h
+ *  \brief Declares a table of results that is written to disk while it grows.
+ */
+
+#ifndef _TABLESTREAM_H
+#define _TABLESTREAM_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+class ParquetWriter;
+
+//! A table of results that is written to a file row by row.
+/*! Rows are collected in a queue of limited size and written whenever it is
+ *  full, so that the memory that is needed doesn't grow with the number of
+ *  rows. Files whose name ends with ".h5" are HDF5 files (see
+ *  stfio::createHDF5Table()), files whose name ends with ".parquet" are
+ *  Parquet files with a row group per write (see stfio::ParquetWriter); all
+ *  other files, and the name "-" for the standard output, are written as
+ *  comma-separated values, with the row
+ *  labels in quotes and empty cells for NaN. Every write is complete on disk
+ *  before the next one starts, so that the rows that have been written
+ *  survive if the program doesn't finish.
+ *
+ *  Rows may be appended by several threads at the same time; they are
+ *  written in the order in which they were appended.
+ */
+class StfioDll TableStream {
+public:
+    //! Constructor. Creates the file and writes the column labels.
+    /*! Throws std::runtime_error if the file can't be written.
+     *  \param fName Full path to the file, or "-" for the standard output.
+     *  \param labelTitle Title of the row labels, e.g. "file" or "Section".
+     *  \param colLabels The labels of the columns; at least one is needed.
+     *  \param queueRows Number of rows that are collected before they are written.
+     */
+    TableStream(const std::string& fName, const std::string& labelTitle,
+                const std::vector<std::string>& colLabels, std::size_t queueRows=1024);
+
+    //! Destructor. Writes the remaining rows and closes the file; errors are ignored.
+    ~TableStream();
+
+    //! Appends a row.
+    /*! Writes the queue if it is full. Throws std::runtime_error if the
+     *  number of values doesn't match the number of columns, if the table
+     *  has been closed, or if the file can't be written.
+     *  \param label The row label.
+     *  \param values The values of the row; NaN for empty cells.
+     */
+    void Append(const std::string& label, const Vector_double& values);
+
+    //! Writes all rows that have been appended.
+    /*! Throws std::runtime_error if the file can't be written.
+     */
+    void Flush();
+
+    //! Writes all rows that have been appended and closes the file.
+    /*! Rows can't be appended afterwards. Throws std::runtime_error if
+     *  the file can't be written.
+     */
+    void Close();
+
+    //! Retrieves the number of rows that have been appended.
+    std::size_t GetRows() const { return n_rows; }
+
+    //! Retrieves the name of the file.
+    const std::string& GetName() const { return name; }
+
+private:
+    TableStream(const TableStream&);
+    TableStream& operator=(const TableStream&);
+
+    // Writes the rows in writeLabels and writeValues; the write lock is held.
+    void Write();
+
+    struct Locks;
+
+    std::string name;
+    bool hdf5;
+    ParquetWriter* parquet;
+    bool closed;
+    std::size_t n_cols;
+    std::size_t queueRows;
+    std::size_t n_rows;
+    FILE* fp;
+    std::vector<std::string> labels, writeLabels;
+    Vector_double values, writeValues;
+    std::string text;
+    Locks* locks;
+};
+
+//! Reads a table that stfio::TableStream has written as comma-separated values.
+/*! Used to merge the tables of several runs. Empty cells are read as NaN;
+ *  numbers are read in the C locale. Throws std::runtime_error if the file
+ *  can't be read or if a row doesn't have as many cells as the header.
+ *  \param fName Full path to the file.
+ *  \param labelTitle On exit, the title of the row labels.
+ *  \param colLabels On exit, the labels of the columns.
+ *  \param labels On exit, the row labels.
+ *  \param values On exit, the values row by row.
+ */
+StfioDll void readTableCSV(const std::string& fName, std::string& labelTitle,
+                           std::vector<std::string>& colLabels, std::vector<std::string>& labels,
+                           Vector_double& values);
+
+}
+
+/*@}*/
+
+#endif
@@ -0,0 +1,521 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file tdmslib.cpp
+ *  \brief Import National Instruments TDMS files.
+ *
+ *  Follows the description of the TDMS file format at
+ *  http://www.ni.com/product-documentation/5696/en/
+ */
+
+#include <cstring>
+#include <cctype>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "./tdmslib.h"
+#include "./../recording.h"
+#include "./../mappedfile.h"
+
+namespace {
+
+    // Flags of the table of contents of a segment:
+    const unsigned int kTocMetaData = 1 << 1;
+    const unsigned int kTocNewObjList = 1 << 2;
+    const unsigned int kTocRawData = 1 << 3;
+    const unsigned int kTocInterleavedData = 1 << 5;
+    const unsigned int kTocBigEndian = 1 << 6;
+    const unsigned int kTocDAQmxRawData = 1 << 7;
+
+    // Data types:
+    enum tdsDataType {
+        tdsTypeVoid = 0,
+        tdsTypeI8 = 1,
+        tdsTypeI16 = 2,
+        tdsTypeI32 = 3,
+        tdsTypeI64 = 4,
+        tdsTypeU8 = 5,
+        tdsTypeU16 = 6,
+        tdsTypeU32 = 7,
+        tdsTypeU64 = 8,
+        tdsTypeSingleFloat = 9,
+        tdsTypeDoubleFloat = 10,
+        tdsTypeExtendedFloat = 11,
+        tdsTypeSingleFloatWithUnit = 0x19,
+        tdsTypeDoubleFloatWithUnit = 0x1A,
+        tdsTypeString = 0x20,
+        tdsTypeBoolean = 0x21,
+        tdsTypeTimeStamp = 0x44,
+        tdsTypeComplexSingleFloat = 0x08000c,
+        tdsTypeComplexDoubleFloat = 0x10000d
+    };
+
+    const unsigned int kNoRawData = 0xFFFFFFFF;
+    const unsigned int kSameRawIndex = 0;
+    const unsigned long long kIncompleteSegment = 0xFFFFFFFFFFFFFFFFULL;
+
+    std::size_t typeSize(unsigned int type) {
+        switch (type) {
+         case tdsTypeVoid: return 0;
+         case tdsTypeI8: case tdsTypeU8: case tdsTypeBoolean: return 1;
+         case tdsTypeI16: case tdsTypeU16: return 2;
+         case tdsTypeI32: case tdsTypeU32: case tdsTypeSingleFloat:
+         case tdsTypeSingleFloatWithUnit: return 4;
+         case tdsTypeI64: case tdsTypeU64: case tdsTypeDoubleFloat:
+         case tdsTypeDoubleFloatWithUnit: case tdsTypeComplexSingleFloat: return 8;
+         case tdsTypeExtendedFloat: case tdsTypeTimeStamp: case tdsTypeComplexDoubleFloat: return 16;
+         default: {
+             std::ostringstream error;
+             error << "Unsupported data type " << type << " in TDMS file";
+             throw std::runtime_error(error.str());
+         }
+        }
+    }
+
+    bool hostIsBigEndian() {
+        const unsigned short one = 1;
+        return *(const unsigned char*)&one == 0;
+    }
+
+    // Reads numbers and strings from the metadata of a segment:
+    class Reader {
+    public:
+        Reader(const char* begin, const char* end_, bool bigEndian)
+            : p(begin), end(end_), swap(bigEndian != hostIsBigEndian()) {}
+
+        template <typename T>
+        T Get() {
+            Require(sizeof(T));
+            char bytes[sizeof(T)];
+            memcpy(bytes, p, sizeof(T));
+            if (swap) {
+                std::reverse(bytes, bytes+sizeof(T));
+            }
+            p += sizeof(T);
+            T value;
+            memcpy(&value, bytes, sizeof(T));
+            return value;
+        }
+
+        std::string GetString() {
+            std::size_t length = Get<unsigned int>();
+            Require(length);
+            std::string value(p, length);
+            p += length;
+            return value;
+        }
+
+        void Skip(std::size_t n) { Require(n); p += n; }
+
+    private:
+        void Require(std::size_t n) const {
+            if ((std::size_t)(end-p) < n) {
+                throw std::runtime_error("Truncated metadata in TDMS file");
+            }
+        }
+        const char* p;
+        const char* end;
+        bool swap;
+    };
+
+    // A property; numbers are converted to double:
+    struct Property {
+        std::string text;
+        double value;
+        bool isText;
+    };
+
+    // A contiguous run of samples in the file:
+    struct Piece {
+        std::size_t offset, size, stride;
+        bool bigEndian;
+    };
+
+    struct Object {
+        Object() : type(tdsTypeVoid), n_values(0), bytes(0), props(), pieces() {}
+        unsigned int type;
+        unsigned long long n_values;
+        // only used for strings:
+        unsigned long long bytes;
+        std::map<std::string, Property> props;
+        std::vector<Piece> pieces;
+    };
+
+    Property readProperty(Reader& reader) {
+        Property prop;
+        prop.value = 0;
+        prop.isText = false;
+        unsigned int type = reader.Get<unsigned int>();
+        switch (type) {
+         case tdsTypeString: prop.text = reader.GetString(); prop.isText = true; break;
+         case tdsTypeI8: prop.value = reader.Get<signed char>(); break;
+         case tdsTypeU8: case tdsTypeBoolean: prop.value = reader.Get<unsigned char>(); break;
+         case tdsTypeI16: prop.value = reader.Get<short>(); break;
+         case tdsTypeU16: prop.value = reader.Get<unsigned short>(); break;
+         case tdsTypeI32: prop.value = reader.Get<int>(); break;
+         case tdsTypeU32: prop.value = reader.Get<unsigned int>(); break;
+         case tdsTypeI64: prop.value = (double)reader.Get<long long>(); break;
+         case tdsTypeU64: prop.value = (double)reader.Get<unsigned long long>(); break;
+         case tdsTypeSingleFloat: case tdsTypeSingleFloatWithUnit: prop.value = reader.Get<float>(); break;
+         case tdsTypeDoubleFloat: case tdsTypeDoubleFloatWithUnit: prop.value = reader.Get<double>(); break;
+         default: reader.Skip(typeSize(type)); break;
+        }
+        return prop;
+    }
+
+    // Splits "/'group'/'channel'" into its names; quotes within names are doubled:
+    std::vector<std::string> splitPath(const std::string& path) {
+        std::vector<std::string> names;
+        std::size_t pos = 0;
+        while (pos < path.size()) {
+            if (path[pos] != '/' || pos+1 >= path.size() || path[pos+1] != '\'') {
+                throw std::runtime_error("Invalid object path " + path + " in TDMS file");
+            }
+            pos += 2;
+            std::string name;
+            for (;;) {
+                if (pos >= path.size()) {
+                    throw std::runtime_error("Invalid object path " + path + " in TDMS file");
+                }
+                if (path[pos] == '\'') {
+                    if (pos+1 < path.size() && path[pos+1] == '\'') {
+                        name += '\'';
+                        pos += 2;
+                        continue;
+                    }
+                    ++pos;
+                    break;
+                }
+                name += path[pos++];
+            }
+            names.push_back(name);
+        }
+        return names;
+    }
+
+    std::string lower(std::string s) {
+        for (std::size_t n = 0; n < s.size(); ++n) {
+            s[n] = (char)std::tolower((unsigned char)s[n]);
+        }
+        return s;
+    }
+
+    bool isMappable(unsigned int type, stfio::SampleType& sampleType) {
+        switch (type) {
+         case tdsTypeI16: sampleType = stfio::sample_int16; return true;
+         case tdsTypeI32: sampleType = stfio::sample_int32; return true;
+         case tdsTypeSingleFloat: case tdsTypeSingleFloatWithUnit:
+             sampleType = stfio::sample_float32; return true;
+         case tdsTypeDoubleFloat: case tdsTypeDoubleFloatWithUnit:
+             sampleType = stfio::sample_float64; return true;
+         default: return false;
+        }
+    }
+
+    // Decodes a piece of samples of any numeric type into memory:
+    void decodePiece(const char* data, const Piece& piece, unsigned int type, double* dest) {
+        stfio::SampleType sampleType;
+        bool swap = (piece.bigEndian != hostIsBigEndian());
+        if (isMappable(type, sampleType)) {
+            stfio::decodeSamples(data+piece.offset, piece.size, piece.stride, sampleType,
+                                 swap, 1.0, 0.0, dest);
+            return;
+        }
+        for (std::size_t n = 0; n < piece.size; ++n) {
+            Reader reader(data+piece.offset+n*piece.stride,
+                          data+piece.offset+n*piece.stride+typeSize(type), piece.bigEndian);
+            switch (type) {
+             case tdsTypeI8: dest[n] = reader.Get<signed char>(); break;
+             case tdsTypeU8: case tdsTypeBoolean: dest[n] = reader.Get<unsigned char>(); break;
+             case tdsTypeU16: dest[n] = reader.Get<unsigned short>(); break;
+             case tdsTypeU32: dest[n] = reader.Get<unsigned int>(); break;
+             case tdsTypeI64: dest[n] = (double)reader.Get<long long>(); break;
+             case tdsTypeU64: dest[n] = (double)reader.Get<unsigned long long>(); break;
+             default: throw std::runtime_error("Unsupported sample type in TDMS file");
+            }
+        }
+    }
+
+    // Reads the metadata of all segments and locates the raw data of all objects.
+    // Objects are returned in the order of their first appearance.
+    void readSegments(const stfio::MappedFile& file, std::vector<std::string>& order,
+                      std::map<std::string, Object>& objects, stfio::ProgressInfo& progDlg)
+    {
+        const char* data = file.GetData();
+        std::size_t size = file.GetSize();
+        std::vector<std::string> active;
+        std::size_t pos = 0;
+        while (pos + 28 <= size) {
+            if (memcmp(data+pos, "TDSm", 4) != 0) {
+                throw std::runtime_error("Invalid segment tag in TDMS file");
+            }
+            unsigned int toc = Reader(data+pos+4, data+pos+8, false).Get<unsigned int>();
+            bool bigEndian = (toc & kTocBigEndian) != 0;
+            Reader leadIn(data+pos+8, data+pos+28, bigEndian);
+            leadIn.Get<unsigned int>(); // version
+            unsigned long long next = leadIn.Get<unsigned long long>();
+            unsigned long long raw = leadIn.Get<unsigned long long>();
+            std::size_t meta_begin = pos+28;
+            // the last segment may not have been completed:
+            std::size_t seg_end = (next == kIncompleteSegment || next > size-meta_begin) ?
+                size : meta_begin + (std::size_t)next;
+            if (raw > seg_end-meta_begin) {
+                throw std::runtime_error("Invalid raw data offset in TDMS file");
+            }
+            std::size_t raw_begin = meta_begin + (std::size_t)raw;
+            if (toc & kTocDAQmxRawData) {
+                throw std::runtime_error("DAQmx raw data in TDMS files aren't supported");
+            }
+            if (toc & kTocNewObjList) {
+                active.clear();
+            }
+            if (toc & kTocMetaData) {
+                Reader reader(data+meta_begin, data+raw_begin, bigEndian);
+                unsigned int n_objects = reader.Get<unsigned int>();
+                for (unsigned int n_o = 0; n_o < n_objects; ++n_o) {
+                    std::string path = reader.GetString();
+                    if (objects.find(path) == objects.end()) {
+                        order.push_back(path);
+                    }
+                    Object& obj = objects[path];
+                    unsigned int index = reader.Get<unsigned int>();
+                    std::vector<std::string>::iterator it = std::find(active.begin(), active.end(), path);
+                    if (index == kNoRawData) {
+                        if (it != active.end()) {
+                            active.erase(it);
+                        }
+                    } else {
+                        if (index != kSameRawIndex) {
+                            if (index == 0x69120000 || index == 0x69130000) {
+                                throw std::runtime_error("DAQmx raw data in TDMS files aren't supported");
+                            }
+                            obj.type = reader.Get<unsigned int>();
+                            if (reader.Get<unsigned int>() != 1) {
+                                throw std::runtime_error("Multidimensional arrays in TDMS files aren't supported");
+                            }
+                            obj.n_values = reader.Get<unsigned long long>();
+                            if (obj.type == tdsTypeString) {
+                                obj.bytes = reader.Get<unsigned long long>();
+                            } else {
+                                obj.bytes = obj.n_values*typeSize(obj.type);
+                            }
+                        }
+                        if (it == active.end()) {
+                            active.push_back(path);
+                        }
+                    }
+                    unsigned int n_props = reader.Get<unsigned int>();
+                    for (unsigned int n_p = 0; n_p < n_props; ++n_p) {
+                        std::string name = reader.GetString();
+                        obj.props[name] = readProperty(reader);
+                    }
+                }
+            }
+            if (toc & kTocRawData) {
+                bool interleaved = (toc & kTocInterleavedData) != 0;
+                std::size_t chunk = 0, width = 0;
+                for (std::size_t n_a = 0; n_a < active.size(); ++n_a) {
+                    const Object& obj = objects[active[n_a]];
+                    chunk += (std::size_t)obj.bytes;
+                    width += typeSize(obj.type);
+                }
+                std::size_t n_chunks = chunk > 0 ? (seg_end-raw_begin) / chunk : 0;
+                std::size_t offset = raw_begin;
+                for (std::size_t n_c = 0; n_c < n_chunks; ++n_c) {
+                    for (std::size_t n_a = 0; n_a < active.size(); ++n_a) {
+                        Object& obj = objects[active[n_a]];
+                        Piece piece;
+                        piece.bigEndian = bigEndian;
+                        if (interleaved) {
+                            if (obj.type == tdsTypeString) {
+                                throw std::runtime_error("Interleaved strings in TDMS files aren't supported");
+                            }
+                            piece.offset = offset;
+                            piece.size = (std::size_t)obj.n_values;
+                            piece.stride = width;
+                            offset += typeSize(obj.type);
+                        } else {
+                            piece.offset = offset;
+                            piece.size = (std::size_t)obj.n_values;
+                            piece.stride = obj.type == tdsTypeString ? 0 : typeSize(obj.type);
+                            offset += (std::size_t)obj.bytes;
+                        }
+                        if (piece.size > 0 && obj.type != tdsTypeString) {
+                            obj.pieces.push_back(piece);
+                        }
+                    }
+                    if (interleaved) {
+                        offset = raw_begin + (n_c+1)*chunk;
+                    }
+                }
+            }
+            progDlg.Update((int)(100.0*seg_end/size), "Reading TDMS segments");
+            pos = seg_end;
+        }
+    }
+
+    Section readSection(const stfio::MappedFile& file,
+#if (__cplusplus < 201103)
+                        const boost::shared_ptr<stfio::MappedFile>& mapped,
+#else
+                        const std::shared_ptr<stfio::MappedFile>& mapped,
+#endif
+                        const Object& obj, const std::string& label)
+    {
+        stfio::SampleType sampleType;
+        bool lazy = isMappable(obj.type, sampleType);
+        std::size_t n_samples = 0;
+        for (std::size_t n_p = 0; n_p < obj.pieces.size(); ++n_p) {
+            lazy = lazy && (obj.pieces[n_p].bigEndian == hostIsBigEndian());
+            n_samples += obj.pieces[n_p].size;
+        }
+        if (lazy) {
+            std::vector<stfio::MappedSamples> pieces;
+            for (std::size_t n_p = 0; n_p < obj.pieces.size(); ++n_p) {
+                const Piece& piece = obj.pieces[n_p];
+                pieces.push_back(stfio::MappedSamples(mapped, piece.offset, piece.size,
+                                                      piece.stride, sampleType));
+            }
+            return Section(pieces.size() == 1 ? pieces[0] : stfio::chainSamples(pieces), label);
+        }
+        Vector_double samples(n_samples);
+        std::size_t n_done = 0;
+        for (std::size_t n_p = 0; n_p < obj.pieces.size(); ++n_p) {
+            decodePiece(file.GetData(), obj.pieces[n_p], obj.type, &samples[n_done]);
+            n_done += obj.pieces[n_p].size;
+        }
+        return Section(STFIO_MOVE(samples), label);
+    }
+
+    double findProperty(const std::map<std::string, Property>& props, const std::string& name,
+                        double defaultValue)
+    {
+        std::map<std::string, Property>::const_iterator it = props.find(name);
+        if (it == props.end()) {
+            return defaultValue;
+        }
+        if (it->second.isText) {
+            std::istringstream text(it->second.text);
+            double value = defaultValue;
+            text >> value;
+            return value;
+        }
+        return it->second.value;
+    }
+}
+
+void stfio::importTDMSFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg) {
+#if (__cplusplus < 201103)
+    boost::shared_ptr<MappedFile> file(new MappedFile(fName));
+#else
+    std::shared_ptr<MappedFile> file(new MappedFile(fName));
+#endif
+    std::vector<std::string> order;
+    std::map<std::string, Object> objects;
+    readSegments(*file, order, objects, progDlg);
+
+    // groups and their channels in the order of their first appearance:
+    std::vector<std::string> groups;
+    std::map<std::string, std::vector<std::string> > channels;
+    for (std::size_t n_o = 0; n_o < order.size(); ++n_o) {
+        if (order[n_o] == "/") {
+            continue;
+        }
+        std::vector<std::string> names = splitPath(order[n_o]);
+        if (names.size() == 1 && channels.find(names[0]) == channels.end()) {
+            groups.push_back(names[0]);
+            channels[names[0]];
+        } else if (names.size() == 2) {
+            if (channels.find(names[0]) == channels.end()) {
+                groups.push_back(names[0]);
+            }
+            channels[names[0]].push_back(order[n_o]);
+        }
+    }
+
+    double dt = 0;
+    for (std::size_t n_g = 0; n_g < groups.size() && dt <= 0; ++n_g) {
+        if (lower(groups[n_g]) != "time") {
+            continue;
+        }
+        const std::vector<std::string>& paths = channels[groups[n_g]];
+        for (std::size_t n_c = 0; n_c < paths.size(); ++n_c) {
+            const Object& obj = objects[paths[n_c]];
+            if (!obj.pieces.empty()) {
+                Section times(readSection(*file, file, obj, ""));
+                if (times.size() > 1) {
+                    // the mean of the differences:
+                    dt = (times[times.size()-1]-times[0]) / (times.size()-1);
+                }
+                break;
+            }
+        }
+    }
+
+    std::vector<Channel> imported;
+    for (std::size_t n_g = 0; n_g < groups.size(); ++n_g) {
+        std::string prefix = lower(groups[n_g]).substr(0, 2);
+        if (prefix != "ai" && prefix != "ao") {
+            continue;
+        }
+        const std::vector<std::string>& paths = channels[groups[n_g]];
+        std::vector<Section> sections;
+        std::string units;
+        for (std::size_t n_c = 0; n_c < paths.size(); ++n_c) {
+            const Object& obj = objects[paths[n_c]];
+            if (obj.pieces.empty()) {
+                continue;
+            }
+            sections.push_back(readSection(*file, file, obj, splitPath(paths[n_c])[1]));
+            if (dt <= 0) {
+                // waveform increments are stored in s:
+                dt = 1e3*findProperty(obj.props, "wf_increment", 0);
+            }
+            std::map<std::string, Property>::const_iterator unit = obj.props.find("unit_string");
+            if (units.empty() && unit != obj.props.end() && unit->second.isText) {
+                units = unit->second.text;
+            }
+        }
+        if (sections.empty()) {
+            continue;
+        }
+        Channel ch(sections.size());
+        for (std::size_t n_s = 0; n_s < sections.size(); ++n_s) {
+            ch.InsertSection(STFIO_MOVE(sections[n_s]), n_s);
+        }
+        ch.SetChannelName(groups[n_g]);
+        if (!units.empty()) {
+            ch.SetYUnits(units);
+        }
+        imported.push_back(STFIO_MOVE(ch));
+    }
+
+    if (dt <= 0) {
+        const std::map<std::string, Property>& root = objects["/"].props;
+        double sr = findProperty(root, "Sampling Rate", findProperty(root, "Sampling Rate(AI)", -1));
+        if (root.find("Sampling Rate") == root.end() && root.find("Sampling Rate(AI)") == root.end()) {
+            dt = 1.0;
+        } else {
+            dt = sr > 0 ? 1e3/sr : 1.0/25.0;
+        }
+    }
+
+    ReturnData.resize(imported.size());
+    for (std::size_t n_c = 0; n_c < imported.size(); ++n_c) {
+        ReturnData.InsertChannel(STFIO_MOVE(imported[n_c]), n_c);
+    }
+    ReturnData.SetXScale(dt);
+}
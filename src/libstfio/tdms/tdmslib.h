@@ -0,0 +1,49 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file tdmslib.h
+ *  \brief Import National Instruments TDMS files.
+ */
+
+#ifndef _TDMSLIB_H
+#define _TDMSLIB_H
+
+#include "./../stfio.h"
+
+class Recording;
+
+namespace stfio {
+
+//! Open a TDMS file and store its contents to a Recording object.
+/*! Every group whose name starts with "ai" or "ao" (case-insensitive)
+ *  becomes a channel, and every TDMS channel of such a group becomes a
+ *  section. Samples that are stored as little-endian 16- or 32-bit
+ *  integers or floating point numbers stay in the file and are decoded
+ *  on demand (see stfio::MappedSamples); samples that are spread over
+ *  several segments are chained rather than copied. The sampling
+ *  interval is taken from the first channel of a group called "time" if
+ *  there is one, then from the "wf_increment" property of the first
+ *  section, and finally from the "Sampling Rate" or "Sampling Rate(AI)"
+ *  properties of the file. Throws std::runtime_error if the file can't
+ *  be read, e.g. because it holds DAQmx raw data.
+ *  \param fName Full path to the file to be read.
+ *  \param ReturnData On entry, an empty Recording object. On exit,
+ *         the data stored in \e fName.
+ *  \param progDlg Progress indicator.
+ */
+void importTDMSFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg);
+
+}
+
+#endif
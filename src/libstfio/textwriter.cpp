@@ -0,0 +1,187 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file textwriter.cpp
+ *  \brief Defines a buffered writer for large tables of numbers in text files.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+#include <stdexcept>
+#include <algorithm>
+#if (__cplusplus >= 201703L)
+#include <charconv>
+#endif
+
+#include "./textwriter.h"
+#include "./section.h"
+#include "./parallel.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    // Size of the text buffer of every thread:
+    const std::size_t blockBytes = 1024*1024;
+
+#ifndef __cpp_lib_to_chars
+    // Replaces the decimal point of the current locale:
+    void toCLocale(char* begin, char* end) {
+        char point = localeconv()->decimal_point[0];
+        if (point != '.') {
+            std::replace(begin, end, point, '.');
+        }
+    }
+#endif
+}
+
+char* stfio::formatNumber(double value, int precision, char* dest) {
+#ifdef __cpp_lib_to_chars
+    std::to_chars_result result = (precision > 0) ?
+        std::to_chars(dest, dest+numberTextSize, value, std::chars_format::general, precision) :
+        std::to_chars(dest, dest+numberTextSize, value);
+    return result.ptr;
+#else
+    int length = 0;
+    if (precision > 0) {
+        length = snprintf(dest, numberTextSize, "%.*g", precision, value);
+    } else {
+        // 17 significant digits always read back as the same number:
+        for (int digits = 15; digits <= 17; ++digits) {
+            length = snprintf(dest, numberTextSize, "%.*g", digits, value);
+            if (strtod(dest, NULL) == value) {
+                break;
+            }
+        }
+    }
+    toCLocale(dest, dest+length);
+    return dest+length;
+#endif
+}
+
+std::size_t stfio::TextColumn::GetSize() const {
+    return (section != NULL) ? section->size() : size;
+}
+
+void stfio::writeTextTable(const std::string& fName, const std::string& header,
+                           const std::vector<TextColumn>& columns,
+                           const std::string& separator, const std::string& lineEnd,
+                           double fill, int n_threads)
+{
+    std::size_t n_cols = columns.size();
+    std::size_t n_rows = 0;
+    for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+        n_rows = std::max(n_rows, columns[n_c].GetSize());
+    }
+    // blocks of rows that fill a buffer:
+    std::size_t rowBytes = n_cols*(numberTextSize + separator.size()) + lineEnd.size();
+    std::size_t blockRows = std::max<std::size_t>(1, blockBytes/rowBytes);
+    int n_blocks = (int)((n_rows + blockRows - 1)/blockRows);
+
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_blocks);
+#else
+    n_threads = 1;
+#endif
+
+    FILE* fp = fopen(fName.c_str(), "wb");
+    if (fp == NULL) {
+        throw std::runtime_error("Couldn't open " + fName + " for writing");
+    }
+    bool written = (fwrite(header.data(), 1, header.size(), fp) == header.size());
+
+    // every thread reuses its buffers for all of its blocks:
+    std::vector< std::vector<char> > texts(n_threads, std::vector<char>(blockRows*rowBytes));
+    std::vector<Vector_double> values(n_threads, Vector_double(blockRows*n_cols));
+    std::string error;
+#ifdef _OPENMP
+#pragma omp parallel for ordered schedule(static, 1) num_threads(n_threads)
+#endif
+    for (int n_b = 0; n_b < n_blocks; ++n_b) {
+#ifdef _OPENMP
+        int n_t = omp_get_thread_num();
+#else
+        int n_t = 0;
+#endif
+        std::size_t begin = n_b*blockRows;
+        std::size_t end = std::min(begin + blockRows, n_rows);
+        char* text = &texts[n_t][0];
+        char* pos = text;
+        bool formatted = true;
+        try {
+            // the values of every column, as contiguous doubles:
+            double* block = &values[n_t][0];
+            for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+                const TextColumn& col = columns[n_c];
+                double* dest = block + n_c*blockRows;
+                std::size_t available = std::min(std::max(col.GetSize(), begin), end);
+                if (col.section != NULL) {
+                    if (available > begin) {
+                        col.section->CopyRange(begin, available, dest);
+                    }
+                } else {
+                    for (std::size_t n = begin; n < available; ++n) {
+                        dest[n-begin] = n*col.step;
+                    }
+                }
+                std::fill(dest + (available-begin), dest + (end-begin), fill);
+            }
+            for (std::size_t n = 0; n < end-begin; ++n) {
+                for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+                    if (n_c > 0) {
+                        memcpy(pos, separator.data(), separator.size());
+                        pos += separator.size();
+                    }
+                    pos = formatNumber(block[n_c*blockRows + n], columns[n_c].precision, pos);
+                }
+                memcpy(pos, lineEnd.data(), lineEnd.size());
+                pos += lineEnd.size();
+            }
+        }
+        catch (const std::exception& e) {
+            formatted = false;
+#ifdef _OPENMP
+#pragma omp critical(textwriter_error)
+#endif
+            {
+                if (error.empty()) {
+                    error = e.what();
+                }
+            }
+        }
+        // blocks are written in order while the other threads keep formatting:
+#ifdef _OPENMP
+#pragma omp ordered
+#endif
+        {
+            if (written && formatted) {
+                written = (fwrite(text, 1, pos-text, fp) == (std::size_t)(pos-text));
+            }
+        }
+    }
+    if (fclose(fp) != 0) {
+        written = false;
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    if (!written) {
+        throw std::runtime_error("Couldn't write to " + fName);
+    }
+}
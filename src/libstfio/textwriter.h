@@ -0,0 +1,98 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+/*! \file textwriter.h
+ *  \brief Declares a buffered writer for large tables of numbers in text files.
+ */
+
+#ifndef _TEXTWRITER_H
+#define _TEXTWRITER_H
+
+#include <string>
+#include <vector>
+
+#include "./stfio.h"
+
+class Section;
+
+/*! \addtogroup stfio
+ *  @{
+ */
+
+namespace stfio {
+
+//! Maximal number of characters that stfio::formatNumber() writes.
+const int numberTextSize = 32;
+
+//! Formats a number in the C locale, independent of the current locale.
+/*! \param value The number.
+ *  \param precision Number of significant digits, or 0 for the shortest
+ *         text that reads back as the same number.
+ *  \param dest Buffer for at least stfio::numberTextSize characters.
+ *  \return Pointer past the last character; no terminating null is written.
+ */
+StfioDll char* formatNumber(double value, int precision, char* dest);
+
+//! A column of a table that is written by stfio::writeTextTable().
+struct StfioDll TextColumn {
+    //! Constructor for a column that holds the data points of a section.
+    /*! \param section_ The section; it has to exist until the table has been written.
+     *  \param precision_ Number of significant digits, or 0 for the shortest
+     *         text that reads back as the same number.
+     */
+    explicit TextColumn(const Section& section_, int precision_=0)
+        : section(&section_), size(0), step(0), precision(precision_) {}
+
+    //! Constructor for a column of equally spaced values, such as a time axis.
+    /*! \param size_ Number of values.
+     *  \param step_ Interval between values; the first value is 0.
+     *  \param precision_ Number of significant digits, or 0 for the shortest
+     *         text that reads back as the same number.
+     */
+    TextColumn(std::size_t size_, double step_, int precision_)
+        : section(NULL), size(size_), step(step_), precision(precision_) {}
+
+    //! Retrieves the number of values.
+    std::size_t GetSize() const;
+
+    const Section* section; /*!< The section, or NULL for equally spaced values. */
+    std::size_t size; /*!< Number of equally spaced values. */
+    double step; /*!< Interval between equally spaced values. */
+    int precision; /*!< Significant digits, 0 for the shortest text. */
+};
+
+//! Writes a table of numbers to a text file.
+/*! Blocks of rows are formatted in parallel into buffers that are reused
+ *  for the next blocks, and each block is written as soon as all blocks
+ *  before it have been written, so that formatting and writing overlap.
+ *  Throws std::runtime_error if the file can't be written.
+ *  \param fName Full path to the file to be written.
+ *  \param header Text that is written before the first row, including its line breaks.
+ *  \param columns The columns. There are as many rows as values in the longest column.
+ *  \param separator Text between the values of a row.
+ *  \param lineEnd Text at the end of each row.
+ *  \param fill Value that is written past the end of shorter columns.
+ *  \param n_threads Number of threads, or 0 to use the configured number of threads.
+ */
+StfioDll void writeTextTable(const std::string& fName, const std::string& header,
+                             const std::vector<TextColumn>& columns,
+                             const std::string& separator="\t", const std::string& lineEnd="\n",
+                             double fill=0.0, int n_threads=0);
+
+}
+
+/*@}*/
+
+#endif
@@ -0,0 +1,978 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file zarrlib.cpp
+ *  \brief Import from and export to chunked Zarr (version 2) stores.
+ *
+ *  Follows the Zarr storage specification, version 2, at
+ *  https://zarr.readthedocs.io/en/stable/spec/v2.html
+ */
+
+#include <zlib.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./zarrlib.h"
+#include "./../recording.h"
+#include "./../mappedfile.h"
+#include "./../hdf5/ephyscodec.h"
+#include "./../parallel.h"
+
+namespace {
+
+    // Samples per chunk of a section:
+    const std::size_t CHUNKSIZE = 65536;
+    // Chunks that are compressed before they're written:
+    const std::size_t CHUNKBATCH = 64;
+    // Chunks of a section that are fetched at once, even on few processors,
+    // since fetching from remote stores waits for the network:
+    const int FETCH_THREADS = 8;
+    // Compression level of zlib:
+    const int ZLIB_LEVEL = 4;
+
+    // Stores by URL scheme, and where chunks of remote stores are cached:
+    std::map<std::string, stfio::ChunkStoreFactory> storeFactories;
+    std::string chunkCacheDir;
+
+    // Stores that lazily read sections refer to, with the number of sections:
+    std::map<std::string, std::size_t> lazyStores;
+
+    // A parsed JSON value.
+    struct Json {
+        enum Type { null_type, bool_type, number_type, string_type, array_type, object_type };
+
+        Json() : type(null_type), number(0) {}
+
+        // Member of an object, or null if there's none:
+        const Json& operator[](const std::string& key) const {
+            static const Json null;
+            std::map<std::string, Json>::const_iterator it = members.find(key);
+            return it == members.end() ? null : it->second;
+        }
+        double Number(double defaultValue) const { return type == number_type ? number : defaultValue; }
+        std::string String(const std::string& defaultValue) const {
+            return type == string_type ? str : defaultValue;
+        }
+
+        Type type;
+        double number;
+        std::string str;
+        std::vector<Json> items;
+        std::map<std::string, Json> members;
+    };
+
+    // Parses JSON text; throws std::runtime_error on syntax errors.
+    class JsonParser {
+    public:
+        JsonParser(const std::vector<unsigned char>& text, const std::string& name_)
+            : p((const char*)(text.empty() ? NULL : &text[0])), end(p + text.size()), name(name_) {}
+
+        Json Parse() {
+            Json value = Value();
+            Skip();
+            if (p != end) {
+                Fail();
+            }
+            return value;
+        }
+
+    private:
+        void Fail() const { throw std::runtime_error("Invalid JSON in " + name); }
+
+        void Skip() {
+            while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+                ++p;
+            }
+        }
+
+        bool Literal(const char* word) {
+            std::size_t n = std::strlen(word);
+            if ((std::size_t)(end - p) < n || std::strncmp(p, word, n) != 0) {
+                return false;
+            }
+            p += n;
+            return true;
+        }
+
+        Json Value() {
+            Skip();
+            if (p == end) {
+                Fail();
+            }
+            Json value;
+            if (*p == '{') {
+                value.type = Json::object_type;
+                ++p;
+                Skip();
+                if (p != end && *p == '}') {
+                    ++p;
+                    return value;
+                }
+                for (;;) {
+                    Skip();
+                    std::string key = String();
+                    Skip();
+                    if (p == end || *p++ != ':') {
+                        Fail();
+                    }
+                    value.members[key] = Value();
+                    Skip();
+                    if (p == end) {
+                        Fail();
+                    }
+                    if (*p == '}') {
+                        ++p;
+                        return value;
+                    }
+                    if (*p++ != ',') {
+                        Fail();
+                    }
+                }
+            }
+            if (*p == '[') {
+                value.type = Json::array_type;
+                ++p;
+                Skip();
+                if (p != end && *p == ']') {
+                    ++p;
+                    return value;
+                }
+                for (;;) {
+                    value.items.push_back(Value());
+                    Skip();
+                    if (p == end) {
+                        Fail();
+                    }
+                    if (*p == ']') {
+                        ++p;
+                        return value;
+                    }
+                    if (*p++ != ',') {
+                        Fail();
+                    }
+                }
+            }
+            if (*p == '"') {
+                value.type = Json::string_type;
+                value.str = String();
+                return value;
+            }
+            if (Literal("null")) {
+                return value;
+            }
+            if (Literal("true")) {
+                value.type = Json::bool_type;
+                value.number = 1;
+                return value;
+            }
+            if (Literal("false")) {
+                value.type = Json::bool_type;
+                return value;
+            }
+            // numbers, including the NaN and Infinity of Python's json module:
+            value.type = Json::number_type;
+            if (Literal("NaN")) {
+                value.number = std::numeric_limits<double>::quiet_NaN();
+                return value;
+            }
+            std::string number;
+            while (p != end && std::strchr("+-.0123456789eE", *p) != NULL) {
+                number += *p++;
+            }
+            if (Literal("Infinity")) {
+                value.number = (number == "-" ? -1 : 1)*std::numeric_limits<double>::infinity();
+                return value;
+            }
+            char* parsed = NULL;
+            value.number = std::strtod(number.c_str(), &parsed);
+            if (number.empty() || *parsed != '\0') {
+                Fail();
+            }
+            return value;
+        }
+
+        std::string String() {
+            if (p == end || *p++ != '"') {
+                Fail();
+            }
+            std::string str;
+            while (p != end && *p != '"') {
+                char c = *p++;
+                if (c != '\\') {
+                    str += c;
+                    continue;
+                }
+                if (p == end) {
+                    Fail();
+                }
+                c = *p++;
+                switch (c) {
+                 case 'b': str += '\b'; break;
+                 case 'f': str += '\f'; break;
+                 case 'n': str += '\n'; break;
+                 case 'r': str += '\r'; break;
+                 case 't': str += '\t'; break;
+                 case 'u': {
+                     if (end - p < 4) {
+                         Fail();
+                     }
+                     unsigned int code = (unsigned int)std::strtoul(std::string(p, 4).c_str(), NULL, 16);
+                     p += 4;
+                     // UTF-8; surrogate pairs aren't combined:
+                     if (code < 0x80) {
+                         str += (char)code;
+                     } else if (code < 0x800) {
+                         str += (char)(0xc0 | (code >> 6));
+                         str += (char)(0x80 | (code & 0x3f));
+                     } else {
+                         str += (char)(0xe0 | (code >> 12));
+                         str += (char)(0x80 | ((code >> 6) & 0x3f));
+                         str += (char)(0x80 | (code & 0x3f));
+                     }
+                     break;
+                 }
+                 default: str += c;
+                }
+            }
+            if (p == end) {
+                Fail();
+            }
+            ++p;
+            return str;
+        }
+
+        const char* p;
+        const char* end;
+        std::string name;
+    };
+
+    std::string jsonString(const std::string& s) {
+        std::string out("\"");
+        for (std::size_t n = 0; n < s.size(); ++n) {
+            if (s[n] == '"' || s[n] == '\\') {
+                out += '\\';
+                out += s[n];
+            } else if ((unsigned char)s[n] < 0x20) {
+                char buf[8];
+                std::sprintf(buf, "\\u%04x", (unsigned char)s[n]);
+                out += buf;
+            } else {
+                out += s[n];
+            }
+        }
+        out += '"';
+        return out;
+    }
+
+    std::vector<unsigned char> bytes(const std::string& text) {
+        return std::vector<unsigned char>(text.begin(), text.end());
+    }
+
+    // Reads and parses a metadata object; returns null if there is none.
+    Json readJson(const stfio::ChunkStore& store, const std::string& key, const std::string& location) {
+        std::vector<unsigned char> text;
+        if (!store.Get(key, text)) {
+            return Json();
+        }
+        return JsonParser(text, location + "/" + key).Parse();
+    }
+
+    bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+        return _mkdir(path.c_str()) == 0;
+#else
+        return mkdir(path.c_str(), 0755) == 0;
+#endif
+    }
+
+    // Creates the directories of a path if they don't exist.
+    void makeParents(const std::string& path) {
+        for (std::size_t pos = path.find_first_of("/\\", 1); pos != std::string::npos;
+             pos = path.find_first_of("/\\", pos+1))
+        {
+            makeDirectory(path.substr(0, pos));
+        }
+    }
+
+    // FNV-1a, to give each cached store a directory of its own:
+    std::string hashName(const std::string& text) {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (std::size_t n = 0; n < text.size(); ++n) {
+            hash = (hash ^ (unsigned char)text[n]) * 1099511628211ULL;
+        }
+        char buf[32];
+        std::sprintf(buf, "%016llx", hash);
+        return buf;
+    }
+
+    // The storage format of an array, as far as it's understood here.
+    struct ArrayFormat {
+        std::string key;              // the array's key in the store, e.g. "Im"
+        std::size_t rows, cols;       // shape; 1-D arrays have a single row
+        std::size_t chunk_rows, chunk_cols;
+        int rank;
+        char separator;
+        char kind;                    // 'i', 'u' or 'f'
+        std::size_t size;             // bytes per element
+        bool compressed, shuffled;
+        double fill, scale, shift;
+
+        std::string ChunkKey(std::size_t row, std::size_t col) const {
+            std::ostringstream key_str;
+            if (!key.empty()) {
+                key_str << key << "/";
+            }
+            if (rank == 2) {
+                key_str << row << separator;
+            }
+            key_str << col;
+            return key_str.str();
+        }
+
+        // Decodes little-endian element n of a chunk:
+        double Element(const unsigned char* p) const {
+            unsigned long long raw = 0;
+            for (std::size_t b = 0; b < size; ++b) {
+                raw |= (unsigned long long)p[b] << (8*b);
+            }
+            switch (kind) {
+             case 'f':
+                 if (size == 4) {
+                     unsigned int bits = (unsigned int)raw;
+                     float value;
+                     std::memcpy(&value, &bits, 4);
+                     return value;
+                 } else {
+                     double value;
+                     std::memcpy(&value, &raw, 8);
+                     return value;
+                 }
+             case 'i': {
+                 // sign extension:
+                 unsigned long long sign = 1ULL << (8*size - 1);
+                 return (double)(long long)((raw ^ sign) - sign);
+             }
+             default:
+                 return (double)raw;
+            }
+        }
+    };
+
+    typedef
+#if (__cplusplus < 201103)
+        boost::shared_ptr<const ArrayFormat>
+#else
+        std::shared_ptr<const ArrayFormat>
+#endif
+        ArrayFormatPtr;
+
+    ArrayFormat parseArray(const Json& zarray, const Json& zattrs, const std::string& key,
+                           const std::string& location)
+    {
+        ArrayFormat format;
+        format.key = key;
+        const Json& shape = zarray["shape"];
+        const Json& chunks = zarray["chunks"];
+        std::string dtype = zarray["dtype"].String("");
+        const Json& compressor = zarray["compressor"];
+        const Json& filters = zarray["filters"];
+        std::string error;
+        if (zarray.type != Json::object_type || zarray["zarr_format"].Number(0) != 2) {
+            error = "is not a Zarr array of version 2";
+        } else if (shape.items.size() != chunks.items.size() || shape.items.empty() || shape.items.size() > 2) {
+            error = "has an unsupported shape";
+        } else if (zarray["order"].String("C") != "C") {
+            error = "is not stored in C order";
+        } else if (dtype.size() < 3 || (dtype[0] != '<' && dtype[0] != '|') ||
+                   std::strchr("iuf", dtype[1]) == NULL || dtype[1] == '\0')
+        {
+            error = "has an unsupported data type " + dtype;
+        } else if (compressor.type != Json::null_type &&
+                   compressor["id"].String("") != "zlib" && compressor["id"].String("") != "gzip")
+        {
+            error = "uses an unsupported compressor " + compressor["id"].String("");
+        }
+        format.rank = (int)shape.items.size();
+        format.kind = dtype.size() > 1 ? dtype[1] : 'f';
+        format.size = std::atoi(dtype.c_str() + std::min((std::size_t)2, dtype.size()));
+        if (error.empty() && (format.size == 0 || format.size > 8 || (format.kind == 'f' && format.size != 4 && format.size != 8))) {
+            error = "has an unsupported data type " + dtype;
+        }
+        format.shuffled = false;
+        for (std::size_t n_f = 0; n_f < filters.items.size() && error.empty(); ++n_f) {
+            if (filters.items[n_f]["id"].String("") != "shuffle" || n_f > 0) {
+                error = "uses an unsupported filter " + filters.items[n_f]["id"].String("");
+            }
+            format.shuffled = true;
+        }
+        if (!error.empty()) {
+            throw std::runtime_error(location + "/" + key + " " + error);
+        }
+        format.rows = format.rank == 2 ? (std::size_t)shape.items[0].Number(0) : 1;
+        format.cols = (std::size_t)shape.items[format.rank-1].Number(0);
+        format.chunk_rows = format.rank == 2 ? (std::size_t)chunks.items[0].Number(1) : 1;
+        format.chunk_cols = (std::size_t)chunks.items[format.rank-1].Number(1);
+        if (format.chunk_rows == 0 || format.chunk_cols == 0) {
+            throw std::runtime_error(location + "/" + key + " has empty chunks");
+        }
+        format.separator = zarray["dimension_separator"].String(".") == "/" ? '/' : '.';
+        format.compressed = compressor.type != Json::null_type;
+        format.fill = zarray["fill_value"].Number(0);
+        format.scale = zattrs["scale_factor"].Number(1.0);
+        format.shift = zattrs["add_offset"].Number(0.0);
+        return format;
+    }
+
+    // Decompresses zlib or gzip data of a known size.
+    bool inflateChunk(const std::vector<unsigned char>& src, std::vector<unsigned char>& dest, std::size_t size) {
+        dest.resize(size);
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        // detects zlib and gzip headers:
+        if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+            return false;
+        }
+        stream.next_in = (Bytef*)&src[0];
+        stream.avail_in = (uInt)src.size();
+        stream.next_out = (Bytef*)&dest[0];
+        stream.avail_out = (uInt)dest.size();
+        int status = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        return status == Z_STREAM_END && stream.total_out == size;
+    }
+
+    // Fetches and decodes a chunk, and copies the samples [col_begin, col_end)
+    // of a row to dest. Missing chunks hold the fill value.
+    void readChunk(const stfio::ChunkStore& store, const ArrayFormat& format, std::size_t row,
+                   std::size_t chunk_col, std::size_t col_begin, std::size_t col_end, double* dest)
+    {
+        std::vector<unsigned char> raw, decoded;
+        std::string key = format.ChunkKey(row / format.chunk_rows, chunk_col);
+        if (!store.Get(key, raw)) {
+            std::fill(dest, dest + (col_end-col_begin), format.scale*format.fill + format.shift);
+            return;
+        }
+        std::size_t n_elements = format.chunk_rows*format.chunk_cols;
+        std::size_t n_bytes = n_elements*format.size;
+        if (format.compressed) {
+            if (raw.empty() || !inflateChunk(raw, decoded, n_bytes)) {
+                throw std::runtime_error("Corrupt chunk " + key);
+            }
+            raw.swap(decoded);
+        }
+        if (raw.size() != n_bytes) {
+            throw std::runtime_error("Unexpected size of chunk " + key);
+        }
+        if (format.shuffled) {
+            decoded.resize(n_bytes);
+            for (std::size_t b = 0; b < format.size; ++b) {
+                for (std::size_t n = 0; n < n_elements; ++n) {
+                    decoded[n*format.size + b] = raw[b*n_elements + n];
+                }
+            }
+            raw.swap(decoded);
+        }
+        std::size_t first = (row % format.chunk_rows)*format.chunk_cols + (col_begin - chunk_col*format.chunk_cols);
+        for (std::size_t n = 0; n < col_end-col_begin; ++n) {
+            dest[n] = format.scale*format.Element(&raw[(first+n)*format.size]) + format.shift;
+        }
+    }
+
+    // Reads a row of an array from a store; the chunks are fetched in parallel.
+    class ReadRow : public stfio::SampleOperation {
+    public:
+        ReadRow(const stfio::ChunkStorePtr& store_, const ArrayFormatPtr& format_, const std::string& location_,
+                std::size_t row_, std::size_t length_)
+            : store(store_), format(format_), location(location_), row(row_), length(length_)
+        {
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_stores)
+#endif
+            ++lazyStores[location];
+        }
+
+        ~ReadRow() {
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_stores)
+#endif
+            {
+                std::map<std::string, std::size_t>::iterator it = lazyStores.find(location);
+                if (it != lazyStores.end() && --it->second == 0) {
+                    lazyStores.erase(it);
+                }
+            }
+        }
+
+        void Apply(std::vector<double>& data) const {
+            data.resize(length);
+            int n_chunks = (int)((length + format->chunk_cols - 1) / format->chunk_cols);
+            std::string error;
+#ifdef _OPENMP
+            int n_threads = stfio::threadCount(std::max(stfio::getThreadCount(), FETCH_THREADS), n_chunks);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+            for (int n_k = 0; n_k < n_chunks; ++n_k) {
+                std::size_t begin = n_k*format->chunk_cols;
+                std::size_t end = std::min(begin + format->chunk_cols, length);
+                try {
+                    readChunk(*store, *format, row, n_k, begin, end, &data[begin]);
+                }
+                catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_read)
+#endif
+                    error = e.what();
+                }
+            }
+            if (!error.empty()) {
+                throw std::runtime_error(error);
+            }
+        }
+
+        std::size_t Size(std::size_t) const { return length; }
+
+    private:
+        ReadRow(const ReadRow&);
+        ReadRow& operator=(const ReadRow&);
+
+        stfio::ChunkStorePtr store;
+        ArrayFormatPtr format;
+        std::string location;
+        std::size_t row, length;
+    };
+
+    // Strips the name of a metadata file from the location of a store:
+    std::string storeLocation(const std::string& fName) {
+        std::string location(fName);
+        const char* names[] = { ".zgroup", ".zattrs" };
+        for (int n = 0; n < 2; ++n) {
+            std::size_t len = std::strlen(names[n]);
+            if (location.size() > len && location.compare(location.size()-len, len, names[n]) == 0 &&
+                (location[location.size()-len-1] == '/' || location[location.size()-len-1] == '\\'))
+            {
+                location.erase(location.size()-len-1);
+            }
+        }
+        while (location.size() > 1 && (location[location.size()-1] == '/' || location[location.size()-1] == '\\')) {
+            location.erase(location.size()-1);
+        }
+        return location;
+    }
+
+    // The name of a channel's array; unique within the store:
+    std::string arrayName(const std::string& channelName, std::size_t n_c, const std::vector<std::string>& taken) {
+        std::string name;
+        for (std::size_t n = 0; n < channelName.size(); ++n) {
+            char c = channelName[n];
+            name += (c == '/' || c == '\\' || c == '.' || (unsigned char)c < 0x20) ? '_' : c;
+        }
+        if (name.empty() || std::find(taken.begin(), taken.end(), name) != taken.end()) {
+            std::ostringstream numbered;
+            numbered << (name.empty() ? "ch" : name + "_") << n_c;
+            name = numbered.str();
+        }
+        return name;
+    }
+
+    // A chunk of an export:
+    struct ExportChunk {
+        std::size_t row, col;
+        std::vector<unsigned char> bytes;
+
+        std::string ChunkKey(const std::string& name) const {
+            std::ostringstream key;
+            key << name << "/" << row << "." << col;
+            return key.str();
+        }
+    };
+
+    void writeChannel(stfio::ChunkStore& store, const Channel& channel, const std::string& name,
+                      double dt, const std::string& xunits, std::size_t n_c, std::size_t n_channels,
+                      stfio::ProgressInfo& progDlg)
+    {
+        double scale = 1.0, shift = 0.0;
+        bool integer = stfio::findQuantization(channel, scale, shift);
+        std::size_t type_size = integer ? 2 : 4;
+        std::size_t max_length = 0;
+        for (std::size_t n_s = 0; n_s < channel.size(); ++n_s) {
+            max_length = std::max(max_length, channel[n_s].size());
+        }
+        std::size_t chunk_cols = std::max(std::min(max_length, CHUNKSIZE), (std::size_t)1);
+
+        std::vector<ExportChunk> chunks;
+        for (std::size_t n_s = 0; n_s < channel.size(); ++n_s) {
+            for (std::size_t col = 0; col < channel[n_s].size(); col += chunk_cols) {
+                ExportChunk chunk;
+                chunk.row = n_s;
+                chunk.col = col / chunk_cols;
+                chunks.push_back(chunk);
+            }
+        }
+        for (std::size_t batch = 0; batch < chunks.size(); batch += CHUNKBATCH) {
+            std::ostringstream progStr;
+            progStr << "Writing channel #" << n_c + 1 << " of " << n_channels;
+            progDlg.Update((int)(((double)n_c + (double)batch/(double)chunks.size())/(double)n_channels*100.0),
+                           progStr.str());
+            int batch_end = (int)std::min(batch + CHUNKBATCH, chunks.size());
+            bool ok = true;
+#ifdef _OPENMP
+            int n_threads = stfio::threadCount(0, batch_end-(int)batch);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+            for (int n_k = (int)batch; n_k < batch_end; ++n_k) {
+                ExportChunk& chunk = chunks[n_k];
+                const Section& sec = channel[chunk.row];
+                std::size_t begin = chunk.col*chunk_cols;
+                std::size_t end = std::min(begin + chunk_cols, sec.size());
+                Vector_double values(end-begin);
+                sec.CopyRange(begin, end, &values[0]);
+                // little-endian, shuffled: byte b of all elements is stored in a block:
+                std::vector<unsigned char> shuffled(chunk_cols*type_size, 0);
+                for (std::size_t n = 0; n < values.size(); ++n) {
+                    unsigned int raw = 0;
+                    if (integer) {
+                        raw = (unsigned short)(short)std::floor((values[n]-shift)/scale + 0.5);
+                    } else {
+                        float value = (float)values[n];
+                        std::memcpy(&raw, &value, 4);
+                    }
+                    for (std::size_t b = 0; b < type_size; ++b) {
+                        shuffled[b*chunk_cols + n] = (unsigned char)(raw >> (8*b));
+                    }
+                }
+                uLongf size = compressBound((uLong)shuffled.size());
+                chunk.bytes.resize(size);
+                if (compress2(&chunk.bytes[0], &size, &shuffled[0], (uLong)shuffled.size(), ZLIB_LEVEL) != Z_OK) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_write)
+#endif
+                    ok = false;
+                }
+                chunk.bytes.resize(size);
+            }
+            if (!ok) {
+                throw std::runtime_error("Couldn't compress the samples of " + name);
+            }
+            for (int n_k = (int)batch; n_k < batch_end; ++n_k) {
+                store.Put(chunks[n_k].ChunkKey(name), chunks[n_k].bytes);
+                std::vector<unsigned char>().swap(chunks[n_k].bytes);
+            }
+        }
+
+        std::ostringstream zarray;
+        zarray.precision(17);
+        zarray << "{\n    \"zarr_format\": 2,\n"
+               << "    \"shape\": [" << channel.size() << ", " << max_length << "],\n"
+               << "    \"chunks\": [1, " << chunk_cols << "],\n"
+               << "    \"dtype\": \"" << (integer ? "<i2" : "<f4") << "\",\n"
+               << "    \"compressor\": {\"id\": \"zlib\", \"level\": " << ZLIB_LEVEL << "},\n"
+               << "    \"fill_value\": 0,\n"
+               << "    \"order\": \"C\",\n"
+               << "    \"filters\": [{\"id\": \"shuffle\", \"elementsize\": " << type_size << "}],\n"
+               << "    \"dimension_separator\": \".\"\n}\n";
+        std::ostringstream zattrs;
+        zattrs.precision(17);
+        zattrs << "{\n    \"lengths\": [";
+        for (std::size_t n_s = 0; n_s < channel.size(); ++n_s) {
+            zattrs << (n_s > 0 ? ", " : "") << channel[n_s].size();
+        }
+        zattrs << "],\n    \"dt\": " << dt << ",\n"
+               << "    \"xunits\": " << jsonString(xunits) << ",\n"
+               << "    \"yunits\": " << jsonString(channel.GetYUnits()) << ",\n"
+               << "    \"channel_name\": " << jsonString(channel.GetChannelName());
+        if (integer) {
+            zattrs << ",\n    \"scale_factor\": " << scale << ",\n    \"add_offset\": " << shift;
+        }
+        zattrs << "\n}\n";
+        store.Put(name + "/.zarray", bytes(zarray.str()));
+        store.Put(name + "/.zattrs", bytes(zattrs.str()));
+    }
+}
+
+stfio::DirectoryStore::DirectoryStore(const std::string& root_) : root(root_) {}
+
+bool stfio::DirectoryStore::Get(const std::string& key, std::vector<unsigned char>& value) const {
+    std::string path = root + "/" + key;
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    std::streamoff size = file.tellg();
+    if (size < 0) {
+        throw std::runtime_error("Couldn't read " + path);
+    }
+    value.resize((std::size_t)size);
+    file.seekg(0);
+    if (size > 0 && !file.read((char*)&value[0], size)) {
+        throw std::runtime_error("Couldn't read " + path);
+    }
+    return true;
+}
+
+void stfio::DirectoryStore::Put(const std::string& key, const std::vector<unsigned char>& value) {
+    std::string path = root + "/" + key;
+    makeParents(path);
+    // readers never see a partly written object, and threads that cache
+    // the same chunk don't write to the same file:
+    std::ostringstream tmpName;
+    tmpName << path << ".part";
+#ifdef _OPENMP
+    tmpName << omp_get_thread_num();
+#endif
+    {
+        std::ofstream file(tmpName.str().c_str(), std::ios::binary | std::ios::trunc);
+        if (!file || (!value.empty() && !file.write((const char*)&value[0], value.size())) || !file.flush()) {
+            file.close();
+            std::remove(tmpName.str().c_str());
+            throw std::runtime_error("Couldn't write " + path);
+        }
+    }
+#ifdef _WIN32
+    // rename() doesn't replace existing files:
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmpName.str().c_str(), path.c_str()) != 0) {
+        std::remove(tmpName.str().c_str());
+        throw std::runtime_error("Couldn't write " + path);
+    }
+}
+
+stfio::CachedStore::CachedStore(const ChunkStorePtr& remote_, const std::string& cacheDir)
+    : remote(remote_), cache(cacheDir) {}
+
+bool stfio::CachedStore::Get(const std::string& key, std::vector<unsigned char>& value) const {
+    std::size_t slash = key.find_last_of('/');
+    bool metadata = key[slash == std::string::npos ? 0 : slash+1] == '.';
+    if (!metadata && cache.Get(key, value)) {
+        return true;
+    }
+    if (!remote->Get(key, value)) {
+        return false;
+    }
+    if (!metadata) {
+        try {
+            cache.Put(key, value);
+        }
+        catch (const std::runtime_error&) {
+            // e.g. a full disk; the chunk is fetched again next time
+        }
+    }
+    return true;
+}
+
+void stfio::CachedStore::Put(const std::string& key, const std::vector<unsigned char>& value) {
+    remote->Put(key, value);
+    cache.Put(key, value);
+}
+
+void stfio::registerChunkStore(const std::string& scheme, ChunkStoreFactory factory) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_registry)
+#endif
+    {
+        if (factory != NULL) {
+            storeFactories[scheme] = factory;
+        } else {
+            storeFactories.erase(scheme);
+        }
+    }
+}
+
+void stfio::setChunkCacheDir(const std::string& dir) {
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_registry)
+#endif
+    chunkCacheDir = dir;
+}
+
+stfio::ChunkStorePtr stfio::openChunkStore(const std::string& location) {
+    std::size_t pos = location.find("://");
+    if (pos == std::string::npos) {
+        return ChunkStorePtr(new DirectoryStore(location));
+    }
+    std::string scheme = location.substr(0, pos);
+    if (scheme == "file") {
+        return ChunkStorePtr(new DirectoryStore(location.substr(pos+3)));
+    }
+    ChunkStoreFactory factory = NULL;
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_registry)
+#endif
+    {
+        std::map<std::string, ChunkStoreFactory>::const_iterator it = storeFactories.find(scheme);
+        if (it != storeFactories.end()) {
+            factory = it->second;
+        }
+    }
+    if (factory == NULL) {
+        throw std::runtime_error("No store has been registered for " + scheme + ":// locations");
+    }
+    ChunkStorePtr store = factory(location);
+    if (!store) {
+        throw std::runtime_error("Couldn't open " + location);
+    }
+    return store;
+}
+
+void stfio::importZarrFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg) {
+    std::string location(storeLocation(fName));
+    ChunkStorePtr store = openChunkStore(location);
+
+    Json zgroup = readJson(*store, ".zgroup", location);
+    Json attrs = readJson(*store, ".zattrs", location);
+    Json root_array = readJson(*store, ".zarray", location);
+    std::vector<std::string> keys;
+    if (root_array.type == Json::object_type) {
+        // a store that holds a single array:
+        keys.push_back("");
+    } else if (zgroup.type != Json::object_type) {
+        throw std::runtime_error(location + " is not a Zarr store");
+    } else {
+        const Json& channels = attrs["channels"];
+        for (std::size_t n_c = 0; n_c < channels.items.size(); ++n_c) {
+            keys.push_back(channels.items[n_c].String(""));
+        }
+        if (keys.empty()) {
+            throw std::runtime_error(location + " doesn't list any channels");
+        }
+    }
+
+    if (location.find("://") != std::string::npos && location.compare(0, 7, "file://") != 0) {
+        std::string cacheDir;
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_registry)
+#endif
+        cacheDir = chunkCacheDir;
+        if (!cacheDir.empty()) {
+            // exported stores get a new id, so that stale chunks aren't read:
+            store.reset(new CachedStore(store, cacheDir + "/" + hashName(location + " " + attrs["id"].String(""))));
+        }
+    }
+
+    double dt = attrs["dt"].Number(0);
+    std::string xunits(attrs["xunits"].String("ms"));
+    ReturnData.resize(keys.size());
+    for (std::size_t n_c = 0; n_c < keys.size(); ++n_c) {
+        std::ostringstream progStr;
+        progStr << "Reading channel #" << n_c + 1 << " of " << keys.size();
+        progDlg.Update((int)((double)n_c/(double)keys.size()*100.0), progStr.str());
+
+        std::string prefix(keys[n_c].empty() ? "" : keys[n_c] + "/");
+        Json zattrs = readJson(*store, prefix + ".zattrs", location);
+        Json zarray = keys[n_c].empty() ? root_array : readJson(*store, prefix + ".zarray", location);
+        if (zarray.type != Json::object_type) {
+            throw std::runtime_error("Channel " + keys[n_c] + " is missing from " + location);
+        }
+        ArrayFormatPtr format(new ArrayFormat(parseArray(zarray, zattrs, keys[n_c], location)));
+        const Json& lengths = zattrs["lengths"];
+        Channel ch(format->rows);
+        for (std::size_t n_s = 0; n_s < format->rows; ++n_s) {
+            std::size_t length = format->cols;
+            if (n_s < lengths.items.size()) {
+                length = std::min((std::size_t)lengths.items[n_s].Number(0), format->cols);
+            }
+            std::vector<stfio::SampleOperationPtr> read(1,
+                stfio::SampleOperationPtr(new ReadRow(store, format, location, n_s, length)));
+            ch.InsertSection(Section(stfio::deriveSamples(stfio::MappedSamples(), read)), n_s);
+        }
+        ch.SetChannelName(zattrs["channel_name"].String(keys[n_c].empty() ? "Ch1" : keys[n_c]));
+        ch.SetYUnits(zattrs["yunits"].String(""));
+        ReturnData.InsertChannel(STFIO_MOVE(ch), n_c);
+        if (dt <= 0) {
+            dt = zattrs["dt"].Number(0);
+            xunits = zattrs["xunits"].String(xunits);
+        }
+    }
+    ReturnData.SetXScale(dt > 0 ? dt : 1.0);
+    ReturnData.SetXUnits(xunits);
+    ReturnData.SetFileDescription(attrs["description"].String(""));
+    ReturnData.SetComment(attrs["comment"].String(""));
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, sec = 0;
+    if (sscanf(attrs["start_time"].String("").c_str(), "%d-%d-%dT%d:%d:%d",
+               &year, &month, &day, &hour, &minute, &sec) >= 3)
+    {
+        ReturnData.SetDateTime(year-1900, month-1, day, hour, minute, sec);
+    }
+}
+
+bool stfio::exportZarrFile(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg) {
+    std::string location(storeLocation(fName));
+
+    // sections that are still read from the store that is replaced have to
+    // be decoded before:
+    bool lazy = false;
+#ifdef _OPENMP
+#pragma omp critical(stfio_zarr_stores)
+#endif
+    lazy = lazyStores.find(location) != lazyStores.end();
+    std::vector<stfio::DecodedSamples> pinned;
+    for (std::size_t n_c = 0; n_c < WData.size() && lazy; ++n_c) {
+        for (std::size_t n_s = 0; n_s < WData[n_c].size(); ++n_s) {
+            if (WData[n_c][n_s].IsMapped()) {
+                pinned.push_back(WData[n_c][n_s].GetDecoded());
+            }
+        }
+    }
+
+    ChunkStorePtr store = openChunkStore(location);
+    std::vector<std::string> names;
+    for (std::size_t n_c = 0; n_c < WData.size(); ++n_c) {
+        names.push_back(arrayName(WData[n_c].GetChannelName(), n_c, names));
+        writeChannel(*store, WData[n_c], names[n_c], WData.GetXScale(), WData.GetXUnits(),
+                     n_c, WData.size(), progDlg);
+    }
+
+    struct tm start = WData.GetDateTime();
+    // large enough for any values of the fields:
+    char start_time[80];
+    snprintf(start_time, sizeof(start_time), "%04d-%02d-%02dT%02d:%02d:%02d",
+             start.tm_year+1900, start.tm_mon+1, start.tm_mday, start.tm_hour, start.tm_min, start.tm_sec);
+    time_t now = time(NULL);
+    std::ostringstream id;
+    id << location << " " << now << " " << clock();
+
+    std::ostringstream zattrs;
+    zattrs.precision(17);
+    zattrs << "{\n    \"channels\": [";
+    for (std::size_t n_c = 0; n_c < names.size(); ++n_c) {
+        zattrs << (n_c > 0 ? ", " : "") << jsonString(names[n_c]);
+    }
+    zattrs << "],\n    \"dt\": " << WData.GetXScale() << ",\n"
+           << "    \"xunits\": " << jsonString(WData.GetXUnits()) << ",\n"
+           << "    \"start_time\": " << jsonString(start_time) << ",\n"
+           << "    \"description\": " << jsonString(WData.GetFileDescription()) << ",\n"
+           << "    \"comment\": " << jsonString(WData.GetComment()) << ",\n"
+           << "    \"id\": " << jsonString(hashName(id.str())) << "\n}\n";
+    store->Put(".zattrs", bytes(zattrs.str()));
+    store->Put(".zgroup", bytes("{\n    \"zarr_format\": 2\n}\n"));
+    progDlg.Update(100, "Done");
+    return true;
+}
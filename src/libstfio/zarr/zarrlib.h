@@ -0,0 +1,163 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file zarrlib.h
+ *  \brief Import from and export to chunked Zarr (version 2) stores.
+ *
+ *  A store holds one 2-D array (sections x samples) per channel, split
+ *  into compressed chunks that are separate objects, so that a section can
+ *  be read without fetching the whole recording. Stores are directories,
+ *  or objects in a remote store (e.g. a bucket of an object storage) that
+ *  the application registers for a URL scheme.
+ */
+
+#ifndef _ZARRLIB_H
+#define _ZARRLIB_H
+
+#include <vector>
+#if (__cplusplus < 201103)
+    #include <boost/shared_ptr.hpp>
+#else
+    #include <memory>
+#endif
+#include "./../stfio.h"
+
+class Recording;
+class RecordingView;
+
+namespace stfio {
+
+//! The objects of a Zarr store, e.g. the files in a directory.
+/*! Keys are paths relative to the root of the store, such as ".zattrs" or "Im/0.3".
+ */
+class StfioDll ChunkStore {
+public:
+    //! Destructor.
+    virtual ~ChunkStore() {}
+
+    //! Reads an object.
+    /*! Has to be safe to call from several threads at once, since the chunks
+     *  of a section are fetched in parallel. Throws std::runtime_error if
+     *  the object exists but can't be read.
+     *  \param key The key of the object.
+     *  \param value On exit, the contents of the object.
+     *  \return false if there is no such object.
+     */
+    virtual bool Get(const std::string& key, std::vector<unsigned char>& value) const = 0;
+
+    //! Writes an object, replacing an existing one.
+    /*! Only called by one thread at a time. Throws std::runtime_error if
+     *  the object can't be written.
+     *  \param key The key of the object.
+     *  \param value The contents of the object.
+     */
+    virtual void Put(const std::string& key, const std::vector<unsigned char>& value) = 0;
+};
+
+#if (__cplusplus < 201103)
+typedef boost::shared_ptr<ChunkStore> ChunkStorePtr;
+#else
+typedef std::shared_ptr<ChunkStore> ChunkStorePtr;
+#endif
+
+//! A store that keeps each object in a file below a directory.
+class StfioDll DirectoryStore : public ChunkStore {
+public:
+    //! Constructor.
+    /*! \param root The directory; created with the first object that is written.
+     */
+    explicit DirectoryStore(const std::string& root);
+
+    bool Get(const std::string& key, std::vector<unsigned char>& value) const;
+    void Put(const std::string& key, const std::vector<unsigned char>& value);
+
+private:
+    std::string root;
+};
+
+//! A store that keeps local copies of the chunks of another store.
+/*! Chunks are fetched from \e remote once and read from \e cacheDir
+ *  afterwards. Metadata objects, whose names start with '.', are always
+ *  fetched, since they're small and may change.
+ */
+class StfioDll CachedStore : public ChunkStore {
+public:
+    //! Constructor.
+    /*! \param remote The store whose chunks are cached.
+     *  \param cacheDir The directory that holds the copies.
+     */
+    CachedStore(const ChunkStorePtr& remote, const std::string& cacheDir);
+
+    bool Get(const std::string& key, std::vector<unsigned char>& value) const;
+    void Put(const std::string& key, const std::vector<unsigned char>& value);
+
+private:
+    ChunkStorePtr remote;
+    mutable DirectoryStore cache;
+};
+
+//! Creates the store of a location such as "s3://bucket/recording.zarr".
+typedef ChunkStorePtr (*ChunkStoreFactory)(const std::string& location);
+
+//! Registers the store of a URL scheme.
+/*! libstfio itself only reads and writes directories; the application
+ *  provides stores for object storage or HTTP servers.
+ *  \param scheme The scheme, e.g. "s3" for locations that start with "s3://".
+ *  \param factory Creates the store of a location; NULL unregisters the scheme.
+ */
+StfioDll void registerChunkStore(const std::string& scheme, ChunkStoreFactory factory);
+
+//! Sets the directory where chunks of remote stores are cached.
+/*! Each store that is imported gets a subdirectory of its own; stores
+ *  that have been exported again get a new one.
+ *  \param dir The directory; an empty string disables caching (the default).
+ */
+StfioDll void setChunkCacheDir(const std::string& dir);
+
+//! Opens the store of a location.
+/*! Throws std::runtime_error if a URL scheme hasn't been registered.
+ *  \param location A directory, or a URL with a registered scheme.
+ *  \return The store; its chunks aren't cached.
+ */
+StfioDll ChunkStorePtr openChunkStore(const std::string& location);
+
+//! Open a Zarr store and store its contents to a Recording object.
+/*! Only the metadata are read; the samples of a section are fetched when
+ *  they're first needed, chunk by chunk and in parallel, and the chunks of
+ *  other sections aren't touched. Arrays with 16-bit integers are scaled
+ *  by their attributes "scale_factor" and "add_offset". Throws
+ *  std::runtime_error if the store can't be read.
+ *  \param fName The location of the store, or of its file ".zgroup" or ".zattrs".
+ *  \param ReturnData On entry, an empty Recording object. On exit,
+ *         the data stored in \e fName.
+ *  \param progDlg Progress indicator.
+ */
+void importZarrFile(const std::string& fName, Recording& ReturnData, ProgressInfo& progDlg);
+
+//! Export a Recording to a Zarr store.
+/*! Each channel becomes an array with one section per chunk row, compressed
+ *  with shuffle and zlib; channels of scaled 16-bit integers (see
+ *  stfio::findQuantization()) are stored as such. Chunks are compressed in
+ *  parallel, and the metadata are written last. Throws std::runtime_error
+ *  if the store can't be written.
+ *  \param fName The location of the store.
+ *  \param WData The data to be exported.
+ *  \param progDlg Progress indicator.
+ *  \return true if the store has been written.
+ */
+StfioDll bool exportZarrFile(const std::string& fName, const RecordingView& WData, ProgressInfo& progDlg);
+
+}
+
+#endif
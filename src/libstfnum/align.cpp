@@ -0,0 +1,211 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file align.cpp
+ *  \brief Aligns sections by cross-correlation with subsample precision.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "./align.h"
+#include "./gpu.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/aligned.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/parallel.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    // Copies the window of a section, extended by maxLag on either side and
+    // padded with zeros beyond the section, and subtracts its mean:
+    void readWindow(const Section& sec, std::size_t begin, std::size_t end, std::size_t maxLag,
+                    double* dest)
+    {
+        std::size_t n = end - begin + 2*maxLag;
+        std::fill(dest, dest+n, 0.0);
+        std::size_t first = begin > maxLag ? begin-maxLag : 0;
+        std::size_t last = std::min(end+maxLag, sec.size());
+        if (first >= last) {
+            return;
+        }
+        double* x = dest + (first + maxLag - begin);
+        sec.CopyRange(first, last, x);
+        double mean = 0.0;
+        for (std::size_t k = 0; k < last-first; ++k) {
+            mean += x[k];
+        }
+        mean /= (last-first);
+        for (std::size_t k = 0; k < last-first; ++k) {
+            x[k] -= mean;
+        }
+    }
+
+    // The index of the largest value, refined by a parabola through it and its neighbours:
+    double parabolicPeak(const double* c, std::size_t n) {
+        std::size_t j = std::max_element(c, c+n) - c;
+        if (j == 0 || j+1 == n) {
+            return (double)j;
+        }
+        double denom = c[j-1] - 2.0*c[j] + c[j+1];
+        if (!(denom < 0)) {
+            return (double)j;
+        }
+        return j + 0.5*(c[j-1] - c[j+1]) / denom;
+    }
+
+    // Averages the windows of the sections, shifted by their lags; shifts
+    // that would leave a section are limited to its ends:
+    Vector_double shiftedAverage(const Channel& ch, const std::vector<std::size_t>& sections,
+                                 std::size_t begin, std::size_t end, const Vector_double& lags)
+    {
+        std::size_t len = end - begin;
+        Vector_double average(len, 0.0), buffer(len);
+        for (std::size_t n = 0; n < sections.size(); ++n) {
+            const Section& sec = ch[sections[n]];
+            double pos = std::max(0.0, std::min(begin + lags[n], (double)(sec.size()-len)));
+            sec.CopyInterpolated(pos, len, &buffer[0]);
+            for (std::size_t k = 0; k < len; ++k) {
+                average[k] += buffer[k];
+            }
+        }
+        for (std::size_t k = 0; k < len; ++k) {
+            average[k] /= sections.size();
+        }
+        return average;
+    }
+
+}
+
+Vector_double stfnum::correlationLags(const Channel& ch, const std::vector<std::size_t>& sections,
+                                      std::size_t begin, std::size_t end, std::size_t maxLag,
+                                      const Vector_double& reference, int n_threads)
+{
+    STF_PROFILE_SCOPE("align/correlation");
+    if (begin >= end || reference.size() != end-begin) {
+        throw std::out_of_range("Window out of range in stfnum::correlationLags()");
+    }
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::correlationLags()");
+        }
+        if (begin >= ch[sections[n]].size()) {
+            throw std::out_of_range("Window out of range in stfnum::correlationLags()");
+        }
+    }
+    std::size_t len = end - begin, n_window = len + 2*maxLag;
+    // the correlations at lags -maxLag..maxLag don't wrap around:
+    int fft_size = (int)fftSize(n_window);
+    int n_cplx = fft_size/2 + 1;
+    fftw_plan p_fwd = fftwPlan(fft_size, false);
+    fftw_plan p_inv = fftwPlan(fft_size, true);
+
+    // the conjugate transform of the reference is shared by all sections:
+    stfio::Vector_aligned in(fft_size, 0.0), ref_fft(2*n_cplx);
+    double mean = 0.0;
+    for (std::size_t k = 0; k < len; ++k) {
+        mean += reference[k];
+    }
+    mean /= len;
+    for (std::size_t k = 0; k < len; ++k) {
+        in[k] = reference[k] - mean;
+    }
+    fftw_complex* R = reinterpret_cast<fftw_complex*>(&ref_fft[0]);
+    executeR2C(p_fwd, fft_size, &in[0], R);
+
+    int n_sections = (int)sections.size();
+    Vector_double lags(n_sections, 0.0);
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+        stfio::Vector_aligned x(fft_size, 0.0), spectrum(2*n_cplx);
+        fftw_complex* X = reinterpret_cast<fftw_complex*>(&spectrum[0]);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (int n_s = 0; n_s < n_sections; ++n_s) {
+            readWindow(ch[sections[n_s]], begin, end, maxLag, &x[0]);
+            std::fill(x.begin() + n_window, x.end(), 0.0);
+            executeR2C(p_fwd, fft_size, &x[0], X);
+            // conj(R)*X is the transform of the cross-correlation:
+            for (int k = 0; k < n_cplx; ++k) {
+                double re = R[k][0]*X[k][0] + R[k][1]*X[k][1];
+                double im = R[k][0]*X[k][1] - R[k][1]*X[k][0];
+                X[k][0] = re;
+                X[k][1] = im;
+            }
+            executeC2R(p_inv, fft_size, X, &x[0]);
+            lags[n_s] = parabolicPeak(&x[0], 2*maxLag+1) - (double)maxLag;
+        }
+    }
+    return lags;
+}
+
+Vector_double stfnum::correlationLags(const Channel& ch, const std::vector<std::size_t>& sections,
+                                      std::size_t begin, std::size_t end, std::size_t maxLag,
+                                      correlation_reference reference, int iterations, int n_threads)
+{
+    if (sections.empty()) {
+        return Vector_double(0);
+    }
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::correlationLags()");
+        }
+        if (begin >= end || end > ch[sections[n]].size()) {
+            throw std::out_of_range("Window out of range in stfnum::correlationLags()");
+        }
+    }
+    Vector_double lags(sections.size(), 0.0);
+    if (reference == reference_first) {
+        return correlationLags(ch, sections, begin, end, maxLag,
+                               shiftedAverage(ch, std::vector<std::size_t>(1, sections[0]),
+                                              begin, end, lags), n_threads);
+    }
+    for (int it = 0; it < std::max(iterations, 1); ++it) {
+        lags = correlationLags(ch, sections, begin, end, maxLag,
+                               shiftedAverage(ch, sections, begin, end, lags), n_threads);
+        double mean = 0.0;
+        for (std::size_t n = 0; n < lags.size(); ++n) {
+            mean += lags[n];
+        }
+        mean /= lags.size();
+        for (std::size_t n = 0; n < lags.size(); ++n) {
+            lags[n] -= mean;
+        }
+    }
+    return lags;
+}
+
+Vector_double stfnum::lagsToShifts(const Vector_double& lags, std::size_t& shift_size) {
+    shift_size = 0;
+    if (lags.empty()) {
+        return Vector_double(0);
+    }
+    double min_lag = *std::min_element(lags.begin(), lags.end());
+    double max_lag = *std::max_element(lags.begin(), lags.end());
+    Vector_double shift(lags.size());
+    for (std::size_t n = 0; n < lags.size(); ++n) {
+        shift[n] = lags[n] - min_lag;
+    }
+    shift_size = (std::size_t)ceil(max_lag - min_lag);
+    return shift;
+}
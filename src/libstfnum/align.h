@@ -0,0 +1,96 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file align.h
+ *  \brief Aligns sections by cross-correlation with subsample precision.
+ *
+ *  Unlike the alignment points of stfnum::alignmentPoints(), the lags use
+ *  the whole waveform within a window, so that noisy sections without a
+ *  distinct peak or rise can be aligned. The cross-correlations are
+ *  computed with FFTs of a single size, so that all sections share the
+ *  cached plans and the transform of the reference. The lag of the largest
+ *  correlation is refined by fitting a parabola to it and its neighbours.
+ */
+
+#ifndef _STFNUM_ALIGN_H
+#define _STFNUM_ALIGN_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "./stfnum.h"
+
+class Channel;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! References that sections can be aligned to by stfnum::correlationLags().
+enum correlation_reference {
+    reference_first = 0,   /*!< The first section. */
+    reference_average = 1  /*!< The average of the sections, aligned iteratively. */
+};
+
+//! Finds the lags at which sections match a reference trace best.
+/*! Data point \e k of the reference corresponds to data point
+ *  \e begin + \e k + lag of a section. Within a section, the window is
+ *  extended by \e maxLag on either side; parts of it that lie outside of
+ *  the section are treated as zeros. The means of the reference and of
+ *  the windows are subtracted. Sections are processed in parallel.
+ *  Throws std::out_of_range if a section index or the window is out of range,
+ *  or if the reference doesn't have \e end - \e begin data points.
+ *  \param ch The channel containing the sections.
+ *  \param sections Indices of the sections.
+ *  \param begin Index of the first data point of the window.
+ *  \param end Index past the last data point of the window.
+ *  \param maxLag Largest lag, in sampling points, in either direction.
+ *  \param reference The reference trace.
+ *  \param n_threads Number of threads; 0 uses the configured number of threads.
+ *  \return The lag of every section, in sampling points.
+ */
+StfioDll Vector_double correlationLags(const Channel& ch, const std::vector<std::size_t>& sections,
+                                       std::size_t begin, std::size_t end, std::size_t maxLag,
+                                       const Vector_double& reference, int n_threads = 0);
+
+//! Finds the lags at which sections match the first section or their average.
+/*! With stfnum::reference_average, the sections are first aligned to their
+ *  plain average; the average of the aligned sections then becomes the
+ *  reference of the next iteration. The lags are centred on 0 after every
+ *  iteration, so that the reference doesn't drift. See the function above
+ *  for a description of the other parameters.
+ *  \param reference The reference.
+ *  \param iterations Number of times the lags are computed.
+ *  \return The lag of every section, in sampling points.
+ */
+StfioDll Vector_double correlationLags(const Channel& ch, const std::vector<std::size_t>& sections,
+                                       std::size_t begin, std::size_t end, std::size_t maxLag,
+                                       correlation_reference reference = reference_average,
+                                       int iterations = 3, int n_threads = 0);
+
+//! Converts lags into non-negative shifts for Recording::MakeAverage().
+/*! \param lags The lags, e.g. from stfnum::correlationLags().
+ *  \param shift_size On exit, the number of data points by which the
+ *         average has to be shorter than the shortest section.
+ *  \return The lags minus the smallest lag.
+ */
+StfioDll Vector_double lagsToShifts(const Vector_double& lags, std::size_t& shift_size);
+
+/*@}*/
+
+}
+
+#endif
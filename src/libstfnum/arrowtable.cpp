@@ -0,0 +1,178 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdexcept>
+#include <vector>
+#if (__cplusplus < 201103)
+    #include <boost/shared_ptr.hpp>
+#else
+    #include <memory>
+#endif
+
+#include "./arrowtable.h"
+
+namespace {
+
+    // The storage that all arrays of an export share:
+    struct TableData {
+        TableData(const stfnum::Table& table_) : table(table_) {}
+
+        stfnum::Table table;
+        std::vector<int32_t> offsets;
+        std::string labels;
+        // validity bitmaps of the columns; empty if a column has no empty cells:
+        std::vector< std::vector<unsigned char> > valid;
+        std::vector<int64_t> nullCounts;
+    };
+
+    typedef
+#if (__cplusplus < 201103)
+        boost::shared_ptr<const TableData>
+#else
+        std::shared_ptr<const TableData>
+#endif
+        TableDataPtr;
+
+    struct SchemaPrivate {
+        std::string format, name;
+        std::vector<ArrowSchema> children;
+        std::vector<ArrowSchema*> pointers;
+    };
+
+    struct ArrayPrivate {
+        TableDataPtr data;
+        std::vector<const void*> buffers;
+        std::vector<ArrowArray> children;
+        std::vector<ArrowArray*> pointers;
+    };
+
+    // Children that the consumer has moved elsewhere have been marked as
+    // released and are skipped:
+    void releaseSchema(ArrowSchema* schema) {
+        for (int64_t n = 0; n < schema->n_children; ++n) {
+            if (schema->children[n]->release != NULL) {
+                schema->children[n]->release(schema->children[n]);
+            }
+        }
+        delete static_cast<SchemaPrivate*>(schema->private_data);
+        schema->release = NULL;
+    }
+
+    void releaseArray(ArrowArray* array) {
+        for (int64_t n = 0; n < array->n_children; ++n) {
+            if (array->children[n]->release != NULL) {
+                array->children[n]->release(array->children[n]);
+            }
+        }
+        delete static_cast<ArrayPrivate*>(array->private_data);
+        array->release = NULL;
+    }
+
+    void initSchema(ArrowSchema* schema, const std::string& format, const std::string& name,
+                    int64_t flags, std::size_t n_children)
+    {
+        SchemaPrivate* priv = new SchemaPrivate;
+        priv->format = format;
+        priv->name = name;
+        priv->children.resize(n_children);
+        for (std::size_t n = 0; n < n_children; ++n) {
+            priv->pointers.push_back(&priv->children[n]);
+        }
+        schema->format = priv->format.c_str();
+        schema->name = priv->name.c_str();
+        schema->metadata = NULL;
+        schema->flags = flags;
+        schema->n_children = (int64_t)n_children;
+        schema->children = n_children > 0 ? &priv->pointers[0] : NULL;
+        schema->dictionary = NULL;
+        schema->release = releaseSchema;
+        schema->private_data = priv;
+    }
+
+    void initArray(ArrowArray* array, const TableDataPtr& data, int64_t length, int64_t null_count,
+                   const std::vector<const void*>& buffers, std::size_t n_children)
+    {
+        ArrayPrivate* priv = new ArrayPrivate;
+        priv->data = data;
+        priv->buffers = buffers;
+        priv->children.resize(n_children);
+        for (std::size_t n = 0; n < n_children; ++n) {
+            priv->pointers.push_back(&priv->children[n]);
+        }
+        array->length = length;
+        array->null_count = null_count;
+        array->offset = 0;
+        array->n_buffers = (int64_t)buffers.size();
+        array->n_children = (int64_t)n_children;
+        array->buffers = &priv->buffers[0];
+        array->children = n_children > 0 ? &priv->pointers[0] : NULL;
+        array->dictionary = NULL;
+        array->release = releaseArray;
+        array->private_data = priv;
+    }
+}
+
+void stfnum::exportArrowTable(const Table& table, const std::string& labelTitle,
+                              ArrowSchema* schema, ArrowArray* array)
+{
+    std::size_t n_rows = table.nRows(), n_cols = table.nCols();
+#if (__cplusplus < 201103)
+    boost::shared_ptr<TableData> data(new TableData(table));
+#else
+    std::shared_ptr<TableData> data(new TableData(table));
+#endif
+    data->offsets.reserve(n_rows+1);
+    data->offsets.push_back(0);
+    for (std::size_t n_r = 0; n_r < n_rows; ++n_r) {
+        data->labels += table.GetRowLabel(n_r);
+        if (data->labels.size() > 0x7fffffff) {
+            throw std::runtime_error("Row labels are too long for an Arrow string array");
+        }
+        data->offsets.push_back((int32_t)data->labels.size());
+    }
+    data->valid.resize(n_cols);
+    data->nullCounts.resize(n_cols, 0);
+    for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+        const std::vector<bool>& empty = table.GetEmptyColumn(n_c);
+        std::vector<unsigned char> valid((n_rows+7)/8, 0);
+        for (std::size_t n_r = 0; n_r < n_rows; ++n_r) {
+            if (empty[n_r]) {
+                ++data->nullCounts[n_c];
+            } else {
+                valid[n_r/8] |= (unsigned char)(1 << (n_r%8));
+            }
+        }
+        if (data->nullCounts[n_c] > 0) {
+            data->valid[n_c].swap(valid);
+        }
+    }
+
+    initSchema(schema, "+s", "", 0, n_cols+1);
+    initSchema(schema->children[0], "u", labelTitle, 0, 0);
+    for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+        initSchema(schema->children[n_c+1], "g", table.GetColLabel(n_c), ARROW_FLAG_NULLABLE, 0);
+    }
+
+    std::vector<const void*> buffers(1, (const void*)NULL);
+    initArray(array, data, (int64_t)n_rows, 0, buffers, n_cols+1);
+    buffers.push_back(&data->offsets[0]);
+    buffers.push_back(data->labels.empty() ? NULL : data->labels.data());
+    initArray(array->children[0], data, (int64_t)n_rows, 0, buffers, 0);
+    for (std::size_t n_c = 0; n_c < n_cols; ++n_c) {
+        const Vector_double& column = data->table.GetColumn(n_c);
+        buffers.assign(1, data->valid[n_c].empty() ? NULL : (const void*)&data->valid[n_c][0]);
+        buffers.push_back(column.empty() ? NULL : (const void*)&column[0]);
+        initArray(array->children[n_c+1], data, (int64_t)n_rows, data->nullCounts[n_c], buffers, 0);
+    }
+}
@@ -0,0 +1,95 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file arrowtable.h
+ *  \brief Hands tables of results to Apache Arrow without copying their values.
+ *
+ *  Uses the Arrow C data interface, a stable ABI that pyarrow, pandas and
+ *  the Arrow libraries import from, so that no Arrow library is needed
+ *  here. See https://arrow.apache.org/docs/format/CDataInterface.html
+ */
+
+#ifndef _STFNUM_ARROWTABLE_H
+#define _STFNUM_ARROWTABLE_H
+
+#include <stdint.h>
+#include <string>
+
+#include "./stfnum.h"
+
+// The structures of the Arrow C data interface, as given by its specification:
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+}
+
+#endif
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Exports a table as an Arrow struct array, i.e. a record batch.
+/*! The first field holds the row labels as UTF-8 strings, followed by a
+ *  nullable float64 field per column, in which empty cells are null. The
+ *  table is copied once into storage that the arrays share; the values of
+ *  the columns are handed over from there without copying them again, and
+ *  the storage is freed when the consumer has released all arrays. Throws
+ *  std::runtime_error if the row labels exceed 2 GB.
+ *  \param table The table.
+ *  \param labelTitle Name of the field of row labels, e.g. "Event".
+ *  \param schema On exit, the type of the array; the consumer releases it.
+ *  \param array On exit, the array; the consumer releases it.
+ */
+StfioDll void exportArrowTable(const Table& table, const std::string& labelTitle,
+                               ArrowSchema* schema, ArrowArray* array);
+
+/*@}*/
+
+}
+
+#endif
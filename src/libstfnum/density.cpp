@@ -0,0 +1,152 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <cmath>
+#include <climits>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./density.h"
+#include "../libstfio/section.h"
+#include "../libstfio/parallel.h"
+
+namespace {
+
+// Rows that a section covers in a pixel column; empty if first > last:
+struct Span {
+    int first, last;
+};
+
+// Sections that are reduced to spans at once; bounds the memory of the spans:
+const std::size_t batchSize = 64;
+
+void reduceSection(const Section& sec, double startX, double xZoom, double startY, double yZoom,
+                   std::size_t width, std::size_t height, Span* spans)
+{
+    for (std::size_t c = 0; c < width; ++c) {
+        spans[c].first = 1;
+        spans[c].last = 0;
+    }
+    if (sec.size() == 0) {
+        return;
+    }
+    double c_first = std::floor(startX);
+    double c_last = std::floor(startX + (sec.size()-1)*xZoom);
+    if (c_last < 0 || c_first >= (double)width) {
+        return;
+    }
+    std::size_t c_begin = (std::size_t)std::max(c_first, 0.0);
+    std::size_t c_end = (std::size_t)std::min(c_last+1, (double)width);
+    for (std::size_t c = c_begin; c < c_end; ++c) {
+        // the points of the column, and the one before it that the
+        // polyline enters the column from:
+        double n0 = std::max(std::ceil((c-startX)/xZoom), 0.0);
+        double n1 = std::min(std::ceil((c+1-startX)/xZoom), (double)sec.size());
+        std::size_t begin = (n0 > 0) ? (std::size_t)n0-1 : 0;
+        std::size_t end = std::min(std::max((std::size_t)n1, (std::size_t)n0+1), sec.size());
+        if (begin >= end) {
+            continue;
+        }
+        double min, max;
+        sec.GetExtrema(begin, end, min, max);
+        if (std::isnan(min) || std::isnan(max)) {
+            continue;
+        }
+        double top = std::floor(startY - max*yZoom);
+        double bottom = std::floor(startY - min*yZoom);
+        if (top > bottom) {
+            std::swap(top, bottom);
+        }
+        if (bottom < 0 || top >= (double)height) {
+            continue;
+        }
+        spans[c].first = (int)std::max(top, 0.0);
+        spans[c].last = (int)std::min(bottom, (double)height-1);
+    }
+}
+
+}
+
+stfnum::DensityMap::DensityMap(std::size_t width_, std::size_t height_)
+    : width(width_), height(height_), counts(width_*height_, 0)
+{}
+
+void stfnum::DensityMap::Clear() {
+    std::fill(counts.begin(), counts.end(), 0);
+}
+
+unsigned stfnum::DensityMap::GetMax() const {
+    if (counts.empty()) {
+        return 0;
+    }
+    return *std::max_element(counts.begin(), counts.end());
+}
+
+void stfnum::DensityMap::Add(const std::vector<const Section*>& sections, double startX, double xZoom,
+                             double startY, double yZoom, int n_threads)
+{
+    if (!(xZoom > 0)) {
+        throw std::out_of_range("Non-positive x zoom in stfnum::DensityMap::Add()");
+    }
+    if (width == 0 || height == 0 || sections.empty()) {
+        return;
+    }
+    n_threads = stfio::threadCount(n_threads, INT_MAX);
+    std::vector<Span> spans(std::min(batchSize, sections.size())*width);
+    std::string error;
+    for (std::size_t batch = 0; batch < sections.size(); batch += batchSize) {
+        int n_batch = (int)std::min(batchSize, sections.size()-batch);
+        // a section is only read by a single thread:
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(std::min(n_threads, n_batch))
+#endif
+        for (int n_s = 0; n_s < n_batch; ++n_s) {
+            try {
+                reduceSection(*sections[batch+n_s], startX, xZoom, startY, yZoom,
+                              width, height, &spans[n_s*width]);
+            }
+            catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_density_error)
+#endif
+                if (error.empty()) error = e.what();
+                for (std::size_t c = 0; c < width; ++c) {
+                    spans[n_s*width+c].first = 1;
+                    spans[n_s*width+c].last = 0;
+                }
+            }
+        }
+        // a column is only written by a single thread:
+        int n_columns = (int)width;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(n_threads)
+#endif
+        for (int c = 0; c < n_columns; ++c) {
+            unsigned* column = &counts[c*height];
+            for (int n_s = 0; n_s < n_batch; ++n_s) {
+                const Span& span = spans[n_s*width+c];
+                for (int r = span.first; r <= span.last; ++r) {
+                    ++column[r];
+                }
+            }
+        }
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+    }
+}
@@ -0,0 +1,104 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file density.h
+ *  \brief Overlays of many sections as a 2-D histogram at screen resolution.
+ *
+ *  Every section is drawn into the histogram like a polyline with a pen
+ *  of a single pixel, so that each pixel counts the sections that pass
+ *  through it. The columns of a section are reduced to their extrema with
+ *  the section's min/max pyramid, so that the cost is proportional to the
+ *  number of columns rather than to the number of points.
+ */
+
+#ifndef _STFNUM_DENSITY_H
+#define _STFNUM_DENSITY_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+
+class Section;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Counts the sections that pass through each pixel of an image.
+/*! Pixels are given by the zoom of the graph window: data point n of a
+ *  section falls into column floor(startX + n*xZoom), and a value y into
+ *  row floor(startY - y*yZoom).
+ */
+class StfioDll DensityMap {
+public:
+    //! Constructor
+    /*! \param width Number of pixel columns.
+     *  \param height Number of pixel rows.
+     */
+    DensityMap(std::size_t width = 0, std::size_t height = 0);
+
+    //! Adds sections to the histogram.
+    /*! Sections are reduced to pixel columns in parallel; a mapped section
+     *  mustn't be passed twice, because it mustn't be read from several
+     *  threads at once. NaN values are skipped. Throws std::runtime_error
+     *  if a section can't be read.
+     *  \param sections The sections.
+     *  \param startX Column of the first data point.
+     *  \param xZoom Columns per data point; has to be > 0.
+     *  \param startY Row of the value 0.
+     *  \param yZoom Rows per y unit.
+     *  \param n_threads Number of sections that are reduced in parallel;
+     *         0 uses the configured number of threads.
+     */
+    void Add(const std::vector<const Section*>& sections, double startX, double xZoom,
+             double startY, double yZoom, int n_threads = 0);
+
+    //! Sets all counts to 0.
+    void Clear();
+
+    //! Retrieves the number of pixel columns.
+    /*! \return The number of pixel columns.
+     */
+    std::size_t GetWidth() const { return width; }
+
+    //! Retrieves the number of pixel rows.
+    /*! \return The number of pixel rows.
+     */
+    std::size_t GetHeight() const { return height; }
+
+    //! Retrieves the number of sections that pass through a pixel.
+    /*! \param column The pixel column; has to be < GetWidth().
+     *  \param row The pixel row; has to be < GetHeight().
+     *  \return The number of sections.
+     */
+    unsigned Count(std::size_t column, std::size_t row) const { return counts[column*height + row]; }
+
+    //! Retrieves the largest count.
+    /*! \return The largest number of sections that pass through a single pixel.
+     */
+    unsigned GetMax() const;
+
+private:
+    std::size_t width, height;
+    // column-major, so that a column is filled with contiguous writes:
+    std::vector<unsigned> counts;
+};
+
+/*@}*/
+
+}
+
+#endif
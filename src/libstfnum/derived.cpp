@@ -0,0 +1,164 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file derived.cpp
+ *  \brief Channels that are derived from other channels on demand.
+ */
+
+#include <cmath>
+#include <stdexcept>
+
+#include "./stfnum.h"
+#include "./derived.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/profile.h"
+
+namespace {
+
+    class ScaleOperation : public stfio::SampleOperation {
+    public:
+        explicit ScaleOperation(double factor_) : factor(factor_) {}
+        virtual void Apply(Vector_double& data) const {
+            for (std::size_t n = 0; n < data.size(); ++n) {
+                data[n] *= factor;
+            }
+        }
+    private:
+        double factor;
+    };
+
+    class OffsetOperation : public stfio::SampleOperation {
+    public:
+        explicit OffsetOperation(double shift_) : shift(shift_) {}
+        virtual void Apply(Vector_double& data) const {
+            for (std::size_t n = 0; n < data.size(); ++n) {
+                data[n] += shift;
+            }
+        }
+    private:
+        double shift;
+    };
+
+    class LnOperation : public stfio::SampleOperation {
+    public:
+        virtual void Apply(Vector_double& data) const {
+            for (std::size_t n = 0; n < data.size(); ++n) {
+                data[n] = std::log(data[n]);
+            }
+        }
+    };
+
+    class DiffOperation : public stfio::SampleOperation {
+    public:
+        explicit DiffOperation(double x_scale_) : x_scale(x_scale_) {}
+        virtual void Apply(Vector_double& data) const {
+            if (data.size() < 2) {
+                data.clear();
+                return;
+            }
+            stfnum::diff(&data[0], data.size(), x_scale, &data[0]);
+            data.pop_back();
+        }
+        virtual std::size_t Size(std::size_t n) const { return n < 2 ? 0 : n-1; }
+    private:
+        double x_scale;
+    };
+
+    class FilterOperation : public stfio::SampleOperation {
+    public:
+        FilterOperation(const Vector_double& a_, int SR_, stfnum::Func func_, bool inverse_)
+            : a(a_), SR(SR_), func(func_), inverse(inverse_) {}
+        virtual void Apply(Vector_double& data) const {
+            STF_PROFILE_SCOPE("stfnum/FilterOperation");
+            if (data.empty()) {
+                return;
+            }
+            Vector_double filtered(stfnum::filter(data, 0, data.size()-1, a, SR, func, inverse));
+            data.swap(filtered);
+        }
+    private:
+        Vector_double a;
+        int SR;
+        stfnum::Func func;
+        bool inverse;
+    };
+
+}
+
+stfio::SampleOperationPtr stfnum::scaleOperation(double factor) {
+    return stfio::SampleOperationPtr(new ScaleOperation(factor));
+}
+
+stfio::SampleOperationPtr stfnum::offsetOperation(double shift) {
+    return stfio::SampleOperationPtr(new OffsetOperation(shift));
+}
+
+stfio::SampleOperationPtr stfnum::lnOperation() {
+    return stfio::SampleOperationPtr(new LnOperation());
+}
+
+stfio::SampleOperationPtr stfnum::diffOperation(double x_scale) {
+    return stfio::SampleOperationPtr(new DiffOperation(x_scale));
+}
+
+stfio::SampleOperationPtr stfnum::filterOperation(const Vector_double& a, int SR,
+                                                  stfnum::Func func, bool inverse)
+{
+    return stfio::SampleOperationPtr(new FilterOperation(a, SR, func, inverse));
+}
+
+Section stfnum::deriveSection(const Section& sec,
+                              const std::vector<stfio::SampleOperationPtr>& operations,
+                              const std::string& suffix)
+{
+    Section derived(stfio::deriveSamples(sec.GetSamples(), operations),
+                    sec.GetSectionDescription()+suffix);
+    derived.SetXScale(sec.GetXScale());
+    return derived;
+}
+
+Channel stfnum::deriveChannel(const Channel& ch, const std::vector<std::size_t>& sections,
+                              const std::vector<stfio::SampleOperationPtr>& operations,
+                              const std::string& suffix)
+{
+    Channel derived(sections.size());
+    derived.SetChannelName(ch.GetChannelName());
+    derived.SetYUnits(ch.GetYUnits());
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::deriveChannel()");
+        }
+        derived.InsertSection(deriveSection(ch[sections[n]], operations, suffix), n);
+    }
+    return derived;
+}
+
+Channel stfnum::subtractBaselines(const Channel& ch, const std::vector<std::size_t>& sections,
+                                  const Vector_double& bases)
+{
+    if (bases.size() != sections.size()) {
+        throw std::out_of_range("Number of baselines doesn't match the number of sections in stfnum::subtractBaselines()");
+    }
+    Channel subtracted(sections.size());
+    subtracted.SetChannelName(ch.GetChannelName());
+    subtracted.SetYUnits(ch.GetYUnits());
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::subtractBaselines()");
+        }
+        std::vector<stfio::SampleOperationPtr> operations(1, offsetOperation(-bases[n]));
+        subtracted.InsertSection(deriveSection(ch[sections[n]], operations, ", baseline subtracted"), n);
+    }
+    return subtracted;
+}
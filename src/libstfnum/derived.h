@@ -0,0 +1,112 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file derived.h
+ *  \brief Channels that are derived from other channels on demand.
+ *
+ *  A derived section holds its source samples and a pipeline of
+ *  operations rather than the transformed samples (see
+ *  stfio::deriveSamples()). The pipeline is evaluated for a single
+ *  section when its samples are needed, and the result is kept in the
+ *  section cache, so that a transformed view of a large file never needs
+ *  a transformed copy of the whole file.
+ */
+
+#ifndef _STFNUM_DERIVED_H
+#define _STFNUM_DERIVED_H
+
+#include <vector>
+#include <string>
+
+#include "../libstfio/stfio.h"
+#include "./stfnum.h"
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Multiplies all samples by a factor.
+/*! \param factor The factor.
+ *  \return The operation.
+ */
+StfioDll stfio::SampleOperationPtr scaleOperation(double factor);
+
+//! Adds a constant to all samples, e.g. to subtract a baseline.
+/*! \param shift The value that is added.
+ *  \return The operation.
+ */
+StfioDll stfio::SampleOperationPtr offsetOperation(double shift);
+
+//! Takes the natural logarithm of all samples.
+/*! \return The operation.
+ */
+StfioDll stfio::SampleOperationPtr lnOperation();
+
+//! Differentiates the samples; see stfnum::diff().
+/*! The derived samples are one shorter than the source samples.
+ *  \param x_scale The sampling interval.
+ *  \return The operation.
+ */
+StfioDll stfio::SampleOperationPtr diffOperation(double x_scale);
+
+//! Filters all samples in the frequency domain; see stfnum::filter().
+/*! \param a, SR, func, inverse See stfnum::filter().
+ *  \return The operation.
+ */
+StfioDll stfio::SampleOperationPtr filterOperation(const Vector_double& a, int SR,
+                                                   stfnum::Func func, bool inverse = false);
+
+//! Derives a section from another one.
+/*! The samples of \e sec are shared rather than copied, and no operation
+ *  is applied until the samples of the returned section are needed.
+ *  \param sec The source section.
+ *  \param operations The operations in order.
+ *  \param suffix Appended to the section description.
+ *  \return The derived section.
+ */
+StfioDll Section deriveSection(const Section& sec,
+                               const std::vector<stfio::SampleOperationPtr>& operations,
+                               const std::string& suffix = "");
+
+//! Derives sections of a channel.
+/*! Throws std::out_of_range if a section index is out of range.
+ *  \param ch The source channel.
+ *  \param sections Indices of the sections to derive.
+ *  \param operations, suffix See deriveSection().
+ *  \return A channel that holds one derived section per index in \e sections.
+ */
+StfioDll Channel deriveChannel(const Channel& ch, const std::vector<std::size_t>& sections,
+                               const std::vector<stfio::SampleOperationPtr>& operations,
+                               const std::string& suffix = "");
+
+//! Subtracts a baseline from each of a number of sections without copying them.
+/*! Each returned section derives from its source section with an
+ *  offsetOperation(), so that the baseline is subtracted when the samples
+ *  are read. Throws std::out_of_range if a section index is out of range
+ *  or if \e bases and \e sections differ in size.
+ *  \param ch The source channel.
+ *  \param sections Indices of the sections.
+ *  \param bases The baseline of each section in \e sections.
+ *  \return A channel that holds one section per index in \e sections.
+ */
+StfioDll Channel subtractBaselines(const Channel& ch, const std::vector<std::size_t>& sections,
+                                   const Vector_double& bases);
+
+/*@}*/
+
+}
+
+#endif
@@ -0,0 +1,235 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file events.cpp
+ *  \brief Template-based event detection in many sections at once.
+ */
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <map>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./stfnum.h"
+#include "./measure.h"
+#include "./events.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/parallel.h"
+
+namespace {
+
+// Progress of single sections isn't shown while several of them are scanned:
+class SilentProgressInfo : public stfio::ProgressInfo {
+public:
+    SilentProgressInfo() : stfio::ProgressInfo("", "", 100, false) {}
+    bool Update(int value, const std::string& newmsg="", bool* skip=NULL) { return true; }
+};
+
+}
+
+void stfnum::EventTable::append(const EventTable& other) {
+    section.insert(section.end(), other.section.begin(), other.section.end());
+    index.insert(index.end(), other.index.begin(), other.index.end());
+    peakIndex.insert(peakIndex.end(), other.peakIndex.begin(), other.peakIndex.end());
+    amplitude.insert(amplitude.end(), other.amplitude.begin(), other.amplitude.end());
+    criterion.insert(criterion.end(), other.criterion.begin(), other.criterion.end());
+}
+
+stfnum::Table stfnum::EventTable::ToTable(double dt) const {
+    Table table(size(), 5);
+    table.SetColLabel(0, "Section");
+    table.SetColLabel(1, "Time of event onset");
+    table.SetColLabel(2, "Time of peak");
+    table.SetColLabel(3, "Amplitude");
+    table.SetColLabel(4, "Criterion");
+    for (std::size_t n = 0; n < size(); ++n) {
+        std::ostringstream label;
+        label << "Event #" << n+1;
+        table.SetRowLabel(n, label.str());
+        table.at(n, 0) = (double)section[n]+1;
+        table.at(n, 1) = index[n]*dt;
+        table.at(n, 2) = peakIndex[n]*dt;
+        table.at(n, 3) = amplitude[n];
+        table.at(n, 4) = criterion[n];
+    }
+    return table;
+}
+
+stfnum::EventDetectionPlan::EventDetectionPlan() :
+    templ(), mode(detect_criterion), threshold(4.0), minDistance(150), baseline(100),
+    SR(20.0), lowpass(0.5), highpass(0.0001)
+{}
+
+stfnum::EventTable stfnum::EventDetectionPlan::Detect(const Section& sec, std::size_t n_section,
+                                                      stfio::ProgressInfo& progDlg) const
+{
+    return Detect(sec, n_section, NULL, progDlg);
+}
+
+stfnum::EventTable stfnum::EventDetectionPlan::Detect(const Section& sec, std::size_t n_section,
+                                                      const DeconvolutionPlan* deconv,
+                                                      stfio::ProgressInfo& progDlg) const
+{
+    EventTable events;
+    if (templ.empty() || sec.size() <= templ.size()) {
+        return events;
+    }
+    // Mapped samples are decoded into a copy that shares them, so that
+    // the decoded data don't stay in memory once the section is done:
+    Section mapped;
+    if (sec.IsMapped()) {
+        mapped = sec;
+    }
+    const Vector_double& data = sec.IsMapped() ? mapped.get() : sec.get();
+
+    Vector_double detect;
+    switch (mode) {
+     case detect_correlation:
+         detect = linCorr(data, templ, progDlg);
+         break;
+     case detect_deconvolution:
+         if (deconv != NULL && deconv->size() == data.size()) {
+             detect = deconv->Apply(data, progDlg);
+         } else {
+             detect = deconvolve(data, templ, (int)SR, highpass, lowpass, progDlg);
+         }
+         break;
+     default:
+         detect = detectionCriterion(data, templ, progDlg);
+    }
+    if (detect.empty()) {
+        return events;
+    }
+    std::vector<int> startIndices(peakIndices(detect, threshold, minDistance));
+
+    for (std::size_t n_e = 0; n_e < startIndices.size(); ++n_e) {
+        int start = startIndices[n_e];
+        // Baseline before the event, as in wxStfDoc::MarkEvents():
+        double baselineMean = 0;
+        for (int n_mean = start-baseline; n_mean < start; ++n_mean) {
+            baselineMean += data[n_mean < 0 ? 0 : n_mean];
+        }
+        if (baseline > 0) {
+            baselineMean /= baseline;
+        }
+        int eventl = templ.size();
+        if (start + eventl >= (int)data.size()) {
+            eventl = data.size()-1-start;
+        }
+        double peakIndex = 0;
+        double peakValue = peak(data, baselineMean, start, start+eventl, 1, both, peakIndex);
+        if (peakIndex != peakIndex || peakIndex < 0 || peakIndex >= data.size()) {
+            throw std::runtime_error("Error during peak detection (result is NAN)\n");
+        }
+        events.section.push_back(n_section);
+        events.index.push_back(start);
+        events.peakIndex.push_back(peakIndex);
+        events.amplitude.push_back(peakValue-baselineMean);
+        events.criterion.push_back(detect[start]);
+    }
+    return events;
+}
+
+stfnum::EventTable stfnum::EventDetectionPlan::Detect(const Channel& ch, const std::vector<std::size_t>& sections,
+                                                      stfio::ProgressInfo& progDlg, int n_threads) const
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::EventDetectionPlan::Detect()");
+        }
+    }
+    // Sweeps usually share their length, so that a single transform of
+    // the template serves all of them:
+    std::map<std::size_t, DeconvolutionPlan> deconvs;
+    if (mode == detect_deconvolution) {
+        for (std::size_t n = 0; n < sections.size(); ++n) {
+            std::size_t size = ch[sections[n]].size();
+            if (!templ.empty() && size > templ.size() && deconvs.find(size) == deconvs.end()) {
+                deconvs.insert(std::make_pair(size, DeconvolutionPlan(templ, size, (int)SR, highpass, lowpass)));
+            }
+        }
+    }
+    int n_sections = (int)sections.size();
+    std::vector<EventTable> results(n_sections);
+    std::vector<std::string> errors(n_sections);
+    int n_finished = 0;
+    bool cancelled = false;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+    // the progress indicator may belong to the GUI and is only updated
+    // from the calling thread:
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        bool skip;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_event_progress)
+#endif
+        skip = cancelled;
+        if (!skip) {
+            try {
+                SilentProgressInfo silent;
+                std::map<std::size_t, DeconvolutionPlan>::const_iterator deconv =
+                    deconvs.find(ch[sections[n_s]].size());
+                results[n_s] = Detect(ch[sections[n_s]], sections[n_s],
+                                      deconv != deconvs.end() ? &deconv->second : NULL, silent);
+            }
+            catch (const std::exception& e) {
+                errors[n_s] = e.what();
+            }
+        }
+#ifdef _OPENMP
+#pragma omp critical(stfnum_event_progress)
+#endif
+        {
+            ++n_finished;
+            bool master = true;
+#ifdef _OPENMP
+            master = omp_get_thread_num() == 0;
+#endif
+            if (master && !cancelled) {
+                std::ostringstream msg;
+                msg << "Scanning section " << n_finished << " of " << n_sections;
+                cancelled = !progDlg.Update((int)(100.0*n_finished/n_sections), msg.str());
+            }
+        }
+    }
+    EventTable events;
+    if (cancelled) {
+        return events;
+    }
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        if (!errors[n_s].empty()) {
+            std::ostringstream error;
+            error << "Section " << sections[n_s]+1 << ": " << errors[n_s];
+            throw std::runtime_error(error.str());
+        }
+        events.append(results[n_s]);
+    }
+    return events;
+}
+
+stfnum::EventTable stfnum::EventDetectionPlan::Detect(const Channel& ch, stfio::ProgressInfo& progDlg,
+                                                      int n_threads) const
+{
+    std::vector<std::size_t> sections(ch.size());
+    for (std::size_t n_s = 0; n_s < sections.size(); ++n_s) {
+        sections[n_s] = n_s;
+    }
+    return Detect(ch, sections, progDlg, n_threads);
+}
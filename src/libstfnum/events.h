@@ -0,0 +1,131 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file events.h
+ *  \brief Template-based event detection in many sections at once.
+ */
+
+#ifndef _STFNUM_EVENTS_H
+#define _STFNUM_EVENTS_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "./stfnum.h"
+
+class Channel;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Methods to compare a template with the data.
+enum detection_mode {
+    detect_criterion = 0,     /*!< Clements & Bekkers criterion (see stfnum::detectionCriterion()). */
+    detect_correlation = 1,   /*!< Jonas et al. correlation coefficient (see stfnum::linCorr()). */
+    detect_deconvolution = 2  /*!< Pernia-Andrade et al. deconvolution (see stfnum::deconvolve()). */
+};
+
+//! Detected events, stored column by column.
+/*! Row n describes a single event; rows are sorted by section and onset.
+ *  Indices are given in sampling points within the section.
+ */
+struct StfioDll EventTable {
+    std::vector<std::size_t> section; /*!< Index of the section within the channel. */
+    std::vector<std::size_t> index;   /*!< Onset of the event, i.e. the best template match. */
+    std::vector<double> peakIndex;    /*!< Index of the peak of the event. */
+    std::vector<double> amplitude;    /*!< Peak amplitude, measured from the baseline before the onset. */
+    std::vector<double> criterion;    /*!< Value of the detection criterion at the onset. */
+
+    //! Retrieves the number of events.
+    /*! \return The number of rows.
+     */
+    std::size_t size() const { return index.size(); }
+
+    //! Appends all events of another table.
+    /*! \param other The events to be appended.
+     */
+    void append(const EventTable& other);
+
+    //! Converts the events to a table that can be shown in the results window.
+    /*! \param dt The sampling interval; times are given in x units.
+     *  \return A table with one row per event.
+     */
+    Table ToTable(double dt) const;
+};
+
+//! Detection settings that can be applied to many sections.
+/*! This is the GUI-free counterpart of wxStfDoc::MarkEvents(). Sections are
+ *  scanned in parallel; each of them is scanned in exactly the same way
+ *  as the current section in the program.
+ */
+struct StfioDll EventDetectionPlan {
+    //! Constructor. Sets defaults that match the event detection dialog.
+    EventDetectionPlan();
+
+    //! Detects events in a single section.
+    /*! \param sec The section to be scanned.
+     *  \param n_section The section index that is written to the table.
+     *  \param progDlg Progress indicator of the detection criterion.
+     *  \return The events of this section.
+     */
+    EventTable Detect(const Section& sec, std::size_t n_section, stfio::ProgressInfo& progDlg) const;
+
+    //! Detects events in a single section with a prepared deconvolution.
+    /*! Same as Detect() above, except that \e deconv is used for the
+     *  deconvolution if it has been made for the length of \e sec.
+     *  \param sec, n_section, progDlg See Detect() above.
+     *  \param deconv A deconvolution plan for the template; may be NULL.
+     *  \return The events of this section.
+     */
+    EventTable Detect(const Section& sec, std::size_t n_section, const DeconvolutionPlan* deconv,
+                      stfio::ProgressInfo& progDlg) const;
+
+    //! Detects events in several sections of a channel.
+    /*! Throws std::out_of_range if a section index is out of range.
+     *  For deconvolution, the template is transformed once for every
+     *  section length rather than once for every section.
+     *  \param ch The channel to be scanned.
+     *  \param sections Indices of the sections within \e ch.
+     *  \param progDlg Progress indicator; updated as sections are finished.
+     *  \param n_threads Number of sections that are scanned in parallel;
+     *         0 uses the configured number of threads.
+     *  \return The events of all sections in the order of \e sections,
+     *          or an empty table if the operation was cancelled.
+     */
+    EventTable Detect(const Channel& ch, const std::vector<std::size_t>& sections,
+                      stfio::ProgressInfo& progDlg, int n_threads = 0) const;
+
+    //! Detects events in all sections of a channel.
+    /*! See Detect() above for a description of the parameters.
+     */
+    EventTable Detect(const Channel& ch, stfio::ProgressInfo& progDlg, int n_threads = 0) const;
+
+    Vector_double templ;   /*!< The template waveform, scaled to a negative peak of -1. */
+    detection_mode mode;   /*!< Method to compare the template with the data. */
+    double threshold;      /*!< Detection threshold for the criterion. */
+    int minDistance;       /*!< Minimal distance between events in sampling points. */
+    int baseline;          /*!< Number of points before the onset that are averaged for the amplitude. */
+    double SR;             /*!< Sampling rate in kHz, used for the deconvolution. */
+    double lowpass;        /*!< Lowpass filter cutoff of the deconvolution in kHz. */
+    double highpass;       /*!< Highpass filter cutoff of the deconvolution in kHz. */
+};
+
+/*@}*/
+
+}
+
+#endif
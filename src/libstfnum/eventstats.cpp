@@ -0,0 +1,451 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file eventstats.cpp
+ *  \brief Inter-event intervals, event rates and amplitude distributions of detected events.
+ */
+
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "./eventstats.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/parallel.h"
+#include "../libstfio/profile.h"
+
+namespace {
+
+// Number of bins if no bin width has been set:
+const int defaultBins = 20;
+
+// The contiguous events of a single section.
+struct EventRun {
+    std::size_t set;    // index of the set
+    std::size_t begin;  // first row within the table of the set
+    std::size_t end;    // past the last row
+    std::size_t offset; // position of the first row in the pooled results
+};
+
+// Computes the intervals of a range of runs. Every run writes to its own
+// rows and sorted vectors; the bins are counted per thread.
+class RunStatistics : public stfio::RangeTask {
+public:
+    RunStatistics(const std::vector<stfnum::EventSet>& sets_, const std::vector<EventRun>& runs_,
+                  double binWidth_, std::size_t n_bins, int n_threads, stfnum::EventStatistics& stats_) :
+        sets(sets_), runs(runs_), binWidth(binWidth_), stats(stats_),
+        intervals(runs_.size()), amplitudes(runs_.size()),
+        counts(n_threads, std::vector<int>(n_bins, 0)), errors(runs_.size())
+    {}
+
+    void Run(std::size_t begin, std::size_t end, int thread) {
+        for (std::size_t n_r = begin; n_r < end; ++n_r) {
+            try {
+                RunOne(n_r, counts[thread]);
+            } catch (const std::exception& e) {
+                errors[n_r] = e.what();
+            }
+        }
+    }
+
+    const std::vector<stfnum::EventSet>& sets;
+    const std::vector<EventRun>& runs;
+    double binWidth;
+    stfnum::EventStatistics& stats;
+    std::vector<Vector_double> intervals;
+    std::vector<Vector_double> amplitudes;
+    std::vector< std::vector<int> > counts;
+    std::vector<std::string> errors;
+
+private:
+    void RunOne(std::size_t n_r, std::vector<int>& count) {
+        const EventRun& run = runs[n_r];
+        const stfnum::EventTable& events = *sets[run.set].events;
+        double dt = sets[run.set].dt;
+        Vector_double& runIntervals = intervals[n_r];
+        Vector_double& runAmplitudes = amplitudes[n_r];
+        runIntervals.reserve(run.end-run.begin);
+        runAmplitudes.reserve(run.end-run.begin);
+        for (std::size_t n = run.begin; n < run.end; ++n) {
+            std::size_t pos = run.offset + (n-run.begin);
+            double t = events.index[n]*dt;
+            stats.time[pos] = t;
+            if (n == run.begin) {
+                stats.interval[pos] = NAN;
+                stats.frequency[pos] = NAN;
+            } else {
+                if (events.index[n] < events.index[n-1]) {
+                    std::ostringstream error;
+                    error << "Events of section " << events.section[n]+1 << " aren't sorted by onset";
+                    throw std::runtime_error(error.str());
+                }
+                double interval = t - events.index[n-1]*dt;
+                stats.interval[pos] = interval;
+                stats.frequency[pos] = (interval > 0) ? 1.0/interval : NAN;
+                runIntervals.push_back(interval);
+            }
+            if (!std::isnan(events.amplitude[n])) {
+                runAmplitudes.push_back(events.amplitude[n]);
+            }
+            if (!count.empty()) {
+                std::size_t bin = (std::size_t)std::max(t/binWidth, 0.0);
+                count[std::min(bin, count.size()-1)]++;
+            }
+        }
+        std::sort(runIntervals.begin(), runIntervals.end());
+        std::sort(runAmplitudes.begin(), runAmplitudes.end());
+    }
+};
+
+// Merges pairs of sorted vectors; pair n goes to merged[n].
+class MergePairs : public stfio::RangeTask {
+public:
+    MergePairs(std::vector<Vector_double>& sorted_, std::vector<Vector_double>& merged_) :
+        sorted(sorted_), merged(merged_)
+    {}
+
+    void Run(std::size_t begin, std::size_t end, int thread) {
+        for (std::size_t n = begin; n < end; ++n) {
+            Vector_double& first = sorted[2*n];
+            if (2*n+1 == sorted.size()) {
+                merged[n].swap(first);
+                continue;
+            }
+            Vector_double& second = sorted[2*n+1];
+            merged[n].resize(first.size() + second.size());
+            std::merge(first.begin(), first.end(), second.begin(), second.end(), merged[n].begin());
+            Vector_double().swap(first);
+            Vector_double().swap(second);
+        }
+    }
+
+private:
+    std::vector<Vector_double>& sorted;
+    std::vector<Vector_double>& merged;
+};
+
+// Merges the sorted vectors of all runs pairwise, so that every round
+// takes a single parallel pass over the values:
+Vector_double mergeSorted(std::vector<Vector_double>& sorted, int n_threads) {
+    while (sorted.size() > 1) {
+        std::vector<Vector_double> merged((sorted.size()+1)/2);
+        MergePairs task(sorted, merged);
+        stfio::parallelFor(merged.size(), task, n_threads);
+        sorted.swap(merged);
+    }
+    return sorted.empty() ? Vector_double() : sorted[0];
+}
+
+double median(const Vector_double& sorted) {
+    std::size_t n = sorted.size();
+    if (n == 0) {
+        return NAN;
+    }
+    return (n % 2) ? sorted[n/2] : 0.5*(sorted[n/2-1] + sorted[n/2]);
+}
+
+// Mean and standard deviation of a sample:
+void meanSD(const Vector_double& sample, double& mean, double& sd) {
+    std::size_t n = sample.size();
+    mean = sd = NAN;
+    if (n == 0) {
+        return;
+    }
+    double sum = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+        sum += sample[k];
+    }
+    mean = sum/n;
+    if (n < 2) {
+        return;
+    }
+    double sumSq = 0;
+    for (std::size_t k = 0; k < n; ++k) {
+        sumSq += (sample[k]-mean)*(sample[k]-mean);
+    }
+    sd = std::sqrt(sumSq/(n-1));
+}
+
+// Sets a cell, or leaves it empty if the value is NaN:
+void setCell(stfnum::Table& table, std::size_t row, std::size_t col, double value) {
+    if (std::isnan(value)) {
+        table.SetEmpty(row, col);
+    } else {
+        table.at(row, col) = value;
+    }
+}
+
+}
+
+stfnum::EventSet::EventSet(const EventTable& events_, double dt_, const std::vector<std::size_t>& sections_,
+                           const Vector_double& durations_) :
+    events(&events_), dt(dt_), sections(sections_), durations(durations_)
+{
+    if (durations.size() != sections.size()) {
+        throw std::out_of_range("Number of durations differs from the number of sections in stfnum::EventSet");
+    }
+}
+
+stfnum::EventSet::EventSet(const EventTable& events_, double dt_, const std::vector<std::size_t>& sections_,
+                           const Channel& ch) :
+    events(&events_), dt(dt_), sections(sections_), durations(sections_.size())
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::EventSet");
+        }
+        durations[n] = ch[sections[n]].size()*dt;
+    }
+}
+
+stfnum::EventStatistics::EventStatistics() :
+    time(), interval(), frequency(), binTime(), binCount(), binRate(),
+    sortedIntervals(), sortedAmplitudes(), nEvents(0), nSections(0), duration(0),
+    meanRate(NAN), meanInterval(NAN), medianInterval(NAN), cvInterval(NAN),
+    meanAmplitude(NAN), medianAmplitude(NAN), sdAmplitude(NAN)
+{}
+
+stfnum::Table stfnum::EventStatistics::ToTable() const {
+    const char* labels[] = {"Events", "Sections", "Duration", "Mean rate", "Mean interval",
+                            "Median interval", "CV of intervals", "Mean amplitude",
+                            "Median amplitude", "SD of amplitudes"};
+    double values[] = {(double)nEvents, (double)nSections, duration, meanRate, meanInterval,
+                       medianInterval, cvInterval, meanAmplitude, medianAmplitude, sdAmplitude};
+    std::size_t n_rows = sizeof(values)/sizeof(values[0]);
+    Table table(n_rows, 1);
+    table.SetColLabel(0, "Value");
+    for (std::size_t n = 0; n < n_rows; ++n) {
+        table.SetRowLabel(n, labels[n]);
+        setCell(table, n, 0, values[n]);
+    }
+    return table;
+}
+
+stfnum::Table stfnum::EventStatistics::IntervalTable() const {
+    Table table(time.size(), 3);
+    table.SetColLabel(0, "Time of event onset");
+    table.SetColLabel(1, "Inter-event interval");
+    table.SetColLabel(2, "Instantaneous frequency");
+    for (std::size_t n = 0; n < time.size(); ++n) {
+        std::ostringstream label;
+        label << "Event #" << n+1;
+        table.SetRowLabel(n, label.str());
+        table.at(n, 0) = time[n];
+        setCell(table, n, 1, interval[n]);
+        setCell(table, n, 2, frequency[n]);
+    }
+    return table;
+}
+
+stfnum::Table stfnum::EventStatistics::RateTable() const {
+    Table table(binTime.size(), 3);
+    table.SetColLabel(0, "Bin start");
+    table.SetColLabel(1, "Events");
+    table.SetColLabel(2, "Rate");
+    for (std::size_t n = 0; n < binTime.size(); ++n) {
+        std::ostringstream label;
+        label << "Bin #" << n+1;
+        table.SetRowLabel(n, label.str());
+        table.at(n, 0) = binTime[n];
+        table.at(n, 1) = binCount[n];
+        setCell(table, n, 2, binRate[n]);
+    }
+    return table;
+}
+
+stfnum::Table stfnum::EventStatistics::DistributionTable() const {
+    std::size_t n_rows = std::max(sortedIntervals.size(), sortedAmplitudes.size());
+    Table table(n_rows, 4);
+    table.SetColLabel(0, "Interval");
+    table.SetColLabel(1, "Cumulative fraction");
+    table.SetColLabel(2, "Amplitude");
+    table.SetColLabel(3, "Cumulative fraction");
+    for (std::size_t n = 0; n < n_rows; ++n) {
+        std::ostringstream label;
+        label << "#" << n+1;
+        table.SetRowLabel(n, label.str());
+        if (n < sortedIntervals.size()) {
+            table.at(n, 0) = sortedIntervals[n];
+            table.at(n, 1) = (double)(n+1)/sortedIntervals.size();
+        } else {
+            table.SetEmpty(n, 0);
+            table.SetEmpty(n, 1);
+        }
+        if (n < sortedAmplitudes.size()) {
+            table.at(n, 2) = sortedAmplitudes[n];
+            table.at(n, 3) = (double)(n+1)/sortedAmplitudes.size();
+        } else {
+            table.SetEmpty(n, 2);
+            table.SetEmpty(n, 3);
+        }
+    }
+    return table;
+}
+
+stfnum::EventStatisticsPlan::EventStatisticsPlan() :
+    binWidth(0)
+{}
+
+stfnum::EventStatistics stfnum::EventStatisticsPlan::Compute(const EventSet& set, int n_threads) const {
+    return Compute(std::vector<EventSet>(1, set), n_threads);
+}
+
+stfnum::EventStatistics stfnum::EventStatisticsPlan::Compute(const std::vector<EventSet>& sets,
+                                                             int n_threads) const
+{
+    STF_PROFILE_SCOPE("stfnum/eventStatistics");
+    EventStatistics stats;
+
+    // The events of every section form a run; the sections have to be
+    // listed in their sets for their durations:
+    std::vector<EventRun> runs;
+    double maxDuration = 0;
+    for (std::size_t n_set = 0; n_set < sets.size(); ++n_set) {
+        const EventSet& set = sets[n_set];
+        std::map<std::size_t, double> durations;
+        for (std::size_t n = 0; n < set.sections.size(); ++n) {
+            durations[set.sections[n]] = set.durations[n];
+            stats.duration += set.durations[n];
+            maxDuration = std::max(maxDuration, set.durations[n]);
+        }
+        stats.nSections += set.sections.size();
+        const EventTable& events = *set.events;
+        for (std::size_t begin = 0; begin < events.size();) {
+            std::size_t end = begin+1;
+            while (end < events.size() && events.section[end] == events.section[begin]) {
+                ++end;
+            }
+            if (durations.find(events.section[begin]) == durations.end()) {
+                std::ostringstream error;
+                error << "Events of section " << events.section[begin]+1
+                      << " that hasn't been scanned in stfnum::EventStatisticsPlan::Compute()";
+                throw std::out_of_range(error.str());
+            }
+            EventRun run;
+            run.set = n_set;
+            run.begin = begin;
+            run.end = end;
+            run.offset = stats.nEvents + begin;
+            runs.push_back(run);
+            begin = end;
+        }
+        stats.nEvents += events.size();
+    }
+    stats.time.resize(stats.nEvents);
+    stats.interval.resize(stats.nEvents);
+    stats.frequency.resize(stats.nEvents);
+
+    // The bins cover the longest section:
+    double width = (binWidth > 0) ? binWidth : maxDuration/defaultBins;
+    std::size_t n_bins = 0;
+    if (width > 0 && maxDuration > 0) {
+        n_bins = (std::size_t)std::ceil(maxDuration/width);
+    }
+
+    n_threads = stfio::threadCount(n_threads, (int)std::max<std::size_t>(runs.size(), 1));
+    RunStatistics task(sets, runs, width, n_bins, n_threads, stats);
+    stfio::parallelFor(runs.size(), task, n_threads);
+    for (std::size_t n_r = 0; n_r < runs.size(); ++n_r) {
+        if (!task.errors[n_r].empty()) {
+            throw std::runtime_error(task.errors[n_r]);
+        }
+    }
+
+    // Time that the sections spend in every bin; a section of duration d
+    // covers floor(d/width) bins completely and the next one in part:
+    stats.binTime.resize(n_bins);
+    stats.binCount.assign(n_bins, 0);
+    stats.binRate.resize(n_bins);
+    if (n_bins > 0) {
+        std::vector<int> complete(n_bins+1, 0);
+        Vector_double partial(n_bins, 0.0);
+        for (std::size_t n_set = 0; n_set < sets.size(); ++n_set) {
+            for (std::size_t n = 0; n < sets[n_set].durations.size(); ++n) {
+                double d = std::max(sets[n_set].durations[n], 0.0);
+                std::size_t full = std::min((std::size_t)(d/width), n_bins);
+                complete[full]++;
+                if (full < n_bins) {
+                    partial[full] += d - full*width;
+                }
+            }
+        }
+        int covering = 0;
+        for (std::size_t n_b = n_bins; n_b-- > 0;) {
+            covering += complete[n_b+1];
+            for (int n_t = 0; n_t < n_threads; ++n_t) {
+                stats.binCount[n_b] += task.counts[n_t][n_b];
+            }
+            double coverage = covering*width + partial[n_b];
+            stats.binTime[n_b] = n_b*width;
+            stats.binRate[n_b] = (coverage > 0) ? stats.binCount[n_b]/coverage : NAN;
+        }
+    }
+
+    stats.sortedIntervals = mergeSorted(task.intervals, n_threads);
+    stats.sortedAmplitudes = mergeSorted(task.amplitudes, n_threads);
+
+    if (stats.duration > 0) {
+        stats.meanRate = stats.nEvents/stats.duration;
+    }
+    double sdInterval = NAN;
+    meanSD(stats.sortedIntervals, stats.meanInterval, sdInterval);
+    if (stats.meanInterval > 0) {
+        stats.cvInterval = sdInterval/stats.meanInterval;
+    }
+    stats.medianInterval = median(stats.sortedIntervals);
+    meanSD(stats.sortedAmplitudes, stats.meanAmplitude, stats.sdAmplitude);
+    stats.medianAmplitude = median(stats.sortedAmplitudes);
+    return stats;
+}
+
+double stfnum::ksTest(const Vector_double& a, const Vector_double& b, double& p) {
+    p = NAN;
+    if (a.empty() || b.empty()) {
+        return NAN;
+    }
+    // walk along both samples; ties are passed in a single step:
+    double n_a = (double)a.size(), n_b = (double)b.size();
+    double d = 0;
+    std::size_t j_a = 0, j_b = 0;
+    while (j_a < a.size() && j_b < b.size()) {
+        double x = std::min(a[j_a], b[j_b]);
+        while (j_a < a.size() && a[j_a] <= x) {
+            ++j_a;
+        }
+        while (j_b < b.size() && b[j_b] <= x) {
+            ++j_b;
+        }
+        d = std::max(d, std::fabs(j_a/n_a - j_b/n_b));
+    }
+    // asymptotic distribution with the correction of Stephens (1970):
+    double en = std::sqrt(n_a*n_b/(n_a+n_b));
+    double lambda = (en + 0.12 + 0.11/en)*d;
+    if (lambda < 0.2) {
+        p = 1.0;
+        return d;
+    }
+    double sum = 0, sign = 1;
+    for (int j = 1; j <= 100; ++j) {
+        double term = sign*2.0*std::exp(-2.0*j*j*lambda*lambda);
+        sum += term;
+        if (std::fabs(term) < 1e-10*std::fabs(sum)) {
+            break;
+        }
+        sign = -sign;
+    }
+    p = std::min(std::max(sum, 0.0), 1.0);
+    return d;
+}
@@ -0,0 +1,156 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file eventstats.h
+ *  \brief Inter-event intervals, event rates and amplitude distributions of detected events.
+ */
+
+#ifndef _STFNUM_EVENTSTATS_H
+#define _STFNUM_EVENTSTATS_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "./stfnum.h"
+#include "./events.h"
+
+class Channel;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! The events of a recording, together with the sections that have been scanned.
+/*! Sections that have been scanned without finding events count for the
+ *  event rates as well, so that they are listed with their durations.
+ */
+struct StfioDll EventSet {
+    //! Constructor
+    /*! \param events_ The events; the table has to outlive the set. The events
+     *         of a section have to be contiguous and sorted by onset, as
+     *         returned by stfnum::EventDetectionPlan::Detect().
+     *  \param dt_ The sampling interval; times are given in x units.
+     *  \param sections_ Indices of the sections that have been scanned.
+     *  \param durations_ Durations of these sections in x units.
+     */
+    EventSet(const EventTable& events_, double dt_, const std::vector<std::size_t>& sections_,
+             const Vector_double& durations_);
+
+    //! Constructor for events that have been detected in a channel.
+    /*! \param events_, dt_, sections_ See the constructor above.
+     *  \param ch The channel; the durations are taken from its sections.
+     */
+    EventSet(const EventTable& events_, double dt_, const std::vector<std::size_t>& sections_,
+             const Channel& ch);
+
+    const EventTable* events;          /*!< The events. */
+    double dt;                         /*!< The sampling interval. */
+    std::vector<std::size_t> sections; /*!< Indices of the scanned sections. */
+    Vector_double durations;           /*!< Durations of the scanned sections in x units. */
+};
+
+//! Statistics of events that have been pooled over sections and recordings.
+/*! Intervals are only taken between events of the same section. Rates are
+ *  given in events per x unit, e.g. kHz if x units are ms.
+ */
+struct StfioDll EventStatistics {
+    //! Constructor for empty statistics.
+    EventStatistics();
+
+    Vector_double time;      /*!< Onset of every event within its section, in the order of the sets and their tables. */
+    Vector_double interval;  /*!< Time since the previous event of the same section; NaN for the first one. */
+    Vector_double frequency; /*!< Instantaneous frequency, i.e. the reciprocal of the interval. */
+
+    Vector_double binTime;       /*!< Start of every rate bin within the sections. */
+    std::vector<int> binCount;   /*!< Number of events in every bin. */
+    Vector_double binRate;       /*!< Events per x unit in every bin, averaged over the sections that reach into it; NaN if none does. */
+
+    Vector_double sortedIntervals;  /*!< All intervals in ascending order, e.g. for stfnum::ksTest(). */
+    Vector_double sortedAmplitudes; /*!< All amplitudes in ascending order. */
+
+    std::size_t nEvents;    /*!< Number of events. */
+    std::size_t nSections;  /*!< Number of scanned sections. */
+    double duration;        /*!< Total duration of the scanned sections. */
+    double meanRate;        /*!< Number of events divided by the total duration. */
+    double meanInterval;    /*!< Mean of the intervals. */
+    double medianInterval;  /*!< Median of the intervals. */
+    double cvInterval;      /*!< Coefficient of variation of the intervals. */
+    double meanAmplitude;   /*!< Mean of the amplitudes. */
+    double medianAmplitude; /*!< Median of the amplitudes. */
+    double sdAmplitude;     /*!< Standard deviation of the amplitudes. */
+
+    //! Summarizes the statistics in a table that can be shown in the results window.
+    /*! \return A table with one row per summary value.
+     */
+    Table ToTable() const;
+
+    //! Lists the events with their intervals.
+    /*! \return A table with one row per event.
+     */
+    Table IntervalTable() const;
+
+    //! Lists the rate bins.
+    /*! \return A table with one row per bin.
+     */
+    Table RateTable() const;
+
+    //! Lists the cumulative distributions of intervals and amplitudes.
+    /*! \return A table with the sorted values and their cumulative fractions;
+     *          the shorter of the two columns is padded with empty cells.
+     */
+    Table DistributionTable() const;
+};
+
+//! Settings of the event statistics.
+struct StfioDll EventStatisticsPlan {
+    //! Constructor. Sets the default bin width.
+    EventStatisticsPlan();
+
+    //! Computes the statistics of several recordings.
+    /*! The sections of all sets are processed in parallel. Throws
+     *  std::out_of_range if an event belongs to a section that isn't listed
+     *  in its set, and std::runtime_error if the events of a section aren't
+     *  sorted by onset.
+     *  \param sets The events of the recordings.
+     *  \param n_threads Number of threads; 0 uses the configured number of threads.
+     *  \return The pooled statistics.
+     */
+    EventStatistics Compute(const std::vector<EventSet>& sets, int n_threads = 0) const;
+
+    //! Computes the statistics of a single recording.
+    /*! See Compute() above for a description of the parameters.
+     */
+    EventStatistics Compute(const EventSet& set, int n_threads = 0) const;
+
+    double binWidth; /*!< Width of the rate bins in x units; 0 or less divides the longest section into 20 bins. */
+};
+
+//! Compares two distributions with the two-sample Kolmogorov-Smirnov test.
+/*! \param a, b Samples in ascending order, e.g. stfnum::EventStatistics::sortedIntervals
+ *         of two recordings.
+ *  \param p Is set to the asymptotic probability of a distance that is at
+ *         least as large if both samples come from the same distribution;
+ *         NaN if a sample is empty.
+ *  \return The largest distance between the cumulative distributions; NaN
+ *          if a sample is empty.
+ */
+StfioDll double ksTest(const Vector_double& a, const Vector_double& b, double& p);
+
+/*@}*/
+
+}
+
+#endif
@@ -14,67 +14,94 @@
 
 #include "./fit.h"
 #include "./levmar/levmar.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/parallel.h"
 
 #include <float.h>
 #include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace stfnum {
 // C-style functions for Lourakis' routines:
 void c_func_lour(double *p, double* hx, int m, int n, void *adata);
 void c_jac_lour(double *p, double *j, int m, int n, void *adata);
-
-// Helper functions for lmFit to store the function at global scope:
-void saveFunc(stfnum::Func func);
-void saveJac(stfnum::Jac jac);
+// ... and their single precision variants:
+void c_func_lour_s(float *p, float* hx, int m, int n, void *adata);
+void c_jac_lour_s(float *p, float *j, int m, int n, void *adata);
 
 // A struct that will be passed as a pointer to
 // Lourakis' C-functions. It is used to:
 // (1) specify which parameters are to be fitted, and
 // (2) pass the constant parameters
 // (3) the sampling interval
+// (4) the function and its Jacobian
+// Since everything the callbacks need travels with this struct,
+// lmFit doesn't rely on any global state and is re-entrant.
+// The vectors belong to the FitWorkspace of the fit.
 struct fitInfo {
     fitInfo(const std::deque<bool>& fit_p_arg,
             const Vector_double& const_p_arg,
-            double dt_arg)
-        :   fit_p(fit_p_arg), const_p(const_p_arg),
-            dt(dt_arg)
+            Vector_double& p_f_arg,
+            double dt_arg,
+            const Vector_double& x_arg,
+            Vector_double& jac_f_arg,
+            Vector_double& hx_arg,
+            const stfnum::storedFunc& fitFunc)
+        :   fit_p(fit_p_arg), const_p(const_p_arg), p_f(p_f_arg),
+            dt(dt_arg), x(x_arg), jac_f(jac_f_arg), hx(hx_arg),
+            func(fitFunc.func), jac(fitFunc.jac),
+            batchFunc(fitFunc.batchFunc), batchJac(fitFunc.batchJac)
     {}
 
     // Specifies for each parameter whether the client
     // wants to fit it (true) or to keep it constant (false)
-    std::deque<bool> fit_p;
+    const std::deque<bool>& fit_p;
 
     // A valarray containing the parameters that
     // will be kept constant:
-    Vector_double const_p;
+    const Vector_double& const_p;
+
+    // Buffer for all parameters, including constants, that is
+    // filled by the callbacks:
+    Vector_double& p_f;
 
     // sampling interval
     double dt;
-};
-}
 
-// Functions stored at global scope to be called by c_func_lour
-// and c_jac_lour
-stfnum::Func func_lour;
-stfnum::Jac jac_lour; 
+    // x-values of all sampling points and a buffer for the
+    // jacobian of all parameters, for the batch callbacks:
+    const Vector_double& x;
+    Vector_double& jac_f;
 
-void stfnum::saveFunc(stfnum::Func func) {
-    func_lour=func;
-}
+    // Buffer for the function values or the jacobian in double
+    // precision, for the single precision callbacks:
+    Vector_double& hx;
 
-void stfnum::saveJac(stfnum::Jac jac) {
-    jac_lour=jac;
+    // The function to be fitted and its Jacobian;
+    // references to the storedFunc passed to lmFit, which
+    // outlives the fitInfo struct:
+    const stfnum::Func& func;
+    const stfnum::Jac& jac;
+    const stfnum::BatchFunc& batchFunc;
+    const stfnum::BatchJac& batchJac;
+};
 }
 
-void stfnum::c_func_lour(double *p, double* hx, int m, int n, void *adata) {
-    // m: the number of parameters that are to be fitted
-    // adata: pointer to a struct that (1) specifies which parameters are to be fitted
-    //		  and (2) contains the constant parameters
-    fitInfo *fInfo=static_cast<fitInfo*>(adata);
+namespace {
+
+// Assembles all parameters, including constants, in fInfo->p_f:
+template <typename T>
+void assembleParams(const T *p, stfnum::fitInfo *fInfo) {
     // total number of parameters, including constants:
     int tot_p=(int)fInfo->fit_p.size();
     // all parameters, including constants:
-    Vector_double p_f(tot_p);
+    Vector_double& p_f = fInfo->p_f;
     for (int n_tp=0, n_p=0, n_f=0;n_tp<tot_p;++n_tp) {
         // if the parameter needs to be fitted...
         if (fInfo->fit_p[n_tp]) {
@@ -85,34 +112,45 @@ void stfnum::c_func_lour(double *p, double* hx, int m, int n, void *adata) {
             p_f[n_tp] = fInfo->const_p[n_f++];
         }
     }
+}
+
+// Evaluates the function at the parameters in fInfo->p_f:
+void evalFunc(stfnum::fitInfo *fInfo, int n, double *hx) {
+    Vector_double& p_f = fInfo->p_f;
+    if (!fInfo->batchFunc.empty()) {
+        fInfo->batchFunc(&fInfo->x[0], n, &p_f[0], p_f.size(), hx);
+        return;
+    }
     for (int n_x=0;n_x<n;++n_x) {
-        hx[n_x]=func_lour( (double)n_x*fInfo->dt, p_f);
-    }	
+        hx[n_x]=fInfo->func( (double)n_x*fInfo->dt, p_f);
+    }
 }
 
-void stfnum::c_jac_lour(double *p, double *jac, int m, int n, void *adata) {
-    // m: the number of parameters that are to be fitted
-    // adata: pointer to a struct that (1) specifies which parameters are to be fitted
-    //		  and (2) contains the constant parameters
-    fitInfo *fInfo=static_cast<fitInfo*>(adata);
-    // total number of parameters, including constants:
+// Evaluates the jacobian of the m fitted parameters at the parameters in fInfo->p_f:
+void evalJac(stfnum::fitInfo *fInfo, int m, int n, double *jac) {
     int tot_p=(int)fInfo->fit_p.size();
-    // all parameters, including constants:
-    Vector_double p_f(tot_p);
-    for (int n_tp=0,n_p=0,n_f=0;n_tp<tot_p;++n_tp) {
-        // if the parameter needs to be fitted...
-        if (fInfo->fit_p[n_tp]) {
-            // ... take it from *p, ...
-            p_f[n_tp] = p[n_p++];
-        } else {
-            // ... otherwise, take it from the fInfo struct:
-            p_f[n_tp] = fInfo->const_p[n_f++];
+    Vector_double& p_f = fInfo->p_f;
+    if (!fInfo->batchJac.empty()) {
+        if (m == tot_p) {
+            fInfo->batchJac(&fInfo->x[0], n, &p_f[0], tot_p, jac);
+            return;
         }
+        // the derivatives of the constants are eliminated afterwards:
+        double* jac_f = &fInfo->jac_f[0];
+        fInfo->batchJac(&fInfo->x[0], n, &p_f[0], tot_p, jac_f);
+        for (int n_x=0,n_j=0;n_x<n;++n_x) {
+            for (int n_tp=0;n_tp<tot_p;++n_tp) {
+                if (fInfo->fit_p[n_tp]) {
+                    jac[n_j++]=jac_f[n_x*tot_p+n_tp];
+                }
+            }
+        }
+        return;
     }
     for (int n_x=0,n_j=0;n_x<n;++n_x) {
         // jac_f will calculate the derivatives of all parameters,
         // including the constants...
-        Vector_double jac_f(jac_lour((double)n_x*fInfo->dt,p_f));
+        Vector_double jac_f(fInfo->jac((double)n_x*fInfo->dt,p_f));
         // ... but we only need the derivatives of the non-constants...
         for (int n_tp=0;n_tp<tot_p;++n_tp) {
             // ... hence, we will eliminate the derivatives of the constants:
@@ -123,6 +161,149 @@ void stfnum::c_jac_lour(double *p, double *jac, int m, int n, void *adata) {
     }
 }
 
+}
+
+void stfnum::c_func_lour(double *p, double* hx, int m, int n, void *adata) {
+    // m: the number of parameters that are to be fitted
+    // adata: pointer to a struct that (1) specifies which parameters are to be fitted
+    //		  and (2) contains the constant parameters
+    fitInfo *fInfo=static_cast<fitInfo*>(adata);
+    assembleParams(p, fInfo);
+    evalFunc(fInfo, n, hx);
+}
+
+void stfnum::c_jac_lour(double *p, double *jac, int m, int n, void *adata) {
+    fitInfo *fInfo=static_cast<fitInfo*>(adata);
+    assembleParams(p, fInfo);
+    evalJac(fInfo, m, n, jac);
+}
+
+void stfnum::c_func_lour_s(float *p, float* hx, int m, int n, void *adata) {
+    // the function is evaluated in double precision and rounded:
+    fitInfo *fInfo=static_cast<fitInfo*>(adata);
+    assembleParams(p, fInfo);
+    double* hx_d = &fInfo->hx[0];
+    evalFunc(fInfo, n, hx_d);
+    for (int n_x=0;n_x<n;++n_x) {
+        hx[n_x]=(float)hx_d[n_x];
+    }
+}
+
+void stfnum::c_jac_lour_s(float *p, float *jac, int m, int n, void *adata) {
+    fitInfo *fInfo=static_cast<fitInfo*>(adata);
+    assembleParams(p, fInfo);
+    double* jac_d = &fInfo->hx[0];
+    evalJac(fInfo, m, n, jac_d);
+    for (int n_j=0;n_j<m*n;++n_j) {
+        jac[n_j]=(float)jac_d[n_j];
+    }
+}
+
+namespace {
+
+// Lourakis' routines in double and single precision. Box constraints are
+// used if lb isn't NULL:
+template <typename T> struct levmar;
+
+template <> struct levmar<double> {
+    static int dif(double *p, double *x, int m, int n, double *lb, double *ub,
+                   int itmax, double *opts, double *info, double *work, void *adata)
+    {
+        if (lb == NULL) {
+            return dlevmar_dif( stfnum::c_func_lour, p, x, m, n, itmax, opts, info,
+                                work, NULL, adata );
+        }
+        return dlevmar_bc_dif( stfnum::c_func_lour, p, x, m, n, lb, ub, NULL,
+                               itmax, opts, info, work, NULL, adata );
+    }
+    static int der(double *p, double *x, int m, int n, double *lb, double *ub,
+                   int itmax, double *opts, double *info, double *work, void *adata)
+    {
+        if (lb == NULL) {
+            return dlevmar_der( stfnum::c_func_lour, stfnum::c_jac_lour, p, x, m, n, itmax,
+                                opts, info, work, NULL, adata );
+        }
+        return dlevmar_bc_der( stfnum::c_func_lour, stfnum::c_jac_lour, p, x, m, n, lb, ub,
+                               NULL, itmax, opts, info, work, NULL, adata );
+    }
+    // the stopping thresholds are used as given:
+    static double min_threshold() { return 0.0; }
+};
+
+template <> struct levmar<float> {
+    static int dif(float *p, float *x, int m, int n, float *lb, float *ub,
+                   int itmax, float *opts, float *info, float *work, void *adata)
+    {
+        if (lb == NULL) {
+            return slevmar_dif( stfnum::c_func_lour_s, p, x, m, n, itmax, opts, info,
+                                work, NULL, adata );
+        }
+        return slevmar_bc_dif( stfnum::c_func_lour_s, p, x, m, n, lb, ub, NULL,
+                               itmax, opts, info, work, NULL, adata );
+    }
+    static int der(float *p, float *x, int m, int n, float *lb, float *ub,
+                   int itmax, float *opts, float *info, float *work, void *adata)
+    {
+        if (lb == NULL) {
+            return slevmar_der( stfnum::c_func_lour_s, stfnum::c_jac_lour_s, p, x, m, n, itmax,
+                                opts, info, work, NULL, adata );
+        }
+        return slevmar_bc_der( stfnum::c_func_lour_s, stfnum::c_jac_lour_s, p, x, m, n, lb, ub,
+                               NULL, itmax, opts, info, work, NULL, adata );
+    }
+    // thresholds below the resolution of single precision would never be reached:
+    static double min_threshold() { return FLT_EPSILON; }
+};
+
+// Scales the data like stfnum::get_scale():
+Vector_double scaleData(Vector_double& data, double oldx) {
+    return stfnum::get_scale(data, oldx);
+}
+
+Vector_double scaleData(std::vector<float>& data, double oldx) {
+    Vector_double xyscale(4);
+    xyscale[0] = 1.0/oldx;
+    xyscale[1] = 0.0;
+    xyscale[2] = 1.0;
+    xyscale[3] = 0.0;
+    if (data.empty()) {
+        return xyscale;
+    }
+    float ymin = *std::min_element(data.begin(), data.end());
+    float ymax = *std::max_element(data.begin(), data.end());
+    double amp = (double)ymax - ymin;
+    double off = ymin / amp;
+    float factor = (float)(1.0 / amp), shift = (float)-off;
+    for (std::size_t n = 0; n < data.size(); ++n) {
+        data[n] = data[n]*factor + shift;
+    }
+    xyscale[0] = 1.0/(data.size()*oldx);
+    xyscale[2] = 1.0/amp;
+    xyscale[3] = off;
+    return xyscale;
+}
+
+// Makes sure that the buffers can hold a fit of the given size:
+template <typename T>
+void reserveBuffers(stfnum::LevmarBuffers<T>& buf, std::size_t n_params, std::size_t n_points) {
+    if (n_params > buf.lb.capacity()) {
+        buf.lb.reserve(n_params);
+        buf.ub.reserve(n_params);
+        buf.p_toFit.reserve(n_params);
+        buf.old_p.reserve(n_params);
+    }
+    if (n_points > buf.data.capacity()) {
+        buf.data.reserve(n_points);
+    }
+    // the derivative-free variant needs the largest work array:
+    std::size_t worksz = LM_DIF_WORKSZ(n_params, n_points);
+    if (worksz > buf.work.size()) {
+        buf.work.resize(worksz);
+    }
+}
+
+}
+
 Vector_double stfnum::get_scale(Vector_double& data, double oldx) {
     Vector_double xyscale(4);
 
@@ -147,8 +328,7 @@ Vector_double stfnum::get_scale(Vector_double& data, double oldx) {
     amp = ymax - ymin;
     off = ymin / amp;
 
-    data = stfio::vec_scal_mul(data, 1.0 / amp);
-    data = stfio::vec_scal_minus(data, off);
+    stfio::scale_offset_inplace(data, 1.0 / amp, -off);
 
     xyscale[0] = 1.0/(data.size()*oldx);
     xyscale[1] = 0;
@@ -158,11 +338,89 @@ Vector_double stfnum::get_scale(Vector_double& data, double oldx) {
     return xyscale;
 }
 
+stfnum::FitWorkspace::FitWorkspace() :
+    dbl(), sngl(), p_const(0), p_f(0), x(0), jac(0), hx(0), fit_p(0)
+{}
+
+stfnum::FitWorkspace::FitWorkspace(std::size_t n_params, std::size_t n_points, bool single_precision) :
+    dbl(), sngl(), p_const(0), p_f(0), x(0), jac(0), hx(0), fit_p(0)
+{
+    Reserve(n_params, n_points, single_precision);
+}
+
+void stfnum::FitWorkspace::Reserve(std::size_t n_params, std::size_t n_points, bool single_precision) {
+    // Vectors are resized to the exact size of every fit, which
+    // doesn't reallocate as long as it stays within their capacity:
+    if (n_params > p_f.capacity()) {
+        p_const.reserve(n_params);
+        p_f.reserve(n_params);
+    }
+    if (n_points > x.capacity()) {
+        x.reserve(n_points);
+    }
+    if (single_precision) {
+        reserveBuffers(sngl, n_params, n_points);
+    } else {
+        reserveBuffers(dbl, n_params, n_points);
+    }
+}
+
 double stfnum::lmFit( const Vector_double& data, double dt,
                    const stfnum::storedFunc& fitFunc, const Vector_double& opts,
                    bool use_scaling,
                    Vector_double& p, std::string& info, int& warning )
 {
+    FitWorkspace workspace(fitFunc.pInfo.size(), data.size());
+    return lmFit(data, dt, fitFunc, opts, use_scaling, p, info, warning, workspace);
+}
+
+double stfnum::lmFit( const Vector_double& data, double dt,
+                   const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                   bool use_scaling,
+                   Vector_double& p, std::string& info, int& warning,
+                   FitWorkspace& workspace )
+{
+    return FitWorkspace::Fit(data.empty() ? NULL : &data[0], data.size(), dt, fitFunc, opts,
+                             use_scaling, p, info, warning, workspace, workspace.dbl);
+}
+
+double stfnum::lmFit( const double* data, std::size_t n_data, double dt,
+                   const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                   bool use_scaling,
+                   Vector_double& p, std::string& info, int& warning,
+                   FitWorkspace& workspace )
+{
+    return FitWorkspace::Fit(n_data == 0 ? NULL : data, n_data, dt, fitFunc, opts,
+                             use_scaling, p, info, warning, workspace, workspace.dbl);
+}
+
+double stfnum::lmFit( const std::vector<float>& data, double dt,
+                   const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                   bool use_scaling,
+                   Vector_double& p, std::string& info, int& warning )
+{
+    FitWorkspace workspace(fitFunc.pInfo.size(), data.size(), true);
+    return lmFit(data, dt, fitFunc, opts, use_scaling, p, info, warning, workspace);
+}
+
+double stfnum::lmFit( const std::vector<float>& data, double dt,
+                   const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                   bool use_scaling,
+                   Vector_double& p, std::string& info, int& warning,
+                   FitWorkspace& workspace )
+{
+    return FitWorkspace::Fit(data.empty() ? NULL : &data[0], data.size(), dt, fitFunc, opts,
+                             use_scaling, p, info, warning, workspace, workspace.sngl);
+}
+
+template <typename T>
+double stfnum::FitWorkspace::Fit( const T* data, std::size_t n_data, double dt,
+                                  const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                                  bool use_scaling,
+                                  Vector_double& p, std::string& info, int& warning,
+                                  FitWorkspace& workspace, LevmarBuffers<T>& buf )
+{
+    STF_PROFILE_SCOPE("lmFit");
     // Basic range checking:
     if (fitFunc.pInfo.size()!=p.size()) {
         std::string msg("Error in stfnum::lmFit()\n"
@@ -175,20 +433,24 @@ double stfnum::lmFit( const Vector_double& data, double dt,
         throw std::runtime_error(msg);
     }
 
+    workspace.Reserve(fitFunc.pInfo.size(), n_data, sizeof(T) < sizeof(double));
+
     bool constrained = false;
-    std::vector< double > constrains_lm_lb( fitFunc.pInfo.size() );
-    std::vector< double > constrains_lm_ub( fitFunc.pInfo.size() );
+    std::vector<T>& constrains_lm_lb = buf.lb;
+    std::vector<T>& constrains_lm_ub = buf.ub;
+    constrains_lm_lb.resize( fitFunc.pInfo.size() );
+    constrains_lm_ub.resize( fitFunc.pInfo.size() );
 
     bool can_scale = use_scaling;
     
     for ( unsigned n_p=0; n_p < fitFunc.pInfo.size(); ++n_p ) {
         if ( fitFunc.pInfo[n_p].constrained ) {
             constrained = true;
-            constrains_lm_lb[n_p] = fitFunc.pInfo[n_p].constr_lb;
-            constrains_lm_ub[n_p] = fitFunc.pInfo[n_p].constr_ub;
+            constrains_lm_lb[n_p] = (T)fitFunc.pInfo[n_p].constr_lb;
+            constrains_lm_ub[n_p] = (T)fitFunc.pInfo[n_p].constr_ub;
         } else {
-            constrains_lm_lb[n_p] = -DBL_MAX;
-            constrains_lm_ub[n_p] = DBL_MAX;
+            constrains_lm_lb[n_p] = -std::numeric_limits<T>::max();
+            constrains_lm_ub[n_p] = std::numeric_limits<T>::max();
         }
         if ( can_scale ) {
             if (fitFunc.pInfo[n_p].scale == stfnum::noscale) {
@@ -197,15 +459,12 @@ double stfnum::lmFit( const Vector_double& data, double dt,
         }
     }
 
-    // Store the functions at global scope:
-    saveFunc(fitFunc.func);
-    saveJac(fitFunc.jac);
-
-    double info_id[LM_INFO_SZ];
-    Vector_double data_ptr(data);
+    T info_id[LM_INFO_SZ];
+    std::vector<T>& data_ptr = buf.data;
+    data_ptr.assign(data, data+n_data);
     Vector_double xyscale(4);
     if (can_scale) {
-        xyscale = get_scale(data_ptr, dt);
+        xyscale = scaleData(data_ptr, dt);
     }
     
     // The parameters need to be separated into two parts:
@@ -220,23 +479,24 @@ double stfnum::lmFit( const Vector_double& data, double dt,
         n_fitted += fitFunc.pInfo[n_p].toFit;
     }
     // parameters that need to be fitted:
-    Vector_double p_toFit(n_fitted);
-    std::deque<bool> p_fit_bool( fitFunc.pInfo.size() );
+    std::vector<T>& p_toFit = buf.p_toFit;
+    p_toFit.resize(n_fitted);
+    std::deque<bool>& p_fit_bool = workspace.fit_p;
+    p_fit_bool.resize( fitFunc.pInfo.size() );
     // parameters that are held constant:
-    Vector_double p_const( fitFunc.pInfo.size()-n_fitted );
+    Vector_double& p_const = workspace.p_const;
+    p_const.resize( fitFunc.pInfo.size()-n_fitted );
+    workspace.p_f.resize( fitFunc.pInfo.size() );
     for ( unsigned n_p=0, n_c=0, n_f=0; n_p < fitFunc.pInfo.size(); ++n_p ) {
+        double value = p[n_p];
+        if (can_scale) {
+            value = fitFunc.pInfo[n_p].scale(value, xyscale[0],
+                                             xyscale[1], xyscale[2], xyscale[3]);
+        }
         if (fitFunc.pInfo[n_p].toFit) {
-            p_toFit[n_f++] = p[n_p];
-            if (can_scale) {
-                p_toFit[n_f-1] = fitFunc.pInfo[n_p].scale(p_toFit[n_f-1], xyscale[0],
-                                                          xyscale[1], xyscale[2], xyscale[3]);
-            }
+            p_toFit[n_f++] = (T)value;
         } else {
-            p_const[n_c++] = p[n_p];
-            if (can_scale) {
-                p_const[n_c-1] = fitFunc.pInfo[n_p].scale(p_const[n_c-1], xyscale[0],
-                                                          xyscale[1], xyscale[2], xyscale[3]);
-            }
+            p_const[n_c++] = value;
         }
         p_fit_bool[n_p] = fitFunc.pInfo[n_p].toFit;
     }
@@ -245,18 +505,41 @@ double stfnum::lmFit( const Vector_double& data, double dt,
     if (can_scale)
         dt_finfo = 1.0/data_ptr.size();
 
-    fitInfo fInfo( p_fit_bool, p_const, dt_finfo );
+    // x-values for the batch callbacks:
+    Vector_double& x_f = workspace.x;
+    if (!fitFunc.batchFunc.empty() || !fitFunc.batchJac.empty()) {
+        x_f.resize(data_ptr.size());
+        for (std::size_t n_x=0; n_x < x_f.size(); ++n_x) {
+            x_f[n_x] = (double)n_x*dt_finfo;
+        }
+    }
+    if (fitFunc.hasJac && !fitFunc.batchJac.empty() && n_fitted < (int)fitFunc.pInfo.size()) {
+        workspace.jac.resize(data_ptr.size()*fitFunc.pInfo.size());
+    }
+    // single precision callbacks evaluate the function or the jacobian
+    // in double precision first:
+    if (sizeof(T) < sizeof(double)) {
+        workspace.hx.resize(data_ptr.size()*(fitFunc.hasJac ? std::max(n_fitted, 1) : 1));
+    }
+
+    fitInfo fInfo( p_fit_bool, p_const, workspace.p_f, dt_finfo, x_f, workspace.jac,
+                   workspace.hx, fitFunc );
 
     // make l-value of opts:
-    Vector_double opts_l(5);
-    for (std::size_t n=0; n < 4; ++n) opts_l[n] = opts[n];
-    opts_l[4] = -1e-6;
+    T opts_l[5];
+    for (std::size_t n=0; n < 4; ++n) opts_l[n] = (T)opts[n];
+    opts_l[1] = (T)std::max(opts[1], levmar<T>::min_threshold());
+    opts_l[2] = (T)std::max(opts[2], levmar<T>::min_threshold());
+    opts_l[4] = (T)-1e-6;
+    T* lb = constrained ? &constrains_lm_lb[0] : NULL;
+    T* ub = constrained ? &constrains_lm_ub[0] : NULL;
     int it = 0;
     if (p_toFit.size()!=0 && data_ptr.size()!=0) {
-        double old_info_id[LM_INFO_SZ];
+        T old_info_id[LM_INFO_SZ];
 
         // initialize with initial parameter guess:
-        Vector_double old_p_toFit(p_toFit);
+        std::vector<T>& old_p_toFit = buf.old_p;
+        old_p_toFit = p_toFit;
 
 #ifdef _DEBUG
         std::ostringstream optsMsg;
@@ -286,33 +569,22 @@ double stfnum::lmFit( const Vector_double& data, double dt,
 #endif
 
             if ( !fitFunc.hasJac ) {
-                if ( !constrained ) {
-                    dlevmar_dif( c_func_lour, &p_toFit[0], &data_ptr[0], n_fitted, 
-                            (int)data.size(), (int)opts[4], &opts_l[0], info_id,
-                            NULL, NULL, &fInfo );
-                } else {
-                    dlevmar_bc_dif( c_func_lour, &p_toFit[0], &data_ptr[0], n_fitted, 
-                            (int)data.size(), &constrains_lm_lb[0], &constrains_lm_ub[0], NULL,
-                            (int)opts[4], &opts_l[0], info_id, NULL, NULL, &fInfo );
-                }
+                levmar<T>::dif( &p_toFit[0], &data_ptr[0], n_fitted, (int)n_data, lb, ub,
+                                (int)opts[4], &opts_l[0], info_id, &buf.work[0], &fInfo );
             } else {
-                if ( !constrained ) {
-                    dlevmar_der( c_func_lour, c_jac_lour, &p_toFit[0], &data_ptr[0], 
-                            n_fitted, (int)data.size(), (int)opts[4], &opts_l[0], info_id,
-                            NULL, NULL, &fInfo );                
-                } else {
-                    dlevmar_bc_der( c_func_lour,  c_jac_lour, &p_toFit[0], 
-                            &data_ptr[0], n_fitted, (int)data.size(), &constrains_lm_lb[0], 
-                            &constrains_lm_ub[0], NULL, (int)opts[4], &opts_l[0], info_id,
-                            NULL, NULL, &fInfo );
-                }
+                levmar<T>::der( &p_toFit[0], &data_ptr[0], n_fitted, (int)n_data, lb, ub,
+                                (int)opts[4], &opts_l[0], info_id, &buf.work[0], &fInfo );
             }
             it++;
+            STF_PROFILE_COUNT("lmFit/passes", 1);
+            STF_PROFILE_COUNT("lmFit/iterations", info_id[5]);
+            STF_PROFILE_COUNT("lmFit/function evaluations", info_id[7]);
+            STF_PROFILE_COUNT("lmFit/Jacobian evaluations", info_id[8]);
             if ( info_id[1] != info_id[1] ) {
                 // restore previous parameters if new chisqr is NaN:
                 p_toFit = old_p_toFit;
             } else {
-                double dchisqr = (info_id[0] - info_id[1]) / info_id[1]; // (old chisqr - new chisqr) / new_chisqr
+                double dchisqr = ((double)info_id[0] - info_id[1]) / info_id[1]; // (old chisqr - new chisqr) / new_chisqr
             
                 if ( dchisqr < 0 ) {
                     // restore previous results and exit if new chisqr is larger:
@@ -332,7 +604,7 @@ double stfnum::lmFit( const Vector_double& data, double dt,
                 // Exit if maximal number of iterations is reached
                 break;
             // decrease initial step size for next iteration:
-            opts_l[0] *= 1e-4;
+            opts_l[0] *= (T)1e-4;
         }
     } else {
         std::runtime_error e("Array of size zero in lmFit");
@@ -403,6 +675,1181 @@ double stfnum::lmFit( const Vector_double& data, double dt,
     return info_id[1];
 }
 
+namespace {
+
+// Fits the window of a single section in stfnum::batchFit(), in the
+// precision of the buffer x; returns false if the fit failed.
+template <typename T>
+bool fitWindow(const Section& sec, double dt, const stfnum::storedFunc& fitFunc,
+               std::size_t fitBeg, std::size_t fitEnd,
+               const Vector_double& opts, bool use_scaling,
+               std::vector<T>& x, stfnum::FitWorkspace& workspace,
+               Vector_double& params, double& chisqr, int& warning)
+{
+    if (fitEnd > sec.size()) {
+        return false;
+    }
+    std::string info;
+    try {
+        if (sec.IsMapped()) {
+            sec.CopyRange(fitBeg, fitEnd, &x[0]);
+        } else {
+            std::copy(sec.get().begin()+fitBeg, sec.get().begin()+fitEnd, x.begin());
+        }
+        chisqr = stfnum::lmFit(x, dt, fitFunc, opts, use_scaling,
+                               params, info, warning, workspace);
+    }
+    catch (const std::exception&) {
+        // Exceptions mustn't leave a parallel region;
+        // failed fits will show up as empty rows.
+        return false;
+    }
+    return true;
+}
+
+// Element-wise median of parameter vectors:
+void medianParams(const std::deque<Vector_double>& history, Vector_double& params) {
+    Vector_double values(history.size());
+    for (std::size_t n_p=0; n_p < params.size(); ++n_p) {
+        for (std::size_t n_h=0; n_h < history.size(); ++n_h) {
+            values[n_h] = history[n_h][n_p];
+        }
+        std::nth_element(values.begin(), values.begin()+values.size()/2, values.end());
+        params[n_p] = values[values.size()/2];
+    }
+}
+
+}
+
+namespace {
+
+// Park-Miller minimal standard generator; its sequence doesn't depend on
+// the standard library, so that equal seeds give equal starts everywhere:
+class MinStdRand {
+public:
+    MinStdRand(unsigned int seed) : state(seed % 2147483647u) {
+        if (state == 0) state = 1;
+    }
+    // uniform in [0, 1):
+    double operator()() {
+        state = (unsigned int)(((unsigned long long)state * 48271u) % 2147483647u);
+        return (state - 1) / 2147483646.0;
+    }
+    // uniform in [0, n):
+    std::size_t operator()(std::size_t n) {
+        return std::min((std::size_t)((*this)() * n), n-1);
+    }
+private:
+    unsigned int state;
+};
+
+}
+
+stfnum::MultiStartResult stfnum::multiStartFit(const Vector_double& data, double dt,
+                                               const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                                               bool use_scaling, const Vector_double& initP,
+                                               std::size_t n_starts, double range,
+                                               unsigned int seed, int n_threads)
+{
+    std::size_t n_pars = fitFunc.pInfo.size();
+    if (initP.size() != n_pars) {
+        throw std::runtime_error("Error in stfnum::multiStartFit()\n"
+                                 "function parameters and initial parameters have different sizes");
+    }
+    if (n_starts == 0) {
+        n_starts = 1;
+    }
+
+    MultiStartResult result;
+    result.starts.assign(n_starts, initP);
+    result.results.resize(n_starts);
+    result.chisqrs.assign(n_starts, NAN);
+
+    // Latin hypercube: every parameter takes each of n_starts-1 strata
+    // of its interval exactly once, in a random order:
+    MinStdRand rng(seed);
+    std::size_t n_lhs = n_starts-1;
+    std::vector<std::size_t> strata(n_lhs);
+    for (std::size_t n_p=0; n_p < n_pars && n_lhs > 0; ++n_p) {
+        const stfnum::parInfo& info = fitFunc.pInfo[n_p];
+        if (!info.toFit) {
+            continue;
+        }
+        double width = initP[n_p] != 0 ? range*fabs(initP[n_p]) : range;
+        double lo = initP[n_p] - width, hi = initP[n_p] + width;
+        if (info.constrained) {
+            if (info.constr_lb > -DBL_MAX && info.constr_ub < DBL_MAX) {
+                lo = info.constr_lb;
+                hi = info.constr_ub;
+            } else {
+                lo = std::max(lo, info.constr_lb);
+                hi = std::min(hi, info.constr_ub);
+            }
+        }
+        for (std::size_t n_k=0; n_k < n_lhs; ++n_k) {
+            strata[n_k] = n_k;
+        }
+        for (std::size_t n_k=n_lhs; n_k > 1; --n_k) {
+            std::swap(strata[n_k-1], strata[rng(n_k)]);
+        }
+        for (std::size_t n_k=0; n_k < n_lhs; ++n_k) {
+            result.starts[n_k+1][n_p] = lo + (strata[n_k] + rng()) / n_lhs * (hi-lo);
+        }
+    }
+
+    std::vector<int> warnings(n_starts, 0);
+    std::vector<std::string> infos(n_starts), errors(n_starts);
+    int n_fits = (int)n_starts;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_fits);
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+    FitWorkspace workspace(n_pars, data.size());
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int n_f=0; n_f < n_fits; ++n_f) {
+        Vector_double params(result.starts[n_f]);
+        try {
+            result.chisqrs[n_f] = lmFit(data, dt, fitFunc, opts, use_scaling, params,
+                                        infos[n_f], warnings[n_f], workspace);
+            result.results[n_f] = params;
+        }
+        catch (const std::exception& e) {
+            // Exceptions mustn't leave a parallel region:
+            errors[n_f] = e.what();
+        }
+    }
+    }
+
+    // best start and spread of the successful starts:
+    int best = -1;
+    std::size_t n_ok = 0;
+    Vector_double mean(n_pars, 0.0), m2(n_pars, 0.0);
+    for (int n_f=0; n_f < n_fits; ++n_f) {
+        double chisqr = result.chisqrs[n_f];
+        if (chisqr != chisqr || result.results[n_f].empty()) {
+            continue;
+        }
+        if (best < 0 || chisqr < result.chisqrs[best]) {
+            best = n_f;
+        }
+        ++n_ok;
+        for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+            double delta = result.results[n_f][n_p] - mean[n_p];
+            mean[n_p] += delta / n_ok;
+            m2[n_p] += delta * (result.results[n_f][n_p] - mean[n_p]);
+        }
+    }
+    if (best < 0) {
+        std::string msg("Error in stfnum::multiStartFit()\nNone of the fits succeeded");
+        for (int n_f=0; n_f < n_fits; ++n_f) {
+            if (!errors[n_f].empty()) {
+                msg += ":\n" + errors[n_f];
+                break;
+            }
+        }
+        throw std::runtime_error(msg);
+    }
+    result.spread.resize(n_pars);
+    for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+        result.spread[n_p] = n_ok > 1 ? sqrt(m2[n_p] / (n_ok-1)) : 0.0;
+    }
+    result.best = best;
+    result.p = result.results[best];
+    result.chisqr = result.chisqrs[best];
+    result.warning = warnings[best];
+    result.info = infos[best];
+    return result;
+}
+
+namespace {
+
+// Inverse of the standard normal distribution function; Acklam's rational
+// approximation, with a relative error below 1.2e-9:
+double normalQuantile(double p) {
+    static const double a[6] = { -3.969683028665376e+01, 2.209460984245205e+02,
+                                 -2.759285104469687e+02, 1.383577518672690e+02,
+                                 -3.066479806614716e+01, 2.506628277459239e+00 };
+    static const double b[5] = { -5.447609879822406e+01, 1.615858368580409e+02,
+                                 -1.556989798598866e+02, 6.680131188771972e+01,
+                                 -1.328068155288572e+01 };
+    static const double c[6] = { -7.784894002430293e-03, -3.223964580411365e-01,
+                                 -2.400758277161838e+00, -2.549732539343734e+00,
+                                 4.374664141464968e+00, 2.938163982698783e+00 };
+    static const double d[4] = { 7.784695709041462e-03, 3.224671290700398e-01,
+                                 2.445134137142996e+00, 3.754408661907416e+00 };
+    if (p < 0.02425) {
+        double q = sqrt(-2.0*log(p));
+        return (((((c[0]*q+c[1])*q+c[2])*q+c[3])*q+c[4])*q+c[5]) /
+            ((((d[0]*q+d[1])*q+d[2])*q+d[3])*q+1.0);
+    }
+    if (p > 1.0-0.02425) {
+        return -normalQuantile(1.0-p);
+    }
+    double q = p-0.5, r = q*q;
+    return (((((a[0]*r+a[1])*r+a[2])*r+a[3])*r+a[4])*r+a[5])*q /
+        (((((b[0]*r+b[1])*r+b[2])*r+b[3])*r+b[4])*r+1.0);
+}
+
+// Linearly interpolated quantile of sorted values:
+double sortedQuantile(const Vector_double& sorted, double q) {
+    double pos = q * (sorted.size()-1);
+    std::size_t lo = (std::size_t)pos;
+    if (lo+1 >= sorted.size()) {
+        return sorted.back();
+    }
+    return sorted[lo] + (pos-lo) * (sorted[lo+1]-sorted[lo]);
+}
+
+}
+
+stfnum::BootstrapResult stfnum::bootstrapFit(const Vector_double& data, double dt,
+                                             const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                                             bool use_scaling, const Vector_double& bestP,
+                                             fit_resampling method, std::size_t n_resamples,
+                                             double level, std::size_t block,
+                                             unsigned int seed, int n_threads)
+{
+    STF_PROFILE_SCOPE("fit/bootstrap");
+    std::size_t n_pars = fitFunc.pInfo.size();
+    if (bestP.size() != n_pars) {
+        throw std::runtime_error("Error in stfnum::bootstrapFit()\n"
+                                 "function parameters and best-fit parameters have different sizes");
+    }
+    std::size_t n_data = data.size();
+    if (method == resample_jackknife) {
+        n_resamples = std::min(n_resamples, n_data);
+    }
+    if (!(level > 0 && level < 1) || n_resamples < 2) {
+        throw std::out_of_range("Invalid confidence level or number of resamples in stfnum::bootstrapFit()");
+    }
+    block = std::max(std::min(block, n_data), (std::size_t)1);
+
+    // the best-fit function and its residuals, centred for the bootstrap:
+    Vector_double fitted(n_data), residuals(n_data);
+    double mean = 0.0;
+    for (std::size_t n = 0; n < n_data; ++n) {
+        fitted[n] = fitFunc.func((double)n*dt, bestP);
+        residuals[n] = data[n] - fitted[n];
+        mean += residuals[n];
+    }
+    mean /= n_data;
+    for (std::size_t n = 0; n < n_data; ++n) {
+        residuals[n] -= mean;
+    }
+
+    BootstrapResult result;
+    result.p = bestP;
+    result.level = level;
+    result.samples.resize(n_resamples);
+    std::vector<std::string> errors(n_resamples);
+    int n_fits = (int)n_resamples;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_fits);
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+    FitWorkspace workspace(n_pars, n_data);
+    Vector_double x(n_data), params(n_pars);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int n_f=0; n_f < n_fits; ++n_f) {
+        if (method == resample_bootstrap) {
+            // every resample has its own generator, so that the
+            // resamples don't depend on the number of threads:
+            MinStdRand rng((unsigned int)stfio::hashBytes(&n_f, sizeof(int), seed));
+            for (std::size_t n = 0; n < n_data; n += block) {
+                std::size_t first = rng(n_data-block+1);
+                std::size_t len = std::min(block, n_data-n);
+                for (std::size_t k = 0; k < len; ++k) {
+                    x[n+k] = fitted[n+k] + residuals[first+k];
+                }
+            }
+        } else {
+            std::size_t first = (std::size_t)n_f*n_data/n_resamples;
+            std::size_t last = ((std::size_t)n_f+1)*n_data/n_resamples;
+            std::copy(data.begin(), data.end(), x.begin());
+            std::copy(fitted.begin()+first, fitted.begin()+last, x.begin()+first);
+        }
+        // warm start from the best fit:
+        params = bestP;
+        std::string info;
+        int warning = 0;
+        try {
+            double chisqr = lmFit(x, dt, fitFunc, opts, use_scaling, params, info, warning, workspace);
+            if (chisqr == chisqr) {
+                result.samples[n_f] = params;
+            }
+        }
+        catch (const std::exception& e) {
+            // Exceptions mustn't leave a parallel region:
+            errors[n_f] = e.what();
+        }
+    }
+    }
+
+    std::size_t n_ok = 0;
+    for (int n_f=0; n_f < n_fits; ++n_f) {
+        if (!result.samples[n_f].empty()) {
+            ++n_ok;
+        }
+    }
+    if (n_ok < 2) {
+        std::string msg("Error in stfnum::bootstrapFit()\nFewer than two refits succeeded");
+        for (int n_f=0; n_f < n_fits; ++n_f) {
+            if (!errors[n_f].empty()) {
+                msg += ":\n" + errors[n_f];
+                break;
+            }
+        }
+        throw std::runtime_error(msg);
+    }
+    result.n_failed = n_resamples - n_ok;
+    result.lower.resize(n_pars);
+    result.upper.resize(n_pars);
+    result.se.resize(n_pars);
+    Vector_double values(n_ok);
+    for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+        std::size_t n_v = 0;
+        double sum = 0.0;
+        for (int n_f=0; n_f < n_fits; ++n_f) {
+            if (!result.samples[n_f].empty()) {
+                values[n_v] = result.samples[n_f][n_p];
+                sum += values[n_v++];
+            }
+        }
+        double avg = sum / n_ok, ss = 0.0;
+        for (std::size_t n_k = 0; n_k < n_ok; ++n_k) {
+            ss += (values[n_k]-avg) * (values[n_k]-avg);
+        }
+        if (method == resample_bootstrap) {
+            std::sort(values.begin(), values.end());
+            result.se[n_p] = sqrt(ss / (n_ok-1));
+            result.lower[n_p] = sortedQuantile(values, 0.5*(1.0-level));
+            result.upper[n_p] = sortedQuantile(values, 0.5*(1.0+level));
+        } else {
+            // The deviations of the refits are (g-1)/g times those of
+            // deleted blocks to first order, which cancels the usual
+            // jackknife factor (g-1)/g of the variance once:
+            result.se[n_p] = sqrt(ss * n_ok / (n_ok-1));
+            double z = normalQuantile(0.5*(1.0+level));
+            result.lower[n_p] = bestP[n_p] - z*result.se[n_p];
+            result.upper[n_p] = bestP[n_p] + z*result.se[n_p];
+        }
+    }
+    return result;
+}
+
+stfnum::Table stfnum::confidenceTable(const Table& output, const BootstrapResult& ci) {
+    std::size_t n_rows = output.nRows(), n_cols = output.nCols();
+    Table table(n_rows, n_cols+3);
+    for (std::size_t n_r=0; n_r < n_rows; ++n_r) {
+        table.SetRowLabel(n_r, output.GetRowLabel(n_r));
+        for (std::size_t n_c=0; n_c < n_cols; ++n_c) {
+            table.at(n_r, n_c) = output.at(n_r, n_c);
+            table.SetEmpty(n_r, n_c, output.IsEmpty(n_r, n_c));
+        }
+    }
+    for (std::size_t n_c=0; n_c < n_cols; ++n_c) {
+        table.SetColLabel(n_c, output.GetColLabel(n_c));
+    }
+    std::ostringstream percent;
+    percent << ci.level*100.0 << "%";
+    table.SetColLabel(n_cols, "SE");
+    table.SetColLabel(n_cols+1, "Lower " + percent.str());
+    table.SetColLabel(n_cols+2, "Upper " + percent.str());
+    for (std::size_t n_r=0; n_r < n_rows; ++n_r) {
+        bool param = n_r < ci.se.size();
+        table.at(n_r, n_cols) = param ? ci.se[n_r] : 0;
+        table.at(n_r, n_cols+1) = param ? ci.lower[n_r] : 0;
+        table.at(n_r, n_cols+2) = param ? ci.upper[n_r] : 0;
+        for (std::size_t n_c=n_cols; n_c < n_cols+3; ++n_c) {
+            table.SetEmpty(n_r, n_c, !param);
+        }
+    }
+    return table;
+}
+
+unsigned long long stfnum::fitCacheKey(const Section& sec, std::size_t fitBeg, std::size_t fitEnd,
+                                       double dt, const stfnum::storedFunc& fitFunc,
+                                       const Vector_double& opts, bool use_scaling,
+                                       const Vector_double& initP, bool single_precision)
+{
+    if (fitEnd > sec.size() || fitBeg > fitEnd) {
+        throw std::out_of_range("Fit window out of range in stfnum::fitCacheKey()");
+    }
+    unsigned long long key = stfio::hashSeed;
+    // the samples of the window, decoded block-wise from mapped sections:
+    if (sec.IsMapped()) {
+        Vector_double buffer(std::min(fitEnd-fitBeg, (std::size_t)4096));
+        for (std::size_t begin = fitBeg; begin < fitEnd; begin += buffer.size()) {
+            std::size_t end = std::min(begin+buffer.size(), fitEnd);
+            sec.CopyRange(begin, end, &buffer[0]);
+            key = stfio::hashBytes(&buffer[0], (end-begin)*sizeof(double), key);
+        }
+    } else if (fitEnd > fitBeg) {
+        key = stfio::hashBytes(&sec.get()[fitBeg], (fitEnd-fitBeg)*sizeof(double), key);
+    }
+    unsigned long long window[2] = { fitBeg, fitEnd };
+    key = stfio::hashBytes(window, sizeof(window), key);
+    key = stfio::hashBytes(&dt, sizeof(double), key);
+    // the function and its parameter settings:
+    key = stfio::hashBytes(fitFunc.name.c_str(), fitFunc.name.size(), key);
+    for (std::size_t n_p=0; n_p < fitFunc.pInfo.size(); ++n_p) {
+        const stfnum::parInfo& info = fitFunc.pInfo[n_p];
+        char flags[2] = { (char)info.toFit, (char)info.constrained };
+        key = stfio::hashBytes(flags, sizeof(flags), key);
+        if (info.constrained) {
+            key = stfio::hashBytes(&info.constr_lb, sizeof(double), key);
+            key = stfio::hashBytes(&info.constr_ub, sizeof(double), key);
+        }
+    }
+    // the fit settings:
+    if (!opts.empty()) {
+        key = stfio::hashBytes(&opts[0], opts.size()*sizeof(double), key);
+    }
+    if (!initP.empty()) {
+        key = stfio::hashBytes(&initP[0], initP.size()*sizeof(double), key);
+    }
+    char settings[2] = { (char)use_scaling, (char)single_precision };
+    return stfio::hashBytes(settings, sizeof(settings), key);
+}
+
+stfnum::Table stfnum::batchFit(const Recording& rec, std::size_t channel,
+                               const std::vector<std::size_t>& sections,
+                               const stfnum::storedFunc& fitFunc,
+                               std::size_t fitBeg, std::size_t fitEnd,
+                               const Vector_double& opts, bool use_scaling,
+                               const Vector_double& initP,
+                               fit_start start, std::size_t n_median,
+                               bool single_precision, std::vector<stfio::FitCache>* caches)
+{
+    if (channel >= rec.size()) {
+        throw std::out_of_range("Channel number out of range in stfnum::batchFit()");
+    }
+    if (initP.size() != fitFunc.pInfo.size()) {
+        throw std::runtime_error("Error in stfnum::batchFit()\n"
+                                 "function parameters and initial parameters have different sizes");
+    }
+    if (fitEnd <= fitBeg+1) {
+        throw std::out_of_range("Check fit limits in stfnum::batchFit()");
+    }
+    if (caches != NULL && caches->size() != rec[channel].size()) {
+        throw std::runtime_error("Error in stfnum::batchFit()\n"
+                                 "number of fit caches and sections differ");
+    }
+
+    std::size_t n_pars = fitFunc.pInfo.size();
+    Table table(sections.size(), n_pars+2);
+    for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+        table.SetColLabel(n_p, fitFunc.pInfo[n_p].desc);
+    }
+    table.SetColLabel(n_pars, "SSE");
+    table.SetColLabel(n_pars+1, "Warning");
+
+    const Channel& ch = rec[channel];
+    for (std::size_t n_s=0; n_s < sections.size(); ++n_s) {
+        std::ostringstream label;
+        if (sections[n_s] < ch.size() && !ch[sections[n_s]].GetSectionDescription().empty()) {
+            label << ch[sections[n_s]].GetSectionDescription();
+        } else {
+            label << "Section #" << sections[n_s]+1;
+        }
+        table.SetRowLabel(n_s, label.str());
+    }
+
+    if (start == start_median && n_median == 0) {
+        n_median = 1;
+    }
+    bool warm = (start != start_initial);
+    int n_sections = (int)sections.size();
+
+    // Every iteration only writes to its own row of the table,
+    // so the rows can be filled concurrently. All fit windows have
+    // the same length, so that each thread can re-use its buffers:
+#ifdef _OPENMP
+#pragma omp parallel num_threads(stfio::threadCount(0, n_sections))
+#endif
+    {
+    FitWorkspace workspace(n_pars, fitEnd-fitBeg, single_precision);
+    // the copy of the window in the precision of the fits:
+    Vector_double x(single_precision ? 0 : fitEnd-fitBeg);
+    std::vector<float> x_s(single_precision ? fitEnd-fitBeg : 0);
+    Vector_double params(n_pars), retry(n_pars);
+    // best-fit parameters of the previous sections of this thread:
+    std::deque<Vector_double> history;
+#ifdef _OPENMP
+    // Warm starts need a contiguous block of sections in each thread:
+    int chunk = 1;
+    if (warm) {
+        chunk = std::max((n_sections + omp_get_num_threads() - 1) / omp_get_num_threads(), 1);
+    }
+#pragma omp for schedule(dynamic, chunk)
+#endif
+    for (int n_s=0; n_s < n_sections; ++n_s) {
+        bool ok = false;
+        double chisqr = 0;
+        int warning = 0;
+        if (sections[n_s] < ch.size()) {
+            const Section& sec = ch[sections[n_s]];
+            params = initP;
+            bool seeded = warm && !history.empty();
+            unsigned long long key = 0;
+            bool cached = false;
+            if (caches != NULL && fitEnd <= sec.size()) {
+                key = fitCacheKey(sec, fitBeg, fitEnd, rec.GetXScale(), fitFunc, opts,
+                                  use_scaling, initP, single_precision);
+                if (warm) {
+                    key = stfio::hashBytes(&start, sizeof(start), key);
+                }
+                // the same section may occur several times in sections:
+#ifdef _OPENMP
+#pragma omp critical(stfnum_fit_cache)
+#endif
+                {
+                    const stfio::FitCacheEntry* entry = (*caches)[sections[n_s]].Find(key);
+                    if (entry != NULL && entry->params.size() == n_pars) {
+                        cached = true;
+                        ok = true;
+                        params = entry->params;
+                        chisqr = entry->chisqr;
+                        warning = entry->warning;
+                    }
+                }
+            }
+            if (!cached) {
+                if (seeded) {
+                    if (start == start_previous) {
+                        params = history.back();
+                    } else {
+                        medianParams(history, params);
+                    }
+                }
+                ok = single_precision ?
+                    fitWindow(sec, rec.GetXScale(), fitFunc, fitBeg, fitEnd, opts, use_scaling,
+                              x_s, workspace, params, chisqr, warning) :
+                    fitWindow(sec, rec.GetXScale(), fitFunc, fitBeg, fitEnd, opts, use_scaling,
+                              x, workspace, params, chisqr, warning);
+                if (seeded && (!ok || warning != 0 || chisqr != chisqr)) {
+                    // fall back to the initial parameters if the warm start diverged:
+                    retry = initP;
+                    double chisqr_retry = 0;
+                    int warning_retry = 0;
+                    bool ok_retry = single_precision ?
+                        fitWindow(sec, rec.GetXScale(), fitFunc, fitBeg, fitEnd, opts, use_scaling,
+                                  x_s, workspace, retry, chisqr_retry, warning_retry) :
+                        fitWindow(sec, rec.GetXScale(), fitFunc, fitBeg, fitEnd, opts, use_scaling,
+                                  x, workspace, retry, chisqr_retry, warning_retry);
+                    if (ok_retry && (!ok || chisqr != chisqr || chisqr_retry <= chisqr))
+                    {
+                        ok = true;
+                        params = retry;
+                        chisqr = chisqr_retry;
+                        warning = warning_retry;
+                    }
+                }
+                if (ok && caches != NULL) {
+                    stfio::FitCacheEntry entry;
+                    entry.key = key;
+                    entry.funcName = fitFunc.name;
+                    entry.fitBeg = fitBeg;
+                    entry.fitEnd = fitEnd;
+                    entry.params = params;
+                    entry.chisqr = chisqr;
+                    entry.warning = warning;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_fit_cache)
+#endif
+                    (*caches)[sections[n_s]].Insert(entry);
+                }
+            }
+            if (warm && ok && warning == 0 && chisqr == chisqr) {
+                history.push_back(params);
+                if (history.size() > (start == start_median ? n_median : 1)) {
+                    history.pop_front();
+                }
+            }
+        }
+        for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+            table.at(n_s, n_p) = ok ? params[n_p] : 0;
+            table.SetEmpty(n_s, n_p, !ok);
+        }
+        table.at(n_s, n_pars) = ok ? chisqr : 0;
+        table.SetEmpty(n_s, n_pars, !ok);
+        table.at(n_s, n_pars+1) = ok ? warning : 0;
+        table.SetEmpty(n_s, n_pars+1, !ok);
+    }
+    }
+
+    return table;
+}
+
+stfnum::Table stfnum::fitEvents(const Section& sec, double dt,
+                                const std::vector<std::size_t>& onsets,
+                                std::size_t pre, std::size_t length,
+                                const stfnum::storedFunc& fitFunc,
+                                const Vector_double& opts, bool use_scaling,
+                                const Vector_double& initP)
+{
+    if (initP.size() != fitFunc.pInfo.size()) {
+        throw std::runtime_error("Error in stfnum::fitEvents()\n"
+                                 "function parameters and initial parameters have different sizes");
+    }
+    if (length < 2) {
+        throw std::out_of_range("Check fit window in stfnum::fitEvents()");
+    }
+
+    std::size_t n_pars = fitFunc.pInfo.size();
+    Table table(onsets.size(), n_pars+3);
+    table.SetColLabel(0, "Onset");
+    for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+        table.SetColLabel(n_p+1, fitFunc.pInfo[n_p].desc);
+    }
+    table.SetColLabel(n_pars+1, "SSE");
+    table.SetColLabel(n_pars+2, "Warning");
+    for (std::size_t n_e=0; n_e < onsets.size(); ++n_e) {
+        std::ostringstream label;
+        label << "Event #" << n_e+1;
+        table.SetRowLabel(n_e, label.str());
+    }
+
+    int n_events = (int)onsets.size();
+    bool mapped = sec.IsMapped();
+    std::vector<char> fitted(onsets.size(), 0);
+
+    // Every iteration only writes to its own row of the table; empty
+    // cells are marked afterwards because they share bits of a bitmap:
+#ifdef _OPENMP
+#pragma omp parallel num_threads(stfio::threadCount(0, n_events))
+#endif
+    {
+    FitWorkspace workspace(n_pars, length);
+    Vector_double x(mapped ? length : 0);
+    Vector_double params(n_pars);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int n_e=0; n_e < n_events; ++n_e) {
+        bool ok = false;
+        double chisqr = 0;
+        int warning = 0;
+        std::size_t onset = onsets[n_e];
+        if (onset >= pre && onset-pre+length <= sec.size()) {
+            std::size_t fitBeg = onset-pre;
+            params = initP;
+            std::string info;
+            try {
+                const double* window = NULL;
+                if (mapped) {
+                    sec.CopyRange(fitBeg, fitBeg+length, &x[0]);
+                    window = &x[0];
+                } else {
+                    window = &sec.get()[fitBeg];
+                }
+                chisqr = lmFit(window, length, dt, fitFunc, opts, use_scaling,
+                               params, info, warning, workspace);
+                ok = true;
+            }
+            catch (const std::exception&) {
+                // Exceptions mustn't leave a parallel region;
+                // failed fits will show up as empty rows.
+            }
+        }
+        fitted[n_e] = ok;
+        table.at(n_e, 0) = onset*dt;
+        for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+            table.at(n_e, n_p+1) = ok ? params[n_p] : 0;
+        }
+        table.at(n_e, n_pars+1) = ok ? chisqr : 0;
+        table.at(n_e, n_pars+2) = ok ? warning : 0;
+    }
+    }
+
+    for (std::size_t n_e=0; n_e < onsets.size(); ++n_e) {
+        for (std::size_t n_c=1; n_c < n_pars+3; ++n_c) {
+            table.SetEmpty(n_e, n_c, !fitted[n_e]);
+        }
+    }
+    return table;
+}
+
+namespace {
+
+// Cholesky decomposition of a symmetric n x n matrix (row major) in place;
+// only the lower triangle is used. Returns false if a isn't positive definite.
+bool cholesky(double* a, std::size_t n) {
+    for (std::size_t j=0; j < n; ++j) {
+        double d = a[j*n+j];
+        for (std::size_t k=0; k < j; ++k) {
+            d -= a[j*n+k]*a[j*n+k];
+        }
+        if (!(d > 0)) {
+            return false;
+        }
+        d = sqrt(d);
+        a[j*n+j] = d;
+        for (std::size_t i=j+1; i < n; ++i) {
+            double s = a[i*n+j];
+            for (std::size_t k=0; k < j; ++k) {
+                s -= a[i*n+k]*a[j*n+k];
+            }
+            a[i*n+j] = s/d;
+        }
+    }
+    return true;
+}
+
+// Solves l l^T x = b in place, using the decomposition from cholesky():
+void cholesky_solve(const double* l, std::size_t n, double* b) {
+    for (std::size_t i=0; i < n; ++i) {
+        double s = b[i];
+        for (std::size_t k=0; k < i; ++k) {
+            s -= l[i*n+k]*b[k];
+        }
+        b[i] = s/l[i*n+i];
+    }
+    for (std::size_t i=n; i-- > 0; ) {
+        double s = b[i];
+        for (std::size_t k=i+1; k < n; ++k) {
+            s -= l[k*n+i]*b[k];
+        }
+        b[i] = s/l[i*n+i];
+    }
+}
+
+// A global fit problem: evaluates the function and its jacobian for single data sets.
+class GlobalProblem {
+public:
+    GlobalProblem(const std::vector<Vector_double>& data_, double dt,
+                  const stfnum::storedFunc& fitFunc_)
+        : data(data_), fitFunc(fitFunc_), x(), f(), jac_row()
+    {
+        std::size_t n_max = 0;
+        for (std::size_t n_s=0; n_s < data.size(); ++n_s) {
+            n_max = std::max(n_max, data[n_s].size());
+        }
+        x.resize(n_max);
+        for (std::size_t n_x=0; n_x < n_max; ++n_x) {
+            x[n_x] = (double)n_x*dt;
+        }
+        f.resize(n_max);
+    }
+
+    // Residuals of data set n_s; returns the sum of squared errors:
+    double residuals(std::size_t n_s, const Vector_double& p, double* r) {
+        const Vector_double& y = data[n_s];
+        eval(y.size(), p, &f[0]);
+        double chisqr = 0;
+        for (std::size_t n_x=0; n_x < y.size(); ++n_x) {
+            r[n_x] = y[n_x] - f[n_x];
+            chisqr += r[n_x]*r[n_x];
+        }
+        return chisqr;
+    }
+
+    // Jacobian of data set n_s with respect to all parameters (row major):
+    void jacobian(std::size_t n_s, Vector_double& p, double* J) {
+        std::size_t n = data[n_s].size(), n_p = p.size();
+        if (fitFunc.hasJac && !fitFunc.batchJac.empty()) {
+            fitFunc.batchJac(&x[0], n, &p[0], n_p, J);
+        } else if (fitFunc.hasJac) {
+            for (std::size_t n_x=0; n_x < n; ++n_x) {
+                jac_row = fitFunc.jac(x[n_x], p);
+                std::copy(jac_row.begin(), jac_row.end(), J+n_x*n_p);
+            }
+        } else {
+            // forward differences:
+            eval(n, p, &f[0]);
+            Vector_double f_h(n);
+            for (std::size_t n_pp=0; n_pp < n_p; ++n_pp) {
+                double p_old = p[n_pp];
+                double h = 1e-6*std::max(fabs(p_old), 1e-3);
+                p[n_pp] += h;
+                eval(n, p, &f_h[0]);
+                p[n_pp] = p_old;
+                for (std::size_t n_x=0; n_x < n; ++n_x) {
+                    J[n_x*n_p+n_pp] = (f_h[n_x]-f[n_x])/h;
+                }
+            }
+        }
+    }
+
+private:
+    void eval(std::size_t n, const Vector_double& p, double* out) {
+        if (!fitFunc.batchFunc.empty()) {
+            fitFunc.batchFunc(&x[0], n, &p[0], p.size(), out);
+        } else {
+            for (std::size_t n_x=0; n_x < n; ++n_x) {
+                out[n_x] = fitFunc.func(x[n_x], p);
+            }
+        }
+    }
+
+    const std::vector<Vector_double>& data;
+    const stfnum::storedFunc& fitFunc;
+    Vector_double x, f, jac_row;
+};
+
+}
+
+stfnum::GlobalFitResult stfnum::globalFit(const std::vector<Vector_double>& data, double dt,
+                                          const stfnum::storedFunc& fitFunc, const std::deque<bool>& shared,
+                                          const Vector_double& opts, const std::vector<Vector_double>& initP)
+{
+    std::size_t n_sets = data.size(), n_pars = fitFunc.pInfo.size();
+    if (shared.size() != n_pars) {
+        throw std::runtime_error("Error in stfnum::globalFit()\n"
+                                 "function parameters and shared parameters have different sizes");
+    }
+    if (initP.size() != n_sets && initP.size() != 1) {
+        throw std::runtime_error("Error in stfnum::globalFit()\n"
+                                 "initial parameters are required for every data set");
+    }
+    for (std::size_t n_s=0; n_s < initP.size(); ++n_s) {
+        if (initP[n_s].size() != n_pars) {
+            throw std::runtime_error("Error in stfnum::globalFit()\n"
+                                     "function parameters and initial parameters have different sizes");
+        }
+    }
+    if (opts.size() != 6) {
+        throw std::runtime_error("Error in stfnum::globalFit()\nwrong number of options");
+    }
+    if (n_sets == 0) {
+        throw std::runtime_error("Array of size zero in globalFit");
+    }
+    for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+        if (data[n_s].empty()) {
+            throw std::runtime_error("Array of size zero in globalFit");
+        }
+    }
+
+    // shared (global) and local parameters that are fitted:
+    std::vector<std::size_t> idx_g, idx_l;
+    for (std::size_t n_p=0; n_p < n_pars; ++n_p) {
+        if (fitFunc.pInfo[n_p].toFit) {
+            if (shared[n_p]) {
+                idx_g.push_back(n_p);
+            } else {
+                idx_l.push_back(n_p);
+            }
+        }
+    }
+    std::size_t n_g = idx_g.size(), n_l = idx_l.size();
+    if (n_g + n_l == 0) {
+        throw std::runtime_error("Array of size zero in globalFit");
+    }
+
+    // p[n_s] holds all parameters of data set n_s; shared parameters are
+    // identical in all of them:
+    std::vector<Vector_double> p(n_sets), p_new(n_sets);
+    for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+        p[n_s] = initP[initP.size() == 1 ? 0 : n_s];
+        for (std::size_t n_i=0; n_i < n_g; ++n_i) {
+            p[n_s][idx_g[n_i]] = initP[0][idx_g[n_i]];
+        }
+    }
+
+    // Normal equations, with blocks
+    //     | A    B_s |
+    //     | B_s' D_s |
+    // where A couples the shared parameters and D_s the local parameters
+    // of data set n_s; gradients are g (shared) and g_s (local):
+    Vector_double A(n_g*n_g), g(n_g);
+    Vector_double B(n_sets*n_g*n_l), D(n_sets*n_l*n_l), gl(n_sets*n_l);
+    // damped copies, their solutions and the Schur complement:
+    Vector_double Dd(n_l*n_l), DinvBt(n_sets*n_l*n_g), Dinvg(n_sets*n_l);
+    Vector_double S(n_g*n_g), rhs(n_g), dg(n_g), dl(n_sets*n_l);
+    GlobalProblem problem(data, dt, fitFunc);
+    std::size_t n_max = 0;
+    for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+        n_max = std::max(n_max, data[n_s].size());
+    }
+    Vector_double r(n_max), J(n_max*n_pars);
+    Vector_double chisqrs(n_sets), chisqrs_new(n_sets);
+
+    double chisqr = 0;
+    for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+        chisqrs[n_s] = problem.residuals(n_s, p[n_s], &r[0]);
+        chisqr += chisqrs[n_s];
+    }
+
+    int max_it = (int)(opts[4]*opts[5]);
+    double mu = 0, nu = 2;
+    int it = 0, reason = 0;
+    bool update = true;
+    while (reason == 0) {
+        if (update) {
+            // set up the normal equations at the current parameters:
+            std::fill(A.begin(), A.end(), 0.0);
+            std::fill(g.begin(), g.end(), 0.0);
+            for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+                std::size_t n = data[n_s].size();
+                problem.residuals(n_s, p[n_s], &r[0]);
+                problem.jacobian(n_s, p[n_s], &J[0]);
+                double* Bs = &B[n_s*n_g*n_l];
+                double* Ds = &D[n_s*n_l*n_l];
+                double* gs = &gl[n_s*n_l];
+                std::fill(Bs, Bs+n_g*n_l, 0.0);
+                std::fill(Ds, Ds+n_l*n_l, 0.0);
+                std::fill(gs, gs+n_l, 0.0);
+                for (std::size_t n_x=0; n_x < n; ++n_x) {
+                    const double* Jx = &J[n_x*n_pars];
+                    for (std::size_t i=0; i < n_g; ++i) {
+                        double ji = Jx[idx_g[i]];
+                        g[i] += ji*r[n_x];
+                        for (std::size_t k=0; k <= i; ++k) {
+                            A[i*n_g+k] += ji*Jx[idx_g[k]];
+                        }
+                        for (std::size_t k=0; k < n_l; ++k) {
+                            Bs[i*n_l+k] += ji*Jx[idx_l[k]];
+                        }
+                    }
+                    for (std::size_t i=0; i < n_l; ++i) {
+                        double ji = Jx[idx_l[i]];
+                        gs[i] += ji*r[n_x];
+                        for (std::size_t k=0; k <= i; ++k) {
+                            Ds[i*n_l+k] += ji*Jx[idx_l[k]];
+                        }
+                    }
+                }
+            }
+            // Stop if the gradient is small:
+            double g_max = 0, diag_max = 0;
+            for (std::size_t i=0; i < n_g; ++i) {
+                g_max = std::max(g_max, fabs(g[i]));
+                diag_max = std::max(diag_max, A[i*n_g+i]);
+            }
+            for (std::size_t i=0; i < n_sets*n_l; ++i) {
+                g_max = std::max(g_max, fabs(gl[i]));
+            }
+            for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+                for (std::size_t i=0; i < n_l; ++i) {
+                    diag_max = std::max(diag_max, D[n_s*n_l*n_l+i*n_l+i]);
+                }
+            }
+            if (g_max <= opts[1]) {
+                reason = 1;
+                break;
+            }
+            if (it == 0) {
+                mu = opts[0]*diag_max;
+            }
+            update = false;
+        }
+        if (it >= max_it) {
+            reason = 3;
+            break;
+        }
+        ++it;
+
+        // Solve the damped normal equations by eliminating the local parameters:
+        bool singular = false;
+        for (std::size_t i=0; i < n_g; ++i) {
+            for (std::size_t k=0; k <= i; ++k) {
+                S[i*n_g+k] = A[i*n_g+k];
+            }
+            S[i*n_g+i] += mu;
+            rhs[i] = g[i];
+        }
+        for (std::size_t n_s=0; n_s < n_sets && !singular; ++n_s) {
+            std::copy(&D[n_s*n_l*n_l], &D[n_s*n_l*n_l]+n_l*n_l, Dd.begin());
+            for (std::size_t i=0; i < n_l; ++i) {
+                Dd[i*n_l+i] += mu;
+            }
+            if (n_l > 0 && !cholesky(&Dd[0], n_l)) {
+                singular = true;
+                break;
+            }
+            const double* Bs = &B[n_s*n_g*n_l];
+            double* Xs = n_l > 0 ? &DinvBt[n_s*n_l*n_g] : NULL;
+            double* ys = n_l > 0 ? &Dinvg[n_s*n_l] : NULL;
+            if (n_l == 0) {
+                continue;
+            }
+            // X_s = D_s^-1 B_s' (column by column), y_s = D_s^-1 g_s:
+            Vector_double col(n_l);
+            for (std::size_t j=0; j < n_g; ++j) {
+                for (std::size_t k=0; k < n_l; ++k) {
+                    col[k] = Bs[j*n_l+k];
+                }
+                cholesky_solve(&Dd[0], n_l, &col[0]);
+                for (std::size_t k=0; k < n_l; ++k) {
+                    Xs[k*n_g+j] = col[k];
+                }
+            }
+            std::copy(&gl[n_s*n_l], &gl[n_s*n_l]+n_l, ys);
+            cholesky_solve(&Dd[0], n_l, ys);
+            // S -= B_s X_s, rhs -= B_s y_s:
+            for (std::size_t i=0; i < n_g; ++i) {
+                for (std::size_t k=0; k <= i; ++k) {
+                    double s = 0;
+                    for (std::size_t m=0; m < n_l; ++m) {
+                        s += Bs[i*n_l+m]*Xs[m*n_g+k];
+                    }
+                    S[i*n_g+k] -= s;
+                }
+                double s = 0;
+                for (std::size_t m=0; m < n_l; ++m) {
+                    s += Bs[i*n_l+m]*ys[m];
+                }
+                rhs[i] -= s;
+            }
+        }
+        if (!singular && n_g > 0) {
+            if (!cholesky(&S[0], n_g)) {
+                singular = true;
+            } else {
+                dg = rhs;
+                cholesky_solve(&S[0], n_g, &dg[0]);
+            }
+        }
+        if (singular) {
+            mu *= nu;
+            nu *= 2;
+            if (nu > 1e300 || !(mu < DBL_MAX)) {
+                reason = 4;
+            }
+            continue;
+        }
+        // dl_s = y_s - X_s dg:
+        double dnorm = 0, pnorm = 0, predicted = 0;
+        for (std::size_t i=0; i < n_g; ++i) {
+            dnorm += dg[i]*dg[i];
+            pnorm += p[0][idx_g[i]]*p[0][idx_g[i]];
+            predicted += dg[i]*(mu*dg[i] + g[i]);
+        }
+        for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+            for (std::size_t k=0; k < n_l; ++k) {
+                double d = Dinvg[n_s*n_l+k];
+                for (std::size_t j=0; j < n_g; ++j) {
+                    d -= DinvBt[n_s*n_l*n_g+k*n_g+j]*dg[j];
+                }
+                dl[n_s*n_l+k] = d;
+                dnorm += d*d;
+                pnorm += p[n_s][idx_l[k]]*p[n_s][idx_l[k]];
+                predicted += d*(mu*d + gl[n_s*n_l+k]);
+            }
+        }
+        if (dnorm <= opts[2]*opts[2]*pnorm) {
+            reason = 2;
+            break;
+        }
+        // new parameters and their error:
+        double chisqr_new = 0;
+        for (std::size_t n_s=0; n_s < n_sets; ++n_s) {
+            p_new[n_s] = p[n_s];
+            for (std::size_t i=0; i < n_g; ++i) {
+                p_new[n_s][idx_g[i]] += dg[i];
+            }
+            for (std::size_t k=0; k < n_l; ++k) {
+                p_new[n_s][idx_l[k]] += dl[n_s*n_l+k];
+            }
+            chisqrs_new[n_s] = problem.residuals(n_s, p_new[n_s], &r[0]);
+            chisqr_new += chisqrs_new[n_s];
+        }
+        if (chisqr_new != chisqr_new || fabs(chisqr_new) > DBL_MAX) {
+            if (it == 1) {
+                reason = 7;
+                break;
+            }
+            chisqr_new = DBL_MAX;
+        }
+        double rho = (chisqr - chisqr_new) / predicted;
+        if (rho > 0 && predicted > 0) {
+            // accept the step:
+            p.swap(p_new);
+            chisqrs.swap(chisqrs_new);
+            chisqr = chisqr_new;
+            double t = 2*rho - 1;
+            mu *= std::max(1.0/3.0, 1 - t*t*t);
+            nu = 2;
+            update = true;
+            if (chisqr <= opts[3]) {
+                reason = 6;
+            }
+        } else {
+            mu *= nu;
+            nu *= 2;
+            if (nu > 1e300 || !(mu < DBL_MAX)) {
+                reason = 5;
+            }
+        }
+    }
+
+    GlobalFitResult result;
+    result.p = p;
+    result.chisqrs = chisqrs;
+    result.chisqr = chisqr;
+    result.iterations = it;
+    std::ostringstream str_info;
+    str_info << "Iterations: " << it;
+    str_info << "\nStopping reason:";
+    switch (reason) {
+     case 1:
+         str_info << "\nStopped by small gradient of squared error.";
+         result.warning = 0;
+         break;
+     case 2:
+         str_info << "\nStopped by small rel. parameter change.";
+         result.warning = 0;
+         break;
+     case 3:
+         str_info << "\nReached max. number of iterations.";
+         result.warning = 3;
+         break;
+     case 4:
+         str_info << "\nSingular matrix.";
+         result.warning = 4;
+         break;
+     case 5:
+         str_info << "\nNo further error reduction is possible.";
+         result.warning = 5;
+         break;
+     case 6:
+         str_info << "\nStopped by small squared error.";
+         result.warning = 0;
+         break;
+     default:
+         str_info << "\nStopped by invalid (i.e. NaN or Inf) \"func\" values.\n";
+         str_info << "This is a user error.";
+         result.warning = 7;
+    }
+    result.info = str_info.str();
+    return result;
+}
+
+stfnum::GlobalFitResult stfnum::globalFit(const Recording& rec, std::size_t channel,
+                                          const std::vector<std::size_t>& sections,
+                                          const stfnum::storedFunc& fitFunc,
+                                          std::size_t fitBeg, std::size_t fitEnd,
+                                          const std::deque<bool>& shared,
+                                          const Vector_double& opts, const std::vector<Vector_double>& initP)
+{
+    if (channel >= rec.size()) {
+        throw std::out_of_range("Channel number out of range in stfnum::globalFit()");
+    }
+    if (fitEnd <= fitBeg+1) {
+        throw std::out_of_range("Check fit limits in stfnum::globalFit()");
+    }
+    const Channel& ch = rec[channel];
+    std::vector<Vector_double> data(sections.size(), Vector_double(fitEnd-fitBeg));
+    for (std::size_t n_s=0; n_s < sections.size(); ++n_s) {
+        if (sections[n_s] >= ch.size() || fitEnd > ch[sections[n_s]].size()) {
+            throw std::out_of_range("Section or fit window out of range in stfnum::globalFit()");
+        }
+        const Section& sec = ch[sections[n_s]];
+        if (sec.IsMapped()) {
+            sec.CopyRange(fitBeg, fitEnd, &data[n_s][0]);
+        } else {
+            std::copy(sec.get().begin()+fitBeg, sec.get().begin()+fitEnd, data[n_s].begin());
+        }
+    }
+    return globalFit(data, rec.GetXScale(), fitFunc, shared, opts, initP);
+}
+
 double stfnum::flin(double x, const Vector_double& p) { return p[0]*x + p[1]; }
 
 //! Dummy function to be passed to stfnum::storedFunc for linear functions.
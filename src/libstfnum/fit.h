@@ -27,6 +27,7 @@
 #define _FITLIB_H
 
 #include "./stfnum.h"
+#include "../libstfio/fitcache.h"
 #include <deque>
 
 namespace stfnum {
@@ -50,6 +51,84 @@ T linFit(
         T& c
 );
 
+//! Buffers of Lourakis' routines in a given precision; see stfnum::FitWorkspace.
+template <typename T>
+struct LevmarBuffers {
+    std::vector<T> lb, ub;     /*!< Parameter bounds. */
+    std::vector<T> data;       /*!< (Scaled) copy of the data. */
+    std::vector<T> p_toFit;    /*!< Parameters that are fitted. */
+    std::vector<T> old_p;      /*!< Fitted parameters after the previous pass. */
+    std::vector<T> work;       /*!< Work array of Lourakis' routines. */
+};
+
+//! Preallocated buffers for stfnum::lmFit().
+/*! A workspace holds the parameter bounds, a scaled copy of the data and
+ *  the work arrays of Lourakis' routines. Fits that use the same workspace
+ *  re-use these buffers; they are only enlarged when a fit needs more
+ *  parameters or sampling points than any previous one, so that fitting many
+ *  windows of equal length doesn't allocate the buffers again for every fit.
+ *  Double and single precision fits use separate buffers.
+ *  A workspace must not be used by several fits at the same time.
+ */
+class StfioDll FitWorkspace {
+public:
+    //! Default constructor. Buffers are allocated by the first fit.
+    FitWorkspace();
+
+    //! Constructor that allocates the buffers in advance.
+    /*! \param n_params Total number of function parameters, including constants.
+     *  \param n_points Number of sampling points that are fitted.
+     *  \param single_precision Whether the buffers are allocated for
+     *         single precision fits rather than for double precision fits.
+     */
+    FitWorkspace(std::size_t n_params, std::size_t n_points, bool single_precision = false);
+
+    //! Makes sure that the buffers can hold a fit of the given size.
+    /*! See FitWorkspace(std::size_t, std::size_t, bool) for a description of the parameters.
+     */
+    void Reserve(std::size_t n_params, std::size_t n_points, bool single_precision = false);
+
+    //! Retrieves the number of parameters that the buffers can hold.
+    /*! \return The number of parameters, including constants.
+     */
+    std::size_t GetNParams() const { return p_f.capacity(); }
+
+    //! Retrieves the number of sampling points that the buffers can hold.
+    /*! \return The number of sampling points.
+     */
+    std::size_t GetNPoints() const { return x.capacity(); }
+
+private:
+    friend double lmFit(const Vector_double& data, double dt,
+                        const storedFunc& fitFunc, const Vector_double& opts,
+                        bool use_scaling, Vector_double& p, std::string& info,
+                        int& warning, FitWorkspace& workspace);
+    friend double lmFit(const double* data, std::size_t n_data, double dt,
+                        const storedFunc& fitFunc, const Vector_double& opts,
+                        bool use_scaling, Vector_double& p, std::string& info,
+                        int& warning, FitWorkspace& workspace);
+    friend double lmFit(const std::vector<float>& data, double dt,
+                        const storedFunc& fitFunc, const Vector_double& opts,
+                        bool use_scaling, Vector_double& p, std::string& info,
+                        int& warning, FitWorkspace& workspace);
+
+    // Performs a fit in the precision of T:
+    template <typename T>
+    static double Fit(const T* data, std::size_t n_data, double dt,
+                      const storedFunc& fitFunc, const Vector_double& opts,
+                      bool use_scaling, Vector_double& p, std::string& info,
+                      int& warning, FitWorkspace& workspace, LevmarBuffers<T>& buf);
+
+    LevmarBuffers<double> dbl; // buffers of double precision fits
+    LevmarBuffers<float> sngl; // buffers of single precision fits
+    Vector_double p_const;    // parameters that are kept constant
+    Vector_double p_f;        // all parameters, assembled by the callbacks
+    Vector_double x;          // x-values for batch evaluation
+    Vector_double jac;        // jacobian of all parameters, including constants
+    Vector_double hx;         // function values or jacobian of single precision fits
+    std::deque<bool> fit_p;   // whether a parameter is fitted
+};
+
 //! Uses the Levenberg-Marquardt algorithm to perform a non-linear least-squares fit.
 /*! \param data A valarray containing the data.
  *  \param dt The sampling interval of \e data.
@@ -61,11 +140,318 @@ T linFit(
  *  \param info Information about why the fit stopped iterating
  *  \param warning A warning code on return.
  *  \return The sum of squred errors between \e data and the best-fit function.
+ *
+ *  lmFit doesn't keep any global state; it is safe to run several fits
+ *  concurrently as long as \e fitFunc itself is thread-safe.
  */
 double StfioDll lmFit(const Vector_double& data, double dt,
                       const stfnum::storedFunc& fitFunc, const Vector_double& opts,
                       bool use_scaling, Vector_double& p, std::string& info, int& warning );
 
+//! Performs a non-linear least-squares fit using preallocated buffers.
+/*! Same as lmFit() above, but re-uses the buffers of \e workspace
+ *  instead of allocating them for this fit only.
+ *  \param workspace Buffers that are enlarged as required and can be
+ *         passed to subsequent fits.
+ */
+double StfioDll lmFit(const Vector_double& data, double dt,
+                      const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                      bool use_scaling, Vector_double& p, std::string& info, int& warning,
+                      FitWorkspace& workspace );
+
+//! Performs a non-linear least-squares fit of samples that are stored elsewhere.
+/*! Same as lmFit() above, but fits \e n_data samples starting at \e data,
+ *  e.g. a window of a section, without copying them into a vector first.
+ *  \param data The first sample to be fitted.
+ *  \param n_data The number of samples to be fitted.
+ */
+double StfioDll lmFit(const double* data, std::size_t n_data, double dt,
+                      const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                      bool use_scaling, Vector_double& p, std::string& info, int& warning,
+                      FitWorkspace& workspace );
+
+//! Performs a non-linear least-squares fit in single precision.
+/*! Same as lmFit() above, but uses the single precision variants of
+ *  Lourakis' routines, which halves the memory of the data, the jacobian
+ *  and the work arrays. The function and its jacobian are still evaluated
+ *  in double precision and rounded afterwards. Stopping thresholds in
+ *  \e opts that can't be resolved in single precision are raised to
+ *  FLT_EPSILON. Use this only if single precision is adequate for the
+ *  data, e.g. for sections that are stored as single precision samples
+ *  (see Section::CopyRange()).
+ *  \param data The data in single precision.
+ *  See lmFit() above for a description of the other parameters.
+ */
+double StfioDll lmFit(const std::vector<float>& data, double dt,
+                      const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                      bool use_scaling, Vector_double& p, std::string& info, int& warning );
+
+//! Performs a non-linear least-squares fit in single precision using preallocated buffers.
+/*! See the functions above for a description of the parameters.
+ */
+double StfioDll lmFit(const std::vector<float>& data, double dt,
+                      const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                      bool use_scaling, Vector_double& p, std::string& info, int& warning,
+                      FitWorkspace& workspace );
+
+//! Results of stfnum::multiStartFit().
+struct StfioDll MultiStartResult {
+    Vector_double p;                    /*!< Best-fit parameters of the best start. */
+    double chisqr;                      /*!< Sum of squared errors of the best start. */
+    int warning;                        /*!< Warning code of the best start. */
+    std::string info;                   /*!< Information about the fit of the best start. */
+    std::size_t best;                   /*!< Index of the best start. */
+    std::vector<Vector_double> starts;  /*!< Initial parameters of all starts. */
+    std::vector<Vector_double> results; /*!< Best-fit parameters of all starts; empty if a fit failed. */
+    Vector_double chisqrs;              /*!< Sums of squared errors of all starts; NaN if a fit failed. */
+    Vector_double spread;               /*!< Standard deviation of each parameter across all successful starts. */
+};
+
+//! Performs several fits from perturbed initial parameters and keeps the best one.
+/*! The first start uses \e initP; the others are spread over the parameter space
+ *  by Latin hypercube sampling. Parameters that are constrained to a finite
+ *  interval are sampled within the constraints; others are sampled within
+ *  \e initP[i] \f$\pm\f$ \e range |\e initP[i]| (or \f$\pm\f$ \e range if \e initP[i]
+ *  is zero), clipped to the constraints. Parameters that aren't fitted keep
+ *  their initial values. The fits run in parallel using stfnum::lmFit().
+ *  Throws std::runtime_error if the parameters don't match \e fitFunc or if
+ *  none of the fits succeeded.
+ *  \param data The data that are to be fitted.
+ *  \param dt The sampling interval of \e data.
+ *  \param fitFunc An stfnum::storedFunc to be fitted to \e data.
+ *  \param opts Options controlling Lourakis' implementation of the algorithm.
+ *  \param use_scaling Whether to scale x and y-amplitudes to 1.0
+ *  \param initP Initial parameter guess.
+ *  \param n_starts Number of starts, including \e initP.
+ *  \param range Relative range around \e initP for unconstrained parameters.
+ *  \param seed Seed of the random numbers; equal seeds give equal starts.
+ *  \param n_threads Number of fits that are run in parallel; 0 uses the configured number of threads.
+ *  \return The best fit and the results of all starts.
+ */
+MultiStartResult StfioDll multiStartFit(const Vector_double& data, double dt,
+                                        const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                                        bool use_scaling, const Vector_double& initP,
+                                        std::size_t n_starts, double range = 1.0,
+                                        unsigned int seed = 1, int n_threads = 0);
+
+//! Resampling schemes of stfnum::bootstrapFit().
+enum fit_resampling {
+    resample_bootstrap = 0, /*!< Residual bootstrap; percentile intervals. */
+    resample_jackknife = 1  /*!< Delete-a-block jackknife; normal intervals. */
+};
+
+//! Results of stfnum::bootstrapFit().
+struct StfioDll BootstrapResult {
+    Vector_double p;                    /*!< Best-fit parameters that were resampled. */
+    Vector_double lower;                /*!< Lower confidence limit of each parameter. */
+    Vector_double upper;                /*!< Upper confidence limit of each parameter. */
+    Vector_double se;                   /*!< Standard error of each parameter. */
+    double level;                       /*!< Confidence level of the intervals. */
+    std::vector<Vector_double> samples; /*!< Parameters of all refits; empty if a refit failed. */
+    std::size_t n_failed;               /*!< Number of refits that failed. */
+};
+
+//! Estimates confidence intervals of best-fit parameters by refitting resampled data.
+/*! With stfnum::resample_bootstrap, every refit is performed on the best-fit
+ *  function plus the centred residuals, resampled with replacement in blocks
+ *  of \e block consecutive points (a moving-block bootstrap; 1 draws single
+ *  points), and the intervals are the percentiles of the refitted parameters.
+ *  With stfnum::resample_jackknife, the window is split into \e n_resamples
+ *  contiguous blocks, and every refit omits the residuals of one of them by
+ *  replacing its samples with the best-fit function; this keeps the sampling
+ *  uniform and equals deleting the block to first order. The intervals are
+ *  normal intervals around \e bestP with the jackknife standard error.
+ *  The refits run in parallel using stfnum::lmFit(); each thread re-uses a
+ *  single stfnum::FitWorkspace, and all refits start from \e bestP.
+ *  Parameters that aren't fitted get intervals of zero width.
+ *  Throws std::runtime_error if the parameters don't match \e fitFunc or if
+ *  fewer than two refits succeeded, and std::out_of_range if \e level isn't
+ *  within (0,1) or if there are fewer than two resamples.
+ *  \param data The data that have been fitted.
+ *  \param dt The sampling interval of \e data.
+ *  \param fitFunc The stfnum::storedFunc that has been fitted to \e data.
+ *  \param opts Options controlling Lourakis' implementation of the algorithm.
+ *  \param use_scaling Whether to scale x and y-amplitudes to 1.0
+ *  \param bestP Best-fit parameters, e.g. from stfnum::lmFit().
+ *  \param method The resampling scheme.
+ *  \param n_resamples Number of refits; for the jackknife, the number of blocks.
+ *  \param level Confidence level of the intervals, e.g. 0.95.
+ *  \param block Number of consecutive residuals that are drawn together by
+ *         the bootstrap; should exceed the correlation time of the noise.
+ *  \param seed Seed of the random numbers; equal seeds give equal intervals.
+ *  \param n_threads Number of refits that are run in parallel; 0 uses the configured number of threads.
+ *  \return The confidence intervals and the results of all refits.
+ */
+BootstrapResult StfioDll bootstrapFit(const Vector_double& data, double dt,
+                                      const stfnum::storedFunc& fitFunc, const Vector_double& opts,
+                                      bool use_scaling, const Vector_double& bestP,
+                                      fit_resampling method = resample_bootstrap,
+                                      std::size_t n_resamples = 1000, double level = 0.95,
+                                      std::size_t block = 1, unsigned int seed = 1,
+                                      int n_threads = 0);
+
+//! Adds the confidence intervals of stfnum::bootstrapFit() to the output of a fit.
+/*! \param output The output of the fit, e.g. from stfnum::storedFunc::output,
+ *         whose first rows hold the best-fit parameters in their order.
+ *  \param ci The confidence intervals.
+ *  \return A copy of \e output with columns for the standard errors and
+ *          the lower and upper confidence limits; their cells in rows
+ *          other than the parameters are empty.
+ */
+Table StfioDll confidenceTable(const Table& output, const BootstrapResult& ci);
+
+//! Initial parameters of the fits in stfnum::batchFit().
+enum fit_start {
+    start_initial = 0,  /*!< Every section starts from the initial parameters. */
+    start_previous = 1, /*!< Start from the best-fit parameters of the previous section. */
+    start_median = 2    /*!< Start from the median best-fit parameters of the previous sections. */
+};
+
+//! Fits a function to several sections of a channel in parallel.
+/*! Every section is fitted independently with stfnum::lmFit(); when
+ *  compiled with OpenMP, the sections are distributed across threads.
+ *  Each thread re-uses a single stfnum::FitWorkspace for all of its fits.
+ *  When consecutive sections are similar, warm starts from the results of
+ *  the previous sections (see stfnum::fit_start) need fewer iterations; every
+ *  thread then fits a contiguous block of sections in their given order. A
+ *  section whose warm-started fit fails or gives a warning is fitted again
+ *  from \e initP, and the better of both fits is kept.
+ *  \param rec The recording containing the data.
+ *  \param channel Index of the channel to be fitted.
+ *  \param sections Indices of the sections to be fitted.
+ *  \param fitFunc An stfnum::storedFunc to be fitted to every section.
+ *  \param fitBeg Index of the first sampling point of the fit window.
+ *  \param fitEnd Index one past the last sampling point of the fit window.
+ *  \param opts Options controlling Lourakis' implementation of the algorithm.
+ *  \param use_scaling Whether to scale x and y-amplitudes to 1.0
+ *  \param initP Initial parameter guess that will be used for every section.
+ *  \param start Where the fits of the sections start from.
+ *  \param n_median Number of previous sections whose best-fit parameters
+ *         are used if \e start is stfnum::start_median.
+ *  \param single_precision Whether the sections are fitted in single
+ *         precision (see the single precision variant of stfnum::lmFit()).
+ *  \param caches Optional fit caches, one for each section of the channel.
+ *         Sections whose fit is found in their cache (see stfnum::fitCacheKey())
+ *         aren't fitted again; new results are inserted. With warm starts,
+ *         the key also depends on \e start, so that results of warm-started
+ *         fits are only re-used by fits that start in the same way.
+ *  \return A table with one row per section, containing the best-fit
+ *          parameters, the sum of squared errors and the warning code
+ *          returned by stfnum::lmFit(). Rows of sections that couldn't be
+ *          fitted (e.g. because the fit window is out of range) are empty.
+ */
+Table StfioDll batchFit(const Recording& rec, std::size_t channel,
+                        const std::vector<std::size_t>& sections,
+                        const stfnum::storedFunc& fitFunc,
+                        std::size_t fitBeg, std::size_t fitEnd,
+                        const Vector_double& opts, bool use_scaling,
+                        const Vector_double& initP,
+                        fit_start start = start_initial, std::size_t n_median = 3,
+                        bool single_precision = false,
+                        std::vector<stfio::FitCache>* caches = NULL);
+
+//! Fits a function to every event of a section in parallel.
+/*! Every event is fitted independently with stfnum::lmFit() in a window of
+ *  \e length sampling points that starts \e pre points before the onset of
+ *  the event. The windows are fitted where they are stored in the section;
+ *  only windows of memory-mapped sections are decoded into a buffer of each
+ *  thread. When compiled with OpenMP, the events are distributed across
+ *  threads, and each thread re-uses a single stfnum::FitWorkspace.
+ *  \param sec The section containing the events.
+ *  \param dt The sampling interval.
+ *  \param onsets Indices of the onsets of the events, e.g. the start
+ *         indices of the detected events of a section.
+ *  \param pre Number of sampling points of the fit windows before the onsets.
+ *  \param length Number of sampling points of the fit windows.
+ *  \param fitFunc An stfnum::storedFunc to be fitted to every event.
+ *  \param opts Options controlling Lourakis' implementation of the algorithm.
+ *  \param use_scaling Whether to scale x and y-amplitudes to 1.0
+ *  \param initP Initial parameter guess that will be used for every event.
+ *  \return A table with one row per event, containing the time of its onset,
+ *          the best-fit parameters, the sum of squared errors and the warning
+ *          code returned by stfnum::lmFit(). All but the onset are empty in
+ *          rows of events that couldn't be fitted (e.g. because the fit window
+ *          exceeds the section).
+ */
+Table StfioDll fitEvents(const Section& sec, double dt,
+                         const std::vector<std::size_t>& onsets,
+                         std::size_t pre, std::size_t length,
+                         const stfnum::storedFunc& fitFunc,
+                         const Vector_double& opts, bool use_scaling,
+                         const Vector_double& initP);
+
+//! Computes the key of a fit in a stfio::FitCache.
+/*! The key is a hash of the samples in the fit window, the window itself,
+ *  the sampling interval, the function and its parameter settings, the
+ *  options and the initial parameters, so that a cached result can only be
+ *  found for a fit that would give the same result.
+ *  \param sec The section containing the data.
+ *  \param fitBeg Index of the first sampling point of the fit window.
+ *  \param fitEnd Index one past the last sampling point of the fit window.
+ *  \param dt The sampling interval.
+ *  \param fitFunc The function that is fitted.
+ *  \param opts Options controlling Lourakis' implementation of the algorithm.
+ *  \param use_scaling Whether x and y-amplitudes are scaled to 1.0
+ *  \param initP Initial parameter guess.
+ *  \param single_precision Whether the fit is performed in single precision.
+ *  \return The key of the fit.
+ */
+unsigned long long StfioDll fitCacheKey(const Section& sec, std::size_t fitBeg, std::size_t fitEnd,
+                                        double dt, const stfnum::storedFunc& fitFunc,
+                                        const Vector_double& opts, bool use_scaling,
+                                        const Vector_double& initP, bool single_precision = false);
+
+//! Results of stfnum::globalFit().
+struct StfioDll GlobalFitResult {
+    std::vector<Vector_double> p; /*!< Best-fit parameters of every data set. */
+    Vector_double chisqrs;        /*!< Sum of squared errors of every data set. */
+    double chisqr;                /*!< Total sum of squared errors. */
+    int iterations;               /*!< Number of iterations. */
+    int warning;                  /*!< Warning code, as returned by stfnum::lmFit(). */
+    std::string info;             /*!< Information about why the fit stopped iterating. */
+};
+
+//! Fits a function to several data sets at once, sharing some of the parameters.
+/*! Shared parameters take a single value in all data sets, while the other
+ *  fitted parameters take a separate value in every data set; parameters
+ *  that aren't fitted according to \e fitFunc keep their initial values.
+ *  The Levenberg-Marquardt iterations eliminate the parameters of single
+ *  data sets from the normal equations (Schur complement), so that the cost
+ *  of an iteration increases linearly with the number of data sets. Box
+ *  constraints and scaling aren't supported.
+ *  Throws std::runtime_error if the sizes of the arguments don't match.
+ *  \param data The data sets that are to be fitted.
+ *  \param dt The sampling interval of the data.
+ *  \param fitFunc An stfnum::storedFunc to be fitted to all data sets.
+ *  \param shared Specifies for each parameter whether it is shared.
+ *  \param opts Options controlling the algorithm (see stfnum::LM_default_opts());
+ *         at most opts[4]*opts[5] iterations are performed.
+ *  \param initP Initial parameters, either one vector for every data set or a
+ *         single vector for all of them. Shared parameters are taken from the
+ *         first vector.
+ *  \return The best-fit parameters and errors of all data sets.
+ */
+GlobalFitResult StfioDll globalFit(const std::vector<Vector_double>& data, double dt,
+                                   const stfnum::storedFunc& fitFunc, const std::deque<bool>& shared,
+                                   const Vector_double& opts, const std::vector<Vector_double>& initP);
+
+//! Fits a function to the same window of several sections, sharing some of the parameters.
+/*! Copies the window of every section and passes it to the function above.
+ *  Throws std::out_of_range if a section or the window is out of range.
+ *  \param rec The recording containing the data.
+ *  \param channel Index of the channel to be fitted.
+ *  \param sections Indices of the sections to be fitted.
+ *  \param fitBeg Index of the first sampling point of the fit window.
+ *  \param fitEnd Index one past the last sampling point of the fit window.
+ *  See above for a description of the other parameters.
+ */
+GlobalFitResult StfioDll globalFit(const Recording& rec, std::size_t channel,
+                                   const std::vector<std::size_t>& sections,
+                                   const stfnum::storedFunc& fitFunc,
+                                   std::size_t fitBeg, std::size_t fitEnd,
+                                   const std::deque<bool>& shared,
+                                   const Vector_double& opts, const std::vector<Vector_double>& initP);
+
 //! Linear function.
 /*! \f[f(x)=p_0 x + p_1\f]
  *  \param x Function argument.
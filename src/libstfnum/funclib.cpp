@@ -15,119 +15,306 @@
 #include <cfloat>
 #include <cmath>
 #include <sstream>
+#include <algorithm>
+#include <stdexcept>
 
 #include "./fit.h"
 #include "./measure.h"
 #include "./funclib.h"
 
-std::vector< stfnum::storedFunc > stfnum::GetFuncLib() {
-    std::vector< stfnum::storedFunc > funcList;
-    
+// exp() in the batch functions uses two double precision lanes where these
+// are part of the baseline instruction set (SSE2 on x86-64, NEON on AArch64),
+// as the kernels in measure.cpp do.
+#if !defined(STFNUM_NO_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define STFNUM_SIMD_SSE2
+#elif !defined(STFNUM_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define STFNUM_SIMD_NEON
+#endif
+
+namespace {
+
+// Number of x-values that are evaluated at once by the batch functions:
+const std::size_t batchBlockSize = 256;
+
+#if defined(STFNUM_SIMD_SSE2) || defined(STFNUM_SIMD_NEON)
+// exp(x) = 2^n exp(r) with x = n ln(2) + r and |r| <= ln(2)/2; exp(r) is
+// computed from a rational approximation (Cephes), which is accurate to
+// about one unit in the last place. Outside of [exp_lo, exp_hi], 2^n
+// isn't a normal number, so these arguments are left to std::exp().
+const double exp_lo = -708.0;
+const double exp_hi = 709.0;
+const double exp_log2e = 1.4426950408889634073599;
+const double exp_c1 = 6.93145751953125E-1;
+const double exp_c2 = 1.42860682030941723212E-6;
+const double exp_p0 = 1.26177193074810590878E-4;
+const double exp_p1 = 3.02994407707441961300E-2;
+const double exp_p2 = 9.99999999999999999910E-1;
+const double exp_q0 = 3.00198505138664455042E-6;
+const double exp_q1 = 2.52448340349684104192E-3;
+const double exp_q2 = 2.27265548208155028766E-1;
+const double exp_q3 = 2.00000000000000000009E0;
+#endif
+
+#if defined(STFNUM_SIMD_SSE2)
+// Computes exp() of two values in place; returns false if one of them
+// is out of range (or NaN) and nothing has been computed.
+inline bool exp_pair(double* a) {
+    __m128d x = _mm_loadu_pd(a);
+    __m128d inrange = _mm_and_pd(_mm_cmpge_pd(x, _mm_set1_pd(exp_lo)),
+                                 _mm_cmple_pd(x, _mm_set1_pd(exp_hi)));
+    if (_mm_movemask_pd(inrange) != 3) {
+        return false;
+    }
+    __m128i ni = _mm_cvtpd_epi32(_mm_mul_pd(x, _mm_set1_pd(exp_log2e)));
+    __m128d fn = _mm_cvtepi32_pd(ni);
+    x = _mm_sub_pd(x, _mm_mul_pd(fn, _mm_set1_pd(exp_c1)));
+    x = _mm_sub_pd(x, _mm_mul_pd(fn, _mm_set1_pd(exp_c2)));
+    __m128d xx = _mm_mul_pd(x, x);
+    __m128d px = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(exp_p0), xx), _mm_set1_pd(exp_p1));
+    px = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(px, xx), _mm_set1_pd(exp_p2)), x);
+    __m128d qx = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(exp_q0), xx), _mm_set1_pd(exp_q1));
+    qx = _mm_add_pd(_mm_mul_pd(qx, xx), _mm_set1_pd(exp_q2));
+    qx = _mm_add_pd(_mm_mul_pd(qx, xx), _mm_set1_pd(exp_q3));
+    x = _mm_div_pd(px, _mm_sub_pd(qx, px));
+    x = _mm_add_pd(_mm_set1_pd(1.0), _mm_add_pd(x, x));
+    // 2^n from the exponent bits:
+    __m128i e = _mm_unpacklo_epi32(_mm_add_epi32(ni, _mm_set1_epi32(1023)), _mm_setzero_si128());
+    e = _mm_slli_epi64(e, 52);
+    _mm_storeu_pd(a, _mm_mul_pd(x, _mm_castsi128_pd(e)));
+    return true;
+}
+#define STFNUM_SIMD_EXP
+#elif defined(STFNUM_SIMD_NEON)
+inline bool exp_pair(double* a) {
+    float64x2_t x = vld1q_f64(a);
+    uint64x2_t inrange = vandq_u64(vcgeq_f64(x, vdupq_n_f64(exp_lo)),
+                                   vcleq_f64(x, vdupq_n_f64(exp_hi)));
+    if (!vgetq_lane_u64(inrange, 0) || !vgetq_lane_u64(inrange, 1)) {
+        return false;
+    }
+    float64x2_t fn = vrndnq_f64(vmulq_f64(x, vdupq_n_f64(exp_log2e)));
+    int64x2_t ni = vcvtq_s64_f64(fn);
+    x = vsubq_f64(x, vmulq_f64(fn, vdupq_n_f64(exp_c1)));
+    x = vsubq_f64(x, vmulq_f64(fn, vdupq_n_f64(exp_c2)));
+    float64x2_t xx = vmulq_f64(x, x);
+    float64x2_t px = vaddq_f64(vmulq_f64(vdupq_n_f64(exp_p0), xx), vdupq_n_f64(exp_p1));
+    px = vmulq_f64(vaddq_f64(vmulq_f64(px, xx), vdupq_n_f64(exp_p2)), x);
+    float64x2_t qx = vaddq_f64(vmulq_f64(vdupq_n_f64(exp_q0), xx), vdupq_n_f64(exp_q1));
+    qx = vaddq_f64(vmulq_f64(qx, xx), vdupq_n_f64(exp_q2));
+    qx = vaddq_f64(vmulq_f64(qx, xx), vdupq_n_f64(exp_q3));
+    x = vdivq_f64(px, vsubq_f64(qx, px));
+    x = vaddq_f64(vdupq_n_f64(1.0), vaddq_f64(x, x));
+    int64x2_t e = vshlq_n_s64(vaddq_s64(ni, vdupq_n_s64(1023)), 52);
+    vst1q_f64(a, vmulq_f64(x, vreinterpretq_f64_s64(e)));
+    return true;
+}
+#define STFNUM_SIMD_EXP
+#endif
+
+// Replaces the n values of a with their exponentials:
+inline void exp_block(double* a, std::size_t n) {
+    std::size_t k = 0;
+#ifdef STFNUM_SIMD_EXP
+    for (; k+1 < n; k += 2) {
+        if (!exp_pair(a+k)) {
+            a[k] = exp(a[k]);
+            a[k+1] = exp(a[k+1]);
+        }
+    }
+#endif
+    for (; k < n; ++k) {
+        a[k] = exp(a[k]);
+    }
+}
+
+}
+
+namespace {
+
+// A parameter of a function of the library. The descriptions are stored
+// in static tables, so that the library is built without any string
+// formatting or field-by-field assignment:
+struct ParSpec {
+    const char* desc;
+    bool toFit;
+    double (*scale)(double, double, double, double, double);
+    double (*unscale)(double, double, double, double, double);
+};
+
+template <std::size_t N>
+std::vector<stfnum::parInfo> makeParInfo(const ParSpec (&spec)[N]) {
+    std::vector<stfnum::parInfo> pInfo(N);
+    for (std::size_t n = 0; n < N; ++n) {
+        pInfo[n].desc = spec[n].desc;
+        pInfo[n].toFit = spec[n].toFit;
+        pInfo[n].scale = spec[n].scale;
+        pInfo[n].unscale = spec[n].unscale;
+    }
+    return pInfo;
+}
+
+const ParSpec parMExpDe[] = {
+    { "Baseline", false, stfnum::yscaleoffset, stfnum::yunscaleoffset },
+    { "Delay",    true,  stfnum::xscale,       stfnum::xunscale },
+    { "tau",      true,  stfnum::xscale,       stfnum::xunscale },
+    // the peak is the level that the function decays to, like the baseline:
+    { "Peak",     true,  stfnum::yscaleoffset, stfnum::yunscaleoffset }
+};
+
+// The delay and the time constants aren't constrained (yet), although
+// the names of the functions say so:
+const ParSpec parBExpDe[] = {
+    { "Baseline", false, stfnum::yscaleoffset, stfnum::yunscaleoffset },
+    { "Delay",    true,  stfnum::xscale,       stfnum::xunscale },
+    { "tau1",     true,  stfnum::xscale,       stfnum::xunscale },
+    { "Factor",   true,  stfnum::yscale,       stfnum::yunscale },
+    { "tau2",     true,  stfnum::xscale,       stfnum::xunscale }
+};
+
+const ParSpec parTExpDe[] = {
+    { "Baseline", false, stfnum::yscaleoffset, stfnum::yunscaleoffset },
+    { "Delay",    true,  stfnum::xscale,       stfnum::xunscale },
+    { "tau1a",    true,  stfnum::xscale,       stfnum::xunscale },
+    { "Factor",   true,  stfnum::yscale,       stfnum::yunscale },
+    { "tau2",     true,  stfnum::xscale,       stfnum::xunscale },
+    { "tau1b",    true,  stfnum::xscale,       stfnum::xunscale },
+    { "ptau1b",   true,  stfnum::noscale,      stfnum::noscale }
+};
+
+const ParSpec parAlpha[] = {
+    { "Amplitude", true, stfnum::noscale, stfnum::noscale },
+    { "Rate",      true, stfnum::noscale, stfnum::noscale },
+    { "Offset",    true, stfnum::noscale, stfnum::noscale }
+};
+
+const ParSpec parHH[] = {
+    { "gprime_na", true,  stfnum::noscale, stfnum::noscale },
+    { "tau_m",     true,  stfnum::noscale, stfnum::noscale },
+    { "tau_h",     true,  stfnum::noscale, stfnum::noscale },
+    { "offset",    false, stfnum::noscale, stfnum::noscale }
+};
+
+const ParSpec parGauss[] = {
+    { "amp",   true, stfnum::yscale, stfnum::yunscale },
+    { "mean",  true, stfnum::xscale, stfnum::xunscale },
+    { "width", true, stfnum::xscale, stfnum::xunscale }
+};
+
+// Builds the library in the order of stfnum::func_id:
+std::vector<stfnum::storedFunc> buildFuncLib() {
+    using namespace stfnum;
+    std::vector<storedFunc> funcList;
+    funcList.reserve(func_count);
+
     // Monoexponential function, free fit:
-    std::vector<stfnum::parInfo> parInfoMExp=getParInfoExp(1);
-    funcList.push_back(stfnum::storedFunc("Monoexponential",parInfoMExp,fexp,fexp_init,fexp_jac,true));
+    std::vector<parInfo> parInfoMExp = getParInfoExp(1);
+    funcList.push_back(storedFunc("Monoexponential", parInfoMExp, ExpSum<1>::func, fexp_init, ExpSum<1>::jac, true,
+                                  defaultOutput, ExpSum<1>::batch, ExpSum<1>::jac_batch));
 
     // Monoexponential function, offset fixed to baseline:
-    parInfoMExp[2].toFit=false;
-    funcList.push_back(stfnum::storedFunc("Monoexponential, offset fixed to baseline",
-                                         parInfoMExp,fexp,fexp_init,fexp_jac,true));
+    parInfoMExp[2].toFit = false;
+    funcList.push_back(storedFunc("Monoexponential, offset fixed to baseline",
+                                  parInfoMExp, ExpSum<1>::func, fexp_init, ExpSum<1>::jac, true,
+                                  defaultOutput, ExpSum<1>::batch, ExpSum<1>::jac_batch));
 
     // Monoexponential function, starting with a delay, start fixed to baseline:
-    std::vector<stfnum::parInfo> parInfoMExpDe(4);
-    parInfoMExpDe[0].toFit=false; parInfoMExpDe[0].desc="Baseline"; parInfoMExpDe[0].scale=stfnum::yscaleoffset; parInfoMExpDe[0].unscale=stfnum::yunscaleoffset; 
-    parInfoMExpDe[1].toFit=true; parInfoMExpDe[1].desc="Delay"; parInfoMExpDe[0].scale=stfnum::xscale; parInfoMExpDe[0].unscale=stfnum::xunscale;
-    parInfoMExpDe[2].toFit=true; parInfoMExpDe[2].desc="tau"; parInfoMExpDe[0].scale=stfnum::xscale; parInfoMExpDe[0].unscale=stfnum::xunscale;
-    parInfoMExpDe[3].toFit=true; parInfoMExpDe[3].desc="Peak"; parInfoMExpDe[0].scale=stfnum::yscale; parInfoMExpDe[0].unscale=stfnum::yunscale;
-    funcList.push_back(stfnum::storedFunc("Monoexponential with delay, start fixed to baseline",
-                                         parInfoMExpDe,fexpde,fexpde_init,stfnum::nojac,false));
+    funcList.push_back(storedFunc("Monoexponential with delay, start fixed to baseline",
+                                  makeParInfo(parMExpDe), fexpde, fexpde_init, fexpde_jac, true,
+                                  defaultOutput, fexpde_batch, fexpde_jac_batch));
 
     // Biexponential function, free fit:
-    std::vector<stfnum::parInfo> parInfoBExp=getParInfoExp(2);
-    funcList.push_back(stfnum::storedFunc(
-                                       "Biexponential",parInfoBExp,fexp,fexp_init,fexp_jac,true,outputWTau));
+    std::vector<parInfo> parInfoBExp = getParInfoExp(2);
+    funcList.push_back(storedFunc("Biexponential", parInfoBExp, ExpSum<2>::func, fexp_init, ExpSum<2>::jac, true,
+                                  outputWTau, ExpSum<2>::batch, ExpSum<2>::jac_batch));
 
     // Biexponential function, offset fixed to baseline:
-    parInfoBExp[4].toFit=false;
-    funcList.push_back(stfnum::storedFunc("Biexponential, offset fixed to baseline",
-                                         parInfoBExp,fexp,fexp_init,fexp_jac,true,outputWTau));
+    parInfoBExp[4].toFit = false;
+    funcList.push_back(storedFunc("Biexponential, offset fixed to baseline",
+                                  parInfoBExp, ExpSum<2>::func, fexp_init, ExpSum<2>::jac, true,
+                                  outputWTau, ExpSum<2>::batch, ExpSum<2>::jac_batch));
 
     // Biexponential function, starting with a delay, start fixed to baseline:
-    std::vector<stfnum::parInfo> parInfoBExpDe(5);
-    parInfoBExpDe[0].toFit=false; parInfoBExpDe[0].desc="Baseline"; parInfoBExpDe[0].scale=stfnum::yscaleoffset; parInfoBExpDe[0].unscale=stfnum::yunscaleoffset;
-    parInfoBExpDe[1].toFit=true;  parInfoBExpDe[1].desc="Delay"; parInfoBExpDe[1].scale=stfnum::xscale; parInfoBExpDe[1].unscale=stfnum::xunscale; 
-    // parInfoBExpDe[1].constrained = true; parInfoBExpDe[1].constr_lb = 0.0; parInfoBExpDe[1].constr_ub = DBL_MAX;
-    parInfoBExpDe[2].toFit=true;  parInfoBExpDe[2].desc="tau1"; parInfoBExpDe[2].scale=stfnum::xscale; parInfoBExpDe[2].unscale=stfnum::xunscale;
-    // parInfoBExpDe[2].constrained = true; parInfoBExpDe[2].constr_lb = 1.0e-16; parInfoBExpDe[2].constr_ub = DBL_MAX;
-    parInfoBExpDe[3].toFit=true;  parInfoBExpDe[3].desc="Factor"; parInfoBExpDe[3].scale=stfnum::yscale; parInfoBExpDe[3].unscale=stfnum::yunscale;
-    parInfoBExpDe[4].toFit=true;  parInfoBExpDe[4].desc="tau2"; parInfoBExpDe[4].scale=stfnum::xscale; parInfoBExpDe[4].unscale=stfnum::xunscale;
-    // parInfoBExpDe[4].constrained = true; parInfoBExpDe[4].constr_lb = 1.0e-16; parInfoBExpDe[4].constr_ub = DBL_MAX;
-    funcList.push_back(stfnum::storedFunc(
-                                       "Biexponential with delay, start fixed to baseline, delay constrained to > 0",
-                                       parInfoBExpDe,fexpbde,fexpbde_init,stfnum::nojac,false));
+    funcList.push_back(storedFunc("Biexponential with delay, start fixed to baseline, delay constrained to > 0",
+                                  makeParInfo(parBExpDe), fexpbde, fexpbde_init, fexpbde_jac, true,
+                                  defaultOutput, fexpbde_batch, fexpbde_jac_batch));
 
     // Triexponential function, free fit:
-    std::vector<stfnum::parInfo> parInfoTExp=getParInfoExp(3);
-    funcList.push_back(stfnum::storedFunc(
-                                       "Triexponential",parInfoTExp,fexp,fexp_init,fexp_jac,true,outputWTau));
+    std::vector<parInfo> parInfoTExp = getParInfoExp(3);
+    funcList.push_back(storedFunc("Triexponential", parInfoTExp, ExpSum<3>::func, fexp_init, ExpSum<3>::jac, true,
+                                  outputWTau, ExpSum<3>::batch, ExpSum<3>::jac_batch));
 
     // Triexponential function, free fit, different initialization:
-    funcList.push_back(stfnum::storedFunc(
-                                       "Triexponential, initialize for PSCs/PSPs",parInfoTExp,fexp,fexp_init2,fexp_jac,true,outputWTau));
+    funcList.push_back(storedFunc("Triexponential, initialize for PSCs/PSPs",
+                                  parInfoTExp, ExpSum<3>::func, fexp_init2, ExpSum<3>::jac, true,
+                                  outputWTau, ExpSum<3>::batch, ExpSum<3>::jac_batch));
 
     // Triexponential function, offset fixed to baseline:
-    parInfoTExp[6].toFit=false;
-    funcList.push_back(stfnum::storedFunc(
-                                       "Triexponential, offset fixed to baseline",parInfoTExp,fexp,fexp_init,fexp_jac,true,outputWTau));
+    parInfoTExp[6].toFit = false;
+    funcList.push_back(storedFunc("Triexponential, offset fixed to baseline",
+                                  parInfoTExp, ExpSum<3>::func, fexp_init, ExpSum<3>::jac, true,
+                                  outputWTau, ExpSum<3>::batch, ExpSum<3>::jac_batch));
 
     // Alpha function:
-    std::vector<stfnum::parInfo> parInfoAlpha(3);
-    parInfoAlpha[0].toFit=true; parInfoAlpha[0].desc="Amplitude";
-    parInfoAlpha[1].toFit=true; parInfoAlpha[1].desc="Rate";
-    parInfoAlpha[2].toFit=true; parInfoAlpha[2].desc="Offset";
-    funcList.push_back(stfnum::storedFunc(
-                                       "Alpha function", parInfoAlpha,falpha,falpha_init,falpha_jac,true));
+    funcList.push_back(storedFunc("Alpha function", makeParInfo(parAlpha), falpha, falpha_init, falpha_jac, true,
+                                  defaultOutput, falpha_batch, falpha_jac_batch));
 
     // HH gNa function:
-    std::vector<stfnum::parInfo> parInfoHH(4);
-    parInfoHH[0].toFit=true; parInfoHH[0].desc="gprime_na";
-    parInfoHH[1].toFit=true; parInfoHH[1].desc="tau_m";
-    parInfoHH[2].toFit=true; parInfoHH[2].desc="tau_h";
-    parInfoHH[3].toFit=false; parInfoHH[3].desc="offset";
-    funcList.push_back(stfnum::storedFunc(
-                                         "Hodgkin-Huxley g_Na function, offset fixed to baseline", parInfoHH, fHH, fHH_init, stfnum::nojac, false));
+    std::vector<parInfo> parInfoHH = makeParInfo(parHH);
+    funcList.push_back(storedFunc("Hodgkin-Huxley g_Na function, offset fixed to baseline",
+                                  parInfoHH, fHH, fHH_init, fHH_jac, true,
+                                  defaultOutput, fHH_batch, fHH_jac_batch));
 
     // power of 1 gNa function:
-    funcList.push_back(stfnum::storedFunc(
-                                         "power of 1 g_Na function, offset fixed to baseline", parInfoHH, fgnabiexp, fgnabiexp_init, fgnabiexp_jac, true));
+    funcList.push_back(storedFunc("power of 1 g_Na function, offset fixed to baseline",
+                                  parInfoHH, fgnabiexp, fgnabiexp_init, fgnabiexp_jac, true,
+                                  defaultOutput, fgnabiexp_batch, fgnabiexp_jac_batch));
+
+    // Gaussian, with a positive width:
+    std::vector<parInfo> parInfoGauss = makeParInfo(parGauss);
+    parInfoGauss[2].constrained = true;
+    parInfoGauss[2].constr_lb = 0;
+    parInfoGauss[2].constr_ub = DBL_MAX;
+    funcList.push_back(storedFunc("Gaussian", parInfoGauss, fgauss, fgauss_init, fgauss_jac, true,
+                                  defaultOutput, fgauss_batch, fgauss_jac_batch));
 
-    // Gaussian
-    std::vector<stfnum::parInfo> parInfoGauss(3);
-    parInfoGauss[0].toFit=true; parInfoGauss[0].desc="amp"; parInfoGauss[0].scale = stfnum::yscale; parInfoGauss[0].unscale = stfnum::yunscale;
-    parInfoGauss[1].toFit=true; parInfoGauss[1].desc="mean"; parInfoGauss[1].scale = stfnum::xscale; parInfoGauss[1].unscale = stfnum::xunscale;
+    // Triexponential function, starting with a delay, start fixed to baseline:
+    funcList.push_back(storedFunc("Triexponential with delay, start fixed to baseline, delay constrained to > 0",
+                                  makeParInfo(parTExpDe), fexptde, fexptde_init, fexptde_jac, true,
+                                  defaultOutput, fexptde_batch, fexptde_jac_batch));
 
-    parInfoGauss[2].toFit=true;
-    parInfoGauss[2].constrained=true; parInfoGauss[2].constr_lb=0; parInfoGauss[2].constr_ub=DBL_MAX;
-    parInfoGauss[2].desc="width"; parInfoGauss[2].scale = stfnum::xscale; parInfoGauss[2].unscale = stfnum::xunscale;
+    return funcList;
+}
 
-    funcList.push_back(stfnum::storedFunc(
-                                       "Gaussian", parInfoGauss, fgauss, fgauss_init, fgauss_jac, true));
+}
 
-    // Triexponential function, starting with a delay, start fixed to baseline:
-    std::vector<stfnum::parInfo> parInfoTExpDe(7);
-    parInfoTExpDe[0].toFit=false; parInfoTExpDe[0].desc="Baseline"; parInfoTExpDe[0].scale=stfnum::yscaleoffset; parInfoTExpDe[0].unscale=stfnum::yunscaleoffset;
-    parInfoTExpDe[1].toFit=true;  parInfoTExpDe[1].desc="Delay"; parInfoTExpDe[1].scale=stfnum::xscale; parInfoTExpDe[1].unscale=stfnum::xunscale; 
-    // parInfoTExpDe[1].constrained = true; parInfoTExpDe[1].constr_lb = 0.0; parInfoTExpDe[1].constr_ub = DBL_MAX;
-    parInfoTExpDe[2].toFit=true;  parInfoTExpDe[2].desc="tau1a"; parInfoTExpDe[2].scale=stfnum::xscale; parInfoTExpDe[2].unscale=stfnum::xunscale;
-    // parInfoTExpDe[2].constrained = true; parInfoTExpDe[2].constr_lb = 1.0e-16; parInfoTExpDe[2].constr_ub = DBL_MAX;
-    parInfoTExpDe[3].toFit=true;  parInfoTExpDe[3].desc="Factor"; parInfoTExpDe[3].scale=stfnum::yscale; parInfoTExpDe[3].unscale=stfnum::yunscale;
-    parInfoTExpDe[4].toFit=true;  parInfoTExpDe[4].desc="tau2"; parInfoTExpDe[4].scale=stfnum::xscale; parInfoTExpDe[4].unscale=stfnum::xunscale;
-    parInfoTExpDe[5].toFit=true;  parInfoTExpDe[5].desc="tau1b"; parInfoTExpDe[5].scale=stfnum::xscale; parInfoTExpDe[5].unscale=stfnum::xunscale;
-    parInfoTExpDe[6].toFit=true;  parInfoTExpDe[6].desc="ptau1b"; parInfoTExpDe[6].scale=stfnum::noscale; parInfoTExpDe[6].unscale=stfnum::noscale;
-    funcList.push_back(stfnum::storedFunc(
-                                       "Triexponential with delay, start fixed to baseline, delay constrained to > 0",
-                                       parInfoTExpDe,fexptde,fexptde_init,stfnum::nojac,false));
+const std::vector<stfnum::storedFunc>& stfnum::FuncLib() {
+    // Built once, on first use, and never changed afterwards, so that
+    // references and pointers into it stay valid for the whole process:
+    static const std::vector<stfnum::storedFunc> funcLib(buildFuncLib());
+    return funcLib;
+}
 
-    return funcList;
+const stfnum::storedFunc& stfnum::GetFunc(std::size_t id) {
+    const std::vector<stfnum::storedFunc>& funcLib = FuncLib();
+    if (id >= funcLib.size()) {
+        throw std::out_of_range("Function id out of range in stfnum::GetFunc()");
+    }
+    return funcLib[id];
+}
+
+std::size_t stfnum::FuncId(const stfnum::storedFunc* func) {
+    const std::vector<stfnum::storedFunc>& funcLib = FuncLib();
+    if (func == NULL || func < &funcLib[0] || func >= &funcLib[0] + funcLib.size()) {
+        return funcLib.size();
+    }
+    return (std::size_t)(func - &funcLib[0]);
+}
+
+std::vector< stfnum::storedFunc > stfnum::GetFuncLib() {
+    return FuncLib();
 }
 
 double stfnum::fexp(double x, const Vector_double& p) {
@@ -156,8 +343,8 @@ void stfnum::fexp_init(const Vector_double& data, double base, double peak, doub
     Vector_double::const_iterator max_el = std::max_element(data.begin(), data.end());
     Vector_double::const_iterator min_el = std::min_element(data.begin(), data.end());
     double floor = (increasing ? (*max_el+1.0e-9) : (*min_el-1.0e-9));
-    Vector_double peeled( stfio::vec_scal_minus(data, floor));
-    if (increasing) peeled = stfio::vec_scal_mul(peeled, -1.0);
+    Vector_double peeled(data);
+    stfio::offset_scale_inplace(peeled, -floor, increasing ? -1.0 : 1.0);
     std::transform(peeled.begin(), peeled.end(), peeled.begin(),
 #if defined(_WINDOWS) && !defined(__MINGW32__)                      
                    std::logl);
@@ -244,24 +431,19 @@ double stfnum::fexpde(double x, const Vector_double& p) {
     }
 }
 
-#if 0
 Vector_double stfnum::fexpde_jac(double x, const Vector_double& p) {
-    Vector_double jac(4);
-    if (x<p[3]) {
+    Vector_double jac(4, 0.0);
+    if (x<p[1]) {
         jac[0]=1.0;
-        jac[1]=0.0;
-        jac[2]=0.0;
-        jac[3]=0.0;
     } else {
-        double e=exp((p[3]-x)/p[1]);
+        double e=exp((p[1]-x)/p[2]);
         jac[0]=e;
-        jac[1]=(p[0]-p[2])*(p[3]-x)*(-1.0/(p[1]*p[1]))*e;
-        jac[2]=-e+1.0;
-        jac[3]=(p[0]-p[2])*(1.0/p[1])*e;
+        jac[1]=(p[0]-p[3])*e/p[2];
+        jac[2]=(p[0]-p[3])*(x-p[1])*e/(p[2]*p[2]);
+        jac[3]=1.0-e;
     }
     return jac;
 }
-#endif 
 
 void stfnum::fexpde_init(const Vector_double& data, double base, double peak, double RTLoHI, double HalfWidth, double dt, Vector_double& pInit ) {
     // Find the peak position in data:
@@ -301,29 +483,40 @@ double stfnum::fexptde(double x, const Vector_double& p) {
     }
 }
 
-#if 0
 Vector_double stfnum::fexpbde_jac(double x, const Vector_double& p) {
-    Vector_double jac(5);
+    Vector_double jac(5, 0.0);
     if (x<p[1]) {
         jac[0]=1.0;
-        jac[1]=0.0;
-        jac[2]=0.0;
-        jac[3]=0.0;
-        jac[4]=0.0;
     } else {
-        double tpeak = p[4]*p[2]*log(p[4]/p[2])/(p[4]-p[2]);
-        double adjust = 1.0/((1.0-exp(-tpeak/p[4]))-(1.0-exp(-tpeak/p[2])));
         double e1=exp((p[1]-x)/p[2]);
         double e2=exp((p[1]-x)/p[4]);
         jac[0]=1.0;
-        jac[1]=adjust*p[3]/p[2] * e1 - adjust*p[3]/p[4] * e2;
-        jac[2]=adjust*p[3]*(p[1]-x)*(-1.0/(p[2]*p[2]))*e1;
-        jac[3]=adjust*e1-adjust*e2;
-        jac[4]=adjust*p[3]*(p[1]-x)*(1.0/(p[4]*p[4]))*e2;
+        jac[1]=p[3]*e1/p[2] - p[3]*e2/p[4];
+        jac[2]=p[3]*(x-p[1])*e1/(p[2]*p[2]);
+        jac[3]=e1-e2;
+        jac[4]=-p[3]*(x-p[1])*e2/(p[4]*p[4]);
+    }
+    return jac;
+}
+
+Vector_double stfnum::fexptde_jac(double x, const Vector_double& p) {
+    Vector_double jac(7, 0.0);
+    if (x<p[1]) {
+        jac[0]=1.0;
+    } else {
+        double e1=exp((p[1]-x)/p[2]);
+        double e2=exp((p[1]-x)/p[4]);
+        double e3=exp((p[1]-x)/p[5]);
+        jac[0]=1.0;
+        jac[1]=p[6]*p[3]*e1/p[2] + (1.0-p[6])*p[3]*e3/p[5] - p[3]*e2/p[4];
+        jac[2]=p[6]*p[3]*(x-p[1])*e1/(p[2]*p[2]);
+        jac[3]=p[6]*e1 + (1.0-p[6])*e3 - e2;
+        jac[4]=-p[3]*(x-p[1])*e2/(p[4]*p[4]);
+        jac[5]=(1.0-p[6])*p[3]*(x-p[1])*e3/(p[5]*p[5]);
+        jac[6]=p[3]*e1 - p[3]*e3;
     }
     return jac;
 }
-#endif
 
 void stfnum::fexpbde_init(const Vector_double& data, double base, double peak, double RTLoHi, double HalfWidth, double dt, Vector_double& pInit ) {
     // Find the peak position in data:
@@ -410,6 +603,18 @@ double stfnum::fHH(double x, const Vector_double& p) {
     return p[0] * (m*m*m) * h + p[3];
 }
 
+Vector_double stfnum::fHH_jac(double x, const Vector_double& p) {
+    Vector_double jac(4);
+    double em = exp(-x/p[1]);
+    double m = 1 - em;
+    double h = exp(-x/p[2]);
+    jac[0] = m*m*m * h;
+    jac[1] = -3.0 * p[0] * m*m * h * x * em / (p[1]*p[1]);
+    jac[2] = p[0] * m*m*m * h * x / (p[2]*p[2]);
+    jac[3] = 1.0;
+    return jac;
+}
+
 double stfnum::fgnabiexp(double x, const Vector_double& p) {
     // p[0]: gprime_na
     // p[1]: tau_m
@@ -508,6 +713,425 @@ void stfnum::fgnabiexp_init(const Vector_double& data, double base, double peak,
     pInit[0] = (peak-base)/norm;
 }
 
+// Batch evaluation of the models. Arguments of exp() are collected in
+// blocks on the stack, so that the exponentials can be computed
+// two at a time without allocating memory:
+
+void stfnum::fexp_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bout = out+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            bout[k] = p[n_p-1];
+        }
+        for (std::size_t n_e = 0; n_e+1 < n_p; n_e += 2) {
+            for (std::size_t k = 0; k < len; ++k) {
+                e[k] = -bx[k]/p[n_e+1];
+            }
+            exp_block(e, len);
+            for (std::size_t k = 0; k < len; ++k) {
+                bout[k] += p[n_e]*e[k];
+            }
+        }
+    }
+}
+
+void stfnum::fexp_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t n_e = 0; n_e+1 < n_p; n_e += 2) {
+            for (std::size_t k = 0; k < len; ++k) {
+                e[k] = -bx[k]/p[n_e+1];
+            }
+            exp_block(e, len);
+            double tau2 = p[n_e+1]*p[n_e+1];
+            for (std::size_t k = 0; k < len; ++k) {
+                bJ[k*n_p+n_e] = e[k];
+                bJ[k*n_p+n_e+1] = p[n_e]*bx[k]*e[k]/tau2;
+            }
+        }
+        for (std::size_t k = 0; k < len; ++k) {
+            bJ[k*n_p+n_p-1] = 1.0;
+        }
+    }
+}
+
+template <int N>
+double stfnum::ExpSum<N>::func(double x, const Vector_double& p) {
+    double sum=0.0;
+    for (int n_e=0; n_e<N; ++n_e) {
+        sum+=p[2*n_e]*exp(-x/p[2*n_e+1]);
+    }
+    return sum+p[2*N];
+}
+
+template <int N>
+Vector_double stfnum::ExpSum<N>::jac(double x, const Vector_double& p) {
+    Vector_double jac(n_params);
+    for (int n_e=0; n_e<N; ++n_e) {
+        double e=exp(-x/p[2*n_e+1]);
+        jac[2*n_e]=e;
+        jac[2*n_e+1]=p[2*n_e]*x*e/(p[2*n_e+1]*p[2*n_e+1]);
+    }
+    jac[2*N]=1.0;
+    return jac;
+}
+
+template <int N>
+void stfnum::ExpSum<N>::batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double e[N][batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (int n_e = 0; n_e < N; ++n_e) {
+            for (std::size_t k = 0; k < len; ++k) {
+                e[n_e][k] = -bx[k]/p[2*n_e+1];
+            }
+            exp_block(e[n_e], len);
+        }
+        for (std::size_t k = 0; k < len; ++k) {
+            double sum = p[2*N];
+            for (int n_e = 0; n_e < N; ++n_e) {
+                sum += p[2*n_e]*e[n_e][k];
+            }
+            out[begin+k] = sum;
+        }
+    }
+}
+
+template <int N>
+void stfnum::ExpSum<N>::jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double e[N][batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (int n_e = 0; n_e < N; ++n_e) {
+            for (std::size_t k = 0; k < len; ++k) {
+                e[n_e][k] = -bx[k]/p[2*n_e+1];
+            }
+            exp_block(e[n_e], len);
+        }
+        for (std::size_t k = 0; k < len; ++k) {
+            double* j = J+(begin+k)*n_params;
+            for (int n_e = 0; n_e < N; ++n_e) {
+                j[2*n_e] = e[n_e][k];
+                j[2*n_e+1] = p[2*n_e]*bx[k]*e[n_e][k]/(p[2*n_e+1]*p[2*n_e+1]);
+            }
+            j[2*N] = 1.0;
+        }
+    }
+}
+
+// The specializations that are used by FuncLib():
+template struct stfnum::ExpSum<1>;
+template struct stfnum::ExpSum<2>;
+template struct stfnum::ExpSum<3>;
+
+void stfnum::fexpde_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            e[k] = bx[k] < p[1] ? 0.0 : (p[1]-bx[k])/p[2];
+        }
+        exp_block(e, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            out[begin+k] = bx[k] < p[1] ? p[0] : (p[0]-p[3])*e[k] + p[3];
+        }
+    }
+}
+
+void stfnum::fexpde_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t k = 0; k < len; ++k) {
+            e[k] = bx[k] < p[1] ? 0.0 : (p[1]-bx[k])/p[2];
+        }
+        exp_block(e, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            double* j = bJ+k*n_p;
+            if (bx[k] < p[1]) {
+                j[0] = 1.0; j[1] = 0.0; j[2] = 0.0; j[3] = 0.0;
+            } else {
+                j[0] = e[k];
+                j[1] = (p[0]-p[3])*e[k]/p[2];
+                j[2] = (p[0]-p[3])*(bx[k]-p[1])*e[k]/(p[2]*p[2]);
+                j[3] = 1.0-e[k];
+            }
+        }
+    }
+}
+
+void stfnum::fexpbde_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double e1[batchBlockSize], e2[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            double d = bx[k] < p[1] ? 0.0 : p[1]-bx[k];
+            e1[k] = d/p[2];
+            e2[k] = d/p[4];
+        }
+        exp_block(e1, len);
+        exp_block(e2, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            out[begin+k] = bx[k] < p[1] ? p[0] : p[3]*e1[k] - p[3]*e2[k] + p[0];
+        }
+    }
+}
+
+void stfnum::fexpbde_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double e1[batchBlockSize], e2[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t k = 0; k < len; ++k) {
+            double d = bx[k] < p[1] ? 0.0 : p[1]-bx[k];
+            e1[k] = d/p[2];
+            e2[k] = d/p[4];
+        }
+        exp_block(e1, len);
+        exp_block(e2, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            double* j = bJ+k*n_p;
+            j[0] = 1.0;
+            if (bx[k] < p[1]) {
+                j[1] = 0.0; j[2] = 0.0; j[3] = 0.0; j[4] = 0.0;
+            } else {
+                double d = bx[k]-p[1];
+                j[1] = p[3]*e1[k]/p[2] - p[3]*e2[k]/p[4];
+                j[2] = p[3]*d*e1[k]/(p[2]*p[2]);
+                j[3] = e1[k]-e2[k];
+                j[4] = -p[3]*d*e2[k]/(p[4]*p[4]);
+            }
+        }
+    }
+}
+
+void stfnum::fexptde_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double e1[batchBlockSize], e2[batchBlockSize], e3[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            double d = bx[k] < p[1] ? 0.0 : p[1]-bx[k];
+            e1[k] = d/p[2];
+            e2[k] = d/p[4];
+            e3[k] = d/p[5];
+        }
+        exp_block(e1, len);
+        exp_block(e2, len);
+        exp_block(e3, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            out[begin+k] = bx[k] < p[1] ? p[0] :
+                p[6]*p[3]*e1[k] + (1.0-p[6])*p[3]*e3[k] - p[3]*e2[k] + p[0];
+        }
+    }
+}
+
+void stfnum::fexptde_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double e1[batchBlockSize], e2[batchBlockSize], e3[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t k = 0; k < len; ++k) {
+            double d = bx[k] < p[1] ? 0.0 : p[1]-bx[k];
+            e1[k] = d/p[2];
+            e2[k] = d/p[4];
+            e3[k] = d/p[5];
+        }
+        exp_block(e1, len);
+        exp_block(e2, len);
+        exp_block(e3, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            double* j = bJ+k*n_p;
+            j[0] = 1.0;
+            if (bx[k] < p[1]) {
+                for (std::size_t i = 1; i < 7; ++i) {
+                    j[i] = 0.0;
+                }
+            } else {
+                double d = bx[k]-p[1];
+                j[1] = p[6]*p[3]*e1[k]/p[2] + (1.0-p[6])*p[3]*e3[k]/p[5] - p[3]*e2[k]/p[4];
+                j[2] = p[6]*p[3]*d*e1[k]/(p[2]*p[2]);
+                j[3] = p[6]*e1[k] + (1.0-p[6])*e3[k] - e2[k];
+                j[4] = -p[3]*d*e2[k]/(p[4]*p[4]);
+                j[5] = (1.0-p[6])*p[3]*d*e3[k]/(p[5]*p[5]);
+                j[6] = p[3]*e1[k] - p[3]*e3[k];
+            }
+        }
+    }
+}
+
+void stfnum::falpha_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            e[k] = 1-bx[k]/p[1];
+        }
+        exp_block(e, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            out[begin+k] = p[0]*bx[k]/p[1]*e[k] + p[2];
+        }
+    }
+}
+
+void stfnum::falpha_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t k = 0; k < len; ++k) {
+            e[k] = 1-bx[k]/p[1];
+        }
+        exp_block(e, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            double j0 = bx[k]*e[k]/p[1];
+            bJ[k*n_p] = j0;
+            bJ[k*n_p+1] = j0*( bx[k]*p[0]/(p[1]*p[1]) - p[0]/p[1] );
+            bJ[k*n_p+2] = 1.0;
+        }
+    }
+}
+
+void stfnum::fHH_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double em[batchBlockSize], eh[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            em[k] = -bx[k]/p[1];
+            eh[k] = -bx[k]/p[2];
+        }
+        exp_block(em, len);
+        exp_block(eh, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            double m = 1 - em[k];
+            out[begin+k] = p[0] * (m*m*m) * eh[k] + p[3];
+        }
+    }
+}
+
+void stfnum::fHH_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double em[batchBlockSize], eh[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t k = 0; k < len; ++k) {
+            em[k] = -bx[k]/p[1];
+            eh[k] = -bx[k]/p[2];
+        }
+        exp_block(em, len);
+        exp_block(eh, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            double m = 1 - em[k];
+            double* j = bJ+k*n_p;
+            j[0] = m*m*m * eh[k];
+            j[1] = -3.0 * p[0] * m*m * eh[k] * bx[k] * em[k] / (p[1]*p[1]);
+            j[2] = p[0] * m*m*m * eh[k] * bx[k] / (p[2]*p[2]);
+            j[3] = 1.0;
+        }
+    }
+}
+
+void stfnum::fgnabiexp_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double em[batchBlockSize], eh[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            em[k] = -bx[k]/p[1];
+            eh[k] = -bx[k]/p[2];
+        }
+        exp_block(em, len);
+        exp_block(eh, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            out[begin+k] = p[0] * (1-em[k]) * eh[k] + p[3];
+        }
+    }
+}
+
+void stfnum::fgnabiexp_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double em[batchBlockSize], eh[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t k = 0; k < len; ++k) {
+            em[k] = -bx[k]/p[1];
+            eh[k] = -bx[k]/p[2];
+        }
+        exp_block(em, len);
+        exp_block(eh, len);
+        for (std::size_t k = 0; k < len; ++k) {
+            bJ[k*n_p] = (1-em[k]) * eh[k];
+            bJ[k*n_p+1] = -p[0] * bx[k] * em[k] * eh[k] / (p[1]*p[1]);
+            bJ[k*n_p+2] = p[0] * bx[k] * (1-em[k]) * eh[k] / (p[2]*p[2]);
+            bJ[k*n_p+3] = 1.0;
+        }
+    }
+}
+
+void stfnum::fgauss_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bout = out+begin;
+        for (std::size_t k = 0; k < len; ++k) {
+            bout[k] = 0.0;
+        }
+        for (std::size_t i = 0; i+1 < n_p; i += 3) {
+            for (std::size_t k = 0; k < len; ++k) {
+                double arg = (bx[k]-p[i+1])/p[i+2];
+                e[k] = -arg*arg;
+            }
+            exp_block(e, len);
+            for (std::size_t k = 0; k < len; ++k) {
+                bout[k] += p[i]*e[k];
+            }
+        }
+    }
+}
+
+void stfnum::fgauss_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J) {
+    double e[batchBlockSize];
+    for (std::size_t begin = 0; begin < n; begin += batchBlockSize) {
+        std::size_t len = std::min(batchBlockSize, n-begin);
+        const double* bx = x+begin;
+        double* bJ = J+begin*n_p;
+        for (std::size_t i = 0; i+1 < n_p; i += 3) {
+            for (std::size_t k = 0; k < len; ++k) {
+                double arg = (bx[k]-p[i+1])/p[i+2];
+                e[k] = -arg*arg;
+            }
+            exp_block(e, len);
+            double w2 = p[i+2]*p[i+2];
+            for (std::size_t k = 0; k < len; ++k) {
+                double d = bx[k]-p[i+1];
+                bJ[k*n_p+i] = e[k];
+                bJ[k*n_p+i+1] = 2.0*e[k]*p[i]*d / w2;
+                bJ[k*n_p+i+2] = 2.0*e[k]*p[i]*d*d / (w2*p[i+2]);
+            }
+        }
+    }
+}
+
 std::vector<stfnum::parInfo> stfnum::getParInfoExp(int n_exp) {
     std::vector<stfnum::parInfo> retParInfo(n_exp*2+1);
     for (int n_e=0; n_e<n_exp*2; n_e+=2) {
@@ -63,6 +63,30 @@ namespace stfnum {
      */
     Vector_double fexp_jac(double x, const Vector_double& p);
 
+    //! Sum of \e N exponential functions, with \e N known at compile time.
+    /*! Evaluates the same function as stfnum::fexp() with 2<em>N</em>+1 parameters.
+     *  Since the number of terms is a constant, the compiler can unroll and inline
+     *  the loops over the terms. Specializations for \e N = 1, 2 and 3 are used by
+     *  the library (see stfnum::FuncLib()).
+     */
+    template <int N>
+    struct ExpSum {
+        //! The number of parameters.
+        enum { n_params = 2*N+1 };
+
+        //! Evaluates the function; see stfnum::fexp().
+        static double func(double x, const Vector_double& p);
+
+        //! Evaluates the Jacobian; see stfnum::fexp_jac().
+        static Vector_double jac(double x, const Vector_double& p);
+
+        //! Batch evaluation of the function; see stfnum::fexp_batch().
+        static void batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+        //! Batch evaluation of the Jacobian; see stfnum::fexp_jac_batch().
+        static void jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+    };
+
     //! Initialises parameters for fitting stfnum::fexp() to \e data.
     /*! This needs to be made more robust.
      *  \param data The waveform of the data for the fit.
@@ -88,62 +112,40 @@ namespace stfnum {
      */
     void fexp_init2(const Vector_double& data, double base, double peak, double RTLoHi, double HalfWidth, double dt, Vector_double& pInit );
     
+    //! Monoexponential function with delay. 
     //! Monoexponential function with delay. 
     /*! \f{eqnarray*}
      *      f(x)=
      *      \begin{cases}
-     *          p_0, & \mbox{if }x < p_3 \\ 
-     *          \left( p_0 - p_2 \right) \mathrm{e}^{\left (\frac{p_3 - x}{p_1}\right )} + p_2, & \mbox{if }x \geq p_3
+     *          p_0, & \mbox{if }x < p_1 \\ 
+     *          \left( p_0 - p_3 \right) \mathrm{e}^{\left (\frac{p_1 - x}{p_2}\right )} + p_3, & \mbox{if }x \geq p_1
      *      \end{cases}
      *  \f} 
      *  \param x Function argument.
      *  \param p A valarray of parameters, where \n
      *         \e p[0] is the baseline, \n
-     *         \e p[1] is the time constant, \n
-     *         \e p[2] is the amplitude and \n
-     *         \e p[3] is the delay.
+     *         \e p[1] is the delay, \n
+     *         \e p[2] is the time constant and \n
+     *         \e p[3] is the peak.
      *  \return The evaluated function.
      */
     double fexpde(double x, const Vector_double& p);
 
-#if 0
     //! Computes the Jacobian of stfnum::fexpde().
-    /*! \f{eqnarray*}
-     *      j_0(x)&=& \frac{df(x)}{dp_0} = 
-     *      \begin{cases}
-     *          1, & \mbox{if }x < p_3 \\ 
-     *          \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases} \\
-     *      j_1(x)&=& \frac{df(x)}{dp_1} = 
-     *      \begin{cases}
-     *          0, & \mbox{if }x < p_3 \\ 
-     *          \left( p_0-p_2 \right) \left( p_3-x \right) \frac{-1}{p_1^2} \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases} \\
-     *      j_2(x)&=& \frac{df(x)}{dp_2} = 
-     *      \begin{cases}
-     *          0, & \mbox{if }x < p_3 \\ 
-     *          1 - \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases} \\
-     *      j_3(x)&=& \frac{df(x)}{dp_3} = 
-     *      \begin{cases}
-     *          0, & \mbox{if }x < p_3 \\ 
-     *          \left( p_0-p_2 \right) \frac{1}{p_1} \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases}
+    /*! For \f$x < p_1\f$, the only non-zero derivative is \f$j_0(x) = 1\f$; otherwise, with
+     *  \f$e = \mathrm{e}^{\frac{p_1 - x}{p_2}}\f$:
+     *  \f{eqnarray*}
+     *   j_0(x) &=& e \\
+     *   j_1(x) &=& \frac{p_0 - p_3}{p_2} e \\
+     *   j_2(x) &=& \left( p_0 - p_3 \right) \frac{x - p_1}{p_2^2} e \\
+     *   j_3(x) &=& 1 - e
      *  \f} 
+     *  The derivative with respect to the delay is taken from the right at \f$x = p_1\f$.
      *  \param x Function argument.
-     *  \param p A valarray of parameters, where \n
-     *         \e p[0] is the baseline, \n
-     *         \e p[1] is the time constant, \n
-     *         \e p[2] is the amplitude and \n
-     *         \e p[3] is the delay.
-     *  \return A valarray \e j with the evaluated Jacobian, where \n
-     *          \e j[0] contains the derivative with respect to \e p[0], \n
-     *          \e j[1] contains the derivative with respect to \e p[1], \n
-     *          \e j[2] contains the derivative with respect to \e p[2] and \n
-     *          \e j[3] contains the derivative with respect to \e p[3].
+     *  \param p A valarray of parameters (see stfnum::fexpde()).
+     *  \return A valarray \e j with the derivatives with respect to \e p.
      */
     Vector_double fexpde_jac(double x, const Vector_double& p);
-#endif
     
     //! Initialises parameters for fitting stfnum::fexpde() to \e data.
     /*! \param data The waveform of the data for the fit.
@@ -196,44 +198,39 @@ namespace stfnum {
      */
     double fexptde(double x, const Vector_double& p);
 
-#if 0
-    //! Computes the Jacobian of stfnum::fexpde().
-    /*! \f{eqnarray*}
-     *      j_0(x)&=& \frac{df(x)}{dp_0} = 
-     *      \begin{cases}
-     *          1, & \mbox{if }x < p_3 \\ 
-     *          \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases} \\
-     *      j_1(x)&=& \frac{df(x)}{dp_1} = 
-     *      \begin{cases}
-     *          0, & \mbox{if }x < p_3 \\ 
-     *          \left( p_0-p_2 \right) \left( p_3-x \right) \frac{-1}{p_1^2} \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases} \\
-     *      j_2(x)&=& \frac{df(x)}{dp_2} = 
-     *      \begin{cases}
-     *          0, & \mbox{if }x < p_3 \\ 
-     *          1 - \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases} \\
-     *      j_3(x)&=& \frac{df(x)}{dp_3} = 
-     *      \begin{cases}
-     *          0, & \mbox{if }x < p_3 \\ 
-     *          \left( p_0-p_2 \right) \frac{1}{p_1} \mathrm{e}^{\frac{p_3 - x}{p_1}}, & \mbox{if }x \geq p_3
-     *      \end{cases}
+    //! Computes the Jacobian of stfnum::fexpbde().
+    /*! For \f$x < p_1\f$, the only non-zero derivative is \f$j_0(x) = 1\f$; otherwise, with
+     *  \f$e_i = \mathrm{e}^{\frac{p_1 - x}{p_i}}\f$:
+     *  \f{eqnarray*}
+     *   j_0(x) &=& 1 \\
+     *   j_1(x) &=& p_3 \left( \frac{e_2}{p_2} - \frac{e_4}{p_4} \right) \\
+     *   j_2(x) &=& p_3 \frac{x - p_1}{p_2^2} e_2 \\
+     *   j_3(x) &=& e_2 - e_4 \\
+     *   j_4(x) &=& -p_3 \frac{x - p_1}{p_4^2} e_4
      *  \f} 
      *  \param x Function argument.
-     *  \param p A valarray of parameters, where \n
-     *         \e p[0] is the baseline, \n
-     *         \e p[1] is the time constant, \n
-     *         \e p[2] is the amplitude and \n
-     *         \e p[3] is the delay.
-     *  \return A valarray \e j with the evaluated Jacobian, where \n
-     *          \e j[0] contains the derivative with respect to \e p[0], \n
-     *          \e j[1] contains the derivative with respect to \e p[1], \n
-     *          \e j[2] contains the derivative with respect to \e p[2] and \n
-     *          \e j[3] contains the derivative with respect to \e p[3].
+     *  \param p A valarray of parameters (see stfnum::fexpbde()).
+     *  \return A valarray \e j with the derivatives with respect to \e p.
      */
     Vector_double fexpbde_jac(double x, const Vector_double& p);
-#endif
+
+    //! Computes the Jacobian of stfnum::fexptde().
+    /*! For \f$x < p_1\f$, the only non-zero derivative is \f$j_0(x) = 1\f$; otherwise, with
+     *  \f$e_i = \mathrm{e}^{\frac{p_1 - x}{p_i}}\f$:
+     *  \f{eqnarray*}
+     *   j_0(x) &=& 1 \\
+     *   j_1(x) &=& p_3 \left( p_6 \frac{e_2}{p_2} + \left( 1 - p_6 \right) \frac{e_5}{p_5} - \frac{e_4}{p_4} \right) \\
+     *   j_2(x) &=& p_6 p_3 \frac{x - p_1}{p_2^2} e_2 \\
+     *   j_3(x) &=& p_6 e_2 + \left( 1 - p_6 \right) e_5 - e_4 \\
+     *   j_4(x) &=& -p_3 \frac{x - p_1}{p_4^2} e_4 \\
+     *   j_5(x) &=& \left( 1 - p_6 \right) p_3 \frac{x - p_1}{p_5^2} e_5 \\
+     *   j_6(x) &=& p_3 \left( e_2 - e_5 \right)
+     *  \f} 
+     *  \param x Function argument.
+     *  \param p A valarray of parameters (see stfnum::fexptde()).
+     *  \return A valarray \e j with the derivatives with respect to \e p.
+     */
+    Vector_double fexptde_jac(double x, const Vector_double& p);
     
     //! Initialises parameters for fitting stfnum::fexpde() to \e data.
     /*! \param data The waveform of the data for the fit.
@@ -297,6 +294,20 @@ namespace stfnum {
      */
     double fHH(double x, const Vector_double& p);
 
+    //! Computes the Jacobian of stfnum::fHH().
+    /*! With \f$m = 1-\mathrm{e}^{\frac{-x}{p_1}}\f$ and \f$h = \mathrm{e}^{\frac{-x}{p_2}}\f$:
+     *  \f{eqnarray*}
+     *   j_0(x) &=& m^3 h \\
+     *   j_1(x) &=& -3 p_0 m^2 h \frac{x}{p_1^2} \mathrm{e}^{\frac{-x}{p_1}} \\
+     *   j_2(x) &=& p_0 m^3 h \frac{x}{p_2^2} \\
+     *   j_3(x) &=& 1
+     *  \f} 
+     *  \param x Function argument.
+     *  \param p A valarray of parameters (see stfnum::fHH()).
+     *  \return A valarray \e j with the derivatives with respect to \e p.
+     */
+    Vector_double fHH_jac(double x, const Vector_double& p);
+
     //! Computes the sum of an arbitrary number of Gaussians.
     /*! \f[
      *      f(x) = \sum_{i=0}^{n-1}p_{3i}\mathrm{e}^{- \left( \frac{x-p_{3i+1}}{p_{3i+2}} \right) ^2}
@@ -454,6 +465,91 @@ namespace stfnum {
      */
     double yunscaleoffset(double param, double xscale, double xoff, double yscale, double yoff);
 
+    //! Batch evaluation of stfnum::fexp().
+    /*! All batch functions have the signature of a stfnum::BatchFunc or a stfnum::BatchJac.
+     *  \param x The x-values at which the function is evaluated.
+     *  \param n The number of x-values.
+     *  \param p The parameters, as described for the scalar function.
+     *  \param n_p The number of parameters.
+     *  \param out On exit, the \e n function values.
+     */
+    void fexp_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::fexp_jac().
+    /*! \param J On exit, \e n rows of \e n_p derivatives. See stfnum::fexp_batch() for the other parameters.
+     */
+    void fexp_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
+    //! Batch evaluation of stfnum::fexpde().
+    /*! See stfnum::fexp_batch() for a description of the parameters.
+     */
+    void fexpde_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::fexpde_jac().
+    /*! See stfnum::fexp_jac_batch() for a description of the parameters.
+     */
+    void fexpde_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
+    //! Batch evaluation of stfnum::fexpbde().
+    /*! See stfnum::fexp_batch() for a description of the parameters.
+     */
+    void fexpbde_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::fexpbde_jac().
+    /*! See stfnum::fexp_jac_batch() for a description of the parameters.
+     */
+    void fexpbde_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
+    //! Batch evaluation of stfnum::fexptde().
+    /*! See stfnum::fexp_batch() for a description of the parameters.
+     */
+    void fexptde_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::fexptde_jac().
+    /*! See stfnum::fexp_jac_batch() for a description of the parameters.
+     */
+    void fexptde_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
+    //! Batch evaluation of stfnum::falpha().
+    /*! See stfnum::fexp_batch() for a description of the parameters.
+     */
+    void falpha_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::falpha_jac().
+    /*! \param J On exit, \e n rows of \e n_p derivatives. See stfnum::fexp_batch() for the other parameters.
+     */
+    void falpha_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
+    //! Batch evaluation of stfnum::fHH().
+    /*! See stfnum::fexp_batch() for a description of the parameters.
+     */
+    void fHH_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::fHH_jac().
+    /*! See stfnum::fexp_jac_batch() for a description of the parameters.
+     */
+    void fHH_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
+    //! Batch evaluation of stfnum::fgnabiexp().
+    /*! See stfnum::fexp_batch() for a description of the parameters.
+     */
+    void fgnabiexp_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::fgnabiexp_jac().
+    /*! \param J On exit, \e n rows of \e n_p derivatives. See stfnum::fexp_batch() for the other parameters.
+     */
+    void fgnabiexp_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
+    //! Batch evaluation of stfnum::fgauss().
+    /*! See stfnum::fexp_batch() for a description of the parameters.
+     */
+    void fgauss_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* out);
+
+    //! Batch evaluation of stfnum::fgauss_jac().
+    /*! \param J On exit, \e n rows of \e n_p derivatives. See stfnum::fexp_batch() for the other parameters.
+     */
+    void fgauss_jac_batch(const double* x, std::size_t n, const double* p, std::size_t n_p, double* J);
+
     //! Creates stfnum::parInfo structs for n-exponential functions.
     /*! \param n_exp Number of exponential terms.
      *  \return A vector of parameter information structs.
@@ -475,10 +571,56 @@ namespace stfnum {
      */
     std::size_t whereis(const Vector_double& data, double value);
 
+    //! Indices of the functions in the library returned by stfnum::FuncLib().
+    enum func_id {
+        func_mexp = 0,      /*!< Monoexponential. */
+        func_mexp_offset,   /*!< Monoexponential, offset fixed to baseline. */
+        func_mexp_delay,    /*!< Monoexponential with delay. */
+        func_bexp,          /*!< Biexponential. */
+        func_bexp_offset,   /*!< Biexponential, offset fixed to baseline. */
+        func_bexp_delay,    /*!< Biexponential with delay. */
+        func_texp,          /*!< Triexponential. */
+        func_texp_psc,      /*!< Triexponential, initialized for PSCs/PSPs. */
+        func_texp_offset,   /*!< Triexponential, offset fixed to baseline. */
+        func_alpha,         /*!< Alpha function. */
+        func_hh,            /*!< Hodgkin-Huxley g_Na function. */
+        func_gnabiexp,      /*!< Power of 1 g_Na function. */
+        func_gauss,         /*!< Gaussian. */
+        func_texp_delay,    /*!< Triexponential with delay. */
+        func_count          /*!< Number of functions in the library. */
+    };
+
     //! Returns the library of functions for non-linear regression.
-    /*! \return A vector of non-linear regression functions.
+    /*! The library is built once, the first time it's needed, and is shared
+     *  by the whole process; it's never changed afterwards, so that pointers
+     *  to its functions, e.g. stf::SectionAttributes::fitFunc, can be copied
+     *  freely and stay valid. The functions are ordered as in stfnum::func_id.
+     *  \return The non-linear regression functions.
      */
-	StfioDll
+    StfioDll
+    const std::vector<stfnum::storedFunc>& FuncLib();
+
+    //! Returns a function of the library.
+    /*! Throws std::out_of_range if \e id is out of range.
+     *  \param id The index of the function, e.g. a stfnum::func_id.
+     *  \return The function.
+     */
+    StfioDll
+    const stfnum::storedFunc& GetFunc(std::size_t id);
+
+    //! Finds the index of a function in the library.
+    /*! \param func Pointer to a function.
+     *  \return The index of \e func in stfnum::FuncLib(), or the size of the
+     *          library if \e func doesn't point into it.
+     */
+    StfioDll
+    std::size_t FuncId(const stfnum::storedFunc* func);
+
+    //! Returns a copy of the library of functions for non-linear regression.
+    /*! Prefer stfnum::FuncLib(), which doesn't copy the functions.
+     *  \return A vector of non-linear regression functions.
+     */
+    StfioDll
     std::vector<stfnum::storedFunc> GetFuncLib();
 
     /*@}*/
@@ -0,0 +1,27 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file gpu.cpp
+ *  \brief The single entry point of libstfnum's Fourier transforms.
+ */
+
+#include "./gpu.h"
+
+void stfnum::executeR2C(fftw_plan plan, int n, double* in, fftw_complex* out) {
+    fftw_execute_dft_r2c(plan, in, out);
+}
+
+void stfnum::executeC2R(fftw_plan plan, int n, fftw_complex* in, double* out) {
+    fftw_execute_dft_c2r(plan, in, out);
+}
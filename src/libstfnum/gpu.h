@@ -0,0 +1,59 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file gpu.h
+ *  \brief The single entry point of libstfnum's Fourier transforms.
+ *
+ *  All Fourier transforms of libstfnum (filtering, deconvolution and the
+ *  detection criteria) are executed through executeR2C() and executeC2R(),
+ *  which currently run the cached FFTW plans. A backend that offloads
+ *  long transforms, e.g. to a GPU, only needs to be added here; callers
+ *  don't need to know which one was used.
+ */
+
+#ifndef _STFNUM_GPU_H
+#define _STFNUM_GPU_H
+
+#include <fftw3.h>
+
+#include "../libstfio/stfio.h"
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Executes a real-to-complex (forward) transform.
+/*! \param plan A plan returned by stfnum::fftwPlan() for \e n and false.
+ *  \param n The size of the real array.
+ *  \param in The real array of size \e n.
+ *  \param out The complex array of size \e n /2+1.
+ */
+StfioDll void executeR2C(fftw_plan plan, int n, double* in, fftw_complex* out);
+
+//! Executes a complex-to-real (backward) transform.
+/*! As with FFTW, the transform is unnormalized and \e in is overwritten.
+ *  \param plan A plan returned by stfnum::fftwPlan() for \e n and true.
+ *  \param n The size of the real array.
+ *  \param in The complex array of size \e n /2+1.
+ *  \param out The real array of size \e n.
+ */
+StfioDll void executeC2R(fftw_plan plan, int n, fftw_complex* in, double* out);
+
+/*@}*/
+
+}
+
+#endif
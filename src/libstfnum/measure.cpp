@@ -26,19 +26,452 @@
  */
 
 #include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <sstream>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
 #include "./stfnum.h"
 #include "./measure.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/scratch.h"
+#include "../libstfio/section.h"
+#include "../libstfio/parallel.h"
 
-int compareDouble(const void *a, const void *b)
+// Kernels of peak(), maxRise(), maxDecay() and t_half() use two double
+// precision lanes where these are part of the baseline instruction set
+// (SSE2 on x86-64, NEON on AArch64). Only exact operations (subtraction,
+// absolute values, comparisons) are vectorized, so that the results are
+// identical to the scalar code that is used elsewhere. The sums of linRegress()
+// are the only exception; they are accumulated in two lanes and therefore
+// rounded slightly differently than a scalar loop.
+#if !defined(STFNUM_NO_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #include <emmintrin.h>
+    #define STFNUM_SIMD_SSE2
+#elif !defined(STFNUM_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define STFNUM_SIMD_NEON
+#endif
+
+namespace {
+
+#if defined(STFNUM_SIMD_SSE2)
+typedef __m128d simd_d;
+typedef __m128d simd_mask;
+inline simd_d simd_load(const double* p) { return _mm_loadu_pd(p); }
+inline void simd_store(double* p, simd_d a) { _mm_storeu_pd(p, a); }
+inline simd_d simd_set1(double a) { return _mm_set1_pd(a); }
+inline simd_d simd_set2(double lo, double hi) { return _mm_set_pd(hi, lo); }
+inline simd_d simd_add(simd_d a, simd_d b) { return _mm_add_pd(a, b); }
+inline simd_d simd_sub(simd_d a, simd_d b) { return _mm_sub_pd(a, b); }
+inline simd_d simd_mul(simd_d a, simd_d b) { return _mm_mul_pd(a, b); }
+inline simd_d simd_abs(simd_d a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+inline simd_d simd_neg(simd_d a) { return _mm_xor_pd(_mm_set1_pd(-0.0), a); }
+inline simd_mask simd_greater(simd_d a, simd_d b) { return _mm_cmpgt_pd(a, b); }
+inline simd_d simd_select(simd_mask m, simd_d a, simd_d b) {
+    return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b));
+}
+// bit k is set if lane k of a isn't greater than b (or is NaN):
+inline int simd_not_greater_bits(simd_d a, simd_d b) { return _mm_movemask_pd(_mm_cmpngt_pd(a, b)); }
+#define STFNUM_SIMD
+#elif defined(STFNUM_SIMD_NEON)
+typedef float64x2_t simd_d;
+typedef uint64x2_t simd_mask;
+inline simd_d simd_load(const double* p) { return vld1q_f64(p); }
+inline void simd_store(double* p, simd_d a) { vst1q_f64(p, a); }
+inline simd_d simd_set1(double a) { return vdupq_n_f64(a); }
+inline simd_d simd_set2(double lo, double hi) { return vsetq_lane_f64(hi, vdupq_n_f64(lo), 1); }
+inline simd_d simd_add(simd_d a, simd_d b) { return vaddq_f64(a, b); }
+inline simd_d simd_sub(simd_d a, simd_d b) { return vsubq_f64(a, b); }
+inline simd_d simd_mul(simd_d a, simd_d b) { return vmulq_f64(a, b); }
+inline simd_d simd_abs(simd_d a) { return vabsq_f64(a); }
+inline simd_d simd_neg(simd_d a) { return vnegq_f64(a); }
+inline simd_mask simd_greater(simd_d a, simd_d b) { return vcgtq_f64(a, b); }
+inline simd_d simd_select(simd_mask m, simd_d a, simd_d b) { return vbslq_f64(m, a, b); }
+inline int simd_not_greater_bits(simd_d a, simd_d b) {
+    uint64x2_t m = vcgtq_f64(a, b);
+    return (vgetq_lane_u64(m, 0) ? 0 : 1) | (vgetq_lane_u64(m, 1) ? 0 : 2);
+}
+#define STFNUM_SIMD
+#endif
+
+// Pointer-like access to the samples of a waveform. Doubles in memory are
+// read through plain pointers, so that the vectorized helpers below are
+// used for them; other samples are read through a stfnum::SampleView:
+inline const double* samplePtr(const std::vector<double>& data) {
+    return data.empty() ? NULL : &data[0];
+}
+
+inline const double* samplePtr(const stfnum::SampleView<double, stfnum::IdentityScale>& data) {
+    return data.Raw();
+}
+
+template <typename T, typename Scale>
+stfnum::SampleView<T, Scale> samplePtr(const stfnum::SampleView<T, Scale>& data) {
+    return data;
+}
+
+// Values of a waveform relative to a base, oriented so that the peak
+// in the requested direction is the maximum:
+template <typename Ptr>
+struct PeakValues {
+    PeakValues(Ptr x_, double base_, stfnum::direction dir_) : x(x_), base(base_), dir(dir_) {}
+    double operator()(std::size_t k) const {
+        double v = x[k] - base;
+        return dir == stfnum::up ? v : (dir == stfnum::down ? -v : fabs(v));
+    }
+#ifdef STFNUM_SIMD
+    // only used if Ptr is a plain pointer:
+    simd_d load(std::size_t k) const {
+        simd_d v = simd_sub(simd_load(x+k), simd_set1(base));
+        return dir == stfnum::up ? v : (dir == stfnum::down ? simd_neg(v) : simd_abs(v));
+    }
+#endif
+    Ptr x;
+    double base;
+    stfnum::direction dir;
+};
+
+// Absolute differences between points that are w apart:
+template <typename Ptr>
+struct SlopeValues {
+    SlopeValues(Ptr x_, std::size_t w_) : x(x_), w(w_) {}
+    double operator()(std::size_t k) const { return fabs(x[k] - x[k+w]); }
+#ifdef STFNUM_SIMD
+    simd_d load(std::size_t k) const { return simd_abs(simd_sub(simd_load(x+k), simd_load(x+k+w))); }
+#endif
+    Ptr x;
+    std::size_t w;
+};
+
+template <typename Ptr>
+SlopeValues<Ptr> slopeValues(Ptr x, std::size_t w) {
+    return SlopeValues<Ptr>(x, w);
+}
+
+// The vectorized part of argmax_first(); returns the number of values that
+// have been compared. Values that can't be loaded into lanes are left to
+// the scalar loop:
+template <typename Values>
+std::size_t argmax_lanes(const Values&, std::size_t, double&, std::size_t&) {
+    return 0;
+}
+
+#ifdef STFNUM_SIMD
+template <typename Values>
+std::size_t argmax_simd(const Values& values, std::size_t n, double& maxValue, std::size_t& maxIndex) {
+    std::size_t k = 0;
+    if (n >= 4) {
+        // the first maximum of each lane, with its index:
+        simd_d laneMax = simd_set1(-INFINITY);
+        simd_d laneIndex = simd_set1(-1.0);
+        simd_d index = simd_set2(0.0, 1.0);
+        const simd_d two = simd_set1(2.0);
+        for (; k+2 <= n; k += 2) {
+            simd_d v = values.load(k);
+            simd_mask greater = simd_greater(v, laneMax);
+            laneMax = simd_select(greater, v, laneMax);
+            laneIndex = simd_select(greater, index, laneIndex);
+            index = simd_add(index, two);
+        }
+        double lmax[2], lindex[2];
+        simd_store(lmax, laneMax);
+        simd_store(lindex, laneIndex);
+        for (int l = 0; l < 2; ++l) {
+            if (lindex[l] < 0) continue;
+            std::size_t li = (std::size_t)lindex[l];
+            if (lmax[l] > maxValue || (lmax[l] == maxValue && li < maxIndex)) {
+                maxValue = lmax[l];
+                maxIndex = li;
+            }
+        }
+    }
+    return k;
+}
+
+inline std::size_t argmax_lanes(const PeakValues<const double*>& values, std::size_t n,
+                                double& maxValue, std::size_t& maxIndex)
 {
-    return ( ( *(double*)a >  *(double*)b ) - ( *(double*)a < *(double*)b ) );
+    return argmax_simd(values, n, maxValue, maxIndex);
 }
 
-double stfnum::base(enum stfnum::baseline_method base_method, double& var, const std::vector<double>& data, std::size_t llb, std::size_t ulb)
+inline std::size_t argmax_lanes(const SlopeValues<const double*>& values, std::size_t n,
+                                double& maxValue, std::size_t& maxIndex)
+{
+    return argmax_simd(values, n, maxValue, maxIndex);
+}
+#endif
+
+// Finds the first maximum of values(0..n-1), ignoring NaNs. Returns n and
+// leaves maxValue at -INFINITY if no value is greater than -INFINITY.
+template <typename Values>
+std::size_t argmax_first(const Values& values, std::size_t n, double& maxValue) {
+    maxValue = -INFINITY;
+    std::size_t maxIndex = n;
+    std::size_t k = argmax_lanes(values, n, maxValue, maxIndex);
+    for (; k < n; ++k) {
+        double v = values(k);
+        if (maxValue < v) {
+            maxValue = v;
+            maxIndex = k;
+        }
+    }
+    return maxIndex;
+}
+
+// Finds the first k in [begin, end) for which fabs(x[k]-base) > limit doesn't
+// hold, or returns end.
+template <typename Ptr>
+std::size_t first_within(Ptr x, std::size_t begin, std::size_t end, double base, double limit) {
+    for (std::size_t k = begin; k < end; ++k) {
+        if (!(fabs(x[k]-base) > limit)) {
+            return k;
+        }
+    }
+    return end;
+}
+
+// The same for doubles in memory, comparing two points at a time:
+std::size_t first_within(const double* x, std::size_t begin, std::size_t end, double base, double limit) {
+    std::size_t k = begin;
+#ifdef STFNUM_SIMD
+    const simd_d vbase = simd_set1(base), vlimit = simd_set1(limit);
+    for (; k+2 <= end; k += 2) {
+        int bits = simd_not_greater_bits(simd_abs(simd_sub(simd_load(x+k), vbase)), vlimit);
+        if (bits) {
+            return (bits & 1) ? k : k+1;
+        }
+    }
+#endif
+    return first_within<const double*>(x, k, end, base, limit);
+}
+
+// Finds the last k in [begin, end) for which fabs(x[k]-base) > limit doesn't
+// hold, or returns end.
+template <typename Ptr>
+std::size_t last_within(Ptr x, std::size_t begin, std::size_t end, double base, double limit) {
+    for (std::size_t k = end; k > begin; --k) {
+        if (!(fabs(x[k-1]-base) > limit)) {
+            return k-1;
+        }
+    }
+    return end;
+}
+
+// The same for doubles in memory, comparing two points at a time:
+std::size_t last_within(const double* x, std::size_t begin, std::size_t end, double base, double limit) {
+    std::size_t k = end;
+#ifdef STFNUM_SIMD
+    const simd_d vbase = simd_set1(base), vlimit = simd_set1(limit);
+    for (; k >= begin+2; k -= 2) {
+        int bits = simd_not_greater_bits(simd_abs(simd_sub(simd_load(x+k-2), vbase)), vlimit);
+        if (bits) {
+            return (bits & 2) ? k-1 : k-2;
+        }
+    }
+#endif
+    std::size_t found = last_within<const double*>(x, begin, k, base, limit);
+    return found < k ? found : end;
+}
+
+// What a search for a level crossing looks for in fabs(x[k]-base):
+enum crossing_kind {
+    below_level,      // fabs(x[k]-base) < level
+    above_level,      // fabs(x[k]-base) > level
+    not_above_level,  // !(fabs(x[k]-base) > level), which includes NaN
+    not_below_level   // !(fabs(x[k]-base) < level), which includes NaN
+};
+
+struct LevelCrossing {
+    LevelCrossing(double base_, double level_, crossing_kind kind_)
+        : base(base_), level(level_), kind(kind_) {}
+
+    bool Matches(double x) const {
+        double v = fabs(x-base);
+        switch (kind) {
+         case below_level: return v < level;
+         case above_level: return v > level;
+         case not_above_level: return !(v > level);
+         default: return !(v < level);
+        }
+    }
+
+    // true if no value within [min, max] can match. fabs(x-base) is
+    // monotonic on either side of base, also after rounding, so that its
+    // bounds are taken at min and max:
+    bool Excludes(double min, double max) const {
+        if (min != min || max != max) {
+            return false;
+        }
+        double vmin = fabs(min-base), vmax = fabs(max-base);
+        double low = 0.0, high = 0.0;
+        if (max <= base) {
+            low = vmax;
+            high = vmin;
+        } else if (min >= base) {
+            low = vmin;
+            high = vmax;
+        } else {
+            high = vmin > vmax ? vmin : vmax;
+        }
+        switch (kind) {
+         case below_level: return !(low < level);
+         case above_level: return !(high > level);
+         case not_above_level: return low > level;
+         default: return high < level;
+        }
+    }
+
+    double base, level;
+    crossing_kind kind;
+};
+
+// Finds the first k in [begin, end) whose value matches, or returns end.
+// Blocks of the pyramid that can't contain a match are skipped, and the
+// search descends into the others:
+template <typename Ptr>
+std::size_t first_crossing(Ptr x, const stfio::MinMaxPyramid& index,
+                           std::size_t begin, std::size_t end, const LevelCrossing& crossing)
+{
+    const int top = (int)index.GetLevels()-1;
+    int cap = top;
+    std::size_t pos = begin;
+    while (pos < end) {
+        // the largest aligned block below the cap that fits into the rest of the range:
+        int level = cap;
+        double min = 0.0, max = 0.0;
+        for (; level >= 0; --level) {
+            std::size_t size = stfio::MinMaxPyramid::GetBlockSize(level);
+            if (pos % size == 0 && pos + size <= end && index.GetBlock(level, pos/size, min, max)) {
+                break;
+            }
+        }
+        if (level < 0) {
+            if (crossing.Matches(x[pos])) {
+                return pos;
+            }
+            ++pos;
+            cap = top;
+        } else if (crossing.Excludes(min, max)) {
+            pos += stfio::MinMaxPyramid::GetBlockSize(level);
+            cap = top;
+        } else {
+            cap = level-1;
+        }
+    }
+    return end;
+}
+
+// Finds the last k in [begin, end) whose value matches, or returns end.
+template <typename Ptr>
+std::size_t last_crossing(Ptr x, const stfio::MinMaxPyramid& index,
+                          std::size_t begin, std::size_t end, const LevelCrossing& crossing)
+{
+    const int top = (int)index.GetLevels()-1;
+    int cap = top;
+    std::size_t pos = end;
+    while (pos > begin) {
+        int level = cap;
+        double min = 0.0, max = 0.0;
+        for (; level >= 0; --level) {
+            std::size_t size = stfio::MinMaxPyramid::GetBlockSize(level);
+            if (pos % size == 0 && pos >= begin + size && index.GetBlock(level, pos/size-1, min, max)) {
+                break;
+            }
+        }
+        if (level < 0) {
+            if (crossing.Matches(x[pos-1])) {
+                return pos-1;
+            }
+            --pos;
+            cap = top;
+        } else if (crossing.Excludes(min, max)) {
+            pos -= stfio::MinMaxPyramid::GetBlockSize(level);
+            cap = top;
+        } else {
+            cap = level-1;
+        }
+    }
+    return end;
+}
+
+// Finds the first k in [begin, end) for which x[k+w]-x[k] > limit holds if
+// above is true, or doesn't hold if above is false; returns end if there is
+// none.
+template <typename Ptr>
+std::size_t first_slope(Ptr x, std::size_t begin, std::size_t end, std::size_t w,
+                        double limit, bool above)
+{
+    for (std::size_t k = begin; k < end; ++k) {
+        if ((x[k+w] - x[k] > limit) == above) {
+            return k;
+        }
+    }
+    return end;
+}
+
+// The same for doubles in memory. Four differences are compared per
+// iteration before the early exit.
+std::size_t first_slope(const double* x, std::size_t begin, std::size_t end, std::size_t w,
+                        double limit, bool above)
+{
+    std::size_t k = begin;
+#ifdef STFNUM_SIMD
+    const simd_d vlimit = simd_set1(limit);
+    // bits of lanes that match, for both halves of the block:
+    const int flip = above ? 3 : 0;
+    for (; k+4 <= end; k += 4) {
+        int lo = simd_not_greater_bits(simd_sub(simd_load(x+k+w), simd_load(x+k)), vlimit) ^ flip;
+        int hi = simd_not_greater_bits(simd_sub(simd_load(x+k+w+2), simd_load(x+k+2)), vlimit) ^ flip;
+        if (lo | hi) {
+            int bits = lo | (hi << 2);
+            std::size_t first = k;
+            while (!(bits & 1)) {
+                bits >>= 1;
+                ++first;
+            }
+            return first;
+        }
+    }
+#endif
+    return first_slope<const double*>(x, k, end, w, limit, above);
+}
+
+}
+
+namespace {
+
+// Retrieves the values that would be at the positions ranks[0..n_ranks) if
+// data were sorted. Uses repeated selection, which takes linear time on
+// average, instead of sorting. The order of data is changed. At most 6
+// ranks can be retrieved at once.
+void select_ranks(double* data, std::size_t n, const std::size_t* ranks, double* values, std::size_t n_ranks)
+{
+    std::size_t order[6];
+    std::copy(ranks, ranks+n_ranks, order);
+    std::sort(order, order+n_ranks);
+    // everything before begin is known to be smaller than the remaining values:
+    double* begin = data;
+    for (std::size_t n_r = 0; n_r < n_ranks; ++n_r) {
+        double* nth = data+order[n_r];
+        if (nth >= begin) {
+            std::nth_element(begin, nth, data+n);
+            begin = nth+1;
+        }
+    }
+    for (std::size_t n_r = 0; n_r < n_ranks; ++n_r) {
+        values[n_r] = data[ranks[n_r]];
+    }
+}
+
+// base() and peak() work on anything that provides size() and a
+// const operator[], so that compactly stored Sections can be measured
+// without decoding them first:
+template <typename Data>
+double base_impl(enum stfnum::baseline_method base_method, double& var, const Data& data, std::size_t llb, std::size_t ulb)
 {
     if (data.size()==0) return 0;
     if (llb>ulb || ulb>=data.size()) {
@@ -50,41 +483,49 @@ double stfnum::base(enum stfnum::baseline_method base_method, double& var, const
     assert(n <= data.size());
 
     if (base_method == stfnum::median_iqr) {
-	// make  copy of the data for sorting
-        double *a = (double*)malloc(n * sizeof(double));
+        // copy the window into a buffer of the thread's scratch arena:
+        stfio::ScratchScope scratch;
+        double* a = scratch.Doubles(n);
         for (size_t i = 0; i < n; ++i) {
             a[i] = data[i + llb];
         }
-        qsort(a,n,sizeof(double),&compareDouble);
 
-	// get the median
-        if (n % 2)
-            base = a[(n-1)/2];
-        else {
-            n /=2;
-            base = (a[n-1] + a[n]) / 2;
+        // indices of the order statistics that are required for the median
+        // and for the quartiles; note that n is halved for even sizes:
+        std::size_t ranks[6];
+        if (n % 2) {
+            ranks[0] = ranks[1] = (n-1)/2;
+        } else {
+            n /= 2;
+            ranks[0] = n-1;
+            ranks[1] = n;
         }
-
         /*
          *  compute inter-quartile range (IQR) and return in "var"
          *  interpolate as average of upper and lower bound
          *  and make sure that indices are within [0,n-1] interval
          */
-	double Q32 = a[std::min<long>((long)(n-1), (long)ceil(3*n/4.0-1))] + a[std::max<long>(0l, (long)floor(3*n/4.0-1))];
-	double Q12 = a[std::min<long>((long)(n-1), (long)ceil(  n/4.0-1))] + a[std::max<long>(0l, (long)floor(  n/4.0-1))];
-	var = (Q32 - Q12) / 2;
+        ranks[2] = std::min<long>((long)(n-1), (long)ceil(3*n/4.0-1));
+        ranks[3] = std::max<long>(0l, (long)floor(3*n/4.0-1));
+        ranks[4] = std::min<long>((long)(n-1), (long)ceil(  n/4.0-1));
+        ranks[5] = std::max<long>(0l, (long)floor(  n/4.0-1));
+        double values[6];
+        select_ranks(a, ulb - llb + 1, ranks, values, 6);
+
+        base = (values[0] + values[1]) / 2;
+        double Q32 = values[2] + values[3];
+        double Q12 = values[4] + values[5];
+        var = (Q32 - Q12) / 2;
 
-        free(a);
         return base;
     }
     // else  if (method == mean_baseline)
 
     double sumY=0.0;
     //according to the pascal version, every value 
-    //within the window shall be summed up:
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+:sumY)
-#endif
+    //within the window shall be summed up. The sums are serial: base() is
+    //called for every section from within parallel loops, and a team of
+    //threads per window costs more than the window itself:
     for (int i=(int)llb; i<=(int)ulb;++i) {
         sumY+=data[i];
     }
@@ -93,9 +534,6 @@ double stfnum::base(enum stfnum::baseline_method base_method, double& var, const
     // second pass to calculate the variance:
     double varS=0.0;
     double corr=0.0;
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+:varS,corr)
-#endif
     for (int i=(int)llb; i<=(int)ulb;++i) {
         double diff=data[i]-base;
         varS+=diff*diff;
@@ -108,7 +546,61 @@ double stfnum::base(enum stfnum::baseline_method base_method, double& var, const
     return base;
 }
 
-double stfnum::peak(const std::vector<double>& data, double base, std::size_t llp, std::size_t ulp,
+// The average over the pM points around each point of a peak window, as
+// used by peak(). The window moves by a single point at a time, so that
+// a running sum costs O(1) per point regardless of pM. The sum is
+// recomputed from time to time so that rounding errors don't accumulate.
+template <typename Data>
+class RunningMean {
+public:
+    RunningMean(const Data& data_, int pM_) :
+        data(data_), pM(pM_), half((pM_-1)/2), begin(0), end(0), sum(0.0), n_steps(0)
+    {}
+
+    // The mean around point i; i has to increase by 1 between calls.
+    double operator()(std::size_t i) {
+        std::size_t newBegin = i >= half ? i-half : 0;
+        std::size_t newEnd = std::min(newBegin+pM, data.size());
+        if (n_steps++ % resumInterval == 0 || newBegin < begin || newBegin > end) {
+            begin = newBegin;
+            end = newEnd;
+            sum = 0.0;
+            for (std::size_t k = begin; k < end; ++k) {
+                sum += data[k];
+            }
+        } else {
+            for (; begin < newBegin; ++begin) {
+                sum -= data[begin];
+            }
+            for (; end < newEnd; ++end) {
+                sum += data[end];
+            }
+        }
+        return sum / (end-begin);
+    }
+
+    // The mean around point i, summed up directly in the same order as
+    // in the original implementation.
+    double exact(std::size_t i) const {
+        std::size_t first = i >= half ? i-half : 0;
+        std::size_t last = std::min(first+pM, data.size());
+        double exactSum = 0.0;
+        for (std::size_t k = first; k < last; ++k) {
+            exactSum += data[k];
+        }
+        return exactSum / (last-first);
+    }
+
+private:
+    static const std::size_t resumInterval = 1024;
+    const Data& data;
+    std::size_t pM, half, begin, end;
+    double sum;
+    std::size_t n_steps;
+};
+
+template <typename Data>
+double peak_impl(const Data& data, double base, std::size_t llp, std::size_t ulp,
             int pM, stfnum::direction dir, double& maxT)
 {
     if (llp>ulp || ulp>=data.size()) {
@@ -121,17 +613,10 @@ double stfnum::peak(const std::vector<double>& data, double base, std::size_t ll
     double peak=0.0;
 
     if (pM > 0) {
+        RunningMean<Data> mean(data, pM);
         for (std::size_t i=llp+1; i <=ulp; i++) {
             //Calculate peak as the average over pM points around the point i
-            peak=0.0;
-            div_t Div1=div((int)pM-1, 2);
-            int counter = 0;
-            int start = i-Div1.quot;
-            if (start < 0)
-                start = 0;
-            for (counter=start; counter <= start+pM-1 && counter < (int)data.size(); counter++)
-                peak+=data[counter];
-            peak /= (counter-start);
+            peak=mean(i);
             
             //Set peak for BOTH
             if (dir == stfnum::both && fabs(peak-base) > fabs (max-base))
@@ -152,15 +637,16 @@ double stfnum::peak(const std::vector<double>& data, double base, std::size_t ll
                 maxT = (double)i;
             }
         }	//End loop: data points
+        // the running sum may differ from the average in the last bits:
+        if (maxT != (double)llp) {
+            max = mean.exact((std::size_t)maxT);
+        }
         peak = max;
         //End peak and base calculation
         //-------------------------------
     } else {
         if (pM==-1) { // calculate the average within the peak window
             double sumY=0; 
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+:sumY)
-#endif
             for (int i=(int)llp; i<=(int)ulp;++i) {
                 sumY+=data[i];
             }
@@ -175,7 +661,168 @@ double stfnum::peak(const std::vector<double>& data, double base, std::size_t ll
     return peak;
 }
 
-double stfnum::threshold( const std::vector<double>& data, std::size_t llp, std::size_t ulp, double slope, double& thrT, std::size_t windowLength )
+}
+
+double stfnum::base(enum stfnum::baseline_method base_method, double& var, const std::vector<double>& data, std::size_t llb, std::size_t ulb)
+{
+    return base_impl(base_method, var, data, llb, ulb);
+}
+
+namespace {
+
+// Runs a kernel on the samples of a section in their storage format, e.g.
+// on compactly stored 16-bit integers; returns false if the samples have
+// to be decoded one by one instead:
+template <typename Kernel>
+bool measureNative(const Section& sec, Kernel& kernel) {
+    stfio::SampleType type = stfio::sample_float64;
+    double scale = 1.0, shift = 0.0;
+    const void* raw = sec.GetNative(type, scale, shift);
+    if (raw == NULL) {
+        return false;
+    }
+    bool identity = (scale == 1.0 && shift == 0.0);
+    stfnum::LinearScale linear(scale, shift);
+    switch (type) {
+     case stfio::sample_int16:
+         if (identity) {
+             kernel(stfnum::SampleView<short>((const short*)raw, sec.size()));
+         } else {
+             kernel(stfnum::SampleView<short, stfnum::LinearScale>((const short*)raw, sec.size(), linear));
+         }
+         return true;
+     case stfio::sample_float32:
+         if (identity) {
+             kernel(stfnum::SampleView<float>((const float*)raw, sec.size()));
+         } else {
+             kernel(stfnum::SampleView<float, stfnum::LinearScale>((const float*)raw, sec.size(), linear));
+         }
+         return true;
+     case stfio::sample_float64:
+         if (identity) {
+             kernel(stfnum::SampleView<double>((const double*)raw, sec.size()));
+         } else {
+             kernel(stfnum::SampleView<double, stfnum::LinearScale>((const double*)raw, sec.size(), linear));
+         }
+         return true;
+     default:
+         return false;
+    }
+}
+
+struct BaseKernel {
+    BaseKernel(stfnum::baseline_method method_, std::size_t llb_, std::size_t ulb_)
+        : method(method_), llb(llb_), ulb(ulb_), var(0.0), result(0.0) {}
+    template <typename View>
+    void operator()(const View& data) { result = stfnum::base(method, var, data, llb, ulb); }
+    stfnum::baseline_method method;
+    std::size_t llb, ulb;
+    double var, result;
+};
+
+struct PeakKernel {
+    PeakKernel(double base_, std::size_t llp_, std::size_t ulp_, int pM_, stfnum::direction dir_)
+        : base(base_), llp(llp_), ulp(ulp_), pM(pM_), dir(dir_), maxT(0.0), result(0.0) {}
+    template <typename View>
+    void operator()(const View& data) { result = stfnum::peak(data, base, llp, ulp, pM, dir, maxT); }
+    double base;
+    std::size_t llp, ulp;
+    int pM;
+    stfnum::direction dir;
+    double maxT, result;
+};
+
+}
+
+double stfnum::base(enum stfnum::baseline_method base_method, double& var, const Section& data, std::size_t llb, std::size_t ulb)
+{
+    BaseKernel kernel(base_method, llb, ulb);
+    if (measureNative(data, kernel)) {
+        var = kernel.var;
+        return kernel.result;
+    }
+    return base_impl(base_method, var, data, llb, ulb);
+}
+
+Vector_double stfnum::slidingMedian(const Vector_double& data, std::size_t width)
+{
+    stfnum::RunningBaseline median(stfnum::filter_median, width, 50.0, false);
+    Vector_double result = median.Process(data);
+    Vector_double tail = median.Finish();
+    result.insert(result.end(), tail.begin(), tail.end());
+    return result;
+}
+
+namespace {
+
+// peak_impl() for pM == 1, using argmax_first():
+template <typename Ptr>
+double peak_single(Ptr x, double base, std::size_t llp, std::size_t ulp,
+                   stfnum::direction dir, double& maxT)
+{
+    PeakValues<Ptr> values(x, base, dir);
+    double first = values(llp);
+    std::size_t maxIndex = llp;
+    // a NaN at llp is never replaced:
+    if (first == first) {
+        double restMax;
+        std::size_t n_rest = ulp-llp;
+        std::size_t k = argmax_first(PeakValues<Ptr>(x+(llp+1), base, dir), n_rest, restMax);
+        if (k < n_rest && restMax > first) {
+            maxIndex = llp+1+k;
+        }
+    }
+    maxT = (double)maxIndex;
+    return x[maxIndex];
+}
+
+template <typename Data>
+double peak_dispatch(const Data& data, double base, std::size_t llp, std::size_t ulp,
+                     int pM, stfnum::direction dir, double& maxT)
+{
+    if (pM == 1 && dir != stfnum::undefined_direction && llp <= ulp && ulp < data.size()) {
+        return peak_single(samplePtr(data), base, llp, ulp, dir, maxT);
+    }
+    return peak_impl(data, base, llp, ulp, pM, dir, maxT);
+}
+
+}
+
+double stfnum::peak(const std::vector<double>& data, double base, std::size_t llp, std::size_t ulp,
+            int pM, stfnum::direction dir, double& maxT)
+{
+    return peak_dispatch(data, base, llp, ulp, pM, dir, maxT);
+}
+
+template <typename T, typename Scale>
+double stfnum::base(enum stfnum::baseline_method base_method, double& var,
+                    const SampleView<T, Scale>& data, std::size_t llb, std::size_t ulb)
+{
+    return base_impl(base_method, var, data, llb, ulb);
+}
+
+template <typename T, typename Scale>
+double stfnum::peak(const SampleView<T, Scale>& data, double base, std::size_t llp, std::size_t ulp,
+                    int pM, stfnum::direction dir, double& maxT)
+{
+    return peak_dispatch(data, base, llp, ulp, pM, dir, maxT);
+}
+
+double stfnum::peak(const Section& data, double base, std::size_t llp, std::size_t ulp,
+            int pM, stfnum::direction dir, double& maxT)
+{
+    PeakKernel kernel(base, llp, ulp, pM, dir);
+    if (measureNative(data, kernel)) {
+        maxT = kernel.maxT;
+        return kernel.result;
+    }
+    return peak_impl(data, base, llp, ulp, pM, dir, maxT);
+}
+
+namespace {
+
+template <typename Data>
+double threshold_impl(const Data& data, std::size_t llp, std::size_t ulp, double slope, double& thrT, std::size_t windowLength )
 {
     thrT = -1;
     
@@ -195,21 +842,19 @@ double stfnum::threshold( const std::vector<double>& data, std::size_t llp, std:
     double threshold = 0.0;
 
     // find Slope within peak window:
-    for (std::size_t i=llp; i < ulp; ++i) {
-        double diff = data[i + windowLength] - data[i];
-        if (diff > slope * windowLength) {
-            threshold=(data[i+windowLength] + data[i]) / 2.0;
-            thrT = i + windowLength/2.0;
-            break;
-        }
+    std::size_t i = first_slope(samplePtr(data), llp, ulp, windowLength, slope * windowLength, true);
+    if (i < ulp) {
+        threshold=(data[i+windowLength] + data[i]) / 2.0;
+        thrT = i + windowLength/2.0;
     }
 
     return threshold;
 }
 
-double stfnum::risetime(const std::vector<double>& data, double base, double ampl,
+template <typename Data>
+double risetime_impl(const Data& data, double base, double ampl,
                      double left, double right, double frac, std::size_t& tLoId, std::size_t& tHiId,
-                     double& tLoReal)
+                     double& tLoReal, const stfio::MinMaxPyramid* index)
 {
     if (frac <= 0 || frac >=0.5) {
         tLoReal = NAN;
@@ -225,17 +870,34 @@ double stfnum::risetime(const std::vector<double>& data, double base, double amp
         return NAN;
     }
     tLoId=(int)right>=1? (int)right:1;
-    do {
+    if (index != NULL) {
+        // the walks below, with blocks that the walk would pass skipped:
         --tLoId;
-    } 
-    while (fabs(data[tLoId]-base)>fabs(lo*ampl) && tLoId>left);
+        if (tLoId > left) {
+            std::size_t leftStop = (std::size_t)floor(left);
+            std::size_t found = last_crossing(samplePtr(data), *index, leftStop+1, tLoId+1,
+                                              LevelCrossing(base, fabs(lo*ampl), not_above_level));
+            tLoId = found <= tLoId ? found : leftStop;
+        }
+        tHiId=tLoId+1;
+        if (tHiId < right) {
+            std::size_t rightStop = (std::size_t)ceil(right);
+            tHiId = first_crossing(samplePtr(data), *index, tHiId, rightStop,
+                                   LevelCrossing(base, fabs(hi*ampl), not_below_level));
+        }
+    } else {
+        do {
+            --tLoId;
+        } 
+        while (fabs(data[tLoId]-base)>fabs(lo*ampl) && tLoId>left);
 
-    //Hi%of peak
-    tHiId=tLoId;
-    do {
-        ++tHiId;
+        //Hi%of peak
+        tHiId=tLoId;
+        do {
+            ++tHiId;
+        }
+        while (fabs(data[tHiId]-base)<fabs(hi*ampl) && tHiId<right);
     }
-    while (fabs(data[tHiId]-base)<fabs(hi*ampl) && tHiId<right);
 
     //Calculation of real values by linear interpolation: 
     //Lo%of peak
@@ -266,9 +928,11 @@ double stfnum::risetime(const std::vector<double>& data, double base, double amp
     return rtLoHi;  
 }
 
-double stfnum::risetime2(const std::vector<double>& data, double base, double ampl,
+template <typename Data>
+double risetime2_impl(const Data& data, double base, double ampl,
                      double left, double right, double frac,
-                     double& innerTLoReal, double& innerTHiReal, double& outerTLoReal, double& outerTHiReal )
+                     double& innerTLoReal, double& innerTHiReal, double& outerTLoReal, double& outerTHiReal,
+                     const stfio::MinMaxPyramid* index)
 {
     if (frac <= 0 || frac >=0.5) {
         innerTLoReal = NAN;
@@ -312,21 +976,40 @@ double stfnum::risetime2(const std::vector<double>& data, double base, double am
 	fprintf(stdout,"%s %i:RISETIME2\n",__FILE__,__LINE__);
 #endif
 
-    for (k=(long)left; k<=(long)right; k++) {
-		double v = fabs(data[k]-base);
-		if (v < fabs(lo*ampl)) inner_tLoId = k;
-		if (v < fabs(hi*ampl)) outer_tHiId = k;
+    // a single pass finds the last indices below and the first indices
+    // above both levels:
+    double loLevel = fabs(lo*ampl), hiLevel = fabs(hi*ampl);
+    if (index != NULL) {
+        // each of them is searched for from the end where it's expected,
+        // skipping blocks that can't contain it:
+        if ((long)left <= (long)right) {
+            std::size_t begin = (long)left, end = (long)right+1;
+            std::size_t found = last_crossing(samplePtr(data), *index, begin, end,
+                                              LevelCrossing(base, loLevel, below_level));
+            if (found < end) inner_tLoId = found;
+            found = last_crossing(samplePtr(data), *index, begin, end,
+                                  LevelCrossing(base, hiLevel, below_level));
+            if (found < end) outer_tHiId = found;
+            found = first_crossing(samplePtr(data), *index, begin, end,
+                                   LevelCrossing(base, loLevel, above_level));
+            if (found < end) outer_tLoId = found;
+            found = first_crossing(samplePtr(data), *index, begin, end,
+                                   LevelCrossing(base, hiLevel, above_level));
+            if (found < end) inner_tHiId = found;
+        }
+    } else {
+        for (k=(long)left; k<=(long)right; k++) {
+            double v = fabs(data[k]-base);
+            if (v < loLevel) inner_tLoId = k;
+            if (v < hiLevel) outer_tHiId = k;
+            if (outer_tLoId < 0 && v > loLevel) outer_tLoId = k;
+            if (inner_tHiId < 0 && v > hiLevel) inner_tHiId = k;
+        }
     }
 #ifndef NDEBUG
 	fprintf(stdout,"%s %i:RISETIME2 r:%f l:%f \n",__FILE__,__LINE__,right,left);
 #endif
 
-    for (k=(long)right; k>=(long)left; k--) {
-		double v = fabs(data[k]-base);
-		if (v > fabs(lo*ampl)) outer_tLoId = k;
-		if (v > fabs(hi*ampl)) inner_tHiId = k;
-    }
-
 #ifndef NDEBUG
 	fprintf(stdout,"%s %i:RISETIME2: %i %i %i %i\n",__FILE__,__LINE__,(int)outer_tLoId,(int)inner_tLoId,(int)inner_tHiId,(int)outer_tHiId);
 #endif
@@ -391,7 +1074,8 @@ double stfnum::risetime2(const std::vector<double>& data, double base, double am
     return (innerTHiReal-innerTLoReal);
 }
 
-double   stfnum::t_half(const std::vector<double>& data,
+template <typename Data>
+double t_half_impl(const Data& data,
         double base,
         double ampl,
         double left,
@@ -399,7 +1083,8 @@ double   stfnum::t_half(const std::vector<double>& data,
         double center,
         std::size_t& t50LeftId,
         std::size_t& t50RightId,
-        double& t50LeftReal)
+        double& t50LeftReal,
+        const stfio::MinMaxPyramid* index)
 {
     if (center<0 || center>=data.size() || data.size()<=2 || left<-1) {
         t50LeftReal = NAN;
@@ -413,10 +1098,18 @@ double   stfnum::t_half(const std::vector<double>& data,
 #endif
         return NAN;
     }
-    do {
-        --t50LeftId;
-    } while (fabs(data[t50LeftId]-base)>fabs(0.5 * ampl) &&
-            t50LeftId > left);
+    // Walk to the left from the peak until the amplitude has dropped to 50%,
+    // but not beyond left (the search stops at the first index <= left):
+    double halfAmpl = fabs(0.5 * ampl);
+    std::size_t leftStop = left >= 0 ? (std::size_t)floor(left) : 0;
+    --t50LeftId;
+    if (t50LeftId > leftStop) {
+        std::size_t found = index != NULL ?
+            last_crossing(samplePtr(data), *index, leftStop+1, t50LeftId+1,
+                          LevelCrossing(base, halfAmpl, not_above_level)) :
+            last_within(samplePtr(data), leftStop+1, t50LeftId+1, base, halfAmpl);
+        t50LeftId = found <= t50LeftId ? found : leftStop;
+    }
     //Right side half duration
     if ((std::size_t)center <= data.size()-2) {
         t50RightId = center;
@@ -430,10 +1123,15 @@ double   stfnum::t_half(const std::vector<double>& data,
 #endif
         return NAN;
     }
-    do {
-        ++t50RightId;
-    } while (fabs(data[t50RightId]-base)>fabs(0.5 * ampl) &&
-            t50RightId < right);
+    // the same to the right; the search stops at the first index >= right:
+    std::size_t rightStop = right > 0 ? (std::size_t)ceil(right) : 0;
+    ++t50RightId;
+    if (t50RightId < rightStop) {
+        t50RightId = index != NULL ?
+            first_crossing(samplePtr(data), *index, t50RightId, rightStop,
+                           LevelCrossing(base, halfAmpl, not_above_level)) :
+            first_within(samplePtr(data), t50RightId, rightStop, base, halfAmpl);
+    }
 
     //calculation of real values by linear interpolation: 
     //Left side
@@ -458,7 +1156,8 @@ double   stfnum::t_half(const std::vector<double>& data,
     return t50RightReal-t50LeftReal;
 }
 
-double   stfnum::maxRise(const std::vector<double>& data,
+template <typename Data>
+double maxRise_impl(const Data& data,
         double left,
         double right,
         double& maxRiseT,
@@ -478,11 +1177,12 @@ double   stfnum::maxRise(const std::vector<double>& data,
     }
     double maxRise = -INFINITY;  // -Infinity
     maxRiseT = NAN;		// non-a-number
-    size_t i,j;
-    for (i = leftc, j = leftc + windowLength; j <= rightc; i++, j++) {
-        double diff = fabs( data[i] - data[j] );
-        if (maxRise<diff) {
-            maxRise=diff;
+    // differences data[i]-data[i+windowLength] for i+windowLength <= rightc:
+    if (leftc <= rightc && rightc-leftc >= windowLength) {
+        std::size_t n = rightc-windowLength-leftc+1;
+        std::size_t k = argmax_first(slopeValues(samplePtr(data)+leftc, windowLength), n, maxRise);
+        if (k < n) {
+            std::size_t i = leftc+k, j = i+windowLength;
             maxRiseY=(data[i]+data[j])/2.0;
             maxRiseT=(i+windowLength/2.0);
         }
@@ -490,7 +1190,8 @@ double   stfnum::maxRise(const std::vector<double>& data,
     return maxRise/windowLength;
 }
 
-double stfnum::maxDecay(const std::vector<double>& data,
+template <typename Data>
+double maxDecay_impl(const Data& data,
         double left,
         double right,
         double& maxDecayT,
@@ -509,11 +1210,12 @@ double stfnum::maxDecay(const std::vector<double>& data,
     }
     double maxDecay = -INFINITY;  // -Infinity
     maxDecayT = NAN;		// non-a-number
-    size_t i,j;
-    for (j = leftc, i = leftc + windowLength; i < rightc; i++, j++) {
-        double diff = fabs( data[i] - data[j] );
-        if (maxDecay<diff) {
-            maxDecay=diff;
+    // differences data[j+windowLength]-data[j] for j+windowLength < rightc:
+    if (leftc <= rightc && rightc-leftc > windowLength) {
+        std::size_t n = rightc-windowLength-leftc;
+        std::size_t k = argmax_first(slopeValues(samplePtr(data)+leftc, windowLength), n, maxDecay);
+        if (k < n) {
+            std::size_t j = leftc+k, i = j+windowLength;
             maxDecayY=(data[i]+data[j])/2.0;
             maxDecayT=(j+windowLength/2.0);
         }
@@ -521,27 +1223,1157 @@ double stfnum::maxDecay(const std::vector<double>& data,
     return maxDecay/windowLength;
 }
 
-#ifdef WITH_PSLOPE
-double stfnum::pslope(const std::vector<double>& data, std::size_t left, std::size_t right) {
-
-    // data testing not zero 
-    //if (!data.size()) return 0;
-    if (data.size()==0) return 0;
+}
 
-    // cursor testing out of bounds
-    if (left>right || right>data.size()) {
-        return NAN;
+std::vector<stfnum::SlopeCrossing>
+stfnum::slopeCrossings( const std::vector<double>& data, std::size_t llp, std::size_t ulp,
+                        double slope, std::size_t windowLength )
+{
+    std::vector<SlopeCrossing> crossings;
+    if (data.empty() || llp > ulp || ulp >= data.size() || ulp + windowLength > data.size()) {
+        return crossings;
     }
-    // use interpolated data
-    double y2 = ( data[right]+data[right+1] )/(double)2.0;
-    double y1 = ( data[left]+data[left+1] )/(double)2.0;
-    double t2 = (double)(right-0.5);
-    double t1 = (double)(left-0.5);
+    const double* x = &data[0];
+    double limit = slope * windowLength;
+    std::size_t i = llp;
+    while (i < ulp) {
+        i = first_slope(x, i, ulp, windowLength, limit, true);
+        if (i >= ulp) {
+            break;
+        }
+        SlopeCrossing crossing;
+        crossing.value = (data[i+windowLength] + data[i]) / 2.0;
+        crossing.t = i + windowLength/2.0;
+        crossings.push_back(crossing);
+        // the slope has to fall below the threshold before it can be crossed again:
+        i = first_slope(x, i+1, ulp, windowLength, limit, false);
+    }
+    return crossings;
+}
 
-    double SlopeVal = (y2-y1)/(t2-t1);
+double stfnum::threshold( const std::vector<double>& data, std::size_t llp, std::size_t ulp, double slope, double& thrT, std::size_t windowLength )
+{
+    return threshold_impl(data, llp, ulp, slope, thrT, windowLength);
+}
 
-    return SlopeVal;
+double stfnum::risetime(const std::vector<double>& data, double base, double ampl,
+                     double left, double right, double frac, std::size_t& tLoId, std::size_t& tHiId,
+                     double& tLoReal, const stfio::MinMaxPyramid* index)
+{
+    return risetime_impl(data, base, ampl, left, right, frac, tLoId, tHiId, tLoReal, index);
+}
+
+double stfnum::risetime2(const std::vector<double>& data, double base, double ampl,
+                     double left, double right, double frac,
+                     double& innerTLoReal, double& innerTHiReal, double& outerTLoReal, double& outerTHiReal,
+                     const stfio::MinMaxPyramid* index)
+{
+    return risetime2_impl(data, base, ampl, left, right, frac,
+                          innerTLoReal, innerTHiReal, outerTLoReal, outerTHiReal, index);
+}
+
+double stfnum::t_half(const std::vector<double>& data, double base, double ampl, double left, double right,
+                      double center, std::size_t& t50LeftId, std::size_t& t50RightId, double& t50LeftReal,
+                      const stfio::MinMaxPyramid* index)
+{
+    return t_half_impl(data, base, ampl, left, right, center, t50LeftId, t50RightId, t50LeftReal, index);
+}
+
+double stfnum::maxRise(const std::vector<double>& data, double left, double right, double& maxRiseT,
+                       double& maxRiseY, std::size_t windowLength)
+{
+    return maxRise_impl(data, left, right, maxRiseT, maxRiseY, windowLength);
+}
+
+double stfnum::maxDecay(const std::vector<double>& data, double left, double right, double& maxDecayT,
+                        double& maxDecayY, std::size_t windowLength)
+{
+    return maxDecay_impl(data, left, right, maxDecayT, maxDecayY, windowLength);
+}
+
+template <typename T, typename Scale>
+double stfnum::threshold(const SampleView<T, Scale>& data, std::size_t llp, std::size_t ulp,
+                         double slope, double& thrT, std::size_t windowLength)
+{
+    return threshold_impl(data, llp, ulp, slope, thrT, windowLength);
+}
+
+template <typename T, typename Scale>
+double stfnum::risetime(const SampleView<T, Scale>& data, double base, double ampl,
+                        double left, double right, double frac, std::size_t& tLoId, std::size_t& tHiId,
+                        double& tLoReal, const stfio::MinMaxPyramid* index)
+{
+    return risetime_impl(data, base, ampl, left, right, frac, tLoId, tHiId, tLoReal, index);
+}
+
+template <typename T, typename Scale>
+double stfnum::risetime2(const SampleView<T, Scale>& data, double base, double ampl,
+                         double left, double right, double frac,
+                         double& innerTLoReal, double& innerTHiReal, double& outerTLoReal, double& outerTHiReal,
+                         const stfio::MinMaxPyramid* index)
+{
+    return risetime2_impl(data, base, ampl, left, right, frac,
+                          innerTLoReal, innerTHiReal, outerTLoReal, outerTHiReal, index);
+}
+
+template <typename T, typename Scale>
+double stfnum::t_half(const SampleView<T, Scale>& data, double base, double ampl, double left, double right,
+                      double center, std::size_t& t50LeftId, std::size_t& t50RightId, double& t50LeftReal,
+                      const stfio::MinMaxPyramid* index)
+{
+    return t_half_impl(data, base, ampl, left, right, center, t50LeftId, t50RightId, t50LeftReal, index);
+}
+
+template <typename T, typename Scale>
+double stfnum::maxRise(const SampleView<T, Scale>& data, double left, double right, double& maxRiseT,
+                       double& maxRiseY, std::size_t windowLength)
+{
+    return maxRise_impl(data, left, right, maxRiseT, maxRiseY, windowLength);
+}
+
+template <typename T, typename Scale>
+double stfnum::maxDecay(const SampleView<T, Scale>& data, double left, double right, double& maxDecayT,
+                        double& maxDecayY, std::size_t windowLength)
+{
+    return maxDecay_impl(data, left, right, maxDecayT, maxDecayY, windowLength);
+}
+
+// The kernels for the sample types of stfio::compactSamples():
+#define STFNUM_INSTANTIATE_KERNELS(T, Scale) \
+    template double stfnum::base<T, Scale>(enum stfnum::baseline_method, double&, \
+        const stfnum::SampleView<T, Scale>&, std::size_t, std::size_t); \
+    template double stfnum::peak<T, Scale>(const stfnum::SampleView<T, Scale>&, double, \
+        std::size_t, std::size_t, int, stfnum::direction, double&); \
+    template double stfnum::threshold<T, Scale>(const stfnum::SampleView<T, Scale>&, \
+        std::size_t, std::size_t, double, double&, std::size_t); \
+    template double stfnum::risetime<T, Scale>(const stfnum::SampleView<T, Scale>&, double, double, \
+        double, double, double, std::size_t&, std::size_t&, double&, const stfio::MinMaxPyramid*); \
+    template double stfnum::risetime2<T, Scale>(const stfnum::SampleView<T, Scale>&, double, double, \
+        double, double, double, double&, double&, double&, double&, const stfio::MinMaxPyramid*); \
+    template double stfnum::t_half<T, Scale>(const stfnum::SampleView<T, Scale>&, double, double, \
+        double, double, double, std::size_t&, std::size_t&, double&, const stfio::MinMaxPyramid*); \
+    template double stfnum::maxRise<T, Scale>(const stfnum::SampleView<T, Scale>&, double, double, \
+        double&, double&, std::size_t); \
+    template double stfnum::maxDecay<T, Scale>(const stfnum::SampleView<T, Scale>&, double, double, \
+        double&, double&, std::size_t);
+
+STFNUM_INSTANTIATE_KERNELS(short, stfnum::IdentityScale)
+STFNUM_INSTANTIATE_KERNELS(short, stfnum::LinearScale)
+STFNUM_INSTANTIATE_KERNELS(float, stfnum::IdentityScale)
+STFNUM_INSTANTIATE_KERNELS(float, stfnum::LinearScale)
+STFNUM_INSTANTIATE_KERNELS(double, stfnum::IdentityScale)
+STFNUM_INSTANTIATE_KERNELS(double, stfnum::LinearScale)
+
+#undef STFNUM_INSTANTIATE_KERNELS
+
+namespace {
+
+// The same as peak_impl() followed by stfnum::threshold(), but with a
+// single pass over the peak window. Only used for pM > 1; for pM == 1,
+// the vectorized peak() and the early exit of threshold() are faster.
+double peak_and_threshold(const std::vector<double>& data, double base, std::size_t llp, std::size_t ulp,
+                          int pM, stfnum::direction dir, double& maxT,
+                          double slope, std::size_t windowLength, double& threshold, double& thrT)
+{
+    thrT = -1;
+    threshold = 0.0;
+    if (llp>ulp || ulp>=data.size()) {
+        maxT = NAN;
+        thrT = NAN;
+        threshold = NAN;
+        return NAN;
+    }
+    bool findThreshold = true;
+    if (ulp + windowLength > data.size()) {
+        thrT = NAN;
+        threshold = NAN;
+        findThreshold = false;
+    }
+
+    double max=data[llp];
+    maxT=(double)llp;
+    RunningMean<std::vector<double> > mean(data, pM);
+    for (std::size_t i=llp; i <= ulp; ++i) {
+        if (findThreshold && i < ulp) {
+            double diff = data[i + windowLength] - data[i];
+            if (diff > slope * windowLength) {
+                threshold=(data[i+windowLength] + data[i]) / 2.0;
+                thrT = i + windowLength/2.0;
+                findThreshold = false;
+            }
+        }
+        if (i == llp) {
+            continue;
+        }
+        double peak=mean(i);
+
+        if (dir == stfnum::both && fabs(peak-base) > fabs (max-base)) {
+            max = peak;
+            maxT = (double)i;
+        }
+        if (dir == stfnum::up && peak-base > max-base) {
+            max = peak;
+            maxT = (double)i;
+        }
+        if (dir == stfnum::down && peak-base < max-base) {
+            max = peak;
+            maxT = (double)i;
+        }
+    }
+    if (maxT != (double)llp) {
+        max = mean.exact((std::size_t)maxT);
+    }
+    return max;
+}
+
+}
+
+stfnum::MeasurementResults::MeasurementResults() :
+    base(0), baseSD(0), peak(0), maxT(0), threshold(0), thrT(-1),
+    tLoReal(0), tHiReal(0), rtLoHi(0),
+    innerLoRT(NAN), innerHiRT(NAN), outerLoRT(NAN), outerHiRT(NAN),
+    halfDuration(0), t50LeftReal(0), t50RightReal(0), t50Y(0), t0Real(0),
+    maxRise(0), maxRiseT(0), maxRiseY(0), maxDecay(0), maxDecayT(0), maxDecayY(0), slopeRatio(0),
+    tLoIndex(0), tHiIndex(0), t50LeftIndex(0), t50RightIndex(0),
+    APBase(0), APPeak(0), APMaxT(0), APMaxRiseT(0), APMaxRiseY(0), APt50LeftReal(0),
+    APtLoReal(0), APtHiReal(0), APrtLoHi(0), APt0Real(0),
+    APt50LeftIndex(0), APt50RightIndex(0), APtLoIndex(0), APtHiIndex(0),
+    latencyBeg(0), latencyEnd(0), latency(0),
+    regression()
+{}
+
+stfnum::MeasurementPlan::MeasurementPlan() :
+    measurements(stfnum::measure_all),
+    baseBeg(0), baseEnd(0), peakBeg(0), peakEnd(0),
+    baselineMethod(stfnum::mean_sd), pM(1), dir(stfnum::both),
+    RTFactor(20), fromBase(true), slopeForThreshold(20.0),
+    latencyStartMode(stfnum::manual_latency), latencyEndMode(stfnum::manual_latency),
+    latencyBeg(0), latencyEnd(0), slopeBeg(0), slopeEnd(0)
+{}
+
+bool stfnum::MeasurementPlan::operator==(const MeasurementPlan& other) const {
+    return measurements == other.measurements &&
+        baseBeg == other.baseBeg && baseEnd == other.baseEnd &&
+        peakBeg == other.peakBeg && peakEnd == other.peakEnd &&
+        baselineMethod == other.baselineMethod && pM == other.pM && dir == other.dir &&
+        RTFactor == other.RTFactor && fromBase == other.fromBase &&
+        slopeForThreshold == other.slopeForThreshold &&
+        latencyStartMode == other.latencyStartMode && latencyEndMode == other.latencyEndMode &&
+        latencyBeg == other.latencyBeg && latencyEnd == other.latencyEnd &&
+        slopeBeg == other.slopeBeg && slopeEnd == other.slopeEnd;
+}
+
+stfnum::MeasurementCache::MeasurementCache() :
+    sec(NULL), secSize(0), secData(NULL), reference(NULL), refSize(0), refData(NULL), dt(0.0),
+    buffer(0), refBuffer(0), plan(), res(),
+    hasBase(false), hasRegression(false), hasPeak(false), hasThreshold(false), hasReference(false)
+{}
+
+void stfnum::MeasurementCache::Clear() {
+    sec = NULL;
+    secSize = 0;
+    secData = NULL;
+    reference = NULL;
+    refSize = 0;
+    refData = NULL;
+    Vector_double(0).swap(buffer);
+    Vector_double(0).swap(refBuffer);
+    hasBase = hasRegression = hasPeak = hasThreshold = hasReference = false;
+}
+
+stfnum::MeasurementResults stfnum::MeasurementPlan::Evaluate(const Section& sec, double dt,
+                                                             const Section* reference) const
+{
+    MeasurementCache cache;
+    return Evaluate(sec, dt, reference, cache);
+}
+
+stfnum::MeasurementResults stfnum::MeasurementPlan::Evaluate(const Section& sec, double dt,
+                                                             const Section* reference,
+                                                             MeasurementCache& cache) const
+{
+    if (sec.size() == 0) {
+        throw std::out_of_range("Empty section in stfnum::MeasurementPlan::Evaluate()");
+    }
+    double SR = 1.0/dt;
+    MeasurementResults res;
+
+    // Decode compactly stored data once, without keeping them in the section:
+    const double* secData = sec.IsMapped() ? NULL : &sec.get()[0];
+    if (cache.sec != &sec || cache.secSize != sec.size() || cache.secData != secData) {
+        cache.Clear();
+        if (sec.IsMapped()) {
+            cache.buffer.resize(sec.size());
+            sec.CopyRange(0, sec.size(), &cache.buffer[0]);
+        }
+        cache.sec = &sec;
+        cache.secSize = sec.size();
+        cache.secData = secData;
+    }
+    if (cache.dt != dt) {
+        cache.hasRegression = cache.hasPeak = cache.hasThreshold = cache.hasReference = false;
+        cache.dt = dt;
+    }
+    const Vector_double& data = sec.IsMapped() ? cache.buffer : sec.get();
+    const MeasurementPlan& last = cache.plan;
+
+    /*
+       windowLength (defined in samples) determines the size of the window for computing slopes.
+       if the window length larger than 1 is used, a kind of smoothing and low pass filtering is applied.
+       If slope estimates from data with different sampling rates should be compared, the
+       window should be choosen in such a way that the length in milliseconds is approximately the same.
+
+       Set window length to 0.05 ms, with a minimum of 1 sample. In this way, all data
+       sampled with 20 kHz or lower, will use a 1 sample window, data with a larger sampling rate
+       use a window of 0.05 ms for computing the slope.
+    */
+    long windowLength = lround(0.05 * SR);
+    if (windowLength < 1) windowLength = 1;
+
+    bool wantLatency = (measurements & measure_latency) != 0;
+    bool wantReference = reference != NULL && reference->size() > 0 &&
+        ((measurements & measure_reference) != 0 ||
+         (wantLatency && latencyStartMode != stfnum::manual_latency));
+
+    // The same for the reference section:
+    if (wantReference) {
+        const double* refData = reference->IsMapped() ? NULL : &reference->get()[0];
+        if (cache.reference != reference || cache.refSize != reference->size() || cache.refData != refData) {
+            cache.hasReference = false;
+            Vector_double(0).swap(cache.refBuffer);
+            if (reference->IsMapped()) {
+                cache.refBuffer.resize(reference->size());
+                reference->CopyRange(0, reference->size(), &cache.refBuffer[0]);
+            }
+            cache.reference = reference;
+            cache.refSize = reference->size();
+            cache.refData = refData;
+        }
+    }
+    bool sameReference = wantReference && cache.hasReference &&
+        last.baseBeg == baseBeg && last.baseEnd == baseEnd && last.baselineMethod == baselineMethod &&
+        last.peakBeg == peakBeg && last.peakEnd == peakEnd && last.pM == pM && last.dir == dir;
+    if (sameReference) {
+        const MeasurementResults& prev = cache.res;
+        res.APBase = prev.APBase;
+        res.APPeak = prev.APPeak;
+        res.APMaxT = prev.APMaxT;
+        res.APMaxRiseT = prev.APMaxRiseT;
+        res.APMaxRiseY = prev.APMaxRiseY;
+        res.APt50LeftIndex = prev.APt50LeftIndex;
+        res.APt50RightIndex = prev.APt50RightIndex;
+        res.APt50LeftReal = prev.APt50LeftReal;
+        res.APtLoIndex = prev.APtLoIndex;
+        res.APtHiIndex = prev.APtHiIndex;
+        res.APtLoReal = prev.APtLoReal;
+        res.APrtLoHi = prev.APrtLoHi;
+        res.APtHiReal = prev.APtHiReal;
+        res.APt0Real = prev.APt0Real;
+    }
+
+    // Both channels are measured at the same time unless sections are
+    // already measured in parallel, e.g. by stfnum::evaluateWindows():
+    bool measureRef = wantReference && !sameReference;
+    unsigned int done = 0;
+    double foot = 0.0;
+    std::string secError, refError;
+#ifdef _OPENMP
+#pragma omp parallel sections num_threads(2) if (measureRef && !omp_in_parallel())
+#endif
+    {
+#ifdef _OPENMP
+#pragma omp section
+#endif
+        {
+            try {
+                done = MeasureSection(sec, data, dt, windowLength, cache, res, foot);
+            }
+            catch (const std::out_of_range& e) {
+                secError = e.what();
+            }
+        }
+#ifdef _OPENMP
+#pragma omp section
+#endif
+        {
+            if (measureRef) {
+                try {
+                    MeasureReference(*reference, reference->IsMapped() ? cache.refBuffer : reference->get(),
+                                     windowLength, res);
+                }
+                catch (const std::out_of_range& e) {
+                    refError = e.what();
+                }
+            }
+        }
+    }
+    if (!secError.empty()) {
+        throw std::out_of_range(secError);
+    }
+    if (!refError.empty()) {
+        throw std::out_of_range(refError);
+    }
+
+    // Only now that nothing can throw anymore:
+    cache.plan = *this;
+    cache.res = res;
+    cache.hasBase = true;
+    cache.hasRegression = (done & measure_regression_slope) != 0;
+    cache.hasPeak = (done & measure_peak) != 0;
+    cache.hasThreshold = (done & measure_threshold) != 0;
+    cache.hasReference = wantReference;
+
+    if (!wantLatency) {
+        return res;
+    }
+    switch (latencyStartMode) {
+     case stfnum::peak_latency:
+         res.latencyBeg = res.APMaxT;
+         break;
+     case stfnum::rise_latency:
+         res.latencyBeg = res.APMaxRiseT;
+         break;
+     case stfnum::half_latency:
+         res.latencyBeg = res.APt50LeftReal;
+         break;
+     case stfnum::manual_latency:
+     default:
+         res.latencyBeg = latencyBeg;
+         break;
+    }
+    switch (latencyEndMode) {
+     case stfnum::foot_latency:
+         res.latencyEnd = foot;
+         break;
+     case stfnum::rise_latency:
+         res.latencyEnd = res.maxRiseT;
+         break;
+     case stfnum::half_latency:
+         res.latencyEnd = res.t50LeftReal;
+         break;
+     case stfnum::peak_latency:
+         res.latencyEnd = res.maxT;
+         break;
+     case stfnum::manual_latency:
+     default:
+         res.latencyEnd = latencyEnd;
+         break;
+    }
+    res.latency = res.latencyEnd-res.latencyBeg;
+
+    return res;
+}
+
+unsigned int stfnum::MeasurementPlan::MeasureSection(const Section& sec, const Vector_double& data, double dt,
+                                                     long windowLength, const MeasurementCache& cache,
+                                                     MeasurementResults& res, double& foot) const
+{
+    double SR = 1.0/dt;
+    const MeasurementPlan& last = cache.plan;
+
+    // Only the requested measurements and the ones they depend on are done:
+    bool wantLatency = (measurements & measure_latency) != 0;
+    bool footLatency = wantLatency && latencyEndMode == stfnum::foot_latency;
+    bool needSlopes = (measurements & measure_slopes) != 0 ||
+        (wantLatency && latencyEndMode == stfnum::rise_latency);
+    bool needRise = (measurements & measure_risetime) != 0 || footLatency ||
+        (latencyEndMode == stfnum::foot_latency && (measurements & measure_half_duration) != 0);
+    // the maximal slope of decay is searched within the half duration:
+    bool needHalf = (measurements & measure_half_duration) != 0 || needSlopes ||
+        (wantLatency && latencyEndMode == stfnum::half_latency);
+    bool needInnerOuter = (measurements & measure_inner_outer_risetime) != 0;
+    bool needAmplitude = needRise || needHalf || needInnerOuter;
+    bool needThreshold = (measurements & measure_threshold) != 0 || (needAmplitude && !fromBase);
+    bool needPeak = needThreshold || needAmplitude || needSlopes ||
+        (measurements & measure_peak) != 0 || wantLatency;
+
+    // Everything below the baseline depends on it:
+    bool sameBase = cache.hasBase && last.baseBeg == baseBeg && last.baseEnd == baseEnd &&
+        last.baselineMethod == baselineMethod;
+    if (sameBase) {
+        res.base = cache.res.base;
+        res.baseSD = cache.res.baseSD;
+    } else {
+        double var = 0.0;
+        res.base = stfnum::base(baselineMethod, var, data, baseBeg, baseEnd);
+        res.baseSD = sqrt(var);
+    }
+    bool wantRegression = (measurements & measure_regression_slope) != 0 && slopeEnd > slopeBeg;
+    if (wantRegression) {
+        if (cache.hasRegression && last.slopeBeg == slopeBeg && last.slopeEnd == slopeEnd) {
+            res.regression = cache.res.regression;
+        } else {
+            if (slopeEnd >= data.size()) {
+                throw std::out_of_range("Slope cursor out of range in stfnum::MeasurementPlan::Evaluate()");
+            }
+            res.regression = linRegress(&data[slopeBeg], slopeEnd-slopeBeg+1, dt);
+        }
+    }
+    bool samePeak = sameBase && cache.hasPeak && cache.hasThreshold == needThreshold &&
+        last.peakBeg == peakBeg && last.peakEnd == peakEnd && last.pM == pM && last.dir == dir &&
+        (!needThreshold || last.slopeForThreshold == slopeForThreshold);
+    if (needPeak && samePeak) {
+        res.peak = cache.res.peak;
+        res.maxT = cache.res.maxT;
+        res.threshold = cache.res.threshold;
+        res.thrT = cache.res.thrT;
+    } else if (needPeak) {
+        if (pM > 1 && needThreshold) {
+            res.peak = peak_and_threshold(data, res.base, peakBeg, peakEnd, pM, dir, res.maxT,
+                                          slopeForThreshold/SR, windowLength, res.threshold, res.thrT);
+        } else {
+            res.peak = stfnum::peak(data, res.base, peakBeg, peakEnd, pM, dir, res.maxT);
+            if (needThreshold) {
+                res.threshold = stfnum::threshold(data, peakBeg, peakEnd, slopeForThreshold/SR, res.thrT, windowLength);
+            }
+        }
+    }
+
+    // reference is either from baseline or from threshold
+    double reference_value = res.base;
+    if (!fromBase && res.thrT >= 0) {
+        reference_value = res.threshold;
+    }
+    double ampl = res.peak-reference_value;
+    double factor = RTFactor*0.01;
+    // crossings are searched for with the min/max pyramid of the section,
+    // which is kept for as long as the section isn't modified:
+    const stfio::MinMaxPyramid* index = needAmplitude ? &sec.GetPyramid() : NULL;
+
+    if (needInnerOuter) {
+        stfnum::risetime2(data, reference_value, ampl, 0.0, res.maxT, factor,
+                          res.innerLoRT, res.innerHiRT, res.outerLoRT, res.outerHiRT, index);
+        res.innerLoRT /= SR;
+        res.innerHiRT /= SR;
+        res.outerLoRT /= SR;
+        res.outerHiRT /= SR;
+    }
+
+    foot = 0.0;
+    if (needRise) {
+        res.rtLoHi = stfnum::risetime(data, reference_value, ampl, 0.0, res.maxT, factor,
+                                      res.tLoIndex, res.tHiIndex, res.tLoReal, index);
+        res.tHiReal = res.tLoReal+res.rtLoHi;
+        res.rtLoHi /= SR;
+        // beginning of the event by linear extrapolation of the 20-80% rise time
+        // (f/(1-2f) = 0.2/(1-0.4) = 1/3.0):
+        foot = res.tLoReal-(res.tHiReal-res.tLoReal)/3.0;
+    }
+
+    if (needHalf) {
+        res.halfDuration = stfnum::t_half(data, reference_value, ampl, 0.0, (double)data.size()-1, res.maxT,
+                                          res.t50LeftIndex, res.t50RightIndex, res.t50LeftReal, index);
+        res.t50RightReal = res.t50LeftReal+res.halfDuration;
+        res.halfDuration /= SR;
+        res.t50Y = 0.5*ampl + reference_value;
+    }
+    if (latencyEndMode == stfnum::foot_latency) {
+        res.t0Real = foot;
+    } else {
+        res.t0Real = res.t50LeftReal;
+    }
+
+    if (needSlopes) {
+        res.maxRise = stfnum::maxRise(data, (double)peakBeg, res.maxT, res.maxRiseT, res.maxRiseY, windowLength);
+        double t_half_3 = res.t50RightIndex+2.0*(res.t50RightIndex-res.t50LeftIndex);
+        double right_decay = peakEnd<=t_half_3 ? peakEnd : t_half_3+1;
+        res.maxDecay = stfnum::maxDecay(data, res.maxT, right_decay, res.maxDecayT, res.maxDecayY, windowLength);
+        if (res.maxDecay != 0) res.slopeRatio = res.maxRise/res.maxDecay;
+        else res.slopeRatio = 0.0;
+        res.maxRise *= SR;
+        res.maxDecay *= SR;
+    }
+
+    unsigned int done = 0;
+    if (wantRegression) done |= measure_regression_slope;
+    if (needPeak) done |= measure_peak;
+    if (needPeak && needThreshold) done |= measure_threshold;
+    return done;
+}
+
+void stfnum::MeasurementPlan::MeasureReference(const Section& reference, const Vector_double& refdata,
+                                               long windowLength, MeasurementResults& res) const
+{
+    // use the baseline cursors of the measured channel:
+    double APVar = 0.0;
+    res.APBase = stfnum::base(baselineMethod, APVar, refdata, baseBeg, baseEnd);
+    res.APPeak = stfnum::peak(refdata, res.APBase, peakBeg, peakEnd, pM, dir, res.APMaxT);
+
+    // maximal slope in the rise before the peak:
+    const int searchRange = 100;
+    double left_APRise = res.APMaxT-searchRange>2.0 ? res.APMaxT-searchRange : 2.0;
+    try {
+        stfnum::maxRise(refdata, left_APRise, res.APMaxT, res.APMaxRiseT, res.APMaxRiseY, windowLength);
+    }
+    catch (const std::out_of_range&) {
+        res.APMaxRiseT = 0.0;
+        res.APMaxRiseY = 0.0;
+        left_APRise = peakBeg;
+    }
+    // as in the measured channel, crossings are searched for with the pyramid:
+    const stfio::MinMaxPyramid* index = &reference.GetPyramid();
+    stfnum::t_half(refdata, res.APBase, res.APPeak-res.APBase, left_APRise,
+                   (double)refdata.size(), res.APMaxT, res.APt50LeftIndex,
+                   res.APt50RightIndex, res.APt50LeftReal, index);
+    res.APrtLoHi = stfnum::risetime(refdata, res.APBase, res.APPeak-res.APBase, 0.0,
+                                    res.APMaxT, 0.2, res.APtLoIndex, res.APtHiIndex, res.APtLoReal, index);
+    res.APtHiReal = res.APtLoReal + res.APrtLoHi;
+    res.APt0Real = res.APtLoReal-(res.APtHiReal-res.APtLoReal)/3.0;
+}
+
+double stfnum::MeasurementPlan::AlignmentPoint(const Section& sec, double dt, alignment_mode mode,
+                                               bool reference) const
+{
+    if (sec.size() == 0) {
+        throw std::out_of_range("Empty section in stfnum::MeasurementPlan::AlignmentPoint()");
+    }
+    double SR = 1.0/dt;
+    Vector_double buffer;
+    if (sec.IsMapped()) {
+        buffer.resize(sec.size());
+        sec.CopyRange(0, sec.size(), &buffer[0]);
+    }
+    const Vector_double& data = sec.IsMapped() ? buffer : sec.get();
+
+    // The same measurements as in Evaluate(), skipping everything that
+    // the alignment point doesn't depend on:
+    long windowLength = lround(0.05 * SR);
+    if (windowLength < 1) windowLength = 1;
+
+    double var = 0.0, maxT = 0.0;
+    double base = stfnum::base(baselineMethod, var, data, baseBeg, baseEnd);
+
+    if (reference) {
+        double APPeak = stfnum::peak(data, base, peakBeg, peakEnd, pM, dir, maxT);
+        if (mode == align_peak) {
+            return maxT;
+        }
+        if (mode == align_onset) {
+            std::size_t tLoIndex = 0, tHiIndex = 0;
+            double tLoReal = 0.0;
+            double rt = stfnum::risetime(data, base, APPeak-base, 0.0, maxT, 0.2,
+                                         tLoIndex, tHiIndex, tLoReal);
+            return tLoReal-rt/3.0;
+        }
+        const int searchRange = 100;
+        double left_APRise = maxT-searchRange>2.0 ? maxT-searchRange : 2.0;
+        double maxRiseT = 0.0, maxRiseY = 0.0;
+        try {
+            stfnum::maxRise(data, left_APRise, maxT, maxRiseT, maxRiseY, windowLength);
+        }
+        catch (const std::out_of_range&) {
+            maxRiseT = 0.0;
+            left_APRise = peakBeg;
+        }
+        if (mode == align_rise) {
+            return maxRiseT;
+        }
+        std::size_t t50LeftIndex = 0, t50RightIndex = 0;
+        double t50LeftReal = 0.0;
+        stfnum::t_half(data, base, APPeak-base, left_APRise, (double)data.size(), maxT,
+                       t50LeftIndex, t50RightIndex, t50LeftReal);
+        return t50LeftReal;
+    }
+
+    bool needsAmplitude = (mode == align_half || mode == align_onset);
+    double peakValue = 0.0, reference_value = base;
+    if (needsAmplitude && !fromBase && pM > 1) {
+        double threshold = 0.0, thrT = -1;
+        peakValue = peak_and_threshold(data, base, peakBeg, peakEnd, pM, dir, maxT,
+                                       slopeForThreshold/SR, windowLength, threshold, thrT);
+        if (thrT >= 0) reference_value = threshold;
+    } else {
+        peakValue = stfnum::peak(data, base, peakBeg, peakEnd, pM, dir, maxT);
+        if (needsAmplitude && !fromBase) {
+            double thrT = -1;
+            double threshold = stfnum::threshold(data, peakBeg, peakEnd, slopeForThreshold/SR, thrT, windowLength);
+            if (thrT >= 0) reference_value = threshold;
+        }
+    }
+    switch (mode) {
+     case align_peak:
+         return maxT;
+     case align_rise: {
+         double maxRiseT = 0.0, maxRiseY = 0.0;
+         stfnum::maxRise(data, (double)peakBeg, maxT, maxRiseT, maxRiseY, windowLength);
+         return maxRiseT;
+     }
+     default:
+         break;
+    }
+    double ampl = peakValue-reference_value;
+    if (mode == align_onset && latencyEndMode == stfnum::foot_latency) {
+        std::size_t tLoIndex = 0, tHiIndex = 0;
+        double tLoReal = 0.0;
+        double rt = stfnum::risetime(data, reference_value, ampl, 0.0, maxT, RTFactor*0.01,
+                                     tLoIndex, tHiIndex, tLoReal);
+        return tLoReal-rt/3.0;
+    }
+    std::size_t t50LeftIndex = 0, t50RightIndex = 0;
+    double t50LeftReal = 0.0;
+    stfnum::t_half(data, reference_value, ampl, 0.0, (double)data.size()-1, maxT,
+                   t50LeftIndex, t50RightIndex, t50LeftReal);
+    return t50LeftReal;
+}
+
+std::vector<int> stfnum::alignmentPoints(const Channel& ch, const std::vector<std::size_t>& sections,
+                                         double dt, const MeasurementPlan& plan, alignment_mode mode,
+                                         bool reference, bool peakAtEnd, int n_threads)
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::alignmentPoints()");
+        }
+    }
+    int n_sections = (int)sections.size();
+    std::vector<int> points(n_sections, 0);
+    std::string error;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        const Section& sec = ch[sections[n_s]];
+        MeasurementPlan secPlan(plan);
+        if (peakAtEnd && sec.size() > 0) {
+            secPlan.peakEnd = sec.size()-1;
+        }
+        try {
+            points[n_s] = (int)lround(secPlan.AlignmentPoint(sec, dt, mode, reference));
+        }
+        catch (const std::out_of_range& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_alignment_error)
+#endif
+            if (error.empty()) error = e.what();
+        }
+    }
+    if (!error.empty()) {
+        throw std::out_of_range(error);
+    }
+    return points;
+}
+
+#ifdef WITH_PSLOPE
+double stfnum::pslope(const std::vector<double>& data, std::size_t left, std::size_t right) {
+
+    // data testing not zero 
+    //if (!data.size()) return 0;
+    if (data.size()==0) return 0;
+
+    // cursor testing out of bounds
+    if (left>right || right>data.size()) {
+        return NAN;
+    }
+    // use interpolated data
+    double y2 = ( data[right]+data[right+1] )/(double)2.0;
+    double y1 = ( data[left]+data[left+1] )/(double)2.0;
+    double t2 = (double)(right-0.5);
+    double t1 = (double)(left-0.5);
+
+    double SlopeVal = (y2-y1)/(t2-t1);
+
+    return SlopeVal;
+}
+#endif // WITH_PSLOPE
+
+namespace {
+
+// Number of data points that are decoded at once from mapped sections:
+const std::size_t regressionBlockSize = 4096;
+
+// Sums of uniformly sampled points k = 0..n-1, relative to the first y value
+// so that a large offset doesn't cancel the variance:
+struct RegressionSums {
+    RegressionSums() : n(0), y0(0), sy(0), sky(0), syy(0) {}
+    std::size_t n;
+    double y0, sy, sky, syy;
+};
+
+// Adds the next len points to the sums:
+void add_regression_sums(RegressionSums& sums, const double* y, std::size_t len) {
+    if (sums.n == 0 && len > 0) {
+        sums.y0 = y[0];
+    }
+    double sy = 0.0, sky = 0.0, syy = 0.0;
+    std::size_t k = 0;
+#ifdef STFNUM_SIMD
+    if (len >= 4) {
+        simd_d y0 = simd_set1(sums.y0);
+        simd_d index = simd_set2((double)sums.n, (double)sums.n+1.0);
+        const simd_d two = simd_set1(2.0);
+        simd_d vsy = simd_set1(0.0), vsky = simd_set1(0.0), vsyy = simd_set1(0.0);
+        for (; k+2 <= len; k += 2) {
+            simd_d v = simd_sub(simd_load(y+k), y0);
+            vsy = simd_add(vsy, v);
+            vsky = simd_add(vsky, simd_mul(index, v));
+            vsyy = simd_add(vsyy, simd_mul(v, v));
+            index = simd_add(index, two);
+        }
+        double lanes[2];
+        simd_store(lanes, vsy);
+        sy = lanes[0] + lanes[1];
+        simd_store(lanes, vsky);
+        sky = lanes[0] + lanes[1];
+        simd_store(lanes, vsyy);
+        syy = lanes[0] + lanes[1];
+    }
+#endif
+    for (; k < len; ++k) {
+        double v = y[k] - sums.y0;
+        sy += v;
+        sky += (double)(sums.n+k) * v;
+        syy += v*v;
+    }
+    sums.sy += sy;
+    sums.sky += sky;
+    sums.syy += syy;
+    sums.n += len;
+}
+
+// Regression line from the means and the centred sums of squares and products:
+stfnum::LinRegression finish_regression(std::size_t n, double meanX, double meanY,
+                                        double sxx, double sxy, double syy)
+{
+    stfnum::LinRegression res;
+    res.n = n;
+    res.slope = sxy / sxx;
+    res.intercept = meanY - res.slope*meanX;
+    res.chisqr = std::max(syy - res.slope*sxy, 0.0);
+    if (syy > 0) {
+        res.r = std::max(std::min(sxy / sqrt(sxx*syy), 1.0), -1.0);
+    }
+    if (n > 2) {
+        double s2 = res.chisqr / (n-2.0);
+        res.slopeSE = sqrt(s2 / sxx);
+        res.interceptSE = sqrt(s2 * (1.0/n + meanX*meanX/sxx));
+    }
+    return res;
+}
+
+stfnum::LinRegression finish_regression(const RegressionSums& sums, double dt, double x0) {
+    double n = (double)sums.n;
+    double meanK = (n-1.0) / 2.0;
+    // sum of (k-meanK)^2 over k = 0..n-1:
+    double skk = n*(n*n-1.0) / 12.0;
+    double meanY = sums.sy / n;
+    // (k-meanK) sums to 0, so that y needn't be centred:
+    double sky = sums.sky - meanK*sums.sy;
+    double syy = sums.syy - sums.sy*meanY;
+    return finish_regression(sums.n, x0 + meanK*dt, sums.y0 + meanY, skk*dt*dt, sky*dt, syy);
+}
+
+}
+
+stfnum::LinRegression::LinRegression() :
+    slope(NAN), intercept(NAN), r(NAN), slopeSE(NAN), interceptSE(NAN), chisqr(NAN), n(0)
+{}
+
+stfnum::LinRegression stfnum::linRegress(const double* y, std::size_t n, double dt, double x0) {
+    if (n < 2) {
+        throw std::out_of_range("Too few points in stfnum::linRegress()");
+    }
+    RegressionSums sums;
+    add_regression_sums(sums, y, n);
+    return finish_regression(sums, dt, x0);
+}
+
+stfnum::LinRegression stfnum::linRegress(const std::vector<double>& x, const std::vector<double>& y) {
+    if (x.size() != y.size()) {
+        throw std::out_of_range("x and y differ in size in stfnum::linRegress()");
+    }
+    std::size_t n = x.size();
+    if (n < 2) {
+        throw std::out_of_range("Too few points in stfnum::linRegress()");
+    }
+    double x0 = x[0], y0 = y[0];
+    double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, syy = 0.0;
+    for (std::size_t k = 0; k < n; ++k) {
+        double u = x[k] - x0;
+        double v = y[k] - y0;
+        sx += u;
+        sy += v;
+        sxx += u*u;
+        sxy += u*v;
+        syy += v*v;
+    }
+    double meanU = sx / n;
+    double meanV = sy / n;
+    return finish_regression(n, x0 + meanU, y0 + meanV,
+                             sxx - sx*meanU, sxy - sx*meanV, syy - sy*meanV);
+}
+
+stfnum::LinRegression stfnum::linRegress(const Section& sec, std::size_t begin, std::size_t end, double dt) {
+    if (end > sec.size() || begin >= end) {
+        throw std::out_of_range("Range out of bounds in stfnum::linRegress()");
+    }
+    if (!sec.IsMapped()) {
+        return linRegress(&sec.get()[begin], end-begin, dt);
+    }
+    if (end-begin < 2) {
+        throw std::out_of_range("Too few points in stfnum::linRegress()");
+    }
+    RegressionSums sums;
+    Vector_double buffer(std::min(regressionBlockSize, end-begin));
+    for (std::size_t start = begin; start < end; start += regressionBlockSize) {
+        std::size_t len = std::min(regressionBlockSize, end-start);
+        sec.CopyRange(start, start+len, &buffer[0]);
+        add_regression_sums(sums, &buffer[0], len);
+    }
+    return finish_regression(sums, dt, 0.0);
+}
+
+stfnum::MeasurementJob::MeasurementJob(const MeasurementPlan& plan_, const Section* sec_,
+                                       double dt_, const Section* reference_) :
+    plan(plan_), sec(sec_), dt(dt_), reference(reference_)
+{}
+
+namespace {
+
+// Measures a range of jobs; every job writes to its own slots only.
+class EvaluateJobs : public stfio::RangeTask {
+public:
+    EvaluateJobs(const std::vector<stfnum::MeasurementJob>& jobs_,
+                 std::vector<stfnum::MeasurementResults>& results_, std::vector<std::string>& errors_) :
+        jobs(jobs_), results(results_), errors(errors_)
+    {}
+
+    void Run(std::size_t begin, std::size_t end, int thread) {
+        for (std::size_t n_j = begin; n_j < end; ++n_j) {
+            const stfnum::MeasurementJob& job = jobs[n_j];
+            if (job.sec == NULL) {
+                continue;
+            }
+            try {
+                results[n_j] = job.plan.Evaluate(*job.sec, job.dt, job.reference);
+            }
+            catch (const std::exception& e) {
+                errors[n_j] = e.what();
+                if (errors[n_j].empty()) {
+                    errors[n_j] = "Unknown error";
+                }
+            }
+        }
+    }
+
+private:
+    const std::vector<stfnum::MeasurementJob>& jobs;
+    std::vector<stfnum::MeasurementResults>& results;
+    std::vector<std::string>& errors;
+};
+
+}
+
+std::vector<stfnum::MeasurementResults> stfnum::evaluateMany(const std::vector<MeasurementJob>& jobs,
+                                                             std::vector<std::string>& errors, int n_threads)
+{
+    std::vector<MeasurementResults> results(jobs.size());
+    errors.assign(jobs.size(), std::string());
+    // the jobs may differ widely in their windows and in the storage of
+    // their sections, so that idle threads steal jobs from busy ones:
+    EvaluateJobs task(jobs, results, errors);
+    stfio::parallelFor(jobs.size(), task, n_threads);
+    return results;
+}
+
+stfnum::MeasurementWindow::MeasurementWindow(const std::string& name_, const MeasurementPlan& plan_) :
+    name(name_), plan(plan_)
+{}
+
+void stfnum::MultiWindowPlan::Add(const std::string& name, const MeasurementPlan& plan) {
+    if (Find(name) >= 0) {
+        throw std::runtime_error("Window " + name + " exists already in stfnum::MultiWindowPlan::Add()");
+    }
+    windows.push_back(MeasurementWindow(name, plan));
+}
+
+int stfnum::MultiWindowPlan::Find(const std::string& name) const {
+    for (std::size_t n_w = 0; n_w < windows.size(); ++n_w) {
+        if (windows[n_w].name == name) {
+            return (int)n_w;
+        }
+    }
+    return -1;
+}
+
+std::vector<stfnum::MeasurementResults> stfnum::MultiWindowPlan::Evaluate(const Section& sec, double dt,
+                                                                          const Section* reference) const
+{
+    // the cache keeps the decoded data and the results of the previous
+    // window, which later windows reuse where their settings agree:
+    MeasurementCache cache;
+    std::vector<MeasurementResults> results;
+    results.reserve(windows.size());
+    for (std::size_t n_w = 0; n_w < windows.size(); ++n_w) {
+        results.push_back(windows[n_w].plan.Evaluate(sec, dt, reference, cache));
+    }
+    return results;
+}
+
+std::vector<std::vector<stfnum::MeasurementResults> >
+stfnum::evaluateWindows(const Channel& ch, const std::vector<std::size_t>& sections, double dt,
+                        const MultiWindowPlan& plan, const Channel* reference, int n_threads)
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::evaluateWindows()");
+        }
+    }
+    int n_sections = (int)sections.size();
+    std::vector<std::vector<MeasurementResults> > results(n_sections);
+    std::string error;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        std::size_t index = sections[n_s];
+        const Section* refsec = (reference != NULL && index < reference->size()) ? &(*reference)[index] : NULL;
+        try {
+            results[n_s] = plan.Evaluate(ch[index], dt, refsec);
+        }
+        catch (const std::out_of_range& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_windows_error)
+#endif
+            if (error.empty()) error = e.what();
+        }
+    }
+    if (!error.empty()) {
+        throw std::out_of_range(error);
+    }
+    return results;
+}
+
+std::vector<stfnum::LinRegression> stfnum::linRegress(const Channel& ch, const std::vector<std::size_t>& sections,
+                                                      std::size_t begin, std::size_t end, double dt, int n_threads)
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::linRegress()");
+        }
+    }
+    int n_sections = (int)sections.size();
+    std::vector<LinRegression> lines(n_sections);
+    std::string error;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        try {
+            lines[n_s] = linRegress(ch[sections[n_s]], begin, end, dt);
+        }
+        catch (const std::out_of_range& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_regression_error)
+#endif
+            if (error.empty()) error = e.what();
+        }
+    }
+    if (!error.empty()) {
+        throw std::out_of_range(error);
+    }
+    return lines;
+}
+
+stfnum::StepResponse::StepResponse() :
+    base(NAN), response(NAN)
+{}
+
+std::vector<stfnum::StepResponse> stfnum::stepResponses(const Channel& ch, const std::vector<std::size_t>& sections,
+                                                        std::size_t baseBeg, std::size_t baseEnd,
+                                                        std::size_t respBeg, std::size_t respEnd,
+                                                        baseline_method method, int n_threads)
+{
+    if (baseBeg > baseEnd || respBeg > respEnd) {
+        throw std::out_of_range("Window out of range in stfnum::stepResponses()");
+    }
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::stepResponses()");
+        }
+        if (std::max(baseEnd, respEnd) >= ch[sections[n]].size()) {
+            throw std::out_of_range("Window out of range in stfnum::stepResponses()");
+        }
+    }
+    int n_sections = (int)sections.size();
+    std::vector<StepResponse> responses(n_sections);
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        // the windows have been checked, so that nothing throws in here:
+        const Section& sec = ch[sections[n_s]];
+        double var = 0;
+        responses[n_s].base = stfnum::base(method, var, sec, baseBeg, baseEnd);
+        responses[n_s].response = stfnum::base(method, var, sec, respBeg, respEnd);
+    }
+    return responses;
+}
+
+Vector_double stfnum::resistance(const Channel& ch, const std::vector<std::size_t>& sections,
+                                 std::size_t baseBeg, std::size_t baseEnd,
+                                 std::size_t respBeg, std::size_t respEnd,
+                                 double step, int n_threads)
+{
+    std::vector<StepResponse> responses =
+        stepResponses(ch, sections, baseBeg, baseEnd, respBeg, respEnd, mean_sd, n_threads);
+    Vector_double r(responses.size());
+    for (std::size_t n = 0; n < responses.size(); ++n) {
+        r[n] = step / (responses[n].response - responses[n].base);
+    }
+    return r;
+}
+
+stfnum::Table stfnum::ivCurve(const Channel& ch, const std::vector<std::size_t>& sections,
+                              std::size_t baseBeg, std::size_t baseEnd,
+                              std::size_t respBeg, std::size_t respEnd,
+                              const Vector_double& commands, int n_threads)
+{
+    if (commands.empty()) {
+        throw std::out_of_range("No commands in stfnum::ivCurve()");
+    }
+    std::vector<StepResponse> responses =
+        stepResponses(ch, sections, baseBeg, baseEnd, respBeg, respEnd, mean_sd, n_threads);
+
+    std::size_t n_steps = commands.size();
+    Vector_double sum(n_steps, 0.0), sumsq(n_steps, 0.0);
+    std::vector<std::size_t> count(n_steps, 0);
+    for (std::size_t n = 0; n < responses.size(); ++n) {
+        double amp = responses[n].response - responses[n].base;
+        sum[n % n_steps] += amp;
+        sumsq[n % n_steps] += amp*amp;
+        ++count[n % n_steps];
+    }
+
+    Table table(n_steps, 4);
+    table.SetColLabel(0, "Command");
+    table.SetColLabel(1, "Response");
+    table.SetColLabel(2, "SD");
+    table.SetColLabel(3, "n");
+    for (std::size_t n_st = 0; n_st < n_steps; ++n_st) {
+        std::ostringstream label;
+        label << "Step #" << n_st+1;
+        table.SetRowLabel(n_st, label.str());
+        table.at(n_st, 0) = commands[n_st];
+        table.at(n_st, 3) = (double)count[n_st];
+        if (count[n_st] == 0) {
+            table.SetEmpty(n_st, 1);
+            table.SetEmpty(n_st, 2);
+            continue;
+        }
+        double mean = sum[n_st] / count[n_st];
+        table.at(n_st, 1) = mean;
+        if (count[n_st] > 1) {
+            double var = (sumsq[n_st] - count[n_st]*mean*mean) / (count[n_st]-1);
+            table.at(n_st, 2) = sqrt(std::max(var, 0.0));
+        } else {
+            table.SetEmpty(n_st, 2);
+        }
+    }
+    return table;
 }
-#endif // WITH_PSLOPE
 
 
@@ -32,6 +32,13 @@
 #include <vector>
 
 #include "../libstfio/stfio.h"
+#include "./stfnum.h"
+
+class Channel;
+
+namespace stfio {
+    class MinMaxPyramid;
+}
 
 namespace stfnum {
 
@@ -52,6 +59,24 @@ namespace stfnum {
 StfioDll
 double base(enum stfnum::baseline_method method, double& var, const std::vector<double>& data, std::size_t llb, std::size_t ulb);
 
+//! Calculate the baseline of a Section without decoding compactly stored data.
+/*! See stfnum::base() above for a description of the parameters.
+ */
+StfioDll
+double base(enum stfnum::baseline_method method, double& var, const Section& data, std::size_t llb, std::size_t ulb);
+
+//! Computes the running median of \e data, e.g. as a baseline of gap-free recordings.
+/*! Each value is the median of a window of \e width sampling points around
+ *  the corresponding point of \e data; the window is truncated at both ends
+ *  of \e data. Each point takes O(log(width)) time.
+ *  Throws std::out_of_range if \e width is 0.
+ *  \param data The data waveform to be analysed.
+ *  \param width The width of the window in sampling points.
+ *  \return The running median, with the same size as \e data.
+ */
+StfioDll
+Vector_double slidingMedian(const Vector_double& data, std::size_t width);
+
 
 //! Find the peak value of \e data between \e llp and \e ulp.
 /*! Note that peaks will be detected by measuring from \e base, but the return value
@@ -73,6 +98,13 @@ double base(enum stfnum::baseline_method method, double& var, const std::vector<
 StfioDll
 double peak( const std::vector<double>& data, double base, std::size_t llp, std::size_t ulp,
         int pM, stfnum::direction, double& maxT);
+
+//! Find the peak value of a Section without decoding compactly stored data.
+/*! See stfnum::peak() above for a description of the parameters.
+ */
+StfioDll
+double peak( const Section& data, double base, std::size_t llp, std::size_t ulp,
+        int pM, stfnum::direction, double& maxT);
  
 //! Find the value within \e data between \e llp and \e ulp at which \e slope is exceeded.
 /*! \param data The data waveform to be analysed.
@@ -88,6 +120,30 @@ double peak( const std::vector<double>& data, double base, std::size_t llp, std:
 StfioDll
 double threshold( const std::vector<double>& data, std::size_t llp, std::size_t ulp, double slope, double& thrT, std::size_t windowLength );
 
+//! A crossing of a slope threshold found by stfnum::slopeCrossings().
+struct SlopeCrossing {
+    double value; /*!< The interpolated threshold value, as returned by stfnum::threshold(). */
+    double t;     /*!< The interpolated time point in units of sampling points, as thrT of stfnum::threshold(). */
+};
+
+//! Find all points within \e data between \e llp and \e ulp at which \e slope is exceeded.
+/*! Unlike stfnum::threshold(), which stops at the first crossing, this
+ *  function scans the whole window once, e.g. to find the thresholds of
+ *  all action potentials of a spike train. After a crossing, the slope has
+ *  to fall to or below \e slope again before the next crossing is counted.
+ *  The first crossing is the one that stfnum::threshold() returns.
+ *  \param data The data waveform to be analysed.
+ *  \param llp Lower limit of the window.
+ *  \param ulp Upper limit of the window.
+ *  \param slope The slope threshold, in units of data per sampling point.
+ *  \param windowLength The distance (in number of samples) used to compute the difference.
+ *  \return The crossings in chronological order; empty if there are none or
+ *          if the window is out of range.
+ */
+StfioDll
+std::vector<SlopeCrossing> slopeCrossings( const std::vector<double>& data, std::size_t llp, std::size_t ulp,
+                                           double slope, std::size_t windowLength );
+
 //! Find 20 to 80% rise time of an event in \e data.
 /*! Although t80real is not explicitly returned, it can be calculated
  *  from t20Real+risetime.
@@ -102,12 +158,15 @@ double threshold( const std::vector<double>& data, std::size_t llp, std::size_t
  *  \param t20Real the linearly interpolated 20%-timepoint in
  *         units of sampling points.
 
+ *  \param index A min/max pyramid of \e data, e.g. from Section::GetPyramid(),
+ *         or NULL. Blocks of data points that can't contain a crossing are
+ *         skipped; the result is the same as without the pyramid.
  *  \return The rise time.
  */
 StfioDll
 double risetime(const std::vector<double>& data, double base, double ampl,
                 double left, double right, double frac, std::size_t& tLoId, std::size_t& tHiId,
-                double& tLoReal);
+                double& tLoReal, const stfio::MinMaxPyramid* index = NULL);
 
 //! Find 20 to 80% rise time of an event in \e data.
 /*! Although t80real is not explicitly returned, it can be calculated
@@ -125,13 +184,18 @@ double risetime(const std::vector<double>& data, double base, double ampl,
     the inner rise time is (innerTHiReal-innerTLoReal),
     the outer rise time is (outerTHiReal-outerTLoReal),
     in case of noise free data, inner and outer rise time are the same.
+ *  \param index A min/max pyramid of \e data, e.g. from Section::GetPyramid(),
+ *         or NULL. The four crossings are then searched for separately,
+ *         skipping blocks of data points that can't contain them, rather
+ *         than in a single pass over the whole range; the results are the same.
 
  *  \return The inner rise time.
  */
 StfioDll
 double risetime2(const std::vector<double>& data, double base, double ampl,
                 double left, double right, double frac,
-                double& innerTLoReal, double& innerTHiReal, double& outerTLoReal, double& outerTHiReal );
+                double& innerTLoReal, double& innerTHiReal, double& outerTLoReal, double& outerTHiReal,
+                const stfio::MinMaxPyramid* index = NULL);
 
 //! Find the full width at half-maximal amplitude of an event within \e data.
 /*! Although t50RightReal is not explicitly returned, it can be calculated
@@ -148,11 +212,15 @@ double risetime2(const std::vector<double>& data, double base, double ampl,
  *  \param t50RightId On exit, the index wich is closest to the right 50%-point.
  *  \param t50LeftReal the linearly interpolated left 50%-timepoint in 
  *         units of sampling points.
+ *  \param index A min/max pyramid of \e data, e.g. from Section::GetPyramid(),
+ *         or NULL. Blocks of data points that can't contain a crossing are
+ *         skipped; the result is the same as without the pyramid.
  *  \return The full width at half-maximal amplitude.
  */
 StfioDll
 double t_half( const std::vector<double>& data, double base, double ampl, double left, double right,
-               double center, std::size_t& t50LeftId, std::size_t& t50RightId, double& t50LeftReal );
+               double center, std::size_t& t50LeftId, std::size_t& t50RightId, double& t50LeftReal,
+               const stfio::MinMaxPyramid* index = NULL );
 
 //! Find the maximal slope during the rising phase of an event within \e data.
 /*! \param data The data waveform to be analysed.
@@ -184,6 +252,109 @@ StfioDll
 double  maxDecay( const std::vector<double>& data, double left, double right, double& maxDecayT,
                   double& maxDecayY, std::size_t windowLength);
 
+//! Scale policy of stfnum::SampleView for samples that are measured as they are stored.
+struct IdentityScale {
+    //! Converts a stored sample to its value.
+    double operator()(double raw) const { return raw; }
+};
+
+//! Scale policy of stfnum::SampleView for samples whose value is scale*raw+shift.
+struct LinearScale {
+    //! Constructor.
+    /*! \param scale_ Scaling factor applied to the stored values.
+     *  \param shift_ Offset added to the scaled values.
+     */
+    LinearScale(double scale_ = 1.0, double shift_ = 0.0) : scale(scale_), shift(shift_) {}
+    //! Converts a stored sample to its value.
+    double operator()(double raw) const { return scale*raw + shift; }
+    double scale; /*!< Scaling factor applied to the stored values. */
+    double shift; /*!< Offset added to the scaled values. */
+};
+
+//! Read-only view of samples of type \e T that are converted to doubles on access.
+/*! Lets the measurement kernels below work on samples in their storage
+ *  format, e.g. on 16-bit integers (see Section::GetNative()), without
+ *  decoding the whole waveform into a vector of doubles first. Values are
+ *  converted exactly as by the const Section::operator[], so that the
+ *  results are the same as for the decoded waveform. Explicit instantiations
+ *  of the kernels exist for short, float and double samples with either policy.
+ */
+template <typename T, typename Scale = IdentityScale>
+class SampleView {
+public:
+    //! Constructor.
+    /*! \param data_ Pointer to the first sample.
+     *  \param n_ Number of samples.
+     *  \param scale_ Converts stored samples to their values.
+     */
+    SampleView(const T* data_, std::size_t n_, const Scale& scale_ = Scale())
+        : data(data_), n(n_), scale(scale_) {}
+
+    //! Unchecked access.
+    /*! \param at Sample index.
+     *  \return The value of the sample.
+     */
+    double operator[](std::size_t at) const { return scale((double)data[at]); }
+
+    //! A view of the samples from \e at onwards.
+    SampleView operator+(std::size_t at) const { return SampleView(data+at, n-at, scale); }
+
+    //! Number of samples.
+    std::size_t size() const { return n; }
+
+    //! Pointer to the first stored sample.
+    const T* Raw() const { return data; }
+
+private:
+    const T* data;
+    std::size_t n;
+    Scale scale;
+};
+
+//! stfnum::base() of stored samples.
+template <typename T, typename Scale>
+StfioDll double base(enum stfnum::baseline_method method, double& var,
+                     const SampleView<T, Scale>& data, std::size_t llb, std::size_t ulb);
+
+//! stfnum::peak() of stored samples.
+template <typename T, typename Scale>
+StfioDll double peak(const SampleView<T, Scale>& data, double base, std::size_t llp, std::size_t ulp,
+                     int pM, stfnum::direction dir, double& maxT);
+
+//! stfnum::threshold() of stored samples.
+template <typename T, typename Scale>
+StfioDll double threshold(const SampleView<T, Scale>& data, std::size_t llp, std::size_t ulp,
+                          double slope, double& thrT, std::size_t windowLength);
+
+//! stfnum::risetime() of stored samples.
+template <typename T, typename Scale>
+StfioDll double risetime(const SampleView<T, Scale>& data, double base, double ampl,
+                         double left, double right, double frac, std::size_t& tLoId, std::size_t& tHiId,
+                         double& tLoReal, const stfio::MinMaxPyramid* index = NULL);
+
+//! stfnum::risetime2() of stored samples.
+template <typename T, typename Scale>
+StfioDll double risetime2(const SampleView<T, Scale>& data, double base, double ampl,
+                          double left, double right, double frac,
+                          double& innerTLoReal, double& innerTHiReal, double& outerTLoReal, double& outerTHiReal,
+                          const stfio::MinMaxPyramid* index = NULL);
+
+//! stfnum::t_half() of stored samples.
+template <typename T, typename Scale>
+StfioDll double t_half(const SampleView<T, Scale>& data, double base, double ampl, double left, double right,
+                       double center, std::size_t& t50LeftId, std::size_t& t50RightId, double& t50LeftReal,
+                       const stfio::MinMaxPyramid* index = NULL);
+
+//! stfnum::maxRise() of stored samples.
+template <typename T, typename Scale>
+StfioDll double maxRise(const SampleView<T, Scale>& data, double left, double right, double& maxRiseT,
+                        double& maxRiseY, std::size_t windowLength);
+
+//! stfnum::maxDecay() of stored samples.
+template <typename T, typename Scale>
+StfioDll double maxDecay(const SampleView<T, Scale>& data, double left, double right, double& maxDecayT,
+                         double& maxDecayY, std::size_t windowLength);
+
 #ifdef WITH_PSLOPE
 //! Find the slope an event within \e data.
 /*! \param data The data waveform to be analysed.
@@ -194,6 +365,447 @@ double  maxDecay( const std::vector<double>& data, double left, double right, do
 double pslope( const std::vector<double>& data, std::size_t left, std::size_t right);
 
 #endif
+
+//! Results of a closed-form linear regression (see stfnum::linRegress()).
+struct StfioDll LinRegression {
+    //! Constructor. Sets the number of points to 0 and all other values to NAN.
+    LinRegression();
+
+    double slope;       /*!< Slope of the regression line. */
+    double intercept;   /*!< y-intercept of the regression line. */
+    double r;           /*!< Pearson's correlation coefficient, or NAN if the y values are constant. */
+    double slopeSE;     /*!< Standard error of the slope, or NAN if there are fewer than 3 points. */
+    double interceptSE; /*!< Standard error of the y-intercept, or NAN if there are fewer than 3 points. */
+    double chisqr;      /*!< Sum of squared residuals. */
+    std::size_t n;      /*!< Number of points. */
+};
+
+//! Least-squares regression line of uniformly sampled data.
+/*! The regression is computed in closed form from a single pass over the
+ *  data, two points at a time where SIMD instructions are available; the
+ *  summation order therefore differs from stfnum::linFit().
+ *  Throws std::out_of_range if \e n is smaller than 2.
+ *  \param y The y- values.
+ *  \param n The number of points.
+ *  \param dt The sampling interval; point k has an x value of \e x0 + k * \e dt.
+ *  \param x0 The x value of the first point.
+ *  \return The regression line and its statistics.
+ */
+StfioDll
+LinRegression linRegress( const double* y, std::size_t n, double dt, double x0 = 0.0 );
+
+//! Least-squares regression line of arbitrary x- and y- values.
+/*! Throws std::out_of_range if \e x and \e y differ in size or have fewer than 2 points.
+ *  \param x The x- values.
+ *  \param y The y- values.
+ *  \return The regression line and its statistics.
+ */
+StfioDll
+LinRegression linRegress( const std::vector<double>& x, const std::vector<double>& y );
+
+//! Regression line of a range of a Section without decoding compactly stored data.
+/*! Compactly stored data are decoded in blocks. x values are given in x units
+ *  from \e begin, as in fits of the same range.
+ *  Throws std::out_of_range if the range is out of bounds or has fewer than 2 points.
+ *  \param sec The section.
+ *  \param begin The first index of the range.
+ *  \param end One past the last index of the range.
+ *  \param dt The sampling interval.
+ *  \return The regression line and its statistics.
+ */
+StfioDll
+LinRegression linRegress( const Section& sec, std::size_t begin, std::size_t end, double dt );
+
+//! Regression lines of the same range in several sections.
+/*! Sections are processed in parallel; each of them gives the same result as
+ *  linRegress() of a single section.
+ *  Throws std::out_of_range if a section index or the range is out of bounds.
+ *  \param ch The channel.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param begin The first index of the range.
+ *  \param end One past the last index of the range.
+ *  \param dt The sampling interval.
+ *  \param n_threads Number of sections that are processed in parallel; 0 uses the configured number of threads.
+ *  \return The regression lines in the order of \e sections.
+ */
+StfioDll
+std::vector<LinRegression> linRegress( const Channel& ch, const std::vector<std::size_t>& sections,
+                                       std::size_t begin, std::size_t end, double dt, int n_threads = 0 );
+
+//! Baseline and steady-state response of a step protocol in one section.
+struct StfioDll StepResponse {
+    //! Constructor. Sets all values to NAN.
+    StepResponse();
+
+    double base;     /*!< Mean of the baseline window. */
+    double response; /*!< Mean of the response window. */
+};
+
+//! Measures the baseline and the response to a step in several sections.
+/*! Sections are processed in parallel and are read in place where
+ *  possible; both windows include their ends, as the cursors of
+ *  MeasurementPlan. Throws std::out_of_range if a section index is out
+ *  of range or a window exceeds a section.
+ *  \param ch The channel.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param baseBeg First index of the baseline window.
+ *  \param baseEnd Last index of the baseline window.
+ *  \param respBeg First index of the response window.
+ *  \param respEnd Last index of the response window.
+ *  \param method Mean or median of the windows.
+ *  \param n_threads Number of sections that are processed in parallel; 0 uses the configured number of threads.
+ *  
+eturn The responses in the order of \e sections.
+ */
+StfioDll
+std::vector<StepResponse> stepResponses( const Channel& ch, const std::vector<std::size_t>& sections,
+                                         std::size_t baseBeg, std::size_t baseEnd,
+                                         std::size_t respBeg, std::size_t respEnd,
+                                         baseline_method method = mean_sd, int n_threads = 0 );
+
+//! Time course of a resistance measured with a test pulse in every section.
+/*! The resistance of each section is \e step / (response - base), e.g.
+ *  the series or input resistance in GOhm for a step in mV and a current
+ *  in pA. See stfnum::stepResponses() for the other parameters.
+ *  \param step The amplitude of the command step.
+ *  
+eturn The resistances in the order of \e sections; infinite if
+ *          there is no response.
+ */
+StfioDll
+Vector_double resistance( const Channel& ch, const std::vector<std::size_t>& sections,
+                          std::size_t baseBeg, std::size_t baseEnd,
+                          std::size_t respBeg, std::size_t respEnd,
+                          double step, int n_threads = 0 );
+
+//! Current-voltage (or voltage-current) relation of a step protocol.
+/*! The k-th section of \e sections was recorded with the command
+ *  commands[k % commands.size()], so that repeated protocols are averaged.
+ *  The table has a row for every command with the columns "Command",
+ *  "Response" (mean of response - base), "SD" and "n". The cells of
+ *  commands without sections are empty. See stfnum::stepResponses() for
+ *  the other parameters; throws std::out_of_range if \e commands is empty.
+ *  \param commands The command of every step of the protocol.
+ *  
+eturn The IV table.
+ */
+StfioDll
+Table ivCurve( const Channel& ch, const std::vector<std::size_t>& sections,
+               std::size_t baseBeg, std::size_t baseEnd,
+               std::size_t respBeg, std::size_t respEnd,
+               const Vector_double& commands, int n_threads = 0 );
+
+//! Modes for setting the latency cursors in MeasurementPlan.
+/*! The values match stf::latency_mode of the GUI.
+ */
+enum latency_mode {
+    manual_latency = 0, /*!< Use the latency cursor of the plan. */
+    peak_latency = 1,   /*!< Use the peak. */
+    rise_latency = 2,   /*!< Use the maximal slope of rise. */
+    half_latency = 3,   /*!< Use the half-maximal amplitude. */
+    foot_latency = 4    /*!< Use the beginning of an event (end of latency only). */
+};
+
+//! Time points that sections can be aligned to before averaging.
+/*! The values match the choices of the alignment dialog.
+ */
+enum alignment_mode {
+    align_peak = 0,  /*!< Align to the peak. */
+    align_rise = 1,  /*!< Align to the maximal slope of rise. */
+    align_half = 2,  /*!< Align to the half-maximal amplitude. */
+    align_onset = 3  /*!< Align to the beginning of an event. */
+};
+
+//! Groups of measurements that MeasurementPlan::Evaluate() can be restricted to.
+/*! Flags can be combined; the baseline is always measured. Measurements that
+ *  a requested one depends on are done as well.
+ */
+enum measurement_flags {
+    measure_peak = 1,                  /*!< Peak value and time. */
+    measure_threshold = 2,             /*!< Threshold crossing. */
+    measure_risetime = 4,              /*!< Lo-Hi% rise time. */
+    measure_inner_outer_risetime = 8,  /*!< Inner and outer rise times (see stfnum::risetime2()). */
+    measure_half_duration = 16,        /*!< Half duration and the onset of the event. */
+    measure_slopes = 32,               /*!< Maximal slopes of rise and decay, and their ratio. */
+    measure_reference = 64,            /*!< Time points of the reference channel. */
+    measure_latency = 128,             /*!< Latency. */
+    measure_regression_slope = 256,    /*!< Regression line between the slope cursors. */
+    measure_all = 511                  /*!< All of the above. */
+};
+
+//! Results of MeasurementPlan::Evaluate().
+/*! Time points (members ending in T, Real or Index) and the latency are given
+ *  in units of sampling points; rise times, half durations and slopes are
+ *  given in x units, as shown in the results table. Time points of the reference
+ *  channel start with AP and are only set if a reference section was passed.
+ */
+struct StfioDll MeasurementResults {
+    //! Constructor. Sets all values to 0.
+    MeasurementResults();
+
+    double base, baseSD, peak, maxT, threshold, thrT;
+    double tLoReal, tHiReal, rtLoHi;
+    double innerLoRT, innerHiRT, outerLoRT, outerHiRT;
+    double halfDuration, t50LeftReal, t50RightReal, t50Y, t0Real;
+    double maxRise, maxRiseT, maxRiseY, maxDecay, maxDecayT, maxDecayY, slopeRatio;
+    std::size_t tLoIndex, tHiIndex, t50LeftIndex, t50RightIndex;
+
+    double APBase, APPeak, APMaxT, APMaxRiseT, APMaxRiseY, APt50LeftReal;
+    double APtLoReal, APtHiReal, APrtLoHi, APt0Real;
+    std::size_t APt50LeftIndex, APt50RightIndex, APtLoIndex, APtHiIndex;
+
+    double latencyBeg, latencyEnd, latency;
+
+    //! Regression line between the slope cursors.
+    /*! The slope is given in y units per x unit; x is measured from MeasurementPlan::slopeBeg.
+     */
+    LinRegression regression;
+};
+
+class MeasurementCache;
+
+//! Cursor and measurement settings that can be applied to many sections.
+/*! This is the GUI-free counterpart of wxStfDoc::Measure(). Cursor positions
+ *  are given in sampling points and include both ends.
+ */
+struct StfioDll MeasurementPlan {
+    //! Constructor. Sets defaults that match a new document.
+    MeasurementPlan();
+
+    //! Applies the plan to a section.
+    /*! The data are decoded only once, and the peak window is scanned only once
+     *  both for the peak and for the threshold crossing. The reference section
+     *  is measured by a second thread at the same time, unless the call is made
+     *  from within a parallel region. Only the measurements
+     *  in \e measurements and the ones they depend on are done; all other
+     *  results keep their default values.
+     *  Throws std::out_of_range if the section is empty.
+     *  \param sec The section to be measured.
+     *  \param dt The sampling interval.
+     *  \param reference A section of a second channel that is used for the
+     *         beginning of the latency measurement, or NULL.
+     *  \return The results of all measurements.
+     */
+    MeasurementResults Evaluate(const Section& sec, double dt, const Section* reference = NULL) const;
+
+    //! Applies the plan to a section, reusing the results of the previous evaluation.
+    /*! Gives the same results as Evaluate() above. Measurements whose data and
+     *  settings haven't changed since \e cache was last used are copied rather
+     *  than redone, e.g. the baseline isn't measured again while only the peak
+     *  window is moved. Mapped data are decoded only when the section changes.
+     *  \param sec The section to be measured.
+     *  \param dt The sampling interval.
+     *  \param reference A section of a second channel, or NULL.
+     *  \param cache Intermediate results of the previous evaluation; updated on return.
+     *  \return The results of all measurements.
+     */
+    MeasurementResults Evaluate(const Section& sec, double dt, const Section* reference,
+                                MeasurementCache& cache) const;
+
+    //! Measures a single time point that a section can be aligned to.
+    /*! Only the measurements that the alignment point depends on are done;
+     *  the result is the same as the corresponding member of Evaluate().
+     *  Throws std::out_of_range if the section is empty or a cursor is out of range.
+     *  \param sec The section to be measured.
+     *  \param dt The sampling interval.
+     *  \param mode The time point to be measured.
+     *  \param reference true if \e sec belongs to a reference channel. The time point
+     *         is then measured like the AP members of MeasurementResults.
+     *  \return The time point in units of sampling points.
+     */
+    double AlignmentPoint(const Section& sec, double dt, alignment_mode mode, bool reference = false) const;
+
+    //! Compares all settings, e.g. to find out whether results measured with another plan are still valid.
+    /*! \param other Another plan.
+     *  \return true if both plans give the same results for any section.
+     */
+    bool operator==(const MeasurementPlan& other) const;
+
+    //! Compares all settings.
+    /*! \param other Another plan.
+     *  \return true if the plans differ in any setting.
+     */
+    bool operator!=(const MeasurementPlan& other) const { return !(*this == other); }
+
+    unsigned int measurements; /*!< Requested measurements, see stfnum::measurement_flags. */
+    std::size_t baseBeg;      /*!< First index of the baseline window. */
+    std::size_t baseEnd;      /*!< Last index of the baseline window. */
+    std::size_t peakBeg;      /*!< First index of the peak window. */
+    std::size_t peakEnd;      /*!< Last index of the peak window. */
+    baseline_method baselineMethod; /*!< Mean or median baseline. */
+    int pM;                   /*!< Number of points for the peak average (see stfnum::peak()). */
+    stfnum::direction dir;    /*!< Direction of peak detection. */
+    double RTFactor;          /*!< Lower limit of the rise time in percent, e.g. 20 for 20-80%. */
+    bool fromBase;            /*!< Measure amplitudes from the baseline rather than from the threshold. */
+    double slopeForThreshold; /*!< Slope defining the threshold, in y units per x unit. */
+    latency_mode latencyStartMode; /*!< Start of the latency, measured in the reference section. */
+    latency_mode latencyEndMode;   /*!< End of the latency. */
+    double latencyBeg;        /*!< Start of the latency in manual mode, in sampling points. */
+    double latencyEnd;        /*!< End of the latency in manual mode, in sampling points. */
+    std::size_t slopeBeg;     /*!< First index of the regression slope window. */
+    std::size_t slopeEnd;     /*!< Last index of the regression slope window; no regression is
+                                   computed if the window has fewer than 2 points. */
+
+private:
+    // Measures the section itself for Evaluate(), reusing the results in cache.
+    // Returns the measurement_flags of the peak, threshold and regression if
+    // they have been measured:
+    unsigned int MeasureSection(const Section& sec, const Vector_double& data, double dt,
+                                long windowLength, const MeasurementCache& cache,
+                                MeasurementResults& res, double& foot) const;
+
+    // Measures the AP members of res in a reference section:
+    void MeasureReference(const Section& reference, const Vector_double& refdata,
+                          long windowLength, MeasurementResults& res) const;
+};
+
+//! Intermediate results that MeasurementPlan::Evaluate() can reuse.
+/*! While a cursor is dragged, the same section is measured over and over
+ *  with plans that differ in a single window. The cache keeps the decoded
+ *  data of mapped sections and the previous plan and results, so that only
+ *  the measurements that depend on a changed setting are redone.
+ *  Sections are recognised by their address and size; the cache has to be
+ *  cleared when the data of a section are modified in place. A cache must
+ *  only be used by one thread at a time.
+ */
+class StfioDll MeasurementCache {
+public:
+    //! Default constructor. Creates an empty cache.
+    MeasurementCache();
+
+    //! Discards all intermediate results.
+    void Clear();
+
+private:
+    friend struct MeasurementPlan;
+
+    // Identifies the measured data:
+    const Section* sec;
+    std::size_t secSize;
+    const double* secData;
+    const Section* reference;
+    std::size_t refSize;
+    const double* refData;
+    double dt;
+    // Decoded data of a mapped section and of a mapped reference:
+    Vector_double buffer, refBuffer;
+
+    MeasurementPlan plan;
+    MeasurementResults res;
+    bool hasBase, hasRegression, hasPeak, hasThreshold, hasReference;
+};
+
+//! A section and the plan it is measured with, as used by stfnum::evaluateMany().
+struct StfioDll MeasurementJob {
+    //! Constructor
+    /*! \param plan_ The cursor and measurement settings.
+     *  \param sec_ The section to be measured, or NULL to skip the job.
+     *  \param dt_ The sampling interval.
+     *  \param reference_ The reference section, or NULL (see MeasurementPlan::Evaluate()).
+     */
+    MeasurementJob(const MeasurementPlan& plan_ = MeasurementPlan(), const Section* sec_ = NULL,
+                   double dt_ = 1.0, const Section* reference_ = NULL);
+
+    MeasurementPlan plan;      /*!< The cursor and measurement settings. */
+    const Section* sec;        /*!< The section to be measured, or NULL. */
+    double dt;                 /*!< The sampling interval. */
+    const Section* reference;  /*!< The reference section, or NULL. */
+};
+
+//! Evaluates many measurement plans in parallel.
+/*! Each job can use its own plan, e.g. when the current sections of
+ *  several documents are measured with their own cursors. A job that
+ *  fails doesn't stop the others.
+ *  \param jobs The sections to be measured. Jobs without a section are skipped.
+ *  \param errors Is set to the description of the exception each job has
+ *         thrown, or to an empty string if it has succeeded or was skipped.
+ *  \param n_threads Number of jobs that are evaluated in parallel; 0 uses the configured number of threads.
+ *  \return The results in the order of \e jobs; default values for
+ *          jobs that have failed or were skipped.
+ */
+StfioDll std::vector<MeasurementResults> evaluateMany(const std::vector<MeasurementJob>& jobs,
+                                                      std::vector<std::string>& errors, int n_threads = 0);
+
+//! A named set of cursors within a stfnum::MultiWindowPlan.
+struct StfioDll MeasurementWindow {
+    //! Constructor
+    /*! \param name_ The name of the window, e.g. "EPSC 1".
+     *  \param plan_ The cursor and measurement settings of the window.
+     */
+    MeasurementWindow(const std::string& name_ = "", const MeasurementPlan& plan_ = MeasurementPlan());
+
+    std::string name;      /*!< The name of the window. */
+    MeasurementPlan plan;  /*!< The cursor and measurement settings. */
+};
+
+//! Several sets of cursors that are measured in a single pass over each section.
+/*! Responses to paired pulses or trains are measured with one window per
+ *  response. All windows of a section share a stfnum::MeasurementCache, so
+ *  that mapped data are decoded only once, and measurements that several
+ *  windows have in common, such as a shared baseline, are done only once.
+ */
+struct StfioDll MultiWindowPlan {
+    //! Adds a window.
+    /*! Throws std::runtime_error if a window with the same name exists.
+     *  \param name The name of the window.
+     *  \param plan The cursor and measurement settings of the window.
+     */
+    void Add(const std::string& name, const MeasurementPlan& plan);
+
+    //! Retrieves the index of a window.
+    /*! \param name The name of the window.
+     *  \return The index within \e windows, or -1 if there is no such window.
+     */
+    int Find(const std::string& name) const;
+
+    //! Applies all windows to a section.
+    /*! Throws std::out_of_range if the section is empty or a cursor is out of range.
+     *  \param sec The section to be measured.
+     *  \param dt The sampling interval.
+     *  \param reference A section of a second channel, or NULL (see MeasurementPlan::Evaluate()).
+     *  \return The results in the order of \e windows.
+     */
+    std::vector<MeasurementResults> Evaluate(const Section& sec, double dt,
+                                             const Section* reference = NULL) const;
+
+    std::vector<MeasurementWindow> windows; /*!< The windows in the order they are measured. */
+};
+
+//! Measures several sections with all windows of a plan in parallel.
+/*! Throws std::out_of_range if a section index or a cursor is out of range.
+ *  \param ch The channel to be measured.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param dt The sampling interval.
+ *  \param plan The windows.
+ *  \param reference A reference channel whose sections with the same indices
+ *         are passed to MeasurementPlan::Evaluate(), or NULL.
+ *  \param n_threads Number of sections that are measured in parallel; 0 uses the configured number of threads.
+ *  \return The results of each window in the order of \e sections.
+ */
+StfioDll std::vector<std::vector<MeasurementResults> > evaluateWindows(const Channel& ch,
+                                                                       const std::vector<std::size_t>& sections,
+                                                                       double dt, const MultiWindowPlan& plan,
+                                                                       const Channel* reference = NULL,
+                                                                       int n_threads = 0);
+
+//! Measures the alignment points of several sections in parallel.
+/*! This is the first step of an aligned average: the shift of each section
+ *  can be computed from the results without measuring anything else.
+ *  Throws std::out_of_range if a section index or a cursor is out of range.
+ *  \param ch The channel to be measured.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param dt The sampling interval.
+ *  \param plan The cursor settings.
+ *  \param mode The time point to be measured.
+ *  \param reference true if \e ch is a reference channel (see MeasurementPlan::AlignmentPoint()).
+ *  \param peakAtEnd true if the peak window should extend to the end of each section.
+ *  \param n_threads Number of sections that are measured in parallel; 0 uses the configured number of threads.
+ *  \return The alignment points in the order of \e sections, rounded to sampling points.
+ */
+StfioDll std::vector<int> alignmentPoints(const Channel& ch, const std::vector<std::size_t>& sections,
+                                          double dt, const MeasurementPlan& plan, alignment_mode mode,
+                                          bool reference = false, bool peakAtEnd = false, int n_threads = 0);
+
 /*@}*/
 
 }
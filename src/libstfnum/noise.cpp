@@ -0,0 +1,237 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file noise.cpp
+ *  \brief Non-stationary fluctuation analysis of repeated sweeps.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "./noise.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/scratch.h"
+#include "../libstfio/parallel.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    // Sampling points that are processed by a thread at a time; the sums
+    // of a block stay in cache while the sections are read contiguously:
+    const std::size_t noiseBlockSize = 4096;
+
+    // Reads a block of a section in place or decodes it into buffer:
+    const double* readBlock(const Section& sec, std::size_t begin, std::size_t len, double* buffer) {
+        const double* x = sec.GetSpan();
+        if (x != NULL) {
+            return x + begin;
+        }
+        sec.CopyRange(begin, begin+len, buffer);
+        return buffer;
+    }
+
+}
+
+void stfnum::ensembleVariance(const Channel& ch, const std::vector<std::size_t>& sections,
+                              std::size_t begin, std::size_t end,
+                              Vector_double& mean, Vector_double& variance,
+                              bool pairwise, int n_threads)
+{
+    STF_PROFILE_SCOPE("nsfa/variance");
+    std::size_t n_sections = sections.size();
+    if (n_sections < 2) {
+        throw std::out_of_range("At least two sections are required in stfnum::ensembleVariance()");
+    }
+    if (begin > end) {
+        throw std::out_of_range("Range out of range in stfnum::ensembleVariance()");
+    }
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        if (sections[n_s] >= ch.size()) {
+            throw std::out_of_range("Section number out of range in stfnum::ensembleVariance()");
+        }
+        if (end > ch[sections[n_s]].size()) {
+            throw std::out_of_range("Sampling point out of range in stfnum::ensembleVariance()");
+        }
+    }
+
+    std::size_t n_points = end-begin;
+    mean.resize(n_points);
+    variance.resize(n_points);
+    int n_blocks = (int)((n_points + noiseBlockSize - 1) / noiseBlockSize);
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_blocks);
+#pragma omp parallel for num_threads(n_threads) schedule(dynamic)
+#endif
+    for (int b = 0; b < n_blocks; ++b) {
+        std::size_t offset = b*noiseBlockSize;
+        std::size_t len = std::min(noiseBlockSize, n_points-offset);
+        double* bmean = &mean[offset];
+        double* bvar = &variance[offset];
+        std::fill(bmean, bmean+len, 0.0);
+        std::fill(bvar, bvar+len, 0.0);
+        stfio::ScratchScope scratch;
+        // two buffers, so that the previous section is still available:
+        double* buffers[2] = { scratch.Doubles(len), scratch.Doubles(len) };
+        const double* previous = NULL;
+        for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+            const double* x = readBlock(ch[sections[n_s]], begin+offset, len, buffers[n_s%2]);
+            if (pairwise) {
+                for (std::size_t k = 0; k < len; ++k) {
+                    bmean[k] += x[k];
+                }
+                if (previous != NULL) {
+                    for (std::size_t k = 0; k < len; ++k) {
+                        double d = x[k] - previous[k];
+                        bvar[k] += d*d;
+                    }
+                }
+                previous = x;
+            } else {
+                // Welford's algorithm:
+                double rn = 1.0 / (n_s+1);
+                for (std::size_t k = 0; k < len; ++k) {
+                    double delta = x[k] - bmean[k];
+                    bmean[k] += delta * rn;
+                    bvar[k] += delta * (x[k] - bmean[k]);
+                }
+            }
+        }
+        if (pairwise) {
+            for (std::size_t k = 0; k < len; ++k) {
+                bmean[k] /= n_sections;
+                bvar[k] /= 2.0*(n_sections-1);
+            }
+        } else {
+            for (std::size_t k = 0; k < len; ++k) {
+                bvar[k] /= n_sections-1;
+            }
+        }
+    }
+}
+
+void stfnum::binVariance(const Vector_double& mean, const Vector_double& variance,
+                         std::size_t n_bins, Vector_double& binMean,
+                         Vector_double& binVariance, std::vector<std::size_t>& binCount)
+{
+    if (mean.size() != variance.size()) {
+        throw std::runtime_error("Error in stfnum::binVariance()\n"
+                                 "mean and variance have different sizes");
+    }
+    binMean.clear();
+    binVariance.clear();
+    binCount.clear();
+    if (mean.empty() || n_bins == 0) {
+        return;
+    }
+    double lo = *std::min_element(mean.begin(), mean.end());
+    double hi = *std::max_element(mean.begin(), mean.end());
+    double width = (hi-lo) / n_bins;
+
+    Vector_double sumMean(n_bins, 0.0), sumVar(n_bins, 0.0);
+    std::vector<std::size_t> count(n_bins, 0);
+    for (std::size_t n = 0; n < mean.size(); ++n) {
+        std::size_t bin = width > 0 ? (std::size_t)((mean[n]-lo) / width) : 0;
+        bin = std::min(bin, n_bins-1);
+        sumMean[bin] += mean[n];
+        sumVar[bin] += variance[n];
+        ++count[bin];
+    }
+    for (std::size_t bin = 0; bin < n_bins; ++bin) {
+        if (count[bin] > 0) {
+            binMean.push_back(sumMean[bin] / count[bin]);
+            binVariance.push_back(sumVar[bin] / count[bin]);
+            binCount.push_back(count[bin]);
+        }
+    }
+}
+
+void stfnum::fitParabola(const Vector_double& binMean, const Vector_double& binVariance,
+                         NoiseAnalysis& result)
+{
+    std::size_t n_bins = binMean.size();
+    if (n_bins != binVariance.size()) {
+        throw std::runtime_error("Error in stfnum::fitParabola()\n"
+                                 "mean and variance have different sizes");
+    }
+    if (n_bins < 3) {
+        throw std::runtime_error("Error in stfnum::fitParabola()\n"
+                                 "at least three bins are required");
+    }
+    // normal equations of var = a*I + b*I^2 + c, augmented by the right-hand side:
+    double m[3][4] = {{0}};
+    for (std::size_t n = 0; n < n_bins; ++n) {
+        double basis[3] = { binMean[n], binMean[n]*binMean[n], 1.0 };
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                m[r][c] += basis[r]*basis[c];
+            }
+            m[r][3] += basis[r]*binVariance[n];
+        }
+    }
+    // Gaussian elimination with partial pivoting:
+    double scale = std::max(std::max(m[0][0], m[1][1]), m[2][2]);
+    for (int c = 0; c < 3; ++c) {
+        int pivot = c;
+        for (int r = c+1; r < 3; ++r) {
+            if (fabs(m[r][c]) > fabs(m[pivot][c])) {
+                pivot = r;
+            }
+        }
+        if (!(fabs(m[pivot][c]) > scale*std::numeric_limits<double>::epsilon())) {
+            throw std::runtime_error("Error in stfnum::fitParabola()\n"
+                                     "the bins don't determine a parabola");
+        }
+        for (int k = 0; k < 4; ++k) {
+            std::swap(m[c][k], m[pivot][k]);
+        }
+        for (int r = 0; r < 3; ++r) {
+            if (r != c) {
+                double f = m[r][c] / m[c][c];
+                for (int k = c; k < 4; ++k) {
+                    m[r][k] -= f*m[c][k];
+                }
+            }
+        }
+    }
+    double a = m[0][3] / m[0][0];
+    double b = m[1][3] / m[1][1];
+    double c = m[2][3] / m[2][2];
+
+    result.i = a;
+    result.N = b != 0 ? -1.0/b : std::numeric_limits<double>::infinity();
+    result.background = c;
+    result.SSE = 0;
+    for (std::size_t n = 0; n < n_bins; ++n) {
+        double e = binVariance[n] - (a*binMean[n] + b*binMean[n]*binMean[n] + c);
+        result.SSE += e*e;
+    }
+}
+
+stfnum::NoiseAnalysis stfnum::nsfa(const Channel& ch, const std::vector<std::size_t>& sections,
+                                   std::size_t begin, std::size_t end, std::size_t n_bins,
+                                   bool pairwise, int n_threads)
+{
+    NoiseAnalysis result;
+    ensembleVariance(ch, sections, begin, end, result.mean, result.variance, pairwise, n_threads);
+    binVariance(result.mean, result.variance, n_bins, result.binMean, result.binVariance,
+                result.binCount);
+    fitParabola(result.binMean, result.binVariance, result);
+    return result;
+}
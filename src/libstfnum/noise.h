@@ -0,0 +1,114 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file noise.h
+ *  \brief Non-stationary fluctuation analysis of repeated sweeps.
+ *
+ *  The variance of a current that is carried by N identical channels with
+ *  a single-channel current i depends on the mean current I as
+ *  \f$\sigma^2 = iI - I^2/N + \sigma_b^2\f$, where \f$\sigma_b^2\f$ is the
+ *  background variance. The ensemble mean and variance are computed across
+ *  sweeps at every sampling point, binned by the mean current and fitted
+ *  with this parabola.
+ */
+
+#ifndef _STFNUM_NOISE_H
+#define _STFNUM_NOISE_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "./stfnum.h"
+
+class Channel;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Computes the ensemble mean and variance of several sections.
+/*! The sampling points are distributed across threads in blocks; every
+ *  thread reads the sections block by block, in place where they are
+ *  stored in memory. With \e pairwise, the variance is computed from the
+ *  differences between consecutive sections,
+ *  \f$\sigma^2 = \sum_k (x_{k+1}-x_k)^2 / (2(n-1))\f$, so that slow drifts
+ *  of the amplitude across sections don't add to the variance.
+ *  Throws std::out_of_range if a section or the range is out of range,
+ *  or if there are fewer than two sections.
+ *  \param ch The channel containing the sections.
+ *  \param sections Indices of the sections, in the order of recording.
+ *  \param begin Index of the first sampling point.
+ *  \param end Index past the last sampling point.
+ *  \param mean On exit, the ensemble mean at every sampling point.
+ *  \param variance On exit, the ensemble variance at every sampling point.
+ *  \param pairwise Whether the variance is computed from consecutive differences.
+ *  \param n_threads Number of threads; 0 uses the configured number of threads.
+ */
+StfioDll void ensembleVariance(const Channel& ch, const std::vector<std::size_t>& sections,
+                               std::size_t begin, std::size_t end,
+                               Vector_double& mean, Vector_double& variance,
+                               bool pairwise = true, int n_threads = 0);
+
+//! Averages the variance in bins of equal width of the mean current.
+/*! Bins that don't contain any sampling point are left out.
+ *  \param mean The ensemble mean at every sampling point.
+ *  \param variance The ensemble variance at every sampling point.
+ *  \param n_bins Number of bins between the smallest and the largest mean.
+ *  \param binMean On exit, the average mean current of every bin.
+ *  \param binVariance On exit, the average variance of every bin.
+ *  \param binCount On exit, the number of sampling points of every bin.
+ */
+StfioDll void binVariance(const Vector_double& mean, const Vector_double& variance,
+                          std::size_t n_bins, Vector_double& binMean,
+                          Vector_double& binVariance, std::vector<std::size_t>& binCount);
+
+//! Results of stfnum::fitParabola() and stfnum::nsfa().
+struct StfioDll NoiseAnalysis {
+    Vector_double mean;                 /*!< Ensemble mean at every sampling point. */
+    Vector_double variance;             /*!< Ensemble variance at every sampling point. */
+    Vector_double binMean;              /*!< Average mean current of every bin. */
+    Vector_double binVariance;          /*!< Average variance of every bin. */
+    std::vector<std::size_t> binCount;  /*!< Number of sampling points of every bin. */
+    double i;                           /*!< Single-channel current; has the sign of the mean current. */
+    double N;                           /*!< Number of channels. */
+    double background;                  /*!< Background variance. */
+    double SSE;                         /*!< Sum of squared errors of the parabola. */
+};
+
+//! Fits the parabola \f$\sigma^2 = iI - I^2/N + \sigma_b^2\f$ to binned variances.
+/*! The fit is a linear least-squares fit. Throws std::runtime_error
+ *  if there are fewer than three bins or if they don't determine the parabola.
+ *  \param binMean The mean current of every bin.
+ *  \param binVariance The variance of every bin.
+ *  \param result On exit, \e i, \e N, \e background and \e SSE are set.
+ */
+StfioDll void fitParabola(const Vector_double& binMean, const Vector_double& binVariance,
+                          NoiseAnalysis& result);
+
+//! Performs a non-stationary fluctuation analysis of several sections.
+/*! Combines stfnum::ensembleVariance(), stfnum::binVariance() and
+ *  stfnum::fitParabola(); see these for a description of the parameters.
+ *  \return The ensemble mean and variance, the bins and the parabola.
+ */
+StfioDll NoiseAnalysis nsfa(const Channel& ch, const std::vector<std::size_t>& sections,
+                            std::size_t begin, std::size_t end, std::size_t n_bins,
+                            bool pairwise = true, int n_threads = 0);
+
+/*@}*/
+
+}
+
+#endif
@@ -0,0 +1,487 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file pipeline.cpp
+ *  \brief Analyses a recording sweep by sweep.
+ */
+
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "./pipeline.h"
+#include "./fit.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/tablestream.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/parallel.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    // Progress of single files and sections isn't shown while sweeps are streamed:
+    class SilentProgressInfo : public stfio::ProgressInfo {
+    public:
+        SilentProgressInfo() : stfio::ProgressInfo("", "", 100, false) {}
+        bool Update(int value, const std::string& newmsg="", bool* skip=NULL) { return true; }
+    };
+
+    std::string sweepLabel(const std::string& label, std::size_t index) {
+        std::ostringstream str;
+        if (label.empty()) {
+            str << "Sweep " << index+1;
+        } else {
+            str << label << ", sweep " << index+1;
+        }
+        return str.str();
+    }
+
+    // The smallest number of sections of any channel:
+    std::size_t sweepCount(const Recording& rec) {
+        if (rec.size() == 0) {
+            return 0;
+        }
+        std::size_t n = rec[0].size();
+        for (std::size_t n_c = 1; n_c < rec.size(); ++n_c) {
+            n = std::min(n, rec[n_c].size());
+        }
+        return n;
+    }
+
+    void fillSweep(const Recording& rec, std::size_t n_s, stfnum::Sweep& sweep) {
+        sweep.dt = rec.GetXScale();
+        sweep.sections.resize(rec.size());
+        for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+            sweep.sections[n_c] = rec[n_c][n_s];
+        }
+        sweep.values.clear();
+        sweep.events = stfnum::EventTable();
+    }
+
+    const Section& sweepSection(const stfnum::Sweep& sweep, std::size_t channel) {
+        if (channel >= sweep.sections.size()) {
+            throw std::out_of_range("Channel index out of range in stfnum::SweepStage::Process()");
+        }
+        return sweep.sections[channel];
+    }
+
+}
+
+stfnum::RecordingSource::RecordingSource(const Recording& rec_, const std::string& label_)
+    : rec(rec_), label(label_), next(0)
+{}
+
+bool stfnum::RecordingSource::Next(Sweep& sweep) {
+    if (next >= Size()) {
+        return false;
+    }
+    fillSweep(rec, next, sweep);
+    sweep.index = next;
+    sweep.label = sweepLabel(label, next);
+    ++next;
+    return true;
+}
+
+std::size_t stfnum::RecordingSource::Size() const {
+    return sweepCount(rec);
+}
+
+stfnum::FileSource::FileSource(const std::string& fName_, stfio::filetype type_,
+                               const stfio::txtImportSettings& txtImport_,
+                               std::size_t blockSize_, const std::string& label_)
+    : fName(fName_), label(label_.empty() ? fName_ : label_), type(type_), txtImport(txtImport_),
+      blockSize(std::max<std::size_t>(blockSize_, 1)), ranged(false), imported(false), n_sweeps(0),
+      block(), blockBegin(0), next(0)
+{
+    std::vector<std::size_t> counts = stfio::getSectionCounts(fName, type);
+    if (!counts.empty()) {
+        ranged = true;
+        n_sweeps = *std::min_element(counts.begin(), counts.end());
+    }
+}
+
+bool stfnum::FileSource::Next(Sweep& sweep) {
+    SilentProgressInfo progDlg;
+    if (!ranged && !imported) {
+        STF_PROFILE_SCOPE("pipeline/import");
+        if (!stfio::importFile(fName, type, block, txtImport, progDlg)) {
+            throw std::runtime_error("Couldn't import " + fName + " in stfnum::FileSource::Next()");
+        }
+        imported = true;
+        n_sweeps = sweepCount(block);
+    }
+    if (next >= n_sweeps) {
+        return false;
+    }
+    if (ranged && (block.size() == 0 || next < blockBegin || next >= blockBegin + block[0].size())) {
+        STF_PROFILE_SCOPE("pipeline/import");
+        // release the previous block before the next one is read:
+        block = Recording();
+        stfio::importFileRange(fName, type, block, progDlg, next, std::min(next + blockSize, n_sweeps));
+        blockBegin = next;
+        if (sweepCount(block) == 0) {
+            throw std::runtime_error("Couldn't read " + fName + " in stfnum::FileSource::Next()");
+        }
+    }
+    fillSweep(block, next - blockBegin, sweep);
+    sweep.index = next;
+    sweep.label = sweepLabel(label, next);
+    ++next;
+    return true;
+}
+
+std::size_t stfnum::FileSource::Size() const {
+    return n_sweeps;
+}
+
+stfnum::FilterStage::FilterStage(const BiquadCascade& filter_, std::size_t channel_)
+    : filter(filter_), channel(channel_)
+{}
+
+void stfnum::FilterStage::Process(Sweep& sweep) const {
+    const Section& sec = sweepSection(sweep, channel);
+    sweep.sections[channel] = Section(filtfilt(filter, sec.get()), sec.GetSectionDescription());
+}
+
+stfnum::BaselineStage::BaselineStage(std::size_t channel_, std::size_t begin_, std::size_t end_,
+                                     baseline_method method_, bool subtract_)
+    : channel(channel_), begin(begin_), end(end_), method(method_), subtract(subtract_)
+{}
+
+std::vector<std::string> stfnum::BaselineStage::Columns() const {
+    std::vector<std::string> columns;
+    columns.push_back("baseline");
+    columns.push_back("baseline_sd");
+    return columns;
+}
+
+void stfnum::BaselineStage::Process(Sweep& sweep) const {
+    const Section& sec = sweepSection(sweep, channel);
+    if (begin > end || end >= sec.size()) {
+        throw std::out_of_range("Baseline window out of range in stfnum::BaselineStage::Process()");
+    }
+    double var = 0.0;
+    double base = stfnum::base(method, var, sec, begin, end);
+    if (subtract) {
+        Vector_double data(sec.size());
+        sec.CopyRange(0, sec.size(), &data[0]);
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            data[k] -= base;
+        }
+        sweep.sections[channel] = Section(data, sec.GetSectionDescription());
+    }
+    sweep.values.push_back(base);
+    sweep.values.push_back(sqrt(var));
+}
+
+stfnum::DetectStage::DetectStage(const EventDetectionPlan& plan_, std::size_t channel_)
+    : plan(plan_), channel(channel_)
+{}
+
+std::vector<std::string> stfnum::DetectStage::Columns() const {
+    return std::vector<std::string>(1, "events");
+}
+
+void stfnum::DetectStage::Process(Sweep& sweep) const {
+    SilentProgressInfo progDlg;
+    sweep.events = plan.Detect(sweepSection(sweep, channel), sweep.index, progDlg);
+    sweep.values.push_back((double)sweep.events.size());
+}
+
+stfnum::MeasureStage::MeasureStage(const MeasurementPlan& plan_, std::size_t channel_,
+                                   std::size_t reference_)
+    : plan(plan_), channel(channel_), reference(reference_)
+{}
+
+std::vector<std::string> stfnum::MeasureStage::Columns() const {
+    const char* const labels[] = {
+        "base", "base_sd", "peak", "amplitude", "threshold", "peak_time", "rise_time",
+        "half_duration", "max_rise", "max_decay", "slope_ratio", "latency"
+    };
+    return std::vector<std::string>(labels, labels + sizeof(labels)/sizeof(labels[0]));
+}
+
+void stfnum::MeasureStage::Process(Sweep& sweep) const {
+    const Section& sec = sweepSection(sweep, channel);
+    const Section* refsec = NULL;
+    if (reference != (std::size_t)-1) {
+        refsec = &sweepSection(sweep, reference);
+    }
+    MeasurementResults res = plan.Evaluate(sec, sweep.dt, refsec);
+    // amplitudes are measured as in stfbatch:
+    double from = res.base;
+    if (!plan.fromBase && res.thrT >= 0) {
+        from = res.threshold;
+    }
+    sweep.values.push_back(res.base);
+    sweep.values.push_back(res.baseSD);
+    sweep.values.push_back(res.peak);
+    sweep.values.push_back(res.peak - from);
+    sweep.values.push_back(res.threshold);
+    sweep.values.push_back(res.maxT * sweep.dt);
+    sweep.values.push_back(res.rtLoHi);
+    sweep.values.push_back(res.halfDuration);
+    sweep.values.push_back(res.maxRise);
+    sweep.values.push_back(res.maxDecay);
+    sweep.values.push_back(res.slopeRatio);
+    sweep.values.push_back(res.latency * sweep.dt);
+}
+
+stfnum::FitStage::FitStage(const storedFunc& fitFunc_, std::size_t channel_, std::size_t fitBeg_,
+                           std::size_t fitEnd_, const Vector_double& initP_, const Vector_double& opts_,
+                           bool use_scaling_)
+    : fitFunc(fitFunc_), channel(channel_), fitBeg(fitBeg_), fitEnd(fitEnd_),
+      initP(initP_), opts(opts_), use_scaling(use_scaling_)
+{
+    if (initP.size() != fitFunc.pInfo.size()) {
+        throw std::out_of_range("Initial parameters don't match the function in stfnum::FitStage");
+    }
+}
+
+std::vector<std::string> stfnum::FitStage::Columns() const {
+    std::vector<std::string> columns;
+    for (std::size_t n_p = 0; n_p < fitFunc.pInfo.size(); ++n_p) {
+        columns.push_back(fitFunc.pInfo[n_p].desc);
+    }
+    columns.push_back("SSE");
+    columns.push_back("Warning");
+    return columns;
+}
+
+void stfnum::FitStage::Process(Sweep& sweep) const {
+    const Section& sec = sweepSection(sweep, channel);
+    Vector_double p(initP);
+    double chisqr = NAN, warn = NAN;
+    if (fitBeg < fitEnd && fitEnd <= sec.size()) {
+        Vector_double data(fitEnd - fitBeg);
+        sec.CopyRange(fitBeg, fitEnd, &data[0]);
+        std::string info;
+        int warning = 0;
+        try {
+            chisqr = lmFit(data, sweep.dt, fitFunc, opts, use_scaling, p, info, warning);
+            warn = warning;
+        } catch (const std::exception&) {
+            chisqr = NAN;
+        }
+    }
+    if (std::isnan(chisqr)) {
+        p.assign(p.size(), NAN);
+    }
+    sweep.values.insert(sweep.values.end(), p.begin(), p.end());
+    sweep.values.push_back(chisqr);
+    sweep.values.push_back(warn);
+}
+
+void stfnum::TableSink::Begin(const std::vector<std::string>& columns_) {
+    columns = columns_;
+    labels.clear();
+    values.clear();
+    events = EventTable();
+}
+
+void stfnum::TableSink::Consume(const Sweep& sweep) {
+    labels.push_back(sweep.label);
+    values.insert(values.end(), sweep.values.begin(), sweep.values.end());
+    events.append(sweep.events);
+}
+
+stfnum::Table stfnum::TableSink::GetTable() const {
+    Table table(labels.size(), columns.size());
+    for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+        table.SetColLabel(n_c, columns[n_c]);
+    }
+    for (std::size_t n_r = 0; n_r < labels.size(); ++n_r) {
+        table.SetRowLabel(n_r, labels[n_r]);
+        for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+            double value = values[n_r*columns.size() + n_c];
+            if (std::isnan(value)) {
+                table.SetEmpty(n_r, n_c);
+            } else {
+                table.at(n_r, n_c) = value;
+            }
+        }
+    }
+    return table;
+}
+
+stfnum::StreamSink::StreamSink(const std::string& fName_, const std::string& labelTitle_,
+                               std::size_t queueRows_)
+    : fName(fName_), labelTitle(labelTitle_), queueRows(queueRows_), stream(NULL)
+{}
+
+stfnum::StreamSink::~StreamSink() {
+    delete stream;
+}
+
+void stfnum::StreamSink::Begin(const std::vector<std::string>& columns) {
+    delete stream;
+    stream = NULL;
+    stream = new stfio::TableStream(fName, labelTitle, columns, queueRows);
+}
+
+void stfnum::StreamSink::Consume(const Sweep& sweep) {
+    if (stream == NULL) {
+        throw std::runtime_error("stfnum::StreamSink::Consume() called before Begin()");
+    }
+    stream->Append(sweep.label, sweep.values);
+}
+
+void stfnum::StreamSink::End() {
+    if (stream != NULL) {
+        stream->Close();
+    }
+}
+
+stfnum::Pipeline::Pipeline(SweepSource& source_, SweepSink& sink_, std::size_t queueSize_, int n_threads_)
+    : source(source_), sink(sink_), stages(0), queueSize(queueSize_), n_threads(n_threads_)
+{}
+
+void stfnum::Pipeline::Add(const SweepStage& stage) {
+    stages.push_back(&stage);
+}
+
+std::vector<std::string> stfnum::Pipeline::Columns() const {
+    std::vector<std::string> columns;
+    for (std::size_t n = 0; n < stages.size(); ++n) {
+        std::vector<std::string> stageColumns = stages[n]->Columns();
+        columns.insert(columns.end(), stageColumns.begin(), stageColumns.end());
+    }
+    return columns;
+}
+
+std::size_t stfnum::Pipeline::Run(stfio::ProgressInfo& progDlg) {
+    STF_PROFILE_SCOPE("pipeline/run");
+    std::vector<std::size_t> n_columns(stages.size());
+    for (std::size_t n = 0; n < stages.size(); ++n) {
+        n_columns[n] = stages[n]->Columns().size();
+    }
+    sink.Begin(Columns());
+
+    int threads = stfio::threadCount(n_threads, INT_MAX);
+    std::size_t queue = queueSize > 0 ? queueSize : 2*(std::size_t)threads;
+
+    // In every round, the sweeps in processing go through the stages, while
+    // the next ones are read into reading and the previous ones are written
+    // from writing; the reader and the writer help with the stages once they
+    // are done:
+    std::vector<Sweep> reading, processing, writing;
+    bool more = true, failed = false;
+    std::string error;
+    std::size_t n_written = 0;
+    for (;;) {
+        writing.swap(processing);
+        processing.swap(reading);
+        reading.clear();
+        if (processing.empty() && writing.empty() && !more) {
+            break;
+        }
+        int next = 0;
+        int n_processing = (int)processing.size();
+#ifdef _OPENMP
+        int team = std::max(std::min(threads, n_processing), 1) + 2;
+#pragma omp parallel num_threads(team)
+#endif
+        {
+            int thread = 0, writer = 0;
+#ifdef _OPENMP
+            thread = omp_get_thread_num();
+            writer = omp_get_num_threads() - 1;
+#endif
+            if (thread == 0 && more) {
+                try {
+                    while (reading.size() < queue) {
+                        Sweep sweep;
+                        if (!source.Next(sweep)) {
+                            more = false;
+                            break;
+                        }
+                        reading.push_back(sweep);
+                    }
+                } catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_pipeline)
+#endif
+                    {
+                        failed = true;
+                        error = e.what();
+                    }
+                }
+            }
+            if (thread == writer) {
+                try {
+                    for (std::size_t n = 0; n < writing.size() && !failed; ++n) {
+                        sink.Consume(writing[n]);
+                        ++n_written;
+                    }
+                } catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_pipeline)
+#endif
+                    {
+                        failed = true;
+                        error = e.what();
+                    }
+                }
+            }
+            for (;;) {
+                int n = 0;
+#ifdef _OPENMP
+#pragma omp atomic capture
+#endif
+                n = next++;
+                if (n >= n_processing || failed) {
+                    break;
+                }
+                Sweep& sweep = processing[n];
+                try {
+                    sweep.values.clear();
+                    std::size_t n_values = 0;
+                    for (std::size_t n_st = 0; n_st < stages.size(); ++n_st) {
+                        stages[n_st]->Process(sweep);
+                        n_values += n_columns[n_st];
+                        if (sweep.values.size() != n_values) {
+                            throw std::runtime_error("A stage didn't append a value for every column");
+                        }
+                    }
+                } catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_pipeline)
+#endif
+                    {
+                        failed = true;
+                        error = e.what();
+                    }
+                }
+            }
+        }
+        if (failed) {
+            throw std::runtime_error("Error in stfnum::Pipeline::Run(): " + error);
+        }
+        std::size_t total = source.Size();
+        int percent = total > 0 ? (int)(100.0*n_written/total) : 0;
+        std::ostringstream msg;
+        msg << n_written << " sweeps processed";
+        bool skip = false;
+        if (!progDlg.Update(std::min(percent, 100), msg.str(), &skip)) {
+            break;
+        }
+    }
+    sink.End();
+    return n_written;
+}
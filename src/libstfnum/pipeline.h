@@ -0,0 +1,417 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file pipeline.h
+ *  \brief Analyses a recording sweep by sweep.
+ *
+ *  A pipeline reads sweeps from a source, passes every sweep through a
+ *  chain of stages (e.g. filtering, baseline subtraction, event detection,
+ *  measurements and fits) and hands the results to a sink, e.g. a table
+ *  that is written to disk while it grows. Only a few queues of sweeps are
+ *  held in memory at any time, so that files of any size can be analysed.
+ *  While one queue is processed by a pool of threads, the next one is read
+ *  and the previous one is written at the same time.
+ */
+
+#ifndef _STFNUM_PIPELINE_H
+#define _STFNUM_PIPELINE_H
+
+#include <string>
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "../libstfio/section.h"
+#include "../libstfio/recording.h"
+#include "./stfnum.h"
+#include "./measure.h"
+#include "./events.h"
+#include "./tdfilter.h"
+
+namespace stfio {
+class TableStream;
+}
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! The sections of all channels that were recorded at the same time.
+struct StfioDll Sweep {
+    //! Default constructor. Creates an empty sweep.
+    Sweep() : index(0), dt(1.0), sections(0), label(), values(0), events() {}
+
+    std::size_t index;             /*!< Index of the sweep within its source. */
+    double dt;                     /*!< The sampling interval. */
+    std::vector<Section> sections; /*!< One section per channel; may be replaced by the stages. */
+    std::string label;             /*!< Row label of the results. */
+    Vector_double values;          /*!< Results that the stages have appended so far. */
+    EventTable events;             /*!< Events that have been detected by a stfnum::DetectStage. */
+};
+
+//! Provides the sweeps of a pipeline.
+/*! Next() is called by one thread at a time, while other threads process
+ *  sweeps that have been read before.
+ */
+class StfioDll SweepSource {
+public:
+    //! Destructor
+    virtual ~SweepSource() {}
+
+    //! Reads the next sweep.
+    /*! \param sweep On exit, the next sweep.
+     *  \return false if there are no more sweeps.
+     */
+    virtual bool Next(Sweep& sweep) = 0;
+
+    //! Retrieves the number of sweeps, if it is known.
+    /*! \return The number of sweeps, or 0 if it isn't known in advance.
+     */
+    virtual std::size_t Size() const { return 0; }
+};
+
+//! The sweeps of a recording in memory.
+/*! Sections are shared with the recording rather than copied; samples that
+ *  are mapped from a file or compactly stored are only decoded by the stages
+ *  that need them.
+ */
+class StfioDll RecordingSource : public SweepSource {
+public:
+    //! Constructor.
+    /*! \param rec The recording; has to exist while the source is used.
+     *  \param label Prefix of the row labels of the sweeps.
+     */
+    explicit RecordingSource(const Recording& rec, const std::string& label = "");
+
+    bool Next(Sweep& sweep);
+
+    //! The smallest number of sections of any channel.
+    std::size_t Size() const;
+
+private:
+    const Recording& rec;
+    std::string label;
+    std::size_t next;
+};
+
+//! The sweeps of a file.
+/*! Files whose sections can be read in ranges (see stfio::importFileRange())
+ *  are read a block of sweeps at a time, so that only a block is held in
+ *  memory. All other files are imported as a whole when the first sweep is
+ *  requested; with a memory budget (see stfio::setMemoryBudget()), their
+ *  samples may then stay in a mapped file until a stage needs them.
+ */
+class StfioDll FileSource : public SweepSource {
+public:
+    //! Constructor.
+    /*! \param fName The full path name of the file.
+     *  \param type The file type.
+     *  \param txtImport The text import filter settings.
+     *  \param blockSize Number of sweeps that are read at a time.
+     *  \param label Prefix of the row labels of the sweeps; the file name if empty.
+     */
+    FileSource(const std::string& fName, stfio::filetype type,
+               const stfio::txtImportSettings& txtImport = stfio::txtImportSettings(),
+               std::size_t blockSize = 16, const std::string& label = "");
+
+    //! Reads the next sweep.
+    /*! Throws std::runtime_error if the file can't be read.
+     *  \param sweep On exit, the next sweep.
+     *  \return false if there are no more sweeps.
+     */
+    bool Next(Sweep& sweep);
+
+    //! The number of sweeps if the file is read in blocks or has been imported; 0 otherwise.
+    std::size_t Size() const;
+
+private:
+    std::string fName, label;
+    stfio::filetype type;
+    stfio::txtImportSettings txtImport;
+    std::size_t blockSize;
+    bool ranged, imported;
+    std::size_t n_sweeps;
+    // the sweeps [blockBegin, blockBegin + block[0].size()) of the file:
+    Recording block;
+    std::size_t blockBegin;
+    std::size_t next;
+};
+
+//! A step of a pipeline.
+/*! Process() is called by several threads at the same time for different
+ *  sweeps, so that stages must not change their own state.
+ */
+class StfioDll SweepStage {
+public:
+    //! Destructor
+    virtual ~SweepStage() {}
+
+    //! Retrieves the labels of the results that the stage appends to Sweep::values.
+    virtual std::vector<std::string> Columns() const { return std::vector<std::string>(); }
+
+    //! Processes a sweep.
+    /*! Appends one value for every column to Sweep::values. Exceptions
+     *  stop the pipeline.
+     *  \param sweep The sweep.
+     */
+    virtual void Process(Sweep& sweep) const = 0;
+};
+
+//! Filters a channel forward and backward with an IIR filter (see stfnum::filtfilt()).
+class StfioDll FilterStage : public SweepStage {
+public:
+    //! Constructor.
+    /*! \param filter The filter, e.g. from stfnum::designIIR().
+     *  \param channel The channel that is filtered.
+     */
+    FilterStage(const BiquadCascade& filter, std::size_t channel);
+
+    //! Throws std::out_of_range if the sweep doesn't have the channel.
+    void Process(Sweep& sweep) const;
+
+private:
+    BiquadCascade filter;
+    std::size_t channel;
+};
+
+//! Measures the baseline of a channel and optionally subtracts it.
+/*! Appends the columns "baseline" and "baseline_sd".
+ */
+class StfioDll BaselineStage : public SweepStage {
+public:
+    //! Constructor.
+    /*! \param channel The channel.
+     *  \param begin First index of the baseline window.
+     *  \param end Last index of the baseline window.
+     *  \param method Mean or median baseline.
+     *  \param subtract true if the baseline is subtracted from the section.
+     */
+    BaselineStage(std::size_t channel, std::size_t begin, std::size_t end,
+                  baseline_method method = mean_sd, bool subtract = true);
+
+    std::vector<std::string> Columns() const;
+
+    //! Throws std::out_of_range if the sweep doesn't have the channel or the window is out of range.
+    void Process(Sweep& sweep) const;
+
+private:
+    std::size_t channel, begin, end;
+    baseline_method method;
+    bool subtract;
+};
+
+//! Detects events in a channel (see stfnum::EventDetectionPlan).
+/*! The events are stored in Sweep::events; their number is appended as the column "events".
+ */
+class StfioDll DetectStage : public SweepStage {
+public:
+    //! Constructor.
+    /*! \param plan The detection settings.
+     *  \param channel The channel that is scanned.
+     */
+    DetectStage(const EventDetectionPlan& plan, std::size_t channel);
+
+    std::vector<std::string> Columns() const;
+
+    //! Throws std::out_of_range if the sweep doesn't have the channel.
+    void Process(Sweep& sweep) const;
+
+private:
+    EventDetectionPlan plan;
+    std::size_t channel;
+};
+
+//! Measures a channel (see stfnum::MeasurementPlan).
+/*! Appends the columns of stfbatch: "base", "base_sd", "peak", "amplitude",
+ *  "threshold", "peak_time", "rise_time", "half_duration", "max_rise",
+ *  "max_decay", "slope_ratio" and "latency". Times are given in x units.
+ */
+class StfioDll MeasureStage : public SweepStage {
+public:
+    //! Constructor.
+    /*! \param plan The measurement settings.
+     *  \param channel The channel that is measured.
+     *  \param reference The channel that the latency starts from, or
+     *         (std::size_t)-1 if there is none.
+     */
+    MeasureStage(const MeasurementPlan& plan, std::size_t channel,
+                 std::size_t reference = (std::size_t)-1);
+
+    std::vector<std::string> Columns() const;
+
+    //! Throws std::out_of_range if the sweep doesn't have the channels or the section is empty.
+    void Process(Sweep& sweep) const;
+
+private:
+    MeasurementPlan plan;
+    std::size_t channel, reference;
+};
+
+//! Fits a function to a window of a channel (see stfnum::lmFit()).
+/*! Like stfnum::batchFit(), every sweep is fitted from the same initial
+ *  parameters. Appends the best-fit parameters, "SSE" and "Warning";
+ *  these are NaN if the window is out of range or the fit fails.
+ */
+class StfioDll FitStage : public SweepStage {
+public:
+    //! Constructor.
+    /*! Throws std::out_of_range if \e initP doesn't have a value for every parameter.
+     *  \param fitFunc The function, e.g. from stfnum::FuncLib(); has to exist
+     *         while the stage is used.
+     *  \param channel The channel that is fitted.
+     *  \param fitBeg Index of the first sampling point of the fit window.
+     *  \param fitEnd Index one past the last sampling point of the fit window.
+     *  \param initP Initial parameters.
+     *  \param opts Options of the algorithm (see stfnum::LM_default_opts()).
+     *  \param use_scaling Whether to scale x and y-amplitudes to 1.0.
+     */
+    FitStage(const storedFunc& fitFunc, std::size_t channel, std::size_t fitBeg, std::size_t fitEnd,
+             const Vector_double& initP, const Vector_double& opts, bool use_scaling = true);
+
+    std::vector<std::string> Columns() const;
+
+    //! Throws std::out_of_range if the sweep doesn't have the channel.
+    void Process(Sweep& sweep) const;
+
+private:
+    const storedFunc& fitFunc;
+    std::size_t channel, fitBeg, fitEnd;
+    Vector_double initP, opts;
+    bool use_scaling;
+};
+
+//! Receives the results of a pipeline.
+/*! The functions are called by one thread at a time; sweeps arrive in the
+ *  order in which the source has provided them.
+ */
+class StfioDll SweepSink {
+public:
+    //! Destructor
+    virtual ~SweepSink() {}
+
+    //! Called before the first sweep.
+    /*! \param columns The labels of Sweep::values.
+     */
+    virtual void Begin(const std::vector<std::string>& columns) = 0;
+
+    //! Called when all stages have processed a sweep.
+    /*! \param sweep The sweep.
+     */
+    virtual void Consume(const Sweep& sweep) = 0;
+
+    //! Called after the last sweep.
+    virtual void End() {}
+};
+
+//! Collects the results of a pipeline in memory.
+class StfioDll TableSink : public SweepSink {
+public:
+    //! Default constructor.
+    TableSink() : columns(0), labels(0), values(0), events() {}
+
+    void Begin(const std::vector<std::string>& columns);
+    void Consume(const Sweep& sweep);
+
+    //! Retrieves the results.
+    /*! \return A table with one row per sweep; NaN results are empty cells.
+     */
+    Table GetTable() const;
+
+    //! Retrieves the events of all sweeps.
+    /*! \return The events; EventTable::section holds the sweep index.
+     */
+    const EventTable& GetEvents() const { return events; }
+
+private:
+    std::vector<std::string> columns, labels;
+    Vector_double values;
+    EventTable events;
+};
+
+//! Writes the results of a pipeline to a file while they are computed.
+/*! The file is written by a stfio::TableStream, i.e. as HDF5, Parquet or
+ *  comma-separated values, depending on its name.
+ */
+class StfioDll StreamSink : public SweepSink {
+public:
+    //! Constructor.
+    /*! \param fName Full path to the file, or "-" for the standard output.
+     *  \param labelTitle Title of the row labels.
+     *  \param queueRows Number of rows that are collected before they are written.
+     */
+    StreamSink(const std::string& fName, const std::string& labelTitle = "sweep",
+               std::size_t queueRows = 1024);
+
+    //! Destructor. Closes the file; errors are ignored.
+    ~StreamSink();
+
+    //! Creates the file. Throws std::runtime_error if it can't be written.
+    void Begin(const std::vector<std::string>& columns);
+    void Consume(const Sweep& sweep);
+
+    //! Writes the remaining rows and closes the file.
+    void End();
+
+private:
+    StreamSink(const StreamSink&);
+    StreamSink& operator=(const StreamSink&);
+
+    std::string fName, labelTitle;
+    std::size_t queueRows;
+    stfio::TableStream* stream;
+};
+
+//! Passes the sweeps of a source through a chain of stages to a sink.
+class StfioDll Pipeline {
+public:
+    //! Constructor.
+    /*! \param source Provides the sweeps; has to exist while the pipeline is used.
+     *  \param sink Receives the results; has to exist while the pipeline is used.
+     *  \param queueSize Number of sweeps per queue; 0 uses two per thread.
+     *         At most three queues are held in memory at the same time.
+     *  \param n_threads Number of threads that process sweeps; 0 uses the configured number of threads.
+     */
+    Pipeline(SweepSource& source, SweepSink& sink, std::size_t queueSize = 0, int n_threads = 0);
+
+    //! Appends a stage.
+    /*! \param stage The stage; has to exist while the pipeline is used.
+     */
+    void Add(const SweepStage& stage);
+
+    //! Retrieves the labels of the results of all stages, in the order of the stages.
+    std::vector<std::string> Columns() const;
+
+    //! Runs the pipeline until the source has no more sweeps.
+    /*! Throws std::runtime_error if the source, a stage or the sink fails.
+     *  \param progDlg Progress indicator; updated whenever a queue has been
+     *         processed. The sweeps that haven't been written are
+     *         discarded if the operation is cancelled.
+     *  \return The number of sweeps that have been passed to the sink.
+     */
+    std::size_t Run(stfio::ProgressInfo& progDlg);
+
+private:
+    SweepSource& source;
+    SweepSink& sink;
+    std::vector<const SweepStage*> stages;
+    std::size_t queueSize;
+    int n_threads;
+};
+
+/*@}*/
+
+}
+
+#endif
@@ -0,0 +1,344 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
+
+#include "./plugin.h"
+#include "../libstfio/section.h"
+#include "../libstfio/parallel.h"
+
+namespace {
+
+#if (__cplusplus < 201103)
+    typedef boost::shared_ptr<void> LibraryPtr;
+#else
+    typedef std::shared_ptr<void> LibraryPtr;
+#endif
+
+    // Sections per call of a reentrant plugin:
+    const std::size_t batchSize = 16;
+
+    std::vector<std::string> readLabels(const char* const* labels, std::size_t n,
+                                        const std::string& plugin)
+    {
+        if (n > 0 && labels == NULL) {
+            throw std::runtime_error("Labels are missing in plugin " + plugin);
+        }
+        std::vector<std::string> res(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            res[i] = (labels[i] != NULL) ? labels[i] : "";
+        }
+        return res;
+    }
+
+    // Shared by all batches of a run:
+    struct RunState {
+        stfio::ProgressInfo* progDlg;
+        std::size_t n_sections;
+        std::size_t n_done;
+        bool cancelled;
+    };
+
+    // The stf_progress context of a batch:
+    struct BatchProgress {
+        RunState* state;
+        std::size_t reported;
+    };
+
+    int updateProgress(void* context, size_t n_done) {
+        BatchProgress* batch = static_cast<BatchProgress*>(context);
+        RunState* state = batch->state;
+        bool cancelled = false;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_plugin_progress)
+#endif
+        {
+            if (n_done > batch->reported) {
+                state->n_done += n_done - batch->reported;
+                batch->reported = n_done;
+                std::ostringstream msg;
+                msg << "Section " << state->n_done << " of " << state->n_sections;
+                if (!state->cancelled &&
+                    !state->progDlg->Update((int)(100.0*state->n_done/state->n_sections), msg.str()))
+                {
+                    state->cancelled = true;
+                }
+            }
+            cancelled = state->cancelled;
+        }
+        return cancelled ? 0 : 1;
+    }
+
+    void closeLibrary(void* handle) {
+#ifdef _WIN32
+        FreeLibrary((HMODULE)handle);
+#else
+        dlclose(handle);
+#endif
+    }
+
+    bool isLibrary(const std::string& fName) {
+#ifdef _WIN32
+        const std::string ext(".dll");
+#elif defined(__APPLE__)
+        const std::string ext(".dylib");
+#else
+        const std::string ext(".so");
+#endif
+        return fName.size() > ext.size() &&
+            fName.compare(fName.size()-ext.size(), ext.size(), ext) == 0;
+    }
+}
+
+stfnum::NativePlugin::NativePlugin(const stf_plugin& desc, const LibraryPtr& library_)
+    : name(desc.name != NULL ? desc.name : ""),
+      description(desc.description != NULL ? desc.description : ""),
+      flags(desc.flags),
+      paramLabels(readLabels(desc.param_labels, desc.n_params, name)),
+      paramDefaults(desc.n_params, 0.0),
+      resultLabels(readLabels(desc.result_labels, desc.n_results, name)),
+      run(desc.run),
+      library(library_)
+{
+    if (name.empty() || run == NULL) {
+        throw std::runtime_error("Incomplete plugin description");
+    }
+    if (desc.param_defaults != NULL) {
+        std::copy(desc.param_defaults, desc.param_defaults+desc.n_params, paramDefaults.begin());
+    }
+}
+
+stfnum::PluginResults stfnum::NativePlugin::Run(const Channel& sections, double dt,
+                                                const Vector_double& params,
+                                                stfio::ProgressInfo& progDlg, int n_threads) const
+{
+    if (params.size() != paramLabels.size()) {
+        throw std::out_of_range("Wrong number of parameters for plugin " + name);
+    }
+    std::size_t n_sections = sections.size();
+    std::size_t n_results = resultLabels.size();
+    PluginResults res;
+    res.results = Table(n_sections, n_results);
+    for (std::size_t n_r = 0; n_r < n_results; ++n_r) {
+        res.results.SetColLabel(n_r, resultLabels[n_r]);
+    }
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        std::ostringstream label;
+        label << "Section " << n_s+1;
+        res.results.SetRowLabel(n_s, label.str());
+    }
+    if (n_sections == 0) {
+        return res;
+    }
+
+    std::vector<Vector_double> out(Transforms() ? n_sections : 0);
+    Vector_double values(n_sections*n_results, std::numeric_limits<double>::quiet_NaN());
+    // a plugin that isn't reentrant gets all sections at once:
+    std::size_t batch = IsReentrant() ? batchSize : n_sections;
+    int n_batches = (int)((n_sections+batch-1) / batch);
+
+    RunState state;
+    state.progDlg = &progDlg;
+    state.n_sections = n_sections;
+    state.n_done = 0;
+    state.cancelled = false;
+    std::string error;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_batches);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_b = 0; n_b < n_batches; ++n_b) {
+        bool skip = false;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_plugin_progress)
+#endif
+        skip = state.cancelled;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_plugin_error)
+#endif
+        skip = skip || !error.empty();
+        if (skip) {
+            continue;
+        }
+        std::size_t first = n_b*batch;
+        std::size_t count = std::min(batch, n_sections-first);
+        std::vector<stf_span> spans(count);
+        std::vector<double*> outPtrs(count, (double*)NULL);
+        char msg[512] = "";
+        int ret = 0;
+        try {
+            for (std::size_t n = 0; n < count; ++n) {
+                // decodes mapped samples:
+                const Vector_double& data = sections[first+n].get();
+                spans[n].data = data.empty() ? NULL : &data[0];
+                spans[n].size = data.size();
+                if (Transforms()) {
+                    out[first+n].resize(data.size());
+                    outPtrs[n] = data.empty() ? NULL : &out[first+n][0];
+                }
+            }
+            BatchProgress progress = {&state, 0};
+            stf_progress callback = {&progress, updateProgress};
+            ret = run(&spans[0], count, dt, params.empty() ? NULL : &params[0],
+                      Transforms() ? &outPtrs[0] : NULL,
+                      n_results > 0 ? &values[first*n_results] : NULL,
+                      &callback, msg, sizeof(msg));
+            msg[sizeof(msg)-1] = '\0';
+        }
+        catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_plugin_error)
+#endif
+            if (error.empty()) error = e.what();
+        }
+        if (ret != 0) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_plugin_error)
+#endif
+            if (error.empty()) error = name + ": " + (msg[0] != '\0' ? msg : "unknown error");
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    if (state.cancelled) {
+        return PluginResults();
+    }
+
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        for (std::size_t n_r = 0; n_r < n_results; ++n_r) {
+            double value = values[n_s*n_results+n_r];
+            if (std::isnan(value)) {
+                res.results.SetEmpty(n_s, n_r, true);
+            } else {
+                res.results.at(n_s, n_r) = value;
+            }
+        }
+    }
+    if (Transforms()) {
+        res.traces = Channel(n_sections);
+        res.traces.SetChannelName(sections.GetChannelName());
+        res.traces.SetYUnits(sections.GetYUnits());
+        for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+            Section sec(STFIO_MOVE(out[n_s]), sections[n_s].GetSectionDescription() + ", " + name);
+            sec.SetXScale(sections[n_s].GetXScale());
+            res.traces.InsertSection(STFIO_MOVE(sec), n_s);
+        }
+    }
+    return res;
+}
+
+std::vector<stfnum::NativePlugin> stfnum::GetPlugins(const stf_plugin_library& desc,
+                                                     const LibraryPtr& library)
+{
+    if (desc.api_version != STF_PLUGIN_API_VERSION) {
+        std::ostringstream msg;
+        msg << "The plugin library has been built for version " << desc.api_version
+            << " of the plugin interface; version " << STF_PLUGIN_API_VERSION << " is required";
+        throw std::runtime_error(msg.str());
+    }
+    if (desc.n_plugins > 0 && desc.plugins == NULL) {
+        throw std::runtime_error("The plugin library has no plugin descriptions");
+    }
+    std::vector<NativePlugin> plugins;
+    for (std::size_t n = 0; n < desc.n_plugins; ++n) {
+        plugins.push_back(NativePlugin(desc.plugins[n], library));
+    }
+    return plugins;
+}
+
+std::vector<stfnum::NativePlugin> stfnum::LoadPlugins(const std::string& fName) {
+#ifdef _WIN32
+    HMODULE handle = LoadLibraryA(fName.c_str());
+    if (handle == NULL) {
+        throw std::runtime_error("Couldn't load " + fName);
+    }
+    LibraryPtr library((void*)handle, closeLibrary);
+    stf_plugin_entry entry = (stf_plugin_entry)GetProcAddress(handle, STF_PLUGIN_ENTRY);
+#else
+    void* handle = dlopen(fName.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        const char* msg = dlerror();
+        throw std::runtime_error(msg != NULL ? std::string(msg) : "Couldn't load " + fName);
+    }
+    LibraryPtr library(handle, closeLibrary);
+    stf_plugin_entry entry = reinterpret_cast<stf_plugin_entry>(dlsym(handle, STF_PLUGIN_ENTRY));
+#endif
+    if (entry == NULL) {
+        throw std::runtime_error(fName + " doesn't export " + STF_PLUGIN_ENTRY);
+    }
+    const stf_plugin_library* desc = entry();
+    if (desc == NULL) {
+        throw std::runtime_error(fName + " doesn't describe any plugins");
+    }
+    return GetPlugins(*desc, library);
+}
+
+std::vector<stfnum::NativePlugin> stfnum::LoadPluginDir(const std::string& dirName,
+                                                        std::vector<std::string>& errors)
+{
+    std::vector<std::string> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE hFind = FindFirstFileA((dirName + "\\*").c_str(), &data);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isLibrary(data.cFileName)) {
+                files.push_back(dirName + "\\" + data.cFileName);
+            }
+        } while (FindNextFileA(hFind, &data));
+        FindClose(hFind);
+    }
+#else
+    DIR* dir = opendir(dirName.c_str());
+    if (dir != NULL) {
+        while (struct dirent* d = readdir(dir)) {
+            std::string path = dirName + "/" + d->d_name;
+            struct stat st;
+            if (isLibrary(d->d_name) && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                files.push_back(path);
+            }
+        }
+        closedir(dir);
+    }
+#endif
+    // the menu entries shouldn't depend on the order of the directory:
+    std::sort(files.begin(), files.end());
+    std::vector<NativePlugin> plugins;
+    for (std::size_t n = 0; n < files.size(); ++n) {
+        try {
+            std::vector<NativePlugin> lib(LoadPlugins(files[n]));
+            plugins.insert(plugins.end(), lib.begin(), lib.end());
+        }
+        catch (const std::runtime_error& e) {
+            errors.push_back(e.what());
+        }
+    }
+    return plugins;
+}
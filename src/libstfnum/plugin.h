@@ -0,0 +1,169 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file plugin.h
+ *  \brief Native analysis plugins that are loaded from shared libraries.
+ *
+ *  The binary interface that plugin libraries implement is declared in
+ *  stfplugin.h; this file declares how Stimfit loads and runs them.
+ */
+
+#ifndef _STFNUM_PLUGIN_H
+#define _STFNUM_PLUGIN_H
+
+#include <string>
+#include <vector>
+#if (__cplusplus < 201103)
+    #include <boost/shared_ptr.hpp>
+#else
+    #include <memory>
+#endif
+
+#include "../libstfio/stfio.h"
+#include "../libstfio/channel.h"
+#include "./stfnum.h"
+#include "./stfplugin.h"
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! The results of a native plugin.
+struct PluginResults {
+    //! Constructor
+    PluginResults() : traces(), results(0, 0) {}
+    Channel traces; /*!< A new trace for each section; empty unless the plugin transforms traces. */
+    Table results;  /*!< A row for each section and a column for each result. */
+};
+
+//! An analysis that is provided by a native plugin library.
+/*! Copies of a plugin keep its library loaded.
+ */
+class StfioDll NativePlugin {
+public:
+    //! Constructor
+    /*! \param desc The description of the analysis.
+     *  \param library Keeps the code of the analysis loaded; may be empty
+     *         if the analysis is linked into the program.
+     */
+    NativePlugin(const stf_plugin& desc,
+#if (__cplusplus < 201103)
+                 const boost::shared_ptr<void>& library
+#else
+                 const std::shared_ptr<void>& library
+#endif
+                 );
+
+    //! Retrieves the menu entry of the analysis.
+    /*! \return The name of the analysis.
+     */
+    const std::string& GetName() const { return name; }
+
+    //! Retrieves the description of the analysis.
+    /*! \return The description.
+     */
+    const std::string& GetDescription() const { return description; }
+
+    //! Retrieves the labels of the parameters that the user enters.
+    /*! \return One label per parameter.
+     */
+    const std::vector<std::string>& GetParamLabels() const { return paramLabels; }
+
+    //! Retrieves the default values of the parameters.
+    /*! \return One value per parameter.
+     */
+    const Vector_double& GetParamDefaults() const { return paramDefaults; }
+
+    //! Determines whether the analysis writes new traces.
+    /*! \return true if PluginResults::traces are filled in.
+     */
+    bool Transforms() const { return (flags & STF_PLUGIN_TRANSFORMS) != 0; }
+
+    //! Determines whether batches of sections may be analysed in parallel.
+    /*! \return true if the plugin is reentrant.
+     */
+    bool IsReentrant() const { return (flags & STF_PLUGIN_REENTRANT) != 0; }
+
+    //! Runs the analysis.
+    /*! Sections are handed to the plugin in batches. Batches are analysed
+     *  in parallel if the plugin is reentrant; otherwise, all sections are
+     *  passed at once. Can be called from a worker thread. Throws
+     *  std::out_of_range if the number of parameters is wrong and
+     *  std::runtime_error if the plugin reports an error.
+     *  \param sections The sections to be analysed.
+     *  \param dt The sampling interval.
+     *  \param params One value per parameter.
+     *  \param progDlg Progress indicator.
+     *  \param n_threads Number of batches that are analysed in parallel;
+     *         0 uses the configured number of threads.
+     *  \return The results, or empty results if the analysis has been cancelled.
+     */
+    PluginResults Run(const Channel& sections, double dt, const Vector_double& params,
+                      stfio::ProgressInfo& progDlg, int n_threads = 0) const;
+
+private:
+    std::string name, description;
+    unsigned flags;
+    std::vector<std::string> paramLabels;
+    Vector_double paramDefaults;
+    std::vector<std::string> resultLabels;
+    int (*run)(const stf_span*, size_t, double, const double*, double* const*, double*,
+               const stf_progress*, char*, size_t);
+#if (__cplusplus < 201103)
+    boost::shared_ptr<void> library;
+#else
+    std::shared_ptr<void> library;
+#endif
+};
+
+//! Reads the analyses from a plugin library description.
+/*! Throws std::runtime_error if the library has been built for another
+ *  version of the interface or if a description is incomplete.
+ *  \param desc The description that the library's entry function has returned.
+ *  \param library Keeps the library loaded; may be empty.
+ *  \return The analyses.
+ */
+StfioDll std::vector<NativePlugin> GetPlugins(const stf_plugin_library& desc,
+#if (__cplusplus < 201103)
+                                              const boost::shared_ptr<void>& library
+#else
+                                              const std::shared_ptr<void>& library
+#endif
+                                              );
+
+//! Loads a plugin library.
+/*! The library is unloaded when the last of its analyses is destroyed.
+ *  Throws std::runtime_error if the library can't be loaded or doesn't
+ *  export STF_PLUGIN_ENTRY.
+ *  \param fName The path of the shared library.
+ *  \return The analyses of the library.
+ */
+StfioDll std::vector<NativePlugin> LoadPlugins(const std::string& fName);
+
+//! Loads all plugin libraries in a directory.
+/*! Libraries that can't be loaded are skipped.
+ *  \param dirName The directory.
+ *  \param errors Is set to a message for each library that has been skipped.
+ *  \return The analyses of all libraries.
+ */
+StfioDll std::vector<NativePlugin> LoadPluginDir(const std::string& dirName,
+                                                 std::vector<std::string>& errors);
+
+/*@}*/
+
+}
+
+#endif
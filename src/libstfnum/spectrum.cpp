@@ -0,0 +1,215 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file spectrum.cpp
+ *  \brief Power spectral densities and spectrograms.
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "./spectrum.h"
+#include "./gpu.h"
+#include "../libstfio/section.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/parallel.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+    // Samples that are decoded at a time from sections that aren't stored
+    // in memory as doubles:
+    const std::size_t spectrumBlockSize = 65536;
+
+    int spectrumThreads(int n_threads, int n_tasks) {
+        return stfio::threadCount(n_threads, n_tasks);
+    }
+
+}
+
+stfnum::WelchAccumulator::WelchAccumulator(std::size_t segment_, std::size_t overlap, double dt_)
+    : segment(segment_), hop(0), dt(dt_), norm(0), window(0), pending(0), sum(0), n_segments(0),
+      in(0), out(0)
+{
+    if (segment < 2 || overlap >= segment || !(dt > 0)) {
+        throw std::out_of_range("Invalid segment, overlap or sampling interval in stfnum::WelchAccumulator");
+    }
+    hop = segment - overlap;
+    // periodic Hann window:
+    window.resize(segment);
+    double sum_w2 = 0.0;
+    for (std::size_t n = 0; n < segment; ++n) {
+        window[n] = 0.5 - 0.5*cos(2.0*3.14159265358979323846*n/segment);
+        sum_w2 += window[n]*window[n];
+    }
+    norm = dt / sum_w2;
+    sum.resize(Frequencies(), 0.0);
+    in.resize(segment);
+    out.resize(2*Frequencies());
+}
+
+void stfnum::WelchAccumulator::Reset() {
+    pending.clear();
+    std::fill(sum.begin(), sum.end(), 0.0);
+    n_segments = 0;
+}
+
+void stfnum::WelchAccumulator::Add(const double* x, std::size_t n) {
+    // The segments start at multiples of hop in the pending samples
+    // followed by x; only those that span both are copied:
+    std::size_t n_old = pending.size(), total = n_old + n, p = 0;
+    for (; p + segment <= total; p += hop) {
+        if (p >= n_old) {
+            AddSegment(x + (p-n_old));
+        } else {
+            std::copy(pending.begin() + p, pending.end(), in.begin());
+            std::copy(x, x + (segment-(n_old-p)), in.begin() + (n_old-p));
+            AddSegment(&in[0]);
+        }
+    }
+    // keep the samples from the start of the next segment:
+    if (p >= n_old) {
+        pending.assign(x + std::min(p-n_old, n), x + n);
+    } else {
+        pending.erase(pending.begin(), pending.begin() + p);
+        pending.insert(pending.end(), x, x + n);
+    }
+}
+
+void stfnum::WelchAccumulator::AddSegment(const double* x) {
+    Vector_double density;
+    Periodogram(x, density);
+    for (std::size_t k = 0; k < density.size(); ++k) {
+        sum[k] += density[k];
+    }
+    ++n_segments;
+}
+
+void stfnum::WelchAccumulator::Periodogram(const double* x, Vector_double& density) const {
+    STF_PROFILE_SCOPE("fft/periodogram");
+    double mean = 0.0;
+    for (std::size_t n = 0; n < segment; ++n) {
+        mean += x[n];
+    }
+    mean /= segment;
+    // x may point into in:
+    for (std::size_t n = 0; n < segment; ++n) {
+        in[n] = (x[n] - mean) * window[n];
+    }
+    fftw_complex* spectrum = reinterpret_cast<fftw_complex*>(&out[0]);
+    executeR2C(fftwPlan((int)segment, false), (int)segment, &in[0], spectrum);
+
+    std::size_t n_freq = Frequencies();
+    density.resize(n_freq);
+    for (std::size_t k = 0; k < n_freq; ++k) {
+        double p = spectrum[k][0]*spectrum[k][0] + spectrum[k][1]*spectrum[k][1];
+        // one-sided: all but the constant and the Nyquist term appear twice:
+        if (k > 0 && 2*k != segment) {
+            p *= 2.0;
+        }
+        density[k] = p * norm;
+    }
+}
+
+Vector_double stfnum::WelchAccumulator::Density() const {
+    Vector_double density(0);
+    if (n_segments > 0) {
+        density.resize(sum.size());
+        for (std::size_t k = 0; k < sum.size(); ++k) {
+            density[k] = sum[k] / n_segments;
+        }
+    }
+    return density;
+}
+
+Vector_double stfnum::welch(const Section& sec, std::size_t segment, std::size_t overlap,
+                            double dt, std::size_t& n_segments)
+{
+    STF_PROFILE_SCOPE("spectrum/welch");
+    WelchAccumulator acc(segment, overlap, dt);
+    const double* x = sec.GetSpan();
+    if (x != NULL) {
+        acc.Add(x, sec.size());
+    } else {
+        Vector_double buffer(std::min(spectrumBlockSize, sec.size()));
+        for (std::size_t begin = 0; begin < sec.size(); begin += spectrumBlockSize) {
+            std::size_t end = std::min(begin + spectrumBlockSize, sec.size());
+            sec.CopyRange(begin, end, &buffer[0]);
+            acc.Add(&buffer[0], end-begin);
+        }
+    }
+    n_segments = acc.Segments();
+    return acc.Density();
+}
+
+std::vector<Vector_double> stfnum::welch(const std::vector<const Section*>& sections,
+                                         std::size_t segment, std::size_t overlap,
+                                         double dt, int n_threads)
+{
+    // throws before any thread has been started:
+    WelchAccumulator check(segment, overlap, dt);
+
+    std::vector<Vector_double> result(sections.size());
+    int n_sections = (int)sections.size();
+    n_threads = spectrumThreads(n_threads, n_sections);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(n_threads) schedule(dynamic)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        std::size_t n_segments = 0;
+        result[n_s] = welch(*sections[n_s], segment, overlap, dt, n_segments);
+    }
+    return result;
+}
+
+stfnum::Spectrogram stfnum::spectrogram(const Section& sec, std::size_t segment, std::size_t overlap,
+                                        double dt, int n_threads)
+{
+    STF_PROFILE_SCOPE("spectrum/spectrogram");
+    WelchAccumulator check(segment, overlap, dt);
+    std::size_t hop = segment - overlap;
+
+    Spectrogram result;
+    result.df = check.Df();
+    result.dt = hop*dt;
+    int n_windows = sec.size() >= segment ? (int)((sec.size()-segment)/hop + 1) : 0;
+    result.density.resize(n_windows);
+    const double* span = sec.GetSpan();
+    n_threads = spectrumThreads(n_threads, n_windows);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+        WelchAccumulator acc(segment, overlap, dt);
+        Vector_double buffer(segment);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (int n_w = 0; n_w < n_windows; ++n_w) {
+            std::size_t begin = n_w*hop;
+            const double* x = &buffer[0];
+            if (span != NULL) {
+                x = span + begin;
+            } else {
+                sec.CopyRange(begin, begin + segment, &buffer[0]);
+            }
+            acc.Periodogram(x, result.density[n_w]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,155 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file spectrum.h
+ *  \brief Power spectral densities and spectrograms.
+ *
+ *  Traces are split into overlapping segments of equal length. Every
+ *  segment is detrended by subtracting its mean, multiplied with a Hann
+ *  window and transformed with a cached FFTW plan. Welch's method averages
+ *  the periodograms of all segments; a spectrogram keeps them apart.
+ *  Densities are one-sided: their sum times the frequency resolution is
+ *  the variance of the trace. Frequencies are in units of the inverse of
+ *  the x units, i.e. in kHz if the sampling interval is given in ms.
+ */
+
+#ifndef _STFNUM_SPECTRUM_H
+#define _STFNUM_SPECTRUM_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "../libstfio/aligned.h"
+#include "./stfnum.h"
+
+class Section;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Averages the periodograms of overlapping segments of a stream of samples.
+/*! Samples may be added in blocks of any size; only the samples of the
+ *  segment that hasn't been completed yet are kept, so that traces of any
+ *  length are processed in bounded memory. Not thread-safe; use one
+ *  accumulator per stream.
+ */
+class StfioDll WelchAccumulator {
+public:
+    //! Constructor.
+    /*! Throws std::out_of_range if \e segment is smaller than 2, if
+     *  \e overlap isn't smaller than \e segment, or if \e dt isn't positive.
+     *  \param segment Number of samples per segment.
+     *  \param overlap Number of samples that consecutive segments share.
+     *  \param dt The sampling interval.
+     */
+    WelchAccumulator(std::size_t segment, std::size_t overlap, double dt);
+
+    //! Adds samples to the stream.
+    /*! \param x Pointer to the first sample.
+     *  \param n Number of samples.
+     */
+    void Add(const double* x, std::size_t n);
+
+    //! Starts a new stream, discarding all segments.
+    void Reset();
+
+    //! Retrieves the power spectral density.
+    /*! \return The average density of the completed segments at every
+     *          multiple of Df(), starting at 0; empty if no segment has
+     *          been completed.
+     */
+    Vector_double Density() const;
+
+    //! Number of segments that have been completed.
+    std::size_t Segments() const { return n_segments; }
+
+    //! Frequency resolution of the density.
+    double Df() const { return 1.0 / (segment*dt); }
+
+    //! Number of frequencies of the density.
+    std::size_t Frequencies() const { return segment/2 + 1; }
+
+    //! Computes the density of a single segment.
+    /*! Used by stfnum::spectrogram(); independent of the stream.
+     *  \param x Pointer to the first of Segment() samples.
+     *  \param density On exit, the density of the segment at every multiple of Df().
+     */
+    void Periodogram(const double* x, Vector_double& density) const;
+
+private:
+    // Adds the periodogram of a segment to sum:
+    void AddSegment(const double* x);
+
+    std::size_t segment, hop;
+    double dt, norm;
+    Vector_double window;
+    // samples of the incomplete segment:
+    Vector_double pending;
+    std::size_t n_pending;
+    Vector_double sum;
+    std::size_t n_segments;
+    mutable stfio::Vector_aligned in, out;
+};
+
+//! Computes the power spectral density of a section with Welch's method.
+/*! The section is read block by block; compactly stored or lazily read
+ *  sections aren't decoded as a whole. Throws std::out_of_range if the
+ *  parameters are invalid (see stfnum::WelchAccumulator).
+ *  \param sec The section.
+ *  \param segment Number of samples per segment.
+ *  \param overlap Number of samples that consecutive segments share.
+ *  \param dt The sampling interval.
+ *  \param n_segments On exit, the number of segments that have been averaged.
+ *  \return The density at every multiple of 1/(segment*dt), starting at 0;
+ *          empty if the section is shorter than a segment.
+ */
+StfioDll Vector_double welch(const Section& sec, std::size_t segment, std::size_t overlap,
+                             double dt, std::size_t& n_segments);
+
+//! Computes the power spectral densities of several sections in parallel.
+/*! The sections may belong to different channels. See stfnum::welch() for
+ *  a description of the remaining parameters.
+ *  \param sections The sections.
+ *  \param n_threads Number of threads; 0 uses the configured number of threads.
+ *  \return The density of every section.
+ */
+StfioDll std::vector<Vector_double> welch(const std::vector<const Section*>& sections,
+                                          std::size_t segment, std::size_t overlap,
+                                          double dt, int n_threads = 0);
+
+//! A short-time power spectrum, as returned by stfnum::spectrogram().
+struct StfioDll Spectrogram {
+    //! The density of every segment at every multiple of \e df, starting at 0.
+    std::vector<Vector_double> density;
+    double df;  /*!< Frequency resolution. */
+    double dt;  /*!< Time between the starts of consecutive segments. */
+};
+
+//! Computes a spectrogram of a section.
+/*! Segments are transformed in parallel; every thread reads the samples of
+ *  its segment only. See stfnum::welch() for a description of the parameters.
+ *  \param n_threads Number of threads; 0 uses the configured number of threads.
+ *  \return The density of every segment.
+ */
+StfioDll Spectrogram spectrogram(const Section& sec, std::size_t segment, std::size_t overlap,
+                                 double dt, int n_threads = 0);
+
+/*@}*/
+
+}
+
+#endif
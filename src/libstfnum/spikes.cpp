@@ -0,0 +1,221 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file spikes.cpp
+ *  \brief Measurement of all action potentials of many sections at once.
+ */
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./stfnum.h"
+#include "./measure.h"
+#include "./spikes.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/parallel.h"
+
+void stfnum::SpikeTable::append(const SpikeTable& other) {
+    section.insert(section.end(), other.section.begin(), other.section.end());
+    thresholdT.insert(thresholdT.end(), other.thresholdT.begin(), other.thresholdT.end());
+    threshold.insert(threshold.end(), other.threshold.begin(), other.threshold.end());
+    peakT.insert(peakT.end(), other.peakT.begin(), other.peakT.end());
+    peak.insert(peak.end(), other.peak.begin(), other.peak.end());
+    amplitude.insert(amplitude.end(), other.amplitude.begin(), other.amplitude.end());
+    halfWidth.insert(halfWidth.end(), other.halfWidth.begin(), other.halfWidth.end());
+    maxRise.insert(maxRise.end(), other.maxRise.begin(), other.maxRise.end());
+    maxRiseT.insert(maxRiseT.end(), other.maxRiseT.begin(), other.maxRiseT.end());
+    maxDecay.insert(maxDecay.end(), other.maxDecay.begin(), other.maxDecay.end());
+    maxDecayT.insert(maxDecayT.end(), other.maxDecayT.begin(), other.maxDecayT.end());
+    ahp.insert(ahp.end(), other.ahp.begin(), other.ahp.end());
+    ahpT.insert(ahpT.end(), other.ahpT.begin(), other.ahpT.end());
+}
+
+stfnum::Table stfnum::SpikeTable::ToTable(double dt) const {
+    Table table(size(), 12);
+    table.SetColLabel(0, "Section");
+    table.SetColLabel(1, "Time of threshold");
+    table.SetColLabel(2, "Threshold");
+    table.SetColLabel(3, "Time of peak");
+    table.SetColLabel(4, "Peak (from 0)");
+    table.SetColLabel(5, "Amplitude");
+    table.SetColLabel(6, "Half width");
+    table.SetColLabel(7, "Max. slope of rise");
+    table.SetColLabel(8, "Max. slope of decay");
+    table.SetColLabel(9, "AHP (from 0)");
+    table.SetColLabel(10, "AHP (from threshold)");
+    table.SetColLabel(11, "Time of AHP");
+    for (std::size_t n = 0; n < size(); ++n) {
+        std::ostringstream label;
+        label << "Spike #" << n+1;
+        table.SetRowLabel(n, label.str());
+        table.at(n, 0) = (double)section[n]+1;
+        table.at(n, 1) = thresholdT[n]*dt;
+        table.at(n, 2) = threshold[n];
+        table.at(n, 3) = peakT[n]*dt;
+        table.at(n, 4) = peak[n];
+        table.at(n, 5) = amplitude[n];
+        table.at(n, 6) = halfWidth[n]*dt;
+        table.at(n, 7) = maxRise[n]/dt;
+        table.at(n, 8) = maxDecay[n]/dt;
+        table.at(n, 9) = ahp[n];
+        table.at(n, 10) = ahp[n]-threshold[n];
+        table.at(n, 11) = ahpT[n]*dt;
+    }
+    return table;
+}
+
+stfnum::SpikeDetectionPlan::SpikeDetectionPlan() :
+    slope(1.0), windowLength(1), minAmplitude(20.0), maxDuration(0)
+{}
+
+stfnum::SpikeTable stfnum::SpikeDetectionPlan::Detect(const Section& sec, std::size_t n_section) const
+{
+    STF_PROFILE_SCOPE("stfnum/spikes");
+    SpikeTable spikes;
+    std::size_t w = std::max(windowLength, (std::size_t)1);
+    if (sec.size() < w+2) {
+        return spikes;
+    }
+    // Mapped samples are decoded into a copy that shares them, so that
+    // the decoded data don't stay in memory once the section is done:
+    Section mapped;
+    if (sec.IsMapped()) {
+        mapped = sec;
+    }
+    const Vector_double& data = sec.IsMapped() ? mapped.get() : sec.get();
+    std::size_t last = data.size()-1;
+
+    std::vector<SlopeCrossing> crossings(slopeCrossings(data, 0, data.size()-w, slope, w));
+    for (std::size_t n_c = 0; n_c < crossings.size(); ++n_c) {
+        // each spike extends to the next crossing:
+        std::size_t begin = (std::size_t)lround(crossings[n_c].t - w/2.0);
+        std::size_t end = (n_c+1 < crossings.size()) ?
+            (std::size_t)lround(crossings[n_c+1].t - w/2.0) : last;
+        std::size_t peakEnd = end;
+        if (maxDuration > 0 && begin+maxDuration < peakEnd) {
+            peakEnd = begin+maxDuration;
+        }
+        double thr = crossings[n_c].value;
+        double peakT = 0;
+        double peakValue = stfnum::peak(data, thr, begin, peakEnd, 1, stfnum::up, peakT);
+        if (!(peakValue-thr >= minAmplitude)) {
+            continue;
+        }
+        double ahpT = 0;
+        double ahpValue = stfnum::peak(data, thr, (std::size_t)peakT, end, 1, stfnum::down, ahpT);
+
+        double riseT = NAN, riseY = NAN, decayT = NAN, decayY = NAN;
+        double rise = stfnum::maxRise(data, (double)begin, peakT, riseT, riseY, w);
+        double decay = stfnum::maxDecay(data, peakT, ahpT, decayT, decayY, w);
+        std::size_t t50LeftId = 0, t50RightId = 0;
+        double t50LeftReal = 0;
+        double halfWidth = stfnum::t_half(data, thr, peakValue-thr, (double)begin, (double)end,
+                                          peakT, t50LeftId, t50RightId, t50LeftReal);
+
+        spikes.section.push_back(n_section);
+        spikes.thresholdT.push_back(crossings[n_c].t);
+        spikes.threshold.push_back(thr);
+        spikes.peakT.push_back(peakT);
+        spikes.peak.push_back(peakValue);
+        spikes.amplitude.push_back(peakValue-thr);
+        spikes.halfWidth.push_back(halfWidth);
+        spikes.maxRise.push_back(rise);
+        spikes.maxRiseT.push_back(riseT);
+        spikes.maxDecay.push_back(decay);
+        spikes.maxDecayT.push_back(decayT);
+        spikes.ahp.push_back(ahpValue);
+        spikes.ahpT.push_back(ahpT);
+    }
+    return spikes;
+}
+
+stfnum::SpikeTable stfnum::SpikeDetectionPlan::Detect(const Channel& ch, const std::vector<std::size_t>& sections,
+                                                      stfio::ProgressInfo& progDlg, int n_threads) const
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::SpikeDetectionPlan::Detect()");
+        }
+    }
+    int n_sections = (int)sections.size();
+    std::vector<SpikeTable> results(n_sections);
+    std::vector<std::string> errors(n_sections);
+    int n_finished = 0;
+    bool cancelled = false;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+    // the progress indicator may belong to the GUI and is only updated
+    // from the calling thread:
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        bool skip;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_spike_progress)
+#endif
+        skip = cancelled;
+        if (!skip) {
+            try {
+                results[n_s] = Detect(ch[sections[n_s]], sections[n_s]);
+            }
+            catch (const std::exception& e) {
+                errors[n_s] = e.what();
+            }
+        }
+#ifdef _OPENMP
+#pragma omp critical(stfnum_spike_progress)
+#endif
+        {
+            ++n_finished;
+            bool master = true;
+#ifdef _OPENMP
+            master = omp_get_thread_num() == 0;
+#endif
+            if (master && !cancelled) {
+                std::ostringstream msg;
+                msg << "Measuring section " << n_finished << " of " << n_sections;
+                cancelled = !progDlg.Update((int)(100.0*n_finished/n_sections), msg.str());
+            }
+        }
+    }
+    SpikeTable spikes;
+    if (cancelled) {
+        return spikes;
+    }
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        if (!errors[n_s].empty()) {
+            std::ostringstream error;
+            error << "Section " << sections[n_s]+1 << ": " << errors[n_s];
+            throw std::runtime_error(error.str());
+        }
+        spikes.append(results[n_s]);
+    }
+    return spikes;
+}
+
+stfnum::SpikeTable stfnum::SpikeDetectionPlan::Detect(const Channel& ch, stfio::ProgressInfo& progDlg,
+                                                      int n_threads) const
+{
+    std::vector<std::size_t> sections(ch.size());
+    for (std::size_t n_s = 0; n_s < sections.size(); ++n_s) {
+        sections[n_s] = n_s;
+    }
+    return Detect(ch, sections, progDlg, n_threads);
+}
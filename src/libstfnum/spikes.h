@@ -0,0 +1,121 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file spikes.h
+ *  \brief Measurement of all action potentials of many sections at once.
+ */
+
+#ifndef _STFNUM_SPIKES_H
+#define _STFNUM_SPIKES_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "./stfnum.h"
+
+class Channel;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Action potentials, stored column by column.
+/*! Row n describes a single spike; rows are sorted by section and time.
+ *  Times and widths are given in sampling points within the section,
+ *  slopes in y units per sampling point.
+ */
+struct StfioDll SpikeTable {
+    std::vector<std::size_t> section; /*!< Index of the section within the channel. */
+    std::vector<double> thresholdT;   /*!< Interpolated time of the threshold crossing (see stfnum::threshold()). */
+    std::vector<double> threshold;    /*!< Value at the threshold crossing. */
+    std::vector<double> peakT;        /*!< Time of the peak. */
+    std::vector<double> peak;         /*!< Peak value, measured from 0. */
+    std::vector<double> amplitude;    /*!< Peak value, measured from the threshold. */
+    std::vector<double> halfWidth;    /*!< Full width at half-maximal amplitude above the threshold. */
+    std::vector<double> maxRise;      /*!< Maximal slope between the threshold and the peak. */
+    std::vector<double> maxRiseT;     /*!< Interpolated time of the maximal slope of rise. */
+    std::vector<double> maxDecay;     /*!< Maximal slope between the peak and the afterhyperpolarisation. */
+    std::vector<double> maxDecayT;    /*!< Interpolated time of the maximal slope of decay. */
+    std::vector<double> ahp;          /*!< Minimum between the peak and the next spike, measured from 0. */
+    std::vector<double> ahpT;         /*!< Time of the afterhyperpolarisation minimum. */
+
+    //! Retrieves the number of spikes.
+    /*! \return The number of rows.
+     */
+    std::size_t size() const { return peakT.size(); }
+
+    //! Appends all spikes of another table.
+    /*! \param other The spikes to be appended.
+     */
+    void append(const SpikeTable& other);
+
+    //! Converts the spikes to a table that can be shown in the results window.
+    /*! \param dt The sampling interval; times are given in x units and
+     *         slopes in y units per x unit.
+     *  \return A table with one row per spike.
+     */
+    Table ToTable(double dt) const;
+};
+
+//! Spike detection settings that can be applied to many sections.
+/*! A spike starts where the slope exceeds a threshold, as in
+ *  stfnum::threshold(), and ends where the next spike starts or the
+ *  section ends. Each section is measured in a single pass: the threshold
+ *  crossings are found with stfnum::slopeCrossings(), and each spike is
+ *  then measured with the vectorized kernels of stfnum::peak(),
+ *  stfnum::t_half(), stfnum::maxRise() and stfnum::maxDecay() within its
+ *  own stretch of data.
+ */
+struct StfioDll SpikeDetectionPlan {
+    //! Constructor. Sets defaults for a recording at 20 kHz in mV.
+    SpikeDetectionPlan();
+
+    //! Measures the spikes of a single section.
+    /*! \param sec The section to be scanned.
+     *  \param n_section The section index that is written to the table.
+     *  \return The spikes of this section.
+     */
+    SpikeTable Detect(const Section& sec, std::size_t n_section) const;
+
+    //! Measures the spikes of several sections of a channel.
+    /*! Throws std::out_of_range if a section index is out of range.
+     *  \param ch The channel to be scanned.
+     *  \param sections Indices of the sections within \e ch.
+     *  \param progDlg Progress indicator; updated as sections are finished.
+     *  \param n_threads Number of sections that are scanned in parallel;
+     *         0 uses the configured number of threads.
+     *  \return The spikes of all sections in the order of \e sections,
+     *          or an empty table if the operation was cancelled.
+     */
+    SpikeTable Detect(const Channel& ch, const std::vector<std::size_t>& sections,
+                      stfio::ProgressInfo& progDlg, int n_threads = 0) const;
+
+    //! Measures the spikes of all sections of a channel.
+    /*! See Detect() above for a description of the parameters.
+     */
+    SpikeTable Detect(const Channel& ch, stfio::ProgressInfo& progDlg, int n_threads = 0) const;
+
+    double slope;             /*!< Slope threshold in y units per sampling point. */
+    std::size_t windowLength; /*!< Distance in sampling points used to compute slopes. */
+    double minAmplitude;      /*!< Spikes with a smaller amplitude above the threshold are discarded. */
+    std::size_t maxDuration;  /*!< Maximal distance from the threshold to the peak in sampling points; 0 for no limit. */
+};
+
+/*@}*/
+
+}
+
+#endif
@@ -18,36 +18,47 @@
 // C. Schmidt-Hieber
 
 #include <cmath>
+#include <climits>
 #include <limits>
 #include <algorithm>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <sstream>
 
 #include "stfnum.h"
 #include "fit.h"
 #include "funclib.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/aligned.h"
+#include "../libstfio/scratch.h"
+#include "../libstfio/parallel.h"
+#include "./gpu.h"
 
 int isnan(double x) { return x != x; }
 int isinf(double x) { return !isnan(x) && isnan(x - x); }
 
 stfnum::Table::Table(std::size_t nRows,std::size_t nCols) :
-values(nRows,std::vector<double>(nCols,1.0)),
-    empty(nRows,std::deque<bool>(nCols,false)),
+values(nCols,Vector_double(nRows,1.0)),
+    empty(nCols,std::vector<bool>(nRows,false)),
     rowLabels(nRows, "\0"),
     colLabels(nCols, "\0")
     {}
 
 stfnum::Table::Table(const std::map< std::string, double >& map)
-: values(map.size(),std::vector<double>(1,1.0)), empty(map.size(),std::deque<bool>(1,false)),
+: values(1,Vector_double(map.size(),1.0)), empty(1,std::vector<bool>(map.size(),false)),
 rowLabels(map.size(), "\0"), colLabels(1, "Results")
 {
     std::map< std::string, double >::const_iterator cit;
     sst_it it1 = rowLabels.begin();
-    std::vector< std::vector<double> >::iterator it2 = values.begin();
+    Vector_double::iterator it2 = values[0].begin();
     for (cit = map.begin();
-         cit != map.end() && it1 != rowLabels.end() && it2 != values.end();
+         cit != map.end() && it1 != rowLabels.end() && it2 != values[0].end();
          cit++)
     {
         (*it1) = cit->first;
-        it2->at(0) = cit->second;
+        (*it2) = cit->second;
         it1++;
         it2++;
     }
@@ -55,7 +66,7 @@ rowLabels(map.size(), "\0"), colLabels(1, "Results")
 
 double stfnum::Table::at(std::size_t row,std::size_t col) const {
     try {
-        return values.at(row).at(col);
+        return values.at(col).at(row);
     }
     catch (...) {
         throw;
@@ -64,7 +75,7 @@ double stfnum::Table::at(std::size_t row,std::size_t col) const {
 
 double& stfnum::Table::at(std::size_t row,std::size_t col) {
     try {
-        return values.at(row).at(col);
+        return values.at(col).at(row);
     }
     catch (...) {
         throw;
@@ -73,7 +84,7 @@ double& stfnum::Table::at(std::size_t row,std::size_t col) {
 
 bool stfnum::Table::IsEmpty(std::size_t row,std::size_t col) const {
     try {
-        return empty.at(row).at(col);
+        return empty.at(col).at(row);
     }
     catch (...) {
         throw;
@@ -82,7 +93,7 @@ bool stfnum::Table::IsEmpty(std::size_t row,std::size_t col) const {
 
 void stfnum::Table::SetEmpty(std::size_t row,std::size_t col,bool value) {
     try {
-        empty.at(row).at(col)=value;
+        empty.at(col).at(row)=value;
     }
     catch (...) {
         throw;
@@ -126,14 +137,32 @@ const std::string& stfnum::Table::GetColLabel(std::size_t col) const {
 }
 
 void stfnum::Table::AppendRows(std::size_t nRows_) {
-    std::size_t oldRows=nRows();
-    rowLabels.resize(oldRows+nRows_);
-    values.resize(oldRows+nRows_);
-    empty.resize(oldRows+nRows_);
-    for (std::size_t nRow = 0; nRow < oldRows + nRows_; ++nRow) {
-        values[nRow].resize(nCols());
-        empty[nRow].resize(nCols());
+    std::size_t newRows=nRows()+nRows_;
+    // grow geometrically if the storage is exhausted:
+    if (newRows > rowLabels.capacity()) {
+        Reserve(std::max(newRows, 2*rowLabels.capacity()));
     }
+    rowLabels.resize(newRows);
+    for (std::size_t nCol = 0; nCol < nCols(); ++nCol) {
+        values[nCol].resize(newRows);
+        empty[nCol].resize(newRows);
+    }
+}
+
+void stfnum::Table::Reserve(std::size_t nRows_) {
+    rowLabels.reserve(nRows_);
+    for (std::size_t nCol = 0; nCol < nCols(); ++nCol) {
+        values[nCol].reserve(nRows_);
+        empty[nCol].reserve(nRows_);
+    }
+}
+
+const Vector_double& stfnum::Table::GetColumn(std::size_t col) const {
+    return values.at(col);
+}
+
+const std::vector<bool>& stfnum::Table::GetEmptyColumn(std::size_t col) const {
+    return empty.at(col);
 }
 
 double stfnum::fboltz(double x, const Vector_double& pars) {
@@ -170,28 +199,179 @@ int stfnum::fac(int arg) {
     }
 }
 
+namespace {
+    // Process-wide cache of FFTW plans, keyed by transform size and direction:
+    std::map< std::pair<int, bool>, fftw_plan > fftwPlanCache;
+    unsigned fftwPlannerFlags = FFTW_ESTIMATE;
+    bool fftPadding = false;
+
+    // Length of the transform of n points:
+    std::size_t transformSize(std::size_t n, stfnum::fft_padding padding) {
+        if (padding == stfnum::pad_fast || (padding == stfnum::pad_global && fftPadding)) {
+            return stfnum::fftSize(n);
+        }
+        return n;
+    }
+
+    // FFTW's planner isn't thread-safe; all of these have to be called
+    // from within the stfnum_fftw_planner critical section.
+    void destroyFFTWPlans() {
+        std::map< std::pair<int, bool>, fftw_plan >::iterator it;
+        for (it = fftwPlanCache.begin(); it != fftwPlanCache.end(); ++it) {
+            fftw_destroy_plan(it->second);
+        }
+        fftwPlanCache.clear();
+    }
+
+    fftw_plan createFFTWPlan(int n, bool inverse) {
+        // Plan on scratch arrays so that FFTW_MEASURE won't overwrite
+        // any data; the plan will later be executed on new arrays.
+        double* in = (double *)fftw_malloc(sizeof(double) * n);
+        fftw_complex* out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * (n/2+1));
+        fftw_plan plan = inverse ?
+            fftw_plan_dft_c2r_1d(n, out, in, fftwPlannerFlags) :
+            fftw_plan_dft_r2c_1d(n, in, out, fftwPlannerFlags);
+        fftw_free(in);
+        fftw_free(out);
+        return plan;
+    }
+}
+
+fftw_plan stfnum::fftwPlan(int n, bool inverse) {
+    if (n <= 0) {
+        throw std::out_of_range("Invalid transform size in stfnum::fftwPlan()");
+    }
+    fftw_plan plan = NULL;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_fftw_planner)
+#endif
+    {
+        std::pair<int, bool> key(n, inverse);
+        std::map< std::pair<int, bool>, fftw_plan >::const_iterator it = fftwPlanCache.find(key);
+        if (it != fftwPlanCache.end()) {
+            plan = it->second;
+        } else {
+            {
+                STF_PROFILE_SCOPE("fft/plan");
+                plan = createFFTWPlan(n, inverse);
+            }
+            if (plan != NULL) {
+                fftwPlanCache[key] = plan;
+            }
+        }
+    }
+    if (plan == NULL) {
+        throw std::runtime_error("Couldn't create FFTW plan in stfnum::fftwPlan()");
+    }
+    return plan;
+}
+
+void stfnum::setFFTWPlannerFlags(unsigned flags) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_fftw_planner)
+#endif
+    {
+        if (flags != fftwPlannerFlags) {
+            destroyFFTWPlans();
+            fftwPlannerFlags = flags;
+        }
+    }
+}
+
+unsigned stfnum::getFFTWPlannerFlags() {
+    return fftwPlannerFlags;
+}
+
+void stfnum::clearFFTWPlans() {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_fftw_planner)
+#endif
+    {
+        destroyFFTWPlans();
+    }
+}
+
+std::size_t stfnum::fftSize(std::size_t n) {
+    std::size_t best = 1;
+    while (best < n) {
+        best *= 2;
+    }
+    // Try all products of powers of 3, 5 and 7 that are smaller than the
+    // next power of 2, each with the smallest power of 2 that reaches n:
+    for (std::size_t p7 = 1; p7 < best; p7 *= 7) {
+        for (std::size_t p5 = p7; p5 < best; p5 *= 5) {
+            for (std::size_t p3 = p5; p3 < best; p3 *= 3) {
+                for (std::size_t p2 = p3; p2 < best; p2 *= 2) {
+                    if (p2 >= n) {
+                        best = p2;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return best;
+}
+
+void stfnum::setFFTPadding(bool enable) {
+    fftPadding = enable;
+}
+
+bool stfnum::getFFTPadding() {
+    return fftPadding;
+}
+
+bool stfnum::importFFTWWisdom(const std::string& fName) {
+    int success = 0;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_fftw_planner)
+#endif
+    {
+        success = fftw_import_wisdom_from_filename(fName.c_str());
+    }
+    return success != 0;
+}
+
+bool stfnum::exportFFTWWisdom(const std::string& fName) {
+    int success = 0;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_fftw_planner)
+#endif
+    {
+        success = fftw_export_wisdom_to_filename(fName.c_str());
+    }
+    return success != 0;
+}
+
 Vector_double
 stfnum::filter( const Vector_double& data, std::size_t filter_start,
         std::size_t filter_end, const Vector_double &a, int SR,
-        stfnum::Func func, bool inverse ) {
+        stfnum::Func func, bool inverse, fft_padding padding ) {
+    STF_PROFILE_SCOPE("fft/filter");
     if (data.size()<=0 || filter_start>=data.size() || filter_end > data.size()) {
         std::out_of_range e("subscript out of range in stfnum::filter()");
         throw e;
     }
     std::size_t filter_size=filter_end-filter_start+1;
+    std::size_t fft_size=transformSize(filter_size, padding);
     Vector_double data_return(filter_size);
     double SI=1.0/SR; //the sampling interval
 
-    double *in;
+    //transform within the return array if it has the size of the transform
+    //and is aligned like the arrays the cached plans were made for, in an
+    //aligned copy otherwise. The window has been extended with zeros, which
+    //continue it smoothly once the offset has been removed:
+    stfio::Vector_aligned scratch;
+    double *in = &data_return[0];
+    if (fft_size != filter_size || fftw_alignment_of(in) != 0) {
+        scratch.resize(fft_size, 0.0);
+        in = &scratch[0];
+    }
     //fftw_complex is a double[2]; hence, out is an array of
     //double[2] with out[n][0] being the real and out[n][1] being
     //the imaginary part.
-    fftw_complex *out;
-    fftw_plan p1, p2;
-
-    //memory allocation as suggested by fftw:
-    in =(double *)fftw_malloc(sizeof(double) * filter_size);
-    out=(fftw_complex *)fftw_malloc(sizeof(fftw_complex) * ((int)(filter_size/2)+1));
+    stfio::Vector_aligned spectrum(2*((int)(fft_size/2)+1));
+    fftw_complex *out = reinterpret_cast<fftw_complex*>(&spectrum[0]);
 
     // calculate the offset (a straight line between the first and last points):
     double offset_0=data[filter_start];
@@ -203,137 +383,783 @@ stfnum::filter( const Vector_double& data, std::size_t filter_start,
         in[n_point]=data[n_point+filter_start]-(offset_0 + offset_step*n_point);
     }
 
-    //plan the fft and execute it:
-    p1 =fftw_plan_dft_r2c_1d((int)filter_size,in,out,FFTW_ESTIMATE);
-    fftw_execute(p1);
+    //execute the fft using a cached plan:
+    executeR2C(fftwPlan((int)fft_size, false), (int)fft_size, in, out);
 
-    for (std::size_t n_point=0; n_point < (unsigned int)(filter_size/2)+1; ++n_point) {
+    for (std::size_t n_point=0; n_point < (unsigned int)(fft_size/2)+1; ++n_point) {
         //calculate the frequency (in kHz) which corresponds to the index:
-        double f=n_point / (filter_size*SI);
+        double f=n_point / (fft_size*SI);
         double rslt= (!inverse? func(f,a) : 1.0-func(f,a));
         out[n_point][0] *= rslt;
         out[n_point][1] *= rslt;
     }
 
     //do the reverse fft:
-    p2=fftw_plan_dft_c2r_1d((int)filter_size,out,in,FFTW_ESTIMATE);
-    fftw_execute(p2);
+    executeC2R(fftwPlan((int)fft_size, true), (int)fft_size, out, in);
 
-    //fill the return array, adding the offset, and scaling by filter_size
+    //fill the return array, adding the offset, and scaling by fft_size
     //(because fftw computes an unnormalized transform):
-    data_return.resize(filter_size);
     for (std::size_t n_point=0; n_point < filter_size; ++n_point) {
-        data_return[n_point]=(in[n_point]/filter_size + offset_0 + offset_step*n_point);
+        data_return[n_point]=(in[n_point]/fft_size + offset_0 + offset_step*n_point);
     }
-    fftw_destroy_plan(p1);
-    fftw_destroy_plan(p2);
-    fftw_free(in);fftw_free(out);
     return data_return;
 }
 
+stfnum::StreamFilter::StreamFilter(const Vector_double& a, int SR, stfnum::Func func, bool inverse,
+                                   std::size_t kernel_size, std::size_t block_size)
+    : kernel(kernel_size | 1), fft_size(2), n_valid(0), buffer(0), started(false),
+      n_in(0), n_out(0), in(NULL), out(NULL), kernel_fft(NULL)
+{
+    if (SR <= 0) {
+        throw std::out_of_range("Invalid sampling rate in stfnum::StreamFilter");
+    }
+    int n_kernel = (int)kernel.size();
+    while (fft_size < 2*n_kernel || fft_size < (int)block_size) {
+        fft_size *= 2;
+    }
+    n_valid = fft_size - n_kernel + 1;
+    int n_cplx = fft_size/2 + 1;
+    double SI = 1.0/SR;
+
+    in = (double *)fftw_malloc(sizeof(double) * fft_size);
+    out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n_cplx);
+    kernel_fft = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n_cplx);
+    fftw_plan p_fwd = fftwPlan(fft_size, false);
+    fftw_plan p_inv = fftwPlan(fft_size, true);
+
+    // Sample the (real, zero-phase) frequency response and transform it
+    // back to get the impulse response centred on 0:
+    for (int n_c=0; n_c<n_cplx; ++n_c) {
+        double f = n_c / (fft_size*SI);
+        out[n_c][0] = (!inverse? func(f,a) : 1.0-func(f,a));
+        out[n_c][1] = 0.0;
+    }
+    executeC2R(p_inv, fft_size, out, in);
+
+    // Truncate it to the kernel size with a Hann window, keeping its sum:
+    int half = n_kernel/2;
+    double sum_ir = 0.0, sum_kernel = 0.0;
+    for (int n_k=0; n_k<n_kernel; ++n_k) {
+        double ir = in[(n_k-half+fft_size) % fft_size] / fft_size;
+        double w = 0.5 + 0.5*cos(3.14159265358979323846*(n_k-half)/(half+1));
+        kernel[n_k] = ir*w;
+        sum_ir += ir;
+        sum_kernel += kernel[n_k];
+    }
+    if (sum_kernel != 0.0) {
+        for (int n_k=0; n_k<n_kernel; ++n_k) {
+            kernel[n_k] *= sum_ir / sum_kernel;
+        }
+    }
+
+    std::copy(kernel.begin(), kernel.end(), in);
+    std::fill(in + n_kernel, in + fft_size, 0.0);
+    executeR2C(p_fwd, fft_size, in, kernel_fft);
+}
+
+stfnum::StreamFilter::~StreamFilter() {
+    fftw_free(in);
+    fftw_free(out);
+    fftw_free(kernel_fft);
+}
+
+void stfnum::StreamFilter::Reset() {
+    buffer.clear();
+    started = false;
+    n_in = 0;
+    n_out = 0;
+}
+
+void stfnum::StreamFilter::ProcessBlocks(Vector_double& output, std::size_t n_max) {
+    STF_PROFILE_SCOPE("fft/StreamFilter");
+    fftw_plan p_fwd = fftwPlan(fft_size, false);
+    fftw_plan p_inv = fftwPlan(fft_size, true);
+    int n_cplx = fft_size/2 + 1;
+    std::size_t n_kernel = kernel.size();
+    std::size_t consumed = 0;
+    while (buffer.size()-consumed >= (std::size_t)fft_size && n_out < n_max) {
+        std::copy(buffer.begin()+consumed, buffer.begin()+consumed+fft_size, in);
+        executeR2C(p_fwd, fft_size, in, out);
+        for (int n_c=0; n_c<n_cplx; ++n_c) {
+            double re = out[n_c][0]*kernel_fft[n_c][0] - out[n_c][1]*kernel_fft[n_c][1];
+            double im = out[n_c][0]*kernel_fft[n_c][1] + out[n_c][1]*kernel_fft[n_c][0];
+            out[n_c][0] = re;
+            out[n_c][1] = im;
+        }
+        executeC2R(p_inv, fft_size, out, in);
+        // the first n_kernel-1 points are corrupted by circular wrap-around;
+        // fftw doesn't normalize:
+        std::size_t n_store = std::min((std::size_t)n_valid, n_max-n_out);
+        for (std::size_t n_s=0; n_s<n_store; ++n_s) {
+            output.push_back(in[n_kernel-1+n_s] / fft_size);
+        }
+        n_out += n_store;
+        consumed += n_valid;
+    }
+    buffer.erase(buffer.begin(), buffer.begin()+consumed);
+}
+
+Vector_double stfnum::StreamFilter::Process(const Vector_double& chunk) {
+    Vector_double output;
+    if (chunk.empty()) {
+        return output;
+    }
+    if (!started) {
+        // extend the stream backwards with its first value:
+        buffer.assign(kernel.size()/2, chunk[0]);
+        started = true;
+    }
+    buffer.insert(buffer.end(), chunk.begin(), chunk.end());
+    n_in += chunk.size();
+    ProcessBlocks(output, n_in);
+    return output;
+}
+
+Vector_double stfnum::StreamFilter::Finish() {
+    Vector_double output;
+    if (started) {
+        // extend the stream forwards with its last value, then pad
+        // the last blocks with zeros:
+        buffer.insert(buffer.end(), kernel.size()/2, buffer.back());
+        while (n_out < n_in) {
+            buffer.resize(std::max(buffer.size(), (std::size_t)fft_size), 0.0);
+            ProcessBlocks(output, n_in);
+        }
+    }
+    Reset();
+    return output;
+}
+
+stfnum::RunningBaseline::RunningBaseline(baseline_filter method_, std::size_t width_, double percentile,
+                                         bool subtract_)
+    : method(method_), width(width_), half(width_/2), quantile(percentile/100.0), subtract(subtract_),
+      buffer(), n_begin(0), n_end(0), n_out(0), n_in(0), lower(), upper(), sum(0.0), n_erased(0)
+{
+    if (width == 0) {
+        throw std::out_of_range("Window width is 0 in stfnum::RunningBaseline");
+    }
+    if (percentile < 0 || percentile > 100) {
+        throw std::out_of_range("Percentile out of range in stfnum::RunningBaseline");
+    }
+    if (method == stfnum::filter_median) {
+        quantile = 0.5;
+    }
+}
+
+void stfnum::RunningBaseline::Reset() {
+    buffer.clear();
+    n_begin = n_end = n_out = n_in = 0;
+    lower.clear();
+    upper.clear();
+    sum = 0.0;
+    n_erased = 0;
+}
+
+void stfnum::RunningBaseline::Insert(double value) {
+    if (method == stfnum::filter_mean) {
+        sum += value;
+    } else if (!lower.empty() && value <= *lower.rbegin()) {
+        lower.insert(value);
+    } else {
+        upper.insert(value);
+    }
+}
+
+void stfnum::RunningBaseline::Erase(double value) {
+    if (method == stfnum::filter_mean) {
+        sum -= value;
+        ++n_erased;
+    } else if (!lower.empty() && value <= *lower.rbegin()) {
+        lower.erase(lower.find(value));
+    } else {
+        upper.erase(upper.find(value));
+    }
+}
+
+double stfnum::RunningBaseline::Value() {
+    std::size_t n_window = n_end-n_begin;
+    if (method == stfnum::filter_mean) {
+        return sum/n_window;
+    }
+    // lower has to hold the values up to the requested rank:
+    double pos = quantile*(n_window-1);
+    std::size_t rank = (std::size_t)pos;
+    double frac = pos-rank;
+    while (lower.size() > rank+1) {
+        std::multiset<double>::iterator last = --lower.end();
+        upper.insert(*last);
+        lower.erase(last);
+    }
+    while (lower.size() < rank+1) {
+        lower.insert(*upper.begin());
+        upper.erase(upper.begin());
+    }
+    double lo = *lower.rbegin();
+    if (frac == 0 || upper.empty()) {
+        return lo;
+    }
+    double hi = *upper.begin();
+    if (frac == 0.5) {
+        return (lo+hi)/2;
+    }
+    return lo+frac*(hi-lo);
+}
+
+void stfnum::RunningBaseline::Emit(Vector_double& output, bool finish) {
+    while (n_out < n_in) {
+        std::size_t end = n_out-half+width;
+        if (end > n_in) {
+            if (!finish) {
+                break;
+            }
+            end = n_in;
+        }
+        for (; n_end < end; ++n_end) {
+            Insert(buffer[n_end-n_begin]);
+        }
+        std::size_t begin = n_out > half ? n_out-half : 0;
+        for (; n_begin < begin; ++n_begin) {
+            Erase(buffer.front());
+            buffer.pop_front();
+        }
+        // avoid accumulating rounding errors in the running sum:
+        if (n_erased >= width) {
+            sum = std::accumulate(buffer.begin(), buffer.begin()+(n_end-n_begin), 0.0);
+            n_erased = 0;
+        }
+        double baseline = Value();
+        output.push_back(subtract ? buffer[n_out-n_begin]-baseline : baseline);
+        ++n_out;
+    }
+}
+
+Vector_double stfnum::RunningBaseline::Process(const Vector_double& chunk) {
+    buffer.insert(buffer.end(), chunk.begin(), chunk.end());
+    n_in += chunk.size();
+    Vector_double output;
+    output.reserve(chunk.size());
+    Emit(output, false);
+    return output;
+}
+
+Vector_double stfnum::RunningBaseline::Finish() {
+    Vector_double output;
+    Emit(output, true);
+    Reset();
+    return output;
+}
+
+Section
+stfnum::subtractBaseline(const Section& data, baseline_filter method, std::size_t width, double percentile)
+{
+    stfnum::RunningBaseline baseline(method, width, percentile, true);
+    Section result(data.size(), data.GetSectionDescription());
+    result.SetXScale(data.GetXScale());
+    Vector_double& dest = result.get_w();
+    const std::size_t chunk_size = 65536;
+    Vector_double chunk;
+    std::size_t n_out = 0;
+    for (std::size_t begin = 0; begin < data.size(); begin += chunk_size) {
+        std::size_t end = std::min(begin+chunk_size, data.size());
+        chunk.resize(end-begin);
+        data.CopyRange(begin, end, &chunk[0]);
+        Vector_double processed = baseline.Process(chunk);
+        std::copy(processed.begin(), processed.end(), dest.begin()+n_out);
+        n_out += processed.size();
+    }
+    Vector_double processed = baseline.Finish();
+    std::copy(processed.begin(), processed.end(), dest.begin()+n_out);
+    return result;
+}
+
+namespace {
+    // Templates of at least this many points are correlated with the
+    // data in the frequency domain:
+    const std::size_t fftTemplateMin = 64;
+}
+
+Vector_double
+stfnum::slidingProduct(const Vector_double& data, const Vector_double& templ, std::size_t n_out)
+{
+    STF_PROFILE_SCOPE("fft/slidingProduct");
+    std::size_t n_templ = templ.size();
+    if (n_templ == 0 || n_out + n_templ - 1 > data.size()) {
+        throw std::out_of_range("Template doesn't fit into data in stfnum::slidingProduct");
+    }
+    Vector_double product(n_out, 0.0);
+    if (n_out == 0) {
+        return product;
+    }
+    if (n_templ < fftTemplateMin) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(stfio::threadCount(0, (int)n_out))
+#endif
+        for (int n_data=0; n_data<(int)n_out; ++n_data) {
+            double sum_templ_data=0.0;
+            for (int n_t=0; n_t<(int)n_templ; ++n_t) {
+                sum_templ_data+=templ[n_t]*data[n_data+n_t];
+            }
+            product[n_data]=sum_templ_data;
+        }
+        return product;
+    }
+
+    // Overlap-save: each block of fft_size data points yields
+    // n_valid products that are unaffected by circular wrap-around.
+    int fft_size = 1024;
+    while (fft_size < 4*(int)n_templ) {
+        fft_size *= 2;
+    }
+    int n_valid = fft_size - (int)n_templ + 1;
+    int n_cplx = fft_size/2 + 1;
+    fftw_plan p_fwd = fftwPlan(fft_size, false);
+    fftw_plan p_inv = fftwPlan(fft_size, true);
+
+    // Spectrum of the zero-padded template; the buffers come from the
+    // scratch arena of each thread, which aligns them like fftw_malloc():
+    stfio::ScratchScope scratch;
+    double* in_templ = scratch.Doubles(fft_size);
+    fftw_complex* out_templ = scratch.Array<fftw_complex>(n_cplx);
+    std::copy(templ.begin(), templ.end(), in_templ);
+    std::fill(in_templ + n_templ, in_templ + fft_size, 0.0);
+    executeR2C(p_fwd, fft_size, in_templ, out_templ);
+
+    int n_blocks = ((int)n_out + n_valid - 1) / n_valid;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(stfio::threadCount(0, n_blocks))
+#endif
+    {
+        stfio::ScratchScope thread_scratch;
+        double* in_block = thread_scratch.Doubles(fft_size);
+        fftw_complex* out_block = thread_scratch.Array<fftw_complex>(n_cplx);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int n_b=0; n_b<n_blocks; ++n_b) {
+            std::size_t start = (std::size_t)n_b * n_valid;
+            std::size_t n_copy = std::min((std::size_t)fft_size, data.size()-start);
+            std::copy(data.begin()+start, data.begin()+start+n_copy, in_block);
+            std::fill(in_block + n_copy, in_block + fft_size, 0.0);
+            executeR2C(p_fwd, fft_size, in_block, out_block);
+            // Correlation: multiply with the complex conjugate of the template spectrum
+            for (int n_c=0; n_c<n_cplx; ++n_c) {
+                double re = out_block[n_c][0]*out_templ[n_c][0] + out_block[n_c][1]*out_templ[n_c][1];
+                double im = out_block[n_c][1]*out_templ[n_c][0] - out_block[n_c][0]*out_templ[n_c][1];
+                out_block[n_c][0] = re;
+                out_block[n_c][1] = im;
+            }
+            executeC2R(p_inv, fft_size, out_block, in_block);
+            // fftw doesn't normalize:
+            std::size_t n_store = std::min((std::size_t)n_valid, n_out-start);
+            for (std::size_t n_s=0; n_s<n_store; ++n_s) {
+                product[start+n_s] = in_block[n_s] / fft_size;
+            }
+        }
+    }
+    return product;
+}
+
+std::vector<Vector_double>
+stfnum::slidingProducts(const Vector_double& data, const std::vector<Vector_double>& templs)
+{
+    STF_PROFILE_SCOPE("fft/slidingProducts");
+    std::size_t n_templs = templs.size();
+    std::vector<Vector_double> products(n_templs);
+    std::size_t max_templ = 0, min_templ = data.size();
+    for (std::size_t n_k=0; n_k<n_templs; ++n_k) {
+        if (templs[n_k].empty() || templs[n_k].size() > data.size()) {
+            throw std::out_of_range("Template doesn't fit into data in stfnum::slidingProducts");
+        }
+        max_templ = std::max(max_templ, templs[n_k].size());
+        min_templ = std::min(min_templ, templs[n_k].size());
+    }
+    if (n_templs == 0) {
+        return products;
+    }
+    if (max_templ < fftTemplateMin) {
+        for (std::size_t n_k=0; n_k<n_templs; ++n_k) {
+            products[n_k] = slidingProduct(data, templs[n_k], data.size()-templs[n_k].size());
+        }
+        return products;
+    }
+
+    // Overlap-save as in slidingProduct(), with blocks that are long enough
+    // for the longest template, so that every block is transformed only once:
+    int fft_size = 1024;
+    while (fft_size < 4*(int)max_templ) {
+        fft_size *= 2;
+    }
+    int n_valid = fft_size - (int)max_templ + 1;
+    int n_cplx = fft_size/2 + 1;
+    fftw_plan p_fwd = fftwPlan(fft_size, false);
+    fftw_plan p_inv = fftwPlan(fft_size, true);
+
+    // Spectra of the zero-padded templates:
+    stfio::ScratchScope scratch;
+    std::vector<fftw_complex*> out_templs(n_templs);
+    double* in_templ = scratch.Doubles(fft_size);
+    for (std::size_t n_k=0; n_k<n_templs; ++n_k) {
+        products[n_k].resize(data.size()-templs[n_k].size());
+        out_templs[n_k] = scratch.Array<fftw_complex>(n_cplx);
+        std::copy(templs[n_k].begin(), templs[n_k].end(), in_templ);
+        std::fill(in_templ + templs[n_k].size(), in_templ + fft_size, 0.0);
+        executeR2C(p_fwd, fft_size, in_templ, out_templs[n_k]);
+    }
+
+    std::size_t max_out = data.size()-min_templ;
+    int n_blocks = ((int)max_out + n_valid - 1) / n_valid;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(stfio::threadCount(0, n_blocks))
+#endif
+    {
+        stfio::ScratchScope thread_scratch;
+        double* in_block = thread_scratch.Doubles(fft_size);
+        fftw_complex* out_block = thread_scratch.Array<fftw_complex>(n_cplx);
+        fftw_complex* out_prod = thread_scratch.Array<fftw_complex>(n_cplx);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int n_b=0; n_b<n_blocks; ++n_b) {
+            std::size_t start = (std::size_t)n_b * n_valid;
+            std::size_t n_copy = std::min((std::size_t)fft_size, data.size()-start);
+            std::copy(data.begin()+start, data.begin()+start+n_copy, in_block);
+            std::fill(in_block + n_copy, in_block + fft_size, 0.0);
+            executeR2C(p_fwd, fft_size, in_block, out_block);
+            for (std::size_t n_k=0; n_k<n_templs; ++n_k) {
+                const fftw_complex* out_templ = out_templs[n_k];
+                for (int n_c=0; n_c<n_cplx; ++n_c) {
+                    out_prod[n_c][0] = out_block[n_c][0]*out_templ[n_c][0] + out_block[n_c][1]*out_templ[n_c][1];
+                    out_prod[n_c][1] = out_block[n_c][1]*out_templ[n_c][0] - out_block[n_c][0]*out_templ[n_c][1];
+                }
+                executeC2R(p_inv, fft_size, out_prod, in_block);
+                Vector_double& product = products[n_k];
+                if (start < product.size()) {
+                    std::size_t n_store = std::min((std::size_t)n_valid, product.size()-start);
+                    for (std::size_t n_s=0; n_s<n_store; ++n_s) {
+                        product[start+n_s] = in_block[n_s] / fft_size;
+                    }
+                }
+            }
+        }
+    }
+    return products;
+}
+
+namespace {
+    // Computes the detection criterion from the products of the template with
+    // the data for the first detection_criterion.size() points. Returns false if
+    // the operation was cancelled.
+    bool criterionFromProducts(const Vector_double& data, const Vector_double& templ,
+                               const Vector_double& templ_data, Vector_double& detection_criterion,
+                               stfio::ProgressInfo* progDlg)
+    {
+        bool skipped=false;
+        // avoid redundant computations:
+        double sum_templ_data=0.0, sum_templ=0.0, sum_templ_sqr=0.0, sum_data=0.0, sum_data_sqr=0.0;
+        for (int n_templ=0; n_templ<(int)templ.size();++n_templ) {
+            sum_data+=data[0+n_templ];
+            sum_data_sqr+=data[0+n_templ]*data[0+n_templ];
+            sum_templ+=templ[n_templ];
+            sum_templ_sqr+=templ[n_templ]*templ[n_templ];
+        }
+        double y_old=0.0;
+        double y2_old=0.0;
+        int progCounter=0;
+        std::size_t n_out=detection_criterion.size();
+        double progFraction=n_out/100.0;
+        for (unsigned n_data=0; n_data<n_out; ++n_data) {
+            if (progDlg != NULL && n_data/progFraction>progCounter) {
+                progDlg->Update( (int)((double)n_data/(double)n_out*100.0),
+                                 "Calculating detection criterion", &skipped );
+                if (skipped) {
+                    return false;
+                }
+                progCounter++;
+            }
+            sum_templ_data=templ_data[n_data];
+            if (n_data!=0) {
+                // The new value that will be added is:
+                double y_new=data[n_data+templ.size()-1];
+                double y2_new=data[n_data+templ.size()-1]*data[n_data+templ.size()-1];
+                sum_data+=y_new-y_old;
+                sum_data_sqr+=y2_new-y2_old;
+            }
+            // The first value that was added (and will have to be subtracted during
+            // the next loop):
+            y_old=data[n_data+0];
+            y2_old=data[n_data+0]*data[n_data+0];
+
+            double scale=(sum_templ_data-sum_templ*sum_data/templ.size())/
+                (sum_templ_sqr-sum_templ*sum_templ/templ.size());
+            double offset=(sum_data-scale*sum_templ)/templ.size();
+            double sse=sum_data_sqr+scale*scale*sum_templ_sqr+templ.size()*offset*offset -
+                2.0*(scale*sum_templ_data +
+                     offset*sum_data-scale*offset*sum_templ);
+            double standard_error=sqrt(sse/(templ.size()-1));
+            detection_criterion[n_data]=(scale/standard_error);
+        }
+        return true;
+    }
+}
+
 Vector_double
 stfnum::detectionCriterion(const Vector_double& data, const Vector_double& templ, stfio::ProgressInfo& progDlg)
 {
-    bool skipped=false;
     // variable names are taken from Clements & Bekkers (1997) as long
     // as they don't interfere with C++ keywords (such as "template")
     Vector_double detection_criterion(data.size()-templ.size());
-    // avoid redundant computations:
-    double sum_templ_data=0.0, sum_templ=0.0, sum_templ_sqr=0.0, sum_data=0.0, sum_data_sqr=0.0;
-    for (int n_templ=0; n_templ<(int)templ.size();++n_templ) {
-        sum_templ_data+=templ[n_templ]*data[0+n_templ];
-        sum_data+=data[0+n_templ];
-        sum_data_sqr+=data[0+n_templ]*data[0+n_templ];
-        sum_templ+=templ[n_templ];
-        sum_templ_sqr+=templ[n_templ]*templ[n_templ];
+    // The template-data products are computed up front, in the
+    // frequency domain for long templates:
+    Vector_double templ_data = slidingProduct(data, templ, detection_criterion.size());
+    if (!criterionFromProducts(data, templ, templ_data, detection_criterion, &progDlg)) {
+        detection_criterion.resize(0);
     }
-    double y_old=0.0;
-    double y2_old=0.0;
-    int progCounter=0;
-    double progFraction=(data.size()-templ.size())/100.0;
-    for (unsigned n_data=0; n_data<data.size()-templ.size(); ++n_data) {
-        if (n_data/progFraction>progCounter) {
-            progDlg.Update( (int)((double)n_data/(double)(data.size()-templ.size())*100.0),
-                            "Calculating detection criterion", &skipped );
-            if (skipped) {
-                detection_criterion.resize(0);
-                return detection_criterion;
+    return detection_criterion;
+}
+
+stfnum::StreamCriterion::StreamCriterion(const Vector_double& templ_)
+    : templ(templ_), buffer(), n_out(0)
+{
+    if (templ.size() < 2) {
+        throw std::out_of_range("Template too short in stfnum::StreamCriterion");
+    }
+}
+
+Vector_double stfnum::StreamCriterion::Process(const Vector_double& chunk) {
+    buffer.insert(buffer.end(), chunk.begin(), chunk.end());
+    if (buffer.size() <= templ.size()) {
+        return Vector_double(0);
+    }
+    Vector_double criterion(buffer.size()-templ.size());
+    Vector_double templ_data = slidingProduct(buffer, templ, criterion.size());
+    criterionFromProducts(buffer, templ, templ_data, criterion, NULL);
+    // the overlap with the next chunk:
+    buffer.erase(buffer.begin(), buffer.begin()+criterion.size());
+    n_out += criterion.size();
+    return criterion;
+}
+
+void stfnum::StreamCriterion::Reset() {
+    buffer.clear();
+    n_out = 0;
+}
+
+Vector_double
+stfnum::detectionCriterion(const Vector_double& data, const std::vector<Vector_double>& templs,
+                           stfio::ProgressInfo& progDlg, std::vector<int>& bestTemplate)
+{
+    bestTemplate.clear();
+    if (templs.empty()) {
+        throw std::out_of_range("No templates in stfnum::detectionCriterion");
+    }
+    std::size_t max_templ = 0;
+    for (std::size_t n_k=0; n_k<templs.size(); ++n_k) {
+        max_templ = std::max(max_templ, templs[n_k].size());
+    }
+    std::vector<Vector_double> templ_data = slidingProducts(data, templs);
+    std::size_t n_out = data.size()-max_templ;
+
+    Vector_double best(n_out, -std::numeric_limits<double>::infinity());
+    bestTemplate.assign(n_out, 0);
+    Vector_double detection_criterion(n_out);
+    for (std::size_t n_k=0; n_k<templs.size(); ++n_k) {
+        bool skipped = false;
+        progDlg.Update((int)(100.0*n_k/templs.size()), "Calculating detection criterion", &skipped);
+        if (skipped) {
+            bestTemplate.clear();
+            return Vector_double(0);
+        }
+        criterionFromProducts(data, templs[n_k], templ_data[n_k], detection_criterion, NULL);
+        Vector_double().swap(templ_data[n_k]);
+        for (std::size_t n_data=0; n_data<n_out; ++n_data) {
+            if (detection_criterion[n_data] > best[n_data]) {
+                best[n_data] = detection_criterion[n_data];
+                bestTemplate[n_data] = (int)n_k;
+            }
+        }
+    }
+    return best;
+}
+
+Vector_double
+stfnum::detectionCriterion(const Section& data, const Vector_double& templ, stfio::ProgressInfo& progDlg,
+                           baseline_filter method, std::size_t width, double percentile)
+{
+    Section detrended = subtractBaseline(data, method, width, percentile);
+    return detectionCriterion(detrended.get(), templ, progDlg);
+}
+
+namespace {
+    // A supra-threshold window found by peakIndices():
+    struct PeakWindow {
+        std::size_t llp, ulp, peak;
+    };
+
+    // Returns the first index in [begin, end) where data exceeds threshold, or end.
+    // Blocks are tested without branches so that the compiler can vectorize them.
+    std::size_t findAbove(const double* data, std::size_t begin, std::size_t end, double threshold) {
+        const std::size_t block = 8;
+        std::size_t n = begin;
+        for (; n+block <= end; n += block) {
+            int any = 0;
+            for (std::size_t k=0; k<block; ++k) {
+                any |= (data[n+k] > threshold);
+            }
+            if (any) {
+                break;
             }
-            progCounter++;
         }
-        if (n_data!=0) {
-            sum_templ_data=0.0;
-            // The product has to be computed in full length:
-            for (int n_templ=0; n_templ<(int)templ.size();++n_templ) {
-                sum_templ_data+=templ[n_templ]*data[n_data+n_templ];
+        for (; n < end; ++n) {
+            if (data[n] > threshold) {
+                return n;
             }
-            // The new value that will be added is:
-            double y_new=data[n_data+templ.size()-1];
-            double y2_new=data[n_data+templ.size()-1]*data[n_data+templ.size()-1];
-            sum_data+=y_new-y_old;
-            sum_data_sqr+=y2_new-y2_old;
         }
-        // The first value that was added (and will have to be subtracted during
-        // the next loop):
-        y_old=data[n_data+0];
-        y2_old=data[n_data+0]*data[n_data+0];
+        return end;
+    }
 
-        double scale=(sum_templ_data-sum_templ*sum_data/templ.size())/
-            (sum_templ_sqr-sum_templ*sum_templ/templ.size());
-        double offset=(sum_data-scale*sum_templ)/templ.size();
-        double sse=sum_data_sqr+scale*scale*sum_templ_sqr+templ.size()*offset*offset -
-            2.0*(scale*sum_templ_data +
-                 offset*sum_data-scale*offset*sum_templ);
-        double standard_error=sqrt(sse/(templ.size()-1));
-        detection_criterion[n_data]=(scale/standard_error);
+    // Finds the next window that starts in [pos, end), tracking its maximum on the
+    // way. The window may extend beyond end. Returns false if there is none.
+    bool nextPeakWindow(const Vector_double& data, double threshold, int minDistance,
+                        std::size_t pos, std::size_t end, PeakWindow& window)
+    {
+        std::size_t size = data.size();
+        std::size_t llp = findAbove(&data[0], pos, end, threshold);
+        if (llp >= end) {
+            return false;
+        }
+        // find the data point where the threshold is crossed again in the
+        // opposite direction, making this the upper limit of the peak window:
+        double max = -1e8;
+        std::size_t peak = llp;
+        if (data[llp] > max) {
+            max = data[llp];
+        }
+        std::size_t n = llp;
+        for (;;) {
+            if (n+2 > size) {
+                n = size-1;
+                break;
+            }
+            ++n;
+            if (data[n] > max) {
+                max = data[n];
+                peak = n;
+            }
+            if (data[n] < threshold && (long)n-(long)llp-1 > (long)minDistance) {
+                break;
+            }
+        }
+        window.llp = llp;
+        window.ulp = n;
+        window.peak = peak;
+        return true;
     }
-    return detection_criterion;
+
+    // Data sets smaller than this are scanned by a single thread:
+    const std::size_t peakChunkMin = 65536;
 }
 
 std::vector<int>
 stfnum::peakIndices(const Vector_double& data, double threshold,
                  int minDistance)
 {
-    // to avoid unnecessary copying, we first reserve quite
-    // a bit of space for the vector:
     std::vector<int> peakInd;
-    peakInd.reserve(data.size());
-    for (unsigned n_data=0; n_data<data.size(); ++n_data) {
-        // check whether the data point is above threshold...
-        int llp=n_data;
-        int ulp=n_data+1;
-        if (data[n_data]>threshold) {
-            // ... and if so, find the data point where the threshold
-            // is crossed again in the opposite direction, ...
-            for (;;) {
-                if (n_data>data.size()-2) {
-                    ulp=(int)data.size()-1;
-                    break;
-                }
-                n_data++;
-                if (data[n_data]<threshold && (int)n_data-ulp>minDistance) {
-                    // ... making this the upper limit of the peak window:
-                    ulp=n_data;
-                    break;
-                }
+    std::size_t size = data.size();
+    if (size == 0) {
+        return peakInd;
+    }
+    int n_chunks = 1;
+#ifdef _OPENMP
+    if (size >= 2*peakChunkMin) {
+        n_chunks = std::min((int)(size/peakChunkMin), 4*stfio::threadCount(0, INT_MAX));
+    }
+#endif
+    std::size_t chunk_size = (size + n_chunks - 1) / n_chunks;
+
+    // Each chunk is scanned as if no window had started before it:
+    std::vector< std::vector<PeakWindow> > windows(n_chunks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(stfio::threadCount(0, n_chunks))
+#endif
+    for (int n_c=0; n_c<n_chunks; ++n_c) {
+        std::size_t begin = std::min(n_c*chunk_size, size);
+        std::size_t end = std::min(begin+chunk_size, size);
+        PeakWindow window;
+        std::size_t pos = begin;
+        while (pos < end && nextPeakWindow(data, threshold, minDistance, pos, end, window)) {
+            windows[n_c].push_back(window);
+            pos = window.ulp+1;
+        }
+    }
+
+    // A window that extends into the next chunk changes where the scan resumes
+    // there. The scans agree again as soon as the resume point is outside the
+    // windows of that chunk; until then, windows are searched again serially.
+    std::size_t resume = 0;
+    for (int n_c=0; n_c<n_chunks; ++n_c) {
+        std::size_t begin = std::min(n_c*chunk_size, size);
+        std::size_t end = std::min(begin+chunk_size, size);
+        resume = std::max(resume, begin);
+        const std::vector<PeakWindow>& chunk = windows[n_c];
+        std::size_t n_w = 0;
+        while (resume < end) {
+            while (n_w < chunk.size() && chunk[n_w].ulp < resume) {
+                ++n_w;
             }
-            // Now, find the peak within the window:
-            double max=-1e8;
-            int peakIndex=llp;
-            for (int n_p=llp; n_p<=ulp; ++n_p) {
-                if (data[n_p]>max) {
-                    max=data[n_p];
-                    peakIndex=n_p;
+            if (n_w == chunk.size() || chunk[n_w].llp >= resume) {
+                // in sync with the scan of this chunk:
+                for (; n_w < chunk.size(); ++n_w) {
+                    peakInd.push_back((int)chunk[n_w].peak);
+                    resume = chunk[n_w].ulp+1;
                 }
+                break;
+            }
+            PeakWindow window;
+            if (!nextPeakWindow(data, threshold, minDistance, resume, end, window)) {
+                break;
             }
-            peakInd.push_back(peakIndex);
+            peakInd.push_back((int)window.peak);
+            resume = window.ulp+1;
         }
     }
-    // Trim peakInd's reserved memory:
-    std::vector<int>(peakInd.begin(),peakInd.end()).swap(peakInd);
     return peakInd;
 }
 
+Vector_double stfnum::runningMean(const Vector_double& data, std::size_t binwidth) {
+    if (binwidth == 0) {
+        throw std::out_of_range("Bin width is 0 in stfnum::runningMean()");
+    }
+    std::size_t size = data.size();
+    Vector_double result(size);
+    if (size == 0) {
+        return result;
+    }
+    stfio::PrefixSums sums(data);
+    double var = 0;
+    for (std::size_t n = 0; n < size; ++n) {
+        result[n] = sums.Mean(n, std::min(n+binwidth, size), var);
+    }
+    return result;
+}
+
+std::vector<std::size_t> stfnum::thresholdCrossings(const Vector_double& data, std::size_t begin, std::size_t end,
+                                                    double threshold, bool up)
+{
+    if (end > data.size() || begin > end) {
+        throw std::out_of_range("Range out of range in stfnum::thresholdCrossings()");
+    }
+    std::vector<std::size_t> crossings;
+    bool inside = false;
+    for (std::size_t n = begin; n < end; ++n) {
+        bool beyond = up ? (data[n] > threshold) : (data[n] < threshold);
+        if (beyond && !inside) {
+            crossings.push_back(n);
+        }
+        inside = beyond;
+    }
+    return crossings;
+}
+
 Vector_double
 stfnum::linCorr(const Vector_double& data, const Vector_double& templ, stfio::ProgressInfo& progDlg)
 {
@@ -346,19 +1172,30 @@ stfnum::linCorr(const Vector_double& data, const Vector_double& templ, stfio::Pr
         throw std::runtime_error("Array of size 0 in stfnum::crossCorr");
     }
     Vector_double Corr(data.size()-templ.size());
+    Vector_double templ_data = slidingProduct(data, templ, Corr.size());
+    // For long templates, the SDs and the correlation are computed
+    // from the sums rather than in full length for every data point:
+    bool fromSums = (templ.size() >= fftTemplateMin);
 
     // Optimal scaling & offset:
     // avoid redundant computations:
-    double sum_templ_data=0.0, sum_templ=0.0, sum_templ_sqr=0.0, sum_data=0.0, sum_data_sqr=0.0;
+    double sum_templ_data=0.0, sum_templ=0.0, sum_templ_sqr=0.0, sum_data=0.0;
     for (int n_templ=0; n_templ<(int)templ.size();++n_templ) {
-        sum_templ_data+=templ[n_templ]*data[0+n_templ];
-        sum_data+=data[0+n_templ];
-        sum_data_sqr+=data[0+n_templ]*data[0+n_templ];
         sum_templ+=templ[n_templ];
         sum_templ_sqr+=templ[n_templ]*templ[n_templ];
     }
-    double y_old=0.0;
-    double y2_old=0.0;
+    // SD of the unscaled template:
+    double sd_templ_unscaled=0.0;
+    for (int i=0;i<(int)templ.size();++i) {
+        sd_templ_unscaled+=SQR(templ[i]-sum_templ/templ.size());
+    }
+    sd_templ_unscaled=sqrt(sd_templ_unscaled/templ.size());
+    // The window sums of the data are slid along the trace as sums of the
+    // deviations from an anchor. Adding and subtracting squares of large
+    // values over the whole trace would lose the variance of offset or
+    // drifting data to cancellation, so the anchor is moved to the window
+    // mean and the sums are taken afresh every templ.size() windows:
+    double anchor=0.0, sum_dev=0.0, sum_dev_sqr=0.0;
     int progCounter=0;
     double progFraction=(data.size()-templ.size())/100.0;
     for (unsigned n_data=0; n_data<data.size()-templ.size(); ++n_data) {
@@ -371,22 +1208,28 @@ stfnum::linCorr(const Vector_double& data, const Vector_double& templ, stfio::Pr
             }
             progCounter++;
         }
-        if (n_data!=0) {
-            sum_templ_data=0.0;
-            // The product has to be computed in full length:
-            for (int n_templ=0; n_templ<(int)templ.size();++n_templ) {
-                sum_templ_data+=templ[n_templ]*data[n_data+n_templ];
+        sum_templ_data=templ_data[n_data];
+        if (n_data%templ.size()==0) {
+            anchor=0.0;
+            for (std::size_t i=0; i<templ.size(); ++i) {
+                anchor+=data[n_data+i];
             }
-            // The new value that will be added is:
-            double y_new=data[n_data+templ.size()-1];
-            double y2_new=data[n_data+templ.size()-1]*data[n_data+templ.size()-1];
-            sum_data+=y_new-y_old;
-            sum_data_sqr+=y2_new-y2_old;
+            anchor/=templ.size();
+            sum_dev=0.0;
+            sum_dev_sqr=0.0;
+            for (std::size_t i=0; i<templ.size(); ++i) {
+                double dev=data[n_data+i]-anchor;
+                sum_dev+=dev;
+                sum_dev_sqr+=dev*dev;
+            }
+        } else {
+            // One value leaves the window, and a new one enters it:
+            double dev_old=data[n_data-1]-anchor;
+            double dev_new=data[n_data+templ.size()-1]-anchor;
+            sum_dev+=dev_new-dev_old;
+            sum_dev_sqr+=dev_new*dev_new-dev_old*dev_old;
         }
-        // The first value that was added (and will have to be subtracted during
-        // the next loop):
-        y_old=data[n_data+0];
-        y2_old=data[n_data+0]*data[n_data+0];
+        sum_data=anchor*templ.size()+sum_dev;
 
         double scale=(sum_templ_data-sum_templ*sum_data/templ.size())/
         (sum_templ_sqr-sum_templ*sum_templ/templ.size());
@@ -395,13 +1238,23 @@ stfnum::linCorr(const Vector_double& data, const Vector_double& templ, stfio::Pr
         // Now that the optimal template has been found,
         // compute the correlation between data and optimal template.
         // The correlation coefficient is computed in a way that avoids
-        // numerical instability; therefore, the sum of squares
-        // computed above can't be re-used.
+        // numerical instability: either from the sums of the deviations
+        // from the anchor, or in full length for short templates.
         // Get the means:
         double mean_data=sum_data/templ.size();
         double sum_optTempl=sum_templ*scale+offset*templ.size();
         double mean_optTempl=sum_optTempl/templ.size();
 
+        if (fromSums) {
+            double mean_dev=sum_dev/templ.size();
+            double var_data=sum_dev_sqr/templ.size()-mean_dev*mean_dev;
+            double sd_data=var_data>0.0 ? sqrt(var_data) : 0.0;
+            double sd_templ=fabs(scale)*sd_templ_unscaled;
+            Corr[n_data]=scale*(sum_templ_data-sum_templ*mean_data)/
+                ((templ.size()-1)*sd_data*sd_templ);
+            continue;
+        }
+
         // Get SDs:
         double sd_data=0.0;
         double sd_templ=0.0;
@@ -444,12 +1297,25 @@ double stfnum::integrate_simpson(
     double a=i1*x_scale;
     double b=i2*x_scale;
 
-    double sum_2=0.0, sum_4=0.0;
-    for (std::size_t j = 1; j <= n/2; ++j) {
-        if (j<n/2)
-            sum_2+=input[i1+2*j];
-        sum_4+=input[i1+2*j-1];
+    // odd points are weighted with 4, inner even points with 2; two
+    // independent sums of each, so that the loop can be vectorized:
+    const double* x = &input[i1];
+    double sum_2a=0.0, sum_2b=0.0, sum_4a=0.0, sum_4b=0.0;
+    std::size_t k = 1;
+    for (; k+3 < n; k += 4) {
+        sum_4a += x[k];
+        sum_2a += x[k+1];
+        sum_4b += x[k+2];
+        sum_2b += x[k+3];
+    }
+    for (; k+1 < n; k += 2) {
+        sum_4a += x[k];
+        sum_2a += x[k+1];
     }
+    if (k < n) {
+        sum_4a += x[k];
+    }
+    double sum_2 = sum_2a+sum_2b, sum_4 = sum_4a+sum_4b;
     double sum=input[i1] + 2*sum_2 + 4*sum_4 + input[i2];
     sum *= (b-a)/(double)n;
     sum /= 3;
@@ -476,10 +1342,19 @@ double stfnum::integrate_trapezium(
     double a = i1 * x_scale;
     double b = i2 * x_scale;
 
-    double sum=input[i1]+input[i2];
-    for (std::size_t n=i1+1; n<i2; ++n) {
-        sum += 2*input[n];
+    // inner points with four independent sums, so that the loop can be vectorized:
+    double s0=0.0, s1=0.0, s2=0.0, s3=0.0;
+    std::size_t n=i1+1;
+    for (; n+3<i2; n+=4) {
+        s0 += input[n];
+        s1 += input[n+1];
+        s2 += input[n+2];
+        s3 += input[n+3];
+    }
+    for (; n<i2; ++n) {
+        s0 += input[n];
     }
+    double sum=input[i1]+input[i2] + 2*((s0+s1)+(s2+s3));
     sum *= (b-a)/2/(i2-i1);
     return sum;
 }
@@ -606,6 +1481,84 @@ stfnum::linsolv( int m, int n, int nrhs, Vector_double& A,
     return 0;
 }
 
+namespace {
+
+// Fills the equation systems of stfnum::quad() for n_intervals intervals,
+// starting at sampling point begin; y[0] is the data point at begin:
+void quad_systems(const double* y, std::size_t begin, int n_intervals, Vector_double& A, Vector_double& B) {
+    for (int n_i=0; n_i<n_intervals; ++n_i) {
+        double n = (double)begin + 2.0*n_i;
+        double* a = &A[9*n_i];
+        double* b = &B[3*n_i];
+        // use column-major order (Fortran)
+        a[0]=n*n;
+        a[1]=(n+1.0)*(n+1.0);
+        a[2]=(n+2.0)*(n+2.0);
+        a[3]=n;
+        a[4]=n+1.0;
+        a[5]=n+2.0;
+        a[6]=1.0;
+        a[7]=1.0;
+        a[8]=1.0;
+        b[0]=y[2*n_i];
+        b[1]=y[2*n_i+1];
+        b[2]=y[2*n_i+2];
+    }
+}
+
+}
+
+void stfnum::batchLinsolv(int n, int nrhs, std::size_t n_systems, Vector_double& A,
+                          Vector_double& B, int n_threads)
+{
+#ifndef TEST_MINIMAL
+    std::size_t a_size = (std::size_t)n*n;
+    std::size_t b_size = (std::size_t)n*nrhs;
+    if (n <= 0 || nrhs <= 0 || A.size() != a_size*n_systems || B.size() != b_size*n_systems) {
+        throw std::runtime_error("Matrix sizes don't match in stfnum::batchLinsolv");
+    }
+    int n_batch = (int)n_systems;
+    std::string error;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_batch);
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+        // LAPACK takes all arguments by pointer:
+        int m_f = n, nrhs_f = nrhs;
+        char trans = 'N';
+        std::vector<int> ipiv(n);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for (int n_s = 0; n_s < n_batch; ++n_s) {
+            double* a = &A[n_s*a_size];
+            double* b = &B[n_s*b_size];
+            int info = 0;
+            dgetrf_(&m_f, &m_f, a, &m_f, &ipiv[0], &info);
+            if (info == 0) {
+                dgetrs_(&trans, &m_f, &nrhs_f, a, &m_f, &ipiv[0], b, &m_f, &info);
+            }
+            if (info != 0) {
+                std::ostringstream error_msg;
+                if (info > 0) {
+                    error_msg << "Singular matrix in system " << n_s << " in LAPACK's dgetrf_; would result in division by zero";
+                } else {
+                    error_msg << "Argument " << -info << " had an illegal value in LAPACK's dgetrf_ or dgetrs_";
+                }
+#ifdef _OPENMP
+#pragma omp critical(stfnum_linsolv_error)
+#endif
+                if (error.empty()) error = error_msg.str();
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+#endif
+}
+
 Vector_double stfnum::quad(const Vector_double& data, std::size_t begin, std::size_t end) {
 
     // Solve quadratic equations relating 3 sample points a time
@@ -614,38 +1567,346 @@ Vector_double stfnum::quad(const Vector_double& data, std::size_t begin, std::si
     
     Vector_double quad_p(n_intervals*3);
     
-    int n_q=0;
-    if (begin-end>1) {
-        for (int n=begin; n<(int)end-1; n+=2) {
-            Vector_double A(9);
-            Vector_double B(3);
-    
-            // solve linear equation system:
-            // use column-major order (Fortran)
-            A[0]=(double)n*(double)n;
-            A[1]=((double)n+1.0)*((double)n+1.0);
-            A[2]=((double)n+2.0)*((double)n+2.0);
-            A[3]=(double)n;
-            A[4]=(double)n+1.0;
-            A[5]=(double)n+2.0;
-            A[6]=1.0;
-            A[7]=1.0;
-            A[8]=1.0;
-            B[0]=data[n];
-            B[1]=data[n+1];
-            B[2]=data[n+2];
-            try {
-                stfnum::linsolv(3,3,1,A,B);
+    if (begin-end>1 && n_intervals>0) {
+        // all systems are solved in a single call, and their solutions
+        // are stored in place of the right-hand sides:
+        Vector_double A(9*n_intervals);
+        quad_systems(&data[begin], begin, n_intervals, A, quad_p);
+        stfnum::batchLinsolv(3,1,n_intervals,A,quad_p);
+    }
+    return quad_p;
+}
+
+std::vector<Vector_double> stfnum::batchQuad(const Channel& ch, const std::vector<std::size_t>& sections,
+                                             std::size_t begin, std::size_t end, int n_threads)
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::batchQuad()");
+        }
+    }
+    int n_intervals = end > begin ? (int)((end-begin)/2) : 0;
+    // the last point of the last interval:
+    std::size_t last = begin + 2*n_intervals;
+    int n_sections = (int)sections.size();
+    std::vector<Vector_double> results(n_sections);
+    std::string error;
+    bool rangeError = false;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        const Section& sec = ch[sections[n_s]];
+        try {
+            if (n_intervals > 0 && last >= sec.size()) {
+                throw std::out_of_range("Interval out of range in stfnum::batchQuad()");
             }
-            catch (...) {
-                throw;
+            Vector_double& quad_p = results[n_s];
+            quad_p.resize(n_intervals*3);
+            if (n_intervals > 0) {
+                Vector_double buffer;
+                const double* y = NULL;
+                if (sec.IsMapped()) {
+                    buffer.resize(last-begin+1);
+                    sec.CopyRange(begin, last+1, &buffer[0]);
+                    y = &buffer[0];
+                } else {
+                    y = &sec.get()[begin];
+                }
+                Vector_double A(9*n_intervals);
+                quad_systems(y, begin, n_intervals, A, quad_p);
+                stfnum::batchLinsolv(3,1,n_intervals,A,quad_p);
             }
-            quad_p[n_q++]=B[0];
-            quad_p[n_q++]=B[1];
-            quad_p[n_q++]=B[2];
+        }
+        catch (const std::out_of_range& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_quad_error)
+#endif
+            if (error.empty()) { error = e.what(); rangeError = true; }
+        }
+        catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_quad_error)
+#endif
+            if (error.empty()) error = e.what();
         }
     }
-    return quad_p;
+    if (!error.empty()) {
+        if (rangeError) {
+            throw std::out_of_range(error);
+        }
+        throw std::runtime_error(error);
+    }
+    return results;
+}
+
+namespace {
+
+    // stfnum::filter() of a whole window:
+    struct FFTWindowFilter {
+        FFTWindowFilter(const Vector_double& a_, int SR_, stfnum::Func func_, bool inverse_)
+            : a(a_), SR(SR_), func(func_), inverse(inverse_) {}
+        Vector_double operator()(const Vector_double& window) const {
+            return stfnum::filter(window, 0, window.size()-1, a, SR, func, inverse);
+        }
+        Vector_double a;
+        int SR;
+        stfnum::Func func;
+        bool inverse;
+    };
+}
+
+Channel stfnum::batchFilter(const Channel& ch, const std::vector<std::size_t>& sections,
+                            std::size_t filter_start, std::size_t filter_end,
+                            const Vector_double& a, int SR, stfnum::Func func, bool inverse,
+                            stfio::ProgressInfo& progDlg, int n_threads)
+{
+    STF_PROFILE_SCOPE("fft/batchFilter");
+    if (filter_start <= filter_end && !sections.empty()) {
+        // plan once, so that the workers don't queue up at the planner:
+        int fft_size = (int)transformSize(filter_end-filter_start+1, pad_global);
+        fftwPlan(fft_size, false);
+        fftwPlan(fft_size, true);
+    }
+    return batchFilter(ch, sections, filter_start, filter_end,
+                       fftWindowFilter(a, SR, func, inverse), progDlg, n_threads);
+}
+
+stfnum::WindowFilter
+stfnum::fftWindowFilter(const Vector_double& a, int SR, stfnum::Func func, bool inverse) {
+    return WindowFilter(FFTWindowFilter(a, SR, func, inverse));
+}
+
+Channel stfnum::batchFilter(const Channel& ch, const std::vector<std::size_t>& sections,
+                            std::size_t filter_start, std::size_t filter_end,
+                            const stfnum::WindowFilter& filter,
+                            stfio::ProgressInfo& progDlg, int n_threads)
+{
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::batchFilter()");
+        }
+        if (filter_start > filter_end || filter_end >= ch[sections[n]].size()) {
+            throw std::out_of_range("Filter window out of range in stfnum::batchFilter()");
+        }
+    }
+    int n_sections = (int)sections.size();
+    Channel filtered(sections.size());
+    if (n_sections == 0) {
+        return filtered;
+    }
+    std::size_t filter_size = filter_end-filter_start+1;
+
+    std::string error;
+    bool cancelled = false;
+    int n_done = 0;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        bool skip = false;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_filter_progress)
+#endif
+        skip = cancelled || !error.empty();
+        if (skip) {
+            continue;
+        }
+        const Section& sec = ch[sections[n_s]];
+        try {
+            Vector_double window(filter_size);
+            sec.CopyRange(filter_start, filter_end+1, &window[0]);
+            Section result(filter(window));
+            result.SetXScale(sec.GetXScale());
+            result.SetSectionDescription(sec.GetSectionDescription() + ", filtered");
+            filtered.InsertSection(STFIO_MOVE(result), n_s);
+        }
+        catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_filter_progress)
+#endif
+            if (error.empty()) error = e.what();
+        }
+#ifdef _OPENMP
+#pragma omp critical(stfnum_filter_progress)
+#endif
+        {
+            ++n_done;
+            std::ostringstream msg;
+            msg << "Section " << n_done << " of " << n_sections;
+            if (!cancelled && !progDlg.Update((int)(100.0*n_done/n_sections), msg.str())) {
+                cancelled = true;
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    if (cancelled) {
+        return Channel();
+    }
+    return filtered;
+}
+
+Channel stfnum::batchDiff(const Channel& ch, const std::vector<std::size_t>& sections,
+                          double x_scale, int n_threads)
+{
+    STF_PROFILE_SCOPE("stfnum/batchDiff");
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::batchDiff()");
+        }
+    }
+    int n_sections = (int)sections.size();
+    Channel differentiated(sections.size());
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        const Section& sec = ch[sections[n_s]];
+        Vector_double data(sec.size());
+        if (!data.empty()) {
+            sec.CopyRange(0, data.size(), &data[0]);
+            diff(&data[0], data.size(), x_scale, &data[0]);
+            data.pop_back();
+        }
+        Section result(STFIO_MOVE(data));
+        result.SetXScale(sec.GetXScale());
+        result.SetSectionDescription(sec.GetSectionDescription() + ", differentiated");
+        differentiated.InsertSection(STFIO_MOVE(result), n_s);
+    }
+    return differentiated;
+}
+
+stfnum::SplinePlan::SplinePlan(std::size_t n_points)
+    : n(n_points), cp(0), inv_pivot(0)
+{
+    if (n < 3) {
+        return;
+    }
+    // The rows of the system are ypp[0]-ypp[1] = 0,
+    // ypp[i-1]+4*ypp[i]+ypp[i+1] = 6*(y[i-1]-2*y[i]+y[i+1]) and
+    // -ypp[n-2]+ypp[n-1] = 0; it is solved with the Thomas algorithm:
+    cp.resize(n);
+    inv_pivot.resize(n);
+    inv_pivot[0] = 1.0;
+    cp[0] = -1.0;
+    for (std::size_t i = 1; i+1 < n; ++i) {
+        inv_pivot[i] = 1.0 / (4.0 - cp[i-1]);
+        cp[i] = inv_pivot[i];
+    }
+    inv_pivot[n-1] = 1.0 / (1.0 + cp[n-2]);
+    cp[n-1] = 0.0;
+}
+
+void stfnum::SplinePlan::Solve(const double* y, double* ypp) const {
+    if (n < 3) {
+        std::fill(ypp, ypp+n, 0.0);
+        return;
+    }
+    ypp[0] = 0.0;
+    for (std::size_t i = 1; i+1 < n; ++i) {
+        ypp[i] = (6.0*(y[i-1] - 2.0*y[i] + y[i+1]) - ypp[i-1]) * inv_pivot[i];
+    }
+    ypp[n-1] = ypp[n-2] * inv_pivot[n-1];
+    for (std::size_t i = n-1; i-- > 0;) {
+        ypp[i] -= cp[i]*ypp[i+1];
+    }
+}
+
+namespace {
+    // Weights of y[i], y[i+1], ypp[i] and ypp[i+1] at i+t:
+    inline void splineWeights(double t, double& a, double& b, double& c, double& d) {
+        a = 1.0 - t;
+        b = t;
+        c = t*(-1.0/3.0 + t*(0.5 - t/6.0));
+        d = t*(-1.0/6.0 + t*t/6.0);
+    }
+}
+
+void stfnum::SplinePlan::Evaluate(const double* y, const double* ypp, double begin, double step,
+                                  std::size_t n_out, double* out) const
+{
+    if (n < 2) {
+        std::fill(out, out+n_out, n == 1 ? y[0] : 0.0);
+        return;
+    }
+    std::size_t k = 0;
+    double inv_step = 1.0/step;
+    std::size_t m = (std::size_t)(inv_step + 0.5);
+    if (begin == 0 && m > 0 && fabs(inv_step - m) <= 1e-9*inv_step) {
+        // every interval holds the same m points:
+        Vector_double w(4*m);
+        for (std::size_t p = 0; p < m; ++p) {
+            splineWeights((double)p/m, w[4*p], w[4*p+1], w[4*p+2], w[4*p+3]);
+        }
+        std::size_t n_intervals = std::min(n-1, n_out/m);
+        for (std::size_t i = 0; i < n_intervals; ++i) {
+            double* o = out + i*m;
+            for (std::size_t p = 0; p < m; ++p) {
+                o[p] = w[4*p]*y[i] + w[4*p+1]*y[i+1] + w[4*p+2]*ypp[i] + w[4*p+3]*ypp[i+1];
+            }
+        }
+        k = n_intervals*m;
+    }
+    for (; k < n_out; ++k) {
+        double x = begin + k*step;
+        std::size_t i = x <= 0 ? 0 : std::min((std::size_t)x, n-2);
+        double a, b, c, d;
+        splineWeights(x - i, a, b, c, d);
+        out[k] = a*y[i] + b*y[i+1] + c*ypp[i] + d*ypp[i+1];
+    }
+}
+
+Channel stfnum::batchUpsample(const Channel& ch, const std::vector<std::size_t>& sections,
+                              double factor, int n_threads)
+{
+    STF_PROFILE_SCOPE("stfnum/batchUpsample");
+    if (!(factor > 0)) {
+        throw std::out_of_range("Invalid factor in stfnum::batchUpsample()");
+    }
+    // one factorization per section length:
+    std::map<std::size_t, SplinePlan> plans;
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] >= ch.size()) {
+            throw std::out_of_range("Section index out of range in stfnum::batchUpsample()");
+        }
+        std::size_t size = ch[sections[n]].size();
+        if (plans.find(size) == plans.end()) {
+            plans.insert(std::make_pair(size, SplinePlan(size)));
+        }
+    }
+    int n_sections = (int)sections.size();
+    Channel upsampled(sections.size());
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        const Section& sec = ch[sections[n_s]];
+        std::size_t size = sec.size();
+        std::size_t size_i = (std::size_t)(size*factor);
+        Vector_double data(size_i);
+        double step = size_i > 0 ? (double)size/size_i : 1.0;
+        if (size > 0 && size_i > 0) {
+            // the data and their second derivatives are only needed per thread:
+            stfio::ScratchScope scratch;
+            double* y = scratch.Doubles(size);
+            double* ypp = scratch.Doubles(size);
+            sec.CopyRange(0, size, y);
+            const SplinePlan& plan = plans.find(size)->second;
+            plan.Solve(y, ypp);
+            plan.Evaluate(y, ypp, 0.0, step, size_i, &data[0]);
+        }
+        Section result(STFIO_MOVE(data));
+        result.SetXScale(sec.GetXScale()*step);
+        result.SetSectionDescription(sec.GetSectionDescription() + ", upsampled");
+        upsampled.InsertSection(STFIO_MOVE(result), n_s);
+    }
+    return upsampled;
 }
 
 Vector_double stfnum::nojac(double x, const Vector_double& p) {
@@ -680,53 +1941,157 @@ stfnum::Table stfnum::defaultOutput(
 	return output;
 }
 
-std::map<double, int>
-stfnum::histogram(const Vector_double& data, int nbins) {
-
+stfnum::Histogram
+stfnum::histogramBins(const Vector_double& data, int nbins, int n_threads) {
+    STF_PROFILE_SCOPE("stfnum/histogram");
+    Histogram histo;
     if (nbins==-1) {
         nbins = int(data.size()/100.0);
     }
+    nbins = std::max(nbins, 1);
 
-    double fmax = *std::max_element(data.begin(), data.end());
-    double fmin = *std::min_element(data.begin(), data.end());
+    double fmin = 0, fmax = 0;
+    bool found = false;
+    for (std::size_t npoint=0; npoint < data.size(); ++npoint) {
+        double x = data[npoint];
+        if (x != x) {
+            continue;
+        }
+        if (!found || x < fmin) fmin = x;
+        if (!found || x > fmax) fmax = x;
+        found = true;
+    }
+    if (!found) {
+        return histo;
+    }
     fmax += (fmax-fmin)*1e-9;
+    histo.binWidth = (fmax-fmin)/nbins;
+    if (histo.binWidth > 0) {
+        for (int nbin=0; fmin + nbin*histo.binWidth < fmax; ++nbin) {
+            histo.edges.push_back(fmin + nbin*histo.binWidth);
+        }
+    } else {
+        // all values are equal:
+        histo.edges.push_back(fmin);
+        histo.binWidth = 1.0;
+    }
+    int n_bins = (int)histo.edges.size();
+    histo.counts.resize(n_bins, 0);
+
+    // one partial histogram per block of data, added up in order:
+    const std::size_t block_size = 1 << 16;
+    int n_blocks = (int)((data.size() + block_size - 1) / block_size);
+    std::vector< std::vector<int> > partial(n_blocks);
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_blocks);
+#pragma omp parallel for schedule(static) num_threads(n_threads)
+#endif
+    for (int n_b = 0; n_b < n_blocks; ++n_b) {
+        std::vector<int> counts(n_bins, 0);
+        std::size_t end = std::min(data.size(), (std::size_t)(n_b+1)*block_size);
+        for (std::size_t npoint = (std::size_t)n_b*block_size; npoint < end; ++npoint) {
+            double x = data[npoint];
+            if (x != x) {
+                continue;
+            }
+            int nbin = std::min(int((x-fmin) / histo.binWidth), n_bins-1);
+            ++counts[nbin];
+        }
+        partial[n_b].swap(counts);
+    }
+    for (int n_b = 0; n_b < n_blocks; ++n_b) {
+        for (int nbin = 0; nbin < n_bins; ++nbin) {
+            histo.counts[nbin] += partial[n_b][nbin];
+        }
+    }
+    return histo;
+}
 
-    double bin = (fmax-fmin)/nbins;
-
+std::map<double, int>
+stfnum::histogram(const Vector_double& data, int nbins) {
+    Histogram bins = histogramBins(data, nbins);
     std::map<double,int> histo;
-    for (int nbin=0; fmin + nbin*bin < fmax; ++nbin) {
-        histo[fmin + nbin*bin] = 0;
-    }
-    for (std::size_t npoint=0; npoint < data.size(); ++npoint) {
-        int nbin = int((data[npoint]-fmin) / bin);
-        histo[fmin + nbin*bin]++;
+    for (std::size_t nbin=0; nbin < bins.edges.size(); ++nbin) {
+        histo.insert(histo.end(), std::make_pair(bins.edges[nbin], bins.counts[nbin]));
     }
     return histo;
 }
 
 Vector_double
-stfnum::deconvolve(const Vector_double& dataIn, const Vector_double& templ,
-                int SR, double hipass, double lopass, stfio::ProgressInfo& progDlg)
+stfnum::deconvolve(const Vector_double& data, const Vector_double& templ,
+                int SR, double hipass, double lopass, stfio::ProgressInfo& progDlg,
+                fft_padding padding)
 {
+    if (data.size()<=0 || templ.size() <=0 || templ.size() > data.size()) {
+        std::out_of_range e("subscript out of range in stfnum::deconvolve()");
+        throw e;
+    }
+    return DeconvolutionPlan(templ, data.size(), SR, hipass, lopass, padding).Apply(data, progDlg);
+}
+
+stfnum::DeconvolutionPlan::DeconvolutionPlan(const Vector_double& templ, std::size_t size,
+                                             int SR, double hipass, double lopass, fft_padding padding)
+    : n_data(size), n_fft(transformSize(size, padding)), response()
+{
+    STF_PROFILE_SCOPE("fft/deconvolution_plan");
+    if (size<=0 || templ.size() <=0 || templ.size() > size) {
+        std::out_of_range e("subscript out of range in stfnum::DeconvolutionPlan");
+        throw e;
+    }
+    /* pad templ */
+    stfio::Vector_aligned in_templ_padded(n_fft, 0.0);
+    std::copy(templ.begin(), templ.end(), in_templ_padded.begin());
+
+    std::size_t n_cplx = n_fft/2+1;
+    stfio::Vector_aligned spectrum_templ(2*n_cplx);
+    fftw_complex* out_templ_padded = reinterpret_cast<fftw_complex*>(&spectrum_templ[0]);
+    executeR2C(fftwPlan((int)n_fft, false), (int)n_fft, &in_templ_padded[0], out_templ_padded);
+
+    double SI=1.0/SR; //the sampling interval
+    response.resize(2*n_cplx);
+    Vector_double f_c(1);
+    for (std::size_t n_point=0; n_point < n_cplx; ++n_point) {
+        /* highpass filter */
+        double f = n_point / (n_fft*SI);
+
+        double rslt_hi = 1.0;
+        if (hipass > 0) {
+            f_c[0] = hipass;
+            rslt_hi = 1.0-fgaussColqu(f, f_c);
+        }
+
+        /* lowpass filter */
+        double rslt_lo = 1.0;
+        if (lopass > 0) {
+            f_c[0] = lopass;
+            rslt_lo= fgaussColqu(f, f_c);
+        }
+
+        /* divide the filter response by the template spectrum */
+        double c = out_templ_padded[n_point][0];
+        double d = out_templ_padded[n_point][1];
+        double mag2 = c*c + d*d;
+        response[2*n_point] = rslt_hi * rslt_lo * c/mag2;
+        response[2*n_point+1] = -rslt_hi * rslt_lo * d/mag2;
+    }
+}
+
+Vector_double
+stfnum::DeconvolutionPlan::Apply(const Vector_double& dataIn, stfio::ProgressInfo& progDlg) const
+{
+    STF_PROFILE_SCOPE("fft/deconvolve");
+    if (dataIn.size() != n_data) {
+        std::out_of_range e("Data size doesn't match the plan in stfnum::DeconvolutionPlan::Apply()");
+        throw e;
+    }
 	// Normalize data
     double fmax = *std::max_element(dataIn.begin(), dataIn.end());
     double fmin = *std::min_element(dataIn.begin(), dataIn.end());
-    Vector_double data = stfio::vec_scal_minus(dataIn, fmin);
-    data = stfio::vec_scal_div(data, fmax-fmin);
+    Vector_double data(dataIn);
+    stfio::offset_scale_inplace(data, -fmin, 1.0/(fmax-fmin));
 
     bool skipped = false;
     progDlg.Update( 0, "Starting deconvolution...", &skipped );
-    if (data.size()<=0 || templ.size() <=0 || templ.size() > data.size()) {
-        std::out_of_range e("subscript out of range in stfnum::filter()");
-        throw e;
-    }
-    /* pad templ */
-    double* in_templ_padded =(double *)fftw_malloc(sizeof(double) * data.size());
-    std::copy(templ.begin(), templ.end(), in_templ_padded);
-    if (templ.size() < data.size()) {
-        for (size_t kp=templ.size(); kp<data.size(); ++kp)
-            in_templ_padded[kp] = 0;
-    }
 
     Vector_double data_return(data.size());
     if (skipped) {
@@ -734,109 +2099,87 @@ stfnum::deconvolve(const Vector_double& dataIn, const Vector_double& templ,
         return data_return;
     }
 
+    //the normalized data are a copy already; transform them in place
+    //unless they have to be extended or are aligned differently from
+    //the arrays the cached plans were made for:
+    stfio::Vector_aligned scratch;
+    double* in_data = &data[0];
+    if (n_fft != n_data || fftw_alignment_of(in_data) != 0) {
+        scratch.assign(data.begin(), data.end());
+        //return from the last to the first point along a straight line,
+        //so that the periodic continuation doesn't jump:
+        std::size_t n_ext = n_fft - n_data;
+        for (std::size_t n_point=0; n_point < n_ext; ++n_point) {
+            double frac = (double)(n_point+1) / (n_ext+1);
+            scratch.push_back(data[n_data-1] + frac*(data[0]-data[n_data-1]));
+        }
+        in_data = &scratch[0];
+    }
     //fftw_complex is a double[2]; hence, out is an array of
     //double[2] with out[n][0] being the real and out[n][1] being
     //the imaginary part.
-    fftw_plan p_data, p_templ, p_inv;
+    std::size_t n_cplx = n_fft/2+1;
+    stfio::Vector_aligned spectrum_data(2*n_cplx);
+    fftw_complex* out_data = reinterpret_cast<fftw_complex*>(&spectrum_data[0]);
 
-    //memory allocation as suggested by fftw:
-    double* in_data =(double *)fftw_malloc(sizeof(double) * data.size());
-    std::copy(data.begin(), data.end(), in_data);
-    fftw_complex* out_data = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * ((int)(data.size()/2)+1));
-
-    //plan the ffts and execute them:
-    p_data =fftw_plan_dft_r2c_1d((int)data.size(), in_data, out_data,
-                                 FFTW_ESTIMATE);
-    fftw_execute(p_data);
+    //execute the fft using a cached plan:
+    executeR2C(fftwPlan((int)n_fft, false), (int)n_fft, in_data, out_data);
     if (isnan(out_data[0][0]) || isinf(out_data[0][0])) {
         data_return.resize(0);
         throw std::runtime_error("Unstable fft; try again avoiding any test pulses (if present)");
     }
-    fftw_complex* out_templ_padded = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * ((int)(data.size()/2)+1));
-    p_templ =fftw_plan_dft_r2c_1d((int)data.size(),
-                                  in_templ_padded, out_templ_padded, FFTW_ESTIMATE);
-    fftw_execute(p_templ);
 
-    double SI=1.0/SR; //the sampling interval
     progDlg.Update( 25, "Performing deconvolution...", &skipped );
     if (skipped) {
         data_return.resize(0);
         return data_return;
     }
 
-    Vector_double f_c(1);
-    for (std::size_t n_point=0; n_point < (unsigned int)(data.size()/2)+1; ++n_point) {
-        /* highpass filter */
-        double f = n_point / (data.size()*SI);
-
-        double rslt_hi = 1.0;
-        if (hipass > 0) {
-            f_c[0] = hipass;
-            rslt_hi = 1.0-fgaussColqu(f, f_c);
-        }
-
-        /* lowpass filter */
-        double rslt_lo = 1.0;
-        if (lopass > 0) {
-            f_c[0] = lopass;
-            rslt_lo= fgaussColqu(f, f_c);
-        }
-
-        /* do the division in place */
+    for (std::size_t n_point=0; n_point < n_cplx; ++n_point) {
+        /* multiply with the precomputed response in place */
         double a = out_data[n_point][0];
         double b = out_data[n_point][1];
-        double c = out_templ_padded[n_point][0];
-        double d = out_templ_padded[n_point][1];
-        double mag2 = c*c + d*d;
-        out_data[n_point][0] = rslt_hi * rslt_lo * (a*c + b*d)/mag2;
-        out_data[n_point][1] = rslt_hi * rslt_lo * (b*c - a*d)/mag2;
+        double c = response[2*n_point];
+        double d = response[2*n_point+1];
+        out_data[n_point][0] = a*c - b*d;
+        out_data[n_point][1] = a*d + b*c;
     }
 
     //do the reverse fft:
-    p_inv = fftw_plan_dft_c2r_1d((int)data.size(),out_data, in_data, FFTW_ESTIMATE);
-    fftw_execute(p_inv);
+    executeC2R(fftwPlan((int)n_fft, true), (int)n_fft, out_data, in_data);
 
-    //fill the return array, adding the offset, and scaling by data.size()
-    //(because fftw computes an unnormalized transform):
+    //fill the return array, scaling by n_fft (because fftw computes an
+    //unnormalized transform):
     for (std::size_t n_point=0; n_point < data.size(); ++n_point) {
-        data_return[n_point]= in_data[n_point]/data.size();
+        data_return[n_point]= in_data[n_point]/n_fft;
     }
 
-    fftw_destroy_plan(p_data);
-    fftw_destroy_plan(p_templ);
-    fftw_destroy_plan(p_inv);
-
-    fftw_free(in_data);
-    fftw_free(out_data);
-    fftw_free(in_templ_padded);
-    fftw_free(out_templ_padded);
-
     progDlg.Update( 50, "Computing data histogram...", &skipped );
     if (skipped) {
         data_return.resize(0);
         return data_return;
     }
     int nbins =  500; //int(data_return.size()/500.0);
-    std::map<double, int> histo = histogram(data_return, nbins);
+    Histogram histo = histogramBins(data_return, nbins);
+    if (histo.edges.empty()) {
+        throw std::runtime_error("Deconvolution didn't yield any numbers in stfnum::deconvolve()");
+    }
     double max_value = -1;
     double max_time = 0;
     double maxhalf_time = 0;
-    Vector_double histo_fit(0);
-    for (std::map<double,int>::const_iterator it=histo.begin();
-         it != histo.end(); ++it) {
-        if (it->second > max_value) {
-            max_value = it->second;
-            max_time = it->first;
-        }
-        histo_fit.push_back(it->second);
+    Vector_double histo_fit(histo.counts.begin(), histo.counts.end());
+    for (std::size_t nbin=0; nbin < histo.edges.size(); ++nbin) {
+        if (histo.counts[nbin] > max_value) {
+            max_value = histo.counts[nbin];
+            max_time = histo.edges[nbin];
+        }
 #ifdef _STFDEBUG
-        std::cout << it->first << "\t" << it->second << std::endl;
+        std::cout << histo.edges[nbin] << "\t" << histo.counts[nbin] << std::endl;
 #endif
     }
-    for (std::map<double,int>::const_iterator it=histo.begin();
-         it != histo.end(); ++it) {
-        if (it->second > 0.5*max_value) {
-            maxhalf_time = it->first;
+    for (std::size_t nbin=0; nbin < histo.edges.size(); ++nbin) {
+        if (histo.counts[nbin] > 0.5*max_value) {
+            maxhalf_time = histo.edges[nbin];
             break;
         }
     }
@@ -848,14 +2191,14 @@ stfnum::deconvolve(const Vector_double& dataIn, const Vector_double& templ,
     }
     
     /* Fit Gaussian to histogram */
-    double interval = (++histo.begin())->first-histo.begin()->first;
+    double interval = histo.binWidth;
     if (maxhalf_time==0) {
         maxhalf_time = interval;
     }
     /* Initial parameter guesses */
     Vector_double pars(3);
     pars[0] = max_value;
-    pars[1] = (max_time - histo.begin()->first);
+    pars[1] = (max_time - histo.edges[0]);
     pars[2] = maxhalf_time *sqrt(2.0)/2.35482;
 #ifdef _STFDEBUG    
     std::cout << "nbins: " << nbins << std::endl;
@@ -866,13 +2209,12 @@ stfnum::deconvolve(const Vector_double& dataIn, const Vector_double& templ,
 #endif
 
     Vector_double opts = LM_default_opts();
-    std::vector< stfnum::storedFunc > funcLib = stfnum::GetFuncLib();
     std::string info;
     int warning;
 #ifdef _STFDEBUG
     double chisqr =
 #endif
-        lmFit(histo_fit, interval, funcLib[funcLib.size()-2], opts, true,
+        lmFit(histo_fit, interval, GetFunc(func_gauss), opts, true,
               pars, info, warning );
 #ifdef _STFDEBUG
     std::cout << chisqr << "\t" << interval << std::endl;
@@ -33,6 +33,7 @@
 #include <vector>
 #include <complex>
 #include <deque>
+#include <set>
 #include <boost/function.hpp>
 #ifdef _OPENMP
 #include <omp.h>
@@ -42,14 +43,16 @@
 #ifdef _MSC_VER
 #define INFINITY (DBL_MAX+DBL_MAX)
 #ifndef NAN
-        static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
-        #define NAN (*(const float *) __nan)
+        static const unsigned long __nan[2] = {0xffffffff, 0x7fffffff};
+        #define NAN (*(const float *) __nan)
 #endif
 #endif
 
 #include "../libstfio/stfio.h"
 #include "./spline.h"
 
+class Channel;
+
 namespace stfnum {
 
 /*! \addtogroup stfgen
@@ -66,6 +69,25 @@ typedef boost::function<double(double, const Vector_double&)> Func;
 //! The jacobian of a stfnum::Func.
 typedef boost::function<Vector_double(double, const Vector_double&)> Jac;
 
+//! Evaluates a function at many x-values at once.
+/*! Type definition for a batch counterpart of a stfnum::Func. The arguments are
+ *  the x-values, their number \e n, the parameters, their number and an array
+ *  of size \e n that receives the function's results.
+ */
+typedef boost::function<void(const double*, std::size_t, const double*, std::size_t, double*)> BatchFunc;
+
+//! Filters a window of data.
+/*! Type definition for a function that takes a copy of the data window and
+ *  returns the filtered data. It may be called from several threads at once.
+ */
+typedef boost::function<Vector_double(const Vector_double&)> WindowFilter;
+
+//! Evaluates the jacobian of a function at many x-values at once.
+/*! Same arguments as stfnum::BatchFunc, except that the last array receives
+ *  \e n rows of derivatives with respect to all parameters (row major order).
+ */
+typedef boost::function<void(const double*, std::size_t, const double*, std::size_t, double*)> BatchJac;
+
 //! Scaling function for fit parameters
 typedef boost::function<double(double, double, double, double, double)> Scale;
 
@@ -113,7 +135,10 @@ struct parInfo {
 };
 
 //! A table used for printing information.
-/*! Members will throw std::out_of_range if out of range.
+/*! Values are stored column by column, each column in a single contiguous
+ *  buffer with a bitmap of empty cells, so that appending rows doesn't
+ *  allocate every row separately and columns can be read without copying.
+ *  Members will throw std::out_of_range if out of range.
  */
 class StfioDll Table {
 public:
@@ -191,14 +216,35 @@ public:
     std::size_t nCols() const { return colLabels.size(); }
     
     //! Appends rows to the table.
-    /*! \param nRows The number of rows to be appended.
+    /*! Storage grows geometrically, so that appending rows one at a time
+     *  takes amortized constant time.
+     *  \param nRows The number of rows to be appended.
      */
     void AppendRows(std::size_t nRows);
 
+    //! Reserves storage for a number of rows.
+    /*! \param nRows The total number of rows that the table is expected to have.
+     */
+    void Reserve(std::size_t nRows);
+
+    //! Retrieves all values of a column without copying them.
+    /*! The reference is invalidated when rows are appended.
+     *  \param col 0-based column index.
+     *  \return The values of the column, one per row; empty cells keep their value.
+     */
+    const Vector_double& GetColumn(std::size_t col) const;
+
+    //! Retrieves the empty cells of a column without copying them.
+    /*! The reference is invalidated when rows are appended.
+     *  \param col 0-based column index.
+     *  \return true for every row whose cell in \e col is empty.
+     */
+    const std::vector<bool>& GetEmptyColumn(std::size_t col) const;
+
 private:
-    // row major order:
-    std::vector< std::vector<double> > values;
-    std::vector< std::deque< bool > > empty;
+    // column major order:
+    std::vector< Vector_double > values;
+    std::vector< std::vector< bool > > empty;
     std::vector< std::string > rowLabels;
     std::vector< std::string > colLabels;
 };
@@ -230,12 +276,17 @@ struct StfioDll storedFunc {
      *  \param hasJac_ true if a Jacobian is available.
      *  \param init_ A function for initialising the parameters.
      *  \param output_ Output of the fit.
+     *  \param batchFunc_ Optional batch evaluation of func_.
+     *  \param batchJac_ Optional batch evaluation of jac_.
      */
     storedFunc( const std::string& name_, const std::vector<parInfo>& pInfo_,
             const Func& func_, const Init& init_, const Jac& jac_, bool hasJac_ = true,
-            const Output& output_ = defaultOutput /*,
+            const Output& output_ = defaultOutput,
+            const BatchFunc& batchFunc_ = BatchFunc(),
+            const BatchJac& batchJac_ = BatchJac() /*,
             bool hasId_ = true*/
-    ) : name(name_),pInfo(pInfo_),func(func_),init(init_),jac(jac_),hasJac(hasJac_),output(output_) /*, hasId(hasId_)*/
+    ) : name(name_),pInfo(pInfo_),func(func_),init(init_),jac(jac_),hasJac(hasJac_),output(output_),
+        batchFunc(batchFunc_),batchJac(batchJac_) /*, hasId(hasId_)*/
     {
 /*        if (hasId) {
             id = NextId();
@@ -258,6 +309,8 @@ struct StfioDll storedFunc {
     Jac jac;                     /*!< Jacobian of func. */
     bool hasJac;                 /*!< True if the function has an analytic Jacobian. */
     Output output;               /*!< Output of the fit. */
+    BatchFunc batchFunc;         /*!< Batch evaluation of func; used by stfnum::lmFit() if not empty. */
+    BatchJac batchJac;           /*!< Batch evaluation of jac; used by stfnum::lmFit() if not empty and hasJac is set. */
 //    bool hasId;                  /*!< Determines whether a function should have an id. */
 
 };
@@ -269,14 +322,44 @@ struct StfioDll storedFunc {
 template <typename T>
 T SQR (T a);
 
+//! Lengths of the Fourier transforms in filter() and deconvolve().
+enum fft_padding {
+    pad_global = 0, /*!< Use the setting of stfnum::setFFTPadding(). */
+    pad_exact,      /*!< Transform exactly the data. */
+    pad_fast        /*!< Extend the data to the length returned by stfnum::fftSize(). */
+};
+
+//! Retrieves a length for which Fourier transforms are fast.
+/*! FFTW is fastest for products of small primes; a transform of a large
+ *  prime length can take many times longer than one of a slightly
+ *  longer, composite length.
+ *  \param n The minimal length.
+ *  \return The smallest number of the form 2^a 3^b 5^c 7^d that is at least \e n.
+ */
+StfioDll std::size_t fftSize(std::size_t n);
+
+//! Sets whether filter() and deconvolve() extend data to a fast transform length by default.
+/*! Disabled by default, so that results don't depend on the padding.
+ *  \param enable true to use stfnum::pad_fast where stfnum::pad_global is passed.
+ */
+StfioDll void setFFTPadding(bool enable);
+
+//! Checks whether filter() and deconvolve() extend data to a fast transform length by default.
+/*! \return true if stfnum::pad_global stands for stfnum::pad_fast.
+ */
+StfioDll bool getFFTPadding();
+
 //! Convolves a data set with a filter function.
-/*! \param toFilter The valarray to be filtered.
+/*! With stfnum::pad_fast, the window is extended with zeros after its
+ *  linear offset has been removed, so that it continues smoothly.
+ *  \param toFilter The valarray to be filtered.
  *  \param filter_start The index from which to start filtering.
  *  \param filter_end The index at which to stop filtering.
  *  \param a A valarray of parameters for the filter function.
  *  \param SR The sampling rate.
  *  \param func The filter function in the frequency domain.
  *  \param inverse true if (1- \e func) should be used as the filter function, false otherwise
+ *  \param padding Length of the transform.
  *  \return The convolved data set.
  */
 StfioDll Vector_double
@@ -287,15 +370,226 @@ filter(
         const Vector_double &a,
         int SR,
         stfnum::Func func,
-        bool inverse = false
+        bool inverse = false,
+        fft_padding padding = pad_global
 );
 
+//! Filters a data stream block by block.
+/*! Unlike filter(), which transforms the whole range at once, this applies
+ *  a finite impulse response derived from the same filter function by
+ *  overlap-save convolution, so that memory is bounded by the block size
+ *  rather than by the length of the recording. Data can be passed in
+ *  chunks of any size; the output doesn't depend on how the stream
+ *  is split up. The filter has zero phase; the ends of the stream are
+ *  extended with their first and last values, respectively.
+ */
+class StfioDll StreamFilter {
+public:
+    //! Constructor
+    /*! \param a A valarray of parameters for the filter function.
+     *  \param SR The sampling rate.
+     *  \param func The filter function in the frequency domain.
+     *  \param inverse true if (1- \e func) should be used as the filter function, false otherwise
+     *  \param kernel_size Length of the impulse response; rounded up to an odd number.
+     *  \param block_size Length of the transforms; rounded up to a power of 2
+     *         of at least twice the kernel size.
+     */
+    StreamFilter(const Vector_double& a, int SR, stfnum::Func func, bool inverse = false,
+                 std::size_t kernel_size = 1025, std::size_t block_size = 65536);
+
+    //! Destructor
+    ~StreamFilter();
+
+    //! Passes the next chunk of data through the filter.
+    /*! Output lags behind input by half the kernel size.
+     *  \param chunk The next chunk of data.
+     *  \return All filtered samples that can be computed so far.
+     */
+    Vector_double Process(const Vector_double& chunk);
+
+    //! Ends the data stream.
+    /*! \return The remaining filtered samples. In total, the number of samples
+     *          returned equals the number of samples passed to Process().
+     *          The filter is reset afterwards.
+     */
+    Vector_double Finish();
+
+    //! Discards all buffered data so that a new stream can be filtered.
+    void Reset();
+
+    //! Retrieves the impulse response of the filter.
+    /*! \return The impulse response.
+     */
+    const Vector_double& GetKernel() const { return kernel; }
+
+private:
+    StreamFilter(const StreamFilter&);
+    StreamFilter& operator=(const StreamFilter&);
+
+    // Filters all complete blocks in the buffer and appends the results to output:
+    void ProcessBlocks(Vector_double& output, std::size_t n_max);
+
+    Vector_double kernel;
+    int fft_size, n_valid;
+    // pending input, including the overlap with the previous block:
+    Vector_double buffer;
+    bool started;
+    std::size_t n_in, n_out;
+    double* in;
+    fftw_complex* out;
+    fftw_complex* kernel_fft;
+};
+
+//! Methods for running baselines
+enum baseline_filter {
+    filter_mean       = 0, /*!< Sliding mean. */
+    filter_median     = 1, /*!< Sliding median. */
+    filter_percentile = 2  /*!< Sliding percentile. */
+};
+
+//! Removes a running baseline from a data stream block by block.
+/*! The baseline at each sampling point is the mean, median or a percentile
+ *  of a window of \e width points around it; the window is truncated at both
+ *  ends of the stream. Each point takes amortized O(1) time for the mean
+ *  and O(log(width)) time for the median and percentiles.
+ *  Like StreamFilter, data can be passed in chunks of any size; the output
+ *  doesn't depend on how the stream is split up, and memory is bounded
+ *  by the window width.
+ */
+class StfioDll RunningBaseline {
+public:
+    //! Constructor. Throws std::out_of_range if \e width is 0 or \e percentile isn't within [0,100].
+    /*! \param method The type of baseline.
+     *  \param width The width of the window in sampling points.
+     *  \param percentile The percentile for stfnum::filter_percentile; percentiles
+     *         between two sampling points are interpolated linearly.
+     *  \param subtract true if the baseline should be subtracted from the data,
+     *         false if the baseline itself should be returned.
+     */
+    RunningBaseline(baseline_filter method, std::size_t width, double percentile = 50.0,
+                    bool subtract = true);
+
+    //! Passes the next chunk of data.
+    /*! Output lags behind input by half the window width.
+     *  \param chunk The next chunk of data.
+     *  \return All samples that can be computed so far.
+     */
+    Vector_double Process(const Vector_double& chunk);
+
+    //! Ends the data stream.
+    /*! \return The remaining samples. In total, the number of samples
+     *          returned equals the number of samples passed to Process().
+     *          The baseline is reset afterwards.
+     */
+    Vector_double Finish();
+
+    //! Discards all buffered data so that a new stream can be processed.
+    void Reset();
+
+private:
+    void Insert(double value);
+    void Erase(double value);
+    double Value();
+    // Computes all output samples whose windows are complete:
+    void Emit(Vector_double& output, bool finish);
+
+    baseline_filter method;
+    std::size_t width, half;
+    double quantile;
+    bool subtract;
+    // samples from the beginning of the current window to the last input:
+    std::deque<double> buffer;
+    // absolute indices of the first sample in buffer, of the next sample that
+    // enters the window, of the next output sample and of the next input sample:
+    std::size_t n_begin, n_end, n_out, n_in;
+    // the window values, split at the percentile:
+    std::multiset<double> lower, upper;
+    double sum;
+    std::size_t n_erased;
+};
+
+//! Subtracts a running baseline from a section.
+/*! Compactly stored sections are decoded chunk by chunk rather than as a whole.
+ *  See stfnum::RunningBaseline for a description of the parameters.
+ *  \return A new section containing the data minus the baseline.
+ */
+StfioDll Section
+subtractBaseline(const Section& data, baseline_filter method, std::size_t width, double percentile = 50.0);
+
+//! Retrieves a cached FFTW plan for a one-dimensional real transform.
+/*! Plans are created once per transform size and direction and are kept
+ *  for the lifetime of the process, so that repeated transforms of equal
+ *  size pay for planning only once. Creating plans is serialised; the
+ *  returned plan may be executed concurrently from several threads.
+ *  The plan has to be executed with fftw_execute_dft_r2c() or fftw_execute_dft_c2r()
+ *  on out-of-place arrays that are aligned like those returned by fftw_malloc(),
+ *  i.e. fftw_alignment_of() returns 0, such as stfio::Vector_aligned.
+ *  Don't destroy it.
+ *  \param n The size of the real array.
+ *  \param inverse false for a real-to-complex (forward) transform,
+ *         true for a complex-to-real (backward) transform.
+ *  \return The cached plan.
+ */
+StfioDll fftw_plan fftwPlan(int n, bool inverse);
+
+//! Sets the planner flags that will be used for new FFTW plans.
+/*! Defaults to FFTW_ESTIMATE. Use FFTW_MEASURE for faster transforms at
+ *  the expense of a more costly first plan for every size. Changing the flags
+ *  discards all cached plans.
+ *  \param flags FFTW planner flags.
+ */
+StfioDll void setFFTWPlannerFlags(unsigned flags);
+
+//! Retrieves the planner flags that are used for new FFTW plans.
+/*! \return FFTW planner flags.
+ */
+StfioDll unsigned getFFTWPlannerFlags();
+
+//! Discards all cached FFTW plans.
+StfioDll void clearFFTWPlans();
+
+//! Loads FFTW wisdom from a file.
+/*! \param fName Full path of the wisdom file.
+ *  \return true if the wisdom was read successfully, false otherwise.
+ */
+StfioDll bool importFFTWWisdom(const std::string& fName);
+
+//! Saves the accumulated FFTW wisdom to a file.
+/*! \param fName Full path of the wisdom file.
+ *  \return true if the wisdom was written successfully, false otherwise.
+ */
+StfioDll bool exportFFTWWisdom(const std::string& fName);
+
+//! A histogram with bins of equal width.
+struct StfioDll Histogram {
+    //! Constructor for an empty histogram.
+    Histogram() : edges(), counts(), binWidth(0) {}
+
+    Vector_double edges;     /*!< Lower limits of the bins in ascending order. */
+    std::vector<int> counts; /*!< Number of observations in each bin. */
+    double binWidth;         /*!< Width of the bins. */
+};
+
+//! Computes a histogram with bins of equal width.
+/*! The bins cover the range of \e data. Every thread counts a part of the
+ *  data into histogram of its own; these are added up at the end, so that
+ *  millions of values take a single pass. NaNs aren't counted.
+ *  \param data The signal
+ *  \param nbins Number of bins in the histogram; -1 uses one bin per 100
+ *         data points. At least one bin is used.
+ *  \param n_threads Number of threads that count in parallel; 0 uses the
+ *         configured number of threads.
+ *  \return The histogram; empty if \e data doesn't contain any numbers.
+ */
+StfioDll Histogram histogramBins(const Vector_double& data, int nbins=-1, int n_threads=0);
+
 //! Computes a histogram
-/*! \param data The signal
+/*! Same as stfnum::histogramBins(), in a different format.
+ *  \param data The signal
  *  \param nbins Number of bins in the histogram.
  *  \return A map with lower bin limits as keys, number of observations as values.
  */
-std::map<double, int>
+StfioDll std::map<double, int>
 histogram(const Vector_double& data, int nbins=-1);
 
 //! Deconvolves a template from a signal
@@ -304,14 +598,111 @@ histogram(const Vector_double& data, int nbins=-1);
  *  \param SR The sampling rate in kHz.
  *  \param hipass Highpass filter cutoff frequency in kHz
  *  \param lopass Lowpass filter cutoff frequency in kHz
+ *  \param progDlg Progress indicator.
+ *  \param padding Length of the transforms. With stfnum::pad_fast, the
+ *         data are extended by a straight line from their last back to
+ *         their first point, so that they continue smoothly.
  *  \return The result of the deconvolution
  */
 StfioDll Vector_double
 deconvolve(const Vector_double& data, const Vector_double& templ,
-           int SR, double hipass, double lopass, stfio::ProgressInfo& progDlg);
+           int SR, double hipass, double lopass, stfio::ProgressInfo& progDlg,
+           fft_padding padding = pad_global);
+
+//! Deconvolves a template from many signals of equal length.
+/*! stfnum::deconvolve() transforms the zero-padded template and evaluates
+ *  the highpass and lowpass filters every time it's called. A plan does
+ *  this once for a given length and sampling rate and keeps the combined
+ *  frequency response, so that only the signal itself is transformed when
+ *  the plan is applied. Apply() doesn't change the plan and may be called
+ *  concurrently from several threads.
+ */
+class StfioDll DeconvolutionPlan {
+public:
+    //! Constructor
+    /*! Throws std::out_of_range if the template is empty or longer than \e size.
+     *  \param templ The template
+     *  \param size Length of the signals that the plan will be applied to.
+     *  \param SR The sampling rate in kHz.
+     *  \param hipass Highpass filter cutoff frequency in kHz
+     *  \param lopass Lowpass filter cutoff frequency in kHz
+     *  \param padding Length of the transforms; see stfnum::deconvolve().
+     */
+    DeconvolutionPlan(const Vector_double& templ, std::size_t size,
+                      int SR, double hipass, double lopass, fft_padding padding = pad_global);
+
+    //! Deconvolves the template from a signal.
+    /*! Throws std::out_of_range if \e data doesn't have the length of the plan.
+     *  \param data The input signal
+     *  \param progDlg Progress indicator.
+     *  \return The result of the deconvolution, as returned by stfnum::deconvolve().
+     */
+    Vector_double Apply(const Vector_double& data, stfio::ProgressInfo& progDlg) const;
+
+    //! Retrieves the length of the signals that the plan can be applied to.
+    /*! \return The length of the signals.
+     */
+    std::size_t size() const { return n_data; }
+
+private:
+    std::size_t n_data, n_fft;
+    // The filter response divided by the template spectrum, as pairs
+    // of real and imaginary parts:
+    Vector_double response;
+};
+
+//! Cubic splines through a fixed number of equally spaced data points.
+/*! The tridiagonal system for the second derivatives depends only on the
+ *  number of points. It is factorized once, so that any number of sections
+ *  of that length are interpolated by a forward and a back substitution.
+ *  The spline is a quadratic over the first and the last interval; with
+ *  fewer than three points, it is a straight line. A plan can be used by
+ *  several threads at once.
+ */
+class StfioDll SplinePlan {
+public:
+    //! Constructor.
+    /*! \param n_points Number of data points.
+     */
+    explicit SplinePlan(std::size_t n_points);
+
+    //! Retrieves the number of data points.
+    std::size_t size() const { return n; }
+
+    //! Computes the second derivatives of the spline at the data points.
+    /*! \param y size() data points.
+     *  \param ypp On exit, size() second derivatives.
+     */
+    void Solve(const double* y, double* ypp) const;
+
+    //! Evaluates the spline at equally spaced points.
+    /*! Point \e k lies at the fractional index \e begin + \e k * \e step of
+     *  the data; points beyond the ends are extrapolated from the first or
+     *  last interval. If 1 / \e step is an integer, the weights of the data
+     *  points are computed once per position within an interval, so that the
+     *  evaluation is a loop of multiply-adds.
+     *  \param y size() data points.
+     *  \param ypp The second derivatives from Solve().
+     *  \param begin Fractional index of the first point.
+     *  \param step Distance between the points, in sampling intervals of the data.
+     *  \param n_out Number of points.
+     *  \param out On exit, the \e n_out values of the spline.
+     */
+    void Evaluate(const double* y, const double* ypp, double begin, double step,
+                  std::size_t n_out, double* out) const;
+
+private:
+    std::size_t n;
+    // Coefficients of the LU factorization of the tridiagonal matrix:
+    // the modified super diagonal and the inverse pivots:
+    Vector_double cp, inv_pivot;
+};
 
 //! Interpolates a dataset using cubic splines.
-/*! \param y The valarray to be interpolated.
+/*! The points of the interpolated data set lie at multiples of
+ *  size / (size*newF/oldF) in sampling intervals of \e y. See
+ *  stfnum::SplinePlan for the spline.
+ *  \param y The valarray to be interpolated.
  *  \param oldF The original sampling frequency.
  *  \param newF The new frequency of the interpolated array.
  *  \return The interpolated data set.
@@ -324,6 +715,25 @@ cubicSpline(
         T newF
 );
 
+//! Upsamples several sections at once with cubic splines.
+/*! Sections are interpolated in parallel as by stfnum::cubicSpline(). The
+ *  factorizations are shared by all sections of the same length, and each
+ *  section is decoded into its output vector without other copies.
+ *  Throws std::out_of_range if a section index is out of range or if the
+ *  factor isn't positive.
+ *  \param ch The channel.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param factor The ratio of the new to the old sampling rate.
+ *  \param n_threads Number of sections that are interpolated in parallel;
+ *         0 uses the configured number of threads.
+ *  \return A channel with the interpolated sections in the order of
+ *          \e sections, with x scales that match their new sampling points
+ *          and ", upsampled" appended to their descriptions.
+ */
+StfioDll Channel
+batchUpsample(const Channel& ch, const std::vector<std::size_t>& sections, double factor,
+              int n_threads = 0);
+
 //! Differentiate data.
 /* \param input The valarray to be differentiated.
  * \param x_scale The sampling interval.
@@ -332,6 +742,36 @@ cubicSpline(
 template <class T>
 std::vector<T> diff(const std::vector<T>& input, T x_scale);
 
+//! Differentiates data into a buffer.
+/*! Computes (input[n+1]-input[n])/x_scale for n < size-1, with the same
+ *  results as stfnum::diff() above. Iterations are independent, so that the
+ *  compiler can vectorize the loop. \e output may point to \e input to
+ *  differentiate in place, or to a buffer that is reused for many sections.
+ *  \param input The data to be differentiated.
+ *  \param size Number of data points in \e input.
+ *  \param x_scale The sampling interval.
+ *  \param output Receives size-1 values.
+ */
+template <class T>
+void diff(const T* input, std::size_t size, T x_scale, T* output);
+
+//! Differentiates several sections at once.
+/*! Sections are differentiated in parallel. Each section is decoded into
+ *  its output vector and differentiated in place there, so that no other
+ *  copies are made.
+ *  Throws std::out_of_range if a section index is out of range.
+ *  \param ch The channel.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param x_scale The sampling interval.
+ *  \param n_threads Number of sections that are differentiated in parallel;
+ *         0 uses the configured number of threads.
+ *  \return A channel with the differentiated sections in the order of
+ *          \e sections, with the x scales of the originals and
+ *          ", differentiated" appended to their descriptions.
+ */
+StfioDll Channel
+batchDiff(const Channel& ch, const std::vector<std::size_t>& sections, double x_scale, int n_threads = 0);
+
 //! Integration using Simpson's rule.
 /*! \param input The valarray to be integrated.
  *  \param a Start of the integration interval.
@@ -392,8 +832,118 @@ linsolv(
  */
 StfioDll Vector_double
 quad(const Vector_double& data, std::size_t begin, std::size_t end);
+
+//! Solves many small linear equation systems of the same size using LAPACK.
+/*! The systems are stored one after the other, each of them in column-major
+ *  order as in stfnum::linsolv(). Work arrays are allocated once per thread
+ *  rather than once per system.
+ *  Throws std::runtime_error if the sizes of \e A or \e B don't match or
+ *  if one of the matrices is singular.
+ *  \param n Number of rows and columns of each matrix in \e A.
+ *  \param nrhs Number of columns of each matrix in \e B.
+ *  \param n_systems Number of systems.
+ *  \param A On entry, \e n_systems left-hand-side matrices. On exit, their
+ *         LU factorizations (see stfnum::linsolv()).
+ *  \param B On entry, \e n_systems right-hand-side matrices. On exit, the
+ *         solutions of the systems.
+ *  \param n_threads Number of threads that solve systems in parallel;
+ *         0 uses the configured number of threads.
+ */
+StfioDll void
+batchLinsolv(
+        int n,
+        int nrhs,
+        std::size_t n_systems,
+        Vector_double& A,
+        Vector_double& B,
+        int n_threads = 1
+);
+
+//! Solves the quadratic equations of stfnum::quad() in several sections at once.
+/*! Sections are processed in parallel; compactly stored data are only decoded
+ *  within the interval. Each result is the same as stfnum::quad() of a single section.
+ *  Throws std::out_of_range if a section index or the interval is out of range.
+ *  \param ch The channel.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param begin Start of interval to be used
+ *  \param end End of interval to be used
+ *  \param n_threads Number of sections that are processed in parallel;
+ *         0 uses the configured number of threads.
+ *  \return Parameters of the quadratic equations in the order of \e sections.
+ */
+StfioDll std::vector<Vector_double>
+batchQuad(const Channel& ch, const std::vector<std::size_t>& sections,
+          std::size_t begin, std::size_t end, int n_threads = 0);
+
+//! Filters several sections at once.
+/*! Sections are filtered in parallel with stfnum::filter(). Since all
+ *  windows have the same size, they share a single pair of cached FFTW
+ *  plans (see stfnum::fftwPlan()), which are created before the workers
+ *  start. Compactly stored data are only decoded within the window.
+ *  Throws std::out_of_range if a section index or the window is out of range.
+ *  \param ch The channel.
+ *  \param sections Indices of the sections within \e ch.
+ *  \param filter_start The index of the first data point of every section to be filtered.
+ *  \param filter_end The index of the last data point of every section to be filtered.
+ *  \param a, SR, func, inverse See stfnum::filter().
+ *  \param progDlg Progress indicator; updated once per section from within a
+ *         critical section, so that it needn't be thread-safe.
+ *  \param n_threads Number of sections that are filtered in parallel;
+ *         0 uses the configured number of threads.
+ *  \return A channel with the filtered sections in the order of \e sections,
+ *          with the x scales of the originals and ", filtered" appended to
+ *          their descriptions; empty if the operation has been cancelled.
+ */
+StfioDll Channel
+batchFilter(const Channel& ch, const std::vector<std::size_t>& sections,
+            std::size_t filter_start, std::size_t filter_end,
+            const Vector_double& a, int SR, stfnum::Func func, bool inverse,
+            stfio::ProgressInfo& progDlg, int n_threads = 0);
+
+//! Wraps stfnum::filter() of whole windows.
+/*! \param a, SR, func, inverse See stfnum::filter().
+ *  \return A function that filters a window from its first to its last point.
+ */
+StfioDll WindowFilter
+fftWindowFilter(const Vector_double& a, int SR, stfnum::Func func, bool inverse);
+
+//! Filters several sections at once with an arbitrary filter.
+/*! Same as batchFilter() above, except that the windows are copied and
+ *  passed to \e filter, e.g. a time-domain filter from tdfilter.h.
+ *  \param ch, sections, filter_start, filter_end, progDlg, n_threads See batchFilter() above.
+ *  \param filter The filter; called concurrently for different sections.
+ *  \return See batchFilter() above.
+ */
+StfioDll Channel
+batchFilter(const Channel& ch, const std::vector<std::size_t>& sections,
+            std::size_t filter_start, std::size_t filter_end,
+            const stfnum::WindowFilter& filter,
+            stfio::ProgressInfo& progDlg, int n_threads = 0);
  
 
+//! Computes the dot product of a template with every stretch of a data array.
+/*! For long templates, the products are computed in the frequency domain
+ *  (overlap-save), which takes O(N log M) rather than O(N M) operations.
+ *  \param data The data array.
+ *  \param templ The template waveform.
+ *  \param n_out Number of products; the last one uses data[n_out-1+templ.size()-1].
+ *  \return A vector of size \e n_out with the sum of templ[k]*data[n+k] for each \e n.
+ */
+StfioDll Vector_double
+slidingProduct(const Vector_double& data, const Vector_double& templ, std::size_t n_out);
+
+//! Computes the dot products of several templates with every stretch of a data array.
+/*! Each block of the data is transformed to the frequency domain only once
+ *  and then multiplied with the spectrum of every template, so that a bank of
+ *  templates costs far less than separate calls to stfnum::slidingProduct().
+ *  \param data The data array.
+ *  \param templs The template waveforms; they may have different sizes.
+ *  \return For each template, a vector of size data.size()-templs[n].size()
+ *          as returned by stfnum::slidingProduct().
+ */
+StfioDll std::vector<Vector_double>
+slidingProducts(const Vector_double& data, const std::vector<Vector_double>& templs);
+
 //! Computes the event detection criterion according to Clements & Bekkers (1997).
 /*! \param data The valarray from which to extract events.
  *  \param templ A template waveform that is used for event detection.
@@ -406,15 +956,122 @@ detectionCriterion(
         stfio::ProgressInfo& progDlg
 );
 
+//! Computes the event detection criterion after removing a running baseline.
+/*! Slow drifts of gap-free recordings are removed with stfnum::subtractBaseline()
+ *  before stfnum::detectionCriterion() is applied.
+ *  \param data The section from which to extract events.
+ *  \param templ A template waveform that is used for event detection.
+ *  \param method The type of baseline.
+ *  \param width The width of the baseline window in sampling points; should
+ *         be considerably longer than the template.
+ *  \param percentile The percentile for stfnum::filter_percentile.
+ *  \return The detection criterion for every value of \e data.
+ */
+StfioDll Vector_double
+detectionCriterion(
+        const Section& data,
+        const Vector_double& templ,
+        stfio::ProgressInfo& progDlg,
+        baseline_filter method,
+        std::size_t width,
+        double percentile = 50.0
+);
+
+//! Computes the event detection criterion of a data stream block by block.
+/*! Each call to Process() computes the criterion for the points whose
+ *  template window has become complete, keeping the last templ.size()
+ *  points as the overlap with the next chunk (overlap-save), so that the
+ *  criterion of a recording that is still being acquired can be updated
+ *  with every chunk of new data. Combine it with stfnum::RunningBaseline
+ *  to remove slow drifts first. After N points have been passed, the
+ *  criterion is known for the first N-templ.size() of them, like the
+ *  result of stfnum::detectionCriterion() for the same N points; values may
+ *  differ from the latter by rounding errors.
+ */
+class StfioDll StreamCriterion {
+public:
+    //! Constructor. Throws std::out_of_range if the template has fewer than 2 points.
+    /*! \param templ A template waveform that is used for event detection.
+     */
+    explicit StreamCriterion(const Vector_double& templ);
+
+    //! Passes the next chunk of data.
+    /*! \param chunk The next chunk of data.
+     *  \return The detection criterion for all points that can be computed so far.
+     */
+    Vector_double Process(const Vector_double& chunk);
+
+    //! Retrieves the number of criterion values that have been returned so far.
+    /*! \return The index of the point that the next criterion value belongs to.
+     */
+    std::size_t GetPosition() const { return n_out; }
+
+    //! Discards all buffered data so that a new stream can be processed.
+    void Reset();
+
+private:
+    Vector_double templ;
+    // pending input, starting with the point of the next criterion value:
+    Vector_double buffer;
+    std::size_t n_out;
+};
+
+//! Computes the detection criterion for a bank of templates.
+/*! The template-data products of all templates are computed with
+ *  stfnum::slidingProducts().
+ *  \param data The valarray from which to extract events.
+ *  \param templs The template waveforms; they may have different sizes.
+ *  \param bestTemplate On exit, the index of the best-matching template for
+ *         every value of the result.
+ *  \return The largest detection criterion of all templates for the first
+ *          data.size()-m values of \e data, where m is the size of the longest
+ *          template, or an empty vector if the operation was cancelled.
+ */
+StfioDll Vector_double
+detectionCriterion(
+        const Vector_double& data,
+        const std::vector<Vector_double>& templs,
+        stfio::ProgressInfo& progDlg,
+        std::vector<int>& bestTemplate
+);
+
 // TODO: Add negative-going peaks.
 //! Searches for positive-going peaks.
-/*! \param data The valarray to be searched for peaks.
+/*! Long data sets are scanned in parallel chunks; the result is the
+ *  same as that of a single serial scan.
+ *  \param data The valarray to be searched for peaks.
  *  \param threshold Minimal amplitude of a peak.
  *  \param minDistance Minimal distance between subsequent peaks.
  *  \return A vector of indices where peaks have occurred in \e data.
  */
 StfioDll std::vector<int> peakIndices(const Vector_double& data, double threshold, int minDistance);
 
+//! Computes a running mean.
+/*! Point n of the result is the mean of \e binwidth points starting at point n,
+ *  or of all remaining points near the end of \e data. Each mean is computed
+ *  in constant time from prefix sums (see stfio::PrefixSums).
+ *  Throws std::out_of_range if \e binwidth is 0.
+ *  \param data The data to be averaged.
+ *  \param binwidth The number of points that are averaged.
+ *  \return The running mean, with the same size as \e data.
+ */
+StfioDll Vector_double runningMean(const Vector_double& data, std::size_t binwidth);
+
+//! Finds threshold crossings.
+/*! An event starts at the first point that is above (or below) the threshold
+ *  and lasts until the data return below (or above) it.
+ *  Throws std::out_of_range if the range is out of range.
+ *  \param data The data to be searched for events.
+ *  \param begin Index of the first data point to be searched.
+ *  \param end Index past the last data point to be searched.
+ *  \param threshold The detection threshold.
+ *  \param up true for events that exceed the threshold, false for
+ *         events that fall below it.
+ *  \return The index of the first point of each event within \e data.
+ */
+StfioDll std::vector<std::size_t> thresholdCrossings(const Vector_double& data, std::size_t begin, std::size_t end,
+                                                     double threshold, bool up = true);
+
 //! Computes the linear correlation between two arrays.
 /*! \param va1 First array.
  *  \param va2 Second array.
@@ -522,35 +1179,39 @@ stfnum::cubicSpline(const std::vector<T>& y,
     int size=(int)y.size();
     // size of interpolated data:
     int size_i=(int)(size*factor_i);
-    Vector_double x(size);
-    Vector_double y_d(size);
-    for (int n_p=0; n_p < size; ++n_p) {
-        x[n_p]=n_p;
-        y_d[n_p]=y[n_p];
+    if (size_i <= 0) {
+        return std::vector<T>(0);
     }
-    Vector_double y_i(stfnum::spline_cubic_set(x,y_d,0,0,0,0));
-
-    std::vector<T> y_if(size_i);
-    Vector_double x_i(size_i);
+    Vector_double y_d(y.begin(), y.end());
+    Vector_double ypp(size);
+    SplinePlan plan(size);
+    plan.Solve(&y_d[0], &ypp[0]);
 
     //Cubic spline interpolation:
-    for (int n_i=0; n_i < size_i; ++n_i) {
-        x_i[n_i]=(double)n_i * (double)size/(double)size_i;
-        double yp, ypp;
-        y_if[n_i]=(T)stfnum::spline_cubic_val(x,x_i[n_i],y_d,y_i,yp,ypp);
-    }
-    return y_if;
+    Vector_double y_i(size_i);
+    plan.Evaluate(&y_d[0], &ypp[0], 0.0, (double)size/(double)size_i, size_i, &y_i[0]);
+    return std::vector<T>(y_i.begin(), y_i.end());
 }
 
 template <class T>
 std::vector<T> stfnum::diff(const std::vector<T>& input, T x_scale) {
-    std::vector<T> diffVA(input.size()-1);
-    for (unsigned n=0;n<diffVA.size();++n) {
-        diffVA[n]=(input[n+1]-input[n])/x_scale;
+    if (input.size() < 2) {
+        return std::vector<T>(0);
     }
+    std::vector<T> diffVA(input.size()-1);
+    diff(&input[0], input.size(), x_scale, &diffVA[0]);
     return diffVA;
 }
 
+template <class T>
+void stfnum::diff(const T* input, std::size_t size, T x_scale, T* output) {
+    // output[n] is written after input[n] and input[n+1] have been read,
+    // so that this also works in place:
+    for (std::size_t n=0; n+1<size; ++n) {
+        output[n]=(input[n+1]-input[n])/x_scale;
+    }
+}
+
 template <typename T>
 inline T stfnum::SQR(T a) {return a*a;}
 
@@ -0,0 +1,147 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*! \file stfplugin.h
+ *  \brief The binary interface of native analysis plugins.
+ *
+ *  A plugin library is a shared library that exports a function named
+ *  stf_plugin_init (see STF_PLUGIN_ENTRY). The function returns a
+ *  description of the analyses that the library provides. Only plain C
+ *  types cross the interface, so that a plugin may be built with another
+ *  compiler or standard library than Stimfit. A plugin author only needs
+ *  this header:
+ *
+ *  \code
+ *  #include "stfplugin.h"
+ *
+ *  static int scale(const stf_span* in, size_t n_sections, double dt,
+ *                   const double* params, double* const* out, double* results,
+ *                   const stf_progress* progress, char* error, size_t error_size)
+ *  {
+ *      for (size_t n_s = 0; n_s < n_sections; ++n_s) {
+ *          for (size_t n = 0; n < in[n_s].size; ++n)
+ *              out[n_s][n] = params[0] * in[n_s].data[n];
+ *          if (!progress->update(progress->context, n_s+1))
+ *              return 0;
+ *      }
+ *      return 0;
+ *  }
+ *
+ *  static const char* labels[] = {"Factor"};
+ *  static const double defaults[] = {2.0};
+ *  static const stf_plugin plugins[] = {
+ *      {"Scale", "Multiplies traces by a factor", STF_PLUGIN_REENTRANT | STF_PLUGIN_TRANSFORMS,
+ *       1, labels, defaults, 0, NULL, scale}
+ *  };
+ *  static const stf_plugin_library library = {STF_PLUGIN_API_VERSION, 1, plugins};
+ *
+ *  STF_PLUGIN_EXPORT const stf_plugin_library* stf_plugin_init(void) { return &library; }
+ *  \endcode
+ */
+
+#ifndef _STFNUM_STFPLUGIN_H
+#define _STFNUM_STFPLUGIN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+/*! The version of the interface; incremented whenever it changes incompatibly. */
+#define STF_PLUGIN_API_VERSION 1
+
+/*! The name of the function that a plugin library exports. */
+#define STF_PLUGIN_ENTRY "stf_plugin_init"
+
+#ifdef _WIN32
+  #define STF_PLUGIN_EXPORT __declspec(dllexport)
+#else
+  #define STF_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/*! stf_plugin::run may be called from several threads at once with
+ *  different batches of sections. */
+#define STF_PLUGIN_REENTRANT 1u
+
+/*! stf_plugin::run writes a new trace for each section (see stf_plugin::run). */
+#define STF_PLUGIN_TRANSFORMS 2u
+
+/*! The data points of a section. */
+typedef struct stf_span {
+    const double* data; /*!< The first data point; valid during stf_plugin::run only. */
+    size_t size;        /*!< The number of data points. */
+} stf_span;
+
+/*! Progress reporting and cancellation. */
+typedef struct stf_progress {
+    void* context; /*!< To be passed to update(). */
+    /*! Reports the number of sections of the batch that have been analysed.
+     *  Returns 0 if the analysis has been cancelled; run() should then
+     *  return as soon as possible. */
+    int (*update)(void* context, size_t n_done);
+} stf_progress;
+
+/*! An analysis provided by a plugin library. */
+typedef struct stf_plugin {
+    const char* name;                 /*!< The menu entry. */
+    const char* description;          /*!< A longer description, e.g. for the status bar. */
+    unsigned flags;                   /*!< STF_PLUGIN_REENTRANT and STF_PLUGIN_TRANSFORMS. */
+    size_t n_params;                  /*!< The number of parameters that the user enters. */
+    const char* const* param_labels;  /*!< n_params labels for the parameter dialog. */
+    const double* param_defaults;     /*!< n_params default values. */
+    size_t n_results;                 /*!< The number of results per section. */
+    const char* const* result_labels; /*!< n_results column labels of the results table. */
+
+    /*! Analyses a batch of sections.
+     *  \param in The sections.
+     *  \param n_sections The number of sections in the batch.
+     *  \param dt The sampling interval in ms.
+     *  \param params n_params values entered by the user.
+     *  \param out If STF_PLUGIN_TRANSFORMS is set, out[n] has room for
+     *         in[n].size points of the new trace of section n; NULL otherwise.
+     *  \param results n_sections*n_results values; the results of section n
+     *         start at results[n*n_results]. Initialised to NaN.
+     *  \param progress Progress reporting.
+     *  \param error A buffer for an error message.
+     *  \param error_size The size of \e error, including the terminating 0.
+     *  \return 0 on success; otherwise, \e error describes the problem.
+     */
+    int (*run)(const stf_span* in, size_t n_sections, double dt, const double* params,
+               double* const* out, double* results, const stf_progress* progress,
+               char* error, size_t error_size);
+} stf_plugin;
+
+/*! The analyses of a plugin library. */
+typedef struct stf_plugin_library {
+    int api_version;           /*!< STF_PLUGIN_API_VERSION when the library was built. */
+    size_t n_plugins;          /*!< The number of analyses. */
+    const stf_plugin* plugins; /*!< The analyses. */
+} stf_plugin_library;
+
+/*! The type of the function that a plugin library exports. */
+typedef const stf_plugin_library* (*stf_plugin_entry)(void);
+
+/*@}*/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,521 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file tdfilter.cpp
+ *  \brief Time-domain IIR and FIR filters.
+ */
+
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./tdfilter.h"
+#include "../libstfio/profile.h"
+#include "../libstfio/parallel.h"
+
+namespace {
+
+    const double PI = 3.14159265358979323846;
+
+    typedef std::complex<double> complex_t;
+
+    // Poles of the analog Butterworth prototype with a cutoff of 1 rad/s:
+    std::vector<complex_t> butterworthPoles(int order) {
+        std::vector<complex_t> poles(order);
+        for (int k = 0; k < order; ++k) {
+            double theta = PI*(2*k+1+order)/(2.0*order);
+            poles[k] = complex_t(cos(theta), sin(theta));
+        }
+        return poles;
+    }
+
+    // Poles of the analog Bessel prototype, i.e. the roots of the reverse
+    // Bessel polynomial, found with the Durand-Kerner iteration:
+    std::vector<complex_t> besselPoles(int order) {
+        // coefficients a_k = (2n-k)! / (2^(n-k) k! (n-k)!), made monic:
+        Vector_double coeff(order+1);
+        for (int k = 0; k <= order; ++k) {
+            double c = 1.0;
+            for (int i = order-k+1; i <= 2*order-k; ++i) c *= i;
+            for (int i = 2; i <= k; ++i) c /= i;
+            coeff[k] = c / pow(2.0, order-k);
+        }
+        std::vector<complex_t> roots(order);
+        for (int k = 0; k < order; ++k) {
+            roots[k] = pow(complex_t(0.4, 0.9), k);
+        }
+        for (int n_iter = 0; n_iter < 500; ++n_iter) {
+            double change = 0;
+            for (int k = 0; k < order; ++k) {
+                complex_t p(1.0, 0.0);
+                for (int i = order-1; i >= 0; --i) {
+                    p = p*roots[k] + coeff[i]/coeff[order];
+                }
+                complex_t q(1.0, 0.0);
+                for (int j = 0; j < order; ++j) {
+                    if (j != k) q *= roots[k]-roots[j];
+                }
+                complex_t step = p/q;
+                roots[k] -= step;
+                change = std::max(change, std::abs(step));
+            }
+            if (change < 1e-14) break;
+        }
+        return roots;
+    }
+
+    // Gain of an analog all-pole lowpass with unit gain at 0 rad/s:
+    double analogGain(const std::vector<complex_t>& poles, double w) {
+        double gain = 1.0;
+        for (std::size_t k = 0; k < poles.size(); ++k) {
+            gain *= std::abs(poles[k]) / std::abs(complex_t(0, w) - poles[k]);
+        }
+        return gain;
+    }
+
+    // Finds the frequency where the gain of an all-pole lowpass has
+    // dropped to the given value; the gain falls monotonically:
+    double analogCutoff(const std::vector<complex_t>& poles, double gain) {
+        double lo = 1e-3, hi = 1e3;
+        for (int n_iter = 0; n_iter < 200; ++n_iter) {
+            double mid = sqrt(lo*hi);
+            if (analogGain(poles, mid) > gain) lo = mid; else hi = mid;
+        }
+        return sqrt(lo*hi);
+    }
+
+    struct FiltfiltWindowFilter {
+        explicit FiltfiltWindowFilter(const stfnum::BiquadCascade& filter_) : filter(filter_) {}
+        Vector_double operator()(const Vector_double& window) const {
+            return stfnum::filtfilt(filter, window);
+        }
+        stfnum::BiquadCascade filter;
+    };
+
+    // a[0]*b[0] + ... + a[n-1]*b[n-1], with independent partial sums:
+    inline double dot(const double* a, const double* b, std::size_t n) {
+        double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        std::size_t k = 0;
+        for (; k + 4 <= n; k += 4) {
+            s0 += a[k]*b[k];
+            s1 += a[k+1]*b[k+1];
+            s2 += a[k+2]*b[k+2];
+            s3 += a[k+3]*b[k+3];
+        }
+        for (; k < n; ++k) {
+            s0 += a[k]*b[k];
+        }
+        return (s0+s1) + (s2+s3);
+    }
+
+    std::size_t gcd(std::size_t a, std::size_t b) {
+        while (b != 0) {
+            std::size_t r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+}
+
+std::complex<double> stfnum::Biquad::Response(double f, double SR) const {
+    complex_t z1 = std::polar(1.0, -2.0*PI*f/SR);
+    complex_t z2 = z1*z1;
+    return (b0 + b1*z1 + b2*z2) / (1.0 + a1*z1 + a2*z2);
+}
+
+stfnum::BiquadCascade::BiquadCascade()
+    : sections(1), state(2, 0.0)
+{}
+
+stfnum::BiquadCascade::BiquadCascade(const std::vector<Biquad>& sections_)
+    : sections(sections_), state(2*sections_.size(), 0.0)
+{}
+
+Vector_double stfnum::BiquadCascade::Process(const Vector_double& chunk) {
+    Vector_double output(chunk);
+    if (!output.empty()) {
+        Process(&output[0], output.size());
+    }
+    return output;
+}
+
+void stfnum::BiquadCascade::Process(double* data, std::size_t n) {
+    // one section at a time, so that its coefficients stay in registers:
+    for (std::size_t n_s = 0; n_s < sections.size(); ++n_s) {
+        const Biquad& s = sections[n_s];
+        double z1 = state[2*n_s], z2 = state[2*n_s+1];
+        for (std::size_t i = 0; i < n; ++i) {
+            double x = data[i];
+            double y = s.b0*x + z1;
+            z1 = s.b1*x - s.a1*y + z2;
+            z2 = s.b2*x - s.a2*y;
+            data[i] = y;
+        }
+        state[2*n_s] = z1;
+        state[2*n_s+1] = z2;
+    }
+}
+
+void stfnum::BiquadCascade::SetSteadyState(double x) {
+    for (std::size_t n_s = 0; n_s < sections.size(); ++n_s) {
+        const Biquad& s = sections[n_s];
+        double y = x*(s.b0+s.b1+s.b2) / (1.0+s.a1+s.a2);
+        state[2*n_s+1] = s.b2*x - s.a2*y;
+        state[2*n_s] = s.b1*x - s.a1*y + state[2*n_s+1];
+        // the output of this section is the input of the next one:
+        x = y;
+    }
+}
+
+void stfnum::BiquadCascade::Reset() {
+    std::fill(state.begin(), state.end(), 0.0);
+}
+
+std::complex<double> stfnum::BiquadCascade::Response(double f, double SR) const {
+    complex_t response(1.0, 0.0);
+    for (std::size_t n_s = 0; n_s < sections.size(); ++n_s) {
+        response *= sections[n_s].Response(f, SR);
+    }
+    return response;
+}
+
+stfnum::BiquadCascade
+stfnum::designIIR(iir_type type, int order, double cutoff, double SR,
+                  bool highpass, bool zeroPhase)
+{
+    if (order < 1 || order > 10) {
+        throw std::out_of_range("Filter order out of range in stfnum::designIIR()");
+    }
+    if (SR <= 0 || cutoff <= 0 || cutoff >= SR/2.0) {
+        throw std::out_of_range("Cutoff frequency out of range in stfnum::designIIR()");
+    }
+    std::vector<complex_t> poles = (type == iir_bessel) ? besselPoles(order) : butterworthPoles(order);
+
+    // normalise to the attenuation at 1 rad/s; a highpass is the mirror
+    // image of the lowpass on a logarithmic frequency axis:
+    double gain = zeroPhase ? pow(0.5, 0.25) : sqrt(0.5);
+    double w_c = analogCutoff(poles, gain);
+    for (int k = 0; k < order; ++k) {
+        poles[k] /= w_c;
+    }
+
+    // prewarped analog cutoff in rad/ms:
+    double fs2 = 2.0*SR;
+    double w_a = fs2*tan(PI*cutoff/SR);
+
+    std::vector<Biquad> sections;
+    for (int k = 0; k < order; ++k) {
+        if (poles[k].imag() < -1e-12) {
+            // the conjugate is combined with its partner:
+            continue;
+        }
+        complex_t s = highpass ? w_a/poles[k] : w_a*poles[k];
+        complex_t z = (fs2 + s) / (fs2 - s);
+        Biquad bq;
+        double sign = highpass ? -1.0 : 1.0;
+        if (poles[k].imag() > 1e-12) {
+            bq.a1 = -2.0*z.real();
+            bq.a2 = std::norm(z);
+            // unit gain at 0 Hz for a lowpass, at the Nyquist frequency for a highpass:
+            double g = (1.0 + sign*bq.a1 + bq.a2) / 4.0;
+            bq.b0 = g;
+            bq.b1 = sign*2.0*g;
+            bq.b2 = g;
+        } else {
+            bq.a1 = -z.real();
+            double g = (1.0 + sign*bq.a1) / 2.0;
+            bq.b0 = g;
+            bq.b1 = sign*g;
+        }
+        sections.push_back(bq);
+    }
+    return BiquadCascade(sections);
+}
+
+Vector_double stfnum::filtfilt(const BiquadCascade& filter, const Vector_double& data) {
+    STF_PROFILE_SCOPE("stfnum/filtfilt");
+    std::size_t n = data.size();
+    if (n < 2) {
+        return data;
+    }
+    // extend by point reflection at the first and last samples:
+    std::size_t pad = std::min(n-1, (std::size_t)(6*filter.GetSections().size() + 3));
+    Vector_double ext(n + 2*pad);
+    for (std::size_t i = 0; i < pad; ++i) {
+        ext[i] = 2.0*data[0] - data[pad-i];
+        ext[n+pad+i] = 2.0*data[n-1] - data[n-2-i];
+    }
+    std::copy(data.begin(), data.end(), ext.begin()+pad);
+
+    BiquadCascade forward(filter);
+    forward.SetSteadyState(ext[0]);
+    forward.Process(&ext[0], ext.size());
+    std::reverse(ext.begin(), ext.end());
+    BiquadCascade backward(filter);
+    backward.SetSteadyState(ext[0]);
+    backward.Process(&ext[0], ext.size());
+    std::reverse(ext.begin(), ext.end());
+
+    return Vector_double(ext.begin()+pad, ext.begin()+pad+n);
+}
+
+stfnum::WindowFilter stfnum::filtfiltWindowFilter(const BiquadCascade& filter) {
+    return WindowFilter(FiltfiltWindowFilter(filter));
+}
+
+Vector_double stfnum::designFIR(std::size_t n_taps, double cutoff, double SR) {
+    if (SR <= 0 || cutoff <= 0 || cutoff >= SR/2.0) {
+        throw std::out_of_range("Cutoff frequency out of range in stfnum::designFIR()");
+    }
+    n_taps |= 1;
+    Vector_double taps(n_taps);
+    double centre = (n_taps-1)/2.0;
+    double fc = cutoff/SR;
+    // computed for the first half and mirrored, so that the taps are exactly symmetric:
+    for (std::size_t k = 0; 2*k < n_taps; ++k) {
+        double t = k - centre;
+        double sinc = (t == 0) ? 2.0*fc : sin(2.0*PI*fc*t)/(PI*t);
+        double window = (n_taps == 1) ? 1.0 :
+            0.42 - 0.5*cos(2.0*PI*k/(n_taps-1)) + 0.08*cos(4.0*PI*k/(n_taps-1));
+        taps[k] = taps[n_taps-1-k] = sinc*window;
+    }
+    double sum = 0;
+    for (std::size_t k = 0; k < n_taps; ++k) {
+        sum += taps[k];
+    }
+    for (std::size_t k = 0; k < n_taps; ++k) {
+        taps[k] /= sum;
+    }
+    return taps;
+}
+
+stfnum::FIRFilter::FIRFilter(const Vector_double& taps, std::size_t decimation_)
+    : reversed(taps.rbegin(), taps.rend()), decimation(decimation_), history(0),
+      n_in(0), started(false)
+{
+    if (taps.empty()) {
+        throw std::out_of_range("No filter coefficients in stfnum::FIRFilter");
+    }
+    if (decimation == 0) {
+        throw std::out_of_range("Invalid decimation factor in stfnum::FIRFilter");
+    }
+}
+
+Vector_double stfnum::FIRFilter::Process(const Vector_double& chunk) {
+    STF_PROFILE_SCOPE("stfnum/FIRFilter");
+    if (chunk.empty()) {
+        return Vector_double(0);
+    }
+    std::size_t n_hist = reversed.size()-1;
+    if (!started) {
+        history.assign(n_hist, chunk[0]);
+        started = true;
+    }
+    // the history followed by the chunk, so that every window is contiguous:
+    stfio::Vector_aligned work(n_hist + chunk.size());
+    std::copy(history.begin(), history.end(), work.begin());
+    std::copy(chunk.begin(), chunk.end(), work.begin()+n_hist);
+
+    // the first input of this chunk that is due for an output:
+    std::size_t first = (decimation - n_in%decimation) % decimation;
+    Vector_double output;
+    if (first < chunk.size()) {
+        output.resize((chunk.size()-first + decimation-1) / decimation);
+    }
+    for (std::size_t n_o = 0; n_o < output.size(); ++n_o) {
+        output[n_o] = dot(&reversed[0], &work[first + n_o*decimation], reversed.size());
+    }
+    std::copy(work.end()-n_hist, work.end(), history.begin());
+    n_in += chunk.size();
+    return output;
+}
+
+void stfnum::FIRFilter::Reset() {
+    history.clear();
+    n_in = 0;
+    started = false;
+}
+
+Vector_double stfnum::firFilter(const Vector_double& taps, const Vector_double& data,
+                                std::size_t decimation, int n_threads)
+{
+    STF_PROFILE_SCOPE("stfnum/firFilter");
+    if (taps.empty()) {
+        throw std::out_of_range("No filter coefficients in stfnum::firFilter()");
+    }
+    if (decimation == 0) {
+        throw std::out_of_range("Invalid decimation factor in stfnum::firFilter()");
+    }
+    if (data.empty()) {
+        return Vector_double(0);
+    }
+    std::size_t n_taps = taps.size();
+    std::size_t half = (n_taps-1)/2;
+    stfio::Vector_aligned reversed(taps.rbegin(), taps.rend());
+    // extend by the edge values:
+    stfio::Vector_aligned ext(data.size() + n_taps-1);
+    std::fill(ext.begin(), ext.begin()+half, data.front());
+    std::copy(data.begin(), data.end(), ext.begin()+half);
+    std::fill(ext.begin()+half+data.size(), ext.end(), data.back());
+
+    // output m uses ext[m*decimation + n_taps-1 - k] for taps[k]:
+    int n_out = (int)((data.size() + decimation-1) / decimation);
+    Vector_double output(n_out);
+#ifdef _OPENMP
+    // don't start threads for a few thousand products:
+    if ((std::size_t)n_out*n_taps < 1000000) {
+        n_threads = 1;
+    }
+    n_threads = stfio::threadCount(n_threads, n_out);
+#pragma omp parallel for schedule(static) num_threads(n_threads)
+#endif
+    for (int n_o = 0; n_o < n_out; ++n_o) {
+        output[n_o] = dot(&reversed[0], &ext[n_o*decimation], n_taps);
+    }
+    return output;
+}
+
+Vector_double stfnum::resample(const Vector_double& data, std::size_t up, std::size_t down,
+                               std::size_t half_width, int n_threads)
+{
+    STF_PROFILE_SCOPE("stfnum/resample");
+    if (up == 0 || down == 0 || half_width == 0) {
+        throw std::out_of_range("Invalid resampling factor in stfnum::resample()");
+    }
+    std::size_t g = gcd(up, down);
+    up /= g;
+    down /= g;
+    if (up == 1 && down == 1) {
+        return data;
+    }
+    if (data.empty()) {
+        return Vector_double(0);
+    }
+    // the filter runs at the upsampled rate, here taken to be up:
+    std::size_t m = std::max(up, down);
+    std::size_t centre = half_width*m;
+    Vector_double taps = designFIR(2*centre+1, 0.45*up/m, (double)up);
+
+    // taps of phase r meet inputs n0, n0-1, ...; stored in reverse order
+    // and scaled by up, so that each output is a plain dot product:
+    std::size_t n_phase_taps = (taps.size() + up-1) / up;
+    stfio::Vector_aligned phases(up*n_phase_taps, 0.0);
+    for (std::size_t r = 0; r < up; ++r) {
+        for (std::size_t j = 0; j < n_phase_taps; ++j) {
+            std::size_t k = r + (n_phase_taps-1-j)*up;
+            if (k < taps.size()) {
+                phases[r*n_phase_taps+j] = up*taps[k];
+            }
+        }
+    }
+
+    // extend by the edge values:
+    std::size_t n = data.size();
+    std::size_t pad = n_phase_taps + centre/up + 1;
+    stfio::Vector_aligned ext(n + 2*pad);
+    std::fill(ext.begin(), ext.begin()+pad, data.front());
+    std::copy(data.begin(), data.end(), ext.begin()+pad);
+    std::fill(ext.begin()+pad+n, ext.end(), data.back());
+
+    int n_out = (int)((n*up + down-1) / down);
+    Vector_double output(n_out);
+#ifdef _OPENMP
+    if ((std::size_t)n_out*n_phase_taps < 1000000) {
+        n_threads = 1;
+    }
+    n_threads = stfio::threadCount(n_threads, n_out);
+#pragma omp parallel for schedule(static) num_threads(n_threads)
+#endif
+    for (int n_o = 0; n_o < n_out; ++n_o) {
+        std::size_t t = (std::size_t)n_o*down + centre;
+        std::size_t r = t % up;
+        std::size_t n0 = t / up;
+        output[n_o] = dot(&phases[r*n_phase_taps], &ext[pad + n0 - (n_phase_taps-1)], n_phase_taps);
+    }
+    return output;
+}
+
+Channel stfnum::batchResample(const Channel& ch, std::size_t up, std::size_t down,
+                              stfio::ProgressInfo& progDlg, int n_threads)
+{
+    STF_PROFILE_SCOPE("stfnum/batchResample");
+    if (up == 0 || down == 0) {
+        throw std::out_of_range("Invalid resampling factor in stfnum::batchResample()");
+    }
+    int n_sections = (int)ch.size();
+    Channel resampled(ch.size());
+    resampled.SetChannelName(ch.GetChannelName());
+    resampled.SetYUnits(ch.GetYUnits());
+    if (n_sections == 0) {
+        return resampled;
+    }
+
+    std::string error;
+    bool cancelled = false;
+    int n_done = 0;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_sections);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_s = 0; n_s < n_sections; ++n_s) {
+        bool skip = false;
+#ifdef _OPENMP
+#pragma omp critical(stfnum_resample_progress)
+#endif
+        skip = cancelled || !error.empty();
+        if (skip) {
+            continue;
+        }
+        const Section& sec = ch[n_s];
+        try {
+            Vector_double samples(sec.size());
+            if (!samples.empty()) {
+                sec.CopyRange(0, samples.size(), &samples[0]);
+            }
+            Section result(resample(samples, up, down, 10, 1));
+            result.SetXScale(sec.GetXScale()*down/up);
+            result.SetSectionDescription(sec.GetSectionDescription());
+            resampled.InsertSection(STFIO_MOVE(result), n_s);
+        }
+        catch (const std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_resample_progress)
+#endif
+            if (error.empty()) error = e.what();
+        }
+#ifdef _OPENMP
+#pragma omp critical(stfnum_resample_progress)
+#endif
+        {
+            ++n_done;
+            std::ostringstream msg;
+            msg << "Section " << n_done << " of " << n_sections;
+            if (!cancelled && !progDlg.Update((int)(100.0*n_done/n_sections), msg.str())) {
+                cancelled = true;
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    if (cancelled) {
+        return Channel();
+    }
+    return resampled;
+}
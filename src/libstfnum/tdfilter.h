@@ -0,0 +1,280 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file tdfilter.h
+ *  \brief Time-domain IIR and FIR filters.
+ *
+ *  Unlike stfnum::filter(), which transforms a whole window at once, these
+ *  filters process the data sample by sample. They take O(N) operations
+ *  for any length of data, can be applied to a data stream chunk by chunk
+ *  and don't need the data to be periodic within the window.
+ */
+
+#ifndef _STFNUM_TDFILTER_H
+#define _STFNUM_TDFILTER_H
+
+#include <vector>
+#include <complex>
+
+#include "../libstfio/stfio.h"
+#include "../libstfio/aligned.h"
+#include "./stfnum.h"
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Analog prototypes of IIR filters.
+enum iir_type {
+    iir_bessel = 0,      /*!< Bessel filter; maximally flat group delay, hence little overshoot. */
+    iir_butterworth = 1  /*!< Butterworth filter; maximally flat pass band. */
+};
+
+//! A second-order section of an IIR filter.
+/*! Implements y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2].
+ *  First-order sections have b2 = a2 = 0.
+ */
+struct StfioDll Biquad {
+    //! Constructor for a section that passes the data unchanged.
+    Biquad() : b0(1.0), b1(0), b2(0), a1(0), a2(0) {}
+
+    //! Computes the complex frequency response.
+    /*! \param f The frequency in kHz.
+     *  \param SR The sampling rate in kHz.
+     *  \return The response at \e f.
+     */
+    std::complex<double> Response(double f, double SR) const;
+
+    double b0, b1, b2; /*!< Coefficients of the numerator. */
+    double a1, a2;     /*!< Coefficients of the denominator; a0 is 1. */
+};
+
+//! A cascade of second-order sections with its filter state.
+/*! Sections are evaluated in transposed direct form II, which is
+ *  numerically robust for the orders used here. The state is kept between
+ *  calls to Process(), so that a data stream can be filtered chunk by chunk
+ *  with the same result as at once. Objects aren't thread-safe; copy them
+ *  to filter in several threads.
+ */
+class StfioDll BiquadCascade {
+public:
+    //! Constructor for a filter that passes the data unchanged.
+    BiquadCascade();
+
+    //! Constructor
+    /*! \param sections_ The second-order sections in the order in which they're applied.
+     */
+    explicit BiquadCascade(const std::vector<Biquad>& sections_);
+
+    //! Filters the next chunk of a data stream.
+    /*! \param chunk The next samples of the stream.
+     *  \return The filtered samples; as many as \e chunk has.
+     */
+    Vector_double Process(const Vector_double& chunk);
+
+    //! Filters the next samples of a data stream in place.
+    /*! \param data The samples; replaced by the filtered samples.
+     *  \param n Number of samples.
+     */
+    void Process(double* data, std::size_t n);
+
+    //! Sets the filter state to that of a constant input.
+    /*! Avoids the transient while the filter settles at the start of the data.
+     *  \param x The constant input level, usually the first sample.
+     */
+    void SetSteadyState(double x);
+
+    //! Clears the filter state, as if all previous samples had been 0.
+    void Reset();
+
+    //! Computes the complex frequency response of the cascade.
+    /*! \param f The frequency in kHz.
+     *  \param SR The sampling rate in kHz.
+     *  \return The response at \e f.
+     */
+    std::complex<double> Response(double f, double SR) const;
+
+    //! Retrieves the second-order sections.
+    /*! \return The sections in the order in which they're applied.
+     */
+    const std::vector<Biquad>& GetSections() const { return sections; }
+
+private:
+    std::vector<Biquad> sections;
+    // two delay elements per section:
+    Vector_double state;
+};
+
+//! Designs an IIR lowpass or highpass filter.
+/*! The analog prototype is mapped to the digital domain with the bilinear
+ *  transform, prewarped so that the attenuation at the cutoff frequency is
+ *  exact. Bessel filters are normalised to -3 dB at the cutoff rather than
+ *  to a unit group delay, like stfnum::fbessel4.
+ *  Throws std::out_of_range if the order is not within 1 to 10 or if the
+ *  cutoff isn't below the Nyquist frequency.
+ *  \param type The analog prototype.
+ *  \param order Order of the filter; odd orders give a first-order section.
+ *  \param cutoff Cutoff frequency in kHz.
+ *  \param SR Sampling rate in kHz.
+ *  \param highpass true for a highpass, false for a lowpass filter.
+ *  \param zeroPhase true if the filter will be applied forward and backward
+ *         with stfnum::filtfilt(). The cutoff is then moved so that the
+ *         combined response is -3 dB at \e cutoff.
+ *  \return The filter, with a cleared state.
+ */
+StfioDll BiquadCascade
+designIIR(iir_type type, int order, double cutoff, double SR,
+          bool highpass = false, bool zeroPhase = false);
+
+//! Applies an IIR filter forward and backward.
+/*! The result has no phase shift, and its magnitude response is the square
+ *  of that of \e filter. The ends of the data are extended by point
+ *  reflection, and the filter starts from its steady state, so that
+ *  transients at the edges are small.
+ *  \param filter The filter; its state is left unchanged.
+ *  \param data The data.
+ *  \return The filtered data; as many samples as \e data has.
+ */
+StfioDll Vector_double filtfilt(const BiquadCascade& filter, const Vector_double& data);
+
+//! Wraps stfnum::filtfilt() for stfnum::batchFilter().
+/*! \param filter The filter; it is copied.
+ *  \return A function that applies \e filter forward and backward to a window.
+ */
+StfioDll WindowFilter filtfiltWindowFilter(const BiquadCascade& filter);
+
+//! Designs a linear-phase FIR lowpass filter.
+/*! Computes a sinc function tapered with a Blackman window, normalised to
+ *  unit gain at 0 Hz.
+ *  Throws std::out_of_range if the cutoff isn't below the Nyquist frequency.
+ *  \param n_taps Number of coefficients; an even number is increased by one,
+ *         so that the delay is a whole number of samples.
+ *  \param cutoff Frequency in kHz where the gain has dropped to one half.
+ *  \param SR Sampling rate in kHz.
+ *  \return The coefficients.
+ */
+StfioDll Vector_double designFIR(std::size_t n_taps, double cutoff, double SR);
+
+//! An FIR filter that optionally decimates its output.
+/*! Only every decimation-th output sample is computed, which is as fast as
+ *  a polyphase filter bank. The inner products run over contiguous,
+ *  aligned buffers with independent partial sums, so that the compiler can
+ *  vectorise them. The filter is causal; output sample m corresponds to
+ *  input sample m*decimation - GetDelay(). Objects aren't thread-safe.
+ */
+class StfioDll FIRFilter {
+public:
+    //! Constructor
+    /*! Throws std::out_of_range if \e taps is empty or \e decimation is 0.
+     *  \param taps The coefficients.
+     *  \param decimation_ Only every decimation-th output sample is returned.
+     */
+    FIRFilter(const Vector_double& taps, std::size_t decimation_ = 1);
+
+    //! Filters the next chunk of a data stream.
+    /*! Before the first chunk, all previous samples are assumed to be equal
+     *  to the first sample of the stream.
+     *  \param chunk The next samples of the stream.
+     *  \return The filtered samples that are due; in total, one for every
+     *          decimation-th input sample, starting with the first.
+     */
+    Vector_double Process(const Vector_double& chunk);
+
+    //! Discards all buffered data so that a new stream can be processed.
+    void Reset();
+
+    //! Retrieves the delay of the filter.
+    /*! \return The delay in input samples, (number of coefficients - 1)/2
+     *          for the symmetric filters of stfnum::designFIR().
+     */
+    std::size_t GetDelay() const { return (reversed.size()-1)/2; }
+
+    //! Retrieves the decimation factor.
+    /*! \return The decimation factor that was passed to the constructor.
+     */
+    std::size_t GetDecimation() const { return decimation; }
+
+private:
+    // the coefficients in reverse order, so that each output is a plain dot product:
+    stfio::Vector_aligned reversed;
+    std::size_t decimation;
+    // the last reversed.size()-1 input samples:
+    stfio::Vector_aligned history;
+    std::size_t n_in;
+    bool started;
+};
+
+//! Applies an FIR filter without delay.
+/*! Output sample m is centred on input sample m*decimation. The ends of
+ *  the data are extended with the first and last samples. Output samples
+ *  are computed in parallel.
+ *  Throws std::out_of_range if \e taps is empty or \e decimation is 0.
+ *  \param taps The coefficients; their centre is at (taps.size()-1)/2.
+ *  \param data The data.
+ *  \param decimation Only every decimation-th output sample is computed.
+ *  \param n_threads Number of threads; 0 uses the configured number of threads.
+ *  \return The filtered data; (data.size()+decimation-1)/decimation samples.
+ */
+StfioDll Vector_double
+firFilter(const Vector_double& taps, const Vector_double& data,
+          std::size_t decimation = 1, int n_threads = 0);
+
+//! Resamples data by a rational factor with an anti-aliasing filter.
+/*! The data are conceptually upsampled by inserting up-1 zeros after every
+ *  sample, lowpass filtered below the lower of the two Nyquist frequencies
+ *  and decimated by \e down. Only the taps that meet non-zero samples are
+ *  evaluated (a polyphase filter), so that each output sample takes
+ *  2*half_width*max(up,down)/up products. The filter is a windowed sinc
+ *  from stfnum::designFIR() with its half-amplitude point at 90% of that
+ *  Nyquist frequency; it has no delay, and the ends of the data are
+ *  extended with the first and last samples. Output samples are computed
+ *  in parallel. Common factors of \e up and \e down are cancelled.
+ *  Throws std::out_of_range if \e up, \e down or \e half_width is 0.
+ *  \param data The data.
+ *  \param up The upsampling factor.
+ *  \param down The downsampling factor.
+ *  \param half_width Length of the filter on either side of its centre,
+ *         in periods of the lower Nyquist frequency.
+ *  \param n_threads Number of threads; 0 uses the configured number of threads.
+ *  \return The resampled data; output sample m corresponds to input sample
+ *          m*down/up, and there are ceil(data.size()*up/down) samples.
+ */
+StfioDll Vector_double
+resample(const Vector_double& data, std::size_t up, std::size_t down,
+         std::size_t half_width = 10, int n_threads = 0);
+
+//! Resamples all sections of a channel.
+/*! Sections are resampled in parallel with stfnum::resample(). Compactly
+ *  stored sections are decoded one at a time.
+ *  Throws std::out_of_range if \e up or \e down is 0.
+ *  \param ch The channel.
+ *  \param up, down See stfnum::resample().
+ *  \param progDlg Progress indicator; updated once per section from within a
+ *         critical section, so that it needn't be thread-safe.
+ *  \param n_threads Number of sections that are resampled in parallel;
+ *         0 uses the configured number of threads.
+ *  \return A channel with the resampled sections, whose x scales are
+ *          multiplied by down/up; empty if the operation has been cancelled.
+ */
+StfioDll Channel
+batchResample(const Channel& ch, std::size_t up, std::size_t down,
+              stfio::ProgressInfo& progDlg, int n_threads = 0);
+
+/*@}*/
+
+}
+
+#endif
@@ -0,0 +1,214 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "./train.h"
+#include "../libstfio/recording.h"
+#include "../libstfio/parallel.h"
+
+namespace {
+
+// Baseline at time t on the decay of the previous response. The decay is
+// fitted with an exponential towards base0 in the window [begin, end];
+// returns NaN if it doesn't decay.
+double extrapolatedBase(const Section& sec, std::size_t begin, std::size_t end,
+                        double base0, double sign, double t)
+{
+    Vector_double tail(end-begin+1);
+    sec.CopyRange(begin, end+1, &tail[0]);
+    Vector_double x, y;
+    for (std::size_t n = 0; n < tail.size(); ++n) {
+        double distance = sign*(tail[n]-base0);
+        if (distance > 0) {
+            x.push_back((double)n);
+            y.push_back(log(distance));
+        }
+    }
+    if (x.size() < 2 || 2*x.size() < tail.size()) {
+        return NAN;
+    }
+    stfnum::LinRegression decay = stfnum::linRegress(x, y);
+    if (!(decay.slope < 0)) {
+        return NAN;
+    }
+    return base0 + sign*exp(decay.intercept + decay.slope*(t-(double)begin));
+}
+
+}
+
+void stfnum::TrainTable::append(const TrainTable& other) {
+    channel.insert(channel.end(), other.channel.begin(), other.channel.end());
+    section.insert(section.end(), other.section.begin(), other.section.end());
+    pulse.insert(pulse.end(), other.pulse.begin(), other.pulse.end());
+    onset.insert(onset.end(), other.onset.begin(), other.onset.end());
+    base.insert(base.end(), other.base.begin(), other.base.end());
+    peak.insert(peak.end(), other.peak.begin(), other.peak.end());
+    peakIndex.insert(peakIndex.end(), other.peakIndex.begin(), other.peakIndex.end());
+    amplitude.insert(amplitude.end(), other.amplitude.begin(), other.amplitude.end());
+    latency.insert(latency.end(), other.latency.begin(), other.latency.end());
+    ratio.insert(ratio.end(), other.ratio.begin(), other.ratio.end());
+}
+
+stfnum::Table stfnum::TrainTable::ToTable(double dt) const {
+    Table table(size(), 7);
+    table.SetColLabel(0, "Channel");
+    table.SetColLabel(1, "Section");
+    table.SetColLabel(2, "Pulse");
+    table.SetColLabel(3, "Base");
+    table.SetColLabel(4, "Amplitude");
+    table.SetColLabel(5, "Latency");
+    table.SetColLabel(6, "Ratio to pulse 1");
+    for (std::size_t n = 0; n < size(); ++n) {
+        std::ostringstream label;
+        label << "Pulse #" << n+1;
+        table.SetRowLabel(n, label.str());
+        table.at(n, 0) = (double)channel[n]+1;
+        table.at(n, 1) = (double)section[n]+1;
+        table.at(n, 2) = (double)pulse[n]+1;
+        table.at(n, 3) = base[n];
+        table.at(n, 4) = amplitude[n];
+        table.at(n, 5) = latency[n]*dt;
+        table.at(n, 6) = ratio[n];
+    }
+    return table;
+}
+
+stfnum::TrainPlan::TrainPlan() :
+    n_pulses(2), onset(0), interval(0), baseLength(100), peakDelay(0),
+    baselineMode(train_baseline_extrapolated), latencyMode(half_latency), measurement()
+{
+    measurement.measurements = measure_peak | measure_latency;
+}
+
+stfnum::MultiWindowPlan stfnum::TrainPlan::Windows(std::size_t size) const {
+    long first = lround(onset);
+    long length = (long)std::max<std::size_t>(baseLength, 1);
+    if (first < length || first >= (long)size) {
+        throw std::out_of_range("Baseline before the first pulse out of range in stfnum::TrainPlan::Windows()");
+    }
+    MultiWindowPlan windows;
+    for (std::size_t n_p = 0; n_p < n_pulses; ++n_p) {
+        long start = lround(onset + n_p*interval);
+        // the window of a pulse ends before the next one:
+        long end = (n_p+1 < n_pulses || interval >= 1) ?
+            lround(onset + (n_p+1)*interval) - 1 : (long)size-1;
+        end = std::min(end, (long)size-1);
+        long peakBeg = start + (long)peakDelay;
+        if (peakBeg > end) {
+            std::ostringstream error;
+            error << "Pulse " << n_p+1 << " out of range in stfnum::TrainPlan::Windows()";
+            throw std::out_of_range(error.str());
+        }
+        MeasurementPlan plan(measurement);
+        long baseStart = (baselineMode == train_baseline_first || n_p == 0) ? first : start;
+        plan.baseBeg = (std::size_t)(baseStart - length);
+        plan.baseEnd = (std::size_t)(baseStart - 1);
+        plan.peakBeg = (std::size_t)peakBeg;
+        plan.peakEnd = (std::size_t)end;
+        plan.measurements |= measure_peak | measure_latency;
+        plan.latencyStartMode = manual_latency;
+        plan.latencyBeg = (double)start;
+        plan.latencyEndMode = latencyMode;
+        std::ostringstream name;
+        name << "Pulse " << n_p+1;
+        windows.Add(name.str(), plan);
+    }
+    return windows;
+}
+
+stfnum::TrainTable stfnum::TrainPlan::Analyse(const Section& sec, double dt, std::size_t n_channel,
+                                              std::size_t n_section) const
+{
+    MultiWindowPlan windows = Windows(sec.size());
+    std::vector<MeasurementResults> res = windows.Evaluate(sec, dt);
+
+    TrainTable table;
+    for (std::size_t n_p = 0; n_p < res.size(); ++n_p) {
+        const MeasurementPlan& plan = windows.windows[n_p].plan;
+        double base = res[n_p].base;
+        if (baselineMode == train_baseline_extrapolated && n_p > 0) {
+            // the previous response decays towards the baseline before the train:
+            double sign = (table.amplitude[n_p-1] < 0) ? -1.0 : 1.0;
+            double decay = extrapolatedBase(sec, plan.baseBeg, plan.baseEnd, res[0].base,
+                                            sign, res[n_p].maxT);
+            if (!std::isnan(decay)) {
+                base = decay;
+            }
+        }
+        table.channel.push_back(n_channel);
+        table.section.push_back(n_section);
+        table.pulse.push_back(n_p);
+        table.onset.push_back(plan.latencyBeg);
+        table.base.push_back(base);
+        table.peak.push_back(res[n_p].peak);
+        table.peakIndex.push_back(res[n_p].maxT);
+        table.amplitude.push_back(res[n_p].peak - base);
+        table.latency.push_back(res[n_p].latency);
+    }
+    for (std::size_t n_p = 0; n_p < table.size(); ++n_p) {
+        table.ratio.push_back(table.amplitude[0] != 0 ? table.amplitude[n_p]/table.amplitude[0] : NAN);
+    }
+    return table;
+}
+
+stfnum::TrainTable stfnum::TrainPlan::Analyse(const Recording& rec, const std::vector<std::size_t>& channels,
+                                              int n_threads) const
+{
+    // every section of every channel is a job of its own:
+    std::vector<std::size_t> jobChannels, jobSections;
+    for (std::size_t n_c = 0; n_c < channels.size(); ++n_c) {
+        if (channels[n_c] >= rec.size()) {
+            throw std::out_of_range("Channel index out of range in stfnum::TrainPlan::Analyse()");
+        }
+        for (std::size_t n_s = 0; n_s < rec[channels[n_c]].size(); ++n_s) {
+            jobChannels.push_back(channels[n_c]);
+            jobSections.push_back(n_s);
+        }
+    }
+    int n_jobs = (int)jobSections.size();
+    std::vector<TrainTable> tables(n_jobs);
+    std::string error;
+    double dt = rec.GetXScale();
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_jobs);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_j = 0; n_j < n_jobs; ++n_j) {
+        try {
+            tables[n_j] = Analyse(rec[jobChannels[n_j]][jobSections[n_j]], dt,
+                                  jobChannels[n_j], jobSections[n_j]);
+        }
+        catch (const std::out_of_range& e) {
+#ifdef _OPENMP
+#pragma omp critical(stfnum_train_error)
+#endif
+            if (error.empty()) error = e.what();
+        }
+    }
+    if (!error.empty()) {
+        throw std::out_of_range(error);
+    }
+    TrainTable table;
+    for (int n_j = 0; n_j < n_jobs; ++n_j) {
+        table.append(tables[n_j]);
+    }
+    return table;
+}
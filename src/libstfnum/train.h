@@ -0,0 +1,141 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file train.h
+ *  \brief Responses to paired pulses and stimulus trains in many sections at once.
+ *
+ *  Each pulse of a train is measured in its own window of a
+ *  stfnum::MultiWindowPlan, from the pulse onset to the next pulse. When
+ *  responses overlap, the response to a pulse starts on the decay of the
+ *  previous one; its amplitude is then measured from the extrapolated
+ *  decay rather than from the baseline before the train.
+ */
+
+#ifndef _STFNUM_TRAIN_H
+#define _STFNUM_TRAIN_H
+
+#include <vector>
+
+#include "../libstfio/stfio.h"
+#include "./stfnum.h"
+#include "./measure.h"
+
+class Section;
+class Recording;
+
+namespace stfnum {
+
+/*! \addtogroup stfgen
+ *  @{
+ */
+
+//! Baselines of the pulses of a train.
+enum train_baseline {
+    train_baseline_first = 0,       /*!< All pulses are measured from the baseline before the first pulse. */
+    train_baseline_local = 1,       /*!< Each pulse is measured from the points just before it. */
+    train_baseline_extrapolated = 2 /*!< Each pulse is measured from the decay of the previous response,
+                                         extrapolated with an exponential to the time of the peak. */
+};
+
+//! Results of stfnum::TrainPlan::Analyse().
+/*! Row n describes a single pulse; rows are sorted by channel, section
+ *  and pulse. Time points are given in sampling points within the section.
+ */
+struct StfioDll TrainTable {
+    std::vector<std::size_t> channel; /*!< Index of the channel within the recording. */
+    std::vector<std::size_t> section; /*!< Index of the section within the channel. */
+    std::vector<std::size_t> pulse;   /*!< Index of the pulse within the train. */
+    std::vector<double> onset;        /*!< Time of the pulse. */
+    std::vector<double> base;         /*!< Baseline that the amplitude is measured from. */
+    std::vector<double> peak;         /*!< Peak value. */
+    std::vector<double> peakIndex;    /*!< Time of the peak. */
+    std::vector<double> amplitude;    /*!< Peak minus baseline. */
+    std::vector<double> latency;      /*!< Time from the pulse to the response (see TrainPlan::latencyMode). */
+    std::vector<double> ratio;        /*!< Amplitude relative to the first pulse of the same section,
+                                           i.e. the paired-pulse ratio for the second pulse. */
+
+    //! Retrieves the number of pulses.
+    /*! \return The number of rows.
+     */
+    std::size_t size() const { return pulse.size(); }
+
+    //! Appends all pulses of another table.
+    /*! \param other The pulses to be appended.
+     */
+    void append(const TrainTable& other);
+
+    //! Converts the pulses to a table that can be shown in the results window.
+    /*! \param dt The sampling interval; times are given in x units.
+     *  \return A table with one row per pulse.
+     */
+    Table ToTable(double dt) const;
+};
+
+//! Settings of a train of equally spaced pulses.
+/*! Times are given in sampling points. The measurements of each pulse are
+ *  the same as in MeasurementPlan::Evaluate(), using the settings of
+ *  \e measurement except for the cursors, which are set for each pulse.
+ */
+struct StfioDll TrainPlan {
+    //! Constructor. Sets defaults for a pair of pulses.
+    TrainPlan();
+
+    //! Sets up the windows of the pulses for a section.
+    /*! Throws std::out_of_range if the baseline before the first pulse
+     *  or a pulse is outside of the section.
+     *  \param size The number of sampling points of the section.
+     *  \return One window per pulse, named "Pulse 1", "Pulse 2", and so on.
+     */
+    MultiWindowPlan Windows(std::size_t size) const;
+
+    //! Measures the responses to the pulses in a single section.
+    /*! Throws std::out_of_range if the section is too short for the train.
+     *  \param sec The section to be measured.
+     *  \param dt The sampling interval.
+     *  \param n_channel The channel index that is written to the table.
+     *  \param n_section The section index that is written to the table.
+     *  \return One row per pulse.
+     */
+    TrainTable Analyse(const Section& sec, double dt, std::size_t n_channel = 0,
+                       std::size_t n_section = 0) const;
+
+    //! Measures the responses in all sections of several channels in parallel.
+    /*! Throws std::out_of_range if a channel index is out of range or a
+     *  section is too short for the train.
+     *  \param rec The recording to be measured.
+     *  \param channels Indices of the channels within \e rec.
+     *  \param n_threads Number of sections that are measured in parallel;
+     *         0 uses the configured number of threads.
+     *  \return The pulses of all sections, sorted by channel in the order
+     *          of \e channels, section and pulse.
+     */
+    TrainTable Analyse(const Recording& rec, const std::vector<std::size_t>& channels,
+                       int n_threads = 0) const;
+
+    std::size_t n_pulses;       /*!< Number of pulses. */
+    double onset;               /*!< Time of the first pulse. */
+    double interval;            /*!< Interval between pulses. */
+    std::size_t baseLength;     /*!< Number of points before a pulse that make up its baseline. */
+    std::size_t peakDelay;      /*!< Number of points after a pulse that are skipped,
+                                     e.g. to exclude the stimulus artifact. */
+    train_baseline baselineMode; /*!< Baselines of the pulses. */
+    latency_mode latencyMode;   /*!< End of the latency, which starts at the pulse. */
+    MeasurementPlan measurement; /*!< Peak direction, peak average and other settings of the measurements. */
+};
+
+/*@}*/
+
+}
+
+#endif
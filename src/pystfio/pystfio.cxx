@@ -40,6 +40,12 @@
 
 #include "./../libstfnum/fit.h"
 #include "./../libstfnum/measure.h"
+#include "./../libstfnum/events.h"
+#include "./../libstfnum/eventstats.h"
+#include "./../libstfnum/noise.h"
+#include "./../libstfnum/spectrum.h"
+#include "./../libstfnum/arrowtable.h"
+#include "./../libstfio/recording.h"
 
 #include "pystfio.h"
 
@@ -54,6 +60,119 @@ void wrap_array() {
 }
 #endif
 
+// Creates a numpy array that uses data without copying; owner is kept
+// alive for as long as the array exists:
+PyObject* array_view(double* data, npy_intp size, PyObject* owner) {
+    wrap_array();
+
+    npy_intp dims[1] = {size};
+    if (size == 0) {
+        return PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+    }
+    PyObject* np_array = PyArray_SimpleNewFromData(1, dims, NPY_DOUBLE, data);
+    if (np_array == NULL) {
+        return NULL;
+    }
+    Py_INCREF(owner);
+#if NPY_API_VERSION >= 0x00000007
+    PyArray_SetBaseObject((PyArrayObject*)np_array, owner);
+#else
+    PyArray_BASE(np_array) = owner;
+#endif
+    return np_array;
+}
+
+static void delete_vector(PyObject* capsule) {
+    delete static_cast<Vector_double*>(PyCapsule_GetPointer(capsule, "Vector_double"));
+}
+
+// Hands a heap-allocated vector over to a new numpy array, which deletes it
+// when it is no longer used:
+PyObject* adopt_vector(Vector_double* vec) {
+    PyObject* capsule = PyCapsule_New(vec, "Vector_double", delete_vector);
+    if (capsule == NULL) {
+        delete vec;
+        return NULL;
+    }
+    PyObject* np_array = array_view(vec->empty() ? NULL : &(*vec)[0], vec->size(), capsule);
+    Py_DECREF(capsule);
+    return np_array;
+}
+
+namespace {
+    // Releases a Python object from any thread, e.g. when the last section
+    // that refers to a numpy array is destroyed while the GIL is released:
+    struct PyObjectReleaser {
+        void operator()(void* obj) const {
+            if (!Py_IsInitialized()) {
+                return;
+            }
+            PyGILState_STATE state = PyGILState_Ensure();
+            Py_DECREF((PyObject*)obj);
+            PyGILState_Release(state);
+        }
+    };
+}
+
+Section* section_view(PyObject* nparray, double scale, double shift) {
+    wrap_array();
+
+    if (!PyArray_Check(nparray) || PyArray_NDIM((PyArrayObject*)nparray) != 1) {
+        std::cerr << "Argument is not a 1D numpy array\n";
+        return NULL;
+    }
+    PyArrayObject* array = (PyArrayObject*)nparray;
+    stfio::SampleType type = stfio::sample_float64;
+    bool supported = PyArray_ISNOTSWAPPED(array) && PyArray_ISALIGNED(array) &&
+        PyArray_STRIDE(array, 0) >= 0;
+    switch (PyArray_TYPE(array)) {
+     case NPY_INT16: type = stfio::sample_int16; break;
+     case NPY_INT32: type = stfio::sample_int32; break;
+     case NPY_FLOAT32: type = stfio::sample_float32; break;
+     case NPY_FLOAT64: type = stfio::sample_float64; break;
+     default: supported = false;
+    }
+    if (!supported) {
+        // other types and byte orders are converted to doubles once:
+        array = (PyArrayObject*)PyArray_FROM_OTF(nparray, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+        if (array == NULL) {
+            PyErr_Clear();
+            std::cerr << "Couldn't convert the array to doubles\n";
+            return NULL;
+        }
+        type = stfio::sample_float64;
+    } else {
+        Py_INCREF(nparray);
+    }
+
+    std::size_t n_samples = PyArray_DIM(array, 0);
+    std::size_t stride = n_samples > 1 ? PyArray_STRIDE(array, 0) : PyArray_ITEMSIZE(array);
+    std::size_t bytes = n_samples > 0 ? (n_samples-1)*stride + PyArray_ITEMSIZE(array) : 0;
+    // the samples keep the array alive:
+#if (__cplusplus < 201103)
+    boost::shared_ptr<void> owner((void*)array, PyObjectReleaser());
+    boost::shared_ptr<stfio::MappedFile> file(
+#else
+    std::shared_ptr<void> owner((void*)array, PyObjectReleaser());
+    std::shared_ptr<stfio::MappedFile> file(
+#endif
+        new stfio::MappedFile((const char*)PyArray_DATA(array), bytes, owner));
+    return new Section(stfio::MappedSamples(file, 0, n_samples, stride, type, scale, shift));
+}
+
+// Several file format libraries keep global state, such as the file tables
+// of the Axon and CFS libraries, or HDF5, which is shut down after every file.
+// Files are therefore read and written by one thread at a time, while the
+// GIL is released so that other Python threads keep running. Has to be
+// called with the GIL held.
+PyThread_type_lock file_lock() {
+    static PyThread_type_lock lock = NULL;
+    if (lock == NULL) {
+        lock = PyThread_allocate_lock();
+    }
+    return lock;
+}
+
 stfio::filetype gettype(const std::string& ftype) {
     stfio::filetype stftype = stfio::none;
     if (ftype == "cfs") {
@@ -76,6 +195,12 @@ stfio::filetype gettype(const std::string& ftype) {
         stftype = stfio::igor;
     } else if (ftype == "tdms") {
         stftype = stfio::tdms;
+    } else if (ftype == "nwb") {
+        stftype = stfio::nwb;
+    } else if (ftype == "zarr") {
+        stftype = stfio::zarr;
+    } else if (ftype == "son") {
+        stftype = stfio::son;
     } else {
         stftype = stfio::none;
     }
@@ -91,27 +216,33 @@ bool _read(const std::string& filename, const std::string& ftype, bool verbose,
 #endif // TEST_MINIMAL
 
     stfio::txtImportSettings tis;
+    PyThread_type_lock lock = file_lock();
+    bool success = false;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(lock, WAIT_LOCK);
     stfio::StdoutProgressInfo progDlg("File import", "Starting file import", 100, verbose);
-    
     try {
-        if (!stfio::importFile(filename, stftype, Data, tis, progDlg)) {
+        success = stfio::importFile(filename, stftype, Data, tis, progDlg);
+        if (!success) {
             std::cerr << "Error importing file\n";
-            return false;
         }
     } catch (const std::exception& e) {
         std::cerr << "Error importing file:\n"
                   << e.what() << std::endl;
-        return false;
     }
-        
-    return true;
+    PyThread_release_lock(lock);
+    Py_END_ALLOW_THREADS
+
+    return success;
 }
 
-PyObject* detect_events(double* data, int size_data, double* templ, int size_templ,
-                        double dt, const std::string& mode, bool norm, double lowpass, double highpass)
+// Computes the detection criterion, linear correlation or deconvolution
+// without using the Python API:
+static Vector_double compute_detection(double* data, int size_data, double* templ, int size_templ,
+                                       double dt, const std::string& mode, bool norm,
+                                       double lowpass, double highpass)
 {
-    wrap_array();
-
     Vector_double vtempl(templ, &templ[size_templ]);
     if (norm) {
         double fmin = *std::min_element(vtempl.begin(), vtempl.end());
@@ -123,7 +254,7 @@ PyObject* detect_events(double* data, int size_data, double* templ, int size_tem
         } else {
             basel = fmin;
         }
-        vtempl = stfio::vec_scal_minus(vtempl, basel);
+        stfio::vec_scal_minus(vtempl, basel, vtempl);
         fmin = *std::min_element(vtempl.begin(), vtempl.end());
         fmax = *std::max_element(vtempl.begin(), vtempl.end());
         if (fabs(fmin) > fabs(fmax)) {
@@ -131,7 +262,7 @@ PyObject* detect_events(double* data, int size_data, double* templ, int size_tem
         } else {
             normval = fabs(fmax);
         }
-        vtempl = stfio::vec_scal_div(vtempl, normval);
+        stfio::vec_scal_div(vtempl, normval, vtempl);
     }
     Vector_double trace(data, &data[size_data]);
     Vector_double detect(size_data);
@@ -143,29 +274,97 @@ PyObject* detect_events(double* data, int size_data, double* templ, int size_tem
         detect = stfnum::linCorr(trace, vtempl, progDlg);
     } else if (mode=="deconvolution") {
         stfio::StdoutProgressInfo progDlg("Computing detection criterion...", "Computing detection criterion...", 100, true);
-        try {
-            detect = stfnum::deconvolve(trace, vtempl, 1.0/dt, highpass, lowpass, progDlg);
-        } catch (const std::runtime_error& e) {
-            std::cerr << e.what() << std::endl;
-            return Py_BuildValue("");
+        detect = stfnum::deconvolve(trace, vtempl, 1.0/dt, highpass, lowpass, progDlg);
+    }
+    return detect;
+}
+
+namespace {
+    // Stores the recordings of import_files():
+    class StoreRecordings : public stfio::ImportCallback {
+     public:
+        StoreRecordings(std::vector<Recording*>& recs_, const std::vector<std::string>& filenames_)
+            : recs(recs_), filenames(filenames_) {}
+        void Imported(std::size_t index, Recording& data) {
+            recs[index] = new Recording(STFIO_MOVE(data));
         }
+        void Failed(std::size_t index, const std::string& error) {
+            std::cerr << "Error importing file " << filenames[index] << ":\n"
+                      << error << std::endl;
+        }
+     private:
+        std::vector<Recording*>& recs;
+        const std::vector<std::string>& filenames;
+    };
+}
+
+// Reads several files in parallel; files that couldn't be read give NULL.
+std::vector<Recording*> import_files(const std::vector<std::string>& filenames,
+                                     const std::vector<std::string>& ftypes, int nthreads)
+{
+    std::vector<Recording*> recs(filenames.size(), (Recording*)NULL);
+    std::vector<stfio::filetype> stftypes(filenames.size(), stfio::none);
+#ifndef TEST_MINIMAL
+    for (std::size_t n_f = 0; n_f < ftypes.size() && n_f < stftypes.size(); ++n_f) {
+        stftypes[n_f] = gettype(ftypes[n_f]);
     }
-    npy_intp dims[1] = {(int)detect.size()};
-    PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
-    double* gDataP = (double*)array_data(np_array);
+#endif // TEST_MINIMAL
 
-    /* fill */
-    std::copy(detect.begin(), detect.end(), gDataP);
-    
-    return np_array;
+    stfio::txtImportSettings tis;
+    StoreRecordings store(recs, filenames);
+    PyThread_type_lock lock = file_lock();
+
+    // libstfio serializes the formats that can't be read concurrently:
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(lock, WAIT_LOCK);
+    try {
+        stfio::importFiles(filenames, stftypes, store, tis, nthreads);
+    } catch (const std::exception& e) {
+        std::cerr << "Error importing files:\n"
+                  << e.what() << std::endl;
+    }
+    PyThread_release_lock(lock);
+    Py_END_ALLOW_THREADS
+
+    return recs;
+}
+
+PyObject* detect_events(double* data, int size_data, double* templ, int size_templ,
+                        double dt, const std::string& mode, bool norm, double lowpass, double highpass)
+{
+    wrap_array();
+
+    Vector_double detect;
+    bool success = true;
+
+    // other Python threads keep running during the computation;
+    // exceptions mustn't leave this block:
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        detect = compute_detection(data, size_data, templ, size_templ, dt, mode, norm, lowpass, highpass);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        return Py_BuildValue("");
+    }
+    // return the result without copying it:
+    Vector_double* result = new Vector_double;
+    result->swap(detect);
+    return adopt_vector(result);
 }
 
 PyObject* peak_detection(double* invec, int size, double threshold, int min_distance) {
     wrap_array();
 
+    std::vector<int> peak_idcs;
+    Py_BEGIN_ALLOW_THREADS
     Vector_double data(invec, &invec[size]);
-
-    std::vector<int> peak_idcs = stfnum::peakIndices(data, threshold, min_distance);
+    peak_idcs = stfnum::peakIndices(data, threshold, min_distance);
+    Py_END_ALLOW_THREADS
 
     npy_intp dims[1] = {(int)peak_idcs.size()};
     PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_INT);
@@ -192,6 +391,8 @@ PyObject* peak_detection(double* invec, int size, double threshold, int min_dist
 double risetime(double* invec, int size, double base, double amp, double frac) {
     wrap_array();
 
+    double rt = 0;
+    Py_BEGIN_ALLOW_THREADS
     Vector_double data(invec, &invec[size]);
     double itLoReal, itHiReal, otLoReal, otHiReal;
     std::size_t argmax = 0;
@@ -204,5 +405,799 @@ double risetime(double* invec, int size, double base, double amp, double frac) {
             }
         }
     }
-    return stfnum::risetime2(data, base, amp, 0, argmax, frac, itLoReal, itHiReal, otLoReal, otHiReal);
+    rt = stfnum::risetime2(data, base, amp, 0, argmax, frac, itLoReal, itHiReal, otLoReal, otHiReal);
+    Py_END_ALLOW_THREADS
+    return rt;
+}
+
+PyObject* measure(double* invec, int size, double dt, int base_begin, int base_end,
+                  int peak_begin, int peak_end, const std::string& baseline_method,
+                  int peak_points, const std::string& direction, double rise_factor,
+                  bool from_base, double slope)
+{
+    stfnum::MeasurementPlan plan;
+    plan.baseBeg = base_begin;
+    plan.baseEnd = base_end;
+    plan.peakBeg = peak_begin;
+    plan.peakEnd = peak_end;
+    plan.baselineMethod = baseline_method == "median" ? stfnum::median_iqr : stfnum::mean_sd;
+    plan.pM = peak_points;
+    if (direction == "up") {
+        plan.dir = stfnum::up;
+    } else if (direction == "down") {
+        plan.dir = stfnum::down;
+    } else {
+        plan.dir = stfnum::both;
+    }
+    plan.RTFactor = rise_factor;
+    plan.fromBase = from_base;
+    plan.slopeForThreshold = slope;
+    // there's neither a reference channel nor a latency:
+    plan.measurements = stfnum::measure_all & ~(stfnum::measure_reference | stfnum::measure_latency);
+
+    stfnum::MeasurementResults res;
+    bool success = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        Section sec(Vector_double(invec, &invec[size]));
+        res = plan.Evaluate(sec, dt);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        return Py_BuildValue("");
+    }
+    return Py_BuildValue("{s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d}",
+                         "base", res.base, "base_sd", res.baseSD, "peak", res.peak,
+                         "peak_index", res.maxT, "threshold", res.threshold, "threshold_index", res.thrT,
+                         "rise_time", res.rtLoHi, "inner_rise_time", res.innerHiRT-res.innerLoRT,
+                         "outer_rise_time", res.outerHiRT-res.outerLoRT, "half_duration", res.halfDuration,
+                         "max_rise", res.maxRise, "max_decay", res.maxDecay,
+                         "slope_ratio", res.slopeRatio, "t50_left_index", res.t50LeftReal);
+}
+
+namespace {
+    // Copies indices into a new numpy array:
+    PyObject* index_array(const std::vector<std::size_t>& indices) {
+        npy_intp dims[1] = {(npy_intp)indices.size()};
+        PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_INTP);
+        if (np_array != NULL) {
+            std::copy(indices.begin(), indices.end(), (npy_intp*)array_data(np_array));
+        }
+        return np_array;
+    }
+}
+
+namespace {
+    // A table of results with the title of its row labels, held by a capsule:
+    struct LabelledTable {
+        LabelledTable(const stfnum::Table& table_, const std::string& labelTitle_)
+            : table(table_), labelTitle(labelTitle_) {}
+        stfnum::Table table;
+        std::string labelTitle;
+    };
+
+    void delete_table(PyObject* capsule) {
+        delete static_cast<LabelledTable*>(PyCapsule_GetPointer(capsule, "stfio.Table"));
+    }
+
+    // The capsules of the Arrow PyCapsule interface release what the
+    // consumer hasn't taken over:
+    void release_schema(PyObject* capsule) {
+        ArrowSchema* schema = static_cast<ArrowSchema*>(PyCapsule_GetPointer(capsule, "arrow_schema"));
+        if (schema->release != NULL) {
+            schema->release(schema);
+        }
+        delete schema;
+    }
+
+    void release_array(PyObject* capsule) {
+        ArrowArray* array = static_cast<ArrowArray*>(PyCapsule_GetPointer(capsule, "arrow_array"));
+        if (array->release != NULL) {
+            array->release(array);
+        }
+        delete array;
+    }
+
+    PyObject* table_capsule(const stfnum::Table& table, const std::string& labelTitle) {
+        LabelledTable* labelled = new LabelledTable(table, labelTitle);
+        PyObject* capsule = PyCapsule_New(labelled, "stfio.Table", delete_table);
+        if (capsule == NULL) {
+            delete labelled;
+        }
+        return capsule;
+    }
+
+    // Scans several sections of a channel in parallel; the template is used as is.
+    bool detect_channel(const Recording& rec, int channel, double* templ, int size_templ,
+                        const std::vector<int>& sections, const std::string& mode,
+                        double threshold, int min_distance, double lowpass,
+                        double highpass, int nthreads, stfnum::EventTable& events)
+    {
+        if (channel < 0 || channel >= (int)rec.size()) {
+            std::cerr << "Channel index out of range" << std::endl;
+            return false;
+        }
+        stfnum::EventDetectionPlan plan;
+        plan.templ = Vector_double(templ, &templ[size_templ]);
+        if (mode == "correlation") {
+            plan.mode = stfnum::detect_correlation;
+        } else if (mode == "deconvolution") {
+            plan.mode = stfnum::detect_deconvolution;
+        } else {
+            plan.mode = stfnum::detect_criterion;
+        }
+        plan.threshold = threshold;
+        plan.minDistance = min_distance;
+        plan.SR = 1.0/rec.GetXScale();
+        plan.lowpass = lowpass;
+        plan.highpass = highpass;
+
+        std::vector<std::size_t> secs(sections.begin(), sections.end());
+        if (sections.empty()) {
+            for (std::size_t n_s = 0; n_s < rec[channel].size(); ++n_s) {
+                secs.push_back(n_s);
+            }
+        }
+        bool success = true;
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            stfio::StdoutProgressInfo progDlg("Detecting events...", "Detecting events...", 100, false);
+            events = plan.Detect(rec[channel], secs, progDlg, nthreads);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            success = false;
+        }
+        Py_END_ALLOW_THREADS
+        return success;
+    }
+
+    // Measures the IV of a channel in a single parallel pass over its sections.
+    bool iv_channel(const Recording& rec, int channel, double* commands, int size_commands,
+                    int base_start, int base_end, int peak_start, int peak_end,
+                    const std::vector<int>& sections, int nthreads, stfnum::Table& table)
+    {
+        if (channel < 0 || channel >= (int)rec.size()) {
+            std::cerr << "Channel index out of range" << std::endl;
+            return false;
+        }
+        if (base_start < 0 || peak_start < 0) {
+            std::cerr << "Cursor index out of range" << std::endl;
+            return false;
+        }
+        std::vector<std::size_t> secs(sections.begin(), sections.end());
+        if (sections.empty()) {
+            for (std::size_t n_s = 0; n_s < rec[channel].size(); ++n_s) {
+                secs.push_back(n_s);
+            }
+        }
+        Vector_double commandVec(commands, &commands[size_commands]);
+        bool success = true;
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            table = stfnum::ivCurve(rec[channel], secs, base_start, base_end, peak_start, peak_end,
+                                    commandVec, nthreads);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            success = false;
+        }
+        Py_END_ALLOW_THREADS
+        return success;
+    }
+}
+
+PyObject* arrow_c_array(PyObject* table) {
+    LabelledTable* labelled = static_cast<LabelledTable*>(PyCapsule_GetPointer(table, "stfio.Table"));
+    if (labelled == NULL) {
+        return NULL;
+    }
+    ArrowSchema* schema = new ArrowSchema;
+    ArrowArray* array = new ArrowArray;
+    try {
+        stfnum::exportArrowTable(labelled->table, labelled->labelTitle, schema, array);
+    } catch (const std::exception& e) {
+        delete schema;
+        delete array;
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    PyObject* schema_capsule = PyCapsule_New(schema, "arrow_schema", release_schema);
+    if (schema_capsule == NULL) {
+        schema->release(schema);
+        delete schema;
+        array->release(array);
+        delete array;
+        return NULL;
+    }
+    PyObject* array_capsule = PyCapsule_New(array, "arrow_array", release_array);
+    if (array_capsule == NULL) {
+        Py_DECREF(schema_capsule);
+        array->release(array);
+        delete array;
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", schema_capsule, array_capsule);
+}
+
+PyObject* detect_channel_events(const Recording& rec, int channel, double* templ, int size_templ,
+                                const std::vector<int>& sections, const std::string& mode,
+                                double threshold, int min_distance, double lowpass,
+                                double highpass, int nthreads)
+{
+    wrap_array();
+
+    stfnum::EventTable events;
+    if (!detect_channel(rec, channel, templ, size_templ, sections, mode, threshold,
+                        min_distance, lowpass, highpass, nthreads, events))
+    {
+        return Py_BuildValue("");
+    }
+    PyObject* section = index_array(events.section);
+    PyObject* index = index_array(events.index);
+    PyObject* peak_index = adopt_vector(new Vector_double(events.peakIndex));
+    PyObject* amplitude = adopt_vector(new Vector_double(events.amplitude));
+    PyObject* criterion = adopt_vector(new Vector_double(events.criterion));
+    // "N" hands the references over to the dictionary:
+    return Py_BuildValue("{s:N,s:N,s:N,s:N,s:N}", "section", section, "index", index,
+                         "peak_index", peak_index, "amplitude", amplitude, "criterion", criterion);
+}
+
+PyObject* channel_event_table(const Recording& rec, int channel, double* templ, int size_templ,
+                              const std::vector<int>& sections, const std::string& mode,
+                              double threshold, int min_distance, double lowpass,
+                              double highpass, int nthreads)
+{
+    stfnum::EventTable events;
+    if (!detect_channel(rec, channel, templ, size_templ, sections, mode, threshold,
+                        min_distance, lowpass, highpass, nthreads, events))
+    {
+        return Py_BuildValue("");
+    }
+    return table_capsule(events.ToTable(rec.GetXScale()), "Event");
+}
+
+PyObject* channel_event_stats(const Recording& rec, int channel, double* templ, int size_templ,
+                              const std::vector<int>& sections, const std::string& mode,
+                              double threshold, int min_distance, double lowpass,
+                              double highpass, double bin_width, int nthreads)
+{
+    wrap_array();
+
+    stfnum::EventTable events;
+    if (!detect_channel(rec, channel, templ, size_templ, sections, mode, threshold,
+                        min_distance, lowpass, highpass, nthreads, events))
+    {
+        return Py_BuildValue("");
+    }
+    std::vector<std::size_t> secs(sections.begin(), sections.end());
+    if (sections.empty()) {
+        for (std::size_t n_s = 0; n_s < rec[channel].size(); ++n_s) {
+            secs.push_back(n_s);
+        }
+    }
+    stfnum::EventStatistics* stats = new stfnum::EventStatistics;
+    bool success = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        stfnum::EventStatisticsPlan plan;
+        plan.binWidth = bin_width;
+        *stats = plan.Compute(stfnum::EventSet(events, rec.GetXScale(), secs, rec[channel]), nthreads);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        delete stats;
+        return Py_BuildValue("");
+    }
+    PyObject* time = adopt_vector(new Vector_double(stats->time));
+    PyObject* interval = adopt_vector(new Vector_double(stats->interval));
+    PyObject* frequency = adopt_vector(new Vector_double(stats->frequency));
+    PyObject* bin_time = adopt_vector(new Vector_double(stats->binTime));
+    PyObject* bin_count = index_array(std::vector<std::size_t>(stats->binCount.begin(), stats->binCount.end()));
+    PyObject* bin_rate = adopt_vector(new Vector_double(stats->binRate));
+    PyObject* sorted_intervals = adopt_vector(new Vector_double(stats->sortedIntervals));
+    PyObject* sorted_amplitudes = adopt_vector(new Vector_double(stats->sortedAmplitudes));
+    PyObject* ret = Py_BuildValue("{s:N,s:N,s:N,s:N,s:N,s:N,s:N,s:N,s:n,s:n,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d}",
+                                  "time", time, "interval", interval, "frequency", frequency,
+                                  "bin_time", bin_time, "bin_count", bin_count, "bin_rate", bin_rate,
+                                  "sorted_intervals", sorted_intervals,
+                                  "sorted_amplitudes", sorted_amplitudes,
+                                  "n_events", (Py_ssize_t)stats->nEvents,
+                                  "n_sections", (Py_ssize_t)stats->nSections,
+                                  "duration", stats->duration, "mean_rate", stats->meanRate,
+                                  "mean_interval", stats->meanInterval,
+                                  "median_interval", stats->medianInterval,
+                                  "cv_interval", stats->cvInterval,
+                                  "mean_amplitude", stats->meanAmplitude,
+                                  "median_amplitude", stats->medianAmplitude,
+                                  "sd_amplitude", stats->sdAmplitude);
+    delete stats;
+    return ret;
+}
+
+PyObject* ks_test(double* invec, int size, double* data, int size_data) {
+    Vector_double a(invec, invec+size), b(data, data+size_data);
+    // the samples are usually sorted already, e.g. by event_stats():
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    double p = 0;
+    double d = stfnum::ksTest(a, b, p);
+    return Py_BuildValue("(dd)", d, p);
+}
+
+PyObject* get_channel_traces(const Recording& rec, int channel, const std::vector<int>& sections,
+                             int start, int stop, int nthreads)
+{
+    wrap_array();
+
+    if (channel < 0 || channel >= (int)rec.size()) {
+        std::cerr << "Channel index out of range" << std::endl;
+        return Py_BuildValue("");
+    }
+    const Channel& ch = rec[channel];
+    std::vector<std::size_t> secs;
+    secs.reserve(sections.empty() ? ch.size() : sections.size());
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] < 0 || sections[n] >= (int)ch.size()) {
+            std::cerr << "Section index out of range" << std::endl;
+            return Py_BuildValue("");
+        }
+        secs.push_back(sections[n]);
+    }
+    if (sections.empty()) {
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            secs.push_back(n_s);
+        }
+    }
+    if (stop < 0) {
+        // up to the end of the shortest section:
+        stop = 0;
+        for (std::size_t n = 0; n < secs.size(); ++n) {
+            if (n == 0 || (int)ch[secs[n]].size() < stop) {
+                stop = (int)ch[secs[n]].size();
+            }
+        }
+    }
+    if (start < 0 || start > stop) {
+        std::cerr << "Sample range out of range" << std::endl;
+        return Py_BuildValue("");
+    }
+
+    npy_intp dims[2] = {(npy_intp)secs.size(), (npy_intp)(stop-start)};
+    PyObject* np_array = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    if (np_array == NULL) {
+        return NULL;
+    }
+    double* dest = (double*)array_data(np_array);
+    bool success = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        ch.CopyRange(secs, start, stop, dest, nthreads);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        Py_DECREF(np_array);
+        return Py_BuildValue("");
+    }
+    return np_array;
+}
+
+static void delete_section(PyObject* capsule) {
+    delete static_cast<Section*>(PyCapsule_GetPointer(capsule, "Section"));
+}
+
+namespace {
+    // Number of data points of every section of a channel, or -1 if the
+    // sections differ in size:
+    long uniform_size(const Channel& ch) {
+        long size = ch.size() > 0 ? (long)ch[0].size() : 0;
+        for (std::size_t n_s = 1; n_s < ch.size(); ++n_s) {
+            if ((long)ch[n_s].size() != size) {
+                return -1;
+            }
+        }
+        return size;
+    }
+
+    // Copies all sections of a channel to dest; section n starts at n*size.
+    // Sets a Python exception if the sections can't be read:
+    bool copy_channel(const Channel& ch, std::size_t size, double* dest, int nthreads) {
+        const double* contiguous = ch.GetContiguous();
+        bool success = true;
+        std::string error;
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            if (contiguous != NULL) {
+                std::copy(contiguous, contiguous + ch.size()*size, dest);
+            } else {
+                std::vector<std::size_t> secs(ch.size());
+                for (std::size_t n_s = 0; n_s < secs.size(); ++n_s) {
+                    secs[n_s] = n_s;
+                }
+                ch.CopyRange(secs, 0, size, dest, nthreads);
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+            success = false;
+        }
+        Py_END_ALLOW_THREADS
+        if (!success) {
+            PyErr_SetString(PyExc_RuntimeError, error.c_str());
+        }
+        return success;
+    }
+}
+
+PyObject* channel_array(const Channel& ch, int nthreads)
+{
+    wrap_array();
+
+    long size = uniform_size(ch);
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "Sections differ in size");
+        return NULL;
+    }
+    npy_intp dims[2] = {(npy_intp)ch.size(), (npy_intp)size};
+    const double* contiguous = ch.GetContiguous();
+    if (contiguous != NULL) {
+        // a copy of the first section shares the buffer of all sections and
+        // keeps it alive, even if the sections are written to later on:
+        PyObject* capsule = PyCapsule_New(new Section(ch[0]), "Section", delete_section);
+        if (capsule == NULL) {
+            return NULL;
+        }
+        PyObject* np_array = PyArray_SimpleNewFromData(2, dims, NPY_DOUBLE, (void*)contiguous);
+        if (np_array == NULL) {
+            Py_DECREF(capsule);
+            return NULL;
+        }
+#if NPY_API_VERSION >= 0x00000007
+        PyArray_SetBaseObject((PyArrayObject*)np_array, capsule);
+#else
+        PyArray_BASE(np_array) = capsule;
+#endif
+        PyArray_CLEARFLAGS((PyArrayObject*)np_array, NPY_ARRAY_WRITEABLE);
+        return np_array;
+    }
+
+    PyObject* np_array = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    if (np_array == NULL) {
+        return NULL;
+    }
+    if (!copy_channel(ch, size, (double*)array_data(np_array), nthreads)) {
+        Py_DECREF(np_array);
+        return NULL;
+    }
+    return np_array;
+}
+
+PyObject* recording_array(const Recording& rec, int nthreads)
+{
+    wrap_array();
+
+    long n_sections = rec.size() > 0 ? (long)rec[0].size() : 0;
+    long size = rec.size() > 0 ? uniform_size(rec[0]) : 0;
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        if ((long)rec[n_c].size() != n_sections || size < 0 || uniform_size(rec[n_c]) != size) {
+            PyErr_SetString(PyExc_ValueError, "Channels or sections differ in size");
+            return NULL;
+        }
+    }
+    npy_intp dims[3] = {(npy_intp)rec.size(), (npy_intp)n_sections, (npy_intp)size};
+    PyObject* np_array = PyArray_SimpleNew(3, dims, NPY_DOUBLE);
+    if (np_array == NULL) {
+        return NULL;
+    }
+    double* dest = (double*)array_data(np_array);
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        if (!copy_channel(rec[n_c], size, dest + n_c*n_sections*size, nthreads)) {
+            Py_DECREF(np_array);
+            return NULL;
+        }
+    }
+    return np_array;
+}
+
+PyObject* channel_nsfa(const Recording& rec, int channel, const std::vector<int>& sections,
+                       int start, int stop, int bins, bool pairwise, int nthreads)
+{
+    wrap_array();
+
+    if (channel < 0 || channel >= (int)rec.size()) {
+        std::cerr << "Channel index out of range" << std::endl;
+        return Py_BuildValue("");
+    }
+    const Channel& ch = rec[channel];
+    std::vector<std::size_t> secs;
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] < 0 || sections[n] >= (int)ch.size()) {
+            std::cerr << "Section index out of range" << std::endl;
+            return Py_BuildValue("");
+        }
+        secs.push_back(sections[n]);
+    }
+    if (sections.empty()) {
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            secs.push_back(n_s);
+        }
+    }
+    if (stop < 0) {
+        // up to the end of the shortest section:
+        stop = 0;
+        for (std::size_t n = 0; n < secs.size(); ++n) {
+            if (n == 0 || (int)ch[secs[n]].size() < stop) {
+                stop = (int)ch[secs[n]].size();
+            }
+        }
+    }
+    if (start < 0 || start > stop || bins <= 0) {
+        std::cerr << "Sample range or number of bins out of range" << std::endl;
+        return Py_BuildValue("");
+    }
+
+    stfnum::NoiseAnalysis* result = new stfnum::NoiseAnalysis;
+    bool success = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        *result = stfnum::nsfa(ch, secs, start, stop, bins, pairwise, nthreads);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        delete result;
+        return Py_BuildValue("");
+    }
+    PyObject* mean = adopt_vector(new Vector_double(result->mean));
+    PyObject* variance = adopt_vector(new Vector_double(result->variance));
+    PyObject* bin_mean = adopt_vector(new Vector_double(result->binMean));
+    PyObject* bin_variance = adopt_vector(new Vector_double(result->binVariance));
+    PyObject* bin_count = index_array(result->binCount);
+    PyObject* ret = Py_BuildValue("{s:N,s:N,s:N,s:N,s:N,s:d,s:d,s:d,s:d}", "mean", mean,
+                                  "variance", variance, "bin_mean", bin_mean,
+                                  "bin_variance", bin_variance, "bin_count", bin_count,
+                                  "i", result->i, "N", result->N,
+                                  "background", result->background, "SSE", result->SSE);
+    delete result;
+    return ret;
+}
+
+namespace {
+    // Copies densities of equal size into the rows of a new 2D numpy array:
+    PyObject* density_array(const std::vector<Vector_double>& density, std::size_t n_freq) {
+        npy_intp dims[2] = {(npy_intp)density.size(), (npy_intp)n_freq};
+        PyObject* np_array = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+        if (np_array == NULL) {
+            return NULL;
+        }
+        double* dest = (double*)array_data(np_array);
+        for (std::size_t n = 0; n < density.size(); ++n) {
+            if (density[n].size() == n_freq) {
+                std::copy(density[n].begin(), density[n].end(), dest + n*n_freq);
+            } else {
+                std::fill(dest + n*n_freq, dest + (n+1)*n_freq, NAN);
+            }
+        }
+        return np_array;
+    }
+
+    PyObject* frequency_array(std::size_t n_freq, double df) {
+        Vector_double* freq = new Vector_double(n_freq);
+        for (std::size_t k = 0; k < n_freq; ++k) {
+            (*freq)[k] = k*df;
+        }
+        return adopt_vector(freq);
+    }
+
+    bool valid_segment(const Recording& rec, int channel, int segment, int overlap) {
+        if (channel < 0 || channel >= (int)rec.size()) {
+            std::cerr << "Channel index out of range" << std::endl;
+            return false;
+        }
+        if (segment < 2 || overlap < 0 || overlap >= segment) {
+            std::cerr << "Segment or overlap out of range" << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+PyObject* channel_welch(const Recording& rec, int channel, const std::vector<int>& sections,
+                        int segment, int overlap, int nthreads)
+{
+    wrap_array();
+
+    if (overlap < 0) {
+        overlap = segment/2;
+    }
+    if (!valid_segment(rec, channel, segment, overlap)) {
+        return Py_BuildValue("");
+    }
+    const Channel& ch = rec[channel];
+    std::vector<const Section*> secs;
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        if (sections[n] < 0 || sections[n] >= (int)ch.size()) {
+            std::cerr << "Section index out of range" << std::endl;
+            return Py_BuildValue("");
+        }
+        secs.push_back(&ch[sections[n]]);
+    }
+    if (sections.empty()) {
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            secs.push_back(&ch[n_s]);
+        }
+    }
+
+    std::vector<Vector_double> density;
+    bool success = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        density = stfnum::welch(secs, segment, overlap, rec.GetXScale(), nthreads);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        return Py_BuildValue("");
+    }
+    std::size_t n_freq = segment/2 + 1;
+    return Py_BuildValue("{s:N,s:N}",
+                         "frequency", frequency_array(n_freq, 1.0 / (segment*rec.GetXScale())),
+                         "density", density_array(density, n_freq));
+}
+
+PyObject* channel_spectrogram(const Recording& rec, int channel, int section,
+                              int segment, int overlap, int nthreads)
+{
+    wrap_array();
+
+    if (overlap < 0) {
+        overlap = segment/2;
+    }
+    if (!valid_segment(rec, channel, segment, overlap)) {
+        return Py_BuildValue("");
+    }
+    if (section < 0 || section >= (int)rec[channel].size()) {
+        std::cerr << "Section index out of range" << std::endl;
+        return Py_BuildValue("");
+    }
+
+    stfnum::Spectrogram result;
+    bool success = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        result = stfnum::spectrogram(rec[channel][section], segment, overlap,
+                                     rec.GetXScale(), nthreads);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        return Py_BuildValue("");
+    }
+    std::size_t n_freq = segment/2 + 1;
+    Vector_double* time = new Vector_double(result.density.size());
+    for (std::size_t n_w = 0; n_w < time->size(); ++n_w) {
+        (*time)[n_w] = n_w*result.dt;
+    }
+    return Py_BuildValue("{s:N,s:N,s:N}",
+                         "frequency", frequency_array(n_freq, result.df),
+                         "time", adopt_vector(time),
+                         "density", density_array(result.density, n_freq));
+}
+
+PyObject* channel_resistance(const Recording& rec, int channel, int base_start, int base_end,
+                             int peak_start, int peak_end, double amplitude,
+                             const std::vector<int>& sections, int nthreads)
+{
+    wrap_array();
+
+    if (channel < 0 || channel >= (int)rec.size()) {
+        std::cerr << "Channel index out of range" << std::endl;
+        return Py_BuildValue("");
+    }
+    if (base_start < 0 || peak_start < 0) {
+        std::cerr << "Cursor index out of range" << std::endl;
+        return Py_BuildValue("");
+    }
+    // negative indices become too large and are rejected by stfnum:
+    std::vector<std::size_t> secs(sections.begin(), sections.end());
+    if (sections.empty()) {
+        for (std::size_t n_s = 0; n_s < rec[channel].size(); ++n_s) {
+            secs.push_back(n_s);
+        }
+    }
+    Vector_double* r = new Vector_double;
+    bool success = true;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        *r = stfnum::resistance(rec[channel], secs, base_start, base_end, peak_start, peak_end,
+                                amplitude, nthreads);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        success = false;
+    }
+    Py_END_ALLOW_THREADS
+
+    if (!success) {
+        delete r;
+        return Py_BuildValue("");
+    }
+    return adopt_vector(r);
+}
+
+PyObject* channel_iv(const Recording& rec, int channel, double* commands, int size_commands,
+                     int base_start, int base_end, int peak_start, int peak_end,
+                     const std::vector<int>& sections, int nthreads)
+{
+    wrap_array();
+
+    stfnum::Table table(0, 0);
+    if (!iv_channel(rec, channel, commands, size_commands, base_start, base_end, peak_start,
+                    peak_end, sections, nthreads, table))
+    {
+        return Py_BuildValue("");
+    }
+    // one numpy array per column; empty cells become NaN:
+    PyObject* columns[4];
+    for (std::size_t n_c = 0; n_c < 4; ++n_c) {
+        Vector_double* column = new Vector_double(table.nRows());
+        for (std::size_t n_r = 0; n_r < table.nRows(); ++n_r) {
+            (*column)[n_r] = table.IsEmpty(n_r, n_c) ? NAN : table.at(n_r, n_c);
+        }
+        columns[n_c] = adopt_vector(column);
+    }
+    return Py_BuildValue("{s:N,s:N,s:N,s:N}", "command", columns[0], "response", columns[1],
+                         "sd", columns[2], "n", columns[3]);
+}
+
+PyObject* channel_iv_table(const Recording& rec, int channel, double* commands, int size_commands,
+                           int base_start, int base_end, int peak_start, int peak_end,
+                           const std::vector<int>& sections, int nthreads)
+{
+    stfnum::Table table(0, 0);
+    if (!iv_channel(rec, channel, commands, size_commands, base_start, base_end, peak_start,
+                    peak_end, sections, nthreads, table))
+    {
+        return Py_BuildValue("");
+    }
+    return table_capsule(table, "Step");
+}
+
+PyObject* decimate(double* invec, int size, int columns) {
+    wrap_array();
+
+    if (size <= 0 || columns <= 0) {
+        std::cerr << "Empty trace or no columns" << std::endl;
+        return Py_BuildValue("");
+    }
+    std::vector<std::size_t> x;
+    Vector_double* y = new Vector_double;
+    Py_BEGIN_ALLOW_THREADS
+    Section sec(Vector_double(invec, &invec[size]));
+    sec.Decimate(0, sec.size(), columns, x, *y);
+    Py_END_ALLOW_THREADS
+
+    PyObject* np_x = index_array(x);
+    if (np_x == NULL) {
+        delete y;
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", np_x, adopt_vector(y));
 }
@@ -15,12 +15,58 @@ void
 #endif
 wrap_array();
 
+PyObject* array_view(double* data, npy_intp size, PyObject* owner);
+PyObject* adopt_vector(Vector_double* vec);
+Section* section_view(PyObject* nparray, double scale=1.0, double shift=0.0);
+
+PyThread_type_lock file_lock();
+
 stfio::filetype gettype(const std::string& ftype);
 bool _read(const std::string& filename, const std::string& ftype, bool verbose, Recording& Data);
+std::vector<Recording*> import_files(const std::vector<std::string>& filenames,
+                                     const std::vector<std::string>& ftypes, int nthreads);
 PyObject* detect_events(double* data, int size_data, double* templ, int size_templ, double dt,
                         const std::string& mode="criterion",
                         bool norm=true, double lowpass=0.5, double highpass=0.0001);
 PyObject* peak_detection(double* invec, int size, double threshold, int min_distance);
 double risetime(double* invec, int size, double base, double amp, double frac=0.2);
+PyObject* measure(double* invec, int size, double dt, int base_begin, int base_end,
+                  int peak_begin, int peak_end, const std::string& baseline_method="mean",
+                  int peak_points=1, const std::string& direction="both", double rise_factor=20.0,
+                  bool from_base=true, double slope=20.0);
+PyObject* detect_channel_events(const Recording& rec, int channel, double* templ, int size_templ,
+                                const std::vector<int>& sections, const std::string& mode,
+                                double threshold, int min_distance, double lowpass,
+                                double highpass, int nthreads);
+PyObject* get_channel_traces(const Recording& rec, int channel, const std::vector<int>& sections,
+                             int start, int stop, int nthreads);
+PyObject* channel_array(const Channel& ch, int nthreads);
+PyObject* recording_array(const Recording& rec, int nthreads);
+PyObject* channel_nsfa(const Recording& rec, int channel, const std::vector<int>& sections,
+                       int start, int stop, int bins, bool pairwise, int nthreads);
+PyObject* channel_welch(const Recording& rec, int channel, const std::vector<int>& sections,
+                        int segment, int overlap, int nthreads);
+PyObject* channel_spectrogram(const Recording& rec, int channel, int section,
+                              int segment, int overlap, int nthreads);
+PyObject* channel_resistance(const Recording& rec, int channel, int base_start, int base_end,
+                             int peak_start, int peak_end, double amplitude,
+                             const std::vector<int>& sections, int nthreads);
+PyObject* channel_iv(const Recording& rec, int channel, double* commands, int size_commands,
+                     int base_start, int base_end, int peak_start, int peak_end,
+                     const std::vector<int>& sections, int nthreads);
+PyObject* channel_event_table(const Recording& rec, int channel, double* templ, int size_templ,
+                              const std::vector<int>& sections, const std::string& mode,
+                              double threshold, int min_distance, double lowpass,
+                              double highpass, int nthreads);
+PyObject* channel_event_stats(const Recording& rec, int channel, double* templ, int size_templ,
+                              const std::vector<int>& sections, const std::string& mode,
+                              double threshold, int min_distance, double lowpass,
+                              double highpass, double bin_width, int nthreads);
+PyObject* ks_test(double* invec, int size, double* data, int size_data);
+PyObject* channel_iv_table(const Recording& rec, int channel, double* commands, int size_commands,
+                           int base_start, int base_end, int peak_start, int peak_end,
+                           const std::vector<int>& sections, int nthreads);
+PyObject* arrow_c_array(PyObject* table);
+PyObject* decimate(double* invec, int size, int columns);
 
 #endif
@@ -19,6 +19,8 @@ common electrophysiology file formats"
 #include "./../libstfio/recording.h"
 #include "./../libstfio/channel.h"
 #include "./../libstfio/section.h"
+#include "./../libstfio/sharedrecording.h"
+#include "./../libstfio/parallel.h"
 
 #include "pystfio.h"
 
@@ -26,6 +28,7 @@ static int myErr = 0; // flag to save error state
 %}
 %include "../stimfit/py/numpy.i"
 %include "std_string.i"
+%include "std_vector.i"
 %include "exception.i"
 %init %{
     import_array();
@@ -38,11 +41,15 @@ static int myErr = 0; // flag to save error state
 %apply (TYPE* IN_ARRAY1, int DIM1) {(TYPE* invec, int size)};
 %apply (TYPE* IN_ARRAY1, int DIM1) {(TYPE* data, int size_data)};
 %apply (TYPE* IN_ARRAY1, int DIM1) {(TYPE* templ, int size_templ)};
+%apply (TYPE* IN_ARRAY1, int DIM1) {(TYPE* commands, int size_commands)};
 
 %enddef    /* %apply_numpy_typemaps() macro */
 
 %apply_numpy_typemaps(double)
 
+%template(StringVector) std::vector<std::string>;
+%template(IntVector) std::vector<int>;
+
 class Recording {
  public:
     Recording();
@@ -70,6 +77,34 @@ class Channel {
 class Section {
 };
 
+%exception stfio::SharedRecording::SharedRecording {
+    try {
+        $action
+    } catch (const std::exception& e) {
+        SWIG_exception(SWIG_RuntimeError, e.what());
+    }
+}
+
+namespace stfio {
+%feature("autodoc", "A copy of a recording in named shared memory, which
+other processes can attach to with stfio.attach() to read the data
+points without copying them. The name is removed when this object is
+deleted; processes that have attached keep their data.
+
+Arguments:
+rec  -- the Recording to be shared
+name -- name of the shared memory, e.g. 'stfio_cell1'") SharedRecording;
+class SharedRecording {
+ public:
+    SharedRecording(const Recording& data, const std::string& name);
+    ~SharedRecording();
+    %feature("autodoc", "Returns the name of the shared memory.") GetName;
+    const std::string& GetName() const;
+    %feature("autodoc", "Returns the size of the shared memory in bytes.") GetSize;
+    std::size_t GetSize() const;
+};
+}
+
 %exception Recording::__getitem__ {
     assert(!myErr);
     $action
@@ -97,6 +132,28 @@ class Section {
     }
 }
 
+// Proxies of channels and sections refer to the data of their Recording,
+// so they keep the proxy of their owner alive:
+%pythonappend Recording::__getitem__ %{
+    if val is not None:
+        val._owner = self
+%}
+
+%pythonappend Channel::__getitem__ %{
+    if val is not None:
+        val._owner = self
+%}
+
+%pythonappend Recording::event_table %{
+    if val is not None:
+        val = ArrowTable(val)
+%}
+
+%pythonappend Recording::iv_table %{
+    if val is not None:
+        val = ArrowTable(val)
+%}
+
 %extend Recording {
     Recording(PyObject* ChannelList) :
        dt(1.0),
@@ -111,7 +168,7 @@ class Section {
             return NULL;
         }
         Py_ssize_t listsize = PyList_Size(ChannelList);
-        std::deque<Channel> ChannelCpp(listsize);
+        std::vector<Channel*> ChannelCpp(listsize);
         
         for (Py_ssize_t i=0; i<listsize; ++i) {
             PyObject* sec0 = PyList_GetItem(ChannelList, i);
@@ -121,13 +178,15 @@ class Section {
                 std::cerr << "List doesn't consist of channels\n";
                 return NULL;
             }
-            Channel* arg1 = reinterpret_cast< Channel * >(argp1);
-
-            ChannelCpp[i] = *arg1;
+            ChannelCpp[i] = reinterpret_cast< Channel * >(argp1);
         }
 
-        // Note that array size is fixed by this allocation:
-        Recording* rec = new Recording(ChannelCpp);
+        // Note that array size is fixed by this allocation.
+        // The channels still belong to Python, so they are copied once:
+        Recording* rec = new Recording((std::size_t)listsize);
+        for (Py_ssize_t i=0; i<listsize; ++i) {
+            rec->InsertChannel(*ChannelCpp[i], i);
+        }
 
         return rec;
     }
@@ -156,7 +215,7 @@ class Section {
     Arguments:
     fname  -- file name
 #ifndef TEST_MINIMAL
-    ftype  -- file type (string). At present, only \"hdf5\" is supported.
+    ftype  -- file type (string). At present, \"hdf5\", \"nwb\" and \"zarr\" are supported.
 #else
     ftype  -- file type (string). At present, \"hdf5\", \"gdf\", \"cfs\" and \"ibw\" are supported.
 #endif // TEST_MINIMAL
@@ -166,14 +225,302 @@ class Section {
     True upon successful completion.") write;
     bool write(const std::string& fname, const std::string& ftype="hdf5", bool verbose=false) {
         stfio::filetype stftype = gettype(ftype);
+        PyThread_type_lock lock = file_lock();
+        bool success = false;
+
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(lock, WAIT_LOCK);
         stfio::StdoutProgressInfo progDlg("File export", "Writing file", 100, verbose);
         try {
-            return stfio::exportFile(fname, stftype, *($self), progDlg);
+            success = stfio::exportFile(fname, stftype, *($self), progDlg);
         } catch (const std::exception& e) {
             std::cerr << "Couldn't write to file:\n"
                       << e.what() << std::endl;
-            return false;
         }
+        PyThread_release_lock(lock);
+        Py_END_ALLOW_THREADS
+
+        return success;
+    }
+
+    %feature("autodoc", "Detects events in several sections of a channel,
+    which are scanned in parallel.
+
+    Arguments:
+    channel      -- channel index
+    templ        -- 1D numpy array with the template, normalized to a peak of -1
+    sections     -- list of section indices; all sections if empty
+    mode         -- 'criterion', 'correlation' or 'deconvolution'
+    threshold    -- detection threshold
+    min_distance -- minimal distance between events in sampling points
+    lowpass, highpass
+                 -- filter cutoffs of the deconvolution in kHz
+    nthreads     -- number of sections scanned in parallel; 0 uses all processors
+
+    Returns:
+    A dictionary of numpy arrays with one entry per event: 'section',
+    'index' (onset), 'peak_index', 'amplitude' and 'criterion'.
+    None if an error occurred.") detect_events;
+    PyObject* detect_events(int channel, double* templ, int size_templ,
+                            const std::vector<int>& sections=std::vector<int>(),
+                            const std::string& mode="criterion", double threshold=4.0,
+                            int min_distance=150, double lowpass=0.5, double highpass=0.0001,
+                            int nthreads=0)
+    {
+        return detect_channel_events(*($self), channel, templ, size_templ, sections, mode,
+                                     threshold, min_distance, lowpass, highpass, nthreads);
+    }
+
+    %feature("autodoc", "Copies several sections of a channel into a single
+    2D numpy array. Sections are copied in parallel, and only the requested
+    range of sampling points is read from memory-mapped files.
+
+    Arguments:
+    channel  -- channel index
+    sections -- list of section indices; all sections if empty
+    start    -- index of the first sampling point
+    stop     -- index past the last sampling point; -1 stops at the end
+                of the shortest section
+    nthreads -- number of sections copied in parallel; 0 uses all processors
+
+    Returns:
+    A numpy array with one row per section, or None if an index
+    is out of range.") get_traces;
+    PyObject* get_traces(int channel, const std::vector<int>& sections=std::vector<int>(),
+                         int start=0, int stop=-1, int nthreads=0)
+    {
+        return get_channel_traces(*($self), channel, sections, start, stop, nthreads);
+    }
+
+    %feature("autodoc", "Copies all sections of all channels into a single
+    3D numpy array of shape (channels, sections, sampling points), e.g. to
+    hand a recording to a machine learning pipeline without a loop over
+    the sections. See Channel.asarray().
+
+    Arguments:
+    nthreads -- number of sections copied in parallel; 0 uses all processors
+
+    Returns:
+    A numpy array. Raises ValueError if the channels have different
+    numbers of sections or if the sections differ in size.") asarray;
+    PyObject* asarray(int nthreads=0) {
+        return recording_array(*($self), nthreads);
+    }
+
+    %feature("autodoc", "Performs a non-stationary fluctuation analysis of
+    several sections of a channel. The ensemble mean and variance are
+    computed in parallel over blocks of sampling points, averaged in bins
+    of the mean current and fitted with var = i*I - I**2/N + background.
+
+    Arguments:
+    channel  -- channel index
+    sections -- list of section indices in the order of recording; all
+                sections if empty
+    start    -- index of the first sampling point
+    stop     -- index past the last sampling point; -1 stops at the end
+                of the shortest section
+    bins     -- number of bins of the mean current
+    pairwise -- compute the variance from differences between consecutive
+                sections, so that slow drifts don't add to it
+    nthreads -- number of threads; 0 uses all processors
+
+    Returns:
+    A dictionary with numpy arrays of the ensemble 'mean' and 'variance',
+    the 'bin_mean', 'bin_variance' and 'bin_count' of every bin, and the
+    single-channel current 'i', the number of channels 'N', the
+    'background' variance and the 'SSE' of the parabola.
+    None if an error occurred.") nsfa;
+    PyObject* nsfa(int channel, const std::vector<int>& sections=std::vector<int>(),
+                   int start=0, int stop=-1, int bins=20, bool pairwise=true, int nthreads=0)
+    {
+        return channel_nsfa(*($self), channel, sections, start, stop, bins, pairwise, nthreads);
+    }
+
+    %feature("autodoc", "Estimates the power spectral density of several
+    sections of a channel with Welch's method. Every section is split into
+    segments that are detrended, multiplied with a Hann window and
+    transformed; their periodograms are averaged. Sections are processed
+    in parallel and read in blocks, so that long gap-free recordings
+    aren't copied as a whole.
+
+    Arguments:
+    channel  -- channel index
+    sections -- list of section indices; all sections if empty
+    segment  -- number of sampling points per segment
+    overlap  -- number of sampling points that consecutive segments share;
+                -1 uses half a segment
+    nthreads -- number of threads; 0 uses all processors
+
+    Returns:
+    A dictionary with a numpy array of the 'frequency' of every bin, in
+    units of the inverse of the x units (kHz for ms), and a 2D numpy array
+    of the one-sided 'density' with a row per section, in y units**2 per
+    frequency unit. The rows of sections that are shorter than a segment
+    are NaN. None if an error occurred.") welch;
+    PyObject* welch(int channel, const std::vector<int>& sections=std::vector<int>(),
+                    int segment=4096, int overlap=-1, int nthreads=0)
+    {
+        return channel_welch(*($self), channel, sections, segment, overlap, nthreads);
+    }
+
+    %feature("autodoc", "Computes the spectrogram of a section, i.e. the
+    power spectral density of consecutive segments. See welch() for how the
+    segments are transformed; they are processed in parallel.
+
+    Arguments:
+    channel  -- channel index
+    section  -- section index
+    segment  -- number of sampling points per segment
+    overlap  -- number of sampling points that consecutive segments share;
+                -1 uses half a segment
+    nthreads -- number of threads; 0 uses all processors
+
+    Returns:
+    A dictionary with numpy arrays of the 'frequency' of every bin and of
+    the start 'time' of every segment, and a 2D numpy array of the
+    'density' with a row per segment. None if an error occurred.") spectrogram;
+    PyObject* spectrogram(int channel, int section, int segment=1024, int overlap=-1, int nthreads=0)
+    {
+        return channel_spectrogram(*($self), channel, section, segment, overlap, nthreads);
+    }
+
+    %feature("autodoc", "Calculates a resistance from a test pulse in every
+    section of a channel, e.g. the series or input resistance of every
+    sweep. Sections are measured in parallel.
+
+    Arguments:
+    channel    -- channel index
+    base_start -- first index (zero-based) of the baseline window
+    base_end   -- last index of the baseline window
+    peak_start -- first index of the response window
+    peak_end   -- last index of the response window
+    amplitude  -- amplitude of the command step
+    sections   -- list of section indices; all sections if empty
+    nthreads   -- number of sections measured in parallel; 0 uses all processors
+
+    Returns:
+    A numpy array with amplitude / (response - baseline) of every
+    section, or None if an error occurred.") resistance;
+    PyObject* resistance(int channel, int base_start, int base_end, int peak_start,
+                         int peak_end, double amplitude,
+                         const std::vector<int>& sections=std::vector<int>(), int nthreads=0)
+    {
+        return channel_resistance(*($self), channel, base_start, base_end, peak_start,
+                                  peak_end, amplitude, sections, nthreads);
+    }
+
+    %feature("autodoc", "Creates an IV from a step protocol in a single
+    parallel pass over the sections of a channel. The k-th section was
+    recorded with commands[k % len(commands)]; responses to the same
+    command are averaged.
+
+    Arguments:
+    channel    -- channel index
+    commands   -- 1D numpy array with the command of every step
+    base_start -- first index (zero-based) of the baseline window
+    base_end   -- last index of the baseline window
+    peak_start -- first index of the response window
+    peak_end   -- last index of the response window
+    sections   -- list of section indices in the order of the protocol;
+                  all sections if empty
+    nthreads   -- number of sections measured in parallel; 0 uses all processors
+
+    Returns:
+    A dictionary of numpy arrays with one entry per command: 'command',
+    'response' (mean response - baseline), 'sd' and 'n'. NaN for
+    commands without sections. None if an error occurred.") iv;
+    PyObject* iv(int channel, double* commands, int size_commands, int base_start,
+                 int base_end, int peak_start, int peak_end,
+                 const std::vector<int>& sections=std::vector<int>(), int nthreads=0)
+    {
+        return channel_iv(*($self), channel, commands, size_commands, base_start, base_end,
+                          peak_start, peak_end, sections, nthreads);
+    }
+
+    %feature("autodoc", "Detects events like detect_events(), but returns
+    them as a table that pyarrow imports without copying the values, e.g.
+    with pyarrow.record_batch(table).to_pandas().
+
+    Returns:
+    An ArrowTable with the columns 'Event' (row label), 'Section'
+    (one-based), 'Time of event onset', 'Time of peak', 'Amplitude' and
+    'Criterion', with times in x units. None if an error occurred.") event_table;
+    PyObject* event_table(int channel, double* templ, int size_templ,
+                          const std::vector<int>& sections=std::vector<int>(),
+                          const std::string& mode="criterion", double threshold=4.0,
+                          int min_distance=150, double lowpass=0.5, double highpass=0.0001,
+                          int nthreads=0)
+    {
+        return channel_event_table(*($self), channel, templ, size_templ, sections, mode,
+                                   threshold, min_distance, lowpass, highpass, nthreads);
+    }
+
+    %feature("autodoc", "Detects events like detect_events() and computes the
+    statistics of their intervals, rates and amplitudes, pooled over the
+    sections. Intervals are only taken between events of the same section.
+
+    Additional arguments:
+    bin_width -- width of the rate bins in x units; 0 divides the longest
+                 section into 20 bins
+
+    Returns:
+    A dictionary with numpy arrays of one entry per event: 'time' (onset
+    within the section), 'interval' (NaN for the first event of a section)
+    and 'frequency' (1/interval); of one entry per bin: 'bin_time',
+    'bin_count' and 'bin_rate' (events per x unit); the sorted arrays
+    'sorted_intervals' and 'sorted_amplitudes', e.g. for ks_test(); and the
+    summary values 'n_events', 'n_sections', 'duration', 'mean_rate',
+    'mean_interval', 'median_interval', 'cv_interval', 'mean_amplitude',
+    'median_amplitude' and 'sd_amplitude'. None if an error occurred.") event_stats;
+    PyObject* event_stats(int channel, double* templ, int size_templ,
+                          const std::vector<int>& sections=std::vector<int>(),
+                          const std::string& mode="criterion", double threshold=4.0,
+                          int min_distance=150, double lowpass=0.5, double highpass=0.0001,
+                          double bin_width=0.0, int nthreads=0)
+    {
+        return channel_event_stats(*($self), channel, templ, size_templ, sections, mode,
+                                   threshold, min_distance, lowpass, highpass, bin_width, nthreads);
+    }
+
+    %feature("autodoc", "Creates an IV like iv(), but returns it as a table
+    that pyarrow imports without copying the values, e.g. with
+    pyarrow.record_batch(table).
+
+    Returns:
+    An ArrowTable with one row per command; commands without sections
+    are null. None if an error occurred.") iv_table;
+    PyObject* iv_table(int channel, double* commands, int size_commands, int base_start,
+                       int base_end, int peak_start, int peak_end,
+                       const std::vector<int>& sections=std::vector<int>(), int nthreads=0)
+    {
+        return channel_iv_table(*($self), channel, commands, size_commands, base_start, base_end,
+                                peak_start, peak_end, sections, nthreads);
+    }
+
+    %feature("autodoc", "Subtracts leak currents with a P over N protocol.
+
+    Arguments:
+    channel -- channel index
+    n       -- number of leak pulses that follow each test pulse; negative
+               if the leak pulses have the opposite polarity
+
+    Returns:
+    A new recording with one corrected section per test pulse, or None
+    if there aren't enough sections.") p_over_n;
+    %newobject p_over_n;
+    Recording* p_over_n(int channel, int n) {
+        Recording* rec = NULL;
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            rec = new Recording($self->MakePoverN(channel, n));
+            rec->CopyAttributes(*($self));
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            delete rec;
+            rec = NULL;
+        }
+        Py_END_ALLOW_THREADS
+        return rec;
     }
 
     %pythoncode {
@@ -187,7 +534,11 @@ class Section {
                 has_pandas = False
             if has_pandas:
                 chnames = [ch.name for ch in self]
-                channels = np.array([np.concatenate([sec for sec in ch]) for ch in self])
+                channels = self.asarray()
+                if channels is not None:
+                    channels = channels.reshape(len(self), -1)
+                else:
+                    channels = np.array([np.concatenate([sec.asarray() for sec in ch]) for ch in self])
                 date_range = pd.date_range(start=self.datetime, periods=channels.shape[1],
                                            freq='%dU' % np.round(self.dt*1e3))
                 return pd.DataFrame(channels.transpose(), index=date_range, columns=chnames)
@@ -268,7 +619,7 @@ class Section {
             return NULL;
         }
         Py_ssize_t listsize = PyList_Size(SectionList);
-        std::deque<Section> SectionCpp(listsize);
+        std::vector<Section*> SectionCpp(listsize);
         
         for (Py_ssize_t i=0; i<listsize; ++i) {
             PyObject* sec0 = PyList_GetItem(SectionList, i);
@@ -278,13 +629,15 @@ class Section {
                 std::cerr << "List doesn't consist of sections\n";
                 return NULL;
             }
-            Section* arg1 = reinterpret_cast< Section * >(argp1);
-
-            SectionCpp[i] = *arg1;
+            SectionCpp[i] = reinterpret_cast< Section * >(argp1);
         }
 
-        // Note that array size is fixed by this allocation:
-        Channel *ch = new Channel(SectionCpp);
+        // Note that array size is fixed by this allocation.
+        // The sections still belong to Python, so they are copied once:
+        Channel *ch = new Channel((std::size_t)listsize);
+        for (Py_ssize_t i=0; i<listsize; ++i) {
+            ch->InsertSection(*SectionCpp[i], i);
+        }
         ch->SetYUnits(yunits_);
 
         return ch;
@@ -304,6 +657,44 @@ class Section {
         }
     }
     int __len__() { return $self->size(); }
+
+    %feature("autodoc", "Returns all sections of the channel as a single 2D
+    numpy array of shape (sections, sampling points).
+
+    If the sections are stored contiguously (see Channel::MakeContiguous()
+    in libstfio), the array is a read-only view of them and nothing is
+    copied. Otherwise, the sections are copied into a new array in
+    parallel, without a copy per section.
+
+    Arguments:
+    nthreads -- number of sections copied in parallel; 0 uses all processors
+
+    Returns:
+    A numpy array. Raises ValueError if the sections differ in size.") asarray;
+    PyObject* asarray(int nthreads=0) {
+        return channel_array(*($self), nthreads);
+    }
+
+    %feature("autodoc", "Stores the sections of the channel in a single
+    buffer, so that asarray() can return a view of them.
+
+    Arguments:
+    nthreads -- number of sections copied in parallel; 0 uses all processors
+
+    Returns:
+    False if the sections differ in size.") make_contiguous;
+    bool make_contiguous(int nthreads=0) {
+        bool success = true;
+        Py_BEGIN_ALLOW_THREADS
+        try {
+            $self->MakeContiguous(nthreads);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            success = false;
+        }
+        Py_END_ALLOW_THREADS
+        return success;
+    }
 }
 
 %{
@@ -350,17 +741,44 @@ class Section {
     }
     int __len__() { return $self->size(); }
 
-    %feature("autodoc", "Returns the section as a numpy array.") asarray;
-    PyObject* asarray() {
-        npy_intp dims[1] = {$self->size()};
-        PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
-        double* gDataP = (double*)array_data(np_array);
+    PyObject* _asarray(PyObject* owner) {
+        return array_view($self->size() ? &($self->get_w()[0]) : NULL, $self->size(), owner);
+    }
 
-        std::copy( $self->get().begin(),
-                   $self->get().end(),
-                   gDataP);
+    PyObject* _span(PyObject* owner) {
+        const double* span = $self->GetSpan();
+        if (span == NULL) {
+            Py_INCREF(Py_None);
+            return Py_None;
+        }
+        PyObject* np_array = array_view((double*)span, $self->size(), owner);
+        if (np_array != NULL) {
+            PyArray_CLEARFLAGS((PyArrayObject*)np_array, NPY_ARRAY_WRITEABLE);
+        }
         return np_array;
-    };
+    }
+
+    %pythoncode {
+        def asarray(self, readonly=False):
+            """Returns the section as a numpy array.
+
+            The array shares its memory with the section, so that no data
+            are copied and changes to the array are written to the section.
+            The array keeps the Recording that owns the section alive.
+            Copies of the section that are made while the array exists
+            share the memory as well.
+
+            With readonly, sections whose data points are stored as doubles,
+            e.g. in shared memory (see stfio.attach), are returned as a
+            read-only array without making a private copy of them; other
+            sections are returned as above.
+            """
+            if readonly:
+                view = self._span(self)
+                if view is not None:
+                    return view
+            return self._asarray(self)
+    }
 }
 
 //--------------------------------------------------------------------
@@ -381,6 +799,64 @@ A recording object.") _read;
 bool _read(const std::string& filename, const std::string& ftype, bool verbose, Recording& Data);
 //--------------------------------------------------------------------
 
+//--------------------------------------------------------------------
+%{
+    bool _attach(const std::string& name, Recording& Data) {
+        return stfio::attachRecording(name, Data);
+    }
+%}
+%feature("autodoc", 0) _attach;
+bool _attach(const std::string& name, Recording& Data);
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%{
+    PyObject* _read_files(const std::vector<std::string>& filenames,
+                          const std::vector<std::string>& ftypes, int nthreads) {
+        std::vector<Recording*> recs = import_files(filenames, ftypes, nthreads);
+        PyObject* rec_list = PyList_New(recs.size());
+        for (std::size_t n_f = 0; n_f < recs.size(); ++n_f) {
+            PyObject* item = Py_None;
+            if (recs[n_f] != NULL) {
+                item = SWIG_NewPointerObj(recs[n_f], SWIGTYPE_p_Recording, SWIG_POINTER_OWN);
+            } else {
+                Py_INCREF(Py_None);
+            }
+            PyList_SET_ITEM(rec_list, n_f, item);
+        }
+        return rec_list;
+    }
+%}
+%feature("autodoc", 0) _read_files;
+%feature("docstring", "Reads several files in parallel and returns a list of
+recording objects; files that couldn't be read give None.") _read_files;
+PyObject* _read_files(const std::vector<std::string>& filenames,
+                      const std::vector<std::string>& ftypes, int nthreads);
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%newobject section_view;
+%feature("autodoc", 0) section_view;
+%feature("kwargs") section_view;
+%feature("docstring", "Creates a section that reads its data points from a
+numpy array in place instead of copying them.
+
+int16, int32, float32 and float64 arrays in native byte order are stored
+as they are, also with strides, e.g. a column of a 2D array; other
+arrays are converted to float64 once. The array is kept alive by the
+section and mustn't be changed while the section exists. Writing to the
+section makes a private copy of its data points.
+
+Arguments:
+nparray -- 1D numpy array
+scale   -- scaling factor applied to the array values on access
+shift   -- offset added to the scaled values
+
+Returns:
+A section, or None if nparray isn't a 1D numpy array.") section_view;
+Section* section_view(PyObject* nparray, double scale=1.0, double shift=0.0);
+//--------------------------------------------------------------------
+
 //--------------------------------------------------------------------
 %feature("autodoc", 0) detect_events;
 %feature("kwargs") detect_events;
@@ -413,6 +889,100 @@ Arguments:
 double risetime(double* invec, int size, double base, double amp, double frac=0.2);
 //--------------------------------------------------------------------
 
+//--------------------------------------------------------------------
+%feature("autodoc", 0) measure;
+%feature("kwargs") measure;
+%feature("docstring", "Applies the measurements of the Stimfit results table
+to a trace. Uses the same implementation as the program and stfbatch.
+
+Arguments:
+invec           -- 1D numpy array with the trace
+dt              -- sampling interval
+base_begin, base_end, peak_begin, peak_end
+                -- baseline and peak cursors in sampling points (inclusive)
+baseline_method -- 'mean' or 'median'
+peak_points     -- number of sampling points for the running peak average
+direction       -- 'up', 'down' or 'both'
+rise_factor     -- lower limit of the rise time in percent (20 for 20-80%)
+from_base       -- measure the amplitude from the baseline rather than from the threshold
+slope           -- slope defining the threshold, in y units per x unit
+
+Returns:
+A dictionary with the results. Indices are given in sampling points,
+rise times, half duration and slopes in x units. None if the cursors
+don't fit into the trace.
+") measure;
+PyObject* measure(double* invec, int size, double dt, int base_begin, int base_end,
+                  int peak_begin, int peak_end, const std::string& baseline_method="mean",
+                  int peak_points=1, const std::string& direction="both", double rise_factor=20.0,
+                  bool from_base=true, double slope=20.0);
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) decimate;
+%feature("kwargs") decimate;
+%feature("docstring", "Reduces a trace to the extrema of pixel columns for
+plotting. Uses the same min/max pyramid as the program's graph, so that
+long traces are reduced in a fraction of the time of a Python loop.
+
+Arguments:
+invec   -- 1D numpy array with the trace
+columns -- number of pixel columns; point n falls into column
+           n*columns/len(invec)
+
+Returns:
+A tuple of two numpy arrays: the column and the value of each point of
+a polyline that enters every column at its first point, covers the range
+between its extrema and leaves it at its last point. None if the trace
+is empty or columns is not positive.
+") decimate;
+PyObject* decimate(double* invec, int size, int columns);
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%rename(set_threads) stfio::setThreadCount;
+%rename(get_threads) stfio::getThreadCount;
+%feature("autodoc", 0) stfio::setThreadCount;
+%feature("docstring", "Sets the number of threads of all parallel imports
+and analyses that aren't given a number of threads of their own.
+
+Arguments:
+n -- number of threads; 0 restores the default, i.e. the value of the
+     environment variable STFIO_NUM_THREADS if it is set, or the number
+     of processors otherwise
+") stfio::setThreadCount;
+%feature("autodoc", 0) stfio::getThreadCount;
+%feature("docstring", "Returns the number of threads of parallel imports
+and analyses (see set_threads).
+") stfio::getThreadCount;
+namespace stfio {
+void setThreadCount(int n);
+int getThreadCount();
+}
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) ks_test;
+%feature("docstring", "Compares two samples with the two-sample Kolmogorov-Smirnov
+test, e.g. the 'sorted_intervals' of Recording.event_stats() of two cells.
+
+Arguments:
+invec -- 1D numpy array with the first sample
+data  -- 1D numpy array with the second sample
+
+Returns:
+A tuple of the largest distance between the cumulative distributions
+and its asymptotic p value; both NaN if a sample is empty.
+") ks_test;
+PyObject* ks_test(double* invec, int size, double* data, int size_data);
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%rename(_arrow_c_array) arrow_c_array;
+%feature("autodoc", 0) arrow_c_array;
+PyObject* arrow_c_array(PyObject* table);
+//--------------------------------------------------------------------
+
 //--------------------------------------------------------------------
 %pythoncode {
 import os
@@ -425,13 +995,31 @@ class StfIOException(Exception):
     def __str__(self):
         return repr(self.msg)
 
+class ArrowTable(object):
+    """A table of results that implements the Arrow PyCapsule interface,
+    so that pyarrow, polars or pandas import it without copying the values:
+
+    >>> batch = pyarrow.record_batch(rec.event_table(0, templ))
+
+    Each import shares a copy of the table that is made once per import.
+    """
+    def __init__(self, table):
+        self._table = table
+
+    def __arrow_c_array__(self, requested_schema=None):
+        return _arrow_c_array(self._table)
+
 filetype = {
     '.dat':'cfs',
     '.h5':'hdf5',
     '.abf':'abf',
     '.atf':'atf',
     '.axgd':'axg',
-    '.axgx':'axg'}
+    '.axgx':'axg',
+    '.tdms':'tdms',
+    '.nwb':'nwb',
+    '.zarr':'zarr',
+    '.smr':'son'}
 
 def read(fname, ftype=None, verbose=False):
     """Reads a file and returns a Recording object.
@@ -446,6 +1034,10 @@ def read(fname, ftype=None, verbose=False):
               "atf"  - Axon text file
               "axg"  - Axograph X binary file
               "heka" - HEKA binary file
+              "tdms" - National Instruments TDMS file
+              "nwb"  - Neurodata Without Borders (NWB 2.x) file
+              "zarr" - Zarr store (a directory or a registered URL)
+              "son"  - CED Spike2 (32-bit SON) file
               if ftype is None (default), it will be guessed from the
               extension.
 #else
@@ -481,51 +1073,85 @@ def read(fname, ftype=None, verbose=False):
     return rec
 
 
+def read_files(fnames, ftype=None, nthreads=0):
+    """Reads several files in parallel and returns a list of Recording objects.
+
+    Arguments:
+    fnames   -- list of file names
+#ifndef TEST_MINIMAL
+    ftype    -- file type (string) of all files, see read(); if ftype is
+                None (default), it will be guessed from each extension.
+#else
+    ftype    -- file type (string) is obsolete, see read().
+#endif // TEST_MINIMAL
+    nthreads -- maximal number of files that are read at the same time;
+                0 (default) uses one thread per processor.
+
+    Returns:
+    A list of Recording objects in the order of fnames.
+    """
+    ftypes = []
+    for fname in fnames:
+        if not os.path.exists(fname):
+            raise StfIOException('File %s does not exist' % fname)
+#ifndef TEST_MINIMAL
+        if ftype is None:
+            ext = os.path.splitext(fname)[1]
+            try:
+                ftypes.append(filetype[ext])
+            except KeyError:
+                raise StfIOException('Couldn\'t guess file type from extension (%s)' % ext)
+        else:
+            ftypes.append(ftype)
+#else
+        ftypes.append('')
+#endif // TEST_MINIMAL
+
+    recs = _read_files(list(fnames), ftypes, nthreads)
+    for fname, rec in zip(fnames, recs):
+        if rec is None:
+            raise StfIOException('Error reading file %s' % fname)
+    return recs
+
+
+def attach(name):
+    """Attaches to a recording that another process has put into shared
+    memory with stfio.SharedRecording, e.g. for the workers of a
+    multiprocessing pool. The sections read the shared memory in place;
+    use Section.asarray(readonly=True) to access them without copies.
+
+    Arguments:
+    name -- name of the shared memory
+
+    Returns:
+    A Recording object.
+    """
+    rec = Recording()
+    if not _attach(name, rec):
+        raise StfIOException('Couldn\'t attach to shared memory %s' % name)
+    return rec
+
+
 def read_tdms(fn):
-    import numpy as np
-    import sys
-    try:
-        from nptdms import TdmsFile
-    except ImportError:
-        sys.stderr.write("nptdms module unavailable")
-        return None
+    """Reads a TDMS file with the native importer.
 
-    tdms_file = TdmsFile(fn)
+    Arguments:
+    fn -- file name
 
+    Returns:
+    A dictionary with the entries 'data', a list of channels that each
+    hold a list of sections as numpy arrays, and 'dt', the sampling
+    interval. The arrays share their memory with the sections of the
+    imported Recording. None if the file can't be read.
+    """
     try:
-        times = np.array(
-            [[channel.data
-              for channel in tdms_file.group_channels(group)
-              if channel.data is not None]
-             for group in tdms_file.groups()
-             if group.lower() == "time"][0][0])
-        dt = np.mean(np.diff(times))
-    except IndexError:
-        if not "Sampling Rate" in tdms_file.object().properties.keys():
-            if not "Sampling Rate(AI)" in tdms_file.object().properties.keys():
-                dt = 1.0
-            else:
-                sr = float(tdms_file.object().properties['Sampling Rate(AI)'])
-                if sr > 0:
-                    dt = 1e3/sr
-                else:
-                    dt = 1.0/25.0
-        else:
-            sr = float(tdms_file.object().properties['Sampling Rate'])
-            if sr > 0:
-                dt = 1e3/sr
-            else:
-                dt = 1.0/25.0
-
-    return_dict = {
-        "data": [
-            [channel.data.astype(np.float64)
-             for channel in tdms_file.group_channels(group)
-             if channel.data is not None]
-                 for group in tdms_file.groups()
-            if group.lower()[:2] == "ai" or group.lower()[:2] == "ao"],
-        "dt": dt,
-    }
-    return return_dict
+        rec = read(fn, 'tdms')
+    except StfIOException:
+        return None
+
+    return {
+        "data": [[sec.asarray() for sec in ch] for ch in rec],
+        "dt": rec.dt,
+    }
 }
 //--------------------------------------------------------------------
@@ -16,8 +16,30 @@ import numpy as np
 
 import stfio
 
+def _channels(signal):
+    """Yields the channels of a neo analog signal as 1D views of its data."""
+    magnitude = signal.magnitude
+    if magnitude.ndim == 1:
+        yield magnitude
+    else:
+        for nc in range(magnitude.shape[1]):
+            yield magnitude[:, nc]
+
+def _units(units):
+    """Converts a unit string of stfio to a quantity; unknown units are
+    dimensionless."""
+    import quantities as pq
+    try:
+        return pq.Quantity(1.0, units)
+    except (LookupError, ValueError):
+        return pq.dimensionless
+
 def neo2stfio(neo_obj):
     """Convert neo object to stfio recording.
+       The sections read the data of the neo signals in place, so that
+       no data are copied; int16, int32, float32 and float64 signals keep
+       their sample type. Signals with several channels are split into
+       stfio channels.
        Restrictions:
        * Only converts the first block
        * Assumes that the sampling rate is constant throughout segments
@@ -39,16 +61,61 @@ def neo2stfio(neo_obj):
 
     reference_signal = blocks[0].segments[0].analogsignals
 
-    nchannels = len(reference_signal)
+    units = []
+    for signal in reference_signal:
+        for column in _channels(signal):
+            units.append(signal.units.dimensionality.string)
+
+    sections = [[] for nc in range(len(units))]
+    for seg in blocks[0].segments:
+        nc = 0
+        for signal in seg.analogsignals:
+            for column in _channels(signal):
+                sections[nc].append(stfio.section_view(column))
+                nc += 1
 
     rec = stfio.Recording([
-        stfio.Channel([
-            stfio.Section(np.array(seg.analogsignals[nc], dtype=np.float64))
-            for seg in blocks[0].segments
-        ], reference_signal[nc].units.dimensionality.string)
-        for nc in range(nchannels)
+        stfio.Channel(sections[nc], units[nc])
+        for nc in range(len(units))
     ])
     rec.dt = float(reference_signal[0].sampling_period.rescale('ms'))
     rec.xunits = "ms"
 
     return rec
+
+def stfio2neo(rec):
+    """Convert stfio recording to a neo block.
+       Every section becomes an analog signal of a segment; the signals
+       are numpy views of the sections (see stfio.Section.asarray), so that
+       no data are copied, and they keep the recording alive.
+
+       Usage:
+           >>> import stfio
+           >>> rec = stfio.read("filename.h5")
+           >>> block = stfio.neo.stfio2neo(rec)
+           >>> assert(block.segments[0].analogsignals[0][0] == rec[0][0][0])
+    """
+    import neo
+
+    sampling_period = rec.dt * _units(rec.xunits)
+    block = neo.Block(name=rec.file_description)
+    nsections = max([len(ch) for ch in rec] + [0])
+    for ns in range(nsections):
+        seg = neo.Segment(index=ns)
+        for ch in rec:
+            if ns >= len(ch):
+                continue
+            data = ch[ns].asarray().reshape(-1, 1)
+            try:
+                signal = neo.AnalogSignal(data, units=_units(ch.yunits),
+                                          sampling_period=sampling_period,
+                                          name=ch.name, copy=False)
+            except (TypeError, ValueError):
+                # newer versions of neo never copy and don't take the argument:
+                signal = neo.AnalogSignal(data, units=_units(ch.yunits),
+                                          sampling_period=sampling_period,
+                                          name=ch.name)
+            seg.analogsignals.append(signal)
+        block.segments.append(seg)
+
+    return block
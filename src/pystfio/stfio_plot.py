@@ -435,47 +435,48 @@ def yFormat(y):
     return y
 
 
+def _decimate(ydata, columns):
+    """Reduces ydata to the first point, the extrema and the last point
+    of each pixel column; see stfio.decimate()."""
+    try:
+        try:
+            from . import stfio
+        except (ImportError, ValueError):
+            # imported as a standalone module
+            from stfio import stfio
+        return stfio.decimate(ydata, columns)
+    except ImportError:
+        pass
+
+    col = np.arange(len(ydata)) * columns // len(ydata)
+    starts = np.flatnonzero(np.r_[True, col[1:] != col[:-1]])
+    ends = np.r_[starts[1:], len(ydata)]
+    yrange = np.column_stack((
+        ydata[starts], np.minimum.reduceat(ydata, starts),
+        np.maximum.reduceat(ydata, starts), ydata[ends-1])).ravel()
+    return np.repeat(col[starts], 4), yrange
+
+
 def reduce(ydata, dy, maxres, xoffset=0, width=graph_width):
-    x_last = xFormat(0, maxres, len(ydata), width)
-    y_last = yFormat(ydata[0])
-    y_max = y_last
-    y_min = y_last
-    x_next = 0
-    y_next = 0
-    xrange = list()
-    yrange = list()
-    xrange.append(x_last)
-    yrange.append(y_last)
-    for (n, pt) in enumerate(ydata[:-1]):
-        x_next = xFormat(n+1, maxres, len(ydata), width)
-        y_next = yFormat(ydata[n+1])
-        # if we are still at the same pixel column,
-        # only draw if this is an extremum:
-        if (x_next == x_last):
-            if (y_next < y_min):
-                y_min = y_next
-            if (y_next > y_max):
-                y_max = y_next
-        else:
-            # else, always draw and reset extrema:
-            if (y_min != y_next):
-                xrange.append(x_last)
-                yrange.append(y_min)
-                y_last = y_min
-            if (y_max != y_next):
-                xrange.append(x_last)
-                yrange.append(y_max)
-                y_last = y_max
-            xrange.append(x_next)
-            yrange.append(y_next)
-            y_min = y_next
-            y_max = y_next
-            x_last = x_next
-            y_last = y_next
+    """Reduces a trace to the extrema of pixel columns, like the program's graph.
+
+    Arguments:
+    ydata   -- the trace
+    dy      -- sampling interval
+    maxres  -- resolution in pixel columns per width unit
+    xoffset -- x position of the first sampling point
+    width   -- width of the graph
+
+    Returns:
+    A tuple of x and y values of the reduced trace.
+    """
+    columns = max(int(width/2.5 * maxres), 1)
+    xrange, yrange = _decimate(
+        np.ascontiguousarray(ydata, dtype=np.float64), columns)
     trace_len_pts = width/2.5 * maxres
     trace_len_time = len(ydata) * dy
     dt_per_pt = trace_len_time / trace_len_pts
-    xrange = np.array(xrange)*dt_per_pt + xoffset
+    xrange = xrange*dt_per_pt + xoffset
 
     return xrange, yrange
 
@@ -58,6 +58,16 @@ class DataListTest(unittest.TestCase):
     #     # test if Recording object was created
     #     self.assertTrue(True, isinstance(rec, stfio.Recording))
 
+    def testReadFiles(self):
+        """ testReadFiles() Read several files in parallel """
+        recs = stfio.read_files(['test.h5', 'test.h5', 'test.h5'], nthreads=2)
+        self.assertEquals(3, len(recs))
+        for rec_par in recs:
+            self.assertEquals(len(rec), len(rec_par))
+            self.assertEquals(rec[0][0][100], rec_par[0][0][100])
+
+        self.assertRaises(stfio.StfIOException, stfio.read_files, ['test.h5', 'test.txt'])
+
     def testReadStfException(self):
         """ Raises a StfException if file format to read is not supported"""
 
@@ -96,6 +106,56 @@ class DataListTest(unittest.TestCase):
         """ testArrayCreation() creation of a numpy array""" 
         self.assertTrue(type(rec[0][0].asarray()), type(np.empty(0)))
 
+    def testArrayView(self):
+        """ testArrayView() numpy arrays share memory with the recording """
+        rec_view = stfio.read('test.h5')
+        arr = rec_view[0][1].asarray()
+        arr[10] = 42.0
+        self.assertEquals(42.0, rec_view[0][1][10])
+        self.assertEquals(42.0, rec_view[0][1].asarray()[10])
+        # the array keeps the recording alive:
+        del rec_view
+        self.assertEquals(42.0, arr[10])
+
+    def testChannelArray(self):
+        """ testChannelArray() copies whole channels and recordings at once """
+        rec_arr = stfio.read('test.h5')
+        arr = rec_arr[1].asarray()
+        self.assertEquals((len(rec_arr[1]), len(rec_arr[1][0])), arr.shape)
+        self.assertTrue(np.all(arr[2] == rec_arr[1][2].asarray()))
+        self.assertTrue(arr.flags.writeable)
+        all_arr = rec_arr.asarray()
+        self.assertEquals((len(rec_arr),) + arr.shape, all_arr.shape)
+        self.assertTrue(np.all(all_arr[1] == arr))
+        # contiguous channels are returned as read-only views:
+        self.assertTrue(rec_arr[1].make_contiguous())
+        view = rec_arr[1].asarray()
+        self.assertFalse(view.flags.writeable)
+        self.assertTrue(np.all(view == arr))
+        # the view keeps its data when the channel is changed:
+        rec_arr[1][2].asarray()[0] = 42.0
+        del rec_arr
+        self.assertTrue(np.all(view == arr))
+
+    def testChannelArraySizes(self):
+        """ testChannelArraySizes() sections of different sizes raise ValueError """
+        ragged = stfio.Channel([stfio.Section(np.zeros(10)), stfio.Section(np.zeros(5))])
+        self.assertRaises(ValueError, ragged.asarray)
+        self.assertRaises(ValueError, stfio.Recording([ragged]).asarray)
+        uneven = stfio.Recording([stfio.Channel([stfio.Section(np.zeros(10))]),
+                                  stfio.Channel([stfio.Section(np.zeros(10))]*2)])
+        self.assertRaises(ValueError, uneven.asarray)
+
+    def testMeasure(self):
+        """ testMeasure() returns the measurements of the results table """
+        trace = np.zeros(1000)
+        trace[400:] = 5.0*np.exp(-np.arange(600)/100.0)
+        res = stfio.measure(trace, 0.1, 0, 300, 350, 900, direction='up')
+        self.assertAlmostEquals(0.0, res['base'])
+        self.assertAlmostEquals(5.0, res['peak'])
+        self.assertEquals(400, res['peak_index'])
+        self.assertEquals(None, stfio.measure(np.zeros(0), 0.1, 0, 300, 350, 900))
+
     def testChannelName(self):
         """ testChannelName() returns the names of the channels """
         names = [rec[i].name for i in range(len(rec))]
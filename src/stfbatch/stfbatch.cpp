@@ -0,0 +1,963 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file stfbatch.cpp
+ *  \brief Headless batch analysis of many files with the measurements of wxStfDoc::Measure().
+ *
+ *  Usage: stfbatch -c settings.cfg [-o results.csv|results.h5|results.parquet] [-j threads] [-t type] files...
+ *         stfbatch -c settings.cfg -w folder [-x abf,dat] [-i seconds] [-e h5folder] ...
+ *         stfbatch -m [-f list.txt] [-o merged.csv] shard1.csv shard2.parquet...
+ *
+ *  The settings file contains lines of the form "key = value"; everything
+ *  after a '#' is ignored. Cursor positions are given in x units (usually ms)
+ *  and include both ends, as in the cursor dialog. Recognized keys:
+ *  - channel, reference_channel (-1 for none): channel indices
+ *  - base_begin, base_end, peak_begin, peak_end: cursor positions
+ *  - baseline_method: mean or median
+ *  - peak_points: number of points for the running peak average
+ *  - direction: up, down or both
+ *  - rise_factor: lower limit of the rise time in percent (e.g. 20 for 20-80%)
+ *  - from_base: measure amplitudes from the baseline (true) or from the threshold (false)
+ *  - slope_threshold: slope defining the threshold, in y units per x unit
+ *  - latency_start: manual, peak, rise or half (measured in the reference channel)
+ *  - latency_end: manual, foot, rise, half or peak
+ *  - latency_begin, latency_finish: latency cursors in manual mode
+ *  - window: name peak_begin peak_end [base_begin base_end]; may be given
+ *    several times to measure several responses per section in one pass,
+ *    e.g. for paired pulses. Windows without their own baseline cursors use
+ *    base_begin and base_end. The output then has a column with the index of
+ *    the window, in the order of the settings file.
+ *
+ *  Events are detected rather than measured if an event template is given:
+ *  - event_template: text file with the template waveform, normalized to a peak of -1
+ *  - event_mode: criterion, correlation or deconvolution
+ *  - event_threshold: detection threshold
+ *  - event_min_distance: minimal distance between events in sampling points
+ *  - event_lowpass, event_highpass: filter cutoffs of the deconvolution in kHz
+ *
+ *  Responses to a train of pulses are measured if train_pulses is given;
+ *  the baseline and peak cursors are then ignored:
+ *  - train_pulses: number of pulses
+ *  - train_onset, train_interval: time of the first pulse and interval between pulses
+ *  - train_base_length: duration of the baseline before a pulse
+ *  - train_peak_delay: time after a pulse that is skipped, e.g. for the stimulus artifact
+ *  - train_baseline: first, local or extrapolated (from the decay of the previous response)
+ *  - train_latency: end of the latency from each pulse: foot, rise, half or peak
+ *  A channel of -1 analyses all channels of a file.
+ *
+ *  The output has one row per section, one row per event or one row per pulse, labelled with
+ *  the file name. The rows of each file are written as soon as the file has
+ *  been analysed (see stfio::TableStream), so that memory use doesn't grow
+ *  with the number of files and an interrupted run keeps its results.
+ *
+ *  With -w, stfbatch keeps running as an acquisition service: the given
+ *  folders are polled for new files (see stfio::FolderWatcher), which are
+ *  analysed as soon as the acquisition program has closed them. At most two
+ *  files per thread are taken per poll, so that files queue up on disk
+ *  rather than in memory if acquisition outpaces the analysis, and files
+ *  with the same contents as a file that has already been analysed are
+ *  skipped. The results are flushed after every poll; SIGINT or SIGTERM
+ *  closes the output and ends the program.
+ *
+ *  Large file lists can be spread over the nodes of a cluster, e.g. as an
+ *  array job: every node reads the same list with -f and analyses its own
+ *  shard with -s k/N, writing a CSV table of its own. Files that fail are
+ *  tried again (-r) and listed with -F, so that they can be resubmitted.
+ *  stfbatch -m then merges the tables of all shards into one, with the
+ *  rows in the order of the file list.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include <csignal>
+#include <climits>
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+
+#include "../libstfio/stfio.h"
+#include "../libstfio/recording.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/section.h"
+#include "../libstfio/tablestream.h"
+#include "../libstfio/parquet.h"
+#include "../libstfio/folderwatch.h"
+#include "../libstfio/parallel.h"
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/measure.h"
+#include "../libstfnum/events.h"
+#include "../libstfnum/train.h"
+
+namespace {
+
+//! Cursors of a measurement window; NaN baseline cursors use those of the settings.
+struct WindowSettings {
+    std::string name;
+    double base_begin, base_end, peak_begin, peak_end;
+};
+
+//! Settings that are read from the configuration file.
+struct BatchSettings {
+    BatchSettings() :
+        channel(0), reference_channel(-1),
+        base_begin(0), base_end(0), peak_begin(0), peak_end(0),
+        baseline_method(stfnum::mean_sd), peak_points(1), direction(stfnum::both),
+        rise_factor(20.0), from_base(true), slope_threshold(0),
+        latency_start(stfnum::manual_latency), latency_end(stfnum::manual_latency),
+        latency_begin(0), latency_finish(0), events(),
+        train_pulses(0), train_onset(0), train_interval(0), train_base_length(0),
+        train_peak_delay(0), train_baseline(stfnum::train_baseline_extrapolated),
+        train_latency(stfnum::half_latency)
+    {}
+
+    int channel, reference_channel;
+    double base_begin, base_end, peak_begin, peak_end;
+    stfnum::baseline_method baseline_method;
+    int peak_points;
+    stfnum::direction direction;
+    double rise_factor;
+    bool from_base;
+    double slope_threshold;
+    stfnum::latency_mode latency_start, latency_end;
+    double latency_begin, latency_finish;
+    std::string event_template;
+    stfnum::EventDetectionPlan events;
+    std::vector<WindowSettings> windows;
+    int train_pulses;
+    double train_onset, train_interval, train_base_length, train_peak_delay;
+    stfnum::train_baseline train_baseline;
+    stfnum::latency_mode train_latency;
+};
+
+//! Kinds of analysis, chosen from the settings.
+enum batch_mode {
+    mode_measure,
+    mode_events,
+    mode_train
+};
+
+//! Results for a single window of a section.
+struct SectionResults {
+    std::size_t section, window;
+    double base, base_sd, peak, amplitude, threshold, peak_time, rise_time,
+        half_duration, max_rise, max_decay, slope_ratio, latency;
+};
+
+const char* const result_columns[] = {
+    "base", "base_sd", "peak", "amplitude", "threshold", "peak_time", "rise_time",
+    "half_duration", "max_rise", "max_decay", "slope_ratio", "latency"
+};
+const std::size_t n_result_columns = sizeof(result_columns)/sizeof(result_columns[0]);
+
+//! All results of a file.
+struct FileResults {
+    std::vector<SectionResults> sections;
+    stfnum::EventTable events;
+    stfnum::TrainTable train;
+    std::string error;
+};
+
+std::string trim(const std::string& str) {
+    std::size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    std::size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end-begin+1);
+}
+
+double toDouble(const std::string& value, const std::string& key) {
+    char* end = NULL;
+    double result = strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0') {
+        throw std::runtime_error("Invalid number for " + key + ": " + value);
+    }
+    return result;
+}
+
+stfnum::latency_mode toLatencyMode(const std::string& value, const std::string& key) {
+    if (value == "manual") return stfnum::manual_latency;
+    if (value == "peak") return stfnum::peak_latency;
+    if (value == "rise") return stfnum::rise_latency;
+    if (value == "half") return stfnum::half_latency;
+    if (value == "foot" && key == "latency_end") return stfnum::foot_latency;
+    throw std::runtime_error("Invalid mode for " + key + ": " + value);
+}
+
+// Reads a template waveform from a text file with one or more values per line.
+Vector_double readTemplate(const std::string& fName) {
+    std::ifstream file(fName.c_str());
+    if (!file) {
+        throw std::runtime_error("Couldn't open event template " + fName);
+    }
+    Vector_double templ;
+    double value;
+    while (file >> value) {
+        templ.push_back(value);
+    }
+    if (!file.eof() || templ.empty()) {
+        throw std::runtime_error("Invalid event template " + fName);
+    }
+    return templ;
+}
+
+// Reads "name peak_begin peak_end [base_begin base_end]".
+WindowSettings toWindow(const std::string& value) {
+    std::istringstream fields(value);
+    WindowSettings window;
+    window.base_begin = window.base_end = NAN;
+    if (!(fields >> window.name >> window.peak_begin >> window.peak_end)) {
+        throw std::runtime_error("Invalid window: " + value);
+    }
+    if (fields >> window.base_begin) {
+        if (!(fields >> window.base_end)) {
+            throw std::runtime_error("Invalid window: " + value);
+        }
+    }
+    std::string rest;
+    if (fields >> rest) {
+        throw std::runtime_error("Invalid window: " + value);
+    }
+    return window;
+}
+
+BatchSettings readSettings(const std::string& fName) {
+    std::ifstream file(fName.c_str());
+    if (!file) {
+        throw std::runtime_error("Couldn't open settings file " + fName);
+    }
+    BatchSettings settings;
+    std::string line;
+    int n_line = 0;
+    while (std::getline(file, line)) {
+        ++n_line;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        std::size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::ostringstream error;
+            error << fName << ", line " << n_line << ": expected \"key = value\"";
+            throw std::runtime_error(error.str());
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq+1));
+        if (key == "channel") settings.channel = (int)toDouble(value, key);
+        else if (key == "reference_channel") settings.reference_channel = (int)toDouble(value, key);
+        else if (key == "base_begin") settings.base_begin = toDouble(value, key);
+        else if (key == "base_end") settings.base_end = toDouble(value, key);
+        else if (key == "peak_begin") settings.peak_begin = toDouble(value, key);
+        else if (key == "peak_end") settings.peak_end = toDouble(value, key);
+        else if (key == "peak_points") settings.peak_points = (int)toDouble(value, key);
+        else if (key == "rise_factor") settings.rise_factor = toDouble(value, key);
+        else if (key == "slope_threshold") settings.slope_threshold = toDouble(value, key);
+        else if (key == "latency_begin") settings.latency_begin = toDouble(value, key);
+        else if (key == "latency_finish") settings.latency_finish = toDouble(value, key);
+        else if (key == "latency_start") settings.latency_start = toLatencyMode(value, key);
+        else if (key == "latency_end") settings.latency_end = toLatencyMode(value, key);
+        else if (key == "event_template") settings.event_template = value;
+        else if (key == "window") settings.windows.push_back(toWindow(value));
+        else if (key == "event_threshold") settings.events.threshold = toDouble(value, key);
+        else if (key == "event_min_distance") settings.events.minDistance = (int)toDouble(value, key);
+        else if (key == "event_lowpass") settings.events.lowpass = toDouble(value, key);
+        else if (key == "event_highpass") settings.events.highpass = toDouble(value, key);
+        else if (key == "train_pulses") settings.train_pulses = (int)toDouble(value, key);
+        else if (key == "train_onset") settings.train_onset = toDouble(value, key);
+        else if (key == "train_interval") settings.train_interval = toDouble(value, key);
+        else if (key == "train_base_length") settings.train_base_length = toDouble(value, key);
+        else if (key == "train_peak_delay") settings.train_peak_delay = toDouble(value, key);
+        else if (key == "train_latency") settings.train_latency = toLatencyMode(value, "latency_end");
+        else if (key == "train_baseline") {
+            if (value == "first") settings.train_baseline = stfnum::train_baseline_first;
+            else if (value == "local") settings.train_baseline = stfnum::train_baseline_local;
+            else if (value == "extrapolated") settings.train_baseline = stfnum::train_baseline_extrapolated;
+            else throw std::runtime_error("Invalid train baseline: " + value);
+        }
+        else if (key == "event_mode") {
+            if (value == "criterion") settings.events.mode = stfnum::detect_criterion;
+            else if (value == "correlation") settings.events.mode = stfnum::detect_correlation;
+            else if (value == "deconvolution") settings.events.mode = stfnum::detect_deconvolution;
+            else throw std::runtime_error("Invalid event detection mode: " + value);
+        }
+        else if (key == "baseline_method") {
+            if (value == "mean") settings.baseline_method = stfnum::mean_sd;
+            else if (value == "median") settings.baseline_method = stfnum::median_iqr;
+            else throw std::runtime_error("Invalid baseline method: " + value);
+        }
+        else if (key == "direction") {
+            if (value == "up") settings.direction = stfnum::up;
+            else if (value == "down") settings.direction = stfnum::down;
+            else if (value == "both") settings.direction = stfnum::both;
+            else throw std::runtime_error("Invalid direction: " + value);
+        }
+        else if (key == "from_base") {
+            if (value == "true" || value == "1") settings.from_base = true;
+            else if (value == "false" || value == "0") settings.from_base = false;
+            else throw std::runtime_error("Invalid value for from_base: " + value);
+        }
+        else {
+            std::ostringstream error;
+            error << fName << ", line " << n_line << ": unknown key " << key;
+            throw std::runtime_error(error.str());
+        }
+    }
+    if (settings.peak_points < 1) {
+        settings.peak_points = 1;
+    }
+    if (!settings.event_template.empty()) {
+        settings.events.templ = readTemplate(settings.event_template);
+    }
+    return settings;
+}
+
+// Converts a cursor position from x units to a sample index within the section.
+std::size_t toIndex(double x, double dt, std::size_t size) {
+    long index = lround(x/dt);
+    if (index < 0) return 0;
+    if ((std::size_t)index >= size) return size-1;
+    return (std::size_t)index;
+}
+
+// Converts results to the units of the output.
+SectionResults sectionResults(const BatchSettings& settings, const stfnum::MeasurementResults& res,
+                              double dt)
+{
+    SectionResults results;
+    results.base = res.base;
+    results.base_sd = res.baseSD;
+    results.peak = res.peak;
+    double reference = res.base;
+    if (!settings.from_base && res.thrT >= 0) {
+        reference = res.threshold;
+    }
+    results.amplitude = res.peak-reference;
+    results.threshold = res.threshold;
+    results.peak_time = res.maxT*dt;
+    results.rise_time = res.rtLoHi;
+    results.half_duration = res.halfDuration;
+    results.max_rise = res.maxRise;
+    results.max_decay = res.maxDecay;
+    results.slope_ratio = res.slopeRatio;
+    results.latency = res.latency*dt;
+    return results;
+}
+
+// Applies the same measurements as wxStfDoc::Measure() with every window.
+// Throws std::out_of_range if the section is empty.
+std::vector<SectionResults> measureSection(const BatchSettings& settings, const Section& sec,
+                                           std::size_t n_s, const Section* refsec, double dt)
+{
+    if (settings.latency_start != stfnum::manual_latency && (refsec == NULL || refsec->size() == 0)) {
+        throw std::out_of_range("Latency start mode requires a reference channel");
+    }
+    stfnum::MeasurementPlan plan;
+    // inner and outer rise times aren't written to the results:
+    plan.measurements = stfnum::measure_peak | stfnum::measure_threshold | stfnum::measure_risetime |
+        stfnum::measure_half_duration | stfnum::measure_slopes | stfnum::measure_latency;
+    plan.baseBeg = toIndex(settings.base_begin, dt, sec.size());
+    plan.baseEnd = toIndex(settings.base_end, dt, sec.size());
+    plan.peakBeg = toIndex(settings.peak_begin, dt, sec.size());
+    plan.peakEnd = toIndex(settings.peak_end, dt, sec.size());
+    plan.baselineMethod = settings.baseline_method;
+    plan.pM = settings.peak_points;
+    plan.dir = settings.direction;
+    plan.RTFactor = settings.rise_factor;
+    plan.fromBase = settings.from_base;
+    plan.slopeForThreshold = settings.slope_threshold;
+    plan.latencyStartMode = settings.latency_start;
+    plan.latencyEndMode = settings.latency_end;
+    plan.latencyBeg = settings.latency_begin/dt;
+    plan.latencyEnd = settings.latency_finish/dt;
+
+    // the settings' cursors are the only window if no windows are given:
+    stfnum::MultiWindowPlan windows;
+    for (std::size_t n_w = 0; n_w < settings.windows.size(); ++n_w) {
+        const WindowSettings& w = settings.windows[n_w];
+        stfnum::MeasurementPlan wplan(plan);
+        wplan.peakBeg = toIndex(w.peak_begin, dt, sec.size());
+        wplan.peakEnd = toIndex(w.peak_end, dt, sec.size());
+        if (!std::isnan(w.base_begin)) {
+            wplan.baseBeg = toIndex(w.base_begin, dt, sec.size());
+            wplan.baseEnd = toIndex(w.base_end, dt, sec.size());
+        }
+        windows.Add(w.name, wplan);
+    }
+    if (windows.windows.empty()) {
+        windows.Add("", plan);
+    }
+    std::vector<stfnum::MeasurementResults> res = windows.Evaluate(sec, dt, refsec);
+
+    std::vector<SectionResults> results(res.size());
+    for (std::size_t n_w = 0; n_w < res.size(); ++n_w) {
+        results[n_w] = sectionResults(settings, res[n_w], dt);
+        results[n_w].section = n_s;
+        results[n_w].window = n_w;
+    }
+    return results;
+}
+
+// Measures all sections of a recording.
+void measureRecording(const BatchSettings& settings, const Recording& rec, FileResults& results) {
+    if (settings.channel < 0 || (std::size_t)settings.channel >= rec.size()) {
+        throw std::out_of_range("Channel index out of range");
+    }
+    if (settings.reference_channel >= (int)rec.size()) {
+        throw std::out_of_range("Reference channel index out of range");
+    }
+    const Channel& ch = rec[settings.channel];
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        const Section* refsec = NULL;
+        if (settings.reference_channel >= 0 && n_s < rec[settings.reference_channel].size()) {
+            refsec = &rec[settings.reference_channel][n_s];
+        }
+        std::vector<SectionResults> windows = measureSection(settings, ch[n_s], n_s, refsec, rec.GetXScale());
+        results.sections.insert(results.sections.end(), windows.begin(), windows.end());
+    }
+}
+
+// Measures the responses to a train in all sections of a recording; n_threads sections are measured in parallel.
+void trainRecording(const BatchSettings& settings, const Recording& rec, int n_threads,
+                    FileResults& results)
+{
+    std::vector<std::size_t> channels;
+    if (settings.channel < 0) {
+        for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+            channels.push_back(n_c);
+        }
+    } else {
+        channels.push_back((std::size_t)settings.channel);
+    }
+    double dt = rec.GetXScale();
+    stfnum::TrainPlan plan;
+    plan.n_pulses = (std::size_t)settings.train_pulses;
+    plan.onset = settings.train_onset/dt;
+    plan.interval = settings.train_interval/dt;
+    plan.baseLength = (std::size_t)std::max(lround(settings.train_base_length/dt), 1L);
+    plan.peakDelay = (std::size_t)std::max(lround(settings.train_peak_delay/dt), 0L);
+    plan.baselineMode = settings.train_baseline;
+    plan.latencyMode = settings.train_latency;
+    plan.measurement.baselineMethod = settings.baseline_method;
+    plan.measurement.pM = settings.peak_points;
+    plan.measurement.dir = settings.direction;
+    plan.measurement.RTFactor = settings.rise_factor;
+    results.train = plan.Analyse(rec, channels, n_threads);
+    // times are written in x units:
+    for (std::size_t n_p = 0; n_p < results.train.size(); ++n_p) {
+        results.train.peakIndex[n_p] *= dt;
+        results.train.latency[n_p] *= dt;
+    }
+}
+
+// Detects events in all sections of a recording; n_threads sections are scanned in parallel.
+void detectRecording(const BatchSettings& settings, const Recording& rec, int n_threads,
+                     FileResults& results)
+{
+    if (settings.channel < 0 || (std::size_t)settings.channel >= rec.size()) {
+        throw std::out_of_range("Channel index out of range");
+    }
+    stfnum::EventDetectionPlan plan(settings.events);
+    plan.SR = 1.0/rec.GetXScale();
+    stfio::StdoutProgressInfo progDlg("", "", 100, false);
+    results.events = plan.Detect(rec[settings.channel], progDlg, n_threads);
+}
+
+// Reads a file, optionally stores a copy as an HDF5 file in exportFolder,
+// and analyses it; errors are returned in the results.
+FileResults analyseFile(const BatchSettings& settings, batch_mode mode, const std::string& fName,
+                        stfio::filetype type, int n_threads, const std::string& exportFolder)
+{
+    FileResults results;
+    try {
+        if (type == stfio::none) {
+            throw std::runtime_error("Unknown file type");
+        }
+        Recording rec;
+        stfio::StdoutProgressInfo progDlg("", "", 100, false);
+        stfio::txtImportSettings txtImport;
+        if (!stfio::importFile(fName, type, rec, txtImport, progDlg)) {
+            throw std::runtime_error("Couldn't read file");
+        }
+        if (!exportFolder.empty()) {
+            std::size_t slash = fName.find_last_of("/\\");
+            std::string base = (slash == std::string::npos) ? fName : fName.substr(slash+1);
+            std::string h5Name = exportFolder + "/" + base.substr(0, base.rfind('.')) + ".h5";
+            if (!stfio::exportFile(h5Name, stfio::hdf5, rec, progDlg)) {
+                throw std::runtime_error("Couldn't write " + h5Name);
+            }
+        }
+        const Recording& crec = rec;
+        if (mode == mode_train) {
+            trainRecording(settings, crec, n_threads, results);
+        } else if (mode == mode_events) {
+            detectRecording(settings, crec, n_threads, results);
+        } else {
+            measureRecording(settings, crec, results);
+        }
+    }
+    catch (const std::exception& e) {
+        results = FileResults();
+        results.error = e.what();
+    }
+    return results;
+}
+
+std::string lowerExtension(const std::string& fName) {
+    std::size_t dot = fName.find_last_of('.');
+    if (dot == std::string::npos) {
+        return "";
+    }
+    std::string ext = fName.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+// Guesses the file type from the extension; .dat files are assumed to be CFS files.
+stfio::filetype guessType(const std::string& fName) {
+    std::string ext = lowerExtension(fName);
+    if (ext == ".dat") {
+        return stfio::cfs;
+    }
+    if (ext == ".ibw") {
+        return stfio::igor;
+    }
+    return stfio::findType("*" + ext);
+}
+
+stfio::filetype typeFromName(const std::string& name) {
+    if (name == "cfs") return stfio::cfs;
+    if (name == "abf") return stfio::abf;
+    if (name == "axg") return stfio::axg;
+    if (name == "atf") return stfio::atf;
+    if (name == "hdf5" || name == "h5") return stfio::hdf5;
+    if (name == "heka") return stfio::heka;
+    if (name == "igor") return stfio::igor;
+    if (name == "son") return stfio::son;
+    if (name == "tdms") return stfio::tdms;
+    if (name == "intan") return stfio::intan;
+    if (name == "nwb") return stfio::nwb;
+    if (name == "zarr") return stfio::zarr;
+#if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
+    if (name == "biosig") return stfio::biosig;
+#endif
+    throw std::runtime_error("Unknown file type: " + name);
+}
+
+// Column labels of the output; the label of each row is the file name.
+std::vector<std::string> outputColumns(batch_mode mode, bool windows) {
+    std::vector<std::string> columns;
+    columns.push_back("channel");
+    columns.push_back("section");
+    if (windows && mode == mode_measure) {
+        columns.push_back("window");
+    }
+    if (mode == mode_events) {
+        const char* const event_columns[] = { "index", "peak_index", "amplitude", "criterion" };
+        columns.insert(columns.end(), event_columns, event_columns+4);
+    } else if (mode == mode_train) {
+        const char* const train_columns[] = { "pulse", "base", "peak", "peak_time", "amplitude",
+                                              "latency", "ratio" };
+        columns.insert(columns.end(), train_columns, train_columns+7);
+    } else {
+        columns.insert(columns.end(), result_columns, result_columns+n_result_columns);
+    }
+    return columns;
+}
+
+// Appends one row per section and window, one row per event or one row per pulse to the output.
+void appendResults(stfio::TableStream& out, const std::string& fName,
+                   const FileResults& results, int channel, bool windows)
+{
+    const stfnum::TrainTable& t = results.train;
+    for (std::size_t n_p = 0; n_p < t.size(); ++n_p) {
+        double row[] = { (double)t.channel[n_p], (double)t.section[n_p], (double)t.pulse[n_p],
+                         t.base[n_p], t.peak[n_p], t.peakIndex[n_p], t.amplitude[n_p],
+                         t.latency[n_p], t.ratio[n_p] };
+        out.Append(fName, Vector_double(row, row+9));
+    }
+    const stfnum::EventTable& e = results.events;
+    for (std::size_t n_e = 0; n_e < e.size(); ++n_e) {
+        double row[] = { (double)channel, (double)e.section[n_e], (double)e.index[n_e],
+                         e.peakIndex[n_e], e.amplitude[n_e], e.criterion[n_e] };
+        out.Append(fName, Vector_double(row, row+6));
+    }
+    for (std::size_t n_r = 0; n_r < results.sections.size(); ++n_r) {
+        const SectionResults& r = results.sections[n_r];
+        double values[] = { r.base, r.base_sd, r.peak, r.amplitude, r.threshold, r.peak_time,
+                            r.rise_time, r.half_duration, r.max_rise, r.max_decay,
+                            r.slope_ratio, r.latency };
+        Vector_double row;
+        row.push_back(channel);
+        row.push_back((double)r.section);
+        if (windows) {
+            row.push_back((double)r.window);
+        }
+        row.insert(row.end(), values, values+n_result_columns);
+        out.Append(fName, row);
+    }
+}
+
+//! A file that couldn't be analysed.
+struct FileError {
+    std::string file, error;
+};
+
+// Analyses files and appends their rows to the output; files are analysed in
+// parallel by n_threads threads. Returns the files that failed, and throws
+// std::runtime_error if the output can't be written.
+std::vector<FileError> analyseFiles(const BatchSettings& settings, batch_mode mode,
+                                    const std::vector<std::string>& files, stfio::filetype type,
+                                    int n_threads, const std::string& exportFolder,
+                                    stfio::TableStream& out)
+{
+    int n_files = (int)files.size();
+    std::vector<FileError> failed;
+    std::string outError;
+    // a single file is scanned by all threads; several files share the
+    // threads that are left over among their sections:
+    int n_section_threads = n_files > 1 ? 0 : n_threads;
+#ifdef _OPENMP
+    n_threads = stfio::threadCount(n_threads, n_files);
+#pragma omp parallel for schedule(dynamic) num_threads(n_threads)
+#endif
+    for (int n_f = 0; n_f < n_files; ++n_f) {
+        stfio::filetype fType = (type == stfio::none) ? guessType(files[n_f]) : type;
+        FileResults results = analyseFile(settings, mode, files[n_f], fType, n_section_threads,
+                                          exportFolder);
+        // the rows of a file stay together:
+#ifdef _OPENMP
+#pragma omp critical(stfbatch_output)
+#endif
+        {
+            if (!results.error.empty()) {
+                FileError error;
+                error.file = files[n_f];
+                error.error = results.error;
+                failed.push_back(error);
+            } else if (outError.empty()) {
+                try {
+                    appendResults(out, files[n_f], results, settings.channel,
+                                  !settings.windows.empty());
+                }
+                catch (const std::exception& e) {
+                    outError = e.what();
+                }
+            }
+        }
+    }
+    if (!outError.empty()) {
+        throw std::runtime_error(outError);
+    }
+    return failed;
+}
+
+void reportErrors(const std::vector<FileError>& failed) {
+    for (std::size_t n_f = 0; n_f < failed.size(); ++n_f) {
+        std::cerr << failed[n_f].file << ": " << failed[n_f].error << std::endl;
+    }
+}
+
+volatile std::sig_atomic_t stopWatching = 0;
+
+extern "C" void onStopSignal(int) {
+    stopWatching = 1;
+}
+
+void sleepSeconds(double seconds) {
+#ifdef _WIN32
+    Sleep((DWORD)(seconds*1000.0));
+#else
+    usleep((useconds_t)(seconds*1.0e6));
+#endif
+}
+
+// Analyses new files in the watched folders until SIGINT or SIGTERM arrives.
+// At most queueSize files are taken per poll; the others wait in the folders.
+int watchFolders(const BatchSettings& settings, batch_mode mode, const std::vector<std::string>& folders,
+                 const std::vector<std::string>& extensions, double interval, stfio::filetype type,
+                 int n_threads, const std::string& exportFolder, stfio::TableStream& out)
+{
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+    std::size_t queueSize = 2*(std::size_t)stfio::threadCount(n_threads, INT_MAX);
+    stfio::FolderWatcher watcher(folders, extensions);
+    int n_failed = 0;
+    std::size_t n_duplicates = 0;
+    while (!stopWatching) {
+        std::vector<std::string> files = watcher.Poll(queueSize);
+        if (watcher.GetDuplicates() > n_duplicates) {
+            std::cerr << "stfbatch: skipped " << watcher.GetDuplicates()-n_duplicates
+                      << " file(s) with contents that have already been analysed" << std::endl;
+            n_duplicates = watcher.GetDuplicates();
+        }
+        if (files.empty()) {
+            sleepSeconds(interval);
+            continue;
+        }
+        std::vector<FileError> failed = analyseFiles(settings, mode, files, type, n_threads,
+                                                     exportFolder, out);
+        reportErrors(failed);
+        n_failed += (int)failed.size();
+        // results are on disk within one poll of the file being closed:
+        out.Flush();
+    }
+    return n_failed;
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::istringstream fields(list);
+    std::string item;
+    while (std::getline(fields, item, ',')) {
+        item = trim(item);
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+// Reads file names, one per line; empty lines and lines starting with '#' are ignored.
+std::vector<std::string> readFileList(const std::string& fName) {
+    std::ifstream file(fName.c_str());
+    if (!file) {
+        throw std::runtime_error("Couldn't open file list " + fName);
+    }
+    std::vector<std::string> files;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (!line.empty() && line[0] != '#') {
+            files.push_back(line);
+        }
+    }
+    return files;
+}
+
+// Keeps every n_shards-th file, starting with file n_shard. Every node of a
+// cluster gets the same list, so that the shards don't overlap.
+std::vector<std::string> shardFiles(const std::vector<std::string>& files, const std::string& shard) {
+    int n_shard = -1, n_shards = 0;
+    char slash = 0;
+    std::istringstream fields(shard);
+    if (!(fields >> n_shard >> slash >> n_shards) || slash != '/' || n_shards < 1 ||
+        n_shard < 0 || n_shard >= n_shards)
+    {
+        throw std::runtime_error("Invalid shard (expected k/N with 0 <= k < N): " + shard);
+    }
+    std::vector<std::string> mine;
+    for (std::size_t n_f = n_shard; n_f < files.size(); n_f += n_shards) {
+        mine.push_back(files[n_f]);
+    }
+    return mine;
+}
+
+// Merges the CSV or Parquet tables of several shards into one. If the file list is
+// given, rows are sorted by the position of their file in the list, so that
+// the result doesn't depend on how the files were sharded.
+void mergeTables(const std::vector<std::string>& tables, const std::vector<std::string>& fileList,
+                 const std::string& outName)
+{
+    std::map<std::string, std::size_t> positions;
+    for (std::size_t n_f = 0; n_f < fileList.size(); ++n_f) {
+        positions.insert(std::make_pair(fileList[n_f], n_f));
+    }
+    std::string title;
+    std::vector<std::string> columns, labels;
+    Vector_double values;
+    // (position in the file list, row) of all rows:
+    std::vector< std::pair<std::size_t, std::size_t> > order;
+    for (std::size_t n_t = 0; n_t < tables.size(); ++n_t) {
+        std::string tableTitle;
+        std::vector<std::string> tableColumns, tableLabels;
+        Vector_double tableValues;
+        if (stfio::isParquetName(tables[n_t])) {
+            stfio::readTableParquet(tables[n_t], tableTitle, tableColumns, tableLabels, tableValues);
+        } else {
+            stfio::readTableCSV(tables[n_t], tableTitle, tableColumns, tableLabels, tableValues);
+        }
+        if (n_t == 0) {
+            title = tableTitle;
+            columns = tableColumns;
+        } else if (tableTitle != title || tableColumns != columns) {
+            throw std::runtime_error("Columns of " + tables[n_t] + " differ from those of " + tables[0]);
+        }
+        for (std::size_t n_r = 0; n_r < tableLabels.size(); ++n_r) {
+            std::map<std::string, std::size_t>::const_iterator it = positions.find(tableLabels[n_r]);
+            order.push_back(std::make_pair(it != positions.end() ? it->second : fileList.size(),
+                                           labels.size()));
+            labels.push_back(tableLabels[n_r]);
+        }
+        values.insert(values.end(), tableValues.begin(), tableValues.end());
+    }
+    if (columns.empty()) {
+        throw std::runtime_error("No tables to merge");
+    }
+    std::stable_sort(order.begin(), order.end());
+    stfio::TableStream out(outName.empty() ? "-" : outName, title, columns);
+    std::size_t n_cols = columns.size();
+    for (std::size_t n_o = 0; n_o < order.size(); ++n_o) {
+        std::size_t n_r = order[n_o].second;
+        out.Append(labels[n_r], Vector_double(values.begin()+n_r*n_cols, values.begin()+(n_r+1)*n_cols));
+    }
+    out.Close();
+}
+
+void usage() {
+    std::cerr << "Usage: stfbatch -c settings.cfg [-o results.csv|results.h5|results.parquet] [-j threads] [-t type] files...\n"
+              << "       stfbatch -c settings.cfg -w folder [-w folder...] [-x abf,dat] [-i seconds] [-e folder] ...\n"
+              << "       stfbatch -m [-f list.txt] [-o merged.csv|merged.h5|merged.parquet] shard1.csv shard2.parquet...\n"
+              << "  -c  settings file with cursor and baseline settings (see stfbatch.cpp)\n"
+              << "  -o  output file; HDF5 if the extension is .h5, Parquet if it is .parquet, CSV otherwise\n"
+              << "      (default: stdout as CSV)\n"
+              << "  -j  number of threads (default: STFIO_NUM_THREADS, or the number of processors)\n"
+              << "  -t  file type (cfs, abf, axg, atf, hdf5, heka, igor, son, tdms, intan, nwb, zarr);\n"
+              << "      guessed from the extension by default\n"
+              << "  -f  text file with further files to analyse, one per line\n"
+              << "  -s  analyse only shard k of N of the files (k/N, 0 <= k < N), e.g. on node k of a cluster\n"
+              << "  -r  number of times that files that failed are tried again (default: 1)\n"
+              << "  -F  text file where the files that failed are listed, e.g. to resubmit them with -f\n"
+              << "  -m  merge the CSV or Parquet tables of several shards; rows are sorted by the file list of -f\n"
+              << "  -w  folder to watch for new files until interrupted\n"
+              << "  -x  extensions of the files to watch (default: abf,dat)\n"
+              << "  -i  interval between polls of the watched folders in seconds (default: 1)\n"
+              << "  -e  folder where a copy of every file is stored as an HDF5 file\n"
+              << "Events are detected in all sections if the settings contain an event_template,\n"
+              << "and responses to a train of pulses are measured if they contain train_pulses." << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string settingsName, outName, exportFolder, listName, shard, failedName;
+    int n_threads = 0, n_retries = 1;
+    bool merge = false;
+    stfio::filetype type = stfio::none;
+    std::vector<std::string> files, folders, extensions(split("abf,dat"));
+    double interval = 1.0;
+    try {
+        for (int n_a = 1; n_a < argc; ++n_a) {
+            std::string arg(argv[n_a]);
+            if ((arg == "-c" || arg == "-o" || arg == "-j" || arg == "-t" || arg == "-w" ||
+                 arg == "-x" || arg == "-i" || arg == "-e" || arg == "-f" || arg == "-s" ||
+                 arg == "-r" || arg == "-F") && n_a+1 < argc)
+            {
+                std::string value(argv[++n_a]);
+                if (arg == "-c") settingsName = value;
+                else if (arg == "-o") outName = value;
+                else if (arg == "-j") n_threads = atoi(value.c_str());
+                else if (arg == "-w") folders.push_back(value);
+                else if (arg == "-x") extensions = split(value);
+                else if (arg == "-i") interval = toDouble(value, "-i");
+                else if (arg == "-e") exportFolder = value;
+                else if (arg == "-f") listName = value;
+                else if (arg == "-s") shard = value;
+                else if (arg == "-r") n_retries = atoi(value.c_str());
+                else if (arg == "-F") failedName = value;
+                else type = typeFromName(value);
+            } else if (arg == "-m") {
+                merge = true;
+            } else if (arg == "-h" || arg == "--help") {
+                usage();
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                usage();
+                return 1;
+            } else {
+                files.push_back(arg);
+            }
+        }
+        stfio::setThreadCount(n_threads);
+        std::vector<std::string> fileList;
+        if (!listName.empty()) {
+            fileList = readFileList(listName);
+        }
+        if (merge) {
+            if (files.empty()) {
+                usage();
+                return 1;
+            }
+            mergeTables(files, fileList, outName);
+            return 0;
+        }
+        files.insert(files.end(), fileList.begin(), fileList.end());
+        if (!shard.empty()) {
+            files = shardFiles(files, shard);
+        }
+        if (settingsName.empty() || (files.empty() && folders.empty() && shard.empty())) {
+            usage();
+            return 1;
+        }
+        BatchSettings settings = readSettings(settingsName);
+
+        batch_mode mode = mode_measure;
+        if (settings.train_pulses > 0) {
+            mode = mode_train;
+        } else if (!settings.events.templ.empty()) {
+            mode = mode_events;
+        }
+        // the rows of each file are written as soon as it has been analysed:
+        stfio::TableStream out(outName.empty() ? "-" : outName, "file", outputColumns(mode, !settings.windows.empty()));
+        int n_failed = 0;
+        if (!files.empty()) {
+            std::vector<FileError> failed = analyseFiles(settings, mode, files, type, n_threads,
+                                                         exportFolder, out);
+            // e.g. files on a network share that was briefly unavailable:
+            for (int n_r = 0; n_r < n_retries && !failed.empty(); ++n_r) {
+                std::vector<std::string> retry;
+                for (std::size_t n_f = 0; n_f < failed.size(); ++n_f) {
+                    retry.push_back(failed[n_f].file);
+                }
+                failed = analyseFiles(settings, mode, retry, type, n_threads, exportFolder, out);
+            }
+            reportErrors(failed);
+            n_failed += (int)failed.size();
+            if (!failedName.empty()) {
+                std::ofstream failedList(failedName.c_str());
+                for (std::size_t n_f = 0; n_f < failed.size(); ++n_f) {
+                    failedList << failed[n_f].file << "\n";
+                }
+                if (!failedList) {
+                    throw std::runtime_error("Couldn't write " + failedName);
+                }
+            }
+        }
+        if (!folders.empty()) {
+            out.Flush();
+            n_failed += watchFolders(settings, mode, folders, extensions, interval, type,
+                                     n_threads, exportFolder, out);
+        }
+        out.Close();
+        return n_failed == 0 ? 0 : 2;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "stfbatch: " << e.what() << std::endl;
+        return 1;
+    }
+}
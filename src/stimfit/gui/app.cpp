@@ -17,6 +17,8 @@
 // 2007-12-27, Christoph Schmidt-Hieber, University of Freiburg
 
 #include <sstream>
+#include <fstream>
+#include <algorithm>
 
 // For compilers that support precompilation, includes "wx/wx.h".
 #include <wx/wxprec.h>
@@ -30,6 +32,7 @@
 #include <wx/datetime.h>
 #include <wx/filename.h>
 #include <wx/stockitem.h>
+#include <wx/stdpaths.h>
 
 #ifdef __BORLANDC__
 #pragma hdrstop
@@ -54,10 +57,17 @@
 #include "./parentframe.h"
 #include "./childframe.h"
 #include "./graph.h"
+#include "./taskpool.h"
+#include "./../../libstfnum/measure.h"
 #include "./dlgs/cursorsdlg.h"
 #include "./dlgs/smalldlgs.h"
 #include "./../../libstfnum/funclib.h"
 #include "./../../libstfnum/fit.h"
+#include "./../../libstfio/sidecar.h"
+#include "./../../libstfio/memory.h"
+#include "./../../libstfio/parallel.h"
+#include "./../../libstfio/synth.h"
+#include "./../../libstfio/profile.h"
 
 #if defined(__WXGTK__) || defined(__WXMAC__) 
 #if !defined(__MINGW32__)
@@ -78,6 +88,11 @@ EVT_MENU( ID_CURSORS, wxStfApp::OnCursorSettings )
 EVT_MENU( ID_NEWFROMSELECTED, wxStfApp::OnNewfromselected )
 EVT_MENU( ID_NEWFROMALL, wxStfApp::OnNewfromall )
 EVT_MENU( ID_APPLYTOALL, wxStfApp::OnApplytoall )
+EVT_MENU( ID_EDIT_INPLACE, wxStfApp::OnEditInPlace )
+EVT_UPDATE_UI( ID_EDIT_INPLACE, wxStfApp::OnUpdateEditInPlace )
+EVT_IDLE( wxStfApp::OnIdle )
+EVT_TIMER( ID_PROFILETIMER, wxStfApp::OnProfileTimer )
+EVT_MENU_RANGE( ID_NATIVEPLUGIN, ID_NATIVEPLUGIN+31, wxStfApp::OnNativePlugin )
 
 #ifdef WITH_PYTHON
 EVT_MENU( ID_IMPORTPYTHON, wxStfApp::OnPythonImport )
@@ -85,11 +100,16 @@ EVT_MENU_RANGE(ID_USERDEF, ID_USERDEF+32, wxStfApp::OnUserdef)
 #endif 
 END_EVENT_TABLE()
 
-wxStfApp::wxStfApp(void) : directTxtImport(false), isBars(true), txtImport(), funcLib(),
+wxStfApp::wxStfApp(void) : directTxtImport(false), isBars(true), txtImport(),
 #ifdef WITH_PYTHON
 extensionLib(),
 #endif 
-    CursorsDialog(NULL), storedLinFunc( stfnum::initLinFunc() ), /*m_file_menu(0),*/ m_fileToLoad(wxEmptyString), mrActiveDoc(0) {}
+    CursorsDialog(NULL), storedLinFunc( stfnum::initLinFunc() ), /*m_file_menu(0),*/ m_fileToLoad(wxEmptyString), m_renderBenchmark(wxEmptyString), mrActiveDoc(0),
+    taskPool(NULL), profile(), profileTimer(this, ID_PROFILETIMER), profileChanged(false)
+#ifdef WITH_PYTHON
+    , m_mainTState(NULL), pythonState(python_pending)
+#endif
+{}
 
 void wxStfApp::OnInitCmdLine(wxCmdLineParser& parser)
 {
@@ -97,6 +117,9 @@ void wxStfApp::OnInitCmdLine(wxCmdLineParser& parser)
 
     parser.AddOption(wxT("d"), wxT("dir"),
                      wxT("Working directory to change to"), wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL );
+    parser.AddOption(wxT(""), wxT("benchmark-render"),
+                     wxT("Time the drawing of synthetic recordings, write the results to a JSON file and quit"),
+                     wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL );
     parser.AddParam(wxT("File to open"),
                     wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL );
 }
@@ -123,6 +146,8 @@ bool wxStfApp::OnCmdLineParsed(wxCmdLineParser& parser)
         }
     }
     
+    parser.Found( wxT("benchmark-render"), &m_renderBenchmark );
+
     // Get file to load
     if ( parser.GetParamCount() > 0 ) {
         m_fileToLoad = parser.GetParam();
@@ -138,26 +163,50 @@ bool wxStfApp::OnInit(void)
         return false;
     }
 
-#ifdef WITH_PYTHON
-    if ( !Init_wxPython() ) {
-        // don't start the app if we can't initialize wxPython.
-        wxString msg;
-        msg << wxT("Could not start wxPython");
-        ErrorMsg( msg );
-        return false;
-    }
-    
-// Load Python extensions before creation of wxMenuBar ( see later CreateUnifiedMenuBar() )
-#if PY_MAJOR_VERSION < 3
-    
-    extensionLib = LoadExtensions();
-    #ifdef _STFDEBUG
-    std::cout << (int) GetExtensionLib().size() << " Python extension/s loaded"<< std::endl;
-    #endif
-#endif
-#endif //WITH_PTYHON
+    // Python and its extensions are started by OnIdle() once the main
+    // window is up (see EnsurePython()).
+
     // Config:
     config.reset(new wxFileConfig(wxT("Stimfit")));
+    LoadProfile();
+
+    // Native plugins have to be known before the menus are created:
+    LoadNativePlugins();
+
+    // Memory budget for decoded samples of mapped files, in MB:
+    int cacheMB = wxGetProfileInt(wxT("Settings"), wxT("SectionCacheMB"), 512);
+    if (cacheMB >= 0) {
+        stfio::setSectionCacheBudget((std::size_t)cacheMB*1024*1024);
+    }
+
+    // Sidecar indices that let files be reopened without reading them again:
+    stfio::setSidecarIndex(wxGetProfileInt(wxT("Settings"), wxT("SidecarIndex"), 0) != 0);
+
+    // Memory budget for imports, in MB; files that don't fit are stored
+    // compactly or mapped (0 means no budget):
+    int budgetMB = wxGetProfileInt(wxT("Settings"), wxT("MemoryBudgetMB"), 0);
+    if (budgetMB >= 0) {
+        stfio::setMemoryBudget((std::size_t)budgetMB*1024*1024);
+    }
+
+    // Threads of all parallel analyses and imports (0 means the value of
+    // STFIO_NUM_THREADS or one per processor):
+    stfio::setThreadCount(wxGetProfileInt(wxT("Settings"), wxT("Threads"), 0));
+
+    // FFTW: measured plans are faster but costly to create; wisdom
+    // from previous sessions makes them cheap:
+    if (wxGetProfileInt(wxT("Settings"), wxT("FFTWMeasure"), 0)) {
+        stfnum::setFFTWPlannerFlags(FFTW_MEASURE);
+    }
+    // extend filter windows and deconvolved sweeps to fast transform lengths:
+    stfnum::setFFTPadding(wxGetProfileInt(wxT("Settings"), wxT("FFTPadding"), 0) != 0);
+    wxString wisdomFile = GetFFTWWisdomFile();
+    if (wxFileName::FileExists(wisdomFile)) {
+        stfnum::importFFTWWisdom(stf::wx2std(wisdomFile));
+    }
+
+    // Worker threads for long analyses; 0 uses the thread count from above:
+    taskPool = new wxStfTaskPool(wxGetProfileInt(wxT("Settings"), wxT("TaskThreads"), 0));
 
     //// Create a document manager
     wxDocManager* docManager = new wxDocManager;
@@ -220,12 +269,19 @@ bool wxStfApp::OnInit(void)
                                      wxT("Mantis TDMS file"), wxT("*.tdms"), wxT(""), wxT("tdms"),
                                      wxT("Mantis TDMS Document"), wxT("TDMS View"), CLASSINFO(wxStfDoc),
                                      CLASSINFO(wxStfView) );
-#if 0
+    m_nwbTemplate=new wxDocTemplate( docManager,
+                                     wxT("Neurodata Without Borders file"), wxT("*.nwb"), wxT(""), wxT("nwb"),
+                                     wxT("NWB Document"), wxT("NWB View"), CLASSINFO(wxStfDoc),
+                                     CLASSINFO(wxStfView) );
+    // a store is a directory; it's opened by its file ".zgroup":
+    m_zarrTemplate=new wxDocTemplate( docManager,
+                                     wxT("Zarr store"), wxT("*.zgroup"), wxT(""), wxT("zgroup"),
+                                     wxT("Zarr Document"), wxT("Zarr View"), CLASSINFO(wxStfDoc),
+                                     CLASSINFO(wxStfView) );
     m_sonTemplate=new wxDocTemplate( docManager,
-                                     wxT("CED Spike 2 (SON) file"), wxT("*.smr"), wxT(""), wxT(""),
+                                     wxT("CED Spike 2 (SON) file"), wxT("*.smr"), wxT(""), wxT("smr"),
                                      wxT("SON Document"), wxT("SON View"), CLASSINFO(wxStfDoc),
                                      CLASSINFO(wxStfView) );
-#endif
     m_txtTemplate=new wxDocTemplate( docManager,
                                      wxT("General text file import"), wxT("*.*"), wxT(""), wxT(""),
                                      wxT("Text Document"), wxT("Text View"), CLASSINFO(wxStfDoc),
@@ -286,6 +342,10 @@ bool wxStfApp::OnInit(void)
     wxMenu *help_menu = new wxMenu;
     help_menu->Append(wxID_HELP);
     help_menu->Append(ID_UPDATE, wxT("&Check for updates"));
+#ifdef WITH_PROFILING
+    help_menu->Append(ID_PERFORMANCE, wxT("&Performance..."),
+                      wxT("Shows where the time of imports and analyses is spent"));
+#endif
     help_menu->Append(wxID_ABOUT);
 
     wxMenu *m_view_menu = new wxMenu;
@@ -336,8 +396,8 @@ bool wxStfApp::OnInit(void)
 //    std::cout << "DEBUG: wxStfApp extensionLib size is " << GetExtensionLib().size() << std::endl;
 //#endif
     
-    // load fit function library:
-    funcLib = stfnum::GetFuncLib();
+    // build the fit function library before the first fit needs it:
+    stfnum::FuncLib();
 
     SetTopWindow(frame);
 
@@ -352,6 +412,13 @@ bool wxStfApp::OnInit(void)
         }
     }
 
+    if (!m_renderBenchmark.empty()) {
+        if (!RunRenderBenchmark(m_renderBenchmark)) {
+            return false;
+        }
+        frame->Close(true);
+    }
+
     return true;
 }
 
@@ -360,45 +427,142 @@ int wxStfApp::OnExit()
 #if wxUSE_CONFIG
     GetDocManager()->FileHistorySave(*config);
 #endif // wxUSE_CONFIG
+    profileTimer.Stop();
+    FlushProfile();
 
+    // Running tasks mustn't deliver their results to closed documents:
+    if (taskPool != NULL) {
+        taskPool->Shutdown();
+    }
     delete GetDocManager();
+    delete taskPool;
+    taskPool = NULL;
+
+    wxFileName wisdomFile(GetFFTWWisdomFile());
+    if (wisdomFile.DirExists() || wisdomFile.Mkdir(0777, wxPATH_MKDIR_FULL)) {
+        stfnum::exportFFTWWisdom(stf::wx2std(wisdomFile.GetFullPath()));
+    }
+    stfnum::clearFFTWPlans();
 
 #ifdef WITH_PYTHON
-    Exit_wxPython();
+    if (pythonState == python_ready) {
+        Exit_wxPython();
+    }
 #endif
 
     return wxApp::OnExit();
 }
 
-// "Fake" registry
-void wxStfApp::wxWriteProfileInt(const wxString& main, const wxString& sub, int value) const {
-    // create a wxConfig-compatible path:
-    wxString path=wxT("/")+main+wxT("/")+sub;
-    if (!config->Write(path,(long)value)) {
-        ErrorMsg(wxT("Couldn't write application settings"));
+void wxStfApp::LoadNativePlugins() {
+    wxArrayString dirs;
+    dirs.Add(wxFileName(wxStandardPaths::Get().GetUserDataDir(), wxT("plugins")).GetFullPath());
+    dirs.Add(wxFileName(wxStandardPaths::Get().GetPluginsDir(), wxT("plugins")).GetFullPath());
+    std::vector<std::string> errors;
+    for (std::size_t n_d = 0; n_d < dirs.GetCount(); ++n_d) {
+        std::vector<stfnum::NativePlugin> plugins(stfnum::LoadPluginDir(stf::wx2std(dirs[n_d]), errors));
+        nativePlugins.insert(nativePlugins.end(), plugins.begin(), plugins.end());
+    }
+    // the menu has room for 32 entries:
+    if (nativePlugins.size() > 32) {
+        errors.push_back("Only the first 32 native plugins are shown");
+        nativePlugins.erase(nativePlugins.begin()+32, nativePlugins.end());
+    }
+    if (!errors.empty()) {
+        wxString msg(wxT("Some native plugins couldn't be loaded:"));
+        for (std::size_t n = 0; n < errors.size(); ++n) {
+            msg << wxT("\n") << stf::std2wx(errors[n]);
+        }
+        ErrorMsg(msg);
+    }
+}
+
+void wxStfApp::OnNativePlugin(wxCommandEvent& event) {
+    wxStfDoc* pDoc = GetActiveDoc();
+    if (pDoc == NULL) {
+        ErrorMsg(wxT("Open a file first"));
         return;
     }
-    config->Flush();
+    pDoc->RunNativePlugin(event.GetId()-ID_NATIVEPLUGIN);
+}
+
+wxString wxStfApp::GetFFTWWisdomFile() const {
+    return wxFileName(wxStandardPaths::Get().GetUserDataDir(), wxT("fftw_wisdom")).GetFullPath();
+}
+
+// "Fake" registry
+void wxStfApp::LoadProfile() {
+    profile.clear();
+    // wxFileConfig stores all entries as strings; walk the groups depth-first:
+    std::vector<wxString> groups(1, wxT("/"));
+    while (!groups.empty()) {
+        wxString group = groups.back();
+        groups.pop_back();
+        wxString prefix = (group == wxT("/")) ? group : group + wxT("/");
+        config->SetPath(group);
+        wxString name, value;
+        long index = 0;
+        for (bool more = config->GetFirstEntry(name, index); more; more = config->GetNextEntry(name, index)) {
+            if (config->Read(name, &value)) {
+                profile[prefix + name] = value;
+            }
+        }
+        for (bool more = config->GetFirstGroup(name, index); more; more = config->GetNextGroup(name, index)) {
+            groups.push_back(prefix + name);
+        }
+    }
+    config->SetPath(wxT("/"));
+}
+
+void wxStfApp::FlushProfile() const {
+    if (profileChanged) {
+        profileChanged = false;
+        config->Flush();
+    }
+}
+
+void wxStfApp::OnProfileTimer(wxTimerEvent& WXUNUSED(event)) {
+    FlushProfile();
+}
+
+void wxStfApp::wxWriteProfileInt(const wxString& main, const wxString& sub, int value) const {
+    wxString text;
+    text << value;
+    wxWriteProfileString(main, sub, text);
 }
 
 int wxStfApp::wxGetProfileInt(const wxString& main,const wxString& sub, int default_) const {
     wxString path=wxT("/")+main+wxT("/")+sub;
-    return config->Read(path,default_);
+    std::map<wxString, wxString>::const_iterator it = profile.find(path);
+    long value = 0;
+    if (it == profile.end() || !it->second.ToLong(&value)) {
+        return default_;
+    }
+    return (int)value;
 }
 
 void wxStfApp::wxWriteProfileString( const wxString& main, const wxString& sub, const wxString& value ) const {
     // create a wxConfig-compatible path:
     wxString path=wxT("/")+main+wxT("/")+sub;
+    std::map<wxString, wxString>::iterator it = profile.find(path);
+    if (it != profile.end() && it->second == value) {
+        return;
+    }
+    // wxFileConfig keeps the entry in memory until it's flushed:
     if (!config->Write(path,value)) {
         ErrorMsg(wxT("Couldn't write application settings"));
         return;
     }
-    config->Flush();
+    profile[path] = value;
+    profileChanged = true;
+    if (!profileTimer.IsRunning()) {
+        profileTimer.Start(2000, wxTIMER_ONE_SHOT);
+    }
 }
 
 wxString wxStfApp::wxGetProfileString( const wxString& main, const wxString& sub, const wxString& default_) const {
     wxString path=wxT("/")+main+wxT("/")+sub;
-    return config->Read(path,default_);
+    std::map<wxString, wxString>::const_iterator it = profile.find(path);
+    return (it != profile.end()) ? it->second : default_;
 }
 
 
@@ -664,6 +828,22 @@ wxMenuBar *wxStfApp::CreateUnifiedMenuBar(wxStfDoc* doc) {
 #endif
 
     wxMenu* m_edit_menu=new wxMenu;
+    m_edit_menu->Append(
+                        ID_UNDO_EDIT,
+                        wxT("&Undo\tCtrl+Z"),
+                        wxT("Undo the last in-place modification of this file")
+                        );
+    m_edit_menu->Append(
+                        ID_REDO_EDIT,
+                        wxT("&Redo\tCtrl+Y"),
+                        wxT("Redo the last undone modification of this file")
+                        );
+    m_edit_menu->AppendCheckItem(
+                        ID_EDIT_INPLACE,
+                        wxT("Edit traces in &place"),
+                        wxT("Modify the selected traces rather than creating a new window when subtracting baselines, multiplying, filtering or taking the logarithm")
+                        );
+    m_edit_menu->AppendSeparator();
     m_edit_menu->Append(
                         ID_CURSORS,
                         wxT("&Cursor settings...\tCtrl+R"),
@@ -782,6 +962,11 @@ wxMenuBar *wxStfApp::CreateUnifiedMenuBar(wxStfDoc* doc) {
                           wxT("&Multiply..."),
                           wxT("Multiply selected traces")
                           );
+    analysis_menu->Append(
+                          ID_MULTIPLY_INPLACE,
+                          wxT("Multiply in pl&ace..."),
+                          wxT("Multiply selected traces without creating a new window")
+                          );
     analysis_menu->Append(
                           ID_INTEGRATE,
                           wxT("&Integrate"),
@@ -802,6 +987,21 @@ wxMenuBar *wxStfApp::CreateUnifiedMenuBar(wxStfDoc* doc) {
                           wxT("Fi&lter..."),
                           wxT("Filter selected traces")
                           );
+    analysis_menu->Append(
+                          ID_DOWNSAMPLE,
+                          wxT("Do&wnsample..."),
+                          wxT("Show all traces at a lower sampling rate in a new window")
+                          );
+    analysis_menu->Append(
+                          ID_SPECTRUM,
+                          wxT("Power spectral densit&y..."),
+                          wxT("Estimate the power spectra of the selected traces of all channels with Welch's method")
+                          );
+    analysis_menu->Append(
+                          ID_SPECTROGRAM,
+                          wxT("Spectro&gram..."),
+                          wxT("Show the power spectrum of the current trace in consecutive segments")
+                          );
     analysis_menu->Append(
                           ID_MPL_SPECTRUM,
                           wxT("&Power spectrum..."),
@@ -826,6 +1026,17 @@ wxMenuBar *wxStfApp::CreateUnifiedMenuBar(wxStfDoc* doc) {
                           wxT("&Batch analysis..."),
                           wxT("Analyze selected traces and show results in a table")
                           );
+    if (!GetNativePlugins().empty()) {
+        wxMenu* nativeSub=new wxMenu;
+        for (std::size_t n=0;n<GetNativePlugins().size();++n) {
+            nativeSub->Append(
+                              ID_NATIVEPLUGIN+(int)n,
+                              stf::std2wx(GetNativePlugins()[n].GetName()),
+                              stf::std2wx(GetNativePlugins()[n].GetDescription())
+                              );
+        }
+        analysis_menu->AppendSubMenu(nativeSub,wxT("&Native plugins"));
+    }
 
 #if 0
     wxMenu* userdefSub=new wxMenu;
@@ -838,17 +1049,19 @@ wxMenuBar *wxStfApp::CreateUnifiedMenuBar(wxStfDoc* doc) {
     analysis_menu->AppendSubMenu(userdefSub,wxT("User-defined functions"));
 #endif
 #ifdef WITH_PYTHON
+    // Empty until the extensions have been loaded (see UpdateExtensionsMenus()):
     wxMenu *extensions_menu = new wxMenu;
-    for (std::size_t n=0;n<GetExtensionLib().size();++n) {
-        extensions_menu->Append(ID_USERDEF+(int)n,
-                                stf::std2wx(GetExtensionLib()[n].menuEntry));
-    }
+    FillExtensionsMenu(extensions_menu);
 #endif 
     
     wxMenu *help_menu = new wxMenu;
     help_menu->Append(wxID_HELP, wxT("Online &help\tF1"));
     help_menu->Append(wxID_ABOUT, wxT("&About"));
     help_menu->Append(ID_UPDATE, wxT("&Check for updates"));
+#ifdef WITH_PROFILING
+    help_menu->Append(ID_PERFORMANCE, wxT("&Performance..."),
+                      wxT("Shows where the time of imports and analyses is spent"));
+#endif
 
     wxMenuBar *menu_bar = new wxMenuBar;
 
@@ -905,38 +1118,176 @@ wxStfChildFrame *wxStfApp::CreateChildFrame(wxDocument *doc, wxView *view)
     return subframe;
 }
 
-wxStfDoc* wxStfApp::NewChild(const Recording& NewData, const wxStfDoc* Sender,
-                             const wxString& title)
+wxStfDoc* wxStfApp::CreateChildDoc(const wxString& title)
 {
     wxStfDoc* NewDoc=(wxStfDoc*)m_cfsTemplate->CreateDocument(title,wxDOC_NEW);
     NewDoc->SetDocumentName(title);
     NewDoc->SetTitle(title);
     NewDoc->SetDocumentTemplate(m_cfsTemplate);
     if (!NewDoc->OnNewDocument()) return NULL;
+    return NewDoc;
+}
+
+void wxStfApp::DiscardChildDoc(wxStfDoc* NewDoc, const wxString& msg)
+{
+    ExceptMsg( msg );
+    // Close file:
+    if (!NewDoc->OnCloseDocument())
+        ErrorMsg(wxT("Could not close file; please close manually"));
+}
+
+wxStfDoc* wxStfApp::NewChild(const Recording& NewData, const wxStfDoc* Sender,
+                             const wxString& title)
+{
+    wxStfDoc* NewDoc=CreateChildDoc(title);
+    if (NewDoc==NULL) return NULL;
     try {
         NewDoc->SetData(NewData, Sender, title);
     }
     catch (const std::out_of_range& e) {
-        wxString msg;
-        msg << wxT("Error while creating new document:\n")
-            << stf::std2wx(e.what());
-        ExceptMsg(msg);
-        // Close file:
-        NewDoc->OnCloseDocument();
+        DiscardChildDoc(NewDoc, wxT("Error while creating new document:\n") + stf::std2wx(e.what()));
+        return NULL;
+    }
+    catch (const std::runtime_error& e) {
+        DiscardChildDoc(NewDoc, wxT("Runtime error while creating new document:\n") +
+                        wxString( e.what(), wxConvLocal ));
+        return NULL;
+    }
+    return NewDoc;
+}
+
+#if (__cplusplus >= 201103)
+wxStfDoc* wxStfApp::NewChild(Recording&& NewData, const wxStfDoc* Sender,
+                             const wxString& title)
+{
+    wxStfDoc* NewDoc=CreateChildDoc(title);
+    if (NewDoc==NULL) return NULL;
+    try {
+        NewDoc->SetData(std::move(NewData), Sender, title);
+    }
+    catch (const std::out_of_range& e) {
+        DiscardChildDoc(NewDoc, wxT("Error while creating new document:\n") + stf::std2wx(e.what()));
         return NULL;
     }
     catch (const std::runtime_error& e) {
-        wxString msg;
-        msg << wxT("Runtime error while creating new document:\n")
-            << wxString( e.what(), wxConvLocal );
-        ExceptMsg( msg );
-        // Close file:
-        if (!NewDoc->OnCloseDocument())
-            ErrorMsg(wxT("Could not close file; please close manually"));
+        DiscardChildDoc(NewDoc, wxT("Runtime error while creating new document:\n") +
+                        wxString( e.what(), wxConvLocal ));
         return NULL;
     }
     return NewDoc;
 }
+#endif
+
+namespace {
+
+    // A synthetic recording and the way it is shown:
+    struct RenderCase {
+        std::size_t n_points, n_sections, n_channels;
+        double visible;     // fraction of the section that is shown
+        bool selected;      // whether all sections are selected and shown
+    };
+
+    const RenderCase renderCases[] = {
+        {    10000,   1, 1, 1.0,  false },
+        {  1000000,   1, 1, 1.0,  false },
+        {  1000000,   1, 1, 0.01, false },
+        { 10000000,   1, 1, 1.0,  false },
+        {  1000000,   1, 2, 1.0,  false },
+        {   100000,  20, 1, 1.0,  true  },
+        {   100000, 100, 1, 1.0,  true  },
+        {   100000, 100, 1, 0.1,  true  },
+        {   100000,  20, 2, 1.0,  true  }
+    };
+
+    const int renderFrames = 20;
+}
+
+bool wxStfApp::RunRenderBenchmark(const wxString& fName) {
+    std::ofstream out(fName.mb_str());
+    if (!out) {
+        ErrorMsg(wxT("Couldn't write to ") + fName);
+        return false;
+    }
+    out << "{\n  \"profiling\": " << (stfio::profilingAvailable() ? "true" : "false");
+    out << ",\n  \"frames\": " << renderFrames;
+    out << ",\n  \"results\": [\n";
+    out.precision(6);
+    std::size_t n_cases = sizeof(renderCases)/sizeof(renderCases[0]);
+    bool first = true;
+    for (std::size_t n_r = 0; n_r < n_cases; ++n_r) {
+        const RenderCase& rc = renderCases[n_r];
+        stfio::SynthSettings settings;
+        settings.n_points = rc.n_points;
+        settings.n_sections = rc.n_sections;
+        settings.n_channels = rc.n_channels;
+        wxStfDoc* pDoc = NewChild(stfio::synthRecording(settings), NULL, wxT("Render benchmark"));
+        if (pDoc == NULL) {
+            return false;
+        }
+        wxStfChildFrame* pChild = (wxStfChildFrame*)pDoc->GetDocumentWindow();
+        wxStfView* pView = (wxStfView*)pDoc->GetFirstView();
+        if (pChild == NULL || pView == NULL || pView->GetGraph() == NULL) {
+            pDoc->Modify(false);
+            GetDocManager()->CloseDocument(pDoc, true);
+            return false;
+        }
+        // the same window size on every run:
+        pChild->SetClientSize(1024, 768);
+        pChild->Layout();
+        wxStfGraph* pGraph = pView->GetGraph();
+        if (rc.selected) {
+            std::vector<std::size_t> toSelect(rc.n_sections);
+            for (std::size_t n_s = 0; n_s < rc.n_sections; ++n_s) {
+                toSelect[n_s] = n_s;
+            }
+            pDoc->SelectTraces(toSelect, 0, std::min(rc.n_points, (std::size_t)100)-1);
+        }
+        pChild->SetShowSelected(rc.selected);
+        pChild->SetShowSecond(rc.n_channels > 1);
+        pGraph->Fittowindow(false);
+        pDoc->GetXZoomW().xZoom /= rc.visible;
+        wxSize size(pGraph->GetClientSize());
+
+        // The first frame draws the layer; a cursor that is dragged copies
+        // it, while a changed zoom or trace draws it again:
+        pGraph->DrawOffscreen(1, false);
+        for (int cached = 0; cached < 2; ++cached) {
+            stfio::profileReset();
+            std::vector<double> times = pGraph->DrawOffscreen(renderFrames, cached != 0);
+            std::sort(times.begin(), times.end());
+            double median = times[times.size()/2];
+            out << (first ? "" : ",\n");
+            first = false;
+            out << "    {\"points\": " << rc.n_points
+                << ", \"sections\": " << rc.n_sections
+                << ", \"channels\": " << rc.n_channels
+                << ", \"visible\": " << rc.visible
+                << ", \"selected\": " << (rc.selected ? rc.n_sections : 0)
+                << ", \"width\": " << size.GetWidth()
+                << ", \"height\": " << size.GetHeight()
+                << ", \"mode\": \"" << (cached ? "cached" : "full") << "\""
+                << ", \"median_s\": " << std::scientific << median
+                << ", \"fps\": " << std::fixed << (median > 0 ? 1.0/median : 0.0);
+            // the sub-stages, in s per frame:
+            out << ", \"stages\": {";
+            std::vector<stfio::ProfileTimer> timers = stfio::profileTimers();
+            bool firstStage = true;
+            for (std::size_t n_t = 0; n_t < timers.size(); ++n_t) {
+                if (timers[n_t].name.compare(0, 12, "wxStfGraph::") != 0) {
+                    continue;
+                }
+                out << (firstStage ? "" : ", ") << "\"" << timers[n_t].name.substr(12) << "\": "
+                    << std::scientific << timers[n_t].total/renderFrames << std::fixed;
+                firstStage = false;
+            }
+            out << "}}";
+        }
+        pDoc->Modify(false);
+        GetDocManager()->CloseDocument(pDoc, true);
+    }
+    out << "\n  ]\n}\n";
+    return true;
+}
 
 wxStfView* wxStfApp::GetActiveView() const {
     if ( GetDocManager() == 0) {
@@ -1113,7 +1464,7 @@ void wxStfApp::OnNewfromselected( wxCommandEvent& WXUNUSED(event) ) {
 
     // Create a new document in a new child window, using the settings
     // of the last open document:
-    NewChild(Selected,pDoc,wxT("New from selected traces"));
+    NewChild(STFIO_MOVE(Selected),pDoc,wxT("New from selected traces"));
 }
 
 void wxStfApp::OnNewfromall( wxCommandEvent& WXUNUSED(event) ) {
@@ -1196,7 +1547,15 @@ void wxStfApp::OnNewfromall( wxCommandEvent& WXUNUSED(event) ) {
 
     // Create a new document in a new child window, using the settings
     // of the last open document:
-    NewChild(Selected,pDoc,wxT("New from all traces"));
+    NewChild(STFIO_MOVE(Selected),pDoc,wxT("New from all traces"));
+}
+
+void wxStfApp::OnEditInPlace( wxCommandEvent& event ) {
+    wxWriteProfileInt(wxT("Settings"), wxT("EditInPlace"), event.IsChecked() ? 1 : 0);
+}
+
+void wxStfApp::OnUpdateEditInPlace( wxUpdateUIEvent& event ) {
+    event.Check(wxGetProfileInt(wxT("Settings"), wxT("EditInPlace"), 0) != 0);
 }
 
 void wxStfApp::OnApplytoall( wxCommandEvent& WXUNUSED(event) ) {
@@ -1224,13 +1583,18 @@ void wxStfApp::OnApplytoall( wxCommandEvent& WXUNUSED(event) ) {
     double latencyStartCursorToApply=pDoc->GetLatencyBeg();
     double latencyEndCursorToApply=pDoc->GetLatencyEnd();
 
+    // The cursors are copied first; the documents are then measured in
+    // parallel, and their windows are updated once the GUI is idle.
+    std::vector<wxStfDoc*> docs;
+    std::vector<stfnum::MeasurementJob> jobs;
+
     // Since random access is expensive, go through the list node by node:
     // Get first node:
     wxObjectList::compatibility_iterator curNode=docList.GetFirst();
     while (curNode) {
         wxStfDoc* OpenDoc=(wxStfDoc*)curNode->GetData();
         if (OpenDoc==NULL)
-            return;
+            break;
         wxStfView* curView = (wxStfView*)OpenDoc->GetFirstView(); //(GetActiveView());
         if (curView!=pView && curView!=NULL) {
             OpenDoc->GetXZoomW() = pDoc->GetXZoom();
@@ -1247,13 +1611,71 @@ void wxStfApp::OnApplytoall( wxCommandEvent& WXUNUSED(event) ) {
             OpenDoc->SetFitEnd((int)uldToApply);
             OpenDoc->SetLatencyBeg(latencyStartCursorToApply);
             OpenDoc->SetLatencyEnd(latencyEndCursorToApply);
-            wxStfChildFrame* pChild=(wxStfChildFrame*)curView->GetFrame();
-            pChild->UpdateResults();
-            if (curView->GetGraph() != NULL)
-                curView->GetGraph()->Refresh();
+            docs.push_back(OpenDoc);
+            jobs.push_back(OpenDoc->GetMeasurementJob());
         }
         curNode=curNode->GetNext();
     }
+    if (docs.empty()) {
+        return;
+    }
+
+    std::vector<std::string> errors;
+    std::vector<stfnum::MeasurementResults> results;
+    {
+        wxBusyCursor wc;
+        results = stfnum::evaluateMany(jobs, errors);
+    }
+    wxString errorMsg;
+    for (std::size_t n_d=0; n_d < docs.size(); ++n_d) {
+        try {
+            if (!errors[n_d].empty()) {
+                docs[n_d]->ClearMeasurement();
+                errorMsg << docs[n_d]->GetTitle() << wxT(": ") << stf::std2wx(errors[n_d]) << wxT("\n");
+            } else if (jobs[n_d].sec != NULL) {
+                docs[n_d]->SetMeasurementResults(results[n_d]);
+            }
+        }
+        catch (const std::out_of_range& e) {
+            errorMsg << docs[n_d]->GetTitle() << wxT(": ") << stf::std2wx(e.what()) << wxT("\n");
+        }
+        RequestUpdate(docs[n_d]);
+    }
+    if (!errorMsg.IsEmpty()) {
+        ExceptMsg(errorMsg);
+    }
+}
+
+void wxStfApp::RequestUpdate(wxStfDoc* pDoc) {
+    if (std::find(pendingUpdates.begin(), pendingUpdates.end(), pDoc) == pendingUpdates.end()) {
+        pendingUpdates.push_back(pDoc);
+    }
+}
+
+void wxStfApp::OnIdle( wxIdleEvent& event ) {
+    // Swapped out first because updating the windows may dispatch events:
+    std::vector<wxStfDoc*> docs;
+    docs.swap(pendingUpdates);
+    for (std::size_t n_d=0; n_d < docs.size(); ++n_d) {
+        wxStfView* pView = (wxStfView*)docs[n_d]->GetFirstView();
+        if (pView == NULL) {
+            continue;
+        }
+        wxStfChildFrame* pChild=(wxStfChildFrame*)pView->GetFrame();
+        if (pChild != NULL) {
+            pChild->UpdateResults();
+        }
+        if (pView->GetGraph() != NULL) {
+            pView->GetGraph()->Refresh();
+        }
+    }
+#ifdef WITH_PYTHON
+    // The main window has been drawn; now it's Python's turn:
+    if (pythonState == python_pending && frame != NULL && frame->IsShown()) {
+        EnsurePython();
+    }
+#endif
+    event.Skip();
 }
 
 bool wxStfApp::OpenFileSeries(const wxArrayString& fNameArray) {
@@ -1276,8 +1698,10 @@ bool wxStfApp::OpenFileSeries(const wxArrayString& fNameArray) {
                              frame,
                              wxPD_SMOOTH | wxPD_AUTO_HIDE
                              );
+    if (singleWindow) {
+        return OpenFileSeriesSingle(fNameArray, progDlg);
+    }
     int n_opened=0;
-    Recording seriesRec;
     while (n_opened!=nFiles) {
         wxString progStr;
         progStr << wxT("Reading file #") << n_opened + 1 << wxT(" of ") << nFiles;
@@ -1285,75 +1709,92 @@ bool wxStfApp::OpenFileSeries(const wxArrayString& fNameArray) {
                        (int)((double)n_opened/(double)nFiles*100.0),
                        progStr
                        );
-        if (!singleWindow) {
-            wxDocTemplate* templ=GetDocManager()->FindTemplateForPath(fNameArray[n_opened]);
-            wxStfDoc* NewDoc=(wxStfDoc*)templ->CreateDocument(fNameArray[n_opened],wxDOC_NEW);
-            NewDoc->SetDocumentTemplate(templ);
-            if (!NewDoc->OnOpenDocument(fNameArray[n_opened++])) {
-                ErrorMsg(wxT("Couldn't open file, aborting file import"));
-                GetDocManager()->CloseDocument(NewDoc);
-                return false;
-            }
-        } else {
-            // Add to recording first:
+        wxDocTemplate* templ=GetDocManager()->FindTemplateForPath(fNameArray[n_opened]);
+        wxStfDoc* NewDoc=(wxStfDoc*)templ->CreateDocument(fNameArray[n_opened],wxDOC_NEW);
+        NewDoc->SetDocumentTemplate(templ);
+        if (!NewDoc->OnOpenDocument(fNameArray[n_opened++])) {
+            ErrorMsg(wxT("Couldn't open file, aborting file import"));
+            GetDocManager()->CloseDocument(NewDoc);
+            return false;
+        }
+    }
+    // reset direct import:
+    directTxtImport=false;
+    return true;
+}
+
+bool wxStfApp::OpenFileSeriesSingle(const wxArrayString& fNameArray, wxProgressDialog& progDlg) {
+    std::size_t nFiles=fNameArray.GetCount();
+    std::vector<std::string> fNames(nFiles);
+    std::vector<stfio::filetype> types(nFiles);
+    for (std::size_t n_f=0; n_f < nFiles; ++n_f) {
+        fNames[n_f] = stf::wx2std(fNameArray[n_f]);
 #ifndef TEST_MINIMAL
-            // Find a template:
-            wxDocTemplate* templ=GetDocManager()->FindTemplateForPath(fNameArray[n_opened]);
-            // Use this template only for type recognition:
-            wxString filter(templ->GetFileFilter());
-            stfio::filetype type = stfio::findType(stf::wx2std(templ->GetFileFilter()));
+        // Use the template only for type recognition:
+        wxDocTemplate* templ=GetDocManager()->FindTemplateForPath(fNameArray[n_f]);
+        types[n_f] = stfio::findType(stf::wx2std(templ->GetFileFilter()));
 #else
-            stfio::filetype type = stfio::none;
+        types[n_f] = stfio::none;
 #endif
+    }
 #if 0 // TODO: re-implement ascii
-            if (type==stfio::ascii) {
-                if (!get_directTxtImport()) {
-                    wxStfTextImportDlg ImportDlg(NULL, stf::CreatePreview(fNameArray[n_opened]), 1,
-                                                 true);
-                    if (ImportDlg.ShowModal()!=wxID_OK) {
-                        return false;
-                    }
-                    // store settings in application:
-                    set_txtImportSettings(ImportDlg.GetTxtImport());
-                    set_directTxtImport(ImportDlg.ApplyToAll());
-                }
-            }
+    if (std::find(types.begin(), types.end(), stfio::ascii) != types.end() && !get_directTxtImport()) {
+        wxStfTextImportDlg ImportDlg(NULL, stf::CreatePreview(fNameArray[0]), 1, true);
+        if (ImportDlg.ShowModal()!=wxID_OK) {
+            return false;
+        }
+        // store settings in application:
+        set_txtImportSettings(ImportDlg.GetTxtImport());
+        set_directTxtImport(ImportDlg.ApplyToAll());
+    }
 #endif
-            // add this file to the series recording:
-            Recording singleRec;
-            try {
-                stf::wxProgressInfo progDlg("Reading file", "Opening file", 100);
-                stfio::importFile(stf::wx2std(fNameArray[n_opened++]),type,singleRec,txtImport, progDlg);
-                if (n_opened==1) {
-                    seriesRec.resize(singleRec.size());
-                    // reserve memory to avoid allocations:
-                    for (std::size_t n_c=0;n_c<singleRec.size();++n_c) {
-                        seriesRec[n_c].reserve(singleRec[n_c].size()*nFiles);
-                    }
-                    seriesRec.SetXScale(singleRec.GetXScale());
+
+    Recording seriesRec;
+    try {
+        // The files are read concurrently; libraries that keep global
+        // state are still read one file at a time by stfio::importFiles().
+        progDlg.Pulse(wxT("Reading files"));
+        std::vector<Recording> recordings;
+        {
+            wxBusyCursor wc;
+            recordings = stfio::importFiles(fNames, types, txtImport);
+        }
+        seriesRec.resize(recordings[0].size());
+        seriesRec.CopyAttributes(recordings[0]);
+        // reserve memory to avoid allocations:
+        for (std::size_t n_c=0; n_c < seriesRec.size(); ++n_c) {
+            std::size_t n_sections = 0;
+            for (std::size_t n_f=0; n_f < nFiles; ++n_f) {
+                if (n_c < recordings[n_f].size()) {
+                    n_sections += recordings[n_f][n_c].size();
                 }
-                seriesRec.AddRec(singleRec);
-            }
-            catch (const std::runtime_error& e) {
-                wxString errorMsg;
-                errorMsg << wxT("Couldn't open file, aborting file import:\n")
-                         << stf::std2wx(e.what());
-                ErrorMsg(errorMsg);
-                return false;
-            }
-            catch (const std::out_of_range& e) {
-                wxString errorMsg;
-                errorMsg << wxT("Couldn't open file, aborting file import:\n")
-                         << wxString( e.what(), wxConvLocal );
-                ErrorMsg(errorMsg);
-                return false;
-            }
-            // check whether this was the last file in the queue:
-            if (n_opened==nFiles) {
-                NewChild(seriesRec,NULL,wxT("File series"));
             }
+            seriesRec[n_c].reserve(n_sections);
+            seriesRec[n_c].SetChannelName(recordings[0][n_c].GetChannelName());
+        }
+        // the sections are moved rather than copied:
+        for (std::size_t n_f=0; n_f < nFiles; ++n_f) {
+            wxString progStr;
+            progStr << wxT("Adding file #") << (int)n_f + 1 << wxT(" of ") << (int)nFiles;
+            progDlg.Update((int)((double)n_f/(double)nFiles*100.0), progStr);
+            seriesRec.AddRec(STFIO_MOVE(recordings[n_f]));
         }
     }
+    catch (const std::runtime_error& e) {
+        wxString errorMsg;
+        errorMsg << wxT("Couldn't open file, aborting file import:\n")
+                 << stf::std2wx(e.what());
+        ErrorMsg(errorMsg);
+        return false;
+    }
+    catch (const std::out_of_range& e) {
+        wxString errorMsg;
+        errorMsg << wxT("Couldn't open file, aborting file import:\n")
+                 << wxString( e.what(), wxConvLocal );
+        ErrorMsg(errorMsg);
+        return false;
+    }
+    NewChild(STFIO_MOVE(seriesRec),NULL,wxT("File series"));
     // reset direct import:
     directTxtImport=false;
     return true;
@@ -1382,6 +1823,11 @@ bool wxStfApp::OpenFilePy(const wxString& filename) {
 #endif //WITH_PYTHON
 
 void wxStfApp::CleanupDocument(wxStfDoc* pDoc) {
+    if (taskPool != NULL) {
+        taskPool->CancelTasks(pDoc);
+    }
+    pendingUpdates.erase(std::remove(pendingUpdates.begin(), pendingUpdates.end(), pDoc),
+                         pendingUpdates.end());
     // count open docs:
     if (GetDocManager() && GetDocManager()->GetDocuments().GetCount()==1) {
         // Clean up if this was the last document:
@@ -1410,13 +1856,12 @@ std::vector<stf::SectionPointer> wxStfApp::GetSectionsWithFits() const {
     while (curNode) {
         wxStfDoc* pDoc=(wxStfDoc*)curNode->GetData();
         try {
-            for (std::size_t n_sec=0; n_sec < pDoc->get().at(pDoc->GetCurChIndex()).size(); ++n_sec) {
-                stf::SectionAttributes sec_attr = pDoc->GetSectionAttributes(pDoc->GetCurChIndex(), n_sec);
-                if (sec_attr.isFitted) {
-                    sectionList.push_back(stf::SectionPointer(&pDoc->get()[pDoc->GetCurChIndex()][n_sec],
-                                                              sec_attr)
-                                          );
-                }
+            std::size_t n_ch = pDoc->GetCurChIndex();
+            std::vector<std::size_t> fitted(pDoc->GetFittedSections(n_ch));
+            for (c_st_it cit = fitted.begin(); cit != fitted.end(); ++cit) {
+                sectionList.push_back(stf::SectionPointer(&pDoc->get().at(n_ch)[*cit],
+                                                          &pDoc->GetSectionAttributes(n_ch, *cit))
+                                      );
             }
         }
         catch (const std::out_of_range& e) {
@@ -1464,6 +1909,9 @@ void wxStfApp::OnPythonImport(wxCommandEvent& WXUNUSED(event)) {
                 wxFD_OPEN | wxFD_PREVIEW );
 
     if (LoadModuleDialog.ShowModal() == wxID_OK) {
+        if (!EnsurePython()) {
+            return;
+        }
         wxString modulelocation = LoadModuleDialog.GetPath();
         ImportPython(modulelocation); // see in /src/app/unopt.cpp L196
     }
@@ -56,6 +56,7 @@ enum {
     ID_TOOL_SNAPSHOT,
 
     ID_TOOL_SNAPSHOT_WMF,
+    ID_TOOL_SNAPSHOT_SVG,
     ID_TOOL_FITDECAY,
 #ifdef WITH_PYTHON
     ID_IMPORTPYTHON,
@@ -113,6 +114,9 @@ enum {
     ID_APPLYTOALL,
     ID_UPDATE,
     ID_CONVERT,
+#ifdef WITH_PROFILING
+    ID_PERFORMANCE,
+#endif
 #if 0
     ID_LATENCYSTART_MAXSLOPE,
     ID_LATENCYSTART_HALFRISE,
@@ -132,6 +136,10 @@ enum {
     ID_PRINT_PREVIEW,
     ID_COPYINTABLE,
     ID_MULTIPLY,
+    ID_MULTIPLY_INPLACE,
+    ID_UNDO_EDIT,
+    ID_REDO_EDIT,
+    ID_EDIT_INPLACE,
     ID_SELECTSOME,
     ID_UNSELECTSOME,
     ID_MYSELECTALL,
@@ -144,7 +152,10 @@ enum {
     ID_CONCATENATE_MULTICHANNEL,
     ID_SUBTRACTBASE,
     ID_FILTER,
+    ID_DOWNSAMPLE,
     ID_POVERN,
+    ID_SPECTRUM,
+    ID_SPECTROGRAM,
     ID_PLOTCRITERION,
     ID_PLOTCORRELATION,
     ID_PLOTDECONVOLUTION,
@@ -157,26 +168,37 @@ enum {
     ID_EVENT_ADDEVENT,
     ID_EVENT_EXTRACT,
     ID_EVENT_ERASE,
+    ID_EVENT_ERASEONE,
     ID_COMBOTRACES,
     ID_SPINCTRLTRACES,
     ID_ZERO_INDEX,
     ID_COMBOACTCHANNEL,
     ID_COMBOINACTCHANNEL,
+    ID_LOADTIMER,
+    ID_MEMTIMER,
+    ID_PROFILETIMER,
 #ifdef WITH_PYTHON
-    ID_USERDEF, // this should be the last ID event
+    ID_USERDEF, // Python extensions use the 33 IDs from here on
+    ID_NATIVEPLUGIN = ID_USERDEF+33, // this should be the last ID event
+#else
+    ID_NATIVEPLUGIN, // this should be the last ID event
 #endif
 };
 
 #include <list>
+#include <map>
 
 #include <wx/mdi.h>
 #include <wx/docview.h>
 #include <wx/docmdi.h>
 #include <wx/fileconf.h>
+#include <wx/timer.h>
 #include <wx/settings.h>
 
 #include "./../stf.h"
 #include "./../../libstfnum/stfnum.h"
+#include "./../../libstfnum/funclib.h"
+#include "./../../libstfnum/plugin.h"
 
 #ifdef WITH_PYTHON
 
@@ -227,6 +249,7 @@ class wxStfView;
 class wxStfCursorsDlg;
 class wxStfParentFrame;
 class wxStfChildFrame;
+class wxStfTaskPool;
 class Section;
 
 //! The application, derived from wxApp
@@ -331,15 +354,16 @@ public:
     }
 
     //! Retrieves the functions that are available for least-squares minimisation.
-    /*! \return A vector containing the available functions.
+    /*! The library is shared by the whole process (see stfnum::FuncLib()).
+     *  \return A vector containing the available functions.
      */
-    const std::vector<stfnum::storedFunc>& GetFuncLib() const { return funcLib; }
+    const std::vector<stfnum::storedFunc>& GetFuncLib() const { return stfnum::FuncLib(); }
 
 
     //! Retrieves a pointer to a function for least-squares minimisation.
-    /*! \return A vector containing the available functions.
+    /*! \return A pointer to the function at index \e at of the library.
      */
-    stfnum::storedFunc* GetFuncLibPtr(std::size_t at) { return &funcLib.at(at); }
+    const stfnum::storedFunc* GetFuncLibPtr(std::size_t at) const { return &stfnum::GetFunc(at); }
 
 
     //! Retrieves a pointer to a function for least-squares minimisation.
@@ -347,11 +371,28 @@ public:
      */
     stfnum::storedFunc* GetLinFuncPtr( ) { return &storedLinFunc; }
 
+    //! Retrieves the analyses of the native plugin libraries.
+    /*! Plugin libraries are loaded at startup from the "plugins" folders
+     *  of the user data directory and of the installation (see
+     *  stfnum::LoadPluginDir()).
+     *  \return The analyses in the order of the "Native plugins" menu.
+     */
+    const std::vector<stfnum::NativePlugin>& GetNativePlugins() const { return nativePlugins; }
+
 #ifdef WITH_PYTHON
     //! Retrieves the user-defined extension functions.
     /*! \return A vector containing the user-defined functions.
      */
     const std::vector< stf::Extension >& GetExtensionLib() const { return extensionLib; }
+
+    //! Starts Python if this hasn't happened yet.
+    /*! The interpreter, the Python shell and the extensions are loaded
+     *  when the GUI becomes idle for the first time after start-up, or
+     *  earlier if a Python feature is used before. Extension menus are
+     *  filled in once the extensions have been loaded.
+     *  \return true if Python is available.
+     */
+    bool EnsurePython();
 #endif
 
     //! Retrieves the cursor settings dialog.
@@ -365,14 +406,20 @@ public:
     std::vector<stf::SectionPointer> GetSectionsWithFits() const;
     
     //! Writes an integer value to the configuration.
-    /*! \param main The main path within the configuration.
+    /*! Settings are kept in memory (see wxGetProfileInt()); changes are
+     *  written to the configuration file shortly afterwards, so that a
+     *  series of changes, e.g. while cursors are dragged, is written at once.
+     *  Must be called from the GUI thread.
+     *  \param main The main path within the configuration.
      *  \param sub The sub-path within the configuration.
      *  \param value The integer to write to the configuration.
      */
     void wxWriteProfileInt(const wxString& main,const wxString& sub, int value) const;
 
     //! Retrieves an integer value from the configuration.
-    /*! \param main The main path within the configuration.
+    /*! The configuration is read into memory once at startup, so that this
+     *  doesn't access the configuration file. Must be called from the GUI thread.
+     *  \param main The main path within the configuration.
      *  \param sub The sub-path within the configuration.
      *  \param default_ The default integer to return if the configuration entry can't be read.
      *  \return The integer that is stored in /main/sub, or default_ if the entry couldn't
@@ -410,6 +457,30 @@ public:
             const wxString& title = wxT("\0")
     );
 
+    //! Times the drawing of synthetic recordings of different sizes.
+    /*! Every recording is shown in a window of its own, with all sections
+     *  selected or none, and at different zoom levels. The graph is drawn
+     *  into an off-screen bitmap with and without the cached layer of the
+     *  traces behind the current trace. The median frame time, the frames
+     *  per second and, if profiling has been compiled in, the time per frame
+     *  of every drawing stage are written as JSON. Run with
+     *  --benchmark-render=results.json to compare builds.
+     *  \param fName Path of the JSON file.
+     *  \return true if all recordings could be shown and the results written.
+     */
+    bool RunRenderBenchmark(const wxString& fName);
+
+#if (__cplusplus >= 201103)
+    //! Creates a new child window that takes over the data without copying them.
+    /*! See NewChild() above; \e NewData is left without channels.
+     */
+    wxStfDoc* NewChild(
+            Recording&& NewData,
+            const wxStfDoc* Sender,
+            const wxString& title = wxT("\0")
+    );
+#endif
+
     //! Execute all pending calculations.
     /*! Whenever settings that have an effect on measurements, such as
      *  cursor positions or trace selections, are modified, this function
@@ -423,11 +494,24 @@ public:
     void SetMRActiveDoc(wxStfDoc* pDoc) {mrActiveDoc = pDoc;}
 
     //! Destroys the last cursor settings dialog when the last document is closed
-    /*! Do not use this function directly. It only needs to be called from wxStfDoc::OnCloseDocument().
+    /*! Also cancels the background tasks of the document.
+     *  Do not use this function directly. It only needs to be called from wxStfDoc::OnCloseDocument().
      *  \param pDoc Pointer to the document that is being closed.
      */
     void CleanupDocument(wxStfDoc* pDoc);
 
+    //! Updates the results table and the graph of a document when the GUI is idle.
+    /*! Several requests for the same document are merged into a single update.
+     *  \param pDoc The document whose windows should be updated.
+     */
+    void RequestUpdate(wxStfDoc* pDoc);
+
+    //! Retrieves the pool that runs analyses in the background.
+    /*! Only to be used on the GUI thread.
+     *  \return A reference to the task pool.
+     */
+    wxStfTaskPool& GetTaskPool() { return *taskPool; }
+
     //! Closes all documents
     bool CloseAll() { return GetDocManager()->CloseDocuments(); }
 
@@ -489,6 +573,9 @@ private:
     void OnCursorSettings( wxCommandEvent& event );
     void OnNewfromall( wxCommandEvent& event );
     void OnApplytoall( wxCommandEvent& event );
+    void OnEditInPlace( wxCommandEvent& event );
+    void OnUpdateEditInPlace( wxUpdateUIEvent& event );
+    void OnIdle( wxIdleEvent& event );
     void OnProcessCustom( wxCommandEvent& event );
     void OnKeyDown( wxKeyEvent& event );
     
@@ -498,9 +585,24 @@ private:
     bool Init_wxPython();
     bool Exit_wxPython();
     std::vector<stf::Extension> LoadExtensions();
+    void FillExtensionsMenu(wxMenu* extensions_menu) const;
+    // Refills the extension menus of all frames:
+    void UpdateExtensionsMenus();
 #endif // WITH_PYTHON
 
     wxMenuBar* CreateUnifiedMenuBar(wxStfDoc* doc=NULL);
+    // Reads a file series in parallel into a single new document:
+    bool OpenFileSeriesSingle(const wxArrayString& fNameArray, wxProgressDialog& progDlg);
+    // Used by NewChild():
+    wxStfDoc* CreateChildDoc(const wxString& title);
+    void DiscardChildDoc(wxStfDoc* NewDoc, const wxString& msg);
+    // Location of the FFTW wisdom that is kept across sessions:
+    wxString GetFFTWWisdomFile() const;
+    // Reads all settings of the configuration into memory:
+    void LoadProfile();
+    // Writes changed settings to the configuration file:
+    void FlushProfile() const;
+    void OnProfileTimer(wxTimerEvent& event);
     
 #ifdef _WINDOWS
 #pragma optimize( "", off )
@@ -518,23 +620,36 @@ private:
 #else
     std::shared_ptr<wxFileConfig> config;
 #endif
-
-    std::vector<stfnum::storedFunc> funcLib;
+    // All settings of the configuration by their path, e.g. "/Settings/Direction":
+    mutable std::map<wxString, wxString> profile;
+    // Changed settings are written to the configuration file when this expires:
+    mutable wxTimer profileTimer;
+    mutable bool profileChanged;
+
+    std::vector<stfnum::NativePlugin> nativePlugins;
+    void LoadNativePlugins();
+    void OnNativePlugin(wxCommandEvent& event);
 #ifdef WITH_PYTHON
     std::vector< stf::Extension > extensionLib;
 #endif
     // Pointer to the cursors settings dialog box
     wxStfCursorsDlg* CursorsDialog;
     wxDocTemplate* m_cfsTemplate, *m_hdf5Template, *m_txtTemplate,*m_abfTemplate,
-      *m_atfTemplate,*m_axgTemplate,*m_sonTemplate, *m_hekaTemplate, *m_intanTemplate, *m_tdmsTemplate, *m_biosigTemplate;
+      *m_atfTemplate,*m_axgTemplate,*m_sonTemplate, *m_hekaTemplate, *m_intanTemplate, *m_tdmsTemplate, *m_nwbTemplate, *m_zarrTemplate, *m_biosigTemplate;
     stfnum::storedFunc storedLinFunc;
     // wxMenu* m_file_menu;
     wxString m_fileToLoad;
+    // JSON file of the rendering benchmark, empty if it isn't run:
+    wxString m_renderBenchmark;
     /*std::list<wxStfDoc *> activeDoc;*/
     wxStfDoc* mrActiveDoc;
+    wxStfTaskPool* taskPool;
+    // Documents whose windows are updated when the GUI is idle:
+    std::vector<wxStfDoc*> pendingUpdates;
 
 #ifdef WITH_PYTHON
     PyThreadState* m_mainTState;
+    enum { python_pending, python_starting, python_ready, python_failed } pythonState;
 #endif
 
     DECLARE_EVENT_TABLE()
@@ -536,19 +536,31 @@ void wxStfChildFrame::UpdateResults() {
         }
     }
 
+    // This is called for every mouse move while a cursor is dragged, so only
+    // the cells that have changed are set, and the grid is redrawn once:
+    m_table->BeginBatch();
     for (std::size_t nRow=0;nRow<table.nRows();++nRow) {
         // set row label:
-        m_table->SetRowLabelValue((int)nRow, stf::std2wx(table.GetRowLabel(nRow)));
+        wxString rowLabel(stf::std2wx(table.GetRowLabel(nRow)));
+        if (m_table->GetRowLabelValue((int)nRow) != rowLabel)
+            m_table->SetRowLabelValue((int)nRow, rowLabel);
         for (std::size_t nCol=0;nCol<table.nCols();++nCol) {
-            if (nRow==0) m_table->SetColLabelValue((int)nCol, stf::std2wx(table.GetColLabel(nCol)));
+            if (nRow==0) {
+                wxString colLabel(stf::std2wx(table.GetColLabel(nCol)));
+                if (m_table->GetColLabelValue((int)nCol) != colLabel)
+                    m_table->SetColLabelValue((int)nCol, colLabel);
+            }
+            wxString entry;
             if (!table.IsEmpty(nRow,nCol)) {
-                wxString entry; entry << table.at(nRow,nCol);
-                m_table->SetCellValue((int)nRow,(int)nCol,entry);
+                entry << table.at(nRow,nCol);
             } else {
-                m_table->SetCellValue((int)nRow,(int)nCol,wxT("n.a."));
+                entry = wxT("n.a.");
             }
+            if (m_table->GetCellValue((int)nRow,(int)nCol) != entry)
+                m_table->SetCellValue((int)nRow,(int)nCol,entry);
         }
     }
+    m_table->EndBatch();
 }
 
 void wxStfChildFrame::Saveperspective() {
@@ -173,11 +173,21 @@ public:
      */
     bool ShowSelected() const {return pShowSelected->IsChecked();}
 
+    //! Sets whether all selected traces should be plotted.
+    /*! \param value true if they should be plotted, false otherwise.
+     */
+    void SetShowSelected(bool value) {pShowSelected->SetValue(value);}
+
     //! Indicates whether the second channel should be plotted.
     /*! \return true if it should be plotted, false otherwise.
      */
     bool ShowSecond();// const {return pShowSecond->IsChecked();}
 
+    //! Sets whether the second channel should be plotted.
+    /*! \param value true if it should be plotted, false otherwise.
+     */
+    void SetShowSecond(bool value) {pShowSecond->SetValue(value);}
+
     //! Indicates whether all channels should be plotted.
     /*! \return true if they should be plotted, false otherwise.
      */
@@ -25,6 +25,9 @@
 #include "wx/grid.h"
 #include "wx/clipbrd.h"
 
+#include <sstream>
+#include <algorithm>
+
 
 #include "./app.h"
 #include "./doc.h"
@@ -32,6 +35,7 @@
 #include "./childframe.h"
 #include "./view.h"
 #include "./graph.h"
+#include "./table.h"
 #include "./copygrid.h"
 
 
@@ -104,34 +108,63 @@ void wxStfGrid::Copy(wxCommandEvent& WXUNUSED(event)) {
         wxGetApp().ErrorMsg( wxT("Select cells first") );
         return;
     }
-    // Write some text to the clipboard
-    // These data objects are held by the clipboard, 
-    // so do not delete them in the app.
-    selection.Clear();
-    bool newline=true;
-    for (int nRow=0;nRow<GetNumberRows();++nRow) {
-        /* bool selected=false;*/
-        newline=true;
-        for (int nCol=0;nCol<GetNumberCols();++nCol) {
+    // Only the bounding box of the selection is scanned, rather than the whole grid:
+    int topRow = GetNumberRows(), bottomRow = -1, leftCol = GetNumberCols(), rightCol = -1;
+    wxGridCellCoordsArray topLeft(GetSelectionBlockTopLeft());
+    wxGridCellCoordsArray bottomRight(GetSelectionBlockBottomRight());
+    for (std::size_t n = 0; n < topLeft.size() && n < bottomRight.size(); ++n) {
+        topRow = std::min(topRow, topLeft[n].GetRow());
+        leftCol = std::min(leftCol, topLeft[n].GetCol());
+        bottomRow = std::max(bottomRow, bottomRight[n].GetRow());
+        rightCol = std::max(rightCol, bottomRight[n].GetCol());
+    }
+    wxGridCellCoordsArray cells(GetSelectedCells());
+    for (std::size_t n = 0; n < cells.size(); ++n) {
+        topRow = std::min(topRow, cells[n].GetRow());
+        leftCol = std::min(leftCol, cells[n].GetCol());
+        bottomRow = std::max(bottomRow, cells[n].GetRow());
+        rightCol = std::max(rightCol, cells[n].GetCol());
+    }
+    wxArrayInt rows(GetSelectedRows());
+    for (std::size_t n = 0; n < rows.size(); ++n) {
+        topRow = std::min(topRow, rows[n]);
+        bottomRow = std::max(bottomRow, rows[n]);
+        leftCol = 0;
+        rightCol = GetNumberCols()-1;
+    }
+    wxArrayInt cols(GetSelectedCols());
+    for (std::size_t n = 0; n < cols.size(); ++n) {
+        leftCol = std::min(leftCol, cols[n]);
+        rightCol = std::max(rightCol, cols[n]);
+        topRow = 0;
+        bottomRow = GetNumberRows()-1;
+    }
+
+    // Cells of result tables are formatted directly rather than through the grid:
+    wxStfTable* pTable = dynamic_cast<wxStfTable*>(GetTable());
+    std::ostringstream out;
+    bool firstLine=true;
+    for (int nRow=topRow;nRow<=bottomRow;++nRow) {
+        bool newline=true;
+        for (int nCol=leftCol;nCol<=rightCol;++nCol) {
             if (IsInSelection(nRow,nCol)) {
                 // Add a line break if this is not the first line:
-                if (newline && selection != wxT("") ) {
-                    selection << wxT("\n");
+                if (newline && !firstLine) {
+                    out << "\n";
                 }
                 if (!newline) {
-                    selection << wxT("\t");
+                    out << "\t";
                 }
                 newline=false;
-                try {
-                    selection << GetCellValue(nRow,nCol);
-                    /* selected=true;*/
-                }
-                catch (const std::out_of_range& e) {
-                    throw e;
-                }
+                firstLine=false;
+                out << stf::wx2std(pTable != NULL ? pTable->FormatCell(nRow,nCol) : GetCellValue(nRow,nCol));
             }
         }
     }
+    // Write some text to the clipboard
+    // These data objects are held by the clipboard, 
+    // so do not delete them in the app.
+    selection = stf::std2wx(out.str());
     if (wxTheClipboard->Open()) {
         wxTheClipboard->SetData(
                                 new wxTextDataObject(selection)
@@ -136,6 +136,7 @@ wxStfConvertDlg::wxStfConvertDlg(wxWindow* parent, int id, wxString title, wxPoi
     wxArrayString mydestextensions; //ordered by importance 
     mydestextensions.Add(wxT("Igor binary   [*.ibw ]"));
     mydestextensions.Add(wxT("Axon textfile [*.atf ]"));
+    mydestextensions.Add(wxT("HDF5          [*.h5  ]"));
 #if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
     mydestextensions.Add(wxT("GDF (Biosig) [*.gdf ]"));
 #endif
@@ -197,8 +198,11 @@ void wxStfConvertDlg::OnComboBoxDestExt(wxCommandEvent& event){
         case 1:
             destFilterExt = stfio::atf;
             break;
-#if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
         case 2:
+            destFilterExt = stfio::hdf5;
+            break;
+#if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
+        case 3:
             destFilterExt = stfio::biosig;
             break;
 #endif
@@ -292,9 +292,8 @@ void wxStfFitSelDlg::SetPars() {
         }
         Vector_double x(fitSize);
         //fill array:
-        std::copy(&pDoc->cursec()[pDoc->GetFitBeg()],
-                  &pDoc->cursec()[pDoc->GetFitBeg()+fitSize],
-                  &x[0]);
+        pDoc->cursec().CopyRange(pDoc->GetFitBeg(), pDoc->GetFitBeg()+fitSize,
+                                 x.empty() ? NULL : &x[0]);
         Vector_double initPars(wxGetApp().GetFuncLib().at(m_fselect).pInfo.size());
         wxGetApp().GetFuncLib().at(m_fselect).init( x, pDoc->GetBase(),
             pDoc->GetPeak(), pDoc->GetRTLoHi(), pDoc->GetHalfDuration(),
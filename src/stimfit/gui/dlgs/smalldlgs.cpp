@@ -12,6 +12,7 @@
 #include "./../app.h"
 
 #include "./smalldlgs.h"
+#include "./../../../libstfio/profile.h"
 
 BEGIN_EVENT_TABLE( wxStfFileInfoDlg, wxDialog )
 END_EVENT_TABLE()
@@ -231,7 +232,8 @@ wxStfAlignDlg::wxStfAlignDlg(wxWindow* parent, bool hasReference, int id, wxStri
         wxT("peak"),
         wxT("steepest slope during rise"),
         wxT("half amplitude"),
-        wxT("onset")
+        wxT("onset"),
+        wxT("cross-correlation within the peak window")
     };
     int m_radioBoxNChoices = sizeof( m_radioBoxChoices ) / sizeof( wxString );
     m_radioBox = new wxRadioBox(
@@ -285,11 +287,13 @@ wxStfFilterSelDlg::wxStfFilterSelDlg(wxWindow* parent, int id, wxString title, w
     wxString m_radioBoxChoices[] = { 
             wxT("Notch (inverted Gaussian)"),
             wxT("Low pass (4th-order Bessel)"), 
-            wxT("Low pass (Gaussian)") 
+            wxT("Low pass (Gaussian)"),
+            wxT("Low pass (4th-order Bessel, zero-phase time domain)"),
+            wxT("Low pass (4th-order Butterworth, zero-phase time domain)")
     };
     int m_radioBoxNChoices = sizeof( m_radioBoxChoices ) / sizeof( wxString );
     m_radioBox = new wxRadioBox( this, wxID_ANY, wxT("Select filter function"), wxDefaultPosition,
-            wxDefaultSize, m_radioBoxNChoices, m_radioBoxChoices, 3, wxRA_SPECIFY_ROWS );
+            wxDefaultSize, m_radioBoxNChoices, m_radioBoxChoices, m_radioBoxNChoices, wxRA_SPECIFY_ROWS );
     topSizer->Add( m_radioBox, 0, wxALL, 5 );
 
     m_sdbSizer = new wxStdDialogButtonSizer();
@@ -407,12 +411,92 @@ wxStfFitInfoDlg::wxStfFitInfoDlg(wxWindow* parent, const wxString& info, int id,
     this->Layout();
 }
 
+#ifdef WITH_PROFILING
+#define wxPERFREFRESH 1000
+#define wxPERFRESET   1001
+#define wxPERFTRACE   1002
+
+BEGIN_EVENT_TABLE( wxStfPerformanceDlg, wxDialog )
+EVT_BUTTON( wxPERFREFRESH, wxStfPerformanceDlg::OnRefresh )
+EVT_BUTTON( wxPERFRESET, wxStfPerformanceDlg::OnReset )
+EVT_BUTTON( wxPERFTRACE, wxStfPerformanceDlg::OnSaveTrace )
+END_EVENT_TABLE()
+
+wxStfPerformanceDlg::wxStfPerformanceDlg(wxWindow* parent, int id, wxString title,
+        wxPoint pos, wxSize size, int style)
+: wxDialog( parent, id, title, pos, size, style )
+{
+    wxBoxSizer* topSizer;
+    topSizer = new wxBoxSizer( wxVERTICAL );
+
+    m_textCtrl=new wxTextCtrl(
+            this,
+            wxID_ANY,
+            wxT(""),
+            wxDefaultPosition,
+            wxSize(640,400),
+            wxTE_MULTILINE | wxTE_READONLY | wxTE_DONTWRAP
+    );
+    // the report is a table with aligned columns:
+    m_textCtrl->SetFont( wxFont(9, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL) );
+    topSizer->Add( m_textCtrl, 1, wxEXPAND | wxALL, 5 );
+
+    wxBoxSizer* buttonSizer = new wxBoxSizer( wxHORIZONTAL );
+    buttonSizer->Add( new wxButton( this, wxPERFREFRESH, wxT("&Refresh") ), 0, wxALL, 2 );
+    buttonSizer->Add( new wxButton( this, wxPERFRESET, wxT("R&eset") ), 0, wxALL, 2 );
+    buttonSizer->Add( new wxButton( this, wxPERFTRACE, wxT("&Save trace...") ), 0, wxALL, 2 );
+    topSizer->Add( buttonSizer, 0, wxALIGN_CENTER | wxALL, 5 );
+
+    m_sdbSizer = new wxStdDialogButtonSizer();
+    m_sdbSizer->AddButton( new wxButton( this, wxID_OK ) );
+    m_sdbSizer->Realize();
+    topSizer->Add( m_sdbSizer, 0, wxALIGN_CENTER | wxALL, 5 );
+
+    topSizer->SetSizeHints(this);
+    this->SetSizer( topSizer );
+
+    this->Layout();
+    UpdateReport();
+}
+
+void wxStfPerformanceDlg::UpdateReport() {
+    m_textCtrl->SetValue( stf::std2wx(stfio::profileReport()) );
+}
+
+void wxStfPerformanceDlg::OnRefresh( wxCommandEvent& event ) {
+    event.Skip();
+    UpdateReport();
+}
+
+void wxStfPerformanceDlg::OnReset( wxCommandEvent& event ) {
+    event.Skip();
+    stfio::profileReset();
+    UpdateReport();
+}
+
+void wxStfPerformanceDlg::OnSaveTrace( wxCommandEvent& event ) {
+    event.Skip();
+    wxFileDialog SaveTraceDialog( this, wxT("Save trace"), wxT(""), wxT("stimfit-trace.json"),
+            wxT("Chrome trace (*.json)|*.json"), wxFD_SAVE | wxFD_OVERWRITE_PROMPT );
+    if (SaveTraceDialog.ShowModal() != wxID_OK) {
+        return;
+    }
+    try {
+        stfio::writeChromeTrace( stf::wx2std(SaveTraceDialog.GetPath()) );
+    }
+    catch (const std::exception& e) {
+        wxGetApp().ExceptMsg( stf::std2wx(e.what()) );
+    }
+}
+#endif
+
 BEGIN_EVENT_TABLE( wxStfBatchDlg, wxDialog )
 END_EVENT_TABLE()
 
 wxStfBatchDlg::wxStfBatchDlg(wxWindow* parent, int id, wxString title, wxPoint pos,
         wxSize size, int style)
-: wxDialog( parent, id, wxT("Choose values"), pos, size, style ), batchOptions( 0 )
+: wxDialog( parent, id, wxT("Choose values"), pos, size, style ), batchOptions( 0 ),
+  streamToFile( false )
 {
     wxBoxSizer* topSizer;
     topSizer = new wxBoxSizer( wxVERTICAL );
@@ -458,6 +542,11 @@ wxStfBatchDlg::wxStfBatchDlg(wxWindow* parent, int id, wxString title, wxPoint p
     }
     topSizer->Add( m_checkList, 0, wxALIGN_CENTER | wxALL, 5 );
 
+    m_streamCheck = new wxCheckBox( this, wxID_ANY, wxT("Write results to a file during the analysis"),
+                                    wxDefaultPosition, wxDefaultSize, 0 );
+    m_streamCheck->SetValue( wxGetApp().wxGetProfileInt( wxT("Batch Dialog"), wxT("Stream to file"), 0 ) != 0 );
+    topSizer->Add( m_streamCheck, 0, wxALIGN_LEFT | wxALL, 5 );
+
     m_sdbSizer = new wxStdDialogButtonSizer();
     m_sdbSizer->AddButton( new wxButton( this, wxID_OK ) );
     m_sdbSizer->AddButton( new wxButton( this, wxID_CANCEL ) );
@@ -487,6 +576,8 @@ bool wxStfBatchDlg::OnOK() {
         bo_it->selection = m_checkList->IsChecked( bo_it->index );
         wxGetApp().wxWriteProfileInt( wxT("Batch Dialog"), bo_it->label, bo_it->selection );
     }
+    streamToFile = m_streamCheck->IsChecked();
+    wxGetApp().wxWriteProfileInt( wxT("Batch Dialog"), wxT("Stream to file"), streamToFile );
     return true;
 }
 
@@ -162,6 +162,12 @@ public:
      */
     int AlignRise() const {return m_alignRise;}
 
+    //! Indicates whether the average should be aligned by cross-correlation.
+    /*!  \return true if the lags should be computed by stfnum::correlationLags()
+     *           rather than from an alignment point.
+     */
+    bool UseCorrelation() const {return m_alignRise == 4;}
+
     //! Indicates whether the reference channel should be used for alignment
     /*!  \return true if the reference channel should be used, false if the active
      *           channel should be used
@@ -294,6 +300,41 @@ public:
     );
 };
 
+#ifdef WITH_PROFILING
+//! Dialog showing the timers and counters of the instrumentation (see profile.h).
+class wxStfPerformanceDlg : public wxDialog 
+{
+    DECLARE_EVENT_TABLE()
+
+private:
+    wxTextCtrl* m_textCtrl;
+    wxStdDialogButtonSizer* m_sdbSizer;
+
+    void UpdateReport();
+    void OnRefresh( wxCommandEvent& event );
+    void OnReset( wxCommandEvent& event );
+    void OnSaveTrace( wxCommandEvent& event );
+
+public:
+    //! Constructor
+    /*! \param parent Pointer to parent window.
+     *  \param id Window id.
+     *  \param title Dialog title.
+     *  \param pos Initial position.
+     *  \param size Initial size.
+     *  \param style Dialog style.
+     */
+    wxStfPerformanceDlg(
+            wxWindow* parent,
+            int id = wxID_ANY,
+            wxString title = wxT("Performance"),
+            wxPoint pos = wxDefaultPosition,
+            wxSize size = wxDefaultSize,
+            int style = wxCAPTION
+    );
+};
+#endif
+
 //! small struct representing a batch dialog option
 struct BatchOption {
     //! Default constructor
@@ -317,8 +358,10 @@ class wxStfBatchDlg : public wxDialog
 
     private:
     std::vector<BatchOption> batchOptions;
+    bool streamToFile;
     
     wxCheckListBox*	m_checkList;	
+    wxCheckBox* m_streamCheck;
     wxStdDialogButtonSizer* m_sdbSizer;
 
     //! Only called when a modal dialog is closed with the OK button.
@@ -465,6 +508,12 @@ public:
     /*! \return true if it should be printed, false otherwise.
      */
     bool PrintFitResults() const {return LookUp(id_fit).selection;}
+
+    //! Indicates whether the results should be written to a file while the sections are analysed.
+    /*! \return true if each row should be written as soon as it has been measured,
+     *          false if all results should be shown in a table at the end.
+     */
+    bool StreamToFile() const {return streamToFile;}
     
     //! Called upon ending a modal dialog.
     /*! \param retCode The dialog button id that ended the dialog
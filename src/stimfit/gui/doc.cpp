@@ -16,10 +16,13 @@
 // The document class, derived from both wxDocument and recording
 // 2007-12-27, Christoph Schmidt-Hieber, University of Freiburg
 
+#include <algorithm>
+
 // For compilers that support precompilation, includes "wx/wx.h".
 #include <wx/wxprec.h>
 #include <wx/progdlg.h>
 #include <wx/filename.h>
+#include <wx/timer.h>
 #ifdef __BORLANDC__
 #pragma hdrstop
 #endif
@@ -44,7 +47,17 @@
 #include "./../../libstfnum/fit.h"
 #include "./../../libstfnum/funclib.h"
 #include "./../../libstfnum/measure.h"
+#include "./../../libstfnum/events.h"
+#include "./../../libstfnum/eventstats.h"
+#include "./../../libstfnum/tdfilter.h"
+#include "./../../libstfnum/derived.h"
+#include "./../../libstfnum/spectrum.h"
+#include "./../../libstfnum/align.h"
 #include "./../../libstfio/stfio.h"
+#include "./../../libstfio/hdf5/hdf5lib.h"
+#include "./../../libstfio/profile.h"
+#include "./../../libstfio/sidecar.h"
+#include "./../../libstfio/tablestream.h"
 #ifdef WITH_PYTHON
 #include "./../../pystfio/pystfio.h"
 #endif
@@ -52,6 +65,7 @@
 #include "./usrdlg/usrdlg.h"
 #include "./doc.h"
 #include "./graph.h"
+#include "./taskpool.h"
 
 IMPLEMENT_DYNAMIC_CLASS(wxStfDoc, wxDocument)
 
@@ -73,12 +87,20 @@ EVT_MENU( ID_BATCH, wxStfDoc::OnAnalysisBatch )
 EVT_MENU( ID_INTEGRATE, wxStfDoc::OnAnalysisIntegrate )
 EVT_MENU( ID_DIFFERENTIATE, wxStfDoc::OnAnalysisDifferentiate )
 EVT_MENU( ID_MULTIPLY, wxStfDoc::Multiply)
+EVT_MENU( ID_MULTIPLY_INPLACE, wxStfDoc::MultiplyInPlace)
+EVT_MENU( ID_UNDO_EDIT, wxStfDoc::OnUndoEdit)
+EVT_MENU( ID_REDO_EDIT, wxStfDoc::OnRedoEdit)
+EVT_UPDATE_UI( ID_UNDO_EDIT, wxStfDoc::OnUpdateUndoEdit)
+EVT_UPDATE_UI( ID_REDO_EDIT, wxStfDoc::OnUpdateRedoEdit)
 EVT_MENU( ID_SUBTRACTBASE, wxStfDoc::SubtractBaseMenu )
 EVT_MENU( ID_FIT, wxStfDoc::FitDecay)
 EVT_MENU( ID_LFIT, wxStfDoc::LFit)
 EVT_MENU( ID_LOG, wxStfDoc::LnTransform)
 EVT_MENU( ID_FILTER,wxStfDoc::Filter)
+EVT_MENU( ID_DOWNSAMPLE,wxStfDoc::Downsample)
 EVT_MENU( ID_POVERN,wxStfDoc::P_over_N)
+EVT_MENU( ID_SPECTRUM,wxStfDoc::PowerSpectrum)
+EVT_MENU( ID_SPECTROGRAM,wxStfDoc::Spectrogram)
 EVT_MENU( ID_PLOTCRITERION,wxStfDoc::Plotcriterion)
 EVT_MENU( ID_PLOTCORRELATION,wxStfDoc::Plotcorrelation)
 EVT_MENU( ID_PLOTDECONVOLUTION,wxStfDoc::Plotdeconvolution)
@@ -87,9 +109,89 @@ EVT_MENU( ID_THRESHOLD,wxStfDoc::Threshold)
 EVT_MENU( ID_VIEWTABLE, wxStfDoc::Viewtable)
 EVT_MENU( ID_EVENT_EXTRACT, wxStfDoc::Extract )
 EVT_MENU( ID_EVENT_ERASE, wxStfDoc::InteractiveEraseEvents )
+EVT_MENU( ID_EVENT_ERASEONE, wxStfDoc::EraseEvent )
 EVT_MENU( ID_EVENT_ADDEVENT, wxStfDoc::AddEvent )
+EVT_TIMER( ID_LOADTIMER, wxStfDoc::OnLoadTimer )
 END_EVENT_TABLE()
 
+// Reads sections [begin, end) of a file in batches of growing size. The
+// batches are collected until the GUI thread merges them into the document.
+class wxStfSectionLoader : public wxThread {
+public:
+    wxStfSectionLoader(const std::string& fName_, stfio::filetype type_,
+                       std::size_t begin_, std::size_t end_)
+        : wxThread(wxTHREAD_JOINABLE), fName(fName_), type(type_),
+          begin(begin_), end(end_), finished(false), cancel(false)
+    {}
+
+    // Moves the batches that have been read so far into batches_.
+    // Returns true once all batches have been handed out.
+    bool TakeBatches(std::vector< std::pair<std::size_t, Recording> >& batches_,
+                     std::string& error_)
+    {
+        wxCriticalSectionLocker locker(cs);
+        batches_.swap(batches);
+        batches.clear();
+        error_ = error;
+        return finished;
+    }
+
+    void Cancel() {
+        wxCriticalSectionLocker locker(cs);
+        cancel = true;
+    }
+
+protected:
+    virtual ExitCode Entry() {
+        std::size_t batch_size = 8;
+        std::size_t pos = begin;
+        while (pos < end) {
+            {
+                wxCriticalSectionLocker locker(cs);
+                if (cancel) {
+                    break;
+                }
+            }
+            std::size_t next = std::min(pos+batch_size, end);
+            std::pair<std::size_t, Recording> batch(pos, Recording());
+            try {
+                stfio::StdoutProgressInfo progDlg("", "", 100, false);
+                stfio::importFileRange(fName, type, batch.second, progDlg, pos, next);
+            }
+            catch (const std::exception& e) {
+                wxCriticalSectionLocker locker(cs);
+                error = e.what();
+                if (error.empty()) {
+                    error = "Unknown error";
+                }
+                break;
+            }
+            {
+                wxCriticalSectionLocker locker(cs);
+                batches.push_back(batch);
+            }
+            pos = next;
+            // show the first sections early, then read more at a time:
+            if (batch_size < 256) {
+                batch_size *= 2;
+            }
+        }
+        wxCriticalSectionLocker locker(cs);
+        finished = true;
+        return 0;
+    }
+
+private:
+    std::string fName;
+    stfio::filetype type;
+    std::size_t begin, end;
+
+    wxCriticalSection cs;
+    std::vector< std::pair<std::size_t, Recording> > batches;
+    std::string error;
+    bool finished, cancel;
+};
+
 static const int baseline=100;
 // static const double rtfrac = 0.2; // now expressed in percentage, see RTFactor
 
@@ -189,15 +291,22 @@ wxStfDoc::wxStfDoc() :
     viewCursors(true),
     xzoom(XZoom(0, 0.1, false)),
     yzoom(size(), YZoom(500,0.1,false)),
-    sec_attr(size())
+    sec_attr(size()),
+    emptySecAttr(),
+    measureCache(new stfnum::MeasurementCache),
+    loader(NULL),
+    loadTimer(NULL),
+    loaded_end(0),
+    history(),
+    epoch(0)
 {
-    for (std::size_t nchannel=0; nchannel < sec_attr.size(); ++nchannel) {
-        sec_attr[nchannel].resize(at(nchannel).size());
-    }
 }
 
 wxStfDoc::~wxStfDoc()
-{}
+{
+    StopLoading();
+    delete measureCache;
+}
 
 bool wxStfDoc::OnOpenPyDocument(const wxString& filename) {
     progress = false;
@@ -244,49 +353,49 @@ bool wxStfDoc::OnOpenDocument(const wxString& filename) {
             }
         }
 #endif
-        if (type == stfio::tdms) {
-#ifdef WITH_PYTHON
-            if (!LoadTDMS(stf::wx2std(filename), *this)) {
-                wxString errorMsg(wxT("Error opening file\n"));
-#else
-            {
-                wxString errorMsg(wxT("Error opening file - TDMS requires python \n"));
-#endif
-                wxGetApp().ExceptMsg(errorMsg);
-                get().clear();
-                return false;
-            }
-        } else {
-            try {
-                if (progress) {
+        try {
+            if (progress) {
+                // a sidecar index is only written after a complete import and
+                // makes reading the file in the background unnecessary:
+                if (stfio::getSidecarIndex() || !StartProgressiveLoad(stf::wx2std(filename), type)) {
                     stf::wxProgressInfo progDlg("Reading file", "Opening file", 100);
                     stfio::importFile(stf::wx2std(filename), type, *this, wxGetApp().GetTxtImport(), progDlg);
-                } else {
-                    stfio::StdoutProgressInfo progDlg("Reading file", "Opening file", 100, true);
-                    stfio::importFile(stf::wx2std(filename), type, *this, wxGetApp().GetTxtImport(), progDlg);
                 }
+            } else {
+                stfio::StdoutProgressInfo progDlg("Reading file", "Opening file", 100, true);
+                stfio::importFile(stf::wx2std(filename), type, *this, wxGetApp().GetTxtImport(), progDlg);
             }
-            catch (const std::runtime_error& e) {
-                wxString errorMsg(wxT("Error opening file\n"));
-                errorMsg += wxString( e.what(),wxConvLocal );
-                wxGetApp().ExceptMsg(errorMsg);
-                get().clear();
-                return false;
-            }
-            catch (const std::exception& e) {
-                wxString errorMsg(wxT("Error opening file\n"));
-                errorMsg += wxString( e.what(), wxConvLocal );
-                wxGetApp().ExceptMsg(errorMsg);
-                get().clear();
-                return false;
-            }
-            catch (...) {
-                wxString errorMsg(wxT("Error opening file\n"));
-                wxGetApp().ExceptMsg(errorMsg);
-                get().clear();
-                return false;
+            if (type == stfio::hdf5) {
+                // cached fit results are applied by PostInit(); losing
+                // them only means that sections have to be fitted again:
+                try {
+                    storedFitCaches = stfio::importHDF5FitCaches(stf::wx2std(filename));
+                }
+                catch (const std::runtime_error&) {
+                    storedFitCaches.clear();
+                }
             }
         }
+        catch (const std::runtime_error& e) {
+            wxString errorMsg(wxT("Error opening file\n"));
+            errorMsg += wxString( e.what(),wxConvLocal );
+            wxGetApp().ExceptMsg(errorMsg);
+            get().clear();
+            return false;
+        }
+        catch (const std::exception& e) {
+            wxString errorMsg(wxT("Error opening file\n"));
+            errorMsg += wxString( e.what(), wxConvLocal );
+            wxGetApp().ExceptMsg(errorMsg);
+            get().clear();
+            return false;
+        }
+        catch (...) {
+            wxString errorMsg(wxT("Error opening file\n"));
+            wxGetApp().ExceptMsg(errorMsg);
+            get().clear();
+            return false;
+        }
         if (get().empty()) {
             wxGetApp().ErrorMsg(wxT("File is probably empty\n"));
             get().clear();
@@ -363,7 +472,22 @@ void wxStfDoc::SetData( const Recording& c_Data, const wxStfDoc* Sender, const w
     resize(c_Data.size());
     std::copy(c_Data.get().begin(),c_Data.get().end(),get().begin());
     CopyAttributes(c_Data);
+    InitData(Sender, title);
+}
+
+#if (__cplusplus >= 201103)
+void wxStfDoc::SetData( Recording&& c_Data, const wxStfDoc* Sender, const wxString& title )
+{
+    resize(c_Data.size());
+    // before the channels, whose units would be gone afterwards, are moved:
+    CopyAttributes(c_Data);
+    std::move(c_Data.get().begin(),c_Data.get().end(),get().begin());
+    InitData(Sender, title);
+}
+#endif
 
+void wxStfDoc::InitData( const wxStfDoc* Sender, const wxString& title )
+{
     // Make sure curChannel and curSection are not out of range:
     std::out_of_range e("Data empty in wxStimfitDoc::SetData()");
     if (get().empty()) {
@@ -551,10 +675,21 @@ void wxStfDoc::PostInit() {
 
     // Update some vector sizes
     sec_attr.resize(size());
-    for (std::size_t nchannel=0; nchannel < sec_attr.size(); ++nchannel) {
-        sec_attr[nchannel].resize(at(nchannel).size());
+    // Fit results that were stored with the file:
+    for (std::size_t nchannel=0; nchannel < size() && nchannel < storedFitCaches.size(); ++nchannel) {
+        for (std::size_t nsection=0; nsection < at(nchannel).size() &&
+                 nsection < storedFitCaches[nchannel].size(); ++nsection)
+        {
+            if (storedFitCaches[nchannel][nsection].size() != 0) {
+                SectionAttrW(nchannel, nsection).fitCache = storedFitCaches[nchannel][nsection];
+            }
+        }
     }
+    storedFitCaches.clear();
     yzoom.resize(size());
+    // The average of the selected traces is updated whenever a trace is
+    // selected or unselected, so that it needn't be computed from scratch:
+    SetLiveAverage(true);
     
     try {
         pFrame->CreateMenuTraces(get().at(GetCurChIndex()).size());
@@ -705,7 +840,109 @@ void wxStfDoc::Fileinfo(wxCommandEvent& WXUNUSED(event)) {
     dlg.ShowModal();
 }
 
+bool wxStfDoc::StartProgressiveLoad(const std::string& fName, stfio::filetype type) {
+    std::vector<std::size_t> counts = stfio::getSectionCounts(fName, type);
+    std::size_t n_sections = 0;
+    for (std::size_t nc = 0; nc < counts.size(); ++nc) {
+        n_sections = std::max(n_sections, counts[nc]);
+    }
+    if (n_sections < 2) {
+        return false;
+    }
+
+    // Read the first section now and leave room for the others:
+    stfio::StdoutProgressInfo progDlg("Reading file", "Opening file", 100, false);
+    stfio::importFileRange(fName, type, *this, progDlg, 0, 1);
+    for (std::size_t nc = 0; nc < size() && nc < counts.size(); ++nc) {
+        get()[nc].resize(counts[nc]);
+    }
+    loaded_end = 1;
+
+    loader = new wxStfSectionLoader(fName, type, 1, n_sections);
+    if (loader->Create() != wxTHREAD_NO_ERROR || loader->Run() != wxTHREAD_NO_ERROR) {
+        delete loader;
+        loader = NULL;
+        get().clear();
+        return false;
+    }
+    loadTimer = new wxTimer(this, ID_LOADTIMER);
+    loadTimer->Start(100);
+    return true;
+}
+
+void wxStfDoc::MergeLoadedSections() {
+    if (loader == NULL) {
+        return;
+    }
+    std::vector< std::pair<std::size_t, Recording> > batches;
+    std::string error;
+    bool finished = loader->TakeBatches(batches, error);
+    for (std::size_t nb = 0; nb < batches.size(); ++nb) {
+        std::size_t begin = batches[nb].first;
+        Recording& batch = batches[nb].second;
+        for (std::size_t nc = 0; nc < size() && nc < batch.size(); ++nc) {
+            for (std::size_t ns = 0; ns < batch[nc].size() && begin+ns < get()[nc].size(); ++ns) {
+                get()[nc][begin+ns] = batch[nc][ns];
+            }
+        }
+        for (std::size_t nc = 0; nc < batch.size(); ++nc) {
+            loaded_end = std::max(loaded_end, begin+batch[nc].size());
+        }
+    }
+    if (finished) {
+        StopLoading();
+        if (!error.empty()) {
+            wxGetApp().ErrorMsg(wxT("Error while reading file\n") + stf::std2wx(error));
+        }
+    }
+}
+
+void wxStfDoc::StopLoading() {
+    if (loadTimer != NULL) {
+        loadTimer->Stop();
+        delete loadTimer;
+        loadTimer = NULL;
+    }
+    if (loader != NULL) {
+        loader->Cancel();
+        loader->Wait();
+        delete loader;
+        loader = NULL;
+    }
+}
+
+void wxStfDoc::OnLoadTimer(wxTimerEvent& WXUNUSED(event)) {
+    MergeLoadedSections();
+}
+
+void wxStfDoc::WaitForSections(std::size_t section) {
+    if (loader == NULL || section < loaded_end) {
+        return;
+    }
+    wxBusyCursor wait;
+    while (loader != NULL && section >= loaded_end) {
+        MergeLoadedSections();
+        if (loader != NULL) {
+            wxMilliSleep(10);
+        }
+    }
+}
+
+void wxStfDoc::WaitForSections() {
+    if (loader == NULL) {
+        return;
+    }
+    wxBusyCursor wait;
+    while (loader != NULL) {
+        MergeLoadedSections();
+        if (loader != NULL) {
+            wxMilliSleep(10);
+        }
+    }
+}
+
 bool wxStfDoc::OnCloseDocument() {
+    StopLoading();
     if (!get().empty()) {
         WriteToReg();
     }
@@ -725,10 +962,14 @@ bool wxStfDoc::SaveAs() {
     // file types
     wxString filters;
     filters += wxT("hdf5 file (*.h5)|*.h5|");
+    filters += wxT("hdf5 file, lossless ADC compression (*.h5)|*.h5|");
     filters += wxT("CED filing system (*.dat;*.cfs)|*.dat;*.cfs|");
     filters += wxT("Axon text file (*.atf)|*.atf|");
     filters += wxT("Igor binary wave (*.ibw)|*.ibw|");
+    filters += wxT("Igor packed experiment (*.pxp)|*.pxp|");
     filters += wxT("Mantis TDMS file (*.tdms)|*.tdms|");
+    filters += wxT("Neurodata Without Borders file (*.nwb)|*.nwb|");
+    filters += wxT("Zarr store (*.zarr)|*.zarr|");
     filters += wxT("Text file series (*.txt)|*.txt|");
 #if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
     filters += wxT("GDF file (*.gdf)|*.gdf");
@@ -738,25 +979,51 @@ bool wxStfDoc::SaveAs() {
             wxFD_SAVE | wxFD_OVERWRITE_PROMPT | wxFD_PREVIEW );
     if(SelectFileDialog.ShowModal()==wxID_OK) {
         wxString filename = SelectFileDialog.GetPath();
-        Recording writeRec(ReorderChannels());
-        if (writeRec.size() == 0) return false;
+        std::vector<std::size_t> channelOrder(ReorderChannels());
+        if (channelOrder.empty()) return false;
+        // the channels are written in place without copying:
+        RecordingView writeRec(*this, channelOrder);
         try {
             stf::wxProgressInfo progDlg("Reading file", "Opening file", 100);
 			stfio::filetype type;
+            stfio::hdf5_filter filter = stfio::hdf5_shuffle_deflate;
             switch (SelectFileDialog.GetFilterIndex()) {
             case 0: type=stfio::hdf5; break;
-            case 1: type=stfio::cfs; break;
-            case 2: type=stfio::atf; break;
-            case 3: type=stfio::igor; break;
-            case 4: type=stfio::tdms; break;
-            case 5: type=stfio::ascii; break;
+            case 1: type=stfio::hdf5; filter=stfio::hdf5_ephys; break;
+            case 2: type=stfio::cfs; break;
+            case 3: type=stfio::atf; break;
+            case 4: type=stfio::igor; break;
+            case 5:
+                // the extension selects a packed experiment:
+                type=stfio::igor;
+                if (wxFileName(filename).GetExt() != wxT("pxp")) {
+                    filename += wxT(".pxp");
+                }
+                break;
+            case 6: type=stfio::tdms; break;
+            case 7: type=stfio::nwb; break;
+            case 8: type=stfio::zarr; break;
+            case 9: type=stfio::ascii; break;
 #if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
             default: type=stfio::biosig;
 #else
             default: type=stfio::hdf5;
 #endif
             }
-            return stfio::exportFile(stf::wx2std(filename), type, writeRec, progDlg);
+            if (filter == stfio::hdf5_ephys) {
+                // channels that aren't scaled 16-bit integers fall back to deflate:
+                stfio::LibraryLock lock(stfio::hdf5);
+                if (!stfio::exportHDF5File(stf::wx2std(filename), writeRec, progDlg,
+                                           stfio::hdf5_chunked, filter)) {
+                    return false;
+                }
+            } else if (!stfio::exportFile(stf::wx2std(filename), type, writeRec, progDlg)) {
+                return false;
+            }
+            if (type == stfio::hdf5) {
+                SaveFitCaches(stf::wx2std(filename), channelOrder);
+            }
+            return true;
         }
         catch (const std::runtime_error& e) {
             wxGetApp().ExceptMsg(stf::std2wx(e.what()));
@@ -767,7 +1034,25 @@ bool wxStfDoc::SaveAs() {
     }
 }
 
-Recording wxStfDoc::ReorderChannels() {
+void wxStfDoc::SaveFitCaches(const std::string& fName, const std::vector<std::size_t>& channelOrder) {
+    // the caches follow the channels in the order in which they were written:
+    std::vector< std::vector<stfio::FitCache> > caches(channelOrder.size());
+    for (std::size_t n_c=0; n_c < channelOrder.size(); ++n_c) {
+        if (channelOrder[n_c] >= sec_attr.size()) {
+            continue;
+        }
+        const std::map<std::size_t, stf::SectionAttributes>& attr = sec_attr[channelOrder[n_c]];
+        caches[n_c].resize(at(channelOrder[n_c]).size());
+        for (std::map<std::size_t, stf::SectionAttributes>::const_iterator cit = attr.begin();
+             cit != attr.end() && cit->first < caches[n_c].size(); ++cit)
+        {
+            caches[n_c][cit->first] = cit->second.fitCache;
+        }
+    }
+    stfio::exportHDF5FitCaches(fName, caches);
+}
+
+std::vector<std::size_t> wxStfDoc::ReorderChannels() {
     // Re-order channels?
     std::vector< wxString > channelNames(size());
     wxs_it it = channelNames.begin();
@@ -782,7 +1067,7 @@ Recording wxStfDoc::ReorderChannels() {
     if (size()>1) {
         wxStfOrderChannelsDlg orderDlg(GetDocumentWindow(),channelNames);
         if (orderDlg.ShowModal() != wxID_OK) {
-            return Recording(0);
+            return std::vector<std::size_t>(0);
         }
         channelOrder=orderDlg.GetChannelOrder();
     } else {
@@ -791,28 +1076,21 @@ Recording wxStfDoc::ReorderChannels() {
             *it = n_c++;
         }
     }
-
-    Recording writeRec(size());
-    writeRec.CopyAttributes(*this);
-    std::size_t n_c = 0;
-    for (c_int_it cit2 = channelOrder.begin(); cit2 != channelOrder.end(); cit2++) {
-        writeRec.InsertChannel(get()[*cit2],n_c);
-        // correct units:
-        writeRec[n_c++].SetYUnits( at(*cit2).GetYUnits() );
-    }
-    return writeRec;
+    return std::vector<std::size_t>(channelOrder.begin(), channelOrder.end());
 }
 
 #ifndef TEST_MINIMAL
 bool wxStfDoc::DoSaveDocument(const wxString& filename) {
-    Recording writeRec(ReorderChannels());
-    if (writeRec.size() == 0) return false;
+    WaitForSections();
+    std::vector<std::size_t> channelOrder(ReorderChannels());
+    if (channelOrder.empty()) return false;
+    RecordingView writeRec(*this, channelOrder);
     try {
         stf::wxProgressInfo progDlg("Reading file", "Opening file", 100);
-        if (stfio::exportFile(stf::wx2std(filename), stfio::hdf5, writeRec, progDlg))
-            return true;
-        else
+        if (!stfio::exportFile(stf::wx2std(filename), stfio::hdf5, writeRec, progDlg))
             return false;
+        SaveFitCaches(stf::wx2std(filename), channelOrder);
+        return true;
     }
     catch (const std::runtime_error& e) {
         wxGetApp().ExceptMsg(stf::std2wx(e.what()));
@@ -882,6 +1160,7 @@ void wxStfDoc::WriteToReg() {
 }
 
 bool wxStfDoc::SetSection(std::size_t section){
+    WaitForSections(section);
     // Check range:
     if (!(get().size()>1)) {
         if (section>=get()[GetCurChIndex()].size())
@@ -907,6 +1186,15 @@ bool wxStfDoc::SetSection(std::size_t section){
         }
     }
     CheckBoundaries();
+    // sections that are no longer shown may be reclaimed by the section cache:
+    std::size_t section_old = GetCurSecIndex();
+    if (section_old != section) {
+        for (std::size_t nc = 0; nc < get().size(); ++nc) {
+            if (section_old < get()[nc].size()) {
+                get()[nc][section_old].Release();
+            }
+        }
+    }
     SetCurSecIndex(section);
     UpdateSelectedButton();
 
@@ -928,17 +1216,7 @@ void wxStfDoc::OnSwapChannels(wxCommandEvent& WXUNUSED(event)) {
 
 void wxStfDoc::ToggleSelect() {
     // get current selection status of this trace:
-
-    bool selected = false;
-    for (c_st_it cit = GetSelectedSections().begin();
-         cit != GetSelectedSections().end() && !selected;
-         ++cit) {
-        if (*cit == GetCurSecIndex()) {
-            selected = true;
-        }
-    }
-
-    if (selected) {
+    if (IsSelected(GetCurSecIndex())) {
         Remove();
     } else {
         Select();
@@ -951,19 +1229,9 @@ void wxStfDoc::Select() {
         wxGetApp().ErrorMsg(wxT("No more traces can be selected\nAll traces are selected"));
         return;
     }
-    //control whether trace has already been selected:
-    bool already=false;
-    for (c_st_it cit = GetSelectedSections().begin();
-         cit != GetSelectedSections().end() && !already;
-         ++cit) {
-        if (*cit == GetCurSecIndex()) {
-            already = true;
-        }
-    }
-
-    //add trace number to selected numbers, print number of selected traces
-    if (!already) {
-        SelectTrace(GetCurSecIndex(), baseBeg, baseEnd);
+    //add trace number to selected numbers unless it has already been selected,
+    //print number of selected traces
+    if (SelectTrace(GetCurSecIndex(), baseBeg, baseEnd)) {
         //String output in the trace navigator
         wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
         pFrame->SetSelected(GetSelectedSections().size());
@@ -1000,7 +1268,7 @@ void wxStfDoc::ConcatenateMultiChannel(wxCommandEvent &WXUNUSED(event)) {
 
     try {
         Recording Concatenated = stfio::concatenate(*this, GetSelectedSections(), progDlg);
-        wxGetApp().NewChild(Concatenated,this,wxString(GetTitle()+wxT(", concatenated")));
+        wxGetApp().NewChild(STFIO_MOVE(Concatenated),this,wxString(GetTitle()+wxT(", concatenated")));
     } catch (const std::runtime_error& e) {
         wxGetApp().ErrorMsg(wxT("Error concatenating sections:\n") + stf::std2wx(e.what()));
     }
@@ -1018,8 +1286,8 @@ void wxStfDoc::CreateAverage(
     wxBusyCursor wc;
     //array indicating how many indices to shift when aligning,
     //has to be filled with zeros:
-    std::vector<int> shift(GetSelectedSections().size(),0);
-    int shift_size = 0;
+    Vector_double shift(GetSelectedSections().size(),0.0);
+    std::size_t shift_size = 0;
 
     /* Aligned average */
     //find alignment points in the reference (==second) channel:
@@ -1028,104 +1296,47 @@ void wxStfDoc::CreateAverage(
         // check that we have more than one channel
         wxStfAlignDlg AlignDlg(GetDocumentWindow(), size()>1);
         if (AlignDlg.ShowModal() != wxID_OK) return;
-        //store current section and channel index:
-        std::size_t section_old=GetCurSecIndex();
-        std::size_t channel_old=GetCurChIndex();
-        //initialize the lowest and the highest index:
-        std::size_t min_index=0;
+        if (AlignDlg.AlignRise() < 0 || AlignDlg.AlignRise() > 4) {
+            wxGetApp().ExceptMsg(wxT("Invalid alignment method"));
+            return;
+        }
+        WaitForSections();
+        // Only the alignment points are measured, in parallel; the other
+        // measurements and the current section stay untouched.
+        // The steepest rise etc. of the reference (==second) channel are
+        // measured with the cursors of the current channel, as in Measure():
+        bool reference = AlignDlg.UseReference();
+        Vector_double lags;
         try {
-            if (AlignDlg.UseReference())
-                min_index=get()[GetSecChIndex()].at(GetSelectedSections().at(0)).size()-1;
-            else
-                min_index=get()[GetCurChIndex()].at(GetSelectedSections().at(0)).size()-1;
+            const Channel& alignCh = reference ? get()[GetSecChIndex()] : get()[GetCurChIndex()];
+            if (AlignDlg.UseCorrelation()) {
+                // the waveforms within the peak window are aligned to their average,
+                // with subsample precision, by up to half the window:
+                std::size_t end = peakAtEnd ? alignCh[GetSelectedSections()[0]].size() : GetPeakEnd()+1;
+                for (c_st_it sit = GetSelectedSections().begin(); sit != GetSelectedSections().end(); sit++) {
+                    end = std::min(end, alignCh[*sit].size());
+                }
+                std::size_t maxLag = end > GetPeakBeg() ? (end-GetPeakBeg())/2 : 0;
+                lags = stfnum::correlationLags(alignCh, GetSelectedSections(), GetPeakBeg(), end,
+                                               maxLag, stfnum::reference_average);
+            } else {
+                std::vector<int> alignIndices =
+                    stfnum::alignmentPoints(alignCh, GetSelectedSections(), GetXScale(),
+                                            GetMeasurementPlan(),
+                                            (stfnum::alignment_mode)AlignDlg.AlignRise(),
+                                            reference, peakAtEnd);
+                lags.assign(alignIndices.begin(), alignIndices.end());
+            }
         }
         catch (const std::out_of_range& e) {
-            wxString msg(wxT("Error while aligning\nIt is safer to re-start the program\n"));
+            wxString msg(wxT("Error while aligning\n"));
             msg+=wxString( e.what(), wxConvLocal );
             wxGetApp().ExceptMsg(msg);
             return;
         }
-        // swap channels temporarily:
-        // if (AlignDlg.UseReference())
-        //     SetCurChIndex(GetSecChIndex());
-        std::size_t max_index=0, n=0;
-        int_it it = shift.begin();
-        //loop through all selected sections:
-        for (c_st_it cit = GetSelectedSections().begin();
-             cit != GetSelectedSections().end() && it != shift.end();
-             cit++)
-        {
-            //Set the selected section as the current section temporarily:
-            SetSection(*cit);
-            if (peakAtEnd) {
-                SetPeakEnd((int)get()[GetSecChIndex()][*cit].size()-1);
-            }
-            // Calculate all variables for the current settings
-            // APMaxSlopeT will be calculated for the second (==reference)
-            // channel, so channels may not be changed!
-            try {
-                Measure();
-            }
-            catch (const std::out_of_range& e) {
-                Average.resize(0);
-                SetSection(section_old);
-                SetCurChIndex(channel_old);
-                wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
-                return;
-            }
-
-            std::size_t alignIndex;
-            //check whether the current index is a max or a min,
-            //and if so, store it:
-            switch (AlignDlg.AlignRise()) {
-             case 0:	// align to peak time
-                 if (AlignDlg.UseReference())
-                     alignIndex = lround(GetAPMaxT());
-                 else
-                     alignIndex = lround(GetMaxT());
-                 break;
-             case 1:	// align to steepest slope time
-                 if (AlignDlg.UseReference())
-                     alignIndex = lround(GetAPMaxRiseT());
-                 else
-                     alignIndex = lround(GetMaxRiseT());
-                 break;
-             case 2:	// align to half amplitude time 
-                 if (AlignDlg.UseReference())
-                     alignIndex = lround(GetAPT50LeftReal());
-                 else
-                     alignIndex = lround(GetT50LeftReal());
-                 break;
-            case 3:     // align to onset
-                 if (AlignDlg.UseReference())
-                     alignIndex = lround(GetAPT0Real());
-                 else
-                     alignIndex = lround(GetT0Real());
-                 break;
-            default:
-                wxGetApp().ExceptMsg(wxT("Invalid alignment method"));
-                return;
-            }
-
-            *it = alignIndex;
-            if (alignIndex > max_index) {
-                max_index=alignIndex;
-            }
-            if (alignIndex < min_index) {
-                min_index=alignIndex;
-            }
-            n++;
-            it++;
-        }
-        //now that max and min indices are known, calculate the number of
+        //now that the smallest and largest lags are known, calculate the number of
         //points that need to be shifted:
-        for (int_it it = shift.begin(); it != shift.end(); it++) {
-            (*it) -= (int)min_index;
-        }
-        //restore section and channel settings:
-        SetSection(section_old);
-        SetCurChIndex(channel_old);
-        shift_size = (max_index-min_index);
+        shift = stfnum::lagsToShifts(lags, shift_size);
     }
 
     //number of points in average:
@@ -1143,7 +1354,19 @@ void wxStfDoc::CreateAverage(
     for (c_ch_it cit = get().begin(); cit != get().end(); cit++) {
         Section TempSection(average_size), TempSig(average_size);
         try {
-            MakeAverage(TempSection, TempSig, n_c, GetSelectedSections(), calcSD, shift);
+            // Without alignment, the running average of the selection can be
+            // used as it is if it covers the same points:
+            if (!align && IsLiveAverage() &&
+                GetLiveAverage(n_c).GetN() == GetSelectedSections().size() &&
+                GetLiveAverage(n_c).size() == average_size)
+            {
+                TempSection = Section(GetLiveAverage(n_c).GetMean());
+                if (calcSD) {
+                    TempSig = Section(GetLiveAverage(n_c).GetSD());
+                }
+            } else {
+                MakeAverage(TempSection, TempSig, n_c, GetSelectedSections(), calcSD, shift);
+            }
         }
         catch (const std::out_of_range& e) {
             Average.resize(0);
@@ -1153,10 +1376,11 @@ void wxStfDoc::CreateAverage(
         TempSection.SetXScale(get()[n_c][0].GetXScale());	// set xscale for channel n_c and the only section
         TempSection.SetSectionDescription(stf::wx2std(GetTitle())
                                           +std::string(", average"));
-        Channel TempChannel(TempSection);
+        Channel TempChannel(1);
+        TempChannel.InsertSection(STFIO_MOVE(TempSection), 0);
         TempChannel.SetChannelName(cit->GetChannelName());
         try {
-            Average.InsertChannel(TempChannel,n_c);
+            Average.InsertChannel(STFIO_MOVE(TempChannel),n_c);
         }
         catch (const std::out_of_range& e) {
             Average.resize(0);
@@ -1167,6 +1391,12 @@ void wxStfDoc::CreateAverage(
     }
     Average.CopyAttributes(*this);
 
+    // the average is shown in this window as well:
+    wxStfView* pView=(wxStfView*)GetFirstView();
+    if (pView != NULL && pView->GetGraph() != NULL) {
+        pView->GetGraph()->InvalidateLayers();
+    }
+
     wxString title;
     title << GetFilename() << wxT(", average of ") << (int)GetSelectedSections().size() << wxT(" traces");
     wxGetApp().NewChild(Average,this,title);
@@ -1205,16 +1435,40 @@ void wxStfDoc::FitDecay(wxCommandEvent& WXUNUSED(event)) {
     Vector_double params ( FitSelDialog.GetInitP() );
     int warning = 0;
     try {
-        std::size_t fitSize = GetFitEnd() - GetFitBeg();
-        Vector_double x( fitSize );
-        //fill array:
-        std::copy(&cursec()[GetFitBeg()], &cursec()[GetFitBeg()+fitSize], &x[0]);
         if (params.size() != n_params) {
             throw std::runtime_error("Wrong size of params in wxStfDoc::lmFit()");
         }
-        double chisqr = stfnum::lmFit( x, GetXScale(), wxGetApp().GetFuncLib()[fselect],
+        const stfnum::storedFunc& fitFunc = wxGetApp().GetFuncLib()[fselect];
+        // Revisiting a section with the same fit settings re-uses its result:
+        stfio::FitCache& fitCache = GetCurrentSectionAttributesW().fitCache;
+        unsigned long long key = stfnum::fitCacheKey( cursec(), GetFitBeg(), GetFitEnd(), GetXScale(),
+                                                      fitFunc, FitSelDialog.GetOpts(),
+                                                      FitSelDialog.UseScaling(), params );
+        const stfio::FitCacheEntry* cached = fitCache.Find(key);
+        double chisqr = 0;
+        if (cached != NULL && cached->params.size() == n_params) {
+            params = cached->params;
+            chisqr = cached->chisqr;
+            warning = cached->warning;
+            fitInfo = "Restored the result of a previous fit with the same settings.";
+        } else {
+            std::size_t fitSize = GetFitEnd() - GetFitBeg();
+            Vector_double x( fitSize );
+            //fill array:
+            cursec().CopyRange(GetFitBeg(), GetFitBeg()+fitSize, x.empty() ? NULL : &x[0]);
+            chisqr = stfnum::lmFit( x, GetXScale(), fitFunc,
                                     FitSelDialog.GetOpts(), FitSelDialog.UseScaling(),
                                     params, fitInfo, warning );
+            stfio::FitCacheEntry entry;
+            entry.key = key;
+            entry.funcName = fitFunc.name;
+            entry.fitBeg = GetFitBeg();
+            entry.fitEnd = GetFitEnd();
+            entry.params = params;
+            entry.chisqr = chisqr;
+            entry.warning = warning;
+            fitCache.Insert(entry);
+        }
         SetIsFitted( GetCurChIndex(), GetCurSecIndex(), params, wxGetApp().GetFuncLibPtr(fselect),
                      chisqr, GetFitBeg(), GetFitEnd() );
     }
@@ -1238,7 +1492,7 @@ void wxStfDoc::FitDecay(wxCommandEvent& WXUNUSED(event)) {
     wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
     wxString label; label << wxT("Fit, Section #") << (int)GetCurSecIndex()+1;
     try {
-        pFrame->ShowTable(sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).bestFit, label);
+        pFrame->ShowTable(GetCurrentSectionAttributes().bestFit, label);
     }
     catch (const std::out_of_range e) {
         wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
@@ -1264,16 +1518,19 @@ void wxStfDoc::LFit(wxCommandEvent& WXUNUSED(event)) {
     n_params=2;
     Vector_double params( n_params );
 
-    //fill array:
-    Vector_double x(n_points);
-    std::copy(&cursec()[GetFitBeg()], &cursec()[GetFitBeg()+n_points], &x[0]);
-    Vector_double t(x.size());
-    for (std::size_t n_t=0;n_t<x.size();++n_t) t[n_t]=n_t*GetXScale();
-
-    // Perform the fit:
-    double chisqr = stfnum::linFit(t,x,params[0],params[1]);
+    // A straight line has a closed-form solution; no iterative fit is needed:
+    stfnum::LinRegression line;
+    try {
+        line = stfnum::linRegress(cursec(), GetFitBeg(), GetFitEnd(), GetXScale());
+    }
+    catch (const std::out_of_range& e) {
+        wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+        return;
+    }
+    params[0] = line.slope;
+    params[1] = line.intercept;
     try {
-        SetIsFitted( GetCurChIndex(), GetCurSecIndex(), params, wxGetApp().GetLinFuncPtr(), chisqr, GetFitBeg(), GetFitEnd() );
+        SetIsFitted( GetCurChIndex(), GetCurSecIndex(), params, wxGetApp().GetLinFuncPtr(), line.chisqr, GetFitBeg(), GetFitEnd() );
     }
     catch (const std::out_of_range e) {
         wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
@@ -1286,15 +1543,17 @@ void wxStfDoc::LFit(wxCommandEvent& WXUNUSED(event)) {
     if (pView!=NULL && pView->GetGraph()!=NULL)
         pView->GetGraph()->Refresh();
     std::ostringstream fitInfoStr;
-    fitInfoStr << wxT("slope = ") << params[0] << wxT("\n1/slope = ") << 1.0/params[0]
-            << wxT("\ny-intercept = ") << params[1];
+    fitInfoStr << wxT("slope = ") << params[0] << wxT(" +/- ") << line.slopeSE
+            << wxT("\n1/slope = ") << 1.0/params[0]
+            << wxT("\ny-intercept = ") << params[1] << wxT(" +/- ") << line.interceptSE
+            << wxT("\nr = ") << line.r;
     fitInfo += fitInfoStr.str();
     wxStfFitInfoDlg InfoDialog(GetDocumentWindow(), stf::std2wx(fitInfo));
     InfoDialog.ShowModal();
     wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
     wxString label; label << wxT("Fit, Section #") << (int)GetCurSecIndex();
     try {
-        pFrame->ShowTable(sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).bestFit, label);
+        pFrame->ShowTable(GetCurrentSectionAttributes().bestFit, label);
     }
     catch (const std::out_of_range e) {
         wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
@@ -1302,35 +1561,27 @@ void wxStfDoc::LFit(wxCommandEvent& WXUNUSED(event)) {
 }
 
 void wxStfDoc::LnTransform(wxCommandEvent& WXUNUSED(event)) {
-    Channel TempChannel(GetSelectedSections().size(), get()[GetCurChIndex()][GetSelectedSections()[0]].size());
-    std::size_t n = 0;
-    for (c_st_it cit = GetSelectedSections().begin(); cit != GetSelectedSections().end(); cit++) {
-        Section TempSection(size());
-        std::transform(get()[GetCurChIndex()][*cit].get().begin(), 
-                       get()[GetCurChIndex()][*cit].get().end(), 
-                       TempSection.get_w().begin(),
-#if defined(_WINDOWS) && !defined(__MINGW32__)
-                       std::logl);
-#else
-        (double(*)(double))log);
-#endif
-        TempSection.SetXScale(get()[GetCurChIndex()][*cit].GetXScale());
-        TempSection.SetSectionDescription( get()[GetCurChIndex()][*cit].GetSectionDescription()+
-                                           ", transformed (ln)");
-        try {
-            TempChannel.InsertSection(TempSection,n);
-        }
-        catch (const std::out_of_range e) {
-            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
-        }
-        n++;
+    // the logarithm is only taken when a section is drawn or measured:
+    Channel TempChannel;
+    try {
+        TempChannel = stfnum::deriveChannel(get()[GetCurChIndex()], GetSelectedSections(),
+                                            std::vector<stfio::SampleOperationPtr>(1, stfnum::lnOperation()),
+                                            ", transformed (ln)");
+    }
+    catch (const std::out_of_range& e) {
+        wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+        return;
     }
     if (TempChannel.size()>0) {
-        Recording Transformed(TempChannel);
+        if (GetEditInPlace()) {
+            ReplaceSections(GetCurChIndex(), GetSelectedSections(), TempChannel, "logarithm");
+            return;
+        }
+        Recording Transformed(STFIO_MOVE(TempChannel));
         Transformed.CopyAttributes(*this);
         wxString title(GetTitle());
         title+=wxT(", transformed (ln)");
-        wxGetApp().NewChild(Transformed,this,title);
+        wxGetApp().NewChild(STFIO_MOVE(Transformed),this,title);
     }
 }
 
@@ -1346,10 +1597,10 @@ void wxStfDoc::Viewtable(wxCommandEvent& WXUNUSED(event)) {
     }
 }
 
-void wxStfDoc::Multiply(wxCommandEvent& WXUNUSED(event)) {
+bool wxStfDoc::MultiplyDlg(double& factor) {
     if (GetSelectedSections().empty()) {
         wxGetApp().ErrorMsg(wxT("Select traces first"));
-        return;
+        return false;
     }
     //insert standard values:
     std::vector<std::string> labels(1);
@@ -1358,61 +1609,171 @@ void wxStfDoc::Multiply(wxCommandEvent& WXUNUSED(event)) {
     stf::UserInput init(labels,defaults,"Set factor");
 
     wxStfUsrDlg MultDialog(GetDocumentWindow(),init);
-    if (MultDialog.ShowModal()!=wxID_OK) return;
+    if (MultDialog.ShowModal()!=wxID_OK) return false;
     Vector_double input(MultDialog.readInput());
-    if (input.size()!=1) return;
+    if (input.size()!=1) return false;
+
+    factor=input[0];
+    return true;
+}
 
-    double factor=input[0];
+void wxStfDoc::Multiply(wxCommandEvent& event) {
+    if (GetEditInPlace()) {
+        MultiplyInPlace(event);
+        return;
+    }
+    double factor;
+    if (!MultiplyDlg(factor)) return;
 
     try {
         Recording Multiplied = stfio::multiply(*this, GetSelectedSections(), GetCurChIndex(), factor);
-        wxGetApp().NewChild(Multiplied, this, wxString(GetTitle()+wxT(", multiplied")));
+        wxGetApp().NewChild(STFIO_MOVE(Multiplied), this, wxString(GetTitle()+wxT(", multiplied")));
     } catch (const std::exception& e) {
         wxGetApp().ErrorMsg(wxT("Error during multiplication:\n") + stf::std2wx(e.what()));
     }
 }
 
-bool wxStfDoc::SubtractBase( ) {
-    if (GetSelectedSections().empty()) {
-        wxGetApp().ErrorMsg(wxT("Select traces first"));
-        return false;
+void wxStfDoc::MultiplyInPlace(wxCommandEvent& WXUNUSED(event)) {
+    double factor;
+    if (!MultiplyDlg(factor)) return;
+
+    try {
+        // the sections keep their samples until they're written to below:
+        history.Record(*this, GetCurChIndex(), GetSelectedSections(), "multiplication");
+        stfio::multiplyInPlace(*this, GetSelectedSections(), GetCurChIndex(), factor);
+    } catch (const std::exception& e) {
+        wxGetApp().ErrorMsg(wxT("Error during multiplication:\n") + stf::std2wx(e.what()));
+        return;
     }
-    Channel TempChannel(GetSelectedSections().size(), get()[GetCurChIndex()][GetSelectedSections()[0]].size());
-    std::size_t n = 0;
-    for (c_st_it cit = GetSelectedSections().begin(); cit != GetSelectedSections().end(); cit++) {
-        Section TempSection(stfio::vec_scal_minus(get()[GetCurChIndex()][*cit].get(), GetSelectBase()[n]));
-        TempSection.SetXScale(get()[GetCurChIndex()][*cit].GetXScale());
-        TempSection.SetSectionDescription( get()[GetCurChIndex()][*cit].GetSectionDescription()+
-                                           ", baseline subtracted");
-        try {
-            TempChannel.InsertSection(TempSection,n);
-        }
-        catch (const std::out_of_range& e) {
-            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
-            return false;
-        }
-        n++;
+    Modify(true);
+    UpdateAllViews();
+    wxGetApp().OnPeakcalcexecMsg();
+}
+
+bool wxStfDoc::GetEditInPlace() const {
+    return wxGetApp().wxGetProfileInt(wxT("Settings"), wxT("EditInPlace"), 0) != 0;
+}
+
+void wxStfDoc::ReplaceSections(std::size_t channel, const std::vector<std::size_t>& sections,
+                               const Channel& replacements, const std::string& label)
+{
+    if (replacements.size() != sections.size()) {
+        throw std::out_of_range("Number of replacements doesn't match in wxStfDoc::ReplaceSections()");
     }
-    if (TempChannel.size()>0) {
-        Recording SubBase(TempChannel);
-        SubBase.CopyAttributes(*this);
-        wxString title(GetTitle());
-        title+=wxT(", baseline subtracted");
-        wxGetApp().NewChild(SubBase,this,title);
-    } else {
-        wxGetApp().ErrorMsg( wxT("Channel is empty.") );
-        return false;
+    history.Record(*this, channel, sections, label);
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        get()[channel][sections[n]] = replacements[n];
     }
+    Modify(true);
+    UpdateAllViews();
+    wxGetApp().OnPeakcalcexecMsg();
+}
 
-    return true;
+void wxStfDoc::Modify(bool mod) {
+    if (mod) {
+        ++epoch;
+    }
+    wxDocument::Modify(mod);
 }
 
+stfio::Snapshot wxStfDoc::GetSelectedSnapshot() const {
+    return stfio::Snapshot(*this, epoch, GetCurChIndex(), GetSelectedSections());
+}
 
-void wxStfDoc::OnAnalysisBatch(wxCommandEvent &WXUNUSED(event)) {
-    //	event.Skip();
-    if (GetSelectedSections().empty())
-    {
-        wxGetApp().ErrorMsg(wxT("No selected traces"));
+bool wxStfDoc::IsCurrent(const stfio::Snapshot& snapshot) const {
+    // the sections are compared rather than the epochs, since Python scripts
+    // may write to the data without marking the document as modified:
+    return snapshot.Unchanged(*this);
+}
+
+void wxStfDoc::OnUndoEdit(wxCommandEvent& WXUNUSED(event)) {
+    if (!history.CanUndo()) {
+        wxGetApp().ErrorMsg(wxT("There is nothing to undo"));
+        return;
+    }
+    try {
+        history.Undo(*this);
+    } catch (const std::out_of_range& e) {
+        wxGetApp().ErrorMsg(wxT("Error while undoing:\n") + stf::std2wx(e.what()));
+        history.Clear();
+        return;
+    }
+    Modify(true);
+    UpdateAllViews();
+    wxGetApp().OnPeakcalcexecMsg();
+}
+
+void wxStfDoc::OnRedoEdit(wxCommandEvent& WXUNUSED(event)) {
+    if (!history.CanRedo()) {
+        wxGetApp().ErrorMsg(wxT("There is nothing to redo"));
+        return;
+    }
+    try {
+        history.Redo(*this);
+    } catch (const std::out_of_range& e) {
+        wxGetApp().ErrorMsg(wxT("Error while redoing:\n") + stf::std2wx(e.what()));
+        history.Clear();
+        return;
+    }
+    Modify(true);
+    UpdateAllViews();
+    wxGetApp().OnPeakcalcexecMsg();
+}
+
+void wxStfDoc::OnUpdateUndoEdit(wxUpdateUIEvent& event) {
+    event.Enable(history.CanUndo());
+    event.SetText(history.CanUndo() ? wxT("&Undo ") + stf::std2wx(history.GetUndoLabel()) + wxT("\tCtrl+Z")
+                                    : wxString(wxT("&Undo\tCtrl+Z")));
+}
+
+void wxStfDoc::OnUpdateRedoEdit(wxUpdateUIEvent& event) {
+    event.Enable(history.CanRedo());
+    event.SetText(history.CanRedo() ? wxT("&Redo ") + stf::std2wx(history.GetRedoLabel()) + wxT("\tCtrl+Y")
+                                    : wxString(wxT("&Redo\tCtrl+Y")));
+}
+
+bool wxStfDoc::SubtractBase( ) {
+    if (GetSelectedSections().empty()) {
+        wxGetApp().ErrorMsg(wxT("Select traces first"));
+        return false;
+    }
+    // the sections aren't copied; the baselines are subtracted when they're read:
+    Channel TempChannel;
+    try {
+        TempChannel = stfnum::subtractBaselines(get()[GetCurChIndex()], GetSelectedSections(), GetSelectBase());
+    }
+    catch (const std::out_of_range& e) {
+        wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+        return false;
+    }
+    if (TempChannel.size()>0 && GetEditInPlace()) {
+        try {
+            ReplaceSections(GetCurChIndex(), GetSelectedSections(), TempChannel, "baseline subtraction");
+        }
+        catch (const std::out_of_range& e) {
+            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+            return false;
+        }
+    } else if (TempChannel.size()>0) {
+        Recording SubBase(STFIO_MOVE(TempChannel));
+        SubBase.CopyAttributes(*this);
+        wxString title(GetTitle());
+        title+=wxT(", baseline subtracted");
+        wxGetApp().NewChild(STFIO_MOVE(SubBase),this,title);
+    } else {
+        wxGetApp().ErrorMsg( wxT("Channel is empty.") );
+        return false;
+    }
+
+    return true;
+}
+
+
+void wxStfDoc::OnAnalysisBatch(wxCommandEvent &WXUNUSED(event)) {
+    //	event.Skip();
+    if (GetSelectedSections().empty())
+    {
+        wxGetApp().ErrorMsg(wxT("No selected traces"));
         return;
     }
 
@@ -1521,10 +1882,38 @@ void wxStfDoc::OnAnalysisBatch(wxCommandEvent &WXUNUSED(event)) {
         }
         threshold=myDlg.readInput()[0];
     }
+
+    // rows are written as soon as they have been measured rather than
+    // collected in a table, so that memory use doesn't grow with the
+    // number of sections and finished rows survive an interruption:
+#if (__cplusplus < 201103)
+    boost::shared_ptr<stfio::TableStream> stream;
+#else
+    std::shared_ptr<stfio::TableStream> stream;
+#endif
+    if (SaveYtDialog.StreamToFile() && !colTitles.empty()) {
+        wxString filters( wxT("CSV file (*.csv)|*.csv|HDF5 file (*.h5)|*.h5") );
+        wxFileDialog StreamFileDialog( GetDocumentWindow(), wxT("Write results to"), wxT(""), wxT(""),
+                                       filters, wxFD_SAVE | wxFD_OVERWRITE_PROMPT );
+        if (StreamFileDialog.ShowModal()!=wxID_OK) {
+            return;
+        }
+        wxFileName streamName( StreamFileDialog.GetPath() );
+        streamName.SetExt( StreamFileDialog.GetFilterIndex()==1 ? wxT("h5") : wxT("csv") );
+        try {
+            stream.reset( new stfio::TableStream( stf::wx2std(streamName.GetFullPath()), "Section", colTitles ) );
+        }
+        catch (const std::runtime_error& e) {
+            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+            return;
+        }
+    }
+
     wxProgressDialog progDlg( wxT("Batch analysis in progress"), wxT("Starting batch analysis"),
             100, GetDocumentWindow(), wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_APP_MODAL );
 
-    stfnum::Table table(GetSelectedSections().size(),colTitles.size());
+    // a single row is reused when the rows are written to a file:
+    stfnum::Table table(stream ? 1 : GetSelectedSections().size(),colTitles.size());
     for (std::size_t nCol=0;nCol<colTitles.size();++nCol) {
         try {
             table.SetColLabel(nCol,colTitles[nCol]);
@@ -1575,7 +1964,7 @@ void wxStfDoc::OnAnalysisBatch(wxCommandEvent &WXUNUSED(event)) {
             // not from user input:
             Vector_double x(GetFitEnd()-GetFitBeg());
             //fill array:
-            std::copy(&cursec()[GetFitBeg()], &cursec()[GetFitEnd()], &x[0]);
+            cursec().CopyRange(GetFitBeg(), GetFitEnd(), x.empty() ? NULL : &x[0]);
             params.resize(n_params);
             wxGetApp().GetFuncLib().at(fselect).init( x, GetBase(), GetPeak(), GetRTLoHi(),
                     GetHalfDuration(), GetXScale(), params );
@@ -1612,66 +2001,67 @@ void wxStfDoc::OnAnalysisBatch(wxCommandEvent &WXUNUSED(event)) {
             n_crossings= stfnum::peakIndices( cursec().get(), threshold, 0 ).size();
         }
         std::size_t nCol=0;
+        std::size_t n_row = stream ? 0 : n_s;
         //Write the variables of the current channel in a string
         try {
-            table.SetRowLabel(n_s, cursec().GetSectionDescription());
+            table.SetRowLabel(n_row, cursec().GetSectionDescription());
 
             if (SaveYtDialog.PrintBase())
-                table.at(n_s,nCol++)=GetBase();
+                table.at(n_row,nCol++)=GetBase();
             if (SaveYtDialog.PrintBaseSD())
-                table.at(n_s,nCol++)=GetBaseSD();
+                table.at(n_row,nCol++)=GetBaseSD();
             if (SaveYtDialog.PrintThreshold())
-                table.at(n_s,nCol++)=GetThreshold();
+                table.at(n_row,nCol++)=GetThreshold();
             if (SaveYtDialog.PrintSlopeThresholdTime())
-                table.at(n_s,nCol++)=GetThrT()*GetXScale();
+                table.at(n_row,nCol++)=GetThrT()*GetXScale();
             if (SaveYtDialog.PrintPeakZero())
-                table.at(n_s,nCol++)=GetPeak();
+                table.at(n_row,nCol++)=GetPeak();
             if (SaveYtDialog.PrintPeakBase())
-                table.at(n_s,nCol++)=GetPeak()-GetBase();
+                table.at(n_row,nCol++)=GetPeak()-GetBase();
             if (SaveYtDialog.PrintPeakThreshold())
-                table.at(n_s,nCol++)=GetPeak()-GetThreshold();
+                table.at(n_row,nCol++)=GetPeak()-GetThreshold();
             if (SaveYtDialog.PrintPeakTime())
-                table.at(n_s,nCol++)=GetPeakTime()*GetXScale();
+                table.at(n_row,nCol++)=GetPeakTime()*GetXScale();
             if (SaveYtDialog.PrintRTLoHi())
-                table.at(n_s,nCol++)=GetRTLoHi();
+                table.at(n_row,nCol++)=GetRTLoHi();
             if (SaveYtDialog.PrintInnerRTLoHi())
-                table.at(n_s,nCol++)=GetInnerRiseTime();
+                table.at(n_row,nCol++)=GetInnerRiseTime();
             if (SaveYtDialog.PrintOuterRTLoHi())
-                table.at(n_s,nCol++)=GetOuterRiseTime();
+                table.at(n_row,nCol++)=GetOuterRiseTime();
             if (SaveYtDialog.PrintT50())
-                table.at(n_s,nCol++)=GetHalfDuration();
+                table.at(n_row,nCol++)=GetHalfDuration();
             if (SaveYtDialog.PrintT50SE()) {
-                table.at(n_s,nCol++)=GetT50LeftReal()*GetXScale();
-                table.at(n_s,nCol++)=GetT50RightReal()*GetXScale();
+                table.at(n_row,nCol++)=GetT50LeftReal()*GetXScale();
+                table.at(n_row,nCol++)=GetT50RightReal()*GetXScale();
             }
             if (SaveYtDialog.PrintSlopes()) {
-                table.at(n_s,nCol++)=GetMaxRise();
-                table.at(n_s,nCol++)=GetMaxDecay();
+                table.at(n_row,nCol++)=GetMaxRise();
+                table.at(n_row,nCol++)=GetMaxDecay();
             }
             if (SaveYtDialog.PrintSlopeTimes()) {
-                table.at(n_s,nCol++)=GetMaxRiseT()*GetXScale();
-                table.at(n_s,nCol++)=GetMaxDecayT()*GetXScale();
+                table.at(n_row,nCol++)=GetMaxRiseT()*GetXScale();
+                table.at(n_row,nCol++)=GetMaxDecayT()*GetXScale();
             }
             if (SaveYtDialog.PrintLatencies()) {
-                table.at(n_s,nCol++)=GetLatency()*GetXScale();
+                table.at(n_row,nCol++)=GetLatency()*GetXScale();
             }
             if (SaveYtDialog.PrintFitResults()) {
                 for (std::size_t n_pf=0;n_pf<n_params;++n_pf) {
-                    table.at(n_s,nCol++)=params[n_pf];
+                    table.at(n_row,nCol++)=params[n_pf];
                 }
                 if (fitWarning != 0) {
-                    table.at(n_s,nCol++) = (double)fitWarning;
+                    table.at(n_row,nCol++) = (double)fitWarning;
                 } else {
-                    table.SetEmpty(n_s,nCol++);
+                    table.SetEmpty(n_row,nCol++);
                 }
             }
 #ifdef WITH_PSLOPE
             if (SaveYtDialog.PrintPSlopes()) {
-                table.at(n_s,nCol++)=GetPSlope();
+                table.at(n_row,nCol++)=GetPSlope();
             }
 #endif
             if (SaveYtDialog.PrintThr()) {
-                table.at(n_s,nCol++)=n_crossings;
+                table.at(n_row,nCol++)=n_crossings;
             }
         }
         catch (const std::out_of_range& e) {
@@ -1679,10 +2069,39 @@ void wxStfDoc::OnAnalysisBatch(wxCommandEvent &WXUNUSED(event)) {
             SetSection(section_old);
             return;
         }
+        if (stream) {
+            Vector_double row(colTitles.size());
+            for (std::size_t n_c=0; n_c<row.size(); ++n_c) {
+                row[n_c] = table.IsEmpty(0,n_c) ? NAN : table.at(0,n_c);
+                table.SetEmpty(0,n_c,false);
+            }
+            try {
+                stream->Append(table.GetRowLabel(0), row);
+            }
+            catch (const std::runtime_error& e) {
+                wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+                SetSection(section_old);
+                return;
+            }
+        }
         n_s++;
     }
     progDlg.Update(100,wxT("Finished"));
     SetSection(section_old);
+    if (stream) {
+        try {
+            stream->Close();
+        }
+        catch (const std::runtime_error& e) {
+            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+            return;
+        }
+        wxString msg;
+        msg << wxT("Results of ") << (int)stream->GetRows() << wxT(" traces were written to\n")
+            << stf::std2wx(stream->GetName());
+        wxGetApp().InfoMsg(msg);
+        return;
+    }
     wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
     pFrame->ShowTable(table,wxT("Batch analysis results"));
 }
@@ -1741,28 +2160,22 @@ void wxStfDoc::OnAnalysisDifferentiate(wxCommandEvent &WXUNUSED(event)) {
         wxGetApp().ErrorMsg(wxT("Select traces first"));
         return;
     }
-    Channel TempChannel(GetSelectedSections().size(), get()[GetCurChIndex()][GetSelectedSections()[0]].size());
-    std::size_t n = 0;
-    for (c_st_it cit = GetSelectedSections().begin(); cit != GetSelectedSections().end(); cit++) {
-        Section TempSection( stfnum::diff( get()[GetCurChIndex()][*cit].get(), GetXScale() ) );
-        TempSection.SetXScale(get()[GetCurChIndex()][*cit].GetXScale());
-        TempSection.SetSectionDescription( get()[GetCurChIndex()][*cit].GetSectionDescription()+
-                ", differentiated");
-        try {
-            TempChannel.InsertSection(TempSection,n);
-        }
-        catch (const std::out_of_range& e) {
-            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
-        }
-        n++;
+    // sections are differentiated in parallel, without intermediate copies:
+    Channel TempChannel;
+    try {
+        TempChannel = stfnum::batchDiff(get()[GetCurChIndex()], GetSelectedSections(), GetXScale());
+    }
+    catch (const std::out_of_range& e) {
+        wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+        return;
     }
     if (TempChannel.size()>0) {
-        Recording Diff(TempChannel);
+        Recording Diff(STFIO_MOVE(TempChannel));
         Diff.CopyAttributes(*this);
         Diff[0].SetYUnits(at(GetCurChIndex()).GetYUnits()+" / ms");
         wxString title(GetTitle());
         title+=wxT(", differentiated");
-        wxGetApp().NewChild(Diff,this,title);
+        wxGetApp().NewChild(STFIO_MOVE(Diff),this,title);
     }
 
 }
@@ -1776,13 +2189,12 @@ bool wxStfDoc::OnNewfromselectedThis( ) {
     Channel TempChannel(GetSelectedSections().size(), get()[GetCurChIndex()][GetSelectedSections()[0]].size());
     std::size_t n = 0;
     for (c_st_it cit = GetSelectedSections().begin(); cit != GetSelectedSections().end(); cit++) {
-        // Multiply the valarray in Data:
-        Section TempSection(get()[GetCurChIndex()][*cit].get());
-        TempSection.SetXScale(get()[GetCurChIndex()][*cit].GetXScale());
+        // shares the data points with this document until either is written to:
+        Section TempSection(get()[GetCurChIndex()][*cit]);
         TempSection.SetSectionDescription( get()[GetCurChIndex()][*cit].GetSectionDescription()+
                 ", new from selected");
         try {
-            TempChannel.InsertSection(TempSection,n);
+            TempChannel.InsertSection(STFIO_MOVE(TempSection),n);
         }
         catch (const std::out_of_range e) {
             wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
@@ -1791,13 +2203,13 @@ bool wxStfDoc::OnNewfromselectedThis( ) {
         n++;
     }
     if (TempChannel.size()>0) {
-        Recording Selected(TempChannel);
+        Recording Selected(STFIO_MOVE(TempChannel));
         Selected.CopyAttributes(*this);
         Selected[0].SetYUnits( at(GetCurChIndex()).GetYUnits() );
         Selected[0].SetChannelName( at(GetCurChIndex()).GetChannelName() );
         wxString title(GetTitle());
         title+=wxT(", new from selected");
-        wxGetApp().NewChild(Selected,this,title);
+        wxGetApp().NewChild(STFIO_MOVE(Selected),this,title);
 
     } else {
         wxGetApp().ErrorMsg( wxT("Channel is empty.") );
@@ -1807,6 +2219,7 @@ bool wxStfDoc::OnNewfromselectedThis( ) {
 }
 
 void wxStfDoc::Selectsome(wxCommandEvent &WXUNUSED(event)) {
+    WaitForSections();
     if (GetSelectedSections().size()>0) {
         wxGetApp().ErrorMsg(wxT("Unselect all"));
         return;
@@ -1825,13 +2238,15 @@ void wxStfDoc::Selectsome(wxCommandEvent &WXUNUSED(event)) {
     int everynth=(int)input[0];
     int everystart=(int)input[1];
     //div_t n_selected=div((int)get()[GetCurChIndex()].size(),everynth);
+    std::vector<std::size_t> toSelect;
     for (int n=0; n*everynth+everystart-1 < (int)get()[GetCurChIndex()].size(); ++n) {
-        try {
-            SelectTrace(n*everynth+everystart-1, baseBeg, baseEnd);
-        }
-        catch (const std::out_of_range& e) {
-            wxGetApp().ExceptMsg( wxString::FromAscii(e.what()) );
-        }
+        toSelect.push_back(n*everynth+everystart-1);
+    }
+    try {
+        SelectTraces(toSelect, baseBeg, baseEnd);
+    }
+    catch (const std::out_of_range& e) {
+        wxGetApp().ExceptMsg( wxString::FromAscii(e.what()) );
     }
     wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
     pFrame->SetSelected(GetSelectedSections().size());
@@ -1839,6 +2254,7 @@ void wxStfDoc::Selectsome(wxCommandEvent &WXUNUSED(event)) {
 }
 
 void wxStfDoc::SelectTracesOfType(wxCommandEvent &WXUNUSED(event)) {
+    WaitForSections();
     // TODO: dialog should display possible selections
 
     //insert standard values:
@@ -1852,9 +2268,11 @@ void wxStfDoc::SelectTracesOfType(wxCommandEvent &WXUNUSED(event)) {
     Vector_double input(EveryDialog.readInput());
     if (input.size()!=1) return;
     int selTyp=(int)input[0];
+    std::vector<std::size_t> toSelect;
     for (size_t n=0; n < (int)get()[GetCurChIndex()].size(); ++n) {
-        if (GetSectionType(n)==selTyp) SelectTrace(n, baseBeg, baseEnd);
+        if (GetSectionType(n)==selTyp) toSelect.push_back(n);
     }
+    SelectTraces(toSelect, baseBeg, baseEnd);
     wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
     pFrame->SetSelected(GetSelectedSections().size());
     Focus();
@@ -1910,12 +2328,15 @@ void wxStfDoc::Unselectsome(wxCommandEvent &WXUNUSED(event)) {
 }
 
 void wxStfDoc::Selectall(wxCommandEvent& event) {
+    WaitForSections();
     //Make sure all traces are unselected prior to selecting them all:
     if ( !GetSelectedSections().empty() )
         Deleteselected(event);
-    for (int n_s=0; n_s<(int)get()[GetCurChIndex()].size(); ++n_s) {
-        SelectTrace(n_s, baseBeg, baseEnd);
+    std::vector<std::size_t> toSelect(get()[GetCurChIndex()].size());
+    for (std::size_t n_s=0; n_s<toSelect.size(); ++n_s) {
+        toSelect[n_s] = n_s;
     }
+    SelectTraces(toSelect, baseBeg, baseEnd);
     wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
     pFrame->SetSelected(GetSelectedSections().size());
     Focus();
@@ -1924,8 +2345,7 @@ void wxStfDoc::Selectall(wxCommandEvent& event) {
 void wxStfDoc::Deleteselected(wxCommandEvent &WXUNUSED(event)) {
     wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
     if( !GetSelectedSections().empty() ) {
-        GetSelectedSectionsW().clear();
-        GetSelectBaseW().clear();
+        ClearSelection();
         //Update selected traces string in the trace navigator
         pFrame->SetSelected(GetSelectedSections().size());
     } else {
@@ -1956,14 +2376,7 @@ void wxStfDoc::Focus() {
 
 void wxStfDoc::UpdateSelectedButton() {
     // control whether trace has been selected:
-    bool selected=false;
-    for (c_st_it cit = GetSelectedSections().begin();
-         cit != GetSelectedSections().end() && !selected;
-         ++cit) {
-        if (*cit == GetCurSecIndex()) {
-            selected = true;
-        }
-    }
+    bool selected=IsSelected(GetCurSecIndex());
 
     // Set status of selection button:
     wxStfParentFrame* parentFrame = GetMainFrame();
@@ -1973,6 +2386,283 @@ void wxStfDoc::UpdateSelectedButton() {
 
 }
 
+namespace {
+
+// Filters copies of sections in the background and shows them in a new window.
+class wxStfFilterTask : public wxStfTask {
+public:
+    wxStfFilterTask(wxStfDoc* doc, const stfio::Snapshot& snapshot_, int llf_, int ulf_,
+                    const stfnum::WindowFilter& filter_)
+        : wxStfTask(wxT("Filter"), doc), snapshot(snapshot_), llf(llf_), ulf(ulf_),
+          filter(filter_), filtered(), inPlace(doc->GetEditInPlace())
+    {}
+
+    virtual void Run(stfio::ProgressInfo& progDlg) {
+        std::vector<std::size_t> indices(snapshot[0].size());
+        for (std::size_t n = 0; n < indices.size(); ++n) {
+            indices[n] = n;
+        }
+        filtered = stfnum::batchFilter(snapshot[0], indices, llf, ulf, filter, progDlg);
+    }
+
+    virtual void Finish() {
+        if (filtered.size() > 0 && inPlace) {
+            if (GetOwner()->IsCurrent(snapshot)) {
+                GetOwner()->ReplaceSections(snapshot.GetChannelIndex(0), snapshot.GetSectionIndices(0),
+                                            filtered, "filter");
+                return;
+            }
+            // the user has edited the traces in the meantime:
+            wxGetApp().ErrorMsg(wxT("The traces have been modified while they were filtered;\n"
+                                    "the filtered traces are shown in a new window instead"));
+        }
+        if (filtered.size() > 0) {
+            Recording Fft(STFIO_MOVE(filtered));
+            Fft.CopyAttributes(*GetOwner());
+            wxGetApp().NewChild(STFIO_MOVE(Fft), GetOwner(), GetOwner()->GetTitle()+wxT(", filtered"));
+        }
+    }
+
+private:
+    // the selected sections when the task was started:
+    stfio::Snapshot snapshot;
+    int llf, ulf;
+    stfnum::WindowFilter filter;
+    Channel filtered;
+    bool inPlace;
+};
+
+// Downsamples copies of all channels in the background and shows them in a new window.
+class wxStfDownsampleTask : public wxStfTask {
+public:
+    wxStfDownsampleTask(wxStfDoc* doc, const stfio::Snapshot& source_, std::size_t factor_)
+        : wxStfTask(wxT("Downsample"), doc), source(source_), factor(factor_), downsampled()
+    {}
+
+    virtual void Run(stfio::ProgressInfo& progDlg) {
+        for (std::size_t n_c = 0; n_c < source.size(); ++n_c) {
+            Channel ch(stfnum::batchResample(source[n_c], 1, factor, progDlg));
+            if (ch.size() != source[n_c].size()) {
+                // cancelled:
+                downsampled.clear();
+                break;
+            }
+            downsampled.push_back(STFIO_MOVE(ch));
+        }
+    }
+
+    virtual void Finish() {
+        if (!downsampled.empty()) {
+            Recording Downsampled(downsampled.size());
+            for (std::size_t n_c = 0; n_c < downsampled.size(); ++n_c) {
+                Downsampled.InsertChannel(STFIO_MOVE(downsampled[n_c]), n_c);
+            }
+            Downsampled.CopyAttributes(*GetOwner());
+            Downsampled.SetXScale(source.GetXScale()*factor);
+            wxString title;
+            title << GetOwner()->GetTitle() << wxT(", downsampled ") << (int)factor << wxT("x");
+            wxGetApp().NewChild(STFIO_MOVE(Downsampled), GetOwner(), title);
+        }
+    }
+
+private:
+    stfio::Snapshot source;
+    std::size_t factor;
+    std::deque<Channel> downsampled;
+};
+
+namespace {
+    // Units of frequencies and of spectral densities:
+    std::string frequencyUnits(const std::string& xunits) {
+        return xunits == "ms" ? "kHz" : (xunits == "s" ? "Hz" : "1/" + xunits);
+    }
+
+    std::string densityUnits(const std::string& yunits, const std::string& xunits) {
+        return yunits + "^2/" + frequencyUnits(xunits);
+    }
+}
+
+// Computes the power spectral densities of the same sections of all
+// channels in the background and shows them in a new window.
+class wxStfSpectrumTask : public wxStfTask {
+public:
+    wxStfSpectrumTask(wxStfDoc* doc, const stfio::Snapshot& source_,
+                      const std::vector<std::size_t>& sections_,
+                      std::size_t segment_, std::size_t overlap_)
+        : wxStfTask(wxT("Power spectrum"), doc), source(source_), sections(sections_),
+          segment(segment_), overlap(overlap_), density()
+    {}
+
+    virtual void Run(stfio::ProgressInfo& progDlg) {
+        // the sections of all channels are transformed in parallel:
+        std::vector<const Section*> secs;
+        for (std::size_t n_c = 0; n_c < source.size(); ++n_c) {
+            for (std::size_t n = 0; n < sections.size(); ++n) {
+                secs.push_back(&source[n_c][sections[n]]);
+            }
+        }
+        density = stfnum::welch(secs, segment, overlap, source.GetXScale());
+    }
+
+    virtual void Finish() {
+        const wxStfDoc* owner = GetOwner();
+        Recording Spectra(source.size());
+        for (std::size_t n_c = 0; n_c < source.size(); ++n_c) {
+            Channel ch(sections.size());
+            for (std::size_t n = 0; n < sections.size(); ++n) {
+                Section sec(STFIO_MOVE(density[n_c*sections.size()+n]));
+                std::ostringstream desc;
+                desc << "Power spectrum of section #" << sections[n]+1;
+                sec.SetSectionDescription(desc.str());
+                ch.InsertSection(STFIO_MOVE(sec), n);
+            }
+            ch.SetChannelName(owner->at(source.GetChannelIndex(n_c)).GetChannelName());
+            ch.SetYUnits(densityUnits(owner->at(source.GetChannelIndex(n_c)).GetYUnits(),
+                                      owner->GetXUnits()));
+            Spectra.InsertChannel(STFIO_MOVE(ch), n_c);
+        }
+        Spectra.CopyAttributes(*owner);
+        Spectra.SetXScale(1.0 / (segment*source.GetXScale()));
+        Spectra.SetXUnits(frequencyUnits(owner->GetXUnits()));
+        wxString title;
+        title << owner->GetTitle() << wxT(", power spectrum");
+        wxGetApp().NewChild(STFIO_MOVE(Spectra), GetOwner(), title);
+    }
+
+private:
+    stfio::Snapshot source;
+    std::vector<std::size_t> sections;
+    std::size_t segment, overlap;
+    std::vector<Vector_double> density;
+};
+
+// Computes the spectrogram of a section in the background and shows the
+// density of every segment as a section of a new window.
+class wxStfSpectrogramTask : public wxStfTask {
+public:
+    wxStfSpectrogramTask(wxStfDoc* doc, const stfio::Snapshot& source_,
+                         std::size_t segment_, std::size_t overlap_)
+        : wxStfTask(wxT("Spectrogram"), doc), source(source_),
+          segment(segment_), overlap(overlap_), result()
+    {}
+
+    virtual void Run(stfio::ProgressInfo& progDlg) {
+        result = stfnum::spectrogram(source[0][0], segment, overlap, source.GetXScale());
+    }
+
+    virtual void Finish() {
+        const wxStfDoc* owner = GetOwner();
+        const Channel& origin = owner->at(source.GetChannelIndex(0));
+        Channel ch(result.density.size());
+        for (std::size_t n_w = 0; n_w < result.density.size(); ++n_w) {
+            Section sec(STFIO_MOVE(result.density[n_w]));
+            std::ostringstream desc;
+            desc << "Power spectrum from " << n_w*result.dt << " " << owner->GetXUnits();
+            sec.SetSectionDescription(desc.str());
+            ch.InsertSection(STFIO_MOVE(sec), n_w);
+        }
+        ch.SetChannelName(origin.GetChannelName());
+        ch.SetYUnits(densityUnits(origin.GetYUnits(), owner->GetXUnits()));
+        Recording Spectra(STFIO_MOVE(ch));
+        Spectra.CopyAttributes(*owner);
+        Spectra.SetXScale(result.df);
+        Spectra.SetXUnits(frequencyUnits(owner->GetXUnits()));
+        wxString title;
+        title << owner->GetTitle() << wxT(", spectrogram of section ")
+              << (int)source.GetSectionIndices(0)[0]+1;
+        wxGetApp().NewChild(STFIO_MOVE(Spectra), GetOwner(), title);
+    }
+
+private:
+    stfio::Snapshot source;
+    std::size_t segment, overlap;
+    stfnum::Spectrogram result;
+};
+
+// Runs the analysis of a native plugin on the selected sections.
+class wxStfNativePluginTask : public wxStfTask {
+public:
+    wxStfNativePluginTask(wxStfDoc* doc, const stfnum::NativePlugin& plugin_,
+                          const stfio::Snapshot& snapshot_, const Vector_double& params_)
+        : wxStfTask(stf::std2wx(plugin_.GetName()), doc), plugin(plugin_), snapshot(snapshot_),
+          params(params_), res(), inPlace(doc->GetEditInPlace())
+    {}
+
+    virtual void Run(stfio::ProgressInfo& progDlg) {
+        res = plugin.Run(snapshot[0], snapshot.GetXScale(), params, progDlg);
+    }
+
+    virtual void Finish() {
+        wxStfDoc* pDoc = GetOwner();
+        wxString name(stf::std2wx(plugin.GetName()));
+        if (res.traces.size() > 0) {
+            if (inPlace && pDoc->IsCurrent(snapshot)) {
+                pDoc->ReplaceSections(snapshot.GetChannelIndex(0), snapshot.GetSectionIndices(0),
+                                      res.traces, plugin.GetName());
+            } else {
+                Recording Transformed(STFIO_MOVE(res.traces));
+                Transformed.CopyAttributes(*pDoc);
+                pDoc = wxGetApp().NewChild(STFIO_MOVE(Transformed), pDoc, pDoc->GetTitle()+wxT(", ")+name);
+            }
+        }
+        if (pDoc != NULL && res.results.nRows() > 0 && res.results.nCols() > 0) {
+            wxStfChildFrame* pFrame=(wxStfChildFrame*)pDoc->GetDocumentWindow();
+            pFrame->ShowTable(res.results, name);
+        }
+    }
+
+private:
+    // copies keep the plugin library loaded:
+    stfnum::NativePlugin plugin;
+    stfio::Snapshot snapshot;
+    Vector_double params;
+    stfnum::PluginResults res;
+    bool inPlace;
+};
+
+// Decodes and measures copies of the sections next to the current one.
+class wxStfPrefetchTask : public wxStfTask {
+public:
+    wxStfPrefetchTask(wxStfDoc* doc, const std::vector<std::size_t>& indices_,
+                      const std::vector<wxStfDoc::PrefetchedSection>& entries_)
+        : wxStfTask(wxT("Prefetch"), doc), indices(indices_), entries(entries_)
+    {}
+
+    virtual void Run(stfio::ProgressInfo& WXUNUSED(progDlg)) {
+        for (std::size_t n = 0; n < entries.size(); ++n) {
+            if (IsCancelled()) {
+                return;
+            }
+            wxStfDoc::PrefetchedSection& entry = entries[n];
+            for (std::size_t n_c = 0; n_c < entry.sections.size(); ++n_c) {
+                entry.sections[n_c].Prepare();
+            }
+            // measured like wxStfDoc::GetMeasurementJob() would:
+            const Section* reference = entry.sections.size() > 1 ? &entry.sections[entry.secCh] : NULL;
+            try {
+                entry.results = entry.plan.Evaluate(entry.sections[entry.curCh], entry.dt, reference);
+                entry.measured = true;
+            }
+            catch (const std::out_of_range&) {
+                // Measure() reports the error when the section is shown
+                entry.measured = false;
+            }
+        }
+    }
+
+    virtual void Finish() {
+        for (std::size_t n = 0; n < entries.size(); ++n) {
+            GetOwner()->AdoptPrefetched(indices[n], entries[n]);
+        }
+    }
+
+private:
+    std::vector<std::size_t> indices;
+    std::vector<wxStfDoc::PrefetchedSection> entries;
+};
+
+}
+
 void wxStfDoc::Filter(wxCommandEvent& WXUNUSED(event)) {
 #ifndef TEST_MINIMAL
     if (GetSelectedSections().empty()) {
@@ -2004,6 +2694,8 @@ void wxStfDoc::Filter(wxCommandEvent& WXUNUSED(event)) {
         size=3; break;
     case 2:
     case 3:
+    case 4:
+    case 5:
         size=1;
         break;
     }
@@ -2018,7 +2710,9 @@ void wxStfDoc::Filter(wxCommandEvent& WXUNUSED(event)) {
         a[2]=(int)(FftDialog.Width()*100000.0)/100000.0;	/*width in kHz*/
         break;
     case 2:
-    case 3: {
+    case 3:
+    case 4:
+    case 5: {
         //insert standard values:
         std::vector<std::string> labels(1);
         Vector_double defaults(labels.size());
@@ -2035,58 +2729,130 @@ void wxStfDoc::Filter(wxCommandEvent& WXUNUSED(event)) {
     }
     }
 
-    wxBusyCursor wc;
+    stfnum::WindowFilter filter;
+    stfnum::Func func;
+    switch (fselect) {
+     case 4:
+     case 5:
+         // zero-phase time-domain filters with the same -3 dB point:
+         try {
+             stfnum::BiquadCascade cascade =
+                 stfnum::designIIR(fselect==4 ? stfnum::iir_bessel : stfnum::iir_butterworth,
+                                   4, a[0], GetSR(), false, true);
+             filter = stfnum::filtfiltWindowFilter(cascade);
+         }
+         catch (const std::out_of_range& e) {
+             wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+             return;
+         }
+         break;
+     case 3:
+         func = stfnum::fgaussColqu;
+         inverse = false;
+         break;
+     case 2:
+         func = stfnum::fbessel4;
+         inverse = false;
+         break;
+     default:
+         func = stfnum::fgauss;
+    }
+
+    if (filter.empty()) {
+        filter = stfnum::fftWindowFilter(a, (int)GetSR(), func, inverse);
+    }
+    // the document can be used while the snapshot is filtered:
+    wxGetApp().GetTaskPool().Submit(new wxStfFilterTask(this, GetSelectedSnapshot(), llf, ulf, filter));
+#endif
+}
 
-    //--I. Defining the parameters of the filter function
+void wxStfDoc::RunNativePlugin(std::size_t n) {
+    if (n >= wxGetApp().GetNativePlugins().size()) {
+        wxGetApp().ErrorMsg(wxT("Couldn't find native plugin"));
+        return;
+    }
+    const stfnum::NativePlugin& plugin = wxGetApp().GetNativePlugins()[n];
+    if (GetSelectedSections().empty()) {
+        wxGetApp().ErrorMsg(wxT("Select traces first"));
+        return;
+    }
+    Vector_double params(plugin.GetParamDefaults());
+    if (!params.empty()) {
+        stf::UserInput init(plugin.GetParamLabels(), params, plugin.GetName());
+        wxStfUsrDlg PluginDialog(GetDocumentWindow(), init);
+        if (PluginDialog.ShowModal()!=wxID_OK) return;
+        params = PluginDialog.readInput();
+    }
+    // plugins read the samples of all selected traces:
+    WaitForSections();
+    wxGetApp().GetTaskPool().Submit(new wxStfNativePluginTask(this, plugin, GetSelectedSnapshot(), params));
+}
 
-    /*sampling interval in ms*/
+void wxStfDoc::Downsample(wxCommandEvent& WXUNUSED(event)) {
+    //insert standard values:
+    std::vector<std::string> labels(1);
+    Vector_double defaults(labels.size());
+    labels[0]="Downsampling factor:";defaults[0]=10;
+    stf::UserInput init(labels,defaults,"Downsample");
 
-    Channel TempChannel(GetSelectedSections().size(), get()[GetCurChIndex()][GetSelectedSections()[0]].size());
-    std::size_t n = 0;
-    for (c_st_it cit = GetSelectedSections().begin(); cit != GetSelectedSections().end(); cit++) {
-        try {
-            switch (fselect) {
-                case 3: {
-                    Section FftTemp(stfnum::filter(get()[GetCurChIndex()][*cit].get(),
-                            llf,ulf,a,(int)GetSR(),stfnum::fgaussColqu,false));
-		    FftTemp.SetXScale(get()[GetCurChIndex()][*cit].GetXScale());
-                    FftTemp.SetSectionDescription( get()[GetCurChIndex()][*cit].GetSectionDescription()+
-                                                   ", filtered");
-                    TempChannel.InsertSection(FftTemp, n);
-                    break;
-                }
-                case 2: {
-                    Section FftTemp(stfnum::filter(get()[GetCurChIndex()][*cit].get(),
-                            llf,ulf,a,(int)GetSR(),stfnum::fbessel4,false));
-		    FftTemp.SetXScale(get()[GetCurChIndex()][*cit].GetXScale());
-                    FftTemp.SetSectionDescription( get()[GetCurChIndex()][*cit].GetSectionDescription()+
-                                                   ", filtered" );
-                    TempChannel.InsertSection(FftTemp, n);
-                    break;
-                }
-                case 1: {
-                    Section FftTemp(stfnum::filter(get()[GetCurChIndex()][*cit].get(),
-                            llf,ulf,a,(int)GetSR(),stfnum::fgauss,inverse));
-		    FftTemp.SetXScale(get()[GetCurChIndex()][*cit].GetXScale());
-                    FftTemp.SetSectionDescription( get()[GetCurChIndex()][*cit].GetSectionDescription()+
-                                                   std::string(", filtered") );
-                    TempChannel.InsertSection(FftTemp, n);
-                    break;
-                }
-            }
-        }
-        catch (const std::exception& e) {
-            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
-        }
-        n++;
+    wxStfUsrDlg DownsampleDialog(GetDocumentWindow(),init);
+    if (DownsampleDialog.ShowModal()!=wxID_OK) return;
+    Vector_double input(DownsampleDialog.readInput());
+    if (input.size()!=1) return;
+    int factor=(int)input[0];
+    if (factor < 2 || (std::size_t)factor >= cursec().size()) {
+        wxGetApp().ErrorMsg(wxT("The downsampling factor has to be at least 2\nand smaller than the number of points"));
+        return;
     }
-    if (TempChannel.size()>0) {
-        Recording Fft(TempChannel);
-        Fft.CopyAttributes(*this);
+    // all traces are needed:
+    WaitForSections();
+    // the copies share their data with this document; the original is kept
+    // for detailed measurements:
+    wxGetApp().GetTaskPool().Submit(new wxStfDownsampleTask(this, stfio::Snapshot(*this, GetEpoch()),
+                                                            (std::size_t)factor));
+}
 
-        wxGetApp().NewChild(Fft, this,GetTitle()+wxT(", filtered"));
+bool wxStfDoc::SpectrumDlg(const std::string& title, std::size_t& segment, std::size_t& overlap) {
+    std::vector<std::string> labels(2);
+    Vector_double defaults(labels.size());
+    labels[0]="Points per segment:";defaults[0]=4096;
+    labels[1]="Overlap (%):";defaults[1]=50;
+    stf::UserInput init(labels,defaults,title);
+
+    wxStfUsrDlg SpectrumDialog(GetDocumentWindow(),init);
+    if (SpectrumDialog.ShowModal()!=wxID_OK) return false;
+    Vector_double input(SpectrumDialog.readInput());
+    if (input.size()!=2) return false;
+    if (input[0] < 2 || input[0] > cursec().size() || input[1] < 0 || input[1] >= 100) {
+        wxGetApp().ErrorMsg(wxT("The segments have to be at least 2 points long and fit into the trace,\n"
+                                "and they have to overlap by less than 100%"));
+        return false;
     }
-#endif
+    segment = (std::size_t)input[0];
+    overlap = (std::size_t)(segment*input[1]/100.0);
+    return true;
+}
+
+void wxStfDoc::PowerSpectrum(wxCommandEvent& WXUNUSED(event)) {
+    std::size_t segment = 0, overlap = 0;
+    if (!SpectrumDlg("Power spectrum", segment, overlap)) return;
+    // the selected sections of all channels, or the current one if none is selected:
+    std::vector<std::size_t> sections(GetSelectedSections());
+    if (sections.empty()) {
+        sections.push_back(GetCurSecIndex());
+    }
+    WaitForSections();
+    wxGetApp().GetTaskPool().Submit(new wxStfSpectrumTask(this, stfio::Snapshot(*this, GetEpoch()),
+                                                          sections, segment, overlap));
+}
+
+void wxStfDoc::Spectrogram(wxCommandEvent& WXUNUSED(event)) {
+    std::size_t segment = 0, overlap = 0;
+    if (!SpectrumDlg("Spectrogram", segment, overlap)) return;
+    std::vector<std::size_t> sections(1, GetCurSecIndex());
+    wxGetApp().GetTaskPool().Submit(
+        new wxStfSpectrogramTask(this, stfio::Snapshot(*this, GetEpoch(), GetCurChIndex(), sections),
+                                 segment, overlap));
 }
 
 void wxStfDoc::P_over_N(wxCommandEvent& WXUNUSED(event)){
@@ -2100,52 +2866,24 @@ void wxStfDoc::P_over_N(wxCommandEvent& WXUNUSED(event)){
     if (PonDialog.ShowModal()!=wxID_OK) return;
     Vector_double input(PonDialog.readInput());
     if (input.size()!=1) return;
-    int PoN=(int)fabs(input[0]);
-    int ponDirection=input[0]<0? -1:1;
-    int new_sections=(int)get()[GetCurChIndex()].size()/(PoN+1);
-    if (new_sections<1) {
-        wxGetApp().ErrorMsg(wxT("Not enough traces for P/n correction"));
-        return;
-    }
-
-    //File dialog box
     wxBusyCursor wc;
-    Channel TempChannel(new_sections);
-
-    //read and PoN
-    for (int n_section=0; n_section < new_sections; n_section++) {
-        //Section loop
-        Section TempSection(get()[GetCurChIndex()][n_section].size());
-        TempSection.SetXScale(get()[GetCurChIndex()][n_section].GetXScale());
-        for (int n_point=0; n_point < (int)get()[GetCurChIndex()][n_section].size(); n_point++)
-            TempSection[n_point]=0.0;
-
-        //Addition of the PoN-values:
-        for (int n_PoN=1; n_PoN < PoN+1; n_PoN++)
-            for (int n_point=0; n_point < (int)get()[GetCurChIndex()][n_section].size(); n_point++)
-                TempSection[n_point] += get()[GetCurChIndex()][n_PoN+(n_section*(PoN+1))][n_point];
-
-        //Subtraction from the original values:
-        for (int n_point=0; n_point < (int)get()[GetCurChIndex()][n_section].size(); n_point++)
-            TempSection[n_point] = get()[GetCurChIndex()][n_section*(PoN+1)][n_point]-
-                    TempSection[n_point]*ponDirection;
-        std::ostringstream povernLabel;
-        povernLabel << GetTitle() << ", #" << n_section << ", P over N";
-        TempSection.SetSectionDescription(povernLabel.str());
-        try {
-            TempChannel.InsertSection(TempSection,n_section);
-        }
-        catch (const std::out_of_range& e) {
-            wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+    // all traces are needed:
+    WaitForSections();
+    try {
+        Channel TempChannel(MakePoverN(GetCurChIndex(), (int)input[0]));
+        for (std::size_t n_section=0; n_section < TempChannel.size(); n_section++) {
+            std::ostringstream povernLabel;
+            povernLabel << GetTitle() << ", #" << n_section << ", P over N";
+            TempChannel[n_section].SetSectionDescription(povernLabel.str());
         }
-    }
-    if (TempChannel.size()>0) {
-        Recording DataPoN(TempChannel);
+        Recording DataPoN(STFIO_MOVE(TempChannel));
         DataPoN.CopyAttributes(*this);
 
-        wxGetApp().NewChild(DataPoN,this,GetTitle()+wxT(", p over n subtracted"));
+        wxGetApp().NewChild(STFIO_MOVE(DataPoN),this,GetTitle()+wxT(", p over n subtracted"));
+    }
+    catch (const std::out_of_range& e) {
+        wxGetApp().ErrorMsg(wxString( e.what(), wxConvLocal ));
     }
-
 }
 
 void wxStfDoc::Plotextraction(stf::extraction_mode mode) {
@@ -2162,11 +2900,11 @@ void wxStfDoc::Plotextraction(stf::extraction_mode mode) {
     int nTemplate=MiniDialog.GetTemplate();
     try {
         Vector_double templateWave(
-                sectionList.at(nTemplate).sec_attr.storeFitEnd -
-                sectionList.at(nTemplate).sec_attr.storeFitBeg);
+                sectionList.at(nTemplate).pSecAttr->storeFitEnd -
+                sectionList.at(nTemplate).pSecAttr->storeFitBeg);
         for ( std::size_t n_p=0; n_p < templateWave.size(); n_p++ ) {
-            templateWave[n_p] = sectionList.at(nTemplate).sec_attr.fitFunc->func(
-                n_p*GetXScale(), sectionList.at(nTemplate).sec_attr.bestFitP);
+            templateWave[n_p] = sectionList.at(nTemplate).pSecAttr->fitFunc->func(
+                n_p*GetXScale(), sectionList.at(nTemplate).pSecAttr->bestFitP);
         }
         wxBusyCursor wc;
 #undef min
@@ -2175,9 +2913,8 @@ void wxStfDoc::Plotextraction(stf::extraction_mode mode) {
 
         double fmax = *std::max_element(templateWave.begin(), templateWave.end());
         double fmin = *std::min_element(templateWave.begin(), templateWave.end());
-        templateWave = stfio::vec_scal_minus(templateWave, fmax);
         double minim=fabs(fmin);
-        templateWave = stfio::vec_scal_div(templateWave, minim);
+        stfio::offset_scale_inplace(templateWave, -fmax, 1.0/minim);
         std::string section_description, window_title;
         Section TempSection(cursec().get().size());
         switch (mode) {
@@ -2215,10 +2952,10 @@ void wxStfDoc::Plotextraction(stf::extraction_mode mode) {
         TempSection.SetSectionDescription(section_description +
                                           cursec().GetSectionDescription());
         Channel TempChannel(TempSection);
-        Recording detCrit(TempChannel);
+        Recording detCrit(STFIO_MOVE(TempChannel));
         detCrit.CopyAttributes(*this);
 
-        wxGetApp().NewChild(detCrit, this, GetTitle() + stf::std2wx(window_title));
+        wxGetApp().NewChild(STFIO_MOVE(detCrit), this, GetTitle() + stf::std2wx(window_title));
     }
     catch (const std::runtime_error& e) {
         wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
@@ -2254,11 +2991,11 @@ void wxStfDoc::MarkEvents(wxCommandEvent& WXUNUSED(event)) {
     int nTemplate=MiniDialog.GetTemplate();
     try {
         Vector_double templateWave(
-                sectionList.at(nTemplate).sec_attr.storeFitEnd -
-                sectionList.at(nTemplate).sec_attr.storeFitBeg);
+                sectionList.at(nTemplate).pSecAttr->storeFitEnd -
+                sectionList.at(nTemplate).pSecAttr->storeFitBeg);
         for ( std::size_t n_p=0; n_p < templateWave.size(); n_p++ ) {
-            templateWave[n_p] = sectionList.at(nTemplate).sec_attr.fitFunc->func(
-                    n_p*GetXScale(), sectionList.at(nTemplate).sec_attr.bestFitP);
+            templateWave[n_p] = sectionList.at(nTemplate).pSecAttr->fitFunc->func(
+                    n_p*GetXScale(), sectionList.at(nTemplate).pSecAttr->bestFitP);
         }
         wxBusyCursor wc;
 #undef min
@@ -2266,22 +3003,16 @@ void wxStfDoc::MarkEvents(wxCommandEvent& WXUNUSED(event)) {
         // subtract offset and normalize:
         double fmax = *std::max_element(templateWave.begin(), templateWave.end());
         double fmin = *std::min_element(templateWave.begin(), templateWave.end());
-        templateWave = stfio::vec_scal_minus(templateWave, fmax);
         double minim=fabs(fmin);
-        templateWave = stfio::vec_scal_div(templateWave, minim);
-        Vector_double detect( cursec().get().size() - templateWave.size() );
-        switch (MiniDialog.GetMode()) {
-         case stf::criterion: {
-             stf::wxProgressInfo progDlg("Computing detection criterion...", "Computing detection criterion...", 100);
-             detect=stfnum::detectionCriterion(cursec().get(), templateWave, progDlg);
-             break;
-         }
-         case stf::correlation: {
-             stf::wxProgressInfo progDlg("Computing linear correlation...", "Computing linear correlation...", 100);
-             detect=stfnum::linCorr(cursec().get(), templateWave, progDlg);
-             break;
-         }
-         case stf::deconvolution:
+        stfio::offset_scale_inplace(templateWave, -fmax, 1.0/minim);
+        stfnum::EventDetectionPlan plan;
+        plan.templ = templateWave;
+        plan.mode = (stfnum::detection_mode)MiniDialog.GetMode();
+        plan.threshold = MiniDialog.GetThreshold();
+        plan.minDistance = MiniDialog.GetMinDistance();
+        plan.baseline = baseline;
+        plan.SR = GetSR();
+        if (plan.mode == stfnum::detect_deconvolution) {
              std::string usrInStr[2] = {"Lowpass (kHz)", "Highpass (kHz)"};
              double usrInDbl[2] = {0.5, 0.0001};
              stf::UserInput Input( std::vector<std::string>(usrInStr, usrInStr+2),
@@ -2289,58 +3020,59 @@ void wxStfDoc::MarkEvents(wxCommandEvent& WXUNUSED(event)) {
              wxStfUsrDlg myDlg( GetDocumentWindow(), Input );
              if (myDlg.ShowModal()!=wxID_OK) return;
              Vector_double filter = myDlg.readInput();
-             stf::wxProgressInfo progDlg("Computing deconvolution...", "Starting deconvolution...", 100);
-             detect=stfnum::deconvolve(cursec().get(), templateWave, (int)GetSR(), filter[1], filter[0], progDlg);
-             break;
+             plan.lowpass = filter[0];
+             plan.highpass = filter[1];
         }
-        if (detect.empty()) {
-            wxGetApp().ErrorMsg(wxT("Error: Detection criterion is empty."));
-            return;
+        // selected traces are scanned in parallel on request:
+        std::vector<std::size_t> sections(1, GetCurSecIndex());
+        if (GetSelectedSections().size() > 1 &&
+            wxMessageDialog( GetDocumentWindow(), wxT("Detect events in all selected traces?"),
+                             wxT("Event detection"), wxYES_NO ).ShowModal()==wxID_YES)
+        {
+            sections = GetSelectedSections();
+        }
+        stfnum::EventTable events;
+        if (sections.size() == 1) {
+            stf::wxProgressInfo progDlg("Detecting events...", "Computing detection criterion...", 100);
+            events = plan.Detect(cursec(), GetCurSecIndex(), progDlg);
+        } else {
+            stf::wxProgressInfo progDlg("Detecting events...", "Scanning selected traces...", 100);
+            events = plan.Detect(get()[GetCurChIndex()], sections, progDlg);
         }
-        std::vector<int> startIndices(
-                stfnum::peakIndices( detect, MiniDialog.GetThreshold(),
-                        MiniDialog.GetMinDistance() ) );
-        if (startIndices.empty()) {
+        if (events.size() == 0) {
             wxGetApp().ErrorMsg( wxT( "No events were found. Try to lower the threshold." ) );
             return;
         }
-        // erase old events:
-        ClearEvents(GetCurChIndex(), GetCurSecIndex());
 
         wxStfView* pView = (wxStfView*)GetFirstView();
         wxStfGraph* pGraph = pView->GetGraph();
 
-        for (c_int_it cit = startIndices.begin(); cit != startIndices.end(); ++cit ) {
-            sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.push_back(
-                stf::Event( *cit, 0, templateWave.size(), new wxCheckBox(
-                    pGraph, -1, wxEmptyString) ) );
-            // Find peak in this event:
-            double baselineMean=0;
-            for ( int n_mean = *cit-baseline;
-                  n_mean < *cit;
-                  ++n_mean )
-            {
-                if (n_mean < 0) {
-                    baselineMean += cursec().at(0);
-                } else {
-                    baselineMean += cursec().at(n_mean);
-                }
-            }
-            baselineMean /= baseline;
-            double peakIndex=0;
-            int eventl = templateWave.size();
-            if (*cit + eventl >= cursec().get().size()) {
-                eventl = cursec().get().size()-1- (*cit);
-            }
-            stfnum::peak( cursec().get(), baselineMean, *cit, *cit + eventl,
-                          1, stfnum::both, peakIndex );
-            if (peakIndex != peakIndex || peakIndex < 0 || peakIndex >= cursec().get().size()) {
-                throw std::runtime_error("Error during peak detection (result is NAN)\n");
+        // erase old events:
+        for (c_st_it cit = sections.begin(); cit != sections.end(); ++cit) {
+            if (*cit == GetCurSecIndex()) {
+                ClearEvents(GetCurChIndex(), *cit);
+            } else {
+                SectionAttrW(GetCurChIndex(), *cit).eventList.clear();
             }
-            // set peak index of this event:
-            sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.back().SetEventPeakIndex((int)peakIndex);
         }
 
+        for (std::size_t n_e = 0; n_e < events.size(); ++n_e) {
+            std::vector<stf::Event>& eventList =
+                SectionAttrW(GetCurChIndex(), events.section[n_e]).eventList;
+            eventList.push_back(
+                stf::Event( events.index[n_e], (std::size_t)events.peakIndex[n_e], templateWave.size() ) );
+        }
+
+        if (sections.size() > 1) {
+            wxStfChildFrame* pFrame=(wxStfChildFrame*)GetDocumentWindow();
+            pFrame->ShowTable(events.ToTable(GetXScale()), wxT("Detected events"));
+            // intervals, rates and distributions pooled over the scanned traces:
+            stfnum::EventSet set(events, GetXScale(), sections, get()[GetCurChIndex()]);
+            stfnum::EventStatistics stats = stfnum::EventStatisticsPlan().Compute(set);
+            pFrame->ShowTable(stats.ToTable(), wxT("Event statistics"));
+            pFrame->ShowTable(stats.RateTable(), wxT("Event rate"));
+            pFrame->ShowTable(stats.DistributionTable(), wxT("Event distributions"));
+        }
         if (pGraph != NULL) {
             pGraph->Refresh();
         }
@@ -2373,6 +3105,9 @@ void wxStfDoc::Extract( wxCommandEvent& WXUNUSED(event) ) {
         Channel TempChannel2(n_real);
         std::vector<int> peakIndices(n_real);
         n_real = 0;
+        // the events refer to the samples of the trace instead of copying them:
+        stfio::MappedSamples source = cursec().GetSamples();
+        long n_points = (long)cursec().size();
         c_event_it lastEventIt = GetCurrentSectionAttributes().eventList.begin();
         for (c_event_it it = GetCurrentSectionAttributes().eventList.begin();
              it != GetCurrentSectionAttributes().eventList.end(); ++it) {
@@ -2384,31 +3119,38 @@ void wxStfDoc::Extract( wxCommandEvent& WXUNUSED(event) ) {
                     ((double)(it->GetEventStartIndex() -
                             lastEventIt->GetEventStartIndex())) / GetSR();
                 // add some baseline at the beginning and end:
-                std::size_t eventSize = it->GetEventSize() + 2*baseline;
-                Section TempSection2( eventSize );
-                for ( std::size_t n_new = 0; n_new < eventSize; ++n_new ) {
-                    // make sure index is not out of range:
-                    int index = it->GetEventStartIndex() + n_new - baseline;
-                    if (index < 0)
-                        index = 0;
-                    if (index >= (int)cursec().size())
-                        index = cursec().size()-1;
-                    TempSection2[n_new] = cursec()[index];
+                long eventSize = (long)it->GetEventSize() + 2*baseline;
+                long first = (long)it->GetEventStartIndex() - baseline;
+                long begin = std::min(std::max(first, 0L), n_points);
+                long end = std::max(std::min(first+eventSize, n_points), begin);
+                // beyond the trace, its first or last data point is repeated:
+                std::vector<stfio::MappedSamples> pieces;
+                if (begin > first) {
+                    long n_pad = std::min(begin-first, eventSize);
+                    pieces.push_back( stfio::compactSamples(Vector_double(n_pad, cursec()[0])) );
+                }
+                if (end > begin) {
+                    pieces.push_back( stfio::sliceSamples(source, begin, end-begin) );
                 }
+                long n_right = eventSize - (long)std::min(begin-first, eventSize) - (end-begin);
+                if (n_right > 0) {
+                    pieces.push_back( stfio::compactSamples(Vector_double(n_right, cursec()[n_points-1])) );
+                }
+                Section TempSection2( pieces.size() == 1 ? pieces[0] : stfio::chainSamples(pieces) );
                 std::ostringstream eventDesc;
                 eventDesc << "Extracted event #" << (int)n_real;
                 TempSection2.SetSectionDescription(eventDesc.str());
                 TempSection2.SetXScale(get()[GetCurChIndex()][GetCurSecIndex()].GetXScale());
-                TempChannel2.InsertSection( TempSection2, n_real );
+                TempChannel2.InsertSection( STFIO_MOVE(TempSection2), n_real );
                 n_real++;
                 lastEventIt = it;
             }
         }
         if (TempChannel2.size()>0) {
-            Recording Minis( TempChannel2 );
+            Recording Minis( STFIO_MOVE(TempChannel2) );
             Minis.CopyAttributes( *this );
 
-            wxStfDoc* pDoc=wxGetApp().NewChild( Minis, this,
+            wxStfDoc* pDoc=wxGetApp().NewChild( STFIO_MOVE(Minis), this,
                     GetTitle()+wxT(", extracted events") );
             if (pDoc != NULL) {
                 wxStfChildFrame* pChild=(wxStfChildFrame*)pDoc->GetDocumentWindow();
@@ -2442,14 +3184,31 @@ void wxStfDoc::InteractiveEraseEvents( wxCommandEvent& WXUNUSED(event) ) {
     }
 }
 
+void wxStfDoc::EraseEvent( wxCommandEvent& WXUNUSED(event) ) {
+    try {
+        wxStfView* pView = (wxStfView*)GetFirstView();
+        wxStfGraph* pGraph = pView->GetGraph();
+        std::vector<stf::Event>& eventList = GetCurrentSectionAttributesW().eventList;
+        std::size_t n_event = stf::eventAt(eventList, pGraph->get_eventPos());
+        if (n_event == eventList.size()) {
+            wxGetApp().ErrorMsg(wxT("There is no event at this position"));
+            return;
+        }
+        eventList.erase(eventList.begin() + n_event);
+        pGraph->Refresh();
+    }
+    catch (const std::out_of_range& e) {
+        wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
+    }
+}
+
 void wxStfDoc::AddEvent( wxCommandEvent& WXUNUSED(event) ) {
     try {
         // retrieve the position where to add the event:
         wxStfView* pView = (wxStfView*)GetFirstView();
         wxStfGraph* pGraph = pView->GetGraph();
         int newStartPos = pGraph->get_eventPos();
-        stf::Event newEvent(newStartPos, 0, GetCurrentSectionAttributes().eventList.at(0).GetEventSize(),
-                            new wxCheckBox(pGraph, -1, wxEmptyString));
+        stf::Event newEvent(newStartPos, 0, GetCurrentSectionAttributes().eventList.at(0).GetEventSize());
         // Find peak in this event:
         double baselineMean=0;
         for ( int n_mean = newStartPos - baseline;
@@ -2469,21 +3228,8 @@ void wxStfDoc::AddEvent( wxCommandEvent& WXUNUSED(event) ) {
                 stfnum::both, peakIndex );
         // set peak index of last event:
         newEvent.SetEventPeakIndex( (int)peakIndex );
-        // find the position in the current event list where the new
-        // event should be inserted:
-        bool found = false;
-        for (event_it it = sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.begin();
-             it != sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.end(); ++it) {
-            if ( (int)(it->GetEventStartIndex()) > newStartPos ) {
-                // insert new event before this event, then break:
-                sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.insert( it, newEvent );
-                found = true;
-                break;
-            }
-        }
-        // if we are at the end of the list, append the event:
-        if (!found)
-            sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.push_back( newEvent );
+        // keep the event list sorted by the events' start:
+        stf::insertEvent(GetCurrentSectionAttributesW().eventList, newEvent);
     }
     catch (const std::out_of_range& e) {
         wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ));
@@ -2518,12 +3264,10 @@ void wxStfDoc::Threshold(wxCommandEvent& WXUNUSED(event)) {
         );
     }
     // clear table from previous detection
-    wxStfView* pView=(wxStfView*)GetFirstView();
-    wxStfGraph* pGraph = pView->GetGraph();
-    sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.clear();
+    ClearEvents(GetCurChIndex(), GetCurSecIndex());
     for (c_int_it cit = startIndices.begin(); cit != startIndices.end(); ++cit) {
-        sec_attr.at(GetCurChIndex()).at(GetCurSecIndex()).eventList.push_back(
-            stf::Event(*cit, 0, baseline, new wxCheckBox(pGraph, -1, wxEmptyString)));
+        GetCurrentSectionAttributesW().eventList.push_back(
+            stf::Event(*cit, 0, baseline));
     }
     // show results in a table:
     stfnum::Table events(GetCurrentSectionAttributes().eventList.size(),2);
@@ -2548,241 +3292,229 @@ void wxStfDoc::Threshold(wxCommandEvent& WXUNUSED(event)) {
     }
 }
 
+stfnum::MeasurementPlan wxStfDoc::GetMeasurementPlan() const {
+    stfnum::MeasurementPlan plan;
+    plan.baseBeg = baseBeg;
+    plan.baseEnd = baseEnd;
+    plan.peakBeg = peakBeg;
+    plan.peakEnd = peakEnd;
+    plan.baselineMethod = baselineMethod;
+    plan.pM = pM;
+    plan.dir = direction;
+    plan.RTFactor = RTFactor;
+    plan.fromBase = fromBase;
+    plan.slopeForThreshold = slopeForThreshold;
+    // stf::latency_mode and stfnum::latency_mode share their values, except
+    // that the start of the latency can't be set to the foot of an event:
+    plan.latencyStartMode = latencyStartMode == stf::footMode ?
+        stfnum::manual_latency : (stfnum::latency_mode)latencyStartMode;
+    plan.latencyEndMode = (stfnum::latency_mode)latencyEndMode;
+    plan.latencyBeg = GetLatencyBeg();
+    plan.latencyEnd = GetLatencyEnd();
+
+    return plan;
+}
+
 //Function calculates the peak and respective measures: base, Lo/Hi rise time
 //half duration, ratio of rise/slope and maximum slope
 void wxStfDoc::Measure( )
 {
-    double var=0.0;
-    if (cursec().get().size() == 0) return;
-    try {
-        cursec().at(0);
-    }
-    catch (const std::out_of_range&) {
-        return;
+    STF_PROFILE_SCOPE("wxStfDoc::Measure");
+    // The measurements are done by stfnum::MeasurementPlan, which is shared
+    // with the batch analysis tool. While a cursor is dragged, only the
+    // measurements that depend on it are redone:
+    stfnum::MeasurementJob job(GetMeasurementJob());
+    if (job.sec == NULL) return;
+
+    // the current section may have been measured by Prefetch() already:
+    std::map<std::size_t, PrefetchedSection>::const_iterator it = prefetched.find(GetCurSecIndex());
+    if (it != prefetched.end()) {
+        const PrefetchedSection& entry = it->second;
+        if (entry.measured && entry.plan == job.plan && entry.dt == job.dt &&
+            entry.curCh == GetCurChIndex() && entry.secCh == GetSecChIndex() &&
+            entry.sections.size() == size() && job.sec->SharesData(entry.sections[entry.curCh]) &&
+            (job.reference == NULL || job.reference->SharesData(entry.sections[entry.secCh])))
+        {
+            SetMeasurementResults(entry.results);
+            return;
+        }
     }
 
-    long windowLength = 1;
-    /*
-       windowLength (defined in samples) determines the size of the window for computing slopes.
-       if the window length larger than 1 is used, a kind of smoothing and low pass filtering is applied.
-       If slope estimates from data with different sampling rates should be compared, the
-       window should be choosen in such a way that the length in milliseconds is approximately the same.
-       This reduces some variability, the slope estimates are more robust and comparible.
-
-       Set window length to 0.05 ms, with a minimum of 1 sample. In this way, all data
-       sampled with 20 kHz or lower, will use a 1 sample window, data with a larger sampling rate
-       use a window of 0.05 ms for computing the slope.
-    */
-    windowLength = lround(0.05 * GetSR());    // use window length of about 0.05 ms.
-    if (windowLength < 1) windowLength = 1;   // use a minimum window length of 1 sample
-
-
-    //Begin peak and base calculation
-    //-------------------------------
+    stfnum::MeasurementResults res;
     try {
-        base=stfnum::base(baselineMethod,var,cursec().get(),baseBeg,baseEnd);
-        baseSD=sqrt(var);
-        peak=stfnum::peak(cursec().get(),base,
-                       peakBeg,peakEnd,pM,direction,maxT);
+        res = job.plan.Evaluate(*job.sec, job.dt, job.reference, *measureCache);
     }
     catch (const std::out_of_range& e) {
-        base=0.0;
-        baseSD=0.0;
-        peak=0.0;
-        throw e;
-    }
-    try {
-        threshold = stfnum::threshold( cursec().get(), peakBeg, peakEnd, slopeForThreshold/GetSR(), thrT, windowLength );
-    } catch (const std::out_of_range& e) {
-        threshold = 0;
+        ClearMeasurement();
         throw e;
     }
-    //Begin Lo to Hi% Rise Time calculation
-    //-------------------------------------
-    // 2009-06-05: reference is either from baseline or from threshold
-    double reference = base;
-    if (!fromBase && thrT >= 0) {
-        reference = threshold;
+    SetMeasurementResults(res);
+}
+
+std::vector<std::size_t> wxStfDoc::PrefetchWindow(std::size_t prefetchCount) const {
+    std::vector<std::size_t> window;
+    std::size_t n_sections = get()[GetCurChIndex()].size();
+    std::size_t cur = GetCurSecIndex();
+    // next and previous sections alternately; wrap around like wxStfGraph::OnNext():
+    for (std::size_t d = 1; d <= prefetchCount && window.size()+1 < n_sections; ++d) {
+        std::size_t next = (cur+d) % n_sections;
+        std::size_t prev = (cur+n_sections-d%n_sections) % n_sections;
+        if (std::find(window.begin(), window.end(), next) == window.end()) {
+            window.push_back(next);
+        }
+        if (prev != next && std::find(window.begin(), window.end(), prev) == window.end()) {
+            window.push_back(prev);
+        }
     }
-    double ampl=peak-reference;
-    
-    tLoReal=0.0;
-    double factor= RTFactor*0.01; /* normalized value */
-    InnerLoRT=NAN;
-    InnerHiRT=NAN;
-    OuterLoRT=NAN;
-    OuterHiRT=NAN;
+    return window;
+}
 
-    try {
-        // 2008-04-27: changed limits to start from the beginning of the trace
-        // 2013-06-16: changed to accept different rise-time proportions
-        rtLoHi=stfnum::risetime2(cursec().get(),reference,ampl, (double)0/*(double)baseEnd*/,
-                             maxT, factor/*0.2*/, InnerLoRT, InnerHiRT, OuterLoRT, OuterHiRT);
-        InnerLoRT/=GetSR();
-        InnerHiRT/=GetSR();
-        OuterLoRT/=GetSR();
-        OuterHiRT/=GetSR();
+void wxStfDoc::Prefetch() {
+    if (get().empty()) {
+        return;
     }
-    catch (const std::out_of_range& e) {
-        throw e;
+    int prefetchCount = wxGetProfileInt(wxT("Settings"), wxT("PrefetchSections"), 2);
+    std::vector<std::size_t> window;
+    if (prefetchCount > 0) {
+        window = PrefetchWindow(prefetchCount);
+    }
+    // sections that have moved out of the window may be reclaimed:
+    for (std::map<std::size_t, PrefetchedSection>::iterator it = prefetched.begin(); it != prefetched.end();) {
+        if (std::find(window.begin(), window.end(), it->first) == window.end()) {
+            prefetched.erase(it++);
+        } else {
+            ++it;
+        }
     }
 
+    stfnum::MeasurementJob job(GetMeasurementJob());
+    std::vector<std::size_t> indices;
+    std::vector<PrefetchedSection> entries;
+    for (std::size_t n = 0; n < window.size(); ++n) {
+        std::size_t index = window[n];
+        if (prefetched.count(index) || prefetchPending.count(index)) {
+            continue;
+        }
+        PrefetchedSection entry;
+        bool complete = true;
+        for (std::size_t n_c = 0; n_c < get().size(); ++n_c) {
+            if (index >= get()[n_c].size()) {
+                // not loaded yet (see StartProgressiveLoad())
+                complete = false;
+                break;
+            }
+            entry.sections.push_back(get()[n_c][index]);
+        }
+        if (!complete || entry.sections[GetCurChIndex()].size() == 0) {
+            continue;
+        }
+        entry.plan = job.plan;
+        entry.dt = job.dt;
+        entry.curCh = GetCurChIndex();
+        entry.secCh = GetSecChIndex();
+        entry.measured = false;
+        indices.push_back(index);
+        entries.push_back(entry);
+        prefetchPending.insert(index);
+    }
+    if (!entries.empty()) {
+        wxGetApp().GetTaskPool().Submit(new wxStfPrefetchTask(this, indices, entries));
+    }
+}
 
-    try {
-        // 2008-04-27: changed limits to start from the beginning of the trace
-        // 2013-06-16: changed to accept different rise-time proportions 
-        rtLoHi=stfnum::risetime(cursec().get(),reference,ampl, (double)0/*(double)baseEnd*/,
-                             maxT, factor/*0.2*/, tLoIndex, tHiIndex, tLoReal);
+void wxStfDoc::AdoptPrefetched(std::size_t index, const PrefetchedSection& entry) {
+    prefetchPending.erase(index);
+    std::vector<std::size_t> window(PrefetchWindow(wxGetProfileInt(wxT("Settings"), wxT("PrefetchSections"), 2)));
+    // the current section is kept too if the user has been quicker:
+    if (index != GetCurSecIndex() && std::find(window.begin(), window.end(), index) == window.end()) {
+        return;
     }
-    catch (const std::out_of_range& e) {
-        rtLoHi=0.0;
-        throw e;
+    for (std::size_t n_c = 0; n_c < entry.sections.size() && n_c < get().size(); ++n_c) {
+        if (index < get()[n_c].size()) {
+            get()[n_c][index].AdoptCaches(entry.sections[n_c]);
+        }
     }
+    prefetched[index] = entry;
+}
 
-    tHiReal=tLoReal+rtLoHi;
-    rtLoHi/=GetSR();
-
-    //Begin Half Duration calculation
-    //-------------------------------
-    //t50LeftReal=0.0;
-    // 2008-04-27: changed limits to start from the beginning of the trace
-    //             and to stop at the end of the trace
-    halfDuration = stfnum::t_half(cursec().get(), reference, ampl, (double)0 /*(double)baseBeg*/,
-            (double)cursec().size()-1 /*(double)peakEnd*/,maxT, t50LeftIndex, t50RightIndex, t50LeftReal);
-
-    t50RightReal=t50LeftReal+halfDuration;
-    halfDuration/=GetSR();
-    t50Y=0.5*ampl + reference;
-
-    //Calculate the beginning of the event by linear extrapolation:
-    if (latencyEndMode==stf::footMode) {
-        t0Real=tLoReal-(tHiReal-tLoReal)/3.0; // using 20-80% rise time (f/(1-2f) = 0.2/(1-0.4) = 1/3.0)
-    } else {
-        t0Real=t50LeftReal;
+stfnum::MeasurementJob wxStfDoc::GetMeasurementJob() const {
+    stfnum::MeasurementJob job(GetMeasurementPlan(), NULL, GetXScale());
+    if (get().empty() || cursec().size() == 0) {
+        return job;
     }
+    job.sec = &cursec();
+    if (size()>1) {
+        job.reference = &secsec();
+    }
+    return job;
+}
+
+void wxStfDoc::InvalidateMeasurement() {
+    measureCache->Clear();
+}
 
-    //Begin Ratio of slopes rise/decay calculation
-    //--------------------------------------------
-    double left_rise = peakBeg;
-    maxRise=stfnum::maxRise(cursec().get(),left_rise,maxT,maxRiseT,maxRiseY,windowLength);
-    double t_half_3=t50RightIndex+2.0*(t50RightIndex-t50LeftIndex);
-    double right_decay=peakEnd<=t_half_3 ? peakEnd : t_half_3+1;
-    maxDecay=stfnum::maxDecay(cursec().get(),maxT,right_decay,maxDecayT,maxDecayY,windowLength);
+void wxStfDoc::ClearMeasurement() {
+    base=0.0;
+    baseSD=0.0;
+    peak=0.0;
+    threshold=0.0;
+    rtLoHi=0.0;
+}
 
-    //Slope ratio
-    if (maxDecay !=0) slopeRatio=maxRise/maxDecay;
-    else slopeRatio=0.0;
-    maxRise *= GetSR();
-    maxDecay *= GetSR();
+void wxStfDoc::SetMeasurementResults(const stfnum::MeasurementResults& res)
+{
+    base=res.base;
+    baseSD=res.baseSD;
+    peak=res.peak;
+    maxT=res.maxT;
+    threshold=res.threshold;
+    thrT=res.thrT;
+
+    InnerLoRT=res.innerLoRT;
+    InnerHiRT=res.innerHiRT;
+    OuterLoRT=res.outerLoRT;
+    OuterHiRT=res.outerHiRT;
+    rtLoHi=res.rtLoHi;
+    tLoIndex=res.tLoIndex;
+    tHiIndex=res.tHiIndex;
+    tLoReal=res.tLoReal;
+    tHiReal=res.tHiReal;
+
+    halfDuration=res.halfDuration;
+    t50LeftIndex=res.t50LeftIndex;
+    t50RightIndex=res.t50RightIndex;
+    t50LeftReal=res.t50LeftReal;
+    t50RightReal=res.t50RightReal;
+    t50Y=res.t50Y;
+    t0Real=res.t0Real;
+
+    maxRise=res.maxRise;
+    maxRiseT=res.maxRiseT;
+    maxRiseY=res.maxRiseY;
+    maxDecay=res.maxDecay;
+    maxDecayT=res.maxDecayT;
+    maxDecayY=res.maxDecayY;
+    slopeRatio=res.slopeRatio;
 
     if (size()>1) {
-        //Calculate the absolute peak of the (AP) Ch2 inbetween the peak boundaries
-        //A direction dependent evaluation of the peak as in Ch1 does NOT exist!!
-
-        // endResting is set to 100 points arbitrarily in the pascal version
-        // (see measlib.pas) assuming that the resting potential is stable
-        // during the first 100 sampling points.
-        // const int endResting=100;
-        const int searchRange=100;
-        double APBase=0.0, APVar=0.0;
-        try {
-            // in 2012-11-02: use baseline cursors and not arbitrarily 100 points
-            //APBase=stfnum::base(APVar,secsec().get(),0,endResting);
-            APBase=stfnum::base(baselineMethod,APVar,secsec().get(), baseBeg, baseEnd ); // use baseline cursors
-            //APPeak=stfnum::peak(secsec().get(),APBase,peakBeg,peakEnd,pM,stfnum::up,APMaxT);
-            APPeak=stfnum::peak( secsec().get(),APBase ,peakBeg ,peakEnd ,pM,direction ,APMaxT );
-        }
-        catch (const std::out_of_range& e) {
-            APBase=0.0;
-            APPeak=0.0;
-            throw e;
-        }
-        //-------------------------------
-        //Maximal slope in the rise before the peak
-        //----------------------------
-        APMaxRiseT=0.0;
-        APMaxRiseY=0.0;
-        double left_APRise = peakBeg; 
-        //if (GetLatencyWindowMode() == stf::defaultMode ) {
-        left_APRise= APMaxT-searchRange>2.0 ? APMaxT-searchRange : 2.0;
-        try {
-            stfnum::maxRise(secsec().get(),left_APRise,APMaxT,APMaxRiseT,APMaxRiseY,windowLength);
-        }
-        catch (const std::out_of_range&) {
-            APMaxRiseT=0.0;
-            APMaxRiseY=0.0;
-            left_APRise = peakBeg; 
-        }
-
-        //End determination of the region of maximal slope in the second channel
-        //----------------------------
-
-        //-------------------------------
-        //Half-maximal amplitude
-        //----------------------------
-        //APt50LeftReal=0.0;
-        //std::size_t APt50LeftIndex,APt50RightIndex;
-        stfnum::t_half(secsec().get(), APBase, APPeak-APBase, left_APRise,
-                      (double)secsec().get().size(), APMaxT, APt50LeftIndex,
-                      APt50RightIndex, APt50LeftReal);
-        //End determination of the region of maximal slope in the second channel
-        //----------------------------
-
-        // Get onset in 2nd channel
-        APrtLoHi=stfnum::risetime(secsec().get(), APBase, APPeak-APBase, (double)0,
-                                  APMaxT, 0.2, APtLoIndex, APtHiIndex, APtLoReal);
-        APtHiReal = APtLoReal + APrtLoHi;
-        APt0Real = APtLoReal-(APtHiReal-APtLoReal)/3.0;  // using 20-80% rise time (f/(1-2f) = 0.2/(1-0.4) = 1/3.0)
-    }
-
-    // get and set start of latency measurement:
-    double latStart=0.0;
-    switch (latencyStartMode) {
-    // Interestingly, latencyCursor is an int in pascal, although
-    // the maxTs aren't. That's why there are double type casts
-    // here.
-    case stf::peakMode: //Latency cursor is set to the peak						
-        latStart=APMaxT;
-        break;
-    case stf::riseMode:
-        latStart=APMaxRiseT;
-        break;
-    case stf::halfMode:
-        latStart=APt50LeftReal;
-        break;
-    case stf::manualMode:
-    default:
-        latStart=GetLatencyBeg();
-        break;
+        APBase=res.APBase;
+        APPeak=res.APPeak;
+        APMaxT=res.APMaxT;
+        APMaxRiseT=res.APMaxRiseT;
+        APMaxRiseY=res.APMaxRiseY;
+        APt50LeftIndex=res.APt50LeftIndex;
+        APt50RightIndex=res.APt50RightIndex;
+        APt50LeftReal=res.APt50LeftReal;
+        APrtLoHi=res.APrtLoHi;
+        APtLoIndex=res.APtLoIndex;
+        APtHiIndex=res.APtHiIndex;
+        APtLoReal=res.APtLoReal;
+        APtHiReal=res.APtHiReal;
     }
-    SetLatencyBeg(latStart);
-
     APt0Real = tLoReal-(tHiReal-tLoReal)/3.0;  // using 20-80% rise time (f/(1-2f) = 0.2/(1-0.4) = 1/3.0)
-    // get and set end of latency measurement:
-    double latEnd=0.0;
-    switch (latencyEndMode) {
-    // Interestingly, latencyCursor is an int in pascal, although
-    // the maxTs aren't. That's why there are double type casts
-    // here.
-    case stf::footMode:
-        latEnd=tLoReal-(tHiReal-tLoReal)/3.0; // using 20-80% rise time (f/(1-2f) = 0.2/(1-0.4) = 1/3.0)
-        break;
-    case stf::riseMode:
-        latEnd=maxRiseT;
-        break;
-    case stf::halfMode:
-        latEnd=t50LeftReal;
-        break;
-    case stf::peakMode:
-        latEnd=maxT;
-        break;
-    case stf::manualMode:
-    default:
-        latEnd=GetLatencyEnd();
-        break;
-    }
-    SetLatencyEnd(latEnd);
 
+    SetLatencyBeg(res.latencyBeg);
+    SetLatencyEnd(res.latencyEnd);
     SetLatency(GetLatencyEnd()-GetLatencyBeg());
 
 #ifdef WITH_PSLOPE
@@ -2845,7 +3577,7 @@ void wxStfDoc::Measure( )
 #endif // WITH_PSLOPE
     //--------------------------
 
-}	//End of Measure(,,,,,)
+}	//End of SetMeasurementResults()
 
 
 void wxStfDoc::CopyCursors(const wxStfDoc& c_Recording) {
@@ -3261,27 +3993,18 @@ void wxStfDoc::resize(std::size_t c_n_channels) {
     Recording::resize(c_n_channels);
     yzoom.resize(size());
     sec_attr.resize(size());
-    for (std::size_t nchannel = 0; nchannel < size(); ++nchannel) {
-        sec_attr[nchannel].resize(at(nchannel).size());
-    }
 }
 
 void wxStfDoc::InsertChannel(Channel& c_Channel, std::size_t pos) {
     Recording::InsertChannel(c_Channel, pos);
     yzoom.resize(size());
     sec_attr.resize(size());
-    for (std::size_t nchannel = 0; nchannel < size(); ++nchannel) {
-        sec_attr[nchannel].resize(at(nchannel).size());
-    }
 }
 
 void wxStfDoc::SetIsFitted( std::size_t nchannel, std::size_t nsection,
-                            const Vector_double& bestFitP_, stfnum::storedFunc* fitFunc_,
+                            const Vector_double& bestFitP_, const stfnum::storedFunc* fitFunc_,
                             double chisqr, std::size_t fitBeg, std::size_t fitEnd )
 {
-    if (nchannel >= sec_attr.size() || nsection >= sec_attr[nchannel].size()) {
-        throw std::out_of_range("Index out of range in wxStfDoc::SetIsFitted");
-    }
     if ( !fitFunc_ ) {
         throw std::runtime_error("Function pointer is zero in wxStfDoc::SetIsFitted");
     }
@@ -3289,37 +4012,60 @@ void wxStfDoc::SetIsFitted( std::size_t nchannel, std::size_t nsection,
         throw std::runtime_error("Number of best-fit parameters doesn't match number\n \
                                  of function parameters in wxStfDoc::SetIsFitted");
     }
-    sec_attr[nchannel][nsection].fitFunc = fitFunc_;
-    if ( sec_attr[nchannel][nsection].bestFitP.size() != bestFitP_.size() )
-        sec_attr[nchannel][nsection].bestFitP.resize(bestFitP_.size()); 
-    sec_attr[nchannel][nsection].bestFitP = bestFitP_;
-    sec_attr[nchannel][nsection].bestFit =
-        sec_attr[nchannel][nsection].fitFunc->output(sec_attr[nchannel][nsection].bestFitP,
-                                                     sec_attr[nchannel][nsection].fitFunc->pInfo, chisqr );
-    sec_attr[nchannel][nsection].storeFitBeg = fitBeg;
-    sec_attr[nchannel][nsection].storeFitEnd = fitEnd;
-    sec_attr[nchannel][nsection].isFitted = true;
+    stf::SectionAttributes& attr = SectionAttrW(nchannel, nsection);
+    attr.fitFunc = fitFunc_;
+    if ( attr.bestFitP.size() != bestFitP_.size() )
+        attr.bestFitP.resize(bestFitP_.size()); 
+    attr.bestFitP = bestFitP_;
+    attr.bestFit =
+        attr.fitFunc->output(attr.bestFitP, attr.fitFunc->pInfo, chisqr );
+    attr.storeFitBeg = fitBeg;
+    attr.storeFitEnd = fitEnd;
+    attr.isFitted = true;
+    if (fittedSections.size() <= nchannel) {
+        fittedSections.resize(nchannel+1);
+    }
+    fittedSections[nchannel].insert(nsection);
+}
+
+std::vector<std::size_t> wxStfDoc::GetFittedSections(std::size_t nchannel) const {
+    std::vector<std::size_t> fitted;
+    if (nchannel >= fittedSections.size() || nchannel >= size()) {
+        return fitted;
+    }
+    // the index may still contain sections that were removed since:
+    for (std::set<std::size_t>::const_iterator cit = fittedSections[nchannel].begin();
+         cit != fittedSections[nchannel].end(); ++cit)
+    {
+        if (*cit < at(nchannel).size() && SectionAttr(nchannel, *cit).isFitted) {
+            fitted.push_back(*cit);
+        }
+    }
+    return fitted;
 }
 
 void wxStfDoc::DeleteFit(std::size_t nchannel, std::size_t nsection) {
-    if (nchannel >= sec_attr.size() || nsection >= sec_attr[nchannel].size()) {
-        throw std::out_of_range("Index out of range in wxStfDoc::DeleteFit");
+    if (!SectionAttr(nchannel, nsection).isFitted) {
+        return;
+    }
+    stf::SectionAttributes& attr = SectionAttrW(nchannel, nsection);
+    attr.fitFunc = NULL;
+    attr.bestFitP.resize( 0 );
+    attr.bestFit = stfnum::Table( 0, 0 );
+    attr.isFitted = false;
+    if (nchannel < fittedSections.size()) {
+        fittedSections[nchannel].erase(nsection);
     }
-    sec_attr[nchannel][nsection].fitFunc = NULL;
-    sec_attr[nchannel][nsection].bestFitP.resize( 0 );
-    sec_attr[nchannel][nsection].bestFit = stfnum::Table( 0, 0 );
-    sec_attr[nchannel][nsection].isFitted = false;
 }
 
 
 void wxStfDoc::SetIsIntegrated(std::size_t nchannel, std::size_t nsection, bool value,
                                std::size_t begin, std::size_t end, const Vector_double& quad_p_)
 {
-    if (nchannel >= sec_attr.size() || nsection >= sec_attr[nchannel].size()) {
-        throw std::out_of_range("Index out of range in wxStfDoc::SetIsIntegrated");
-    }
     if (value==false) {
-        sec_attr[nchannel][nsection].isIntegrated=value;
+        if (SectionAttr(nchannel, nsection).isIntegrated) {
+            SectionAttrW(nchannel, nsection).isIntegrated=value;
+        }
         return;
     }
     if (end<=begin) {
@@ -3329,10 +4075,11 @@ void wxStfDoc::SetIsIntegrated(std::size_t nchannel, std::size_t nsection, bool
     if ((int)quad_p_.size() != n_intervals*3) {
         throw std::out_of_range("Wrong number of parameters for quadratic equations in Section::SetIsIntegrated");
     }
-    sec_attr[nchannel][nsection].quad_p = quad_p_;
-    sec_attr[nchannel][nsection].isIntegrated=value;
-    sec_attr[nchannel][nsection].storeIntBeg=begin;
-    sec_attr[nchannel][nsection].storeIntEnd=end;
+    stf::SectionAttributes& attr = SectionAttrW(nchannel, nsection);
+    attr.quad_p = quad_p_;
+    attr.isIntegrated=value;
+    attr.storeIntBeg=begin;
+    attr.storeIntEnd=end;
 }
 
 void wxStfDoc::ClearEvents(std::size_t nchannel, std::size_t nsection) {
@@ -3343,39 +4090,45 @@ void wxStfDoc::ClearEvents(std::size_t nchannel, std::size_t nsection) {
             pGraph->ClearEvents();
         }
     }
-    try {
-        sec_attr.at(nchannel).at(nsection).eventList.clear();
-    }
-    catch(const std::out_of_range& e) {
-        throw e;
+    if (!SectionAttr(nchannel, nsection).eventList.empty()) {
+        SectionAttrW(nchannel, nsection).eventList.clear();
     }
 }
 
-const stf::SectionAttributes& wxStfDoc::GetSectionAttributes(std::size_t nchannel, std::size_t nsection) const {
-    try {
-        return sec_attr.at(nchannel).at(nsection);
+const stf::SectionAttributes& wxStfDoc::SectionAttr(std::size_t nchannel, std::size_t nsection) const {
+    if (nchannel >= size() || nsection >= at(nchannel).size()) {
+        throw std::out_of_range("Index out of range in wxStfDoc::SectionAttr");
     }
-    catch(const std::out_of_range& e) {
-        throw e;
+    if (nchannel >= sec_attr.size()) {
+        return emptySecAttr;
     }
+    std::map<std::size_t, stf::SectionAttributes>::const_iterator cit = sec_attr[nchannel].find(nsection);
+    return (cit != sec_attr[nchannel].end()) ? cit->second : emptySecAttr;
 }
 
-const stf::SectionAttributes& wxStfDoc::GetCurrentSectionAttributes() const {
-    try {
-        return sec_attr.at(GetCurChIndex()).at(GetCurSecIndex());
+stf::SectionAttributes& wxStfDoc::SectionAttrW(std::size_t nchannel, std::size_t nsection) {
+    if (nchannel >= size() || nsection >= at(nchannel).size()) {
+        throw std::out_of_range("Index out of range in wxStfDoc::SectionAttrW");
     }
-    catch(const std::out_of_range& e) {
-        throw e;
+    if (nchannel >= sec_attr.size()) {
+        sec_attr.resize(size());
     }
+    // the caller may modify the attributes:
+    ++epoch;
+    // default-constructed on first use:
+    return sec_attr[nchannel][nsection];
+}
+
+const stf::SectionAttributes& wxStfDoc::GetSectionAttributes(std::size_t nchannel, std::size_t nsection) const {
+    return SectionAttr(nchannel, nsection);
+}
+
+const stf::SectionAttributes& wxStfDoc::GetCurrentSectionAttributes() const {
+    return SectionAttr(GetCurChIndex(), GetCurSecIndex());
 }
 
 stf::SectionAttributes& wxStfDoc::GetCurrentSectionAttributesW() {
-    try {
-        return sec_attr.at(GetCurChIndex()).at(GetCurSecIndex());
-    }
-    catch(const std::out_of_range& e) {
-        throw e;
-    }
+    return SectionAttrW(GetCurChIndex(), GetCurSecIndex());
 }
 
 #if 0
@@ -3416,7 +4169,7 @@ void wxStfDoc::Userdef(std::size_t id) {
     wxString newTitle(GetTitle());
     newTitle += wxT(", ");
     newTitle += wxGetApp().GetPluginLib().at(fselect).menuEntry;
-    wxStfDoc* pDoc = wxGetApp().NewChild(newR,this,newTitle);
+    wxStfDoc* pDoc = wxGetApp().NewChild(STFIO_MOVE(newR),this,newTitle);
     ((wxStfChildFrame*)pDoc->GetDocumentWindow())->ShowTable(
             stfnum::Table(resultsMap), wxGetApp().GetPluginLib().at(fselect).menuEntry
                                                              );
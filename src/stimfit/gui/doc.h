@@ -25,7 +25,15 @@
  *  @{
  */
 
+#include <map>
+#include <set>
+
 #include "./../stf.h"
+#include "./../../libstfnum/measure.h"
+#include "./../../libstfio/history.h"
+#include "./../../libstfio/snapshot.h"
+
+class wxStfSectionLoader;
 
 //! The document class, derived from both wxDocument and Recording.
 /*! The document class can be used to model an application’s file-based data.
@@ -41,8 +49,12 @@ private:
     Recording Average;
     int InitCursors();
     void PostInit();
+    // Checks the data that SetData() has stored and sets up the cursors:
+    void InitData(const wxStfDoc* Sender, const wxString& title);
     bool ChannelSelDlg();
     void WriteToReg();
+    // the cursor settings as used by Measure():
+    stfnum::MeasurementPlan GetMeasurementPlan() const;
     bool outOfRange(std::size_t check) {
         return (check >= cursec().size());
     }
@@ -58,11 +70,23 @@ private:
     void OnAnalysisDifferentiate( wxCommandEvent& event );
     //void OnSwapChannels( wxCommandEvent& event );
     void Multiply(wxCommandEvent& event);
+    void MultiplyInPlace(wxCommandEvent& event);
+    void OnUndoEdit(wxCommandEvent& event);
+    void OnRedoEdit(wxCommandEvent& event);
+    void OnUpdateUndoEdit(wxUpdateUIEvent& event);
+    void OnUpdateRedoEdit(wxUpdateUIEvent& event);
+    // Asks for the factor of Multiply() and MultiplyInPlace():
+    bool MultiplyDlg(double& factor);
     void SubtractBaseMenu( wxCommandEvent& event ) { SubtractBase( ); }
     void LFit(wxCommandEvent& event);
     void LnTransform(wxCommandEvent& event);
     void Filter(wxCommandEvent& event);
+    void Downsample(wxCommandEvent& event);
     void P_over_N(wxCommandEvent& event);
+    void PowerSpectrum(wxCommandEvent& event);
+    void Spectrogram(wxCommandEvent& event);
+    // Asks for the segments of PowerSpectrum() and Spectrogram():
+    bool SpectrumDlg(const std::string& title, std::size_t& segment, std::size_t& overlap);
     void Plotextraction(stf::extraction_mode mode);
     void Plotcriterion(wxCommandEvent& event);
     void Plotcorrelation(wxCommandEvent& event);
@@ -71,7 +95,7 @@ private:
     void Threshold(wxCommandEvent& event);
     void Viewtable(wxCommandEvent& event);
     void Fileinfo(wxCommandEvent& event);
-    Recording ReorderChannels();
+    std::vector<std::size_t> ReorderChannels();
 
     wxMenu* doc_file_menu;
 
@@ -117,7 +141,44 @@ private:
     XZoom xzoom;
     std::vector<YZoom> yzoom;
 
-    std::vector< std::vector<stf::SectionAttributes> > sec_attr;
+    // Attributes of the sections that have any, per channel; they are
+    // allocated when they are written for the first time:
+    std::vector< std::map<std::size_t, stf::SectionAttributes> > sec_attr;
+    // Attributes of all other sections:
+    stf::SectionAttributes emptySecAttr;
+    // Both throw std::out_of_range if there is no such section:
+    const stf::SectionAttributes& SectionAttr(std::size_t nchannel, std::size_t nsection) const;
+    stf::SectionAttributes& SectionAttrW(std::size_t nchannel, std::size_t nsection);
+    // Indices of the fitted sections of each channel, so that they can be
+    // listed without scanning all sections:
+    std::vector< std::set<std::size_t> > fittedSections;
+    // Fit caches read from a HDF5 file; moved into sec_attr by PostInit():
+    std::vector< std::vector<stfio::FitCache> > storedFitCaches;
+    // Writes the fit caches of all sections to a HDF5 file:
+    void SaveFitCaches(const std::string& fName, const std::vector<std::size_t>& channelOrder);
+
+    // Results of the last measurement, reused by Measure() while a cursor is dragged:
+    stfnum::MeasurementCache* measureCache;
+
+    // Sections next to the current one that have been prepared in the background:
+    std::map<std::size_t, PrefetchedSection> prefetched;
+    std::set<std::size_t> prefetchPending;
+    // Indices of the sections within prefetchCount of the current one:
+    std::vector<std::size_t> PrefetchWindow(std::size_t prefetchCount) const;
+
+    // Reads the remaining sections of a file in the background:
+    wxStfSectionLoader* loader;
+    wxTimer* loadTimer;
+    std::size_t loaded_end; // sections before this index have been read
+    bool StartProgressiveLoad(const std::string& fName, stfio::filetype type);
+    void MergeLoadedSections();
+    void StopLoading();
+    void OnLoadTimer(wxTimerEvent& event);
+
+    // Operations that have modified the traces in place, so that they can be undone:
+    stfio::EditHistory history;
+    // Counts the modifications of the data and of the section attributes:
+    std::size_t epoch;
     
 public:
 
@@ -177,6 +238,13 @@ public:
      */
     void SetData( const Recording& c_Data, const wxStfDoc* Sender, const wxString& title );
 
+#if (__cplusplus >= 201103)
+    //! Sets the content of a newly created file without copying the data.
+    /*! See SetData() above; \e c_Data is left without channels.
+     */
+    void SetData( Recording&& c_Data, const wxStfDoc* Sender, const wxString& title );
+#endif
+
     //! Indicates whether an average has been created.
     /*! \return true if an average has been created, false otherwise.
      */
@@ -224,6 +292,21 @@ public:
      */
     bool SetSection(std::size_t section);
 
+    //! Indicates whether sections are still being read in the background.
+    /*! \return true while the file is being read, false otherwise.
+     */
+    bool IsLoading() const { return loader != NULL; }
+
+    //! Waits until a section has been read from the file.
+    /*! Large files are shown as soon as their first section has been read,
+     *  while the remaining sections are read in the background.
+     *  \param section The 0-based index of the section.
+     */
+    void WaitForSections(std::size_t section);
+
+    //! Waits until all sections have been read from the file.
+    void WaitForSections();
+
     //! Creates a new window containing the selected sections of this file.
     /*! \return true upon success, false otherwise.
      */
@@ -274,6 +357,11 @@ public:
     /*! \param event The menu event that made the call.
      */
     void InteractiveEraseEvents(wxCommandEvent& event);
+
+    //! Erases the event that contains the current eventPos
+    /*! \param event The menu event that made the call.
+     */
+    void EraseEvent(wxCommandEvent& event);
     
     //! Adds an event at the current eventPos
     /*! \param event The menu event that made the call.
@@ -281,10 +369,74 @@ public:
     void AddEvent( wxCommandEvent& event );
 
     //! Subtracts the baseline of all selected traces.
-    /*! \return true upon success, false otherwise.
+    /*! The traces are modified in place if GetEditInPlace() is true;
+     *  otherwise, they are shown in a new window.
+     *  \return true upon success, false otherwise.
      */
     bool SubtractBase( );
 
+    //! Checks whether operations modify the selected traces in place.
+    /*! Subtracting baselines, multiplying, filtering and taking the
+     *  logarithm modify the traces in place rather than creating a new
+     *  window if the "EditInPlace" setting is set; these
+     *  modifications can be undone (see ReplaceSections()).
+     *  \return true if operations modify the traces in place.
+     */
+    bool GetEditInPlace() const;
+
+    //! Replaces sections of a channel, so that the replacement can be undone.
+    /*! The replaced sections are kept in the undo history without copying
+     *  their samples. Throws std::out_of_range if a section doesn't exist
+     *  or the number of replacements doesn't match.
+     *  \param channel Index of the channel.
+     *  \param sections Indices of the sections to be replaced.
+     *  \param replacements The new sections, in the order of \e sections.
+     *  \param label Describes the operation in the "Undo" menu item.
+     */
+    void ReplaceSections(std::size_t channel, const std::vector<std::size_t>& sections,
+                         const Channel& replacements, const std::string& label);
+
+    //! Marks the document as modified or unmodified.
+    /*! Marking the document as modified starts a new epoch (see GetEpoch()).
+     *  \param mod true if the document has been modified.
+     */
+    virtual void Modify(bool mod);
+
+    //! Retrieves the modification counter of the document.
+    /*! The counter is incremented whenever the data are marked as modified
+     *  (see Modify()) and whenever section attributes are written to, so
+     *  that background tasks can tell whether their results are still valid.
+     *  \return The current epoch.
+     */
+    std::size_t GetEpoch() const { return epoch; }
+
+    //! Takes a snapshot of the selected sections of the active channel.
+    /*! Background tasks read the snapshot instead of the document, so that
+     *  the user can keep working while they run.
+     *  \return The snapshot at the current epoch.
+     */
+    stfio::Snapshot GetSelectedSnapshot() const;
+
+    //! Checks whether results that were computed from a snapshot are still valid.
+    /*! Only the sections of the snapshot are compared; results that depend
+     *  on other sections or on section attributes should compare GetEpoch()
+     *  with stfio::Snapshot::GetEpoch() instead.
+     *  \param snapshot A snapshot of this document.
+     *  \return true if the sections of the snapshot haven't been modified
+     *          or replaced since the snapshot was taken.
+     */
+    bool IsCurrent(const stfio::Snapshot& snapshot) const;
+
+    //! Runs the analysis of a native plugin on the selected traces.
+    /*! The user enters the parameters of the analysis; the analysis then
+     *  runs in the background on a snapshot of the selected traces. New
+     *  traces are shown in a new window, or replace the selected ones if
+     *  traces are edited in place (see GetEditInPlace()); results are
+     *  shown in a table.
+     *  \param n Index of the analysis in wxStfApp::GetNativePlugins().
+     */
+    void RunNativePlugin(std::size_t n);
+
     //! Fit a function to the data.
     /*! \param event The menu event that made the call.
      */
@@ -301,6 +453,61 @@ public:
      *  and the latency.
      */
     void Measure();
+
+    //! A section that has been prepared in the background by Prefetch().
+    struct PrefetchedSection {
+        std::vector<Section> sections;      /*!< Prepared copies of the section of each channel. */
+        stfnum::MeasurementPlan plan;       /*!< The cursors that the section has been measured with. */
+        double dt;                          /*!< The sampling interval. */
+        std::size_t curCh;                  /*!< The measured channel. */
+        std::size_t secCh;                  /*!< The reference channel. */
+        bool measured;                      /*!< false if the measurement has failed. */
+        stfnum::MeasurementResults results; /*!< The results of the measurement. */
+    };
+
+    //! Prepares the sections next to the current one in the background.
+    /*! Copies of the next and previous sections are decoded, their min/max
+     *  pyramids are built and they are measured with the current cursors on
+     *  a worker thread, so that Measure() and drawing are instant when the
+     *  user moves on to one of them. The number of sections in either
+     *  direction is read from the "PrefetchSections" setting (default 2);
+     *  0 disables prefetching. Called after the current section has changed.
+     */
+    void Prefetch();
+
+    //! Takes over sections that have been prepared by Prefetch().
+    /*! Called on the GUI thread when the background work is done. Sections
+     *  that have been modified or that are no longer next to the current
+     *  one are ignored.
+     *  \param index The section index.
+     *  \param entry The prepared copies of the section and their measurement.
+     */
+    void AdoptPrefetched(std::size_t index, const PrefetchedSection& entry);
+
+    //! Describes the measurement that Measure() does.
+    /*! The job refers to the data of the document, so that it can be evaluated
+     *  on other threads as long as the document isn't modified.
+     *  \return The current section with the current cursor settings, or
+     *          a job without a section if there is nothing to measure.
+     */
+    stfnum::MeasurementJob GetMeasurementJob() const;
+
+    //! Stores the results of a measurement.
+    /*! This is the second half of Measure(), which updates the cursors that
+     *  depend on the results. Used to store measurements that have been
+     *  evaluated elsewhere, e.g. by stfnum::evaluateMany().
+     *  \param res The results of GetMeasurementJob().
+     */
+    void SetMeasurementResults(const stfnum::MeasurementResults& res);
+
+    //! Resets the main results after a measurement has failed.
+    void ClearMeasurement();
+
+    //! Discards the intermediate results that Measure() reuses.
+    /*! Has to be called when the data of a section are modified in place;
+     *  Measure() recognises other changes of the current section itself.
+     */
+    void InvalidateMeasurement();
     
     //! Put the current measurement results into a text table.
     stfnum::Table CurResultsTable();
@@ -1025,9 +1232,16 @@ public:
         \param fitEnd Sampling point index where the fit ends
      */
     void SetIsFitted( std::size_t nchannel, std::size_t nsection,
-                      const Vector_double& bestFitP_, stfnum::storedFunc* fitFunc_,
+                      const Vector_double& bestFitP_, const stfnum::storedFunc* fitFunc_,
                       double chisqr, std::size_t fitBeg, std::size_t fitEnd );
 
+    //! Retrieves the sections of a channel that have been fitted.
+    /*! Only the fitted sections are visited, rather than all sections of the channel.
+     *  \param nchannel The channel index.
+     *  \return The indices of the fitted sections in ascending order.
+     */
+    std::vector<std::size_t> GetFittedSections(std::size_t nchannel) const;
+
 
     //! Determines whether an integral has been calculated in this section.
     /*! \return true if an integral has been calculated, false otherwise.
@@ -1040,7 +1254,6 @@ public:
 
     void correctRangeR(int& value);
     void correctRangeR(std::size_t& value);
-    bool LoadTDMS(const std::string& filename, Recording& ReturnData);
     
     DECLARE_EVENT_TABLE()
 };
@@ -27,6 +27,11 @@
 #include <wx/metafile.h>
 #include <wx/printdlg.h>
 #include <wx/paper.h>
+#if (wxCHECK_VERSION(2, 9, 0))
+#include <wx/dcsvg.h>
+#endif
+
+#include <algorithm>
 
 #include "./app.h"
 #include "./doc.h"
@@ -39,6 +44,8 @@
 #include "./usrdlg/usrdlg.h"
 #include "./graph.h"
 #include "./../../libstfnum/measure.h"
+#include "./../../libstfnum/density.h"
+#include "./../../libstfio/profile.h"
 
 #ifdef _STFDEBUG
 #include <iostream>
@@ -49,42 +56,6 @@
 #elif !defined(isnan)
 #define isnan std::isnan
 #endif
-// #define BENCHMARK // uncomment to run benchmark
-
-#ifdef BENCHMARK //def _STFDEBUG
-#include <wx/utils.h>
-#include <iostream>
-#include <fstream>
-#include <ctime>
-#ifdef __MACH__
-#include <mach/clock.h>
-#include <mach/mach.h>
-#endif
-/* From https://gist.github.com/jbenet/1087739 */
-void current_utc_time(struct timespec *ts) {
-#ifdef __MACH__ // OS X does not have clock_gettime, use clock_get_time
-    clock_serv_t cclock;
-    mach_timespec_t mts;
-    host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
-    clock_get_time(cclock, &mts);
-    mach_port_deallocate(mach_task_self(), cclock);
-    ts->tv_sec = mts.tv_sec;
-    ts->tv_nsec = mts.tv_nsec;
-#else
-    clock_gettime(CLOCK_REALTIME, ts);
-#endif
-
-}
-static const double BILLION = 1000000000L;
-double tdiff(timespec time1, timespec time0) {
-    return ( time1.tv_sec - time0.tv_sec )
-        + ( time1.tv_nsec - time0.tv_nsec ) / BILLION;
-}
-
-double t2d(timespec time1) {
-    return time1.tv_sec + time1.tv_nsec / BILLION;
-}
-#endif
 
 BEGIN_EVENT_TABLE(wxStfGraph, wxWindow)
 EVT_MENU(ID_ZOOMHV,wxStfGraph::OnZoomHV)
@@ -92,6 +63,7 @@ EVT_MENU(ID_ZOOMH,wxStfGraph::OnZoomH)
 EVT_MENU(ID_ZOOMV,wxStfGraph::OnZoomV)
 EVT_MOUSE_EVENTS(wxStfGraph::OnMouseEvent)
 EVT_KEY_DOWN( wxStfGraph::OnKeyDown )
+EVT_CHECKBOX( wxID_ANY, wxStfGraph::OnEventCheckBox )
 #if defined __WXMAC__ && !(wxCHECK_VERSION(2, 9, 0))
 EVT_PAINT( wxStfGraph::OnPaint )
 #endif
@@ -166,6 +138,14 @@ wxStfGraph::wxStfGraph(wxView *v, wxStfChildFrame *frame, const wxPoint& pos, co
     zeroBrush(*wxLIGHT_GREY,wxFDIAGONAL_HATCH),
     lastLDown(0,0),
     yzoombg(),
+    layerBitmap(),
+    layerKey(),
+    layerValid(false),
+    useGraphicsContext(false),
+    densitySweeps(0),
+#if wxUSE_GRAPHICS_CONTEXT
+    tracePaths(),
+#endif
     m_zoomContext( new wxMenu ),
     m_eventContext( new wxMenu )
 {
@@ -174,6 +154,7 @@ wxStfGraph::wxStfGraph(wxView *v, wxStfChildFrame *frame, const wxPoint& pos, co
     m_zoomContext->Append( ID_ZOOMV, wxT("Expand zoom window vertically") );
 
     m_eventContext->Append( ID_EVENT_ADDEVENT, wxT("Add an event that starts here") );
+    m_eventContext->Append( ID_EVENT_ERASEONE, wxT("Erase the event at this position") );
     m_eventContext->Append( ID_EVENT_ERASE, wxT("Erase all events") );
     m_eventContext->Append( ID_EVENT_EXTRACT, wxT("Extract selected events") );
 
@@ -197,6 +178,7 @@ wxStfParentFrame* wxStfGraph::ParentFrame() {
 // Defines the repainting behaviour
 void wxStfGraph::OnDraw( wxDC& DC )
 {
+    STF_PROFILE_SCOPE("wxStfGraph::OnDraw");
 
     if ( !view || Doc()->get().empty() || !Doc()->IsInitialized() )
         return;
@@ -221,6 +203,12 @@ void wxStfGraph::OnDraw( wxDC& DC )
         firstPass = false;
         InitPlot();
     }
+
+    //Traces that don't depend on the cursors are copied from a cached bitmap,
+    //so that dragging a cursor only redraws what's on top of them
+    if (!isPrinted) {
+        DrawLayerCached(DC);
+    }
     
     //Creates scale bars and labelings for display or print out
     //Calculate scale bars and labelings
@@ -240,14 +228,10 @@ void wxStfGraph::OnDraw( wxDC& DC )
     //Plot fit curves (including current trace)
     DrawFit(&DC);
 
-    if (!Doc()->GetSelectedSections().empty() && pFrame->ShowSelected()) {
-        PlotSelected(DC);
-    }	//End plot all selected traces
-
-    //Plot average
-    if (Doc()->GetIsAverage()) {
-        PlotAverage(DC);
-    }	//End plot average
+    //Selected traces, average and reference channel for print out
+    if (isPrinted) {
+        DrawLayer(DC);
+    }
 
 
     // Plot integral boundaries
@@ -266,6 +250,49 @@ void wxStfGraph::OnDraw( wxDC& DC )
     }
     //End zoom
 
+    //Standard plot of the current trace
+    //Trace one when displayed first time
+    if (!isPrinted) {
+	//Draw current trace on display
+        //For display use point to point drawing
+        DC.SetPen(standardPen);
+        PlotTrace(&DC,Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetCurSecIndex()]);
+    } else {
+        //For print out use polyline tool
+        DC.SetPen(standardPrintPen);
+        PrintTrace(&DC,Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetCurSecIndex()]);
+    }	// End display or print out
+    //End plot of the current trace
+
+    //Ensure old scaling after print out
+    if(isPrinted) {
+        for (std::size_t n=0; n < Doc()->size(); ++n) {
+            Doc()->GetYZoomW(n) = Doc()->GetYZoomW(n) * (1.0/printScale);
+        }
+        Doc()->GetXZoomW() = Doc()->GetXZoomW() * (1.0/printScale);
+        WindowRect=printRect;
+    }	//End ensure old scaling after print out
+
+    //CreateScale() may have corrected the zoom that the layer was drawn with:
+    if (!isPrinted && layerValid && GetLayerKey() != layerKey) {
+        layerValid = false;
+        Refresh();
+    }
+
+    view->OnDraw(& DC);
+}
+
+void wxStfGraph::DrawLayer(wxDC& DC) {
+    STF_PROFILE_SCOPE("wxStfGraph::DrawLayer");
+    if (!Doc()->GetSelectedSections().empty() && pFrame->ShowSelected()) {
+        PlotSelected(DC);
+    }	//End plot all selected traces
+
+    //Plot average
+    if (Doc()->GetIsAverage()) {
+        PlotAverage(DC);
+    }	//End plot average
+
     //Plot of the second channel
     //Trace one when displayed first time
     if ((Doc()->size()>1) && pFrame->ShowSecond()) {
@@ -273,11 +300,11 @@ void wxStfGraph::OnDraw( wxDC& DC )
             //Draw current trace on display
             //For display use point to point drawing
             DC.SetPen(standardPen2);
-            PlotTrace(&DC,Doc()->get()[Doc()->GetSecChIndex()][Doc()->GetCurSecIndex()].get(), reference);
+            PlotTrace(&DC,Doc()->get()[Doc()->GetSecChIndex()][Doc()->GetCurSecIndex()], reference);
         } else {	//Draw second channel for print out
             //For print out use polyline tool
             DC.SetPen(standardPrintPen2);
-            PrintTrace(&DC,Doc()->get()[Doc()->GetSecChIndex()][Doc()->GetCurSecIndex()].get(), reference);
+            PrintTrace(&DC,Doc()->get()[Doc()->GetSecChIndex()][Doc()->GetCurSecIndex()], reference);
         }	// End display or print out
     }		//End plot of the second channel
 
@@ -287,37 +314,235 @@ void wxStfGraph::OnDraw( wxDC& DC )
                 //Draw current trace on display
                 //For display use point to point drawing
                 DC.SetPen(standardPen3);
-                PlotTrace(&DC,Doc()->get()[n][Doc()->GetCurSecIndex()].get(), background, n);
+                PlotTrace(&DC,Doc()->get()[n][Doc()->GetCurSecIndex()], background, n);
             }
         }
     }		//End plot of the second channel
-    
-    //Standard plot of the current trace
-    //Trace one when displayed first time
-    if (!isPrinted) {
-	//Draw current trace on display
-        //For display use point to point drawing
-        DC.SetPen(standardPen);
-        PlotTrace(&DC,Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetCurSecIndex()].get());
-    } else {
-        //For print out use polyline tool
-        DC.SetPen(standardPrintPen);
-        PrintTrace(&DC,Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetCurSecIndex()].get());
-    }	// End display or print out
-    //End plot of the current trace
+}
 
-    //Ensure old scaling after print out
-    if(isPrinted) {
+std::vector<double> wxStfGraph::GetLayerKey() {
+    // Everything that the drawing of DrawLayer() depends on, except for the data:
+    std::vector<double> key;
+    bool showSelected = !Doc()->GetSelectedSections().empty() && pFrame->ShowSelected();
+    bool showSecond = (Doc()->size()>1) && pFrame->ShowSecond();
+    bool showAll = (Doc()->size()>1) && pFrame->ShowAll();
+    if (!showSelected && !Doc()->GetIsAverage() && !showSecond && !showAll) {
+        // nothing to draw
+        return key;
+    }
+    wxSize size(GetClientSize());
+    key.push_back(size.GetWidth());
+    key.push_back(size.GetHeight());
+    key.push_back(showSelected);
+    key.push_back(Doc()->GetIsAverage());
+    key.push_back(showSecond);
+    key.push_back(showAll);
+    key.push_back(downsampling);
+    key.push_back(Doc()->GetCurChIndex());
+    key.push_back(Doc()->GetSecChIndex());
+    key.push_back(Doc()->GetCurSecIndex());
+    key.push_back(Doc()->GetXZoom().startPosX);
+    key.push_back(Doc()->GetXZoom().xZoom);
+    for (std::size_t n_c=0; n_c < Doc()->size(); ++n_c) {
+        key.push_back(Doc()->GetYZoom(n_c).startPosY);
+        key.push_back(Doc()->GetYZoom(n_c).yZoom);
+    }
+    if (showSelected) {
+        key.insert(key.end(), Doc()->GetSelectedSections().begin(), Doc()->GetSelectedSections().end());
+    }
+    if (Doc()->GetIsAverage() && Doc()->GetAverage().size() > 0 && Doc()->GetAverage()[0].size() > 0) {
+        key.push_back(Doc()->GetAverage()[0][0].size());
+    }
+    return key;
+}
+
+void wxStfGraph::DrawLayerCached(wxDC& DC) {
+    STF_PROFILE_SCOPE("wxStfGraph::DrawLayerCached");
+    std::vector<double> key(GetLayerKey());
+    if (key.empty()) {
+        return;
+    }
+    if (!layerValid || key != layerKey || !layerBitmap.IsOk()) {
+        wxSize size(GetClientSize());
+        if (size.GetWidth() <= 0 || size.GetHeight() <= 0) {
+            return;
+        }
+        if (!layerBitmap.IsOk() || layerBitmap.GetWidth() != size.GetWidth() ||
+            layerBitmap.GetHeight() != size.GetHeight())
+        {
+            layerBitmap = wxBitmap(size.GetWidth(), size.GetHeight());
+        }
+        wxMemoryDC layerDC;
+        layerDC.SelectObject(layerBitmap);
+        layerDC.SetBackground(wxBrush(GetBackgroundColour()));
+        layerDC.Clear();
+#if wxUSE_GRAPHICS_CONTEXT
+        if (useGraphicsContext) {
+            DrawLayerPaths(layerDC);
+        } else {
+            DrawLayer(layerDC);
+        }
+#else
+        DrawLayer(layerDC);
+#endif
+        layerDC.SelectObject(wxNullBitmap);
+        layerKey.swap(key);
+        layerValid = true;
+    }
+    DC.DrawBitmap(layerBitmap, 0, 0, false);
+}
+
+#if wxUSE_GRAPHICS_CONTEXT
+void wxStfGraph::DrawLayerPaths(wxMemoryDC& DC) {
+    // Same traces as DrawLayer(); the paths are created and stroked by the
+    // same renderer, which is hardware accelerated where one is available:
+    wxGraphicsRenderer* renderer = wxGraphicsRenderer::GetDefaultRenderer();
+#if defined(__WXMSW__) && wxUSE_GRAPHICS_DIRECT2D
+    if (wxGraphicsRenderer::GetDirect2DRenderer() != NULL) {
+        renderer = wxGraphicsRenderer::GetDirect2DRenderer();
+    }
+#endif
+    if (renderer == NULL) {
+        DrawLayer(DC);
+        return;
+    }
+    wxGraphicsContext* gc = renderer->CreateContext(DC);
+    if (gc == NULL) {
+        DrawLayer(DC);
+        return;
+    }
+    gc->SetAntialiasMode(wxANTIALIAS_NONE);
+    for (std::size_t n = 0; n < tracePaths.size(); ++n) {
+        tracePaths[n].used = false;
+    }
+
+    std::size_t curSec = Doc()->GetCurSecIndex();
+    if (!Doc()->GetSelectedSections().empty() && pFrame->ShowSelected() && UseDensity()) {
+        PlotDensity(DC);
+    } else if (!Doc()->GetSelectedSections().empty() && pFrame->ShowSelected()) {
+        for (std::size_t m=0; m < Doc()->GetSelectedSections().size(); ++m) {
+            StrokeTrace(*gc, *renderer, DC,
+                        Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetSelectedSections()[m]],
+                        selectPen);
+        }
+    }
+    if (Doc()->GetIsAverage()) {
+        StrokeTrace(*gc, *renderer, DC, Doc()->GetAverage()[0][0], averagePen);
+    }
+    if ((Doc()->size()>1) && pFrame->ShowSecond()) {
+        StrokeTrace(*gc, *renderer, DC, Doc()->get()[Doc()->GetSecChIndex()][curSec],
+                    standardPen2, reference);
+    }
+    if ((Doc()->size()>1) && pFrame->ShowAll()) {
         for (std::size_t n=0; n < Doc()->size(); ++n) {
-            Doc()->GetYZoomW(n) = Doc()->GetYZoomW(n) * (1.0/printScale);
+            StrokeTrace(*gc, *renderer, DC, Doc()->get()[n][curSec], standardPen3, background, n);
         }
-        Doc()->GetXZoomW() = Doc()->GetXZoomW() * (1.0/printScale);
-        WindowRect=printRect;
-    }	//End ensure old scaling after print out
+    }
+    delete gc;
 
-    view->OnDraw(& DC);
+    // only keep the paths of the traces that are shown:
+    std::size_t n_used = 0;
+    for (std::size_t n = 0; n < tracePaths.size(); ++n) {
+        if (tracePaths[n].used) {
+            if (n != n_used) {
+                tracePaths[n_used] = tracePaths[n];
+            }
+            ++n_used;
+        }
+    }
+    tracePaths.resize(n_used);
+}
+
+void wxStfGraph::StrokeTrace(wxGraphicsContext& gc, wxGraphicsRenderer& renderer, wxDC& DC,
+                             const Section& sec, const wxPen& pen, plottype pt, int bgno)
+{
+    // Paths longer than this are drawn through the device context; this only
+    // happens when large sections are zoomed in, where few points are visible:
+    static const std::size_t maxPathColumns = 1 << 18;
+
+    if (sec.size() == 0) {
+        return;
+    }
+    // Use the coarsest level of the min/max pyramid whose blocks are
+    // narrower than a pixel column:
+    std::size_t block = 1;
+    for (std::size_t level = 0; level < 12; ++level) {
+        std::size_t next = stfio::MinMaxPyramid::GetBlockSize(level);
+        if (next*XZ() > 1.0 || next >= sec.size()) {
+            break;
+        }
+        block = next;
+    }
+    if (sec.size()/block > maxPathColumns) {
+        DC.SetPen(pen);
+        PlotTrace(&DC, sec, pt, bgno);
+        return;
+    }
+
+    double startPosY = SPY(), yZoom = YZ();
+    switch (pt) {
+     case reference:
+         startPosY = SPY2();
+         yZoom = YZ2();
+         break;
+     case background:
+         FitBackground(sec, bgno);
+         startPosY = yzoombg.startPosY;
+         yZoom = yzoombg.yZoom;
+         break;
+     default:
+         break;
+    }
+
+    // The cached path is in sample coordinates; a copy is transformed to the
+    // window, which leaves the cached path untouched:
+    wxGraphicsPath path(GetTracePath(renderer, sec, block));
+    path.Transform(gc.CreateMatrix(XZ(), 0.0, 0.0, -yZoom, SPX(), startPosY));
+    gc.SetPen(pen);
+    gc.StrokePath(path);
 }
 
+const wxGraphicsPath& wxStfGraph::GetTracePath(wxGraphicsRenderer& renderer, const Section& sec,
+                                               std::size_t block)
+{
+    for (std::size_t n = 0; n < tracePaths.size(); ++n) {
+        TracePath& entry = tracePaths[n];
+        if (entry.sec == &sec && entry.size == sec.size() && entry.block == block) {
+            entry.used = true;
+            return entry.path;
+        }
+    }
+
+    TracePath entry;
+    entry.sec = &sec;
+    entry.size = sec.size();
+    entry.block = block;
+    entry.used = true;
+    entry.path = renderer.CreatePath();
+    entry.path.MoveToPoint(0, sec[0]);
+    if (block == 1) {
+        for (std::size_t n = 1; n < sec.size(); ++n) {
+            entry.path.AddLineToPoint(n, sec[n]);
+        }
+    } else {
+        // Like PlotColumns(), every block is entered at its first point,
+        // covers the range between its extrema and is left at its last point:
+        for (std::size_t n = 0; n < sec.size(); n += block) {
+            std::size_t n_end = std::min(n+block, sec.size());
+            double x = n + 0.5*(n_end-n-1);
+            double min, max;
+            sec.GetExtrema(n, n_end, min, max);
+            entry.path.AddLineToPoint(x, sec[n]);
+            entry.path.AddLineToPoint(x, min);
+            entry.path.AddLineToPoint(x, max);
+            entry.path.AddLineToPoint(x, sec[n_end-1]);
+        }
+    }
+    tracePaths.push_back(entry);
+    return tracePaths.back().path;
+}
+#endif
+
 void wxStfGraph::InitPlot() {
 
     if (wxGetApp().wxGetProfileInt(wxT("Settings"),wxT("ViewScaleBars"),1)) {
@@ -338,6 +563,12 @@ void wxStfGraph::InitPlot() {
         isSyncx=false;
     }
 
+    // Draw the cached traces through a graphics context that keeps their paths:
+    useGraphicsContext =
+        (wxGetApp().wxGetProfileInt(wxT("Settings"),wxT("GraphicsContext"),0) != 0);
+    // Number of selected traces from which on they are shown as a density map:
+    densitySweeps = wxGetApp().wxGetProfileInt(wxT("Settings"),wxT("DensitySweeps"),500);
+
     // Ensure proper dimensioning
     // Determine scaling factors and Units
     // Zoom and offset variables are currently not part of the settings dialog =>
@@ -368,15 +599,18 @@ void wxStfGraph::InitPlot() {
 }
 
 void wxStfGraph::PlotSelected(wxDC& DC) {
-    if (!isPrinted)
+    if (!isPrinted && UseDensity()) {
+        PlotDensity(DC);
+    }
+    else if (!isPrinted)
     {	//Draw traces on display
         DC.SetPen(selectPen);
         for (unsigned m=0; m < Doc()->GetSelectedSections().size(); ++m)
         {
-            //For display use point to point drawing
+            //Each trace is drawn as a single polyline that is decimated to the window width
             PlotTrace(
                       &DC,
-                      Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetSelectedSections()[m]].get()
+                      Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetSelectedSections()[m]]
                       );
         }
     }  //End draw traces on display
@@ -385,24 +619,79 @@ void wxStfGraph::PlotSelected(wxDC& DC) {
         DC.SetPen(selectPrintPen);
         for (unsigned m=0; m < Doc()->GetSelectedSections().size() && Doc()->GetSelectedSections().size()>0; ++m)
         {
-            PrintTrace(&DC,Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetSelectedSections()[m]].get());
+            PrintTrace(&DC,Doc()->get()[Doc()->GetCurChIndex()][Doc()->GetSelectedSections()[m]]);
         }	//End draw for print out
     }	//End if display or print out
 }
 
+bool wxStfGraph::UseDensity() {
+    return densitySweeps > 0 && Doc()->GetSelectedSections().size() >= (std::size_t)densitySweeps;
+}
+
+void wxStfGraph::PlotDensity(wxDC& DC) {
+    wxSize size(GetClientSize());
+    if (size.GetWidth() <= 0 || size.GetHeight() <= 0 || XZ() <= 0) {
+        return;
+    }
+    const Channel& ch = Doc()->get()[Doc()->GetCurChIndex()];
+    std::vector<const Section*> sections;
+    sections.reserve(Doc()->GetSelectedSections().size());
+    for (std::size_t m=0; m < Doc()->GetSelectedSections().size(); ++m) {
+        sections.push_back(&ch[Doc()->GetSelectedSections()[m]]);
+    }
+    stfnum::DensityMap density(size.GetWidth(), size.GetHeight());
+    try {
+        density.Add(sections, SPX(), XZ(), SPY(), YZ());
+    }
+    catch (const std::exception& e) {
+        wxGetApp().ExceptMsg( wxString( e.what(), wxConvLocal ) );
+        return;
+    }
+    unsigned max = density.GetMax();
+    if (max == 0) {
+        return;
+    }
+
+    // Pixels darken with the logarithm of the number of traces that pass
+    // through them, so that rare excursions remain visible next to the
+    // bulk of the traces; pixels without traces are transparent:
+    wxImage image(size.GetWidth(), size.GetHeight());
+    image.SetAlpha();
+    unsigned char* rgb = image.GetData();
+    unsigned char* alpha = image.GetAlpha();
+    wxColour bg(GetBackgroundColour());
+    double scale = 1.0/log(1.0+max);
+    for (int r = 0; r < size.GetHeight(); ++r) {
+        for (int c = 0; c < size.GetWidth(); ++c) {
+            std::size_t pixel = (std::size_t)r*size.GetWidth() + c;
+            unsigned count = density.Count(c, r);
+            if (count == 0) {
+                alpha[pixel] = 0;
+                continue;
+            }
+            double shade = 0.8*(1.0 - log(1.0+count)*scale);
+            alpha[pixel] = 255;
+            rgb[3*pixel] = (unsigned char)(bg.Red()*shade);
+            rgb[3*pixel+1] = (unsigned char)(bg.Green()*shade);
+            rgb[3*pixel+2] = (unsigned char)(bg.Blue()*shade);
+        }
+    }
+    DC.DrawBitmap(wxBitmap(image), 0, 0, true);
+}
+
 void wxStfGraph::PlotAverage(wxDC& DC) {
     //Average is calculated but not plotted
     if (!isPrinted)
     {	//Draw Average on display
         //For display use point to point drawing
         DC.SetPen(averagePen);
-        PlotTrace(&DC,Doc()->GetAverage()[0][0].get());
+        PlotTrace(&DC,Doc()->GetAverage()[0][0]);
     }	//End draw Average on display
     else
     {	//Draw average for print out
         //For print out use polyline tool
         DC.SetPen(averagePrintPen);
-        PrintTrace(&DC,Doc()->GetAverage()[0][0].get());
+        PrintTrace(&DC,Doc()->GetAverage()[0][0]);
     }	//End draw average for print out
 }
 
@@ -420,7 +709,20 @@ void wxStfGraph::DrawZoomRect(wxDC& DC) {
     DC.DrawPolygon(4,ZoomPoints);
 }
 
+namespace {
+
+bool eventStartsBefore(const stf::Event& event, double index) {
+    return (double)event.GetEventStartIndex() < index;
+}
+
+bool markerBefore(const stf::PyMarker& marker, double x) {
+    return marker.x < x;
+}
+
+}
+
 void wxStfGraph::PlotGimmicks(wxDC& DC) {
+    STF_PROFILE_SCOPE("wxStfGraph::PlotGimmicks");
 
     // crosshair through measurement cursor:
     int crosshairSize=20;
@@ -499,13 +801,21 @@ void wxStfGraph::PlotGimmicks(wxDC& DC) {
     DrawCircle(&DC,Doc()->GetMaxDecayT(),Doc()->GetMaxDecayY(), rdPen, rdPrintPen);
     
     try {
-        stf::SectionAttributes sec_attr = Doc()->GetCurrentSectionAttributes();
+        const stf::SectionAttributes& sec_attr = Doc()->GetCurrentSectionAttributes();
         if (!sec_attr.eventList.empty()) {
             PlotEvents(DC);
         }
         if (!sec_attr.pyMarkers.empty()) {
+            // Markers are sorted by x; only the visible ones are drawn:
+            wxRect WindowRect=GetRect();
+            if (isPrinted) WindowRect=wxRect(printRect);
+            double firstX = (0.0 - SPX()) / XZ() - 1.0;
+            double lastX = ((double)WindowRect.width - SPX()) / XZ() + 1.0;
+            c_marker_it first = std::lower_bound(sec_attr.pyMarkers.begin(), sec_attr.pyMarkers.end(),
+                                                 firstX, markerBefore);
+            c_marker_it last = std::lower_bound(first, sec_attr.pyMarkers.end(), lastX, markerBefore);
             DC.SetPen(eventPen);
-            for (c_marker_it it = sec_attr.pyMarkers.begin(); it != sec_attr.pyMarkers.end(); ++it) {
+            for (c_marker_it it = first; it != last; ++it) {
                 // Create circles indicating the peak of an event:
                 DC.DrawRectangle( xFormat(it->x), yFormat(it->y), boebbel*2.0, boebbel*2.0 );
             }
@@ -521,15 +831,32 @@ void wxStfGraph::PlotGimmicks(wxDC& DC) {
 void wxStfGraph::PlotEvents(wxDC& DC) {
     const int MAX_EVENTS_PLOT = 200;
 
-    stf::SectionAttributes sec_attr;
+    const stf::SectionAttributes* sec_attr = NULL;
     try {
-        sec_attr = Doc()->GetCurrentSectionAttributes();
+        sec_attr = &Doc()->GetCurrentSectionAttributes();
     }
     catch (const std::out_of_range& e) {
         return;
     }
+    const std::vector<stf::Event>& eventList = sec_attr->eventList;
+    if (eventList.empty()) {
+        HideEventCheckBoxes(0);
+        return;
+    }
+
+    // Events are sorted by their start; only the ones that can be seen
+    // within the window are drawn, so that long event lists stay fast:
+    wxRect WindowRect=GetRect();
+    if (isPrinted) WindowRect=wxRect(printRect);
+    int right=WindowRect.width;
+    double firstIndex = (0.0 - SPX()) / XZ() - (double)eventList[0].GetEventSize();
+    double lastIndex = ((double)right - SPX()) / XZ() + 1.0;
+    c_event_it first = std::lower_bound(eventList.begin(), eventList.end(), firstIndex, eventStartsBefore);
+    c_event_it last = std::lower_bound(first, eventList.end(), lastIndex, eventStartsBefore);
+
     DC.SetPen(eventPen);
-    for (c_event_it it = sec_attr.eventList.begin(); it != sec_attr.eventList.end(); ++it) {
+    int nevents_plot = 0;
+    for (c_event_it it = first; it != last; ++it) {
         // Create small arrows indicating the start of an event:
         eventArrow(&DC, (int)it->GetEventStartIndex());
         // Create circles indicating the peak of an event:
@@ -540,51 +867,63 @@ void wxStfGraph::PlotEvents(wxDC& DC) {
             wxGetApp().ExceptMsg( wxString( e.what(), wxConvLocal ) );
             return;
         }
+        nevents_plot += (xFormat(it->GetEventStartIndex()) < right &&
+                         xFormat(it->GetEventStartIndex()) > 0);
     }
 
-    // Only draw check boxes if there are less than 1000 events (takes too long
-    // to draw them and it's impossible to check them anyway)
-    wxRect WindowRect=GetRect();
-    if (isPrinted) WindowRect=wxRect(printRect);
-    int right=WindowRect.width;
-    int nevents_plot = 0;
-    for (event_it it2 = sec_attr.eventList.begin(); it2 != sec_attr.eventList.end(); ++it2) {
-        nevents_plot += (xFormat(it2->GetEventStartIndex()) < right &&
-                         xFormat(it2->GetEventStartIndex()) > 0);
-    }
-
+    // Only draw check boxes if there are less than MAX_EVENTS_PLOT visible events
+    // (it's impossible to check them anyway)
+    std::size_t n_boxes = 0;
     if (nevents_plot < MAX_EVENTS_PLOT) {
-        for (event_it it2 = sec_attr.eventList.begin(); it2 != sec_attr.eventList.end(); ++it2) {
-            if (xFormat(it2->GetEventStartIndex()) < right &&
-                xFormat(it2->GetEventStartIndex()) > 0)
+        for (c_event_it it = first; it != last; ++it) {
+            if (xFormat(it->GetEventStartIndex()) < right &&
+                xFormat(it->GetEventStartIndex()) > 0)
             {
-                it2->GetCheckBox()->Move(wxPoint(xFormat(it2->GetEventStartIndex()), 0));
-                it2->GetCheckBox()->Show(true);
-            } else {
-                it2->GetCheckBox()->Show(false);
+                if (n_boxes == eventCheckBoxes.size()) {
+                    eventCheckBoxes.push_back(new wxCheckBox(this, -1, wxEmptyString));
+                    checkBoxEvents.push_back(0);
+                }
+                wxCheckBox* checkBox = eventCheckBoxes[n_boxes];
+                checkBox->Move(wxPoint(xFormat(it->GetEventStartIndex()), 0));
+                checkBox->SetValue(!it->GetDiscard());
+                checkBox->Show(true);
+                checkBoxEvents[n_boxes] = it - eventList.begin();
+                ++n_boxes;
             }
         }
-    } else {
-        for (event_it it2 = sec_attr.eventList.begin(); it2 != sec_attr.eventList.end(); ++it2) {
-            it2->GetCheckBox()->Show(false);
-        }
     }
+    HideEventCheckBoxes(n_boxes);
 
     // return focus to frame:
     SetFocus();
 }
 
-void wxStfGraph::ClearEvents() {
-    stf::SectionAttributes sec_attr;
-    try {
-        sec_attr = Doc()->GetCurrentSectionAttributes();
-    }
-    catch (const std::out_of_range& e) {
-        return;
+void wxStfGraph::HideEventCheckBoxes(std::size_t first) {
+    for (std::size_t n = first; n < eventCheckBoxes.size(); ++n) {
+        eventCheckBoxes[n]->Show(false);
     }
-    for (event_it it2 = sec_attr.eventList.begin(); it2 != sec_attr.eventList.end(); ++it2) {
-        it2->GetCheckBox()->Destroy();
+}
+
+void wxStfGraph::OnEventCheckBox(wxCommandEvent& event) {
+    for (std::size_t n = 0; n < eventCheckBoxes.size(); ++n) {
+        if (event.GetEventObject() == eventCheckBoxes[n]) {
+            try {
+                std::vector<stf::Event>& eventList = Doc()->GetCurrentSectionAttributesW().eventList;
+                if (checkBoxEvents[n] < eventList.size()) {
+                    eventList[checkBoxEvents[n]].SetDiscard(!event.IsChecked());
+                }
+            }
+            catch (const std::out_of_range& e) {
+                /* Do nothing for now */
+            }
+            return;
+        }
     }
+    event.Skip();
+}
+
+void wxStfGraph::ClearEvents() {
+    HideEventCheckBoxes(0);
 }
 
 void wxStfGraph::DrawCrosshair( wxDC& DC, const wxPen& pen, const wxPen& printPen, int crosshairSize, double xch, double ych) {
@@ -661,7 +1000,8 @@ double wxStfGraph::get_plot_y2max() const {
     return SPY2()/YZ2();
 }
 
-void wxStfGraph::PlotTrace( wxDC* pDC, const Vector_double& trace, plottype pt, int bgno ) {
+void wxStfGraph::PlotTrace( wxDC* pDC, const Section& sec, plottype pt, int bgno ) {
+    STF_PROFILE_SCOPE("wxStfGraph::PlotTrace");
     // speed up drawing by omitting points that are outside the window:
 
     // find point before left window border:
@@ -670,27 +1010,28 @@ void wxStfGraph::PlotTrace( wxDC* pDC, const Vector_double& trace, plottype pt,
     // toFormat=-zoom.startPosX/zoom.xZoom
     std::size_t start=0;
     int x0i=int(-SPX()/XZ());
-    if (x0i>=0 && x0i<(int)trace.size()-1) start=x0i;
+    if (x0i>=0 && x0i<(int)sec.size()-1) start=x0i;
     // find point after right window border:
     // for xFormat==right:
     // toFormat=(right-zoom.startPosX)/zoom.xZoom
-    std::size_t end=trace.size();
+    std::size_t end=sec.size();
     wxRect WindowRect=GetRect();
     if (isPrinted) WindowRect=wxRect(printRect);
     int right=WindowRect.width;
     int xri = int((right-SPX())/XZ())+1;
-    if (xri>=0 && xri<(int)trace.size()-1) end=xri;
+    if (xri>=0 && xri<(int)sec.size()-1) end=xri;
 
     // apply filter at half the new sampling frequency:
-    DoPlot(pDC, trace, start, end, 1, pt, bgno);
+    DoPlot(pDC, sec, start, end, 1, pt, bgno);
 }
 
-void wxStfGraph::DoPlot( wxDC* pDC, const Vector_double& trace, int start, int end, int step, plottype pt, int bgno) {
-#if (__cplusplus < 201103)
-    boost::function<int(double)> yFormatFunc;
-#else
-    std::function<int(double)> yFormatFunc;
-#endif
+void wxStfGraph::DoPlot( wxDC* pDC, const Section& sec, int start, int end, int step, plottype pt, int bgno) {
+    // Samples are read through the const operator[] and the min/max pyramid,
+    // so that mapped or concatenated sections aren't decoded as a whole:
+    if (sec.size() == 0) {
+        return;
+    }
+    YFormatFunc yFormatFunc;
 
     switch (pt) {
      case active:
@@ -700,84 +1041,86 @@ void wxStfGraph::DoPlot( wxDC* pDC, const Vector_double& trace, int start, int e
          yFormatFunc = std::bind1st( std::mem_fun(&wxStfGraph::yFormatD2), this);
          break;
      case background:
-         Vector_double::const_iterator max_el = std::max_element(trace.begin(), trace.end());
-         Vector_double::const_iterator min_el = std::min_element(trace.begin(), trace.end());
-         double min = *min_el;
-         if (min>1.0e12)  min= 1.0e12;
-         if (min<-1.0e12) min=-1.0e12;
-         double max = *max_el;
-         if (max>1.0e12)  max= 1.0e12;
-         if (max<-1.0e12) max=-1.0e12;
-         wxRect WindowRect=GetRect();
-         WindowRect.height /= Doc()->size();
-         FittorectY(yzoombg, WindowRect, min, max, 1.0);
-         yzoombg.startPosY += bgno*WindowRect.height;
+         FitBackground(sec, bgno);
          yFormatFunc = std::bind1st( std::mem_fun(&wxStfGraph::yFormatDB), this);
          break;
     }
 
-    int x_last = xFormat(start);
-    int y_last = yFormatFunc( trace[start] );
-    int x_next = 0;
-    int y_next = 0;
-#ifdef BENCHMARK //def _STFDEBUG
-    struct timespec time0, time1;
-    current_utc_time(&time0);
-#else
+    // The trace is emitted as a single polyline, which is much faster
+    // than drawing each segment separately. The point buffer is a member
+    // so that its memory is reused across repaints:
+    plotPoints.clear();
     wxRect WindowRect(GetRect());
     if (end-start < 2*WindowRect.width+2) {
-#endif    
-    for (int n=start; n<end-1; ++n) {
-        x_next = xFormat(n+1);
-        y_next = yFormatFunc( trace[n+1] );
-        pDC->DrawLine( x_last, y_last, x_next, y_next );
-        x_last = x_next;
-        y_last = y_next;
-    }
-#ifdef BENCHMARK //def _STFDEBUG
-    current_utc_time(&time1);
-    double accum = tdiff(time1, time0)*1e3;
-    std::string fn_platform = "plt_bench_" + stf::wx2std(wxGetOsDescription()) + ".txt";
-    std::ofstream plt_bench;
-    plt_bench.open(fn_platform.c_str(), std::ios::out | std::ios::app);
-    plt_bench << end-start << "\t" << accum << "\t";
-    current_utc_time(&time0);
-    x_last = xFormat(start);
-#else
+        plotPoints.reserve(end-start);
+        for (int n=start; n<end; ++n) {
+            plotPoints.push_back( wxPoint(xFormat(n), yFormatFunc( sec[n] )) );
+        }
     } else {
-#endif
-    double y_max = trace[start];
-    double y_min = trace[start];
-    for (int n=start; n<end-1; ++n) {
-        x_next = xFormat(n+1);
-        // if we are still in the same pixel column, find extrema:
-        if (x_next == x_last) {
-            if (trace[n+1] < y_min) {
-                y_min = trace[n+1];
-            }
-            if (trace[n+1] > y_max) {
-                y_max = trace[n+1];
-            }
-        } else {
-            // plot line between extrema of previous column:
-            pDC->DrawLine( x_last, yFormatFunc(y_min), x_last, yFormatFunc(y_max) );
+        PlotColumns(sec, start, end, yFormatFunc);
+    }
+    DrawPolyline(pDC);
+}
 
-            // plot line between last point of previous and first point of this column:
-            pDC->DrawLine( x_last, yFormatFunc(trace[n]), x_next, yFormatFunc(trace[n+1]) );
+void wxStfGraph::FitBackground(const Section& sec, int bgno) {
+    double min, max;
+    sec.GetExtrema(0, sec.size(), min, max);
+    if (min>1.0e12)  min= 1.0e12;
+    if (min<-1.0e12) min=-1.0e12;
+    if (max>1.0e12)  max= 1.0e12;
+    if (max<-1.0e12) max=-1.0e12;
+    wxRect WindowRect=GetRect();
+    WindowRect.height /= Doc()->size();
+    FittorectY(yzoombg, WindowRect, min, max, 1.0);
+    yzoombg.startPosY += bgno*WindowRect.height;
+}
 
-            y_min = trace[n+1];
-            y_max = trace[n+1];
-            x_last = x_next;
+void wxStfGraph::PlotColumns(const Section& sec, int start, int end, const YFormatFunc& yFormatFunc) {
+    // Draw one vertical line per pixel column. The extrema of each column
+    // are taken from the section's min/max pyramid, so that the cost is
+    // proportional to the window width rather than to the number of points:
+    int x_last = xFormat(start);
+    int n = start;
+    while (n < end) {
+        // find the first point of the next column; xFormat() is monotonic:
+        int n_next = (XZ() > 0) ? (int)ceil((x_last+1-SPX())/XZ()) : n+1;
+        if (n_next <= n) n_next = n+1;
+        if (n_next > end) n_next = end;
+        while (n_next > n+1 && xFormat(n_next-1) != x_last) --n_next;
+        while (n_next < end && xFormat(n_next) == x_last) ++n_next;
+
+        double y_min, y_max;
+        sec.GetExtrema(n, n_next, y_min, y_max);
+        // Enter the column at its first point, cover the range between its
+        // extrema and leave it at its last point, from where the polyline
+        // continues to the first point of the next column:
+        plotPoints.push_back( wxPoint(x_last, yFormatFunc(sec[n])) );
+        plotPoints.push_back( wxPoint(x_last, yFormatFunc(y_min)) );
+        plotPoints.push_back( wxPoint(x_last, yFormatFunc(y_max)) );
+        plotPoints.push_back( wxPoint(x_last, yFormatFunc(sec[n_next-1])) );
+
+        if (n_next < end) {
+            x_last = xFormat(n_next);
         }
+        n = n_next;
     }
-#ifdef BENCHMARK //def _STFDEBUG
-    current_utc_time(&time1);
-    accum = tdiff(time1, time0)*1e3;
-    plt_bench << accum << std::endl;
-    plt_bench.close();
-#else
+}
+
+void wxStfGraph::DrawPolyline(wxDC* pDC) {
+    if (plotPoints.size() == 1) {
+        pDC->DrawPoint(plotPoints[0]);
+        return;
+    }
+    // Vector outputs store each polyline as a single record; metafiles count
+    // its points in 16 bits, and PostScript interpreters limit the length
+    // of a path. Printed polylines are therefore drawn in batches that
+    // share their end points:
+    static const std::size_t printBatch = 4096;
+    std::size_t batch = isPrinted ? printBatch : plotPoints.size();
+    for (std::size_t n = 0; n+1 < plotPoints.size(); n += batch-1) {
+        std::size_t count = std::min(batch, plotPoints.size()-n);
+        pDC->DrawLines((int)count, &plotPoints[n]);
     }
-#endif
 }
 
 void wxStfGraph::PrintScale(wxRect& WindowRect) {
@@ -800,7 +1143,7 @@ void wxStfGraph::PrintScale(wxRect& WindowRect) {
     if ( printSizePen4 < 1 ) boebbelPrint=4;
 }
 
-void wxStfGraph::PrintTrace( wxDC* pDC, const Vector_double& trace, plottype ptype ) {
+void wxStfGraph::PrintTrace( wxDC* pDC, const Section& sec, plottype ptype ) {
     // speed up drawing by omitting points that are outside the window:
 
     // find point before left window border:
@@ -809,27 +1152,26 @@ void wxStfGraph::PrintTrace( wxDC* pDC, const Vector_double& trace, plottype pty
     // toFormat=-zoom.startPosX/zoom.xZoom
     std::size_t start=0;
     int x0i=int(-SPX()/XZ());
-    if (x0i>=0 && x0i<(int)trace.size()-1) start=x0i;
+    if (x0i>=0 && x0i<(int)sec.size()-1) start=x0i;
     // find point after right window border:
     // for xFormat==right:
     // toFormat=(right-zoom.startPosX)/zoom.xZoom
-    std::size_t end=trace.size();
+    std::size_t end=sec.size();
     wxRect WindowRect=GetRect();
     if (isPrinted)
         WindowRect=wxRect(printRect);
     int right=WindowRect.width;
     int xri=int((right-SPX())/XZ())+1;
-    if (xri>=0 && xri<(int)trace.size()-1) end=xri;
-    DoPrint(pDC, trace, start, end, ptype);
+    if (xri>=0 && xri<(int)sec.size()-1) end=xri;
+    DoPrint(pDC, sec, start, end, ptype);
 }
 
-void wxStfGraph::DoPrint( wxDC* pDC, const Vector_double& trace, int start, int end, plottype ptype) {
-#if (__cplusplus < 201103)
-    boost::function<int(double)> yFormatFunc;
-#else
-    std::function<int(double)> yFormatFunc;
-#endif
-    
+void wxStfGraph::DoPrint( wxDC* pDC, const Section& sec, int start, int end, plottype ptype) {
+    if (sec.size() == 0 || end <= start) {
+        return;
+    }
+    YFormatFunc yFormatFunc;
+
     switch (ptype) {
      case active:
          yFormatFunc = std::bind1st( std::mem_fun(&wxStfGraph::yFormatD), this);
@@ -839,40 +1181,22 @@ void wxStfGraph::DoPrint( wxDC* pDC, const Vector_double& trace, int start, int
          break;
     }
 
-    std::vector<wxPoint> points;
-    int x_last = xFormat(start);
-    int y_last = yFormatFunc( trace[start] );
-    int y_max = y_last;
-    int y_min = y_last;
-    int x_next = 0;
-    int y_next = 0;
-    points.push_back( wxPoint(x_last,y_last) );
-    for (int n=start; n<end-downsampling; n+=downsampling) {
-        x_next = xFormat(n+downsampling);
-        y_next = yFormatFunc( trace[n+downsampling] );
-        // if we are still at the same pixel column, only draw if this is an extremum:
-        if (x_next == x_last) {
-            if (y_next < y_min) {
-                y_min = y_next;
-            }
-            if (y_next > y_max) {
-                y_max = y_next;
-            }
-        } else {
-            // else, always draw and reset extrema:
-            if (y_min != y_next) {
-                points.push_back( wxPoint(x_last, y_min) );
-            }
-            if (y_max != y_next) {
-                points.push_back( wxPoint(x_last, y_max) );
-            }
-            points.push_back( wxPoint(x_next, y_next) );
-            y_min = y_next;
-            y_max = y_next;
-            x_last = x_next;
+    plotPoints.clear();
+    // Every n-th point is printed as long as there are fewer of them than
+    // twice the device width. Beyond that, the trace is reduced to the
+    // extrema of each device pixel column as on screen, so that the size
+    // of printouts and metafiles depends on the page rather than on the
+    // number of samples:
+    int n_points = (end-start-1)/downsampling + 1;
+    if (n_points < 2*printRect.width+2) {
+        plotPoints.reserve(n_points);
+        for (int n=start; n<end; n+=downsampling) {
+            plotPoints.push_back( wxPoint(xFormat(n), yFormatFunc( sec[n] )) );
         }
+    } else {
+        PlotColumns(sec, start, end, yFormatFunc);
     }
-    pDC->DrawLines((int)points.size(),&points[0]);
+    DrawPolyline(pDC);
 }
 
 void wxStfGraph::DrawCircle(wxDC* pDC, double x, double y, const wxPen& pen, const wxPen& printPen) {
@@ -931,6 +1255,7 @@ void wxStfGraph::eventArrow(wxDC* pDC, int eventIndex) {
 }
 
 void wxStfGraph::DrawFit(wxDC* pDC) {
+    STF_PROFILE_SCOPE("wxStfGraph::DrawFit");
 
     try {
         // go through selected traces:
@@ -942,9 +1267,9 @@ void wxStfGraph::DrawFit(wxDC* pDC) {
             std::size_t sel_index = Doc()->GetSelectedSections()[ n_sel ];
             // Check whether this section contains a fit:
             try {
-                stf::SectionAttributes sec_attr = Doc()->GetSectionAttributes(Doc()->GetCurChIndex(), sel_index);
+                const stf::SectionAttributes& sec_attr = Doc()->GetSectionAttributes(Doc()->GetCurChIndex(), sel_index);
                 if ( sec_attr.isFitted && pFrame->ShowSelected() ) {
-                    PlotFit( pDC, stf::SectionPointer( &((*Doc())[Doc()->GetCurChIndex()][sel_index]), sec_attr ) );
+                    PlotFit( pDC, stf::SectionPointer( &((*Doc())[Doc()->GetCurChIndex()][sel_index]), &sec_attr ) );
                 }
             } catch (const std::out_of_range& e) {
                 /* Do nothing */
@@ -956,10 +1281,10 @@ void wxStfGraph::DrawFit(wxDC* pDC) {
             pDC->SetPen(fitPrintPen);
         else
             pDC->SetPen(fitPen);
-        stf::SectionAttributes sec_attr = Doc()->GetCurrentSectionAttributes();
+        const stf::SectionAttributes& sec_attr = Doc()->GetCurrentSectionAttributes();
         if (sec_attr.isFitted) {
             PlotFit( pDC, stf::SectionPointer( &((*Doc())[Doc()->GetCurChIndex()][Doc()->GetCurSecIndex()]),
-                                               sec_attr) );
+                                               &sec_attr) );
         }
     }
     catch (const std::out_of_range& e) {
@@ -975,9 +1300,9 @@ void wxStfGraph::PlotFit( wxDC* pDC, const stf::SectionPointer& Sec ) {
         WindowRect=printRect;
     }
 
-    int firstPixel = xFormat( Sec.sec_attr.storeFitBeg );
+    int firstPixel = xFormat( Sec.pSecAttr->storeFitBeg );
     if ( firstPixel < 0 ) firstPixel = 0;
-    int lastPixel = xFormat( Sec.sec_attr.storeFitEnd );
+    int lastPixel = xFormat( Sec.pSecAttr->storeFitEnd );
     if ( lastPixel > WindowRect.width + 1 ) lastPixel = WindowRect.width + 1;
 
     if (!isPrinted) {
@@ -985,32 +1310,32 @@ void wxStfGraph::PlotFit( wxDC* pDC, const stf::SectionPointer& Sec ) {
         //For display use point to point drawing
         double fit_time_1 =
             ( ((double)firstPixel - (double)SPX()) / XZ() -
-                    (double)Sec.sec_attr.storeFitBeg )* Doc()->GetXScale();
+                    (double)Sec.pSecAttr->storeFitBeg )* Doc()->GetXScale();
         for ( int n_px = firstPixel; n_px < lastPixel-1; n_px++ ) {
             // Calculate pixel back to time (GetStoreFitBeg() is t=0)
             double fit_time_2 =
                 ( ((double)n_px+1.0 - (double)SPX()) / XZ() -
-                        (double)Sec.sec_attr.storeFitBeg )
+                        (double)Sec.pSecAttr->storeFitBeg )
                         * Doc()->GetXScale(); // undo xFormat = (int)(toFormat * XZ() + SPX());
             pDC->DrawLine( n_px,
-                    yFormat(Sec.sec_attr.fitFunc->func( fit_time_1, Sec.sec_attr.bestFitP)),
-                            n_px + 1, yFormat(Sec.sec_attr.fitFunc->func(fit_time_2, Sec.sec_attr.bestFitP))
+                    yFormat(Sec.pSecAttr->fitFunc->func( fit_time_1, Sec.pSecAttr->bestFitP)),
+                            n_px + 1, yFormat(Sec.pSecAttr->fitFunc->func(fit_time_2, Sec.pSecAttr->bestFitP))
             );
             fit_time_1 = fit_time_2;
         }
     } else {    //Draw Fit for print out
         // For print out use polyline
-        std::vector<wxPoint> f_print( lastPixel - firstPixel );
+        plotPoints.resize( lastPixel > firstPixel ? lastPixel - firstPixel : 0 );
         for ( int n_px = firstPixel; n_px < lastPixel; n_px++ ) {
             // Calculate pixel back to time (GetStoreFitBeg() is t=0)
             double fit_time =
-                ( ((double)n_px - (double)SPX()) / XZ() -(double)Sec.sec_attr.storeFitBeg )
+                ( ((double)n_px - (double)SPX()) / XZ() -(double)Sec.pSecAttr->storeFitBeg )
                         * Doc()->GetXScale(); // undo xFormat = (int)(toFormat * XZ() + SPX());
-            f_print[n_px-firstPixel].x = n_px;
-            f_print[n_px-firstPixel].y = yFormat( Sec.sec_attr.fitFunc->func(
-                            fit_time, Sec.sec_attr.bestFitP) );
+            plotPoints[n_px-firstPixel].x = n_px;
+            plotPoints[n_px-firstPixel].y = yFormat( Sec.pSecAttr->fitFunc->func(
+                            fit_time, Sec.pSecAttr->bestFitP) );
         }
-        pDC->DrawLines( f_print.size(), &f_print[0] );
+        DrawPolyline(pDC);
     }   //End if display or print out
 }
 
@@ -1133,6 +1458,39 @@ void wxStfGraph::Snapshotwmf() {
     }
 }
 
+void wxStfGraph::Snapshotsvg() {
+#if (wxCHECK_VERSION(2, 9, 0))
+    wxFileDialog SelectFileDialog( this, wxT("Export SVG file"), wxT(""), wxT(""),
+            wxT("SVG file (*.svg)|*.svg"), wxFD_SAVE | wxFD_OVERWRITE_PROMPT );
+    if (SelectFileDialog.ShowModal()!=wxID_OK) return;
+
+    // Get size of Graph, in pixels:
+    wxRect screenRect(GetRect());
+
+    // Export at the same resolution as metafiles:
+    printRect = wxRect(wxPoint(0,0), wxSize(GetRect().GetSize()*4));
+
+    double scale=(double)printRect.width/(double)screenRect.width;
+
+    // wxSVGFileDC writes every drawing operation to the file right away
+    // rather than keeping the figure in memory:
+    wxSVGFileDC svgDC(SelectFileDialog.GetPath(), printRect.width, printRect.height);
+    if (!svgDC.IsOk()) {
+        wxGetApp().ErrorMsg(wxT("Error while creating SVG file"));
+        return;
+    }
+    set_downsampling(1);
+    set_noGimmicks(true);
+    set_isPrinted(true);
+    printScale=scale;
+    OnDraw(svgDC);
+    set_isPrinted(false);
+    no_gimmicks=false;
+#else
+    wxGetApp().ErrorMsg(wxT("SVG export requires wxWidgets 2.9 or later"));
+#endif
+}
+
 void wxStfGraph::OnMouseEvent(wxMouseEvent& event) {
     // event.Skip();
     
@@ -1573,6 +1931,7 @@ double prettyNumber( double fDistance, double pixelDistance, int limit ) {
 
 void wxStfGraph::CreateScale(wxDC* pDC)
 {
+    STF_PROFILE_SCOPE("wxStfGraph::CreateScale");
     // catch bizarre y-Zooms:
     double fstartPosY=(double)SPY();
     if (fabs(fstartPosY)>(double)1.0e15)
@@ -2013,17 +2372,11 @@ void wxStfGraph::Fittowindow(bool refresh)
         wxGetApp().ErrorMsg(wxT("Array of size zero in wxGraph::Fittowindow()"));
         return;
     }
-#if (__cplusplus < 201103)
-    Vector_double::const_iterator max_el = std::max_element(Doc()->cursec().get().begin(), Doc()->cursec().get().end());
-    Vector_double::const_iterator min_el = std::min_element(Doc()->cursec().get().begin(), Doc()->cursec().get().end());
-#else
-    Vector_double::const_iterator max_el = std::max(Doc()->cursec().get().begin(), Doc()->cursec().get().end());
-    Vector_double::const_iterator min_el = std::min(Doc()->cursec().get().begin(), Doc()->cursec().get().end());
-#endif
-    double min = *min_el;
+    // uses the min/max pyramid of the section that is also used for drawing:
+    double min, max;
+    Doc()->cursec().GetExtrema(0, points, min, max);
     if (min>1.0e12)  min= 1.0e12;
     if (min<-1.0e12) min=-1.0e12;
-    double max = *max_el;
     if (max>1.0e12)  max= 1.0e12;
     if (max<-1.0e12) max=-1.0e12;
     wxRect WindowRect(GetRect());
@@ -2072,37 +2425,56 @@ void wxStfGraph::FitToWindowSecCh(bool refresh)
         std::size_t secCh=Doc()->GetSecChIndex();
     #undef min
     #undef max
-#if (__cplusplus < 201103)
-        Vector_double::const_iterator max_el = std::max_element(Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().begin(),
-                                                                Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().end());
-        Vector_double::const_iterator min_el = std::min_element(Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().begin(),
-                                                                Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().end());
-#else
-        Vector_double::const_iterator max_el = std::max(Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().begin(),
-                                                               Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().end());
-        Vector_double::const_iterator min_el = std::min(Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().begin(),
-                                                                Doc()->get()[secCh][Doc()->GetCurSecIndex()].get().end());
-#endif
-
-        double min=*min_el;
-        double max=*max_el;
+        const Section& sec = Doc()->get()[secCh][Doc()->GetCurSecIndex()];
+        if (sec.size()==0) {
+            return;
+        }
+        double min, max;
+        sec.GetExtrema(0, sec.size(), min, max);
         FittorectY(Doc()->GetYZoomW(Doc()->GetSecChIndex()), WindowRect, min, max, screen_part);
         if (refresh) Refresh();
     }
 }	//End FitToWindowSecCh()
 
-void wxStfGraph::ChangeTrace(int trace) {
-    stf::SectionAttributes sec_attr = Doc()->GetCurrentSectionAttributes();
-    if (!sec_attr.eventList.empty() && trace != Doc()->GetCurSecIndex()) {
-        for (event_it it2 = sec_attr.eventList.begin(); it2 != sec_attr.eventList.end(); ++it2) {
-            it2->GetCheckBox()->Show(false);
+void wxStfGraph::InvalidateLayers() {
+    layerValid = false;
+#if wxUSE_GRAPHICS_CONTEXT
+    tracePaths.clear();
+#endif
+}
+
+std::vector<double> wxStfGraph::DrawOffscreen(int frames, bool cached) {
+    wxSize size(GetClientSize());
+    wxBitmap bitmap(std::max(size.GetWidth(), 1), std::max(size.GetHeight(), 1));
+    wxMemoryDC DC;
+    DC.SelectObject(bitmap);
+    DC.SetBackground(wxBrush(GetBackgroundColour()));
+    std::vector<double> times;
+    times.reserve(frames);
+    for (int n = 0; n < frames; ++n) {
+        if (!cached) {
+            InvalidateLayers();
         }
+        DC.Clear();
+        double start = stfio::profileClock();
+        OnDraw(DC);
+        times.push_back(stfio::profileClock() - start);
+    }
+    DC.SelectObject(wxNullBitmap);
+    return times;
+}
+
+void wxStfGraph::ChangeTrace(int trace) {
+    if (trace != Doc()->GetCurSecIndex()) {
+        ClearEvents();
     }
 
     Doc()->SetSection(trace);
     wxGetApp().OnPeakcalcexecMsg();
     pFrame->SetCurTrace(trace);
     Refresh();
+    // so that the next keypress finds its section decoded and measured:
+    Doc()->Prefetch();
 }
 
 void wxStfGraph::OnPrevious() {
@@ -2327,13 +2699,21 @@ void wxStfGraph::ChangeYScale(double factor) {
     Refresh();
 }
 
+double wxStfGraph::Ch2baseline() {
+    const Section& sec2 = Doc()->get()[Doc()->GetSecChIndex()][Doc()->GetCurSecIndex()];
+    double var2=0.0;
+    if (Doc()->GetBaselineMethod()==stfnum::mean_sd) {
+        // constant time from the prefix sums of the section:
+        return sec2.GetMean(Doc()->GetBaseBeg(), Doc()->GetBaseEnd()+1, var2);
+    }
+    return stfnum::base(Doc()->GetBaselineMethod(),var2,sec2.get(),Doc()->GetBaseBeg(),Doc()->GetBaseEnd());
+}
+
 void wxStfGraph::Ch2base() {
     if ((Doc()->size()>1)) {
         double base2=0.0;
         try {
-            double var2=0.0;
-            base2=stfnum::base(Doc()->GetBaselineMethod(),var2,Doc()->get()[Doc()->GetSecChIndex()][Doc()->GetCurSecIndex()].get(),
-                    Doc()->GetBaseBeg(),Doc()->GetBaseEnd());
+            base2=Ch2baseline();
         }
         catch (const std::out_of_range& e) {
             wxGetApp().ExceptMsg(wxString( e.what(), wxConvLocal ) );
@@ -2372,9 +2752,7 @@ void wxStfGraph::Ch2basezoom() {
         // Adjust baseline:
         double base2=0.0;
         try {
-            double var2=0.0;
-            base2=stfnum::base(Doc()->GetBaselineMethod(),var2,Doc()->get()[Doc()->GetSecChIndex()][Doc()->GetCurSecIndex()].get(),
-                    Doc()->GetBaseBeg(),Doc()->GetBaseEnd());
+            base2=Ch2baseline();
         }
         catch (const std::out_of_range& e) {
             wxGetApp().ExceptMsg( wxString( e.what(), wxConvLocal ) );
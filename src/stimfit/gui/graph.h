@@ -32,6 +32,8 @@ class wxStfParentFrame;
 class wxStfCheckBox;
 class wxEnhMetaFile;
 
+#include <wx/graphics.h>
+
 #include "./zoom.h"
 
 enum plottype {
@@ -68,6 +70,14 @@ public:
      */
     void Snapshotwmf();
 
+    //! Exports the drawing to a scalable vector graphics (SVG) file.
+    /*! The file is written while the graph is drawn, and traces are
+     *  reduced to the extrema of each pixel column at export resolution,
+     *  so that long recordings give compact files. PDF files can be
+     *  created by printing to a file.
+     */
+    void Snapshotsvg();
+
     //! Handles mouse events.
     /*! The different possibilities (e.g. left or right click) split up
      *  within this function.
@@ -83,6 +93,26 @@ public:
      */
     void OnKeyDown(wxKeyEvent& event);
     
+    //! Redraws the cached background traces on the next repaint.
+    /*! The selected traces, the average and the reference channel are drawn
+     *  into a cached bitmap. Changes of the zoom, the window size, the current
+     *  trace or the selection are detected automatically; this has to be called
+     *  if the data of these traces have been modified.
+     */
+    void InvalidateLayers();
+
+    //! Draws the graph repeatedly into an off-screen bitmap.
+    /*! The bitmap has the size of the window, so that the same pixels are
+     *  drawn as on screen. Used to time the rendering (see
+     *  wxStfApp::RunRenderBenchmark()).
+     *  \param frames Number of frames to be drawn.
+     *  \param cached true to copy the traces behind the current trace from
+     *         the cached layer, as while a cursor is dragged; false to draw
+     *         everything in every frame, as after the zoom has changed.
+     *  \return The time that every frame took in s.
+     */
+    std::vector<double> DrawOffscreen(int frames, bool cached);
+
     //! Change trace
     /*! Takes care of refreshing everything when a new trace is shown
      *  \param trace Index of next trace to be displayed 
@@ -210,7 +240,7 @@ public:
      */
     void Fittowindow(bool refresh);
 
-    //! Destroys all event check boxes
+    //! Hides all event check boxes
     void ClearEvents();
 
     //! Set to true if the graph is drawn on a printer.
@@ -300,6 +330,15 @@ public:
     bool firstPass;
     bool isSyncx;
 
+    // point buffer for the polylines of DoPlot(), DoPrint() and PlotFit(); reused across repaints:
+    std::vector<wxPoint> plotPoints;
+
+    // check boxes of the visible events; they are reused for whichever events
+    // are visible, so that long event lists don't create native widgets:
+    std::vector<wxCheckBox*> eventCheckBoxes;
+    // index within the current event list of the event shown by each check box:
+    std::vector<std::size_t> checkBoxEvents;
+
     //Zoom struct
 //    Zoom zoom;
 
@@ -350,7 +389,35 @@ public:
     wxPoint lastLDown;
 
     YZoom yzoombg;
+
+    // Cached drawing of the traces of DrawLayer(), which don't change while
+    // cursors are dragged, and the settings it was drawn with:
+    wxBitmap layerBitmap;
+    std::vector<double> layerKey;
+    bool layerValid;
+
+    // Draw the cached traces through a graphics context (see DrawLayerPaths()):
+    bool useGraphicsContext;
+    // Number of selected traces from which on they are shown as a density map; 0 disables it:
+    int densitySweeps;
+#if wxUSE_GRAPHICS_CONTEXT
+    // Decimated paths of the cached traces in sample coordinates, so that
+    // zooming and panning only change the transform they are stroked with:
+    struct TracePath {
+        const Section* sec;
+        std::size_t size, block;
+        bool used;
+        wxGraphicsPath path;
+    };
+    std::vector<TracePath> tracePaths;
+#endif
     
+#if (__cplusplus < 201103)
+    typedef boost::function<int(double)> YFormatFunc;
+#else
+    typedef std::function<int(double)> YFormatFunc;
+#endif
+
 #if (__cplusplus < 201103)
     boost::shared_ptr<wxMenu> m_zoomContext;
     boost::shared_ptr<wxMenu> m_eventContext;
@@ -362,15 +429,31 @@ public:
     void InitPlot();
     void PlotSelected(wxDC& DC);
     void PlotAverage(wxDC& DC);
+    bool UseDensity();
+    void PlotDensity(wxDC& DC);
+    void DrawLayer(wxDC& DC);
+    void DrawLayerCached(wxDC& DC);
+    std::vector<double> GetLayerKey();
+#if wxUSE_GRAPHICS_CONTEXT
+    void DrawLayerPaths(wxMemoryDC& DC);
+    void StrokeTrace( wxGraphicsContext& gc, wxGraphicsRenderer& renderer, wxDC& DC,
+                      const Section& sec, const wxPen& pen, plottype pt=active, int bgno=0 );
+    const wxGraphicsPath& GetTracePath( wxGraphicsRenderer& renderer, const Section& sec, std::size_t block );
+#endif
+    void FitBackground( const Section& sec, int bgno );
     void DrawZoomRect(wxDC& DC);
     void PlotGimmicks(wxDC& DC);
     void PlotEvents(wxDC& DC);
+    void HideEventCheckBoxes(std::size_t first);
+    void OnEventCheckBox(wxCommandEvent& event);
     void DrawCrosshair( wxDC& DC, const wxPen& pen, const wxPen& printPen, int crosshairSize, double xch, double ych);
-    void PlotTrace( wxDC* pDC, const Vector_double& trace, plottype pt=active, int bgno=0 );
-    void DoPlot( wxDC* pDC, const Vector_double& trace, int start, int end, int step, plottype pt=active, int bgno=0 );
+    void PlotTrace( wxDC* pDC, const Section& sec, plottype pt=active, int bgno=0 );
+    void DoPlot( wxDC* pDC, const Section& sec, int start, int end, int step, plottype pt=active, int bgno=0 );
+    void PlotColumns( const Section& sec, int start, int end, const YFormatFunc& yFormatFunc );
+    void DrawPolyline( wxDC* pDC );
     void PrintScale(wxRect& WindowRect);
-    void PrintTrace( wxDC* pDC, const Vector_double& trace, plottype ptype=active);
-    void DoPrint( wxDC* pDC, const Vector_double& trace, int start, int end, plottype ptype=active);
+    void PrintTrace( wxDC* pDC, const Section& sec, plottype ptype=active);
+    void DoPrint( wxDC* pDC, const Section& sec, int start, int end, plottype ptype=active);
     void DrawCircle(wxDC* pDC, double x, double y, const wxPen& pen, const wxPen& printPen);
     void DrawVLine(wxDC* pDC, double x, const wxPen& pen, const wxPen& printPen);
     void DrawHLine(wxDC* pDC, double y, const wxPen& pen, const wxPen& printPen);
@@ -379,6 +462,8 @@ public:
     void PlotFit( wxDC* pDC, const stf::SectionPointer& Sec );
     void DrawIntegral(wxDC* pDC);
     void CreateScale(wxDC* pDC);
+    // Baseline of the second channel with the cursors of the active channel:
+    double Ch2baseline();
 
     // Function receives the x-coordinate of a point and returns 
     // its formatted value according to the current Zoom settings
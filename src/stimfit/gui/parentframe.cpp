@@ -27,6 +27,7 @@
 #include <wx/file.h>
 #include <wx/filename.h>
 #include <wx/progdlg.h>
+#include <wx/thread.h>
 #include <wx/splitter.h>
 #include <wx/choicdlg.h>
 #include <wx/aboutdlg.h>
@@ -66,6 +67,8 @@
     #include "./../../libstfio/biosig/biosiglib.h"
 #endif
 #include "./../../libstfio/igor/igorlib.h"
+#include "./../../libstfio/memory.h"
+#include "./../../libstfio/parallel.h"
 
 #include "./childframe.h"
 #include "./parentframe.h"
@@ -113,7 +116,11 @@ IMPLEMENT_CLASS(wxStfParentFrame, wxStfParentType)
 BEGIN_EVENT_TABLE(wxStfParentFrame, wxStfParentType)
 EVT_MENU(wxID_HELP, wxStfParentFrame::OnHelp)
 EVT_MENU(ID_UPDATE, wxStfParentFrame::OnCheckUpdate)
+#ifdef WITH_PROFILING
+EVT_MENU(ID_PERFORMANCE, wxStfParentFrame::OnPerformance)
+#endif
 EVT_MENU(wxID_ABOUT, wxStfParentFrame::OnAbout)
+EVT_TIMER(ID_MEMTIMER, wxStfParentFrame::OnMemoryTimer)
 
 EVT_TOOL(ID_TOOL_SELECT,wxStfParentFrame::OnToggleSelect)
 EVT_TOOL(ID_TOOL_FIRST, wxStfParentFrame::OnToolFirst)
@@ -131,6 +138,7 @@ EVT_TOOL(ID_TOOL_LEFT, wxStfParentFrame::OnToolLeft)
 EVT_TOOL(ID_TOOL_RIGHT, wxStfParentFrame::OnToolRight)
 
 EVT_TOOL(ID_TOOL_SNAPSHOT_WMF, wxStfParentFrame::OnToolSnapshotwmf)
+EVT_TOOL(ID_TOOL_SNAPSHOT_SVG, wxStfParentFrame::OnToolSnapshotsvg)
 
 EVT_TOOL(ID_TOOL_CH1, wxStfParentFrame::OnToolCh1)
 EVT_TOOL(ID_TOOL_CH2, wxStfParentFrame::OnToolCh2)
@@ -185,7 +193,8 @@ END_EVENT_TABLE()
 
 wxStfParentFrame::wxStfParentFrame(wxDocManager *manager, wxFrame *frame, const wxString& title,
                  const wxPoint& pos, const wxSize& size, long type):
-wxStfParentType(manager, frame, wxID_ANY, title, pos, size, type, _T("myFrame")), mpl_figno(0)
+wxStfParentType(manager, frame, wxID_ANY, title, pos, size, type, _T("myFrame")), mpl_figno(0),
+    memTimer(this, ID_MEMTIMER)
 {
     // ::wxInitAllImageHandlers();
 
@@ -297,6 +306,37 @@ wxStfParentType(manager, frame, wxID_ANY, title, pos, size, type, _T("myFrame"))
                  << wxT("    return win\n")
 #endif
     ;
+    // The shell is created by CreatePythonShell() once wxStfApp has
+    // started the interpreter after the frame has been shown.
+#endif // WITH_PYTHON
+    m_mgr.Update();
+
+    wxStatusBar* pStatusBar = new wxStatusBar(this, wxID_ANY, wxST_SIZEGRIP);
+    SetStatusBar(pStatusBar);
+    // the second field shows the memory use (see OnMemoryTimer()):
+    int widths[] = { -1, 240 };
+    pStatusBar->SetFieldsCount(WXSIZEOF(widths), widths);
+    memTimer.Start(2000);
+}
+
+wxStfParentFrame::~wxStfParentFrame() {
+    // deinitialize the frame manager
+#ifdef WITH_PYTHON
+    // write visibility of the shell to config:
+    // (unless Python has never been started)
+    if (m_mgr.GetPane(wxT("pythonShell")).IsOk()) {
+        bool shell_state = m_mgr.GetPane(wxT("pythonShell")).IsShown();
+        wxGetApp().wxWriteProfileInt( wxT("Settings"),wxT("ViewShell"), int(shell_state) );
+    }
+#endif
+    m_mgr.UnInit();
+}
+
+#ifdef WITH_PYTHON
+bool wxStfParentFrame::CreatePythonShell() {
+    if (m_mgr.GetPane(wxT("pythonShell")).IsOk()) {
+        return true;
+    }
     /*  The window remains open after the main application has been closed; deactivated for the time being.
      *  RedirectStdio();
      */
@@ -310,6 +350,7 @@ wxStfParentType(manager, frame, wxID_ANY, title, pos, size, type, _T("myFrame"))
                                      ).cppWindow;
     if ( pPython == 0 ) {
         wxGetApp().ErrorMsg(wxT("Can't create a window for the python shell\nPointer is zero"));
+        return false;
     }
 
 #ifdef _STFDEBUG
@@ -319,26 +360,9 @@ wxStfParentType(manager, frame, wxID_ANY, title, pos, size, type, _T("myFrame"))
     std::cout << "python startup script:\n" << std::string( python_code2.char_str() );
 #endif // _WINDOWS
 #endif // _STFDEBUG
-#else // WITH_PYTHON
-    m_mgr.Update();
-#endif // WITH_PYTHON
-
-    wxStatusBar* pStatusBar = new wxStatusBar(this, wxID_ANY, wxST_SIZEGRIP);
-    SetStatusBar(pStatusBar);
-    //int widths[] = { 60, 60, -1 };
-    //pStatusBar->SetFieldWidths(WXSIZEOF(widths), widths);
-    //pStatusBar->SetStatusText(wxT("Test"), 0);
-}
-
-wxStfParentFrame::~wxStfParentFrame() {
-    // deinitialize the frame manager
-#ifdef WITH_PYTHON
-    // write visibility of the shell to config:
-    bool shell_state = m_mgr.GetPane(wxT("pythonShell")).IsShown();
-    wxGetApp().wxWriteProfileInt( wxT("Settings"),wxT("ViewShell"), int(shell_state) );
-#endif
-    m_mgr.UnInit();
+    return true;
 }
+#endif // WITH_PYTHON
 
 wxStfToolBar* wxStfParentFrame::CreateStdTb() {
     wxStfToolBar* tb1=new wxStfToolBar( this, wxID_ANY, wxDefaultPosition, wxDefaultSize,
@@ -500,6 +524,12 @@ wxStfToolBar* wxStfParentFrame::CreateCursorTb() {
                             wxT("Copy vectorized image to clipboard"),
                             wxITEM_NORMAL );
 
+    cursorToolBar->AddTool( ID_TOOL_SNAPSHOT_SVG,
+                            wxT("SVG Snapshot"),
+                            wxBitmap(camera_ps),
+                            wxT("Export vectorized image to an SVG file"),
+                            wxITEM_NORMAL );
+
     cursorToolBar->AddSeparator();
     cursorToolBar->AddTool( ID_TOOL_MEASURE,
                             _T("Measure"),
@@ -594,6 +624,30 @@ void wxStfParentFrame::OnHelp(wxCommandEvent& WXUNUSED(event) )
     wxLaunchDefaultBrowser( wxT("http://www.stimfit.org/doc/sphinx/index.html") );
 }
 
+#ifdef WITH_PROFILING
+void wxStfParentFrame::OnPerformance(wxCommandEvent& WXUNUSED(event) )
+{
+    wxStfPerformanceDlg PerformanceDialog(this);
+    PerformanceDialog.ShowModal();
+}
+#endif
+
+void wxStfParentFrame::OnMemoryTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (GetStatusBar() == NULL) {
+        return;
+    }
+    std::size_t usage = stfio::getMemoryUsage();
+    if (usage == 0) {
+        return;
+    }
+    wxString text = wxString::Format(wxT("Memory: %lu MB"), (unsigned long)(usage/(1024*1024)));
+    std::size_t budget = stfio::getMemoryBudget();
+    if (budget > 0) {
+        text << wxString::Format(wxT(" of %lu MB budget"), (unsigned long)(budget/(1024*1024)));
+    }
+    SetStatusText(text, 1);
+}
+
 std::vector<int> ParseVersionString( const wxString& VersionString ) {
     std::vector<int> VersionInt(5);
     
@@ -732,117 +786,224 @@ void wxStfParentFrame::OnCheckUpdate(wxCommandEvent& WXUNUSED(event) )
     CheckUpdate( &progDlg );
 }
 
+namespace {
+
+// State that is shared between the GUI thread and the conversion workers.
+// All members below the critical section have to be accessed with the
+// section locked.
+struct ConvertJob {
+    ConvertJob(stfio::filetype ift_, stfio::filetype eft_, const stfio::txtImportSettings& txtImport_)
+        : ift(ift_), eft(eft_), txtImport(txtImport_), next(0), done(0), active(0), cancel(false)
+    {}
+    stfio::filetype ift, eft;
+    stfio::txtImportSettings txtImport;
+    std::vector<std::string> srcNames, destNames;
+
+    wxCriticalSection cs;
+    std::size_t next;   // index of the next file to be converted
+    std::size_t done;   // number of files that have been processed
+    int active;         // number of workers that are still running
+    bool cancel;        // set by the GUI thread to stop handing out files
+    std::string current;
+    std::vector<std::string> errors;
+};
+
+// Worker that converts files of a ConvertJob until none are left.
+// Using several workers is safe because libstfio serializes the file
+// format libraries that aren't reentrant.
+class ConvertThread : public wxThread {
+public:
+    ConvertThread(ConvertJob& job_) : wxThread(wxTHREAD_JOINABLE), job(job_) {}
+
+protected:
+    virtual ExitCode Entry() {
+        for (;;) {
+            std::size_t nFile;
+            {
+                wxCriticalSectionLocker locker(job.cs);
+                if (job.cancel || job.next >= job.srcNames.size()) {
+                    break;
+                }
+                nFile = job.next++;
+                job.current = job.srcNames[nFile];
+            }
+            std::string error;
+            try {
+                Recording sourceFile;
+                stfio::StdoutProgressInfo progDlg("", "", 100, false);
+                if (!stfio::importFile(job.srcNames[nFile], job.ift, sourceFile, job.txtImport, progDlg)) {
+                    throw std::runtime_error("Couldn't read file");
+                }
+                stfio::exportFile(job.destNames[nFile], job.eft, sourceFile, progDlg);
+            }
+            catch (const std::exception& e) {
+                error = e.what();
+                if (error.empty()) {
+                    error = "Unknown error";
+                }
+            }
+            wxCriticalSectionLocker locker(job.cs);
+            ++job.done;
+            if (!error.empty()) {
+                job.errors.push_back(job.srcNames[nFile] + ": " + error);
+            }
+        }
+        wxCriticalSectionLocker locker(job.cs);
+        --job.active;
+        return 0;
+    }
+
+private:
+    ConvertJob& job;
+};
+
+}
+
 void wxStfParentFrame::OnConvert(wxCommandEvent& WXUNUSED(event) ) {
 
-    int nfiles; // files to convert
     wxString src_ext; // extension of the source file
     wxString dest_ext; // extesion of the destiny file
 
     // "Convert files" Dialog (see wxStfConvertDlg in smalldlgs.cpp)
     wxStfConvertDlg myDlg(this);
-    if(myDlg.ShowModal() == wxID_OK) {
-
-		stfio::filetype ift = myDlg.GetSrcFileExt();
-		stfio::filetype eft = myDlg.GetDestFileExt();
-        src_ext = myDlg.GetSrcFilter();
-
-        // wxProgressDialog
-        wxProgressDialog progDlg( wxT("CFS conversion utility"), wxT("Starting file conversion"),
-            100, NULL, wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_APP_MODAL );
-
-        wxArrayString srcFilenames(myDlg.GetSrcFileNames());
-        nfiles = srcFilenames.size(); // number of files to convert
-        wxString myDestDir = myDlg.GetDestDir();
-
-        for (std::size_t nFile=0; nFile<srcFilenames.size(); ++nFile) {
-            wxString progStr;
-
-            // Strip source directory from source file name:
-            wxFileName srcWxFilename(srcFilenames[nFile]);
-            srcWxFilename.MakeRelativeTo(myDlg.GetSrcDir());
-            srcWxFilename.ClearExt();
-            wxString destFilename(myDlg.GetDestDir() +
-                                  wxFileName::GetPathSeparators(wxPATH_NATIVE) +
-                                  srcWxFilename.GetFullPath() +
-                                  stf::std2wx(stfio::findExtension(myDlg.GetDestFileExt())));
-
-            wxString target_path = wxFileName(destFilename).GetPath();
-            if (!wxFileName::DirExists(target_path)) {
-                wxFileName::Mkdir(target_path, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
-            }
-
-            if ( eft == stfio::atf ) {
-                destFilename += wxT(".atf");
-            }
+    if(myDlg.ShowModal() != wxID_OK) {
+        return;
+    }
 
-            // Update progress bar:
-            progStr << wxT("Converting file #") << (int)nFile + 1
-                << wxT(" of ") << (int)srcFilenames.size() << wxT("\n")
-                << srcFilenames[nFile] << wxT(" -> ") << destFilename;
-            progDlg.Update(
-                (int)(((double)nFile/(double)srcFilenames.size())*100.0),
-                progStr
-                );
-
-            // Open source file and convert:
-            Recording sourceFile;
-            try {
+    stfio::filetype ift = myDlg.GetSrcFileExt();
+    stfio::filetype eft = myDlg.GetDestFileExt();
+    src_ext = myDlg.GetSrcFilter();
+    switch ( eft ) {
+     case stfio::atf:
+         dest_ext = wxT("Axon textfile [*.atf]");
+         break;
+     case stfio::igor:
+         dest_ext = wxT("Igor binary file [*.ibw]");
+         break;
+     case stfio::hdf5:
+         dest_ext = wxT("HDF5 [*.h5]");
+         break;
+#if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
+     case stfio::biosig:
+         dest_ext = wxT("Biosig/GDF [*.gdf]");
+         break;
+#endif
+     default:
+         wxGetApp().ErrorMsg(wxT("Unknown export file type\n"));
+         return;
+    }
 
-                stf::wxProgressInfo progDlgIn("Reading file", "Opening file", 100);
-                stfio::importFile(stf::wx2std(srcFilenames[nFile]), ift, sourceFile, wxGetApp().GetTxtImport(), progDlgIn);
+    ConvertJob job(ift, eft, wxGetApp().GetTxtImport());
+    wxArrayString srcFilenames(myDlg.GetSrcFileNames());
+    if (srcFilenames.empty()) {
+        return;
+    }
+    for (std::size_t nFile=0; nFile<srcFilenames.size(); ++nFile) {
+        // Strip source directory from source file name:
+        wxFileName srcWxFilename(srcFilenames[nFile]);
+        srcWxFilename.MakeRelativeTo(myDlg.GetSrcDir());
+        srcWxFilename.ClearExt();
+        wxString destFilename(myDlg.GetDestDir() +
+                              wxFileName::GetPathSeparators(wxPATH_NATIVE) +
+                              srcWxFilename.GetFullPath() +
+                              stf::std2wx(stfio::findExtension(eft)));
+
+        // Directories are created here because the workers mustn't use wx:
+        wxString target_path = wxFileName(destFilename).GetPath();
+        if (!wxFileName::DirExists(target_path)) {
+            wxFileName::Mkdir(target_path, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+        }
 
-                stf::wxProgressInfo progDlgOut("Writing file", "Opening file", 100);
-                switch ( eft ) {
-#ifndef WITHOUT_ABF
-                 case stfio::atf:
-                     stfio::exportATFFile(stf::wx2std(destFilename), sourceFile);
-                     dest_ext = wxT("Axon textfile [*.atf]");
-                     break;
-#endif
-                 case stfio::igor:
-                     stfio::exportIGORFile(stf::wx2std(destFilename), sourceFile, progDlgOut);
-                     dest_ext = wxT("Igor binary file [*.ibw]");
-                     break;
+        if ( eft == stfio::atf ) {
+            destFilename += wxT(".atf");
+        }
+        job.srcNames.push_back(stf::wx2std(srcFilenames[nFile]));
+        job.destNames.push_back(stf::wx2std(destFilename));
+    }
 
-#if (defined(WITH_BIOSIG) || defined(WITH_BIOSIG2))
-                 case stfio::biosig:
-                     stfio::exportBiosigFile(stf::wx2std(destFilename), sourceFile, progDlgOut);
-                     dest_ext = wxT("Biosig/GDF [*.gdf]");
-                     break;
-#endif
-                 default:
-                     wxString errorMsg(wxT("Unknown export file type\n"));
-                     wxGetApp().ErrorMsg(errorMsg);
-                     return;
-                }
-            }
-           catch (const std::runtime_error& e) {
-                wxString errorMsg(wxT("Error opening file\n"));
-                errorMsg += wxT("Runtime Error\n");
-                errorMsg += wxString( e.what(), wxConvLocal );
-                wxGetApp().ExceptMsg(errorMsg);
-                return;
-            }
+    // Start a bounded pool of workers:
+    int n_threads = stfio::getThreadCount();
+    if (n_threads > (int)job.srcNames.size()) {
+        n_threads = (int)job.srcNames.size();
+    }
+    std::vector<ConvertThread*> workers;
+    for (int n_t=0; n_t<n_threads; ++n_t) {
+        ConvertThread* worker = new ConvertThread(job);
+        if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR) {
+            delete worker;
+            continue;
+        }
+        wxCriticalSectionLocker locker(job.cs);
+        ++job.active;
+        workers.push_back(worker);
+    }
+    if (workers.empty()) {
+        wxGetApp().ErrorMsg(wxT("Couldn't start file conversion"));
+        return;
+    }
 
-            catch (const std::exception& e) {
-                wxString errorMsg(wxT("Error opening file\n"));
-                errorMsg += wxT("Exception\n");
-                errorMsg += wxString( e.what(), wxConvLocal );
-                wxGetApp().ExceptMsg(errorMsg);
-                return;
+    // The progress dialog isn't application modal, and it dispatches
+    // events while it's updated, so that the GUI stays responsive:
+    int nfiles = (int)job.srcNames.size(); // files to convert
+    wxProgressDialog progDlg( wxT("File conversion utility"), wxT("Starting file conversion"),
+        nfiles, this, wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_CAN_ABORT |
+        wxPD_ELAPSED_TIME | wxPD_REMAINING_TIME );
+    for (;;) {
+        std::size_t done;
+        int active;
+        wxString progStr;
+        {
+            wxCriticalSectionLocker locker(job.cs);
+            done = job.done;
+            active = job.active;
+            progStr << wxT("Converted ") << (int)done << wxT(" of ") << nfiles
+                    << wxT(" files (") << (int)job.errors.size() << wxT(" failed)\n")
+                    << stf::std2wx(job.current);
+            if (job.cancel) {
+                progStr = wxT("Cancelling, waiting for the current files to finish");
             }
         }
-    // Show now a smal information dialog
-    //std::count << srcFilter.c_str() << std::endl;
+        if (active == 0) {
+            break;
+        }
+        if (!progDlg.Update((int)done, progStr)) {
+            wxCriticalSectionLocker locker(job.cs);
+            job.cancel = true;
+        }
+        wxMilliSleep(50);
+    }
+    for (std::size_t n_t=0; n_t<workers.size(); ++n_t) {
+        workers[n_t]->Wait();
+        delete workers[n_t];
+    }
+    progDlg.Hide();
+
+    // Show now a summary:
+    int nconverted = (int)(job.done - job.errors.size());
     wxString msg;
-    msg = wxString::Format(wxT("%i"), nfiles);
+    msg = wxString::Format(wxT("%i"), nconverted);
     msg << src_ext;
     msg << wxT(" files \nwere converted to ");
     msg << dest_ext;
-	wxMessageDialog Simple(this, msg);
-	Simple.ShowModal();
-    } // end of wxStfConvertDlg
-
+    if (job.done < job.srcNames.size()) {
+        msg << wxT("\n") << (int)(job.srcNames.size() - job.done)
+            << wxT(" files were skipped because the conversion was cancelled");
+    }
+    if (!job.errors.empty()) {
+        msg << wxT("\n\n") << (int)job.errors.size() << wxT(" files couldn't be converted:\n");
+        // don't make the dialog taller than the screen:
+        const std::size_t max_listed = 20;
+        for (std::size_t n_e=0; n_e<job.errors.size() && n_e<max_listed; ++n_e) {
+            msg << stf::std2wx(job.errors[n_e]) << wxT("\n");
+        }
+        if (job.errors.size() > max_listed) {
+            msg << wxT("...\n");
+        }
+        wxGetApp().ErrorMsg(msg);
+        return;
+    }
+    wxMessageDialog Simple(this, msg);
+    Simple.ShowModal();
 }
 
 // Creates a graph. Called from view.cpp when a new drawing
@@ -905,6 +1066,8 @@ void wxStfParentFrame::OnMpl(wxCommandEvent& WXUNUSED(event))
     if (wxGetApp().GetActiveDoc()==NULL) return;
 
 #ifdef WITH_PYTHON
+    // Starts Python if this is its first use:
+    if (!wxGetApp().EnsurePython()) return;
     std::ostringstream mgr_name;
     mgr_name << "mpl" << GetMplFigNo();
     wxWindow* pPython = MakePythonWindow("plotWindowMpl", mgr_name.str(), "Matplotlib", true, false, true, 800, 600).cppWindow;
@@ -919,6 +1082,8 @@ void wxStfParentFrame::OnMplSpectrum(wxCommandEvent& WXUNUSED(event))
     if (wxGetApp().GetActiveDoc()==NULL) return;
 
 #ifdef WITH_PYTHON
+    // Starts Python if this is its first use:
+    if (!wxGetApp().EnsurePython()) return;
     std::ostringstream mgr_name;
     mgr_name << "mpl" << GetMplFigNo();
     wxWindow* pPython = MakePythonWindow("spectrumWindowMpl", mgr_name.str(), "Matplotlib", true, false, true, 800, 600).cppWindow;
@@ -1092,6 +1257,13 @@ void wxStfParentFrame::OnToolSnapshotwmf(wxCommandEvent& WXUNUSED(event)) {
     }
 }
 
+void wxStfParentFrame::OnToolSnapshotsvg(wxCommandEvent& WXUNUSED(event)) {
+    wxStfView* pView=wxGetApp().GetActiveView();
+    if (pView!=NULL) {
+        pView->GetGraph()->Snapshotsvg();
+    }
+}
+
 void wxStfParentFrame::OnToolMeasure(wxCommandEvent& WXUNUSED(event)) {
     SetMouseQual( stf::measure_cursor );
 }
@@ -1223,7 +1395,12 @@ void wxStfParentFrame::OnRestoreperspective(wxCommandEvent& WXUNUSED(event)) {
 #ifdef WITH_PYTHON
 void wxStfParentFrame::OnViewshell(wxCommandEvent& WXUNUSED(event)) {
     // Save the current visibility state:
-    bool old_state = m_mgr.GetPane(wxT("pythonShell")).IsShown();
+    bool old_state = m_mgr.GetPane(wxT("pythonShell")).IsOk() &&
+        m_mgr.GetPane(wxT("pythonShell")).IsShown();
+    // The shell doesn't exist before Python has been started:
+    if (!wxGetApp().EnsurePython() || !m_mgr.GetPane(wxT("pythonShell")).IsOk()) {
+        return;
+    }
     // Toggle python shell visibility:
     m_mgr.GetPane(wxT("pythonShell")).Show( !old_state );
     wxGetApp().wxWriteProfileInt( wxT("Settings"),wxT("ViewShell"), int(!old_state) );
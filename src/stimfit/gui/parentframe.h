@@ -28,6 +28,7 @@
 #include <wx/aui/aui.h>
 #include <wx/grid.h>
 #include <wx/dnd.h>
+#include <wx/timer.h>
 
 #include "./../stf.h"
 
@@ -164,6 +165,15 @@ public:
                                   double mpl_width=8.0, double mpl_height=6.0);
 
     int GetMplFigNo() {return mpl_figno++;}
+
+#ifdef WITH_PYTHON
+    //! Creates the Python shell pane.
+    /*! Requires a running interpreter (see wxStfApp::EnsurePython()).
+     *  Does nothing if the shell already exists.
+     *  \return false if the shell couldn't be created.
+     */
+    bool CreatePythonShell();
+#endif
 private:
     wxAuiManager m_mgr;
     wxStfToolBar *m_cursorToolBar, *m_scaleToolBar;
@@ -190,6 +200,10 @@ private:
     bool firstResize;
 
     int mpl_figno;
+
+    // updates the memory use in the status bar:
+    wxTimer memTimer;
+    void OnMemoryTimer(wxTimerEvent& event);
     wxStfToolBar* CreateStdTb();
     wxStfToolBar* CreateScaleTb();
     wxStfToolBar* CreateEditTb();
@@ -197,6 +211,9 @@ private:
 
     void OnHelp(wxCommandEvent& event);
     void OnCheckUpdate(wxCommandEvent& event);
+#ifdef WITH_PROFILING
+    void OnPerformance(wxCommandEvent& event);
+#endif
     
     void OnToggleSelect(wxCommandEvent& event);
     void OnToolFirst(wxCommandEvent& event);
@@ -216,6 +233,7 @@ private:
     void OnToolCh2(wxCommandEvent& event);
 
     void OnToolSnapshotwmf(wxCommandEvent& event);
+    void OnToolSnapshotsvg(wxCommandEvent& event);
 
     void OnToolMeasure(wxCommandEvent& event);
     void OnToolPeak(wxCommandEvent& event);
@@ -211,7 +211,7 @@ void wxStfPrintout::PrintHeader(wxDC* pDC, double scale) {
         }
     }
     try {
-        stf::SectionAttributes sec_attr = Doc()->GetCurrentSectionAttributes();
+        const stf::SectionAttributes& sec_attr = Doc()->GetCurrentSectionAttributes();
         if (sec_attr.isFitted) {
             wxRect WindowRect(GetLogicalPageMarginsRect(*(frame->GetPageSetup())));
             int increment=WindowRect.height/50;
@@ -25,45 +25,65 @@
 
 #include "./table.h"
 
+wxStfTable::wxStfTable(const stfnum::Table& table_) :
+    table(table_), cachedRows(cacheSize, -1), cachedCells(cacheSize)
+{}
+
 bool wxStfTable::IsEmptyCell( int row, int col ) {
-	try {
-		if (row==0 && col>=1) {
-			return table.GetColLabel(col-1) == "\0";
-		} else if (col==0 && row>=1) {
-			return table.GetRowLabel(row-1) == "\0";
-		} else if (col!=0 && row!=0) {
-            return table.IsEmpty(row-1,col-1); 
-		} else {
-			return true;
-		}
+	if (row<0 || col<0 || row>(int)table.nRows() || col>(int)table.nCols()) {
+		return true;
 	}
-	catch (const std::out_of_range&) {
+	if (row==0 && col>=1) {
+		return table.GetColLabel(col-1) == "\0";
+	} else if (col==0 && row>=1) {
+		return table.GetRowLabel(row-1) == "\0";
+	} else if (col!=0 && row!=0) {
+		return table.GetEmptyColumn(col-1)[row-1];
+	} else {
 		return true;
 	}
 }
 
-wxString wxStfTable::GetValue( int row, int col ) {
-	try {
-		if (row==0 && col>=1) {
-                    return stf::std2wx(table.GetColLabel(col-1));
-		} else if (col==0 && row>=1) {
-                    return stf::std2wx(table.GetRowLabel(row-1));
-		} else if (col!=0 && row!=0) {
-            if (table.IsEmpty(row-1,col-1))
-                return wxT("\0");
-			wxString strVal; 
-			strVal << table.at(row-1,col-1);
-			return strVal;
-		} else {
+wxString wxStfTable::FormatCell( int row, int col ) const {
+	if (row<0 || col<0 || row>(int)table.nRows() || col>(int)table.nCols()) {
+		return wxT("\0");
+	}
+	if (row==0 && col>=1) {
+		return stf::std2wx(table.GetColLabel(col-1));
+	} else if (col==0 && row>=1) {
+		return stf::std2wx(table.GetRowLabel(row-1));
+	} else if (col!=0 && row!=0) {
+		if (table.GetEmptyColumn(col-1)[row-1])
 			return wxT("\0");
-		}
+		wxString strVal;
+		strVal << table.GetColumn(col-1)[row-1];
+		return strVal;
+	} else {
+		return wxT("\0");
 	}
-	catch (const std::out_of_range&) {
+}
+
+wxString wxStfTable::GetValue( int row, int col ) {
+	if (row<0 || col<0 || row>(int)table.nRows() || col>(int)table.nCols()) {
 		return wxT("\0");
 	}
+	int slot = row % cacheSize;
+	if (cachedRows[slot] != row) {
+		// format the whole row, since the grid paints rows one after the other:
+		std::vector<wxString>& cells = cachedCells[slot];
+		cells.resize(GetNumberCols());
+		for (int n_col=0; n_col<(int)cells.size(); ++n_col) {
+			cells[n_col] = FormatCell(row, n_col);
+		}
+		cachedRows[slot] = row;
+	}
+	return cachedCells[slot][col];
 }
 
 void wxStfTable::SetValue( int row, int col, const wxString& value ) {
+	if (row>=0) {
+		cachedRows[row % cacheSize] = -1;
+	}
 	try {
 		if (row==0 && col>=1) {
                     return table.SetColLabel(col-1, stf::wx2std(value));
@@ -28,12 +28,16 @@
  */
 
 //! Adapts stfnum::Table to be used by wxStfGrid
+/*! The grid is virtual: cells are formatted when they are painted, and the
+ *  formatted strings of the most recently painted rows are cached, so that
+ *  scrolling through large tables doesn't format every cell again.
+ */
 class wxStfTable : public wxGridTableBase {
 public:
     //! Constructor
     /*! \param table_ The associated stfnum::Table
      */
-    wxStfTable(const stfnum::Table& table_) : table(table_) {}
+    wxStfTable(const stfnum::Table& table_);
 
     //! Get the number of rows.
     /*! \return The number of rows.
@@ -71,9 +75,22 @@ public:
      *  \return The selection as a single string.
      */
     wxString GetSelection(const wxGridCellCoordsArray& selection);
+
+    //! Formats a cell without caching it.
+    /*! \param row The row number of the cell.
+     *  \param col The column number of the cell.
+     *  \return The cell entry as a string, or an empty string if the cell
+     *          is empty or out of range.
+     */
+    wxString FormatCell(int row, int col) const;
     
 private:
     stfnum::Table table;
+
+    // formatted cells of recently painted rows; row n is cached in slot n % cacheSize:
+    static const int cacheSize = 256;
+    std::vector<int> cachedRows;
+    std::vector< std::vector<wxString> > cachedCells;
 };
 
 /*@}*/
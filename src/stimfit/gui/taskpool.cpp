@@ -0,0 +1,286 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// taskpool.cpp
+// Runs analyses on worker threads while the GUI stays responsive.
+
+#include "wx/wxprec.h"
+
+#ifndef WX_PRECOMP
+#include "wx/wx.h"
+#endif
+
+#include <algorithm>
+
+#include "./app.h"
+#include "./parentframe.h"
+#include "./taskpool.h"
+#include "./../../libstfio/parallel.h"
+
+DEFINE_EVENT_TYPE(wxEVT_STF_TASK_DONE)
+
+wxStfTask::wxStfTask(const wxString& title_, wxStfDoc* owner_) :
+    title(title_), owner(owner_), progDlg("", "", 100), lastProgress(0), lastMessage(), error()
+{}
+
+void wxStfTask::Fail(const wxString& msg) {
+    wxString errorMsg;
+    errorMsg << title << wxT(" failed:\n") << msg;
+    wxGetApp().ExceptMsg(errorMsg);
+}
+
+void wxStfTask::Cancel() {
+    progDlg.Cancel();
+}
+
+bool wxStfTask::IsCancelled() const {
+    return progDlg.IsCancelled();
+}
+
+int wxStfTask::GetProgress(std::string& msg) const {
+    msg = lastMessage;
+    return lastProgress;
+}
+
+bool wxStfTask::PollProgress() {
+    return progDlg.Poll(lastProgress, lastMessage);
+}
+
+// Runs queued tasks until the pool is shut down.
+class wxStfTaskPool::Worker : public wxThread {
+public:
+    Worker(wxStfTaskPool& pool_) : wxThread(wxTHREAD_JOINABLE), pool(pool_) {}
+
+protected:
+    virtual ExitCode Entry() {
+        for (;;) {
+            wxStfTask* task = pool.Take();
+            if (task == NULL) {
+                break;
+            }
+            pool.Execute(task);
+        }
+        return 0;
+    }
+
+private:
+    wxStfTaskPool& pool;
+};
+
+BEGIN_EVENT_TABLE( wxStfTaskPool, wxEvtHandler )
+EVT_COMMAND( wxID_ANY, wxEVT_STF_TASK_DONE, wxStfTaskPool::OnTaskDone )
+EVT_TIMER( wxID_ANY, wxStfTaskPool::OnTimer )
+END_EVENT_TABLE()
+
+wxStfTaskPool::wxStfTaskPool(int n_threads) :
+    maxThreads(n_threads), tasks(), workers(), timer(this),
+    mutex(), condition(mutex), queue(), done(), idle(0), stopping(false)
+{
+    if (maxThreads <= 0) {
+        maxThreads = stfio::getThreadCount();
+    }
+    if (maxThreads < 1) {
+        maxThreads = 1;
+    }
+}
+
+wxStfTaskPool::~wxStfTaskPool() {
+    Shutdown();
+}
+
+void wxStfTaskPool::Submit(wxStfTask* task) {
+    if (task == NULL) {
+        return;
+    }
+    bool startWorker = false;
+    {
+        wxMutexLocker locker(mutex);
+        if (stopping) {
+            delete task;
+            return;
+        }
+        tasks.push_back(task);
+        queue.push_back(task);
+        // only start another worker if all of them are busy:
+        startWorker = (idle == 0 && (int)workers.size() < maxThreads);
+        condition.Signal();
+    }
+    if (startWorker) {
+        Worker* worker = new Worker(*this);
+        if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR) {
+            delete worker;
+            if (workers.empty()) {
+                // Nothing would ever run the task:
+                wxMutexLocker locker(mutex);
+                queue.erase(std::remove(queue.begin(), queue.end(), task), queue.end());
+                tasks.erase(std::remove(tasks.begin(), tasks.end(), task), tasks.end());
+                delete task;
+                wxGetApp().ErrorMsg(wxT("Couldn't start a worker thread"));
+                return;
+            }
+        } else {
+            workers.push_back(worker);
+        }
+    }
+    if (!timer.IsRunning()) {
+        timer.Start(frameInterval);
+    }
+    ShowStatus();
+}
+
+void wxStfTaskPool::CancelTasks(const wxStfDoc* owner) {
+    for (std::size_t n_t = 0; n_t < tasks.size(); ++n_t) {
+        if (tasks[n_t]->GetOwner() == owner) {
+            tasks[n_t]->Cancel();
+        }
+    }
+}
+
+void wxStfTaskPool::CancelAll() {
+    for (std::size_t n_t = 0; n_t < tasks.size(); ++n_t) {
+        tasks[n_t]->Cancel();
+    }
+}
+
+wxString wxStfTaskPool::GetStatus() const {
+    if (tasks.empty()) {
+        return wxT("");
+    }
+    wxString status;
+    std::string msg;
+    int progress = tasks.front()->GetProgress(msg);
+    status << tasks.front()->GetTitle() << wxT(": ") << progress << wxT("%");
+    if (!msg.empty()) {
+        status << wxT(" (") << stf::std2wx(msg) << wxT(")");
+    }
+    if (tasks.size() > 1) {
+        status << wxT(", ") << (int)tasks.size()-1 << wxT(" more task(s)");
+    }
+    return status;
+}
+
+void wxStfTaskPool::Shutdown() {
+    {
+        wxMutexLocker locker(mutex);
+        stopping = true;
+        for (std::size_t n_t = 0; n_t < tasks.size(); ++n_t) {
+            tasks[n_t]->Cancel();
+        }
+        condition.Broadcast();
+    }
+    for (std::size_t n_w = 0; n_w < workers.size(); ++n_w) {
+        workers[n_w]->Wait();
+        delete workers[n_w];
+    }
+    workers.clear();
+    timer.Stop();
+    // The results are discarded because the GUI may already be gone:
+    for (std::size_t n_t = 0; n_t < tasks.size(); ++n_t) {
+        delete tasks[n_t];
+    }
+    tasks.clear();
+    queue.clear();
+    done.clear();
+}
+
+wxStfTask* wxStfTaskPool::Take() {
+    wxMutexLocker locker(mutex);
+    ++idle;
+    while (queue.empty() && !stopping) {
+        condition.Wait();
+    }
+    --idle;
+    if (stopping) {
+        return NULL;
+    }
+    wxStfTask* task = queue.front();
+    queue.pop_front();
+    return task;
+}
+
+void wxStfTaskPool::Execute(wxStfTask* task) {
+    if (!task->IsCancelled()) {
+        std::string error;
+        try {
+            task->Run(task->progDlg);
+        }
+        catch (const std::exception& e) {
+            error = e.what();
+            if (error.empty()) {
+                error = "Unknown error";
+            }
+        }
+        catch (...) {
+            error = "Unknown error";
+        }
+        // handed over to the GUI thread with the mutex below:
+        task->error = error;
+    }
+    wxMutexLocker locker(mutex);
+    if (stopping) {
+        return;
+    }
+    done.push_back(task);
+    // wxPostEvent() can be used from any thread:
+    wxCommandEvent event(wxEVT_STF_TASK_DONE);
+    wxPostEvent(this, event);
+}
+
+void wxStfTaskPool::OnTaskDone(wxCommandEvent& WXUNUSED(event)) {
+    std::deque<wxStfTask*> finished;
+    {
+        wxMutexLocker locker(mutex);
+        finished.swap(done);
+    }
+    for (std::size_t n_t = 0; n_t < finished.size(); ++n_t) {
+        wxStfTask* task = finished[n_t];
+        tasks.erase(std::remove(tasks.begin(), tasks.end(), task), tasks.end());
+        if (!task->IsCancelled()) {
+            try {
+                if (task->error.empty()) {
+                    task->Finish();
+                } else {
+                    task->Fail(stf::std2wx(task->error));
+                }
+            }
+            catch (const std::exception& e) {
+                task->Fail(stf::std2wx(e.what()));
+            }
+        }
+        delete task;
+    }
+    if (tasks.empty()) {
+        timer.Stop();
+    }
+    ShowStatus();
+}
+
+void wxStfTaskPool::OnTimer(wxTimerEvent& WXUNUSED(event)) {
+    bool changed = false;
+    for (std::size_t n_t = 0; n_t < tasks.size(); ++n_t) {
+        if (tasks[n_t]->PollProgress()) {
+            changed = true;
+        }
+    }
+    if (changed) {
+        ShowStatus();
+    }
+}
+
+void wxStfTaskPool::ShowStatus() {
+    wxStfParentFrame* pFrame = GetMainFrame();
+    if (pFrame != NULL && pFrame->GetStatusBar() != NULL) {
+        pFrame->SetStatusText(GetStatus());
+    }
+}
@@ -0,0 +1,201 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+/*! \file taskpool.h
+ *  \brief Declares wxStfTask and wxStfTaskPool, which run analyses in the background.
+ */
+
+#ifndef _TASKPOOL_H
+#define _TASKPOOL_H
+
+#include <deque>
+#include <vector>
+#include <string>
+
+#include <wx/thread.h>
+#include <wx/timer.h>
+
+#include "./../stf.h"
+
+class wxStfDoc;
+class wxStfTaskPool;
+
+/*! \addtogroup wxstf
+ *  @{
+ */
+
+//! Posted to the task pool by a worker thread when a task has been run.
+DECLARE_EVENT_TYPE(wxEVT_STF_TASK_DONE, -1)
+
+//! A computation that is run in the background by wxStfTaskPool.
+/*! Derived classes copy everything they need from the document when they
+ *  are constructed, compute their results in Run() on a worker thread and
+ *  hand them over to the GUI in Finish(). Run() mustn't use wxWidgets
+ *  or access a document, since the user can keep working while it runs.
+ */
+class wxStfTask {
+public:
+    //! Constructor
+    /*! \param title_ A short description of the task that is shown in the status bar.
+     *  \param owner_ The document the task belongs to, or NULL. Tasks of a document
+     *         are cancelled when the document is closed.
+     */
+    wxStfTask(const wxString& title_, wxStfDoc* owner_=NULL);
+
+    //! Destructor
+    virtual ~wxStfTask() {}
+
+    //! Does the work. Called on a worker thread.
+    /*! Exceptions are caught by the task pool and passed to Fail().
+     *  \param progDlg Progress indicator; returns false once the task has been cancelled.
+     */
+    virtual void Run(stfio::ProgressInfo& progDlg) = 0;
+
+    //! Delivers the results. Called on the GUI thread after Run() has returned.
+    /*! Isn't called if the task has been cancelled.
+     */
+    virtual void Finish() {}
+
+    //! Reports an error. Called on the GUI thread if Run() has thrown an exception.
+    /*! \param msg The description of the exception.
+     */
+    virtual void Fail(const wxString& msg);
+
+    //! Requests the task to stop. Can be called from any thread.
+    void Cancel();
+
+    //! Determines whether the task has been cancelled. Can be called from any thread.
+    /*! \return true if Cancel() has been called.
+     */
+    bool IsCancelled() const;
+
+    //! Retrieves the progress that has been reported by Run().
+    /*! Only to be used on the GUI thread.
+     *  \param msg Is set to the last progress message.
+     *  \return The progress in percent.
+     */
+    int GetProgress(std::string& msg) const;
+
+    //! Retrieves the description of the task.
+    /*! \return The title that was passed to the constructor.
+     */
+    const wxString& GetTitle() const { return title; }
+
+    //! Retrieves the document the task belongs to.
+    /*! Only to be used on the GUI thread.
+     *  \return The document, or NULL if the task doesn't belong to a document.
+     */
+    wxStfDoc* GetOwner() const { return owner; }
+
+private:
+    friend class wxStfTaskPool;
+
+    // Reads the progress that Run() has reported since the last call.
+    // Returns true if it has changed.
+    bool PollProgress();
+
+    wxString title;
+    wxStfDoc* owner;
+    // Written by Run() without locking, polled by the GUI thread:
+    stfio::AtomicProgressInfo progDlg;
+    // GUI thread only:
+    int lastProgress;
+    std::string lastMessage;
+    // Set by the worker before the task is handed back to the GUI thread:
+    std::string error;
+};
+
+//! Runs wxStfTask objects on a bounded pool of worker threads.
+/*! Tasks are started in the order in which they are submitted, and as many
+ *  of them run at once as stfio::getThreadCount() allows. When a task has been run,
+ *  an event is sent back to the GUI thread, where the results are delivered.
+ *  The progress of running tasks is polled at a fixed frame rate and shown
+ *  in the status bar of the main frame, so that reporting progress doesn't
+ *  slow down the computations.
+ */
+class wxStfTaskPool : public wxEvtHandler {
+public:
+    //! Constructor
+    /*! \param n_threads Maximal number of worker threads; 0 uses stfio::getThreadCount().
+     */
+    wxStfTaskPool(int n_threads=0);
+
+    //! Destructor. Cancels all tasks and waits for the workers.
+    ~wxStfTaskPool();
+
+    //! Queues a task. Only to be used on the GUI thread.
+    /*! \param task The task to be run. The pool takes ownership.
+     */
+    void Submit(wxStfTask* task);
+
+    //! Cancels all tasks of a document.
+    /*! Cancelled tasks are never finished, so that they don't access \e owner
+     *  once it has been closed. Called from wxStfDoc::OnCloseDocument().
+     *  \param owner The document whose tasks are cancelled.
+     */
+    void CancelTasks(const wxStfDoc* owner);
+
+    //! Cancels all tasks.
+    void CancelAll();
+
+    //! Retrieves the number of queued or running tasks.
+    /*! \return The number of tasks that haven't been finished.
+     */
+    std::size_t GetCount() const { return tasks.size(); }
+
+    //! Describes the running tasks.
+    /*! \return A one-line summary that can be shown in the status bar.
+     */
+    wxString GetStatus() const;
+
+    //! Cancels all tasks and stops the worker threads.
+    /*! Called when the application exits; the pool can't be used afterwards.
+     */
+    void Shutdown();
+
+private:
+    class Worker;
+    friend class Worker;
+
+    // Called by the workers:
+    wxStfTask* Take();
+    void Execute(wxStfTask* task);
+
+    void OnTaskDone(wxCommandEvent& event);
+    void OnTimer(wxTimerEvent& event);
+    void ShowStatus();
+
+    // Interval at which the progress of running tasks is displayed, in ms:
+    static const int frameInterval = 100;
+
+    int maxThreads;
+    // GUI thread only: all tasks that haven't been finished yet
+    std::vector<wxStfTask*> tasks;
+    std::vector<Worker*> workers;
+    wxTimer timer;
+
+    // All members below have to be accessed with the mutex locked:
+    wxMutex mutex;
+    wxCondition condition;
+    std::deque<wxStfTask*> queue;
+    std::deque<wxStfTask*> done;
+    int idle;
+    bool stopping;
+
+    DECLARE_EVENT_TABLE()
+};
+
+/*@}*/
+
+#endif
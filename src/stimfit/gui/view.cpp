@@ -100,7 +100,12 @@ void wxStfView::OnDraw(wxDC *WXUNUSED(pDC)) {
 
 void wxStfView::OnUpdate(wxView *WXUNUSED(sender), wxObject *WXUNUSED(hint))
 {
+    if (Doc() != NULL) {
+        Doc()->InvalidateMeasurement();
+    }
     if (graph) {
+        // the data may have changed:
+        graph->InvalidateLayers();
         graph->Refresh();
     }
 }
@@ -140,8 +140,9 @@ def export_hdf5( filename="" ):
     channel_list = list()
     
     for n_c in range(stf.get_size_recording()):
+        # read-only views keep the samples alive without copying them:
         section_list = [ 
-            Section( stf.get_trace(n_s, n_c), stf.get_sampling_interval(), stf.get_xunits(n_s, n_c), stf.get_yunits(n_s, n_c) ) \
+            Section( stf.get_trace(n_s, n_c, view=True), stf.get_sampling_interval(), stf.get_xunits(n_s, n_c), stf.get_yunits(n_s, n_c) ) \
                 for n_s in range(stf.get_size_channel(n_c)) 
             ]
         channel_list.append( Channel( section_list, stf.get_channel_name() ) )
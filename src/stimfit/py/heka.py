@@ -1,3 +1,4 @@
+import os
 import sys
 import numpy as np
 
@@ -58,6 +59,15 @@ def read_heka(filename):
     return channels, channelnames, channelunits, channeldt
 
 def read_heka_stf(filename):
+    """Opens a HEKA file in a new window.
+
+    Binary HEKA files (.dat) are opened with the native importer, which
+    fills the sections directly; only ASCII exports are parsed here.
+    """
+    import stf
+    if os.path.splitext(filename)[1].lower() == '.dat':
+        return stf.file_open(filename)
+
     channels, channelnames, channelunits, channeldt = read_heka(filename)
     for nc, channel in enumerate(channels):
         if channelunits[nc]=="V":
@@ -71,7 +81,6 @@ def read_heka_stf(filename):
                 channels[nc][ns] *= 1.0e12
             channelunits[nc]="pA"
 
-    import stf
     stf.new_window_list(channels)
     for nc, name in enumerate(channelnames):
         stf.set_channel_name(name, nc)
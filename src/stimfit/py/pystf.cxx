@@ -1,5 +1,8 @@
 #include <stdlib.h>
 #include <math.h>
+#include <algorithm>
+#include <deque>
+#include <sstream>
 
 #ifndef WX_PRECOMP
 #include "wx/wx.h"
@@ -75,9 +78,12 @@
 #include "./../gui/childframe.h"
 #include "./../gui/dlgs/cursorsdlg.h"
 #include "./../../libstfnum/fit.h"
+#include "./../../libstfnum/measure.h"
 
 #ifdef WITH_PYTHON
 #define array_data(a)          (((PyArrayObject *)a)->data)
+#define array_flags(a)         (((PyArrayObject *)a)->flags)
+#define array_base(a)          (((PyArrayObject *)a)->base)
 #endif
 
 std::vector< std::vector< Vector_double > > gMatrix;
@@ -118,7 +124,12 @@ void ShowError( const wxString& msg ) {
 }
 
 wxStfDoc* actDoc() {
-    return wxGetApp().GetActiveDoc();
+    wxStfDoc* pDoc = wxGetApp().GetActiveDoc();
+    // scripts may access any section:
+    if (pDoc != NULL) {
+        pDoc->WaitForSections();
+    }
+    return pDoc;
 }
 
 wxStfGraph* actGraph() {
@@ -137,6 +148,8 @@ bool refresh_graph() {
         ShowError( wxT("Pointer to graph is zero") );
         return false;
     }
+    // scripts may have modified the data of any trace:
+    pGraph->InvalidateLayers();
     pGraph->Refresh();
     return true;
 }
@@ -201,7 +214,20 @@ std::string get_versionstring() {
 }
 
 #ifdef WITH_PYTHON
-PyObject* get_trace(int trace, int channel) {
+namespace {
+    // Releases the copy of a section that a NumPy view refers to:
+#if PY_MAJOR_VERSION >= 3 || PY_MINOR_VERSION >= 7
+    void release_section(PyObject* capsule) {
+        delete (Section*)PyCapsule_GetPointer(capsule, NULL);
+    }
+#else
+    void release_section(void* ptr) {
+        delete (Section*)ptr;
+    }
+#endif
+}
+
+PyObject* get_trace(int trace, int channel, bool view) {
     wrap_array();
 
     if ( !check_doc() ) return NULL;
@@ -213,15 +239,46 @@ PyObject* get_trace(int trace, int channel) {
         channel = actDoc()->GetCurChIndex();
     }
 
-    npy_intp dims[1] = {(int)actDoc()->at(channel).at(trace).size()};
-    PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
-    double* gDataP = (double*)array_data(np_array);
+    const Section* sec = NULL;
+    try {
+        sec = &actDoc()->at(channel).at(trace);
+    } catch (const std::out_of_range& e) {
+        ShowExcept(e);
+        return NULL;
+    }
+    npy_intp dims[1] = {(npy_intp)sec->size()};
+
+    if (!view) {
+        PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+        if (np_array == NULL) return NULL;
+        sec->CopyRange(0, sec->size(), (double*)array_data(np_array));
+        return np_array;
+    }
+
+    // The view refers to the samples of a copy of the section, which shares
+    // them with the original until either of them is changed, and which is
+    // owned by the array:
+    Section* owner = new Section(*sec);
+    const Vector_double& samples = owner->get();
+    PyObject* np_array = PyArray_SimpleNewFromData(1, dims, NPY_DOUBLE,
+                                                   dims[0] > 0 ? (void*)&samples[0] : NULL);
+    if (np_array == NULL) {
+        delete owner;
+        return NULL;
+    }
+#if PY_MAJOR_VERSION >= 3 || PY_MINOR_VERSION >= 7
+    PyObject* base = PyCapsule_New(owner, NULL, release_section);
+#else
+    PyObject* base = PyCObject_FromVoidPtr(owner, release_section);
+#endif
+    if (base == NULL) {
+        delete owner;
+        Py_DECREF(np_array);
+        return NULL;
+    }
+    PyArray_SetBaseObject((PyArrayObject*)np_array, base);
+    array_flags(np_array) &= ~NPY_WRITEABLE;
 
-    /* fill */
-    std::copy( (*actDoc())[channel][trace].get().begin(),
-               (*actDoc())[channel][trace].get().end(),
-               gDataP);
-    
     return np_array;
 }
 #endif
@@ -229,18 +286,17 @@ PyObject* get_trace(int trace, int channel) {
 bool new_window( double* invec, int size ) {
     bool open_doc = actDoc() != NULL;
 
-    std::vector< double > va(size);
-    std::copy( &invec[0], &invec[size], va.begin() );
-    Section sec(va);
-    Channel ch(sec);
+    // copied once; the data are moved into the new document from here on:
+    Channel ch( 1 );
+    ch[0].get_w().assign( &invec[0], &invec[size] );
     if (open_doc) {
         ch.SetYUnits( actDoc()->at( actDoc()->GetCurChIndex() ).GetYUnits() );
     }
-    Recording new_rec( ch );
+    Recording new_rec( STFIO_MOVE(ch) );
     if (open_doc) {
         new_rec.SetXScale( actDoc()->GetXScale() );
     }
-    wxStfDoc* testDoc = wxGetApp().NewChild( new_rec, actDoc(), wxT("From python") );
+    wxStfDoc* testDoc = wxGetApp().NewChild( STFIO_MOVE(new_rec), actDoc(), wxT("From python") );
     if ( testDoc == NULL ) {
         ShowError( wxT("Failed to create a new window.") );
         return false;
@@ -255,7 +311,7 @@ bool _new_window_gMatrix( ) {
     for (std::size_t n_c=0; n_c < new_rec.size(); ++n_c) {
         Channel ch( gMatrix[n_c].size() );
         for ( std::size_t n_s = 0; n_s < ch.size(); ++n_s ) {
-            ch.InsertSection( Section(gMatrix[n_c][n_s]), n_s );
+            ch.InsertSection( Section(STFIO_MOVE(gMatrix[n_c][n_s])), n_s );
         }
         std::string yunits = "";
         if (open_doc) {
@@ -265,9 +321,10 @@ bool _new_window_gMatrix( ) {
         if ( !gNames.empty() ) {
             ch.SetChannelName(gNames[n_c]);
         }
-        new_rec.InsertChannel( ch, n_c );
+        new_rec.InsertChannel( STFIO_MOVE(ch), n_c );
     }
-    gNames.resize(0);    
+    gNames.resize(0);
+    gMatrix.resize(0);
     double xscale = 1.0;
     if (open_doc) {
         xscale =  actDoc()->GetXScale();
@@ -277,7 +334,7 @@ bool _new_window_gMatrix( ) {
     if ( open_doc ) {
         pDoc = actDoc();
     }
-    wxStfDoc* testDoc = wxGetApp().NewChild( new_rec, pDoc, wxT("From python") );
+    wxStfDoc* testDoc = wxGetApp().NewChild( STFIO_MOVE(new_rec), pDoc, wxT("From python") );
     if ( testDoc == NULL ) {
         ShowError( wxT("Failed to create a new window.") );
         return false;
@@ -288,22 +345,21 @@ bool _new_window_gMatrix( ) {
 bool new_window_matrix( double* invec, int traces, int size ) {
     bool open_doc = actDoc() != NULL;
 
+    // Each row is copied once, straight into its section; the data are
+    // moved into the new document from here on:
     Channel ch( traces );
     for (int n = 0; n < traces; ++n) {
         std::size_t offset = n * size;
-        std::vector< double > va(size);
-        std::copy( &invec[offset], &invec[offset+size], &va[0] );
-        Section sec(va);
-        ch.InsertSection(sec, n);
+        ch[n].get_w().assign( &invec[offset], &invec[offset+size] );
     }
     if (open_doc) {
         ch.SetYUnits( actDoc()->at( actDoc()->GetCurChIndex() ).GetYUnits() );
     }
-    Recording new_rec( ch );
+    Recording new_rec( STFIO_MOVE(ch) );
     if (open_doc) {
         new_rec.SetXScale( actDoc()->GetXScale() );
     }
-    wxStfDoc* testDoc = wxGetApp().NewChild( new_rec, actDoc(), wxT("From python") );
+    wxStfDoc* testDoc = wxGetApp().NewChild( STFIO_MOVE(new_rec), actDoc(), wxT("From python") );
     if ( testDoc == NULL ) {
         ShowError( wxT("Failed to create a new window.") );
         return false;
@@ -442,19 +498,9 @@ bool select_trace( int trace ) {
         trace = actDoc()->GetCurSecIndex();
     }
 
-    // control whether trace has already been selected:
-    bool already=false;
-    for (c_st_it cit = actDoc()->GetSelectedSections().begin();
-         cit != actDoc()->GetSelectedSections().end() && !already;
-         ++cit) { 
-        if ((int)*cit == trace) {
-            already = true;
-        }
-    }
-
-    // add trace number to selected numbers, print number of selected traces
-    if (!already) {
-        actDoc()->SelectTrace(trace, actDoc()->GetBaseBeg(), actDoc()->GetBaseEnd());
+    // add trace number to selected numbers unless it has already been selected,
+    // print number of selected traces
+    if (actDoc()->SelectTrace(trace, actDoc()->GetBaseBeg(), actDoc()->GetBaseEnd())) {
         //String output in the trace navigator
         wxStfChildFrame* pFrame = (wxStfChildFrame*)actDoc()->GetDocumentWindow();
         if ( !pFrame ) {
@@ -484,6 +530,314 @@ void unselect_all( ) {
 }
 
 #ifdef WITH_PYTHON
+PyObject* get_traces(const std::vector<int>& traces, int channel, int start, int stop) {
+    wrap_array();
+
+    if ( !check_doc() ) return NULL;
+
+    if ( channel == -1 ) {
+        channel = actDoc()->GetCurChIndex();
+    }
+    if ( channel < 0 || channel >= (int)actDoc()->size() ) {
+        ShowError( wxT("Channel index out of range in get_traces()") );
+        return NULL;
+    }
+    const Channel& ch = actDoc()->get()[channel];
+    std::vector<std::size_t> secs;
+    for (std::size_t n = 0; n < traces.size(); ++n) {
+        if ( traces[n] < 0 || traces[n] >= (int)ch.size() ) {
+            ShowError( wxT("Trace index out of range in get_traces()") );
+            return NULL;
+        }
+        secs.push_back( traces[n] );
+    }
+    if ( traces.empty() ) {
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            secs.push_back( n_s );
+        }
+    }
+    if ( stop < 0 ) {
+        // up to the end of the shortest trace:
+        stop = 0;
+        for (std::size_t n = 0; n < secs.size(); ++n) {
+            if ( n == 0 || (int)ch[secs[n]].size() < stop ) {
+                stop = (int)ch[secs[n]].size();
+            }
+        }
+    }
+    if ( start < 0 || start > stop ) {
+        ShowError( wxT("Sample range out of range in get_traces()") );
+        return NULL;
+    }
+
+    npy_intp dims[2] = {(npy_intp)secs.size(), (npy_intp)(stop-start)};
+    PyObject* np_array = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+    if ( np_array == NULL ) return NULL;
+    try {
+        ch.CopyRange( secs, start, stop, (double*)array_data(np_array) );
+    } catch (const std::out_of_range& e) {
+        Py_DECREF( np_array );
+        ShowExcept( e );
+        return NULL;
+    }
+
+    return np_array;
+}
+
+PyObject* running_mean( double* invec, int size, int binwidth ) {
+    wrap_array();
+
+    if ( binwidth <= 0 ) {
+        ShowError( wxT("Bin width has to be positive in running_mean()") );
+        return NULL;
+    }
+    Vector_double rmean = stfnum::runningMean( Vector_double(&invec[0], &invec[size]), binwidth );
+
+    npy_intp dims[1] = {(npy_intp)rmean.size()};
+    PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+    if ( np_array == NULL ) return NULL;
+    std::copy( rmean.begin(), rmean.end(), (double*)array_data(np_array) );
+
+    return np_array;
+}
+
+PyObject* threshold_crossings( double* invec, int size, double threshold, bool up ) {
+    wrap_array();
+
+    std::vector<std::size_t> crossings =
+        stfnum::thresholdCrossings( Vector_double(&invec[0], &invec[size]), 0, size, threshold, up );
+
+    npy_intp dims[1] = {(npy_intp)crossings.size()};
+    PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_INTP);
+    if ( np_array == NULL ) return NULL;
+    std::copy( crossings.begin(), crossings.end(), (npy_intp*)array_data(np_array) );
+
+    return np_array;
+}
+
+PyObject* get_amplitudes( const std::vector<int>& traces ) {
+    wrap_array();
+
+    if ( !check_doc() ) return NULL;
+
+    stfnum::MeasurementJob job = actDoc()->GetMeasurementJob();
+    const Channel& ch = actDoc()->get()[actDoc()->GetCurChIndex()];
+    std::vector<std::size_t> secs;
+    for (std::size_t n = 0; n < traces.size(); ++n) {
+        if ( traces[n] < 0 || traces[n] >= (int)ch.size() ) {
+            ShowError( wxT("Trace index out of range in get_amplitudes()") );
+            return NULL;
+        }
+        secs.push_back( traces[n] );
+    }
+    if ( traces.empty() ) {
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            secs.push_back( n_s );
+        }
+    }
+
+    // Only the baseline and the peak are needed:
+    job.plan.measurements = stfnum::measure_peak;
+    job.reference = NULL;
+    std::vector<stfnum::MeasurementJob> jobs( secs.size(), job );
+    for (std::size_t n = 0; n < secs.size(); ++n) {
+        jobs[n].sec = &ch[secs[n]];
+    }
+    std::vector<std::string> errors;
+    std::vector<stfnum::MeasurementResults> results = stfnum::evaluateMany( jobs, errors );
+
+    npy_intp dims[1] = {(npy_intp)secs.size()};
+    PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+    if ( np_array == NULL ) return NULL;
+    double* amplitudes = (double*)array_data(np_array);
+    for (std::size_t n = 0; n < results.size(); ++n) {
+        if ( !errors[n].empty() ) {
+            Py_DECREF( np_array );
+            ShowError( stf::std2wx(errors[n]) );
+            return NULL;
+        }
+        amplitudes[n] = results[n].peak - results[n].base;
+    }
+
+    return np_array;
+}
+
+namespace {
+
+// Reads a str (or bytes) object; empty if it isn't one:
+std::string py_string( PyObject* obj ) {
+    const char* str = NULL;
+#if PY_MAJOR_VERSION >= 3
+    if ( PyUnicode_Check( obj ) ) {
+        str = PyUnicode_AsUTF8( obj );
+    } else if ( PyBytes_Check( obj ) ) {
+        str = PyBytes_AsString( obj );
+    }
+#else
+    if ( PyString_Check( obj ) ) {
+        str = PyString_AsString( obj );
+    }
+#endif
+    if ( str == NULL ) {
+        PyErr_Clear();
+        return "";
+    }
+    return str;
+}
+
+// Applies the settings of a Python dictionary to a measurement plan:
+bool update_plan( PyObject* dict, stfnum::MeasurementPlan& plan ) {
+    if ( !PyDict_Check( dict ) ) {
+        ShowError( wxT("plan has to be a dictionary in measure_all()") );
+        return false;
+    }
+    Py_ssize_t n_dict = 0;
+    PyObject *pkey = NULL, *pvalue = NULL;
+    while ( PyDict_Next( dict, &n_dict, &pkey, &pvalue ) ) {
+        std::string key = py_string( pkey );
+        if ( key == "direction" ) {
+            std::string dir = py_string( pvalue );
+            if ( dir == "up" ) {
+                plan.dir = stfnum::up;
+            } else if ( dir == "down" ) {
+                plan.dir = stfnum::down;
+            } else if ( dir == "both" ) {
+                plan.dir = stfnum::both;
+            } else {
+                ShowError( wxT("direction has to be 'up', 'down' or 'both' in measure_all()") );
+                return false;
+            }
+            continue;
+        }
+        double value = PyFloat_AsDouble( pvalue );
+        if ( PyErr_Occurred() ) {
+            PyErr_Clear();
+            ShowError( stf::std2wx( "Value of " + key + " isn't a number in measure_all()" ) );
+            return false;
+        }
+        if ( key == "rise_factor" ) {
+            plan.RTFactor = value;
+            continue;
+        }
+        if ( value < 0 ) {
+            ShowError( stf::std2wx( key + " mustn't be negative in measure_all()" ) );
+            return false;
+        }
+        if ( key == "base_start" ) {
+            plan.baseBeg = (std::size_t)value;
+        } else if ( key == "base_end" ) {
+            plan.baseEnd = (std::size_t)value;
+        } else if ( key == "peak_start" ) {
+            plan.peakBeg = (std::size_t)value;
+        } else if ( key == "peak_end" ) {
+            plan.peakEnd = (std::size_t)value;
+        } else if ( key == "slope_start" ) {
+            plan.slopeBeg = (std::size_t)value;
+        } else if ( key == "slope_end" ) {
+            plan.slopeEnd = (std::size_t)value;
+        } else if ( key == "peak_mean" ) {
+            plan.pM = (int)value;
+        } else {
+            ShowError( stf::std2wx( "Unknown setting " + key + " in measure_all()" ) );
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+PyObject* measure_all( int channel, const std::vector<int>& traces, PyObject* plan ) {
+    wrap_array();
+
+    if ( !check_doc() ) return NULL;
+
+    wxStfDoc* pDoc = actDoc();
+    if ( channel == -1 ) {
+        channel = pDoc->GetCurChIndex();
+    }
+    if ( channel < 0 || channel >= (int)pDoc->size() ) {
+        ShowError( wxT("Channel index out of range in measure_all()") );
+        return NULL;
+    }
+    const Channel& ch = pDoc->get()[channel];
+    std::vector<std::size_t> secs;
+    for (std::size_t n = 0; n < traces.size(); ++n) {
+        if ( traces[n] < 0 || traces[n] >= (int)ch.size() ) {
+            ShowError( wxT("Trace index out of range in measure_all()") );
+            return NULL;
+        }
+        secs.push_back( traces[n] );
+    }
+    if ( traces.empty() ) {
+        for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+            secs.push_back( n_s );
+        }
+    }
+
+    // the cursors of the document, measured like wxStfDoc::Measure() does:
+    stfnum::MeasurementJob job = pDoc->GetMeasurementJob();
+    if ( plan != NULL && plan != Py_None && !update_plan( plan, job.plan ) ) {
+        return NULL;
+    }
+    std::size_t refCh = pDoc->GetSecChIndex();
+    bool useReference = pDoc->size() > 1 && refCh != (std::size_t)channel;
+    std::vector<stfnum::MeasurementJob> jobs( secs.size(), job );
+    for (std::size_t n = 0; n < secs.size(); ++n) {
+        jobs[n].sec = &ch[secs[n]];
+        jobs[n].reference = NULL;
+        if ( useReference && secs[n] < pDoc->get()[refCh].size() ) {
+            jobs[n].reference = &pDoc->get()[refCh][secs[n]];
+        }
+    }
+    std::vector<std::string> errors;
+    std::vector<stfnum::MeasurementResults> results = stfnum::evaluateMany( jobs, errors );
+    for (std::size_t n = 0; n < errors.size(); ++n) {
+        if ( !errors[n].empty() ) {
+            ShowError( stf::std2wx(errors[n]) );
+            return NULL;
+        }
+    }
+
+    const char* keys[] = { "trace", "base", "base_sd", "peak", "amplitude", "peak_time",
+                           "threshold", "risetime", "halfwidth", "maxrise", "maxdecay",
+                           "slope_ratio", "latency", "slope" };
+    std::size_t n_keys = sizeof(keys)/sizeof(keys[0]);
+    double dt = job.dt;
+    PyObject* retDict = PyDict_New( );
+    for (std::size_t n_k = 0; n_k < n_keys; ++n_k) {
+        npy_intp dims[1] = {(npy_intp)results.size()};
+        PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+        if ( np_array == NULL ) {
+            Py_DECREF( retDict );
+            return NULL;
+        }
+        double* column = (double*)array_data(np_array);
+        for (std::size_t n = 0; n < results.size(); ++n) {
+            const stfnum::MeasurementResults& res = results[n];
+            switch (n_k) {
+             case 0: column[n] = (double)secs[n]; break;
+             case 1: column[n] = res.base; break;
+             case 2: column[n] = res.baseSD; break;
+             case 3: column[n] = res.peak; break;
+             case 4: column[n] = res.peak - res.base; break;
+             case 5: column[n] = res.maxT*dt; break;
+             case 6: column[n] = res.threshold; break;
+             case 7: column[n] = (res.tHiReal - res.tLoReal)*dt; break;
+             case 8: column[n] = (res.t50RightReal - res.t50LeftReal)*dt; break;
+             case 9: column[n] = res.maxRise; break;
+             case 10: column[n] = res.maxDecay; break;
+             case 11: column[n] = res.slopeRatio; break;
+             case 12: column[n] = res.latency*dt; break;
+             default: column[n] = res.regression.slope; break;
+            }
+        }
+        PyDict_SetItemString( retDict, keys[n_k], np_array );
+        Py_DECREF( np_array );
+    }
+    return retDict;
+}
+
 PyObject* get_selected_indices() {
     if ( !check_doc() ) return NULL;
     
@@ -1489,12 +1843,8 @@ void _gMatrix_resize( std::size_t channels, std::size_t sections ) {
 }
 
 void _gMatrix_at( double* invec, int size, int channel, int section ) {
-    std::vector< double > va(size);
-    std::copy( &invec[0], &invec[size], va.begin() );
-
     try{
-        gMatrix.at(channel).at(section).resize( va.size() );
-        gMatrix[channel][section] = va;
+        gMatrix.at(channel).at(section).assign( &invec[0], &invec[size] );
     }
     catch (const std::out_of_range& e) {
         wxString msg(wxT("Out of range exception in _gMatrix_at:\n"));
@@ -1595,7 +1945,8 @@ void align_selected(  double (*alignment)( bool ), bool active ) {
     
     int new_size=(int)(pDoc->get()[0][pDoc->GetSelectedSections()[0]].size()-(max_index-min_index));
 
-    Recording Aligned( pDoc->size(), pDoc->GetSelectedSections().size(), new_size );
+    // the channels are filled below:
+    Recording Aligned( pDoc->size() );
 
     ch_it chan_it;       // Channel iterator
     std::size_t n_ch = 0;
@@ -1612,21 +1963,20 @@ void align_selected(  double (*alignment)( bool ), bool active ) {
               sel_it != pDoc->GetSelectedSections().end() && it3 != shift.end();
               ++sel_it )
         {
-            Vector_double va( new_size );
-            std::copy( &(chan_it->at( *sel_it ).get_w()[ 0 + (*it3) ]), 
-                       &(chan_it->at( *sel_it ).get_w()[ (*it3) + new_size ]),
-                       &va[0] );
-            Section sec(va);
-            ch.InsertSection(sec, n_sec++);
+            // read-only access doesn't decode mapped sections for good:
+            const Section& source = chan_it->at( *sel_it );
+            Section sec( new_size );
+            source.CopyRange( *it3, *it3 + new_size, &sec.get_w()[0] );
+            ch.InsertSection(STFIO_MOVE(sec), n_sec++);
             ++it3;
         }
-        Aligned.InsertChannel( ch, n_ch++ );
+        Aligned.InsertChannel( STFIO_MOVE(ch), n_ch++ );
     }
     
     wxString title( pDoc->GetTitle() );
     title += wxT(", aligned");
     Aligned.CopyAttributes( *pDoc );
-    wxStfDoc* testDoc = wxGetApp().NewChild(Aligned, pDoc, title);
+    wxStfDoc* testDoc = wxGetApp().NewChild(STFIO_MOVE(Aligned), pDoc, title);
     if ( testDoc == NULL ) {
         ShowError( wxT("Failed to create a new window.") );
     }
@@ -1668,7 +2018,7 @@ PyObject* leastsq( int fselect, bool refresh ) {
 
     std::vector< double > x( pDoc->GetFitEnd() - pDoc->GetFitBeg() );
     //fill array:
-    std::copy(&pDoc->cursec()[pDoc->GetFitBeg()], &pDoc->cursec()[pDoc->GetFitEnd()], &x[0]);
+    pDoc->cursec().CopyRange( pDoc->GetFitBeg(), pDoc->GetFitEnd(), x.empty() ? NULL : &x[0] );
     
     std::vector< double > params( n_params );            
 
@@ -1727,6 +2077,326 @@ PyObject* leastsq( int fselect, bool refresh ) {
 }
 
 #ifdef WITH_PYTHON
+PyObject* leastsq_events( int fselect, int pre, int length, const std::vector<double>& p0 ) {
+    wrap_array();
+
+    if ( !check_doc() ) return NULL;
+
+    wxStfDoc* pDoc = actDoc();
+    const stf::SectionAttributes& attr = pDoc->GetCurrentSectionAttributes();
+    std::vector<std::size_t> onsets;
+    for (c_event_it cit = attr.eventList.begin(); cit != attr.eventList.end(); ++cit) {
+        if ( !cit->GetDiscard() ) {
+            onsets.push_back( cit->GetEventStartIndex() );
+        }
+    }
+    if ( onsets.empty() ) {
+        ShowError( wxT("No events in the current trace; detect events first") );
+        return NULL;
+    }
+    if ( pre < 0 ) {
+        ShowError( wxT("pre mustn't be negative in leastsq_events()") );
+        return NULL;
+    }
+    if ( length < 0 ) {
+        length = (int)attr.eventList.front().GetEventSize();
+    }
+
+    try {
+        const stfnum::storedFunc& func = wxGetApp().GetFuncLib().at(fselect);
+        Vector_double params( p0.begin(), p0.end() );
+        if ( params.empty() ) {
+            // initialize parameters from the window of the first event, as in leastsq():
+            std::size_t fitBeg = onsets[0] >= (std::size_t)pre ? onsets[0]-pre : 0;
+            std::size_t fitEnd = std::min( fitBeg+length, pDoc->cursec().size() );
+            Vector_double x( fitEnd-fitBeg );
+            pDoc->cursec().CopyRange( fitBeg, fitEnd, x.empty() ? NULL : &x[0] );
+            params.resize( func.pInfo.size() );
+            func.init( x, pDoc->GetBase(), pDoc->GetPeak(), pDoc->GetRTLoHi(),
+                       pDoc->GetHalfDuration(), pDoc->GetXScale(), params );
+        }
+        stfnum::Table table = stfnum::fitEvents( pDoc->cursec(), pDoc->GetXScale(), onsets,
+                                                 pre, length, func, stfnum::LM_default_opts(),
+                                                 true, params );
+
+        // one array per column; events that couldn't be fitted are NaN:
+        PyObject* retDict = PyDict_New( );
+        for ( std::size_t n_c = 0; n_c < table.nCols(); ++n_c ) {
+            npy_intp dims[1] = {(npy_intp)table.nRows()};
+            PyObject* np_array = PyArray_SimpleNew(1, dims, NPY_DOUBLE);
+            if ( np_array == NULL ) {
+                Py_DECREF( retDict );
+                return NULL;
+            }
+            double* column = (double*)array_data(np_array);
+            for ( std::size_t n_r = 0; n_r < table.nRows(); ++n_r ) {
+                column[n_r] = table.IsEmpty(n_r, n_c) ? NAN : table.at(n_r, n_c);
+            }
+            PyDict_SetItemString( retDict, table.GetColLabel(n_c).c_str(), np_array );
+            Py_DECREF( np_array );
+        }
+        return retDict;
+    }
+    catch (const std::exception& e) {
+        ShowExcept( e );
+        return NULL;
+    }
+}
+
+namespace {
+
+// A fit model whose values and optional jacobian are computed by Python
+// callables. The callables receive all x-values at once, so that they're
+// called once per iteration rather than once per data point.
+struct PyFitModel {
+    PyFitModel( PyObject* model_, PyObject* jac_ ) : model(model_), jac(jac_), error() {
+        Py_INCREF( model );
+        Py_XINCREF( jac );
+    }
+    ~PyFitModel() {
+        PyGILState_STATE state = PyGILState_Ensure();
+        Py_DECREF( model );
+        Py_XDECREF( jac );
+        PyGILState_Release( state );
+    }
+
+    // Calls model or jac with the x-values and the parameters as NumPy arrays.
+    // The GIL is only held during the call, so that the optimizer can run
+    // without it. Values are NaN after a callable has failed; the first
+    // error is kept in error.
+    void Call( PyObject* callable, const double* x, std::size_t n, const double* p,
+               std::size_t n_p, double* out, std::size_t n_out )
+    {
+        PyGILState_STATE state = PyGILState_Ensure();
+        bool success = false;
+        if ( error.empty() ) {
+            npy_intp xdims[1] = {(npy_intp)n};
+            npy_intp pdims[1] = {(npy_intp)n_p};
+            // the x-values are shared; the parameters are copied because
+            // the optimizer reuses their buffer:
+            PyObject* x_array = PyArray_SimpleNewFromData(1, xdims, NPY_DOUBLE, (void*)x);
+            PyObject* p_array = PyArray_SimpleNew(1, pdims, NPY_DOUBLE);
+            PyObject* result = NULL;
+            if ( x_array != NULL && p_array != NULL ) {
+                std::copy( p, p+n_p, (double*)array_data(p_array) );
+                result = PyObject_CallFunctionObjArgs( callable, x_array, p_array, NULL );
+            }
+            Py_XDECREF( x_array );
+            Py_XDECREF( p_array );
+            if ( result != NULL ) {
+                PyObject* values = PyArray_FROM_OTF( result, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY );
+                Py_DECREF( result );
+                if ( values != NULL ) {
+                    if ( (std::size_t)PyArray_SIZE( (PyArrayObject*)values ) == n_out ) {
+                        const double* data = (const double*)array_data( values );
+                        std::copy( data, data+n_out, out );
+                        success = true;
+                    } else {
+                        std::ostringstream msg;
+                        msg << "The fit model returned " << PyArray_SIZE( (PyArrayObject*)values )
+                            << " values instead of " << n_out;
+                        error = msg.str();
+                    }
+                    Py_DECREF( values );
+                }
+            }
+            if ( !success && error.empty() ) {
+                PyObject *type = NULL, *value = NULL, *traceback = NULL;
+                PyErr_Fetch( &type, &value, &traceback );
+                PyObject* str = value != NULL ? PyObject_Str( value ) : NULL;
+                error = str != NULL ? py_string( str ) : std::string();
+                if ( error.empty() ) {
+                    error = "The fit model has raised an exception";
+                }
+                Py_XDECREF( str );
+                Py_XDECREF( type );
+                Py_XDECREF( value );
+                Py_XDECREF( traceback );
+            }
+            PyErr_Clear();
+        }
+        PyGILState_Release( state );
+        if ( !success ) {
+            std::fill( out, out+n_out, NAN );
+        }
+    }
+
+    PyObject* model;
+    PyObject* jac;
+    std::string error;
+};
+
+#if (__cplusplus < 201103)
+typedef boost::shared_ptr<PyFitModel> PyFitModelPtr;
+#else
+typedef std::shared_ptr<PyFitModel> PyFitModelPtr;
+#endif
+
+// The callables of a stfnum::storedFunc that evaluate a PyFitModel:
+struct PyModelFunc {
+    PyFitModelPtr m;
+    double operator()( double x, const Vector_double& p ) const {
+        double y = 0;
+        m->Call( m->model, &x, 1, &p[0], p.size(), &y, 1 );
+        return y;
+    }
+};
+
+struct PyModelJac {
+    PyFitModelPtr m;
+    Vector_double operator()( double x, const Vector_double& p ) const {
+        Vector_double jac( p.size() );
+        m->Call( m->jac, &x, 1, &p[0], p.size(), &jac[0], jac.size() );
+        return jac;
+    }
+};
+
+struct PyModelBatchFunc {
+    PyFitModelPtr m;
+    void operator()( const double* x, std::size_t n, const double* p, std::size_t n_p, double* out ) const {
+        m->Call( m->model, x, n, p, n_p, out, n );
+    }
+};
+
+struct PyModelBatchJac {
+    PyFitModelPtr m;
+    void operator()( const double* x, std::size_t n, const double* p, std::size_t n_p, double* out ) const {
+        m->Call( m->jac, x, n, p, n_p, out, n*n_p );
+    }
+};
+
+// The parameters of a Python model are passed to leastsq():
+void py_model_init( const Vector_double&, double, double, double, double, double, Vector_double& ) {}
+
+// Fitted sections keep a pointer to their function, so that the functions
+// of Python models have to live as long as the application:
+struct PyModelEntry {
+    PyFitModelPtr model;
+    stfnum::storedFunc func;
+};
+
+std::deque<PyModelEntry>& py_models() {
+    // never destroyed, since the interpreter may be gone at exit:
+    static std::deque<PyModelEntry>* models = new std::deque<PyModelEntry>;
+    return *models;
+}
+
+PyModelEntry& get_py_model( PyObject* model, PyObject* jac, const std::vector<std::string>& names ) {
+    std::deque<PyModelEntry>& pyModels = py_models();
+    for (std::size_t n = 0; n < pyModels.size(); ++n) {
+        const stfnum::storedFunc& func = pyModels[n].func;
+        bool sameNames = func.pInfo.size() == names.size();
+        for (std::size_t n_p = 0; sameNames && n_p < names.size(); ++n_p) {
+            sameNames = func.pInfo[n_p].desc == names[n_p];
+        }
+        if ( pyModels[n].model->model == model && pyModels[n].model->jac == jac && sameNames ) {
+            return pyModels[n];
+        }
+    }
+    PyFitModelPtr pyModel( new PyFitModel( model, jac ) );
+    std::vector<stfnum::parInfo> pInfo;
+    for (std::size_t n_p = 0; n_p < names.size(); ++n_p) {
+        pInfo.push_back( stfnum::parInfo( names[n_p], true ) );
+    }
+    PyModelFunc func = { pyModel };
+    PyModelJac jacFunc = { pyModel };
+    PyModelBatchFunc batchFunc = { pyModel };
+    PyModelBatchJac batchJac = { pyModel };
+    PyObject* name = PyObject_GetAttrString( model, "__name__" );
+    std::string modelName = name != NULL ? py_string( name ) : std::string();
+    Py_XDECREF( name );
+    PyErr_Clear();
+    PyModelEntry entry = {
+        pyModel,
+        stfnum::storedFunc( modelName.empty() ? "Python model" : modelName, pInfo, func,
+                            py_model_init, jac != NULL ? stfnum::Jac(jacFunc) : stfnum::Jac(stfnum::nojac),
+                            jac != NULL, stfnum::defaultOutput, batchFunc,
+                            jac != NULL ? stfnum::BatchJac(batchJac) : stfnum::BatchJac() )
+    };
+    pyModels.push_back( entry );
+    return pyModels.back();
+}
+
+}
+
+PyObject* _leastsq_model( PyObject* model, const std::vector<double>& p0, PyObject* jac,
+                          const std::vector<std::string>& names, bool refresh )
+{
+    wrap_array();
+
+    if ( !check_doc() ) return NULL;
+
+    if ( jac == Py_None ) {
+        jac = NULL;
+    }
+    if ( !PyCallable_Check( model ) || (jac != NULL && !PyCallable_Check( jac )) ) {
+        ShowError( wxT("The fit model and its jacobian have to be callable in leastsq()") );
+        return NULL;
+    }
+    if ( p0.empty() ) {
+        ShowError( wxT("Initial parameters (p0) are required to fit a Python model in leastsq()") );
+        return NULL;
+    }
+    if ( !names.empty() && names.size() != p0.size() ) {
+        ShowError( wxT("Number of parameter names and initial parameters differ in leastsq()") );
+        return NULL;
+    }
+    std::vector<std::string> parNames( names );
+    for (std::size_t n_p = parNames.size(); n_p < p0.size(); ++n_p) {
+        std::ostringstream name;
+        name << "p" << n_p;
+        parNames.push_back( name.str() );
+    }
+    PyModelEntry& entry = get_py_model( model, jac, parNames );
+
+    wxStfDoc* pDoc = actDoc();
+    if ( pDoc->GetFitEnd() <= pDoc->GetFitBeg() || pDoc->GetFitEnd() > pDoc->cursec().size() ) {
+        ShowError( wxT("Fit cursors out of range in leastsq()") );
+        return NULL;
+    }
+    Vector_double x( pDoc->GetFitEnd() - pDoc->GetFitBeg() );
+    pDoc->cursec().CopyRange( pDoc->GetFitBeg(), pDoc->GetFitEnd(), &x[0] );
+    Vector_double params( p0 );
+    std::string fitInfo, fitError;
+    int fitWarning = 0;
+    double chisqr = 0.0;
+    entry.model->error.clear();
+    // the callbacks acquire the GIL while they're called:
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        chisqr = stfnum::lmFit( x, pDoc->GetXScale(), entry.func, stfnum::LM_default_opts(),
+                                false, params, fitInfo, fitWarning );
+    }
+    catch (const std::exception& e) {
+        fitError = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if ( fitError.empty() ) {
+        fitError = entry.model->error;
+    }
+    if ( !fitError.empty() ) {
+        ShowError( stf::std2wx( fitError ) );
+        return NULL;
+    }
+    pDoc->SetIsFitted( pDoc->GetCurChIndex(), pDoc->GetCurSecIndex(), params, &entry.func,
+                       chisqr, pDoc->GetFitBeg(), pDoc->GetFitEnd() );
+
+    if ( refresh ) {
+        if ( !refresh_graph() ) return NULL;
+    }
+
+    PyObject* retDict = PyDict_New( );
+    for ( std::size_t n_dict = 0; n_dict < params.size(); ++n_dict ) {
+        PyObject* value = PyFloat_FromDouble( params[n_dict] );
+        PyDict_SetItemString( retDict, parNames[n_dict].c_str(), value );
+        Py_DECREF( value );
+    }
+    PyObject* value = PyFloat_FromDouble( chisqr );
+    PyDict_SetItemString( retDict, "SSE", value );
+    Py_DECREF( value );
+    return retDict;
+}
+
 PyObject* get_fit( int trace, int channel ) {
     wrap_array();
 
@@ -1870,8 +2540,8 @@ bool set_marker(double x, double y) {
     if ( !check_doc() )
         return false;
     try {
-        actDoc()->GetCurrentSectionAttributesW().pyMarkers.
-            push_back(stf::PyMarker(x,y));
+        stf::insertMarker(actDoc()->GetCurrentSectionAttributesW().pyMarkers,
+                          stf::PyMarker(x,y));
     }
     catch (const std::out_of_range& e) {
         wxString msg( wxT("Could not set the marker:\n") );
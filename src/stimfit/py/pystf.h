@@ -10,7 +10,12 @@
 std::string get_versionstring( );
 
 #ifdef WITH_PYTHON
-PyObject* get_trace(int trace=-1, int channel=-1);
+PyObject* get_trace(int trace=-1, int channel=-1, bool view=false);
+PyObject* get_traces(const std::vector<int>& traces=std::vector<int>(), int channel=-1, int start=0, int stop=-1);
+PyObject* running_mean( double* invec, int size, int binwidth );
+PyObject* threshold_crossings( double* invec, int size, double threshold, bool up = true );
+PyObject* get_amplitudes( const std::vector<int>& traces = std::vector<int>() );
+PyObject* measure_all( int channel = -1, const std::vector<int>& traces = std::vector<int>(), PyObject* plan = NULL );
 #endif
 
 bool new_window( double* invec, int size );
@@ -67,6 +72,11 @@ bool subtract_base( );
 int leastsq_param_size( int fselect );
 #ifdef WITH_PYTHON
 PyObject* leastsq( int fselect, bool refresh = true );
+PyObject* _leastsq_model( PyObject* model, const std::vector<double>& p0, PyObject* jac = NULL,
+                          const std::vector<std::string>& names = std::vector<std::string>(),
+                          bool refresh = true );
+PyObject* leastsq_events( int fselect, int pre = 0, int length = -1,
+                          const std::vector<double>& p0 = std::vector<double>() );
 PyObject* get_fit( int trace = -1, int channel = -1 );
 #endif 
 
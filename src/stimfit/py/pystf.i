@@ -18,6 +18,8 @@ application from the embedded python shell."
 %include "std_vector.i"
 namespace std {
     %template(vectord) vector<double>;
+    %template(vectori) vector<int>;
+    %template(vectors) vector<std::string>;
 };
 
 %init %{
@@ -56,9 +58,109 @@ channel -- ZERO-BASED index of the channel. This is independent
            of whether a channel is active or not.
            The default value of -1 returns the currently
            active channel.
+view --    If False, the samples are copied. If True, the
+           returned array is a read-only view of the samples,
+           which avoids the copy for long traces. The view
+           keeps the samples alive, and it isn't affected
+           when the trace is changed afterwards.
 Returns:
 The trace as a 1D NumPy array.""") get_trace;
-PyObject* get_trace(int trace=-1, int channel=-1);
+PyObject* get_trace(int trace=-1, int channel=-1, bool view=false);
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) get_traces;
+%feature("kwargs") get_traces;
+%feature("docstring", """Returns several traces as a 2-dimensional NumPy array.
+
+The traces are copied in parallel, and only the requested range
+of sampling points is read from memory-mapped files. This is
+much faster than calling get_trace() for every trace.
+
+Arguments:       
+traces --  List of ZERO-BASED trace indices within the channel.
+           The default empty list returns all traces.
+channel -- ZERO-BASED index of the channel. The default value
+           of -1 returns traces of the currently active channel.
+start --   ZERO-BASED index of the first sampling point.
+stop --    Index past the last sampling point. The default value
+           of -1 stops at the end of the shortest trace.
+Returns:
+A 2D NumPy array with one row per trace.""") get_traces;
+PyObject* get_traces(const std::vector<int>& traces=std::vector<int>(), int channel=-1, int start=0, int stop=-1);
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) running_mean;
+%feature("docstring", "Computes a running mean of a 1D NumPy array.
+Point i of the result is the mean of binwidth points starting
+at point i, or of all remaining points near the end of the array.
+
+Arguments:
+invec --    The NumPy array to be averaged.
+binwidth -- Number of points that are averaged.
+
+Returns:
+The running mean as a 1D NumPy array of the same size.") running_mean;
+PyObject* running_mean( double* invec, int size, int binwidth );
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) threshold_crossings;
+%feature("docstring", "Finds the points where a 1D NumPy array
+crosses a threshold. An event starts at the first point beyond
+the threshold and lasts until the data return to the threshold.
+
+Arguments:
+invec --     The NumPy array to be searched for events.
+threshold -- The detection threshold.
+up --        True for events that exceed the threshold, False
+             for events that fall below it.
+
+Returns:
+The ZERO-BASED index of the first point of each event as a
+1D NumPy array.") threshold_crossings;
+PyObject* threshold_crossings( double* invec, int size, double threshold, bool up = true );
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) get_amplitudes;
+%feature("docstring", "Measures the amplitude (peak-base) of several
+traces of the active channel with the current cursor settings.
+The traces are measured in parallel.
+
+Arguments:
+traces -- List of ZERO-BASED trace indices. The default empty
+          list measures all traces.
+
+Returns:
+The amplitudes as a 1D NumPy array.") get_amplitudes;
+PyObject* get_amplitudes( const std::vector<int>& traces = std::vector<int>() );
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) measure_all;
+%feature("docstring", "Measures several traces with the current cursor
+settings in parallel. Unlike set_trace() followed by measure(), this
+neither changes the active trace nor redraws the window.
+
+Arguments:
+channel -- ZERO-BASED index of the channel. Default value of -1
+           measures the active channel.
+traces  -- List of ZERO-BASED trace indices. The default empty
+           list measures all traces.
+plan    -- Optional dictionary that overrides cursor settings for
+           this call. Positions are given in sampling points:
+           base_start, base_end, peak_start, peak_end, slope_start,
+           slope_end, peak_mean (number of points),
+           direction ('up', 'down' or 'both'), rise_factor (percent).
+
+Returns:
+A dictionary of 1D NumPy arrays with one value per trace: trace,
+base, base_sd, peak, amplitude, peak_time, threshold, risetime,
+halfwidth, maxrise, maxdecay, slope_ratio, latency and slope.
+Times are given in x units.") measure_all;
+PyObject* measure_all( int channel = -1, const std::vector<int>& traces = std::vector<int>(), PyObject* plan = NULL );
 //--------------------------------------------------------------------
 
 //--------------------------------------------------------------------
@@ -350,22 +452,47 @@ bool subtract_base( );
 //--------------------------------------------------------------------
 
 //--------------------------------------------------------------------
+%rename(_leastsq) leastsq;
 %feature("autodoc", 0) leastsq;
-%feature("kwargs") leastsq;
-%feature("docstring", "Fits a function to the data between the current
-fit cursors.
+%feature("docstring", "Fits a function of the library to the data between
+the current fit cursors. Do not use directly; use leastsq() instead.") leastsq;
+PyObject* leastsq( int fselect, bool refresh = true );
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) _leastsq_model;
+%feature("docstring", "Fits a Python model to the data between the
+current fit cursors. Do not use directly; use leastsq() instead.") _leastsq_model;
+PyObject* _leastsq_model( PyObject* model, const std::vector<double>& p0, PyObject* jac = NULL,
+                          const std::vector<std::string>& names = std::vector<std::string>(),
+                          bool refresh = true );
+//--------------------------------------------------------------------
+
+//--------------------------------------------------------------------
+%feature("autodoc", 0) leastsq_events;
+%feature("kwargs") leastsq_events;
+%feature("docstring", "Fits a function to every event of the current
+trace that hasn't been discarded. The events are fitted in parallel,
+each in its own window of the trace, without extracting them first.
 
 Arguments:
 fselect -- Zero-based index of the function as it appears in the fit
            selection dialog.
-refresh -- To avoid flicker during batch analysis, this may be set to
-           False so that the fitted function will not immediately
-           be drawn.
+pre --     Number of sampling points of the fit windows before the
+           onsets of the events.
+length --  Number of sampling points of the fit windows. The default
+           value of -1 uses the size of the detected events.
+p0 --      Initial parameters of all fits. By default, they are
+           initialized from the window of the first event as in
+           leastsq().
 
 Returns:
-A dictionary with the best-fit parameters and the least-squared
-error, or a null pointer upon failure.") leastsq;
-PyObject* leastsq( int fselect, bool refresh = true );
+A dictionary with one NumPy array per column: the onsets of the
+events, the best-fit parameters, the least-squared errors and the
+warning codes of the fits. Values of events that couldn't be fitted
+are NaN, or a null pointer upon failure.") leastsq_events;
+PyObject* leastsq_events( int fselect, int pre = 0, int length = -1,
+                          const std::vector<double>& p0 = std::vector<double>() );
 //--------------------------------------------------------------------
 
 //--------------------------------------------------------------------
@@ -1526,6 +1653,47 @@ class StfException(Exception):
     def __str__(self):
         return repr(self.msg)
 
+def leastsq( fselect, refresh=True, p0=None, jac=None, names=None ):
+    """Fits a function to the data between the current fit cursors.
+
+    Arguments:
+    fselect -- Zero-based index of the function as it appears in the fit
+               selection dialog, or a Python model. A model is called
+               as fselect(x, p) with all x-values of the fit window
+               (starting at 0, in x units) and the parameters as 1D
+               NumPy arrays, and returns the function values as an
+               array of the same size as x. It is called once per
+               iteration rather than once per data point.
+    refresh -- To avoid flicker during batch analysis, this may be set to
+               False so that the fitted function will not immediately
+               be drawn.
+    p0 --      Initial parameters; required for Python models.
+    jac --     Optional jacobian of a Python model, called like the
+               model. Returns an array of len(x) rows with the
+               derivatives with respect to all parameters. Finite
+               differences are used if it is None.
+    names --   Optional names of the parameters of a Python model;
+               "p0", "p1", ... by default.
+
+    Returns:
+    A dictionary with the best-fit parameters and the least-squared
+    error, or a null pointer upon failure.
+
+    Example:
+    def biexp(x, p):
+        return p[0]*(np.exp(-x/p[1]) - np.exp(-x/p[2])) + p[3]
+    stf.leastsq(biexp, p0=[-50, 10, 1, 0], names=["amp", "tau_decay", "tau_rise", "offset"])
+    """
+    if callable(fselect):
+        if p0 is None:
+            p0 = []
+        if names is None:
+            names = []
+        return _leastsq_model( fselect, [float(p) for p in p0], jac,
+                               [str(name) for name in names], refresh )
+
+    return _leastsq( fselect, refresh )
+
 def new_window_list( array_list ):
     """Creates a new window showing a sequence of
     1D NumPy arrays, or a sequence of a sequence of 1D
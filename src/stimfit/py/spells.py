@@ -95,21 +95,9 @@ def rmean(binwidth, trace=-1, channel=-1):
     # loads the current trace of the channel in a 1D Numpy Array
     sweep = stf.get_trace(trace, channel)
 
-    # creates a destination python list to append the data
-    dsweep = np.empty((len(sweep)))
-
-    # running mean algorithm
-    for i in range(len(sweep)):
-
-        if (len(sweep)-i) > binwidth:
-            # append to list the running mean of `binwidth` values
-            # np.mean(sweep) calculates the mean of list
-            dsweep[i] = np.mean( sweep[i:(binwidth+i)] )
-
-        else:
-            # use all remaining points for the average:
-            dsweep[i] = np.mean( sweep[i:] )
-
+    # running mean of `binwidth` values; near the end of the trace,
+    # all remaining points are averaged:
+    dsweep = stf.running_mean(sweep, binwidth)
 
     stf.new_window(dsweep)
 
@@ -155,10 +143,8 @@ def get_amplitude(base, peak, delta, trace=None):
     if not(stf.set_peak_end(peak+delta, True)): 
         return False
 
-    # update measurements
-    stf.set_trace(sweep)
-
-    amplitude = stf.get_peak()-stf.get_base()
+    # measure the trace with the new cursors
+    amplitude = stf.get_amplitudes([sweep])[0]
 
     return amplitude
 
@@ -196,10 +182,10 @@ def cut_sweeps(start, delta, sequence=None):
     pstart = int( round(start/dt) )
     pdelta = int( round(delta/dt) )
 
-    # creates a destination python list
-    dlist = [ stf.get_trace(i)[pstart:(pstart+pdelta)] for i in sequence ]
+    # copies only the sampling points to be cut, one row per trace
+    darray = stf.get_traces(list(sequence), start=pstart, stop=pstart+pdelta)
 
-    return stf.new_window_list(dlist)
+    return stf.new_window_matrix(darray)
 
 def count_events(start, delta, threshold=0, up=True, trace=None, mark=True):
     """
@@ -248,27 +234,14 @@ def count_events(start, delta, threshold=0, up=True, trace=None, mark=True):
     # select the section of interest within the trace
     selection = stf.get_trace()[pstart:(pstart+pdelta)]
 
-    # algorithm to detect events
-    event_counter, i = 0, 0 # set counter and index to zero
+    # first point of each event
+    crossings = stf.threshold_crossings(selection, threshold, up)
 
-    # choose comparator according to direction:
-    if up:
-        comp = lambda a, b: a > b
-    else:
-        comp = lambda a, b: a < b
-
-    # run the loop
-    while i < len(selection):
-        if comp(selection[i], threshold):
-            event_counter += 1
-            if mark:
-                stf.set_marker(pstart+i, selection[i])
-            while i < len(selection) and comp(selection[i], threshold):
-                i += 1 # skip  until value is below/above threshold
-        else:
-            i += 1
-
-    return event_counter
+    if mark:
+        for i in crossings:
+            stf.set_marker(pstart+i, selection[i])
+
+    return len(crossings)
 
 class Spike(object):
     """ 
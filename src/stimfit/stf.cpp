@@ -21,7 +21,10 @@
  *  Implements some general functions within the stf namespace
  */
 
+#include <algorithm>
+
 #include "stf.h"
+#include "./../libstfio/ascii/asciilib.h"
 
 #if 0
 wxString stf::sectionToString(const Section& section) {
@@ -32,25 +35,39 @@ wxString stf::sectionToString(const Section& section) {
     }
     return retString;
 }
+#endif
 
 wxString stf::CreatePreview(const wxString& fName) {
-    ifstreamMan ASCIIfile( fName );
-    // Stop reading if we are either at the end or at line 100:
-    wxString preview;
-	ASCIIfile.myStream.ReadAll( &preview );
-    return preview;
+    // Only the start of the file is read:
+    return stf::std2wx(stfio::previewTextFile(stf::wx2std(fName), 100).text);
 }
-#endif
 
-stf::wxProgressInfo::wxProgressInfo(const std::string& title, const std::string& message, int maximum, bool verbose)
-    : ProgressInfo(title, message, maximum, verbose),
-      pd(stf::std2wx(title), stf::std2wx(message), maximum, NULL, wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_APP_MODAL )
+stf::wxProgressInfo::wxProgressInfo(const std::string& title, const std::string& message, int maximum_, bool verbose)
+    : ProgressInfo(title, message, maximum_, verbose),
+      pd(stf::std2wx(title), stf::std2wx(message), maximum_, NULL, wxPD_SMOOTH | wxPD_AUTO_HIDE | wxPD_APP_MODAL ),
+      maximum(maximum_), lastUpdate(0), proceed(true), skipped(false)
 {
     
 }
 
 bool stf::wxProgressInfo::Update(int value, const std::string& newmsg, bool* skip) {
-    return pd.Update(value, stf::std2wx(newmsg), skip);
+    // Repainting the dialog costs far more than the loops that report their
+    // progress, so updates within a frame interval (40 ms) are dropped:
+    wxLongLong now = wxGetLocalTimeMillis();
+    if (value < maximum && now - lastUpdate < 40) {
+        if (skip != NULL) {
+            *skip = skipped;
+        }
+        return proceed;
+    }
+    lastUpdate = now;
+    bool skipNow = false;
+    proceed = pd.Update(value, stf::std2wx(newmsg), &skipNow);
+    skipped = skipNow;
+    if (skip != NULL) {
+        *skip = skipped;
+    }
+    return proceed;
 }
 
 std::string stf::wx2std(const wxString& wxs) {
@@ -82,20 +99,48 @@ wxString stf::std2wx(const std::string& sst) {
 stf::SectionAttributes::SectionAttributes() :
     eventList(),pyMarkers(),isFitted(false),
     isIntegrated(false),fitFunc(NULL),bestFitP(0),quad_p(0),storeFitBeg(0),storeFitEnd(0),
-    storeIntBeg(0),storeIntEnd(0),bestFit(0,0)
+    storeIntBeg(0),storeIntEnd(0),bestFit(0,0),fitCache()
 {}
 
-stf::SectionPointer::SectionPointer(Section* pSec, const stf::SectionAttributes& sa) :
-    pSection(pSec), sec_attr(sa)
+stf::SectionPointer::SectionPointer(Section* pSec, const stf::SectionAttributes* pSa) :
+    pSection(pSec), pSecAttr(pSa)
 {}
 
-stf::Event::Event(std::size_t start, std::size_t peak, std::size_t size, wxCheckBox* cb) :
-    eventStartIndex(start), eventPeakIndex(peak), eventSize(size), checkBox(cb)
-{
-    checkBox->Show(true);
-    checkBox->SetValue(true);
+stf::Event::Event(std::size_t start, std::size_t peak, std::size_t size, bool discard_) :
+    eventStartIndex(start), eventPeakIndex(peak), eventSize(size), discard(discard_)
+{}
+
+namespace {
+
+    bool startsBefore(double index, const stf::Event& event) {
+        return index < (double)event.GetEventStartIndex();
+    }
+
+    bool markerBefore(double x, const stf::PyMarker& marker) {
+        return x < marker.x;
+    }
+
 }
 
-stf::Event::~Event()
-{
+std::size_t stf::insertEvent(std::vector<Event>& events, const Event& event) {
+    event_it it = std::upper_bound(events.begin(), events.end(),
+                                   (double)event.GetEventStartIndex(), startsBefore);
+    return events.insert(it, event) - events.begin();
+}
+
+std::size_t stf::eventAt(const std::vector<Event>& events, double index) {
+    c_event_it it = std::upper_bound(events.begin(), events.end(), index, startsBefore);
+    if (it == events.begin()) {
+        return events.size();
+    }
+    --it;
+    if (index >= (double)(it->GetEventStartIndex() + it->GetEventSize())) {
+        return events.size();
+    }
+    return it - events.begin();
+}
+
+std::size_t stf::insertMarker(std::vector<PyMarker>& markers, const PyMarker& marker) {
+    marker_it it = std::upper_bound(markers.begin(), markers.end(), marker.x, markerBefore);
+    return markers.insert(it, marker) - markers.begin();
 }
@@ -67,6 +67,7 @@
 
     #include <wx/wfstream.h>
     #include <wx/progdlg.h>
+    #include <wx/stopwatch.h>
 #else
     typedef std::string wxString;
     typedef int wxWindow;
@@ -76,6 +77,7 @@
 
 #include "../libstfio/stfio.h"
 #include "../libstfnum/stfnum.h"
+#include "../libstfio/fitcache.h"
 
 //! The stimfit namespace.
 /*! All essential core functions and classes are in this namespace. 
@@ -88,12 +90,20 @@ namespace stf {
  */
 
 //! Progress Info interface adapter; maps to wxProgressDialog
+/*! The dialog is repainted at most once per frame interval, however often
+ *  Update() is called. It may only be used on the GUI thread; workers
+ *  report their progress to a stfio::AtomicProgressInfo instead.
+ */
 class wxProgressInfo : public stfio::ProgressInfo {
 public:
     wxProgressInfo(const std::string& title, const std::string& message, int maximum, bool verbose=true);
     bool Update(int value, const std::string& newmsg="", bool* skip=NULL);
 private:
     wxProgressDialog pd;
+    int maximum;
+    wxLongLong lastUpdate;
+    // results of the last update that was shown:
+    bool proceed, skipped;
 };
 
 std::string wx2std(const wxString& wxs);
@@ -106,7 +116,8 @@ wxString std2wx(const std::string& sst);
 wxString sectionToString(const Section& section);
  
 //! Creates a preview of a text file.
-/*! \param fName Full path name of the file.
+/*! Reads at most 64 kB from the file; see stfio::previewTextFile().
+ *  \param fName Full path name of the file.
  *  \return A string showing at most the initial 100 lines of the text file.
  */
 wxString CreatePreview(const wxString& fName);
@@ -244,13 +255,19 @@ struct ofstreamMan {
 };
  
 //! Describes the attributes of an event.
+/*! Events are plain values; the check boxes that show whether an event is
+ *  discarded belong to the graph, which only creates them for the events
+ *  that are visible (see wxStfGraph::PlotEvents()).
+ */
 class Event {
 public:
     //! Constructor
-    explicit Event(std::size_t start, std::size_t peak, std::size_t size, wxCheckBox* cb);
-    
-    //! Destructor
-    ~Event();
+    /*! \param start The start index of the event within a section.
+     *  \param peak The index of the event's peak.
+     *  \param size The size of the event in units of data points.
+     *  \param discard true if the event should be discarded.
+     */
+    explicit Event(std::size_t start, std::size_t peak, std::size_t size, bool discard = false);
 
     //! Retrieves the start index of an event.
     /*! \return The start index of an event within a section. */
@@ -266,11 +283,7 @@ public:
 
     //! Indicates whether an event should be discarded.
     /*! \return true if it should be discarded, false otherwise. */
-    bool GetDiscard() const { return !checkBox->GetValue(); }
-
-    //! Get the check box associated with this event
-    /*! \return The wxCheckBox associated with this event  */
-    wxCheckBox* GetCheckBox() {return checkBox;}
+    bool GetDiscard() const { return discard; }
 
     //! Sets the start index of an event.
     /*! \param value The start index of an event within a section. */
@@ -285,17 +298,17 @@ public:
     void SetEventSize( std::size_t value ) { eventSize = value; }
 
     //! Determines whether an event should be discarded.
-    /*! \param true if it should be discarded, false otherwise. */
-    /*void SetDiscard( bool value ) { discard = value; }*/
+    /*! \param value true if it should be discarded, false otherwise. */
+    void SetDiscard( bool value ) { discard = value; }
 
     //! Sets discard to true if it was false and vice versa.
-    /*void ToggleStatus() { discard = !discard; }*/
+    void ToggleStatus() { discard = !discard; }
 
 private:
     std::size_t eventStartIndex;
     std::size_t eventPeakIndex;
     std::size_t eventSize;
-    wxCheckBox* checkBox;
+    bool discard;
 
 };
 
@@ -312,12 +325,38 @@ struct PyMarker {
     double y; /*!< y-coordinate in trace units (e.g. mV) */
 };
 
+//! Inserts an event into a list of events that is sorted by the events' start.
+/*! The list remains sorted, so that the events within a range can be
+ *  found with a binary search. Events that start at the same index keep
+ *  the order in which they have been inserted.
+ *  \param events The sorted list of events.
+ *  \param event The new event.
+ *  eturn The position of the new event within the list.
+ */
+StfDll std::size_t insertEvent(std::vector<Event>& events, const Event& event);
+
+//! Finds the event that contains a data point.
+/*! Takes O(log n) in the number of events.
+ *  \param events A list of events that is sorted by the events' start.
+ *  \param index The index of the data point within the section.
+ *  eturn The position of the last event that starts at or before \e index
+ *          and ends after it; events.size() if there is none.
+ */
+StfDll std::size_t eventAt(const std::vector<Event>& events, double index);
+
+//! Inserts a marker into a list of markers that is sorted by x.
+/*! \param markers The sorted list of markers.
+ *  \param marker The new marker.
+ *  \return The position of the new marker within the list.
+ */
+StfDll std::size_t insertMarker(std::vector<PyMarker>& markers, const PyMarker& marker);
+
 struct StfDll SectionAttributes {
     SectionAttributes();
     std::vector<stf::Event> eventList;
     std::vector<stf::PyMarker> pyMarkers;
     bool isFitted,isIntegrated;
-    stfnum::storedFunc *fitFunc;
+    const stfnum::storedFunc *fitFunc;
     Vector_double bestFitP;
     Vector_double quad_p;
     std::size_t storeFitBeg;
@@ -325,12 +364,17 @@ struct StfDll SectionAttributes {
     std::size_t storeIntBeg;
     std::size_t storeIntEnd;
     stfnum::Table bestFit;
+    stfio::FitCache fitCache;
 };
 
+//! A section and its attributes, as stored in a document.
+/*! The attributes aren't copied; the pointers are only valid as long as the
+ *  document isn't modified.
+ */
 struct SectionPointer {
-    SectionPointer(Section* pSec=NULL, const SectionAttributes& sa=SectionAttributes());
-    Section* pSection;
-    SectionAttributes sec_attr;
+    SectionPointer(Section* pSec=NULL, const SectionAttributes* pSa=NULL);
+    Section* pSection;                   /*!< The section. */
+    const SectionAttributes* pSecAttr;   /*!< Its attributes. */
 };
 
 //! Add decimals if you are not satisfied.
@@ -0,0 +1,108 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/align.h"
+#include "../libstfio/recording.h"
+#include "../libstfio/mappedfile.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Park-Miller minimal standard generator, uniform in [0, 1):
+class Uniform {
+public:
+    explicit Uniform(unsigned int seed) : state(seed) {}
+    double operator()() {
+        state = (unsigned int)(((unsigned long long)state * 48271u) % 2147483647u);
+        return (state - 1) / 2147483646.0;
+    }
+private:
+    unsigned int state;
+};
+
+// An event at t0 on a noisy baseline:
+Vector_double event(double t0, std::size_t n, Uniform& uniform) {
+    Vector_double data(n);
+    for (std::size_t k = 0; k < n; ++k) {
+        double t = k - t0;
+        data[k] = 0.05*(uniform()-0.5) + (t > 0 ? 10.0*(exp(-t/40.0) - exp(-t/4.0)) : 0.0);
+    }
+    return data;
+}
+
+const double onsets[5] = {300.0, 301.3, 297.25, 304.7, 299.5};
+
+}
+
+TEST(align_test, copy_interpolated) {
+    Vector_double data(10);
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        data[k] = k*k;
+    }
+    Section sec(data);
+    Vector_double x(3);
+    sec.CopyInterpolated(2.25, 3, &x[0]);
+    EXPECT_DOUBLE_EQ(x[0], 4.0 + 0.25*5.0);
+    EXPECT_DOUBLE_EQ(x[2], 16.0 + 0.25*9.0);
+    sec.CopyInterpolated(7.0, 3, &x[0]);
+    EXPECT_DOUBLE_EQ(x[2], 81.0);
+    EXPECT_THROW(sec.CopyInterpolated(7.5, 3, &x[0]), std::out_of_range);
+    EXPECT_THROW(sec.CopyInterpolated(-0.5, 3, &x[0]), std::out_of_range);
+
+    // compactly stored sections are interpolated alike:
+    std::vector<short> samples(data.begin(), data.end());
+    Section compact(stfio::compactSamples(samples, 1.0, 0.0));
+    Vector_double y(3);
+    compact.CopyInterpolated(2.25, 3, &y[0]);
+    EXPECT_DOUBLE_EQ(y[1], 9.0 + 0.25*7.0);
+}
+
+TEST(align_test, correlation_lags) {
+    Uniform uniform(11);
+    Channel ch(5);
+    for (std::size_t n = 0; n < 5; ++n) {
+        ch.InsertSection(Section(event(onsets[n], 1000, uniform)), n);
+    }
+    std::vector<std::size_t> sections;
+    for (std::size_t n = 0; n < 5; ++n) {
+        sections.push_back(n);
+    }
+
+    Vector_double lags = stfnum::correlationLags(ch, sections, 250, 550, 50, stfnum::reference_first);
+    ASSERT_EQ(lags.size(), 5u);
+    EXPECT_NEAR(lags[0], 0.0, 0.05);
+    for (std::size_t n = 1; n < 5; ++n) {
+        EXPECT_NEAR(lags[n], onsets[n]-onsets[0], 0.15);
+    }
+
+    // aligned to the average, the lags are centred on 0:
+    lags = stfnum::correlationLags(ch, sections, 250, 550, 50, stfnum::reference_average, 3, 2);
+    double mean_onset = 0.0, mean_lag = 0.0;
+    for (std::size_t n = 0; n < 5; ++n) {
+        mean_onset += onsets[n]/5;
+        mean_lag += lags[n]/5;
+    }
+    EXPECT_NEAR(mean_lag, 0.0, 1e-9);
+    for (std::size_t n = 0; n < 5; ++n) {
+        EXPECT_NEAR(lags[n], onsets[n]-mean_onset, 0.15);
+    }
+
+    // the fractional shifts align the events of the average:
+    std::size_t shift_size = 0;
+    Vector_double shift = stfnum::lagsToShifts(lags, shift_size);
+    EXPECT_EQ(shift_size, 8u);
+    Recording rec(ch);
+    Section average(1000-shift_size), sig(1000-shift_size);
+    rec.MakeAverage(average, sig, 0, sections, true, shift);
+    Vector_double single = event(onsets[2], 1000, uniform);
+    double peak_avg = *std::max_element(average.get().begin(), average.get().end());
+    double peak_single = *std::max_element(single.begin(), single.end());
+    EXPECT_NEAR(peak_avg, peak_single, 0.05);
+    EXPECT_LT(*std::max_element(sig.get().begin(), sig.get().end()), 0.2);
+
+    EXPECT_THROW(stfnum::correlationLags(ch, sections, 250, 1001, 50), std::out_of_range);
+    sections.push_back(5);
+    EXPECT_THROW(stfnum::correlationLags(ch, sections, 250, 550, 50), std::out_of_range);
+    shift.push_back(-1.0);
+    EXPECT_THROW(rec.MakeAverage(average, sig, 0, sections, true, shift), std::out_of_range);
+}
@@ -0,0 +1,62 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/arrowtable.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+
+TEST(ArrowTable_test, export) {
+    stfnum::Table table(3, 2);
+    table.SetColLabel(0, "Amplitude");
+    table.SetColLabel(1, "Rise time");
+    for (std::size_t n_r = 0; n_r < 3; ++n_r) {
+        table.SetRowLabel(n_r, n_r == 1 ? "" : "Event");
+        table.at(n_r, 0) = 1.5*n_r;
+        table.at(n_r, 1) = n_r;
+    }
+    table.SetEmpty(2, 1);
+
+    ArrowSchema schema;
+    ArrowArray array;
+    stfnum::exportArrowTable(table, "Label", &schema, &array);
+    EXPECT_STREQ( schema.format, "+s" );
+    ASSERT_EQ( schema.n_children, 3 );
+    EXPECT_STREQ( schema.children[0]->format, "u" );
+    EXPECT_STREQ( schema.children[0]->name, "Label" );
+    EXPECT_STREQ( schema.children[1]->format, "g" );
+    EXPECT_STREQ( schema.children[2]->name, "Rise time" );
+    EXPECT_EQ( schema.children[2]->flags, ARROW_FLAG_NULLABLE );
+
+    ASSERT_EQ( array.length, 3 );
+    ASSERT_EQ( array.n_children, 3 );
+    EXPECT_EQ( array.n_buffers, 1 );
+    const ArrowArray* labels = array.children[0];
+    ASSERT_EQ( labels->n_buffers, 3 );
+    const int32_t* offsets = static_cast<const int32_t*>(labels->buffers[1]);
+    EXPECT_EQ( offsets[1], 5 );
+    EXPECT_EQ( offsets[2], 5 );
+    EXPECT_EQ( offsets[3], 10 );
+    EXPECT_EQ( std::string(static_cast<const char*>(labels->buffers[2]), 10), "EventEvent" );
+
+    const ArrowArray* amplitude = array.children[1];
+    EXPECT_EQ( amplitude->null_count, 0 );
+    EXPECT_TRUE( amplitude->buffers[0] == NULL );
+    EXPECT_EQ( static_cast<const double*>(amplitude->buffers[1])[2], 3.0 );
+    const ArrowArray* rise = array.children[2];
+    EXPECT_EQ( rise->null_count, 1 );
+    EXPECT_EQ( *static_cast<const unsigned char*>(rise->buffers[0]), 3 );
+
+    // the arrays stay valid after the table is gone:
+    table = stfnum::Table(0, 0);
+    EXPECT_EQ( static_cast<const double*>(rise->buffers[1])[1], 1.0 );
+
+    // a child that the consumer has moved elsewhere is released on its own:
+    ArrowArray moved;
+    std::memcpy(&moved, array.children[1], sizeof(ArrowArray));
+    array.children[1]->release = NULL;
+    array.release(&array);
+    EXPECT_TRUE( array.release == NULL );
+    EXPECT_EQ( static_cast<const double*>(moved.buffers[1])[1], 1.5 );
+    moved.release(&moved);
+    schema.release(&schema);
+    EXPECT_TRUE( schema.release == NULL );
+}
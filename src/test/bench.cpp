@@ -0,0 +1,525 @@
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+// bench.cpp
+// Times the core numerical kernels and the file importers on fixed synthetic
+// data and writes the results as JSON, so that runs can be compared with each
+// other. Usage:
+//   stimfitbench [--quick] [--output results.json] [fixture files...]
+// Fixture files are imported with the filter that matches their extension.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../libstfio/stfio.h"
+#include "../libstfio/recording.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/section.h"
+#include "../libstfio/synth.h"
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/fit.h"
+#include "../libstfnum/funclib.h"
+#include "../libstfnum/measure.h"
+
+namespace {
+
+    // Wall clock time in seconds; CPU time would add up the threads of
+    // parallel kernels.
+    double now() {
+#ifdef _OPENMP
+        return omp_get_wtime();
+#else
+        return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+    }
+
+    // A fixed linear congruential generator, so that every run uses the same data:
+    class Noise {
+    public:
+        Noise(unsigned long seed) : state(seed) {}
+        // Uniformly distributed in [-0.5, 0.5):
+        double next() {
+            state = (state * 1103515245UL + 12345UL) & 0x7fffffffUL;
+            return (double)state / 2147483648.0 - 0.5;
+        }
+    private:
+        unsigned long state;
+    };
+
+    const double dt = 0.05;   // ms
+    const int SR = 20;        // kHz
+
+    // An alpha-shaped EPSC template with a negative peak of -1:
+    Vector_double makeTemplate(std::size_t n) {
+        Vector_double templ(n);
+        double tau = n / 8.0;
+        for (std::size_t i = 0; i < n; ++i) {
+            double t = i / tau;
+            templ[i] = -t * exp(1.0 - t);
+        }
+        return templ;
+    }
+
+    // Noisy trace with an event every \e interval points:
+    Vector_double makeTrace(std::size_t n, std::size_t interval, unsigned long seed) {
+        Noise noise(seed);
+        Vector_double templ = makeTemplate(200);
+        Vector_double trace(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            trace[i] = -60.0 + noise.next();
+        }
+        for (std::size_t onset = interval/2; onset + templ.size() < n; onset += interval) {
+            for (std::size_t i = 0; i < templ.size(); ++i) {
+                trace[onset+i] += 5.0 * templ[i];
+            }
+        }
+        return trace;
+    }
+
+    struct Result {
+        std::string group;
+        std::string name;
+        std::size_t n;
+        int iterations;
+        double best;
+        double median;
+        std::string error;
+    };
+
+    std::string jsonString(const std::string& s) {
+        std::string out("\"");
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            char c = s[i];
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if ((unsigned char)c < 0x20) {
+                char buf[8];
+                std::sprintf(buf, "\\u%04x", (unsigned char)c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+        return out;
+    }
+
+    // A benchmarked operation; run() is called once per iteration.
+    class Kernel {
+    public:
+        virtual ~Kernel() {}
+        virtual void run() = 0;
+    };
+
+    class Bench {
+    public:
+        Bench(bool quick_) : quick(quick_), results() {}
+
+        // Runs the kernel at least minIterations times and for at least minTime
+        // seconds, after a single warm-up run.
+        void time(const std::string& group, const std::string& name, std::size_t n, Kernel& kernel) {
+            Result res;
+            res.group = group;
+            res.name = name;
+            res.n = n;
+            res.iterations = 0;
+            res.best = res.median = 0;
+            const int minIterations = quick ? 1 : 5;
+            const int maxIterations = quick ? 3 : 1000;
+            const double minTime = quick ? 0.0 : 0.5;
+            try {
+                kernel.run();
+                std::vector<double> times;
+                double total = 0;
+                while ((int)times.size() < minIterations ||
+                       (total < minTime && (int)times.size() < maxIterations))
+                {
+                    double start = now();
+                    kernel.run();
+                    double elapsed = now() - start;
+                    times.push_back(elapsed);
+                    total += elapsed;
+                }
+                std::sort(times.begin(), times.end());
+                res.iterations = (int)times.size();
+                res.best = times.front();
+                res.median = times[times.size()/2];
+            }
+            catch (const std::exception& e) {
+                res.error = e.what();
+            }
+            std::cerr << group << "/" << name << ": ";
+            if (res.error.empty()) {
+                std::cerr << res.median * 1e3 << " ms\n";
+            } else {
+                std::cerr << "failed (" << res.error << ")\n";
+            }
+            results.push_back(res);
+        }
+
+        void write(std::ostream& out) const {
+            out << "{\n  \"openmp_threads\": ";
+#ifdef _OPENMP
+            out << omp_get_max_threads();
+#else
+            out << 1;
+#endif
+            out << ",\n  \"quick\": " << (quick ? "true" : "false");
+            out << ",\n  \"results\": [\n";
+            out.precision(6);
+            for (std::size_t n_r = 0; n_r < results.size(); ++n_r) {
+                const Result& res = results[n_r];
+                out << "    {\"group\": " << jsonString(res.group)
+                    << ", \"name\": " << jsonString(res.name)
+                    << ", \"n\": " << res.n
+                    << ", \"iterations\": " << res.iterations
+                    << ", \"best_s\": " << std::scientific << res.best
+                    << ", \"median_s\": " << res.median << std::fixed;
+                if (!res.error.empty()) {
+                    out << ", \"error\": " << jsonString(res.error);
+                }
+                out << "}" << (n_r + 1 < results.size() ? "," : "") << "\n";
+            }
+            out << "  ]\n}\n";
+        }
+
+    private:
+        bool quick;
+        std::vector<Result> results;
+    };
+
+    class FilterKernel : public Kernel {
+    public:
+        FilterKernel(const Vector_double& data_) : data(data_), a(1, 1.0) {}
+        void run() { stfnum::filter(data, 0, data.size()-1, a, SR, stfnum::fgaussColqu, false); }
+    private:
+        const Vector_double& data;
+        Vector_double a;
+    };
+
+    class DeconvolveKernel : public Kernel {
+    public:
+        DeconvolveKernel(const Vector_double& data_, const Vector_double& templ_) :
+            data(data_), templ(templ_), progDlg("", "", 100, false) {}
+        void run() { stfnum::deconvolve(data, templ, SR, 0.001, 0.5, progDlg); }
+    private:
+        const Vector_double& data;
+        const Vector_double& templ;
+        stfio::StdoutProgressInfo progDlg;
+    };
+
+    class CriterionKernel : public Kernel {
+    public:
+        CriterionKernel(const Vector_double& data_, const Vector_double& templ_) :
+            data(data_), templ(templ_), progDlg("", "", 100, false) {}
+        void run() { stfnum::detectionCriterion(data, templ, progDlg); }
+    private:
+        const Vector_double& data;
+        const Vector_double& templ;
+        stfio::StdoutProgressInfo progDlg;
+    };
+
+    class LinCorrKernel : public Kernel {
+    public:
+        LinCorrKernel(const Vector_double& data_, const Vector_double& templ_) :
+            data(data_), templ(templ_), progDlg("", "", 100, false) {}
+        void run() { stfnum::linCorr(data, templ, progDlg); }
+    private:
+        const Vector_double& data;
+        const Vector_double& templ;
+        stfio::StdoutProgressInfo progDlg;
+    };
+
+    class FitKernel : public Kernel {
+    public:
+        FitKernel(const Vector_double& data_, const stfnum::storedFunc& func_,
+                  const Vector_double& init_) :
+            data(data_), func(func_), init(init_), opts(stfnum::LM_default_opts()) {}
+        void run() {
+            Vector_double p(init);
+            std::string info;
+            int warning = 0;
+            stfnum::lmFit(data, dt, func, opts, true, p, info, warning);
+        }
+    private:
+        const Vector_double& data;
+        const stfnum::storedFunc& func;
+        Vector_double init;
+        Vector_double opts;
+    };
+
+    class BaseKernel : public Kernel {
+    public:
+        BaseKernel(const Vector_double& data_, stfnum::baseline_method method_) :
+            data(data_), method(method_) {}
+        void run() {
+            double var = 0;
+            stfnum::base(method, var, data, 0, data.size()-1);
+        }
+    private:
+        const Vector_double& data;
+        stfnum::baseline_method method;
+    };
+
+    // The kinetics of a single event, measured as in Recording::Measure():
+    class KineticsKernel : public Kernel {
+    public:
+        KineticsKernel(const Vector_double& data_, int which_) : data(data_), which(which_) {}
+        void run() {
+            double var = 0, maxT = 0;
+            std::size_t last = data.size()-1;
+            double base = stfnum::base(stfnum::mean_sd, var, data, 0, last/10);
+            double peak = stfnum::peak(data, base, 0, last, 1, stfnum::down, maxT);
+            if (which == 0) {
+                return;
+            }
+            double ampl = peak - base;
+            if (which == 1) {
+                double iLo = 0, iHi = 0, oLo = 0, oHi = 0;
+                stfnum::risetime2(data, base, ampl, 0, maxT, 0.2, iLo, iHi, oLo, oHi);
+            } else {
+                std::size_t l = 0, r = 0;
+                double lReal = 0;
+                stfnum::t_half(data, base, ampl, 0, last, maxT, l, r, lReal);
+            }
+        }
+    private:
+        const Vector_double& data;
+        int which;
+    };
+
+    class AverageKernel : public Kernel {
+    public:
+        AverageKernel(const Recording& rec_) :
+            rec(rec_), index(rec_[0].size()), shift(rec_[0].size(), 0)
+        {
+            for (std::size_t n = 0; n < index.size(); ++n) {
+                index[n] = n;
+            }
+        }
+        void run() {
+            Section avg(rec[0][0].size()), sig(rec[0][0].size());
+            rec.MakeAverage(avg, sig, 0, index, true, shift);
+        }
+    private:
+        const Recording& rec;
+        std::vector<std::size_t> index;
+        std::vector<int> shift;
+    };
+
+    class ImportKernel : public Kernel {
+    public:
+        ImportKernel(const std::string& fName_, stfio::filetype type_) :
+            fName(fName_), type(type_), progDlg("", "", 100, false) {}
+        void run() {
+            Recording rec;
+            stfio::txtImportSettings tis;
+            if (!stfio::importFile(fName, type, rec, tis, progDlg) || rec.size() == 0) {
+                throw std::runtime_error("Couldn't import " + fName);
+            }
+        }
+    private:
+        std::string fName;
+        stfio::filetype type;
+        stfio::StdoutProgressInfo progDlg;
+    };
+
+    std::string typeName(stfio::filetype type) {
+        switch (type) {
+         case stfio::atf: return "atf";
+         case stfio::abf: return "abf";
+         case stfio::axg: return "axg";
+         case stfio::ascii: return "ascii";
+         case stfio::cfs: return "cfs";
+         case stfio::igor: return "igor";
+         case stfio::son: return "son";
+         case stfio::hdf5: return "hdf5";
+         case stfio::heka: return "heka";
+         case stfio::biosig: return "biosig";
+         case stfio::tdms: return "tdms";
+         case stfio::intan: return "intan";
+         case stfio::nwb: return "nwb";
+         case stfio::zarr: return "zarr";
+         default: return "none";
+        }
+    }
+
+    void benchNumerics(Bench& bench, bool quick) {
+        std::size_t n = quick ? 20000 : 200000;
+        Vector_double trace = makeTrace(n, 2000, 1);
+        Vector_double templ = makeTemplate(200);
+
+        FilterKernel filterKernel(trace);
+        bench.time("stfnum", "filter_gauss", n, filterKernel);
+        DeconvolveKernel deconvolveKernel(trace, templ);
+        bench.time("stfnum", "deconvolve", n, deconvolveKernel);
+        CriterionKernel criterionKernel(trace, templ);
+        bench.time("stfnum", "detectionCriterion", n, criterionKernel);
+        LinCorrKernel linCorrKernel(trace, templ);
+        bench.time("stfnum", "linCorr", n, linCorrKernel);
+
+        BaseKernel meanKernel(trace, stfnum::mean_sd);
+        bench.time("measure", "base_mean_sd", n, meanKernel);
+        BaseKernel medianKernel(trace, stfnum::median_iqr);
+        bench.time("measure", "base_median_iqr", n, medianKernel);
+
+        // a single event with noise:
+        Vector_double event = makeTrace(2000, 2000, 2);
+        KineticsKernel peakKernel(event, 0);
+        bench.time("measure", "peak", event.size(), peakKernel);
+        KineticsKernel riseKernel(event, 1);
+        bench.time("measure", "risetime2", event.size(), riseKernel);
+        KineticsKernel halfKernel(event, 2);
+        bench.time("measure", "t_half", event.size(), halfKernel);
+    }
+
+    // Every model of the function library is fitted to noisy data generated
+    // from the parameters that its initialiser finds for a synthetic event.
+    void benchFits(Bench& bench, bool quick) {
+        const std::vector<stfnum::storedFunc>& funcLib = stfnum::FuncLib();
+        std::size_t n = quick ? 500 : 2000;
+        Vector_double event = makeTrace(n, n, 3);
+        double var = 0, maxT = 0;
+        double base = stfnum::base(stfnum::mean_sd, var, event, 0, n/10);
+        double peak = stfnum::peak(event, base, 0, n-1, 1, stfnum::down, maxT);
+        std::vector<Vector_double> data(funcLib.size());
+        std::vector<Vector_double> init(funcLib.size());
+        for (std::size_t n_f = 0; n_f < funcLib.size(); ++n_f) {
+            const stfnum::storedFunc& func = funcLib[n_f];
+            Vector_double p(func.pInfo.size());
+            try {
+                func.init(event, base, peak, 20.0*dt, 40.0*dt, dt, p);
+                Noise noise(4 + n_f);
+                data[n_f].resize(n);
+                for (std::size_t i = 0; i < n; ++i) {
+                    data[n_f][i] = func.func(i*dt, p) + 0.01*noise.next();
+                }
+                // start 10% off:
+                init[n_f] = p;
+                for (std::size_t n_p = 0; n_p < p.size(); ++n_p) {
+                    init[n_f][n_p] *= 1.1;
+                }
+            }
+            catch (const std::exception&) {
+                data[n_f].clear();
+            }
+            FitKernel fitKernel(data[n_f].empty() ? event : data[n_f], func, init[n_f]);
+            bench.time("lmFit", func.name, n, fitKernel);
+        }
+    }
+
+    void benchAverage(Bench& bench, bool quick) {
+        stfio::SynthSettings settings;
+        settings.n_sections = quick ? 20 : 100;
+        settings.n_points = quick ? 10000 : 50000;
+        Recording rec = stfio::synthRecording(settings);
+        AverageKernel averageKernel(rec);
+        bench.time("recording", "MakeAverage", settings.n_sections*settings.n_points, averageKernel);
+    }
+
+    // Writes a synthetic recording with every filter that can export and
+    // reads it back.
+    void benchImport(Bench& bench, bool quick, const std::vector<std::string>& fixtures) {
+        stfio::SynthSettings settings;
+        settings.n_channels = 2;
+        settings.n_sections = quick ? 4 : 20;
+        settings.n_points = quick ? 10000 : 100000;
+        Recording rec = stfio::synthRecording(settings);
+        std::size_t n_samples = settings.n_channels*settings.n_sections*settings.n_points;
+
+        static const stfio::filetype exportTypes[] = {
+            stfio::hdf5, stfio::cfs, stfio::atf, stfio::biosig
+        };
+        stfio::StdoutProgressInfo progDlg("", "", 100, false);
+        for (std::size_t n_t = 0; n_t < sizeof(exportTypes)/sizeof(exportTypes[0]); ++n_t) {
+            stfio::filetype type = exportTypes[n_t];
+            std::string fName = "stimfitbench" + stfio::findExtension(type);
+            try {
+                if (!stfio::exportFile(fName, type, rec, progDlg)) {
+                    continue;
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Skipping " << typeName(type) << " import: " << e.what() << "\n";
+                continue;
+            }
+            ImportKernel importKernel(fName, type);
+            bench.time("import", "synthetic_" + typeName(type), n_samples, importKernel);
+            std::remove(fName.c_str());
+        }
+
+        for (std::size_t n_f = 0; n_f < fixtures.size(); ++n_f) {
+            const std::string& fName = fixtures[n_f];
+            std::size_t dot = fName.rfind('.');
+            stfio::filetype type = stfio::none;
+            if (dot != std::string::npos) {
+                type = stfio::findType("*" + fName.substr(dot));
+            }
+            std::size_t slash = fName.find_last_of("/\\");
+            std::string name = (slash == std::string::npos) ? fName : fName.substr(slash+1);
+            ImportKernel importKernel(fName, type);
+            bench.time("import", name, 0, importKernel);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool quick = false;
+    std::string output;
+    std::vector<std::string> fixtures;
+    for (int n_a = 1; n_a < argc; ++n_a) {
+        std::string arg(argv[n_a]);
+        if (arg == "--quick") {
+            quick = true;
+        } else if (arg == "--output" && n_a + 1 < argc) {
+            output = argv[++n_a];
+        } else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: " << argv[0] << " [--quick] [--output results.json] [fixture files...]\n";
+            return 0;
+        } else {
+            fixtures.push_back(arg);
+        }
+    }
+
+    Bench bench(quick);
+    benchNumerics(bench, quick);
+    benchFits(bench, quick);
+    benchAverage(bench, quick);
+    benchImport(bench, quick, fixtures);
+
+    if (output.empty()) {
+        bench.write(std::cout);
+    } else {
+        std::ofstream out(output.c_str());
+        if (!out) {
+            std::cerr << "Couldn't open " << output << "\n";
+            return 1;
+        }
+        bench.write(out);
+    }
+    return 0;
+}
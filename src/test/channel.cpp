@@ -40,3 +40,81 @@ TEST(Channel_test, data_access)
     EXPECT_THROW( ch3.at( ch3.size() ), std::out_of_range );
     EXPECT_THROW( ch3[ch3.size()-1].at(ch3[ch3.size()-1].size()), std::out_of_range );
 }
+
+TEST(Channel_test, copy_range)
+{
+    Channel ch(8, 100);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        for (std::size_t n = 0; n < ch[n_s].size(); ++n) {
+            ch[n_s][n] = n_s*1000.0 + n;
+        }
+    }
+    // a compactly stored section is decoded range by range:
+    std::vector<short> samples(100);
+    for (std::size_t n = 0; n < samples.size(); ++n) {
+        samples[n] = (short)n;
+    }
+    ch[7] = Section(stfio::compactSamples(samples, 1.0, 7000.0));
+
+    std::vector<std::size_t> secs;
+    secs.push_back(7);
+    secs.push_back(2);
+    secs.push_back(2);
+    Vector_double dest(secs.size()*10);
+    ch.CopyRange(secs, 40, 50, &dest[0], 2);
+    for (std::size_t n = 0; n < 10; ++n) {
+        EXPECT_EQ( dest[n], 7040.0 + n );
+        EXPECT_EQ( dest[10+n], 2040.0 + n );
+        EXPECT_EQ( dest[20+n], 2040.0 + n );
+    }
+
+    secs.push_back(8);
+    EXPECT_THROW( ch.CopyRange(secs, 40, 50, &dest[0]), std::out_of_range );
+    secs.pop_back();
+    EXPECT_THROW( ch.CopyRange(secs, 95, 101, &dest[0]), std::out_of_range );
+}
+
+TEST(Channel_test, contiguous)
+{
+    Channel ch(5, 1000);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        for (std::size_t n = 0; n < ch[n_s].size(); ++n) {
+            ch[n_s][n] = n_s*1000.0 + n;
+        }
+        ch[n_s].SetXScale(0.1);
+    }
+    std::vector<short> samples(1000);
+    for (std::size_t n = 0; n < samples.size(); ++n) {
+        samples[n] = (short)n;
+    }
+    ch[4] = Section(stfio::compactSamples(samples, 1.0, 4000.0), "compact");
+    EXPECT_TRUE( ch.GetContiguous() == NULL );
+
+    ch.MakeContiguous(2);
+    const Channel& cch = ch;
+    const double* buffer = cch.GetContiguous();
+    ASSERT_TRUE( buffer != NULL );
+    EXPECT_EQ( (std::size_t)buffer % 64, 0u );
+    for (std::size_t n_s = 0; n_s < cch.size(); ++n_s) {
+        EXPECT_EQ( cch[n_s].GetSpan(), buffer + n_s*1000 );
+        EXPECT_DOUBLE_EQ( cch[n_s].GetXScale(), n_s < 4 ? 0.1 : 1.0 );
+        for (std::size_t n = 0; n < cch[n_s].size(); ++n) {
+            ASSERT_EQ( buffer[n_s*1000 + n], n_s*1000.0 + n );
+        }
+    }
+    EXPECT_EQ( cch[4].GetSectionDescription(), "compact" );
+    // the buffer is shared with copies:
+    Channel copy(ch);
+    EXPECT_EQ( copy.GetContiguous(), buffer );
+
+    // writing to a section copies it out of the buffer:
+    ch[2][0] = -1.0;
+    EXPECT_TRUE( cch.GetContiguous() == NULL );
+    EXPECT_EQ( cch[2][0], -1.0 );
+    EXPECT_EQ( buffer[2000], 2000.0 );
+    EXPECT_EQ( copy.GetContiguous(), buffer );
+    EXPECT_EQ( copy[2].get()[0], 2000.0 );
+
+    ch[2].resize(10);
+    EXPECT_THROW( ch.MakeContiguous(), std::runtime_error );
+}
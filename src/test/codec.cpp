@@ -0,0 +1,149 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/hdf5/hdf5lib.h"
+#include "../libstfio/hdf5/ephyscodec.h"
+#include "../libstfio/mappedfile.h"
+#include "hdf5.h"
+#include "hdf5_hl.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+namespace {
+
+// ADC samples of a slow signal with a few LSB of noise:
+std::vector<short> adc_samples(std::size_t n, unsigned seed) {
+    srand(seed);
+    std::vector<short> samples(n);
+    for (std::size_t k = 0; k < n; ++k) {
+        samples[k] = (short)(2000.0*sin(0.0005*k) + (rand() % 9) - 4);
+    }
+    return samples;
+}
+
+std::size_t fileSize(const char* fName) {
+    std::ifstream file(fName, std::ios::binary | std::ios::ate);
+    return (std::size_t)file.tellg();
+}
+
+}
+
+TEST(Codec_test, roundtrip) {
+    std::vector<short> samples(adc_samples(100000, 1));
+    // extremes and steps that need the widest residuals:
+    samples[500] = 32767;
+    samples[501] = -32768;
+    samples[502] = 32767;
+    std::vector<unsigned char> encoded;
+    stfio::encodeEphys(&samples[0], samples.size(), encoded, 4);
+    EXPECT_LT( encoded.size(), samples.size() );
+
+    std::vector<short> decoded;
+    stfio::decodeEphys(&encoded[0], encoded.size(), decoded, 3);
+    ASSERT_EQ( decoded.size(), samples.size() );
+    for (std::size_t k = 0; k < samples.size(); ++k) {
+        ASSERT_EQ( decoded[k], samples[k] );
+    }
+
+    // short and empty buffers:
+    for (std::size_t n = 0; n < 4; ++n) {
+        stfio::encodeEphys(&samples[500], n, encoded);
+        stfio::decodeEphys(&encoded[0], encoded.size(), decoded);
+        ASSERT_EQ( decoded.size(), n );
+        EXPECT_TRUE( std::equal(decoded.begin(), decoded.end(), samples.begin()+500) );
+    }
+
+    stfio::encodeEphys(&samples[0], samples.size(), encoded);
+    encoded.resize(encoded.size()/2);
+    EXPECT_THROW( stfio::decodeEphys(&encoded[0], encoded.size(), decoded), std::runtime_error );
+    encoded[0] = 0;
+    EXPECT_THROW( stfio::decodeEphys(&encoded[0], encoded.size(), decoded), std::runtime_error );
+}
+
+TEST(Codec_test, quantization) {
+    const double lsb = 20.0/65536.0;
+    Channel ch(3);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        ch.InsertSection(Section(stfio::compactSamples(adc_samples(5000, n_s), lsb, 0.0)), n_s);
+    }
+    double scale = 0, shift = 1;
+    ASSERT_TRUE( stfio::findQuantization(ch, scale, shift) );
+    EXPECT_NEAR( scale, lsb, 1e-12 );
+    EXPECT_EQ( shift, 0.0 );
+
+    // an offset that isn't a multiple of the step:
+    Channel shifted(1);
+    shifted.InsertSection(Section(stfio::compactSamples(adc_samples(5000, 7), lsb, 0.3*lsb)), 0);
+    ASSERT_TRUE( stfio::findQuantization(shifted, scale, shift) );
+    EXPECT_NEAR( scale, lsb, 1e-12 );
+
+    Channel smooth(1);
+    Vector_double data(1000);
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        data[k] = sin(0.001*k);
+    }
+    smooth.InsertSection(Section(data), 0);
+    EXPECT_FALSE( stfio::findQuantization(smooth, scale, shift) );
+    EXPECT_FALSE( stfio::findQuantization(Channel(1), scale, shift) );
+}
+
+TEST(Codec_test, hdf5) {
+    const char* fName = "codec_test.h5";
+    const char* rawName = "codec_test_raw.h5";
+    stftest::NullProgressInfo progDlg;
+    Channel ch(20);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        ch.InsertSection(Section(stfio::compactSamples(adc_samples(50000, n_s), 0.1, 0.0)), n_s);
+    }
+    ch.SetYUnits("pA");
+    ch.SetChannelName("Im");
+    Recording rec(ch);
+    rec.SetXScale(0.05);
+    stfio::exportHDF5File(fName, rec, progDlg, stfio::hdf5_chunked, stfio::hdf5_ephys);
+    stfio::exportHDF5File(rawName, rec, progDlg, stfio::hdf5_chunked, stfio::hdf5_no_filter);
+    EXPECT_LT( 3*fileSize(fName), fileSize(rawName) );
+
+    // chunks that have been encoded in parallel are decoded by the filter:
+    ASSERT_TRUE( stfio::registerEphysFilter() );
+    hid_t file_id = H5Fopen(fName, H5F_ACC_RDONLY, H5P_DEFAULT);
+    ASSERT_GE( file_id, 0 );
+    std::vector<short> codes(20*50000);
+    EXPECT_GE( H5LTread_dataset_short(file_id, "/Im/data", &codes[0]), 0 );
+    H5Fclose(file_id);
+    EXPECT_EQ( codes[3*50000+1234], adc_samples(50000, 3)[1234] );
+
+    Recording imported;
+    stfio::importHDF5File(fName, imported, progDlg);
+    ASSERT_EQ( imported.size(), 1u );
+    ASSERT_EQ( imported[0].size(), ch.size() );
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        ASSERT_EQ( imported[0][n_s].size(), ch[n_s].size() );
+        for (std::size_t k = 0; k < ch[n_s].size(); ++k) {
+            ASSERT_NEAR( imported[0][n_s][k], ch[n_s][k], 1e-9 );
+        }
+    }
+    std::remove(fName);
+    std::remove(rawName);
+}
+
+TEST(Codec_test, filter_id) {
+    // a private identifier, above those of HDF5, of testing and of registered filters:
+    EXPECT_GE( stfio::EPHYS_FILTER_ID, 32768 );
+    EXPECT_LE( stfio::EPHYS_FILTER_ID, H5Z_FILTER_MAX );
+    // registered filters that are often installed as plugins:
+    const int registered[] = { 305 /* LZO */, 307 /* bzip2 */, 32000 /* LZF */, 32001 /* Blosc */,
+                               32004 /* LZ4 */, 32008 /* bitshuffle */, 32013 /* zfp */, 32015 /* Zstandard */ };
+    for (std::size_t n = 0; n < sizeof(registered)/sizeof(registered[0]); ++n) {
+        EXPECT_NE( stfio::EPHYS_FILTER_ID, registered[n] );
+    }
+
+    // no installed plugin provides a filter with the same identifier:
+    H5E_BEGIN_TRY {
+        H5Zunregister(stfio::EPHYS_FILTER_ID);
+    } H5E_END_TRY;
+    EXPECT_LE( H5Zfilter_avail(stfio::EPHYS_FILTER_ID), 0 );
+    EXPECT_TRUE( stfio::registerEphysFilter() );
+    EXPECT_GT( H5Zfilter_avail(stfio::EPHYS_FILTER_ID), 0 );
+}
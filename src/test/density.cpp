@@ -0,0 +1,89 @@
+#include "../libstfnum/density.h"
+#include "../libstfio/section.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Counts of a single section computed point by point:
+std::vector<unsigned> naiveCounts(const Section& sec, double startX, double xZoom,
+                                  double startY, double yZoom, int width, int height)
+{
+    std::vector<unsigned> counts(width*height, 0);
+    std::vector<double> mins(width, INFINITY), maxs(width, -INFINITY);
+    for (std::size_t n = 0; n < sec.size(); ++n) {
+        int c = (int)std::floor(startX + n*xZoom);
+        // the polyline enters the column from the previous point:
+        int c_next = (n+1 < sec.size()) ? (int)std::floor(startX + (n+1)*xZoom) : c;
+        for (int col = c; col <= c_next; ++col) {
+            if (col < 0 || col >= width) continue;
+            double y = (col == c || n+1 == sec.size()) ? sec[n] : sec[n+1];
+            if (col > c) {
+                mins[col] = std::min(mins[col], sec[n]);
+                maxs[col] = std::max(maxs[col], sec[n]);
+            }
+            mins[col] = std::min(mins[col], y);
+            maxs[col] = std::max(maxs[col], y);
+        }
+    }
+    for (int c = 0; c < width; ++c) {
+        if (mins[c] > maxs[c]) continue;
+        int top = (int)std::floor(startY - maxs[c]*yZoom);
+        int bottom = (int)std::floor(startY - mins[c]*yZoom);
+        for (int r = std::max(top, 0); r <= std::min(bottom, height-1); ++r) {
+            counts[c*height + r] = 1;
+        }
+    }
+    return counts;
+}
+
+}
+
+TEST(Density_test, single_section) {
+    Section sec(5000);
+    for (std::size_t n = 0; n < sec.size(); ++n) {
+        sec[n] = sin(0.003*n) + 0.2*sin(0.7*n);
+    }
+    // decimated and zoomed in, partly outside the window:
+    double xZooms[] = {0.013, 0.1, 1.0, 3.5};
+    for (int n_z = 0; n_z < 4; ++n_z) {
+        stfnum::DensityMap map(120, 50);
+        std::vector<const Section*> sections(1, &sec);
+        map.Add(sections, -7.5, xZooms[n_z], 25.0, 20.0, 2);
+        std::vector<unsigned> naive = naiveCounts(sec, -7.5, xZooms[n_z], 25.0, 20.0, 120, 50);
+        for (int c = 0; c < 120; ++c) {
+            for (int r = 0; r < 50; ++r) {
+                EXPECT_EQ( map.Count(c, r), naive[c*50 + r] ) << "zoom " << xZooms[n_z]
+                    << ", column " << c << ", row " << r;
+            }
+        }
+    }
+}
+
+TEST(Density_test, overlay) {
+    std::vector<Section> secs(150, Section(2000));
+    std::vector<const Section*> sections;
+    for (std::size_t n_s = 0; n_s < secs.size(); ++n_s) {
+        for (std::size_t n = 0; n < secs[n_s].size(); ++n) {
+            // every third section is shifted out of the window:
+            secs[n_s][n] = (n_s % 3 == 0) ? 100.0 : 0.5*sin(0.01*n);
+        }
+        sections.push_back(&secs[n_s]);
+    }
+    stfnum::DensityMap map(200, 40);
+    map.Add(sections, 0, 0.1, 20.0, 10.0);
+    EXPECT_EQ( map.GetMax(), 100u );
+
+    // adding again in a single thread doubles all counts:
+    stfnum::DensityMap twice(map);
+    twice.Add(sections, 0, 0.1, 20.0, 10.0, 1);
+    for (int c = 0; c < 200; ++c) {
+        for (int r = 0; r < 40; ++r) {
+            EXPECT_EQ( twice.Count(c, r), 2*map.Count(c, r) );
+        }
+    }
+    twice.Clear();
+    EXPECT_EQ( twice.GetMax(), 0u );
+    EXPECT_THROW( map.Add(sections, 0, 0, 20.0, 10.0), std::out_of_range );
+}
@@ -0,0 +1,128 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/derived.h"
+#include "../libstfio/channel.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+namespace {
+
+// An operation that counts its evaluations:
+class CountingOperation : public stfio::SampleOperation {
+public:
+    explicit CountingOperation(int& count_) : count(count_) {}
+    virtual void Apply(Vector_double& data) const {
+        ++count;
+    }
+private:
+    int& count;
+};
+
+Vector_double ramp(std::size_t size) {
+    Vector_double data(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        data[n] = 1.0 + 0.5*n;
+    }
+    return data;
+}
+
+}
+
+TEST(derived_test, pipeline) {
+    Section sec(ramp(1000), "sweep");
+    sec.SetXScale(0.1);
+    std::vector<stfio::SampleOperationPtr> operations;
+    operations.push_back(stfnum::scaleOperation(2.0));
+    operations.push_back(stfnum::offsetOperation(-1.0));
+    operations.push_back(stfnum::lnOperation());
+    operations.push_back(stfnum::diffOperation(0.1));
+    Section derived(stfnum::deriveSection(sec, operations, ", derived"));
+    EXPECT_EQ(derived.size(), 999);
+    EXPECT_EQ(derived.GetXScale(), 0.1);
+    EXPECT_EQ(derived.GetSectionDescription(), "sweep, derived");
+
+    Vector_double reference(sec.size());
+    for (std::size_t n = 0; n < reference.size(); ++n) {
+        reference[n] = std::log(2.0*sec[n]-1.0);
+    }
+    reference = stfnum::diff(reference, 0.1);
+    EXPECT_TRUE( derived.get() == reference );
+    EXPECT_EQ( derived[10], reference[10] );
+    Vector_double range(5);
+    derived.CopyRange(100, 105, &range[0]);
+    EXPECT_TRUE( std::equal(range.begin(), range.end(), reference.begin()+100) );
+
+    // writing to the source doesn't change the derived section:
+    sec[0] = 1000.0;
+    derived.Release();
+    EXPECT_TRUE( derived.get() == reference );
+
+    // writing to the derived section materializes it:
+    derived[0] = 0.0;
+    EXPECT_FALSE( derived.IsMapped() );
+    EXPECT_EQ( derived[1], reference[1] );
+}
+
+TEST(derived_test, cached_evaluation) {
+    int count = 0;
+    std::vector<stfio::SampleOperationPtr> operations(1,
+        stfio::SampleOperationPtr(new CountingOperation(count)));
+    std::size_t cached = stfio::getSectionCacheSize();
+    {
+        Section derived(stfnum::deriveSection(Section(ramp(100)), operations));
+        EXPECT_EQ(count, 0);
+        EXPECT_EQ(derived.size(), 100);
+        derived.get();
+        EXPECT_EQ(count, 1);
+
+        // the evaluated samples stay in the section cache:
+        derived.Release();
+        EXPECT_EQ( derived.get(), ramp(100) );
+        EXPECT_EQ(count, 1);
+        EXPECT_EQ(stfio::getSectionCacheSize(), cached + 100*sizeof(double));
+
+        // deriving from derived samples extends the pipeline:
+        std::vector<stfio::SampleOperationPtr> more(1, stfnum::scaleOperation(3.0));
+        Section twice(stfnum::deriveSection(derived, more));
+        EXPECT_DOUBLE_EQ( twice[99], 3.0*ramp(100)[99] );
+        EXPECT_EQ(count, 2);
+    }
+    // the cache entries are dropped with their derivations:
+    EXPECT_EQ(stfio::getSectionCacheSize(), cached);
+}
+
+TEST(derived_test, channel) {
+    Channel ch(3);
+    for (std::size_t n = 0; n < ch.size(); ++n) {
+        ch.InsertSection(Section(ramp(200+n)), n);
+    }
+    std::vector<std::size_t> sections(1, 2);
+    sections.push_back(0);
+    std::vector<stfio::SampleOperationPtr> operations(1, stfnum::offsetOperation(-1.0));
+    Channel derived(stfnum::deriveChannel(ch, sections, operations, ", shifted"));
+    ASSERT_EQ(derived.size(), 2);
+    EXPECT_EQ(derived[0].size(), 202);
+    EXPECT_EQ(derived[1].size(), 200);
+    EXPECT_EQ(derived[0][201], ch[2][201]-1.0);
+    EXPECT_EQ(derived[1].GetSectionDescription(), ", shifted");
+
+    sections.push_back(3);
+    EXPECT_THROW( stfnum::deriveChannel(ch, sections, operations), std::out_of_range );
+}
+
+TEST(derived_test, subtract_baselines) {
+    Channel ch(2);
+    for (std::size_t n = 0; n < ch.size(); ++n) {
+        ch.InsertSection(Section(ramp(100)), n);
+    }
+    std::vector<std::size_t> sections(1, 1);
+    Vector_double bases(1, 1.0);
+    Channel subtracted(stfnum::subtractBaselines(ch, sections, bases));
+    ASSERT_EQ(subtracted.size(), 1);
+    EXPECT_TRUE( subtracted[0].IsMapped() );
+    EXPECT_EQ( subtracted[0][0], 0.0 );
+    EXPECT_EQ( subtracted[0][99], 0.5*99 );
+    EXPECT_EQ( subtracted[0].GetSectionDescription(), ", baseline subtracted" );
+
+    bases.push_back(0.0);
+    EXPECT_THROW( stfnum::subtractBaselines(ch, sections, bases), std::out_of_range );
+}
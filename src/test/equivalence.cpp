@@ -0,0 +1,285 @@
+#include "../libstfio/stfio.h"
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/measure.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+// Every fast path is compared with a straightforward reference
+// implementation on random inputs. The inputs are reproducible; set
+// STF_TEST_SEED to try other ones.
+
+namespace {
+
+unsigned long long test_seed() {
+    const char* seed = std::getenv("STF_TEST_SEED");
+    return seed ? std::strtoul(seed, NULL, 10) : 20240611ul;
+}
+
+// xorshift64* generator, so that the inputs don't depend on the platform:
+class Random {
+public:
+    explicit Random(unsigned long long seed) : state(seed*2654435761ull + 1) {}
+
+    double Uniform() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (double)((state*2685821657736338717ull) >> 11) / 9007199254740992.0;
+    }
+
+    std::size_t Index(std::size_t n) { return (std::size_t)(Uniform()*n) % n; }
+
+    Vector_double Data(std::size_t n) {
+        Vector_double data(n);
+        double drift = Uniform()*10.0;
+        for (std::size_t k = 0; k < n; ++k) {
+            data[k] = drift*sin(0.001*k) + 2.0*Uniform() - 1.0;
+        }
+        return data;
+    }
+
+private:
+    unsigned long long state;
+};
+
+Vector_double ref_product(const Vector_double& data, const Vector_double& templ, std::size_t n_out) {
+    Vector_double product(n_out);
+    for (std::size_t n = 0; n < n_out; ++n) {
+        for (std::size_t k = 0; k < templ.size(); ++k) {
+            product[n] += templ[k]*data[n+k];
+        }
+    }
+    return product;
+}
+
+// detection criterion of a single position computed from scratch:
+double ref_criterion(const Vector_double& data, const Vector_double& templ, std::size_t n) {
+    double N = templ.size();
+    double st=0, sd=0, stt=0, std_=0;
+    for (std::size_t k=0; k<templ.size(); ++k) {
+        st+=templ[k]; sd+=data[n+k]; stt+=templ[k]*templ[k]; std_+=templ[k]*data[n+k];
+    }
+    double scale=(std_-st*sd/N)/(stt-st*st/N);
+    double offset=(sd-scale*st)/N;
+    double sse=0;
+    for (std::size_t k=0; k<templ.size(); ++k) {
+        sse+=stfnum::SQR(data[n+k]-scale*templ[k]-offset);
+    }
+    return scale/sqrt(sse/(N-1));
+}
+
+// the same samples once in memory and once stored compactly:
+void make_pair(Random& random, std::size_t n, Section& memory, Section& compact) {
+    std::vector<short> adc(n);
+    Vector_double data(n);
+    for (std::size_t k = 0; k < n; ++k) {
+        adc[k] = (short)(2000.0*sin(0.003*k) + 1000.0*random.Uniform() - 500.0);
+        data[k] = 0.05*adc[k] - 3.0;
+    }
+    memory = Section(data);
+    compact = Section(stfio::compactSamples(adc, 0.05, -3.0));
+}
+
+}
+
+TEST(equivalence_test, sliding_products) {
+    Random random(test_seed());
+    SCOPED_TRACE(test_seed());
+    for (int n_trial = 0; n_trial < 6; ++n_trial) {
+        Vector_double data = random.Data(2000 + random.Index(3000));
+        // on both sides of the size at which the FFT takes over:
+        std::vector<Vector_double> templs;
+        templs.push_back(random.Data(4 + random.Index(60)));
+        templs.push_back(random.Data(64 + random.Index(200)));
+        templs.push_back(random.Data(64 + random.Index(200)));
+        std::vector<Vector_double> products = stfnum::slidingProducts(data, templs);
+        ASSERT_EQ( products.size(), templs.size() );
+        for (std::size_t n_k = 0; n_k < templs.size(); ++n_k) {
+            std::size_t n_out = data.size()-templs[n_k].size();
+            Vector_double single = stfnum::slidingProduct(data, templs[n_k], n_out);
+            Vector_double ref = ref_product(data, templs[n_k], n_out);
+            ASSERT_EQ( single.size(), n_out );
+            ASSERT_EQ( products[n_k].size(), n_out );
+            for (std::size_t n = 0; n < n_out; ++n) {
+                ASSERT_NEAR( single[n], ref[n], 1e-9*templs[n_k].size() ) << "trial " << n_trial;
+                ASSERT_NEAR( products[n_k][n], ref[n], 1e-9*templs[n_k].size() ) << "trial " << n_trial;
+            }
+        }
+    }
+}
+
+TEST(equivalence_test, detection_criterion) {
+    Random random(test_seed());
+    SCOPED_TRACE(test_seed());
+    stftest::NullProgressInfo progDlg;
+    for (int n_trial = 0; n_trial < 4; ++n_trial) {
+        Vector_double data = random.Data(3000 + random.Index(2000));
+        std::vector<Vector_double> templs;
+        for (int n_k = 0; n_k < 3; ++n_k) {
+            std::size_t size = n_trial%2 ? 10 + random.Index(50) : 64 + random.Index(250);
+            Vector_double templ(size);
+            double tau = 1.0 + random.Uniform()*size/3.0;
+            for (std::size_t k = 0; k < size; ++k) {
+                templ[k] = -exp(-(double)k/tau) + 0.01*random.Uniform();
+            }
+            templs.push_back(templ);
+        }
+        std::size_t max_templ = 0;
+        for (std::size_t n_k = 0; n_k < templs.size(); ++n_k) {
+            max_templ = std::max(max_templ, templs[n_k].size());
+        }
+
+        std::vector<int> best;
+        Vector_double bank = stfnum::detectionCriterion(data, templs, progDlg, best);
+        ASSERT_EQ( bank.size(), data.size()-max_templ );
+        ASSERT_EQ( best.size(), bank.size() );
+        std::vector<Vector_double> dc(templs.size());
+        for (std::size_t n_k = 0; n_k < templs.size(); ++n_k) {
+            dc[n_k] = stfnum::detectionCriterion(data, templs[n_k], progDlg);
+            ASSERT_EQ( dc[n_k].size(), data.size()-templs[n_k].size() );
+        }
+        for (std::size_t n = 0; n < bank.size(); n += 1 + random.Index(20)) {
+            double best_ref = -INFINITY;
+            for (std::size_t n_k = 0; n_k < templs.size(); ++n_k) {
+                double ref = ref_criterion(data, templs[n_k], n);
+                EXPECT_NEAR( dc[n_k][n], ref, 1e-6*fabs(ref)+1e-6 ) << "trial " << n_trial;
+                best_ref = std::max(best_ref, dc[n_k][n]);
+            }
+            EXPECT_NEAR( bank[n], best_ref, 1e-9*fabs(best_ref)+1e-9 ) << "trial " << n_trial;
+            ASSERT_GE( best[n], 0 );
+            EXPECT_NEAR( dc[best[n]][n], bank[n], 1e-9*fabs(bank[n])+1e-9 ) << "trial " << n_trial;
+        }
+    }
+}
+
+TEST(equivalence_test, stream_filter) {
+    Random random(test_seed());
+    SCOPED_TRACE(test_seed());
+    const int SR = 20;
+    Vector_double a(1, 0.5 + random.Uniform());
+    Vector_double data = random.Data(6000);
+    stfnum::StreamFilter sf(a, SR, stfnum::fgaussColqu, false, 257, 1024);
+    Vector_double whole = sf.Process(data);
+    Vector_double tail = sf.Finish();
+    whole.insert(whole.end(), tail.begin(), tail.end());
+    ASSERT_EQ( whole.size(), data.size() );
+
+    // random chunks give the same stream:
+    for (int n_trial = 0; n_trial < 3; ++n_trial) {
+        Vector_double chunked;
+        std::size_t pos = 0;
+        while (pos < data.size()) {
+            std::size_t n = std::min(1 + random.Index(2500), data.size()-pos);
+            Vector_double chunk(data.begin()+pos, data.begin()+pos+n);
+            Vector_double filtered = sf.Process(chunk);
+            chunked.insert(chunked.end(), filtered.begin(), filtered.end());
+            pos += n;
+        }
+        tail = sf.Finish();
+        chunked.insert(chunked.end(), tail.begin(), tail.end());
+        ASSERT_EQ( chunked.size(), data.size() );
+        for (std::size_t n = 0; n < data.size(); ++n) {
+            ASSERT_EQ( chunked[n], whole[n] ) << "trial " << n_trial;
+        }
+    }
+
+    // away from the ends, the result agrees with the FFT of the whole trace:
+    Vector_double ref = stfnum::filter(data, 0, data.size()-1, a, SR, stfnum::fgaussColqu, false);
+    for (std::size_t n = 500; n < data.size()-500; n += 1 + random.Index(10)) {
+        EXPECT_NEAR( whole[n], ref[n], 1e-2 );
+    }
+}
+
+TEST(equivalence_test, lazy_sections) {
+    Random random(test_seed());
+    SCOPED_TRACE(test_seed());
+    const stfnum::direction dirs[] = {stfnum::up, stfnum::down, stfnum::both};
+    std::deque<Section> memory_list, compact_list;
+    for (int n_s = 0; n_s < 5; ++n_s) {
+        Section memory, compact;
+        make_pair(random, 5000, memory, compact);
+        memory_list.push_back(memory);
+        compact_list.push_back(compact);
+    }
+    const std::deque<Section>& mem = memory_list;
+    const std::deque<Section>& lazy = compact_list;
+
+    for (int n_trial = 0; n_trial < 50; ++n_trial) {
+        std::size_t n_s = random.Index(mem.size());
+        ASSERT_TRUE( lazy[n_s].IsMapped() );
+        std::size_t begin = random.Index(4000), end = begin + 1 + random.Index(1000);
+        const Vector_double& ref = mem[n_s].get();
+
+        // measurements:
+        double var_mem, var_lazy;
+        stfnum::baseline_method method = n_trial%2 ? stfnum::median_iqr : stfnum::mean_sd;
+        EXPECT_EQ( stfnum::base(method, var_lazy, lazy[n_s], begin, end-1),
+                   stfnum::base(method, var_mem, ref, begin, end-1) );
+        EXPECT_EQ( var_lazy, var_mem );
+        double maxT_mem, maxT_lazy;
+        int pM = 1 + (int)random.Index(10);
+        stfnum::direction dir = dirs[random.Index(3)];
+        EXPECT_EQ( stfnum::peak(lazy[n_s], 0.0, begin, end-1, pM, dir, maxT_lazy),
+                   stfnum::peak(ref, 0.0, begin, end-1, pM, dir, maxT_mem) );
+        EXPECT_EQ( maxT_lazy, maxT_mem );
+
+        // extrema from the min/max pyramid:
+        double min_lazy, max_lazy, min_mem, max_mem;
+        lazy[n_s].GetExtrema(begin, end, min_lazy, max_lazy);
+        mem[n_s].GetExtrema(begin, end, min_mem, max_mem);
+        EXPECT_EQ( min_lazy, *std::min_element(ref.begin()+begin, ref.begin()+end) );
+        EXPECT_EQ( max_lazy, *std::max_element(ref.begin()+begin, ref.begin()+end) );
+        EXPECT_EQ( min_mem, min_lazy );
+        EXPECT_EQ( max_mem, max_lazy );
+
+        // ranges that are decoded on demand:
+        Vector_double range(end-begin);
+        lazy[n_s].CopyRange(begin, end, &range[0]);
+        EXPECT_TRUE( std::equal(range.begin(), range.end(), ref.begin()+begin) );
+        EXPECT_TRUE( lazy[n_s].IsMapped() );
+    }
+
+    // averages of in-memory, compact and contiguous channels:
+    Channel ch_mem(memory_list), ch_lazy(compact_list), ch_contiguous(compact_list);
+    ch_contiguous.MakeContiguous();
+    std::vector<std::size_t> section_index;
+    std::vector<int> shift;
+    for (std::size_t n_s = 0; n_s < mem.size(); ++n_s) {
+        section_index.push_back(random.Index(mem.size()));
+        shift.push_back((int)random.Index(100));
+    }
+    Recording rec_mem(ch_mem), rec_lazy(ch_lazy), rec_contiguous(ch_contiguous);
+    Section av_mem(4900), sd_mem(4900), av_lazy(4900), sd_lazy(4900), av_cont(4900), sd_cont(4900);
+    rec_mem.MakeAverage(av_mem, sd_mem, 0, section_index, true, shift);
+    rec_lazy.MakeAverage(av_lazy, sd_lazy, 0, section_index, true, shift);
+    rec_contiguous.MakeAverage(av_cont, sd_cont, 0, section_index, true, shift);
+    EXPECT_TRUE( av_lazy.get() == av_mem.get() );
+    EXPECT_TRUE( sd_lazy.get() == sd_mem.get() );
+    EXPECT_TRUE( av_cont.get() == av_mem.get() );
+    EXPECT_TRUE( sd_cont.get() == sd_mem.get() );
+
+    // chained views read like the concatenated data:
+    std::vector<stfio::MappedSamples> pieces;
+    Vector_double concatenated;
+    for (std::size_t n_s = 0; n_s < mem.size(); ++n_s) {
+        pieces.push_back(n_s%2 ? lazy[n_s].GetSamples() : mem[n_s].GetSamples());
+        concatenated.insert(concatenated.end(), mem[n_s].get().begin(), mem[n_s].get().end());
+    }
+    const Section chained(stfio::chainSamples(pieces));
+    ASSERT_EQ( chained.size(), concatenated.size() );
+    for (int n_trial = 0; n_trial < 20; ++n_trial) {
+        std::size_t begin = random.Index(concatenated.size()-1);
+        std::size_t end = begin + 1 + random.Index(concatenated.size()-begin-1);
+        Vector_double range(end-begin);
+        chained.CopyRange(begin, end, &range[0]);
+        EXPECT_TRUE( std::equal(range.begin(), range.end(), concatenated.begin()+begin) );
+        double min, max;
+        chained.GetExtrema(begin, end, min, max);
+        EXPECT_EQ( min, *std::min_element(concatenated.begin()+begin, concatenated.begin()+end) );
+        EXPECT_EQ( max, *std::max_element(concatenated.begin()+begin, concatenated.begin()+end) );
+    }
+    EXPECT_TRUE( chained.get() == concatenated );
+}
@@ -0,0 +1,164 @@
+#include "../libstfnum/eventstats.h"
+#include "../libstfio/channel.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+// Events at the given onsets of a section, with amplitudes of -onset/10:
+void add_events(stfnum::EventTable& events, std::size_t section, const int* onsets, int n) {
+    for (int k = 0; k < n; ++k) {
+        events.section.push_back(section);
+        events.index.push_back(onsets[k]);
+        events.peakIndex.push_back(onsets[k] + 5);
+        events.amplitude.push_back(-onsets[k]/10.0);
+        events.criterion.push_back(5.0);
+    }
+}
+
+}
+
+TEST(eventstats_test, intervals_and_rates) {
+    // sections 0 and 2 have events; section 1 has been scanned without any:
+    stfnum::EventTable events;
+    const int onsets0[] = {100, 300, 600};
+    const int onsets2[] = {50, 950};
+    add_events(events, 2, onsets2, 2);
+    add_events(events, 0, onsets0, 3);
+    std::vector<std::size_t> sections;
+    sections.push_back(2);
+    sections.push_back(0);
+    sections.push_back(1);
+    Channel ch(3, 1000);
+    stfnum::EventSet set(events, 0.1, sections, ch);
+    EXPECT_DOUBLE_EQ(set.durations[1], 100.0);
+
+    stfnum::EventStatisticsPlan plan;
+    plan.binWidth = 25.0;
+    for (int n_threads = 1; n_threads <= 3; n_threads += 2) {
+        stfnum::EventStatistics stats = plan.Compute(set, n_threads);
+        EXPECT_EQ(stats.nEvents, 5u);
+        EXPECT_EQ(stats.nSections, 3u);
+        EXPECT_DOUBLE_EQ(stats.duration, 300.0);
+        EXPECT_DOUBLE_EQ(stats.meanRate, 5.0/300.0);
+
+        // in the order of the table:
+        ASSERT_EQ(stats.interval.size(), 5u);
+        EXPECT_TRUE(std::isnan(stats.interval[0]));
+        EXPECT_NEAR(stats.interval[1], 90.0, 1e-12);
+        EXPECT_TRUE(std::isnan(stats.interval[2]));
+        EXPECT_NEAR(stats.interval[3], 20.0, 1e-12);
+        EXPECT_NEAR(stats.frequency[4], 1.0/30.0, 1e-12);
+        EXPECT_NEAR(stats.time[4], 60.0, 1e-12);
+
+        ASSERT_EQ(stats.sortedIntervals.size(), 3u);
+        EXPECT_NEAR(stats.sortedIntervals[0], 20.0, 1e-12);
+        EXPECT_NEAR(stats.sortedIntervals[2], 90.0, 1e-12);
+        EXPECT_NEAR(stats.medianInterval, 30.0, 1e-12);
+        EXPECT_NEAR(stats.meanInterval, 140.0/3.0, 1e-12);
+        ASSERT_EQ(stats.sortedAmplitudes.size(), 5u);
+        EXPECT_DOUBLE_EQ(stats.sortedAmplitudes[0], -95.0);
+        EXPECT_DOUBLE_EQ(stats.sortedAmplitudes[4], -5.0);
+        EXPECT_DOUBLE_EQ(stats.medianAmplitude, -30.0);
+
+        // four bins of 25 x units, covered by all three sections:
+        ASSERT_EQ(stats.binCount.size(), 4u);
+        EXPECT_EQ(stats.binCount[0], 2);
+        EXPECT_EQ(stats.binCount[1], 1);
+        EXPECT_EQ(stats.binCount[2], 1);
+        EXPECT_EQ(stats.binCount[3], 1);
+        EXPECT_DOUBLE_EQ(stats.binRate[0], 2/75.0);
+        EXPECT_DOUBLE_EQ(stats.binTime[3], 75.0);
+    }
+
+    stfnum::Table summary = plan.Compute(set).ToTable();
+    EXPECT_EQ(summary.GetRowLabel(0), "Events");
+    EXPECT_EQ(summary.at(0, 0), 5.0);
+    stfnum::Table intervals = plan.Compute(set).IntervalTable();
+    EXPECT_TRUE(intervals.IsEmpty(0, 1));
+    EXPECT_FALSE(intervals.IsEmpty(1, 1));
+    stfnum::Table distributions = plan.Compute(set).DistributionTable();
+    EXPECT_EQ(distributions.nRows(), 5u);
+    EXPECT_TRUE(distributions.IsEmpty(3, 0));
+    EXPECT_DOUBLE_EQ(distributions.at(2, 1), 1.0);
+}
+
+TEST(eventstats_test, pooled_sets) {
+    // many sections of different lengths in two recordings:
+    std::vector<stfnum::EventTable> tables(2);
+    std::vector< std::vector<std::size_t> > sections(2);
+    std::vector<Vector_double> durations(2);
+    std::size_t n_events = 0, n_firsts = 0;
+    srand(7);
+    for (std::size_t n_set = 0; n_set < 2; ++n_set) {
+        for (std::size_t n_s = 0; n_s < 40; ++n_s) {
+            int onsets[30];
+            int n = rand() % 30;
+            int t = 0;
+            for (int k = 0; k < n; ++k) {
+                t += 1 + rand() % 50;
+                onsets[k] = t;
+            }
+            add_events(tables[n_set], n_s, onsets, n);
+            n_events += n;
+            n_firsts += (n > 0);
+            sections[n_set].push_back(n_s);
+            durations[n_set].push_back((t + 1 + n_s)*(n_set+1)*0.05);
+        }
+    }
+    std::vector<stfnum::EventSet> sets;
+    sets.push_back(stfnum::EventSet(tables[0], 0.05, sections[0], durations[0]));
+    sets.push_back(stfnum::EventSet(tables[1], 0.1, sections[1], durations[1]));
+
+    stfnum::EventStatisticsPlan plan;
+    stfnum::EventStatistics serial = plan.Compute(sets, 1);
+    stfnum::EventStatistics parallel = plan.Compute(sets, 4);
+    EXPECT_EQ(serial.nEvents, n_events);
+    ASSERT_EQ(parallel.sortedIntervals.size(), serial.sortedIntervals.size());
+    // no interval before the first event of a section:
+    EXPECT_EQ(serial.sortedIntervals.size(), n_events - n_firsts);
+    for (std::size_t n = 0; n < serial.sortedIntervals.size(); ++n) {
+        ASSERT_EQ(parallel.sortedIntervals[n], serial.sortedIntervals[n]);
+        if (n > 0) {
+            ASSERT_LE(serial.sortedIntervals[n-1], serial.sortedIntervals[n]);
+        }
+    }
+    ASSERT_EQ(serial.binCount.size(), 20u);
+    int n_binned = 0;
+    for (std::size_t n_b = 0; n_b < serial.binCount.size(); ++n_b) {
+        EXPECT_EQ(parallel.binCount[n_b], serial.binCount[n_b]);
+        n_binned += serial.binCount[n_b];
+    }
+    EXPECT_EQ((std::size_t)n_binned, n_events);
+    EXPECT_DOUBLE_EQ(parallel.meanInterval, serial.meanInterval);
+
+    // events of sections that haven't been scanned:
+    std::vector<std::size_t> few(sections[0].begin(), sections[0].begin()+3);
+    stfnum::EventSet partial(tables[0], 0.05, few, Vector_double(3, 10.0));
+    EXPECT_THROW(plan.Compute(partial), std::out_of_range);
+    // events that aren't sorted:
+    stfnum::EventTable unsorted;
+    const int onsets[] = {30, 10};
+    add_events(unsorted, 0, onsets, 2);
+    stfnum::EventSet wrong(unsorted, 0.1, std::vector<std::size_t>(1, 0), Vector_double(1, 10.0));
+    EXPECT_THROW(plan.Compute(wrong), std::runtime_error);
+}
+
+TEST(eventstats_test, ks_test) {
+    Vector_double a, b, c;
+    for (int k = 0; k < 200; ++k) {
+        a.push_back(k);
+        b.push_back(k + 0.5);
+        c.push_back(k + 100);
+    }
+    double p = 0;
+    // nearly the same distribution:
+    EXPECT_NEAR(stfnum::ksTest(a, b, p), 1.0/200, 1e-12);
+    EXPECT_GT(p, 0.99);
+    // shifted by half the range:
+    EXPECT_NEAR(stfnum::ksTest(a, c, p), 0.5, 1e-12);
+    EXPECT_LT(p, 1e-10);
+    EXPECT_TRUE(std::isnan(stfnum::ksTest(a, Vector_double(), p)));
+    EXPECT_TRUE(std::isnan(p));
+}
@@ -13,7 +13,7 @@ const static float dt = 1/100.0; /* sampling interval of data in ms */
 const static float tol = dt; /* 1 sampling interval */
 
 /* list of available fitting functions, see /src/stimfit/math/funclib.cpp */
-const static std::vector< stfnum::storedFunc > funcLib = stfnum::GetFuncLib();
+const static std::vector< stfnum::storedFunc >& funcLib = stfnum::FuncLib();
 
 /* Fitting options for the LM algorithm, see /src/stimfit/math/fit.h */
 const Vector_double opts = stfnum::LM_default_opts();
@@ -922,3 +922,655 @@ TEST(fitlib_test, id_12_fgaussian){
     //data.clear();
 
 }
+
+//=========================================================================
+// Tests that lmFit is re-entrant: fits of two different functions
+// running concurrently have to give the same results as serial fits
+//=========================================================================
+TEST(fitlib_test, reentrant_concurrent_fits){
+
+    Vector_double pars_exp(3);
+    pars_exp[0] = 50.0;   /* amplitude */
+    pars_exp[1] = 17.0;   /* time constant */
+    pars_exp[2] = -20.0;  /* end  */
+    Vector_double data_exp = fexp_simple(pars_exp);
+
+    Vector_double pars_gauss(3);
+    pars_gauss[0] = 1.5;  /* height */
+    pars_gauss[1] = 5.0;  /* peak   */
+    pars_gauss[2] = 4.5;  /* width  */
+    Vector_double data_gauss = fgauss(pars_gauss);
+
+    const int n_fits = 8;
+    std::vector<Vector_double> results(n_fits, Vector_double(3));
+    std::vector<int> warnings(n_fits, -1);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int n_fit = 0; n_fit < n_fits; ++n_fit) {
+        std::string info;
+        Vector_double pars(3);
+        if (n_fit % 2 == 0) {
+            pars[0] = 0.0; pars[1] = 5.0; pars[2] = -35.0;
+            stfnum::lmFit(data_exp, dt, funcLib[0], opts, true,
+                          pars, info, warnings[n_fit]);
+        } else {
+            pars[0] = 1.72; pars[1] = 5.5; pars[2] = 2.0;
+            stfnum::lmFit(data_gauss, dt, funcLib[12], opts, true,
+                          pars, info, warnings[n_fit]);
+        }
+        results[n_fit] = pars;
+    }
+
+    for (int n_fit = 0; n_fit < n_fits; ++n_fit) {
+        EXPECT_EQ(warnings[n_fit], 0);
+        const Vector_double& expected = (n_fit % 2 == 0) ? pars_exp : pars_gauss;
+        for (std::size_t n_p = 0; n_p < expected.size(); ++n_p) {
+            par_test(results[n_fit][n_p], expected[n_p], tol);
+        }
+    }
+}
+
+//=========================================================================
+// Tests fitting a monoexponential function to several sections at once
+// Stimfit function with ID = 0
+//=========================================================================
+TEST(fitlib_test, batch_fit_sections){
+
+    const std::size_t n_sections = 6;
+    Channel ch(n_sections);
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        Vector_double mypars(3);
+        mypars[0] = 50.0;          /* amplitude */
+        mypars[1] = 10.0 + n_s;    /* time constant */
+        mypars[2] = -20.0;         /* end  */
+        ch.InsertSection(Section(fexp_simple(mypars)), n_s);
+        sections.push_back(n_s);
+    }
+    /* this one is out of range and should result in an empty row */
+    sections.push_back(n_sections);
+
+    Recording rec(ch);
+    rec.SetXScale(dt);
+
+    Vector_double pars(3);
+    pars[0] = 0.0;        /* Offset */
+    pars[1] = 5.0;        /* Tau_0 */
+    pars[2] = -35.0;      /* Amp_0 */
+
+    stfnum::Table table = stfnum::batchFit(rec, 0, sections, funcLib[0], 0,
+                                           rec[0][0].size(), opts, true, pars);
+
+    EXPECT_EQ(table.nRows(), sections.size());
+    EXPECT_EQ(table.nCols(), funcLib[0].pInfo.size()+2);
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        EXPECT_FALSE(table.IsEmpty(n_s, 0));
+        EXPECT_EQ(table.at(n_s, 4), 0);  /* warning */
+        par_test(table.at(n_s, 0), 50.0, tol);        /* Amp_0  */
+        par_test(table.at(n_s, 1), 10.0 + n_s, tol);  /* Tau_0  */
+        par_test(table.at(n_s, 2), -20.0, tol);       /* Offset */
+    }
+    EXPECT_TRUE(table.IsEmpty(n_sections, 0));
+}
+
+//=========================================================================
+// Tests that fits sharing a workspace give the same results as fits
+// that allocate their own buffers, also when the workspace has to grow
+//=========================================================================
+TEST(fitlib_test, workspace_reuse){
+
+    Vector_double pars_exp(3);
+    pars_exp[0] = 50.0;   /* amplitude */
+    pars_exp[1] = 17.0;   /* time constant */
+    pars_exp[2] = -20.0;  /* end  */
+    Vector_double data_exp = fexp_simple(pars_exp);
+    Vector_double data_short(data_exp.begin(), data_exp.begin()+data_exp.size()/2);
+
+    Vector_double pars_gauss(3);
+    pars_gauss[0] = 1.5;  /* height */
+    pars_gauss[1] = 5.0;  /* peak   */
+    pars_gauss[2] = 4.5;  /* width  */
+    Vector_double data_gauss = fgauss(pars_gauss);
+
+    stfnum::FitWorkspace workspace(3, data_short.size());
+    EXPECT_EQ(workspace.GetNParams(), 3);
+    EXPECT_EQ(workspace.GetNPoints(), data_short.size());
+
+    for (int n_fit = 0; n_fit < 3; ++n_fit) {
+        const Vector_double& data = (n_fit == 0) ? data_short :
+            ((n_fit == 1) ? data_exp : data_gauss);
+        const stfnum::storedFunc& func = (n_fit == 2) ? funcLib[12] : funcLib[0];
+        Vector_double init(3);
+        if (n_fit == 2) {
+            init[0] = 1.72; init[1] = 5.5; init[2] = 2.0;
+        } else {
+            init[0] = 0.0; init[1] = 5.0; init[2] = -35.0;
+        }
+        std::string info, info_ws;
+        int warning = -1, warning_ws = -1;
+        Vector_double pars(init), pars_ws(init);
+        double sse = stfnum::lmFit(data, dt, func, opts, true, pars, info, warning);
+        double sse_ws = stfnum::lmFit(data, dt, func, opts, true, pars_ws, info_ws,
+                                      warning_ws, workspace);
+        EXPECT_EQ(warning_ws, warning);
+        EXPECT_EQ(info_ws, info);
+        EXPECT_DOUBLE_EQ(sse_ws, sse);
+        for (std::size_t n_p = 0; n_p < pars.size(); ++n_p) {
+            EXPECT_DOUBLE_EQ(pars_ws[n_p], pars[n_p]);
+        }
+    }
+    EXPECT_GE(workspace.GetNPoints(), data_gauss.size());
+}
+
+//=========================================================================
+// Tests that the batch functions of the library give the same results as
+// the functions and Jacobians that are evaluated point by point
+//=========================================================================
+TEST(fitlib_test, batch_functions){
+
+    const std::size_t n = 1001; /* odd, to test the remainder of SIMD loops */
+    Vector_double x(n);
+    for (std::size_t n_x = 0; n_x < n; ++n_x) {
+        x[n_x] = n_x*dt;
+    }
+    /* the second set makes some arguments of exp() underflow */
+    const double scales[] = {1.0, 0.005};
+
+    for (std::size_t n_f = 0; n_f < funcLib.size(); ++n_f) {
+        const stfnum::storedFunc& func = funcLib[n_f];
+        EXPECT_FALSE(func.batchFunc.empty()) << func.name;
+        if (func.batchFunc.empty()) {
+            continue;
+        }
+        std::size_t n_p = func.pInfo.size();
+        for (int n_s = 0; n_s < 2; ++n_s) {
+            Vector_double p(n_p);
+            for (std::size_t i = 0; i < n_p; ++i) {
+                p[i] = scales[n_s]*(1.0 + 0.7*i);
+            }
+            Vector_double y(n);
+            func.batchFunc(&x[0], n, &p[0], n_p, &y[0]);
+            for (std::size_t n_x = 0; n_x < n; ++n_x) {
+                double ref = func.func(x[n_x], p);
+                EXPECT_NEAR(y[n_x], ref, 1e-12*std::max(1.0, fabs(ref))) << func.name;
+            }
+            EXPECT_TRUE(func.hasJac) << func.name;
+            EXPECT_FALSE(func.batchJac.empty()) << func.name;
+            if (!func.hasJac || func.batchJac.empty()) {
+                continue;
+            }
+            Vector_double J(n*n_p);
+            func.batchJac(&x[0], n, &p[0], n_p, &J[0]);
+            for (std::size_t n_x = 0; n_x < n; ++n_x) {
+                Vector_double ref = func.jac(x[n_x], p);
+                for (std::size_t i = 0; i < n_p; ++i) {
+                    EXPECT_NEAR(J[n_x*n_p+i], ref[i], 1e-12*std::max(1.0, fabs(ref[i]))) << func.name;
+                }
+            }
+        }
+    }
+}
+
+//=========================================================================
+// Tests the analytic Jacobians of the library against central differences
+//=========================================================================
+TEST(fitlib_test, jacobians_finite_differences){
+
+    for (std::size_t n_f = 0; n_f < funcLib.size(); ++n_f) {
+        const stfnum::storedFunc& func = funcLib[n_f];
+        EXPECT_TRUE(func.hasJac) << func.name;
+        if (!func.hasJac) {
+            continue;
+        }
+        std::size_t n_p = func.pInfo.size();
+        Vector_double p(n_p);
+        for (std::size_t i = 0; i < n_p; ++i) {
+            p[i] = 1.0 + 0.7*i;
+        }
+        for (double x = 0.05; x < 10.0; x += 0.3) {
+            /* the functions with a delay have a kink at x = p[1] */
+            if (fabs(x-p[1]) < 1e-3) {
+                continue;
+            }
+            Vector_double jac = func.jac(x, p);
+            ASSERT_EQ(jac.size(), n_p) << func.name;
+            for (std::size_t i = 0; i < n_p; ++i) {
+                double h = 1e-6*std::max(1.0, fabs(p[i]));
+                Vector_double p_hi(p), p_lo(p);
+                p_hi[i] += h;
+                p_lo[i] -= h;
+                double diff = (func.func(x, p_hi) - func.func(x, p_lo)) / (2*h);
+                EXPECT_NEAR(jac[i], diff, 1e-5*std::max(1.0, fabs(diff)))
+                    << func.name << ", parameter " << i << ", x = " << x;
+            }
+        }
+    }
+}
+
+//=========================================================================
+// Tests that the specialized exponential sums evaluate stfnum::fexp()
+//=========================================================================
+template <int N>
+void expsum_test() {
+    Vector_double p(stfnum::ExpSum<N>::n_params);
+    EXPECT_EQ(p.size(), 2*N+1);
+    for (std::size_t i = 0; i < p.size(); ++i) {
+        p[i] = (i % 2 == 0) ? 10.0 - 3.0*i : 0.5 + i;
+    }
+    for (double x = 0; x < 10.0; x += 0.25) {
+        EXPECT_DOUBLE_EQ(stfnum::ExpSum<N>::func(x, p), stfnum::fexp(x, p));
+        Vector_double jac = stfnum::ExpSum<N>::jac(x, p);
+        Vector_double ref = stfnum::fexp_jac(x, p);
+        ASSERT_EQ(jac.size(), ref.size());
+        for (std::size_t i = 0; i < p.size(); ++i) {
+            EXPECT_DOUBLE_EQ(jac[i], ref[i]);
+        }
+    }
+}
+
+TEST(fitlib_test, expsum_specializations){
+    expsum_test<1>();
+    expsum_test<2>();
+    expsum_test<3>();
+}
+
+//=========================================================================
+// Tests warm starts of consecutive sections in batch fits
+//=========================================================================
+TEST(fitlib_test, batch_fit_warm_start){
+
+    const std::size_t n_sections = 8;
+    Channel ch(n_sections);
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        Vector_double mypars(3);
+        mypars[0] = 50.0 + n_s;      /* amplitude */
+        mypars[1] = 10.0 + 0.5*n_s;  /* time constant */
+        mypars[2] = -20.0;           /* end  */
+        ch.InsertSection(Section(fexp_simple(mypars)), n_s);
+        sections.push_back(n_s);
+    }
+    Recording rec(ch);
+    rec.SetXScale(dt);
+
+    Vector_double pars(3);
+    pars[0] = 0.0;        /* Offset */
+    pars[1] = 5.0;        /* Tau_0 */
+    pars[2] = -35.0;      /* Amp_0 */
+
+    stfnum::fit_start starts[] = {stfnum::start_previous, stfnum::start_median};
+    for (int n_start = 0; n_start < 2; ++n_start) {
+        stfnum::Table table = stfnum::batchFit(rec, 0, sections, funcLib[0], 0,
+                                               rec[0][0].size(), opts, true, pars,
+                                               starts[n_start], 3);
+        EXPECT_EQ(table.nRows(), sections.size());
+        for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+            EXPECT_FALSE(table.IsEmpty(n_s, 0));
+            EXPECT_EQ(table.at(n_s, 4), 0);  /* warning */
+            par_test(table.at(n_s, 0), 50.0 + n_s, tol);       /* Amp_0  */
+            par_test(table.at(n_s, 1), 10.0 + 0.5*n_s, tol);   /* Tau_0  */
+            par_test(table.at(n_s, 2), -20.0, tol);            /* Offset */
+        }
+    }
+}
+
+//=========================================================================
+// Tests fits from several starting points
+//=========================================================================
+TEST(fitlib_test, multi_start_fit){
+
+    Vector_double pars_exp(3);
+    pars_exp[0] = 50.0;   /* amplitude */
+    pars_exp[1] = 17.0;   /* time constant */
+    pars_exp[2] = -20.0;  /* end  */
+    Vector_double data_exp = fexp_simple(pars_exp);
+
+    Vector_double init(3);
+    init[0] = 0.0; init[1] = 5.0; init[2] = -35.0;
+    const std::size_t n_starts = 6;
+    stfnum::MultiStartResult result = stfnum::multiStartFit(data_exp, dt, funcLib[0], opts,
+                                                            true, init, n_starts);
+    EXPECT_EQ(result.starts.size(), n_starts);
+    EXPECT_EQ(result.results.size(), n_starts);
+    EXPECT_EQ(result.chisqrs.size(), n_starts);
+    EXPECT_EQ(result.spread.size(), init.size());
+    for (std::size_t n_p = 0; n_p < init.size(); ++n_p) {
+        EXPECT_EQ(result.starts[0][n_p], init[n_p]);
+    }
+    for (std::size_t n_f = 0; n_f < n_starts; ++n_f) {
+        if (result.chisqrs[n_f] == result.chisqrs[n_f]) {
+            EXPECT_LE(result.chisqr, result.chisqrs[n_f]);
+        }
+    }
+    EXPECT_EQ(result.warning, 0);
+    par_test(result.p[0], pars_exp[0], tol);
+    par_test(result.p[1], pars_exp[1], tol);
+    par_test(result.p[2], pars_exp[2], tol);
+
+    /* equal seeds give equal starts */
+    stfnum::MultiStartResult again = stfnum::multiStartFit(data_exp, dt, funcLib[0], opts,
+                                                           true, init, n_starts);
+    for (std::size_t n_f = 0; n_f < n_starts; ++n_f) {
+        for (std::size_t n_p = 0; n_p < init.size(); ++n_p) {
+            EXPECT_EQ(again.starts[n_f][n_p], result.starts[n_f][n_p]);
+        }
+    }
+
+    /* the width of a Gaussian is constrained to positive values */
+    Vector_double init_gauss(3);
+    init_gauss[0] = 1.72; init_gauss[1] = 5.5; init_gauss[2] = 2.0;
+    Vector_double pars_gauss(3);
+    pars_gauss[0] = 1.5; pars_gauss[1] = 5.0; pars_gauss[2] = 4.5;
+    stfnum::MultiStartResult gauss = stfnum::multiStartFit(fgauss(pars_gauss), dt, funcLib[12], opts,
+                                                           true, init_gauss, 16, 0.5);
+    for (std::size_t n_f = 0; n_f < gauss.starts.size(); ++n_f) {
+        EXPECT_GE(gauss.starts[n_f][2], 0.0);
+    }
+}
+
+//=========================================================================
+// Tests global fits with a shared time constant
+//=========================================================================
+TEST(fitlib_test, global_fit_shared_tau){
+
+    const std::size_t n_sections = 5;
+    Channel ch(n_sections);
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        Vector_double mypars(3);
+        mypars[0] = 20.0 + 10.0*n_s;  /* amplitude */
+        mypars[1] = 12.0;             /* time constant */
+        mypars[2] = -5.0*n_s;         /* end  */
+        ch.InsertSection(Section(fexp_simple(mypars)), n_s);
+        sections.push_back(n_s);
+    }
+    Recording rec(ch);
+    rec.SetXScale(dt);
+
+    std::vector<Vector_double> pars(1, Vector_double(3));
+    pars[0][0] = 10.0;     /* Amp_0 */
+    pars[0][1] = 5.0;      /* Tau_0 */
+    pars[0][2] = 0.0;      /* Offset */
+
+    std::deque<bool> shared(3, false);
+    shared[1] = true;
+
+    stfnum::GlobalFitResult result = stfnum::globalFit(rec, 0, sections, funcLib[0], 0,
+                                                       rec[0][0].size(), shared, opts, pars);
+    EXPECT_EQ(result.warning, 0);
+    EXPECT_EQ(result.p.size(), n_sections);
+    EXPECT_LT(result.chisqr, 1e-6);
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        par_test(result.p[n_s][0], 20.0 + 10.0*n_s, tol);  /* Amp_0  */
+        EXPECT_EQ(result.p[n_s][1], result.p[0][1]);     /* shared */
+        par_test(result.p[n_s][1], 12.0, tol);             /* Tau_0  */
+        EXPECT_NEAR(result.p[n_s][2], -5.0*n_s, tol);      /* Offset */
+    }
+}
+
+//=========================================================================
+// Tests single precision fits of compact single precision sections
+//=========================================================================
+TEST(fitlib_test, single_precision_fit){
+
+    const std::size_t n_sections = 4;
+    Channel ch(n_sections);
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        Vector_double mypars(3);
+        mypars[0] = 50.0;          /* amplitude */
+        mypars[1] = 10.0 + n_s;    /* time constant */
+        mypars[2] = -20.0;         /* end  */
+        Vector_double data = fexp_simple(mypars);
+        std::vector<float> samples(data.begin(), data.end());
+        ch.InsertSection(Section(stfio::compactSamples(samples)), n_s);
+        sections.push_back(n_s);
+    }
+    Recording rec(ch);
+    rec.SetXScale(dt);
+
+    /* compact single precision samples are copied exactly */
+    std::vector<float> window(rec[0][0].size());
+    rec[0][0].CopyRange(0, window.size(), &window[0]);
+    for (std::size_t n = 0; n < window.size(); ++n) {
+        EXPECT_EQ(window[n], (float)rec[0][0][n]);
+    }
+
+    Vector_double pars(3);
+    pars[0] = 0.0;        /* Offset */
+    pars[1] = 5.0;        /* Tau_0 */
+    pars[2] = -35.0;      /* Amp_0 */
+
+    std::string info;
+    int warning;
+    Vector_double single(pars), dbl(pars);
+    stfnum::lmFit(window, dt, funcLib[0], opts, true, single, info, warning);
+    stfnum::lmFit(rec[0][0].get(), dt, funcLib[0], opts, true, dbl, info, warning);
+    for (std::size_t n_p = 0; n_p < pars.size(); ++n_p) {
+        par_test(single[n_p], dbl[n_p], tol);
+    }
+
+    stfnum::Table table = stfnum::batchFit(rec, 0, sections, funcLib[0], 0,
+                                           rec[0][0].size(), opts, true, pars,
+                                           stfnum::start_initial, 3, true);
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        EXPECT_FALSE(table.IsEmpty(n_s, 0));
+        par_test(table.at(n_s, 0), 50.0, tol);        /* Amp_0  */
+        par_test(table.at(n_s, 1), 10.0 + n_s, tol);  /* Tau_0  */
+        par_test(table.at(n_s, 2), -20.0, tol);       /* Offset */
+    }
+}
+
+//=========================================================================
+// Tests that batch fits re-use cached results
+//=========================================================================
+TEST(fitlib_test, batch_fit_cache){
+
+    const std::size_t n_sections = 4;
+    Channel ch(n_sections);
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        Vector_double mypars(3);
+        mypars[0] = 50.0;          /* amplitude */
+        mypars[1] = 10.0 + n_s;    /* time constant */
+        mypars[2] = -20.0;         /* end  */
+        ch.InsertSection(Section(fexp_simple(mypars)), n_s);
+        sections.push_back(n_s);
+    }
+    Recording rec(ch);
+    rec.SetXScale(dt);
+
+    Vector_double pars(3);
+    pars[0] = 0.0;        /* Offset */
+    pars[1] = 5.0;        /* Tau_0 */
+    pars[2] = -35.0;      /* Amp_0 */
+
+    std::size_t fitEnd = rec[0][0].size();
+    unsigned long long key = stfnum::fitCacheKey(rec[0][0], 0, fitEnd, dt, funcLib[0], opts, true, pars);
+    EXPECT_EQ(key, stfnum::fitCacheKey(rec[0][0], 0, fitEnd, dt, funcLib[0], opts, true, pars));
+    EXPECT_NE(key, stfnum::fitCacheKey(rec[0][1], 0, fitEnd, dt, funcLib[0], opts, true, pars));
+    EXPECT_NE(key, stfnum::fitCacheKey(rec[0][0], 1, fitEnd, dt, funcLib[0], opts, true, pars));
+    EXPECT_NE(key, stfnum::fitCacheKey(rec[0][0], 0, fitEnd, dt, funcLib[0], opts, false, pars));
+
+    std::vector<stfio::FitCache> caches(n_sections);
+    stfnum::Table table = stfnum::batchFit(rec, 0, sections, funcLib[0], 0, fitEnd, opts, true, pars,
+                                           stfnum::start_initial, 3, false, &caches);
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        ASSERT_EQ(caches[n_s].size(), 1);
+        par_test(table.at(n_s, 1), 10.0 + n_s, tol);  /* Tau_0  */
+    }
+    EXPECT_EQ(caches[0].GetEntries()[0].key, key);
+
+    /* a modified cached result shows that the section isn't fitted again */
+    stfio::FitCacheEntry entry = caches[2].GetEntries()[0];
+    entry.params[1] = 123.0;
+    caches[2].Insert(entry);
+    stfnum::Table again = stfnum::batchFit(rec, 0, sections, funcLib[0], 0, fitEnd, opts, true, pars,
+                                           stfnum::start_initial, 3, false, &caches);
+    EXPECT_EQ(again.at(2, 1), 123.0);
+    EXPECT_EQ(again.at(1, 1), table.at(1, 1));
+    EXPECT_EQ(caches[2].size(), 1);
+}
+
+//=========================================================================
+// Tests that every event of a section is fitted in its own window
+//=========================================================================
+TEST(fitlib_test, fit_events){
+
+    const std::size_t n_events = 4;
+    const std::size_t onsets_[n_events] = {100, 2000, 4000, 9500};
+    std::vector<std::size_t> onsets(onsets_, onsets_+n_events);
+    Vector_double data(int(tmax/dt), -20.0);
+    for (std::size_t n_e = 0; n_e < n_events; ++n_e) {
+        std::size_t end = n_e+1 < n_events ? onsets[n_e+1] : data.size();
+        for (std::size_t n = onsets[n_e]; n < end; ++n) {
+            data[n] = 50.0*exp(-((n-onsets[n_e])*dt)/(1.0 + n_e)) - 20.0;
+        }
+    }
+    Section sec(data);
+
+    Vector_double pars(3);
+    pars[0] = 0.0;        /* Offset */
+    pars[1] = 5.0;        /* Tau_0 */
+    pars[2] = -35.0;      /* Amp_0 */
+
+    /* the window of the last event exceeds the section */
+    const std::size_t length = 1500;
+    stfnum::Table table = stfnum::fitEvents(sec, dt, onsets, 0, length, funcLib[0],
+                                            opts, true, pars);
+
+    EXPECT_EQ(table.nRows(), n_events);
+    EXPECT_EQ(table.nCols(), funcLib[0].pInfo.size()+3);
+    for (std::size_t n_e = 0; n_e < n_events-1; ++n_e) {
+        EXPECT_DOUBLE_EQ(table.at(n_e, 0), onsets[n_e]*(double)dt);
+        EXPECT_FALSE(table.IsEmpty(n_e, 1));
+        par_test(table.at(n_e, 1), 50.0, tol);         /* Amp_0  */
+        par_test(table.at(n_e, 2), 1.0 + n_e, tol);    /* Tau_0  */
+        par_test(table.at(n_e, 3), -20.0, tol);        /* Offset */
+
+        /* same as fitting a copy of the window */
+        Vector_double window(&data[onsets[n_e]], &data[onsets[n_e]]+length);
+        Vector_double copied(pars);
+        std::string info;
+        int warning;
+        double chisqr = stfnum::lmFit(window, dt, funcLib[0], opts, true, copied, info, warning);
+        EXPECT_DOUBLE_EQ(table.at(n_e, 4), chisqr);
+        for (std::size_t n_p = 0; n_p < pars.size(); ++n_p) {
+            EXPECT_DOUBLE_EQ(table.at(n_e, n_p+1), copied[n_p]);
+        }
+    }
+    EXPECT_DOUBLE_EQ(table.at(n_events-1, 0), onsets[n_events-1]*(double)dt);
+    EXPECT_FALSE(table.IsEmpty(n_events-1, 0));
+    EXPECT_TRUE(table.IsEmpty(n_events-1, 1));
+}
+
+//=========================================================================
+// Tests bootstrap and jackknife confidence intervals of a noisy fit
+//=========================================================================
+TEST(fitlib_test, bootstrap_fit){
+
+    Vector_double pars_exp(3);
+    pars_exp[0] = 50.0;   /* amplitude */
+    pars_exp[1] = 17.0;   /* time constant */
+    pars_exp[2] = -20.0;  /* end  */
+    Vector_double data_exp = fexp_simple(pars_exp);
+    /* Gaussian noise from a fixed linear congruential sequence */
+    unsigned long long state = 12345;
+    for (std::size_t n = 0; n+1 < data_exp.size(); n += 2) {
+        state = (state * 6364136223846793005ULL + 1442695040888963407ULL);
+        double u1 = ((state >> 11) + 1.0) / 9007199254740993.0;
+        state = (state * 6364136223846793005ULL + 1442695040888963407ULL);
+        double u2 = (state >> 11) / 9007199254740992.0;
+        double r = sqrt(-2.0*log(u1));
+        data_exp[n] += 2.0 * r * cos(2.0*M_PI*u2);
+        data_exp[n+1] += 2.0 * r * sin(2.0*M_PI*u2);
+    }
+
+    Vector_double p(pars_exp);
+    std::string info;
+    int warning = 0;
+    stfnum::lmFit(data_exp, dt, funcLib[0], opts, true, p, info, warning);
+
+    const std::size_t n_resamples = 100;
+    stfnum::BootstrapResult boot = stfnum::bootstrapFit(data_exp, dt, funcLib[0], opts, true, p,
+                                                        stfnum::resample_bootstrap, n_resamples);
+    EXPECT_EQ(boot.samples.size(), n_resamples);
+    EXPECT_EQ(boot.n_failed, 0u);
+    EXPECT_EQ(boot.level, 0.95);
+    for (std::size_t n_p = 0; n_p < p.size(); ++n_p) {
+        EXPECT_EQ(boot.p[n_p], p[n_p]);
+        EXPECT_GT(boot.se[n_p], 0.0);
+        EXPECT_LT(boot.lower[n_p], p[n_p]);
+        EXPECT_GT(boot.upper[n_p], p[n_p]);
+        /* the true values lie within 4 standard errors */
+        EXPECT_LT(fabs(p[n_p]-pars_exp[n_p]), 4.0*boot.se[n_p]);
+    }
+
+    /* equal seeds give equal intervals, regardless of the number of threads */
+    stfnum::BootstrapResult again = stfnum::bootstrapFit(data_exp, dt, funcLib[0], opts, true, p,
+                                                         stfnum::resample_bootstrap, n_resamples,
+                                                         0.95, 1, 1, 1);
+    for (std::size_t n_p = 0; n_p < p.size(); ++n_p) {
+        EXPECT_DOUBLE_EQ(again.lower[n_p], boot.lower[n_p]);
+        EXPECT_DOUBLE_EQ(again.upper[n_p], boot.upper[n_p]);
+    }
+
+    /* the jackknife agrees with the bootstrap */
+    stfnum::BootstrapResult jack = stfnum::bootstrapFit(data_exp, dt, funcLib[0], opts, true, p,
+                                                        stfnum::resample_jackknife, 50);
+    EXPECT_EQ(jack.samples.size(), 50u);
+    for (std::size_t n_p = 0; n_p < p.size(); ++n_p) {
+        EXPECT_GT(jack.se[n_p], 0.5*boot.se[n_p]);
+        EXPECT_LT(jack.se[n_p], 2.0*boot.se[n_p]);
+        EXPECT_NEAR(0.5*(jack.lower[n_p]+jack.upper[n_p]), p[n_p], 1e-9*fabs(p[n_p]) + 1e-12);
+    }
+
+    /* the intervals are added to the output of the fit */
+    stfnum::Table output = funcLib[0].output(p, funcLib[0].pInfo, 0.0);
+    stfnum::Table table = stfnum::confidenceTable(output, boot);
+    EXPECT_EQ(table.nRows(), output.nRows());
+    EXPECT_EQ(table.nCols(), output.nCols()+3);
+    EXPECT_EQ(table.GetColLabel(output.nCols()+1), "Lower 95%");
+    EXPECT_EQ(table.at(1, output.nCols()+2), boot.upper[1]);
+    EXPECT_TRUE(table.IsEmpty(p.size(), output.nCols()));
+    EXPECT_FALSE(table.IsEmpty(p.size(), 0));
+}
+
+//=========================================================================
+// The function library is shared, and its functions can be found by id
+//=========================================================================
+TEST(fitlib_test, registry) {
+    const std::vector<stfnum::storedFunc>& lib = stfnum::FuncLib();
+    EXPECT_EQ(&lib, &stfnum::FuncLib());
+    EXPECT_EQ(lib.size(), (std::size_t)stfnum::func_count);
+
+    EXPECT_EQ(stfnum::GetFunc(stfnum::func_mexp).name, "Monoexponential");
+    EXPECT_EQ(stfnum::GetFunc(stfnum::func_alpha).name, "Alpha function");
+    EXPECT_EQ(stfnum::GetFunc(stfnum::func_gauss).name, "Gaussian");
+    EXPECT_THROW(stfnum::GetFunc(stfnum::func_count), std::out_of_range);
+
+    for (std::size_t n_f = 0; n_f < lib.size(); ++n_f) {
+        EXPECT_EQ(stfnum::FuncId(&stfnum::GetFunc(n_f)), n_f);
+    }
+    EXPECT_EQ(stfnum::FuncId(NULL), lib.size());
+    EXPECT_EQ(stfnum::FuncId(&funcLib[0]), 0u);
+
+    /* every parameter of the delayed monoexponential has its own scale */
+    const stfnum::storedFunc& mexpde = stfnum::GetFunc(stfnum::func_mexp_delay);
+    ASSERT_EQ(mexpde.pInfo.size(), 4u);
+    EXPECT_DOUBLE_EQ(mexpde.pInfo[1].scale(1.0, 2.0, 0.0, 3.0, 0.0), 2.0);
+    EXPECT_DOUBLE_EQ(mexpde.pInfo[3].scale(1.0, 2.0, 0.0, 3.0, 0.5), 2.5);
+    EXPECT_DOUBLE_EQ(mexpde.pInfo[0].unscale(mexpde.pInfo[0].scale(1.5, 2.0, 0.0, 3.0, 0.5),
+                                             2.0, 0.0, 3.0, 0.5), 1.5);
+
+    /* copies are equal to the shared library */
+    std::vector<stfnum::storedFunc> copy = stfnum::GetFuncLib();
+    ASSERT_EQ(copy.size(), lib.size());
+    for (std::size_t n_f = 0; n_f < lib.size(); ++n_f) {
+        EXPECT_EQ(copy[n_f].name, lib[n_f].name);
+        EXPECT_EQ(copy[n_f].pInfo.size(), lib[n_f].pInfo.size());
+    }
+    EXPECT_TRUE(lib[stfnum::func_gauss].pInfo[2].constrained);
+}
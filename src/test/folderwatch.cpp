@@ -0,0 +1,91 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/folderwatch.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char* const folder = "folderwatch_test";
+
+std::string path(const std::string& name) {
+    return std::string(folder) + "/" + name;
+}
+
+void makeFolder() {
+#ifdef _WIN32
+    _mkdir(folder);
+#else
+    mkdir(folder, 0755);
+#endif
+}
+
+void writeFile(const std::string& name, const std::string& contents, bool append=false) {
+    std::ofstream file(path(name).c_str(), append ? std::ios::app | std::ios::binary : std::ios::binary);
+    file << contents;
+}
+
+}
+
+TEST(FolderWatch_test, hash) {
+    makeFolder();
+    writeFile("a.abf", "recording");
+    writeFile("b.abf", "recording");
+    writeFile("c.abf", "recordinG");
+    EXPECT_EQ( stfio::hashFile(path("a.abf")), stfio::hashFile(path("b.abf")) );
+    EXPECT_NE( stfio::hashFile(path("a.abf")), stfio::hashFile(path("c.abf")) );
+    EXPECT_THROW( stfio::hashFile(path("missing.abf")), std::runtime_error );
+    remove(path("a.abf").c_str());
+    remove(path("b.abf").c_str());
+    remove(path("c.abf").c_str());
+}
+
+TEST(FolderWatch_test, poll) {
+    makeFolder();
+    writeFile("a.abf", "recording 1");
+    writeFile("b.ABF", "recording 1");
+    writeFile("c.txt", "notes");
+    writeFile("d.abf", "");
+
+    std::vector<std::string> folders(1, folder), extensions(1, "abf");
+    stfio::FolderWatcher watcher(folders, extensions);
+    // files are only complete once they haven't changed for a poll:
+    EXPECT_TRUE( watcher.Poll(10).empty() );
+
+    // the second file waits for the next poll:
+    std::vector<std::string> files = watcher.Poll(1);
+    ASSERT_EQ( files.size(), 1 );
+    EXPECT_EQ( files[0], path("a.abf") );
+    EXPECT_EQ( watcher.GetPending(), 1 );
+
+    // the copy has the same contents, and empty files aren't complete:
+    EXPECT_TRUE( watcher.Poll(10).empty() );
+    EXPECT_EQ( watcher.GetDuplicates(), 1 );
+    EXPECT_EQ( watcher.GetPending(), 0 );
+
+    // a file that is still being written:
+    writeFile("e.abf", "recording");
+    EXPECT_TRUE( watcher.Poll(10).empty() );
+    writeFile("e.abf", " 2", true);
+    EXPECT_TRUE( watcher.Poll(10).empty() );
+    files = watcher.Poll(10);
+    ASSERT_EQ( files.size(), 1 );
+    EXPECT_EQ( files[0], path("e.abf") );
+    EXPECT_TRUE( watcher.Poll(10).empty() );
+
+    const char* const names[] = { "a.abf", "b.ABF", "c.txt", "d.abf", "e.abf" };
+    for (int n = 0; n < 5; ++n) {
+        remove(path(names[n]).c_str());
+    }
+#ifndef _WIN32
+    rmdir(folder);
+#endif
+}
@@ -0,0 +1,348 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/hdf5/hdf5lib.h"
+#include "hdf5.h"
+#include "hdf5_hl.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace {
+
+// A recording with two channels and sections of different lengths:
+Recording ragged_recording() {
+    std::deque<Channel> ch_list;
+    for (int n_c = 0; n_c < 2; ++n_c) {
+        std::deque<Section> sec_list;
+        for (int n_s = 0; n_s < 5; ++n_s) {
+            Vector_double data(1000 + 3000*(n_s%3));
+            for (std::size_t k = 0; k < data.size(); ++k) {
+                data[k] = 10.0*n_c + sin(0.001*k*(n_s+1));
+            }
+            sec_list.push_back(Section(data));
+        }
+        Channel ch(sec_list);
+        ch.SetChannelName(n_c == 0 ? "Im" : "Vm");
+        ch.SetYUnits(n_c == 0 ? "pA" : "mV");
+        ch_list.push_back(ch);
+    }
+    Recording rec(ch_list);
+    rec.SetXScale(0.05);
+    return rec;
+}
+
+void expect_roundtrip(stfio::hdf5_layout layout, stfio::hdf5_filter filter) {
+    const char* fName = "hdf5_test.h5";
+    stftest::NullProgressInfo progDlg;
+    Recording rec = ragged_recording();
+    stfio::exportHDF5File(fName, rec, progDlg, layout, filter);
+
+    Recording imported;
+    stfio::importHDF5File(fName, imported, progDlg);
+    std::remove(fName);
+
+    ASSERT_EQ( imported.size(), rec.size() );
+    EXPECT_DOUBLE_EQ( imported.GetXScale(), rec.GetXScale() );
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        EXPECT_EQ( imported[n_c].GetChannelName(), rec[n_c].GetChannelName() );
+        EXPECT_EQ( imported[n_c].GetYUnits(), rec[n_c].GetYUnits() );
+        ASSERT_EQ( imported[n_c].size(), rec[n_c].size() );
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            ASSERT_EQ( imported[n_c][n_s].size(), rec[n_c][n_s].size() );
+            for (std::size_t k = 0; k < rec[n_c][n_s].size(); ++k) {
+                // stored with single precision:
+                ASSERT_EQ( imported[n_c][n_s][k], double(float(rec[n_c][n_s][k])) );
+            }
+        }
+    }
+}
+
+
+void expect_range(stfio::hdf5_layout layout) {
+    const char* fName = "hdf5_test.h5";
+    stftest::NullProgressInfo progDlg;
+    Recording rec = ragged_recording();
+    stfio::exportHDF5File(fName, rec, progDlg, layout);
+
+    const std::size_t sec_begin = 1, sec_end = 4, sample_begin = 500, sample_end = 2500;
+    Recording part;
+    stfio::importHDF5Range(fName, part, progDlg, sec_begin, sec_end, sample_begin, sample_end);
+    ASSERT_EQ( part.size(), rec.size() );
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        EXPECT_EQ( part[n_c].GetYUnits(), rec[n_c].GetYUnits() );
+        ASSERT_EQ( part[n_c].size(), sec_end-sec_begin );
+        for (std::size_t n_s = sec_begin; n_s < sec_end; ++n_s) {
+            const Section& sec = rec[n_c][n_s];
+            std::size_t begin = std::min(sample_begin, sec.size());
+            std::size_t end = std::min(sample_end, sec.size());
+            ASSERT_EQ( part[n_c][n_s-sec_begin].size(), end-begin );
+            for (std::size_t k = begin; k < end; ++k) {
+                ASSERT_EQ( part[n_c][n_s-sec_begin][k-begin], double(float(sec[k])) );
+            }
+        }
+    }
+
+    // ranges are truncated at the end of the data:
+    Recording tail;
+    stfio::importHDF5Range(fName, tail, progDlg, 3, 100);
+    ASSERT_EQ( tail[0].size(), 2 );
+    EXPECT_EQ( tail[0][1].size(), rec[0][4].size() );
+    EXPECT_THROW( stfio::importHDF5Range(fName, tail, progDlg, 2, 1), std::out_of_range );
+
+    // the generic entry points used for progressive loading:
+    std::vector<std::size_t> counts = stfio::getSectionCounts(fName, stfio::hdf5);
+    ASSERT_EQ( counts.size(), rec.size() );
+    EXPECT_EQ( counts[1], rec[1].size() );
+    Recording first;
+    stfio::importFileRange(fName, stfio::hdf5, first, progDlg, 0, 1);
+    ASSERT_EQ( first[1].size(), 1 );
+    EXPECT_EQ( first[1][0].size(), rec[1][0].size() );
+    EXPECT_TRUE( stfio::getSectionCounts(fName, stfio::abf).empty() );
+    EXPECT_THROW( stfio::importFileRange(fName, stfio::abf, first, progDlg, 0, 1), std::runtime_error );
+    std::remove(fName);
+}
+
+}
+
+TEST(hdf5_test, sections_layout)
+{
+    expect_roundtrip(stfio::hdf5_sections, stfio::hdf5_no_filter);
+    expect_range(stfio::hdf5_sections);
+}
+
+TEST(hdf5_test, chunked_layout)
+{
+    expect_roundtrip(stfio::hdf5_chunked, stfio::hdf5_no_filter);
+    expect_roundtrip(stfio::hdf5_chunked, stfio::hdf5_shuffle_deflate);
+    // not quantized, so compressed with shuffle and deflate instead:
+    expect_roundtrip(stfio::hdf5_chunked, stfio::hdf5_ephys);
+    expect_range(stfio::hdf5_chunked);
+}
+
+TEST(hdf5_test, parallel_chunks)
+{
+    // sections that span several chunks, including a partial one at the end:
+    const char* fName = "hdf5_test_chunks.h5";
+    stftest::NullProgressInfo progDlg;
+    std::deque<Section> sec_list;
+    for (int n_s = 0; n_s < 7; ++n_s) {
+        Vector_double data(n_s == 3 ? 0 : 150000 + 20000*n_s);
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            data[k] = n_s + sin(0.0001*k);
+        }
+        sec_list.push_back(Section(data));
+    }
+    Channel ch(sec_list);
+    ch.SetChannelName("Im");
+    Recording rec(ch);
+    rec.SetXScale(0.05);
+    stfio::exportHDF5File(fName, rec, progDlg, stfio::hdf5_chunked, stfio::hdf5_shuffle_deflate);
+
+    // the chunks that are compressed in parallel are decompressed by HDF5:
+    hid_t file_id = H5Fopen(fName, H5F_ACC_RDONLY, H5P_DEFAULT);
+    ASSERT_GE( file_id, 0 );
+    std::vector<float> stored(7*270000);
+    EXPECT_GE( H5LTread_dataset_float(file_id, "/Im/data", &stored[0]), 0 );
+    H5Fclose(file_id);
+    EXPECT_EQ( stored[270000+150000], float(rec[0][1][150000]) );
+    EXPECT_EQ( stored[6*270000+269999], float(rec[0][6][269999]) );
+    EXPECT_EQ( stored[4*270000+250000], 0.0f );
+
+    Recording imported;
+    stfio::importHDF5File(fName, imported, progDlg);
+    ASSERT_EQ( imported[0].size(), rec[0].size() );
+    for (std::size_t n_s = 0; n_s < rec[0].size(); ++n_s) {
+        ASSERT_EQ( imported[0][n_s].size(), rec[0][n_s].size() );
+        for (std::size_t k = 0; k < rec[0][n_s].size(); ++k) {
+            ASSERT_EQ( imported[0][n_s][k], double(float(rec[0][n_s][k])) );
+        }
+    }
+
+    // a window that starts and ends within chunks:
+    Recording part;
+    stfio::importHDF5Range(fName, part, progDlg, 2, 7, 60000, 200000);
+    ASSERT_EQ( part[0].size(), 5u );
+    EXPECT_EQ( part[0][1].size(), 0u );
+    for (std::size_t n_t = 0; n_t < part[0].size(); ++n_t) {
+        const Section& sec = rec[0][n_t+2];
+        std::size_t end = std::min((std::size_t)200000, sec.size());
+        ASSERT_EQ( part[0][n_t].size(), end > 60000 ? end-60000 : 0 );
+        for (std::size_t k = 0; k < part[0][n_t].size(); ++k) {
+            ASSERT_EQ( part[0][n_t][k], double(float(sec[k+60000])) );
+        }
+    }
+    std::remove(fName);
+}
+
+TEST(hdf5_test, contiguous_channel)
+{
+    const char* fName = "hdf5_test.h5";
+    stftest::NullProgressInfo progDlg;
+    Channel ch(4, 3000);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        for (std::size_t k = 0; k < ch[n_s].size(); ++k) {
+            ch[n_s][k] = sin(0.001*k*(n_s+1));
+        }
+    }
+    ch.MakeContiguous();
+    Recording rec(ch);
+    rec.SetXScale(0.05);
+    const Recording& crec = rec;
+    ASSERT_TRUE( crec[0].GetContiguous() != NULL );
+    stfio::exportHDF5File(fName, rec, progDlg, stfio::hdf5_chunked);
+
+    Recording imported;
+    stfio::importHDF5File(fName, imported, progDlg);
+    std::remove(fName);
+    ASSERT_EQ( imported[0].size(), crec[0].size() );
+    for (std::size_t n_s = 0; n_s < crec[0].size(); ++n_s) {
+        ASSERT_EQ( imported[0][n_s].size(), crec[0][n_s].size() );
+        for (std::size_t k = 0; k < crec[0][n_s].size(); ++k) {
+            ASSERT_EQ( imported[0][n_s][k], double(float(crec[0][n_s][k])) );
+        }
+    }
+    EXPECT_TRUE( crec[0].GetContiguous() != NULL );
+}
+
+TEST(hdf5_test, chunked_empty_channels)
+{
+    // channels without sections, or with empty sections only:
+    const char* fName = "hdf5_test_empty.h5";
+    stftest::NullProgressInfo progDlg;
+    std::deque<Channel> ch_list;
+    ch_list.push_back(Channel(std::deque<Section>()));
+    ch_list.push_back(Channel(3, 0));
+    ch_list.push_back(Channel(2, 100));
+    Recording rec(ch_list);
+    rec.SetXScale(0.05);
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        std::ostringstream name;
+        name << "ch" << n_c;
+        rec[n_c].SetChannelName(name.str());
+    }
+    const stfio::hdf5_filter filters[3] = { stfio::hdf5_no_filter, stfio::hdf5_shuffle_deflate, stfio::hdf5_ephys };
+    for (int n_f = 0; n_f < 3; ++n_f) {
+        EXPECT_TRUE( stfio::exportHDF5File(fName, rec, progDlg, stfio::hdf5_chunked, filters[n_f]) );
+        Recording imported;
+        stfio::importHDF5File(fName, imported, progDlg);
+        ASSERT_EQ( imported.size(), 3u );
+        EXPECT_EQ( imported[0].size(), 0u );
+        ASSERT_EQ( imported[1].size(), 3u );
+        EXPECT_EQ( imported[1][2].size(), 0u );
+        ASSERT_EQ( imported[2].size(), 2u );
+        EXPECT_EQ( imported[2][1].size(), 100u );
+    }
+    std::remove(fName);
+}
+
+TEST(hdf5_test, chunked_descriptions)
+{
+    const char* fName = "hdf5_test.h5";
+    stftest::NullProgressInfo progDlg;
+    Recording rec = ragged_recording();
+    rec[0][1].SetSectionDescription("sweep 2, after wash-in");
+    rec[1][3].SetSectionDescription("");
+    rec[1][4].SetSectionDescription("last");
+    stfio::exportHDF5File(fName, rec, progDlg, stfio::hdf5_chunked);
+
+    Recording imported;
+    stfio::importHDF5File(fName, imported, progDlg);
+    ASSERT_EQ( imported[1].size(), rec[1].size() );
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            EXPECT_EQ( imported[n_c][n_s].GetSectionDescription(), rec[n_c][n_s].GetSectionDescription() );
+        }
+    }
+    Recording part;
+    stfio::importHDF5Range(fName, part, progDlg, 3, 5);
+    ASSERT_EQ( part[1].size(), 2u );
+    EXPECT_EQ( part[1][0].GetSectionDescription(), "" );
+    EXPECT_EQ( part[1][1].GetSectionDescription(), "last" );
+    std::remove(fName);
+}
+
+TEST(hdf5_test, import_files)
+{
+    stftest::NullProgressInfo progDlg;
+    std::vector<std::string> fNames;
+    std::vector<stfio::filetype> types;
+    for (int n_f = 0; n_f < 6; ++n_f) {
+        std::ostringstream fName;
+        fName << "hdf5_test_" << n_f << ".h5";
+        Recording rec = ragged_recording();
+        rec[0][0][0] = n_f;
+        stfio::exportHDF5File(fName.str(), rec, progDlg, n_f%2 ? stfio::hdf5_chunked : stfio::hdf5_sections);
+        fNames.push_back(fName.str());
+        types.push_back(stfio::hdf5);
+    }
+
+    stfio::txtImportSettings tis;
+    std::vector<Recording> recs = stfio::importFiles(fNames, types, tis, 3);
+    ASSERT_EQ( recs.size(), fNames.size() );
+    for (std::size_t n_f = 0; n_f < recs.size(); ++n_f) {
+        ASSERT_EQ( recs[n_f].size(), 2 );
+        EXPECT_EQ( recs[n_f][0][0][0], n_f );
+        EXPECT_EQ( recs[n_f][1][4].size(), 1000+3000*(4%3) );
+    }
+
+    fNames.push_back("hdf5_test_missing.h5");
+    types.push_back(stfio::hdf5);
+    EXPECT_THROW( stfio::importFiles(fNames, types, tis), std::runtime_error );
+    types.pop_back();
+    EXPECT_THROW( stfio::importFiles(fNames, types, tis), std::out_of_range );
+
+    for (std::size_t n_f = 0; n_f < fNames.size(); ++n_f) {
+        std::remove(fNames[n_f].c_str());
+    }
+}
+
+TEST(hdf5_test, fit_cache_roundtrip) {
+    const char* fName = "hdf5_test_fitcache.h5";
+    Recording rec = ragged_recording();
+    stftest::NullProgressInfo progDlg;
+    stfio::exportHDF5File(fName, rec, progDlg);
+
+    std::vector<std::vector<stfio::FitCache> > caches(2, std::vector<stfio::FitCache>(5));
+    stfio::FitCacheEntry entry;
+    entry.key = 0xfedcba9876543210ULL;
+    entry.funcName = "Monoexponential";
+    entry.fitBeg = 10;
+    entry.fitEnd = 900;
+    entry.params.push_back(1.5);
+    entry.params.push_back(-2.0);
+    entry.params.push_back(3.25);
+    entry.chisqr = 0.125;
+    entry.warning = 3;
+    caches[1][4].Insert(entry);
+    entry.key = 42;
+    entry.params.pop_back();
+    caches[1][4].Insert(entry);
+    caches[0][2].Insert(entry);
+    stfio::exportHDF5FitCaches(fName, caches);
+
+    std::vector<std::vector<stfio::FitCache> > imported = stfio::importHDF5FitCaches(fName);
+    ASSERT_EQ( imported.size(), 2 );
+    ASSERT_EQ( imported[1].size(), 5 );
+    EXPECT_EQ( imported[0][0].size(), 0 );
+    EXPECT_EQ( imported[0][2].size(), 1 );
+    ASSERT_EQ( imported[1][4].size(), 2 );
+    const stfio::FitCacheEntry* found = imported[1][4].Find(0xfedcba9876543210ULL);
+    ASSERT_TRUE( found != NULL );
+    EXPECT_EQ( found->funcName, "Monoexponential" );
+    EXPECT_EQ( found->fitBeg, 10 );
+    EXPECT_EQ( found->fitEnd, 900 );
+    ASSERT_EQ( found->params.size(), 3 );
+    EXPECT_EQ( found->params[2], 3.25 );
+    EXPECT_EQ( found->chisqr, 0.125 );
+    EXPECT_EQ( found->warning, 3 );
+    EXPECT_EQ( imported[1][4].Find(42)->params.size(), 2 );
+
+    /* storing again replaces the previous caches */
+    stfio::exportHDF5FitCaches(fName, std::vector<std::vector<stfio::FitCache> >());
+    imported = stfio::importHDF5FitCaches(fName);
+    EXPECT_EQ( imported[1][4].size(), 0 );
+
+    std::remove(fName);
+}
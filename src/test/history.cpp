@@ -0,0 +1,85 @@
+#include "../libstfio/history.h"
+#include "../libstfio/recording.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+
+Recording testRecording() {
+    Recording data(2, 4, 100);
+    for (std::size_t n_c = 0; n_c < data.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < data[n_c].size(); ++n_s) {
+            for (std::size_t n = 0; n < data[n_c][n_s].size(); ++n) {
+                data[n_c][n_s][n] = n_c*1000.0 + n_s*100.0 + n;
+            }
+        }
+    }
+    return data;
+}
+
+}
+
+TEST(History_test, undo_redo) {
+    Recording data(testRecording());
+    const Recording original(data);
+    stfio::EditHistory history;
+    EXPECT_FALSE( history.CanUndo() );
+    EXPECT_THROW( history.Undo(data), std::out_of_range );
+
+    std::vector<std::size_t> sections;
+    sections.push_back(1);
+    sections.push_back(3);
+    history.Record(data, 1, sections, "multiply");
+    for (std::size_t n_s = 0; n_s < sections.size(); ++n_s) {
+        Section& sec = data[1][sections[n_s]];
+        for (std::size_t n = 0; n < sec.size(); ++n) {
+            sec[n] *= 2.0;
+        }
+    }
+    // the unmodified sections still share their samples:
+    EXPECT_TRUE( data[1][0].SharesData(original[1][0]) );
+    EXPECT_FALSE( data[1][1].SharesData(original[1][1]) );
+    EXPECT_EQ( history.GetUndoLabel(), "multiply" );
+
+    history.Undo(data);
+    EXPECT_EQ( data[1][3][10], original[1][3][10] );
+    EXPECT_TRUE( history.CanRedo() );
+    EXPECT_EQ( history.GetRedoLabel(), "multiply" );
+    history.Redo(data);
+    EXPECT_EQ( data[1][3][10], 2.0*original[1][3][10] );
+    EXPECT_EQ( data[1][2][10], original[1][2][10] );
+
+    // a new step discards the redo steps:
+    history.Undo(data);
+    history.Record(data, 0, std::vector<std::size_t>(1, 2), "subtract base");
+    EXPECT_FALSE( history.CanRedo() );
+    data[0][2] = Section(Vector_double(100, 1.0));
+    history.Undo(data);
+    EXPECT_EQ( data[0][2][99], original[0][2][99] );
+    history.Redo(data);
+    EXPECT_EQ( data[0][2][99], 1.0 );
+
+    // steps whose sections are gone can't be undone:
+    history.Clear();
+    history.Record(data, 1, sections, "filter");
+    data[1].resize(2);
+    EXPECT_THROW( history.Undo(data), std::out_of_range );
+    EXPECT_THROW( history.Record(data, 2, sections, ""), std::out_of_range );
+}
+
+TEST(History_test, max_steps) {
+    Recording data(testRecording());
+    stfio::EditHistory history(3);
+    std::vector<std::size_t> sections(1, 0);
+    for (int n = 0; n < 5; ++n) {
+        history.Record(data, 0, sections, "add");
+        data[0][0][0] += 1.0;
+    }
+    int n_undone = 0;
+    while (history.CanUndo()) {
+        history.Undo(data);
+        ++n_undone;
+    }
+    EXPECT_EQ( n_undone, 3 );
+    EXPECT_EQ( data[0][0][0], 2.0 );
+}
@@ -0,0 +1,102 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/igor/igorlib.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+extern "C" {
+#include "../libstfio/igor/CrossPlatformFileIO.h"
+#include "../libstfio/igor/IgorBin.h"
+}
+
+namespace {
+
+std::string readFile(const std::string& fName) {
+    std::ifstream file(fName.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+Recording makeRecording() {
+    Recording rec(2, 3, 5);
+    rec[0].SetChannelName("Vm");
+    rec[1].SetChannelName("Im");
+    rec.SetXScale(0.1);
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            for (std::size_t n = 0; n < rec[n_c][n_s].size(); ++n) {
+                rec[n_c][n_s][n] = 100.0*n_c + 10.0*n_s + n;
+            }
+        }
+    }
+    return rec;
+}
+
+// Checks a binary wave that starts at wave[0] against channel n_c of rec:
+void checkWave(const char* wave, const Recording& rec, std::size_t n_c) {
+    BinHeader5 bh;
+    memcpy(&bh, wave, sizeof(bh));
+    EXPECT_EQ( bh.version, 5 );
+    WaveHeader5 wh;
+    memcpy(&wh, wave + sizeof(bh), offsetof(WaveHeader5, wData));
+    EXPECT_EQ( std::string(wh.bname), rec[n_c].GetChannelName() );
+    ASSERT_EQ( wh.npnts, 15 );
+    EXPECT_EQ( wh.nDim[0], 5 );
+    EXPECT_EQ( wh.nDim[1], 3 );
+    EXPECT_DOUBLE_EQ( wh.sfA[0], 0.1 );
+    const char* data = wave + sizeof(bh) + offsetof(WaveHeader5, wData);
+    for (std::size_t n_s = 0; n_s < 3; ++n_s) {
+        for (std::size_t n = 0; n < 5; ++n) {
+            double value;
+            memcpy(&value, data + (n_s*5+n)*sizeof(double), sizeof(double));
+            EXPECT_EQ( value, rec[n_c][n_s][n] );
+        }
+    }
+}
+
+}
+
+TEST(igor_test, binary_waves) {
+    Recording rec(makeRecording());
+    stftest::NullProgressInfo progDlg;
+    EXPECT_TRUE( stfio::exportIGORFile("igor_test", RecordingView(rec), progDlg) );
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        std::string fName = "igor_test_" + rec[n_c].GetChannelName() + ".ibw";
+        std::string contents = readFile(fName);
+        ASSERT_EQ( contents.size(), sizeof(BinHeader5) + offsetof(WaveHeader5, wData) +
+                   15*sizeof(double) + strlen("Wave exported from Stimfit") );
+        checkWave(contents.data(), rec, n_c);
+        std::remove(fName.c_str());
+    }
+
+    // sections of different sizes can't be exported:
+    rec[1][2].resize(4);
+    EXPECT_THROW( stfio::exportIGORFile("igor_test", RecordingView(rec), progDlg), std::runtime_error );
+}
+
+TEST(igor_test, packed_experiment) {
+    Recording rec(makeRecording());
+    stftest::NullProgressInfo progDlg;
+    const char* fName = "igor_test.pxp";
+    EXPECT_TRUE( stfio::exportFile(fName, stfio::igor, RecordingView(rec), progDlg) );
+    std::string contents = readFile(fName);
+    std::size_t pos = 0;
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        // record header: type, version and size of the record
+        ASSERT_LE( pos + 8, contents.size() );
+        unsigned short recordType;
+        IGORLONG numDataBytes;
+        memcpy(&recordType, contents.data() + pos, sizeof(recordType));
+        memcpy(&numDataBytes, contents.data() + pos + 4, sizeof(numDataBytes));
+        EXPECT_EQ( recordType, 3 );
+        ASSERT_LE( pos + 8 + numDataBytes, contents.size() );
+        checkWave(contents.data() + pos + 8, rec, n_c);
+        pos += 8 + numDataBytes;
+    }
+    EXPECT_EQ( pos, contents.size() );
+    std::remove(fName);
+}
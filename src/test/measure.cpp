@@ -1,7 +1,11 @@
 #include "../stimfit/stf.h"
 #include "../libstfnum/measure.h"
+#include "../libstfnum/fit.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/mappedfile.h"
 #include <gtest/gtest.h>
 #include <cmath>
+#include <algorithm>
 #include <fstream>
 #if (__cplusplus < 201103)
     #include <boost/random.hpp>
@@ -392,6 +396,54 @@ TEST(measlib_test, threshold_out_of_range){
     
 }
 
+//=========================================================================
+// test all threshold crossings of a spike train
+//=========================================================================
+TEST(measlib_test, slope_crossings){
+
+    /* spikes of varying shape every 97 points */
+    std::vector<double> train(1000, -60.0);
+    for (std::size_t n = 10; n + 20 < train.size(); n += 97) {
+        for (std::size_t k = 0; k < 20; ++k) {
+            train[n+k] += (40.0+n%7) * sin(PI*k/20.0);
+        }
+    }
+    for (std::size_t windowLength = 1; windowLength <= 3; ++windowLength) {
+        for (std::size_t llp = 0; llp < 5; ++llp) {
+            std::size_t ulp = train.size()-windowLength-llp;
+            double slope = 3.0;
+            std::vector<stfnum::SlopeCrossing> crossings =
+                stfnum::slopeCrossings(train, llp, ulp, slope, windowLength);
+            ASSERT_EQ(crossings.size(), 10);
+
+            /* the first crossing is the one threshold() returns */
+            double thrT;
+            double threshold = stfnum::threshold(train, llp, ulp, slope, thrT, windowLength);
+            EXPECT_EQ(crossings[0].value, threshold);
+            EXPECT_EQ(crossings[0].t, thrT);
+
+            /* scalar reference */
+            std::size_t n_c = 0;
+            bool above = false;
+            for (std::size_t i = llp; i < ulp; ++i) {
+                bool crossed = train[i+windowLength] - train[i] > slope*windowLength;
+                if (crossed && !above) {
+                    ASSERT_LT(n_c, crossings.size());
+                    EXPECT_EQ(crossings[n_c].t, i + windowLength/2.0);
+                    EXPECT_EQ(crossings[n_c].value, (train[i+windowLength] + train[i]) / 2.0);
+                    ++n_c;
+                }
+                above = crossed;
+            }
+            EXPECT_EQ(n_c, crossings.size());
+        }
+    }
+
+    /* out of range */
+    EXPECT_TRUE(stfnum::slopeCrossings(train, 0, train.size(), 3.0, 1).empty());
+    EXPECT_TRUE(stfnum::slopeCrossings(train, 10, 5, 3.0, 1).empty());
+}
+
 //=========================================================================
 // test risetime values 
 //=========================================================================
@@ -632,6 +684,663 @@ TEST(measlib_test, maxdecay_values){
 }
 
 
+//=========================================================================
+// scalar reference implementations of the vectorized kernels
+//=========================================================================
+namespace {
+
+double ref_peak(const Vector_double& data, double base, std::size_t llp, std::size_t ulp,
+                stfnum::direction dir, double& maxT) {
+    double max = data[llp];
+    maxT = (double)llp;
+    for (std::size_t i = llp+1; i <= ulp; i++) {
+        double peak = data[i];
+        if (dir == stfnum::both && fabs(peak-base) > fabs(max-base)) { max = peak; maxT = (double)i; }
+        if (dir == stfnum::up && peak-base > max-base) { max = peak; maxT = (double)i; }
+        if (dir == stfnum::down && peak-base < max-base) { max = peak; maxT = (double)i; }
+    }
+    return max;
+}
+
+double ref_slope(const Vector_double& data, std::size_t leftc, std::size_t rightc, bool rise,
+                 double& T, double& Y, std::size_t windowLength) {
+    double maxSlope = -INFINITY;
+    T = NAN;
+    Y = NAN;
+    for (std::size_t j = leftc, i = leftc + windowLength; rise ? i <= rightc : i < rightc; i++, j++) {
+        double diff = fabs(data[i] - data[j]);
+        if (maxSlope < diff) {
+            maxSlope = diff;
+            Y = (data[i]+data[j])/2.0;
+            T = j+windowLength/2.0;
+        }
+    }
+    return maxSlope/windowLength;
+}
+
+void ref_half(const Vector_double& data, double base, double ampl, double left, double right,
+              double center, std::size_t& t50LeftId, std::size_t& t50RightId) {
+    t50LeftId = (int)center>=1 ? (int)center : 1;
+    do {
+        --t50LeftId;
+    } while (fabs(data[t50LeftId]-base) > fabs(0.5 * ampl) && t50LeftId > left);
+    t50RightId = center;
+    do {
+        ++t50RightId;
+    } while (fabs(data[t50RightId]-base) > fabs(0.5 * ampl) && t50RightId < right);
+}
+
+
+double ref_peak_mean(const Vector_double& data, double base, std::size_t llp, std::size_t ulp,
+                     int pM, stfnum::direction dir, double& maxT) {
+    double max = data[llp];
+    maxT = (double)llp;
+    for (std::size_t i = llp+1; i <= ulp; i++) {
+        int start = std::max((int)i - (pM-1)/2, 0), counter = 0;
+        double peak = 0.0;
+        for (counter = start; counter <= start+pM-1 && counter < (int)data.size(); counter++)
+            peak += data[counter];
+        peak /= (counter-start);
+        if (dir == stfnum::both && fabs(peak-base) > fabs(max-base)) { max = peak; maxT = (double)i; }
+        if (dir == stfnum::up && peak-base > max-base) { max = peak; maxT = (double)i; }
+        if (dir == stfnum::down && peak-base < max-base) { max = peak; maxT = (double)i; }
+    }
+    return max;
+}
+
+// inner and outer rise times with separate forward and backward passes:
+void ref_risetime2(const Vector_double& data, double base, double ampl, long left, long right,
+                   double frac, double& innerLo, double& innerHi, double& outerLo, double& outerHi) {
+    double lo = frac, hi = 1.0-frac;
+    long outer_tLoId=-1, outer_tHiId=-1, inner_tLoId=-1, inner_tHiId=-1;
+    for (long k = left; k <= right; k++) {
+        double v = fabs(data[k]-base);
+        if (v < fabs(lo*ampl)) inner_tLoId = k;
+        if (v < fabs(hi*ampl)) outer_tHiId = k;
+    }
+    for (long k = right; k >= left; k--) {
+        double v = fabs(data[k]-base);
+        if (v > fabs(lo*ampl)) outer_tLoId = k;
+        if (v > fabs(hi*ampl)) inner_tHiId = k;
+    }
+    double y2 = data[inner_tLoId+1], y1 = data[inner_tLoId];
+    innerLo = y2-y1 != 0 ? inner_tLoId + fabs((lo*ampl+base-y1)/(y2-y1)) : inner_tLoId;
+    y2 = data[inner_tHiId]; y1 = data[inner_tHiId-1];
+    innerHi = y2-y1 != 0 ? inner_tHiId - fabs(((y2-base)-hi*ampl)/(y2-y1)) : inner_tHiId;
+    y2 = data[outer_tLoId]; y1 = data[outer_tLoId-1];
+    outerLo = y2-y1 != 0 ? outer_tLoId - fabs(((y2-base)-lo*ampl)/(y2-y1)) : outer_tLoId;
+    y2 = data[outer_tHiId+1]; y1 = data[outer_tHiId];
+    outerHi = y2-y1 != 0 ? outer_tHiId + fabs((hi*ampl+base-y1)/(y2-y1)) : outer_tHiId;
+}
+}
+
+//=========================================================================
+// vectorized kernels have to give the same results as the scalar code
+//=========================================================================
+TEST(measlib_test, simd_kernels) {
+    const stfnum::direction dirs[] = {stfnum::up, stfnum::down, stfnum::both};
+    for (int n_trial = 0; n_trial < 400; ++n_trial) {
+        // coarsely quantized values give many ties:
+        std::size_t size = 20 + (n_trial*37)%500;
+        Vector_double data(size);
+        for (std::size_t n = 0; n < size; ++n) {
+            data[n] = (double)((n*7919 + n_trial*104729)%23) - 11.0 + 3.0*sin(0.05*n*(1+n_trial%5));
+            if (n_trial%4 == 0) data[n] = floor(data[n]);
+            if (n_trial%7 == 3 && n%13 == 5) data[n] = NAN;
+        }
+        std::size_t llp = (n_trial*11)%(size/2), ulp = llp + (n_trial*17)%(size-llp);
+        double base = (n_trial%3) - 1.0;
+        for (int d = 0; d < 3; ++d) {
+            double maxT, refT;
+            double peak = stfnum::peak(data, base, llp, ulp, 1, dirs[d], maxT);
+            double ref = ref_peak(data, base, llp, ulp, dirs[d], refT);
+            EXPECT_EQ(maxT, refT) << "trial " << n_trial << ", direction " << d;
+            if (ref == ref) {
+                EXPECT_EQ(peak, ref);
+            } else {
+                EXPECT_TRUE(peak != peak);
+            }
+            Section sec(data);
+            double secPeak = stfnum::peak(sec, base, llp, ulp, 1, dirs[d], maxT);
+            EXPECT_TRUE(secPeak == peak || (secPeak != secPeak && peak != peak));
+        }
+
+        std::size_t w = 1 + n_trial%4;
+        for (int rise = 0; rise < 2; ++rise) {
+            double T, Y, refT, refY;
+            double slope = rise ? stfnum::maxRise(data, llp, ulp, T, Y, w) :
+                                  stfnum::maxDecay(data, llp, ulp, T, Y, w);
+            double ref = ref_slope(data, llp, ulp, rise==1, refT, refY, w);
+            EXPECT_EQ(slope, ref) << "trial " << n_trial;
+            if (refT == refT) {
+                EXPECT_EQ(T, refT) << "trial " << n_trial;
+                EXPECT_EQ(Y, refY) << "trial " << n_trial;
+            } else {
+                EXPECT_TRUE(T != T);
+            }
+        }
+
+        // half amplitudes on both sides of a point within the data:
+        std::size_t center = 1 + (n_trial*29)%(size-3);
+        double left = (double)((n_trial*3)%(center+1)) + 0.5*(n_trial%2);
+        double right = center + 1 + (n_trial*5)%(size-center-2) + 0.5*(n_trial%2);
+        double ampl = 2.0*(n_trial%9) - 8.0;
+        std::size_t t50LeftId, t50RightId, refLeft, refRight;
+        double t50LeftReal;
+        stfnum::t_half(data, base, ampl, left, right, center, t50LeftId, t50RightId, t50LeftReal);
+        ref_half(data, base, ampl, left, right, center, refLeft, refRight);
+        EXPECT_EQ(t50LeftId, refLeft) << "trial " << n_trial;
+        EXPECT_EQ(t50RightId, refRight) << "trial " << n_trial;
+    }
+}
+
+//=========================================================================
+// averaged peaks are computed with a running sum
+//=========================================================================
+TEST(measlib_test, peak_mean_window) {
+    const stfnum::direction dirs[] = {stfnum::up, stfnum::down, stfnum::both};
+    const int pMs[] = {2, 3, 8, 21, 50};
+    std::vector<short> adc(12000);
+    Vector_double data(adc.size());
+    for (std::size_t n = 0; n < adc.size(); ++n) {
+        double t = n - 3000.0;
+        double event = t > 0 ? -2000*(exp(-t/900.0)-exp(-t/60.0)) : 0;
+        adc[n] = (short)(event + 400*sin(0.002*n) + (n*7919)%301 - 150);
+        data[n] = 0.01*adc[n];
+    }
+    Section sec(stfio::compactSamples(adc, 0.01));
+    for (int n_p = 0; n_p < 5; ++n_p) {
+        for (int d = 0; d < 3; ++d) {
+            // windows at both ends of the data and in between:
+            std::size_t windows[][2] = {{0, 11999}, {0, 40}, {2950, 5000}, {11900, 11999}};
+            for (int w = 0; w < 4; ++w) {
+                double maxT, refT, secT;
+                double ref = ref_peak_mean(data, 0.5, windows[w][0], windows[w][1], pMs[n_p], dirs[d], refT);
+                double peak = stfnum::peak(data, 0.5, windows[w][0], windows[w][1], pMs[n_p], dirs[d], maxT);
+                double secPeak = stfnum::peak(sec, 0.5, windows[w][0], windows[w][1], pMs[n_p], dirs[d], secT);
+                EXPECT_EQ(maxT, refT) << "pM " << pMs[n_p] << ", direction " << d << ", window " << w;
+                EXPECT_DOUBLE_EQ(peak, ref);
+                EXPECT_EQ(secT, maxT);
+                EXPECT_EQ(secPeak, peak);
+            }
+        }
+    }
+    EXPECT_TRUE(sec.IsMapped());
+}
+
+//=========================================================================
+// measurement plans can be restricted to some of the measurements
+//=========================================================================
+TEST(measlib_test, measurement_flags) {
+    Vector_double data(4000);
+    for (std::size_t n = 0; n < data.size(); ++n) {
+        double t = n - 1000.0;
+        data[n] = (t > 0 ? 30*(exp(-t/400.0)-exp(-t/40.0)) : 0) + 0.01*((n*7919)%41) - 0.2;
+    }
+    Section sec(data);
+
+    stfnum::MeasurementPlan plan;
+    plan.baseBeg = 0;
+    plan.baseEnd = 900;
+    plan.peakBeg = 950;
+    plan.peakEnd = 2500;
+    plan.pM = 3;
+    plan.dir = stfnum::up;
+    plan.fromBase = false;
+    plan.latencyEndMode = stfnum::half_latency;
+    plan.latencyBeg = 1000;
+    stfnum::MeasurementResults all = plan.Evaluate(sec, dt);
+
+    // the single pass of risetime2() finds the same crossings:
+    double innerLo, innerHi, outerLo, outerHi;
+    double ampl = all.peak - (all.thrT >= 0 ? all.threshold : all.base);
+    ref_risetime2(data, all.thrT >= 0 ? all.threshold : all.base, ampl, 0, (long)all.maxT, 0.2,
+                  innerLo, innerHi, outerLo, outerHi);
+    EXPECT_EQ(all.innerLoRT, innerLo*dt);
+    EXPECT_EQ(all.innerHiRT, innerHi*dt);
+    EXPECT_EQ(all.outerLoRT, outerLo*dt);
+    EXPECT_EQ(all.outerHiRT, outerHi*dt);
+
+    plan.measurements = stfnum::measure_peak;
+    stfnum::MeasurementResults peak = plan.Evaluate(sec, dt);
+    EXPECT_EQ(peak.base, all.base);
+    EXPECT_EQ(peak.peak, all.peak);
+    EXPECT_EQ(peak.maxT, all.maxT);
+    EXPECT_EQ(peak.thrT, -1);
+    EXPECT_EQ(peak.rtLoHi, 0);
+    EXPECT_EQ(peak.halfDuration, 0);
+    EXPECT_EQ(peak.maxRise, 0);
+    EXPECT_TRUE(peak.innerLoRT != peak.innerLoRT);
+    EXPECT_EQ(peak.latency, 0);
+
+    // measurements that others depend on are done as well:
+    plan.measurements = stfnum::measure_slopes | stfnum::measure_latency;
+    stfnum::MeasurementResults slopes = plan.Evaluate(sec, dt);
+    EXPECT_EQ(slopes.threshold, all.threshold);
+    EXPECT_EQ(slopes.maxRise, all.maxRise);
+    EXPECT_EQ(slopes.maxDecay, all.maxDecay);
+    EXPECT_EQ(slopes.slopeRatio, all.slopeRatio);
+    EXPECT_EQ(slopes.latency, all.latency);
+    EXPECT_EQ(slopes.rtLoHi, 0);
+}
+
+//=========================================================================
+// test base and peak on compactly stored sections
+//=========================================================================
+TEST(measlib_test, compact_section) {
+
+    std::vector<short> adc(10000);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        adc[n] = (short)(1000*sin(n/300.0) + (n*7919)%101);
+    }
+    Section sec(stfio::compactSamples(adc, 0.01, -3.0));
+    Vector_double data(adc.size());
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        data[n] = 0.01*adc[n] - 3.0;
+    }
+
+    double var_sec, var_data;
+    EXPECT_DOUBLE_EQ(stfnum::base(stfnum::mean_sd, var_sec, sec, 100, 2000),
+                     stfnum::base(stfnum::mean_sd, var_data, data, 100, 2000));
+    EXPECT_DOUBLE_EQ(var_sec, var_data);
+    EXPECT_DOUBLE_EQ(stfnum::base(stfnum::median_iqr, var_sec, sec, 100, 2001),
+                     stfnum::base(stfnum::median_iqr, var_data, data, 100, 2001));
+    EXPECT_DOUBLE_EQ(var_sec, var_data);
+
+    double maxT_sec, maxT_data;
+    EXPECT_DOUBLE_EQ(stfnum::peak(sec, 0.0, 0, 5000, 5, stfnum::both, maxT_sec),
+                     stfnum::peak(data, 0.0, 0, 5000, 5, stfnum::both, maxT_data));
+    EXPECT_EQ(maxT_sec, maxT_data);
+
+    // Measuring mustn't decode the section:
+    EXPECT_TRUE(sec.IsMapped());
+}
+
+//=========================================================================
+// the kernels give the same results on stored samples as on decoded ones
+//=========================================================================
+template <typename T, typename Scale>
+void expect_native_kernels(const stfnum::SampleView<T, Scale>& view, const Vector_double& data) {
+    double var_view, var_data;
+    EXPECT_EQ(stfnum::base(stfnum::mean_sd, var_view, view, 100, 2000),
+              stfnum::base(stfnum::mean_sd, var_data, data, 100, 2000));
+    EXPECT_EQ(var_view, var_data);
+    EXPECT_EQ(stfnum::base(stfnum::median_iqr, var_view, view, 100, 2001),
+              stfnum::base(stfnum::median_iqr, var_data, data, 100, 2001));
+    EXPECT_EQ(var_view, var_data);
+
+    double maxT_view, maxT_data;
+    for (int pM = 1; pM <= 5; pM += 4) {
+        double peak = stfnum::peak(data, -3.0, 2100, 5000, pM, stfnum::down, maxT_data);
+        EXPECT_EQ(stfnum::peak(view, -3.0, 2100, 5000, pM, stfnum::down, maxT_view), peak);
+        EXPECT_EQ(maxT_view, maxT_data);
+    }
+    double peak = stfnum::peak(data, -3.0, 2100, 5000, 1, stfnum::down, maxT_data);
+    double ampl = peak + 3.0;
+
+    double thrT_view, thrT_data;
+    EXPECT_EQ(stfnum::threshold(view, 2000, 5000, 0.01, thrT_view, 2),
+              stfnum::threshold(data, 2000, 5000, 0.01, thrT_data, 2));
+    EXPECT_EQ(thrT_view, thrT_data);
+
+    std::size_t lo_view, hi_view, lo_data, hi_data;
+    double real_view, real_data;
+    EXPECT_EQ(stfnum::risetime(view, -3.0, ampl, 2000, maxT_data, 0.2, lo_view, hi_view, real_view),
+              stfnum::risetime(data, -3.0, ampl, 2000, maxT_data, 0.2, lo_data, hi_data, real_data));
+    EXPECT_EQ(lo_view, lo_data);
+    EXPECT_EQ(hi_view, hi_data);
+
+    double inner[2][2], outer[2][2];
+    EXPECT_EQ(stfnum::risetime2(view, -3.0, ampl, 2000, maxT_data, 0.2,
+                                inner[0][0], inner[0][1], outer[0][0], outer[0][1]),
+              stfnum::risetime2(data, -3.0, ampl, 2000, maxT_data, 0.2,
+                                inner[1][0], inner[1][1], outer[1][0], outer[1][1]));
+    EXPECT_EQ(outer[0][0], outer[1][0]);
+    EXPECT_EQ(outer[0][1], outer[1][1]);
+
+    EXPECT_EQ(stfnum::t_half(view, -3.0, ampl, 2000, 9999, maxT_data, lo_view, hi_view, real_view),
+              stfnum::t_half(data, -3.0, ampl, 2000, 9999, maxT_data, lo_data, hi_data, real_data));
+    EXPECT_EQ(hi_view, hi_data);
+    EXPECT_EQ(real_view, real_data);
+
+    double t_view, y_view, t_data, y_data;
+    EXPECT_EQ(stfnum::maxRise(view, 2000, maxT_data, t_view, y_view, 3),
+              stfnum::maxRise(data, 2000, maxT_data, t_data, y_data, 3));
+    EXPECT_EQ(t_view, t_data);
+    EXPECT_EQ(y_view, y_data);
+    EXPECT_EQ(stfnum::maxDecay(view, maxT_data, 9000, t_view, y_view, 3),
+              stfnum::maxDecay(data, maxT_data, 9000, t_data, y_data, 3));
+    EXPECT_EQ(t_view, t_data);
+    EXPECT_EQ(y_view, y_data);
+}
+
+TEST(measlib_test, native_kernels) {
+    std::vector<short> adc(10000);
+    std::vector<float> flt(adc.size());
+    Vector_double raw(adc.size()), data(adc.size());
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        double t = n - 3000.0;
+        double event = t > 0 ? -2000*(exp(-t/900.0)-exp(-t/60.0)) : 0;
+        adc[n] = (short)(event + 100*sin(n/300.0) + (n*7919)%101);
+        flt[n] = (float)adc[n];
+        raw[n] = adc[n];
+        data[n] = 0.01*adc[n] - 3.0;
+    }
+    stfnum::LinearScale scale(0.01, -3.0);
+    expect_native_kernels(stfnum::SampleView<short, stfnum::LinearScale>(&adc[0], adc.size(), scale), data);
+    expect_native_kernels(stfnum::SampleView<float, stfnum::LinearScale>(&flt[0], flt.size(), scale), data);
+    expect_native_kernels(stfnum::SampleView<double, stfnum::LinearScale>(&raw[0], raw.size(), scale), data);
+    expect_native_kernels(stfnum::SampleView<double>(&data[0], data.size()), data);
+
+    // compact sections are measured through a view of their samples:
+    Section sec(stfio::compactSamples(adc, 0.01, -3.0));
+    stfio::SampleType type;
+    double sec_scale, sec_shift;
+    EXPECT_TRUE(sec.GetNative(type, sec_scale, sec_shift) != NULL);
+    EXPECT_EQ(type, stfio::sample_int16);
+    EXPECT_EQ(sec_scale, 0.01);
+    EXPECT_EQ(sec_shift, -3.0);
+    double maxT_sec, maxT_data;
+    EXPECT_EQ(stfnum::peak(sec, -3.0, 2100, 5000, 1, stfnum::down, maxT_sec),
+              stfnum::peak(data, -3.0, 2100, 5000, 1, stfnum::down, maxT_data));
+    EXPECT_EQ(maxT_sec, maxT_data);
+    EXPECT_TRUE(sec.IsMapped());
+}
+
+//=========================================================================
+// test the median baseline against a sorted copy
+//=========================================================================
+TEST(measlib_test, baseline_median_selection) {
+    std::vector<double> data = rand(1001);
+    for (std::size_t n=1; n<=40; ++n) {
+        for (std::size_t llb=0; llb<3; ++llb) {
+            std::size_t ulb = llb+n-1;
+            std::vector<double> a(data.begin()+llb, data.begin()+ulb+1);
+            std::sort(a.begin(), a.end());
+            std::size_t m = n;
+            double median;
+            if (m % 2) {
+                median = a[(m-1)/2];
+            } else {
+                m /= 2;
+                median = (a[m-1] + a[m]) / 2;
+            }
+            double Q32 = a[std::min<long>((long)(m-1), (long)ceil(3*m/4.0-1))] + a[std::max<long>(0l, (long)floor(3*m/4.0-1))];
+            double Q12 = a[std::min<long>((long)(m-1), (long)ceil(  m/4.0-1))] + a[std::max<long>(0l, (long)floor(  m/4.0-1))];
+
+            double var;
+            EXPECT_EQ(median, stfnum::base(stfnum::median_iqr, var, data, llb, ulb));
+            EXPECT_EQ((Q32-Q12)/2, var);
+        }
+    }
+}
+
+//=========================================================================
+// test the running median against the median of each window
+//=========================================================================
+TEST(measlib_test, sliding_median) {
+    std::vector<double> data = rand(500);
+    // include some repeated values:
+    for (std::size_t n=0; n<data.size(); n+=7) {
+        data[n] = 0.5;
+    }
+    for (std::size_t width=1; width<=12; ++width) {
+        std::vector<double> median = stfnum::slidingMedian(data, width);
+        ASSERT_EQ(data.size(), median.size());
+        for (long i=0; i<(long)data.size(); ++i) {
+            long begin = std::max<long>(i-(long)width/2, 0);
+            long end = std::min<long>(i-(long)width/2+(long)width, (long)data.size());
+            std::vector<double> a(data.begin()+begin, data.begin()+end);
+            std::sort(a.begin(), a.end());
+            double expected = a.size() % 2 ? a[a.size()/2] : (a[a.size()/2-1]+a[a.size()/2])/2;
+            EXPECT_EQ(expected, median[i]);
+        }
+    }
+    EXPECT_THROW(stfnum::slidingMedian(data, 0), std::out_of_range);
+    EXPECT_TRUE(stfnum::slidingMedian(std::vector<double>(), 5).empty());
+}
+
+//=========================================================================
+// test that a MeasurementPlan gives the same results as the single
+// measurement functions
+//=========================================================================
+TEST(measlib_test, measurement_plan) {
+
+    std::vector<short> adc(4000);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        double t = n - 1000.0;
+        double event = t > 0 ? 3000*(exp(-t/400.0)-exp(-t/40.0)) : 0;
+        adc[n] = (short)(event + (n*7919)%41 - 20);
+    }
+    Section sec(stfio::compactSamples(adc, 0.01, -70.0));
+    Vector_double data(adc.size());
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        data[n] = 0.01*adc[n] - 70.0;
+    }
+
+    stfnum::MeasurementPlan plan;
+    plan.baseBeg = 0;
+    plan.baseEnd = 900;
+    plan.peakBeg = 950;
+    plan.peakEnd = 2500;
+    plan.pM = 3;
+    plan.dir = stfnum::up;
+    plan.slopeForThreshold = 5.0;
+    plan.latencyEndMode = stfnum::peak_latency;
+    plan.latencyBeg = 1000;
+    stfnum::MeasurementResults res = plan.Evaluate(sec, dt);
+
+    // slopes are measured over 0.05 x units:
+    std::size_t windowLength = lround(0.05/dt);
+    double var, maxT, thrT;
+    double base = stfnum::base(stfnum::mean_sd, var, data, 0, 900);
+    EXPECT_DOUBLE_EQ(res.base, base);
+    EXPECT_DOUBLE_EQ(res.baseSD, sqrt(var));
+    EXPECT_DOUBLE_EQ(res.peak, stfnum::peak(data, base, 950, 2500, 3, stfnum::up, maxT));
+    EXPECT_EQ(res.maxT, maxT);
+    EXPECT_DOUBLE_EQ(res.threshold, stfnum::threshold(data, 950, 2500, 5.0*dt, thrT, windowLength));
+    EXPECT_EQ(res.thrT, thrT);
+
+    std::size_t tLoIndex, tHiIndex;
+    double tLoReal;
+    double rt = stfnum::risetime(data, base, res.peak-base, 0, maxT, 0.2, tLoIndex, tHiIndex, tLoReal);
+    EXPECT_DOUBLE_EQ(res.rtLoHi, rt*dt);
+    EXPECT_DOUBLE_EQ(res.tLoReal, tLoReal);
+
+    std::size_t t50LeftIndex, t50RightIndex;
+    double t50LeftReal;
+    double t50 = stfnum::t_half(data, base, res.peak-base, 0, data.size()-1, maxT,
+                                t50LeftIndex, t50RightIndex, t50LeftReal);
+    EXPECT_DOUBLE_EQ(res.halfDuration, t50*dt);
+    EXPECT_DOUBLE_EQ(res.t50LeftReal, t50LeftReal);
+
+    double maxRiseT, maxRiseY;
+    double maxRise = stfnum::maxRise(data, 950, maxT, maxRiseT, maxRiseY, windowLength);
+    EXPECT_DOUBLE_EQ(res.maxRise, maxRise/dt);
+    EXPECT_DOUBLE_EQ(res.latency, maxT-1000);
+
+    // Evaluating the plan mustn't decode the section:
+    EXPECT_TRUE(sec.IsMapped());
+    EXPECT_THROW(plan.Evaluate(Section(), dt), std::out_of_range);
+}
+
+TEST(measlib_test, alignment_points) {
+
+    // events with different onsets and a compactly stored copy of each of them:
+    Channel ch(12);
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        double onset = 800.0 + 37.0*n_s;
+        std::vector<short> adc(4000);
+        for (std::size_t n=0; n<adc.size(); ++n) {
+            double t = n - onset;
+            double event = t > 0 ? 3000*(exp(-t/400.0)-exp(-t/40.0)) : 0;
+            adc[n] = (short)(event + (n*7919+n_s*13)%41 - 20);
+        }
+        if (n_s%2 == 0) {
+            ch[n_s] = Section(stfio::compactSamples(adc, 0.01, -70.0));
+        } else {
+            Vector_double data(adc.size());
+            for (std::size_t n=0; n<adc.size(); ++n) {
+                data[n] = 0.01*adc[n] - 70.0;
+            }
+            ch[n_s] = Section(data);
+        }
+    }
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s=ch.size(); n_s-- > 0; ) {
+        sections.push_back(n_s);
+    }
+
+    stfnum::MeasurementPlan plan;
+    plan.baseBeg = 0;
+    plan.baseEnd = 700;
+    plan.peakBeg = 750;
+    plan.peakEnd = 2500;
+    plan.pM = 3;
+    plan.dir = stfnum::up;
+    plan.slopeForThreshold = 5.0;
+
+    // The alignment points have to be the same as the full measurements:
+    for (int n_plan = 0; n_plan < 2; ++n_plan) {
+        plan.fromBase = (n_plan == 0);
+        plan.latencyEndMode = (n_plan == 0) ? stfnum::manual_latency : stfnum::foot_latency;
+        for (int mode = stfnum::align_peak; mode <= stfnum::align_onset; ++mode) {
+            for (int reference = 0; reference < 2; ++reference) {
+                std::vector<int> points = stfnum::alignmentPoints(ch, sections, dt, plan,
+                                                                  (stfnum::alignment_mode)mode,
+                                                                  reference == 1, false, 3);
+                ASSERT_EQ(points.size(), sections.size());
+                for (std::size_t n=0; n<sections.size(); ++n) {
+                    const Section& sec = ch[sections[n]];
+                    stfnum::MeasurementResults res = reference ?
+                        plan.Evaluate(sec, dt, &sec) : plan.Evaluate(sec, dt);
+                    double expected = 0;
+                    switch (mode) {
+                     case stfnum::align_peak: expected = reference ? res.APMaxT : res.maxT; break;
+                     case stfnum::align_rise: expected = reference ? res.APMaxRiseT : res.maxRiseT; break;
+                     case stfnum::align_half: expected = reference ? res.APt50LeftReal : res.t50LeftReal; break;
+                     default: expected = reference ? res.APt0Real : res.t0Real; break;
+                    }
+                    EXPECT_EQ(points[n], lround(expected)) << "mode " << mode << ", section " << sections[n];
+                }
+            }
+        }
+    }
+
+    // later events are aligned to later points:
+    std::vector<int> rises = stfnum::alignmentPoints(ch, sections, dt, plan, stfnum::align_rise);
+    EXPECT_NEAR(rises[0]-rises[sections.size()-1], 37.0*(ch.size()-1), 10.0);
+
+    sections.push_back(ch.size());
+    EXPECT_THROW(stfnum::alignmentPoints(ch, sections, dt, plan, stfnum::align_rise), std::out_of_range);
+}
+
+//=========================================================================
+// closed-form regression lines of single and many sections
+//=========================================================================
+TEST(measlib_test, linear_regression) {
+
+    // a line with a large offset and some noise:
+    std::vector<short> adc(10001);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        adc[n] = (short)(0.3*n + (n*7919)%101 - 50);
+    }
+    Vector_double data(adc.size()), x(adc.size());
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        data[n] = 0.01*adc[n] - 70.0;
+        x[n] = n*dt;
+    }
+
+    // expected values from the textbook formulas, with centred sums:
+    double n_points = (double)data.size();
+    double meanX = 0, meanY = 0;
+    for (std::size_t n=0; n<data.size(); ++n) {
+        meanX += x[n]/n_points;
+        meanY += data[n]/n_points;
+    }
+    double sxx = 0, sxy = 0, syy = 0;
+    for (std::size_t n=0; n<data.size(); ++n) {
+        sxx += (x[n]-meanX)*(x[n]-meanX);
+        sxy += (x[n]-meanX)*(data[n]-meanY);
+        syy += (data[n]-meanY)*(data[n]-meanY);
+    }
+    double slope = sxy/sxx;
+    double sse = syy - slope*sxy;
+
+    // odd numbers of points exercise the scalar tail of the SIMD kernel:
+    stfnum::LinRegression line = stfnum::linRegress(&data[0], data.size(), dt);
+    EXPECT_EQ(line.n, data.size());
+    EXPECT_NEAR(line.slope, slope, 1e-9*fabs(slope));
+    EXPECT_NEAR(line.intercept, meanY - slope*meanX, 1e-9);
+    EXPECT_NEAR(line.r, sxy/sqrt(sxx*syy), 1e-12);
+    EXPECT_NEAR(line.chisqr, sse, 1e-7*sse);
+    EXPECT_NEAR(line.slopeSE, sqrt(sse/(n_points-2)/sxx), 1e-9);
+    EXPECT_NEAR(line.interceptSE, sqrt(sse/(n_points-2)*(1/n_points + meanX*meanX/sxx)), 1e-9);
+
+    stfnum::LinRegression general = stfnum::linRegress(x, data);
+    EXPECT_NEAR(general.slope, line.slope, 1e-9*fabs(slope));
+    EXPECT_NEAR(general.intercept, line.intercept, 1e-9);
+    EXPECT_NEAR(general.r, line.r, 1e-12);
+
+    // the same line as the least-squares fit:
+    double m, c;
+    double chisqr = stfnum::linFit(x, data, m, c);
+    EXPECT_NEAR(line.slope, m, 1e-6*fabs(m));
+    EXPECT_NEAR(line.chisqr, chisqr, 1e-6*chisqr);
+
+    // an exact line has no residuals:
+    Vector_double exact(7);
+    for (std::size_t n=0; n<exact.size(); ++n) {
+        exact[n] = 2.0 - 0.5*n;
+    }
+    stfnum::LinRegression exactLine = stfnum::linRegress(&exact[0], exact.size(), 0.5, 1.0);
+    EXPECT_DOUBLE_EQ(exactLine.slope, -1.0);
+    EXPECT_DOUBLE_EQ(exactLine.intercept, 3.0);
+    EXPECT_DOUBLE_EQ(exactLine.r, -1.0);
+    EXPECT_NEAR(exactLine.slopeSE, 0.0, 1e-12);
+
+    // compactly stored sections give the same result, in blocks, over a range:
+    Channel ch(4);
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        if (n_s%2 == 0) {
+            ch[n_s] = Section(stfio::compactSamples(adc, 0.01, -70.0));
+        } else {
+            ch[n_s] = Section(data);
+        }
+    }
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        sections.push_back(n_s);
+    }
+    std::vector<stfnum::LinRegression> lines = stfnum::linRegress(ch, sections, 1000, 9001, dt, 2);
+    ASSERT_EQ(lines.size(), sections.size());
+    stfnum::LinRegression range = stfnum::linRegress(&data[1000], 8001, dt);
+    for (std::size_t n_s=0; n_s<lines.size(); ++n_s) {
+        EXPECT_NEAR(lines[n_s].slope, range.slope, 1e-9*fabs(range.slope));
+        EXPECT_NEAR(lines[n_s].intercept, range.intercept, 1e-9);
+        EXPECT_NEAR(lines[n_s].slopeSE, range.slopeSE, 1e-9);
+    }
+    EXPECT_TRUE(ch[0].IsMapped());
+
+    // the measurement plan measures the same line between the slope cursors:
+    stfnum::MeasurementPlan plan;
+    plan.measurements = stfnum::measure_regression_slope;
+    plan.baseBeg = 0;
+    plan.baseEnd = 100;
+    plan.slopeBeg = 1000;
+    plan.slopeEnd = 9000;
+    stfnum::MeasurementResults res = plan.Evaluate(ch[0], dt);
+    EXPECT_NEAR(res.regression.slope, range.slope, 1e-9*fabs(range.slope));
+    EXPECT_EQ(res.regression.n, 8001u);
+    plan.slopeEnd = plan.slopeBeg;
+    EXPECT_EQ(plan.Evaluate(ch[0], dt).regression.n, 0u);
+
+    EXPECT_THROW(stfnum::linRegress(&data[0], 1, dt), std::out_of_range);
+    EXPECT_THROW(stfnum::linRegress(ch[0], 0, data.size()+1, dt), std::out_of_range);
+    sections.push_back(ch.size());
+    EXPECT_THROW(stfnum::linRegress(ch, sections, 0, 100, dt), std::out_of_range);
+}
+
 
 //=========================================================================
 // test baseline N_MAX random traces
@@ -874,3 +1583,344 @@ TEST(measlib_validation, threshold) {
     
 
 }
+
+TEST(measlib_test, evaluate_many) {
+    // sections with events of different amplitudes, each measured with its own plan:
+    std::vector<Section> sections;
+    std::vector<stfnum::MeasurementJob> jobs;
+    for (int n_s = 0; n_s < 12; ++n_s) {
+        Vector_double data(3000);
+        for (std::size_t n=0; n<data.size(); ++n) {
+            double t = n - 1000.0;
+            data[n] = t > 0 ? (n_s+1)*(exp(-t/400.0)-exp(-t/40.0)) : 0;
+        }
+        sections.push_back(Section(data));
+    }
+    for (int n_s = 0; n_s < 12; ++n_s) {
+        stfnum::MeasurementPlan plan;
+        plan.baseBeg = 0;
+        plan.baseEnd = 900;
+        plan.peakBeg = 950;
+        plan.peakEnd = 1500 + 100*n_s;
+        plan.dir = stfnum::up;
+        jobs.push_back(stfnum::MeasurementJob(plan, &sections[n_s], dt));
+    }
+    // a skipped job and a failing one:
+    jobs.push_back(stfnum::MeasurementJob());
+    Section empty;
+    jobs.push_back(stfnum::MeasurementJob(jobs[0].plan, &empty, dt));
+
+    std::vector<std::string> errors;
+    std::vector<stfnum::MeasurementResults> res(stfnum::evaluateMany(jobs, errors, 4));
+    ASSERT_EQ(res.size(), jobs.size());
+    ASSERT_EQ(errors.size(), jobs.size());
+    for (int n_s = 0; n_s < 12; ++n_s) {
+        stfnum::MeasurementResults single = jobs[n_s].plan.Evaluate(sections[n_s], dt);
+        EXPECT_TRUE(errors[n_s].empty());
+        EXPECT_DOUBLE_EQ(res[n_s].peak, single.peak);
+        EXPECT_DOUBLE_EQ(res[n_s].maxT, single.maxT);
+        EXPECT_DOUBLE_EQ(res[n_s].rtLoHi, single.rtLoHi);
+    }
+    EXPECT_TRUE(errors[12].empty());
+    EXPECT_EQ(res[12].peak, 0);
+    EXPECT_FALSE(errors[13].empty());
+}
+
+TEST(measlib_test, measurement_cache) {
+    Vector_double data(3000), refdata(3000);
+    for (std::size_t n=0; n<data.size(); ++n) {
+        double t = n - 1000.0;
+        data[n] = t > 0 ? 2.0*(exp(-t/400.0)-exp(-t/40.0)) : 0;
+        refdata[n] = t > -50 ? 10.0*exp(-(t+50)/20.0)*(1-exp(-(t+50)/2.0)) : 0;
+        data[n] += 0.01*sin(0.3*n);
+    }
+    Section sec(data), ref(refdata);
+    stfnum::MeasurementPlan plan;
+    plan.measurements = stfnum::measure_all;
+    plan.baseBeg = 0;
+    plan.baseEnd = 900;
+    plan.peakBeg = 950;
+    plan.dir = stfnum::up;
+    plan.fromBase = false;
+    plan.slopeBeg = 100;
+    plan.slopeEnd = 800;
+
+    // drag the peak cursor, then the baseline cursor:
+    stfnum::MeasurementCache cache;
+    for (int n_step = 0; n_step < 40; ++n_step) {
+        if (n_step < 20) {
+            plan.peakEnd = 1100 + 50*n_step;
+        } else {
+            plan.baseEnd = 500 + 20*n_step;
+        }
+        stfnum::MeasurementResults cached = plan.Evaluate(sec, dt, &ref, cache);
+        stfnum::MeasurementResults single = plan.Evaluate(sec, dt, &ref);
+        EXPECT_EQ(cached.base, single.base);
+        EXPECT_EQ(cached.baseSD, single.baseSD);
+        EXPECT_EQ(cached.peak, single.peak);
+        EXPECT_EQ(cached.maxT, single.maxT);
+        EXPECT_EQ(cached.threshold, single.threshold);
+        EXPECT_EQ(cached.rtLoHi, single.rtLoHi);
+        EXPECT_EQ(cached.halfDuration, single.halfDuration);
+        EXPECT_EQ(cached.maxDecay, single.maxDecay);
+        EXPECT_EQ(cached.APMaxT, single.APMaxT);
+        EXPECT_EQ(cached.latency, single.latency);
+        EXPECT_EQ(cached.regression.slope, single.regression.slope);
+    }
+
+    // data that are modified in place are only seen after clearing the cache:
+    plan.Evaluate(sec, dt, &ref, cache);
+    for (std::size_t n=0; n<900; ++n) {
+        sec[n] += 1.0;
+    }
+    cache.Clear();
+    stfnum::MeasurementResults cached = plan.Evaluate(sec, dt, &ref, cache);
+    EXPECT_EQ(cached.base, plan.Evaluate(sec, dt, &ref).base);
+
+    // a different section with the same cursors isn't taken from the cache:
+    Section other(refdata);
+    EXPECT_EQ(plan.Evaluate(other, dt, NULL, cache).peak, plan.Evaluate(other, dt).peak);
+
+    // plans are equal if all their settings are:
+    stfnum::MeasurementPlan copy(plan);
+    EXPECT_TRUE(copy == plan);
+    copy.slopeForThreshold += 1.0;
+    EXPECT_TRUE(copy != plan);
+    copy = plan;
+    copy.latencyEndMode = stfnum::foot_latency;
+    EXPECT_FALSE(copy == plan);
+}
+
+TEST(measlib_test, reference_channel) {
+    std::vector<float> refsamples(3000);
+    Vector_double data(3000), refdata(3000);
+    for (std::size_t n=0; n<data.size(); ++n) {
+        double t = n - 1000.0;
+        data[n] = t > 0 ? 2.0*(exp(-t/400.0)-exp(-t/40.0)) : 0;
+        refsamples[n] = (float)(t > -50 ? 10.0*exp(-(t+50)/20.0)*(1-exp(-(t+50)/2.0)) : 0);
+        refdata[n] = refsamples[n];
+    }
+    Section sec(data), ref(refdata), compact(stfio::compactSamples(refsamples));
+    ASSERT_TRUE(compact.IsMapped());
+    stfnum::MeasurementPlan plan;
+    plan.measurements = stfnum::measure_all;
+    plan.baseBeg = 0;
+    plan.baseEnd = 900;
+    plan.peakBeg = 950;
+    plan.peakEnd = 1800;
+    plan.dir = stfnum::up;
+    plan.latencyStartMode = stfnum::rise_latency;
+
+    // the same as measuring the reference on its own:
+    stfnum::MeasurementResults res = plan.Evaluate(sec, dt, &ref);
+    double var = 0.0, maxT = 0.0, maxRiseT = 0.0, maxRiseY = 0.0, t50LeftReal = 0.0, tLoReal = 0.0;
+    std::size_t t50LeftIndex = 0, t50RightIndex = 0, tLoIndex = 0, tHiIndex = 0;
+    double base = stfnum::base(plan.baselineMethod, var, refdata, plan.baseBeg, plan.baseEnd);
+    double peak = stfnum::peak(refdata, base, plan.peakBeg, plan.peakEnd, plan.pM, plan.dir, maxT);
+    stfnum::maxRise(refdata, maxT-100, maxT, maxRiseT, maxRiseY, lround(0.05/dt));
+    stfnum::t_half(refdata, base, peak-base, maxT-100, (double)refdata.size(), maxT,
+                   t50LeftIndex, t50RightIndex, t50LeftReal);
+    double rt = stfnum::risetime(refdata, base, peak-base, 0.0, maxT, 0.2, tLoIndex, tHiIndex, tLoReal);
+    EXPECT_EQ(res.APBase, base);
+    EXPECT_EQ(res.APPeak, peak);
+    EXPECT_EQ(res.APMaxT, maxT);
+    EXPECT_EQ(res.APMaxRiseT, maxRiseT);
+    EXPECT_EQ(res.APt50LeftReal, t50LeftReal);
+    EXPECT_EQ(res.APrtLoHi, rt);
+    EXPECT_EQ(res.latencyBeg, maxRiseT);
+    // and the section is measured as without a reference:
+    stfnum::MeasurementResults alone = plan.Evaluate(sec, dt);
+    EXPECT_EQ(res.peak, alone.peak);
+    EXPECT_EQ(res.t50LeftReal, alone.t50LeftReal);
+    EXPECT_EQ(res.maxRiseT, alone.maxRiseT);
+
+    // compactly stored references are decoded without keeping them in memory:
+    stfnum::MeasurementCache cache;
+    stfnum::MeasurementResults mapped = plan.Evaluate(sec, dt, &compact, cache);
+    EXPECT_TRUE(compact.IsMapped());
+    EXPECT_EQ(mapped.APMaxT, res.APMaxT);
+    EXPECT_EQ(mapped.APt50LeftReal, res.APt50LeftReal);
+    EXPECT_EQ(mapped.latency, res.latency);
+    plan.peakEnd = 1700;
+    mapped = plan.Evaluate(sec, dt, &compact, cache);
+    EXPECT_EQ(mapped.APMaxRiseT, plan.Evaluate(sec, dt, &ref).APMaxRiseT);
+
+    // errors are reported while the reference is measured:
+    plan.slopeBeg = 100;
+    plan.slopeEnd = 5000;
+    EXPECT_THROW(plan.Evaluate(sec, dt, &ref), std::out_of_range);
+}
+
+TEST(measlib_test, multi_window_plan) {
+    // paired pulses with a facilitated second response:
+    Channel ch(6, 4000);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        for (std::size_t n = 0; n < ch[n_s].size(); ++n) {
+            double t1 = n - 1000.0, t2 = n - 2500.0;
+            ch[n_s][n] = (t1 > 0 ? (n_s+1)*(exp(-t1/200.0)-exp(-t1/20.0)) : 0) +
+                         (t2 > 0 ? 1.5*(n_s+1)*(exp(-t2/200.0)-exp(-t2/20.0)) : 0) +
+                         0.01*sin(0.3*n);
+        }
+    }
+    stfnum::MeasurementPlan first;
+    first.baseBeg = 0;
+    first.baseEnd = 900;
+    first.peakBeg = 950;
+    first.peakEnd = 2400;
+    first.dir = stfnum::up;
+    stfnum::MeasurementPlan second(first);
+    second.peakBeg = 2450;
+    second.peakEnd = 3900;
+    stfnum::MultiWindowPlan plan;
+    plan.Add("pulse 1", first);
+    plan.Add("pulse 2", second);
+    EXPECT_THROW(plan.Add("pulse 2", first), std::runtime_error);
+    EXPECT_EQ(plan.Find("pulse 2"), 1);
+    EXPECT_EQ(plan.Find("pulse 3"), -1);
+
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        sections.push_back(n_s);
+    }
+    std::vector<std::vector<stfnum::MeasurementResults> > res(stfnum::evaluateWindows(ch, sections, dt, plan, NULL, 3));
+    ASSERT_EQ(res.size(), ch.size());
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        ASSERT_EQ(res[n_s].size(), 2);
+        // every window gives the same results as its own plan:
+        for (std::size_t n_w = 0; n_w < 2; ++n_w) {
+            stfnum::MeasurementResults single = plan.windows[n_w].plan.Evaluate(ch[n_s], dt);
+            EXPECT_EQ(res[n_s][n_w].base, single.base);
+            EXPECT_EQ(res[n_s][n_w].peak, single.peak);
+            EXPECT_EQ(res[n_s][n_w].maxT, single.maxT);
+            EXPECT_EQ(res[n_s][n_w].rtLoHi, single.rtLoHi);
+            EXPECT_EQ(res[n_s][n_w].halfDuration, single.halfDuration);
+        }
+        EXPECT_GT(res[n_s][0].maxT, 950);
+        EXPECT_GT(res[n_s][1].maxT, 2450);
+        EXPECT_GT(res[n_s][1].peak, res[n_s][0].peak);
+    }
+
+    // compactly stored sections are decoded once for all windows:
+    std::vector<short> adc(4000);
+    for (std::size_t n = 0; n < adc.size(); ++n) {
+        adc[n] = (short)(100.0*ch[2][n]);
+    }
+    Section compact(stfio::compactSamples(adc, 0.01));
+    std::vector<stfnum::MeasurementResults> mapped(plan.Evaluate(compact, dt));
+    ASSERT_EQ(mapped.size(), 2);
+    EXPECT_EQ(mapped[1].maxT, second.Evaluate(compact, dt).maxT);
+
+    sections.push_back(ch.size());
+    EXPECT_THROW(stfnum::evaluateWindows(ch, sections, dt, plan), std::out_of_range);
+}
+
+TEST(measlib_test, iv_and_resistance) {
+    // a protocol of 4 steps, repeated 3 times, through a 0.2 GOhm resistance:
+    const double commands[] = {-20.0, -10.0, 10.0, 20.0};
+    Channel ch(13, 1000);
+    for (std::size_t n_s = 0; n_s < 12; ++n_s) {
+        double current = commands[n_s%4] / 0.2 + (n_s < 4 ? 1.0 : -0.5);
+        for (std::size_t n = 0; n < ch[n_s].size(); ++n) {
+            ch[n_s][n] = 10.0 + (n >= 300 && n < 700 ? current : 0.0);
+        }
+    }
+    // compact samples are read in place as well:
+    std::vector<short> adc(1000, 0);
+    std::fill(adc.begin()+300, adc.begin()+700, (short)100);
+    ch.InsertSection(Section(stfio::compactSamples(adc, 0.5, 10.0)), 12);
+
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < 12; ++n_s) {
+        sections.push_back(n_s);
+    }
+    std::vector<stfnum::StepResponse> responses =
+        stfnum::stepResponses(ch, sections, 0, 199, 400, 599, stfnum::mean_sd, 4);
+    ASSERT_EQ(responses.size(), 12);
+    EXPECT_DOUBLE_EQ(responses[0].base, 10.0);
+    EXPECT_DOUBLE_EQ(responses[0].response, 10.0 - 100.0 + 1.0);
+
+    Vector_double commandVec(commands, commands+4);
+    stfnum::Table iv = stfnum::ivCurve(ch, sections, 0, 199, 400, 599, commandVec, 4);
+    ASSERT_EQ(iv.nRows(), 4);
+    ASSERT_EQ(iv.nCols(), 4);
+    for (std::size_t n_st = 0; n_st < 4; ++n_st) {
+        EXPECT_EQ(iv.at(n_st, 0), commands[n_st]);
+        EXPECT_NEAR(iv.at(n_st, 1), commands[n_st]/0.2, 1e-9);
+        EXPECT_NEAR(iv.at(n_st, 2), sqrt(0.75), 1e-9);
+        EXPECT_EQ(iv.at(n_st, 3), 3);
+    }
+    // steps without sections are left empty:
+    commandVec.push_back(30.0);
+    std::vector<std::size_t> first(sections.begin(), sections.begin()+4);
+    iv = stfnum::ivCurve(ch, first, 0, 199, 400, 599, commandVec, 4);
+    EXPECT_TRUE(iv.IsEmpty(0, 2));
+    EXPECT_TRUE(iv.IsEmpty(4, 1));
+    EXPECT_EQ(iv.at(4, 3), 0);
+
+    std::vector<std::size_t> pulses(1, 12);
+    pulses.push_back(2);
+    Vector_double r = stfnum::resistance(ch, pulses, 0, 199, 400, 599, 5.0);
+    ASSERT_EQ(r.size(), 2);
+    EXPECT_DOUBLE_EQ(r[0], 0.1);
+    EXPECT_DOUBLE_EQ(r[1], 5.0 / (50.0 + 1.0));
+
+    EXPECT_THROW(stfnum::resistance(ch, pulses, 0, 199, 400, 1000, 5.0), std::out_of_range);
+    EXPECT_THROW(stfnum::ivCurve(ch, pulses, 0, 199, 400, 599, Vector_double()), std::out_of_range);
+}
+
+//=========================================================================
+// the min/max pyramid of a section finds the same crossings as the walks
+//=========================================================================
+TEST(measlib_test, indexed_crossings) {
+    for (int n_trial = 0; n_trial < 60; ++n_trial) {
+        // slow events with noise, some of them with NaNs and plateaus:
+        std::size_t size = 3000 + (n_trial*7919)%40000;
+        Vector_double data(size);
+        double onset = 0.1*size, tau = 0.002*size*(1 + n_trial%5);
+        for (std::size_t n = 0; n < size; ++n) {
+            double t = n - onset;
+            data[n] = (t > 0 ? 50*(1-exp(-t/tau))*exp(-t/(20*tau)) : 0) +
+                      0.5*(n_trial%4)*sin(0.7*n + n_trial) + 0.05*((n*104729)%37);
+            if (n_trial%5 == 2) data[n] = floor(data[n]);
+            if (n_trial%7 == 3 && n%1013 == 5) data[n] = NAN;
+        }
+        Section sec(data);
+        const stfio::MinMaxPyramid& index = sec.GetPyramid();
+        double base = 0.9, maxT = 0;
+        double peak = stfnum::peak(data, base, 0, size-1, 1, stfnum::up, maxT);
+        double ampl = (n_trial%6 == 1) ? -(peak-base) : peak-base;
+        double left = (double)((n_trial*13)%50) + 0.5*(n_trial%2);
+        double right = maxT + 0.25*(n_trial%3);
+        double frac = 0.05 + 0.05*(n_trial%8);
+
+        double r[4], ri[4];
+        double inner = stfnum::risetime2(data, base, ampl, left, right, frac, r[0], r[1], r[2], r[3]);
+        double innerIndexed = stfnum::risetime2(data, base, ampl, left, right, frac,
+                                                ri[0], ri[1], ri[2], ri[3], &index);
+        EXPECT_TRUE(inner == innerIndexed || (inner != inner && innerIndexed != innerIndexed))
+            << "trial " << n_trial;
+        for (int k = 0; k < 4; ++k) {
+            EXPECT_TRUE(r[k] == ri[k] || (r[k] != r[k] && ri[k] != ri[k])) << "trial " << n_trial;
+        }
+
+        std::size_t lo, hi, loIndexed, hiIndexed;
+        double loReal, loRealIndexed;
+        double rt = stfnum::risetime(data, base, ampl, left, right, frac, lo, hi, loReal);
+        double rtIndexed = stfnum::risetime(data, base, ampl, left, right, frac,
+                                            loIndexed, hiIndexed, loRealIndexed, &index);
+        EXPECT_EQ(lo, loIndexed) << "trial " << n_trial;
+        EXPECT_EQ(hi, hiIndexed) << "trial " << n_trial;
+        EXPECT_TRUE(rt == rtIndexed || (rt != rt && rtIndexed != rtIndexed)) << "trial " << n_trial;
+
+        std::size_t t50Left, t50Right, t50LeftIndexed, t50RightIndexed;
+        double t50LeftReal, t50LeftRealIndexed;
+        double half = stfnum::t_half(data, base, ampl, left, (double)size-1, maxT,
+                                     t50Left, t50Right, t50LeftReal);
+        double halfIndexed = stfnum::t_half(data, base, ampl, left, (double)size-1, maxT,
+                                            t50LeftIndexed, t50RightIndexed, t50LeftRealIndexed, &index);
+        EXPECT_EQ(t50Left, t50LeftIndexed) << "trial " << n_trial;
+        EXPECT_EQ(t50Right, t50RightIndexed) << "trial " << n_trial;
+        EXPECT_TRUE(half == halfIndexed || (half != half && halfIndexed != halfIndexed))
+            << "trial " << n_trial;
+    }
+}
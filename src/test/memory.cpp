@@ -0,0 +1,63 @@
+#include "../libstfio/memory.h"
+#include "../libstfio/recording.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+TEST(Memory_test, compact_recording) {
+    Recording data(2, 3, 1000);
+    for (std::size_t n_c = 0; n_c < data.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < data[n_c].size(); ++n_s) {
+            Section& sec = data[n_c][n_s];
+            for (std::size_t n = 0; n < sec.size(); ++n) {
+                // values of a 16-bit digitizer:
+                sec[n] = ((int)(n*37 + n_s*11 + n_c) % 65536) - 32768;
+            }
+            sec.SetSectionDescription("sweep");
+            sec.SetXScale(0.05);
+        }
+    }
+    Recording copy(data);
+    EXPECT_EQ( stfio::compactRecording(data), 2*3*1000*(sizeof(double)-sizeof(float)) );
+    for (std::size_t n_c = 0; n_c < data.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < data[n_c].size(); ++n_s) {
+            const Section& sec = data[n_c][n_s];
+            ASSERT_EQ( sec.size(), 1000 );
+            EXPECT_EQ( sec.GetSectionDescription(), "sweep" );
+            EXPECT_DOUBLE_EQ( sec.GetXScale(), 0.05 );
+            for (std::size_t n = 0; n < sec.size(); ++n) {
+                EXPECT_EQ( sec[n], copy[n_c][n_s][n] );
+            }
+        }
+    }
+    // compact samples aren't compacted again:
+    EXPECT_EQ( stfio::compactRecording(data), 0 );
+}
+
+TEST(Memory_test, choose_storage) {
+    EXPECT_GT( stfio::getPhysicalMemory(), 0 );
+    ASSERT_EQ( stfio::getMemoryBudget(), 0 );
+    EXPECT_EQ( stfio::chooseStorage(std::size_t(1) << 40), stfio::storage_eager );
+
+    std::size_t usage = stfio::getMemoryUsage();
+    if (usage == 0) {
+        return;
+    }
+    stfio::setMemoryBudget(usage + 1000000);
+    EXPECT_EQ( stfio::chooseStorage(1000), stfio::storage_eager );
+    EXPECT_EQ( stfio::chooseStorage(std::size_t(1) << 40), stfio::storage_mapped );
+    stfio::setMemoryBudget(0);
+}
+
+TEST(Memory_test, estimate) {
+    std::string fName = "memory_test.atf";
+    EXPECT_EQ( stfio::estimateDecodedSize(fName, stfio::atf), 0 );
+    {
+        std::ofstream file(fName.c_str());
+        file << std::string(1000, '0');
+    }
+    EXPECT_EQ( stfio::estimateDecodedSize(fName, stfio::atf), 500*sizeof(double) );
+    EXPECT_EQ( stfio::estimateDecodedSize(fName, stfio::hdf5), 250*sizeof(double) );
+    std::remove(fName.c_str());
+}
@@ -0,0 +1,101 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/noise.h"
+#include "../libstfio/channel.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+namespace {
+
+// Park-Miller minimal standard generator, uniform in [0, 1):
+class Uniform {
+public:
+    explicit Uniform(unsigned int seed) : state(seed) {}
+    double operator()() {
+        state = (unsigned int)(((unsigned long long)state * 48271u) % 2147483647u);
+        return (state - 1) / 2147483646.0;
+    }
+private:
+    unsigned int state;
+};
+
+}
+
+TEST(noise_test, ensemble_variance) {
+    Channel ch(3);
+    const double values[3] = {1.0, 2.0, 4.0};
+    for (std::size_t n_s = 0; n_s < 3; ++n_s) {
+        ch.InsertSection(Section(Vector_double(5000, values[n_s])), n_s);
+    }
+    std::vector<std::size_t> sections;
+    sections.push_back(0);
+    sections.push_back(1);
+    sections.push_back(2);
+
+    Vector_double mean, variance;
+    stfnum::ensembleVariance(ch, sections, 10, 4500, mean, variance, false);
+    ASSERT_EQ(mean.size(), 4490);
+    EXPECT_NEAR(mean[0], 7.0/3.0, 1e-12);
+    EXPECT_NEAR(variance[4489], 7.0/3.0, 1e-12);
+
+    // the variance of consecutive differences:
+    stfnum::ensembleVariance(ch, sections, 10, 4500, mean, variance, true);
+    EXPECT_NEAR(mean[4489], 7.0/3.0, 1e-12);
+    EXPECT_NEAR(variance[0], 1.25, 1e-12);
+
+    sections.pop_back();
+    sections.pop_back();
+    EXPECT_THROW(stfnum::ensembleVariance(ch, sections, 0, 100, mean, variance), std::out_of_range);
+    sections.push_back(3);
+    EXPECT_THROW(stfnum::ensembleVariance(ch, sections, 0, 100, mean, variance), std::out_of_range);
+}
+
+TEST(noise_test, nsfa_binomial) {
+    // N channels with a single-channel current of i open with a
+    // probability that rises and decays during every sweep:
+    const int N = 100;
+    const double i = -2.0;
+    const std::size_t n_sweeps = 300, n_points = 400;
+    Uniform rng(7);
+    Channel ch(n_sweeps);
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s = 0; n_s < n_sweeps; ++n_s) {
+        Vector_double sweep(n_points);
+        for (std::size_t n = 0; n < n_points; ++n) {
+            double p = 0.9 * (exp(-(double)n/120.0) - exp(-(double)n/10.0));
+            int open = 0;
+            for (int n_c = 0; n_c < N; ++n_c) {
+                open += rng() < p;
+            }
+            sweep[n] = i*open;
+        }
+        ch.InsertSection(Section(sweep), n_s);
+        sections.push_back(n_s);
+    }
+
+    stfnum::NoiseAnalysis result = stfnum::nsfa(ch, sections, 0, n_points, 20);
+    EXPECT_EQ(result.mean.size(), n_points);
+    EXPECT_LE(result.binMean.size(), 20);
+    EXPECT_GE(result.binMean.size(), 3);
+    std::size_t total = 0;
+    for (std::size_t bin = 0; bin < result.binCount.size(); ++bin) {
+        total += result.binCount[bin];
+    }
+    EXPECT_EQ(total, n_points);
+    EXPECT_NEAR(result.i, i, 0.1);
+    EXPECT_NEAR(result.N, N, 10.0);
+    EXPECT_NEAR(result.background, 0.0, 1.0);
+
+    // the parabola is exact for exact variances:
+    Vector_double binMean(4), binVariance(4);
+    for (std::size_t n = 0; n < 4; ++n) {
+        binMean[n] = -20.0*n;
+        binVariance[n] = i*binMean[n] - binMean[n]*binMean[n]/N + 0.5;
+    }
+    stfnum::fitParabola(binMean, binVariance, result);
+    EXPECT_NEAR(result.i, i, 1e-9);
+    EXPECT_NEAR(result.N, N, 1e-6);
+    EXPECT_NEAR(result.background, 0.5, 1e-9);
+    binMean.resize(2);
+    binVariance.resize(2);
+    EXPECT_THROW(stfnum::fitParabola(binMean, binVariance, result), std::runtime_error);
+}
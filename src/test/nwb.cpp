@@ -0,0 +1,148 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/nwb/nwblib.h"
+#include "hdf5.h"
+#include "hdf5_hl.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// A recording with two channels and sections of different lengths:
+Recording ragged_recording() {
+    std::deque<Channel> ch_list;
+    for (int n_c = 0; n_c < 2; ++n_c) {
+        std::deque<Section> sec_list;
+        for (int n_s = 0; n_s < 12; ++n_s) {
+            Vector_double data(1000 + 70000*(n_s%3));
+            for (std::size_t k = 0; k < data.size(); ++k) {
+                data[k] = 10.0*n_c + sin(0.001*k*(n_s+1));
+            }
+            sec_list.push_back(Section(data));
+        }
+        Channel ch(sec_list);
+        // doesn't sort before "Im":
+        ch.SetChannelName(n_c == 0 ? "Vm" : "Im");
+        ch.SetYUnits(n_c == 0 ? "mV" : "pA");
+        ch_list.push_back(ch);
+    }
+    Recording rec(ch_list);
+    rec.SetXScale(0.05);
+    rec.SetFileDescription("nwb test");
+    rec.SetDateTime(120, 4, 17, 13, 4, 55);
+    return rec;
+}
+
+void expect_equal(const Recording& imported, const Recording& rec) {
+    ASSERT_EQ( imported.size(), rec.size() );
+    EXPECT_NEAR( imported.GetXScale(), rec.GetXScale(), 1e-12 );
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        EXPECT_EQ( imported[n_c].GetChannelName(), rec[n_c].GetChannelName() );
+        EXPECT_EQ( imported[n_c].GetYUnits(), rec[n_c].GetYUnits() );
+        ASSERT_EQ( imported[n_c].size(), rec[n_c].size() );
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            ASSERT_EQ( imported[n_c][n_s].size(), rec[n_c][n_s].size() );
+            for (std::size_t k = 0; k < rec[n_c][n_s].size(); ++k) {
+                // stored with single precision and converted to SI units:
+                ASSERT_NEAR( imported[n_c][n_s][k], rec[n_c][n_s][k], 1e-5 );
+            }
+        }
+    }
+}
+
+}
+
+TEST(NWB_test, roundtrip) {
+    const char* fName = "nwb_test.nwb";
+    stftest::NullProgressInfo progDlg;
+    Recording rec = ragged_recording();
+    stfio::exportNWBFile(fName, rec, progDlg);
+
+    Recording imported;
+    stfio::importNWBFile(fName, imported, progDlg);
+    // compressed data are read when they're first needed:
+    EXPECT_TRUE( imported[0][1].IsMapped() );
+    expect_equal(imported, rec);
+    EXPECT_EQ( imported.GetFileDescription(), "nwb test" );
+    EXPECT_EQ( imported.GetDateTime().tm_year, 120 );
+    EXPECT_EQ( imported.GetDateTime().tm_min, 4 );
+
+    // the required parts of a NWB file:
+    hid_t file_id = H5Fopen(fName, H5F_ACC_RDONLY, H5P_DEFAULT);
+    ASSERT_GE( file_id, 0 );
+    char type[32] = "";
+    EXPECT_GE( H5LTget_attribute_string(file_id, "/", "neurodata_type", type), 0 );
+    EXPECT_STREQ( type, "NWBFile" );
+    EXPECT_GT( H5Lexists(file_id, "identifier", H5P_DEFAULT), 0 );
+    EXPECT_GT( H5Lexists(file_id, "stimulus", H5P_DEFAULT), 0 );
+    double conversion = 0;
+    EXPECT_GE( H5LTget_attribute_double(file_id, "/acquisition/Im_00003/data", "conversion", &conversion), 0 );
+    EXPECT_DOUBLE_EQ( conversion, 1e-12 );
+    H5Fclose(file_id);
+
+    // saving to the file that the sections are read from:
+    stfio::exportNWBFile(fName, imported, progDlg);
+    Recording again;
+    stfio::importNWBFile(fName, again, progDlg);
+    expect_equal(again, rec);
+    std::remove(fName);
+}
+
+TEST(NWB_test, mapped) {
+    const char* fName = "nwb_test_mapped.nwb";
+    stftest::NullProgressInfo progDlg;
+    Recording rec = ragged_recording();
+    // contiguous data sets stay in the file:
+    stfio::exportNWBFile(fName, rec, progDlg, stfio::hdf5_no_filter);
+
+    Recording imported;
+    stfio::importNWBFile(fName, imported, progDlg);
+    std::vector<stfio::SampleLayout> layout;
+    EXPECT_TRUE( imported[1][2].GetSamples().GetLayout(fName, layout) );
+    EXPECT_EQ( layout[0].type, stfio::sample_float32 );
+    expect_equal(imported, rec);
+    std::remove(fName);
+}
+
+TEST(NWB_test, columns) {
+    // a 2-D TimeSeries with timestamps, as written by other programs:
+    const char* fName = "nwb_test_columns.nwb";
+    hid_t file_id = H5Fcreate(fName, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t group = H5Gcreate2(file_id, "/acquisition", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    H5Gclose(group);
+    group = H5Gcreate2(file_id, "/acquisition/ElectricalSeries", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    std::vector<short> data(200);
+    std::vector<double> timestamps(100);
+    for (std::size_t n = 0; n < 100; ++n) {
+        data[2*n] = (short)n;
+        data[2*n+1] = (short)-n;
+        timestamps[n] = 1.0 + n*1e-4;
+    }
+    hsize_t dims[2] = { 100, 2 };
+    H5LTmake_dataset(group, "data", 2, dims, H5T_NATIVE_SHORT, &data[0]);
+    H5LTmake_dataset_double(group, "timestamps", 1, dims, &timestamps[0]);
+    H5LTset_attribute_string(group, "data", "unit", "volts");
+    double conversion = 1e-6;
+    H5LTset_attribute_double(group, "data", "conversion", &conversion, 1);
+    H5Gclose(group);
+    // not a time series:
+    group = H5Gcreate2(file_id, "/acquisition/empty", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    H5Gclose(group);
+    H5Fclose(file_id);
+
+    stftest::NullProgressInfo progDlg;
+    Recording imported;
+    stfio::importNWBFile(fName, imported, progDlg);
+    ASSERT_EQ( imported.size(), 2u );
+    EXPECT_EQ( imported[1].GetChannelName(), "ElectricalSeries_1" );
+    EXPECT_EQ( imported[0].GetYUnits(), "mV" );
+    EXPECT_NEAR( imported.GetXScale(), 0.1, 1e-9 );
+    ASSERT_EQ( imported[1][0].size(), 100u );
+    EXPECT_NEAR( imported[0][0][10], 10e-3, 1e-12 );
+    EXPECT_NEAR( imported[1][0][10], -10e-3, 1e-12 );
+    std::remove(fName);
+
+    Recording none;
+    EXPECT_THROW( stfio::importNWBFile("nonexistent.nwb", none, progDlg), std::runtime_error );
+}
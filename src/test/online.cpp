@@ -0,0 +1,130 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfio/online.h"
+#include "../libstfio/recording.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+Vector_double noisyData(std::size_t size) {
+    srand(17);
+    Vector_double data(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        data[n] = sin(0.01*n) + 0.1*((double)rand()/RAND_MAX - 0.5);
+    }
+    return data;
+}
+
+}
+
+TEST(Online_test, pyramid_extend) {
+    Vector_double data = noisyData(20000);
+    data[5000] = NAN;
+    stfio::MinMaxPyramid whole(data);
+
+    // appended in chunks of varying size:
+    stfio::MinMaxPyramid growing;
+    std::size_t pos = 0;
+    for (std::size_t n_c = 1; pos < data.size(); ++n_c) {
+        std::size_t n = std::min(data.size()-pos, (n_c*37) % 500);
+        growing.Extend(&data[pos], n);
+        pos += n;
+    }
+    ASSERT_EQ( growing.GetLevels(), whole.GetLevels() );
+    for (std::size_t level = 0; level < whole.GetLevels(); ++level) {
+        double min, max, gmin, gmax;
+        std::size_t n_b = 0;
+        for (; whole.GetBlock(level, n_b, min, max); ++n_b) {
+            ASSERT_TRUE( growing.GetBlock(level, n_b, gmin, gmax) );
+            if (std::isnan(min)) {
+                EXPECT_TRUE( std::isnan(gmin) && std::isnan(gmax) );
+            } else {
+                EXPECT_EQ( gmin, min );
+                EXPECT_EQ( gmax, max );
+            }
+        }
+        EXPECT_FALSE( growing.GetBlock(level, n_b, gmin, gmax) );
+    }
+}
+
+TEST(Online_test, section_views) {
+    Vector_double data = noisyData(5000);
+    stfio::OnlineSection online(100);
+    EXPECT_EQ( online.View().size(), 0 );
+
+    Section early;
+    for (std::size_t pos = 0; pos < data.size(); pos += 250) {
+        online.Append(&data[pos], 250);
+        if (pos == 1000) {
+            early = online.View("early");
+        }
+    }
+    // views don't change when more data points are appended:
+    ASSERT_EQ( early.size(), 1250 );
+    EXPECT_EQ( early.GetSectionDescription(), "early" );
+    for (std::size_t n = 0; n < early.size(); ++n) {
+        EXPECT_EQ( early[n], data[n] );
+    }
+
+    ASSERT_EQ( online.size(), data.size() );
+    Section view = online.View();
+    ASSERT_EQ( view.size(), data.size() );
+    Vector_double copy(view.size());
+    view.CopyRange(0, view.size(), &copy[0]);
+    EXPECT_TRUE( copy == data );
+
+    // the pyramid covers all points:
+    double min = 0, max = 0;
+    online.GetPyramid().Extrema(view, 17, 4321, min, max);
+    EXPECT_EQ( min, *std::min_element(data.begin()+17, data.begin()+4321) );
+    EXPECT_EQ( max, *std::max_element(data.begin()+17, data.begin()+4321) );
+}
+
+TEST(Online_test, recording) {
+    stfio::OnlineRecording online(2, 0.1, 64);
+    online.SetChannel(1, "Vm", "mV");
+    Vector_double frames;
+    for (int n = 0; n < 300; ++n) {
+        frames.push_back(n);
+        frames.push_back(-n);
+    }
+    online.AppendInterleaved(&frames[0], frames.size());
+    EXPECT_THROW( online.AppendInterleaved(&frames[0], 3), std::out_of_range );
+
+    Recording view = online.View();
+    ASSERT_EQ( view.size(), 2 );
+    EXPECT_DOUBLE_EQ( view.GetXScale(), 0.1 );
+    EXPECT_EQ( view[1].GetChannelName(), "Vm" );
+    EXPECT_EQ( view[1].GetYUnits(), "mV" );
+    ASSERT_EQ( view[0].size(), 1 );
+    ASSERT_EQ( view[0][0].size(), 300 );
+    EXPECT_EQ( view[0][0][299], 299.0 );
+    EXPECT_EQ( view[1][0][299], -299.0 );
+}
+
+TEST(Online_test, stream_criterion) {
+    Vector_double data = noisyData(20000);
+    Vector_double templ(200);
+    for (std::size_t n = 0; n < templ.size(); ++n) {
+        templ[n] = -exp(-(double)n/40.0);
+    }
+    stfio::StdoutProgressInfo progDlg("", "", 100, false);
+    Vector_double whole = stfnum::detectionCriterion(data, templ, progDlg);
+
+    stfnum::StreamCriterion stream(templ);
+    Vector_double criterion;
+    for (std::size_t pos = 0; pos < data.size(); pos += 1500) {
+        std::size_t end = std::min(pos+1500, data.size());
+        Vector_double chunk(data.begin()+pos, data.begin()+end);
+        Vector_double part = stream.Process(chunk);
+        criterion.insert(criterion.end(), part.begin(), part.end());
+        EXPECT_EQ( stream.GetPosition(), criterion.size() );
+    }
+    ASSERT_EQ( criterion.size(), whole.size() );
+    for (std::size_t n = 0; n < whole.size(); ++n) {
+        EXPECT_NEAR( criterion[n], whole[n], 1e-6*(1.0+fabs(whole[n])) );
+    }
+    EXPECT_THROW( stfnum::StreamCriterion(Vector_double(1)), std::out_of_range );
+}
@@ -0,0 +1,131 @@
+#include "../libstfio/parallel.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Counts the runs of every iteration; iteration n costs about n^2 operations:
+class CountTask : public stfio::RangeTask {
+public:
+    explicit CountTask(std::size_t n) : counts(n, 0), sums(n, 0.0), maxThread(0) {}
+
+    void Run(std::size_t begin, std::size_t end, int thread) {
+        for (std::size_t n = begin; n < end; ++n) {
+            double sum = 0;
+            for (std::size_t k = 0; k < n*n; ++k) {
+                sum += std::sin((double)k);
+            }
+            sums[n] = sum;
+            ++counts[n];
+        }
+#ifdef _OPENMP
+#pragma omp critical(parallel_test)
+#endif
+        maxThread = std::max(maxThread, thread);
+    }
+
+    std::vector<int> counts;
+    Vector_double sums;
+    int maxThread;
+};
+
+// Runs an inner loop for every iteration:
+class NestedTask : public stfio::RangeTask {
+public:
+    NestedTask(std::size_t n_outer, std::size_t n_inner) : inner(n_outer, CountTask(n_inner)) {}
+
+    void Run(std::size_t begin, std::size_t end, int thread) {
+        for (std::size_t n = begin; n < end; ++n) {
+            stfio::parallelFor(inner[n].counts.size(), inner[n]);
+        }
+    }
+
+    std::vector<CountTask> inner;
+};
+
+class FailingTask : public stfio::RangeTask {
+public:
+    void Run(std::size_t begin, std::size_t end, int thread) {
+        for (std::size_t n = begin; n < end; ++n) {
+            if (n == 57) {
+                throw std::out_of_range("iteration 57");
+            }
+        }
+    }
+};
+
+}
+
+TEST(parallel_test, thread_count) {
+    int defaultCount = stfio::getThreadCount();
+    EXPECT_GE(defaultCount, 1);
+    stfio::setThreadCount(3);
+    EXPECT_EQ(stfio::getThreadCount(), 3);
+#ifdef _OPENMP
+    EXPECT_EQ(stfio::threadCount(0, 100), 3);
+    EXPECT_EQ(stfio::threadCount(0, 2), 2);
+    EXPECT_EQ(stfio::threadCount(5, 100), 5);
+    EXPECT_EQ(stfio::threadCount(5, 0), 1);
+#else
+    EXPECT_EQ(stfio::threadCount(0, 100), 1);
+#endif
+    stfio::setThreadCount(0);
+    EXPECT_EQ(stfio::getThreadCount(), defaultCount);
+}
+
+TEST(parallel_test, uneven_costs) {
+    for (std::size_t grain = 1; grain <= 16; grain *= 4) {
+        for (int n_threads = 1; n_threads <= 4; ++n_threads) {
+            CountTask task(200);
+            stfio::parallelFor(task.counts.size(), task, n_threads, grain);
+            for (std::size_t n = 0; n < task.counts.size(); ++n) {
+                ASSERT_EQ(task.counts[n], 1);
+            }
+            EXPECT_LT(task.maxThread, n_threads);
+        }
+    }
+    CountTask empty(0);
+    stfio::parallelFor(0, empty, 4);
+}
+
+TEST(parallel_test, nested) {
+    NestedTask task(7, 50);
+    stfio::parallelFor(task.inner.size(), task, 4);
+    for (std::size_t n_o = 0; n_o < task.inner.size(); ++n_o) {
+        for (std::size_t n_i = 0; n_i < task.inner[n_o].counts.size(); ++n_i) {
+            ASSERT_EQ(task.inner[n_o].counts[n_i], 1);
+        }
+    }
+#ifdef _OPENMP
+    // inner regions share the threads of the outer one:
+    stfio::setThreadCount(8);
+    int inner = 0, team = 0;
+#pragma omp parallel num_threads(4)
+    {
+#pragma omp single
+        {
+            inner = stfio::threadCount(0, 100);
+            team = omp_get_num_threads();
+        }
+    }
+    EXPECT_EQ(inner, std::max(8/team, 1));
+    stfio::setThreadCount(0);
+#endif
+}
+
+TEST(parallel_test, errors) {
+    FailingTask task;
+    try {
+        stfio::parallelFor(100, task, 4, 3);
+        FAIL() << "No exception";
+    } catch (const std::runtime_error& e) {
+        EXPECT_EQ(std::string(e.what()), "iteration 57");
+    }
+    EXPECT_THROW(stfio::parallelFor(100, task, 1), std::runtime_error);
+}
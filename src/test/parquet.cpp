@@ -0,0 +1,142 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/tablestream.h"
+#include "../libstfio/parquet.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> columns() {
+    std::vector<std::string> cols;
+    cols.push_back("section");
+    cols.push_back("amplitude");
+    return cols;
+}
+
+void appendRows(stfio::TableStream& table, int n_rows) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(4)
+#endif
+    for (int n_r = 0; n_r < n_rows; ++n_r) {
+        std::ostringstream label;
+        label << "file " << n_r;
+        Vector_double row(2);
+        row[0] = n_r;
+        row[1] = (n_r % 10 == 0) ? NAN : 0.5*n_r;
+        table.Append(label.str(), row);
+    }
+}
+
+// Checks that every row of appendRows() has been read once:
+void expect_rows(const std::vector<std::string>& labels, const Vector_double& values, int n_rows) {
+    ASSERT_EQ( labels.size(), (std::size_t)n_rows );
+    ASSERT_EQ( values.size(), 2*labels.size() );
+    std::vector<bool> seen(n_rows, false);
+    for (std::size_t n_r = 0; n_r < labels.size(); ++n_r) {
+        int row = (int)values[2*n_r];
+        ASSERT_GE( row, 0 );
+        ASSERT_LT( row, n_rows );
+        EXPECT_FALSE( seen[row] );
+        seen[row] = true;
+        std::ostringstream label;
+        label << "file " << row;
+        EXPECT_EQ( labels[n_r], label.str() );
+        if (row % 10 == 0) {
+            EXPECT_TRUE( std::isnan(values[2*n_r+1]) );
+        } else {
+            EXPECT_EQ( values[2*n_r+1], 0.5*row );
+        }
+    }
+}
+
+}
+
+TEST(Parquet_test, tablestream) {
+    const char* fName = "parquet_test.parquet";
+    const int n_rows = 1000;
+    std::string title;
+    std::vector<std::string> cols, labels;
+    Vector_double values;
+    {
+        // more than 15 row groups, which need a long list header:
+        stfio::TableStream table(fName, "file", columns(), 64);
+        appendRows(table, n_rows);
+        // the file can be read after every write:
+        table.Flush();
+        stfio::readTableParquet(fName, title, cols, labels, values);
+        EXPECT_EQ( labels.size(), (std::size_t)n_rows );
+        table.Append("last", Vector_double(2, 1.0));
+    }
+    stfio::readTableParquet(fName, title, cols, labels, values);
+    EXPECT_EQ( title, "file" );
+    EXPECT_EQ( cols, columns() );
+    ASSERT_EQ( labels.size(), (std::size_t)n_rows+1 );
+    EXPECT_EQ( labels.back(), "last" );
+    labels.pop_back();
+    values.resize(values.size()-2);
+    expect_rows(labels, values, n_rows);
+
+    std::ifstream in(fName, std::ios::binary);
+    char magic[5] = "";
+    in.read(magic, 4);
+    EXPECT_EQ( std::string(magic), "PAR1" );
+    in.seekg(-4, std::ios::end);
+    in.read(magic, 4);
+    EXPECT_EQ( std::string(magic), "PAR1" );
+    in.close();
+    std::remove(fName);
+}
+
+TEST(Parquet_test, writer) {
+    const char* fName = "parquet_test_writer.parquet";
+    std::string title;
+    std::vector<std::string> cols, labels;
+    Vector_double values;
+    {
+        stfio::ParquetWriter writer(fName, "Event", std::vector<std::string>(1, "Amplitude"));
+        // an empty table is a valid file:
+        stfio::readTableParquet(fName, title, cols, labels, values);
+        EXPECT_EQ( title, "Event" );
+        EXPECT_TRUE( labels.empty() );
+        EXPECT_THROW( writer.Append(std::vector<std::string>(2), Vector_double(1)), std::runtime_error );
+
+        std::vector<std::string> rowLabels;
+        Vector_double rowValues;
+        for (int n = 0; n < 100000; ++n) {
+            rowLabels.push_back(n % 2 ? "odd" : "");
+            rowValues.push_back(n % 3 ? n : NAN);
+        }
+        writer.Append(rowLabels, rowValues);
+        writer.Close();
+        EXPECT_THROW( writer.Append(rowLabels, rowValues), std::runtime_error );
+    }
+    stfio::readTableParquet(fName, title, cols, labels, values);
+    ASSERT_EQ( labels.size(), 100000u );
+    ASSERT_EQ( values.size(), 100000u );
+    for (int n = 0; n < 100000; ++n) {
+        ASSERT_EQ( labels[n], n % 2 ? "odd" : "" );
+        if (n % 3) {
+            ASSERT_EQ( values[n], n );
+        } else {
+            ASSERT_TRUE( std::isnan(values[n]) );
+        }
+    }
+    // compressed with gzip:
+    std::ifstream in(fName, std::ios::binary | std::ios::ate);
+    EXPECT_LT( (std::size_t)in.tellg(), 100000u*(8+4) / 2 );
+    in.close();
+
+    EXPECT_TRUE( stfio::isParquetName("a/b.PARQUET") );
+    EXPECT_FALSE( stfio::isParquetName("parquet.csv") );
+    std::ofstream csv(fName);
+    csv << "file,amplitude\n\"a\",1\n";
+    csv.close();
+    EXPECT_THROW( stfio::readTableParquet(fName, title, cols, labels, values), std::runtime_error );
+    std::remove(fName);
+    EXPECT_THROW( stfio::readTableParquet(fName, title, cols, labels, values), std::runtime_error );
+}
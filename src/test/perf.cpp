@@ -0,0 +1,159 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/profile.h"
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/measure.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+// Performance assertions are opt-in, since timings depend on the machine and
+// on its load. Run them with
+//   stimfittest --gtest_also_run_disabled_tests --gtest_filter='perf_test.*'
+// Budgets are multiples of a calibration loop that is timed on the same
+// machine, so that they don't need to be adjusted for faster or slower
+// hardware; STF_PERF_FACTOR scales all of them, e.g. for debug builds.
+
+namespace {
+
+const std::size_t perf_points = 10000000;
+
+Vector_double perf_data(std::size_t n) {
+    Vector_double data(n);
+    unsigned long state = 1;
+    for (std::size_t k = 0; k < n; ++k) {
+        state = (state * 1103515245UL + 12345UL) & 0x7fffffffUL;
+        data[k] = (double)state / 2147483648.0 - 0.5 + sin(0.001*k);
+        if (k%5000 > 1000 && k%5000 < 1400) {
+            data[k] -= 5.0*exp(-(double)(k%5000-1000)/100.0);
+        }
+    }
+    return data;
+}
+
+Vector_double perf_template(std::size_t n) {
+    Vector_double templ(n);
+    for (std::size_t k = 0; k < n; ++k) {
+        templ[k] = -exp(-(double)k/(n/4.0));
+    }
+    return templ;
+}
+
+double perf_factor() {
+    const char* factor = std::getenv("STF_PERF_FACTOR");
+    return factor ? std::atof(factor) : 1.0;
+}
+
+// Shortest of three runs of a function object:
+template <class F>
+double best_time(F& f) {
+    double best = 0;
+    for (int n_r = 0; n_r < 3; ++n_r) {
+        double start = stfio::profileClock();
+        f();
+        double elapsed = stfio::profileClock() - start;
+        if (n_r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+// The calibration loop: a serial pass that computes the running moments
+// of the data, which every detection criterion has to do at least once.
+struct Calibration {
+    explicit Calibration(const Vector_double& data_) : data(data_), result(0) {}
+    void operator()() {
+        double sum = 0, sum2 = 0;
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            sum += data[k];
+            sum2 += data[k]*data[k];
+        }
+        result += sum + sum2;
+    }
+    const Vector_double& data;
+    double result;
+};
+
+double calibrate(const Vector_double& data) {
+    Calibration calibration(data);
+    double t = best_time(calibration);
+    // keep the loop from being optimised away:
+    EXPECT_TRUE( calibration.result == calibration.result );
+    return t;
+}
+
+struct Criterion {
+    Criterion(const Vector_double& data_, const Vector_double& templ_) : data(data_), templ(templ_) {}
+    void operator()() {
+        stftest::NullProgressInfo progDlg;
+        result = stfnum::detectionCriterion(data, templ, progDlg);
+    }
+    const Vector_double& data;
+    const Vector_double& templ;
+    Vector_double result;
+};
+
+struct Baseline {
+    Baseline(const Vector_double& data_) : data(data_), result(0) {}
+    void operator()() {
+        double var;
+        for (std::size_t begin = 0; begin + 1000 < data.size(); begin += 100000) {
+            result += stfnum::base(stfnum::median_iqr, var, data, begin, begin+999);
+            result += stfnum::base(stfnum::mean_sd, var, data, begin, begin+999);
+        }
+    }
+    const Vector_double& data;
+    double result;
+};
+
+struct Filter {
+    Filter(const Vector_double& data_) : data(data_) {}
+    void operator()() {
+        Vector_double a(1, 1.0);
+        stfnum::StreamFilter sf(a, 20, stfnum::fgaussColqu, false, 257, 8192);
+        result = sf.Process(data);
+    }
+    const Vector_double& data;
+    Vector_double result;
+};
+
+}
+
+TEST(perf_test, DISABLED_detection_criterion) {
+    Vector_double data = perf_data(perf_points);
+    double baseline = calibrate(data);
+    for (std::size_t templ_size = 32; templ_size <= 512; templ_size *= 4) {
+        Vector_double templ = perf_template(templ_size);
+        Criterion criterion(data, templ);
+        double t = best_time(criterion);
+        // the cost of the FFT path hardly grows with the template size:
+        double budget = 100.0 * perf_factor() * baseline;
+        std::cout << "detectionCriterion, template " << templ_size << ": "
+                  << 1.0e3*t << " ms, budget " << 1.0e3*budget << " ms\n";
+        ASSERT_EQ( criterion.result.size(), data.size()-templ_size );
+        EXPECT_LT( t, budget ) << "template size " << templ_size;
+    }
+}
+
+TEST(perf_test, DISABLED_baseline) {
+    Vector_double data = perf_data(perf_points);
+    double baseline = calibrate(data);
+    Baseline base(data);
+    double t = best_time(base);
+    double budget = 1.0 * perf_factor() * baseline;
+    std::cout << "base(): " << 1.0e3*t << " ms, budget " << 1.0e3*budget << " ms\n";
+    EXPECT_LT( t, budget );
+}
+
+TEST(perf_test, DISABLED_stream_filter) {
+    Vector_double data = perf_data(perf_points);
+    double baseline = calibrate(data);
+    Filter filter(data);
+    double t = best_time(filter);
+    double budget = 50.0 * perf_factor() * baseline;
+    std::cout << "StreamFilter: " << 1.0e3*t << " ms, budget " << 1.0e3*budget << " ms\n";
+    EXPECT_LT( t, budget );
+}
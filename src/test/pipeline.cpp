@@ -0,0 +1,222 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/pipeline.h"
+#include "../libstfnum/funclib.h"
+#include "../libstfnum/fit.h"
+#include "../libstfio/recording.h"
+#include "../libstfio/tablestream.h"
+#include "../libstfio/hdf5/hdf5lib.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// Two channels; every sweep of the first one has an event of its own amplitude
+// on a baseline of its own:
+Recording events_recording(int n_sweeps) {
+    std::deque<Channel> ch_list;
+    for (int n_c = 0; n_c < 2; ++n_c) {
+        std::deque<Section> sec_list;
+        for (int n_s = 0; n_s < n_sweeps; ++n_s) {
+            Vector_double data(2000);
+            for (std::size_t k = 0; k < data.size(); ++k) {
+                double t = (double)k - 500.0;
+                data[k] = 0.5*n_s + 0.01*sin(0.7*k);
+                if (n_c == 0 && t > 0) {
+                    data[k] -= (1.0 + 0.1*n_s) * (exp(-t/200.0) - exp(-t/20.0));
+                }
+            }
+            sec_list.push_back(Section(data));
+        }
+        ch_list.push_back(Channel(sec_list));
+    }
+    Recording rec(ch_list);
+    rec.SetXScale(0.1);
+    return rec;
+}
+
+stfnum::MeasurementPlan measurement_plan() {
+    stfnum::MeasurementPlan plan;
+    plan.baseBeg = 0;
+    plan.baseEnd = 400;
+    plan.peakBeg = 450;
+    plan.peakEnd = 1500;
+    plan.dir = stfnum::down;
+    return plan;
+}
+
+// Fails at a given sweep:
+class FailingStage : public stfnum::SweepStage {
+public:
+    explicit FailingStage(std::size_t at_) : at(at_) {}
+    void Process(stfnum::Sweep& sweep) const {
+        if (sweep.index == at) {
+            throw std::out_of_range("failing stage");
+        }
+    }
+private:
+    std::size_t at;
+};
+
+}
+
+TEST(pipeline_test, measure) {
+    const int n_sweeps = 37;
+    Recording rec = events_recording(n_sweeps);
+    stfnum::MeasurementPlan plan = measurement_plan();
+    stfnum::BaselineStage baseline(0, 0, 400);
+    stfnum::MeasureStage measure(plan, 0);
+    stftest::NullProgressInfo progDlg;
+
+    // the result doesn't depend on the queue size or the number of threads:
+    stfnum::Table first(0, 0);
+    for (int n_threads = 1; n_threads <= 4; n_threads += 3) {
+        for (std::size_t queue = 1; queue <= 16; queue *= 4) {
+            stfnum::RecordingSource source(rec);
+            stfnum::TableSink sink;
+            stfnum::Pipeline pipeline(source, sink, queue, n_threads);
+            pipeline.Add(baseline);
+            pipeline.Add(measure);
+            ASSERT_EQ(pipeline.Columns().size(), 14u);
+            EXPECT_EQ(pipeline.Run(progDlg), (std::size_t)n_sweeps);
+
+            stfnum::Table table = sink.GetTable();
+            ASSERT_EQ(table.nRows(), (std::size_t)n_sweeps);
+            ASSERT_EQ(table.nCols(), 14u);
+            EXPECT_EQ(table.GetColLabel(0), "baseline");
+            EXPECT_EQ(table.GetColLabel(5), "amplitude");
+            EXPECT_EQ(table.GetRowLabel(2), "Sweep 3");
+            if (first.nRows() == 0) {
+                first = table;
+            }
+            for (std::size_t n_s = 0; n_s < table.nRows(); ++n_s) {
+                for (std::size_t n_c = 0; n_c < table.nCols(); ++n_c) {
+                    ASSERT_EQ(table.at(n_s, n_c), first.at(n_s, n_c));
+                }
+            }
+        }
+    }
+
+    // the measurements follow the baseline subtraction:
+    for (std::size_t n_s = 0; n_s < (std::size_t)n_sweeps; ++n_s) {
+        double var = 0;
+        EXPECT_NEAR(first.at(n_s, 0), stfnum::base(stfnum::mean_sd, var, rec[0][n_s].get(), 0, 400), 1e-12);
+        Vector_double data(rec[0][n_s].get());
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            data[k] -= first.at(n_s, 0);
+        }
+        stfnum::MeasurementResults res = plan.Evaluate(Section(data), rec.GetXScale());
+        EXPECT_NEAR(first.at(n_s, 2), res.base, 1e-12);
+        EXPECT_NEAR(first.at(n_s, 4), res.peak, 1e-12);
+        EXPECT_NEAR(first.at(n_s, 7), res.maxT*rec.GetXScale(), 1e-12);
+    }
+    // the sections of the recording haven't been changed:
+    EXPECT_NEAR(rec[0][10][0], 5.0, 0.02);
+}
+
+TEST(pipeline_test, filter_and_fit) {
+    Recording rec = events_recording(8);
+    stftest::NullProgressInfo progDlg;
+    stfnum::BiquadCascade lowpass = stfnum::designIIR(stfnum::iir_bessel, 4, 1.0, 1.0/rec.GetXScale());
+    stfnum::FilterStage filter(lowpass, 0);
+    const stfnum::storedFunc& func = stfnum::GetFunc(stfnum::func_mexp);
+    Vector_double initP(3);
+    initP[0] = -1.0;
+    initP[1] = 10.0;
+    initP[2] = 0.0;
+    stfnum::FitStage fit(func, 0, 700, 2000, initP, stfnum::LM_default_opts());
+    stfnum::FitStage outside(func, 0, 1500, 3000, initP, stfnum::LM_default_opts());
+    EXPECT_THROW(stfnum::FitStage(func, 0, 0, 10, Vector_double(2), stfnum::LM_default_opts()),
+                 std::out_of_range);
+
+    stfnum::RecordingSource source(rec, "rec");
+    stfnum::TableSink sink;
+    stfnum::Pipeline pipeline(source, sink, 3, 2);
+    pipeline.Add(filter);
+    pipeline.Add(fit);
+    pipeline.Add(outside);
+    EXPECT_EQ(pipeline.Run(progDlg), 8u);
+
+    stfnum::Table table = sink.GetTable();
+    ASSERT_EQ(table.nCols(), 10u);
+    EXPECT_EQ(table.GetColLabel(3), "SSE");
+    EXPECT_EQ(table.GetRowLabel(0), "rec, sweep 1");
+    for (std::size_t n_s = 0; n_s < table.nRows(); ++n_s) {
+        // fitted to the filtered data:
+        Vector_double filtered = stfnum::filtfilt(lowpass, rec[0][n_s].get());
+        Vector_double window(filtered.begin()+700, filtered.end());
+        Vector_double p(initP);
+        std::string info;
+        int warning = 0;
+        stfnum::lmFit(window, rec.GetXScale(), func, stfnum::LM_default_opts(), true, p, info, warning);
+        EXPECT_NEAR(table.at(n_s, 1), p[1], 1e-9*fabs(p[1]));
+        EXPECT_NEAR(table.at(n_s, 1), 20.0, 1.0);
+        // the window of the second fit is out of range:
+        EXPECT_TRUE(table.IsEmpty(n_s, 5));
+        EXPECT_TRUE(table.IsEmpty(n_s, 8));
+    }
+}
+
+TEST(pipeline_test, file_source_and_stream) {
+    const char* h5Name = "pipeline_test.h5";
+    const char* csvName = "pipeline_test.csv";
+    Recording rec = events_recording(21);
+    stftest::NullProgressInfo progDlg;
+    stfio::exportHDF5File(h5Name, rec, progDlg);
+
+    stfnum::MeasurementPlan plan = measurement_plan();
+    stfnum::MeasureStage measure(plan, 0, 1);
+    {
+        // sweeps are read five at a time:
+        stfnum::FileSource source(h5Name, stfio::hdf5, stfio::txtImportSettings(), 5, "cell");
+        EXPECT_EQ(source.Size(), 21u);
+        stfnum::StreamSink sink(csvName);
+        stfnum::Pipeline pipeline(source, sink, 4, 3);
+        pipeline.Add(measure);
+        EXPECT_EQ(pipeline.Run(progDlg), 21u);
+    }
+    std::remove(h5Name);
+
+    std::string title;
+    std::vector<std::string> columns, labels;
+    Vector_double values;
+    stfio::readTableCSV(csvName, title, columns, labels, values);
+    std::remove(csvName);
+    EXPECT_EQ(title, "sweep");
+    ASSERT_EQ(columns.size(), 12u);
+    ASSERT_EQ(labels.size(), 21u);
+    EXPECT_EQ(labels[20], "cell, sweep 21");
+    for (std::size_t n_s = 0; n_s < labels.size(); ++n_s) {
+        // stored with single precision:
+        Vector_double data(rec[0][n_s].size());
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            data[k] = float(rec[0][n_s][k]);
+        }
+        stfnum::MeasurementResults res = plan.Evaluate(Section(data), rec.GetXScale());
+        EXPECT_NEAR(values[n_s*columns.size() + 2], res.peak, 1e-6);
+    }
+}
+
+TEST(pipeline_test, errors) {
+    Recording rec = events_recording(12);
+    stftest::NullProgressInfo progDlg;
+    stfnum::RecordingSource source(rec);
+    stfnum::TableSink sink;
+    stfnum::Pipeline pipeline(source, sink, 2, 4);
+    FailingStage failing(7);
+    pipeline.Add(failing);
+    EXPECT_THROW(pipeline.Run(progDlg), std::runtime_error);
+
+    // channels that the sweeps don't have:
+    stfnum::RecordingSource again(rec);
+    stfnum::Pipeline missing(again, sink);
+    stfnum::BaselineStage baseline(2, 0, 10);
+    missing.Add(baseline);
+    EXPECT_THROW(missing.Run(progDlg), std::runtime_error);
+
+    // files that can't be read:
+    stfnum::FileSource nofile("pipeline_test_missing.dat", stfio::ascii);
+    stfnum::Pipeline unread(nofile, sink);
+    EXPECT_THROW(unread.Run(progDlg), std::runtime_error);
+}
@@ -0,0 +1,118 @@
+#include "../libstfnum/plugin.h"
+#include "../libstfio/section.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+// Implemented like a plugin library would, with the C interface only:
+int scale(const stf_span* in, size_t n_sections, double dt, const double* params,
+          double* const* out, double* results, const stf_progress* progress,
+          char* error, size_t error_size)
+{
+    for (size_t n_s = 0; n_s < n_sections; ++n_s) {
+        double sum = 0;
+        for (size_t n = 0; n < in[n_s].size; ++n) {
+            out[n_s][n] = params[0] * in[n_s].data[n];
+            sum += in[n_s].data[n];
+        }
+        results[n_s*2] = sum / in[n_s].size;
+        results[n_s*2+1] = in[n_s].size * dt;
+        if (!progress->update(progress->context, n_s+1)) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+int failing(const stf_span* in, size_t n_sections, double, const double*,
+            double* const*, double* results, const stf_progress*,
+            char* error, size_t error_size)
+{
+    for (size_t n_s = 0; n_s < n_sections; ++n_s) {
+        if (in[n_s].size < 10) {
+            snprintf(error, error_size, "section too short");
+            return 1;
+        }
+        results[n_s] = in[n_s].data[0];
+    }
+    return 0;
+}
+
+const char* scaleParams[] = {"Factor"};
+const double scaleDefaults[] = {2.0};
+const char* scaleResults[] = {"Mean", "Duration"};
+const char* firstResults[] = {"First"};
+
+const stf_plugin plugins[] = {
+    {"Scale", "Multiplies traces", STF_PLUGIN_REENTRANT | STF_PLUGIN_TRANSFORMS,
+     1, scaleParams, scaleDefaults, 2, scaleResults, scale},
+    {"First", NULL, 0, 0, NULL, NULL, 1, firstResults, failing}
+};
+
+Channel testChannel(std::size_t n_sections) {
+    Channel ch(n_sections);
+    for (std::size_t n_s = 0; n_s < n_sections; ++n_s) {
+        Vector_double data(20 + n_s);
+        for (std::size_t n = 0; n < data.size(); ++n) {
+            data[n] = (double)n_s;
+        }
+        ch.InsertSection(Section(data), n_s);
+    }
+    return ch;
+}
+
+}
+
+TEST(Plugin_test, run) {
+    stf_plugin_library desc = {STF_PLUGIN_API_VERSION, 2, plugins};
+    std::vector<stfnum::NativePlugin> lib(stfnum::GetPlugins(desc, std::shared_ptr<void>()));
+    ASSERT_EQ( lib.size(), 2u );
+    EXPECT_EQ( lib[0].GetName(), "Scale" );
+    EXPECT_TRUE( lib[0].Transforms() );
+    EXPECT_TRUE( lib[0].IsReentrant() );
+    EXPECT_EQ( lib[0].GetParamDefaults()[0], 2.0 );
+    EXPECT_TRUE( lib[1].GetDescription().empty() );
+
+    // several batches in parallel:
+    Channel ch(testChannel(100));
+    stftest::NullProgressInfo progDlg;
+    stfnum::PluginResults res(lib[0].Run(ch, 0.1, Vector_double(1, 3.0), progDlg, 4));
+    ASSERT_EQ( res.traces.size(), 100u );
+    for (std::size_t n_s = 0; n_s < 100; ++n_s) {
+        ASSERT_EQ( res.traces[n_s].size(), ch[n_s].size() );
+        EXPECT_EQ( res.traces[n_s][5], 3.0*n_s );
+        EXPECT_EQ( res.results.at(n_s, 0), (double)n_s );
+        EXPECT_NEAR( res.results.at(n_s, 1), 0.1*(20+n_s), 1e-12 );
+    }
+    EXPECT_EQ( res.results.GetColLabel(1), "Duration" );
+    EXPECT_THROW( lib[0].Run(ch, 0.1, Vector_double(), progDlg), std::out_of_range );
+
+    stftest::NullProgressInfo cancelDlg(50);
+    EXPECT_EQ( lib[0].Run(ch, 0.1, Vector_double(1, 3.0), cancelDlg, 2).traces.size(), 0u );
+
+    // not reentrant: all sections in a single call
+    stfnum::PluginResults first(lib[1].Run(testChannel(30), 0.1, Vector_double(), progDlg));
+    EXPECT_EQ( first.traces.size(), 0u );
+    EXPECT_EQ( first.results.at(29, 0), 29.0 );
+    Channel shortCh(testChannel(2));
+    shortCh[1] = Section(Vector_double(5, 1.0));
+    EXPECT_THROW( lib[1].Run(shortCh, 0.1, Vector_double(), progDlg), std::runtime_error );
+}
+
+TEST(Plugin_test, load) {
+    stf_plugin_library old = {STF_PLUGIN_API_VERSION+1, 2, plugins};
+    EXPECT_THROW( stfnum::GetPlugins(old, std::shared_ptr<void>()), std::runtime_error );
+    stf_plugin incomplete = plugins[0];
+    incomplete.run = NULL;
+    stf_plugin_library broken = {STF_PLUGIN_API_VERSION, 1, &incomplete};
+    EXPECT_THROW( stfnum::GetPlugins(broken, std::shared_ptr<void>()), std::runtime_error );
+
+    EXPECT_THROW( stfnum::LoadPlugins("/nonexistent/plugin.so"), std::runtime_error );
+    std::vector<std::string> errors;
+    EXPECT_TRUE( stfnum::LoadPluginDir("/nonexistent", errors).empty() );
+    EXPECT_TRUE( errors.empty() );
+}
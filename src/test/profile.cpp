@@ -0,0 +1,71 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/profile.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+TEST(profile_test, timers_and_counters) {
+    stfio::profileReset();
+    const int n_runs = 64;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(4)
+#endif
+    for (int n = 0; n < n_runs; ++n) {
+        stfio::ProfileScope scope("test/region");
+        stfio::profileCount("test/counter", 2);
+    }
+    stfio::profileRecord("test/fixed", stfio::profileClock(), 0.5);
+
+    std::vector<stfio::ProfileTimer> timers = stfio::profileTimers();
+    ASSERT_EQ( timers.size(), 2u );
+    // sorted by name:
+    EXPECT_EQ( timers[0].name, "test/fixed" );
+    EXPECT_EQ( timers[0].calls, 1 );
+    EXPECT_DOUBLE_EQ( timers[0].total, 0.5 );
+    EXPECT_DOUBLE_EQ( timers[0].max, 0.5 );
+    EXPECT_EQ( timers[1].name, "test/region" );
+    EXPECT_EQ( timers[1].calls, n_runs );
+    EXPECT_GE( timers[1].total, 0.0 );
+
+    std::vector<stfio::ProfileCounter> counters = stfio::profileCounters();
+    ASSERT_EQ( counters.size(), 1u );
+    EXPECT_EQ( counters[0].name, "test/counter" );
+    EXPECT_EQ( counters[0].value, 2*n_runs );
+
+    std::string report = stfio::profileReport();
+    EXPECT_NE( report.find("test/region"), std::string::npos );
+    EXPECT_NE( report.find("test/counter"), std::string::npos );
+
+    stfio::profileReset();
+    EXPECT_TRUE( stfio::profileTimers().empty() );
+    EXPECT_TRUE( stfio::profileCounters().empty() );
+}
+
+TEST(profile_test, chrome_trace) {
+    stfio::profileReset();
+    double start = 100.0;
+    stfio::profileRecord("test/\"quoted\"", start, 1.0e-3);
+    stfio::profileRecord("test/second", start + 2.0e-3, 1.0e-3);
+    stfio::profileCount("test/counter", 5);
+
+    const char* fName = "profile_test.json";
+    stfio::writeChromeTrace(fName);
+    std::ifstream in(fName);
+    std::stringstream json;
+    json << in.rdbuf();
+    in.close();
+    std::remove(fName);
+
+    std::string trace = json.str();
+    EXPECT_EQ( trace.find("{\"traceEvents\":["), 0u );
+    EXPECT_NE( trace.find("\"name\":\"test/\\\"quoted\\\"\""), std::string::npos );
+    // timestamps are relative to the first event, in microseconds:
+    EXPECT_NE( trace.find("\"ts\":0.000,\"dur\":1000.000"), std::string::npos );
+    EXPECT_NE( trace.find("\"ts\":2000.000,\"dur\":1000.000"), std::string::npos );
+    EXPECT_NE( trace.find("\"ph\":\"C\""), std::string::npos );
+    EXPECT_NE( trace.find("{\"value\":5}"), std::string::npos );
+
+    EXPECT_THROW( stfio::writeChromeTrace("/nonexistent/dir/trace.json"), std::runtime_error );
+    stfio::profileReset();
+}
@@ -1,5 +1,7 @@
 #include "../libstfio/stfio.h"
 #include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
 
 TEST(Recording_test, constructors)
 {
@@ -26,6 +28,67 @@ TEST(Recording_test, constructors)
     EXPECT_EQ( rec3[rec3.size()-1][rec3[rec3.size()-1].size()-1].size(), 32768 );
 }
 
+#if (__cplusplus >= 201103)
+TEST(Recording_test, move_constructors)
+{
+    // the data points end up in the recording without being copied:
+    Vector_double data(32768, 1.5);
+    const double* p_data = &data[0];
+    Section sec(std::move(data));
+    EXPECT_TRUE( data.empty() );
+    EXPECT_EQ( &sec.get()[0], p_data );
+
+    Channel ch(2);
+    ch.InsertSection(std::move(sec), 1);
+    EXPECT_EQ( sec.size(), 0 );
+    EXPECT_EQ( &ch[1].get()[0], p_data );
+
+    Recording rec(std::move(ch));
+    EXPECT_EQ( ch.size(), 0 );
+    EXPECT_EQ( &rec[0][1].get()[0], p_data );
+
+    Recording rec2(2);
+    Channel ch2(rec[0]);
+    rec2.InsertChannel(std::move(ch2), 1);
+    EXPECT_EQ( rec2[1][1][0], 1.5 );
+    EXPECT_EQ( ch2.size(), 0 );
+
+    Recording moved(std::move(rec));
+    EXPECT_EQ( rec.size(), 0 );
+    EXPECT_EQ( &moved[0][1].get()[0], p_data );
+}
+
+TEST(Recording_test, add_rec)
+{
+    Recording series(2, 1, 8);
+    series.SetXScale(0.1);
+    Recording file(2, 3, 16);
+    file.SetXScale(0.1);
+    file[1][2][5] = 2.5;
+    const double* p_data = &file[1][2].get()[0];
+
+    Recording copied(file);
+    series.AddRec(copied);
+    EXPECT_EQ( copied[1].size(), 3 );
+
+    // the sections are moved rather than copied:
+    series[1].reserve(7);
+    series.AddRec(std::move(file));
+    ASSERT_EQ( series[1].size(), 7 );
+    EXPECT_EQ( series[1][3][5], 2.5 );
+    EXPECT_EQ( &series[1][6].get()[0], p_data );
+    EXPECT_EQ( series[1][6][5], 2.5 );
+    EXPECT_EQ( file[1].size(), 0 );
+
+    Recording other(2, 1, 8);
+    other.SetXScale(0.2);
+    EXPECT_THROW( series.AddRec(std::move(other)), std::runtime_error );
+    Recording one(1, 1, 8);
+    one.SetXScale(0.1);
+    EXPECT_THROW( series.AddRec(one), std::runtime_error );
+}
+#endif
+
 TEST(Recording_test, data_access)
 {
     std::deque<Section> sec_list(16, Section(32768));
@@ -58,3 +121,346 @@ TEST(Recording_test, data_access)
     EXPECT_THROW( rec3[recsize-1].at(chsize), std::out_of_range );
     EXPECT_THROW( rec3[recsize-1][chsize-1].at(secsize), std::out_of_range );
 }
+
+TEST(Recording_test, average)
+{
+    // sizes that aren't multiples of the block size:
+    const std::size_t n_sections = 7, sec_size = 10000, avg_size = 9990;
+    std::deque<Section> sec_list;
+    for (std::size_t l = 0; l < n_sections; ++l) {
+        Vector_double data(sec_size);
+        for (std::size_t k = 0; k < sec_size; ++k) {
+            data[k] = 100.0 + sin(0.01*k*(l+1)) + 0.1*l;
+        }
+        if (l%2 == 0) {
+            sec_list.push_back(Section(data));
+        } else {
+            // decoded on demand:
+            std::vector<float> samples(data.begin(), data.end());
+            sec_list.push_back(Section(stfio::compactSamples(samples)));
+        }
+    }
+    Channel ch(sec_list);
+    Recording rec(ch);
+    rec.SetXScale(0.05);
+
+    std::vector<std::size_t> section_index;
+    std::vector<int> shift;
+    for (std::size_t l = 0; l < n_sections; ++l) {
+        section_index.push_back(n_sections-1-l);
+        shift.push_back((int)(l%3)*4);
+    }
+
+    Section average(avg_size), sig(avg_size);
+    rec.MakeAverage(average, sig, 0, section_index, true, shift);
+    Section average_only(avg_size), unused(avg_size);
+    rec.MakeAverage(average_only, unused, 0, section_index, false, shift);
+    EXPECT_EQ( average.GetXScale(), 0.05 );
+
+    const Recording& crec = rec;
+    for (std::size_t k = 0; k < avg_size; ++k) {
+        double mean = 0.0;
+        for (std::size_t l = 0; l < n_sections; ++l) {
+            mean += crec[0][section_index[l]][k+shift[l]];
+        }
+        mean /= n_sections;
+        double var = 0.0;
+        for (std::size_t l = 0; l < n_sections; ++l) {
+            var += pow(crec[0][section_index[l]][k+shift[l]] - mean, 2);
+        }
+        EXPECT_NEAR( average[k], mean, 1e-10 );
+        EXPECT_NEAR( average_only[k], mean, 1e-10 );
+        EXPECT_NEAR( sig[k], sqrt(var/(n_sections-1)), 1e-10 );
+    }
+    // mapped sections are only decoded block-wise:
+    EXPECT_TRUE( crec[0][1].IsMapped() );
+
+    shift[0] = 11;
+    EXPECT_THROW( rec.MakeAverage(average, sig, 0, section_index, true, shift), std::out_of_range );
+    EXPECT_THROW( rec.MakeAverage(average, sig, 1, section_index, true, shift), std::out_of_range );
+}
+
+TEST(Recording_test, live_average)
+{
+    const std::size_t n_sections = 9, sec_size = 5000;
+    Channel ch(n_sections);
+    for (std::size_t l = 0; l < n_sections; ++l) {
+        Vector_double data(sec_size + (l==4 ? 0 : 10));
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            data[k] = 100.0 + sin(0.01*k*(l+1)) + 0.1*l;
+        }
+        if (l%2 == 0) {
+            ch[l] = Section(data);
+        } else {
+            std::vector<float> samples(data.begin(), data.end());
+            ch[l] = Section(stfio::compactSamples(samples));
+        }
+    }
+    Recording rec(ch);
+    rec.SelectTrace(2, 0, 10);
+    EXPECT_THROW( rec.GetLiveAverage(0), std::out_of_range );
+    rec.SetLiveAverage(true);
+    EXPECT_EQ( rec.GetLiveAverage(0).GetN(), 1 );
+    for (std::size_t l = 3; l < n_sections; ++l) {
+        rec.SelectTrace(l, 0, 10);
+    }
+    rec.SelectTrace(0, 0, 10);
+    rec.UnselectTrace(5);
+    rec.UnselectTrace(2);
+    rec.SelectTrace(5, 0, 10);
+    EXPECT_THROW( rec.GetLiveAverage(1), std::out_of_range );
+
+    // The running average has to match an average over the whole selection:
+    const AverageAccumulator& live = rec.GetLiveAverage(0);
+    ASSERT_EQ( live.GetN(), rec.GetSelectedSections().size() );
+    // the shortest section that was ever selected limits the average:
+    ASSERT_EQ( live.size(), sec_size );
+    Section average(sec_size), sig(sec_size);
+    std::vector<int> shift(rec.GetSelectedSections().size(), 0);
+    rec.MakeAverage(average, sig, 0, rec.GetSelectedSections(), true, shift);
+    Vector_double sd(live.GetSD());
+    for (std::size_t k = 0; k < sec_size; ++k) {
+        EXPECT_NEAR( live.GetMean()[k], average[k], 1e-10 );
+        EXPECT_NEAR( sd[k], sig[k], 1e-10 );
+    }
+    // compactly stored sections are only decoded block-wise:
+    const Recording& crec = rec;
+    EXPECT_TRUE( crec[0][3].IsMapped() );
+
+    rec.ClearSelection();
+    EXPECT_EQ( rec.GetLiveAverage(0).GetN(), 0 );
+    EXPECT_EQ( rec.GetLiveAverage(0).size(), 0 );
+    AverageAccumulator empty;
+    EXPECT_THROW( empty.Remove(ch[0]), std::out_of_range );
+}
+
+TEST(Recording_test, selection)
+{
+    Recording rec(1, 6, 10);
+    for (std::size_t n_s = 0; n_s < rec[0].size(); ++n_s) {
+        for (std::size_t k = 0; k < rec[0][n_s].size(); ++k) {
+            rec[0][n_s][k] = (double)n_s;
+        }
+    }
+    EXPECT_TRUE( rec.SelectTrace(4, 0, 9) );
+    EXPECT_FALSE( rec.SelectTrace(4, 0, 9) );
+    EXPECT_THROW( rec.SelectTrace(6, 0, 9), std::out_of_range );
+
+    std::vector<std::size_t> batch;
+    batch.push_back(1); batch.push_back(4); batch.push_back(2); batch.push_back(1);
+    EXPECT_EQ( rec.SelectTraces(batch, 0, 9), 2 );
+    batch.push_back(6);
+    EXPECT_THROW( rec.SelectTraces(batch, 0, 9), std::out_of_range );
+
+    EXPECT_TRUE( rec.UnselectTrace(1) );
+    EXPECT_FALSE( rec.UnselectTrace(1) );
+    EXPECT_FALSE( rec.IsSelected(1) );
+    EXPECT_TRUE( rec.SelectTrace(1, 0, 9) );
+    EXPECT_FALSE( rec.UnselectTrace(5) );
+
+    // the order of selection is kept:
+    ASSERT_EQ( rec.GetSelectedSections().size(), 3 );
+    EXPECT_EQ( rec.GetSelectedSections()[0], 4 );
+    EXPECT_EQ( rec.GetSelectedSections()[1], 2 );
+    EXPECT_EQ( rec.GetSelectedSections()[2], 1 );
+    for (std::size_t n = 0; n < rec.GetSelectedSections().size(); ++n) {
+        EXPECT_DOUBLE_EQ( rec.GetSelectBase()[n], (double)rec.GetSelectedSections()[n] );
+    }
+
+    rec.InvertSelection(0, 9);
+    ASSERT_EQ( rec.GetSelectedSections().size(), 3 );
+    EXPECT_EQ( rec.GetSelectedSections()[0], 0 );
+    EXPECT_EQ( rec.GetSelectedSections()[1], 3 );
+    EXPECT_EQ( rec.GetSelectedSections()[2], 5 );
+    EXPECT_DOUBLE_EQ( rec.GetSelectBase()[2], 5.0 );
+    EXPECT_TRUE( rec.IsSelected(3) );
+    EXPECT_FALSE( rec.IsSelected(4) );
+
+    rec.ClearSelection();
+    EXPECT_TRUE( rec.GetSelectedSections().empty() );
+    EXPECT_FALSE( rec.IsSelected(0) );
+}
+
+TEST(Recording_test, view)
+{
+    std::deque<Channel> ch_list;
+    for (int n_c = 0; n_c < 3; ++n_c) {
+        std::deque<Section> sec_list(2, Section(Vector_double(100, (double)n_c)));
+        ch_list.push_back(Channel(sec_list));
+        ch_list.back().SetYUnits(n_c == 0 ? "mV" : "pA");
+    }
+    Recording rec(ch_list);
+    rec.SetXScale(0.1);
+    rec.SetXUnits("ms");
+
+    std::vector<std::size_t> order(2);
+    order[0] = 2; order[1] = 0;
+    RecordingView view(rec, order);
+    ASSERT_EQ( view.size(), 2 );
+    EXPECT_EQ( view[0][1][0], 2.0 );
+    EXPECT_EQ( view.at(1).GetYUnits(), "mV" );
+    EXPECT_EQ( view.GetChannelSize(0), 2 );
+    EXPECT_EQ( view.GetXUnits(), "ms" );
+    EXPECT_THROW( view.at(2), std::out_of_range );
+    order[1] = 3;
+    EXPECT_THROW( RecordingView(rec, order), std::out_of_range );
+
+    // selected channels are written without copying the recording:
+    const char* fName = "recording_test_view.h5";
+    stfio::StdoutProgressInfo progDlg("", "", 100, false);
+    ASSERT_TRUE( stfio::exportFile(fName, stfio::hdf5, view, progDlg) );
+    Recording result;
+    stfio::txtImportSettings txtImport;
+    ASSERT_TRUE( stfio::importFile(fName, stfio::hdf5, result, txtImport, progDlg) );
+    ASSERT_EQ( result.size(), 2 );
+    EXPECT_EQ( result[0][0][0], 2.0 );
+    EXPECT_EQ( result[1][0][0], 0.0 );
+    EXPECT_EQ( result[1].GetYUnits(), "mV" );
+    std::remove(fName);
+
+    Recording copy = view.Copy();
+    ASSERT_EQ( copy.size(), 2 );
+    EXPECT_EQ( copy[0][0][0], 2.0 );
+    EXPECT_EQ( copy.GetXUnits(), "ms" );
+}
+
+TEST(Recording_test, concatenate)
+{
+    Channel ch(4);
+    std::vector<short> adc(1000);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        for (std::size_t n = 0; n < adc.size(); ++n) {
+            adc[n] = (short)(n_s*1000 + n);
+        }
+        ch[n_s] = Section(stfio::compactSamples(adc));
+        ch[n_s].SetXScale(0.1);
+    }
+    // sections in memory can be mixed with encoded ones:
+    ch[3] = Section(ch[3].get());
+    ch[3].SetXScale(0.1);
+    Recording rec(ch);
+
+    std::vector<std::size_t> selected(3);
+    selected[0] = 3; selected[1] = 0; selected[2] = 2;
+    stfio::StdoutProgressInfo progDlg("", "", 100, false);
+    Recording result = stfio::concatenate(rec, selected, progDlg);
+    ASSERT_EQ( result.size(), 1 );
+    ASSERT_EQ( result[0].size(), 1 );
+    const Section& sec = result[0][0];
+    EXPECT_TRUE( sec.IsMapped() );
+    ASSERT_EQ( sec.size(), 3000 );
+    EXPECT_EQ( sec.GetXScale(), 0.1 );
+    for (std::size_t n = 0; n < sec.size(); n += 7) {
+        EXPECT_EQ( sec[n], rec[0][selected[n/1000]][n%1000] );
+    }
+
+    // writing to the source doesn't change the concatenation:
+    rec[0][0][0] = -1.0;
+    EXPECT_EQ( sec[1000], 0.0 );
+
+    rec[0][2].SetXScale(0.2);
+    EXPECT_THROW( stfio::concatenate(rec, selected, progDlg), std::runtime_error );
+}
+
+TEST(Recording_test, multiply)
+{
+    Channel ch(5);
+    std::vector<short> adc(50000);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        for (std::size_t n = 0; n < adc.size(); ++n) {
+            adc[n] = (short)(n%1000 - n_s);
+        }
+        ch[n_s] = Section(stfio::compactSamples(adc, 0.5));
+        ch[n_s].SetXScale(0.1);
+    }
+    ch[4] = Section(ch[4].get(), "in memory");
+    ch[4].SetXScale(0.1);
+    Recording rec(ch);
+    rec[0].SetYUnits("pA");
+    // non-const access would decode the mapped samples:
+    const Recording& crec = rec;
+
+    std::vector<std::size_t> selected(3);
+    selected[0] = 4; selected[1] = 1; selected[2] = 2;
+    for (int n_threads = 1; n_threads <= 4; n_threads += 3) {
+        Recording result = stfio::multiply(rec, selected, 0, -2.0, n_threads);
+        ASSERT_EQ( result.size(), 1 );
+        ASSERT_EQ( result[0].size(), 3 );
+        EXPECT_EQ( result[0].GetYUnits(), "pA" );
+        EXPECT_EQ( result[0][0].GetSectionDescription(), "in memory, multiplied" );
+        for (std::size_t n_s = 0; n_s < selected.size(); ++n_s) {
+            ASSERT_EQ( result[0][n_s].size(), adc.size() );
+            EXPECT_EQ( result[0][n_s].GetXScale(), 0.1 );
+            for (std::size_t n = 0; n < adc.size(); n += 123) {
+                EXPECT_EQ( result[0][n_s][n], -2.0*crec[0][selected[n_s]][n] );
+            }
+        }
+    }
+    // the source is left alone:
+    EXPECT_TRUE( crec[0][1].IsMapped() );
+
+    Section original(crec[0][1].get());
+    stfio::multiplyInPlace(rec, selected, 0, 4.0);
+    EXPECT_FALSE( crec[0][1].IsMapped() );
+    EXPECT_TRUE( crec[0][3].IsMapped() );
+    for (std::size_t n = 0; n < adc.size(); n += 123) {
+        EXPECT_EQ( rec[0][1][n], 4.0*original[n] );
+    }
+    stfio::multiplyInPlace(rec, selected, 0, 0.25, 2);
+    EXPECT_TRUE( rec[0][1].get() == original.get() );
+
+    EXPECT_THROW( stfio::multiply(rec, selected, 1, 2.0), std::out_of_range );
+    EXPECT_THROW( stfio::multiply(rec, std::vector<std::size_t>(), 0, 2.0), std::runtime_error );
+    selected[2] = 5;
+    EXPECT_THROW( stfio::multiplyInPlace(rec, selected, 0, 2.0), std::out_of_range );
+    selected[2] = 4;
+    EXPECT_THROW( stfio::multiplyInPlace(rec, selected, 0, 2.0), std::runtime_error );
+    EXPECT_EQ( rec[0][4][1], original[1] - 3*0.5 );
+}
+
+TEST(Recording_test, p_over_n)
+{
+    const int n_leak = 4;
+    const std::size_t n_points = 10000;
+    Channel ch(3*(n_leak+1)+2);
+    std::vector<short> adc(n_points);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        if (n_s == 1) {
+            // compactly stored leak pulse:
+            for (std::size_t n = 0; n < n_points; ++n) {
+                adc[n] = (short)(-(int)(n%300));
+            }
+            ch[n_s] = Section(stfio::compactSamples(adc, 0.25));
+            continue;
+        }
+        Vector_double data(n_points);
+        for (std::size_t n = 0; n < n_points; ++n) {
+            data[n] = sin(0.001*n*(n_s+1)) + n_s;
+        }
+        ch[n_s] = Section(data);
+        ch[n_s].SetXScale(0.1);
+    }
+    Recording rec(ch);
+
+    for (int sign = -1; sign <= 1; sign += 2) {
+        Channel result = rec.MakePoverN(0, sign*n_leak);
+        // incomplete groups are ignored:
+        ASSERT_EQ( result.size(), 3 );
+        for (std::size_t g = 0; g < result.size(); ++g) {
+            ASSERT_EQ( result[g].size(), n_points );
+            EXPECT_EQ( result[g].GetXScale(), 0.1 );
+            for (std::size_t n = 0; n < n_points; n += 97) {
+                double leak = 0;
+                for (int l = 1; l <= n_leak; ++l) {
+                    leak += rec[0][g*(n_leak+1)+l][n];
+                }
+                EXPECT_DOUBLE_EQ( result[g][n], rec[0][g*(n_leak+1)][n] - sign*leak );
+            }
+        }
+    }
+    EXPECT_THROW( rec.MakePoverN(1, n_leak), std::out_of_range );
+    EXPECT_THROW( rec.MakePoverN(0, 20), std::out_of_range );
+    EXPECT_THROW( rec.MakePoverN(0, 0), std::out_of_range );
+    rec[0][2].get_w().resize(10);
+    EXPECT_THROW( rec.MakePoverN(0, n_leak), std::out_of_range );
+}
@@ -0,0 +1,68 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/aligned.h"
+#include "../libstfio/scratch.h"
+#include <gtest/gtest.h>
+
+TEST(scratch_test, nested_scopes) {
+    stfio::scratchTrim();
+    double* outer = NULL;
+    {
+        stfio::ScratchScope scope;
+        EXPECT_TRUE( scope.Doubles(0) == NULL );
+        outer = scope.Doubles(100);
+        ASSERT_TRUE( outer != NULL );
+        EXPECT_TRUE( stfio::isAligned(outer) );
+        outer[99] = 1.0;
+        double* inner_first = NULL;
+        {
+            stfio::ScratchScope inner;
+            inner_first = inner.Doubles(10);
+            EXPECT_TRUE( stfio::isAligned(inner_first) );
+            EXPECT_GE( inner_first, outer + 100 );
+            // larger than a block:
+            char* large = inner.Array<char>(3*1024*1024);
+            ASSERT_TRUE( large != NULL );
+            large[3*1024*1024-1] = 'x';
+        }
+        // buffers of the inner scope are handed out again:
+        stfio::ScratchScope inner;
+        EXPECT_EQ( inner.Doubles(10), inner_first );
+        EXPECT_EQ( outer[99], 1.0 );
+    }
+    std::size_t capacity = stfio::scratchCapacity();
+    EXPECT_GE( capacity, (std::size_t)3*1024*1024 );
+    {
+        // memory is kept for later scopes:
+        stfio::ScratchScope scope;
+        EXPECT_EQ( scope.Doubles(100), outer );
+    }
+    EXPECT_EQ( stfio::scratchCapacity(), capacity );
+    stfio::scratchTrim();
+    EXPECT_EQ( stfio::scratchCapacity(), 0u );
+}
+
+TEST(scratch_test, threads) {
+    const int n_threads = 4;
+    std::vector<int> errors(n_threads, 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(n_threads)
+#endif
+    for (int n_t = 0; n_t < n_threads; ++n_t) {
+        for (int n_r = 0; n_r < 100; ++n_r) {
+            stfio::ScratchScope scope;
+            std::size_t n = 1000 + 1000*n_r;
+            double* buffer = scope.Doubles(n);
+            for (std::size_t k = 0; k < n; ++k) {
+                buffer[k] = n_t;
+            }
+            for (std::size_t k = 0; k < n; ++k) {
+                if (buffer[k] != n_t) {
+                    ++errors[n_t];
+                }
+            }
+        }
+    }
+    for (int n_t = 0; n_t < n_threads; ++n_t) {
+        EXPECT_EQ( errors[n_t], 0 );
+    }
+}
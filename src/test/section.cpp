@@ -1,5 +1,7 @@
 #include "../libstfio/stfio.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
 
 TEST(Section_test, constructors) {
     Section sec0;
@@ -22,3 +24,631 @@ TEST(Section_test, data_access) {
     EXPECT_EQ( sec2[sec2.size()-1], 0 );
     EXPECT_THROW( sec2.at( sec2.size() ), std::out_of_range );
 }
+
+TEST(Section_test, copy_on_write) {
+    Section sec(Vector_double(1000, 1.0), "Original");
+    Section copy(sec);
+    const Section& csec = sec;
+    const Section& ccopy = copy;
+    // copies share the data points:
+    EXPECT_EQ( &csec.get()[0], &ccopy.get()[0] );
+    Section assigned;
+    assigned = copy;
+    EXPECT_EQ( &assigned.get()[0], &csec.get()[0] );
+
+    // writing makes a private copy:
+    copy[10] = 2.0;
+    EXPECT_NE( &csec.get()[0], &ccopy.get()[0] );
+    EXPECT_EQ( csec[10], 1.0 );
+    EXPECT_EQ( ccopy[10], 2.0 );
+    EXPECT_EQ( assigned.get()[10], 1.0 );
+    assigned.get_w()[0] = 3.0;
+    EXPECT_EQ( csec[0], 1.0 );
+    assigned.resize(10);
+    EXPECT_EQ( assigned.size(), 10 );
+    EXPECT_EQ( csec.size(), 1000 );
+
+    // unshared data are written in place:
+    const double* before = &csec.get()[0];
+    sec[0] = 4.0;
+    EXPECT_EQ( &csec.get()[0], before );
+
+    // the samples are shared with chains, too:
+    stfio::MappedSamples samples = csec.GetSamples();
+    EXPECT_TRUE( samples.IsShared() );
+    EXPECT_EQ( samples.size(), 1000 );
+    EXPECT_EQ( samples[0], 4.0 );
+    Section view(samples);
+    EXPECT_TRUE( view.IsMapped() );
+    EXPECT_EQ( &view.get()[0], before );
+    sec[0] = 5.0;
+    EXPECT_EQ( view[0], 4.0 );
+
+#if (__cplusplus >= 201103)
+    Section moved(std::move(sec));
+    EXPECT_EQ( moved[0], 5.0 );
+    EXPECT_EQ( sec.size(), 0 );
+    EXPECT_TRUE( sec.get().empty() );
+    sec.resize(3);
+    EXPECT_EQ( sec.size(), 3 );
+#endif
+}
+
+TEST(Section_test, non_const_reads) {
+    Vector_double ramp(1000);
+    for (std::size_t n=0; n<ramp.size(); ++n) {
+        ramp[n] = (double)n;
+    }
+    Section sec(ramp);
+    Section copy(sec);
+    const stfio::MinMaxPyramid* pyramid = &copy.GetPyramid();
+    // reading through a non-const section neither detaches nor drops the caches:
+    double sum = 0;
+    for (std::size_t n=0; n<copy.size(); ++n) {
+        sum += copy[n];
+    }
+    sum += copy.at(999);
+    EXPECT_EQ( sum, 999.0*1000.0/2.0 + 999.0 );
+    EXPECT_TRUE( copy.SharesData(sec) );
+    EXPECT_EQ( &copy.GetPyramid(), pyramid );
+
+    // writing does both:
+    copy[5] += 1.0;
+    EXPECT_FALSE( copy.SharesData(sec) );
+    EXPECT_EQ( copy[5], 6.0 );
+    EXPECT_EQ( sec[5], 5.0 );
+    double min = 0, max = 0;
+    copy[7] = 2000.0;
+    copy.GetExtrema(0, copy.size(), min, max);
+    EXPECT_EQ( max, 2000.0 );
+    copy.at(8) = copy[9];
+    EXPECT_EQ( copy[8], 9.0 );
+    // so does taking the address of a data point:
+    Section other(sec);
+    double* first = &other[0];
+    EXPECT_FALSE( other.SharesData(sec) );
+    *first = -1.0;
+    other.GetExtrema(0, other.size(), min, max);
+    EXPECT_EQ( min, -1.0 );
+}
+
+TEST(Section_test, mapped_data) {
+    // Two interleaved int16 channels after a 10-byte header:
+    const char* fName = "section_test_mapped.bin";
+    std::FILE* fp = std::fopen(fName, "wb");
+    ASSERT_TRUE( fp != NULL );
+    char header[10] = {0};
+    std::fwrite(header, 1, sizeof(header), fp);
+    for (short n=0; n<1000; ++n) {
+        short samples[2] = { n, (short)-n };
+        std::fwrite(samples, sizeof(short), 2, fp);
+    }
+    std::fclose(fp);
+
+    {
+#if (__cplusplus < 201103)
+        boost::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(fName));
+#else
+        std::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(fName));
+#endif
+        EXPECT_EQ( file->GetSize(), 4010 );
+        EXPECT_THROW( stfio::MappedSamples(file, 14, 1000, 4, stfio::sample_int16),
+                      std::out_of_range );
+
+        Section sec(stfio::MappedSamples(file, 12, 1000, 4, stfio::sample_int16, 0.5, 1.0),
+                    "Mapped section");
+        EXPECT_TRUE( sec.IsMapped() );
+        EXPECT_EQ( sec.size(), 1000 );
+        const Section& csec = sec;
+        EXPECT_EQ( csec[999], -0.5*999+1.0 );
+        EXPECT_EQ( csec.at(10), -0.5*10+1.0 );
+        EXPECT_THROW( csec.at(1000), std::out_of_range );
+        EXPECT_TRUE( sec.IsMapped() );
+
+        // Copies share the mapping:
+        Section copy(sec);
+        EXPECT_EQ( copy.get().size(), 1000 );
+        EXPECT_FALSE( copy.IsMapped() );
+        EXPECT_TRUE( sec.IsMapped() );
+        for (std::size_t n=0; n<copy.size(); ++n) {
+            EXPECT_EQ( copy.get()[n], csec[n] );
+        }
+        sec[0] = 42.0;
+        EXPECT_FALSE( sec.IsMapped() );
+        EXPECT_EQ( sec[0], 42.0 );
+        EXPECT_EQ( sec[1], copy[1] );
+    }
+    std::remove(fName);
+    EXPECT_THROW( { stfio::MappedFile missing(fName); }, std::runtime_error );
+}
+
+TEST(Section_test, compact_data) {
+    Vector_float samples(1000);
+    for (std::size_t n=0; n<samples.size(); ++n) {
+        samples[n] = n/3.0f;
+    }
+    Section sec(stfio::compactSamples(samples), "Compact section");
+    EXPECT_TRUE( sec.IsMapped() );
+    EXPECT_EQ( sec.size(), 1000 );
+    const Section& csec = sec;
+    EXPECT_EQ( csec[999], (double)samples[999] );
+
+    std::vector<short> adc(3, 0);
+    adc[1] = -32768;
+    adc[2] = 32767;
+    Section sec16(stfio::compactSamples(adc, 2.0, 1.0));
+    EXPECT_EQ( sec16.get()[0], 1.0 );
+    EXPECT_EQ( sec16.get()[1], -65535.0 );
+    EXPECT_EQ( sec16.get()[2], 65535.0 );
+    EXPECT_FALSE( sec16.IsMapped() );
+}
+
+TEST(Section_test, concurrent_decode) {
+    std::vector<short> adc(100000);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        adc[n] = (short)(n % 2000) - 1000;
+    }
+    for (int pass=0; pass<20; ++pass) {
+        const Section sec(stfio::compactSamples(adc, 0.5));
+        const int n_threads = 8;
+        std::vector<const double*> decoded(n_threads, (const double*)NULL);
+        std::vector<double> mins(n_threads), maxs(n_threads), means(n_threads);
+        // every thread decodes the same const section and builds its caches:
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(n_threads)
+#endif
+        for (int n_t=0; n_t<n_threads; ++n_t) {
+            double var = 0;
+            decoded[n_t] = &sec.get()[0];
+            sec.GetExtrema(0, sec.size(), mins[n_t], maxs[n_t]);
+            means[n_t] = sec.GetMean(0, sec.size(), var);
+        }
+        for (int n_t=0; n_t<n_threads; ++n_t) {
+            EXPECT_EQ( decoded[n_t], decoded[0] );
+            EXPECT_EQ( mins[n_t], -500.0 );
+            EXPECT_EQ( maxs[n_t], 499.5 );
+            EXPECT_NEAR( means[n_t], -0.25, 1e-9 );
+        }
+        EXPECT_EQ( sec.get()[12345], 0.5*adc[12345] );
+        EXPECT_FALSE( sec.IsMapped() );
+    }
+}
+
+TEST(Section_test, external_data) {
+    // every other sample of memory that belongs to someone else:
+#if (__cplusplus < 201103)
+    boost::shared_ptr<std::vector<short> > external(new std::vector<short>(200));
+    boost::weak_ptr<void> alive(external);
+#else
+    std::shared_ptr<std::vector<short> > external(new std::vector<short>(200));
+    std::weak_ptr<void> alive(external);
+#endif
+    for (std::size_t n=0; n<external->size(); ++n) {
+        (*external)[n] = (short)(n%2 == 0 ? n : -1);
+    }
+    const char* data = (const char*)&(*external)[0];
+#if (__cplusplus < 201103)
+    boost::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(data, 400, external));
+#else
+    std::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(data, 400, external));
+#endif
+    external.reset();
+    EXPECT_FALSE( alive.expired() );
+
+    Section sec(stfio::MappedSamples(file, 0, 100, 4, stfio::sample_int16, 0.5, 1.0));
+    file.reset();
+    const Section& csec = sec;
+    EXPECT_TRUE( sec.IsMapped() );
+    EXPECT_EQ( csec[0], 1.0 );
+    EXPECT_EQ( csec[99], 0.5*198 + 1.0 );
+
+    // the memory is released with the last section that refers to it:
+    Section copy(sec);
+    sec = Section();
+    EXPECT_FALSE( alive.expired() );
+    copy = Section();
+    EXPECT_TRUE( alive.expired() );
+}
+
+TEST(Section_test, chained_data) {
+    std::vector<short> adc(100);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        adc[n] = (short)n;
+    }
+    Vector_double data(50, -1.0);
+    std::vector<stfio::MappedSamples> pieces;
+    pieces.push_back(stfio::compactSamples(adc, 2.0));
+    pieces.push_back(stfio::MappedSamples());
+    pieces.push_back(Section(data).GetSamples());
+    stfio::MappedSamples chain = stfio::chainSamples(pieces);
+    EXPECT_TRUE( chain.IsChained() );
+    EXPECT_FALSE( chain.IsFileBacked() );
+    EXPECT_EQ( chain.size(), 150 );
+
+    // chains of chains are flattened:
+    pieces.assign(2, chain);
+    Section sec(stfio::chainSamples(pieces), "Chained section");
+    EXPECT_TRUE( sec.IsMapped() );
+    ASSERT_EQ( sec.size(), 300 );
+    const Section& csec = sec;
+    EXPECT_EQ( csec[0], 0.0 );
+    EXPECT_EQ( csec[99], 198.0 );
+    EXPECT_EQ( csec[100], -1.0 );
+    EXPECT_EQ( csec[150], 0.0 );
+    EXPECT_EQ( csec[299], -1.0 );
+
+    // ranges across pieces:
+    Vector_double range(60);
+    csec.CopyRange(95, 155, &range[0]);
+    EXPECT_EQ( range[0], 190.0 );
+    EXPECT_EQ( range[5], -1.0 );
+    EXPECT_EQ( range[59], 8.0 );
+    EXPECT_THROW( csec.CopyRange(0, 301, &range[0]), std::out_of_range );
+
+    // the extrema don't decode the section as a whole:
+    double min, max;
+    csec.GetExtrema(0, 300, min, max);
+    EXPECT_EQ( min, -1.0 );
+    EXPECT_EQ( max, 198.0 );
+    EXPECT_TRUE( sec.IsMapped() );
+
+    // get() decodes the samples until they're released:
+    EXPECT_EQ( csec.get()[160], 20.0 );
+    EXPECT_FALSE( sec.IsMapped() );
+    sec.Release();
+    EXPECT_TRUE( sec.IsMapped() );
+    sec[0] = 42.0;
+    EXPECT_FALSE( sec.IsMapped() );
+    EXPECT_EQ( sec[0], 42.0 );
+    EXPECT_EQ( sec[299], -1.0 );
+}
+
+TEST(Section_test, sliced_data) {
+    Vector_double data(1000);
+    for (std::size_t n=0; n<data.size(); ++n) {
+        data[n] = n/2.0;
+    }
+    Section source(data);
+
+    // slices of samples in memory refer to the data of the section:
+    Section slice(stfio::sliceSamples(source.GetSamples(), 100, 50));
+    ASSERT_EQ( slice.size(), 50 );
+    EXPECT_TRUE( slice.IsMapped() );
+    EXPECT_EQ( slice.GetSpan(), source.GetSpan()+100 );
+    const Section& cslice = slice;
+    EXPECT_EQ( cslice[0], 50.0 );
+    EXPECT_EQ( cslice[49], 74.5 );
+    EXPECT_THROW( stfio::sliceSamples(source.GetSamples(), 990, 11), std::out_of_range );
+
+    // writing to the section doesn't change the slice:
+    source[100] = -1.0;
+    EXPECT_EQ( cslice[0], 50.0 );
+
+    // slices of chains keep the overlapping pieces only:
+    std::vector<short> adc(100);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        adc[n] = (short)n;
+    }
+    std::vector<stfio::MappedSamples> pieces;
+    pieces.push_back(stfio::compactSamples(adc));
+    pieces.push_back(slice.GetSamples());
+    pieces.push_back(stfio::compactSamples(adc, 2.0));
+    stfio::MappedSamples chain = stfio::chainSamples(pieces);
+    stfio::MappedSamples inner = stfio::sliceSamples(chain, 110, 30);
+    EXPECT_FALSE( inner.IsChained() );
+    EXPECT_EQ( inner[0], 55.0 );
+    Section across(stfio::sliceSamples(chain, 90, 80));
+    ASSERT_EQ( across.size(), 80 );
+    const Section& cacross = across;
+    EXPECT_EQ( cacross[0], 90.0 );
+    EXPECT_EQ( cacross[10], 50.0 );
+    EXPECT_EQ( cacross[79], 38.0 );
+    EXPECT_EQ( stfio::sliceSamples(chain, 200, 0).size(), 0 );
+}
+
+TEST(Section_test, decode_samples) {
+    // big-endian samples as written by a foreign host:
+    short raw16[3] = { 1, -2, 300 };
+    double raw64[2] = { 0.25, -1.5e3 };
+    char swapped16[sizeof(raw16)], swapped64[sizeof(raw64)];
+    for (std::size_t n=0; n<3; ++n) {
+        const char* p = (const char*)&raw16[n];
+        swapped16[2*n] = p[1];
+        swapped16[2*n+1] = p[0];
+    }
+    for (std::size_t n=0; n<2; ++n) {
+        const char* p = (const char*)&raw64[n];
+        for (std::size_t k=0; k<8; ++k) {
+            swapped64[8*n+k] = p[7-k];
+        }
+    }
+    double dest[3];
+    stfio::decodeSamples(swapped16, 3, 2, stfio::sample_int16, true, 2.0, 1.0, dest);
+    EXPECT_EQ( dest[0], 3.0 );
+    EXPECT_EQ( dest[1], -3.0 );
+    EXPECT_EQ( dest[2], 601.0 );
+    stfio::decodeSamples(swapped64, 2, 8, stfio::sample_float64, true, 1.0, 0.0, dest);
+    EXPECT_EQ( dest[0], 0.25 );
+    EXPECT_EQ( dest[1], -1.5e3 );
+    // every other sample, native byte order:
+    stfio::decodeSamples((const char*)raw16, 2, 4, stfio::sample_int16, false, 1.0, 0.0, dest);
+    EXPECT_EQ( dest[0], 1.0 );
+    EXPECT_EQ( dest[1], 300.0 );
+    EXPECT_EQ( stfio::sampleSize(stfio::sample_float32), 4 );
+}
+
+TEST(Section_test, extrema) {
+    Section sec(100000, "Extrema");
+    for (std::size_t n=0; n<sec.size(); ++n) {
+        sec[n] = sin(n*0.001) + 0.1*sin(n*1.7) + (n%977==0 ? 3.0 : 0.0);
+    }
+    const Section& csec = sec;
+    std::size_t ranges[][2] = { {0, 1}, {0, 100000}, {5, 21}, {16, 32}, {15, 33},
+                                {123, 4567}, {999, 65536}, {65535, 99999} };
+    for (std::size_t r=0; r<sizeof(ranges)/sizeof(ranges[0]); ++r) {
+        double min, max;
+        csec.GetExtrema(ranges[r][0], ranges[r][1], min, max);
+        EXPECT_EQ( min, *std::min_element(csec.get().begin()+ranges[r][0], csec.get().begin()+ranges[r][1]) );
+        EXPECT_EQ( max, *std::max_element(csec.get().begin()+ranges[r][0], csec.get().begin()+ranges[r][1]) );
+    }
+    double dummy;
+    EXPECT_THROW( csec.GetExtrema(10, 10, dummy, dummy), std::out_of_range );
+    EXPECT_THROW( csec.GetExtrema(0, sec.size()+1, dummy, dummy), std::out_of_range );
+
+    // Writing discards the cached extrema:
+    double min, max;
+    sec[50000] = 10.0;
+    csec.GetExtrema(0, sec.size(), min, max);
+    EXPECT_EQ( max, 10.0 );
+    sec.get_w()[50000] = -10.0;
+    csec.GetExtrema(40000, 60000, min, max);
+    EXPECT_EQ( min, -10.0 );
+    sec.get_w()[3] = -20.0;
+    csec.GetExtrema(0, sec.size(), min, max);
+    EXPECT_EQ( min, -20.0 );
+    EXPECT_EQ( max, *std::max_element(csec.get().begin(), csec.get().end()) );
+
+    // The extrema of all points agree with those of the whole range,
+    // also when the pyramid grows:
+    Vector_double data(csec.get());
+    stfio::MinMaxPyramid whole(data), growing;
+    EXPECT_FALSE( growing.Total(min, max) );
+    for (std::size_t pos = 0; pos < data.size(); pos += 3001) {
+        growing.Extend(&data[pos], std::min<std::size_t>(3001, data.size()-pos));
+    }
+    double total_min, total_max;
+    whole.Extrema(data, 0, data.size(), min, max);
+    ASSERT_TRUE( whole.Total(total_min, total_max) );
+    EXPECT_EQ( total_min, min );
+    EXPECT_EQ( total_max, max );
+    ASSERT_TRUE( growing.Total(total_min, total_max) );
+    EXPECT_EQ( total_min, min );
+    EXPECT_EQ( total_max, max );
+    // NaN points are ignored:
+    data[777] = NAN;
+    ASSERT_TRUE( stfio::MinMaxPyramid(data).Total(total_min, total_max) );
+    EXPECT_EQ( total_min, -20.0 );
+    EXPECT_EQ( total_max, max );
+    std::vector<float> few(data.begin(), data.begin()+10);
+    Section compact(stfio::compactSamples(few));
+    compact.GetExtrema(0, compact.size(), min, max);
+    EXPECT_EQ( min, *std::min_element(few.begin(), few.end()) );
+    EXPECT_EQ( max, *std::max_element(few.begin(), few.end()) );
+}
+
+TEST(Section_test, decimate) {
+    Section sec(10007, "Decimate");
+    for (std::size_t n=0; n<sec.size(); ++n) {
+        sec[n] = sin(n*0.01) + 0.1*sin(n*1.7);
+    }
+    const Section& csec = sec;
+    std::vector<std::size_t> columns;
+    Vector_double values;
+    csec.Decimate(7, 10007, 600, columns, values);
+    ASSERT_EQ( columns.size(), values.size() );
+    ASSERT_EQ( values.size(), 4*600 );
+    // every point lies within the extrema of its column:
+    for (std::size_t n=7; n<10007; ++n) {
+        std::size_t col = (n-7)*600/10000;
+        EXPECT_GE( csec[n], values[4*col+1] );
+        EXPECT_LE( csec[n], values[4*col+2] );
+    }
+    EXPECT_EQ( columns[4*599], 599 );
+    EXPECT_EQ( values[0], csec[7] );
+    EXPECT_EQ( values.back(), csec[10006] );
+
+    // columns with single points aren't padded:
+    csec.Decimate(0, 10, 20, columns, values);
+    ASSERT_EQ( values.size(), 10 );
+    EXPECT_EQ( columns[9], 18 );
+    EXPECT_EQ( values[9], csec[9] );
+    EXPECT_THROW( csec.Decimate(0, 10, 0, columns, values), std::out_of_range );
+}
+
+TEST(Section_test, vector_arithmetic) {
+    Vector_double a(5), b(5);
+    for (std::size_t n=0; n<a.size(); ++n) {
+        a[n] = n+1.0;
+        b[n] = 2.0*n;
+    }
+    Vector_double out;
+    stfio::vec_vec_minus(a, b, out);
+    EXPECT_EQ( out, stfio::vec_vec_minus(a, b) );
+    EXPECT_EQ( out[4], -3.0 );
+
+    // in place:
+    Vector_double c(a);
+    stfio::vec_scal_mul(c, 3.0, c);
+    EXPECT_EQ( c, stfio::vec_scal_mul(a, 3.0) );
+    stfio::vec_vec_plus(c, b, c);
+    EXPECT_EQ( c[2], 13.0 );
+
+    c = a;
+    stfio::scale_offset_inplace(c, 2.0, -1.0);
+    EXPECT_EQ( c[4], 9.0 );
+    stfio::offset_scale_inplace(c, 1.0, 0.5);
+    EXPECT_EQ( c, a );
+
+    EXPECT_THROW( stfio::vec_vec_mul(a, Vector_double(4), out), std::out_of_range );
+}
+
+TEST(Section_test, section_cache) {
+    const char* fName = "section_test_cache.bin";
+    std::FILE* fp = std::fopen(fName, "wb");
+    ASSERT_TRUE( fp != NULL );
+    for (short n=0; n<1000; ++n) {
+        std::fwrite(&n, sizeof(short), 1, fp);
+    }
+    std::fclose(fp);
+
+    std::size_t budget = stfio::getSectionCacheBudget();
+    {
+        // two documents opening the same file:
+#if (__cplusplus < 201103)
+        boost::shared_ptr<stfio::MappedFile> file1(new stfio::MappedFile(fName));
+        boost::shared_ptr<stfio::MappedFile> file2(new stfio::MappedFile(fName));
+#else
+        std::shared_ptr<stfio::MappedFile> file1(new stfio::MappedFile(fName));
+        std::shared_ptr<stfio::MappedFile> file2(new stfio::MappedFile(fName));
+#endif
+        Section sec1(stfio::MappedSamples(file1, 0, 1000, 2, stfio::sample_int16, 0.5));
+        Section sec2(stfio::MappedSamples(file2, 0, 1000, 2, stfio::sample_int16, 0.5));
+        std::size_t size0 = stfio::getSectionCacheSize();
+        EXPECT_EQ( sec1.get()[999], 499.5 );
+        EXPECT_EQ( stfio::getSectionCacheSize(), size0 + 1000*sizeof(double) );
+        // hits are shared, not copied:
+        EXPECT_EQ( &sec1.get()[0], &sec2.get()[0] );
+        EXPECT_EQ( stfio::getSectionCacheSize(), size0 + 1000*sizeof(double) );
+
+        // writing makes a private copy:
+        sec2[0] = 42.0;
+        EXPECT_EQ( sec1.get()[0], 0.0 );
+        EXPECT_NE( &sec1.get()[0], &sec2.get()[0] );
+
+        // released samples are fetched from the cache again:
+        const double* cached = &sec1.get()[0];
+        sec1.Release();
+        EXPECT_TRUE( sec1.IsMapped() );
+        EXPECT_EQ( &sec1.get()[0], cached );
+
+        // shared samples outlive the section's share:
+        {
+            stfio::DecodedSamples shared = sec1.GetDecoded();
+            ASSERT_TRUE( shared.get() != NULL );
+            EXPECT_EQ( &(*shared)[0], cached );
+            sec1.Release();
+            EXPECT_EQ( (*shared)[999], 499.5 );
+            EXPECT_TRUE( sec2.GetDecoded().get() == NULL );
+        }
+
+        stfio::setSectionCacheBudget(0);
+        EXPECT_EQ( stfio::getSectionCacheSize(), 0 );
+        // still valid while in use:
+        EXPECT_EQ( sec1.get()[999], 499.5 );
+        stfio::setSectionCacheBudget(budget);
+        sec1.Release();
+        EXPECT_EQ( sec1.get()[999], 499.5 );
+        EXPECT_GT( stfio::getSectionCacheSize(), 0 );
+    }
+    // closing the file drops its samples:
+    EXPECT_EQ( stfio::getSectionCacheSize(), 0 );
+    std::remove(fName);
+}
+
+TEST(Section_test, range_mean) {
+    Section sec(50000, "Mean");
+    for (std::size_t n=0; n<sec.size(); ++n) {
+        sec[n] = -70.0 + sin(n*0.01) + 0.1*((n*7919)%41);
+    }
+    const Section& csec = sec;
+    std::size_t ranges[][2] = { {0, 1}, {0, 50000}, {5, 21}, {123, 4567}, {40000, 49999} };
+    for (std::size_t r=0; r<sizeof(ranges)/sizeof(ranges[0]); ++r) {
+        std::size_t begin = ranges[r][0], end = ranges[r][1];
+        double mean = 0.0;
+        for (std::size_t n=begin; n<end; ++n) mean += csec[n];
+        mean /= (end-begin);
+        double var = 0.0;
+        for (std::size_t n=begin; n<end; ++n) var += (csec[n]-mean)*(csec[n]-mean);
+        if (end-begin > 1) var /= (end-begin-1);
+        double fastVar;
+        EXPECT_NEAR( csec.GetMean(begin, end, fastVar), mean, 1e-9 );
+        EXPECT_NEAR( fastVar, var, 1e-9 );
+    }
+    double dummy;
+    EXPECT_THROW( csec.GetMean(10, 10, dummy), std::out_of_range );
+    EXPECT_THROW( csec.GetMean(0, sec.size()+1, dummy), std::out_of_range );
+
+    // Writing discards the cached sums:
+    csec.GetMean(0, 10, dummy);
+    sec.get_w()[5] += 10.0;
+    double before = csec.GetMean(0, 10, dummy);
+    sec[6] += 10.0;
+    EXPECT_NEAR( csec.GetMean(0, 10, dummy), before+1.0, 1e-9 );
+}
+
+TEST(Section_test, prefetch) {
+    const char* fName = "section_test_prefetch.bin";
+    std::FILE* fp = std::fopen(fName, "wb");
+    ASSERT_TRUE( fp != NULL );
+    for (short n=0; n<5000; ++n) {
+        short value = (n*37) % 1000;
+        std::fwrite(&value, sizeof(short), 1, fp);
+    }
+    std::fclose(fp);
+    {
+#if (__cplusplus < 201103)
+        boost::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(fName));
+#else
+        std::shared_ptr<stfio::MappedFile> file(new stfio::MappedFile(fName));
+#endif
+        Section sec(stfio::MappedSamples(file, 0, 5000, 2, stfio::sample_int16, 0.5));
+
+        // a copy is prepared, e.g. on another thread, and handed back:
+        Section copy(sec);
+        copy.Prepare();
+        EXPECT_FALSE( copy.IsMapped() );
+        EXPECT_TRUE( sec.IsMapped() );
+        EXPECT_TRUE( sec.SharesData(copy) );
+        EXPECT_TRUE( sec.AdoptCaches(copy) );
+        EXPECT_FALSE( sec.IsMapped() );
+        EXPECT_EQ( &sec.get()[0], &copy.get()[0] );
+        EXPECT_EQ( &sec.GetPyramid(), &copy.GetPyramid() );
+        double min, max;
+        sec.GetExtrema(0, sec.size(), min, max);
+        EXPECT_EQ( min, 0.0 );
+        EXPECT_EQ( max, 499.5 );
+
+        // nothing is taken over once either section has been written to:
+        Section modified(sec);
+        modified.Release();
+        modified.Prepare();
+        modified[0] = 42.0;
+        Section released(sec);
+        released.Release();
+        EXPECT_FALSE( released.SharesData(modified) );
+        EXPECT_FALSE( released.AdoptCaches(modified) );
+        const Section& creleased = released;
+        EXPECT_TRUE( creleased.IsMapped() );
+        EXPECT_EQ( creleased[0], 0.0 );
+    }
+    std::remove(fName);
+
+    // sections in memory:
+    Section sec(Vector_double(100, 1.0));
+    Section copy(sec);
+    copy.Prepare();
+    EXPECT_TRUE( sec.AdoptCaches(copy) );
+    EXPECT_EQ( &sec.GetPyramid(), &copy.GetPyramid() );
+    sec[0] = 2.0;
+    EXPECT_FALSE( sec.SharesData(copy) );
+    EXPECT_FALSE( sec.AdoptCaches(copy) );
+
+    // compact samples stay compact:
+    std::vector<short> adc(100, 3);
+    Section compact(stfio::compactSamples(adc));
+    Section compactCopy(compact);
+    compactCopy.Prepare();
+    EXPECT_TRUE( compactCopy.IsMapped() );
+    EXPECT_TRUE( compact.AdoptCaches(compactCopy) );
+    EXPECT_EQ( &compact.GetPyramid(), &compactCopy.GetPyramid() );
+}
@@ -0,0 +1,90 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/sharedrecording.h"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+// A name that other test runs don't use at the same time:
+std::string sharedName() {
+    std::ostringstream name;
+#ifdef _WIN32
+    name << "stfio_test";
+#else
+    name << "stfio_test_" << getpid();
+#endif
+    return name.str();
+}
+
+}
+
+TEST(SharedRecording_test, attach) {
+    Recording rec(2, 3, 0);
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            Vector_double data(100 + 10*n_s);
+            for (std::size_t n = 0; n < data.size(); ++n) {
+                data[n] = 1000.0*n_c + 100.0*n_s + n;
+            }
+            rec[n_c].InsertSection(Section(data, "sweep"), n_s);
+        }
+        rec[n_c].SetChannelName(n_c == 0 ? "Im" : "Vm");
+        rec[n_c].SetYUnits(n_c == 0 ? "pA" : "mV");
+    }
+    // compactly stored samples are decoded into the shared memory:
+    std::vector<short> adc(50, 4);
+    rec[1].InsertSection(Section(stfio::compactSamples(adc, 0.5, 1.0)), 2);
+    rec.SetXScale(0.05);
+    rec.SetXUnits("ms");
+    rec.SetComment("comment");
+
+    std::string name = sharedName();
+    Recording attached;
+    {
+        stfio::SharedRecording shared(rec, name);
+        EXPECT_EQ( shared.GetName(), name );
+        EXPECT_GT( shared.GetSize(), 6*100*sizeof(double) );
+        // names can't be used twice:
+        EXPECT_THROW( stfio::SharedRecording(rec, name), std::runtime_error );
+
+        ASSERT_TRUE( stfio::attachRecording(name, attached) );
+    }
+    // the data stay available after the name has been removed:
+    Recording late;
+    EXPECT_FALSE( stfio::attachRecording(name, late) );
+    EXPECT_EQ( late.size(), 0 );
+
+    ASSERT_EQ( attached.size(), 2 );
+    EXPECT_DOUBLE_EQ( attached.GetXScale(), 0.05 );
+    EXPECT_EQ( attached.GetXUnits(), "ms" );
+    EXPECT_EQ( attached.GetComment(), "comment" );
+    EXPECT_EQ( attached[1].GetChannelName(), "Vm" );
+    EXPECT_EQ( attached[1].GetYUnits(), "mV" );
+    for (std::size_t n_c = 0; n_c < attached.size(); ++n_c) {
+        ASSERT_EQ( attached[n_c].size(), 3 );
+        for (std::size_t n_s = 0; n_s < attached[n_c].size(); ++n_s) {
+            const Section& sec = attached[n_c][n_s];
+            EXPECT_TRUE( sec.IsMapped() );
+            // the data points are read in place:
+            ASSERT_TRUE( sec.GetSpan() != NULL );
+            ASSERT_EQ( sec.size(), rec[n_c][n_s].size() );
+            for (std::size_t n = 0; n < sec.size(); ++n) {
+                EXPECT_EQ( sec.GetSpan()[n], rec[n_c][n_s][n] );
+            }
+        }
+    }
+    EXPECT_EQ( attached[0][1].GetSectionDescription(), "sweep" );
+    EXPECT_EQ( attached[1][2][0], 3.0 );
+
+    // writing makes a private copy:
+    attached[0][0][0] = -1.0;
+    EXPECT_EQ( attached[0][0][0], -1.0 );
+    EXPECT_FALSE( attached[0][0].IsMapped() );
+
+    EXPECT_FALSE( stfio::attachRecording("stfio_test_missing", late) );
+}
@@ -0,0 +1,142 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/sidecar.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool fileExists(const std::string& fName) {
+    return std::ifstream(fName.c_str()).good();
+}
+
+}
+
+TEST(sidecar_test, mapped_samples) {
+    // raw 16-bit samples of two interleaved channels:
+    const char* fName = "sidecar_test.raw";
+    std::vector<short> raw(2000);
+    for (std::size_t n = 0; n < raw.size(); ++n) {
+        raw[n] = (short)(n%2 == 0 ? n : -(int)n);
+    }
+    {
+        std::ofstream file(fName, std::ios::binary);
+        file.write((const char*)&raw[0], raw.size()*sizeof(short));
+    }
+#if (__cplusplus < 201103)
+    boost::shared_ptr<stfio::MappedFile> mapped(new stfio::MappedFile(fName));
+#else
+    std::shared_ptr<stfio::MappedFile> mapped(new stfio::MappedFile(fName));
+#endif
+    Recording rec(2, 1, 0);
+    for (std::size_t n_c = 0; n_c < 2; ++n_c) {
+        // the first channel is chained from two pieces:
+        std::vector<stfio::MappedSamples> pieces;
+        pieces.push_back(stfio::MappedSamples(mapped, n_c*2, 400, 4, stfio::sample_int16, 0.5, 1.0));
+        pieces.push_back(stfio::MappedSamples(mapped, n_c*2 + 800*2, 600, 4, stfio::sample_int16, 0.5, 1.0));
+        rec[n_c].InsertSection(Section(n_c == 0 ? stfio::chainSamples(pieces) : pieces[1], "sweep"), 0);
+        rec[n_c].SetChannelName(n_c == 0 ? "Im" : "Vm");
+        rec[n_c].SetYUnits(n_c == 0 ? "pA" : "mV");
+    }
+    rec.SetXScale(0.1);
+    rec.SetComment("comment");
+
+    std::vector<stfio::SampleLayout> layout;
+    EXPECT_TRUE( rec[0][0].GetSamples().GetLayout(fName, layout) );
+    ASSERT_EQ( layout.size(), 2 );
+    EXPECT_EQ( layout[1].offset, 1600 );
+    EXPECT_FALSE( rec[0][0].GetSamples().GetLayout("other.raw", layout) );
+
+    stfio::exportSidecar(fName, rec);
+    // only the layout is stored:
+    std::ifstream index(stfio::sidecarName(fName).c_str(), std::ios::binary | std::ios::ate);
+    EXPECT_LT( (std::size_t)index.tellg(), raw.size()*sizeof(short) );
+    index.close();
+
+    Recording reopened;
+    ASSERT_TRUE( stfio::importSidecar(fName, reopened) );
+    ASSERT_EQ( reopened.size(), 2 );
+    EXPECT_EQ( reopened[1].GetChannelName(), "Vm" );
+    EXPECT_EQ( reopened[1].GetYUnits(), "mV" );
+    EXPECT_EQ( reopened.GetComment(), "comment" );
+    EXPECT_DOUBLE_EQ( reopened.GetXScale(), 0.1 );
+    for (std::size_t n_c = 0; n_c < 2; ++n_c) {
+        ASSERT_EQ( reopened[n_c].size(), 1 );
+        EXPECT_TRUE( reopened[n_c][0].IsMapped() );
+        EXPECT_EQ( reopened[n_c][0].GetSectionDescription(), "sweep" );
+        ASSERT_EQ( reopened[n_c][0].size(), rec[n_c][0].size() );
+        for (std::size_t n = 0; n < rec[n_c][0].size(); ++n) {
+            EXPECT_EQ( reopened[n_c][0][n], rec[n_c][0][n] );
+        }
+    }
+
+    // the index no longer matches once the file has changed:
+    mapped.reset();
+    reopened = Recording();
+    rec = Recording();
+    {
+        std::ofstream file(fName, std::ios::binary | std::ios::app);
+        file << "more";
+    }
+    Recording changed;
+    EXPECT_FALSE( stfio::importSidecar(fName, changed) );
+    EXPECT_EQ( changed.size(), 0 );
+    std::remove(stfio::sidecarName(fName).c_str());
+    std::remove(fName);
+}
+
+TEST(sidecar_test, import_file) {
+    const char* fName = "sidecar_test.h5";
+    Recording rec(2, 3, 100);
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            for (std::size_t n = 0; n < rec[n_c][n_s].size(); ++n) {
+                rec[n_c][n_s][n] = 1000.0*n_c + 100.0*n_s + n;
+            }
+        }
+        rec[n_c].SetChannelName(n_c == 0 ? "Im" : "Vm");
+    }
+    rec.SetXScale(0.05);
+    stftest::NullProgressInfo progDlg;
+    ASSERT_TRUE( stfio::exportFile(fName, stfio::hdf5, RecordingView(rec), progDlg) );
+
+    // without sidecar indices, nothing is written next to the file:
+    Recording imported;
+    ASSERT_TRUE( stfio::importFile(fName, stfio::hdf5, imported, stfio::txtImportSettings(), progDlg) );
+    EXPECT_FALSE( fileExists(stfio::sidecarName(fName)) );
+
+    stfio::setSidecarIndex(true);
+    Recording first;
+    ASSERT_TRUE( stfio::importFile(fName, stfio::hdf5, first, stfio::txtImportSettings(), progDlg) );
+    EXPECT_TRUE( fileExists(stfio::sidecarName(fName)) );
+    EXPECT_FALSE( first[0][0].IsMapped() );
+
+    // samples that were decoded on import are mapped from the index:
+    Recording second;
+    ASSERT_TRUE( stfio::importFile(fName, stfio::hdf5, second, stfio::txtImportSettings(), progDlg) );
+    stfio::setSidecarIndex(false);
+    ASSERT_EQ( second.size(), 2 );
+    EXPECT_EQ( second[1].GetChannelName(), "Vm" );
+    EXPECT_DOUBLE_EQ( second.GetXScale(), 0.05 );
+    for (std::size_t n_c = 0; n_c < second.size(); ++n_c) {
+        ASSERT_EQ( second[n_c].size(), 3 );
+        for (std::size_t n_s = 0; n_s < second[n_c].size(); ++n_s) {
+            EXPECT_TRUE( second[n_c][n_s].IsMapped() );
+            EXPECT_EQ( second[n_c][n_s].get(), first[n_c][n_s].get() );
+        }
+    }
+    second = Recording();
+
+    // a damaged index is ignored:
+    {
+        std::ofstream index(stfio::sidecarName(fName).c_str(), std::ios::binary);
+        index << "STFIDX01";
+    }
+    Recording damaged;
+    EXPECT_FALSE( stfio::importSidecar(fName, damaged) );
+    std::remove(stfio::sidecarName(fName).c_str());
+    std::remove(fName);
+}
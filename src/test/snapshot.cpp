@@ -0,0 +1,54 @@
+#include "../libstfio/snapshot.h"
+#include "../libstfio/recording.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(Snapshot_test, sections) {
+    Recording data(2, 5, 50);
+    for (std::size_t n = 0; n < 50; ++n) {
+        data[1][3][n] = (double)n;
+    }
+    std::vector<std::size_t> sections;
+    sections.push_back(3);
+    sections.push_back(0);
+    stfio::Snapshot snapshot(data, 7, 1, sections);
+    EXPECT_EQ( snapshot.GetEpoch(), 7u );
+    EXPECT_EQ( snapshot.size(), 1u );
+    EXPECT_EQ( snapshot.GetChannelIndex(0), 1u );
+    ASSERT_EQ( snapshot[0].size(), 2u );
+    EXPECT_TRUE( snapshot[0][0].SharesData(data[1][3]) );
+    EXPECT_TRUE( snapshot.Unchanged(data) );
+
+    // writing to a section of the recording leaves the snapshot as it was:
+    data[1][3][10] = -1.0;
+    EXPECT_EQ( snapshot[0][0][10], 10.0 );
+    EXPECT_FALSE( snapshot.Unchanged(data) );
+
+    // sections that aren't in the snapshot may be modified:
+    stfio::Snapshot other(data, 8, 1, sections);
+    data[1][1][0] = 1.0;
+    data[0][3][0] = 1.0;
+    EXPECT_TRUE( other.Unchanged(data) );
+    data[1].resize(2);
+    EXPECT_FALSE( other.Unchanged(data) );
+
+    EXPECT_THROW( stfio::Snapshot(data, 0, 2, sections), std::out_of_range );
+    EXPECT_THROW( stfio::Snapshot(data, 0, 1, sections), std::out_of_range );
+}
+
+TEST(Snapshot_test, recording) {
+    Recording data(3, 4, 20);
+    data.SetXScale(0.05);
+    stfio::Snapshot snapshot(data, 1);
+    EXPECT_EQ( snapshot.size(), 3u );
+    EXPECT_EQ( snapshot.GetXScale(), 0.05 );
+    EXPECT_EQ( snapshot.GetSectionIndices(2).size(), 4u );
+    EXPECT_TRUE( snapshot.Unchanged(data) );
+
+    // replacing a section is detected as well:
+    Section replacement(data[2][1]);
+    replacement[0] = 3.0;
+    data[2][1] = replacement;
+    EXPECT_FALSE( snapshot.Unchanged(data) );
+    EXPECT_EQ( snapshot[2][1][0], 0.0 );
+}
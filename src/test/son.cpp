@@ -0,0 +1,172 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/son/sonlib.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Assembles a version 6 SON file in host (little-endian) byte order:
+class Writer {
+public:
+    explicit Writer(short n_channels) : contents(512 + 140*n_channels, '\0') {
+        put<short>(0, 6);
+        put<short>(20, 10);   // us per tick
+        put<short>(22, 1);
+        put<short>(30, n_channels);
+        put<double>(44, 1e-6);
+        putString(112, "first comment", 80);
+        put<unsigned char>(53, 30);  // date and time
+        put<unsigned char>(54, 12);
+        put<unsigned char>(55, 8);
+        put<unsigned char>(56, 15);
+        put<unsigned char>(57, 6);
+        put<unsigned short>(58, 2009);
+    }
+
+    template <typename T>
+    void put(std::size_t offset, T value) { memcpy(&contents[offset], &value, sizeof(T)); }
+    void putString(std::size_t offset, const std::string& str, std::size_t size) {
+        contents[offset] = (char)str.size();
+        memcpy(&contents[offset+1], str.data(), std::min(str.size(), size-1));
+    }
+
+    void Channel(short n_c, unsigned char kind, int divide, const std::string& title,
+                 const std::string& units, float scale = 1, float offset = 0)
+    {
+        std::size_t header = 512 + 140*n_c;
+        put<int>(header+2, -1);
+        put<int>(header+6, -1);
+        put<int>(header+102, divide);
+        putString(header+108, title, 10);
+        contents[header+122] = (char)kind;
+        put<float>(header+124, scale);
+        put<float>(header+128, offset);
+        putString(header+132, units, 6);
+        last[n_c] = -1;
+    }
+
+    // Appends a data block to the chain of a channel:
+    template <typename T>
+    void Block(short n_c, int start, int divide, const std::vector<T>& samples) {
+        int pos = (int)contents.size();
+        contents.resize(contents.size() + 20 + samples.size()*sizeof(T));
+        put<int>(pos, last[n_c]);
+        put<int>(pos+4, -1);
+        put<int>(pos+8, start);
+        put<int>(pos+12, start + divide*((int)samples.size()-1));
+        put<short>(pos+16, n_c+1);
+        put<unsigned short>(pos+18, (unsigned short)samples.size());
+        memcpy(&contents[pos+20], &samples[0], samples.size()*sizeof(T));
+        std::size_t header = 512 + 140*n_c;
+        if (last[n_c] == -1) {
+            put<int>(header+6, pos);
+        } else {
+            put<int>(last[n_c]+4, pos);
+        }
+        put<int>(header+10, pos);
+        last[n_c] = pos;
+    }
+
+    void Write(const char* fName) const {
+        std::ofstream file(fName, std::ios::binary);
+        file.write(contents.data(), contents.size());
+    }
+
+private:
+    std::string contents;
+    std::map<short, int> last;
+};
+
+}
+
+TEST(son_test, blocks_and_gaps) {
+    const char* fName = "son_test.smr";
+    Writer writer(4);
+    writer.Channel(0, 1, 5, "Vm", "mV", 6553.6f, 1.0f);
+    writer.Channel(1, 3, 0, "Events", "");
+    writer.Channel(2, 9, 5, "Im", "pA");
+    // sampled at a different rate and therefore skipped:
+    writer.Channel(3, 1, 10, "Slow", "V");
+    std::vector<short> adc(4);
+    std::vector<float> real(4);
+    for (int n_b = 0; n_b < 3; ++n_b) {
+        for (int n = 0; n < 4; ++n) {
+            adc[n] = (short)(10*n_b + n);
+            real[n] = 0.5f*(10*n_b + n);
+        }
+        // the third block starts after a gap:
+        int start = n_b < 2 ? 20*n_b : 100;
+        writer.Block(0, start, 5, adc);
+        writer.Block(2, start, 5, real);
+        writer.Block(3, start, 10, adc);
+    }
+    writer.Write(fName);
+
+    stftest::NullProgressInfo progDlg;
+    Recording rec;
+    stfio::importSONFile(fName, rec, progDlg);
+    ASSERT_EQ( rec.size(), 2 );
+    EXPECT_EQ( rec[0].GetChannelName(), "Vm" );
+    EXPECT_EQ( rec[0].GetYUnits(), "mV" );
+    EXPECT_EQ( rec[1].GetChannelName(), "Im" );
+    // 5 ticks of 10 us:
+    EXPECT_NEAR( rec.GetXScale(), 0.05, 1e-12 );
+    EXPECT_EQ( rec.GetComment(), "first comment" );
+    EXPECT_EQ( rec.GetDateTime().tm_year, 109 );
+    EXPECT_EQ( rec.GetDateTime().tm_mon, 5 );
+
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        ASSERT_EQ( rec[n_c].size(), 2 );
+        // contiguous blocks are chained in place:
+        EXPECT_TRUE( rec[n_c][0].IsMapped() );
+        ASSERT_EQ( rec[n_c][0].size(), 8 );
+        ASSERT_EQ( rec[n_c][1].size(), 4 );
+        for (std::size_t n = 0; n < 8; ++n) {
+            double raw = 10*(n/4) + n%4;
+            // the Adc scale factor is stored in single precision:
+            EXPECT_NEAR( rec[n_c][0][n], n_c == 0 ? raw+1.0 : 0.5*raw, 1e-5 );
+        }
+        EXPECT_NEAR( rec[n_c][1][3], n_c == 0 ? 24.0 : 11.5, 1e-5 );
+    }
+    std::remove(fName);
+
+    // the generic importer knows SON files:
+    writer.Write(fName);
+    Recording generic;
+    stfio::importFile(fName, stfio::son, generic, stfio::txtImportSettings(), progDlg);
+    ASSERT_EQ( generic.size(), 2 );
+    EXPECT_EQ( generic[1][0].get(), rec[1][0].get() );
+    std::remove(fName);
+}
+
+TEST(son_test, invalid) {
+    const char* fName = "son_test.smr";
+    stftest::NullProgressInfo progDlg;
+    Recording rec;
+    {
+        std::ofstream file(fName, std::ios::binary);
+        file << "too short";
+    }
+    EXPECT_THROW( stfio::importSONFile(fName, rec, progDlg), std::runtime_error );
+
+    // a 64-bit file:
+    Writer writer(1);
+    writer.put<short>(0, 0);
+    writer.Write(fName);
+    EXPECT_THROW( stfio::importSONFile(fName, rec, progDlg), std::runtime_error );
+
+    // a chain of blocks that points back into the file header:
+    Writer corrupt(1);
+    corrupt.Channel(0, 1, 5, "Vm", "mV");
+    corrupt.put<int>(512+6, 100);
+    corrupt.Write(fName);
+    EXPECT_THROW( stfio::importSONFile(fName, rec, progDlg), std::runtime_error );
+    std::remove(fName);
+}
@@ -0,0 +1,138 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/spectrum.h"
+#include "../libstfio/channel.h"
+#include "../libstfio/mappedfile.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Park-Miller minimal standard generator, uniform in [0, 1):
+class Uniform {
+public:
+    explicit Uniform(unsigned int seed) : state(seed) {}
+    double operator()() {
+        state = (unsigned int)(((unsigned long long)state * 48271u) % 2147483647u);
+        return (state - 1) / 2147483646.0;
+    }
+private:
+    unsigned int state;
+};
+
+const double PI = 3.14159265358979323846;
+
+}
+
+TEST(spectrum_test, welch_sine) {
+    // 50 Hz hum of amplitude 2 mV sampled at 20 kHz (dt in ms, f in kHz):
+    const double dt = 0.05, f = 0.05;
+    Vector_double data(200000);
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        data[k] = 3.0 + 2.0*sin(2*PI*f*k*dt);
+    }
+    std::size_t n_segments = 0;
+    Vector_double psd = stfnum::welch(Section(data), 4000, 2000, dt, n_segments);
+    EXPECT_EQ(n_segments, 99u);
+    ASSERT_EQ(psd.size(), 2001u);
+    // df = 1/(4000*0.05 ms) = 5 Hz; the hum is at bin 10:
+    std::size_t peak = std::max_element(psd.begin(), psd.end()) - psd.begin();
+    EXPECT_EQ(peak, 10u);
+    // the power of the sine is A^2/2, and the offset has been removed:
+    double power = 0.0;
+    for (std::size_t k = 0; k < psd.size(); ++k) {
+        power += psd[k] / (4000*dt);
+    }
+    EXPECT_NEAR(power, 2.0, 1e-6);
+    EXPECT_NEAR(psd[0], 0.0, 1e-12);
+}
+
+TEST(spectrum_test, welch_white_noise) {
+    // uniform noise has a variance of 1/12 and a flat density of 2*var*dt:
+    Uniform uniform(7);
+    const double dt = 0.1;
+    Vector_double data(1 << 18);
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        data[k] = uniform();
+    }
+    std::size_t n_segments = 0;
+    Vector_double psd = stfnum::welch(Section(data), 1024, 512, dt, n_segments);
+    double mean = 0.0;
+    for (std::size_t k = 1; k < psd.size()-1; ++k) {
+        mean += psd[k];
+    }
+    mean /= psd.size()-2;
+    EXPECT_NEAR(mean, 2.0/12.0*dt, 0.02*2.0/12.0*dt);
+}
+
+TEST(spectrum_test, streaming) {
+    // the density doesn't depend on the blocks in which the samples are added:
+    Uniform uniform(3);
+    Vector_double data(50000);
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        data[k] = uniform() + sin(0.01*k);
+    }
+    stfnum::WelchAccumulator whole(1000, 300, 0.1), blocks(1000, 300, 0.1);
+    whole.Add(&data[0], data.size());
+    for (std::size_t begin = 0, len = 1; begin < data.size(); begin += len, len = len*3 % 2011 + 1) {
+        blocks.Add(&data[begin], std::min(len, data.size()-begin));
+    }
+    EXPECT_EQ(whole.Segments(), (50000u-1000u)/700u + 1u);
+    EXPECT_EQ(blocks.Segments(), whole.Segments());
+    Vector_double a = whole.Density(), b = blocks.Density();
+    ASSERT_EQ(a.size(), b.size());
+    for (std::size_t k = 0; k < a.size(); ++k) {
+        EXPECT_NEAR(a[k], b[k], 1e-12*a[0] + 1e-15);
+    }
+    blocks.Reset();
+    EXPECT_TRUE(blocks.Density().empty());
+
+    // sections of several channels in parallel:
+    Section sec(data), compact(stfio::compactSamples(std::vector<short>(20000, 100), 0.01, 0.0));
+    std::vector<const Section*> sections;
+    sections.push_back(&sec);
+    sections.push_back(&compact);
+    sections.push_back(&sec);
+    std::vector<Vector_double> psds = stfnum::welch(sections, 1000, 300, 0.1);
+    ASSERT_EQ(psds.size(), 3u);
+    EXPECT_EQ(psds[2], a);
+    EXPECT_NEAR(psds[1][3], 0.0, 1e-12);
+
+    EXPECT_THROW(stfnum::WelchAccumulator(1000, 1000, 0.1), std::out_of_range);
+    EXPECT_THROW(stfnum::welch(sections, 1, 0, 0.1), std::out_of_range);
+    std::size_t n_segments = 1;
+    EXPECT_TRUE(stfnum::welch(Section(Vector_double(10)), 16, 8, 0.1, n_segments).empty());
+    EXPECT_EQ(n_segments, 0u);
+}
+
+TEST(spectrum_test, spectrogram) {
+    // a tone that jumps from 1 kHz to 2 kHz halfway:
+    const double dt = 0.01;
+    Vector_double data(20000);
+    for (std::size_t k = 0; k < data.size(); ++k) {
+        data[k] = sin(2*PI*(k < 10000 ? 1.0 : 2.0)*k*dt);
+    }
+    stfnum::Spectrogram sg = stfnum::spectrogram(Section(data), 500, 250, dt);
+    EXPECT_NEAR(sg.df, 0.2, 1e-12);
+    EXPECT_NEAR(sg.dt, 2.5, 1e-12);
+    ASSERT_EQ(sg.density.size(), 79u);
+    for (std::size_t n_w = 0; n_w < sg.density.size(); ++n_w) {
+        ASSERT_EQ(sg.density[n_w].size(), 251u);
+        std::size_t peak = std::max_element(sg.density[n_w].begin(), sg.density[n_w].end())
+            - sg.density[n_w].begin();
+        if (n_w*250+500 <= 10000) {
+            EXPECT_EQ(peak, 5u);
+        } else if (n_w*250 >= 10000) {
+            EXPECT_EQ(peak, 10u);
+        }
+    }
+    // the average of the segments is the Welch estimate:
+    std::size_t n_segments = 0;
+    Vector_double psd = stfnum::welch(Section(data), 500, 250, dt, n_segments);
+    ASSERT_EQ(n_segments, sg.density.size());
+    double sum = 0.0;
+    for (std::size_t n_w = 0; n_w < sg.density.size(); ++n_w) {
+        sum += sg.density[n_w][7];
+    }
+    EXPECT_NEAR(sum / n_segments, psd[7], 1e-9);
+}
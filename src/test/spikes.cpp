@@ -0,0 +1,121 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/measure.h"
+#include "../libstfnum/spikes.h"
+#include "../libstfio/channel.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+namespace {
+
+const double pi = 3.14159265358979323846;
+
+// A spike train at -60 mV: each spike rises along a half sine of
+// 10 points to its peak, decays along a half sine of 20 points to an
+// afterhyperpolarisation of -10 mV and recovers within 60 points.
+Vector_double spike_train(const std::vector<std::size_t>& onsets, const std::vector<double>& peaks,
+                          std::size_t size)
+{
+    Vector_double data(size, -60.0);
+    for (std::size_t n = 0; n < onsets.size(); ++n) {
+        double ampl = peaks[n]+60.0;
+        for (std::size_t k = 0; k <= 10; ++k) {
+            data[onsets[n]+k] = -60.0 + ampl*0.5*(1.0-cos(pi*k/10.0));
+        }
+        for (std::size_t k = 1; k <= 20; ++k) {
+            data[onsets[n]+10+k] = -70.0 + (ampl+10.0)*0.5*(1.0+cos(pi*k/20.0));
+        }
+        for (std::size_t k = 1; k < 60; ++k) {
+            data[onsets[n]+30+k] = -60.0 - 10.0*0.5*(1.0+cos(pi*k/60.0));
+        }
+    }
+    return data;
+}
+
+}
+
+TEST(spikes_test, single_section) {
+    std::vector<std::size_t> onsets;
+    std::vector<double> peaks;
+    for (std::size_t n = 0; n < 8; ++n) {
+        onsets.push_back(50 + 120*n);
+        peaks.push_back(20.0 + 2.0*n);
+    }
+    // a small depolarisation that crosses the slope threshold but is too small:
+    onsets.push_back(50 + 120*8);
+    peaks.push_back(-50.0);
+    Section sec(spike_train(onsets, peaks, 1200));
+
+    stfnum::SpikeDetectionPlan plan;
+    plan.slope = 2.0;
+    plan.minAmplitude = 20.0;
+    stfnum::SpikeTable spikes = plan.Detect(sec, 3);
+    ASSERT_EQ(spikes.size(), 8);
+    for (std::size_t n = 0; n < spikes.size(); ++n) {
+        EXPECT_EQ(spikes.section[n], 3);
+        EXPECT_DOUBLE_EQ(spikes.peakT[n], onsets[n]+10);
+        EXPECT_DOUBLE_EQ(spikes.peak[n], peaks[n]);
+        EXPECT_DOUBLE_EQ(spikes.amplitude[n], spikes.peak[n]-spikes.threshold[n]);
+        EXPECT_GT(spikes.thresholdT[n], onsets[n]);
+        EXPECT_LT(spikes.thresholdT[n], onsets[n]+10);
+        EXPECT_NEAR(spikes.ahp[n], -70.0, 1e-9);
+        EXPECT_DOUBLE_EQ(spikes.ahpT[n], onsets[n]+30);
+        EXPECT_GT(spikes.maxRiseT[n], spikes.thresholdT[n]);
+        EXPECT_LT(spikes.maxRiseT[n], spikes.peakT[n]);
+        EXPECT_GT(spikes.maxDecayT[n], spikes.peakT[n]);
+        EXPECT_LT(spikes.maxDecayT[n], spikes.ahpT[n]);
+        // the steepest rise of a half sine is at its centre:
+        EXPECT_NEAR(spikes.maxRise[n], (peaks[n]+60.0)*0.5*pi/10.0, 0.05*(peaks[n]+60.0));
+        EXPECT_GT(spikes.halfWidth[n], 0.0);
+        EXPECT_LT(spikes.halfWidth[n], 30.0);
+
+        // the same as the single-spike measurements:
+        double thrT;
+        std::size_t end = (n+1 < onsets.size()) ? onsets[n+1] : sec.size()-1;
+        double thr = stfnum::threshold(sec.get(), onsets[n], end, plan.slope, thrT, 1);
+        EXPECT_DOUBLE_EQ(spikes.threshold[n], thr);
+        EXPECT_DOUBLE_EQ(spikes.thresholdT[n], thrT);
+    }
+}
+
+TEST(spikes_test, channel) {
+    Channel ch(5);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        std::vector<std::size_t> onsets;
+        std::vector<double> peaks;
+        for (std::size_t n = 0; n <= n_s; ++n) {
+            onsets.push_back(30 + 110*n);
+            peaks.push_back(10.0*n_s);
+        }
+        ch.InsertSection(Section(spike_train(onsets, peaks, 700)), n_s);
+    }
+    stfnum::SpikeDetectionPlan plan;
+    stftest::NullProgressInfo progDlg;
+    stfnum::SpikeTable parallel = plan.Detect(ch, progDlg, 3);
+    ASSERT_EQ(parallel.size(), 1+2+3+4+5);
+
+    stfnum::SpikeTable serial;
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        serial.append(plan.Detect(ch[n_s], n_s));
+    }
+    ASSERT_EQ(serial.size(), parallel.size());
+    for (std::size_t n = 0; n < serial.size(); ++n) {
+        EXPECT_EQ(parallel.section[n], serial.section[n]);
+        EXPECT_EQ(parallel.peakT[n], serial.peakT[n]);
+        EXPECT_EQ(parallel.halfWidth[n], serial.halfWidth[n]);
+    }
+
+    std::vector<std::size_t> sections(1, 4);
+    sections.push_back(1);
+    stfnum::SpikeTable some = plan.Detect(ch, sections, progDlg);
+    ASSERT_EQ(some.size(), 5+2);
+    EXPECT_EQ(some.section[0], 4);
+    EXPECT_EQ(some.section[6], 1);
+
+    stfnum::Table table = parallel.ToTable(0.05);
+    EXPECT_EQ(table.nRows(), parallel.size());
+    EXPECT_DOUBLE_EQ(table.at(0, 3), parallel.peakT[0]*0.05);
+
+    sections.push_back(5);
+    EXPECT_THROW(plan.Detect(ch, sections, progDlg), std::out_of_range);
+}
@@ -0,0 +1,950 @@
+#include "../stimfit/stf.h"
+#include "../libstfnum/events.h"
+#include "../libstfnum/gpu.h"
+#include "../libstfio/aligned.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+// Deterministic noisy data with a few events:
+Vector_double noisy_data(std::size_t size) {
+    Vector_double data(size);
+    for (std::size_t n=0; n<size; ++n) {
+        data[n] = 0.3*sin(0.37*n) + 0.2*cos(1.91*n+0.5) + 0.1*sin(0.013*n) + 5.0;
+        if (n%700 > 100)
+            data[n] -= 2.0*exp(-(double)(n%700-100)/80.0);
+    }
+    return data;
+}
+
+Vector_double event_template(std::size_t size) {
+    Vector_double templ(size);
+    for (std::size_t n=0; n<size; ++n) {
+        templ[n] = -exp(-(double)n/(size/4.0));
+    }
+    return templ;
+}
+
+TEST(stfnum_test, slidingProduct_short_and_long) {
+    Vector_double data = noisy_data(10000);
+    for (std::size_t templ_size=16; templ_size<=1024; templ_size*=4) {
+        Vector_double templ = event_template(templ_size);
+        std::size_t n_out = data.size()-templ.size();
+        Vector_double product = stfnum::slidingProduct(data, templ, n_out);
+        ASSERT_EQ(product.size(), n_out);
+        for (std::size_t n=0; n<n_out; n+=37) {
+            double ref=0.0;
+            for (std::size_t k=0; k<templ.size(); ++k) {
+                ref+=templ[k]*data[n+k];
+            }
+            EXPECT_NEAR(product[n], ref, 1e-9*templ.size());
+        }
+    }
+    Vector_double templ = event_template(100);
+    EXPECT_THROW(stfnum::slidingProduct(data, templ, data.size()), std::out_of_range);
+}
+
+TEST(stfnum_test, detectionCriterion_long_template) {
+    stftest::NullProgressInfo progDlg;
+    Vector_double data = noisy_data(5000);
+    Vector_double templ = event_template(200);
+    Vector_double dc = stfnum::detectionCriterion(data, templ, progDlg);
+    ASSERT_EQ(dc.size(), data.size()-templ.size());
+    double N = templ.size();
+    for (std::size_t n=0; n<dc.size(); n+=11) {
+        // least-squares fit of scale*templ+offset in full length:
+        double st=0, sd=0, stt=0, std_=0;
+        for (std::size_t k=0; k<templ.size(); ++k) {
+            st+=templ[k]; sd+=data[n+k]; stt+=templ[k]*templ[k]; std_+=templ[k]*data[n+k];
+        }
+        double scale=(std_-st*sd/N)/(stt-st*st/N);
+        double offset=(sd-scale*st)/N;
+        double sse=0;
+        for (std::size_t k=0; k<templ.size(); ++k) {
+            sse+=stfnum::SQR(data[n+k]-scale*templ[k]-offset);
+        }
+        double ref=scale/sqrt(sse/(N-1));
+        EXPECT_NEAR(dc[n], ref, 1e-6*fabs(ref)+1e-6);
+    }
+}
+
+TEST(stfnum_test, linCorr_long_template) {
+    stftest::NullProgressInfo progDlg;
+    Vector_double data = noisy_data(5000);
+    Vector_double templ = event_template(200);
+    Vector_double corr = stfnum::linCorr(data, templ, progDlg);
+    ASSERT_EQ(corr.size(), data.size()-templ.size());
+    double N = templ.size();
+    for (std::size_t n=0; n<corr.size(); n+=11) {
+        double mt=0, md=0;
+        for (std::size_t k=0; k<templ.size(); ++k) {
+            mt+=templ[k]/N; md+=data[n+k]/N;
+        }
+        double sdt=0, sdd=0, r=0;
+        for (std::size_t k=0; k<templ.size(); ++k) {
+            sdt+=stfnum::SQR(templ[k]-mt); sdd+=stfnum::SQR(data[n+k]-md);
+            r+=(templ[k]-mt)*(data[n+k]-md);
+        }
+        // correlation with the optimally scaled template is always positive:
+        double ref=fabs(r)/((N-1)*sqrt(sdt/N)*sqrt(sdd/N));
+        EXPECT_NEAR(corr[n], ref, 1e-6);
+    }
+}
+
+TEST(stfnum_test, linCorr_offset_and_drift) {
+    stftest::NullProgressInfo progDlg;
+    // a large offset and a slow drift along a long trace:
+    Vector_double data = noisy_data(200000);
+    for (std::size_t n=0; n<data.size(); ++n) {
+        data[n] += 2.0e4 + 0.05*n;
+    }
+    Vector_double templ = event_template(200);
+    Vector_double corr = stfnum::linCorr(data, templ, progDlg);
+    ASSERT_EQ(corr.size(), data.size()-templ.size());
+    double N = templ.size();
+    for (std::size_t n=corr.size()-20000; n<corr.size(); n+=97) {
+        double mt=0, md=0;
+        for (std::size_t k=0; k<templ.size(); ++k) {
+            mt+=templ[k]/N; md+=data[n+k]/N;
+        }
+        double sdt=0, sdd=0, r=0;
+        for (std::size_t k=0; k<templ.size(); ++k) {
+            sdt+=stfnum::SQR(templ[k]-mt); sdd+=stfnum::SQR(data[n+k]-md);
+            r+=(templ[k]-mt)*(data[n+k]-md);
+        }
+        double ref=fabs(r)/((N-1)*sqrt(sdt/N)*sqrt(sdd/N));
+        EXPECT_NEAR(corr[n], ref, 1e-6);
+    }
+}
+
+TEST(stfnum_test, streamFilter_chunks) {
+    Vector_double data = noisy_data(8000);
+    Vector_double a(1, 1.0); // 1 kHz cutoff
+    const int SR = 20; // 20 kHz
+    stfnum::StreamFilter sf(a, SR, stfnum::fgaussColqu, false, 257, 2048);
+    EXPECT_EQ(sf.GetKernel().size(), 257);
+
+    Vector_double whole = sf.Process(data);
+    Vector_double tail = sf.Finish();
+    whole.insert(whole.end(), tail.begin(), tail.end());
+    ASSERT_EQ(whole.size(), data.size());
+
+    // The output mustn't depend on how the stream is split up:
+    Vector_double chunked;
+    std::size_t pos = 0, chunk_size = 1;
+    while (pos < data.size()) {
+        std::size_t n = std::min(chunk_size, data.size()-pos);
+        Vector_double chunk(data.begin()+pos, data.begin()+pos+n);
+        Vector_double filtered = sf.Process(chunk);
+        chunked.insert(chunked.end(), filtered.begin(), filtered.end());
+        pos += n;
+        chunk_size = (chunk_size*7) % 3001 + 1;
+    }
+    tail = sf.Finish();
+    chunked.insert(chunked.end(), tail.begin(), tail.end());
+    ASSERT_EQ(chunked.size(), data.size());
+    for (std::size_t n=0; n<data.size(); ++n) {
+        EXPECT_EQ(chunked[n], whole[n]);
+    }
+
+    // Away from the ends, the result should agree with filter():
+    Vector_double ref = stfnum::filter(data, 0, data.size()-1, a, SR, stfnum::fgaussColqu, false);
+    for (std::size_t n=500; n<data.size()-500; n+=7) {
+        EXPECT_NEAR(whole[n], ref[n], 1e-3);
+    }
+}
+
+namespace {
+double allPass(double, const Vector_double&) { return 1.0; }
+}
+
+TEST(stfnum_test, aligned_filter) {
+    stfio::Vector_aligned aligned(1001, 1.0);
+    EXPECT_TRUE(stfio::isAligned(&aligned[0]));
+    aligned.resize(3001);
+    EXPECT_TRUE(stfio::isAligned(&aligned[0]));
+    EXPECT_EQ(aligned[1000], 1.0);
+
+    // The transforms run within the returned vector; an all-pass filter
+    // has to give back the original data:
+    Vector_double data = noisy_data(501);
+    Vector_double a(1, 1.0);
+    Vector_double filtered = stfnum::filter(data, 100, 400, a, 20, allPass, false);
+    ASSERT_EQ(filtered.size(), 301);
+    for (std::size_t n=0; n<filtered.size(); ++n) {
+        EXPECT_NEAR(filtered[n], data[100+n], 1e-9);
+    }
+}
+
+TEST(stfnum_test, fft_padding) {
+    EXPECT_EQ(stfnum::fftSize(1), 1);
+    EXPECT_EQ(stfnum::fftSize(4096), 4096);
+    EXPECT_EQ(stfnum::fftSize(4099), 4116);   // 2^2 3 7^3
+    EXPECT_EQ(stfnum::fftSize(10007), 10080); // 2^5 3^2 5 7
+    EXPECT_EQ(stfnum::fftSize(65537), 65610); // 2 3^8
+
+    // a prime window length, filtered with and without padding:
+    Vector_double data = noisy_data(10007);
+    Vector_double a(1, 0.5);
+    Vector_double exact = stfnum::filter(data, 0, data.size()-1, a, 20, stfnum::fgaussColqu, false,
+                                         stfnum::pad_exact);
+    Vector_double padded = stfnum::filter(data, 0, data.size()-1, a, 20, stfnum::fgaussColqu, false,
+                                          stfnum::pad_fast);
+    ASSERT_EQ(padded.size(), exact.size());
+    // away from the edges, the results agree:
+    for (std::size_t n=500; n<data.size()-500; ++n) {
+        EXPECT_NEAR(padded[n], exact[n], 1e-3);
+    }
+    EXPECT_NEAR(padded[0], data[0], 0.5);
+    EXPECT_NEAR(padded[data.size()-1], data[data.size()-1], 0.5);
+
+    // the global setting applies where no padding is passed:
+    EXPECT_FALSE(stfnum::getFFTPadding());
+    stfnum::setFFTPadding(true);
+    Vector_double global = stfnum::filter(data, 0, data.size()-1, a, 20, stfnum::fgaussColqu);
+    stftest::NullProgressInfo progDlg;
+    Vector_double templ = event_template(200);
+    Vector_double deconv = stfnum::deconvolve(data, templ, 20, 0.001, 0.5, progDlg);
+    stfnum::setFFTPadding(false);
+    EXPECT_EQ(global, padded);
+    EXPECT_EQ(deconv, stfnum::deconvolve(data, templ, 20, 0.001, 0.5, progDlg, stfnum::pad_fast));
+    EXPECT_EQ(deconv.size(), data.size());
+}
+
+TEST(stfnum_test, fft_dispatch) {
+    // a forward and a backward transform scale the data by their length:
+    const int n = 1000;
+    Vector_double data = noisy_data(n);
+    double* real = (double *)fftw_malloc(sizeof(double) * n);
+    fftw_complex* cplx = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * (n/2+1));
+    std::copy(data.begin(), data.end(), real);
+    stfnum::executeR2C(stfnum::fftwPlan(n, false), n, real, cplx);
+    EXPECT_NEAR(cplx[0][0], std::accumulate(data.begin(), data.end(), 0.0), 1e-9);
+    stfnum::executeC2R(stfnum::fftwPlan(n, true), n, cplx, real);
+    for (int k=0; k<n; ++k) {
+        EXPECT_NEAR(real[k], n*data[k], 1e-9);
+    }
+    fftw_free(real);
+    fftw_free(cplx);
+}
+
+TEST(stfnum_test, batchFilter_sections) {
+    Channel ch(4);
+    std::vector<short> adc(301);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        adc[n] = (short)(800*sin(n/15.0) + (n*7919)%101);
+    }
+    for (std::size_t n_s=0; n_s<3; ++n_s) {
+        Vector_double data = noisy_data(301+n_s);
+        ch.InsertSection(Section(data, "trace"), n_s);
+    }
+    ch.InsertSection(Section(stfio::compactSamples(adc, 0.01, -70.0), "compact"), 3);
+    ch[1].SetXScale(0.05);
+
+    std::vector<std::size_t> sections;
+    sections.push_back(3);
+    sections.push_back(1);
+    sections.push_back(0);
+    Vector_double a(1, 2.0);
+    stftest::NullProgressInfo progDlg;
+    Channel filtered = stfnum::batchFilter(ch, sections, 10, 290, a, 20, stfnum::fgaussColqu, false, progDlg, 2);
+    ASSERT_EQ(filtered.size(), sections.size());
+    for (std::size_t n=0; n<sections.size(); ++n) {
+        const Section& sec = ch[sections[n]];
+        Vector_double expected = stfnum::filter(sec.get(), 10, 290, a, 20, stfnum::fgaussColqu, false);
+        ASSERT_EQ(filtered[n].size(), expected.size());
+        for (std::size_t i=0; i<expected.size(); ++i) {
+            EXPECT_NEAR(filtered[n][i], expected[i], 1e-9);
+        }
+        EXPECT_EQ(filtered[n].GetXScale(), sec.GetXScale());
+        EXPECT_EQ(filtered[n].GetSectionDescription(), sec.GetSectionDescription() + ", filtered");
+    }
+
+    sections.push_back(4);
+    EXPECT_THROW(stfnum::batchFilter(ch, sections, 10, 290, a, 20, stfnum::fgaussColqu, false, progDlg),
+                 std::out_of_range);
+    sections.pop_back();
+    EXPECT_THROW(stfnum::batchFilter(ch, sections, 10, 301, a, 20, stfnum::fgaussColqu, false, progDlg),
+                 std::out_of_range);
+}
+
+TEST(stfnum_test, histogram_bins) {
+    // more than one block, so that partial histograms are added up:
+    Vector_double data = noisy_data(200000);
+    data[17] = NAN;
+    stfnum::Histogram serial = stfnum::histogramBins(data, 50, 1);
+    stfnum::Histogram parallel = stfnum::histogramBins(data, 50, 4);
+    ASSERT_EQ(serial.edges.size(), serial.counts.size());
+    EXPECT_EQ(serial.edges, parallel.edges);
+    EXPECT_EQ(serial.counts, parallel.counts);
+    int total = 0;
+    for (std::size_t n=0; n<serial.counts.size(); ++n) {
+        total += serial.counts[n];
+        EXPECT_NEAR(serial.edges[n], serial.edges[0] + n*serial.binWidth, 1e-9);
+    }
+    EXPECT_EQ(total, (int)data.size()-1);
+
+    // the map is a view of the same bins:
+    std::map<double, int> histo = stfnum::histogram(data, 50);
+    ASSERT_EQ(histo.size(), serial.edges.size());
+    std::size_t n = 0;
+    for (std::map<double,int>::const_iterator it=histo.begin(); it!=histo.end(); ++it, ++n) {
+        EXPECT_EQ(it->first, serial.edges[n]);
+        EXPECT_EQ(it->second, serial.counts[n]);
+    }
+
+    // constant data end up in a single bin:
+    stfnum::Histogram constant = stfnum::histogramBins(Vector_double(10, 2.0), 5);
+    ASSERT_EQ(constant.counts.size(), 1);
+    EXPECT_EQ(constant.counts[0], 10);
+    EXPECT_TRUE(stfnum::histogramBins(Vector_double(0)).edges.empty());
+}
+
+TEST(stfnum_test, runningBaseline_chunks) {
+    Vector_double data = noisy_data(3000);
+    const std::size_t width = 101;
+    for (int method=stfnum::filter_mean; method<=stfnum::filter_percentile; ++method) {
+        double percentile = 10.0;
+        stfnum::RunningBaseline rb((stfnum::baseline_filter)method, width, percentile, false);
+        Vector_double whole = rb.Process(data);
+        Vector_double tail = rb.Finish();
+        whole.insert(whole.end(), tail.begin(), tail.end());
+        ASSERT_EQ(whole.size(), data.size());
+
+        // compare with the window statistics computed from scratch:
+        for (long i=0; i<(long)data.size(); i+=13) {
+            long begin = std::max<long>(i-(long)width/2, 0);
+            long end = std::min<long>(i-(long)width/2+(long)width, (long)data.size());
+            Vector_double a(data.begin()+begin, data.begin()+end);
+            std::sort(a.begin(), a.end());
+            double expected;
+            if (method == stfnum::filter_mean) {
+                expected = 0;
+                for (std::size_t k=0; k<a.size(); ++k) expected += a[k]/a.size();
+            } else {
+                double q = method == stfnum::filter_median ? 0.5 : percentile/100.0;
+                double pos = q*(a.size()-1);
+                std::size_t rank = (std::size_t)pos;
+                expected = rank+1 < a.size() ? a[rank]+(pos-rank)*(a[rank+1]-a[rank]) : a[rank];
+            }
+            EXPECT_NEAR(whole[i], expected, 1e-9);
+        }
+
+        // The output mustn't depend on how the stream is split up:
+        Vector_double chunked;
+        std::size_t pos = 0, chunk_size = 1;
+        while (pos < data.size()) {
+            std::size_t n = std::min(chunk_size, data.size()-pos);
+            Vector_double chunk(data.begin()+pos, data.begin()+pos+n);
+            Vector_double processed = rb.Process(chunk);
+            chunked.insert(chunked.end(), processed.begin(), processed.end());
+            pos += n;
+            chunk_size = (chunk_size*7) % 301 + 1;
+        }
+        tail = rb.Finish();
+        chunked.insert(chunked.end(), tail.begin(), tail.end());
+        ASSERT_EQ(chunked.size(), data.size());
+        for (std::size_t n=0; n<data.size(); ++n) {
+            EXPECT_NEAR(chunked[n], whole[n], 1e-9);
+        }
+    }
+    EXPECT_THROW(stfnum::RunningBaseline(stfnum::filter_mean, 0), std::out_of_range);
+    EXPECT_THROW(stfnum::RunningBaseline(stfnum::filter_percentile, 10, 101.0), std::out_of_range);
+}
+
+TEST(stfnum_test, subtractBaseline_section) {
+    std::vector<short> adc(200000);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        // slow drift plus noise:
+        adc[n] = (short)(n/20 + (n*7919)%101);
+    }
+    Section sec(stfio::compactSamples(adc, 0.01));
+    sec.SetXScale(0.05);
+    Section detrended = stfnum::subtractBaseline(sec, stfnum::filter_median, 501);
+    ASSERT_EQ(detrended.size(), sec.size());
+    EXPECT_EQ(detrended.GetXScale(), sec.GetXScale());
+    // Compactly stored data mustn't be decoded as a whole:
+    EXPECT_TRUE(sec.IsMapped());
+
+    Vector_double data(adc.size());
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        data[n] = 0.01*adc[n];
+    }
+    stfnum::RunningBaseline rb(stfnum::filter_median, 501, 50.0, false);
+    Vector_double median = rb.Process(data);
+    Vector_double tail = rb.Finish();
+    median.insert(median.end(), tail.begin(), tail.end());
+    for (std::size_t n=0; n<data.size(); n+=997) {
+        EXPECT_DOUBLE_EQ(detrended[n], data[n]-median[n]);
+    }
+
+    stftest::NullProgressInfo progDlg;
+    Vector_double templ = event_template(100);
+    Vector_double dc = stfnum::detectionCriterion(sec, templ, progDlg, stfnum::filter_median, 501);
+    Vector_double ref = stfnum::detectionCriterion(detrended.get(), templ, progDlg);
+    ASSERT_EQ(dc.size(), ref.size());
+    for (std::size_t n=0; n<dc.size(); n+=997) {
+        EXPECT_EQ(dc[n], ref[n]);
+    }
+}
+
+TEST(stfnum_test, eventDetection_sections) {
+    stftest::NullProgressInfo progDlg;
+    Channel ch(6);
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        Vector_double data = noisy_data(4000+500*n_s);
+        for (std::size_t n=0; n<data.size(); ++n) {
+            data[n] += 0.5*n_s;
+        }
+        ch[n_s] = Section(data);
+    }
+    stfnum::EventDetectionPlan plan;
+    plan.templ = event_template(200);
+    plan.threshold = 3.0;
+    plan.minDistance = 100;
+
+    // The table mustn't depend on the number of threads:
+    stfnum::EventTable events = plan.Detect(ch, progDlg, 1);
+    ASSERT_GT(events.size(), ch.size());
+    for (int n_threads=2; n_threads<=8; n_threads*=2) {
+        stfnum::EventTable parallel = plan.Detect(ch, progDlg, n_threads);
+        EXPECT_EQ(parallel.section, events.section);
+        EXPECT_EQ(parallel.index, events.index);
+        EXPECT_EQ(parallel.amplitude, events.amplitude);
+    }
+
+    // Each section gives the events of the single-section scan:
+    std::size_t row = 0;
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        Vector_double dc = stfnum::detectionCriterion(ch[n_s].get(), plan.templ, progDlg);
+        std::vector<int> onsets = stfnum::peakIndices(dc, plan.threshold, plan.minDistance);
+        for (std::size_t n_e=0; n_e<onsets.size(); ++n_e, ++row) {
+            ASSERT_LT(row, events.size());
+            EXPECT_EQ(events.section[row], n_s);
+            EXPECT_EQ(events.index[row], (std::size_t)onsets[n_e]);
+            EXPECT_EQ(events.criterion[row], dc[onsets[n_e]]);
+            EXPECT_GE(events.peakIndex[row], events.index[row]);
+            EXPECT_LE(events.peakIndex[row], events.index[row]+plan.templ.size());
+            EXPECT_GT(fabs(events.amplitude[row]), 0.5);
+        }
+    }
+    EXPECT_EQ(row, events.size());
+
+    std::vector<std::size_t> sections(1, 3);
+    stfnum::EventTable single = plan.Detect(ch, sections, progDlg);
+    EXPECT_EQ(single.size(), (std::size_t)std::count(events.section.begin(), events.section.end(), 3));
+    EXPECT_EQ(plan.Detect(ch, sections, progDlg).ToTable(0.05).nRows(), single.size());
+    sections.push_back(ch.size());
+    EXPECT_THROW(plan.Detect(ch, sections, progDlg), std::out_of_range);
+}
+
+TEST(stfnum_test, deconvolutionPlan_sections) {
+    stftest::NullProgressInfo progDlg;
+    Vector_double templ = event_template(200);
+    stfnum::DeconvolutionPlan deconv(templ, 4000, 20, 0.001, 0.5);
+    EXPECT_EQ(deconv.size(), 4000);
+    for (int n_s=0; n_s<2; ++n_s) {
+        Vector_double data = noisy_data(4000);
+        for (std::size_t n=0; n<data.size(); ++n) {
+            data[n] += 0.2*n_s*sin(0.05*n);
+        }
+        Vector_double planned = deconv.Apply(data, progDlg);
+        ASSERT_EQ(planned.size(), data.size());
+        EXPECT_EQ(planned, stfnum::deconvolve(data, templ, 20, 0.001, 0.5, progDlg));
+    }
+    EXPECT_THROW(deconv.Apply(noisy_data(3999), progDlg), std::out_of_range);
+    EXPECT_THROW(stfnum::DeconvolutionPlan(templ, 100, 20, 0.001, 0.5), std::out_of_range);
+
+    // Sections of equal length share a plan in the event detection:
+    Channel ch(4);
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        Vector_double data = noisy_data(n_s < 3 ? 4000 : 4500);
+        for (std::size_t n=0; n<data.size(); ++n) {
+            data[n] += 0.3*n_s;
+        }
+        ch[n_s] = Section(data);
+    }
+    stfnum::EventDetectionPlan plan;
+    plan.templ = templ;
+    plan.mode = stfnum::detect_deconvolution;
+    plan.SR = 20;
+    stfnum::EventTable events = plan.Detect(ch, progDlg, 2);
+    stfnum::EventTable single;
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        single.append(plan.Detect(ch[n_s], n_s, progDlg));
+    }
+    EXPECT_EQ(events.section, single.section);
+    EXPECT_EQ(events.index, single.index);
+    EXPECT_EQ(events.criterion, single.criterion);
+}
+
+TEST(stfnum_test, detectionCriterion_template_bank) {
+    stftest::NullProgressInfo progDlg;
+    Vector_double data = noisy_data(12000);
+    std::vector<Vector_double> templs;
+    templs.push_back(event_template(100));
+    templs.push_back(event_template(300));
+    templs.push_back(event_template(40));
+    // products of every template mustn't depend on the bank:
+    std::vector<Vector_double> products = stfnum::slidingProducts(data, templs);
+    ASSERT_EQ(products.size(), templs.size());
+    for (std::size_t n_k=0; n_k<templs.size(); ++n_k) {
+        Vector_double ref = stfnum::slidingProduct(data, templs[n_k], data.size()-templs[n_k].size());
+        ASSERT_EQ(products[n_k].size(), ref.size());
+        for (std::size_t n=0; n<ref.size(); n+=7) {
+            EXPECT_NEAR(products[n_k][n], ref[n], 1e-9*templs[n_k].size());
+        }
+    }
+
+    std::vector<int> best;
+    Vector_double dc = stfnum::detectionCriterion(data, templs, progDlg, best);
+    ASSERT_EQ(dc.size(), data.size()-300);
+    ASSERT_EQ(best.size(), dc.size());
+    std::vector<Vector_double> single(templs.size());
+    for (std::size_t n_k=0; n_k<templs.size(); ++n_k) {
+        single[n_k] = stfnum::detectionCriterion(data, templs[n_k], progDlg);
+    }
+    for (std::size_t n=0; n<dc.size(); n+=5) {
+        double ref = std::max(single[0][n], std::max(single[1][n], single[2][n]));
+        EXPECT_NEAR(dc[n], ref, 1e-6*fabs(ref)+1e-6);
+        ASSERT_GE(best[n], 0);
+        ASSERT_LT(best[n], (int)templs.size());
+        EXPECT_NEAR(single[best[n]][n], ref, 1e-6*fabs(ref)+1e-6);
+    }
+}
+
+// The original serial scan of stfnum::peakIndices():
+std::vector<int> peakIndices_reference(const Vector_double& data, double threshold, int minDistance) {
+    std::vector<int> peakInd;
+    for (unsigned n_data=0; n_data<data.size(); ++n_data) {
+        int llp=n_data;
+        int ulp=n_data+1;
+        if (data[n_data]>threshold) {
+            for (;;) {
+                if (n_data>data.size()-2) {
+                    ulp=(int)data.size()-1;
+                    break;
+                }
+                n_data++;
+                if (data[n_data]<threshold && (int)n_data-ulp>minDistance) {
+                    ulp=n_data;
+                    break;
+                }
+            }
+            double max=-1e8;
+            int peakIndex=llp;
+            for (int n_p=llp; n_p<=ulp; ++n_p) {
+                if (data[n_p]>max) {
+                    max=data[n_p];
+                    peakIndex=n_p;
+                }
+            }
+            peakInd.push_back(peakIndex);
+        }
+    }
+    return peakInd;
+}
+
+TEST(stfnum_test, peakIndices_chunks) {
+    Vector_double data(600000);
+    for (std::size_t n=0; n<data.size(); ++n) {
+        data[n] = sin(0.001*n) + 0.5*sin(0.37*n) + 0.3*cos(1.91*n);
+    }
+    // windows of any length, including some that span several chunks:
+    int distances[] = {0, 5, 150, 3000, 70000, 200000};
+    for (std::size_t n_d=0; n_d<sizeof(distances)/sizeof(distances[0]); ++n_d) {
+        for (double threshold=0.5; threshold<2.0; threshold+=0.6) {
+            std::vector<int> ref = peakIndices_reference(data, threshold, distances[n_d]);
+            EXPECT_EQ(stfnum::peakIndices(data, threshold, distances[n_d]), ref)
+                << "minDistance " << distances[n_d] << ", threshold " << threshold;
+        }
+    }
+    Vector_double small(data.begin(), data.begin()+1000);
+    EXPECT_EQ(stfnum::peakIndices(small, 0.8, 10), peakIndices_reference(small, 0.8, 10));
+    EXPECT_TRUE(stfnum::peakIndices(Vector_double(), 0.0, 10).empty());
+    // a window at the very end:
+    Vector_double last(10, 0.0);
+    last[9] = 1.0;
+    ASSERT_EQ(stfnum::peakIndices(last, 0.5, 0).size(), 1);
+    EXPECT_EQ(stfnum::peakIndices(last, 0.5, 0)[0], 9);
+}
+
+TEST(stfnum_test, runningMean_spells) {
+    Vector_double data(1000);
+    for (std::size_t n=0; n<data.size(); ++n) {
+        data[n] = 1000.0 + sin(0.01*n) + 0.3*cos(1.7*n);
+    }
+    // the loop of spells.rmean():
+    std::size_t binwidth = 25;
+    Vector_double rmean = stfnum::runningMean(data, binwidth);
+    ASSERT_EQ(rmean.size(), data.size());
+    for (std::size_t n=0; n<data.size(); ++n) {
+        std::size_t end = std::min(n+binwidth, data.size());
+        double sum = 0;
+        for (std::size_t k=n; k<end; ++k) {
+            sum += data[k];
+        }
+        EXPECT_NEAR(rmean[n], sum/(end-n), 1e-9) << "point " << n;
+    }
+    EXPECT_THROW(stfnum::runningMean(data, 0), std::out_of_range);
+    EXPECT_TRUE(stfnum::runningMean(Vector_double(), 10).empty());
+}
+
+TEST(stfnum_test, thresholdCrossings_spells) {
+    double values[] = {1.0, 0.0, 2.0, 3.0, 0.5, 0.0, 4.0, 4.0, 0.0, 5.0};
+    Vector_double data(values, values+sizeof(values)/sizeof(values[0]));
+    std::vector<std::size_t> up = stfnum::thresholdCrossings(data, 0, data.size(), 0.5);
+    ASSERT_EQ(up.size(), 4);
+    EXPECT_EQ(up[0], 0);
+    EXPECT_EQ(up[1], 2);
+    EXPECT_EQ(up[2], 6);
+    EXPECT_EQ(up[3], 9);
+    // an event that has started before the range is counted at the beginning:
+    up = stfnum::thresholdCrossings(data, 3, 8, 0.5);
+    ASSERT_EQ(up.size(), 2);
+    EXPECT_EQ(up[0], 3);
+    EXPECT_EQ(up[1], 6);
+    std::vector<std::size_t> down = stfnum::thresholdCrossings(data, 0, data.size(), 0.5, false);
+    ASSERT_EQ(down.size(), 3);
+    EXPECT_EQ(down[0], 1);
+    EXPECT_EQ(down[1], 5);
+    EXPECT_EQ(down[2], 8);
+    EXPECT_THROW(stfnum::thresholdCrossings(data, 0, data.size()+1, 0.5), std::out_of_range);
+}
+
+TEST(stfnum_test, batchQuad_sections) {
+    std::vector<short> adc(3001);
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        adc[n] = (short)(800*sin(n/150.0) + (n*7919)%101);
+    }
+    Vector_double data(adc.size());
+    for (std::size_t n=0; n<adc.size(); ++n) {
+        data[n] = 0.01*adc[n] - 70.0;
+    }
+
+    // each parabola passes through its 3 points, as with single systems:
+    std::size_t begin = 101, end = 2900;
+    Vector_double quad_p = stfnum::quad(data, begin, end);
+    ASSERT_EQ(quad_p.size(), 3*((end-begin)/2));
+    for (std::size_t n_i=0; n_i<quad_p.size()/3; ++n_i) {
+        double x = (double)(begin + 2*n_i);
+        for (int k=0; k<3; ++k) {
+            double y = quad_p[3*n_i]*(x+k)*(x+k) + quad_p[3*n_i+1]*(x+k) + quad_p[3*n_i+2];
+            EXPECT_NEAR(y, data[begin+2*n_i+k], 1e-6);
+        }
+    }
+    Vector_double A(9), B(3);
+    double x = (double)begin+20;
+    for (int k=0; k<3; ++k) {
+        A[k] = (x+k)*(x+k);
+        A[3+k] = x+k;
+        A[6+k] = 1.0;
+        B[k] = data[begin+20+k];
+    }
+    stfnum::linsolv(3, 3, 1, A, B);
+    for (int k=0; k<3; ++k) {
+        EXPECT_DOUBLE_EQ(quad_p[30+k], B[k]);
+    }
+
+    // compactly stored sections give the same parameters, in parallel:
+    Channel ch(5);
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        if (n_s%2 == 0) {
+            ch[n_s] = Section(stfio::compactSamples(adc, 0.01, -70.0));
+        } else {
+            ch[n_s] = Section(data);
+        }
+    }
+    std::vector<std::size_t> sections;
+    for (std::size_t n_s=ch.size(); n_s-- > 0; ) {
+        sections.push_back(n_s);
+    }
+    std::vector<Vector_double> params = stfnum::batchQuad(ch, sections, begin, end, 3);
+    ASSERT_EQ(params.size(), sections.size());
+    for (std::size_t n_s=0; n_s<params.size(); ++n_s) {
+        EXPECT_EQ(params[n_s], quad_p);
+    }
+    EXPECT_TRUE(ch[0].IsMapped());
+
+    // many systems at once, in parallel:
+    std::size_t n_systems = 1000;
+    Vector_double As(9*n_systems), Bs(6*n_systems);
+    for (std::size_t n_s=0; n_s<n_systems; ++n_s) {
+        for (int k=0; k<9; ++k) {
+            As[9*n_s+k] = (k%4 == 0 ? 4.0 : 0.0) + sin(n_s+3.0*k);
+        }
+        for (int k=0; k<6; ++k) {
+            Bs[6*n_s+k] = cos(n_s*0.1+k);
+        }
+    }
+    Vector_double As0(As), Bs0(Bs);
+    stfnum::batchLinsolv(3, 2, n_systems, As, Bs, 4);
+    for (std::size_t n_s=0; n_s<n_systems; ++n_s) {
+        for (int col=0; col<2; ++col) {
+            for (int row=0; row<3; ++row) {
+                double lhs = 0;
+                for (int k=0; k<3; ++k) {
+                    lhs += As0[9*n_s+3*k+row]*Bs[6*n_s+3*col+k];
+                }
+                EXPECT_NEAR(lhs, Bs0[6*n_s+3*col+row], 1e-9);
+            }
+        }
+    }
+
+    Vector_double singular(9, 1.0), rhs(3, 1.0);
+    EXPECT_THROW(stfnum::batchLinsolv(3, 1, 1, singular, rhs), std::runtime_error);
+    EXPECT_THROW(stfnum::batchLinsolv(3, 1, 2, singular, rhs), std::runtime_error);
+    EXPECT_THROW(stfnum::batchQuad(ch, sections, begin, adc.size()), std::out_of_range);
+    sections.push_back(ch.size());
+    EXPECT_THROW(stfnum::batchQuad(ch, sections, begin, end), std::out_of_range);
+}
+
+TEST(stfnum_test, table_columns) {
+    stfnum::Table table(2, 3);
+    table.at(0, 1) = 2.0;
+    table.at(1, 1) = 3.0;
+    table.SetEmpty(1, 2);
+    EXPECT_EQ(table.GetColumn(1)[0], 2.0);
+    EXPECT_EQ(table.GetColumn(1)[1], 3.0);
+    EXPECT_TRUE(table.GetEmptyColumn(2)[1]);
+    EXPECT_FALSE(table.GetEmptyColumn(2)[0]);
+
+    // appending rows one at a time keeps the old cells and grows each column:
+    for (std::size_t n = 0; n < 10000; ++n) {
+        table.AppendRows(1);
+        table.at(table.nRows()-1, 0) = (double)n;
+    }
+    ASSERT_EQ(table.nRows(), 10002u);
+    EXPECT_EQ(table.GetColumn(0).size(), table.nRows());
+    EXPECT_EQ(table.GetEmptyColumn(2).size(), table.nRows());
+    EXPECT_EQ(table.at(1, 1), 3.0);
+    EXPECT_TRUE(table.IsEmpty(1, 2));
+    EXPECT_FALSE(table.IsEmpty(5000, 2));
+    EXPECT_EQ(table.at(10001, 0), 9999.0);
+    const double* column = &table.GetColumn(0)[0];
+    EXPECT_EQ(column[2], 0.0);
+
+    std::map<std::string, double> map;
+    map["a"] = 1.0;
+    map["b"] = 2.0;
+    stfnum::Table fromMap(map);
+    EXPECT_EQ(fromMap.nCols(), 1u);
+    EXPECT_EQ(fromMap.GetRowLabel(1), "b");
+    EXPECT_EQ(fromMap.at(1, 0), 2.0);
+
+    EXPECT_THROW(table.at(0, 3), std::out_of_range);
+    EXPECT_THROW(table.at(10002, 0), std::out_of_range);
+    EXPECT_THROW(table.GetColumn(3), std::out_of_range);
+}
+
+TEST(stfnum_test, atomic_progress) {
+    stfio::AtomicProgressInfo progDlg("", "", 1000);
+    int value = -1;
+    std::string msg("unchanged");
+    EXPECT_FALSE( progDlg.Poll(value, msg) );
+    EXPECT_EQ( value, 0 );
+    EXPECT_EQ( msg, "unchanged" );
+
+    // parallel workers share the progress meter:
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(4)
+#endif
+    for (int n = 0; n < 1000; ++n) {
+        progDlg.Step();
+    }
+    EXPECT_TRUE( progDlg.Poll(value, msg) );
+    EXPECT_EQ( value, 1000 );
+    EXPECT_FALSE( progDlg.Poll(value, msg) );
+
+    // messages are only stored when the value changes:
+    EXPECT_TRUE( progDlg.Update(10, "ten") );
+    EXPECT_TRUE( progDlg.Update(10, "still ten") );
+    EXPECT_TRUE( progDlg.Poll(value, msg) );
+    EXPECT_EQ( value, 10 );
+    EXPECT_EQ( msg, "ten" );
+
+    progDlg.Cancel();
+    bool skip = false;
+    EXPECT_FALSE( progDlg.Update(20, "", &skip) );
+    EXPECT_TRUE( skip );
+    EXPECT_FALSE( progDlg.Step() );
+}
+
+namespace {
+
+// Records the progress and the number of updates; not thread-safe:
+class CountingProgressInfo : public stfio::ProgressInfo {
+public:
+    CountingProgressInfo(int cancelAt_) : stfio::ProgressInfo("", "", 100, false),
+                                          value(-1), updates(0), cancelAt(cancelAt_) {}
+    bool Update(int value_, const std::string& newmsg="", bool* skip=NULL) {
+        value = value_;
+        msg = newmsg;
+        ++updates;
+        return value < cancelAt;
+    }
+    int value, updates, cancelAt;
+    std::string msg;
+};
+
+}
+
+TEST(stfnum_test, parallel_progress) {
+    CountingProgressInfo progDlg(1000);
+    {
+        stfio::ParallelProgress progress(progDlg, 10000, "decoding", 20, 60);
+        EXPECT_EQ( progDlg.value, 20 );
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(4)
+#endif
+        for (int n = 0; n < 10000; ++n) {
+            progress.Step();
+        }
+        // the creating thread forwards the final value:
+        progress.Step(0);
+        EXPECT_FALSE( progress.IsCancelled() );
+    }
+    EXPECT_EQ( progDlg.value, 60 );
+    EXPECT_EQ( progDlg.msg, "decoding" );
+    // only changes of the displayed value are forwarded:
+    EXPECT_LE( progDlg.updates, 42 );
+
+    // a cancellation reaches all threads:
+    CountingProgressInfo cancelDlg(50);
+    stfio::ParallelProgress cancelled(cancelDlg, 100, "");
+    bool stopped = false;
+    for (int n = 0; n < 100 && !stopped; ++n) {
+        stopped = !cancelled.Step();
+    }
+    EXPECT_TRUE( stopped );
+    EXPECT_TRUE( cancelled.IsCancelled() );
+    EXPECT_EQ( cancelDlg.value, 50 );
+}
+
+TEST(stfnum_test, diff_and_integrate) {
+    Vector_double data(noisy_data(1001));
+    const double dt = 0.05;
+
+    // the buffer variant gives the same results, also in place:
+    Vector_double reference(data.size()-1);
+    for (std::size_t n = 0; n < reference.size(); ++n) {
+        reference[n] = (data[n+1]-data[n])/dt;
+    }
+    EXPECT_TRUE( stfnum::diff(data, dt) == reference );
+    Vector_double inplace(data);
+    stfnum::diff(&inplace[0], inplace.size(), dt, &inplace[0]);
+    inplace.pop_back();
+    EXPECT_TRUE( inplace == reference );
+    EXPECT_TRUE( stfnum::diff(Vector_double(1, 1.0), dt).empty() );
+
+    Channel ch(4);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        Section sec(noisy_data(500+100*n_s));
+        sec.SetXScale(dt);
+        sec.SetSectionDescription("sweep");
+        ch.InsertSection(sec, n_s);
+    }
+    std::vector<std::size_t> sections(1, 3);
+    sections.push_back(1);
+    Channel differentiated(stfnum::batchDiff(ch, sections, dt, 2));
+    ASSERT_EQ(differentiated.size(), 2);
+    for (std::size_t n = 0; n < sections.size(); ++n) {
+        EXPECT_TRUE( differentiated[n].get() == stfnum::diff(ch[sections[n]].get(), dt) );
+        EXPECT_EQ( differentiated[n].GetXScale(), dt );
+        EXPECT_EQ( differentiated[n].GetSectionDescription(), "sweep, differentiated" );
+    }
+    sections.push_back(4);
+    EXPECT_THROW( stfnum::batchDiff(ch, sections, dt), std::out_of_range );
+
+    // the integrals match the textbook sums for even and odd intervals:
+    for (std::size_t i2 = 990; i2 <= 991; ++i2) {
+        double trapezium = 0.0;
+        for (std::size_t n = 10; n < i2; ++n) {
+            trapezium += (data[n]+data[n+1])/2.0*dt;
+        }
+        EXPECT_NEAR( stfnum::integrate_trapezium(data, 10, i2, dt), trapezium, 1e-9 );
+
+        std::size_t even_end = ((i2-10)%2 == 0) ? i2 : i2-1;
+        double simpson = 0.0;
+        for (std::size_t n = 10; n < even_end; n += 2) {
+            simpson += (data[n] + 4*data[n+1] + data[n+2])*dt/3.0;
+        }
+        if (even_end != i2) {
+            simpson += (data[i2-1]+data[i2])/2.0*dt;
+        }
+        EXPECT_NEAR( stfnum::integrate_simpson(data, 10, i2, dt), simpson, 1e-9 );
+    }
+}
+
+TEST(stfnum_test, cubic_spline) {
+    // quadratics are interpolated exactly:
+    std::vector<double> y(50);
+    for (std::size_t k = 0; k < y.size(); ++k) {
+        y[k] = 0.5*k*k - 3.0*k + 1.0;
+    }
+    std::vector<double> y_i = stfnum::cubicSpline(y, 1.0, 4.0);
+    ASSERT_EQ(y_i.size(), 200u);
+    for (std::size_t k = 0; k < y_i.size(); ++k) {
+        double x = k/4.0;
+        EXPECT_NEAR(y_i[k], 0.5*x*x - 3.0*x + 1.0, 1e-9);
+    }
+    // non-integer factors take the general path:
+    std::vector<float> yf(y.begin(), y.end());
+    std::vector<float> yf_i = stfnum::cubicSpline(yf, 2.0f, 5.0f);
+    ASSERT_EQ(yf_i.size(), 125u);
+    EXPECT_NEAR(yf_i[7], 0.5*2.8*2.8 - 3.0*2.8 + 1.0, 1e-4);
+
+    // the spline passes through the data of a sine:
+    for (std::size_t k = 0; k < y.size(); ++k) {
+        y[k] = sin(0.3*k);
+    }
+    stfnum::SplinePlan plan(y.size());
+    Vector_double ypp(y.size()), out(3*y.size());
+    plan.Solve(&y[0], &ypp[0]);
+    plan.Evaluate(&y[0], &ypp[0], 0.0, 1.0/3.0, out.size(), &out[0]);
+    for (std::size_t k = 0; k < y.size(); ++k) {
+        EXPECT_NEAR(out[3*k], y[k], 1e-12);
+    }
+    EXPECT_NEAR(out[3*20+1], sin(0.3*(20+1.0/3.0)), 1e-3);
+    // ypp approximates the second derivative away from the ends:
+    EXPECT_NEAR(ypp[25], -0.09*sin(0.3*25), 1e-3);
+    Vector_double general(out.size());
+    plan.Evaluate(&y[0], &ypp[0], 1e-300, 1.0/3.0, general.size(), &general[0]);
+    for (std::size_t k = 0; k < out.size(); ++k) {
+        EXPECT_NEAR(general[k], out[k], 1e-12);
+    }
+}
+
+TEST(stfnum_test, batch_upsample) {
+    Channel ch(3);
+    for (std::size_t n_s = 0; n_s < 3; ++n_s) {
+        Vector_double data(100 + 50*(n_s%2));
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            data[k] = cos(0.1*k*(n_s+1));
+        }
+        Section sec(data, "trace");
+        sec.SetXScale(0.1);
+        ch.InsertSection(sec, n_s);
+    }
+    std::vector<std::size_t> sections;
+    sections.push_back(2);
+    sections.push_back(1);
+    sections.push_back(0);
+    Channel upsampled = stfnum::batchUpsample(ch, sections, 4.0);
+    ASSERT_EQ(upsampled.size(), 3u);
+    EXPECT_EQ(upsampled[1].size(), 600u);
+    EXPECT_NEAR(upsampled[0].GetXScale(), 0.025, 1e-12);
+    EXPECT_EQ(upsampled[2].GetSectionDescription(), "trace, upsampled");
+    for (std::size_t n = 0; n < 3; ++n) {
+        std::vector<double> expected = stfnum::cubicSpline(ch[sections[n]].get(), 1.0, 4.0);
+        ASSERT_EQ(upsampled[n].size(), expected.size());
+        for (std::size_t k = 0; k < expected.size(); ++k) {
+            ASSERT_EQ(upsampled[n][k], expected[k]);
+        }
+    }
+    sections.push_back(3);
+    EXPECT_THROW(stfnum::batchUpsample(ch, sections, 4.0), std::out_of_range);
+    EXPECT_THROW(stfnum::batchUpsample(ch, std::vector<std::size_t>(), 0.0), std::out_of_range);
+}
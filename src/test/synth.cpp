@@ -0,0 +1,129 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/synth.h"
+#include "../libstfnum/events.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+stfio::SynthSettings small_settings() {
+    stfio::SynthSettings settings;
+    settings.n_channels = 2;
+    settings.n_sections = 6;
+    settings.n_points = 20000;
+    settings.seed = 42;
+    return settings;
+}
+
+}
+
+TEST(synth_test, reproducible) {
+    stfio::SynthSettings settings = small_settings();
+    Recording serial = stfio::synthRecording(settings, NULL, 1);
+    Recording parallel = stfio::synthRecording(settings, NULL, 4);
+    ASSERT_EQ( serial.size(), settings.n_channels );
+    for (std::size_t n_c = 0; n_c < serial.size(); ++n_c) {
+        ASSERT_EQ( serial[n_c].size(), settings.n_sections );
+        for (std::size_t n_s = 0; n_s < serial[n_c].size(); ++n_s) {
+            ASSERT_EQ( serial[n_c][n_s].size(), settings.n_points );
+            EXPECT_TRUE( serial[n_c][n_s].get() == parallel[n_c][n_s].get() );
+            EXPECT_TRUE( serial[n_c][n_s].get() == stfio::synthSection(settings, n_c, n_s).get() );
+        }
+    }
+    // noise differs between channels and sections:
+    EXPECT_FALSE( serial[0][0].get() == serial[1][0].get() );
+    EXPECT_FALSE( serial[0][0].get() == serial[0][1].get() );
+
+    settings.seed = 43;
+    EXPECT_FALSE( serial[0][0].get() == stfio::synthSection(settings, 0, 0).get() );
+
+    EXPECT_THROW( stfio::synthSection(settings, 2, 0), std::out_of_range );
+    EXPECT_THROW( stfio::synthSection(settings, 0, 6), std::out_of_range );
+}
+
+TEST(synth_test, kinetics) {
+    stfio::SynthSettings settings = small_settings();
+    settings.noise = 0;
+    settings.baseline = -10.0;
+    // longer than an event:
+    settings.minInterval = 40.0;
+
+    Vector_double event = stfio::synthEvent(settings);
+    ASSERT_FALSE( event.empty() );
+    std::size_t peak = std::min_element(event.begin(), event.end()) - event.begin();
+    double tPeak = settings.tauRise*settings.tauDecay / (settings.tauDecay-settings.tauRise) *
+        log(settings.tauDecay/settings.tauRise);
+    EXPECT_NEAR( peak*settings.dt, tPeak, settings.dt );
+    EXPECT_NEAR( event[peak], settings.amplitude, 1e-3*fabs(settings.amplitude) );
+    EXPECT_LT( fabs(event.back()), 2e-3*fabs(settings.amplitude) );
+
+    std::vector< std::vector<std::size_t> > onsets;
+    Recording rec = stfio::synthRecording(settings, &onsets);
+    ASSERT_EQ( onsets.size(), settings.n_sections );
+    std::size_t minDistance = (std::size_t)(settings.minInterval/settings.dt);
+    for (std::size_t n_s = 0; n_s < onsets.size(); ++n_s) {
+        ASSERT_FALSE( onsets[n_s].empty() );
+        for (std::size_t n_e = 0; n_e < onsets[n_s].size(); ++n_e) {
+            std::size_t onset = onsets[n_s][n_e];
+            ASSERT_LE( onset + event.size(), settings.n_points );
+            if (n_e > 0) {
+                EXPECT_GE( onset - onsets[n_s][n_e-1], minDistance );
+            }
+            // events don't overlap, so the peak equals the amplitude on both channels:
+            EXPECT_NEAR( rec[0][n_s][onset+peak], settings.baseline + event[peak], 1e-9 );
+            EXPECT_DOUBLE_EQ( rec[1][n_s][onset+peak], rec[0][n_s][onset+peak] );
+        }
+    }
+
+    settings.event = stfio::synth_ap;
+    settings.amplitude = 100.0;
+    settings.tauRise = 0.1;
+    settings.tauDecay = 0.3;
+    event = stfio::synthEvent(settings);
+    peak = std::max_element(event.begin(), event.end()) - event.begin();
+    EXPECT_EQ( peak, (std::size_t)(3*settings.tauRise/settings.dt + 0.5) );
+    EXPECT_NEAR( event[peak], settings.amplitude, 1e-9 );
+
+    settings.tauRise = settings.tauDecay;
+    settings.event = stfio::synth_epsc;
+    EXPECT_THROW( stfio::synthEvent(settings), std::out_of_range );
+}
+
+TEST(synth_test, detection_recall) {
+    stfio::SynthSettings settings = small_settings();
+    settings.n_channels = 1;
+    settings.n_points = 10000;
+    settings.noise = 2.0;
+    settings.minInterval = 40.0;
+    std::vector< std::vector<std::size_t> > onsets;
+    Recording rec = stfio::synthRecording(settings, &onsets);
+
+    stfnum::EventDetectionPlan plan;
+    plan.templ = stfio::synthEvent(settings);
+    for (std::size_t n = 0; n < plan.templ.size(); ++n) {
+        plan.templ[n] /= fabs(settings.amplitude);
+    }
+    plan.minDistance = (int)(settings.minInterval/settings.dt);
+    stftest::NullProgressInfo progDlg;
+    stfnum::EventTable events = plan.Detect(rec[0], progDlg, 0);
+
+    std::size_t n_true = 0, n_found = 0;
+    for (std::size_t n_s = 0; n_s < onsets.size(); ++n_s) {
+        for (std::size_t n_e = 0; n_e < onsets[n_s].size(); ++n_e) {
+            ++n_true;
+            for (std::size_t n_d = 0; n_d < events.size(); ++n_d) {
+                if (events.section[n_d] == n_s &&
+                    std::abs((long)events.index[n_d] - (long)onsets[n_s][n_e]) <= 20)
+                {
+                    ++n_found;
+                    break;
+                }
+            }
+        }
+    }
+    ASSERT_GT( n_true, 0u );
+    EXPECT_GE( (double)n_found / n_true, 0.95 );
+    EXPECT_LE( events.size(), n_true + n_true/20 );
+}
@@ -0,0 +1,168 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/tablestream.h"
+#include "hdf5.h"
+#include "hdf5_hl.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> columns() {
+    std::vector<std::string> cols;
+    cols.push_back("section");
+    cols.push_back("amplitude");
+    return cols;
+}
+
+// Rows of several threads; the label tells which row it is:
+void appendRows(stfio::TableStream& table, int n_rows) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(4)
+#endif
+    for (int n_r = 0; n_r < n_rows; ++n_r) {
+        std::ostringstream label;
+        label << "file " << n_r;
+        Vector_double row(2);
+        row[0] = n_r;
+        row[1] = (n_r % 10 == 0) ? NAN : 0.5*n_r;
+        table.Append(label.str(), row);
+    }
+}
+
+}
+
+TEST(TableStream_test, csv) {
+    const char* fName = "tablestream_test.csv";
+    const int n_rows = 1000;
+    {
+        stfio::TableStream table(fName, "file", columns(), 64);
+        EXPECT_THROW( table.Append("short", Vector_double(1)), std::runtime_error );
+        appendRows(table, n_rows);
+        EXPECT_EQ( table.GetRows(), (std::size_t)n_rows );
+        // flushed rows are on disk while the table is still open:
+        table.Flush();
+        std::ifstream partial(fName);
+        std::string line;
+        int n_lines = 0;
+        while (std::getline(partial, line)) {
+            ++n_lines;
+        }
+        EXPECT_EQ( n_lines, n_rows+1 );
+        table.Close();
+        EXPECT_THROW( table.Append("closed", Vector_double(2)), std::runtime_error );
+    }
+
+    std::ifstream in(fName);
+    std::string line;
+    ASSERT_TRUE( static_cast<bool>(std::getline(in, line)) );
+    EXPECT_EQ( line, "file,section,amplitude" );
+    std::vector<bool> found(n_rows, false);
+    while (std::getline(in, line)) {
+        int label = -1, section = -1;
+        ASSERT_EQ( sscanf(line.c_str(), "\"file %d\",%d,", &label, &section), 2 ) << line;
+        ASSERT_TRUE( label >= 0 && label < n_rows );
+        EXPECT_EQ( section, label );
+        EXPECT_FALSE( found[label] );
+        found[label] = true;
+        std::string amplitude = line.substr(line.find_last_of(',')+1);
+        if (label % 10 == 0) {
+            EXPECT_TRUE( amplitude.empty() );
+        } else {
+            EXPECT_DOUBLE_EQ( atof(amplitude.c_str()), 0.5*label );
+        }
+    }
+    for (int n_r = 0; n_r < n_rows; ++n_r) {
+        EXPECT_TRUE( found[n_r] );
+    }
+    std::remove(fName);
+}
+
+TEST(TableStream_test, read_csv) {
+    const char* fName = "tablestream_read_test.csv";
+    {
+        stfio::TableStream table(fName, "file", columns());
+        Vector_double row(2);
+        row[0] = 1;
+        row[1] = 0.1;
+        table.Append("a \"quoted\", name", row);
+        row[0] = 2;
+        row[1] = NAN;
+        table.Append("b", row);
+    }
+    std::string title;
+    std::vector<std::string> cols, labels;
+    Vector_double values;
+    stfio::readTableCSV(fName, title, cols, labels, values);
+    EXPECT_EQ( title, "file" );
+    EXPECT_TRUE( cols == columns() );
+    ASSERT_EQ( labels.size(), 2 );
+    EXPECT_EQ( labels[0], "a \"quoted\", name" );
+    EXPECT_EQ( labels[1], "b" );
+    ASSERT_EQ( values.size(), 4 );
+    EXPECT_EQ( values[1], 0.1 );
+    EXPECT_EQ( values[2], 2.0 );
+    EXPECT_TRUE( std::isnan(values[3]) );
+    std::remove(fName);
+
+    EXPECT_THROW( stfio::readTableCSV("tablestream_missing.csv", title, cols, labels, values),
+                  std::runtime_error );
+}
+
+TEST(TableStream_test, hdf5) {
+    const char* fName = "tablestream_test.h5";
+    const int n_rows = 300;
+    {
+        stfio::TableStream table(fName, "file", columns(), 64);
+        appendRows(table, n_rows);
+    }
+
+    hid_t file_id = H5Fopen(fName, H5F_ACC_RDONLY, H5P_DEFAULT);
+    ASSERT_GE( file_id, 0 );
+    hsize_t dims[2] = { 0, 0 };
+    H5T_class_t class_id;
+    size_t type_size;
+    ASSERT_GE( H5LTget_dataset_info(file_id, "/results", dims, &class_id, &type_size), 0 );
+    EXPECT_EQ( dims[0], (hsize_t)n_rows );
+    EXPECT_EQ( dims[1], (hsize_t)2 );
+    Vector_double values(n_rows*2);
+    ASSERT_GE( H5LTread_dataset_double(file_id, "/results", &values[0]), 0 );
+    char attr[64];
+    ASSERT_GE( H5LTget_attribute_string(file_id, "/results", "columns", attr), 0 );
+    EXPECT_EQ( std::string(attr), "section,amplitude" );
+    ASSERT_GE( H5LTget_attribute_string(file_id, "/labels", "title", attr), 0 );
+    EXPECT_EQ( std::string(attr), "file" );
+
+    // every label belongs to the values of its row:
+    hid_t dataset = H5Dopen2(file_id, "/labels", H5P_DEFAULT);
+    hid_t string_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(string_type, H5T_VARIABLE);
+    std::vector<char*> labels(n_rows);
+    ASSERT_GE( H5Dread(dataset, string_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &labels[0]), 0 );
+    std::vector<bool> found(n_rows, false);
+    for (int n_r = 0; n_r < n_rows; ++n_r) {
+        int label = -1;
+        ASSERT_EQ( sscanf(labels[n_r], "file %d", &label), 1 );
+        EXPECT_EQ( values[n_r*2], label );
+        if (label % 10 == 0) {
+            EXPECT_TRUE( std::isnan(values[n_r*2+1]) );
+        } else {
+            EXPECT_DOUBLE_EQ( values[n_r*2+1], 0.5*label );
+        }
+        found[label] = true;
+    }
+    for (int n_r = 0; n_r < n_rows; ++n_r) {
+        EXPECT_TRUE( found[n_r] );
+    }
+    hid_t space = H5Dget_space(dataset);
+    H5Dvlen_reclaim(string_type, space, H5P_DEFAULT, &labels[0]);
+    H5Sclose(space);
+    H5Tclose(string_type);
+    H5Dclose(dataset);
+    H5Fclose(file_id);
+    std::remove(fName);
+}
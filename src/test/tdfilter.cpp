@@ -0,0 +1,222 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/tdfilter.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+namespace {
+
+const double SR = 20.0;
+
+// Sines with a whole number of periods in the window, so that the
+// circular convolution of the FFT path has no edge effects:
+Vector_double periodic_data(std::size_t size) {
+    Vector_double data(size);
+    const double pi = 3.14159265358979323846;
+    for (std::size_t n=0; n<size; ++n) {
+        data[n] = 1.0*sin(2*pi*5*n/size) + 0.5*sin(2*pi*80*n/size+0.3)
+            + 0.3*cos(2*pi*170*n/size) + 0.2*sin(2*pi*330*n/size) + 3.0;
+    }
+    return data;
+}
+
+// The squared gain of a cascade, as a response for stfnum::filter():
+struct SquaredGain {
+    explicit SquaredGain(const stfnum::BiquadCascade& cascade_) : cascade(cascade_) {}
+    double operator()(double f, const Vector_double&) const {
+        return std::norm(cascade.Response(f, SR));
+    }
+    stfnum::BiquadCascade cascade;
+};
+
+// The real response of a symmetric FIR filter without its delay:
+struct FIRGain {
+    explicit FIRGain(const Vector_double& taps_) : taps(taps_) {}
+    double operator()(double f, const Vector_double&) const {
+        double c = (taps.size()-1)/2.0, gain = 0;
+        for (std::size_t k=0; k<taps.size(); ++k) {
+            gain += taps[k]*cos(2*3.14159265358979323846*f*(k-c)/SR);
+        }
+        return gain;
+    }
+    Vector_double taps;
+};
+
+}
+
+TEST(tdfilter_test, iir_design) {
+    for (int order=1; order<=10; ++order) {
+        for (int type=stfnum::iir_bessel; type<=stfnum::iir_butterworth; ++type) {
+            stfnum::BiquadCascade lp = stfnum::designIIR((stfnum::iir_type)type, order, 2.0, SR);
+            EXPECT_EQ(lp.GetSections().size(), (std::size_t)(order+1)/2);
+            EXPECT_NEAR(std::abs(lp.Response(0.0, SR)), 1.0, 1e-9);
+            EXPECT_NEAR(std::abs(lp.Response(2.0, SR)), sqrt(0.5), 1e-6) << "order " << order;
+            EXPECT_LT(std::abs(lp.Response(9.0, SR)), std::abs(lp.Response(4.0, SR)));
+
+            stfnum::BiquadCascade hp = stfnum::designIIR((stfnum::iir_type)type, order, 2.0, SR, true);
+            EXPECT_NEAR(std::abs(hp.Response(0.0, SR)), 0.0, 1e-9);
+            EXPECT_NEAR(std::abs(hp.Response(SR/2, SR)), 1.0, 1e-9);
+            EXPECT_NEAR(std::abs(hp.Response(2.0, SR)), sqrt(0.5), 1e-6) << "order " << order;
+
+            stfnum::BiquadCascade zp = stfnum::designIIR((stfnum::iir_type)type, order, 2.0, SR, false, true);
+            EXPECT_NEAR(std::norm(zp.Response(2.0, SR)), sqrt(0.5), 1e-6) << "order " << order;
+        }
+    }
+    EXPECT_THROW(stfnum::designIIR(stfnum::iir_bessel, 0, 2.0, SR), std::out_of_range);
+    EXPECT_THROW(stfnum::designIIR(stfnum::iir_bessel, 4, 10.0, SR), std::out_of_range);
+}
+
+TEST(tdfilter_test, iir_stream) {
+    Vector_double data = periodic_data(1000);
+    stfnum::BiquadCascade whole = stfnum::designIIR(stfnum::iir_butterworth, 5, 1.5, SR);
+    stfnum::BiquadCascade chunked(whole);
+    Vector_double expected = whole.Process(data);
+    Vector_double result;
+    for (std::size_t start=0; start<data.size(); start+=77) {
+        Vector_double chunk(data.begin()+start, data.begin()+std::min(start+77, data.size()));
+        Vector_double out = chunked.Process(chunk);
+        result.insert(result.end(), out.begin(), out.end());
+    }
+    ASSERT_EQ(result.size(), expected.size());
+    for (std::size_t n=0; n<result.size(); ++n) {
+        EXPECT_DOUBLE_EQ(result[n], expected[n]);
+    }
+
+    // a constant input doesn't cause a transient from the steady state:
+    stfnum::BiquadCascade steady = stfnum::designIIR(stfnum::iir_bessel, 4, 1.0, SR);
+    steady.SetSteadyState(-70.0);
+    Vector_double constant = steady.Process(Vector_double(100, -70.0));
+    for (std::size_t n=0; n<constant.size(); ++n) {
+        EXPECT_NEAR(constant[n], -70.0, 1e-9);
+    }
+}
+
+TEST(tdfilter_test, filtfilt_fft) {
+    // forward and backward filtering equals an FFT filter with the squared gain:
+    Vector_double data = periodic_data(1000);
+    for (int type=stfnum::iir_bessel; type<=stfnum::iir_butterworth; ++type) {
+        stfnum::BiquadCascade cascade = stfnum::designIIR((stfnum::iir_type)type, 4, 2.0, SR, false, true);
+        Vector_double td = stfnum::filtfilt(cascade, data);
+        Vector_double fft = stfnum::filter(data, 0, data.size()-1, Vector_double(0), (int)SR,
+                                           SquaredGain(cascade), false);
+        ASSERT_EQ(td.size(), data.size());
+        for (std::size_t n=200; n<800; ++n) {
+            EXPECT_NEAR(td[n], fft[n], 1e-3) << "type " << type << ", point " << n;
+        }
+    }
+}
+
+TEST(tdfilter_test, fir_fft) {
+    Vector_double taps = stfnum::designFIR(60, 2.0, SR);
+    ASSERT_EQ(taps.size(), 61);
+    double sum = 0;
+    for (std::size_t k=0; k<taps.size(); ++k) {
+        sum += taps[k];
+        EXPECT_DOUBLE_EQ(taps[k], taps[taps.size()-1-k]);
+    }
+    EXPECT_NEAR(sum, 1.0, 1e-12);
+    EXPECT_NEAR(FIRGain(taps)(2.0, Vector_double(0)), 0.5, 0.02);
+
+    Vector_double data = periodic_data(1000);
+    Vector_double td = stfnum::firFilter(taps, data, 1, 2);
+    Vector_double fft = stfnum::filter(data, 0, data.size()-1, Vector_double(0), (int)SR,
+                                       FIRGain(taps), false);
+    ASSERT_EQ(td.size(), data.size());
+    for (std::size_t n=taps.size(); n<data.size()-taps.size(); ++n) {
+        EXPECT_NEAR(td[n], fft[n], 1e-9) << "point " << n;
+    }
+
+    // decimation only skips output samples:
+    Vector_double decimated = stfnum::firFilter(taps, data, 7);
+    ASSERT_EQ(decimated.size(), (data.size()+6)/7);
+    for (std::size_t m=0; m<decimated.size(); ++m) {
+        EXPECT_DOUBLE_EQ(decimated[m], td[7*m]);
+    }
+    EXPECT_THROW(stfnum::firFilter(taps, data, 0), std::out_of_range);
+}
+
+TEST(tdfilter_test, fir_stream) {
+    Vector_double taps = stfnum::designFIR(31, 1.0, SR);
+    Vector_double data = periodic_data(1000);
+    Vector_double centred = stfnum::firFilter(taps, data);
+    for (std::size_t decimation=1; decimation<=4; decimation+=3) {
+        stfnum::FIRFilter fir(taps, decimation);
+        Vector_double result;
+        for (std::size_t start=0; start<data.size(); start+=53) {
+            Vector_double chunk(data.begin()+start, data.begin()+std::min(start+53, data.size()));
+            Vector_double out = fir.Process(chunk);
+            result.insert(result.end(), out.begin(), out.end());
+        }
+        ASSERT_EQ(result.size(), (data.size()+decimation-1)/decimation);
+        // the causal filter lags behind by its delay:
+        for (std::size_t m=0; m<result.size(); ++m) {
+            if (m*decimation >= fir.GetDelay()) {
+                EXPECT_NEAR(result[m], centred[m*decimation-fir.GetDelay()], 1e-12);
+            }
+        }
+    }
+}
+
+TEST(tdfilter_test, resample) {
+    const double pi = 3.14159265358979323846;
+    Vector_double data(2000);
+    for (std::size_t n=0; n<data.size(); ++n) {
+        data[n] = sin(2*pi*0.2*n/SR) + 0.5*cos(2*pi*0.05*n/SR) + 1.0;
+    }
+    std::size_t factors[][2] = { {1, 10}, {3, 2}, {4, 1}, {2, 5} };
+    for (std::size_t f=0; f<4; ++f) {
+        std::size_t up = factors[f][0], down = factors[f][1];
+        Vector_double out = stfnum::resample(data, up, down, 10, 2);
+        ASSERT_EQ(out.size(), (data.size()*up+down-1)/down);
+        // slow components pass unchanged away from the edges:
+        for (std::size_t m=0; m<out.size(); ++m) {
+            double t = (double)m*down/up;
+            if (t < 200 || t > data.size()-200) continue;
+            double expected = sin(2*pi*0.2*t/SR) + 0.5*cos(2*pi*0.05*t/SR) + 1.0;
+            EXPECT_NEAR(out[m], expected, 1e-3) << up << "/" << down << ", point " << m;
+        }
+    }
+
+    // common factors cancel:
+    Vector_double reduced = stfnum::resample(data, 1, 10);
+    Vector_double unreduced = stfnum::resample(data, 2, 20);
+    ASSERT_EQ(reduced.size(), unreduced.size());
+    for (std::size_t m=0; m<reduced.size(); ++m) {
+        EXPECT_DOUBLE_EQ(reduced[m], unreduced[m]);
+    }
+
+    // components above the new Nyquist frequency don't alias:
+    Vector_double fast(data.size());
+    for (std::size_t n=0; n<fast.size(); ++n) {
+        fast[n] = sin(2*pi*7.0*n/SR);
+    }
+    Vector_double decimated = stfnum::resample(fast, 1, 10);
+    for (std::size_t m=20; m<decimated.size()-20; ++m) {
+        EXPECT_NEAR(decimated[m], 0.0, 1e-2) << "point " << m;
+    }
+
+    EXPECT_THROW(stfnum::resample(data, 0, 10), std::out_of_range);
+    EXPECT_THROW(stfnum::resample(data, 1, 0), std::out_of_range);
+}
+
+TEST(tdfilter_test, batch_resample) {
+    Channel ch(3);
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        Section sec(periodic_data(1000+100*n_s));
+        sec.SetXScale(1.0/SR);
+        ch.InsertSection(sec, n_s);
+    }
+    ch.SetYUnits("pA");
+    stftest::NullProgressInfo progDlg;
+    Channel resampled = stfnum::batchResample(ch, 1, 4, progDlg, 2);
+    ASSERT_EQ(resampled.size(), ch.size());
+    EXPECT_EQ(resampled.GetYUnits(), "pA");
+    for (std::size_t n_s=0; n_s<ch.size(); ++n_s) {
+        EXPECT_EQ(resampled[n_s].size(), (ch[n_s].size()+3)/4);
+        EXPECT_DOUBLE_EQ(resampled[n_s].GetXScale(), 4.0/SR);
+        Vector_double single = stfnum::resample(ch[n_s].get(), 1, 4);
+        for (std::size_t m=0; m<single.size(); ++m) {
+            EXPECT_DOUBLE_EQ(resampled[n_s][m], single[m]);
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/tdms/tdmslib.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace {
+
+// Assembles TDMS segments; numbers are written in host (little-endian)
+// byte order unless big is set:
+class Writer {
+public:
+    explicit Writer(bool big_ = false) : big(big_), meta(), raw() {}
+
+    template <typename T>
+    static void put(std::string& dest, T value, bool big) {
+        char bytes[sizeof(T)];
+        memcpy(bytes, &value, sizeof(T));
+        if (big) {
+            std::reverse(bytes, bytes+sizeof(T));
+        }
+        dest.append(bytes, sizeof(T));
+    }
+    void putString(std::string& dest, const std::string& str) {
+        put<unsigned int>(dest, str.size(), big);
+        dest += str;
+    }
+
+    void Objects(unsigned int n) { put<unsigned int>(meta, n, big); }
+    // an object without raw data, with a single property:
+    void Object(const std::string& path, const std::string& prop = "", double value = 0) {
+        putString(meta, path);
+        put<unsigned int>(meta, 0xFFFFFFFF, big);
+        Properties(prop, value);
+    }
+    void Channel(const std::string& path, unsigned int type, unsigned long long n_values,
+                 const std::string& prop = "", double value = 0)
+    {
+        putString(meta, path);
+        put<unsigned int>(meta, 20, big);
+        put<unsigned int>(meta, type, big);
+        put<unsigned int>(meta, 1, big);
+        put<unsigned long long>(meta, n_values, big);
+        Properties(prop, value);
+    }
+    template <typename T>
+    void Raw(T value) { put<T>(raw, value, big); }
+
+    std::string Segment(unsigned int toc) {
+        std::string segment("TDSm");
+        put<unsigned int>(segment, toc | (big ? (1 << 6) : 0), false);
+        put<unsigned int>(segment, 4713, big);
+        put<unsigned long long>(segment, meta.size()+raw.size(), big);
+        put<unsigned long long>(segment, meta.size(), big);
+        segment += meta;
+        segment += raw;
+        meta.clear();
+        raw.clear();
+        return segment;
+    }
+
+private:
+    void Properties(const std::string& prop, double value) {
+        if (prop.empty()) {
+            put<unsigned int>(meta, 0, big);
+            return;
+        }
+        put<unsigned int>(meta, 1, big);
+        putString(meta, prop);
+        put<unsigned int>(meta, 10, big);
+        put<double>(meta, value, big);
+    }
+    bool big;
+    std::string meta, raw;
+};
+
+const unsigned int toc_meta = (1 << 1) | (1 << 2) | (1 << 3);
+const unsigned int toc_raw = 1 << 3;
+const unsigned int toc_interleaved = 1 << 5;
+
+void writeFile(const char* fName, const std::string& contents) {
+    std::ofstream file(fName, std::ios::binary);
+    file.write(contents.data(), contents.size());
+}
+
+}
+
+TEST(tdms_test, segments) {
+    const char* fName = "tdms_test.tdms";
+    Writer writer;
+    // first segment: a group of two channels and an ignored group
+    writer.Objects(5);
+    writer.Object("/", "Sampling Rate", 20000.0);
+    writer.Object("/'AI 0'");
+    writer.Channel("/'AI 0'/'Sweep 1'", 2, 4, "wf_increment", 5e-5);
+    writer.Channel("/'AI 0'/'Sweep 2'", 10, 4);
+    writer.Channel("/'Other'/'x'", 3, 1);
+    for (short n = 0; n < 4; ++n) writer.Raw<short>(n);
+    for (int n = 0; n < 4; ++n) writer.Raw<double>(10.5+n);
+    writer.Raw<int>(99);
+    std::string contents = writer.Segment(toc_meta);
+    // second segment: same objects, two chunks
+    for (int n_c = 0; n_c < 2; ++n_c) {
+        for (short n = 0; n < 4; ++n) writer.Raw<short>(100+4*n_c+n);
+        for (int n = 0; n < 4; ++n) writer.Raw<double>(-1.0*(4*n_c+n));
+        writer.Raw<int>(99);
+    }
+    contents += writer.Segment(toc_raw);
+    writeFile(fName, contents);
+
+    stftest::NullProgressInfo progDlg;
+    Recording rec;
+    stfio::importTDMSFile(fName, rec, progDlg);
+    ASSERT_EQ( rec.size(), 1 );
+    EXPECT_EQ( rec[0].GetChannelName(), "AI 0" );
+    ASSERT_EQ( rec[0].size(), 2 );
+    EXPECT_NEAR( rec.GetXScale(), 0.05, 1e-12 );
+    EXPECT_EQ( rec[0][0].GetSectionDescription(), "Sweep 1" );
+
+    // the samples stay in the file:
+    EXPECT_TRUE( rec[0][0].IsMapped() );
+    ASSERT_EQ( rec[0][0].size(), 12 );
+    ASSERT_EQ( rec[0][1].size(), 12 );
+    for (std::size_t n = 0; n < 12; ++n) {
+        EXPECT_EQ( rec[0][0][n], n < 4 ? n : 100+(n-4) );
+        EXPECT_EQ( rec[0][1][n], n < 4 ? 10.5+n : -1.0*(n-4) );
+    }
+    std::remove(fName);
+
+    // the generic importer knows TDMS files:
+    writeFile(fName, contents);
+    Recording generic;
+    stfio::importFile(fName, stfio::tdms, generic, stfio::txtImportSettings(), progDlg);
+    ASSERT_EQ( generic.size(), 1 );
+    EXPECT_EQ( generic[0][1].get(), rec[0][1].get() );
+    std::remove(fName);
+}
+
+TEST(tdms_test, interleaved_and_big_endian) {
+    const char* fName = "tdms_test.tdms";
+    Writer writer(true);
+    writer.Objects(4);
+    writer.Object("/", "Sampling Rate", 0.0);
+    writer.Channel("/'Time'/'t'", 10, 3);
+    writer.Channel("/'ao'/'a'", 9, 3);
+    writer.Channel("/'ao'/'b'", 2, 3);
+    for (int n = 0; n < 3; ++n) {
+        writer.Raw<double>(0.2*n);
+        writer.Raw<float>(1.5f*n);
+        writer.Raw<short>(-7*n);
+    }
+    writeFile(fName, writer.Segment(toc_meta | toc_interleaved));
+
+    stftest::NullProgressInfo progDlg;
+    Recording rec;
+    stfio::importTDMSFile(fName, rec, progDlg);
+    ASSERT_EQ( rec.size(), 1 );
+    ASSERT_EQ( rec[0].size(), 2 );
+    // the time channel takes precedence over the sampling rate:
+    EXPECT_NEAR( rec.GetXScale(), 0.2, 1e-12 );
+    ASSERT_EQ( rec[0][0].size(), 3 );
+    for (std::size_t n = 0; n < 3; ++n) {
+        EXPECT_EQ( rec[0][0][n], 1.5*n );
+        EXPECT_EQ( rec[0][1][n], -7.0*n );
+    }
+    std::remove(fName);
+
+    writeFile(fName, "TDSm");
+    Recording invalid;
+    EXPECT_NO_THROW( stfio::importTDMSFile(fName, invalid, progDlg) );
+    EXPECT_EQ( invalid.size(), 0 );
+    writeFile(fName, std::string("TDSx") + std::string(24, '\0'));
+    EXPECT_THROW( stfio::importTDMSFile(fName, invalid, progDlg), std::runtime_error );
+    std::remove(fName);
+}
@@ -0,0 +1,23 @@
+#ifndef _STF_TEST_TESTUTIL_H
+#define _STF_TEST_TESTUTIL_H
+
+#include <string>
+
+#include "../libstfio/stfio.h"
+
+namespace stftest {
+
+// Progress indicator that does nothing; asks to cancel once the progress
+// reaches cancelAt:
+class NullProgressInfo : public stfio::ProgressInfo {
+public:
+    explicit NullProgressInfo(int cancelAt_ = 101)
+        : stfio::ProgressInfo("", "", 100, false), cancelAt(cancelAt_) {}
+    bool Update(int value, const std::string& newmsg="", bool* skip=NULL) { return value < cancelAt; }
+private:
+    int cancelAt;
+};
+
+}
+
+#endif
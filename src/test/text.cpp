@@ -0,0 +1,300 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/ascii/asciilib.h"
+#include "../libstfio/atf/atflib.h"
+#include "../libstfio/textwriter.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+double parse(const std::string& str, bool& ok, std::size_t& used) {
+    const char* pos = str.c_str();
+    double value = 0;
+    ok = stfio::parseDouble(pos, str.c_str()+str.size(), value);
+    used = pos-str.c_str();
+    return value;
+}
+
+std::string format(double value, int precision) {
+    char text[stfio::numberTextSize];
+    return std::string(text, stfio::formatNumber(value, precision, text)-text);
+}
+
+}
+
+TEST(text_test, parseDouble) {
+    const char* numbers[] = {
+        "0", "-0", "1", "+1", "-1.5", ".5", "5.", "1e3", "1E-3", "-2.5e+10",
+        "0.1", "0.2", "0.3", "123456.789", "3.141592653589793", "2.2250738585072014e-308",
+        "1.7976931348623157e308", "4.9e-324", "12345678901234567890123", "0.000000000000000000000001",
+        "1e22", "1e23", "9007199254740993", "nan", "-inf", "1e400", "0x1p3"
+    };
+    for (std::size_t n = 0; n < sizeof(numbers)/sizeof(numbers[0]); ++n) {
+        std::string str(numbers[n]);
+        bool ok;
+        std::size_t used;
+        double value = parse(str, ok, used);
+        ASSERT_TRUE( ok ) << str;
+        EXPECT_EQ( used, str.size() ) << str;
+        double ref = strtod(str.c_str(), NULL);
+        if (ref != ref) {
+            EXPECT_TRUE( value != value ) << str;
+        } else {
+            EXPECT_EQ( value, ref ) << str;
+        }
+    }
+    // printed doubles have to be read back exactly:
+    for (int n = 0; n < 10000; ++n) {
+        double ref = sin(0.37*n) * pow(10.0, (n%41)-20);
+        char buf[64];
+        sprintf(buf, (n%2 == 0) ? "%.17g" : "%.6f", ref);
+        bool ok;
+        std::size_t used;
+        double value = parse(buf, ok, used);
+        ASSERT_TRUE( ok ) << buf;
+        EXPECT_EQ( value, strtod(buf, NULL) ) << buf;
+    }
+
+    // numbers end at a delimiter:
+    bool ok;
+    std::size_t used;
+    EXPECT_EQ( parse("2.5\t3", ok, used), 2.5 );
+    EXPECT_TRUE( ok );
+    EXPECT_EQ( used, 3 );
+    parse("2.5x", ok, used);
+    EXPECT_FALSE( ok );
+    EXPECT_EQ( used, 0 );
+    parse("-", ok, used);
+    EXPECT_FALSE( ok );
+    parse("1e", ok, used);
+    EXPECT_FALSE( ok );
+}
+
+TEST(text_test, parseTextColumns) {
+    std::string text;
+    for (int n = 0; n < 5000; ++n) {
+        char buf[128];
+        sprintf(buf, "%.17g\t%.17g, %.17g\t%d\r\n", 0.1*n, sin(0.01*n), -1e-3*n, n);
+        text += buf;
+        if (n%1000 == 0) {
+            text += "\t \r\n";
+        }
+    }
+    // The result mustn't depend on how the text is split up:
+    std::vector<Vector_double> ref(3);
+    stfio::parseTextColumns(text.c_str(), text.c_str()+text.size(), ref, 1);
+    ASSERT_EQ( ref[0].size(), 5000 );
+    for (int n = 0; n < 5000; n += 7) {
+        EXPECT_EQ( ref[1][n], sin(0.01*n) );
+        EXPECT_EQ( ref[2][n], -1e-3*n );
+    }
+    for (int nChunks = 0; nChunks < 20; nChunks += 3) {
+        std::vector<Vector_double> columns(3);
+        stfio::parseTextColumns(text.c_str(), text.c_str()+text.size(), columns, nChunks);
+        for (std::size_t n_c = 0; n_c < columns.size(); ++n_c) {
+            EXPECT_EQ( columns[n_c], ref[n_c] );
+        }
+    }
+
+    // Errors report the line of the text:
+    std::string bad("1 2\n3 4\n\n5\n");
+    std::vector<Vector_double> columns(2);
+    try {
+        stfio::parseTextColumns(bad.c_str(), bad.c_str()+bad.size(), columns, 2);
+        FAIL() << "Missing value wasn't detected";
+    }
+    catch (const std::runtime_error& e) {
+        EXPECT_NE( std::string(e.what()).find("line 4"), std::string::npos ) << e.what();
+    }
+}
+
+TEST(text_test, importATFFile) {
+    const char* fName = "text_test.atf";
+    Channel ch(3);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        Vector_double data(2000);
+        for (std::size_t k = 0; k < data.size(); ++k) {
+            data[k] = 100.0*n_s + cos(0.001*k);
+        }
+        ch[n_s] = Section(data);
+    }
+    Recording rec(ch);
+    rec.SetXScale(0.05);
+    rec.SetXUnits("ms");
+    rec[0].SetYUnits("pA");
+    ASSERT_TRUE( stfio::exportATFFile(fName, rec) );
+
+    stftest::NullProgressInfo progDlg;
+    Recording result;
+    stfio::importATFFile(fName, result, progDlg);
+    ASSERT_EQ( result.size(), 1 );
+    ASSERT_EQ( result[0].size(), ch.size() );
+    EXPECT_NEAR( result.GetXScale(), 0.05, 1e-9 );
+    EXPECT_EQ( result.GetXUnits(), "ms" );
+    EXPECT_EQ( result[0].GetYUnits(), "pA" );
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        ASSERT_EQ( result[0][n_s].size(), ch[n_s].size() );
+        // values are written with all the digits that they need:
+        for (std::size_t k = 0; k < ch[n_s].size(); k += 13) {
+            EXPECT_EQ( result[0][n_s][k], ch[n_s][k] );
+        }
+    }
+    std::remove(fName);
+}
+
+TEST(text_test, importASCIIFile) {
+    const char* fName = "text_test.txt";
+    std::FILE* fp = std::fopen(fName, "w");
+    ASSERT_TRUE( fp != NULL );
+    std::fprintf(fp, "time\tch1\tch2\n");
+    for (int n = 0; n < 100; ++n) {
+        std::fprintf(fp, "%g\t%g\t%g\n", 0.1*n, 1.0*n, -2.0*n);
+    }
+    std::fclose(fp);
+
+    stftest::NullProgressInfo progDlg;
+    stfio::txtImportSettings txtImport;
+    txtImport.ncolumns = 3;
+    Recording rec;
+    ASSERT_TRUE( stfio::importFile(fName, stfio::ascii, rec, txtImport, progDlg) );
+    ASSERT_EQ( rec.size(), 1 );
+    ASSERT_EQ( rec[0].size(), 2 );
+    EXPECT_NEAR( rec.GetXScale(), 0.1, 1e-12 );
+    EXPECT_EQ( rec[0][1][99], -198.0 );
+    EXPECT_EQ( rec.GetFileDescription(), "time\tch1\tch2\n" );
+
+    txtImport.toSection = false;
+    Recording channels;
+    stfio::importFile(fName, stfio::ascii, channels, txtImport, progDlg);
+    ASSERT_EQ( channels.size(), 2 );
+    EXPECT_EQ( channels[0][0][5], 5.0 );
+    std::remove(fName);
+}
+
+TEST(text_test, previewTextFile) {
+    std::string text("recorded 2008-01-23\ntime, ch1, ch2\n\n");
+    for (int n = 0; n < 500; ++n) {
+        char line[64];
+        sprintf(line, "%g, %g, %g\n", 0.05*n, sin(0.1*n), (double)n);
+        text += line;
+    }
+    stfio::TextPreview sniffed = stfio::sniffText(text.c_str(), text.c_str()+text.size(), 20);
+    EXPECT_EQ( sniffed.hLines, 3 );
+    EXPECT_EQ( sniffed.nColumns, 3 );
+    EXPECT_EQ( sniffed.delimiter, ',' );
+    EXPECT_TRUE( sniffed.firstIsTime );
+    EXPECT_NEAR( sniffed.sr, 20.0, 1e-9 );
+    EXPECT_TRUE( sniffed.truncated );
+    EXPECT_EQ( std::count(sniffed.text.begin(), sniffed.text.end(), '\n'), 20 );
+
+    // without time column, separated by tabs and with a short last row:
+    std::string values("1\t5\t0\n2\t3\t9\n-1\t4\n");
+    sniffed = stfio::sniffText(values.c_str(), values.c_str()+values.size());
+    EXPECT_EQ( sniffed.hLines, 0 );
+    EXPECT_EQ( sniffed.nColumns, 2 );
+    EXPECT_EQ( sniffed.delimiter, '\t' );
+    EXPECT_FALSE( sniffed.firstIsTime );
+    EXPECT_FALSE( sniffed.truncated );
+    EXPECT_EQ( sniffed.text, values );
+
+    // only the start of the file is read, and a partial line is dropped:
+    const char* fName = "preview_test.txt";
+    {
+        std::ofstream file(fName, std::ios::out | std::ios::binary);
+        file << text;
+    }
+    stfio::TextPreview preview = stfio::previewTextFile(fName, 100, 1000);
+    EXPECT_TRUE( preview.truncated );
+    EXPECT_LE( preview.text.size(), 1000 );
+    EXPECT_EQ( preview.text, text.substr(0, preview.text.size()) );
+    EXPECT_EQ( preview.text[preview.text.size()-1], '\n' );
+    EXPECT_EQ( preview.hLines, 3 );
+    preview = stfio::previewTextFile(fName, 1000, 1000000);
+    EXPECT_FALSE( preview.truncated );
+    EXPECT_EQ( preview.text, text );
+
+    // the guessed settings import the file:
+    stfio::txtImportSettings txtImport;
+    stfio::applyTextPreview(preview, txtImport);
+    EXPECT_EQ( txtImport.hLines, 3 );
+    EXPECT_EQ( txtImport.ncolumns, 3 );
+    stftest::NullProgressInfo progDlg;
+    Recording rec;
+    ASSERT_TRUE( stfio::importFile(fName, stfio::ascii, rec, txtImport, progDlg) );
+    ASSERT_EQ( rec[0].size(), 2 );
+    EXPECT_EQ( rec[0][1].size(), 500 );
+    EXPECT_EQ( rec[0][1][499], 499.0 );
+    std::remove(fName);
+
+    EXPECT_THROW( stfio::previewTextFile("no_such_file.txt"), std::runtime_error );
+}
+
+TEST(text_test, formatNumber) {
+    const double numbers[] = {
+        0.0, -0.0, 1.0, -1.5, 0.1, 0.3, 0.1+0.2, 1.0/3.0, 123456.789, 1e22, 1e23,
+        2.2250738585072014e-308, 4.9e-324, 1.7976931348623157e308, -3.141592653589793
+    };
+    for (std::size_t n = 0; n < sizeof(numbers)/sizeof(numbers[0]); ++n) {
+        char text[stfio::numberTextSize];
+        const char* end = stfio::formatNumber(numbers[n], 0, text);
+        ASSERT_LE( end-text, stfio::numberTextSize );
+        const char* pos = text;
+        double value = 0;
+        ASSERT_TRUE( stfio::parseDouble(pos, end, value) ) << format(numbers[n], 0);
+        EXPECT_EQ( value, numbers[n] ) << format(numbers[n], 0);
+        EXPECT_EQ( pos, end );
+    }
+    EXPECT_EQ( format(0.1, 0), "0.1" );
+    EXPECT_EQ( format(0.1+0.2, 12), "0.3" );
+    EXPECT_EQ( format(2.0, 12), "2" );
+}
+
+TEST(text_test, writeTextTable) {
+    const char* fName = "text_test_table.txt";
+    std::vector<Section> sections;
+    sections.push_back(Section(Vector_double(250000)));
+    sections.push_back(Section(Vector_double(1000)));
+    for (std::size_t n = 0; n < sections[0].size(); ++n) {
+        sections[0][n] = sin(0.01*n);
+    }
+    for (std::size_t n = 0; n < sections[1].size(); ++n) {
+        sections[1][n] = -0.1*n;
+    }
+    std::vector<stfio::TextColumn> columns;
+    columns.push_back(stfio::TextColumn(sections[0].size(), 0.05, 12));
+    columns.push_back(stfio::TextColumn(sections[0]));
+    columns.push_back(stfio::TextColumn(sections[1]));
+
+    // the text doesn't depend on the number of threads:
+    std::string texts[2];
+    for (int n_threads = 1; n_threads <= 4; n_threads += 3) {
+        stfio::writeTextTable(fName, "header\n", columns, "\t", "\n", -1.0, n_threads);
+        std::ifstream file(fName, std::ios::binary);
+        std::ostringstream text;
+        text << file.rdbuf();
+        texts[n_threads/4] = text.str();
+    }
+    std::remove(fName);
+    EXPECT_EQ( texts[0], texts[1] );
+    ASSERT_EQ( texts[0].compare(0, 7, "header\n"), 0 );
+
+    std::vector<Vector_double> parsed(3);
+    stfio::parseTextColumns(texts[0].c_str()+7, texts[0].c_str()+texts[0].size(), parsed);
+    ASSERT_EQ( parsed[0].size(), sections[0].size() );
+    EXPECT_EQ( parsed[0][3], 0.15 );
+    for (std::size_t n = 0; n < sections[0].size(); ++n) {
+        ASSERT_EQ( parsed[1][n], sections[0][n] );
+        // shorter columns are filled up:
+        ASSERT_EQ( parsed[2][n], n < sections[1].size() ? sections[1][n] : -1.0 );
+    }
+
+    EXPECT_THROW( stfio::writeTextTable("missing_dir/table.txt", "", columns), std::runtime_error );
+}
@@ -0,0 +1,121 @@
+#include "../libstfnum/stfnum.h"
+#include "../libstfnum/train.h"
+#include "../libstfio/recording.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+namespace {
+
+const double dt = 0.05;
+
+// Response to a pulse at t0, with a peak of 1:
+double response(double t, double t0) {
+    double t_rel = t - t0;
+    if (t_rel <= 0) {
+        return 0;
+    }
+    const double tau_rise = 10.0, tau_decay = 200.0;
+    double t_peak = log(tau_decay/tau_rise) * tau_rise*tau_decay / (tau_decay-tau_rise);
+    double norm = exp(-t_peak/tau_decay) - exp(-t_peak/tau_rise);
+    return (exp(-t_rel/tau_decay) - exp(-t_rel/tau_rise)) / norm;
+}
+
+// Trains of 3 pulses whose responses overlap:
+Section train(const double* amplitudes, double offset) {
+    Vector_double data(3000);
+    for (std::size_t n = 0; n < data.size(); ++n) {
+        data[n] = offset;
+        for (int n_p = 0; n_p < 3; ++n_p) {
+            data[n] += amplitudes[n_p]*response((double)n, 500.0 + 400.0*n_p);
+        }
+    }
+    return Section(data);
+}
+
+}
+
+TEST(train_test, overlapping_responses) {
+    const double amplitudes[3] = {2.0, 3.0, 1.5};
+    Section sec(train(amplitudes, -60.0));
+
+    stfnum::TrainPlan plan;
+    plan.n_pulses = 3;
+    plan.onset = 500;
+    plan.interval = 400;
+    plan.baseLength = 50;
+    plan.measurement.dir = stfnum::up;
+    EXPECT_EQ(plan.Windows(sec.size()).windows.size(), 3);
+    EXPECT_EQ(plan.Windows(sec.size()).Find("Pulse 3"), 2);
+
+    stfnum::TrainTable table = plan.Analyse(sec, dt, 1, 4);
+    ASSERT_EQ(table.size(), 3);
+    for (std::size_t n_p = 0; n_p < 3; ++n_p) {
+        EXPECT_EQ(table.channel[n_p], 1);
+        EXPECT_EQ(table.section[n_p], 4);
+        EXPECT_EQ(table.pulse[n_p], n_p);
+        EXPECT_DOUBLE_EQ(table.onset[n_p], 500.0 + 400.0*n_p);
+        // the decay of the previous responses is subtracted:
+        EXPECT_NEAR(table.amplitude[n_p], amplitudes[n_p], 0.02*amplitudes[n_p]);
+        EXPECT_NEAR(table.ratio[n_p], amplitudes[n_p]/amplitudes[0], 0.02);
+        EXPECT_GT(table.latency[n_p], 0);
+        EXPECT_LT(table.latency[n_p], 40);
+    }
+    EXPECT_DOUBLE_EQ(table.base[0], -60.0);
+
+    // measured from the baseline before the train, later pulses include the earlier responses:
+    plan.baselineMode = stfnum::train_baseline_first;
+    stfnum::TrainTable first = plan.Analyse(sec, dt);
+    EXPECT_GT(first.amplitude[1], amplitudes[1]*1.05);
+    EXPECT_DOUBLE_EQ(first.base[1], -60.0);
+    // measured from just before each pulse, the decay that continues until the peak is missed:
+    plan.baselineMode = stfnum::train_baseline_local;
+    stfnum::TrainTable local = plan.Analyse(sec, dt);
+    EXPECT_LT(local.amplitude[1], amplitudes[1]*0.98);
+
+    plan.onset = 20;
+    EXPECT_THROW(plan.Analyse(sec, dt), std::out_of_range);
+    plan.onset = 500;
+    plan.n_pulses = 8;
+    EXPECT_THROW(plan.Analyse(sec, dt), std::out_of_range);
+}
+
+TEST(train_test, recording) {
+    Recording rec(2, 4, 0);
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            double amplitudes[3] = {1.0 + n_s, 2.0 + n_s + n_c, 1.0};
+            rec[n_c].InsertSection(train(amplitudes, 0.0), n_s);
+        }
+    }
+    rec.SetXScale(dt);
+    stfnum::TrainPlan plan;
+    plan.n_pulses = 3;
+    plan.onset = 500;
+    plan.interval = 400;
+    plan.baseLength = 50;
+    plan.measurement.dir = stfnum::up;
+
+    std::vector<std::size_t> channels;
+    channels.push_back(1);
+    channels.push_back(0);
+    stfnum::TrainTable table = plan.Analyse(rec, channels, 3);
+    ASSERT_EQ(table.size(), 2*4*3);
+    // rows are sorted by channel in the given order, section and pulse:
+    for (std::size_t n = 0; n < table.size(); ++n) {
+        std::size_t n_c = (n < 12) ? 1 : 0;
+        std::size_t n_s = (n % 12) / 3;
+        EXPECT_EQ(table.channel[n], n_c);
+        EXPECT_EQ(table.section[n], n_s);
+        EXPECT_EQ(table.pulse[n], n % 3);
+        stfnum::TrainTable single = plan.Analyse(rec[n_c][n_s], dt, n_c, n_s);
+        EXPECT_EQ(table.amplitude[n], single.amplitude[n % 3]);
+    }
+    EXPECT_NEAR(table.ratio[1], 3.0, 0.05);
+
+    stfnum::Table results = table.ToTable(dt);
+    EXPECT_EQ(results.nRows(), table.size());
+    EXPECT_DOUBLE_EQ(results.at(4, 2), 2.0);
+
+    channels.push_back(2);
+    EXPECT_THROW(plan.Analyse(rec, channels), std::out_of_range);
+}
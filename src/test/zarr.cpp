@@ -0,0 +1,272 @@
+#include "../libstfio/stfio.h"
+#include "../libstfio/zarr/zarrlib.h"
+#include "../libstfio/mappedfile.h"
+#include "testutil.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// A store in memory that counts how often objects are read:
+class MemoryStore : public stfio::ChunkStore {
+public:
+    bool Get(const std::string& key, std::vector<unsigned char>& value) const {
+        bool found = false;
+#ifdef _OPENMP
+#pragma omp critical(zarr_test_store)
+#endif
+        {
+            ++gets[key];
+            std::map<std::string, std::vector<unsigned char> >::const_iterator it = objects.find(key);
+            if (it != objects.end()) {
+                value = it->second;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    void Put(const std::string& key, const std::vector<unsigned char>& value) {
+        objects[key] = value;
+    }
+
+    void PutText(const std::string& key, const std::string& text) {
+        Put(key, std::vector<unsigned char>(text.begin(), text.end()));
+    }
+
+    std::map<std::string, std::vector<unsigned char> > objects;
+    mutable std::map<std::string, int> gets;
+};
+
+std::map<std::string, stfio::ChunkStorePtr> memoryStores;
+
+// Opens "mem://" locations:
+stfio::ChunkStorePtr openMemoryStore(const std::string& location) {
+    stfio::ChunkStorePtr& store = memoryStores[location];
+    if (!store) {
+        store.reset(new MemoryStore);
+    }
+    return store;
+}
+
+MemoryStore& memoryStore(const std::string& location) {
+    return *static_cast<MemoryStore*>(openMemoryStore(location).get());
+}
+
+// Removes the files of a directory store that holds the same objects as a memory store:
+void removeStore(const std::string& root, const MemoryStore& keys) {
+    std::set<std::string> dirs;
+    std::map<std::string, std::vector<unsigned char> >::const_iterator it;
+    for (it = keys.objects.begin(); it != keys.objects.end(); ++it) {
+        std::remove((root + "/" + it->first).c_str());
+        if (it->first.find('/') != std::string::npos) {
+            dirs.insert(root + "/" + it->first.substr(0, it->first.find('/')));
+        }
+    }
+    dirs.insert(root);
+    for (std::set<std::string>::reverse_iterator dir = dirs.rbegin(); dir != dirs.rend(); ++dir) {
+#ifdef _WIN32
+        _rmdir(dir->c_str());
+#else
+        rmdir(dir->c_str());
+#endif
+    }
+}
+
+// A recording with two channels and sections of different lengths:
+Recording ragged_recording() {
+    std::deque<Channel> ch_list;
+    for (int n_c = 0; n_c < 2; ++n_c) {
+        std::deque<Section> sec_list;
+        for (int n_s = 0; n_s < 6; ++n_s) {
+            Vector_double data(1000 + 70000*(n_s%3));
+            for (std::size_t k = 0; k < data.size(); ++k) {
+                data[k] = 10.0*n_c + sin(0.001*k*(n_s+1));
+            }
+            sec_list.push_back(Section(data));
+        }
+        Channel ch(sec_list);
+        ch.SetChannelName(n_c == 0 ? "Vm" : "Im");
+        ch.SetYUnits(n_c == 0 ? "mV" : "pA");
+        ch_list.push_back(ch);
+    }
+    Recording rec(ch_list);
+    rec.SetXScale(0.05);
+    rec.SetFileDescription("zarr test");
+    rec.SetComment("a \"quoted\"\ncomment");
+    rec.SetDateTime(120, 4, 17, 13, 4, 55);
+    return rec;
+}
+
+void expect_equal(const Recording& imported, const Recording& rec, double tolerance) {
+    ASSERT_EQ( imported.size(), rec.size() );
+    EXPECT_NEAR( imported.GetXScale(), rec.GetXScale(), 1e-12 );
+    for (std::size_t n_c = 0; n_c < rec.size(); ++n_c) {
+        EXPECT_EQ( imported[n_c].GetChannelName(), rec[n_c].GetChannelName() );
+        EXPECT_EQ( imported[n_c].GetYUnits(), rec[n_c].GetYUnits() );
+        ASSERT_EQ( imported[n_c].size(), rec[n_c].size() );
+        for (std::size_t n_s = 0; n_s < rec[n_c].size(); ++n_s) {
+            ASSERT_EQ( imported[n_c][n_s].size(), rec[n_c][n_s].size() );
+            for (std::size_t k = 0; k < rec[n_c][n_s].size(); ++k) {
+                ASSERT_NEAR( imported[n_c][n_s][k], rec[n_c][n_s][k], tolerance );
+            }
+        }
+    }
+}
+
+}
+
+TEST(Zarr_test, roundtrip) {
+    const char* fName = "zarr_test.zarr";
+    stftest::NullProgressInfo progDlg;
+    Recording rec = ragged_recording();
+    ASSERT_TRUE( stfio::exportZarrFile(fName, rec, progDlg) );
+
+    Recording imported;
+    stfio::importZarrFile(std::string(fName) + "/.zgroup", imported, progDlg);
+    // the samples are fetched when they're first needed:
+    EXPECT_TRUE( imported[0][1].IsMapped() );
+    expect_equal(imported, rec, 1e-6);
+    EXPECT_EQ( imported.GetFileDescription(), "zarr test" );
+    EXPECT_EQ( imported.GetComment(), rec.GetComment() );
+    EXPECT_EQ( imported.GetDateTime().tm_year, 120 );
+    EXPECT_EQ( imported.GetDateTime().tm_min, 4 );
+
+    // a store can replace the one that it has been read from:
+    ASSERT_TRUE( stfio::exportZarrFile(fName, imported, progDlg) );
+    Recording again;
+    stfio::importZarrFile(fName, again, progDlg);
+    expect_equal(again, rec, 1e-6);
+
+    stfio::registerChunkStore("mem", openMemoryStore);
+    stfio::exportZarrFile("mem://roundtrip", rec, progDlg);
+    removeStore(fName, memoryStore("mem://roundtrip"));
+    stfio::registerChunkStore("mem", NULL);
+}
+
+TEST(Zarr_test, lazy) {
+    stftest::NullProgressInfo progDlg;
+    Recording rec = ragged_recording();
+    stfio::registerChunkStore("mem", openMemoryStore);
+    stfio::exportZarrFile("mem://lazy", rec, progDlg);
+    MemoryStore& store = memoryStore("mem://lazy");
+    EXPECT_EQ( store.objects.count(".zgroup"), 1u );
+    EXPECT_EQ( store.objects.count("Im/.zarray"), 1u );
+    // 71000 samples in two chunks:
+    EXPECT_EQ( store.objects.count("Vm/1.1"), 1u );
+    EXPECT_EQ( store.objects.count("Vm/1.2"), 0u );
+
+    Recording imported;
+    stfio::importZarrFile("mem://lazy", imported, progDlg);
+    std::map<std::string, int>::const_iterator it;
+    for (it = store.gets.begin(); it != store.gets.end(); ++it) {
+        EXPECT_EQ( it->first.find('.'), it->first.find('/')+1 ) << it->first << " has been read";
+    }
+
+    // only the chunks of a section are fetched when it is read:
+    store.gets.clear();
+    EXPECT_NEAR( imported[1][4][70500], rec[1][4][70500], 1e-6 );
+    ASSERT_EQ( store.gets.size(), 2u );
+    EXPECT_EQ( store.gets["Im/4.0"], 1 );
+    EXPECT_EQ( store.gets["Im/4.1"], 1 );
+
+    stfio::registerChunkStore("mem", NULL);
+    memoryStores.clear();
+}
+
+TEST(Zarr_test, quantized) {
+    const double lsb = 20.0/65536.0;
+    stftest::NullProgressInfo progDlg;
+    Channel ch(3);
+    for (std::size_t n_s = 0; n_s < ch.size(); ++n_s) {
+        std::vector<short> samples(5000);
+        for (std::size_t k = 0; k < samples.size(); ++k) {
+            samples[k] = (short)(2000.0*sin(0.0005*k*(n_s+1)) + (k*7 % 9));
+        }
+        ch.InsertSection(Section(stfio::compactSamples(samples, lsb, 0.0)), n_s);
+    }
+    ch.SetChannelName("Im");
+    ch.SetYUnits("pA");
+    Recording rec(ch);
+    rec.SetXScale(0.1);
+    stfio::registerChunkStore("mem", openMemoryStore);
+    stfio::exportZarrFile("mem://quantized", rec, progDlg);
+    const std::vector<unsigned char>& zarray = memoryStore("mem://quantized").objects["Im/.zarray"];
+    EXPECT_NE( std::string(zarray.begin(), zarray.end()).find("\"<i2\""), std::string::npos );
+
+    Recording imported;
+    stfio::importZarrFile("mem://quantized", imported, progDlg);
+    expect_equal(imported, rec, 1e-9);
+    stfio::registerChunkStore("mem", NULL);
+    memoryStores.clear();
+}
+
+TEST(Zarr_test, foreign) {
+    // a 1-D array of doubles as written by other implementations, without compression:
+    stftest::NullProgressInfo progDlg;
+    stfio::registerChunkStore("mem", openMemoryStore);
+    MemoryStore& store = memoryStore("mem://foreign");
+    store.PutText(".zarray", "{\"zarr_format\": 2, \"shape\": [10], \"chunks\": [4], \"dtype\": \"<f8\", "
+                  "\"compressor\": null, \"fill_value\": -1.5, \"order\": \"C\", \"filters\": null}");
+    for (int n_k = 0; n_k < 2; ++n_k) {
+        std::vector<unsigned char> chunk(4*sizeof(double));
+        for (int n = 0; n < 4; ++n) {
+            double value = 4*n_k + n;
+            std::memcpy(&chunk[n*sizeof(double)], &value, sizeof(double));
+        }
+        store.Put(n_k == 0 ? "0" : "1", chunk);
+    }
+    Recording imported;
+    stfio::importZarrFile("mem://foreign", imported, progDlg);
+    ASSERT_EQ( imported.size(), 1u );
+    ASSERT_EQ( imported[0].size(), 1u );
+    ASSERT_EQ( imported[0][0].size(), 10u );
+    EXPECT_EQ( imported[0][0][5], 5.0 );
+    // the last chunk is missing:
+    EXPECT_EQ( imported[0][0][9], -1.5 );
+
+    EXPECT_THROW( stfio::openChunkStore("ftp://host/store.zarr"), std::runtime_error );
+    Recording none;
+    EXPECT_THROW( stfio::importZarrFile("mem://none", none, progDlg), std::runtime_error );
+    store.PutText(".zarray", "{\"zarr_format\": 2, \"shape\": [10], \"chunks\": [4], \"dtype\": \"<c16\"}");
+    EXPECT_THROW( stfio::importZarrFile("mem://foreign", none, progDlg), std::runtime_error );
+    store.PutText(".zarray", "{\"zarr_format\": 2, \"shape\": [10");
+    EXPECT_THROW( stfio::importZarrFile("mem://foreign", none, progDlg), std::runtime_error );
+    stfio::registerChunkStore("mem", NULL);
+    memoryStores.clear();
+}
+
+TEST(Zarr_test, cache) {
+    const char* cacheDir = "zarr_test_cache";
+    stfio::ChunkStorePtr remote(new MemoryStore);
+    MemoryStore& remoteStore = *static_cast<MemoryStore*>(remote.get());
+    remoteStore.PutText(".zattrs", "{}");
+    remoteStore.PutText("Im/0.0", "chunk");
+    stfio::CachedStore cached(remote, cacheDir);
+
+    std::vector<unsigned char> value;
+    for (int n = 0; n < 3; ++n) {
+        ASSERT_TRUE( cached.Get("Im/0.0", value) );
+        EXPECT_EQ( std::string(value.begin(), value.end()), "chunk" );
+        ASSERT_TRUE( cached.Get(".zattrs", value) );
+    }
+    EXPECT_FALSE( cached.Get("Im/0.1", value) );
+    // chunks are fetched once, metadata every time:
+    EXPECT_EQ( remoteStore.gets["Im/0.0"], 1 );
+    EXPECT_EQ( remoteStore.gets[".zattrs"], 3 );
+
+    // the copies stay valid after the remote store has gone:
+    stfio::CachedStore offline(stfio::ChunkStorePtr(new MemoryStore), cacheDir);
+    EXPECT_TRUE( offline.Get("Im/0.0", value) );
+    EXPECT_FALSE( offline.Get(".zattrs", value) );
+    removeStore(cacheDir, remoteStore);
+}